@@ -48,6 +48,16 @@ def get_working_set(filename):
     LOG.info("===============================================================================")
     return main_config['config_directory'], working_set['working_set']
 
+def get_submit_mode(filename):
+    '''
+    "serial" sends each mod as it is read, "pipelined" queues them all
+    and sends them with ofdpa.mods.ModPipeline
+    '''
+    main_config_file = open(filename)
+    main_config = json.load(main_config_file)
+    main_config_file.close()
+    return main_config.get('submit_mode', 'serial')
+
 def get_config(filename):
     config_file = open(filename)
     config = json.load(config_file)
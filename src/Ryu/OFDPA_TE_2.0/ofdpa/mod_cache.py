@@ -0,0 +1,74 @@
+#*********************************************************************
+#
+# (C) Copyright Broadcom Corporation 2016
+#
+#  Licensed under the Apache License, Version 2.0 (the 'License');
+#  you may not use this file except in compliance with the License.
+#  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software
+#  distributed under the License is distributed on an 'AS IS' BASIS,
+#  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#  See the License for the specific language governing permissions and
+#  limitations under the License.
+#
+#*********************************************************************
+
+import logging
+import os
+import pickle
+
+LOG = logging.getLogger('ofdpa')
+
+'''
+Cache of compiled mods, one per config file
+
+An entry is reused while the file's mtime and size are unchanged, so a
+reconnecting datapath gets the stored bytes without the JSON being
+parsed again. The cache is kept in a file so it also survives a
+controller restart; a missing or unreadable file just starts it empty.
+'''
+
+class ModCache(object):
+
+    def __init__(self, filename):
+        self.filename = filename
+        self.entries = {}
+        self.dirty = False
+        try:
+            cache_file = open(filename, 'rb')
+            self.entries = pickle.load(cache_file)
+            cache_file.close()
+            LOG.info('mod cache %s: %i entries', filename, len(self.entries))
+        except Exception as e:
+            LOG.debug('mod cache %s not loaded: %s', filename, e)
+
+    def get(self, config_filename, dp):
+        entry = self.entries.get((config_filename, dp.ofproto.OFP_VERSION))
+        if entry is None:
+            return None
+        stamp, mod = entry
+        if stamp != self._stamp(config_filename):
+            return None
+        return mod
+
+    def put(self, config_filename, dp, mod):
+        self.entries[(config_filename, dp.ofproto.OFP_VERSION)] = \
+            (self._stamp(config_filename), mod)
+        self.dirty = True
+
+    def save(self):
+        if not self.dirty:
+            return
+        tmp_filename = self.filename + '.tmp'
+        cache_file = open(tmp_filename, 'wb')
+        pickle.dump(self.entries, cache_file, pickle.HIGHEST_PROTOCOL)
+        cache_file.close()
+        os.rename(tmp_filename, self.filename)
+        self.dirty = False
+
+    def _stamp(self, config_filename):
+        st = os.stat(config_filename)
+        return (st.st_mtime, st.st_size)
@@ -17,6 +17,9 @@
 #*********************************************************************
 
 import logging
+import struct
+
+from ryu.lib import hub
 
 import ofdpa.flow_description as FlowDescription
 import ofdpa.matches as Matches
@@ -70,3 +73,176 @@ def create_group_mod(dp, config):
         )
     return mod
 
+'''
+A flow or group mod serialized once and sent as bytes
+
+Parsing the JSON config and building the Ryu objects is most of the
+cost of sending a mod, so the bytes are kept (see ofdpa.mod_cache) and
+replayed on reconnect. Serializing also validates the mod up front.
+A CompiledMod takes a new xid like a message object: dp.set_xid(mod),
+then dp.send(mod.buf).
+'''
+
+class CompiledMod(object):
+
+    def __init__(self, dp, mod):
+        ofp = dp.ofproto
+        self.version = ofp.OFP_VERSION
+        self.is_group = isinstance(mod, dp.ofproto_parser.OFPGroupMod)
+        self.command = mod.command
+        self.group_id = None
+        # Groups the buckets point to, for ModPipeline ordering
+        self.group_refs = set()
+        if self.is_group:
+            self.group_id = mod.group_id
+            self.group_refs = set(action.group_id
+                                  for bucket in mod.buckets
+                                  for action in bucket.actions
+                                  if action.type == ofp.OFPAT_GROUP)
+        mod.serialize()
+        self.buf = bytearray(mod.buf)
+        self.xid = None
+
+    def set_xid(self, xid):
+        self.xid = xid
+        struct.pack_into('!I', self.buf, 4, xid)
+
+def send_compiled(dp, mod):
+    dp.set_xid(mod)
+    dp.send(mod.buf)
+
+'''
+Pipelined submission of flow and group mods
+
+Mods are queued with ModPipeline.add and sent by ModPipeline.submit
+without waiting for each one. Group adds and modifies go first, ordered
+so a group is sent after the groups its buckets point to, then the flow
+mods, then the group deletes. A barrier follows every barrier_interval
+mods and each ordering step; at most window barriers are outstanding.
+
+Every mod gets an xid, so an error reply names the mod that caused it.
+The app passes error and barrier replies to error_reply and
+barrier_reply. submit blocks on barrier replies, so run it in its own
+greenthread rather than in an event handler.
+'''
+
+DEFAULT_BARRIER_INTERVAL = 256
+DEFAULT_WINDOW = 4
+BARRIER_TIMEOUT = 10
+
+class ModPipeline(object):
+
+    def __init__(self, dp, barrier_interval=DEFAULT_BARRIER_INTERVAL,
+                 window=DEFAULT_WINDOW):
+        self.dp = dp
+        self.barrier_interval = barrier_interval
+        self.window = window
+        self.mods = []
+        # xid -> name of mods sent and not yet covered by a barrier reply
+        self.pending = {}
+        # xids of the mods sent since the last barrier
+        self.unfenced = []
+        # (barrier xid, xids of the mods before it) of barriers sent and
+        # not yet replied, in the order sent
+        self.barriers = []
+        self.barrier_event = hub.Event()
+        self.errors = []
+
+    def add(self, mod, name):
+        if not isinstance(mod, CompiledMod):
+            mod = CompiledMod(self.dp, mod)
+        self.mods.append((mod, name))
+
+    def submit(self):
+        ofp = self.dp.ofproto
+        group_adds = []
+        flow_mods = []
+        group_deletes = []
+
+        for mod, name in self.mods:
+            if not mod.is_group:
+                flow_mods.append((mod, name))
+            elif mod.command == ofp.OFPGC_DELETE:
+                group_deletes.append((mod, name))
+            else:
+                group_adds.append((mod, name))
+
+        sent = 0
+        for step in self._group_order(group_adds) + [flow_mods, group_deletes]:
+            for mod, name in step:
+                self._send(mod, name)
+                sent += 1
+                if sent % self.barrier_interval == 0:
+                    self._barrier()
+            if step:
+                self._barrier()
+        self._wait(0)
+
+        LOG.info("%i mods sent, %i errors", sent, len(self.errors))
+        self.mods = []
+        return self.errors
+
+    def error_reply(self, msg):
+        name = self.pending.get(msg.xid)
+        LOG.error("error reply for %s: type 0x%x code 0x%x",
+                  name or "xid %i" % msg.xid, msg.type, msg.code)
+        self.errors.append((name, msg.type, msg.code))
+
+    def barrier_reply(self, msg):
+        if msg.xid not in [xid for xid, covered in self.barriers]:
+            return
+        # The switch handles messages in order, so everything sent
+        # before this barrier is done and its errors have arrived
+        while self.barriers:
+            xid, covered = self.barriers.pop(0)
+            for mod_xid in covered:
+                del self.pending[mod_xid]
+            if xid == msg.xid:
+                break
+        self.barrier_event.set()
+
+    def _group_order(self, group_adds):
+        '''
+        Split group adds into steps; every group a bucket of a step
+        points to is in an earlier step or already on the switch.
+        '''
+        remaining = list(group_adds)
+        ids = set(mod.group_id for mod, name in remaining)
+        steps = []
+
+        while remaining:
+            step = [(mod, name) for mod, name in remaining
+                    if not mod.group_refs & ids]
+            if not step:
+                LOG.warning("group dependency loop, sending remaining groups in config order")
+                step = remaining
+            steps.append(step)
+            remaining = [entry for entry in remaining if entry not in step]
+            ids -= set(mod.group_id for mod, name in step)
+        return steps
+
+    def _send(self, mod, name):
+        self.dp.set_xid(mod)
+        self.pending[mod.xid] = name
+        self.unfenced.append(mod.xid)
+        self.dp.send(mod.buf)
+        LOG.debug("sent %s, xid %i", name, mod.xid)
+
+    def _barrier(self):
+        if not self.unfenced:
+            return
+        self._wait(self.window - 1)
+        barrier = self.dp.ofproto_parser.OFPBarrierRequest(self.dp)
+        self.dp.set_xid(barrier)
+        self.barriers.append((barrier.xid, self.unfenced))
+        self.unfenced = []
+        self.dp.send_msg(barrier)
+
+    def _wait(self, outstanding):
+        while len(self.barriers) > outstanding:
+            self.barrier_event.clear()
+            if not self.barrier_event.wait(timeout=BARRIER_TIMEOUT):
+                LOG.error("no barrier reply in %i seconds, %i barriers outstanding",
+                          BARRIER_TIMEOUT, len(self.barriers))
+                self.barriers = []
+                self.pending = {}
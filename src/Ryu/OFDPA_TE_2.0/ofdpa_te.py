@@ -18,15 +18,18 @@
 #   This is a script intended
 #   to use by Ryu OpenFlow controller
 
-import sys
 import logging
 
 from ryu.base import app_manager
 from ryu.controller import dpset
+from ryu.controller import ofp_event
+from ryu.controller.handler import MAIN_DISPATCHER
 from ryu.controller.handler import set_ev_cls
+from ryu.lib import hub
 from ryu.ofproto import ofproto_v1_3
 
 import ofdpa.mods as Mods
+import ofdpa.mod_cache as ModCache
 import ofdpa.flow_description as FlowDescriptionReader
 
 ryu_loggers = logging.Logger.manager.loggerDict
@@ -59,9 +62,12 @@ class OfdpaTe2(app_manager.RyuApp):
     OFP_VERSIONS = [ofproto_v1_3.OFP_VERSION]
 
     CONFIG_FILE = 'conf/ofdpa_te.json'
+    CACHE_FILE = 'ofdpa_te.cache'
 
     def __init__(self, *args, **kwargs):
         super(OfdpaTe2, self).__init__(*args, **kwargs)
+        self.pipelines = {}
+        self.mod_cache = ModCache.ModCache(self.CACHE_FILE)
 
     @set_ev_cls(dpset.EventDP, dpset.DPSET_EV_DISPATCHER)
     def handler_datapath(self, ev):
@@ -71,10 +77,30 @@ class OfdpaTe2(app_manager.RyuApp):
         LOG.info("Datapath Id: %i - 0x%x", ev.dp.id, ev.dp.id)
         LOG.info("===============================================================================")        
         if ev.enter:
-            self.build_packets(ev.dp)
+            if FlowDescriptionReader.get_submit_mode(self.CONFIG_FILE) == 'pipelined':
+                # Waits for barrier replies, which this handler's
+                # event loop delivers
+                hub.spawn(self.build_packets, ev.dp)
+            else:
+                self.build_packets(ev.dp)
+
+    @set_ev_cls(ofp_event.EventOFPErrorMsg, MAIN_DISPATCHER)
+    def handler_error(self, ev):
+        pipeline = self.pipelines.get(ev.msg.datapath.id)
+        if pipeline:
+            pipeline.error_reply(ev.msg)
+
+    @set_ev_cls(ofp_event.EventOFPBarrierReply, MAIN_DISPATCHER)
+    def handler_barrier_reply(self, ev):
+        pipeline = self.pipelines.get(ev.msg.datapath.id)
+        if pipeline:
+            pipeline.barrier_reply(ev.msg)
 
     def build_packets(self, dp):
         config_dir, working_set = FlowDescriptionReader.get_working_set(self.CONFIG_FILE)
+        pipeline = None
+        if FlowDescriptionReader.get_submit_mode(self.CONFIG_FILE) == 'pipelined':
+            pipeline = Mods.ModPipeline(dp)
         
         for filename in working_set:
             if filename[0] == '#':
@@ -83,28 +109,48 @@ class OfdpaTe2(app_manager.RyuApp):
             full_filename = config_dir + '/' + filename
             LOG.info("processing file: %s",  full_filename)
 
-            config = FlowDescriptionReader.get_config(full_filename)
+            mod = self.mod_cache.get(full_filename, dp)
+            if mod is None:
+                mod = self.compile_file(dp, full_filename)
+                self.mod_cache.put(full_filename, dp, mod)
+            else:
+                LOG.info("cached")
 
-            for config_type in FlowDescriptionReader.get_config_type(config):
-                
-                if (config_type == "flow_mod"):
-                    mod_config = FlowDescriptionReader.get_flow_mod(config)
-                    mod = Mods.create_flow_mod(dp, mod_config)
-                    
-                elif (config_type == "group_mod"):
-                    mod_config = FlowDescriptionReader.get_group_mod(config)
-                    mod = Mods.create_group_mod(dp, mod_config)
-                    
-                else:
-                    raise Exception()
-                    LOG.exception("Wrong configuration type name:", config_type)
-                
-            LOG.debug("mod length: %i", sys.getsizeof(mod))
-            dp.send_msg(mod)
+            LOG.debug("mod length: %i", len(mod.buf))
+            if pipeline:
+                pipeline.add(mod, filename)
+                continue
+            Mods.send_compiled(dp, mod)
             LOG.info("message sent")
             LOG.info("===============================================================================")
             
             #ryu_loggers_on(True)            
+
+        self.mod_cache.save()
+
+        if pipeline:
+            self.pipelines[dp.id] = pipeline
+            pipeline.submit()
+            del self.pipelines[dp.id]
+
+    def compile_file(self, dp, full_filename):
+        config = FlowDescriptionReader.get_config(full_filename)
+
+        for config_type in FlowDescriptionReader.get_config_type(config):
+            
+            if (config_type == "flow_mod"):
+                mod_config = FlowDescriptionReader.get_flow_mod(config)
+                mod = Mods.create_flow_mod(dp, mod_config)
+                
+            elif (config_type == "group_mod"):
+                mod_config = FlowDescriptionReader.get_group_mod(config)
+                mod = Mods.create_group_mod(dp, mod_config)
+                
+            else:
+                raise Exception()
+                LOG.exception("Wrong configuration type name:", config_type)
+
+        return Mods.CompiledMod(dp, mod)
             
 if __name__ == '__main__':
     pass
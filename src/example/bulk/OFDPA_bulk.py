@@ -0,0 +1,101 @@
+"""
+Bulk flow, group and queue rate programming for OF-DPA scripts.
+
+ofdpaFlowAdd and ofdpaGroupBucketEntryAdd from OFDPA_python take one
+entry per call, so a script provisioning tens of thousands of routes
+spends most of its time crossing from Python into the wrapper. The
+functions here copy a whole list of entries into one array and hand it
+to libofdpa_bulk.so in a single call, which adds them one by one and
+returns a return code for each entry.
+
+Usage, after ofdpaClientInitialize:
+
+    from OFDPA_python import *
+    from OFDPA_bulk import ofdpaFlowAddBulk, ofdpaGroupAddBulk
+
+    rcs = ofdpaFlowAddBulk(flows)
+    failed = [f for f, rc in zip(flows, rcs) if rc != OFDPA_E_NONE]
+
+    rcs = ofdpaGroupAddBulk([(group, [bucket]), ...])
+
+    rcs = ofdpaQueueRateSetBulk([(port, queueId, minRate, maxRate), ...])
+
+The entries are the ofdpaFlowEntry_t, ofdpaGroupEntry_t and
+ofdpaGroupBucketEntry_t objects from OFDPA_python, filled in exactly as
+for the single entry calls.
+"""
+import ctypes
+import os
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "libofdpa_bulk.so"))
+
+_lib.ofdpaBulkFlowEntrySize.restype = ctypes.c_size_t
+_lib.ofdpaBulkGroupEntrySize.restype = ctypes.c_size_t
+_lib.ofdpaBulkGroupBucketEntrySize.restype = ctypes.c_size_t
+
+_lib.ofdpaFlowAddBulk.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                  ctypes.POINTER(ctypes.c_int)]
+_lib.ofdpaGroupAddBulk.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                   ctypes.c_void_p,
+                                   ctypes.POINTER(ctypes.c_int),
+                                   ctypes.POINTER(ctypes.c_int)]
+
+_lib.ofdpaQueueRateSetBulk.argtypes = [ctypes.POINTER(ctypes.c_uint32),
+                                       ctypes.c_int,
+                                       ctypes.POINTER(ctypes.c_int)]
+
+_flowSize = _lib.ofdpaBulkFlowEntrySize()
+_groupSize = _lib.ofdpaBulkGroupEntrySize()
+_bucketSize = _lib.ofdpaBulkGroupBucketEntrySize()
+
+def _pack(entries, size):
+    """Copy SWIG wrapped structures into one contiguous buffer."""
+    buf = ctypes.create_string_buffer(max(len(entries), 1) * size)
+    base = ctypes.addressof(buf)
+    for i, entry in enumerate(entries):
+        # The SWIG proxy's "this" converts to the address of the C structure
+        ctypes.memmove(base + i * size, int(entry.this), size)
+    return buf
+
+def ofdpaFlowAddBulk(flows):
+    """
+    Add a list of ofdpaFlowEntry_t. Returns the list of OFDPA_ERROR_t
+    return codes in the same order. A failed entry does not stop the rest.
+    """
+    count = len(flows)
+    rcs = (ctypes.c_int * max(count, 1))()
+    if count:
+        _lib.ofdpaFlowAddBulk(_pack(flows, _flowSize), count, rcs)
+    return list(rcs[:count])
+
+def ofdpaGroupAddBulk(groups):
+    """
+    Add a list of (ofdpaGroupEntry_t, [ofdpaGroupBucketEntry_t, ...])
+    pairs. Returns one OFDPA_ERROR_t per group: that of the group add or
+    of its first failing bucket add. A group whose bucket fails is deleted
+    again.
+    """
+    count = len(groups)
+    rcs = (ctypes.c_int * max(count, 1))()
+    if count:
+        buckets = [b for (_, groupBuckets) in groups for b in groupBuckets]
+        bucketCounts = (ctypes.c_int * count)(*[len(b) for (_, b) in groups])
+        _lib.ofdpaGroupAddBulk(_pack([g for (g, _) in groups], _groupSize),
+                               count, _pack(buckets, _bucketSize),
+                               bucketCounts, rcs)
+    return list(rcs[:count])
+
+def ofdpaQueueRateSetBulk(rates):
+    """
+    Set the rates of a list of (port, queueId, minRate, maxRate) tuples,
+    such as a whole QoS policy. Returns the list of OFDPA_ERROR_t return
+    codes in the same order. A failed queue does not stop the rest.
+    """
+    count = len(rates)
+    rcs = (ctypes.c_int * max(count, 1))()
+    if count:
+        words = (ctypes.c_uint32 * (4 * count))(
+            *[w for rate in rates for w in rate])
+        _lib.ofdpaQueueRateSetBulk(words, count, rcs)
+    return list(rcs[:count])
@@ -0,0 +1,99 @@
+"""
+Batched packet receive and send for OF-DPA scripts.
+
+ofdpaPktReceive and ofdpaPktSend from OFDPA_python move one packet per
+call through an ofdpaPacket_t wrapper, which limits a punt processor
+written in Python to a few thousand packets per second. An
+ofdpaPktBatch preallocates one buffer of fixed size slots. Each call
+to receive() or send() is one call into libofdpa_bulk.so for the whole
+batch. The packets are exposed as memoryviews of the buffer, so
+nothing is copied or allocated per packet. ctypes releases the GIL
+while the library waits for packets, so other threads keep running.
+
+Usage, after ofdpaClientInitialize and ofdpaClientPktSockBind:
+
+    from OFDPA_pktio import ofdpaPktBatch
+
+    batch = ofdpaPktBatch(64)
+    while True:
+        n = batch.receive()
+        for i in range(n):
+            pkt = batch.packet(i)          # memoryview, valid until the next receive
+            batch.outPorts[i] = 2
+            batch.inPorts[i] = batch.rxInPorts[i]
+        failed = batch.send(n)             # sends the received packets back
+
+To send packets of your own, write them into batch.slot(i) and set
+batch.lens[i], batch.outPorts[i] and batch.inPorts[i] before send().
+"""
+import ctypes
+import os
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "libofdpa_bulk.so"))
+
+_u32p = ctypes.POINTER(ctypes.c_uint32)
+
+_lib.ofdpaPktioMaxPktSize.restype = ctypes.c_uint32
+_lib.ofdpaPktReceiveBulk.argtypes = [ctypes.c_int32, ctypes.c_void_p,
+                                     ctypes.c_uint32, ctypes.c_int,
+                                     _u32p, _u32p, _u32p, _u32p]
+_lib.ofdpaPktSendBulk.argtypes = [ctypes.c_void_p, ctypes.c_uint32,
+                                  ctypes.c_int, _u32p, _u32p, _u32p,
+                                  ctypes.c_uint32,
+                                  ctypes.POINTER(ctypes.c_int)]
+
+class ofdpaPktBatch(object):
+    """
+    Buffers for count packets of up to size bytes each; size defaults
+    to the largest packet OF-DPA can receive.
+
+    After receive(), lens, rxInPorts, reasons and tableIds describe the
+    packets received. Before send(), lens, outPorts and inPorts describe
+    the packets to send; rcs then holds the OFDPA_ERROR_t of each.
+    """
+    def __init__(self, count=32, size=None):
+        if size is None:
+            size = _lib.ofdpaPktioMaxPktSize()
+        self.count = count
+        self.size = size
+        self.buf = ctypes.create_string_buffer(count * size)
+        self.lens = (ctypes.c_uint32 * count)()
+        self.rxInPorts = (ctypes.c_uint32 * count)()
+        self.reasons = (ctypes.c_uint32 * count)()
+        self.tableIds = (ctypes.c_uint32 * count)()
+        self.outPorts = (ctypes.c_uint32 * count)()
+        self.inPorts = (ctypes.c_uint32 * count)()
+        self.rcs = (ctypes.c_int * count)()
+        self._view = memoryview(self.buf).cast('B') \
+            if hasattr(memoryview, 'cast') else memoryview(self.buf)
+
+    def receive(self, timeout=None):
+        """
+        Wait up to timeout seconds, or forever if None, for a packet, then
+        take what else is queued, up to count packets. Returns the number
+        of packets received.
+        """
+        timeoutUs = -1 if timeout is None else int(timeout * 1000000)
+        return _lib.ofdpaPktReceiveBulk(timeoutUs, self.buf, self.size,
+                                        self.count, self.lens, self.rxInPorts,
+                                        self.reasons, self.tableIds)
+
+    def packet(self, i):
+        """The data of packet i, as a memoryview of its slot."""
+        start = i * self.size
+        return self._view[start:start + self.lens[i]]
+
+    def slot(self, i):
+        """The whole slot of packet i, to write a packet into."""
+        start = i * self.size
+        return self._view[start:start + self.size]
+
+    def send(self, count, flags=0):
+        """
+        Send the first count packets. Returns the number of packets that
+        were not sent; a failed packet does not stop the rest.
+        """
+        return _lib.ofdpaPktSendBulk(self.buf, self.size, count, self.lens,
+                                     self.outPorts, self.inPorts, flags,
+                                     self.rcs)
@@ -0,0 +1,164 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ofdpa_bulk.c
+*
+* @purpose      Bulk flow, group and queue rate programming for scripted
+*               clients.
+*               Built as libofdpa_bulk.so and called from OFDPA_bulk.py.
+*
+* @component    Example
+*
+* @comments     The scripts pack their entries into one array and make
+*               a single call here instead of one call through the
+*               Python wrapper per entry. Each entry is still one RPC.
+*
+* @create
+*
+* @end
+*
+**********************************************************************/
+#include "ofdpa_api.h"
+#include <stddef.h>
+
+/*
+ * The Python side sizes its arrays from these so it does not need to
+ * know the layout of the structures.
+ */
+size_t ofdpaBulkFlowEntrySize(void)
+{
+  return sizeof(ofdpaFlowEntry_t);
+}
+
+size_t ofdpaBulkGroupEntrySize(void)
+{
+  return sizeof(ofdpaGroupEntry_t);
+}
+
+size_t ofdpaBulkGroupBucketEntrySize(void)
+{
+  return sizeof(ofdpaGroupBucketEntry_t);
+}
+
+/*****************************************************************//**
+* @brief  Add an array of flow entries.
+*
+* @param[in]    flows    flow entries
+* @param[in]    count    number of entries in flows
+* @param[out]   rcs      return code of ofdpaFlowAdd for each entry
+*
+* @returns  number of entries that were not added
+*
+* @note A failed entry does not stop the ones after it.
+*
+*********************************************************************/
+int ofdpaFlowAddBulk(ofdpaFlowEntry_t *flows, int count, OFDPA_ERROR_t *rcs)
+{
+  int i;
+  int failed = 0;
+
+  for (i = 0; i < count; i++)
+  {
+    rcs[i] = ofdpaFlowAdd(&flows[i]);
+    if (rcs[i] != OFDPA_E_NONE)
+    {
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+/*****************************************************************//**
+* @brief  Add an array of groups together with their buckets.
+*
+* @param[in]    groups        group entries
+* @param[in]    count         number of entries in groups
+* @param[in]    buckets       buckets of all groups, in group order
+* @param[in]    bucketCounts  number of buckets of each group
+* @param[out]   rcs           return code for each group
+*
+* @returns  number of groups that were not added
+*
+* @note The return code of a group is that of ofdpaGroupAdd or of its
+*       first failing ofdpaGroupBucketEntryAdd. A group whose bucket
+*       fails is deleted again so no group is left half programmed.
+*
+*********************************************************************/
+int ofdpaGroupAddBulk(ofdpaGroupEntry_t *groups, int count,
+                      ofdpaGroupBucketEntry_t *buckets, const int *bucketCounts,
+                      OFDPA_ERROR_t *rcs)
+{
+  ofdpaGroupBucketEntry_t *bucket = buckets;
+  int i, j;
+  int failed = 0;
+
+  for (i = 0; i < count; i++)
+  {
+    rcs[i] = ofdpaGroupAdd(&groups[i]);
+
+    for (j = 0; j < bucketCounts[i]; j++, bucket++)
+    {
+      if (rcs[i] == OFDPA_E_NONE)
+      {
+        rcs[i] = ofdpaGroupBucketEntryAdd(bucket);
+        if (rcs[i] != OFDPA_E_NONE)
+        {
+          ofdpaGroupDelete(groups[i].groupId);
+        }
+      }
+    }
+
+    if (rcs[i] != OFDPA_E_NONE)
+    {
+      failed++;
+    }
+  }
+
+  return failed;
+}
+
+/*****************************************************************//**
+* @brief  Set the minimum and maximum rates of an array of port queues.
+*
+* @param[in]    rates    port, queue id, min rate and max rate of each
+*                        queue, four words per queue
+* @param[in]    count    number of queues in rates
+* @param[out]   rcs      return code of ofdpaQueueRateSet for each queue
+*
+* @returns  number of queues whose rates were not set
+*
+* @note A failed queue does not stop the ones after it.
+*
+*********************************************************************/
+int ofdpaQueueRateSetBulk(const uint32_t *rates, int count, OFDPA_ERROR_t *rcs)
+{
+  int i;
+  int failed = 0;
+
+  for (i = 0; i < count; i++, rates += 4)
+  {
+    rcs[i] = ofdpaQueueRateSet(rates[0], rates[1], rates[2], rates[3]);
+    if (rcs[i] != OFDPA_E_NONE)
+    {
+      failed++;
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,142 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ofdpa_pktio.c
+*
+* @purpose      Batched packet receive and send for scripted clients.
+*               Built into libofdpa_bulk.so and called from OFDPA_pktio.py.
+*
+* @component    Example
+*
+* @comments     Packets are received into and sent from one buffer of
+*               fixed size slots owned by the caller, so a script makes
+*               one call per batch and allocates nothing per packet.
+*
+* @create
+*
+* @end
+*
+**********************************************************************/
+#include "ofdpa_api.h"
+#include <stddef.h>
+#include <sys/time.h>
+
+uint32_t ofdpaPktioMaxPktSize(void)
+{
+  uint32_t size = 0;
+
+  (void)ofdpaMaxPktSizeGet(&size);
+  return size;
+}
+
+/*****************************************************************//**
+* @brief  Receive a batch of packets.
+*
+* @param[in]    timeoutUs  time to wait for the first packet, in
+*                          microseconds; negative waits forever
+* @param[in]    buf        maxPkts slots of slotSize bytes
+* @param[in]    slotSize   size of a slot
+* @param[in]    maxPkts    number of slots
+* @param[out]   lens       length of each packet received
+* @param[out]   inPorts    input port of each packet received
+* @param[out]   reasons    OFDPA_PACKET_IN_REASON_t of each packet received
+* @param[out]   tableIds   flow table of each packet received
+*
+* @returns  number of packets received
+*
+* @note Only the first receive waits; the others take the packets
+*       that are already queued.
+*
+*********************************************************************/
+int ofdpaPktReceiveBulk(int32_t timeoutUs, char *buf, uint32_t slotSize, int maxPkts,
+                        uint32_t *lens, uint32_t *inPorts, uint32_t *reasons,
+                        uint32_t *tableIds)
+{
+  struct timeval timeout;
+  struct timeval *tv = NULL;
+  ofdpaPacket_t pkt;
+  int count = 0;
+
+  if (timeoutUs >= 0)
+  {
+    timeout.tv_sec = timeoutUs / 1000000;
+    timeout.tv_usec = timeoutUs % 1000000;
+    tv = &timeout;
+  }
+
+  while (count < maxPkts)
+  {
+    pkt.pktData.pstart = buf + (size_t)count * slotSize;
+    pkt.pktData.size = slotSize;
+    if (ofdpaPktReceive(tv, &pkt) != OFDPA_E_NONE)
+    {
+      break;
+    }
+
+    lens[count] = pkt.pktData.size;
+    inPorts[count] = pkt.inPortNum;
+    reasons[count] = pkt.reason;
+    tableIds[count] = pkt.tableId;
+    count++;
+
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    tv = &timeout;
+  }
+
+  return count;
+}
+
+/*****************************************************************//**
+* @brief  Send a batch of packets.
+*
+* @param[in]    buf        count slots of slotSize bytes
+* @param[in]    slotSize   size of a slot
+* @param[in]    count      number of packets
+* @param[in]    lens       length of each packet
+* @param[in]    outPorts   output port of each packet
+* @param[in]    inPorts    input port of each packet
+* @param[in]    flags      ofdpaPktSend flags, for all packets
+* @param[out]   rcs        return code of ofdpaPktSend for each packet
+*
+* @returns  number of packets that were not sent
+*
+* @note A failed packet does not stop the ones after it.
+*
+*********************************************************************/
+int ofdpaPktSendBulk(char *buf, uint32_t slotSize, int count, const uint32_t *lens,
+                     const uint32_t *outPorts, const uint32_t *inPorts, uint32_t flags,
+                     OFDPA_ERROR_t *rcs)
+{
+  ofdpa_buffdesc pktData;
+  int failed = 0;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    pktData.pstart = buf + (size_t)i * slotSize;
+    pktData.size = lens[i];
+    rcs[i] = ofdpaPktSend(&pktData, flags, outPorts[i], inPorts[i]);
+    if (rcs[i] != OFDPA_E_NONE)
+    {
+      failed++;
+    }
+  }
+
+  return failed;
+}
@@ -83,15 +83,183 @@ void flowTablePurge(OFDPA_FLOW_TABLE_ID_t tableId)
   }
 }
 
+typedef struct
+{
+  uint32_t groupId;
+  uint32_t refCount;        /* groups referencing this one */
+  uint32_t firstRef;        /* this group's references in refs[] */
+  uint32_t numRefs;
+} purgeGroup_t;
+
+static purgeGroup_t *purgeGroupFind(purgeGroup_t *groups, uint32_t numGroups,
+                                    uint32_t groupId)
+{
+  uint32_t lo = 0, hi = numGroups, mid;
+
+  /* groups[] is in ofdpaGroupNextGet order, which is by groupId */
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (groups[mid].groupId == groupId)
+    {
+      return &groups[mid];
+    }
+    if (groups[mid].groupId < groupId)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+  return NULL;
+}
+
+static void *purgeGrow(void *array, uint32_t *size, size_t elemSize)
+{
+  void *grown;
+  uint32_t newSize = (*size == 0) ? 256 : (*size * 2);
+
+  grown = realloc(array, newSize * elemSize);
+  if (grown == NULL)
+  {
+    printf("\tOut of memory reading the group table.\n");
+    free(array);
+    return NULL;
+  }
+  *size = newSize;
+  return grown;
+}
+
+/* Groups are read once with their bucket references, then each one is
+   deleted once no remaining group references it, so no delete fails on a
+   chained group and the table is not walked again. */
+void groupTablePurge(void)
+{
+  OFDPA_ERROR_t rc;
+  ofdpaGroupEntry_t group;
+  ofdpaGroupBucketEntry_t bucket;
+  purgeGroup_t *groups = NULL, *child;
+  uint32_t *refs = NULL, *ready = NULL;
+  uint32_t numGroups = 0, groupsSize = 0, numRefs = 0, refsSize = 0;
+  uint32_t numReady = 0, type, count = 0, failed = 0;
+  uint32_t i, j;
+
+  memset(&group, 0, sizeof(group));
+  while (ofdpaGroupNextGet(group.groupId, &group) == OFDPA_E_NONE)
+  {
+    if (numGroups == groupsSize)
+    {
+      if ((groups = purgeGrow(groups, &groupsSize, sizeof(*groups))) == NULL)
+      {
+        free(refs);
+        return;
+      }
+    }
+    groups[numGroups].groupId = group.groupId;
+    groups[numGroups].refCount = 0;
+    groups[numGroups].firstRef = numRefs;
+    groups[numGroups].numRefs = 0;
+
+    /* L2 interface groups are the leaves; their buckets reference nothing */
+    if ((ofdpaGroupTypeGet(group.groupId, &type) == OFDPA_E_NONE) &&
+        (type != OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE) &&
+        (type != OFDPA_GROUP_ENTRY_TYPE_L2_UNFILTERED_INTERFACE))
+    {
+      rc = ofdpaGroupBucketEntryFirstGet(group.groupId, &bucket);
+      while (rc == OFDPA_E_NONE)
+      {
+        if (numRefs == refsSize)
+        {
+          if ((refs = purgeGrow(refs, &refsSize, sizeof(*refs))) == NULL)
+          {
+            free(groups);
+            return;
+          }
+        }
+        refs[numRefs++] = bucket.referenceGroupId;
+        groups[numGroups].numRefs++;
+        rc = ofdpaGroupBucketEntryNextGet(group.groupId, bucket.bucketIndex, &bucket);
+      }
+    }
+    numGroups++;
+  }
+
+  if (numGroups == 0)
+  {
+    printf("\tNo entries found\n");
+    free(refs);
+    return;
+  }
+
+  for (i = 0; i < numRefs; i++)
+  {
+    if ((child = purgeGroupFind(groups, numGroups, refs[i])) != NULL)
+    {
+      child->refCount++;
+    }
+  }
+
+  ready = malloc(numGroups * sizeof(*ready));
+  if (ready == NULL)
+  {
+    printf("\tOut of memory reading the group table.\n");
+    free(groups);
+    free(refs);
+    return;
+  }
+  for (i = 0; i < numGroups; i++)
+  {
+    if (groups[i].refCount == 0)
+    {
+      ready[numReady++] = i;
+    }
+  }
+
+  /* ready[] grows as groups lose their last reference */
+  for (i = 0; i < numReady; i++)
+  {
+    purgeGroup_t *parent = &groups[ready[i]];
+
+    if ((rc = ofdpaGroupDelete(parent->groupId)) != OFDPA_E_NONE)
+    {
+      printf("\tError returned from ofdpaGroupDelete: rc = %d, groupId = 0x%08x\n",
+             rc, parent->groupId);
+      failed++;
+      continue;
+    }
+    count++;
+
+    for (j = 0; j < parent->numRefs; j++)
+    {
+      child = purgeGroupFind(groups, numGroups, refs[parent->firstRef + j]);
+      if ((child != NULL) && (child->refCount > 0) && (--child->refCount == 0))
+      {
+        ready[numReady++] = child - groups;
+      }
+    }
+  }
+
+  printf("\tDeleted %d groups.\n", count);
+  if (count + failed < numGroups)
+  {
+    printf("\t%d groups left in a reference loop or under a failed delete.\n",
+           numGroups - count - failed);
+  }
+
+  free(ready);
+  free(groups);
+  free(refs);
+}
+
 int main(int argc, char *argv[])
 {
   char              client_name[] = "ofdpa purge client";
   OFDPA_ERROR_t rc;
   uint32_t count;
-  uint32_t atLeastOneGroupEntryDeleted;
 
   uint32_t tableId;
-  ofdpaGroupEntry_t group;
   uint32_t tunnelPortId;
   uint32_t ecmpNextHopId;
   uint32_t nextHopId;
@@ -488,31 +656,7 @@ int main(int argc, char *argv[])
   }
 
   printf("Purging group table.\n");
-  count = 0;
-
-  do
-  {
-    memset(&group, 0, sizeof(group));
-    atLeastOneGroupEntryDeleted = 0;
-
-    while (ofdpaGroupNextGet(group.groupId, &group) == OFDPA_E_NONE)
-    {
-      if ((rc = ofdpaGroupDelete(group.groupId)) == OFDPA_E_NONE)
-      {
-        count++;
-        atLeastOneGroupEntryDeleted = 1;
-      }
-    }
-  } while (atLeastOneGroupEntryDeleted == 1);
-
-  if (count != 0)
-  {
-    printf("\tDeleted %d groups.\n", count);
-  }
-  else
-  {
-    printf("\tNo entries found\n");
-  }
+  groupTablePurge();
 
   /* retrieve all port events to allow logical ports to actually be deleted from database */
   printf("Retrieving pending logical port delete events.\n");
@@ -30,14 +30,16 @@
 *
 **********************************************************************/
 #include "ofdpa_api.h"
+#include "ofdpa_dump.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <argp.h>
 
 #define DEFAULT_COUNT        0
 
-const char *argp_program_version = "client_flowtable_dump v1.1";
+const char *argp_program_version = "client_flowtable_dump v1.2";
 
 /* The options we understand. */
 static struct argp_option options[] =
@@ -45,6 +47,8 @@ static struct argp_option options[] =
   { "count",               'c', "COUNT",     0, "Number of entries from start of table. (0 for all)",       0 },
   { "verbose",             'v',       0,     0, "Print stats for empty flow tables.",                       0 },
   { "list",                'l',       0,     0, "Lists table IDs for supported flow tables and exits.",     0 },
+  { "stats",               's',       0,     0, "Print the packet and byte counters of each entry.",        0 },
+  { "format",              'f', "FORMAT",    0, "Output format: text, csv or json.",                        0 },
   { 0 }
 };
 
@@ -53,6 +57,8 @@ static OFDPA_FLOW_TABLE_ID_t tableId;
 static int tableIdSpecified = 0;
 static int showEmptyTables = 0;
 static int showValidTableIds = 0;
+static int showStats = 0;
+static OFDPA_DUMP_FORMAT_t format = OFDPA_DUMP_FORMAT_TEXT;
 
 /* Parse a single option. */
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
@@ -79,6 +85,18 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
       showEmptyTables = 1;
       break;
 
+    case 's':
+      showStats = 1;
+      break;
+
+    case 'f':
+      if (ofdpaDumpFormatParse(arg, &format) != 0)
+      {
+        argp_error(state, "Invalid format \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
     case ARGP_KEY_ARG:
       errno = 0;
       tableId = strtoul(arg, NULL, 0);
@@ -109,14 +127,60 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
   return 0;
 }
 
+void printFlowRecord(ofdpaFlowDumpRecord_t *record)
+{
+  OFDPA_ERROR_t rc;
+  char buffer[700];
+
+  rc = ofdpaFlowEntryDecode(&record->flow, buffer, sizeof(buffer));
+
+  switch (format)
+  {
+    case OFDPA_DUMP_FORMAT_CSV:
+      printf("%d,%u,%u,%u,0x%" PRIx64 ",", record->flow.tableId, record->flow.priority,
+             record->flow.hard_time, record->flow.idle_time, record->flow.cookie);
+      if (showStats)
+      {
+        printf("%u,%" PRIu64 ",%" PRIu64 ",", record->stats.durationSec,
+               record->stats.receivedPackets, record->stats.receivedBytes);
+      }
+      ofdpaDumpStringPrint(buffer, format);
+      printf("\n");
+      break;
+
+    case OFDPA_DUMP_FORMAT_JSON:
+      printf("{\"table\": %d, \"priority\": %u, \"hard_time\": %u, \"idle_time\": %u, \"cookie\": %" PRIu64 ", ",
+             record->flow.tableId, record->flow.priority,
+             record->flow.hard_time, record->flow.idle_time, record->flow.cookie);
+      if (showStats)
+      {
+        printf("\"duration\": %u, \"packets\": %" PRIu64 ", \"bytes\": %" PRIu64 ", ",
+               record->stats.durationSec, record->stats.receivedPackets, record->stats.receivedBytes);
+      }
+      printf("\"entry\": ");
+      ofdpaDumpStringPrint(buffer, format);
+      printf("}\n");
+      break;
+
+    default:
+      printf("-- %s%s\r\n", buffer, (rc == OFDPA_E_FULL) ? " -- OUTPUT TRUNCATED! --":"");
+      if (showStats)
+      {
+        printf("   duration: %u, packets: %" PRIu64 ", bytes: %" PRIu64 "\r\n", record->stats.durationSec,
+               record->stats.receivedPackets, record->stats.receivedBytes);
+      }
+      break;
+  }
+}
+
 void dumpFlowTable(OFDPA_FLOW_TABLE_ID_t tableId, int entryPrintLimit, int *entriesPrinted)
 {
-  int i;
+  int i, j, n;
   OFDPA_ERROR_t rc;
   char buffer[700];
   ofdpaFlowTableInfo_t info;
-  ofdpaFlowEntry_t flow;
-  ofdpaFlowEntryStats_t flowStats;
+  ofdpaFlowDumpIter_t iter;
+  ofdpaFlowDumpRecord_t records[OFDPA_DUMP_BATCH];
 
   memset(&info, 0, sizeof(info));
   rc = ofdpaFlowTableInfoGet(tableId, &info);
@@ -127,59 +191,72 @@ void dumpFlowTable(OFDPA_FLOW_TABLE_ID_t tableId, int entryPrintLimit, int *entr
     return;
   }
 
-  printf("Table ID %d (%s): ", tableId, ofdpaFlowTableNameGet(tableId));
-
-  if (entryPrintLimit == 0)
-  {
-    sprintf(buffer, "all entries");
-  }
-  else if (entryPrintLimit == 1)
+  /* csv and json print only the entries, one per line */
+  if (format == OFDPA_DUMP_FORMAT_TEXT)
   {
-    sprintf(buffer, "up to 1 entry");
-  }
-  else
-  {
-    sprintf(buffer, "up to %d entries", entryPrintLimit);
-  }
+    printf("Table ID %d (%s): ", tableId, ofdpaFlowTableNameGet(tableId));
 
-  printf("  Retrieving %s. ", buffer);
+    if (entryPrintLimit == 0)
+    {
+      sprintf(buffer, "all entries");
+    }
+    else if (entryPrintLimit == 1)
+    {
+      sprintf(buffer, "up to 1 entry");
+    }
+    else
+    {
+      sprintf(buffer, "up to %d entries", entryPrintLimit);
+    }
 
-  if (rc != OFDPA_E_NONE)
-  {
-    printf("Could not retrieve OF-DPA table info with ID %d. (rc = %d)\r\n", tableId, rc);
-  }
-  else
-  {
-    printf("Max entries = %d, Current entries = %d.\r\n", info.maxEntries, info.numEntries);
-  }
+    printf("  Retrieving %s. ", buffer);
 
-  rc = ofdpaFlowEntryInit(tableId, &flow);
-  if (rc != OFDPA_E_NONE)
-  {
-    printf("Bad return code trying to initialize flow. rc = %d.\r\n", rc);
-    return;
+    if (rc != OFDPA_E_NONE)
+    {
+      printf("Could not retrieve OF-DPA table info with ID %d. (rc = %d)\r\n", tableId, rc);
+    }
+    else
+    {
+      printf("Max entries = %d, Current entries = %d.\r\n", info.maxEntries, info.numEntries);
+    }
   }
 
-  rc = ofdpaFlowStatsGet(&flow, &flowStats);
+  rc = ofdpaFlowTableDumpStart(tableId, showStats ? OFDPA_DUMP_F_STATS : 0, &iter);
   if (rc != OFDPA_E_NONE)
   {
-    rc = ofdpaFlowNextGet(&flow, &flow);
+    fprintf((format == OFDPA_DUMP_FORMAT_TEXT) ? stdout : stderr,
+            "Bad return code trying to initialize flow. rc = %d.\r\n", rc);
+    return;
   }
 
   i = 0;
 
-  while ((rc == OFDPA_E_NONE) &&
-         ((entryPrintLimit == 0) || (i < entryPrintLimit)))
+  while ((entryPrintLimit == 0) || (i < entryPrintLimit))
   {
-    rc = ofdpaFlowEntryDecode(&flow, buffer, sizeof(buffer));
-    printf("-- %s%s\r\n", buffer, (rc == OFDPA_E_FULL) ? " -- OUTPUT TRUNCATED! --":"");
-    i++;
+    n = OFDPA_DUMP_BATCH;
+    if ((entryPrintLimit != 0) && (entryPrintLimit - i < n))
+    {
+      n = entryPrintLimit - i;
+    }
+
+    n = ofdpaFlowTableDumpNext(&iter, records, n);
+    if (n == 0)
+    {
+      break;
+    }
 
-    rc = ofdpaFlowNextGet(&flow, &flow);
+    for (j = 0; j < n; j++)
+    {
+      printFlowRecord(&records[j]);
+    }
+    i += n;
   }
 
-  /* blank line between tables */
-  printf("\r\n");
+  if (format == OFDPA_DUMP_FORMAT_TEXT)
+  {
+    /* blank line between tables */
+    printf("\r\n");
+  }
   *entriesPrinted = i;
 }
 
@@ -208,6 +285,9 @@ int main(int argc, char *argv[])
          "If no argument given, content of all tables are printed.\vDefault values:\n");
   i = strlen(docBuffer);
   i += sprintf(&docBuffer[i], "COUNT     = %d\n", DEFAULT_COUNT);
+  i += sprintf(&docBuffer[i], "FORMAT    = text\n");
+  i += sprintf(&docBuffer[i], "\ncsv prints a line per entry: table,priority,hard_time,idle_time,cookie[,duration,packets,bytes],entry. "
+               "json prints an object per line with the same fields.\n");
   i += sprintf(&docBuffer[i], "\n");
 
   rc = ofdpaClientInitialize(client_name);
@@ -236,6 +316,11 @@ int main(int argc, char *argv[])
 
   totalPrinted = 0;
 
+  if (format == OFDPA_DUMP_FORMAT_CSV)
+  {
+    printf("table,priority,hard_time,idle_time,cookie,%sentry\n", showStats ? "duration,packets,bytes," : "");
+  }
+
   if (tableIdSpecified)
   {
     dumpFlowTable(tableId, count, &totalPrinted);
@@ -274,7 +359,7 @@ int main(int argc, char *argv[])
    * if not printing empty table stats and no flow entries found, we haven't printed anything at all
    * so print a message letting the user know we are responsive
    */
-  if ((showEmptyTables == 0) && (totalPrinted == 0))
+  if ((format == OFDPA_DUMP_FORMAT_TEXT) && (showEmptyTables == 0) && (totalPrinted == 0))
   {
     printf("No flow entries found.\r\n");
   }
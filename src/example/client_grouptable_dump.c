@@ -40,14 +40,16 @@
 
 #include "ofdpa_api.h"
 #include "ofdpa_datatypes.h"
+#include "ofdpa_dump.h"
 
-#define VERSION              1.0
+#define VERSION              1.1
 
 typedef struct
 {
   int count;
   OFDPA_GROUP_ENTRY_TYPE_t groupType;
   int groupTypeOptionGiven;
+  OFDPA_DUMP_FORMAT_t format;
 
 } arguments_t;
 
@@ -56,6 +58,7 @@ static struct argp_option options[] =
 {
   { "count", 'c', "COUNT",     0, "Number of entries to display. If not specified or set to 0, all entries displayed.", 0 },
   { "type",  't', "GROUPTYPE", 0, "Group entry type to list. If not specified, all types displayed.",                   0 },
+  { "format", 'f', "FORMAT",   0, "Output format: text, csv or json.",                                                  0 },
   { 0 }
 };
 
@@ -89,6 +92,14 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
       arguments->groupTypeOptionGiven = 1;
       break;
 
+    case 'f':
+      if (ofdpaDumpFormatParse(arg, &arguments->format) != 0)
+      {
+        argp_error(state, "Invalid format \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
     case ARGP_KEY_ARG:
     case ARGP_KEY_NO_ARGS:
     case ARGP_KEY_END:
@@ -100,92 +111,119 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
   return 0;
 }
 
-void groupTableList(OFDPA_GROUP_ENTRY_TYPE_t groupType, int groupTypeSpecified, int count)
+void printGroupRecord(ofdpaGroupDumpRecord_t *record, OFDPA_DUMP_FORMAT_t format)
 {
   OFDPA_ERROR_t rc;
-  ofdpaGroupEntry_t groupEntry;
-  ofdpaGroupEntryStats_t groupStats;
   ofdpaGroupBucketEntry_t bucketEntry;
-  OFDPA_GROUP_ENTRY_TYPE_t currentEntryType;
+  uint32_t groupType = 0;
   char buf[400];
-  int entriesDisplayedCount = 0;
+  int first = 1;
 
-  memset(&groupEntry, 0, sizeof(groupEntry));
+  ofdpaGroupDecode(record->group.groupId, buf, sizeof(buf));
 
-  ofdpaGroupTypeSet(&groupEntry.groupId, groupType);
-
-  /* it is possible that the groupId is an exact match for an entry */
-  if ((rc = ofdpaGroupStatsGet(groupEntry.groupId, &groupStats)) != OFDPA_E_NONE)
+  switch (format)
   {
-    rc = ofdpaGroupNextGet(groupEntry.groupId, &groupEntry);
+    case OFDPA_DUMP_FORMAT_CSV:
+      /* buckets are left out so each group stays one line */
+      ofdpaGroupTypeGet(record->group.groupId, &groupType);
+      printf("0x%08x,%u,%u,%u,%u,", record->group.groupId, groupType,
+             record->stats.refCount, record->stats.duration, record->stats.bucketCount);
+      ofdpaDumpStringPrint(buf, format);
+      printf("\n");
+      return;
+
+    case OFDPA_DUMP_FORMAT_JSON:
+      ofdpaGroupTypeGet(record->group.groupId, &groupType);
+      printf("{\"group_id\": %u, \"type\": %u, \"ref_count\": %u, \"duration\": %u, \"group\": ",
+             record->group.groupId, groupType, record->stats.refCount, record->stats.duration);
+      ofdpaDumpStringPrint(buf, format);
+      printf(", \"buckets\": [");
+      break;
+
+    default:
+      printf("groupId = 0x%08x (%s): ", record->group.groupId, buf);
+      printf("duration: %d, refCount:%d\r\n", record->stats.duration, record->stats.refCount);
+      break;
   }
 
-  /* found at least one entry, proceed */
-  if (OFDPA_E_NONE == rc)
+  memset(&bucketEntry, 0, sizeof(bucketEntry));
+
+  if (ofdpaGroupBucketEntryFirstGet(record->group.groupId, &bucketEntry) == OFDPA_E_NONE)
   {
     do
     {
-      /* if groupType specified, only iterate of group entries of that type */
-      if (groupTypeSpecified != 0)
+      rc = ofdpaGroupBucketEntryDecode(&bucketEntry, buf, sizeof(buf));
+
+      if (format == OFDPA_DUMP_FORMAT_JSON)
       {
-        if ((OFDPA_E_NONE != ofdpaGroupTypeGet(groupEntry.groupId, &currentEntryType)) ||
-            (groupType != currentEntryType))
-        {
-          /* retrieved group entry not of requested type, done */
-          break;
-        }
+        printf("%s", first ? "" : ", ");
+        ofdpaDumpStringPrint((rc == OFDPA_E_NONE || rc == OFDPA_E_FULL) ? buf : "", format);
+        first = 0;
+        continue;
       }
 
-      /* group entry matches criteria, display it */
-      ofdpaGroupDecode(groupEntry.groupId, buf, sizeof(buf));
-      printf("groupId = 0x%08x (%s): ", groupEntry.groupId, buf);
+      printf("\t");
 
-      rc = ofdpaGroupStatsGet(groupEntry.groupId, &groupStats);
-      if (rc != OFDPA_E_NONE)
+      if (rc == OFDPA_E_NONE)
+      {
+        printf("%s", buf);
+      }
+      else if (rc == OFDPA_E_FULL)
       {
-        printf("Error retrieving group entry stats. (rc = %d)\r\n", rc);
+        printf("%s (** TRUNCATED OUTPUT **)", buf);
       }
       else
       {
-        printf("duration: %d, refCount:%d\r\n", groupStats.duration, groupStats.refCount);
+        printf("Error decoding bucketEntry");
       }
 
-      memset(&bucketEntry, 0, sizeof(bucketEntry));
+      printf("\r\n");
+    } while (ofdpaGroupBucketEntryNextGet(bucketEntry.groupId, bucketEntry.bucketIndex, &bucketEntry) == OFDPA_E_NONE);
+  }
 
-      if (ofdpaGroupBucketEntryFirstGet(groupEntry.groupId, &bucketEntry) == OFDPA_E_NONE)
-      {
-        do
-        {
-          printf("\t");
-          rc = ofdpaGroupBucketEntryDecode(&bucketEntry, buf, sizeof(buf));
-
-          if (rc == OFDPA_E_NONE)
-          {
-            printf("%s", buf);
-          }
-          else if (rc == OFDPA_E_FULL)
-          {
-            printf("%s (** TRUNCATED OUTPUT **)", buf);
-          }
-          else
-          {
-            printf("Error decoding bucketEntry");
-          }
-
-          printf("\r\n");
-        } while (ofdpaGroupBucketEntryNextGet(bucketEntry.groupId, bucketEntry.bucketIndex, &bucketEntry) == OFDPA_E_NONE);
-      }
+  if (format == OFDPA_DUMP_FORMAT_JSON)
+  {
+    printf("]}\n");
+  }
+}
 
-      entriesDisplayedCount++;
-      if ((count != 0) && (entriesDisplayedCount >= count))
-      {
-        break;
-      }
+void groupTableList(OFDPA_GROUP_ENTRY_TYPE_t groupType, int groupTypeSpecified, int count,
+                    OFDPA_DUMP_FORMAT_t format)
+{
+  ofdpaGroupDumpIter_t iter;
+  ofdpaGroupDumpRecord_t records[OFDPA_DUMP_BATCH];
+  int entriesDisplayedCount = 0;
+  int i, n;
+
+  if (format == OFDPA_DUMP_FORMAT_CSV)
+  {
+    printf("group_id,type,ref_count,duration,bucket_count,group\n");
+  }
 
-    } while (ofdpaGroupNextGet(groupEntry.groupId, &groupEntry) == OFDPA_E_NONE);
+  ofdpaGroupTableDumpStart(groupType, groupTypeSpecified, OFDPA_DUMP_F_STATS, &iter);
+
+  while ((count == 0) || (entriesDisplayedCount < count))
+  {
+    n = OFDPA_DUMP_BATCH;
+    if ((count != 0) && (count - entriesDisplayedCount < n))
+    {
+      n = count - entriesDisplayedCount;
+    }
+
+    n = ofdpaGroupTableDumpNext(&iter, records, n);
+    if (n == 0)
+    {
+      break;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      printGroupRecord(&records[i], format);
+    }
+    entriesDisplayedCount += n;
   }
 
-  if (entriesDisplayedCount == 0)
+  if ((format == OFDPA_DUMP_FORMAT_TEXT) && (entriesDisplayedCount == 0))
   {
     printf("No entries found.\r\n");
   }
@@ -214,7 +252,8 @@ int main(int argc, char *argv[])
   sprintf(versionBuf, "%s v%.1f", basename(strdup(__FILE__)), VERSION);
   argp_program_version = versionBuf;
 
-  strcpy(docBuffer, "\nLists group entries.\n");
+  strcpy(docBuffer, "\nLists group entries.\n\vcsv prints a line per group without its buckets, "
+         "json an object per line with the buckets.\n");
 
   /* Parse our arguments; every option seen by `parse_opt' will be reflected in
      `arguments'. */
@@ -226,7 +265,7 @@ int main(int argc, char *argv[])
     return rc;
   }
 
-  groupTableList(arguments.groupType, arguments.groupTypeOptionGiven, arguments.count);
+  groupTableList(arguments.groupType, arguments.groupTypeOptionGiven, arguments.count, arguments.format);
 
   return rc;
 }
@@ -0,0 +1,307 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ofdpa_dump.h
+*
+* @purpose      Batched table iterators and output formats shared by
+*               the dump clients.
+*
+* @component    Example
+*
+* @comments     The iterators hand out entries in arrays so a client
+*               loop does not depend on how they are fetched. Each
+*               entry is still fetched with the per-entry RPCs, and
+*               stats only when asked for; a batched RPC can replace
+*               the body of the Next functions without touching the
+*               clients.
+*
+* @create
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_OFDPA_DUMP_H
+#define INCLUDE_OFDPA_DUMP_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ofdpa_api.h"
+
+/** Fetch the statistics of each entry as well */
+#define OFDPA_DUMP_F_STATS  0x1
+
+/** Entries handed out per Next call by the dump clients */
+#define OFDPA_DUMP_BATCH    64
+
+typedef enum
+{
+  OFDPA_DUMP_FORMAT_TEXT = 0,
+  OFDPA_DUMP_FORMAT_CSV,
+  OFDPA_DUMP_FORMAT_JSON,
+} OFDPA_DUMP_FORMAT_t;
+
+typedef struct
+{
+  ofdpaFlowEntry_t       flow;
+  /** Zero unless OFDPA_DUMP_F_STATS */
+  ofdpaFlowEntryStats_t  stats;
+} ofdpaFlowDumpRecord_t;
+
+typedef struct
+{
+  ofdpaFlowEntry_t  cursor;
+  uint32_t          flags;
+  int               started;
+  int               done;
+} ofdpaFlowDumpIter_t;
+
+typedef struct
+{
+  ofdpaGroupEntry_t       group;
+  /** Zero unless OFDPA_DUMP_F_STATS */
+  ofdpaGroupEntryStats_t  stats;
+} ofdpaGroupDumpRecord_t;
+
+typedef struct
+{
+  ofdpaGroupEntry_t         cursor;
+  OFDPA_GROUP_ENTRY_TYPE_t  groupType;
+  int                       typeSpecified;
+  uint32_t                  flags;
+  int                       started;
+  int                       done;
+} ofdpaGroupDumpIter_t;
+
+/*****************************************************************//**
+* @brief  Start walking a flow table.
+*
+* @param[in]    tableId  flow table
+* @param[in]    flags    OFDPA_DUMP_F_*
+* @param[out]   iter     iterator for ofdpaFlowTableDumpNext
+*
+* @retval   OFDPA_E_NONE  iterator initialized
+* @retval   other         return code of ofdpaFlowEntryInit
+*
+*********************************************************************/
+static inline OFDPA_ERROR_t ofdpaFlowTableDumpStart(OFDPA_FLOW_TABLE_ID_t tableId,
+                                                    uint32_t flags,
+                                                    ofdpaFlowDumpIter_t *iter)
+{
+  memset(iter, 0, sizeof(*iter));
+  iter->flags = flags;
+  return ofdpaFlowEntryInit(tableId, &iter->cursor);
+}
+
+/*****************************************************************//**
+* @brief  Get the next entries of a flow table.
+*
+* @param[in]    iter        iterator from ofdpaFlowTableDumpStart
+* @param[out]   records     entries, with stats if asked for
+* @param[in]    maxRecords  size of records
+*
+* @returns  number of records filled in, 0 at the end of the table
+*
+*********************************************************************/
+static inline int ofdpaFlowTableDumpNext(ofdpaFlowDumpIter_t *iter,
+                                         ofdpaFlowDumpRecord_t *records,
+                                         int maxRecords)
+{
+  ofdpaFlowEntryStats_t stats;
+  int n = 0;
+
+  while (!iter->done && (n < maxRecords))
+  {
+    if (!iter->started)
+    {
+      /* the initialized entry may itself be in the table */
+      iter->started = 1;
+      if (ofdpaFlowStatsGet(&iter->cursor, &stats) == OFDPA_E_NONE)
+      {
+        records[n].flow = iter->cursor;
+        memset(&records[n].stats, 0, sizeof(records[n].stats));
+        if (iter->flags & OFDPA_DUMP_F_STATS)
+        {
+          records[n].stats = stats;
+        }
+        n++;
+        continue;
+      }
+    }
+
+    if (ofdpaFlowNextGet(&iter->cursor, &iter->cursor) != OFDPA_E_NONE)
+    {
+      iter->done = 1;
+      break;
+    }
+
+    records[n].flow = iter->cursor;
+    memset(&records[n].stats, 0, sizeof(records[n].stats));
+    if (iter->flags & OFDPA_DUMP_F_STATS)
+    {
+      ofdpaFlowStatsGet(&iter->cursor, &records[n].stats);
+    }
+    n++;
+  }
+
+  return n;
+}
+
+/*****************************************************************//**
+* @brief  Start walking the group table.
+*
+* @param[in]    groupType      only groups of this type, if typeSpecified
+* @param[in]    typeSpecified  nonzero to filter on groupType
+* @param[in]    flags          OFDPA_DUMP_F_*
+* @param[out]   iter           iterator for ofdpaGroupTableDumpNext
+*
+*********************************************************************/
+static inline void ofdpaGroupTableDumpStart(OFDPA_GROUP_ENTRY_TYPE_t groupType,
+                                            int typeSpecified,
+                                            uint32_t flags,
+                                            ofdpaGroupDumpIter_t *iter)
+{
+  memset(iter, 0, sizeof(*iter));
+  iter->groupType = groupType;
+  iter->typeSpecified = typeSpecified;
+  iter->flags = flags;
+  ofdpaGroupTypeSet(&iter->cursor.groupId, typeSpecified ? groupType : 0);
+}
+
+/*****************************************************************//**
+* @brief  Get the next entries of the group table.
+*
+* @param[in]    iter        iterator from ofdpaGroupTableDumpStart
+* @param[out]   records     entries, with stats if asked for
+* @param[in]    maxRecords  size of records
+*
+* @returns  number of records filled in, 0 at the end of the table
+*
+*********************************************************************/
+static inline int ofdpaGroupTableDumpNext(ofdpaGroupDumpIter_t *iter,
+                                          ofdpaGroupDumpRecord_t *records,
+                                          int maxRecords)
+{
+  ofdpaGroupEntryStats_t stats;
+  uint32_t currentType;
+  int n = 0;
+
+  while (!iter->done && (n < maxRecords))
+  {
+    if (!iter->started)
+    {
+      /* the first group id of the type may itself be in the table */
+      iter->started = 1;
+      if (ofdpaGroupStatsGet(iter->cursor.groupId, &stats) == OFDPA_E_NONE)
+      {
+        records[n].group = iter->cursor;
+        memset(&records[n].stats, 0, sizeof(records[n].stats));
+        if (iter->flags & OFDPA_DUMP_F_STATS)
+        {
+          records[n].stats = stats;
+        }
+        n++;
+        continue;
+      }
+    }
+
+    if (ofdpaGroupNextGet(iter->cursor.groupId, &iter->cursor) != OFDPA_E_NONE)
+    {
+      iter->done = 1;
+      break;
+    }
+
+    /* groups are ordered by type, so the first of another type ends the walk */
+    if (iter->typeSpecified &&
+        ((ofdpaGroupTypeGet(iter->cursor.groupId, &currentType) != OFDPA_E_NONE) ||
+         (currentType != iter->groupType)))
+    {
+      iter->done = 1;
+      break;
+    }
+
+    records[n].group = iter->cursor;
+    memset(&records[n].stats, 0, sizeof(records[n].stats));
+    if (iter->flags & OFDPA_DUMP_F_STATS)
+    {
+      ofdpaGroupStatsGet(iter->cursor.groupId, &records[n].stats);
+    }
+    n++;
+  }
+
+  return n;
+}
+
+/*****************************************************************//**
+* @brief  Parse the argument of a --format option.
+*
+* @returns  0 on success, -1 for an unknown format
+*
+*********************************************************************/
+static inline int ofdpaDumpFormatParse(const char *arg, OFDPA_DUMP_FORMAT_t *format)
+{
+  if (strcmp(arg, "text") == 0)
+  {
+    *format = OFDPA_DUMP_FORMAT_TEXT;
+  }
+  else if (strcmp(arg, "csv") == 0)
+  {
+    *format = OFDPA_DUMP_FORMAT_CSV;
+  }
+  else if (strcmp(arg, "json") == 0)
+  {
+    *format = OFDPA_DUMP_FORMAT_JSON;
+  }
+  else
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/*****************************************************************//**
+* @brief  Print a string as a quoted CSV field or JSON string.
+*
+*********************************************************************/
+static inline void ofdpaDumpStringPrint(const char *s, OFDPA_DUMP_FORMAT_t format)
+{
+  putchar('"');
+  for (; *s != '\0'; s++)
+  {
+    if (*s == '"')
+    {
+      fputs((format == OFDPA_DUMP_FORMAT_CSV) ? "\"\"" : "\\\"", stdout);
+    }
+    else if ((format == OFDPA_DUMP_FORMAT_JSON) && (*s == '\\'))
+    {
+      fputs("\\\\", stdout);
+    }
+    else if ((unsigned char)*s < 0x20)
+    {
+      /* the decode functions use tabs and line breaks for layout */
+      putchar(' ');
+    }
+    else
+    {
+      putchar(*s);
+    }
+  }
+  putchar('"');
+}
+
+#endif /* INCLUDE_OFDPA_DUMP_H */
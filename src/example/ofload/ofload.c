@@ -0,0 +1,1162 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ofload.c
+*
+* @purpose      Controller load generator for the OF Agent. Opens a
+*               number of OpenFlow 1.3 sessions to ofagentapp and drives
+*               them with a scripted mix of flow-mods, barriers,
+*               statistics requests and packet-outs.
+*
+* @component    Unit Test
+*
+* @comments     Start the agent with a listener, for example
+*               "ofagentapp -l 0.0.0.0:6653", and point ofload at it.
+*
+*               A script is a list of "option value" lines using the
+*               long option names below. Each "duration" line ends a
+*               phase: the settings made so far run for that many
+*               seconds, and the lines after it change them for the
+*               next phase.
+*
+* @create
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <argp.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <loci/loci.h>
+
+const char *argp_program_version = "ofload v1.0";
+
+#define OFLOAD_VERSION            OF_VERSION_1_3
+
+#define OFLOAD_MAX_SESSIONS       64
+#define OFLOAD_MAX_PHASES         64
+#define OFLOAD_MAX_PENDING        64      /* multipart requests per session */
+#define OFLOAD_BARRIER_RING       4096    /* barriers in flight per session */
+#define OFLOAD_TX_HIGH_WATER      (1024 * 1024)
+#define OFLOAD_RX_CHUNK           (64 * 1024)
+#define OFLOAD_CONNECT_TIMEOUT_US 5000000ULL
+#define OFLOAD_REPORT_US          1000000ULL
+
+/* Flows go to the OF-DPA ACL policy table and drop, so that they are
+   accepted without any groups having to exist */
+#define OFLOAD_FLOW_TABLE_ID      60
+#define OFLOAD_FLOW_PRIORITY      1000
+
+#define OFLOAD_MULTIPART_REPLY_MORE 0x0001
+
+/* OpenFlow 1.3 message types */
+#define OFLOAD_OFPT_ERROR           1
+#define OFLOAD_OFPT_ECHO_REQUEST    2
+#define OFLOAD_OFPT_FEATURES_REPLY  6
+#define OFLOAD_OFPT_MULTIPART_REPLY 19
+#define OFLOAD_OFPT_BARRIER_REPLY   21
+
+typedef enum
+{
+  OFLOAD_HIST_BARRIER = 0,
+  OFLOAD_HIST_FLOW_STATS,
+  OFLOAD_HIST_PORT_STATS,
+  OFLOAD_HIST_GROUP_STATS,
+  OFLOAD_HIST_COUNT
+} ofloadHistId_t;
+
+static const char *ofloadHistNames[OFLOAD_HIST_COUNT] =
+{
+  [OFLOAD_HIST_BARRIER]     = "flow-mod to barrier reply",
+  [OFLOAD_HIST_FLOW_STATS]  = "flow stats",
+  [OFLOAD_HIST_PORT_STATS]  = "port stats",
+  [OFLOAD_HIST_GROUP_STATS] = "group stats",
+};
+
+/*
+ * Latency histogram in microseconds. Values below 8 have a bucket each;
+ * above that every power of two is split in 8 buckets, so a bucket is
+ * never wider than 12.5% of its lower bound.
+ */
+#define OFLOAD_HIST_SUB_BITS 3
+#define OFLOAD_HIST_BUCKETS  (((32 - OFLOAD_HIST_SUB_BITS) + 1) << OFLOAD_HIST_SUB_BITS)
+
+typedef struct
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[OFLOAD_HIST_BUCKETS];
+} ofloadHist_t;
+
+/* Settings of one phase of the run */
+typedef struct
+{
+  uint32_t durationSec;
+  uint32_t flowModRate;         /* flow-mods per second over all sessions */
+  uint32_t flowWindow;          /* flows kept installed by each session */
+  uint32_t barrierInterval;     /* flow-mods between barriers, 0 for none */
+  uint32_t flowStatsMsec;
+  uint32_t portStatsMsec;
+  uint32_t groupStatsMsec;
+  uint32_t pktOutRate;          /* packet-outs per second over all sessions */
+  uint32_t pktOutPort;
+  uint32_t pktOutBytes;
+} ofloadPhase_t;
+
+typedef struct
+{
+  uint32_t xid;
+  uint64_t sentUs;
+  ofloadHistId_t hist;
+} ofloadPending_t;
+
+typedef struct
+{
+  int fd;
+  int index;
+  int ready;
+  uint32_t xid;
+
+  uint8_t *rxBuf;
+  size_t rxLen;
+  size_t rxSize;
+
+  uint8_t *txBuf;
+  size_t txOff;
+  size_t txLen;
+  size_t txSize;
+
+  /* Flows in [deleteNext, addNext) are installed */
+  uint64_t addNext;
+  uint64_t deleteNext;
+
+  double flowModCredit;
+  double pktOutCredit;
+
+  uint32_t sinceBarrier;
+  uint64_t batchStartUs;
+  uint32_t barrierXid[OFLOAD_BARRIER_RING];
+  uint64_t barrierUs[OFLOAD_BARRIER_RING];
+  uint32_t barrierHead;
+  uint32_t barrierCount;
+
+  ofloadPending_t pending[OFLOAD_MAX_PENDING];
+  int pendingCount;
+
+  uint64_t nextFlowStatsUs;
+  uint64_t nextPortStatsUs;
+  uint64_t nextGroupStatsUs;
+} ofloadSession_t;
+
+typedef struct
+{
+  uint64_t flowMods;
+  uint64_t barriers;
+  uint64_t multiparts;
+  uint64_t pktOuts;
+  uint64_t errors;
+  uint64_t rxBytes;
+  uint64_t txBytes;
+} ofloadCounters_t;
+
+/* The options we understand. */
+static struct argp_option options[] =
+{
+  { "sessions",   'n', "COUNT", 0, "Number of controller sessions to open (default 1).",                          0 },
+  { "flowmods",   'f', "RATE",  0, "Flow-mods per second over all sessions (default 1000).",                       0 },
+  { "flows",      'w', "COUNT", 0, "Flows each session keeps installed; past this each add is paired with a delete of the oldest flow (default 1000).", 0 },
+  { "barrier",    'b', "COUNT", 0, "Send a barrier after every COUNT flow-mods, 0 for none (default 100).",       0 },
+  { "flowstats",  'F', "MSEC",  0, "Flow stats request interval in ms on each session, 0 for none (default 0).",  0 },
+  { "portstats",  'P', "MSEC",  0, "Port stats request interval in ms on each session, 0 for none (default 0).",  0 },
+  { "groupstats", 'G', "MSEC",  0, "Group stats request interval in ms on each session, 0 for none (default 0).", 0 },
+  { "pktout",     'o', "RATE",  0, "Packet-outs per second over all sessions (default 0).",                        0 },
+  { "pktport",    'p', "PORT",  0, "Port the packet-outs are sent to (default 1).",                                0 },
+  { "pktsize",    'z', "BYTES", 0, "Packet-out frame size (default 64).",                                          0 },
+  { "duration",   'd', "SEC",   0, "Run the settings made so far for SEC seconds, ending a phase (default 10).",  0 },
+  { "script",     's', "FILE",  0, "Read \"option value\" lines from FILE.",                                      0 },
+  { 0 }
+};
+
+static char *agentAddress = "127.0.0.1:6653";
+static int sessionCount = 1;
+
+static ofloadPhase_t phases[OFLOAD_MAX_PHASES];
+static int phaseCount = 0;
+static ofloadPhase_t current =
+{
+  .durationSec = 10,
+  .flowModRate = 1000,
+  .flowWindow = 1000,
+  .barrierInterval = 100,
+  .pktOutPort = 1,
+  .pktOutBytes = 64,
+};
+static int currentChanged = 1;
+
+static ofloadSession_t *sessions;
+static ofloadHist_t hists[OFLOAD_HIST_COUNT];
+static ofloadHist_t intervalBarrierHist;
+static ofloadCounters_t totals;
+static ofloadCounters_t interval;
+static int errorsPrinted = 0;
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state);
+
+static uint64_t ofloadNowUs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static int ofloadHistIndex(uint64_t value)
+{
+  int msb;
+
+  if (value > 0xffffffffULL)
+  {
+    value = 0xffffffffULL;
+  }
+  if (value < (1 << OFLOAD_HIST_SUB_BITS))
+  {
+    return value;
+  }
+
+  msb = 63 - __builtin_clzll(value);
+  return ((msb - OFLOAD_HIST_SUB_BITS + 1) << OFLOAD_HIST_SUB_BITS) +
+    ((value >> (msb - OFLOAD_HIST_SUB_BITS)) & ((1 << OFLOAD_HIST_SUB_BITS) - 1));
+}
+
+/* Largest value counted in a bucket */
+static uint64_t ofloadHistBucketTop(int index)
+{
+  int group = index >> OFLOAD_HIST_SUB_BITS;
+  uint64_t sub = index & ((1 << OFLOAD_HIST_SUB_BITS) - 1);
+
+  if (group == 0)
+  {
+    return index;
+  }
+  return ((((1 << OFLOAD_HIST_SUB_BITS) + sub + 1) << (group - 1)) - 1);
+}
+
+static void ofloadHistAdd(ofloadHist_t *hist, uint64_t value)
+{
+  if ((hist->count == 0) || (value < hist->min))
+  {
+    hist->min = value;
+  }
+  if (value > hist->max)
+  {
+    hist->max = value;
+  }
+  hist->count++;
+  hist->sum += value;
+  hist->buckets[ofloadHistIndex(value)]++;
+}
+
+static uint64_t ofloadHistPercentile(const ofloadHist_t *hist, double percent)
+{
+  uint64_t target, seen = 0;
+  int i;
+
+  if (hist->count == 0)
+  {
+    return 0;
+  }
+
+  target = (uint64_t)((hist->count * percent) / 100.0);
+  if (target == 0)
+  {
+    target = 1;
+  }
+
+  for (i = 0; i < OFLOAD_HIST_BUCKETS; i++)
+  {
+    seen += hist->buckets[i];
+    if (seen >= target)
+    {
+      /* The bucket top may overstate the largest value seen */
+      return (ofloadHistBucketTop(i) < hist->max) ? ofloadHistBucketTop(i) : hist->max;
+    }
+  }
+  return hist->max;
+}
+
+static int ofloadUintParse(const char *arg, uint32_t *value)
+{
+  char *end;
+  unsigned long v;
+
+  errno = 0;
+  v = strtoul(arg, &end, 0);
+  if ((errno != 0) || (end == arg) || (*end != '\0') || (v > 0xffffffffUL))
+  {
+    return -1;
+  }
+  *value = v;
+  return 0;
+}
+
+static void ofloadScriptRead(const char *filename, struct argp_state *state)
+{
+  FILE *fp;
+  char line[256];
+  char *name, *value, *end;
+  int lineNum = 0;
+  int i;
+
+  fp = fopen(filename, "r");
+  if (fp == NULL)
+  {
+    argp_failure(state, 1, errno, "Cannot open script \"%s\"", filename);
+    return;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    lineNum++;
+    if ((end = strchr(line, '#')) != NULL)
+    {
+      *end = '\0';
+    }
+
+    name = strtok(line, " \t\r\n");
+    if (name == NULL)
+    {
+      continue;
+    }
+    value = strtok(NULL, " \t\r\n");
+
+    for (i = 0; options[i].name != NULL; i++)
+    {
+      if ((strcmp(options[i].name, name) == 0) && (options[i].key != 's'))
+      {
+        break;
+      }
+    }
+    if ((options[i].name == NULL) || (value == NULL))
+    {
+      argp_failure(state, 1, 0, "%s:%d: expected \"option value\"", filename, lineNum);
+      break;
+    }
+    if (parse_opt(options[i].key, value, state) != 0)
+    {
+      argp_failure(state, 1, 0, "%s:%d: bad value for %s", filename, lineNum, name);
+      break;
+    }
+  }
+
+  fclose(fp);
+}
+
+/* Parse a single option. */
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+  uint32_t value = 0;
+
+  if ((arg != NULL) && (key != 's') && (key != ARGP_KEY_ARG) &&
+      (ofloadUintParse(arg, &value) != 0))
+  {
+    argp_error(state, "Invalid number \"%s\"", arg);
+    return EINVAL;
+  }
+
+  switch (key)
+  {
+    case 'n':
+      if ((value == 0) || (value > OFLOAD_MAX_SESSIONS))
+      {
+        argp_error(state, "Sessions must be 1 to %d", OFLOAD_MAX_SESSIONS);
+        return EINVAL;
+      }
+      sessionCount = value;
+      break;
+
+    case 'f':
+      current.flowModRate = value;
+      currentChanged = 1;
+      break;
+
+    case 'w':
+      if ((value == 0) || (value > 0xffffff))
+      {
+        argp_error(state, "Flows must be 1 to %d", 0xffffff);
+        return EINVAL;
+      }
+      current.flowWindow = value;
+      currentChanged = 1;
+      break;
+
+    case 'b':
+      current.barrierInterval = value;
+      currentChanged = 1;
+      break;
+
+    case 'F':
+      current.flowStatsMsec = value;
+      currentChanged = 1;
+      break;
+
+    case 'P':
+      current.portStatsMsec = value;
+      currentChanged = 1;
+      break;
+
+    case 'G':
+      current.groupStatsMsec = value;
+      currentChanged = 1;
+      break;
+
+    case 'o':
+      current.pktOutRate = value;
+      currentChanged = 1;
+      break;
+
+    case 'p':
+      current.pktOutPort = value;
+      currentChanged = 1;
+      break;
+
+    case 'z':
+      if ((value < 14) || (value > 9000))
+      {
+        argp_error(state, "Packet size must be 14 to 9000 bytes");
+        return EINVAL;
+      }
+      current.pktOutBytes = value;
+      currentChanged = 1;
+      break;
+
+    case 'd':
+      if (phaseCount >= OFLOAD_MAX_PHASES)
+      {
+        argp_error(state, "At most %d phases", OFLOAD_MAX_PHASES);
+        return EINVAL;
+      }
+      current.durationSec = value;
+      phases[phaseCount++] = current;
+      currentChanged = 0;
+      break;
+
+    case 's':
+      ofloadScriptRead(arg, state);
+      break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num >= 1)
+      {
+        argp_usage(state);
+      }
+      agentAddress = arg;
+      break;
+
+    case ARGP_KEY_END:
+      /* Settings not closed by a duration run for the default time */
+      if (currentChanged && (phaseCount < OFLOAD_MAX_PHASES))
+      {
+        phases[phaseCount++] = current;
+      }
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+static int ofloadConnect(const char *address)
+{
+  struct addrinfo hints, *res;
+  char host[256];
+  char *port;
+  int fd, rc, one = 1;
+
+  strncpy(host, address, sizeof(host) - 1);
+  host[sizeof(host) - 1] = '\0';
+  port = strrchr(host, ':');
+  if (port == NULL)
+  {
+    fprintf(stderr, "Agent address \"%s\" is not IP:PORT\r\n", address);
+    return -1;
+  }
+  *port++ = '\0';
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  rc = getaddrinfo(host, port, &hints, &res);
+  if (rc != 0)
+  {
+    fprintf(stderr, "Cannot resolve %s: %s\r\n", address, gai_strerror(rc));
+    return -1;
+  }
+
+  fd = socket(res->ai_family, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    perror("socket");
+    freeaddrinfo(res);
+    return -1;
+  }
+  if (connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+  {
+    fprintf(stderr, "Cannot connect to %s: %s\r\n", address, strerror(errno));
+    close(fd);
+    freeaddrinfo(res);
+    return -1;
+  }
+  freeaddrinfo(res);
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static void ofloadTxReserve(ofloadSession_t *session, size_t bytes)
+{
+  if (session->txOff > 0)
+  {
+    memmove(session->txBuf, session->txBuf + session->txOff, session->txLen);
+    session->txOff = 0;
+  }
+  if (session->txLen + bytes > session->txSize)
+  {
+    session->txSize = (session->txLen + bytes) * 2;
+    session->txBuf = realloc(session->txBuf, session->txSize);
+    if (session->txBuf == NULL)
+    {
+      fprintf(stderr, "Out of memory\r\n");
+      exit(1);
+    }
+  }
+}
+
+/* Queue a message with the next xid of the session and free it */
+static uint32_t ofloadSend(ofloadSession_t *session, of_object_t *obj)
+{
+  uint8_t *msg = OF_OBJECT_TO_MESSAGE(obj);
+  uint32_t xid = ++session->xid;
+  uint8_t *dst;
+
+  ofloadTxReserve(session, obj->length);
+  dst = session->txBuf + session->txOff + session->txLen;
+  memcpy(dst, msg, obj->length);
+  dst[OF_MESSAGE_XID_OFFSET + 0] = xid >> 24;
+  dst[OF_MESSAGE_XID_OFFSET + 1] = xid >> 16;
+  dst[OF_MESSAGE_XID_OFFSET + 2] = xid >> 8;
+  dst[OF_MESSAGE_XID_OFFSET + 3] = xid;
+  session->txLen += obj->length;
+
+  of_object_delete(obj);
+  return xid;
+}
+
+static void ofloadRawSend(ofloadSession_t *session, const uint8_t *msg, size_t len)
+{
+  ofloadTxReserve(session, len);
+  memcpy(session->txBuf + session->txOff + session->txLen, msg, len);
+  session->txLen += len;
+}
+
+static int ofloadFlush(ofloadSession_t *session)
+{
+  ssize_t n;
+
+  while (session->txLen > 0)
+  {
+    n = send(session->fd, session->txBuf + session->txOff, session->txLen, MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      {
+        return 0;
+      }
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+    session->txOff += n;
+    session->txLen -= n;
+    totals.txBytes += n;
+    interval.txBytes += n;
+  }
+  session->txOff = 0;
+  return 0;
+}
+
+static of_object_t *ofloadFlowModNew(ofloadSession_t *session, uint64_t idx, int add)
+{
+  of_object_t *obj;
+  of_list_instruction_t *insts;
+  of_object_t *inst;
+  of_match_t match;
+
+  obj = add ? of_flow_add_new(OFLOAD_VERSION) : of_flow_delete_strict_new(OFLOAD_VERSION);
+  if (obj == NULL)
+  {
+    return NULL;
+  }
+
+  of_flow_modify_table_id_set(obj, OFLOAD_FLOW_TABLE_ID);
+  of_flow_modify_priority_set(obj, OFLOAD_FLOW_PRIORITY);
+  of_flow_modify_cookie_set(obj, idx);
+  of_flow_modify_buffer_id_set(obj, OF_BUFFER_ID_NO_BUFFER);
+  of_flow_modify_out_port_set(obj, OF_PORT_DEST_WILDCARD);
+  of_flow_modify_out_group_set(obj, OF_GROUP_ANY);
+
+  /* Each session owns a source address, each flow a destination */
+  memset(&match, 0, sizeof(match));
+  match.version = OFLOAD_VERSION;
+  match.fields.eth_type = 0x0800;
+  match.masks.eth_type = 0xffff;
+  match.fields.ipv4_src = 0xc0a80000 | session->index;
+  match.masks.ipv4_src = 0xffffffff;
+  match.fields.ipv4_dst = 0x0a000000 | (idx & 0xffffff);
+  match.masks.ipv4_dst = 0xffffffff;
+  if (of_flow_modify_match_set(obj, &match) != OF_ERROR_NONE)
+  {
+    of_object_delete(obj);
+    return NULL;
+  }
+
+  if (add)
+  {
+    insts = of_list_instruction_new(OFLOAD_VERSION);
+    inst = of_instruction_clear_actions_new(OFLOAD_VERSION);
+    of_list_append(insts, inst);
+    of_object_delete(inst);
+    if (of_flow_modify_instructions_set(obj, insts) != OF_ERROR_NONE)
+    {
+      of_object_delete(insts);
+      of_object_delete(obj);
+      return NULL;
+    }
+    of_object_delete(insts);
+  }
+
+  return obj;
+}
+
+static int ofloadBarrierSend(ofloadSession_t *session)
+{
+  uint32_t slot;
+
+  if (session->barrierCount >= OFLOAD_BARRIER_RING)
+  {
+    return -1;
+  }
+
+  slot = (session->barrierHead + session->barrierCount) % OFLOAD_BARRIER_RING;
+  session->barrierXid[slot] = ofloadSend(session, of_barrier_request_new(OFLOAD_VERSION));
+  session->barrierUs[slot] = session->batchStartUs;
+  session->barrierCount++;
+  session->sinceBarrier = 0;
+  return 0;
+}
+
+static void ofloadFlowModSend(ofloadSession_t *session, const ofloadPhase_t *phase, uint64_t now)
+{
+  of_object_t *obj;
+  int add;
+
+  /* Fill the window with adds, then alternate deletes of the oldest
+     flow and adds of a new one */
+  add = ((session->addNext - session->deleteNext) < phase->flowWindow);
+  obj = ofloadFlowModNew(session, add ? session->addNext : session->deleteNext, add);
+  if (obj == NULL)
+  {
+    fprintf(stderr, "Cannot build flow-mod\r\n");
+    exit(1);
+  }
+  (void)ofloadSend(session, obj);
+
+  if (add)
+  {
+    session->addNext++;
+  }
+  else
+  {
+    session->deleteNext++;
+  }
+
+  if (session->sinceBarrier == 0)
+  {
+    session->batchStartUs = now;
+  }
+  session->sinceBarrier++;
+  totals.flowMods++;
+  interval.flowMods++;
+
+  if ((phase->barrierInterval != 0) && (session->sinceBarrier >= phase->barrierInterval))
+  {
+    (void)ofloadBarrierSend(session);
+  }
+}
+
+static void ofloadMultipartSend(ofloadSession_t *session, ofloadHistId_t hist, uint64_t now)
+{
+  of_object_t *obj;
+  ofloadPending_t *pending;
+
+  /* Skip a period rather than stack requests the agent has not answered */
+  if (session->pendingCount >= OFLOAD_MAX_PENDING)
+  {
+    return;
+  }
+
+  switch (hist)
+  {
+    case OFLOAD_HIST_FLOW_STATS:
+      obj = of_flow_stats_request_new(OFLOAD_VERSION);
+      of_flow_stats_request_table_id_set(obj, OF_TABLE_ALL);
+      of_flow_stats_request_out_port_set(obj, OF_PORT_DEST_WILDCARD);
+      of_flow_stats_request_out_group_set(obj, OF_GROUP_ANY);
+      break;
+    case OFLOAD_HIST_PORT_STATS:
+      obj = of_port_stats_request_new(OFLOAD_VERSION);
+      of_port_stats_request_port_no_set(obj, OF_PORT_DEST_WILDCARD);
+      break;
+    case OFLOAD_HIST_GROUP_STATS:
+      obj = of_group_stats_request_new(OFLOAD_VERSION);
+      of_group_stats_request_group_id_set(obj, OF_GROUP_ALL);
+      break;
+    default:
+      return;
+  }
+
+  pending = &session->pending[session->pendingCount++];
+  pending->xid = ofloadSend(session, obj);
+  pending->sentUs = now;
+  pending->hist = hist;
+}
+
+static void ofloadPktOutSend(ofloadSession_t *session, const ofloadPhase_t *phase)
+{
+  static uint8_t frame[9000];
+  of_packet_out_t *obj;
+  of_list_action_t *actions;
+  of_action_output_t *action;
+  of_octets_t data;
+
+  if (frame[0] == 0)
+  {
+    /* Broadcast frame from a locally administered address */
+    memset(frame, 0xff, 6);
+    frame[6] = 0x02;
+    frame[11] = 0x01;
+    frame[12] = 0x88;
+    frame[13] = 0xb5;
+  }
+
+  obj = of_packet_out_new(OFLOAD_VERSION);
+  of_packet_out_buffer_id_set(obj, OF_BUFFER_ID_NO_BUFFER);
+  of_packet_out_in_port_set(obj, OF_PORT_DEST_CONTROLLER);
+
+  actions = of_list_action_new(OFLOAD_VERSION);
+  action = of_action_output_new(OFLOAD_VERSION);
+  of_action_output_port_set(action, phase->pktOutPort);
+  of_list_append(actions, action);
+  of_object_delete(action);
+
+  data.data = frame;
+  data.bytes = phase->pktOutBytes;
+  if ((of_packet_out_actions_set(obj, actions) != OF_ERROR_NONE) ||
+      (of_packet_out_data_set(obj, &data) != OF_ERROR_NONE))
+  {
+    fprintf(stderr, "Cannot build packet-out\r\n");
+    exit(1);
+  }
+  of_object_delete(actions);
+
+  (void)ofloadSend(session, obj);
+  totals.pktOuts++;
+  interval.pktOuts++;
+}
+
+static void ofloadMessageHandle(ofloadSession_t *session, uint8_t *msg, uint16_t len, uint64_t now)
+{
+  of_message_t m = (of_message_t)msg;
+  uint32_t xid = of_message_xid_get(m);
+  uint32_t slot;
+  int i;
+
+  switch (of_message_type_get(m))
+  {
+    case OFLOAD_OFPT_ECHO_REQUEST:
+      msg[OF_MESSAGE_TYPE_OFFSET] = OFLOAD_OFPT_ECHO_REQUEST + 1;
+      ofloadRawSend(session, msg, len);
+      break;
+
+    case OFLOAD_OFPT_FEATURES_REPLY:
+      session->ready = 1;
+      break;
+
+    case OFLOAD_OFPT_BARRIER_REPLY:
+      /* Barriers are answered in order */
+      while (session->barrierCount > 0)
+      {
+        slot = session->barrierHead;
+        session->barrierHead = (session->barrierHead + 1) % OFLOAD_BARRIER_RING;
+        session->barrierCount--;
+        if (session->barrierXid[slot] == xid)
+        {
+          ofloadHistAdd(&hists[OFLOAD_HIST_BARRIER], now - session->barrierUs[slot]);
+          ofloadHistAdd(&intervalBarrierHist, now - session->barrierUs[slot]);
+          totals.barriers++;
+          interval.barriers++;
+          break;
+        }
+      }
+      break;
+
+    case OFLOAD_OFPT_MULTIPART_REPLY:
+      if ((len >= 12) && ((((msg[10] << 8) | msg[11]) & OFLOAD_MULTIPART_REPLY_MORE) != 0))
+      {
+        break;
+      }
+      for (i = 0; i < session->pendingCount; i++)
+      {
+        if (session->pending[i].xid == xid)
+        {
+          ofloadHistAdd(&hists[session->pending[i].hist], now - session->pending[i].sentUs);
+          session->pending[i] = session->pending[--session->pendingCount];
+          totals.multiparts++;
+          interval.multiparts++;
+          break;
+        }
+      }
+      break;
+
+    case OFLOAD_OFPT_ERROR:
+      totals.errors++;
+      interval.errors++;
+      if ((errorsPrinted < 10) && (len >= OF_MESSAGE_MIN_ERROR_LENGTH))
+      {
+        printf("session %d: error type %u code %u for xid %u\r\n", session->index,
+               (msg[8] << 8) | msg[9], (msg[10] << 8) | msg[11], xid);
+        if (++errorsPrinted == 10)
+        {
+          printf("further errors are only counted\r\n");
+        }
+      }
+      break;
+
+    default:
+      /* Hello, packet-ins, port status and flow removed */
+      break;
+  }
+}
+
+static int ofloadReceive(ofloadSession_t *session, uint64_t now)
+{
+  size_t off = 0;
+  ssize_t n;
+  uint16_t len;
+
+  if (session->rxSize - session->rxLen < OFLOAD_RX_CHUNK)
+  {
+    session->rxSize = session->rxLen + (2 * OFLOAD_RX_CHUNK);
+    session->rxBuf = realloc(session->rxBuf, session->rxSize);
+    if (session->rxBuf == NULL)
+    {
+      fprintf(stderr, "Out of memory\r\n");
+      exit(1);
+    }
+  }
+
+  n = recv(session->fd, session->rxBuf + session->rxLen, session->rxSize - session->rxLen, 0);
+  if (n == 0)
+  {
+    return -1;
+  }
+  if (n < 0)
+  {
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? 0 : -1;
+  }
+  session->rxLen += n;
+  totals.rxBytes += n;
+  interval.rxBytes += n;
+
+  while (session->rxLen - off >= OF_MESSAGE_HEADER_LENGTH)
+  {
+    len = of_message_length_get((of_message_t)(session->rxBuf + off));
+    if (len < OF_MESSAGE_HEADER_LENGTH)
+    {
+      fprintf(stderr, "session %d: bad message length %u\r\n", session->index, len);
+      return -1;
+    }
+    if (session->rxLen - off < len)
+    {
+      break;
+    }
+    ofloadMessageHandle(session, session->rxBuf + off, len, now);
+    off += len;
+  }
+
+  memmove(session->rxBuf, session->rxBuf + off, session->rxLen - off);
+  session->rxLen -= off;
+  return 0;
+}
+
+/* Work due on a session since the last pass */
+static void ofloadSessionRun(ofloadSession_t *session, const ofloadPhase_t *phase,
+                             uint64_t now, uint64_t elapsedUs)
+{
+  double flowModCap = (phase->flowModRate / (double)sessionCount) / 10.0;
+  double pktOutCap = (phase->pktOutRate / (double)sessionCount) / 10.0;
+
+  /* Credit for at most 100ms of work so a stall is not made up in a burst */
+  session->flowModCredit += (phase->flowModRate * (double)elapsedUs) / (1e6 * sessionCount);
+  if (session->flowModCredit > flowModCap + 1)
+  {
+    session->flowModCredit = flowModCap + 1;
+  }
+  session->pktOutCredit += (phase->pktOutRate * (double)elapsedUs) / (1e6 * sessionCount);
+  if (session->pktOutCredit > pktOutCap + 1)
+  {
+    session->pktOutCredit = pktOutCap + 1;
+  }
+
+  while ((session->flowModCredit >= 1) &&
+         (session->txLen < OFLOAD_TX_HIGH_WATER) &&
+         (session->barrierCount < OFLOAD_BARRIER_RING))
+  {
+    ofloadFlowModSend(session, phase, now);
+    session->flowModCredit -= 1;
+  }
+
+  while ((session->pktOutCredit >= 1) && (session->txLen < OFLOAD_TX_HIGH_WATER))
+  {
+    ofloadPktOutSend(session, phase);
+    session->pktOutCredit -= 1;
+  }
+
+  if ((phase->flowStatsMsec != 0) && (now >= session->nextFlowStatsUs))
+  {
+    ofloadMultipartSend(session, OFLOAD_HIST_FLOW_STATS, now);
+    session->nextFlowStatsUs = now + (phase->flowStatsMsec * 1000ULL);
+  }
+  if ((phase->portStatsMsec != 0) && (now >= session->nextPortStatsUs))
+  {
+    ofloadMultipartSend(session, OFLOAD_HIST_PORT_STATS, now);
+    session->nextPortStatsUs = now + (phase->portStatsMsec * 1000ULL);
+  }
+  if ((phase->groupStatsMsec != 0) && (now >= session->nextGroupStatsUs))
+  {
+    ofloadMultipartSend(session, OFLOAD_HIST_GROUP_STATS, now);
+    session->nextGroupStatsUs = now + (phase->groupStatsMsec * 1000ULL);
+  }
+}
+
+static void ofloadIntervalReport(double seconds, double intervalSec)
+{
+  printf("%8.1f %10.0f %10.0f %10" PRIu64 " %10" PRIu64 " %10.0f %10.0f %8" PRIu64 "\r\n",
+         seconds,
+         interval.flowMods / intervalSec,
+         interval.barriers / intervalSec,
+         ofloadHistPercentile(&intervalBarrierHist, 50),
+         ofloadHistPercentile(&intervalBarrierHist, 99),
+         interval.multiparts / intervalSec,
+         interval.pktOuts / intervalSec,
+         interval.errors);
+  fflush(stdout);
+
+  memset(&interval, 0, sizeof(interval));
+  memset(&intervalBarrierHist, 0, sizeof(intervalBarrierHist));
+}
+
+static void ofloadSummary(double seconds)
+{
+  int i;
+
+  printf("\r\n%.1f seconds, %d session%s\r\n", seconds, sessionCount, (sessionCount == 1) ? "" : "s");
+  printf("  flow-mods    %12" PRIu64 " (%.0f/s)\r\n", totals.flowMods, totals.flowMods / seconds);
+  printf("  barriers     %12" PRIu64 " (%.0f/s)\r\n", totals.barriers, totals.barriers / seconds);
+  printf("  multiparts   %12" PRIu64 " (%.0f/s)\r\n", totals.multiparts, totals.multiparts / seconds);
+  printf("  packet-outs  %12" PRIu64 " (%.0f/s)\r\n", totals.pktOuts, totals.pktOuts / seconds);
+  printf("  errors       %12" PRIu64 "\r\n", totals.errors);
+  printf("  sent         %12" PRIu64 " bytes (%.1f Mbit/s)\r\n", totals.txBytes, (totals.txBytes * 8) / (seconds * 1e6));
+  printf("  received     %12" PRIu64 " bytes (%.1f Mbit/s)\r\n", totals.rxBytes, (totals.rxBytes * 8) / (seconds * 1e6));
+
+  printf("\r\nLatency in microseconds:\r\n");
+  printf("%-26s %9s %9s %9s %9s %9s %9s %9s %9s\r\n",
+         "", "count", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+  for (i = 0; i < OFLOAD_HIST_COUNT; i++)
+  {
+    if (hists[i].count == 0)
+    {
+      continue;
+    }
+    printf("%-26s %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 "\r\n",
+           ofloadHistNames[i], hists[i].count, hists[i].min, hists[i].sum / hists[i].count,
+           ofloadHistPercentile(&hists[i], 50), ofloadHistPercentile(&hists[i], 90),
+           ofloadHistPercentile(&hists[i], 99), ofloadHistPercentile(&hists[i], 99.9),
+           hists[i].max);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  struct argp argp =
+  {
+    .args_doc = "[IP:PORT]",
+    .doc      = "Drives the OF Agent at IP:PORT (default 127.0.0.1:6653) from one or more "
+                "OpenFlow 1.3 controller sessions and reports throughput and latency.",
+    .options  = options,
+    .parser   = parse_opt,
+  };
+  struct pollfd pfds[OFLOAD_MAX_SESSIONS];
+  ofloadSession_t *session;
+  uint64_t start, now, last, lastReport, phaseEnd;
+  int i, p, readyCount;
+
+  argp_parse(&argp, argc, argv, 0, 0, 0);
+
+  sessions = calloc(sessionCount, sizeof(*sessions));
+  if (sessions == NULL)
+  {
+    fprintf(stderr, "Out of memory\r\n");
+    return 1;
+  }
+
+  for (i = 0; i < sessionCount; i++)
+  {
+    session = &sessions[i];
+    session->index = i;
+    session->fd = ofloadConnect(agentAddress);
+    if (session->fd < 0)
+    {
+      return 1;
+    }
+    (void)ofloadSend(session, of_hello_new(OFLOAD_VERSION));
+    (void)ofloadSend(session, of_features_request_new(OFLOAD_VERSION));
+  }
+
+  /* Wait for the features reply on every session */
+  start = ofloadNowUs();
+  do
+  {
+    readyCount = 0;
+    for (i = 0; i < sessionCount; i++)
+    {
+      pfds[i].fd = sessions[i].fd;
+      pfds[i].events = POLLIN | ((sessions[i].txLen > 0) ? POLLOUT : 0);
+    }
+    (void)poll(pfds, sessionCount, 10);
+    now = ofloadNowUs();
+    for (i = 0; i < sessionCount; i++)
+    {
+      if ((ofloadFlush(&sessions[i]) < 0) ||
+          (((pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) != 0) && (ofloadReceive(&sessions[i], now) < 0)))
+      {
+        fprintf(stderr, "session %d: connection closed during handshake\r\n", i);
+        return 1;
+      }
+      readyCount += sessions[i].ready;
+    }
+    if (now - start > OFLOAD_CONNECT_TIMEOUT_US)
+    {
+      fprintf(stderr, "%d of %d sessions did not complete the handshake\r\n",
+              sessionCount - readyCount, sessionCount);
+      return 1;
+    }
+  } while (readyCount < sessionCount);
+
+  printf("%8s %10s %10s %10s %10s %10s %10s %8s\r\n",
+         "time", "flowmod/s", "barrier/s", "p50 us", "p99 us", "mpart/s", "pktout/s", "errors");
+
+  start = last = lastReport = ofloadNowUs();
+  phaseEnd = start;
+  for (p = 0; p < phaseCount; p++)
+  {
+    phaseEnd += phases[p].durationSec * 1000000ULL;
+    if (phaseCount > 1)
+    {
+      printf("phase %d: %u flow-mod/s, %u flows, barrier every %u, stats %u/%u/%u ms, %u pktout/s\r\n",
+             p + 1, phases[p].flowModRate, phases[p].flowWindow, phases[p].barrierInterval,
+             phases[p].flowStatsMsec, phases[p].portStatsMsec, phases[p].groupStatsMsec,
+             phases[p].pktOutRate);
+    }
+
+    while ((now = ofloadNowUs()) < phaseEnd)
+    {
+      for (i = 0; i < sessionCount; i++)
+      {
+        session = &sessions[i];
+        ofloadSessionRun(session, &phases[p], now, now - last);
+        if (ofloadFlush(session) < 0)
+        {
+          fprintf(stderr, "session %d: send failed: %s\r\n", i, strerror(errno));
+          return 1;
+        }
+        pfds[i].fd = session->fd;
+        pfds[i].events = POLLIN | ((session->txLen > 0) ? POLLOUT : 0);
+      }
+      last = now;
+
+      (void)poll(pfds, sessionCount, 1);
+      now = ofloadNowUs();
+      for (i = 0; i < sessionCount; i++)
+      {
+        if (((pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) != 0) &&
+            (ofloadReceive(&sessions[i], now) < 0))
+        {
+          fprintf(stderr, "session %d: connection closed by the agent\r\n", i);
+          ofloadSummary((now - start) / 1e6);
+          return 1;
+        }
+      }
+
+      if (now - lastReport >= OFLOAD_REPORT_US)
+      {
+        ofloadIntervalReport((now - start) / 1e6, (now - lastReport) / 1e6);
+        lastReport = now;
+      }
+    }
+  }
+
+  ofloadSummary((ofloadNowUs() - start) / 1e6);
+
+  for (i = 0; i < sessionCount; i++)
+  {
+    close(sessions[i].fd);
+    free(sessions[i].rxBuf);
+    free(sessions[i].txBuf);
+  }
+  free(sessions);
+
+  return 0;
+}
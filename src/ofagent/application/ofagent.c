@@ -60,6 +60,7 @@
 #include <OFStateManager/ofstatemanager.h>
 #include <indigo/forwarding.h>
 #include <ind_ofdpa_util.h>
+#include <ind_ofdpa_telemetry.h>
 
 #define PIDFILE "/var/run/ofagent/.pid"
 
@@ -99,8 +100,73 @@ typedef struct
   int           debugComps[10]; // 10: TODO: update from OF Agent debug levels
 #endif
   of_dpid_t     dpid;
+  uint32_t      statsCacheMs;
+  uint32_t      portStatsMs;
+  uint32_t      meterStatsMs;
+  uint32_t      groupStatsMs;
+  uint32_t      ecmpSlots;
+  uint32_t      oamStatsMs;
+  uint32_t      portEventMs;
+  uint32_t      pktCaptureSize;
+  uint32_t      pktCaptureSample;
+  uint32_t      pktBuffers;
+  uint32_t      pktInGlobalPps;
+  uint32_t      pktInPortPps;
+  uint32_t      pktInReasonPps;
+  uint32_t      puntDedupMs;
+  uint32_t      puntDedupBytes;
+  uint32_t      l2LearnMs;
+  uint32_t      l2AgeSec;
+  int           eventThread;
+  int           pktThread;
+  int           pktTxThread;
+  int           flowThread;
+  int           flowUnits;
+  uint32_t      flowUnitPorts;
+  int           statsThread;
+  int           oamProtection;
+  int           routeCompress;
+  int           aclCompile;
+  char         *telemetryDest;
+  char         *tunnelConfig;
+  char         *ttpFile;
+  char         *warmRestartFile;
+  char         *cxnCaptureFile;
+  char         *counterStoreFile;
+  uint32_t      warmSaveSec;
+  uint32_t      telemetrySet;
+  uint16_t      metricsPort;
+  char         *metricsAddr;
+  uint32_t      stallBudgetMs;
+  char         *loopCpus;
+  char         *workerCpus;
+  char         *rtPolicy;
+  int           lockMemory;
+  int           hugePages;
+  indigo_core_disconnected_mode_t disconnectedMode;
+  int           agentExpiry;
+  uint32_t      retryMaxMs;
+  char         *mplsLabelRanges;
+  int           cookieIndexShift;
+  int           cookieIndexBits;
+  int           contentChecksums;
+  int           statsThreads;
+  int           auxiliaryCount;
+  int           pktInBatch;
+  char         *tlsFiles;
+  int           ktls;
 } arguments_t;
 
+/* Keys of the options without a short form */
+#define OPT_WARM_SAVE 256
+#define OPT_METRICS_ADDR 257
+#define OPT_PKTIN_BATCH 258
+#define OPT_PUNT_DEDUP 259
+#define OPT_PUNT_DEDUP_BYTES 260
+#define OPT_CXN_CAPTURE 261
+#define OPT_FLOW_UNITS 262
+#define OPT_COUNTER_STORE 263
+
 /* The options we understand. */
 static struct argp_option options[] =
 {
@@ -109,9 +175,62 @@ static struct argp_option options[] =
   { "ofdpadebuglvl", 'd', "OFDPADEBUGLVL",  0, "The verbosity of OF-DPA debug messages.",                             0 },
   { "ofdpadebugcomp",'c', "OFPDACOMPONENT", 0, "The OF-DPA component for which debug messages are enabled.",          0 },
 #endif /* OFAGENT_APP */
-  { "controller", 't', "IP:PORT", 0,  "Controller" },
+  { "controller", 't', "[tls:]IP:PORT", 0,  "Controller" },
+  { "auxiliary", 'N', "COUNT", 0,  "Open COUNT auxiliary connections to each OpenFlow 1.3 controller and send packet-ins on them." },
+  { "pktinbatch", OPT_PKTIN_BATCH, "COUNT", 0,  "Send up to COUNT packet-ins per BSN packet-in batch message to the controllers, which must understand them, 0 to disable." },
+  { "tls", 'Y', "CERT,KEY[,CA]", 0,  "Certificate and key presented to tls: controllers, and the CA certificates they are verified against." },
+  { "ktls", 'k', 0, 0,  "Use kernel TLS for tls: controllers when the kernel supports it." },
   { "listen",   'l',  "IP:PORT", 0,  "Listen" },
   { "dpid", 'i',  "DATAPATHID", 0,  "Specify Datapath ID." },
+  { "statscache", 's', "MSEC", 0,  "Flow counter cache refresh interval in ms, 0 to disable. The cache is only refreshed while flow counters are read." },
+  { "portstats", 'S', "MSEC", 0,  "Port counter collection interval in ms, 0 to read counters on each request." },
+  { "meterstats", 'M', "MSEC", 0,  "Meter counter collection interval in ms, 0 to read counters on each request." },
+  { "groupstats", 'g', "MSEC", 0,  "Group counter collection interval in ms, 0 to read counters on each request." },
+  { "ecmpslots", 'e', "SLOTS", 0,  "Program ECMP groups as SLOTS resilient hash slots so member changes only move the flows of the slots remapped, 0 to disable." },
+  { "oamstats", 'o', "MSEC", 0,  "OAM MEP state collection interval in ms, 0 to read state on each request." },
+  { "portevents", 'E', "MSEC", 0,  "Window in ms in which port state changes are merged into one port status message, 0 to disable." },
+  { "pktcapture", 'p', "COUNT", 0,  "Number of recent packet-ins kept for capture, 0 to disable. Written to " IND_OFDPA_PKT_CAPTURE_FILE " on SIGHUP." },
+  { "pktsample", 'r', "N", 0,  "Capture one in every N packet-ins." },
+  { "pktbuffers", 'b', "COUNT", 0,  "Number of punted packets kept so that packet-ins are cut to the length the controller asked for and sent with a buffer_id, 0 to disable." },
+  { "pktinpps", 'G', "PPS", 0,  "Packet-in rate limit for the switch, 0 to disable." },
+  { "pktinportpps", 'P', "PPS", 0,  "Packet-in rate limit for each port, 0 to disable." },
+  { "pktinreasonpps", 'R', "PPS", 0,  "Packet-in rate limit for each packet-in reason, 0 to disable." },
+  { "puntdedup", OPT_PUNT_DEDUP, "MSEC", 0,  "Drop copies of a punted frame seen on the same port within MSEC ms, ahead of the packet-in rate limits, and send the controller a summary, 0 to disable." },
+  { "puntdedupbytes", OPT_PUNT_DEDUP_BYTES, "BYTES", 0,  "Leading bytes of a punted frame compared to find copies." },
+  { "l2learn", 'L', "MSEC", 0,  "Learn source MACs in the agent, installing bridging entries every MSEC ms and sending the controller a summary, 0 to disable." },
+  { "l2age", 'A', "SEC", 0,  "Idle time in seconds after which addresses learned in the agent age out." },
+  { "eventthread", 'T', 0, 0,  "Receive OF-DPA flow, port and OAM events in a separate thread." },
+  { "pktthread", 'F', 0, 0,  "Receive punted packets and build packet-ins in a separate thread." },
+  { "pkttxthread", 'B', 0, 0,  "Send packet-outs to OF-DPA from a separate thread." },
+  { "flowthread", 'f', 0, 0,  "Add batched flows to OF-DPA from a separate thread while the rest of the batch is translated." },
+  { "flowunits", OPT_FLOW_UNITS, "N[:PORTS]", 0,  "Use a flow submit thread for each of N switch units, with PORTS ports on each unit. Implies --flowthread." },
+  { "oamprotect", 'O', 0, 0,  "Fail over MPLS-TP protection groups in the agent when a protected MEP loses its remote MEPs." },
+  { "routecompress", 'z', 0, 0,  "Only install the Unicast Routing flows that forward differently from the shorter prefix covering them." },
+  { "aclcompile", 'y', 0, 0,  "Merge and hide Policy ACL flows before installing them, at a few OF-DPA priorities." },
+  { "statsthread", 'W', 0, 0,  "Collect flow, port, queue, meter and group counters and OAM MEP state in a separate thread." },
+  { "telemetry", 'x', "IP:PORT", 0,  "Stream counter changes as UDP datagrams to IP:PORT." },
+  { "metrics", 'm', "PORT", 0,  "Serve OpenMetrics counters over HTTP at GET /metrics on PORT, refreshed every second." },
+  { "metricsaddr", OPT_METRICS_ADDR, "IP", 0,  "Address the metrics endpoint listens on. The endpoint is not authenticated. Defaults to " IND_OFDPA_METRICS_ADDR "." },
+  { "stallbudget", 'U', "MSEC", 0,  "Record recent control plane events and write them to " IND_OFDPA_STALL_RECORD_FILE " when one event loop iteration takes longer than MSEC ms, 0 to disable." },
+  { "loopcpus", 'n', "CPUS", 0,  "Run the event loop on CPUS, a list such as 2-3,6." },
+  { "workercpus", 'J', "CPUS", 0,  "Run the driver worker threads on CPUS, a list such as 2-3,6." },
+  { "rtprio", 'Q', "fifo:PRIO|rr:PRIO", 0,  "Run the event loop with the SCHED_FIFO or SCHED_RR policy at priority PRIO." },
+  { "mlock", 'Z', 0, 0,  "Lock all agent memory so the event loop does not wait on page faults." },
+  { "hugepages", 'H', 0, 0,  "Back the packet buffer pools with huge pages when the kernel has them reserved." },
+  { "disconnected", 'D', "MODE", 0,  "What to do with the flows when all controllers disconnect: sticky keeps them, closed keeps them and lets them expire, reconcile keeps them and on reconnect deletes those the controller does not add again." },
+  { "expiry", 'h', "MODE", 0,  "Which side ages flows with timeouts: hardware programs the timeouts into OF-DPA and sends flow removed messages from its flow events, agent ages them in the state manager from the flow counters." },
+  { "retrymax", 'I', "MSEC", 0,  "Longest delay in ms between attempts to connect to a controller." },
+  { "mplslabels", 'q', "RANGES", 0,  "Comma separated FIRST-LAST MPLS label ranges whose label tables are set up at startup and from which label runs are allocated." },
+  { "telemetryset", 'X', "CLASSES", 0,  "Comma separated counters to stream: port, flow, group, oam." },
+  { "tunnelconfig", 'u', "FILE", 0,  "Program the VXLAN tunnel next hops, tenants and ports in FILE. Reapplied on SIGHUP." },
+  { "ttp", 'j', "FILE", 0,  "Answer table features and check flows against the OF-DPA Table Type Pattern in FILE." },
+  { "warmrestart", 'w', "FILE", 0,  "Save the flows, groups and meters to FILE on exit and take them back on the next start without reprogramming OF-DPA." },
+  { "counterstore", OPT_COUNTER_STORE, "FILE", 0,  "Keep the port counters in FILE so that they keep counting up across agent and OF-DPA restarts." },
+  { "cxncapture", OPT_CXN_CAPTURE, "FILE", 0,  "Capture the bytes received from the controllers to FILE, for replay with cxn_replay.py." },
+  { "warmsave", OPT_WARM_SAVE, "SEC", 0,  "Also save the warm restart state every SEC seconds, so that it is taken back after a crash. Each save writes the whole state from the event loop." },
+  { "contentchecksum", 'K', 0, 0,  "Checksum flows for controller resync by their match and instructions instead of their cookie." },
+  { "cookieindex", 'C', "SHIFT:BITS", 0,  "Index flows by BITS cookie bits starting at bit SHIFT, for controllers that keep an application ID below the top cookie byte." },
+  { "statsencode", 'v', "THREADS", 0,  "Encode large flow stats replies on THREADS threads besides the event loop, 0 to disable." },
   { 0 }
 };
 
@@ -137,6 +256,10 @@ parse_controller(const char *str,
   strtok_state = buf;
 
   proto->protocol = INDIGO_CXN_PROTO_TCP_OVER_IPV4;
+  if (strncmp(buf, "tls:", 4) == 0) {
+      proto->protocol = INDIGO_CXN_PROTO_TLS_OVER_IPV4;
+      strtok_state = buf + 4;
+  }
 
   ip = strtok_r(NULL, ":/", &strtok_state);
   if (ip == NULL) {
@@ -178,6 +301,52 @@ sighup_callback(int socket_id, void *cookie,
         /* silence warn_unused_result */
     }
     AIM_LOG_MSG("Received SIGHUP");
+
+    ind_ofdpa_punt_dedup_show();
+    ind_ofdpa_pktin_rl_show();
+    ind_ofdpa_pkt_thread_show();
+    ind_ofdpa_packet_out_show();
+    ind_ofdpa_flow_expiry_show();
+    ind_ofdpa_pkt_tx_thread_show();
+    ind_ofdpa_flow_submit_thread_show();
+    ind_ofdpa_pdu_tx_show();
+    ind_ofdpa_vlan_stats_show();
+    ind_ofdpa_vlan_member_show();
+    ind_ofdpa_flow_template_show();
+    ind_ofdpa_punt_show();
+    ind_ofdpa_route_compress_show();
+    ind_ofdpa_acl_compile_show();
+    ind_ofdpa_group_modify_show();
+    ind_ofdpa_pkt_buffer_show();
+    ind_ofdpa_port_stats_show();
+    ind_ofdpa_counter_store_show();
+    ind_ofdpa_port_event_show();
+    ind_ofdpa_event_stats_show();
+    ind_ofdpa_oam_notify_show();
+    ind_ofdpa_oam_protection_show();
+    ind_ofdpa_l2_learn_show();
+    ind_ofdpa_metrics_show();
+    ind_ofdpa_sched_show();
+    (void)ind_ofdpa_tunnel_config_reload();
+    ind_soc_stats_show(&aim_pvs_stdout);
+    ind_soc_profile_show(&aim_pvs_stdout, 0);
+    ind_soc_recorder_show(&aim_pvs_stdout);
+    ind_ofdpa_mpls_label_show(&aim_pvs_stdout);
+    if (ind_ofdpa_rpc_profiling) {
+        ind_ofdpa_rpc_stats_show(&aim_pvs_stdout);
+    }
+
+    if (ind_ofdpa_pkt_capture_enabled()) {
+        ind_ofdpa_pkt_capture_show();
+        (void)ind_ofdpa_pkt_capture_pcap_write(IND_OFDPA_PKT_CAPTURE_FILE);
+    }
+}
+
+/* A crash loses what changed since the last save, not the whole state */
+static void
+warm_save_timer(void *cookie)
+{
+    (void)ind_core_warm_save(cookie);
 }
 
 static void
@@ -284,6 +453,497 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 
     break;
 
+    case 's':                           /* flow counter cache interval */
+      errno = 0;
+
+      arguments->statsCacheMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid statscache \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'S':                           /* port counter collection interval */
+      errno = 0;
+
+      arguments->portStatsMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid portstats \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'M':                           /* meter counter collection interval */
+      errno = 0;
+
+      arguments->meterStatsMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid meterstats \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'g':                           /* group counter collection interval */
+      errno = 0;
+
+      arguments->groupStatsMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid groupstats \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'e':                           /* resilient ECMP slots */
+      errno = 0;
+
+      arguments->ecmpSlots = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid ecmpslots \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'o':                           /* OAM MEP state collection interval */
+      errno = 0;
+
+      arguments->oamStatsMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid oamstats \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'E':                           /* port event coalescing window */
+      errno = 0;
+
+      arguments->portEventMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid portevents \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'p':                           /* packet capture ring size */
+      errno = 0;
+
+      arguments->pktCaptureSize = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid pktcapture \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'b':                           /* packet-in buffers */
+      errno = 0;
+
+      arguments->pktBuffers = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid pktbuffers \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'r':                           /* packet capture sample rate */
+      errno = 0;
+
+      arguments->pktCaptureSample = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid pktsample \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'G':                           /* packet-in rate limit */
+    case 'P':                           /* per port packet-in rate limit */
+    case 'R':                           /* per reason packet-in rate limit */
+    {
+      uint32_t pps;
+
+      errno = 0;
+
+      pps = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid packet-in rate \"%s\"", arg);
+        return errno;
+      }
+
+      if (key == 'G')
+      {
+        arguments->pktInGlobalPps = pps;
+      }
+      else if (key == 'P')
+      {
+        arguments->pktInPortPps = pps;
+      }
+      else
+      {
+        arguments->pktInReasonPps = pps;
+      }
+    }
+    break;
+
+    case OPT_PUNT_DEDUP:                /* duplicate punt window */
+      errno = 0;
+
+      arguments->puntDedupMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid puntdedup \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case OPT_PUNT_DEDUP_BYTES:          /* duplicate punt compared bytes */
+      errno = 0;
+
+      arguments->puntDedupBytes = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid puntdedupbytes \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'L':                           /* agent MAC learning batch interval */
+      errno = 0;
+
+      arguments->l2LearnMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid l2learn \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'A':                           /* agent MAC learning aging time */
+      errno = 0;
+
+      arguments->l2AgeSec = strtoul(arg, NULL, 0);
+      if ((errno != 0) || (arguments->l2AgeSec == 0))
+      {
+        argp_error(state, "Invalid l2age \"%s\"", arg);
+        return EINVAL;
+      }
+
+    break;
+
+    case 'T':                           /* driver event thread */
+      arguments->eventThread = 1;
+      break;
+
+    case 'F':                           /* packet-in fast path thread */
+      arguments->pktThread = 1;
+      break;
+
+    case 'B':                           /* packet-out transmit thread */
+      arguments->pktTxThread = 1;
+      break;
+
+    case 'f':                           /* flow submit thread */
+      arguments->flowThread = 1;
+      break;
+
+    case OPT_FLOW_UNITS:                /* flow submit thread per unit */
+    {
+      char *end;
+
+      errno = 0;
+      arguments->flowUnits = strtoul(arg, &end, 0);
+      if ((errno == 0) && (*end == ':'))
+      {
+        arguments->flowUnitPorts = strtoul(end + 1, &end, 0);
+      }
+      if ((errno != 0) || (*end != '\0') ||
+          (arguments->flowUnits < 1) ||
+          (arguments->flowUnits > IND_OFDPA_FLOW_SUBMIT_MAX_UNITS))
+      {
+        argp_error(state, "Invalid flowunits \"%s\"", arg);
+        return EINVAL;
+      }
+      arguments->flowThread = 1;
+    }
+    break;
+
+    case 'O':                           /* agent-local OAM protection */
+      arguments->oamProtection = 1;
+      break;
+
+    case 'z':                           /* routing table compression */
+      arguments->routeCompress = 1;
+      break;
+
+    case 'y':                           /* ACL policy table compilation */
+      arguments->aclCompile = 1;
+      break;
+
+    case 'W':                           /* counter collector thread */
+      arguments->statsThread = 1;
+      break;
+
+    case 'x':                           /* telemetry destination */
+      arguments->telemetryDest = arg;
+      break;
+
+    case 'u':                           /* tunnel config file */
+      arguments->tunnelConfig = arg;
+      break;
+
+    case 'm':                           /* metrics port */
+    {
+      char *endptr;
+      long port = strtol(arg, &endptr, 0);
+
+      if ((*arg == '\0') || (*endptr != '\0') || (port <= 0) || (port > 65535))
+      {
+        argp_error(state, "Invalid metrics port \"%s\"", arg);
+        return EINVAL;
+      }
+      arguments->metricsPort = port;
+      break;
+    }
+
+    case OPT_METRICS_ADDR:              /* metrics listen address */
+    {
+      struct in_addr sa;
+
+      if (inet_pton(AF_INET, arg, &sa) != 1)
+      {
+        argp_error(state, "Invalid metrics address \"%s\"", arg);
+        return EINVAL;
+      }
+      arguments->metricsAddr = arg;
+      break;
+    }
+
+    case 'U':                           /* stall budget */
+      errno = 0;
+
+      arguments->stallBudgetMs = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid stallbudget \"%s\"", arg);
+        return errno;
+      }
+
+      break;
+
+    case 'n':                           /* event loop CPUs */
+      arguments->loopCpus = arg;
+      break;
+
+    case 'J':                           /* worker thread CPUs */
+      arguments->workerCpus = arg;
+      break;
+
+    case 'Q':                           /* real-time policy */
+      arguments->rtPolicy = arg;
+      break;
+
+    case 'Z':                           /* lock memory */
+      arguments->lockMemory = 1;
+      break;
+
+    case 'H':                           /* huge pages */
+      arguments->hugePages = 1;
+      break;
+
+    case 'D':                           /* disconnected mode */
+      if (strcmp(arg, "sticky") == 0)
+      {
+        arguments->disconnectedMode = INDIGO_CORE_DISCONNECTED_MODE_STICKY;
+      }
+      else if (strcmp(arg, "closed") == 0)
+      {
+        arguments->disconnectedMode = INDIGO_CORE_DISCONNECTED_MODE_CLOSED;
+      }
+      else if (strcmp(arg, "reconcile") == 0)
+      {
+        arguments->disconnectedMode = INDIGO_CORE_DISCONNECTED_MODE_RECONCILE;
+      }
+      else
+      {
+        argp_error(state, "Invalid disconnected mode \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
+    case 'h':                           /* flow expiry */
+      if (strcmp(arg, "hardware") == 0)
+      {
+        arguments->agentExpiry = 0;
+      }
+      else if (strcmp(arg, "agent") == 0)
+      {
+        arguments->agentExpiry = 1;
+      }
+      else
+      {
+        argp_error(state, "Invalid expiry mode \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
+    case 'I':                           /* connection retry limit */
+      errno = 0;
+
+      arguments->retryMaxMs = strtoul(arg, NULL, 0);
+      if ((errno != 0) || (arguments->retryMaxMs == 0))
+      {
+        argp_error(state, "Invalid retrymax \"%s\"", arg);
+        return EINVAL;
+      }
+
+      break;
+
+    case 'q':                           /* MPLS label ranges */
+      arguments->mplsLabelRanges = arg;
+      break;
+
+    case 'j':                           /* TTP file */
+      arguments->ttpFile = arg;
+      break;
+
+    case 'w':                           /* warm restart state file */
+      arguments->warmRestartFile = arg;
+      break;
+
+    case OPT_CXN_CAPTURE:               /* controller session capture */
+      arguments->cxnCaptureFile = arg;
+      break;
+
+    case OPT_COUNTER_STORE:             /* persistent port counters */
+      arguments->counterStoreFile = arg;
+      break;
+
+    case OPT_WARM_SAVE:                 /* warm restart save interval */
+    {
+      char *end;
+
+      errno = 0;
+      arguments->warmSaveSec = strtoul(arg, &end, 0);
+      if ((errno != 0) || (*arg == '\0') || (*end != '\0') ||
+          (arguments->warmSaveSec > UINT32_MAX / 1000))
+      {
+        argp_error(state, "Invalid warmsave interval \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+    }
+
+    case 'X':                           /* telemetry sampling set */
+    {
+      char *list = strdup(arg);
+      char *cls, *saveptr = NULL;
+
+      arguments->telemetrySet = 0;
+      for (cls = strtok_r(list, ",", &saveptr); cls != NULL; cls = strtok_r(NULL, ",", &saveptr))
+      {
+        if (strcmp(cls, "port") == 0)
+        {
+          arguments->telemetrySet |= IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_PORT);
+        }
+        else if (strcmp(cls, "flow") == 0)
+        {
+          arguments->telemetrySet |= IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_FLOW);
+        }
+        else if (strcmp(cls, "group") == 0)
+        {
+          arguments->telemetrySet |= IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_GROUP);
+        }
+        else if (strcmp(cls, "oam") == 0)
+        {
+          arguments->telemetrySet |= IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_OAM);
+        }
+        else
+        {
+          free(list);
+          argp_error(state, "Invalid telemetryset \"%s\"", arg);
+          return EINVAL;
+        }
+      }
+      free(list);
+    }
+    break;
+
+    case 'N':                           /* auxiliary connections */
+      errno = 0;
+      arguments->auxiliaryCount = strtoul(arg, NULL, 0);
+      if ((errno != 0) || (arguments->auxiliaryCount > 8))
+      {
+        argp_error(state, "Invalid auxiliary \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
+    case OPT_PKTIN_BATCH:               /* packet-ins per batch */
+      errno = 0;
+      arguments->pktInBatch = strtoul(arg, NULL, 0);
+      if ((errno != 0) || (arguments->pktInBatch > 0xffff))
+      {
+        argp_error(state, "Invalid pktinbatch \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
+    case 'Y':                           /* TLS files */
+      arguments->tlsFiles = arg;
+      break;
+
+    case 'k':                           /* kernel TLS */
+      arguments->ktls = 1;
+      break;
+
+    case 'K':                           /* flow content checksums */
+      arguments->contentChecksums = 1;
+      break;
+
+    case 'C':                           /* cookie range index */
+      if ((sscanf(arg, "%d:%d", &arguments->cookieIndexShift,
+                  &arguments->cookieIndexBits) != 2) ||
+          (arguments->cookieIndexShift < 0) ||
+          (arguments->cookieIndexBits <= 0) ||
+          (arguments->cookieIndexShift + arguments->cookieIndexBits > 64))
+      {
+        argp_error(state, "Invalid cookieindex \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
+    case 'v':                           /* flow stats encoding threads */
+      errno = 0;
+
+      arguments->statsThreads = strtoul(arg, NULL, 0);
+      if ((errno != 0) || (arguments->statsThreads > 64))
+      {
+        argp_error(state, "Invalid statsencode \"%s\"", arg);
+        return EINVAL;
+      }
+      break;
+
     case ARGP_KEY_NO_ARGS:
     case ARGP_KEY_END:
       break;
@@ -392,8 +1052,6 @@ static void
 ind_ofdpa_event_socket_ready(int socket_id, void *cookie, int read_ready,
                             int write_ready, int error_seen)
 {
-  struct timeval timeout;
-
   if (!read_ready)
   {
     AIM_LOG_ERROR("Error: read not ready for connection");
@@ -406,14 +1064,7 @@ ind_ofdpa_event_socket_ready(int socket_id, void *cookie, int read_ready,
     return;
   }
 
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-
-  while ((ofdpaEventReceive(&timeout)) == OFDPA_E_NONE)
-  {
-    ind_ofdpa_flow_event_receive();
-    ind_ofdpa_port_event_receive();
-  }
+  ind_ofdpa_event_dispatch();
   return;
 }
 
@@ -468,6 +1119,56 @@ int main(int argc, char *argv[])
     .debugComps = { 0 },
 #endif
     .dpid = OFSTATEMANAGER_CONFIG_DPID_DEFAULT,
+    .statsCacheMs = IND_OFDPA_FLOW_STATS_CACHE_INTERVAL_MS,
+    .portStatsMs = IND_OFDPA_PORT_STATS_CACHE_INTERVAL_MS,
+    .meterStatsMs = IND_OFDPA_METER_STATS_CACHE_INTERVAL_MS,
+    .groupStatsMs = IND_OFDPA_GROUP_STATS_CACHE_INTERVAL_MS,
+    .ecmpSlots = 0,
+    .oamStatsMs = IND_OFDPA_OAM_CACHE_INTERVAL_MS,
+    .portEventMs = IND_OFDPA_PORT_EVENT_COALESCE_MS,
+    .pktCaptureSize = 0,
+    .pktCaptureSample = 1,
+    .pktBuffers = 0,
+    .pktInGlobalPps = IND_OFDPA_PKTIN_RL_GLOBAL_PPS,
+    .pktInPortPps = IND_OFDPA_PKTIN_RL_PORT_PPS,
+    .pktInReasonPps = IND_OFDPA_PKTIN_RL_REASON_PPS,
+    .puntDedupMs = IND_OFDPA_PUNT_DEDUP_WINDOW_MS,
+    .puntDedupBytes = IND_OFDPA_PUNT_DEDUP_BYTES,
+    .l2LearnMs = 0,
+    .l2AgeSec = IND_OFDPA_L2_LEARN_AGE_SEC,
+    .eventThread = 0,
+    .pktThread = 0,
+    .pktTxThread = 0,
+    .flowThread = 0,
+    .flowUnits = 1,
+    .flowUnitPorts = 0,
+    .statsThread = 0,
+    .oamProtection = 0,
+    .routeCompress = 0,
+    .aclCompile = 0,
+    .telemetryDest = NULL,
+    .metricsPort = 0,
+    .metricsAddr = IND_OFDPA_METRICS_ADDR,
+    .stallBudgetMs = 0,
+    .loopCpus = NULL,
+    .workerCpus = NULL,
+    .rtPolicy = NULL,
+    .lockMemory = 0,
+    .hugePages = 0,
+    .disconnectedMode = INDIGO_CORE_DISCONNECTED_MODE_STICKY,
+    .agentExpiry = 0,
+    .retryMaxMs = OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS,
+    .mplsLabelRanges = NULL,
+    .tunnelConfig = NULL,
+    .ttpFile = NULL,
+    .warmRestartFile = NULL,
+    .cxnCaptureFile = NULL,
+    .counterStoreFile = NULL,
+    .warmSaveSec = 0,
+    .telemetrySet = IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_PORT) |
+                    IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_FLOW) |
+                    IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_GROUP) |
+                    IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_OAM),
   };
 
   argp_program_version = ""; 
@@ -592,6 +1293,13 @@ int main(int argc, char *argv[])
     return rc;
   }
 
+  if (ind_ofdpa_sched_init(arguments.loopCpus, arguments.workerCpus, arguments.rtPolicy,
+                           arguments.lockMemory, arguments.hugePages) < 0) {
+      AIM_LOG_FATAL("Failed to apply CPU and memory settings");
+      return 1;
+  }
+
+  soc_cfg.flags = IND_SOC_CONFIG_F_EPOLL;
   if (ind_soc_init(&soc_cfg) < 0) {
       AIM_LOG_FATAL("Failed to initialize Indigo socket manager");
       return 1;
@@ -601,7 +1309,40 @@ int main(int argc, char *argv[])
       AIM_LOG_FATAL("Failed to initialize Indigo connection manager");
       return 1;
   }
+  ind_cxn_retry_max_set(arguments.retryMaxMs);
+
+  if ((arguments.cxnCaptureFile != NULL) &&
+      (ind_cxn_capture_start(arguments.cxnCaptureFile) < 0)) {
+      AIM_LOG_FATAL("Failed to start the controller session capture");
+      return 1;
+  }
 
+  if (arguments.tlsFiles != NULL) {
+      ind_cxn_tls_config_t tls = { .ktls = arguments.ktls };
+      char *files = strdup(arguments.tlsFiles);
+      char *saveptr = NULL;
+
+      tls.cert_file = strtok_r(files, ",", &saveptr);
+      tls.key_file = strtok_r(NULL, ",", &saveptr);
+      tls.ca_file = strtok_r(NULL, ",", &saveptr);
+      if (ind_cxn_tls_config_set(&tls) < 0) {
+          AIM_LOG_FATAL("Failed to configure TLS");
+          return 1;
+      }
+      free(files);
+  }
+
+  core_cfg.cookie_index_shift = arguments.cookieIndexShift;
+  core_cfg.cookie_index_bits = arguments.cookieIndexBits;
+  core_cfg.content_checksums = arguments.contentChecksums;
+  core_cfg.stats_threads = arguments.statsThreads;
+  core_cfg.disconnected_mode = arguments.disconnectedMode;
+  core_cfg.expire_flows = arguments.agentExpiry;
+  core_cfg.stats_check_ms = 1000;
+  core_cfg.hardware_expiry = !arguments.agentExpiry;
+  ind_ofdpa_flow_expiry_offload_set(!arguments.agentExpiry);
+  core_cfg.lpm_table_id = OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING;
+  core_cfg.l2_table_id = OFDPA_FLOW_TABLE_ID_BRIDGING;
   if (ind_core_init(&core_cfg) < 0) {
       AIM_LOG_FATAL("Failed to initialize Indigo core module");
       return 1;
@@ -624,6 +1365,167 @@ int main(int argc, char *argv[])
       return 1;
   }
 
+  if (ind_ofdpa_flow_stats_cache_init(arguments.statsCacheMs) < 0) {
+      AIM_LOG_FATAL("Failed to initialize flow counter cache");
+      return 1;
+  }
+
+  if ((arguments.counterStoreFile != NULL) &&
+      (ind_ofdpa_counter_store_init(arguments.counterStoreFile) < 0)) {
+      AIM_LOG_FATAL("Failed to open counter store %s", arguments.counterStoreFile);
+      return 1;
+  }
+
+  if (ind_ofdpa_port_stats_cache_init(arguments.portStatsMs) < 0) {
+      AIM_LOG_FATAL("Failed to initialize port counter collector");
+      return 1;
+  }
+
+  if (ind_ofdpa_meter_stats_cache_init(arguments.meterStatsMs) < 0) {
+      AIM_LOG_FATAL("Failed to initialize meter counter collector");
+      return 1;
+  }
+
+  if (ind_ofdpa_group_stats_cache_init(arguments.groupStatsMs) < 0) {
+      AIM_LOG_FATAL("Failed to initialize group counter collector");
+      return 1;
+  }
+
+  if (ind_ofdpa_group_resilient_init(arguments.ecmpSlots) < 0) {
+      AIM_LOG_FATAL("Failed to initialize resilient ECMP");
+      return 1;
+  }
+
+  if (ind_ofdpa_oam_protection_init(arguments.oamProtection) < 0) {
+      AIM_LOG_FATAL("Failed to initialize OAM protection switching");
+      return 1;
+  }
+
+  if (ind_ofdpa_oam_cache_init(arguments.oamStatsMs) < 0) {
+      AIM_LOG_FATAL("Failed to initialize OAM MEP collector");
+      return 1;
+  }
+
+  if (ind_ofdpa_telemetry_init(arguments.telemetryDest, arguments.telemetrySet) < 0) {
+      AIM_LOG_FATAL("Failed to initialize telemetry export");
+      return 1;
+  }
+
+  if ((arguments.stallBudgetMs != 0) &&
+      (ind_soc_recorder_enable(IND_OFDPA_STALL_RECORD_EVENTS, arguments.stallBudgetMs,
+                               IND_OFDPA_STALL_RECORD_FILE) < 0)) {
+      AIM_LOG_FATAL("Failed to initialize flight recorder");
+      return 1;
+  }
+
+  if (ind_ofdpa_metrics_init(arguments.metricsAddr, arguments.metricsPort,
+                             IND_OFDPA_METRICS_REFRESH_MS) < 0) {
+      AIM_LOG_FATAL("Failed to initialize metrics endpoint");
+      return 1;
+  }
+
+  if (ind_ofdpa_port_event_coalesce_init(arguments.portEventMs) < 0) {
+      AIM_LOG_FATAL("Failed to initialize port event coalescing");
+      return 1;
+  }
+
+  if (ind_ofdpa_pkt_capture_init(arguments.pktCaptureSize,
+                                 arguments.pktCaptureSample) < 0) {
+      AIM_LOG_FATAL("Failed to initialize packet capture");
+      return 1;
+  }
+
+  if (ind_ofdpa_pkt_buffer_init(arguments.pktBuffers) < 0) {
+      AIM_LOG_FATAL("Failed to initialize packet buffers");
+      return 1;
+  }
+
+  if (ind_ofdpa_pktin_rl_init(arguments.pktInGlobalPps,
+                              arguments.pktInPortPps,
+                              arguments.pktInReasonPps) < 0) {
+      AIM_LOG_FATAL("Failed to initialize packet-in rate limiter");
+      return 1;
+  }
+
+  if (ind_ofdpa_punt_dedup_init(arguments.puntDedupMs,
+                                arguments.puntDedupBytes) < 0) {
+      AIM_LOG_FATAL("Failed to initialize duplicate punt suppression");
+      return 1;
+  }
+
+  if (ind_ofdpa_l2_learn_init(arguments.l2LearnMs, arguments.l2AgeSec) < 0) {
+      AIM_LOG_FATAL("Failed to initialize MAC learning");
+      return 1;
+  }
+
+  if (ind_ofdpa_pdu_tx_init() < 0) {
+      AIM_LOG_FATAL("Failed to initialize periodic PDU transmission");
+      return 1;
+  }
+
+  if (ind_ofdpa_vlan_stats_init() < 0) {
+      AIM_LOG_FATAL("Failed to initialize VLAN counters");
+      return 1;
+  }
+
+  if (ind_ofdpa_flow_template_init() < 0) {
+      AIM_LOG_FATAL("Failed to initialize flow templates");
+      return 1;
+  }
+
+  if (ind_ofdpa_vlan_member_init() < 0) {
+      AIM_LOG_FATAL("Failed to initialize VLAN membership");
+      return 1;
+  }
+
+  if (ind_ofdpa_route_compress_init(arguments.routeCompress) < 0) {
+      AIM_LOG_FATAL("Failed to initialize route compression");
+      return 1;
+  }
+
+  if (ind_ofdpa_acl_compile_init(arguments.aclCompile) < 0) {
+      AIM_LOG_FATAL("Failed to initialize ACL compilation");
+      return 1;
+  }
+
+  if (ind_ofdpa_punt_init() < 0) {
+      AIM_LOG_FATAL("Failed to initialize packet-in cookies");
+      return 1;
+  }
+
+  if (ind_ofdpa_ttp_init(arguments.ttpFile) < 0) {
+      AIM_LOG_FATAL("Failed to load the TTP from %s", arguments.ttpFile);
+      return 1;
+  }
+
+  if (ind_ofdpa_mpls_label_init(arguments.mplsLabelRanges) < 0) {
+      AIM_LOG_FATAL("Failed to initialize MPLS label ranges");
+      return 1;
+  }
+
+  /* Pick up what the switch already holds before anything is programmed */
+  if (ind_ofdpa_startup_load() < 0) {
+      AIM_LOG_ERROR("Startup load of the driver state is incomplete");
+  }
+
+  if (ind_ofdpa_tunnel_init(arguments.tunnelConfig) < 0) {
+      AIM_LOG_FATAL("Failed to initialize tunnel objects");
+      return 1;
+  }
+
+  /* Restore before any controller can send flow mods */
+  if (arguments.warmRestartFile != NULL)
+  {
+    ind_core_warm_restore(arguments.warmRestartFile);
+
+    if ((arguments.warmSaveSec != 0) &&
+        (ind_soc_timer_event_register(warm_save_timer, arguments.warmRestartFile,
+                                      arguments.warmSaveSec * 1000) < 0))
+    {
+      AIM_LOG_ERROR("Failed to start saving the warm restart state");
+    }
+  }
+
   /* Add controllers from command line */
   {
       biglist_t *element;
@@ -644,6 +1546,8 @@ int main(int argc, char *argv[])
               .listen = 0,
               .periodic_echo_ms = 10000,
               .reset_echo_count = 3,
+              .auxiliary_count = arguments.auxiliaryCount,
+              .packet_in_batch_max = arguments.pktInBatch,
           };
 
           indigo_cxn_id_t cxn_id;
@@ -730,20 +1634,84 @@ int main(int argc, char *argv[])
       abort();
   }
 
-  if (ind_soc_socket_register(ofdpaClientEventSockFdGet(), ind_ofdpa_event_socket_ready, NULL) < 0)
+  if (arguments.eventThread)
+  {
+    if (ind_ofdpa_event_thread_start() < 0)
+    {
+      AIM_LOG_FATAL("Failed to start driver event thread");
+      return 1;
+    }
+  }
+  else if (ind_soc_socket_register_with_priority(ofdpaClientEventSockFdGet(), ind_ofdpa_event_socket_ready,
+                                                 NULL, IND_SOC_PRIORITY_FLOW) < 0)
   {
     return 1;
   }
 
-  if (ind_soc_socket_register(ofdpaClientPktSockFdGet(), ind_ofdpa_pkt_socket_ready, NULL) < 0)
+  if (arguments.pktThread)
+  {
+    if (ind_ofdpa_pkt_thread_start() < 0)
+    {
+      AIM_LOG_FATAL("Failed to start packet-in thread");
+      return 1;
+    }
+  }
+  else if (ind_soc_socket_register_with_priority(ofdpaClientPktSockFdGet(), ind_ofdpa_pkt_socket_ready,
+                                                 NULL, IND_SOC_PRIORITY_PACKET_IN) < 0)
   {
     return 1;
   }
 
+  if (arguments.pktTxThread)
+  {
+    if (ind_ofdpa_pkt_tx_thread_start() < 0)
+    {
+      AIM_LOG_FATAL("Failed to start packet-out thread");
+      return 1;
+    }
+  }
+
+  if (arguments.flowThread)
+  {
+    if (ind_ofdpa_flow_submit_thread_start(arguments.flowUnits,
+                                           arguments.flowUnitPorts) < 0)
+    {
+      AIM_LOG_FATAL("Failed to start flow submit thread");
+      return 1;
+    }
+  }
+
+  if (arguments.statsThread)
+  {
+    if (ind_ofdpa_collector_thread_start() < 0)
+    {
+      AIM_LOG_FATAL("Failed to start counter collector thread");
+      return 1;
+    }
+  }
+
   ind_soc_select_and_run(-1);
 
   AIM_LOG_MSG("Stopping %s", argp_program_version);
 
+  ind_ofdpa_event_thread_stop();
+  ind_ofdpa_pkt_thread_stop();
+  ind_ofdpa_pkt_tx_thread_stop();
+  ind_ofdpa_flow_submit_thread_stop();
+  ind_ofdpa_collector_thread_stop();
+  ind_ofdpa_metrics_finish();
+  ind_ofdpa_counter_store_finish();
+  ind_soc_recorder_disable();
+
+  if (arguments.warmRestartFile != NULL)
+  {
+    if (arguments.warmSaveSec != 0)
+    {
+      ind_soc_timer_event_unregister(warm_save_timer, arguments.warmRestartFile);
+    }
+    ind_core_warm_save(arguments.warmRestartFile);
+  }
+
   ind_core_finish();
   ind_cxn_finish();
   ind_soc_finish();
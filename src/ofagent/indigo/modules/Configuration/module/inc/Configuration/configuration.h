@@ -85,6 +85,20 @@ struct ind_cfg_ops {
      * for this entry.
      */
     const char *filename;
+
+    /**
+     * Configuration keys used by this module
+     *
+     * This is an optional NULL terminated list of paths, in the form
+     * accepted by ind_cfg_lookup. If it is set, a reload that leaves the
+     * values at all of these paths structurally unchanged skips the stage
+     * and commit calls for this module. If it is NULL the module is staged
+     * on every reload.
+     *
+     * The stage and commit functions may call ind_cfg_changed to find
+     * which of their keys changed.
+     */
+    const char * const *keys;
 };
 
 /* If entry's filename is NULL or empty string, use default config */
@@ -106,6 +120,59 @@ extern void ind_cfg_register(const struct ind_cfg_ops *ops);
  */
 extern indigo_error_t ind_cfg_load(void);
 
+/**
+ * Streamed configuration section
+ *
+ * Large sections of the default configuration file, such as per-port
+ * tables on a big chassis, can be consumed element by element as the
+ * file is read instead of through the tree passed to the stage
+ * functions. The section at path (an array or object, named as for
+ * ind_cfg_lookup) is then left out of that tree, and each of its
+ * elements is built, passed to the element callback and freed before
+ * the next is read. For an object section the member name is in
+ * element->string.
+ *
+ * The callbacks run while the file is parsed, before any stage
+ * function, and should only build staged state for the module's commit
+ * to apply. An error from any callback fails the reload. A streamed
+ * section always counts as changed for ind_cfg_ops.keys and
+ * ind_cfg_changed.
+ */
+struct ind_cfg_stream_ops {
+    const char *path;
+
+    /** Optional; called before the first element */
+    indigo_error_t (*begin)(void);
+
+    indigo_error_t (*element)(cJSON *element);
+
+    /** Optional; called after the last element */
+    indigo_error_t (*end)(void);
+};
+
+/**
+ * Register a streamed section
+ */
+extern void ind_cfg_stream_register(const struct ind_cfg_stream_ops *ops);
+
+/**
+ * Start a background reload of the configuration
+ *
+ * Runs the same steps as ind_cfg_load as a socket manager task, staging
+ * one module per step so a large configuration does not stall the event
+ * loop. A reload in progress is restarted. This is what the SIGHUP
+ * handler uses.
+ */
+extern indigo_error_t ind_cfg_reload_start(void);
+
+/**
+ * Whether the value at a path differs from the applied configuration
+ *
+ * Only meaningful inside stage and commit callbacks. Returns true on the
+ * first load, and when the path was added or removed.
+ */
+extern int ind_cfg_changed(const char *path);
+
 extern indigo_error_t ind_cfg_install_sighup_handler(void);
 
 extern indigo_error_t ind_cfg_filename_set(char *filename);
@@ -111,6 +111,16 @@
 #define CONFIGURATION_CONFIG_INCLUDE_UCLI 0
 #endif
 
+/**
+ * CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE
+ *
+ * Bytes read from a configuration file at a time by the streaming parser. */
+
+
+#ifndef CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE
+#define CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE 65536
+#endif
+
 
 
 /**
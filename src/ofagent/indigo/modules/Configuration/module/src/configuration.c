@@ -23,12 +23,47 @@
 #include <cjson/cJSON.h>
 #include <BigList/biglist.h>
 
-/* List of struct ind_cfg_ops pointers */
+/* A registered module */
+struct cfg_entry {
+    const struct ind_cfg_ops *ops;
+    cJSON *applied;     /* Non-default file entries: tree last committed */
+    int staged;         /* Staged in the reload in progress */
+};
+
+/* List of struct cfg_entry pointers */
 static biglist_t *cfg_registration_list;
 
 /* Filename that current_cfg was read from. */
 static char *current_filename;
 
+/* Default configuration tree last committed */
+static cJSON *applied_root;
+
+/*
+ * Trees compared by ind_cfg_changed while a module is staged or
+ * committed. diff_old is NULL on the first load.
+ */
+static cJSON *diff_old;
+static cJSON *diff_new;
+
+/* Reload in progress; see ind_cfg_reload_step */
+enum cfg_reload_state {
+    CFG_RELOAD_IDLE,
+    CFG_RELOAD_NONDEFAULT,
+    CFG_RELOAD_PARSE,
+    CFG_RELOAD_STAGE,
+    CFG_RELOAD_COMMIT,
+};
+
+static struct {
+    enum cfg_reload_state state;
+    biglist_t *next;    /* Next registration to process */
+    cJSON *root;        /* New default configuration tree */
+    int failed;
+    int staged;
+    int skipped;
+} reload;
+
 
 indigo_error_t
 ind_cfg_filename_set(char *filename)
@@ -72,188 +107,325 @@ ind_cfg_filename_get(char *filename, int maxlen)
 void
 ind_cfg_register(const struct ind_cfg_ops *ops)
 {
+    struct cfg_entry *entry;
+
     if (!IND_CFG_ENTRY_USES_DEFAULT(ops)) {
         AIM_LOG_INFO("Registering cfg client for %s", ops->filename);
     }
-    cfg_registration_list = biglist_append(cfg_registration_list, (void *)ops);
+    entry = aim_zmalloc(sizeof(*entry));
+    entry->ops = ops;
+    cfg_registration_list = biglist_append(cfg_registration_list, entry);
 }
 
 /*
- * Given the start of a string containing newlines and another pointer
- * inside that string, return the line and column number of that position.
+ * Structural comparison of two cJSON trees
  *
- * Line and column numbering starts at 1. Tab width is assumed to be 8.
+ * Object members are matched by name regardless of order; array
+ * elements are compared in order. Either tree may be NULL.
  */
-static void
-find_line_number(const char *start, const char *pos, int *line, int *col)
+static int
+cfg_node_equal(cJSON *a, cJSON *b)
 {
-    const char *cur = start;
-    const int tabwidth = 8;
-    *line = 1;
-    *col = 1;
-
-    while (cur < pos) {
-        if (*cur == '\n') {
-            (*line)++;
-            *col = 1;
-        } else if (*cur == '\t') {
-            (*col) += tabwidth - ((*col - 1) % tabwidth);
-        } else {
-            (*col)++;
+    cJSON *ca, *cb;
+
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+
+    if ((a->type & 0xff) != (b->type & 0xff)) {
+        return 0;
+    }
+
+    switch (a->type & 0xff) {
+    case cJSON_Number:
+        return a->valuedouble == b->valuedouble;
+    case cJSON_String:
+        return !strcmp(a->valuestring, b->valuestring);
+    case cJSON_Array:
+        for (ca = a->child, cb = b->child; ca && cb;
+             ca = ca->next, cb = cb->next) {
+            if (!cfg_node_equal(ca, cb)) {
+                return 0;
+            }
+        }
+        return ca == NULL && cb == NULL;
+    case cJSON_Object:
+        if (cJSON_GetArraySize(a) != cJSON_GetArraySize(b)) {
+            return 0;
+        }
+        for (ca = a->child; ca; ca = ca->next) {
+            if (!cfg_node_equal(ca, cJSON_GetObjectItem(b, ca->string))) {
+                return 0;
+            }
         }
-        cur++;
+        return 1;
+    default:
+        return 1;
     }
 }
 
-/*
- * Parse the given config file into a cJSON tree.
- *
- * If the config file is invalid, logs the errors and returns NULL.
- */
+/* Look up a path, treating a missing or unreachable node as NULL */
 static cJSON *
-parse_json_file(const char *filename)
+cfg_node_get(cJSON *root, const char *path)
 {
-    FILE *f;
-    long len;
-    char *data;
-    cJSON *root;
+    cJSON *node;
 
-    f = fopen(filename, "r");
-    if (f == NULL) {
-        AIM_LOG_ERROR("failed to open %s", filename);
+    if (root == NULL || ind_cfg_lookup(root, path, &node) < 0) {
         return NULL;
     }
 
-    fseek(f, 0, SEEK_END);
-    len = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    data = aim_malloc(len + 1);
-    if (fread(data, 1, len, f) == 0) {
-        free(data);
-        fclose(f);
-        AIM_LOG_ERROR("failed to read %s", filename);
-        return NULL;
+    return node;
+}
+
+int
+ind_cfg_changed(const char *path)
+{
+    if (diff_old == NULL || diff_new == NULL) {
+        return 1;
     }
-    data[len] = 0;
-    fclose(f);
 
-    root = cJSON_Parse(data);
-    if (!root) {
-        int line, col;
-        char *next_newline;
-        const char *errptr = cJSON_GetErrorPtr();
-        find_line_number(data, errptr, &line, &col);
+    /* Streamed sections are not kept in the tree, so can not be compared */
+    if (ind_cfg_stream_covers(path)) {
+        return 1;
+    }
 
-        /* Terminate the snippet before the next newline */
-        next_newline = strchr(errptr, '\n');
-        if (next_newline != NULL) {
-            *next_newline = '\0';
-        }
+    return !cfg_node_equal(cfg_node_get(diff_old, path),
+                           cfg_node_get(diff_new, path));
+}
 
-        AIM_LOG_ERROR("Error at line %d col %d: [%.8s]\n", line, col, errptr);
+/*
+ * Whether a module has to be staged for a new tree
+ *
+ * Modules that do not list their keys are always staged.
+ */
+static int
+cfg_entry_changed(const struct cfg_entry *entry, cJSON *old, cJSON *new)
+{
+    const char * const *key;
 
-        free(data);
-        return NULL;
+    if (old == NULL || entry->ops->keys == NULL) {
+        return 1;
     }
 
-    free(data);
+    for (key = entry->ops->keys; *key; key++) {
+        if (ind_cfg_stream_covers(*key) ||
+            !cfg_node_equal(cfg_node_get(old, *key), cfg_node_get(new, *key))) {
+            return 1;
+        }
+    }
 
-    return root;
+    return 0;
 }
 
 /*
- * Iterate thru the registered users and process any entries which
- * use a non-default configuration file
+ * Process an entry which uses a non-default configuration file
  */
 
 static void
-update_nondefault_config(void)
+update_nondefault_entry(struct cfg_entry *entry)
 {
+    const struct ind_cfg_ops *ops = entry->ops;
     cJSON *root;
-    biglist_t *el;
 
-    BIGLIST_FOREACH(el, cfg_registration_list) {
-        struct ind_cfg_ops *ops = el->data;
-        if (!IND_CFG_ENTRY_USES_DEFAULT(ops)) {
-            AIM_LOG_VERBOSE("Loading non-default cfg file %s", ops->filename);
-            root = parse_json_file(ops->filename);
-            if (root == NULL) {
-                /* parse_json_file() logged a detailed message. */
-                AIM_LOG_ERROR("Could not load non-default cfg file %s",
-                              ops->filename);
-            } else {
-                if (ops->stage(root) < 0) {
-                    AIM_LOG_ERROR("Failed to stage non-default cfg file %s",
-                                  ops->filename);
-                } else {
-                    ops->commit();
-                }
-                cJSON_Delete(root);
-            }
+    AIM_LOG_VERBOSE("Loading non-default cfg file %s", ops->filename);
+    root = ind_cfg_stream_parse(ops->filename, 0);
+    if (root == NULL) {
+        /* ind_cfg_stream_parse() logged a detailed message. */
+        AIM_LOG_ERROR("Could not load non-default cfg file %s",
+                      ops->filename);
+        return;
+    }
+
+    if (!cfg_entry_changed(entry, entry->applied, root)) {
+        AIM_LOG_VERBOSE("Non-default cfg file %s unchanged", ops->filename);
+        cJSON_Delete(root);
+        return;
+    }
+
+    diff_old = entry->applied;
+    diff_new = root;
+    if (ops->stage(root) < 0) {
+        AIM_LOG_ERROR("Failed to stage non-default cfg file %s",
+                      ops->filename);
+        cJSON_Delete(root);
+    } else {
+        ops->commit();
+        if (entry->applied != NULL) {
+            cJSON_Delete(entry->applied);
         }
+        entry->applied = root;
+    }
+    diff_old = diff_new = NULL;
+}
+
+/* Drop a reload in progress */
+static void
+reload_abort(void)
+{
+    if (reload.root != NULL) {
+        cJSON_Delete(reload.root);
+    }
+    memset(&reload, 0, sizeof(reload));
+}
+
+void
+ind_cfg_reload_begin(void)
+{
+    if (reload.state != CFG_RELOAD_IDLE) {
+        /* Stage functions tolerate being called again without a commit */
+        AIM_LOG_VERBOSE("Restarting configuration reload");
     }
+
+    reload_abort();
+    reload.state = CFG_RELOAD_NONDEFAULT;
+    reload.next = cfg_registration_list;
+}
+
+int
+ind_cfg_reload_active(void)
+{
+    return reload.state != CFG_RELOAD_IDLE;
 }
 
 /*
- * Load a configuration file.
- *
- * The file is parsed into a cJSON tree and passed to each registered
- * listener.
+ * Advance the reload in progress by one module
  *
- * Use current_filename as the source.
+ * Non-default entries are applied one per step. The default file is then
+ * parsed and diffed against the tree last committed; each module whose
+ * keys changed is staged in its own step. The commits all run in the
+ * final step so the rest of the system never sees a partly applied
+ * configuration.
  */
-indigo_error_t
-ind_cfg_load(void)
+int
+ind_cfg_reload_step(indigo_error_t *result)
 {
-    cJSON *root;
+    struct cfg_entry *entry;
     biglist_t *el;
-    int failed = 0;
 
-    /* Update any entries that use a non-default config file */
-    update_nondefault_config();
+    *result = INDIGO_ERROR_NONE;
 
-    if (current_filename == NULL) {
-        AIM_LOG_WARN("received SIGHUP but not using a config file");
-        return INDIGO_ERROR_NONE;
-    }
+    switch (reload.state) {
+    case CFG_RELOAD_IDLE:
+        return 1;
 
-    root = parse_json_file(current_filename);
-    if (root == NULL) {
-        /* parse_json_file() logged a detailed message. */
-        AIM_LOG_ERROR("Configuration unchanged; could not load %s.",
-                      current_filename);
-        return INDIGO_ERROR_PARSE;
-    }
+    case CFG_RELOAD_NONDEFAULT:
+        while (reload.next != NULL) {
+            entry = reload.next->data;
+            reload.next = reload.next->next;
+            if (!IND_CFG_ENTRY_USES_DEFAULT(entry->ops)) {
+                update_nondefault_entry(entry);
+                return 0;
+            }
+        }
+        reload.state = CFG_RELOAD_PARSE;
+        return 0;
+
+    case CFG_RELOAD_PARSE:
+        if (current_filename == NULL) {
+            AIM_LOG_WARN("received SIGHUP but not using a config file");
+            reload_abort();
+            return 1;
+        }
 
-    AIM_LOG_INFO("Staging new configuration");
+        reload.root = ind_cfg_stream_parse(current_filename, 1);
+        if (reload.root == NULL) {
+            /* ind_cfg_stream_parse() logged a detailed message. */
+            AIM_LOG_ERROR("Configuration unchanged; could not load %s.",
+                          current_filename);
+            reload_abort();
+            *result = INDIGO_ERROR_PARSE;
+            return 1;
+        }
 
-    BIGLIST_FOREACH(el, cfg_registration_list) {
-        struct ind_cfg_ops *ops = el->data;
-        if (IND_CFG_ENTRY_USES_DEFAULT(ops)) {
-            if (ops->stage(root) < 0) {
-                failed = 1;
+        AIM_LOG_INFO("Staging new configuration");
+        BIGLIST_FOREACH(el, cfg_registration_list) {
+            entry = el->data;
+            entry->staged = 0;
+        }
+        reload.next = cfg_registration_list;
+        reload.state = CFG_RELOAD_STAGE;
+        return 0;
+
+    case CFG_RELOAD_STAGE:
+        while (reload.next != NULL) {
+            entry = reload.next->data;
+            reload.next = reload.next->next;
+            if (!IND_CFG_ENTRY_USES_DEFAULT(entry->ops)) {
+                continue;
+            }
+            if (!cfg_entry_changed(entry, applied_root, reload.root)) {
+                reload.skipped++;
+                continue;
+            }
+            diff_old = applied_root;
+            diff_new = reload.root;
+            if (entry->ops->stage(reload.root) < 0) {
+                reload.failed = 1;
             }
+            diff_old = diff_new = NULL;
+            entry->staged = 1;
+            reload.staged++;
+            return 0;
         }
-    }
+        reload.state = CFG_RELOAD_COMMIT;
+        return 0;
 
-    cJSON_Delete(root);
+    case CFG_RELOAD_COMMIT:
+        if (reload.failed) {
+            AIM_LOG_WARN("Reconfiguration failed, new configuration not applied");
+            reload_abort();
+            *result = INDIGO_ERROR_UNKNOWN;
+            return 1;
+        }
 
-    if (failed == 0) {
         AIM_LOG_INFO("Committing new configuration");
 
+        diff_old = applied_root;
+        diff_new = reload.root;
         BIGLIST_FOREACH(el, cfg_registration_list) {
-            struct ind_cfg_ops *ops = el->data;
-            if (IND_CFG_ENTRY_USES_DEFAULT(ops)) {
-                ops->commit();
+            entry = el->data;
+            if (entry->staged) {
+                entry->ops->commit();
+                entry->staged = 0;
             }
         }
+        diff_old = diff_new = NULL;
 
-        AIM_LOG_INFO("Finished reconfiguration");
-        return INDIGO_ERROR_NONE;
-    } else {
-        AIM_LOG_WARN("Reconfiguration failed, new configuration not applied");
-        return INDIGO_ERROR_UNKNOWN;
+        if (applied_root != NULL) {
+            cJSON_Delete(applied_root);
+        }
+        applied_root = reload.root;
+        reload.root = NULL;
+
+        AIM_LOG_INFO("Finished reconfiguration; %d modules updated, "
+                     "%d unchanged", reload.staged, reload.skipped);
+        reload_abort();
+        return 1;
     }
+
+    return 1;
+}
+
+/*
+ * Load a configuration file.
+ *
+ * The file is parsed into a cJSON tree and passed to each registered
+ * listener whose part of the configuration changed.
+ *
+ * Use current_filename as the source. Any reload in progress is
+ * restarted and run to completion.
+ */
+indigo_error_t
+ind_cfg_load(void)
+{
+    indigo_error_t rv;
+
+    ind_cfg_reload_begin();
+    while (!ind_cfg_reload_step(&rv)) {
+        /* Run to completion */
+    }
+
+    return rv;
 }
 
 indigo_error_t
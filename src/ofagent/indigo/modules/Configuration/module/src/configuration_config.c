@@ -72,6 +72,11 @@ configuration_config_settings_t configuration_config_settings[] =
     { __configuration_config_STRINGIFY_NAME(CONFIGURATION_CONFIG_INCLUDE_UCLI), __configuration_config_STRINGIFY_VALUE(CONFIGURATION_CONFIG_INCLUDE_UCLI) },
 #else
 { CONFIGURATION_CONFIG_INCLUDE_UCLI(__configuration_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE
+    { __configuration_config_STRINGIFY_NAME(CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE), __configuration_config_STRINGIFY_VALUE(CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE) },
+#else
+{ CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE(__configuration_config_STRINGIFY_NAME), "__undefined__" },
 #endif
     { NULL, NULL }
 };
@@ -32,4 +32,18 @@
 #include "Configuration/configuration_config.h"
 #include "Configuration/configuration.h"
 
+/*
+ * Reload state machine shared by ind_cfg_load and the background reload
+ *
+ * ind_cfg_reload_step returns true once the reload started by
+ * ind_cfg_reload_begin has finished, with its status in *result.
+ */
+void ind_cfg_reload_begin(void);
+int ind_cfg_reload_step(indigo_error_t *result);
+int ind_cfg_reload_active(void);
+
+/* See configuration_stream.c */
+cJSON *ind_cfg_stream_parse(const char *filename, int streams);
+int ind_cfg_stream_covers(const char *path);
+
 #endif /* __CONFIGURATION_INT_H__ */
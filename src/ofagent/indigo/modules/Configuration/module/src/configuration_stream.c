@@ -0,0 +1,639 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Streaming JSON parser for configuration files
+ *
+ * The file is read CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE bytes at a
+ * time rather than all at once. The tree is built node by node, so no
+ * copy of the file text is held while it exists.
+ *
+ * Sections registered with ind_cfg_stream_register are not added to the
+ * tree. Each element of such a section is built as a small tree of its
+ * own, handed to the module and freed before the next one is read, so
+ * peak memory is bounded by the largest element rather than by the
+ * size of the section.
+ */
+
+#include <indigo/error.h>
+#include "configuration_int.h"
+#include "configuration_log.h"
+#include <cjson/cJSON.h>
+#include <BigList/biglist.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Nesting deeper than this is rejected rather than recursed into */
+#define CFG_STREAM_MAX_DEPTH 64
+
+/* Longest dotted path matched against stream registrations */
+#define CFG_STREAM_PATH_MAX 256
+
+/* List of struct ind_cfg_stream_ops pointers */
+static biglist_t *cfg_stream_list;
+
+struct cfg_reader {
+    FILE *f;
+    char *buf;
+    size_t len;
+    size_t pos;
+    int line;
+    int col;
+    int streams;        /* Deliver registered sections to modules */
+    const char *error;  /* Set on the first error */
+    char *tok;          /* Current string or number */
+    size_t tok_len;
+    size_t tok_size;
+    char path[CFG_STREAM_PATH_MAX];
+};
+
+static cJSON *parse_value(struct cfg_reader *r, int depth, int path_len);
+
+void
+ind_cfg_stream_register(const struct ind_cfg_stream_ops *ops)
+{
+    AIM_LOG_VERBOSE("Registering streamed cfg section %s", ops->path);
+    cfg_stream_list = biglist_append(cfg_stream_list, (void *)ops);
+}
+
+static const struct ind_cfg_stream_ops *
+cfg_stream_find(const char *path)
+{
+    biglist_t *el;
+
+    BIGLIST_FOREACH(el, cfg_stream_list) {
+        const struct ind_cfg_stream_ops *ops = el->data;
+        if (!strcmp(ops->path, path)) {
+            return ops;
+        }
+    }
+
+    return NULL;
+}
+
+/* Whether one dotted path is the other or lies inside it */
+static int
+path_overlaps(const char *a, const char *b)
+{
+    size_t la = strlen(a), lb = strlen(b);
+    size_t n = la < lb ? la : lb;
+
+    if (strncmp(a, b, n)) {
+        return 0;
+    }
+
+    return la == lb || (la < lb ? b[la] : a[lb]) == '.';
+}
+
+int
+ind_cfg_stream_covers(const char *path)
+{
+    biglist_t *el;
+
+    BIGLIST_FOREACH(el, cfg_stream_list) {
+        const struct ind_cfg_stream_ops *ops = el->data;
+        if (path_overlaps(ops->path, path)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/****************************************************************
+ * Reader
+ ****************************************************************/
+
+static int
+reader_peek(struct cfg_reader *r)
+{
+    if (r->pos == r->len) {
+        r->len = fread(r->buf, 1, CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE,
+                       r->f);
+        r->pos = 0;
+        if (r->len == 0) {
+            return -1;
+        }
+    }
+
+    return (unsigned char)r->buf[r->pos];
+}
+
+static int
+reader_next(struct cfg_reader *r)
+{
+    int c = reader_peek(r);
+
+    if (c >= 0) {
+        r->pos++;
+        if (c == '\n') {
+            r->line++;
+            r->col = 1;
+        } else {
+            r->col++;
+        }
+    }
+
+    return c;
+}
+
+static int
+reader_skip_ws(struct cfg_reader *r)
+{
+    int c;
+
+    while ((c = reader_peek(r)) == ' ' || c == '\t' || c == '\n' ||
+           c == '\r') {
+        reader_next(r);
+    }
+
+    return c;
+}
+
+static int
+reader_expect(struct cfg_reader *r, int expected, const char *error)
+{
+    if (reader_skip_ws(r) != expected) {
+        r->error = error;
+        return -1;
+    }
+    reader_next(r);
+
+    return 0;
+}
+
+static int
+tok_push(struct cfg_reader *r, char c)
+{
+    if (r->tok_len + 1 >= r->tok_size) {
+        size_t size = r->tok_size ? r->tok_size * 2 : 256;
+        char *tok = realloc(r->tok, size);
+        if (tok == NULL) {
+            r->error = "out of memory";
+            return -1;
+        }
+        r->tok = tok;
+        r->tok_size = size;
+    }
+    r->tok[r->tok_len++] = c;
+    r->tok[r->tok_len] = '\0';
+
+    return 0;
+}
+
+/****************************************************************
+ * Scalars
+ ****************************************************************/
+
+static int
+parse_hex4(struct cfg_reader *r, unsigned *result)
+{
+    int i, c;
+
+    *result = 0;
+    for (i = 0; i < 4; i++) {
+        c = reader_next(r);
+        *result <<= 4;
+        if (c >= '0' && c <= '9') {
+            *result |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            *result |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            *result |= c - 'A' + 10;
+        } else {
+            r->error = "invalid \\u escape";
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+push_utf8(struct cfg_reader *r, unsigned cp)
+{
+    int rv = 0;
+
+    if (cp < 0x80) {
+        rv |= tok_push(r, cp);
+    } else if (cp < 0x800) {
+        rv |= tok_push(r, 0xc0 | (cp >> 6));
+        rv |= tok_push(r, 0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        rv |= tok_push(r, 0xe0 | (cp >> 12));
+        rv |= tok_push(r, 0x80 | ((cp >> 6) & 0x3f));
+        rv |= tok_push(r, 0x80 | (cp & 0x3f));
+    } else {
+        rv |= tok_push(r, 0xf0 | (cp >> 18));
+        rv |= tok_push(r, 0x80 | ((cp >> 12) & 0x3f));
+        rv |= tok_push(r, 0x80 | ((cp >> 6) & 0x3f));
+        rv |= tok_push(r, 0x80 | (cp & 0x3f));
+    }
+
+    return rv;
+}
+
+/* Read a string, opening quote included, into r->tok */
+static int
+parse_string(struct cfg_reader *r)
+{
+    unsigned cp, lo;
+    int c;
+
+    if (reader_expect(r, '"', "expected string") < 0) {
+        return -1;
+    }
+
+    r->tok_len = 0;
+    if (tok_push(r, '\0') < 0) {
+        return -1;
+    }
+    r->tok_len = 0;
+
+    while ((c = reader_next(r)) != '"') {
+        if (c < 0) {
+            r->error = "unterminated string";
+            return -1;
+        } else if (c < 0x20) {
+            r->error = "control character in string";
+            return -1;
+        } else if (c != '\\') {
+            if (tok_push(r, c) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        switch (c = reader_next(r)) {
+        case '"': case '\\': case '/':
+            break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u':
+            if (parse_hex4(r, &cp) < 0) {
+                return -1;
+            }
+            if (cp >= 0xd800 && cp < 0xdc00) {
+                /* High surrogate; the low half must follow */
+                if (reader_next(r) != '\\' || reader_next(r) != 'u' ||
+                    parse_hex4(r, &lo) < 0 || lo < 0xdc00 || lo >= 0xe000) {
+                    r->error = "invalid surrogate pair";
+                    return -1;
+                }
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            if (push_utf8(r, cp) < 0) {
+                return -1;
+            }
+            continue;
+        default:
+            r->error = "invalid escape";
+            return -1;
+        }
+
+        if (tok_push(r, c) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static cJSON *
+parse_number(struct cfg_reader *r)
+{
+    char *end;
+    double value;
+    int c;
+
+    r->tok_len = 0;
+    while ((c = reader_peek(r)) == '-' || c == '+' || c == '.' ||
+           c == 'e' || c == 'E' || (c >= '0' && c <= '9')) {
+        if (tok_push(r, reader_next(r)) < 0) {
+            return NULL;
+        }
+    }
+
+    if (r->tok_len == 0) {
+        r->error = "unexpected character";
+        return NULL;
+    }
+
+    value = strtod(r->tok, &end);
+    if (*end != '\0') {
+        r->error = "invalid number";
+        return NULL;
+    }
+
+    return cJSON_CreateNumber(value);
+}
+
+static cJSON *
+parse_literal(struct cfg_reader *r, const char *literal, cJSON *item)
+{
+    const char *p;
+
+    for (p = literal; *p; p++) {
+        if (reader_next(r) != *p) {
+            r->error = "invalid literal";
+            cJSON_Delete(item);
+            return NULL;
+        }
+    }
+
+    return item;
+}
+
+/****************************************************************
+ * Containers
+ ****************************************************************/
+
+/* Append to a sibling chain, tracking its tail to stay linear */
+static void
+link_child(cJSON *parent, cJSON **tail, cJSON *item)
+{
+    if (*tail == NULL) {
+        parent->child = item;
+    } else {
+        (*tail)->next = item;
+        item->prev = *tail;
+    }
+    *tail = item;
+}
+
+/*
+ * Extend r->path with a member name
+ *
+ * Returns the new length, or -1 if the member can not be matched
+ * against stream registrations.
+ */
+static int
+path_push(struct cfg_reader *r, int path_len, const char *key)
+{
+    int len;
+
+    if (path_len < 0 || !r->streams) {
+        return -1;
+    }
+
+    len = snprintf(r->path + path_len, sizeof(r->path) - path_len,
+                   path_len ? ".%s" : "%s", key);
+    if (len < 0 || path_len + len >= (int)sizeof(r->path)) {
+        r->path[path_len] = '\0';
+        return -1;
+    }
+
+    return path_len + len;
+}
+
+/*
+ * Deliver the elements of a registered section one at a time
+ *
+ * For an object section the member name is in element->string.
+ */
+static int
+parse_stream(struct cfg_reader *r, const struct ind_cfg_stream_ops *ops,
+             int depth)
+{
+    int close = reader_next(r) == '[' ? ']' : '}';
+    cJSON *element;
+    char *key = NULL;
+    indigo_error_t rv;
+    int count = 0;
+
+    if (ops->begin != NULL && ops->begin() < 0) {
+        r->error = "section rejected by module";
+        return -1;
+    }
+
+    if (reader_skip_ws(r) == close) {
+        reader_next(r);
+    } else {
+        do {
+            if (close == '}') {
+                if (parse_string(r) < 0 ||
+                    reader_expect(r, ':', "expected ':'") < 0) {
+                    return -1;
+                }
+                key = strdup(r->tok);
+            }
+
+            element = parse_value(r, depth + 1, -1);
+            if (element == NULL) {
+                free(key);
+                return -1;
+            }
+            element->string = key;
+            key = NULL;
+
+            rv = ops->element(element);
+            cJSON_Delete(element);
+            if (rv < 0) {
+                r->error = "element rejected by module";
+                return -1;
+            }
+            count++;
+        } while (reader_skip_ws(r) == ',' && reader_next(r) == ',');
+
+        if (reader_expect(r, close, close == ']' ? "expected ',' or ']'" :
+                          "expected ',' or '}'") < 0) {
+            return -1;
+        }
+    }
+
+    if (ops->end != NULL && ops->end() < 0) {
+        r->error = "section rejected by module";
+        return -1;
+    }
+
+    AIM_LOG_VERBOSE("Streamed %d elements of %s", count, ops->path);
+
+    return 0;
+}
+
+static cJSON *
+parse_object(struct cfg_reader *r, int depth, int path_len)
+{
+    const struct ind_cfg_stream_ops *ops;
+    cJSON *obj, *item, *tail = NULL;
+    char *key;
+    int child_len, c;
+
+    reader_next(r);
+    obj = cJSON_CreateObject();
+
+    if (reader_skip_ws(r) == '}') {
+        reader_next(r);
+        return obj;
+    }
+
+    do {
+        if (parse_string(r) < 0 ||
+            reader_expect(r, ':', "expected ':'") < 0) {
+            goto error;
+        }
+
+        child_len = path_push(r, path_len, r->tok);
+        c = reader_skip_ws(r);
+        if (child_len >= 0 && (c == '[' || c == '{') &&
+            (ops = cfg_stream_find(r->path)) != NULL) {
+            if (parse_stream(r, ops, depth) < 0) {
+                goto error;
+            }
+            r->path[path_len] = '\0';
+            continue;
+        }
+
+        key = strdup(r->tok);
+        item = parse_value(r, depth + 1, child_len);
+        if (child_len >= 0) {
+            r->path[path_len] = '\0';
+        }
+        if (item == NULL) {
+            free(key);
+            goto error;
+        }
+        item->string = key;
+        link_child(obj, &tail, item);
+    } while (reader_skip_ws(r) == ',' && reader_next(r) == ',');
+
+    if (reader_expect(r, '}', "expected ',' or '}'") < 0) {
+        goto error;
+    }
+
+    return obj;
+
+error:
+    cJSON_Delete(obj);
+    return NULL;
+}
+
+static cJSON *
+parse_array(struct cfg_reader *r, int depth)
+{
+    cJSON *arr, *item, *tail = NULL;
+
+    reader_next(r);
+    arr = cJSON_CreateArray();
+
+    if (reader_skip_ws(r) == ']') {
+        reader_next(r);
+        return arr;
+    }
+
+    do {
+        item = parse_value(r, depth + 1, -1);
+        if (item == NULL) {
+            cJSON_Delete(arr);
+            return NULL;
+        }
+        link_child(arr, &tail, item);
+    } while (reader_skip_ws(r) == ',' && reader_next(r) == ',');
+
+    if (reader_expect(r, ']', "expected ',' or ']'") < 0) {
+        cJSON_Delete(arr);
+        return NULL;
+    }
+
+    return arr;
+}
+
+static cJSON *
+parse_value(struct cfg_reader *r, int depth, int path_len)
+{
+    if (depth > CFG_STREAM_MAX_DEPTH) {
+        r->error = "nested too deeply";
+        return NULL;
+    }
+
+    switch (reader_skip_ws(r)) {
+    case '{':
+        return parse_object(r, depth, path_len);
+    case '[':
+        return parse_array(r, depth);
+    case '"':
+        if (parse_string(r) < 0) {
+            return NULL;
+        }
+        return cJSON_CreateString(r->tok);
+    case 't':
+        return parse_literal(r, "true", cJSON_CreateTrue());
+    case 'f':
+        return parse_literal(r, "false", cJSON_CreateFalse());
+    case 'n':
+        return parse_literal(r, "null", cJSON_CreateNull());
+    case -1:
+        r->error = "unexpected end of file";
+        return NULL;
+    default:
+        return parse_number(r);
+    }
+}
+
+/*
+ * Parse a configuration file into a cJSON tree
+ *
+ * If streams is set, registered sections are delivered to their modules
+ * and left out of the tree. Errors are logged with their position and
+ * NULL is returned.
+ */
+cJSON *
+ind_cfg_stream_parse(const char *filename, int streams)
+{
+    struct cfg_reader r;
+    cJSON *root;
+
+    memset(&r, 0, sizeof(r));
+    r.line = r.col = 1;
+    r.streams = streams;
+
+    r.f = fopen(filename, "r");
+    if (r.f == NULL) {
+        AIM_LOG_ERROR("failed to open %s", filename);
+        return NULL;
+    }
+
+    r.buf = aim_malloc(CONFIGURATION_CONFIG_STREAM_BUFFER_SIZE);
+
+    root = parse_value(&r, 0, 0);
+    if (root != NULL && reader_skip_ws(&r) != -1) {
+        r.error = "trailing data after configuration";
+        cJSON_Delete(root);
+        root = NULL;
+    }
+
+    if (root == NULL) {
+        if (ferror(r.f)) {
+            AIM_LOG_ERROR("failed to read %s", filename);
+        } else {
+            AIM_LOG_ERROR("Error at line %d col %d: %s",
+                          r.line, r.col, r.error);
+        }
+    }
+
+    fclose(r.f);
+    aim_free(r.buf);
+    free(r.tok);
+
+    return root;
+}
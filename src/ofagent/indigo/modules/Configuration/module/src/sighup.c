@@ -36,6 +36,44 @@ sighup(int signum)
     }
 }
 
+/* Background reload task is registered */
+static int reload_task_registered;
+
+static ind_soc_task_status_t
+reload_task(void *cookie)
+{
+    indigo_error_t rv;
+
+    do {
+        if (ind_cfg_reload_step(&rv)) {
+            reload_task_registered = 0;
+            return IND_SOC_TASK_FINISHED;
+        }
+    } while (!ind_soc_should_yield());
+
+    return IND_SOC_TASK_CONTINUE;
+}
+
+indigo_error_t
+ind_cfg_reload_start(void)
+{
+    indigo_error_t rv;
+
+    ind_cfg_reload_begin();
+    if (reload_task_registered) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    rv = ind_soc_task_register(reload_task, NULL, 20);
+    if (rv < 0) {
+        AIM_LOG_WARN("Could not start background reload; reloading inline");
+        return ind_cfg_load();
+    }
+    reload_task_registered = 1;
+
+    return INDIGO_ERROR_NONE;
+}
+
 static void
 sighup_callback(int socket_id, void *cookie,
                 int read_ready, int write_ready, int error_seen)
@@ -45,7 +83,7 @@ sighup_callback(int socket_id, void *cookie,
         /* silence warn_unused_result */
     }
     AIM_LOG_MSG("received SIGHUP");
-    ind_cfg_load();
+    (void) ind_cfg_reload_start();
 }
 
 /* Set up the SIGHUP handler to load the new configuration. */
@@ -340,7 +340,7 @@ static void
 test_non_dflt_reconfiguration(void)
 {
     FILE *file;
-    char filename_non_dflt[] = "non_dflt_XXXXXX";
+    static char filename_non_dflt[] = "non_dflt_XXXXXX";
 
     file = fdopen(mkstemp(filename_non_dflt), "w");
     fwrite(sample_json_non_dflt, strlen(sample_json_non_dflt), 1, file);
@@ -355,6 +355,238 @@ test_non_dflt_reconfiguration(void)
     unlink(filename_non_dflt);
 }
 
+/* Diff-based reload; ops_keyed only reads "int" */
+
+static int stage_keyed_count;
+static int commit_keyed_count;
+static int keyed_int_changed;
+static int keyed_double_changed;
+
+static indigo_error_t
+stage_keyed(cJSON *cjson)
+{
+    stage_keyed_count++;
+    keyed_int_changed = ind_cfg_changed("int");
+    keyed_double_changed = ind_cfg_changed("double");
+    return INDIGO_ERROR_NONE;
+}
+
+static void
+commit_keyed(void)
+{
+    commit_keyed_count++;
+}
+
+static const char * const keyed_keys[] = { "int", NULL };
+
+static const struct ind_cfg_ops ops_keyed = {
+    .stage = stage_keyed,
+    .commit = commit_keyed,
+    .keys = keyed_keys,
+};
+
+static void
+write_config(const char *filename, const char *json)
+{
+    FILE *file = fopen(filename, "w");
+    fwrite(json, strlen(json), 1, file);
+    fclose(file);
+}
+
+static void
+test_diff_reconfiguration(void)
+{
+    char filename[] = "tmpXXXXXX";
+
+    close(mkstemp(filename));
+    write_config(filename, "{ \"int\": 1, \"double\": 1.5, \"obj\": { \"a\": 1, \"b\": [1, 2] } }");
+    ind_cfg_filename_set(filename);
+    ind_cfg_register(&ops_keyed);
+
+    /* First load stages everything */
+    stage1_retval = stage2_retval = INDIGO_ERROR_NONE;
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stage_keyed_count == 1 && commit_keyed_count == 1);
+    INDIGO_ASSERT(keyed_int_changed && keyed_double_changed);
+
+    /* Same content, reordered members: skipped */
+    write_config(filename, "{ \"obj\": { \"b\": [1, 2], \"a\": 1 }, \"double\": 1.5, \"int\": 1 }");
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stage_keyed_count == 1 && commit_keyed_count == 1);
+
+    /* Unrelated key changed: skipped */
+    write_config(filename, "{ \"int\": 1, \"double\": 2.5, \"obj\": { \"a\": 1, \"b\": [2, 1] } }");
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stage_keyed_count == 1 && commit_keyed_count == 1);
+
+    /* Own key changed: staged, and only that key reported */
+    write_config(filename, "{ \"int\": 2, \"double\": 2.5, \"obj\": { \"a\": 1, \"b\": [2, 1] } }");
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stage_keyed_count == 2 && commit_keyed_count == 2);
+    INDIGO_ASSERT(keyed_int_changed && !keyed_double_changed);
+
+    /* Key removed: staged */
+    write_config(filename, "{ \"double\": 2.5 }");
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stage_keyed_count == 3 && commit_keyed_count == 3);
+
+    unlink(filename);
+}
+
+/* Streamed sections */
+
+static int stream_items_begin, stream_items_end;
+static int stream_items_count, stream_items_sum;
+static int stream_ports_count;
+static int stream_saw_tree;
+
+static indigo_error_t
+items_begin(void)
+{
+    stream_items_begin++;
+    stream_items_count = stream_items_sum = 0;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+items_element(cJSON *element)
+{
+    int id;
+
+    INDIGO_ASSERT(ind_cfg_lookup_int(element, "id", &id) == INDIGO_ERROR_NONE);
+    if (id < 0) {
+        return INDIGO_ERROR_PARAM;
+    }
+    stream_items_count++;
+    stream_items_sum += id;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+items_end(void)
+{
+    stream_items_end++;
+    return INDIGO_ERROR_NONE;
+}
+
+static const struct ind_cfg_stream_ops stream_items = {
+    .path = "items",
+    .begin = items_begin,
+    .element = items_element,
+    .end = items_end,
+};
+
+static indigo_error_t
+ports_element(cJSON *element)
+{
+    INDIGO_ASSERT(element->string != NULL && element->string[0] == 'p');
+    INDIGO_ASSERT(element->type == cJSON_Number);
+    stream_ports_count++;
+    return INDIGO_ERROR_NONE;
+}
+
+static const struct ind_cfg_stream_ops stream_ports = {
+    .path = "chassis.ports",
+    .element = ports_element,
+};
+
+static indigo_error_t
+stage_stream(cJSON *cjson)
+{
+    cJSON *node;
+    char *str;
+
+    /* Streamed sections are left out of the tree */
+    INDIGO_ASSERT(ind_cfg_lookup(cjson, "items", &node) == INDIGO_ERROR_NOT_FOUND);
+    INDIGO_ASSERT(ind_cfg_lookup(cjson, "chassis.ports", &node) == INDIGO_ERROR_NOT_FOUND);
+    INDIGO_ASSERT(ind_cfg_lookup_string(cjson, "chassis.name", &str) == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(!strcmp(str, "a\"b\xc3\xa9\xf0\x9f\x98\x80"));
+    INDIGO_ASSERT(ind_cfg_lookup(cjson, "nested.items", &node) == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(cJSON_GetArraySize(node) == 2);
+    INDIGO_ASSERT(ind_cfg_changed("items"));
+    stream_saw_tree++;
+    return INDIGO_ERROR_NONE;
+}
+
+static void
+commit_stream(void)
+{
+}
+
+static const char * const stream_keys[] = { "items", NULL };
+
+static const struct ind_cfg_ops ops_stream = {
+    .stage = stage_stream,
+    .commit = commit_stream,
+    .keys = stream_keys,
+};
+
+static void
+test_stream(void)
+{
+    char filename[] = "tmpXXXXXX";
+    FILE *file;
+    int i, sum = 0;
+
+    close(mkstemp(filename));
+    file = fopen(filename, "w");
+    fprintf(file, "{\n  \"chassis\": { \"name\": \"a\\\"b\\u00e9\\ud83d\\ude00\",\n"
+            "    \"ports\": { \"p1\": 1, \"p2\": 2, \"p3\": 3 } },\n"
+            "  \"nested\": { \"items\": [ 1, 2 ] },\n"
+            "  \"items\": [\n");
+    for (i = 0; i < 10000; i++) {
+        fprintf(file, "%s    { \"id\": %d, \"name\": \"item%d\" }\n",
+                i ? "," : "", i, i);
+        sum += i;
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    ind_cfg_stream_register(&stream_items);
+    ind_cfg_stream_register(&stream_ports);
+    ind_cfg_register(&ops_stream);
+    ind_cfg_filename_set(filename);
+
+    stage1_retval = stage2_retval = INDIGO_ERROR_NONE;
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stream_items_begin == 1 && stream_items_end == 1);
+    INDIGO_ASSERT(stream_items_count == 10000 && stream_items_sum == sum);
+    INDIGO_ASSERT(stream_ports_count == 3);
+    INDIGO_ASSERT(stream_saw_tree == 1);
+
+    /* Streamed keys always count as changed */
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_NONE);
+    INDIGO_ASSERT(stream_items_begin == 2 && stream_saw_tree == 2);
+
+    /* A rejected element fails the reload */
+    file = fopen(filename, "w");
+    fprintf(file, "{ \"items\": [ { \"id\": 1 }, { \"id\": -1 } ] }");
+    fclose(file);
+    stage1_count = stage2_count = 0;
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_PARSE);
+    INDIGO_ASSERT(stream_saw_tree == 2);
+
+    /* Truncated and trailing input */
+    file = fopen(filename, "w");
+    fprintf(file, "{ \"items\": [ { \"id\": 1 }");
+    fclose(file);
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_PARSE);
+
+    file = fopen(filename, "w");
+    fprintf(file, "{ } x");
+    fclose(file);
+    INDIGO_ASSERT(ind_cfg_load() == INDIGO_ERROR_PARSE);
+
+    unlink(filename);
+}
+
 int main(int argc, char* argv[])
 {
     char filename[256];
@@ -365,6 +597,8 @@ int main(int argc, char* argv[])
     test_json_parse_failure();
     test_reconfiguration(1);
     test_non_dflt_reconfiguration();
+    test_diff_reconfiguration();
+    test_stream();
 
     return 0;
 }
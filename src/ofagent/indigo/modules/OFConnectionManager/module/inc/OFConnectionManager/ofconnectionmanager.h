@@ -114,6 +114,57 @@ ind_cxn_message_track_setup(indigo_cxn_id_t cxn_id, of_object_t *obj);
 extern indigo_error_t
 ind_cxn_message_trace(indigo_cxn_id_t cxn_id, aim_pvs_t* pvs);
 
+/**
+ * Show the binary message trace
+ *
+ * @param pvs Output stream
+ * @param count Number of most recent messages to show; 0 shows all
+ *
+ * Unlike ind_cxn_message_trace, the binary trace is always on. It records
+ * the connection, xid, type, length and handler duration of every message.
+ */
+extern void
+ind_cxn_trace_show(aim_pvs_t *pvs, int count);
+
+/**
+ * Save the binary message trace to a file
+ *
+ * @param filename The file to write
+ *
+ * The file is decoded offline by tools/cxn_trace_decode.py.
+ */
+extern indigo_error_t
+ind_cxn_trace_save(const char *filename);
+
+/**
+ * Capture the controller sessions to a file
+ *
+ * @param filename The file to write
+ *
+ * Until ind_cxn_capture_stop is called, the bytes read from every
+ * controller connection are written to the file with their arrival
+ * time, after TLS is removed. tools/cxn_replay.py replays the sessions
+ * against an agent. Returns INDIGO_ERROR_EXISTS if a capture is already
+ * running.
+ */
+extern indigo_error_t
+ind_cxn_capture_start(const char *filename);
+
+/**
+ * Stop the session capture and close its file
+ */
+extern void
+ind_cxn_capture_stop(void);
+
+/**
+ * Write the connection counters and echo latency histograms in
+ * OpenMetrics text format
+ *
+ * @param pvs Output stream
+ */
+extern void
+ind_cxn_metrics_write(aim_pvs_t *pvs);
+
 /**
  * Value to indicate to cxn_reset to reset all active connections
  */
@@ -128,6 +179,45 @@ ind_cxn_message_trace(indigo_cxn_id_t cxn_id, aim_pvs_t* pvs);
 extern void
 ind_cxn_reset(indigo_cxn_id_t cxn_id);
 
+/**
+ * TLS settings for controller connections
+ * @param cert_file PEM certificate chain presented to the controller, or NULL
+ * @param key_file PEM private key for cert_file, or NULL
+ * @param ca_file PEM CA certificates used to verify the controller; if NULL
+ * the controller certificate is not verified
+ * @param ktls Hand the record layer to the kernel after the handshake when
+ * the kernel and OpenSSL support it
+ */
+typedef struct ind_cxn_tls_config_s {
+    const char *cert_file;
+    const char *key_file;
+    const char *ca_file;
+    int ktls;
+} ind_cxn_tls_config_t;
+
+/**
+ * Configure TLS for connections using INDIGO_CXN_PROTO_TLS_OVER_IPV4
+ * @param config The TLS settings; the files are read immediately
+ *
+ * Applies to connections that connect after the call. Returns
+ * INDIGO_ERROR_NOT_SUPPORTED if built without
+ * OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS.
+ */
+extern indigo_error_t
+ind_cxn_tls_config_set(const ind_cxn_tls_config_t *config);
+
+/**
+ * Set the limit of the backoff between connection attempts
+ * @param max_ms Longest delay in ms; defaults to
+ * OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS
+ *
+ * Delays double from 2 ms up to the limit and are each cut by a random
+ * amount of up to half. The first attempt after a connection is lost is
+ * made within half the limit.
+ */
+extern void
+ind_cxn_retry_max_set(uint32_t max_ms);
+
 
 #endif /* __OFCONNECTIONMANAGER_H__ */
 /** @} */
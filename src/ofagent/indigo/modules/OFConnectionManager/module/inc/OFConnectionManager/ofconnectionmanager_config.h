@@ -109,6 +109,16 @@
 #define OFCONNECTIONMANAGER_CONFIG_INCLUDE_UCLI 0
 #endif
 
+/**
+ * OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS
+ *
+ * Include TLS controller connections. Requires OpenSSL. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS
+#define OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS 0
+#endif
+
 /**
  * OFCONNECTIONMANAGER_CONFIG_ECHO_OPTIMIZATION
  *
@@ -129,6 +139,66 @@
 #define OFCONNECTIONMANAGER_CONFIG_OF_VERSION OF_VERSION_1_0
 #endif
 
+/**
+ * OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE
+ *
+ * Number of OpenFlow messages kept in the binary message trace ring. 0 disables the ring. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE
+#define OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE 4096
+#endif
+
+/**
+ * OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK
+ *
+ * Queued output bytes at which a connection is considered congested. Stats replies are paused and packet-ins are sampled until the queue drains to the low watermark. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK
+#define OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK (4*1024*1024)
+#endif
+
+/**
+ * OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK
+ *
+ * Queued output bytes at which a congested connection is considered drained. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK
+#define OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK (1024*1024)
+#endif
+
+/**
+ * OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE
+ *
+ * Send one in this many packet-ins to a congested connection. 0 drops all packet-ins while congested. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE
+#define OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE 16
+#endif
+
+/**
+ * OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES
+ *
+ * Most bytes of packet-ins carried by one BSN packet-in batch message, for connections with packet_in_batch_max set. At most 65519. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES
+#define OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES 16384
+#endif
+
+/**
+ * OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS
+ *
+ * Default limit in ms of the exponential backoff between connection attempts. Each delay is jittered between half and all of its value. */
+
+
+#ifndef OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS
+#define OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS 1000
+#endif
+
 
 
 /**
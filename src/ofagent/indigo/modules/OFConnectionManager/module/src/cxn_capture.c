@@ -0,0 +1,158 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Controller session capture
+ *
+ * While a capture is running, the bytes read from every controller
+ * connection are written to a file as they arrive, after TLS is removed,
+ * so the sessions can be replayed against another agent build by
+ * tools/cxn_replay.py. The file starts with a header like the one of
+ * ind_cxn_trace_save, followed by records in host byte order:
+ *
+ *   timestamp  aim_trace_now when the data was read
+ *   cxn_id     The connection
+ *   event      IND_CXN_CAPTURE_DATA or IND_CXN_CAPTURE_CLOSE
+ *   length     Bytes of data following the record, 0 for CLOSE
+ *   reserved   0
+ *
+ * A CLOSE record ends the session of a connection; data with the same
+ * cxn_id after it belongs to a new session.
+ */
+
+#include "ofconnectionmanager_log.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "ofconnectionmanager_int.h"
+
+#include <indigo/memory.h>
+
+FILE *ind_cxn_capture_fp;
+
+/* stdio buffer, so a capture costs a write every few hundred reads */
+#define CXN_CAPTURE_BUFFER_SIZE (1024 * 1024)
+
+#define CXN_CAPTURE_FILE_MAGIC "OFCXNCAP"
+#define CXN_CAPTURE_FILE_BYTE_ORDER 0x01020304
+
+typedef struct cxn_capture_file_header_s {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t record_size;
+} cxn_capture_file_header_t;
+
+typedef struct cxn_capture_record_s {
+    uint64_t timestamp;
+    uint32_t cxn_id;
+    uint32_t event;
+    uint32_t length;
+    uint32_t reserved;
+} cxn_capture_record_t;
+
+static char *cxn_capture_buffer;
+static uint64_t cxn_capture_bytes;
+
+/**
+ * Start capturing controller sessions
+ */
+
+indigo_error_t
+ind_cxn_capture_start(const char *filename)
+{
+    cxn_capture_file_header_t hdr;
+    FILE *fp;
+
+    if (ind_cxn_capture_fp != NULL) {
+        return INDIGO_ERROR_EXISTS;
+    }
+
+    if ((fp = fopen(filename, "wb")) == NULL) {
+        AIM_LOG_ERROR("Could not open %s for the session capture", filename);
+        return INDIGO_ERROR_PARAM;
+    }
+
+    cxn_capture_buffer = aim_malloc(CXN_CAPTURE_BUFFER_SIZE);
+    setvbuf(fp, cxn_capture_buffer, _IOFBF, CXN_CAPTURE_BUFFER_SIZE);
+
+    INDIGO_MEM_CLEAR(&hdr, sizeof(hdr));
+    INDIGO_MEM_COPY(hdr.magic, CXN_CAPTURE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = CXN_CAPTURE_FILE_BYTE_ORDER;
+    hdr.record_size = sizeof(cxn_capture_record_t);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        AIM_LOG_ERROR("Error writing the session capture to %s", filename);
+        fclose(fp);
+        aim_free(cxn_capture_buffer);
+        cxn_capture_buffer = NULL;
+        return INDIGO_ERROR_UNKNOWN;
+    }
+
+    ind_cxn_capture_fp = fp;
+    cxn_capture_bytes = 0;
+    AIM_LOG_INFO("Capturing controller sessions to %s", filename);
+
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Stop the capture and close the file
+ */
+
+void
+ind_cxn_capture_stop(void)
+{
+    if (ind_cxn_capture_fp == NULL) {
+        return;
+    }
+
+    if (fclose(ind_cxn_capture_fp) != 0) {
+        AIM_LOG_ERROR("Error writing the session capture");
+    }
+    ind_cxn_capture_fp = NULL;
+    aim_free(cxn_capture_buffer);
+    cxn_capture_buffer = NULL;
+
+    AIM_LOG_INFO("Session capture stopped after %"PRIu64" bytes",
+                 cxn_capture_bytes);
+}
+
+void
+ind_cxn_capture_record(uint32_t event, connection_t *cxn,
+                       const uint8_t *buf, int len)
+{
+    cxn_capture_record_t record;
+
+    record.timestamp = aim_trace_now();
+    record.cxn_id = cxn->cxn_id;
+    record.event = event;
+    record.length = len;
+    record.reserved = 0;
+
+    if (fwrite(&record, sizeof(record), 1, ind_cxn_capture_fp) != 1 ||
+        (len > 0 && fwrite(buf, len, 1, ind_cxn_capture_fp) != 1)) {
+        AIM_LOG_ERROR("Error writing the session capture, stopping it");
+        ind_cxn_capture_stop();
+        return;
+    }
+
+    cxn_capture_bytes += len;
+}
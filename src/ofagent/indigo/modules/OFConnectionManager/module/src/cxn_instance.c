@@ -28,6 +28,7 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "cxn_instance.h"
 #include "ofconnectionmanager_int.h"
@@ -46,6 +47,8 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
 
 
 /* Short hand logging macros */
@@ -73,7 +76,20 @@ state_info_t state_info[INDIGO_CXN_S_COUNT] = {
 
 
 /* Maximum number of messages to send per write callback */
-#define MAX_WRITE_MSGS 32
+#define MAX_WRITE_MSGS 256
+
+/* Initial number of slots in a connection's output queue */
+#define OUTPUT_QUEUE_INIT_SIZE 64
+
+/* Slot of the i'th oldest buffer in the output queue */
+#define OUTPUT_QUEUE_SLOT(cxn, i) \
+    (((cxn)->output_head + (i)) % (cxn)->output_queue_size)
+
+/* Limit of the backoff between connection attempts */
+static uint32_t cxn_retry_max_ms = OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS;
+static unsigned int cxn_retry_seed;
+
+static uint32_t connection_retry_jitter(uint32_t span);
 
 
 /**
@@ -125,6 +141,23 @@ static void periodic_keepalive(void *cookie);
 
 #define VERSION_IS_SET(cxn) ((cxn)->status.negotiated_version > 0)
 
+/*
+ * Free the data of a write queue entry, or drop its shared reference.
+ * One drained arena is kept so a trickle of small messages does not
+ * allocate an arena each.
+ */
+static void
+output_buf_free(connection_t *cxn, cxn_output_buf_t *buf)
+{
+    if (buf->shared != NULL) {
+        ind_cxn_shared_buf_release(buf->shared);
+    } else if (buf->alloc_bytes > 0 && cxn->spare_arena == NULL) {
+        cxn->spare_arena = buf->data;
+    } else {
+        aim_free(buf->data);
+    }
+}
+
 /**
  * Disconnect and clean up
  *
@@ -133,12 +166,14 @@ static void periodic_keepalive(void *cookie);
 static void
 cleanup_disconnect(connection_t *cxn)
 {
-    uint8_t *data;
-    biglist_t *ble;
+    cxn_output_buf_t *buf;
+    int i;
 
     cxn->status.disconnect_count++;
+    IND_CXN_CAPTURE(IND_CXN_CAPTURE_CLOSE, cxn, NULL, 0);
 
     /* Close this socket. */
+    ind_cxn_tls_close(cxn);
     if (cxn->sd >= 0) {
         ind_soc_socket_unregister(cxn->sd);
         close(cxn->sd);
@@ -151,17 +186,29 @@ cleanup_disconnect(connection_t *cxn)
     LOG_VERBOSE(cxn, "Closing connection, current read buf has %d bytes",
                 cxn->read_bytes);
     cxn->read_bytes = 0;
+    cxn->read_offset = 0;
     /* Clear write queue */
-    BIGLIST_FOREACH_DATA(ble, cxn->output_list, uint8_t *, data) {
-        LOG_TRACE(cxn, "Freeing outgoing msg %p", data);
-        aim_free(data);
+    for (i = 0; i < cxn->output_count; i++) {
+        buf = &cxn->output_queue[OUTPUT_QUEUE_SLOT(cxn, i)];
+        LOG_TRACE(cxn, "Freeing outgoing buffer %p", buf->data);
+        output_buf_free(cxn, buf);
     }
-    biglist_free(cxn->output_list);
-    cxn->output_list = NULL;
-
+    cxn->output_head = 0;
+    cxn->output_count = 0;
+    aim_free(cxn->spare_arena);
+    cxn->spare_arena = NULL;
+
+    /* Drop packet-ins not yet batched */
+    aim_free(cxn->packet_in_batch);
+    cxn->packet_in_batch = NULL;
+    cxn->packet_in_batch_len = 0;
+    cxn->packet_in_batch_count = 0;
+
+    indigo_mem_account_free(INDIGO_MEM_TAG_CXN_QUEUE, cxn->bytes_enqueued);
     cxn->bytes_enqueued = 0;
     cxn->pkts_enqueued = 0;
     cxn->output_head_offset = 0;
+    cxn->congested = 0;
 }
 
 
@@ -366,10 +413,12 @@ cxn_state_set(connection_t *cxn, indigo_cxn_state_t new_state)
         } else if (CXN_LOCAL(cxn)) {
             cxn->active = 0;
         } else {
-            /* Disconnected but still active - start connecting again */
+            /* Disconnected but still active - start connecting again,
+             * spread over half the backoff limit */
             ind_soc_timer_event_register_with_priority(
                 ind_cxn_connection_retry_timer, cxn,
-                IND_SOC_TIMER_IMMEDIATE, IND_CXN_EVENT_PRIORITY);
+                connection_retry_jitter(cxn_retry_max_ms / 2),
+                IND_CXN_EVENT_PRIORITY);
         }
         ind_cxn_disconnected_init(cxn);
         break;
@@ -379,6 +428,10 @@ cxn_state_set(connection_t *cxn, indigo_cxn_state_t new_state)
         ind_soc_socket_register_with_priority(
             cxn->sd, indigo_cxn_socket_ready_callback,
             cxn, IND_CXN_EVENT_PRIORITY);
+        if (CXN_TLS(cxn) && ind_cxn_tls_start(cxn) < 0) {
+            ind_cxn_disconnect(cxn);
+            break;
+        }
         ind_cxn_send_hello(cxn);
         if (CXN_LOCAL(cxn)) {
             /* Recursive call; transition to connected */
@@ -458,8 +511,10 @@ check_for_hello(connection_t *cxn, of_object_t *obj)
  * Note that we rely on getting the echo replies before the next
  * echo request goes out due to XID tracking.
  *
- * Any time a message is received from the controller, the timer for
- * this function should be reset and the outstanding count set to 0.
+ * Any time a message is received from the controller, the outstanding
+ * count is set to 0. With the echo optimization, the time of the message
+ * is also recorded and no echo is sent while the controller has been
+ * heard from within the last period.
  */
 
 static void
@@ -477,6 +532,15 @@ periodic_keepalive(void *cookie)
         return;
     }
 
+#if OFCONNECTIONMANAGER_CONFIG_ECHO_OPTIMIZATION == 1
+    if (cxn->keepalive.last_rx_time != 0 &&
+        INDIGO_TIME_DIFF_ms(cxn->keepalive.last_rx_time, INDIGO_LOOP_TIME) <
+            (int)cxn->keepalive.period_ms) {
+        LOG_TRACE(cxn, "Controller active, echo request skipped");
+        return;
+    }
+#endif
+
     if (cxn->keepalive.outstanding_echo_cnt > cxn->keepalive.threshold) {
         LOG_INFO(cxn, "Exceeded outstanding echo requests.  Resetting cxn");
         ind_cxn_disconnect(cxn);
@@ -494,6 +558,7 @@ periodic_keepalive(void *cookie)
 
     LOG_VERBOSE(cxn, "Sending echo request xid %u", xid);
     cxn->keepalive.xid = xid;
+    cxn->keepalive.sent_time = aim_trace_now();
     cxn->keepalive.outstanding_echo_cnt++;
 }
 
@@ -502,7 +567,7 @@ periodic_keepalive(void *cookie)
  */
 
 static indigo_error_t
-send_barrier_reply(connection_t *cxn)
+send_barrier_reply(connection_t *cxn, uint32_t xid)
 {
    of_barrier_reply_t *obj = 0;
 
@@ -511,21 +576,43 @@ send_barrier_reply(connection_t *cxn)
       return INDIGO_ERROR_UNKNOWN;
    }
 
-   of_barrier_reply_xid_set(obj, cxn->barrier.xid);
-   LOG_TRACE(cxn, "Responding to barrier request xid %u", cxn->barrier.xid);
+   of_barrier_reply_xid_set(obj, xid);
+   LOG_TRACE(cxn, "Responding to barrier request xid %u", xid);
 
    indigo_cxn_send_controller_message(cxn->cxn_id, obj);
    return INDIGO_ERROR_NONE;
 }
 
 /**
- * Handle an echo request
+ * Add a latency, in nanoseconds, to a histogram
+ */
+
+static void
+cxn_latency_record(cxn_latency_hist_t *hist, uint64_t elapsed_ns)
+{
+    uint64_t us = elapsed_ns / 1000;
+    uint64_t v = us;
+    int bucket = 0;
+
+    while (v != 0 && bucket < CXN_LATENCY_BUCKETS - 1) {
+        v >>= 1;
+        bucket++;
+    }
+
+    hist->count++;
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+    hist->buckets[bucket]++;
+}
+
+/**
+ * Reply to an echo request
  */
 
 static indigo_error_t
-echo_request_handle(connection_t *cxn, of_object_t *_obj)
+echo_reply_send(connection_t *cxn, of_echo_request_t *echo)
 {
-    of_echo_request_t *echo = _obj;
     of_echo_reply_t *reply = NULL;
     of_octets_t data;
     uint32_t xid;
@@ -552,6 +639,81 @@ echo_request_handle(connection_t *cxn, of_object_t *_obj)
     return INDIGO_ERROR_NONE;
 }
 
+/**
+ * Handle an echo request
+ */
+
+static indigo_error_t
+echo_request_handle(connection_t *cxn, of_object_t *_obj)
+{
+    /* Echo requests are scanned for in order, so this is the oldest */
+    if (cxn->keepalive.answered > 0) {
+        cxn->keepalive.answered--;
+        return INDIGO_ERROR_NONE;
+    }
+
+    return echo_reply_send(cxn, _obj);
+}
+
+/**
+ * Answer echo requests as soon as they are read
+ *
+ * @param cxn The connection
+ * @param read_time When the read completed (aim_trace_now)
+ *
+ * The messages in one read are processed one after another, and a
+ * burst of flow mods can keep an echo request behind them long enough
+ * for the controller to give up on the switch. Every complete echo
+ * request not yet scanned is answered here instead, ahead of the
+ * messages before it. Each is counted, and skipped when processing
+ * reaches it.
+ */
+
+static void
+echo_fast_path(connection_t *cxn, uint64_t read_time)
+{
+    of_object_storage_t obj_storage;
+    of_object_t *obj;
+    of_message_t msg;
+    int offset, msg_bytes;
+
+    if (!CXN_HANDSHAKE_COMPLETE(cxn)) {
+        return;
+    }
+
+    offset = cxn->keepalive.scan_offset;
+    if (offset < cxn->read_offset) {
+        offset = cxn->read_offset;
+    }
+
+    while (cxn->read_bytes - offset >= OF_MESSAGE_HEADER_LENGTH) {
+        msg = (of_message_t)&cxn->read_buffer[offset];
+        msg_bytes = of_message_length_get(msg);
+        if (msg_bytes < OF_MESSAGE_HEADER_LENGTH ||
+            msg_bytes > cxn->read_bytes - offset) {
+            /* Incomplete, or a framing error left to next_message */
+            break;
+        }
+
+        if (of_message_type_get(msg) == OF_OBJ_TYPE_ECHO_REQUEST &&
+            of_message_to_object_id(msg, msg_bytes) == OF_ECHO_REQUEST) {
+            obj = of_object_new_from_message_preallocated(
+                &obj_storage, (uint8_t *)msg, msg_bytes);
+            if (obj != NULL) {
+                echo_reply_send(cxn, obj);
+                cxn->keepalive.answered++;
+                cxn->keepalive.fast_replies++;
+                cxn_latency_record(&cxn->keepalive.reply_lag,
+                                   aim_trace_now() - read_time);
+            }
+        }
+
+        offset += msg_bytes;
+    }
+
+    cxn->keepalive.scan_offset = offset;
+}
+
 /**
  * Handle an echo reply
  */
@@ -567,6 +729,11 @@ echo_reply_handle(connection_t *cxn, of_object_t *_obj)
 
     if (xid == cxn->keepalive.xid) {
         LOG_VERBOSE(cxn, "Received expected echo reply with xid %u", xid);
+        if (cxn->keepalive.sent_time != 0) {
+            cxn_latency_record(&cxn->keepalive.rtt,
+                               aim_trace_now() - cxn->keepalive.sent_time);
+            cxn->keepalive.sent_time = 0;
+        }
         /* This is actually redundant with the reset in process_message */
         cxn->keepalive.outstanding_echo_cnt = 0;
     } else {
@@ -586,15 +753,31 @@ barrier_request_handle(connection_t *cxn, of_object_t *_obj)
 {
     of_barrier_request_t *obj = _obj;
 
-    of_barrier_request_xid_get(obj, &cxn->barrier.xid);
-    LOG_TRACE(cxn, "Got barrier req with xid %u", cxn->barrier.xid);
+    uint32_t xid;
+
+    of_barrier_request_xid_get(obj, &xid);
+    LOG_TRACE(cxn, "Got barrier req with xid %u", xid);
 
     /* No outstanding operations; send reply immediately */
     if (cxn->outstanding_op_cnt == 0)  {
-        return (send_barrier_reply(cxn));
+        return (send_barrier_reply(cxn, xid));
     }
     LOG_TRACE(cxn, "Outstanding op count %d", cxn->outstanding_op_cnt);
 
+    /*
+     * Only stats requests are outstanding, so nothing after the barrier
+     * can change their outcome. Keep reading; the reply is sent once the
+     * operations tracked so far complete.
+     */
+    if (!cxn->barrier.backgroundf && cxn->barrier.write_op_cnt == 0) {
+        cxn->barrier.backgroundf = 1;
+        cxn->barrier.background_xid = xid;
+        cxn->barrier.epoch ^= 1;
+        cxn->barrier.background_cnt++;
+        return (INDIGO_ERROR_NONE);
+    }
+    cxn->barrier.xid = xid;
+
     /* Pause the socket and mark a barrier is pending */
     if (ind_soc_data_in_pause(cxn->sd) < 0) {
         LOG_ERROR(cxn, "Error pausing soc read on barrier request");
@@ -671,7 +854,7 @@ nicira_controller_role_request_handle(connection_t *cxn, of_object_t *_obj)
             ind_cxn_change_master(cxn->cxn_id);
         } else {
             LOG_INFO(cxn, "Setting role to %s", role_to_string(role));
-            cxn->status.role = role;
+            ind_cxn_role_set(cxn, role);
         }
     }
 
@@ -708,7 +891,7 @@ translate_to_openflow_role(indigo_cxn_role_t role)
 /**
  * Handle a role request
  */
-static void
+static indigo_error_t
 role_request_handle(connection_t *cxn, of_object_t *_obj)
 {
     of_role_request_t *request = _obj;
@@ -719,7 +902,7 @@ role_request_handle(connection_t *cxn, of_object_t *_obj)
     uint64_t generation_id;
 
     if ((reply = of_role_reply_new(_obj->version)) == NULL) {
-        return;
+        return INDIGO_ERROR_RESOURCE;
     }
 
     request = (of_role_request_t *)_obj;
@@ -736,7 +919,7 @@ role_request_handle(connection_t *cxn, of_object_t *_obj)
                 OF_ERROR_TYPE_ROLE_REQUEST_FAILED,
                 OF_ROLE_REQUEST_FAILED_BAD_ROLE);
             of_object_delete(reply);
-            return;
+            return INDIGO_ERROR_NONE;
         }
 
         LOG_VERBOSE(cxn, "Cxn role request: %s gen %"PRIu64,
@@ -750,7 +933,7 @@ role_request_handle(connection_t *cxn, of_object_t *_obj)
                     OF_ERROR_TYPE_ROLE_REQUEST_FAILED,
                     OF_ROLE_REQUEST_FAILED_STALE);
                 of_object_delete(reply);
-                return;
+                return INDIGO_ERROR_NONE;
             } else {
                 ind_cxn_generation_id = generation_id;
             }
@@ -761,7 +944,7 @@ role_request_handle(connection_t *cxn, of_object_t *_obj)
                 ind_cxn_change_master(cxn->cxn_id);
             } else {
                 LOG_INFO(cxn, "Setting role to %s", role_to_string(role));
-                cxn->status.role = role;
+                ind_cxn_role_set(cxn, role);
             }
         }
     }
@@ -772,13 +955,15 @@ role_request_handle(connection_t *cxn, of_object_t *_obj)
     of_role_reply_generation_id_set(reply, ind_cxn_generation_id);
 
     indigo_cxn_send_controller_message(cxn->cxn_id, reply);
+
+    return INDIGO_ERROR_NONE;
 }
 
 /**
  * Handle a BSN time request
  */
 
-static void
+static indigo_error_t
 bsn_time_request_handle(connection_t *cxn, of_object_t *_obj)
 {
     of_bsn_time_request_t *request = _obj;
@@ -791,7 +976,7 @@ bsn_time_request_handle(connection_t *cxn, of_object_t *_obj)
     reply = of_bsn_time_reply_new(request->version);
     if (reply == NULL) {
         LOG_ERROR(cxn, "Failed to allocate of_bsn_time_reply");
-        return;
+        return INDIGO_ERROR_RESOURCE;
     }
 
     time_ms = INDIGO_TIME_DIFF_ms(cxn->hello_time, INDIGO_CURRENT_TIME);
@@ -800,13 +985,15 @@ bsn_time_request_handle(connection_t *cxn, of_object_t *_obj)
     of_bsn_time_reply_time_ms_set(reply, time_ms);
 
     indigo_cxn_send_controller_message(cxn->cxn_id, reply);
+
+    return INDIGO_ERROR_NONE;
 }
 
 /**
  * Handle a BSN controller connections request
  */
 
-static void
+static indigo_error_t
 bsn_controller_connections_request_handle(connection_t *cxn, of_object_t *_obj)
 {
     of_bsn_controller_connections_request_t *request = _obj;
@@ -818,7 +1005,7 @@ bsn_controller_connections_request_handle(connection_t *cxn, of_object_t *_obj)
     reply = of_bsn_controller_connections_reply_new(request->version);
     if (reply == NULL) {
         LOG_ERROR(cxn, "Failed to allocate of_bsn_controller_connections_reply");
-        return;
+        return INDIGO_ERROR_RESOURCE;
     }
 
     of_bsn_controller_connections_reply_xid_set(reply, xid);
@@ -829,16 +1016,56 @@ bsn_controller_connections_request_handle(connection_t *cxn, of_object_t *_obj)
     ind_cxn_populate_connection_list(&list);
 
     indigo_cxn_send_controller_message(cxn->cxn_id, reply);
+
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Process messages buffered behind a barrier once it completes
+ */
+
+static void
+buffered_messages_timer(void *cookie)
+{
+    connection_t *cxn = (connection_t *)cookie;
+    int rv;
+
+    rv = ind_cxn_process_buffered_messages(cxn);
+
+    /* Records decrypted ahead of the barrier do not wake up the socket */
+    while (rv == INDIGO_ERROR_NONE && CXN_TLS(cxn) &&
+           ind_cxn_tls_pending(cxn)) {
+        rv = ind_cxn_process_read_buffer(cxn);
+    }
+
+    if (rv < 0 && rv != INDIGO_ERROR_PENDING) {
+        LOG_VERBOSE(cxn, "Error processing read buffer, resetting");
+        ind_cxn_disconnect(cxn);
+    }
 }
 
 /**
- * Callback routine for message object delete
+ * True if a tracked operation only reads state
+ */
+
+static int
+cxn_op_read_only(of_object_t *obj)
+{
+    of_message_t msg = OF_OBJECT_TO_MESSAGE(obj);
+
+    return msg != NULL && of_message_type_get(msg) ==
+        OF_OBJ_TYPE_STATS_REQUEST_BY_VERSION(obj->version);
+}
+
+/**
+ * Message object delete for an operation tracked in the given epoch
  *
  * @param obj The object about to be deleted
+ * @param epoch Epoch the operation was tracked in
  */
 
 static void
-cxn_object_delete_cb(of_object_t *obj)
+cxn_object_delete(of_object_t *obj, int epoch)
 {
     connection_t *cxn;
 
@@ -855,9 +1082,22 @@ cxn_object_delete_cb(of_object_t *obj)
 
     INDIGO_ASSERT(cxn->outstanding_op_cnt > 0);
     cxn->outstanding_op_cnt -= 1;
+    cxn->barrier.epoch_op_cnt[epoch] -= 1;
+    if (!cxn_op_read_only(obj)) {
+        cxn->barrier.write_op_cnt -= 1;
+    }
 
     LOG_TRACE(cxn, "Op count %d", cxn->outstanding_op_cnt);
 
+    /* The operations before a background barrier are done */
+    if (cxn->barrier.backgroundf &&
+            cxn->barrier.epoch_op_cnt[cxn->barrier.epoch ^ 1] == 0 &&
+            CONNECTION_STATE(cxn) != INDIGO_CXN_S_CLOSING) {
+        LOG_TRACE(cxn, "Earlier ops done, sending background barrier reply");
+        send_barrier_reply(cxn, cxn->barrier.background_xid);
+        cxn->barrier.backgroundf = 0;
+    }
+
     /* Check if outstanding ops is now 0 and clean up if needed */
     if (cxn->outstanding_op_cnt == 0) {
         if (CONNECTION_STATE(cxn) == INDIGO_CXN_S_CLOSING) {
@@ -865,13 +1105,29 @@ cxn_object_delete_cb(of_object_t *obj)
             cxn_state_set(cxn, INDIGO_CXN_S_DISCONNECTED);
         } else if (cxn->barrier.pendingf) {
             LOG_TRACE(cxn, "Op count 0, sending barrier reply");
-            send_barrier_reply(cxn);
+            send_barrier_reply(cxn, cxn->barrier.xid);
             cxn->barrier.pendingf = 0;
             (void)ind_soc_data_in_resume(cxn->sd);
+            /* Messages after the barrier may already be buffered */
+            ind_soc_timer_event_register_with_priority(
+                buffered_messages_timer, (void *)cxn,
+                IND_SOC_TIMER_IMMEDIATE, IND_CXN_EVENT_PRIORITY);
         }
     }
 }
 
+/* The epoch is carried by which callback the object holds */
+static void
+cxn_object_delete_cb_0(of_object_t *obj)
+{
+    cxn_object_delete(obj, 0);
+}
+
+static void
+cxn_object_delete_cb_1(of_object_t *obj)
+{
+    cxn_object_delete(obj, 1);
+}
 
 /**
  * Track objects for outstanding op count
@@ -886,78 +1142,93 @@ cxn_object_delete_cb(of_object_t *obj)
 void
 cxn_message_track_setup(connection_t *cxn, of_object_t *obj)
 {
-    obj->track_info.delete_cb = cxn_object_delete_cb;
+    int epoch = cxn->barrier.epoch;
+
+    obj->track_info.delete_cb = epoch ? cxn_object_delete_cb_1 :
+        cxn_object_delete_cb_0;
     obj->track_info.delete_cookie = cxn_to_cookie(cxn);
     cxn->outstanding_op_cnt++;
+    cxn->barrier.epoch_op_cnt[epoch]++;
+    if (!cxn_op_read_only(obj)) {
+        cxn->barrier.write_op_cnt++;
+    }
 }
 
 
+/**
+ * Connection level handling, indexed by message object id
+ *
+ * Messages with a handler are processed here. The rest go to the
+ * state manager, unless they change switch state and the connection
+ * is a slave.
+ */
+
+typedef indigo_error_t (*cxn_msg_handler_f)(connection_t *cxn,
+                                            of_object_t *obj);
+
+typedef struct cxn_msg_type_s {
+    cxn_msg_handler_f handler;
+    bool master_only;
+} cxn_msg_type_t;
+
+static const cxn_msg_type_t cxn_msg_types[OF_MESSAGE_OBJECT_COUNT] = {
+    [OF_ECHO_REQUEST] = { echo_request_handle },
+    [OF_ECHO_REPLY] = { echo_reply_handle },
+    [OF_BARRIER_REQUEST] = { barrier_request_handle },
+    [OF_NICIRA_CONTROLLER_ROLE_REQUEST] = {
+        nicira_controller_role_request_handle },
+    [OF_ROLE_REQUEST] = { role_request_handle },
+    [OF_BSN_TIME_REQUEST] = { bsn_time_request_handle },
+    [OF_BSN_CONTROLLER_CONNECTIONS_REQUEST] = {
+        bsn_controller_connections_request_handle },
+
+    [OF_FLOW_ADD] = { NULL, true },
+    [OF_FLOW_DELETE] = { NULL, true },
+    [OF_FLOW_DELETE_STRICT] = { NULL, true },
+    [OF_FLOW_MODIFY] = { NULL, true },
+    [OF_FLOW_MODIFY_STRICT] = { NULL, true },
+    [OF_PACKET_OUT] = { NULL, true },
+    [OF_PORT_MOD] = { NULL, true },
+    [OF_SET_CONFIG] = { NULL, true },
+    [OF_BSN_SET_IP_MASK] = { NULL, true },
+    [OF_BSN_SET_MIRRORING] = { NULL, true },
+    [OF_BSN_SET_PKTIN_SUPPRESSION_REQUEST] = { NULL, true },
+    [OF_GROUP_MOD] = { NULL, true },
+};
+
 /**
  * Process an object pulled off a connection.
  *
  * @param cxn Connection from which message arrived
  * @param obj The message object
  *
- * Handle echo request, echo reply and barrier request locally
+ * Handle the messages in cxn_msg_types locally
  */
 static void
 of_msg_process(connection_t *cxn, of_object_t *obj)
 {
-    /* Note that the messages handled in cxn_instance are not tracked */
-    switch (obj->object_id) {
-    case OF_ECHO_REQUEST:
-        echo_request_handle(cxn, obj);
-        return;
-
-    case OF_ECHO_REPLY:
-        echo_reply_handle(cxn, obj);
-        return;
-
-    case OF_BARRIER_REQUEST:
-        barrier_request_handle(cxn, obj);
-        return;
-
-    case OF_NICIRA_CONTROLLER_ROLE_REQUEST:
-        nicira_controller_role_request_handle(cxn, obj);
-        return;
+    const cxn_msg_type_t *type;
 
-    case OF_ROLE_REQUEST:
-        role_request_handle(cxn, obj);
+    if (obj->object_id < 0 || obj->object_id >= OF_MESSAGE_OBJECT_COUNT) {
+        OF_MSG_CALLBACK(cxn, obj);
         return;
+    }
 
-    case OF_BSN_TIME_REQUEST:
-        bsn_time_request_handle(cxn, obj);
+    /* Note that the messages handled in cxn_instance are not tracked */
+    type = &cxn_msg_types[obj->object_id];
+    if (type->handler != NULL) {
+        type->handler(cxn, obj);
         return;
+    }
 
-    case OF_BSN_CONTROLLER_CONNECTIONS_REQUEST:
-        bsn_controller_connections_request_handle(cxn, obj);
+    if (type->master_only && ind_cxn_role_get(cxn) == INDIGO_CXN_R_SLAVE) {
+        uint16_t code = cxn->status.negotiated_version < OF_VERSION_1_2 ?
+            OF_REQUEST_FAILED_EPERM : OF_REQUEST_FAILED_IS_SLAVE;
+        LOG_VERBOSE(cxn, "Rejecting %s from slave connection",
+                    of_object_id_str[obj->object_id]);
+        indigo_cxn_send_error_reply(cxn->cxn_id, obj,
+                                    OF_ERROR_TYPE_BAD_REQUEST, code);
         return;
-
-    /* Check permissions and fall through */
-    case OF_FLOW_ADD:
-    case OF_FLOW_DELETE:
-    case OF_FLOW_DELETE_STRICT:
-    case OF_FLOW_MODIFY:
-    case OF_FLOW_MODIFY_STRICT:
-    case OF_PACKET_OUT:
-    case OF_PORT_MOD:
-    case OF_SET_CONFIG:
-    case OF_BSN_SET_IP_MASK:
-    case OF_BSN_SET_MIRRORING:
-    case OF_BSN_SET_PKTIN_SUPPRESSION_REQUEST:
-    case OF_GROUP_MOD:
-        if (cxn->status.role == INDIGO_CXN_R_SLAVE) {
-            uint16_t code = cxn->status.negotiated_version < OF_VERSION_1_2 ?
-                OF_REQUEST_FAILED_EPERM : OF_REQUEST_FAILED_IS_SLAVE;
-            LOG_VERBOSE(cxn, "Rejecting %s from slave connection",
-                        of_object_id_str[obj->object_id]);
-            indigo_cxn_send_error_reply(cxn->cxn_id, obj,
-                                        OF_ERROR_TYPE_BAD_REQUEST, code);
-            return;
-        }
-
-    default:
-        break;
     }
 
     OF_MSG_CALLBACK(cxn, obj);
@@ -969,10 +1240,8 @@ of_msg_process(connection_t *cxn, of_object_t *obj)
 #define IS_MSG_OBJ(obj) \
     ((obj)->object_id >= 0 && (obj)->object_id < OF_MESSAGE_OBJECT_COUNT)
 
-#define READING_HEADER(cxn) (((cxn)->read_bytes) < OF_MESSAGE_HEADER_LENGTH)
-
 /**
- * Read from the cxn, up to cxn->bytes_needed bytes; update bytes needed
+ * Read from the cxn, filling as much of the read buffer as possible
  *
  * Return number of bytes read if no error
  * Return < 0, error number, if error.
@@ -989,7 +1258,13 @@ read_from_cxn(connection_t *cxn)
     uint8_t *inbuf_start;
 
     inbuf_start = &cxn->read_buffer[cxn->read_bytes];
-    bytes_in = read(cxn->sd, inbuf_start, cxn->bytes_needed);
+    if (CXN_TLS(cxn)) {
+        bytes_in = ind_cxn_tls_read(cxn, inbuf_start,
+                                    READ_BUFFER_SIZE - cxn->read_bytes);
+    } else {
+        bytes_in = read(cxn->sd, inbuf_start,
+                        READ_BUFFER_SIZE - cxn->read_bytes);
+    }
 
     /*
      * Reading 0 bytes indicates connection has closed, although we allow
@@ -1013,80 +1288,56 @@ read_from_cxn(connection_t *cxn)
     }
 
     cxn->status.bytes_in += bytes_in;
+    IND_CXN_CAPTURE(IND_CXN_CAPTURE_DATA, cxn, inbuf_start, bytes_in);
+    if (cxn->config_params.socket.quickack > 0) {
+        ind_cxn_socket_quickack(cxn);
+    }
 #if defined(DUMP_OBJECTS_AND_DATA)
     cxn_data_hexdump(&cxn->read_buffer[cxn->read_bytes], bytes_in);
 #endif
 
-    INDIGO_ASSERT((int)bytes_in <= cxn->bytes_needed);
+    INDIGO_ASSERT((int)bytes_in <= READ_BUFFER_SIZE - cxn->read_bytes);
     cxn->read_bytes += bytes_in;
-    cxn->bytes_needed -= bytes_in;
 
     return bytes_in;
 }
 
 /**
- * Try to read a full message from the connnection
+ * Check for a full message at the read offset of the read buffer
  *
+ * @param cxn The connection
+ * @param msg_bytes (out) Length of the message if one is ready
  * @returns INDIGO_ERROR_NONE if message is ready
  * @returns INDIGO_ERROR_PENDING if message is not ready
- * @returns INDIGO_ERROR_CONNECTION if a read error has occurred
  * @returns INDIGO_ERROR_PROTOCOL if the data stream has illegal values
- *
- * If INDIGO_ERROR_NONE is returned, a message is ready to be processed
- * in the connection's read buffer.
  */
 
 static inline int
-read_message(connection_t *cxn)
+next_message(connection_t *cxn, int *msg_bytes)
 {
-    of_message_t msg = NULL;
-    int msg_bytes;
-    int rv = INDIGO_ERROR_NONE;
+    of_message_t msg;
+    int avail = cxn->read_bytes - cxn->read_offset;
 
-    /* No bytes needed; must be stuck. */
-    if (cxn->bytes_needed == 0) {
-        LOG_TRACE(cxn, "Processing appears to be blocked");
+    if (avail < OF_MESSAGE_HEADER_LENGTH) {
+        LOG_TRACE(cxn, "Still need %d bytes for msg hdr",
+                  OF_MESSAGE_HEADER_LENGTH - avail);
         return INDIGO_ERROR_PENDING;
     }
 
-    if (READING_HEADER(cxn)) {
-        INDIGO_ASSERT(cxn->bytes_needed + cxn->read_bytes ==
-                      OF_MESSAGE_HEADER_LENGTH);
-        if ((rv = read_from_cxn(cxn)) < 0) {
-            return rv;
-        }
-
-        if (cxn->bytes_needed != 0) {
-            LOG_TRACE(cxn, "Still need %d bytes for msg hdr",
-                      cxn->bytes_needed);
-            return INDIGO_ERROR_PENDING;
-        }
-
-        msg = (of_message_t)(cxn->read_buffer);
-        msg_bytes = of_message_length_get(msg);
-        if (msg_bytes < OF_MESSAGE_HEADER_LENGTH) {
-            LOG_TRACE(cxn, "Illegal msg length %d. Framing error?", msg_bytes);
-            ++ind_cxn_internal_errors;
-            return INDIGO_ERROR_PROTOCOL;
-        }
-        cxn->bytes_needed = msg_bytes - OF_MESSAGE_HEADER_LENGTH;
-    }
-
-    /* Check if the message only needed the header */
-    if (cxn->bytes_needed == 0) {
-        return INDIGO_ERROR_NONE;
+    msg = (of_message_t)(&cxn->read_buffer[cxn->read_offset]);
+    *msg_bytes = of_message_length_get(msg);
+    if (*msg_bytes < OF_MESSAGE_HEADER_LENGTH) {
+        LOG_TRACE(cxn, "Illegal msg length %d. Framing error?", *msg_bytes);
+        ++ind_cxn_internal_errors;
+        return INDIGO_ERROR_PROTOCOL;
     }
 
-    /* Read the rest of the message; return if error */
-    if ((rv = read_from_cxn(cxn)) < 0) {
-        return rv;
-    }
-    if (cxn->bytes_needed == 0) { /* Read full message, return ready */
-        return INDIGO_ERROR_NONE;
+    if (avail < *msg_bytes) {
+        LOG_TRACE(cxn, "Still need %d bytes for msg", *msg_bytes - avail);
+        return INDIGO_ERROR_PENDING;
     }
 
-    /* Still need more bytes; return pending */
-    return INDIGO_ERROR_PENDING;
+    return INDIGO_ERROR_NONE;
 }
 
 /**
@@ -1148,22 +1399,17 @@ send_parse_error_message(connection_t *cxn, uint8_t *buf, int len)
  */
 
 static inline void
-process_message(connection_t *cxn)
+process_message(connection_t *cxn, uint8_t *buf, int len)
 {
     of_object_t *obj;
-    int len;
     int rv;
     of_object_storage_t obj_storage;
+    uint64_t start = (ind_cxn_trace_ring != NULL) ? aim_trace_now() : 0;
 
-    /* Clear read buffer for next read */
-    len = cxn->read_bytes;
-    cxn->read_bytes = 0;
-    cxn->bytes_needed = OF_MESSAGE_HEADER_LENGTH;
-
-    obj = of_object_new_from_message_preallocated(&obj_storage, cxn->read_buffer, len);
+    obj = of_object_new_from_message_preallocated(&obj_storage, buf, len);
     if (obj == NULL) {
         LOG_ERROR(cxn, "Could not parse msg to OF object, len %d", len);
-        send_parse_error_message(cxn, cxn->read_buffer, len);
+        send_parse_error_message(cxn, buf, len);
         return;
     }
 
@@ -1179,11 +1425,9 @@ process_message(connection_t *cxn)
         cxn->keepalive.outstanding_echo_cnt = 0;
 
 #if OFCONNECTIONMANAGER_CONFIG_ECHO_OPTIMIZATION == 1
-        if (cxn->keepalive.period_ms > 0) {
-            ind_soc_timer_event_register_with_priority(
-                periodic_keepalive, (void *)cxn,
-                cxn->keepalive.period_ms, IND_CXN_EVENT_PRIORITY);
-        }
+        /* periodic_keepalive checks this rather than the timer being
+         * pushed back on every message */
+        cxn->keepalive.last_rx_time = INDIGO_LOOP_TIME;
 #endif
 
     }
@@ -1195,6 +1439,9 @@ process_message(connection_t *cxn)
                     of_object_id_str[obj->object_id], xid);
         LOG_OBJECT(obj);
 
+        IND_SOC_RECORD(IND_SOC_RECORD_MSG_RX, cxn->cxn_id,
+                       (uintptr_t)of_object_id_str[obj->object_id], xid);
+
         if (IS_MSG_OBJ(obj)) {
             cxn->messages_in_by_type[obj->object_id]++;
         } else {
@@ -1214,6 +1461,8 @@ process_message(connection_t *cxn)
         /* Process received message */
         of_msg_process(cxn, obj);
     }
+
+    IND_CXN_TRACE(IND_CXN_TRACE_RX, cxn, buf, len, start);
 }
 
 /**
@@ -1225,14 +1474,74 @@ process_message(connection_t *cxn)
 
 int
 ind_cxn_process_read_buffer(connection_t *cxn)
+{
+    int rv;
+
+    /* Messages left behind by a barrier are processed first */
+    if ((rv = ind_cxn_process_buffered_messages(cxn)) < 0) {
+        return rv;
+    }
+
+    if (cxn->barrier.pendingf) {
+        LOG_TRACE(cxn, "Processing appears to be blocked");
+        return INDIGO_ERROR_PENDING;
+    }
+
+    if ((rv = read_from_cxn(cxn)) < 0) {
+        return rv;
+    }
+
+    echo_fast_path(cxn, aim_trace_now());
+
+    return ind_cxn_process_buffered_messages(cxn);
+}
+
+/**
+ * Process every complete message already in the read buffer
+ *
+ * Processing stops early if the connection is closed or a barrier is
+ * pending; the remaining bytes are kept in the read buffer.
+ *
+ * @returns INDIGO_ERROR_NONE if no framing error
+ * @returns INDIGO_ERROR_PROTOCOL if the data stream has illegal values
+ */
+
+int
+ind_cxn_process_buffered_messages(connection_t *cxn)
 {
     int rv = INDIGO_ERROR_NONE;
+    int msg_bytes;
+    uint8_t *msg;
+
+    while (CXN_TCP_CONNECTED(cxn) && !cxn->barrier.pendingf) {
+        if ((rv = next_message(cxn, &msg_bytes)) != INDIGO_ERROR_NONE) {
+            break;
+        }
 
-    if ((rv = read_message(cxn)) == INDIGO_ERROR_NONE) {
-        process_message(cxn);
+        msg = &cxn->read_buffer[cxn->read_offset];
+        cxn->read_offset += msg_bytes;
+        process_message(cxn, msg, msg_bytes);
     }
 
-    return rv;
+    /* Batched packet-outs point into the read buffer */
+    indigo_core_receive_controller_flush();
+
+    /* Move a partial message to the start of the buffer */
+    if (cxn->read_offset > 0) {
+        if (cxn->read_offset < cxn->read_bytes) {
+            memmove(cxn->read_buffer, &cxn->read_buffer[cxn->read_offset],
+                    cxn->read_bytes - cxn->read_offset);
+        }
+        cxn->read_bytes -= cxn->read_offset;
+        if (cxn->keepalive.scan_offset > cxn->read_offset) {
+            cxn->keepalive.scan_offset -= cxn->read_offset;
+        } else {
+            cxn->keepalive.scan_offset = 0;
+        }
+        cxn->read_offset = 0;
+    }
+
+    return (rv == INDIGO_ERROR_PROTOCOL) ? rv : INDIGO_ERROR_NONE;
 }
 
 /**
@@ -1300,55 +1609,65 @@ ind_cxn_process_write_buffer(connection_t *cxn)
     int written, left;
     int num_iovecs = 0;
     struct iovec iovecs[MAX_WRITE_MSGS];
-    biglist_t *cur_node;
     struct iovec *iov;
 
-    /* Iterate over cxn->output_list adding buffers to iovecs */
-    cur_node = cxn->output_list;
-    while (cur_node != NULL && num_iovecs < MAX_WRITE_MSGS) {
+    if (CXN_TLS(cxn) && !cxn->tls_ready) {
+        /* Queued output waits for the handshake */
+        return 0;
+    }
+
+    /* Iterate over cxn->output_queue adding buffers to iovecs */
+    while (num_iovecs < cxn->output_count && num_iovecs < MAX_WRITE_MSGS) {
+        cxn_output_buf_t *buf =
+            &cxn->output_queue[OUTPUT_QUEUE_SLOT(cxn, num_iovecs)];
         iov = &iovecs[num_iovecs];
-        iov->iov_base = BIGLIST_CAST(void *, cur_node);
-        iov->iov_len = of_message_length_get(iov->iov_base);
+        iov->iov_base = buf->data;
+        iov->iov_len = buf->bytes;
         if (num_iovecs == 0) {
             /* First buffer may be partially written */
             iov->iov_base += cxn->output_head_offset;
             iov->iov_len -= cxn->output_head_offset;
         }
         num_iovecs++;
-        cur_node = biglist_next(cur_node);
     }
 
-    written = writev(cxn->sd, iovecs, num_iovecs);
+    if (CXN_TLS(cxn) && !cxn->tls_ktls) {
+        written = ind_cxn_tls_writev(cxn, iovecs, num_iovecs);
+    } else {
+        written = writev(cxn->sd, iovecs, num_iovecs);
+    }
 
     if (written < 0) {
         /* Error writing to connection socket */
         LOG_ERROR(cxn, "Error writing to socket: %s", strerror(errno));
         return INDIGO_ERROR_UNKNOWN;
     }
+    cxn->output_flushes++;
 
     /*
-     * Iterate over cxn->output_list and iovecs together, freeing completely
+     * Iterate over cxn->output_queue and iovecs together, freeing completely
      * sent messages.
      */
     left = written;
     iov = iovecs;
     while (left > 0) {
         int to_write, bytes_out;
-        cur_node = cxn->output_list;
 
-        /* Number of bytes we attempted to send in this message */
+        /* Number of bytes we attempted to send in this buffer */
         to_write = iov->iov_len;
 
-        /* Number of bytes we actually sent in this message */
+        /* Number of bytes we actually sent in this buffer */
         bytes_out = aim_imin(left, to_write);
         cxn->bytes_enqueued -= bytes_out;
-
-        if (bytes_out == to_write) { /* Completed this message */
-            aim_free(BIGLIST_CAST(void *, cur_node));
-            cxn->output_list =
-                biglist_remove_link_free(cxn->output_list, cur_node);
-            cxn->pkts_enqueued--;
-            cxn->status.messages_out++;
+        indigo_mem_account_free(INDIGO_MEM_TAG_CXN_QUEUE, bytes_out);
+
+        if (bytes_out == to_write) { /* Completed this buffer */
+            cxn_output_buf_t *buf = &cxn->output_queue[cxn->output_head];
+            cxn->pkts_enqueued -= buf->msgs;
+            cxn->status.messages_out += buf->msgs;
+            output_buf_free(cxn, buf);
+            cxn->output_head = OUTPUT_QUEUE_SLOT(cxn, 1);
+            cxn->output_count--;
             cxn->output_head_offset = 0;
         } else {
             /* Partial write */
@@ -1361,7 +1680,13 @@ ind_cxn_process_write_buffer(connection_t *cxn)
         iov++;
     }
 
-    if (cxn->output_list == NULL) { /* Nothing (more) to send */
+    if (cxn->congested && cxn->bytes_enqueued <= CXN_OUTPUT_LOW_WATERMARK) {
+        LOG_VERBOSE(cxn, "Output queue drained to %d bytes",
+                    cxn->bytes_enqueued);
+        cxn->congested = 0;
+    }
+
+    if (cxn->output_count == 0) { /* Nothing (more) to send */
         LOG_TRACE(cxn, "No more data to write");
         INDIGO_ASSERT(cxn->bytes_enqueued == 0);
         INDIGO_ASSERT(cxn->pkts_enqueued == 0);
@@ -1372,21 +1697,102 @@ ind_cxn_process_write_buffer(connection_t *cxn)
 }
 
 /**
- * Enqueue data into the write buffer for transmission to a controller
+ * Double the number of slots in the output queue
  *
- * @param cxn The connection handle
- * @param data Pointer to a message to be sent
- * @param len Number of bytes to be sent out
- *
- * @returns Error code
+ * The queued buffers are moved so that the oldest is in slot 0.
+ */
+
+static int
+output_queue_grow(connection_t *cxn)
+{
+    cxn_output_buf_t *queue;
+    int size;
+    int i;
+
+    size = cxn->output_queue_size ? cxn->output_queue_size * 2 :
+        OUTPUT_QUEUE_INIT_SIZE;
+    queue = aim_zmalloc(size * sizeof(*queue));
+    if (queue == NULL) {
+        LOG_ERROR(cxn, "Could not grow output queue to %d messages", size);
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    for (i = 0; i < cxn->output_count; i++) {
+        queue[i] = cxn->output_queue[OUTPUT_QUEUE_SLOT(cxn, i)];
+    }
+
+    aim_free(cxn->output_queue);
+    cxn->output_queue = queue;
+    cxn->output_queue_size = size;
+    cxn->output_head = 0;
+
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Copy a small message into the arena at the tail of the output queue
  *
- * Takes ownership of data unless an error is returned.
+ * A new arena is queued if the tail buffer is not an arena or is full.
+ * The caller keeps ownership of data.
  */
 
-int
-ind_cxn_instance_enqueue(connection_t *cxn, uint8_t *data, int len)
+static int
+output_coalesce(connection_t *cxn, uint8_t *data, int len)
+{
+    cxn_output_buf_t *buf = NULL;
+
+    if (cxn->output_count > 0) {
+        buf = &cxn->output_queue[OUTPUT_QUEUE_SLOT(cxn, cxn->output_count - 1)];
+        if (buf->alloc_bytes - buf->bytes < len) {
+            buf = NULL;
+        }
+    }
+
+    if (buf == NULL) {
+        if (cxn->output_count == cxn->output_queue_size) {
+            if (output_queue_grow(cxn) < 0) {
+                return INDIGO_ERROR_RESOURCE;
+            }
+        }
+        buf = &cxn->output_queue[OUTPUT_QUEUE_SLOT(cxn, cxn->output_count)];
+        if (cxn->spare_arena != NULL) {
+            buf->data = cxn->spare_arena;
+            cxn->spare_arena = NULL;
+        } else {
+            buf->data = aim_malloc(COALESCE_BUFFER_SIZE);
+            if (buf->data == NULL) {
+                return INDIGO_ERROR_RESOURCE;
+            }
+        }
+        buf->bytes = 0;
+        buf->alloc_bytes = COALESCE_BUFFER_SIZE;
+        buf->msgs = 0;
+        buf->shared = NULL;
+        cxn->output_count++;
+    }
+
+    memcpy(buf->data + buf->bytes, data, len);
+    buf->bytes += len;
+    buf->msgs++;
+
+    cxn->coalesced_msgs++;
+    cxn->coalesced_bytes += len;
+
+    return INDIGO_ERROR_NONE;
+}
+
+/*
+ * Queue a message, either owned (sbuf is NULL) or referencing a shared
+ * buffer. Small messages are copied into an arena in both cases. With
+ * borrowed set, data stays the caller's; it is copied into an arena if it
+ * fits one and into its own buffer otherwise.
+ */
+static int
+output_enqueue(connection_t *cxn, uint8_t *data, int len,
+               ind_cxn_shared_buf_t *sbuf, int borrowed)
 {
     int msg_len;
+    cxn_output_buf_t *buf;
 
     LOG_TRACE(cxn, "Enqueuing %d bytes", len);
     LOG_TRACE(cxn, "Cur len %d bytes, %d pkts",
@@ -1404,9 +1810,57 @@ ind_cxn_instance_enqueue(connection_t *cxn, uint8_t *data, int len)
                   len, msg_len);
         return INDIGO_ERROR_UNKNOWN;
     }
-    cxn->output_list = biglist_append(cxn->output_list, (void *)data);
+
+    IND_CXN_TRACE(IND_CXN_TRACE_TX, cxn, data, len, 0);
+
+    if (len <= COALESCE_MSG_MAX || (borrowed && len <= COALESCE_BUFFER_SIZE)) {
+        if (output_coalesce(cxn, data, len) < 0) {
+            return INDIGO_ERROR_RESOURCE;
+        }
+        if (sbuf == NULL && !borrowed) {
+            aim_free(data);
+        }
+    } else {
+        if (cxn->output_count == cxn->output_queue_size) {
+            if (output_queue_grow(cxn) < 0) {
+                return INDIGO_ERROR_RESOURCE;
+            }
+        }
+        if (borrowed) {
+            uint8_t *copy = aim_malloc(len);
+            if (copy == NULL) {
+                return INDIGO_ERROR_RESOURCE;
+            }
+            memcpy(copy, data, len);
+            data = copy;
+        }
+        buf = &cxn->output_queue[OUTPUT_QUEUE_SLOT(cxn, cxn->output_count)];
+        buf->data = data;
+        buf->bytes = len;
+        buf->alloc_bytes = 0;
+        buf->msgs = 1;
+        buf->shared = sbuf;
+        if (sbuf != NULL) {
+            sbuf->refcount++;
+            cxn->shared_msgs++;
+            cxn->shared_bytes += len;
+        }
+        cxn->output_count++;
+    }
     cxn->bytes_enqueued += len;
     cxn->pkts_enqueued += 1;
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_CXN_QUEUE, len);
+
+    /* Also congested while all queues together exceed the CXN_QUEUE soft limit */
+    if (!cxn->congested &&
+        (cxn->bytes_enqueued >= CXN_OUTPUT_HIGH_WATERMARK ||
+         indigo_mem_soft_limit_exceeded(INDIGO_MEM_TAG_CXN_QUEUE))) {
+        LOG_VERBOSE(cxn, "Output queue congested at %d bytes, %d pkts",
+                    cxn->bytes_enqueued, cxn->pkts_enqueued);
+        cxn->congested = 1;
+        cxn->packet_in_pressure_seq = 0;
+        cxn->status.congestion_count++;
+    }
 
     /* Indicate data is ready to the socket manager */
     INDIGO_ASSERT(cxn->bytes_enqueued > 0);
@@ -1416,6 +1870,94 @@ ind_cxn_instance_enqueue(connection_t *cxn, uint8_t *data, int len)
     return INDIGO_ERROR_NONE;
 }
 
+/**
+ * Enqueue data into the write buffer for transmission to a controller
+ *
+ * @param cxn The connection handle
+ * @param data Pointer to a message to be sent
+ * @param len Number of bytes to be sent out
+ *
+ * @returns Error code
+ *
+ * Takes ownership of data unless an error is returned.
+ */
+
+int
+ind_cxn_instance_enqueue(connection_t *cxn, uint8_t *data, int len)
+{
+    return output_enqueue(cxn, data, len, NULL, 0);
+}
+
+/**
+ * Enqueue a copy of a message for transmission to a controller
+ *
+ * @param cxn The connection handle
+ * @param data Pointer to the message
+ * @param len Number of bytes to be sent out
+ *
+ * @returns Error code
+ *
+ * The message is copied into an output arena when it fits one, so no
+ * allocation is made per message; data stays the caller's.
+ */
+
+int
+ind_cxn_instance_enqueue_copy(connection_t *cxn, uint8_t *data, int len)
+{
+    return output_enqueue(cxn, data, len, NULL, 1);
+}
+
+/**
+ * Enqueue a shared message buffer for transmission to a controller
+ *
+ * @param cxn The connection handle
+ * @param sbuf The shared buffer holding the message
+ * @param len Number of bytes to be sent out
+ *
+ * @returns Error code
+ *
+ * Takes a reference to sbuf if the message is queued without a copy; the
+ * caller keeps its own reference either way.
+ */
+
+int
+ind_cxn_instance_enqueue_shared(connection_t *cxn, ind_cxn_shared_buf_t *sbuf,
+                                int len)
+{
+    return output_enqueue(cxn, sbuf->data, len, sbuf, 0);
+}
+
+/**
+ * Wrap a message wire buffer for sharing between connections
+ *
+ * Takes ownership of data on success. The returned buffer holds one
+ * reference for the caller.
+ */
+
+ind_cxn_shared_buf_t *
+ind_cxn_shared_buf_create(uint8_t *data)
+{
+    ind_cxn_shared_buf_t *sbuf = aim_zmalloc(sizeof(*sbuf));
+
+    if (sbuf == NULL) {
+        return NULL;
+    }
+    sbuf->refcount = 1;
+    sbuf->data = data;
+
+    return sbuf;
+}
+
+void
+ind_cxn_shared_buf_release(ind_cxn_shared_buf_t *sbuf)
+{
+    INDIGO_ASSERT(sbuf->refcount > 0);
+    if (--sbuf->refcount == 0) {
+        aim_free(sbuf->data);
+        aim_free(sbuf);
+    }
+}
+
 /**
  * Send a hello message to the given connection
  */
@@ -1442,6 +1984,91 @@ ind_cxn_send_hello(connection_t *cxn)
 }
 
 
+/**
+ * Apply the configured socket options to the connection socket
+ * @param cxn The instance control block
+ *
+ * Called when the socket is created or accepted. Failures are logged and
+ * leave the system value in place.
+ */
+void
+ind_cxn_socket_options_apply(connection_t *cxn)
+{
+    indigo_cxn_socket_params_t *params = &cxn->config_params.socket;
+    int flag;
+
+    if (cxn->sd < 0) {
+        return;
+    }
+
+    /* Nagle's algorithm is disabled unless configured otherwise */
+    flag = params->nodelay >= 0;
+    if (setsockopt(cxn->sd, IPPROTO_TCP, TCP_NODELAY,
+                   &flag, sizeof(flag)) < 0) {
+        LOG_VERBOSE(cxn, "Failed to set TCP_NODELAY: %s", strerror(errno));
+    }
+
+    if (params->quickack > 0) {
+        ind_cxn_socket_quickack(cxn);
+    }
+
+    /* The FORCE variants exceed the sysctl limits given CAP_NET_ADMIN */
+    if (params->sndbuf > 0) {
+        if (setsockopt(cxn->sd, SOL_SOCKET, SO_SNDBUFFORCE, &params->sndbuf,
+                       sizeof(params->sndbuf)) < 0 &&
+            setsockopt(cxn->sd, SOL_SOCKET, SO_SNDBUF, &params->sndbuf,
+                       sizeof(params->sndbuf)) < 0) {
+            LOG_WARN(cxn, "Failed to set SO_SNDBUF to %d: %s",
+                     params->sndbuf, strerror(errno));
+        }
+    }
+
+    if (params->rcvbuf > 0) {
+        if (setsockopt(cxn->sd, SOL_SOCKET, SO_RCVBUFFORCE, &params->rcvbuf,
+                       sizeof(params->rcvbuf)) < 0 &&
+            setsockopt(cxn->sd, SOL_SOCKET, SO_RCVBUF, &params->rcvbuf,
+                       sizeof(params->rcvbuf)) < 0) {
+            LOG_WARN(cxn, "Failed to set SO_RCVBUF to %d: %s",
+                     params->rcvbuf, strerror(errno));
+        }
+    }
+
+#ifdef SO_BUSY_POLL
+    if (params->busy_poll_us > 0) {
+        if (setsockopt(cxn->sd, SOL_SOCKET, SO_BUSY_POLL,
+                       &params->busy_poll_us,
+                       sizeof(params->busy_poll_us)) < 0) {
+            LOG_WARN(cxn, "Failed to set SO_BUSY_POLL to %d us: %s",
+                     params->busy_poll_us, strerror(errno));
+        }
+    }
+#endif
+
+    if (params->priority > 0) {
+        if (setsockopt(cxn->sd, SOL_SOCKET, SO_PRIORITY, &params->priority,
+                       sizeof(params->priority)) < 0) {
+            LOG_WARN(cxn, "Failed to set SO_PRIORITY to %d: %s",
+                     params->priority, strerror(errno));
+        }
+    }
+}
+
+/**
+ * Ask for immediate ACKs on the connection socket
+ *
+ * TCP_QUICKACK is not sticky; the kernel drops back to delayed ACKs on
+ * its own, so this is repeated after every read.
+ */
+void
+ind_cxn_socket_quickack(connection_t *cxn)
+{
+    int flag = 1;
+
+    (void) setsockopt(cxn->sd, IPPROTO_TCP, TCP_QUICKACK,
+                      &flag, sizeof(flag));
+}
+
+
 /**
  * Attempt to connect to a controller instance.
  * @param cxn The instance control block
@@ -1487,12 +2114,7 @@ ind_cxn_try_to_connect(connection_t *cxn)
             return -1;
         }
 
-        /* Disable Nagle's algorithm */
-        {
-            int flag = 1;
-            (void) setsockopt(cxn->sd, IPPROTO_TCP, TCP_NODELAY,
-                              (char *) &flag, sizeof(int));
-        }
+        ind_cxn_socket_options_apply(cxn);
     }
 
     LOG_TRACE(cxn, "Attempting to connect");
@@ -1543,11 +2165,21 @@ ind_cxn_disconnected_init(connection_t *cxn)
     cxn->status.state = INDIGO_CXN_S_DISCONNECTED;
     cxn->status.role = INDIGO_CXN_R_EQUAL;
     cxn->status.negotiated_version = OF_VERSION_UNKNOWN;
-    cxn->bytes_needed = OF_MESSAGE_HEADER_LENGTH;
+    cxn->read_bytes = 0;
+    cxn->read_offset = 0;
     cxn->flags = 0;
     cxn->outstanding_op_cnt = 0;
     cxn->barrier.pendingf = 0;
+    cxn->barrier.backgroundf = 0;
+    cxn->barrier.epoch = 0;
+    cxn->barrier.epoch_op_cnt[0] = 0;
+    cxn->barrier.epoch_op_cnt[1] = 0;
+    cxn->barrier.write_op_cnt = 0;
     cxn->keepalive.outstanding_echo_cnt = 0;
+    cxn->keepalive.sent_time = 0;
+    cxn->keepalive.last_rx_time = 0;
+    cxn->keepalive.scan_offset = 0;
+    cxn->keepalive.answered = 0;
     cxn->status.bytes_in = 0;
     cxn->status.bytes_out = 0;
     cxn->status.messages_in = 0;
@@ -1556,20 +2188,43 @@ ind_cxn_disconnected_init(connection_t *cxn)
     cxn->hello_time = 0;
 }
 
+void
+ind_cxn_retry_max_set(uint32_t max_ms)
+{
+    cxn_retry_max_ms = max_ms > 0 ? max_ms : 1;
+}
+
+/* Random delay in [0, span] ms */
+static uint32_t
+connection_retry_jitter(uint32_t span)
+{
+    if (cxn_retry_seed == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        cxn_retry_seed = ts.tv_nsec ^ ((unsigned int)getpid() << 16) ^ 1;
+    }
+
+    return rand_r(&cxn_retry_seed) % (span + 1);
+}
+
 /**
  * @brief Calculate timeout between connection attempts.
  *
- * Exponential backoff up to a limit of 1 second.
+ * Exponential backoff up to a limit of cxn_retry_max_ms, each delay cut by
+ * a random amount of up to half. Switches that lost a controller cluster
+ * at the same moment drift apart instead of retrying in lockstep.
  */
 
 static int
 connection_retry_ms(const connection_t *cxn)
 {
-    if (cxn->fail_count < 10) {
-        return 1 << cxn->fail_count;
-    } else {
-        return 1000;
+    uint32_t delay_ms = cxn_retry_max_ms;
+
+    if (cxn->fail_count < 31 && (1U << cxn->fail_count) < cxn_retry_max_ms) {
+        delay_ms = 1U << cxn->fail_count;
     }
+
+    return delay_ms - connection_retry_jitter(delay_ms / 2);
 }
 
 /**
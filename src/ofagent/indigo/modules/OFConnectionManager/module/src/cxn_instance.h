@@ -31,6 +31,7 @@
 #include <loci/loci.h>
 #include <OFConnectionManager/ofconnectionmanager.h>
 #include <BigList/biglist.h>
+#include <sys/uio.h>
 
 #define READ_BUFFER_SIZE (64 * 1024)
 
@@ -49,11 +50,59 @@
  */
 #define WRITE_BUFFER_SIZE (16 * 1024 * 1024)
 
+/**
+ * Messages up to this size are copied into a shared output buffer
+ * (an arena) at the tail of the write queue instead of being queued in
+ * their own buffer. Each arena is COALESCE_BUFFER_SIZE bytes.
+ */
+#define COALESCE_MSG_MAX 512
+#define COALESCE_BUFFER_SIZE (16 * 1024)
+
 /**
  * Connection flag, connection is to be removed pending op completion
  */
 #define CXN_TO_BE_REMOVED 0x1
 
+/**
+ * Most auxiliary connections opened for one main connection
+ */
+#define CXN_AUXILIARY_MAX 8
+
+/**
+ * A message wire buffer queued on several connections at once
+ *
+ * Used to send one encoded async message to every interested controller.
+ * The data is freed when the last reference is released.
+ */
+typedef struct ind_cxn_shared_buf_s {
+    int refcount;
+    uint8_t *data;
+} ind_cxn_shared_buf_t;
+
+/**
+ * An entry in the write queue
+ *
+ * Holds either a single message or, if alloc_bytes is non-zero, an arena of
+ * small messages packed back to back. A single message may reference a
+ * shared buffer instead of owning its data.
+ */
+typedef struct cxn_output_buf_s {
+    uint8_t *data;
+    int bytes;          /* Bytes of message data in the buffer */
+    int alloc_bytes;    /* Size of an arena; 0 for a single message */
+    int msgs;           /* Number of messages in the buffer */
+    ind_cxn_shared_buf_t *shared; /* Owner of data if shared, else NULL */
+} cxn_output_buf_t;
+
+/* Log2 histogram of latencies in microseconds */
+#define CXN_LATENCY_BUCKETS 20
+
+typedef struct cxn_latency_hist_s {
+    uint64_t count;
+    uint64_t max_us;
+    uint64_t buckets[CXN_LATENCY_BUCKETS]; /* < 1 us, then [2^(n-1), 2^n) */
+} cxn_latency_hist_t;
+
 /* Connection control block */
 typedef struct connection_s {
     indigo_cxn_protocol_params_t protocol_params;
@@ -65,25 +114,47 @@ typedef struct connection_s {
     int active; /* Has this connection instance been configured? */
     int fail_count; /* How may failed connection tries */
     indigo_cxn_id_t cxn_id; /* For back tracking */
+    indigo_cxn_id_t main_cxn_id; /* Main connection of an auxiliary one */
 
     int sd; /* The socket descriptor */
 
+    /* TLS state; see cxn_tls.c */
+    void *tls;              /* SSL, while connected */
+    void *tls_session;      /* SSL_SESSION to resume on reconnect */
+    int tls_ready;          /* Handshake complete */
+    int tls_ktls;           /* Kernel encrypts output; write with writev */
+    int tls_write_pending;  /* Length of an SSL_write to be retried */
+    uint64_t tls_handshakes;
+    uint64_t tls_resumed;   /* Handshakes that resumed a session */
+    uint64_t tls_records;   /* Records written by SSL_write */
+
     /*
-     * The read buffer is used to buffer a single message.  There
-     * are two steps to the operation: Read the header, then use that
-     * to determine the number of bytes remaining in the message.
-     * Once a message is read in, it is processed and the read buffer
-     * is cleared.
+     * The read buffer is filled with as many bytes as the socket has
+     * available. Every complete message in it is then processed in
+     * place, and a trailing partial message is moved to the start of
+     * the buffer to be completed by the next read.
      */
     uint8_t read_buffer[READ_BUFFER_SIZE];
     int read_bytes; /* Number of bytes currently in read buffer */
-    int bytes_needed; /* Num bytes needed for next process step */
-
-    /* Write queue */
-    biglist_t *output_list; /* List of outgoing messages */
-    int output_head_offset; /* Bytes already sent out from head of output_list */
+    int read_offset; /* Start of the next unprocessed message */
+
+    /* Write queue; circular array of outgoing message buffers */
+    cxn_output_buf_t *output_queue; /* Oldest buffer at output_head */
+    int output_queue_size;  /* Number of slots in output_queue */
+    int output_head;        /* Index of the oldest queued buffer */
+    int output_count;       /* Number of queued buffers */
+    int output_head_offset; /* Bytes already sent out from head of output_queue */
     int bytes_enqueued;     /* Total bytes queued */
     int pkts_enqueued;      /* Total pkts queued */
+    int congested;          /* Passed the high watermark, not yet drained */
+    uint8_t *spare_arena;   /* Drained arena kept for the next coalesce */
+
+    /* Output coalescing stats */
+    uint64_t output_flushes;        /* Number of writev calls */
+    uint64_t coalesced_msgs;        /* Messages copied into an arena */
+    uint64_t coalesced_bytes;       /* Bytes copied into an arena */
+    uint64_t shared_msgs;           /* Queued by reference to a shared buffer */
+    uint64_t shared_bytes;
 
     /* Additional debug info */
     uint64_t messages_in_by_type[OF_MESSAGE_OBJECT_COUNT];
@@ -92,11 +163,28 @@ typedef struct connection_s {
     uint64_t messages_out_unknown;
 
     uint64_t packet_ins;
+    uint32_t packet_in_pressure_seq; /* Packet-ins seen while congested */
+
+    /* Packet-ins waiting for a BSN packet-in batch message */
+    uint8_t *packet_in_batch;       /* Allocated while connected */
+    int packet_in_batch_len;
+    int packet_in_batch_count;
+    uint64_t packet_in_batches;     /* Batch messages sent */
 
     int outstanding_op_cnt; /* Number of outstanding operations */
     struct {
         unsigned char pendingf;           /* Barrier reply pending flag */
         uint32_t      xid;                /* XID of barrier request */
+
+        /* A barrier behind outstanding stats requests only does not
+         * pause input. Operations are tracked in one of two epochs, and
+         * the barrier is answered when the epoch before it drains. */
+        unsigned char backgroundf;        /* Background barrier pending */
+        uint32_t      background_xid;     /* XID of background barrier */
+        int           epoch;              /* Epoch of new operations, 0 or 1 */
+        int           epoch_op_cnt[2];    /* Outstanding operations by epoch */
+        int           write_op_cnt;       /* Outstanding non-stats operations */
+        uint64_t      background_cnt;     /* Barriers that did not pause */
     } barrier;
 
     /* @todo clean this up */
@@ -105,6 +193,17 @@ typedef struct connection_s {
         uint32_t threshold;  /* value above which connection is declared dead */
         uint32_t period_ms;     /* keepalive period in milliseconds */
         uint32_t xid;   /* xid of last outstanding echo reply */
+        uint64_t sent_time;     /* when that echo was sent, in ns */
+        indigo_time_t last_rx_time;     /* last message from the controller */
+
+        /* Echo requests are answered as soon as they are read, ahead of
+         * the messages before them; see echo_fast_path */
+        int scan_offset;        /* read buffer scanned up to here */
+        int answered;           /* answered but not yet processed */
+        uint64_t fast_replies;  /* total answered from the read path */
+
+        cxn_latency_hist_t rtt;         /* our echo requests */
+        cxn_latency_hist_t reply_lag;   /* read to reply, controller echoes */
     } keepalive;
 
 
@@ -136,6 +235,18 @@ typedef struct connection_s {
 #define CXN_DROP_FLOW_REMOVED(cxn, obj)                \
     ((cxn)->pkts_enqueued > FLOW_REMOVED_DROP_QUEUE_MAX)
 
+/**
+ * Output queue watermarks
+ *
+ * A connection is congested from the time bytes_enqueued reaches the high
+ * watermark until it drains to the low watermark. While congested, stats
+ * replies are paused and packet-ins are sampled, so the queue is kept well
+ * short of WRITE_BUFFER_SIZE and the disconnect that follows a full queue.
+ */
+#define CXN_OUTPUT_HIGH_WATERMARK OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK
+#define CXN_OUTPUT_LOW_WATERMARK OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK
+#define CXN_CONGESTED(cxn) ((cxn)->congested)
+
 /**
  * How many bytes in buffer are free
  * See notes above about WRITE_BUFFER_SIZE.
@@ -158,6 +269,17 @@ typedef struct connection_s {
  */
 #define CXN_LISTEN(cxn) ((cxn)->config_params.listen)
 
+/**
+ * Does connection use TLS
+ */
+#define CXN_TLS(cxn) \
+    ((cxn)->protocol_params.header.protocol == INDIGO_CXN_PROTO_TLS_OVER_IPV4)
+
+/**
+ * Is connection an auxiliary connection of another
+ */
+#define CXN_AUXILIARY(cxn) ((cxn)->status.auxiliary_id != 0)
+
 /**
  * The connection state of connection
  *
@@ -192,6 +314,13 @@ extern state_info_t state_info[INDIGO_CXN_S_COUNT];
      (CONNECTION_STATE(cxn) == INDIGO_CXN_S_HANDSHAKE_COMPLETE))
 
 extern int ind_cxn_instance_enqueue(connection_t *cxn, uint8_t *data, int len);
+extern int ind_cxn_instance_enqueue_copy(connection_t *cxn, uint8_t *data,
+                                         int len);
+extern int ind_cxn_instance_enqueue_shared(connection_t *cxn,
+                                           ind_cxn_shared_buf_t *sbuf, int len);
+
+extern ind_cxn_shared_buf_t *ind_cxn_shared_buf_create(uint8_t *data);
+extern void ind_cxn_shared_buf_release(ind_cxn_shared_buf_t *sbuf);
 
 extern int ind_cxn_send_hello(connection_t *cxn);
 
@@ -234,8 +363,25 @@ cxn_ip_string(connection_t *cxn)
     return proto_ip_string(&cxn->protocol_params);
 }
 
+/****************************************************************
+ * TLS; see cxn_tls.c
+ ****************************************************************/
+
+extern indigo_error_t ind_cxn_tls_start(connection_t *cxn);
+extern int ind_cxn_tls_handshake(connection_t *cxn);
+extern ssize_t ind_cxn_tls_read(connection_t *cxn, void *buf, size_t len);
+extern int ind_cxn_tls_pending(connection_t *cxn);
+extern int ind_cxn_tls_writev(connection_t *cxn, const struct iovec *iov,
+                              int iovcnt);
+extern void ind_cxn_tls_close(connection_t *cxn);
+extern void ind_cxn_tls_session_free(connection_t *cxn);
+
+extern void ind_cxn_socket_options_apply(connection_t *cxn);
+extern void ind_cxn_socket_quickack(connection_t *cxn);
+
 extern int ind_cxn_process_write_buffer(connection_t *cxn);
 extern int ind_cxn_process_read_buffer(connection_t *cxn);
+extern int ind_cxn_process_buffered_messages(connection_t *cxn);
 
 #if 0 /* TBD */
 /**
@@ -0,0 +1,487 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief TLS controller connections
+ *
+ * A TLS connection connects over TCP as usual. The TLS handshake then runs
+ * from the socket ready callback before any message is read or written;
+ * the HELLO queued on entering the connecting state waits in the write
+ * queue until it completes.
+ *
+ * Output is written in records as large as TLS allows: the iovecs that
+ * would have been passed to writev are copied into one buffer per
+ * record, so a burst of small messages costs one record rather than one
+ * each. With kernel TLS the kernel does the record layer after the
+ * handshake and the write queue goes to writev unchanged.
+ *
+ * The session of each connection is kept across disconnects and offered
+ * on the next connect, so a controller that restarts does not pay for a
+ * full handshake on every switch at once.
+ */
+
+#include "ofconnectionmanager_log.h"
+
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "cxn_instance.h"
+#include "ofconnectionmanager_int.h"
+
+#include <SocketManager/socketmanager.h>
+
+#if OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS == 1
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#define LOG_ERROR(cxn, fmt, ...)                                        \
+    AIM_LOG_ERROR("cxn %s: " fmt, cxn_ip_string(cxn), ##__VA_ARGS__)
+#define LOG_INFO(cxn, fmt, ...)                                         \
+    AIM_LOG_INFO("cxn %s: " fmt, cxn_ip_string(cxn), ##__VA_ARGS__)
+#define LOG_VERBOSE(cxn, fmt, ...)                                      \
+    AIM_LOG_VERBOSE("cxn %s: " fmt, cxn_ip_string(cxn), ##__VA_ARGS__)
+
+/* Largest TLS record payload */
+#define CXN_TLS_RECORD_MAX (16 * 1024)
+
+static SSL_CTX *cxn_tls_ctx;
+
+/* Record staging buffer; the connection manager is single threaded */
+static uint8_t cxn_tls_record[CXN_TLS_RECORD_MAX];
+
+static const char *
+cxn_tls_error_string(void)
+{
+    static char buf[128];
+    unsigned long err = ERR_get_error();
+
+    if (err == 0) {
+        return strerror(errno);
+    }
+    ERR_error_string_n(err, buf, sizeof(buf));
+    ERR_clear_error();
+    return buf;
+}
+
+/* Keep the newest session of a connection for the next connect */
+static int
+cxn_tls_new_session(SSL *ssl, SSL_SESSION *session)
+{
+    connection_t *cxn = SSL_get_app_data(ssl);
+
+    if (cxn == NULL) {
+        return 0;
+    }
+
+    if (cxn->tls_session != NULL) {
+        SSL_SESSION_free(cxn->tls_session);
+    }
+    cxn->tls_session = session;
+
+    return 1; /* The reference is kept */
+}
+
+indigo_error_t
+ind_cxn_tls_config_set(const ind_cxn_tls_config_t *config)
+{
+    SSL_CTX *ctx;
+
+    ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        AIM_LOG_ERROR("Could not create TLS context: %s",
+                      cxn_tls_error_string());
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                   SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, cxn_tls_new_session);
+
+    if (config->cert_file != NULL &&
+        SSL_CTX_use_certificate_chain_file(ctx, config->cert_file) != 1) {
+        AIM_LOG_ERROR("Could not load TLS certificate %s: %s",
+                      config->cert_file, cxn_tls_error_string());
+        goto error;
+    }
+
+    if (config->key_file != NULL &&
+        SSL_CTX_use_PrivateKey_file(ctx, config->key_file,
+                                    SSL_FILETYPE_PEM) != 1) {
+        AIM_LOG_ERROR("Could not load TLS key %s: %s",
+                      config->key_file, cxn_tls_error_string());
+        goto error;
+    }
+
+    if (config->ca_file != NULL) {
+        if (SSL_CTX_load_verify_locations(ctx, config->ca_file, NULL) != 1) {
+            AIM_LOG_ERROR("Could not load TLS CA certificates %s: %s",
+                          config->ca_file, cxn_tls_error_string());
+            goto error;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    } else {
+        AIM_LOG_WARN("No TLS CA certificates; controllers are not verified");
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    }
+
+    if (config->ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+        AIM_LOG_WARN("Kernel TLS is not supported by this OpenSSL");
+#endif
+    }
+
+    if (cxn_tls_ctx != NULL) {
+        /* Connections already up keep a reference to the old context */
+        SSL_CTX_free(cxn_tls_ctx);
+    }
+    cxn_tls_ctx = ctx;
+
+    return INDIGO_ERROR_NONE;
+
+ error:
+    SSL_CTX_free(ctx);
+    return INDIGO_ERROR_PARAM;
+}
+
+/**
+ * Set up TLS on a connection whose TCP connection has just completed
+ */
+indigo_error_t
+ind_cxn_tls_start(connection_t *cxn)
+{
+    SSL *ssl;
+
+    if (cxn_tls_ctx == NULL) {
+        LOG_ERROR(cxn, "TLS connection without TLS configuration");
+        return INDIGO_ERROR_INIT;
+    }
+
+    if ((ssl = SSL_new(cxn_tls_ctx)) == NULL) {
+        LOG_ERROR(cxn, "Could not create TLS state: %s",
+                  cxn_tls_error_string());
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    if (SSL_set_fd(ssl, cxn->sd) != 1) {
+        LOG_ERROR(cxn, "Could not attach TLS to socket: %s",
+                  cxn_tls_error_string());
+        SSL_free(ssl);
+        return INDIGO_ERROR_UNKNOWN;
+    }
+
+    SSL_set_app_data(ssl, cxn);
+    SSL_set_connect_state(ssl);
+    if (cxn->tls_session != NULL) {
+        SSL_set_session(ssl, cxn->tls_session);
+    }
+
+    cxn->tls = ssl;
+    cxn->tls_ready = 0;
+    cxn->tls_ktls = 0;
+    cxn->tls_write_pending = 0;
+
+    /* The first flight is written from the write ready callback */
+    CXN_WRITE_READY(cxn->sd);
+
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Continue the TLS handshake
+ *
+ * @returns 1 when complete, 0 while in progress, or an error code
+ */
+int
+ind_cxn_tls_handshake(connection_t *cxn)
+{
+    SSL *ssl = cxn->tls;
+    int rv;
+
+    if (ssl == NULL) {
+        return INDIGO_ERROR_INIT;
+    }
+
+    rv = SSL_do_handshake(ssl);
+    if (rv != 1) {
+        switch (SSL_get_error(ssl, rv)) {
+        case SSL_ERROR_WANT_READ:
+            /* Nothing to write until the controller answers */
+            CXN_WRITE_CLEAR(cxn->sd);
+            return 0;
+        case SSL_ERROR_WANT_WRITE:
+            CXN_WRITE_READY(cxn->sd);
+            return 0;
+        default:
+            LOG_ERROR(cxn, "TLS handshake failed: %s",
+                      cxn_tls_error_string());
+            return INDIGO_ERROR_CONNECTION;
+        }
+    }
+
+    cxn->tls_ready = 1;
+    cxn->tls_handshakes++;
+    if (SSL_session_reused(ssl)) {
+        cxn->tls_resumed++;
+    }
+
+#ifndef OPENSSL_NO_KTLS
+    cxn->tls_ktls = BIO_get_ktls_send(SSL_get_wbio(ssl)) ? 1 : 0;
+#endif
+
+    LOG_INFO(cxn, "TLS %s %s%s%s", SSL_get_version(ssl),
+             SSL_get_cipher_name(ssl),
+             SSL_session_reused(ssl) ? ", resumed" : "",
+             cxn->tls_ktls ? ", kernel TLS" : "");
+
+    /* Send whatever was queued during the handshake */
+    if (cxn->output_count > 0) {
+        CXN_WRITE_READY(cxn->sd);
+    } else {
+        CXN_WRITE_CLEAR(cxn->sd);
+    }
+
+    return 1;
+}
+
+/**
+ * Read decrypted data
+ *
+ * Same return convention as read(2): EAGAIN if no data is ready and 0
+ * if the controller closed the connection.
+ */
+ssize_t
+ind_cxn_tls_read(connection_t *cxn, void *buf, size_t len)
+{
+    SSL *ssl = cxn->tls;
+    int rv;
+
+    if (len == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    rv = SSL_read(ssl, buf, len);
+    if (rv > 0) {
+        return rv;
+    }
+
+    switch (SSL_get_error(ssl, rv)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0) {
+            /* EOF without close_notify */
+            return 0;
+        }
+        return -1;
+    default:
+        LOG_ERROR(cxn, "TLS read failed: %s", cxn_tls_error_string());
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+/**
+ * Is decrypted data buffered in the TLS layer?
+ *
+ * Such data does not make the socket readable again.
+ */
+int
+ind_cxn_tls_pending(connection_t *cxn)
+{
+    return cxn->tls != NULL && SSL_pending(cxn->tls) > 0;
+}
+
+/* Copy up to len bytes from iov, starting skip bytes in, to buf */
+static int
+cxn_tls_gather(const struct iovec *iov, int iovcnt, int skip,
+               uint8_t *buf, int len)
+{
+    int copied = 0;
+    int i, n;
+
+    for (i = 0; i < iovcnt && copied < len; i++) {
+        if (skip >= (int)iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        n = aim_imin(iov[i].iov_len - skip, len - copied);
+        memcpy(buf + copied, (uint8_t *)iov[i].iov_base + skip, n);
+        copied += n;
+        skip = 0;
+    }
+
+    return copied;
+}
+
+/**
+ * Write the iovecs as full size TLS records
+ *
+ * @returns Bytes written, which may be 0, or an error code
+ *
+ * A record SSL_write could not send must be retried with the same bytes.
+ * Nothing is removed from the write queue until it is sent, so the retry
+ * gathers the same length again from the head of the queue.
+ */
+int
+ind_cxn_tls_writev(connection_t *cxn, const struct iovec *iov, int iovcnt)
+{
+    SSL *ssl = cxn->tls;
+    int written = 0;
+    int len, rv;
+
+    if (!cxn->tls_ready) {
+        return 0;
+    }
+
+    for (;;) {
+        len = cxn->tls_write_pending ? cxn->tls_write_pending :
+            CXN_TLS_RECORD_MAX;
+        len = cxn_tls_gather(iov, iovcnt, written, cxn_tls_record, len);
+        if (len == 0) {
+            break;
+        }
+
+        rv = SSL_write(ssl, cxn_tls_record, len);
+        if (rv <= 0) {
+            switch (SSL_get_error(ssl, rv)) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                cxn->tls_write_pending = len;
+                return written;
+            default:
+                LOG_ERROR(cxn, "TLS write failed: %s",
+                          cxn_tls_error_string());
+                return INDIGO_ERROR_UNKNOWN;
+            }
+        }
+
+        cxn->tls_write_pending = 0;
+        cxn->tls_records++;
+        written += rv;
+    }
+
+    return written;
+}
+
+/**
+ * Shut down TLS before the socket is closed
+ *
+ * The session stays with the connection for the next connect.
+ */
+void
+ind_cxn_tls_close(connection_t *cxn)
+{
+    SSL *ssl = cxn->tls;
+
+    if (ssl == NULL) {
+        return;
+    }
+
+    /* Best effort close_notify; the socket is non-blocking */
+    if (cxn->tls_ready) {
+        (void) SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+
+    SSL_set_app_data(ssl, NULL);
+    SSL_free(ssl);
+    cxn->tls = NULL;
+    cxn->tls_ready = 0;
+    cxn->tls_ktls = 0;
+    cxn->tls_write_pending = 0;
+}
+
+/**
+ * Forget the session of a connection instance being set up afresh
+ */
+void
+ind_cxn_tls_session_free(connection_t *cxn)
+{
+    if (cxn->tls_session != NULL) {
+        SSL_SESSION_free(cxn->tls_session);
+        cxn->tls_session = NULL;
+    }
+    cxn->tls_handshakes = 0;
+    cxn->tls_resumed = 0;
+    cxn->tls_records = 0;
+}
+
+#else /* OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS */
+
+indigo_error_t
+ind_cxn_tls_config_set(const ind_cxn_tls_config_t *config)
+{
+    AIM_LOG_ERROR("TLS support is not included");
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+indigo_error_t
+ind_cxn_tls_start(connection_t *cxn)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+int
+ind_cxn_tls_handshake(connection_t *cxn)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+ssize_t
+ind_cxn_tls_read(connection_t *cxn, void *buf, size_t len)
+{
+    errno = ENOTSUP;
+    return -1;
+}
+
+int
+ind_cxn_tls_pending(connection_t *cxn)
+{
+    return 0;
+}
+
+int
+ind_cxn_tls_writev(connection_t *cxn, const struct iovec *iov, int iovcnt)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+void
+ind_cxn_tls_close(connection_t *cxn)
+{
+}
+
+void
+ind_cxn_tls_session_free(connection_t *cxn)
+{
+}
+
+#endif /* OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS */
@@ -0,0 +1,220 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Binary OpenFlow message trace
+ *
+ * Every message received from or queued to a controller is recorded in
+ * an AIM trace ring. Each record packs:
+ *
+ *   id         IND_CXN_TRACE_RX or IND_CXN_TRACE_TX
+ *   arg0       xid
+ *   arg1       cxn_id << 32 | version << 24 | type << 16 | length
+ *   arg2       RX: time processing started; TX: 0
+ *   timestamp  RX: time processing finished; TX: time queued
+ *
+ * The handler duration of a received message is timestamp - arg2. The
+ * agent latency of a request is the timestamp of the reply with the same
+ * cxn_id and xid minus arg2 of the request.
+ *
+ * ind_cxn_trace_save() writes the records after a short header, in host
+ * byte order; tools/cxn_trace_decode.py decodes the file offline.
+ */
+
+#include "ofconnectionmanager_log.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "ofconnectionmanager_int.h"
+
+#include <indigo/memory.h>
+#include <loci/loci.h>
+
+aim_trace_ring_t *ind_cxn_trace_ring;
+
+static aim_map_si_t cxn_trace_event_map[] = {
+    { "rx", IND_CXN_TRACE_RX },
+    { "tx", IND_CXN_TRACE_TX },
+    { NULL, 0 }
+};
+
+/* File header for ind_cxn_trace_save */
+#define CXN_TRACE_FILE_MAGIC "OFCXNTRC"
+#define CXN_TRACE_FILE_BYTE_ORDER 0x01020304
+
+typedef struct cxn_trace_file_header_s {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t record_size;
+} cxn_trace_file_header_t;
+
+/* Message type names, OpenFlow 1.0 and 1.1 onwards */
+static const char *cxn_trace_type_names_of10[] = {
+    "hello", "error", "echo_request", "echo_reply", "vendor",
+    "features_request", "features_reply", "get_config_request",
+    "get_config_reply", "set_config", "packet_in", "flow_removed",
+    "port_status", "packet_out", "flow_mod", "port_mod",
+    "stats_request", "stats_reply", "barrier_request", "barrier_reply",
+    "queue_get_config_request", "queue_get_config_reply",
+};
+
+static const char *cxn_trace_type_names_of11[] = {
+    "hello", "error", "echo_request", "echo_reply", "experimenter",
+    "features_request", "features_reply", "get_config_request",
+    "get_config_reply", "set_config", "packet_in", "flow_removed",
+    "port_status", "packet_out", "flow_mod", "group_mod", "port_mod",
+    "table_mod", "stats_request", "stats_reply", "barrier_request",
+    "barrier_reply", "queue_get_config_request", "queue_get_config_reply",
+    "role_request", "role_reply", "get_async_request", "get_async_reply",
+    "set_async", "meter_mod",
+};
+
+static const char *
+cxn_trace_type_name(int version, int type)
+{
+    if (version == OF_VERSION_1_0) {
+        if (type < AIM_ARRAYSIZE(cxn_trace_type_names_of10)) {
+            return cxn_trace_type_names_of10[type];
+        }
+    } else if (type < AIM_ARRAYSIZE(cxn_trace_type_names_of11)) {
+        return cxn_trace_type_names_of11[type];
+    }
+    return "unknown";
+}
+
+void
+ind_cxn_trace_init(void)
+{
+    if (ind_cxn_trace_ring == NULL &&
+        OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE > 0) {
+        ind_cxn_trace_ring = aim_trace_ring_create(
+            "ofconnectionmanager", OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE,
+            cxn_trace_event_map);
+    }
+}
+
+void
+ind_cxn_trace_message(uint32_t event, connection_t *cxn, uint8_t *buf,
+                      int len, uint64_t start)
+{
+    of_message_t msg = OF_BUFFER_TO_MESSAGE(buf);
+    uint64_t info;
+
+    info = (uint64_t)(uint32_t)cxn->cxn_id << 32 |
+        (uint64_t)of_message_version_get(msg) << 24 |
+        (uint64_t)of_message_type_get(msg) << 16 |
+        (uint16_t)len;
+
+    aim_trace_event(ind_cxn_trace_ring, event, of_message_xid_get(msg),
+                    info, start);
+}
+
+/**
+ * Show the most recent messages in the trace
+ */
+
+void
+ind_cxn_trace_show(aim_pvs_t *pvs, int count)
+{
+    aim_trace_record_t record;
+    uint64_t cursor = 0;
+    uint64_t head;
+
+    if (ind_cxn_trace_ring == NULL) {
+        aim_printf(pvs, "Message trace is disabled\n");
+        return;
+    }
+
+    head = __atomic_load_n(&ind_cxn_trace_ring->head, __ATOMIC_RELAXED);
+    if (count > 0 && head > (uint64_t)count) {
+        cursor = head - count;
+    }
+
+    aim_printf(pvs, "%-10s %-20s %-4s %-3s %-3s %-24s %-10s %-6s %s\n",
+               "seq", "time", "cxn", "dir", "ver", "type", "xid", "len",
+               "handler(us)");
+
+    while (aim_trace_ring_read(ind_cxn_trace_ring, &cursor, &record)) {
+        int version = (record.arg1 >> 24) & 0xff;
+        int type = (record.arg1 >> 16) & 0xff;
+
+        aim_printf(pvs, "%-10" PRIu64 " %10" PRIu64 ".%09" PRIu64
+                   " %-4u %-3s %-3d %-24s %-10u %-6u",
+                   record.seq - 1,
+                   record.timestamp / 1000000000ULL,
+                   record.timestamp % 1000000000ULL,
+                   (uint32_t)(record.arg1 >> 32),
+                   record.id == IND_CXN_TRACE_RX ? "rx" : "tx",
+                   version, cxn_trace_type_name(version, type),
+                   record.arg0, (uint32_t)(record.arg1 & 0xffff));
+        if (record.id == IND_CXN_TRACE_RX && record.arg2 != 0) {
+            aim_printf(pvs, " %.3f",
+                       (record.timestamp - record.arg2) / 1000.0);
+        }
+        aim_printf(pvs, "\n");
+    }
+}
+
+/**
+ * Save the trace for offline decoding
+ */
+
+indigo_error_t
+ind_cxn_trace_save(const char *filename)
+{
+    cxn_trace_file_header_t hdr;
+    aim_trace_record_t record;
+    uint64_t cursor = 0;
+    indigo_error_t rv = INDIGO_ERROR_NONE;
+    FILE *fp;
+
+    if (ind_cxn_trace_ring == NULL) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    if ((fp = fopen(filename, "wb")) == NULL) {
+        AIM_LOG_ERROR("Could not open %s for the message trace", filename);
+        return INDIGO_ERROR_PARAM;
+    }
+
+    INDIGO_MEM_CLEAR(&hdr, sizeof(hdr));
+    INDIGO_MEM_COPY(hdr.magic, CXN_TRACE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = CXN_TRACE_FILE_BYTE_ORDER;
+    hdr.record_size = sizeof(record);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        rv = INDIGO_ERROR_UNKNOWN;
+    }
+
+    while (rv == INDIGO_ERROR_NONE &&
+           aim_trace_ring_read(ind_cxn_trace_ring, &cursor, &record)) {
+        if (fwrite(&record, sizeof(record), 1, fp) != 1) {
+            rv = INDIGO_ERROR_UNKNOWN;
+        }
+    }
+
+    if (fclose(fp) != 0 || rv != INDIGO_ERROR_NONE) {
+        AIM_LOG_ERROR("Error writing the message trace to %s", filename);
+        return INDIGO_ERROR_UNKNOWN;
+    }
+
+    return INDIGO_ERROR_NONE;
+}
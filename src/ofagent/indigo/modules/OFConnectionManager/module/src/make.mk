@@ -30,3 +30,8 @@ LIBRARY := OFConnectionManager
 $(LIBRARY)_SUBDIR := $(dir $(lastword $(MAKEFILE_LIST)))
 include $(BUILDER)/lib.mk
 
+ifeq ($(OFConnectionManager_TLS),1)
+OFConnectionManager_CFLAGS += -DOFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS=1
+GLOBAL_LINK_LIBS += -lssl -lcrypto
+endif
+
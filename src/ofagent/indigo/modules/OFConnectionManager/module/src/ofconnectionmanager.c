@@ -31,6 +31,7 @@
 #include <Configuration/configuration.h>
 
 #include <indigo/of_state_manager.h>
+#include <indigo/of_message.h>
 #include <indigo/memory.h>
 #include <indigo/assert.h>
 
@@ -69,6 +70,10 @@ ind_cxn_listen_socket_ready(int socket_id, void *cookie, int read_ready,
 
 static void ind_cxn_status_notify(void);
 
+static void cxn_auxiliary_add(connection_t *main_cxn);
+
+static void cxn_auxiliary_remove(connection_t *main_cxn);
+
 /****************************************************************
  * Connection Manager Data shared within module
  ****************************************************************/
@@ -137,28 +142,57 @@ static int preferred_cxn_id = -1;
          ++cxn_id, cxn = &connection[cxn_id])                           \
         if (CXN_ACTIVE(cxn))
 
-/* Only remote connections */
+/* Only remote main connections */
 #define FOREACH_REMOTE_ACTIVE_CXN(cxn_id, cxn)                          \
     for (cxn_id = 0, cxn = &connection[0];                              \
          cxn_id < MAX_CONTROLLER_CONNECTIONS;                           \
          ++cxn_id, cxn = &connection[cxn_id])                           \
-        if (CXN_ACTIVE(cxn) && !((cxn)->config_params.local))
+        if (CXN_ACTIVE(cxn) && !((cxn)->config_params.local) &&         \
+            !CXN_AUXILIARY(cxn))
 
-/* All remote connections which completed hand-shake and with requested role */
+/* All remote main connections which completed hand-shake and with requested role */
 #define FOREACH_HS_COMPLETE_CXN_WITH_ROLE(cxn_id, cxn, cxn_role)        \
     for (cxn_id = 0, cxn = &connection[0];                              \
          cxn_id < MAX_CONTROLLER_CONNECTIONS;                           \
          ++cxn_id, cxn = &connection[cxn_id])                           \
         if (CXN_ACTIVE(cxn) && !(cxn->config_params.local) &&           \
+            !CXN_AUXILIARY(cxn) &&                                      \
             (cxn->status.role == cxn_role) &&                           \
             (cxn->status.state == INDIGO_CXN_S_HANDSHAKE_COMPLETE))
 
+/* Active auxiliary connections of a main connection */
+#define FOREACH_AUXILIARY_CXN(aux_id, cxn, main_cxn)                    \
+    for (aux_id = 0, cxn = &connection[0];                              \
+         aux_id < MAX_CONTROLLER_CONNECTIONS;                           \
+         ++aux_id, cxn = &connection[aux_id])                           \
+        if (CXN_ACTIVE(cxn) && CXN_AUXILIARY(cxn) &&                    \
+            (cxn->main_cxn_id == (main_cxn)->cxn_id))
+
 /**
  * Convert connection ID to pointer to cxn block
  */
 
 #define CXN_ID_TO_CONNECTION(cxn_id) (&connection[cxn_id])
 
+/*
+ * Connections accepting each class of async message, one bit per
+ * connection ID. A connection's bits are updated when its state or role
+ * changes, so async dispatch only walks the set bits.
+ */
+typedef enum cxn_async_class_e {
+    CXN_ASYNC_PACKET_IN,
+    CXN_ASYNC_FLOW_REMOVED,
+    CXN_ASYNC_OTHER,
+    CXN_ASYNC_CLASS_COUNT
+} cxn_async_class_t;
+
+AIM_STATIC_ASSERT(CXN_ASYNC_MASK_BITS, MAX_CONTROLLER_CONNECTIONS <= 32);
+
+static uint32_t cxn_async_mask[CXN_ASYNC_CLASS_COUNT];
+
+/* Connections owed a role status message, sent once per loop iteration */
+static uint32_t cxn_role_status_pending;
+
 
 #define GEN_ID_SHIFT 16
 #define GEN_ID_MASK 0xffff
@@ -260,12 +294,28 @@ indigo_cxn_socket_ready_callback(
         return;
     }
 
-    if (read_ready) {
-        if ((rv = ind_cxn_process_read_buffer(cxn)) < 0) {
-            LOG_VERBOSE("Error processing read buffer, resetting");
+    if (CXN_TLS(cxn) && !cxn->tls_ready) {
+        if ((rv = ind_cxn_tls_handshake(cxn)) < 0) {
             ind_cxn_disconnect(cxn);
             return;
         }
+        if (rv == 0) {
+            return; /* Handshake in progress */
+        }
+        read_ready = 1; /* The handshake may have read the first records */
+    }
+
+    if (read_ready) {
+        do {
+            if ((rv = ind_cxn_process_read_buffer(cxn)) < 0 &&
+                rv != INDIGO_ERROR_PENDING) {
+                LOG_VERBOSE("Error processing read buffer, resetting");
+                ind_cxn_disconnect(cxn);
+                return;
+            }
+            /* Decrypted records left in TLS do not wake up the socket */
+        } while (rv == INDIGO_ERROR_NONE && CXN_TLS(cxn) &&
+                 ind_cxn_tls_pending(cxn));
     }
 
     if (write_ready) {
@@ -345,6 +395,8 @@ ind_cxn_status_change(connection_t *cxn)
     int idx;
     indigo_cxn_status_change_f callback;
 
+    ind_cxn_async_mask_update(cxn);
+
     /* Notify registered callbacks */
     FOREACH_STATUS_CALLBACK(idx, callback, cookie) {
         callback(cxn->cxn_id,
@@ -354,6 +406,12 @@ ind_cxn_status_change(connection_t *cxn)
 		 );
     }
 
+    /* Auxiliary connections come and go with their main connection */
+    if (CXN_AUXILIARY(cxn)) {
+        LOG_TRACE("Auxiliary cxn %d status change", cxn->cxn_id);
+        return;
+    }
+
     /* Select this as preferred if no other connection known */
     if (!cxn->config_params.local) {
         if (CONNECTION_STATE(cxn) == INDIGO_CXN_S_CONNECTING) {
@@ -368,7 +426,9 @@ ind_cxn_status_change(connection_t *cxn)
             }
         } if (CONNECTION_STATE(cxn) == INDIGO_CXN_S_HANDSHAKE_COMPLETE) {
             ind_cxn_status_notify();
+            cxn_auxiliary_add(cxn);
         } else if (CONNECTION_STATE(cxn) == INDIGO_CXN_S_CLOSING) {
+            cxn_auxiliary_remove(cxn);
             --remote_connection_count;
             indigo_core_connection_count_notify(remote_connection_count);
             ind_cxn_status_notify();
@@ -538,6 +598,8 @@ connection_socket_setup(indigo_cxn_protocol_params_t *protocol_params,
     INDIGO_MEM_COPY(&cxn->config_params, config_params,
                     sizeof(*config_params));
     INDIGO_MEM_CLEAR(&cxn->status, sizeof(cxn->status));
+    cxn->main_cxn_id = INDIGO_CXN_ID_UNSPECIFIED;
+    ind_cxn_tls_session_free(cxn);
 
     if (!CXN_LOCAL(cxn)) {
         cxn->keepalive.period_ms = config_params->periodic_echo_ms;
@@ -568,12 +630,7 @@ connection_socket_setup(indigo_cxn_protocol_params_t *protocol_params,
         return NULL;
     }
 
-    /* Disable Nagle's algorithm */
-    {
-        int flag = 1;
-        (void) setsockopt(cxn->sd, IPPROTO_TCP, TCP_NODELAY,
-                          (char *) &flag, sizeof(int));
-    }
+    ind_cxn_socket_options_apply(cxn);
 
     LOG_VERBOSE("Created non-blocking socket %d for %s",
                 cxn->sd, cxn_id_ip_string(*cxn_id));
@@ -593,6 +650,20 @@ connection_socket_setup(indigo_cxn_protocol_params_t *protocol_params,
 }
 
 
+/* Read back an integer socket option; -1 if it is not available */
+static int
+cxn_sockopt_get(int sd, int level, int name)
+{
+    int value;
+    socklen_t len = sizeof(value);
+
+    if (getsockopt(sd, level, name, &value, &len) < 0) {
+        return -1;
+    }
+
+    return value;
+}
+
 /* Add a controller connection instance */
 
 indigo_error_t
@@ -620,6 +691,14 @@ indigo_cxn_connection_add(indigo_cxn_protocol_params_t *protocol_params,
         return INDIGO_ERROR_PARAM;
     }
 
+    if (config_params->auxiliary_count > CXN_AUXILIARY_MAX ||
+        (config_params->auxiliary_count &&
+         (config_params->local || config_params->listen))) {
+        LOG_ERROR("Unsupported auxiliary connection count %d on cxn add",
+                  config_params->auxiliary_count);
+        return INDIGO_ERROR_PARAM;
+    }
+
     LOG_TRACE("Connection add: %s", proto_ip_string(protocol_params));
 
     if (cxn_id == NULL) {
@@ -627,7 +706,15 @@ indigo_cxn_connection_add(indigo_cxn_protocol_params_t *protocol_params,
         return INDIGO_ERROR_PARAM;
     }
 
-    if (protocol_params->header.protocol != INDIGO_CXN_PROTO_TCP_OVER_IPV4) {
+    if (protocol_params->header.protocol == INDIGO_CXN_PROTO_TLS_OVER_IPV4 &&
+        (!OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS || config_params->local ||
+         config_params->listen)) {
+        LOG_ERROR("TLS is only supported for remote active connections");
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    if (protocol_params->header.protocol != INDIGO_CXN_PROTO_TCP_OVER_IPV4 &&
+        protocol_params->header.protocol != INDIGO_CXN_PROTO_TLS_OVER_IPV4) {
         LOG_ERROR("Unsupported protocol for connection add: %d",
                      protocol_params->header.protocol);
         return INDIGO_ERROR_NOT_SUPPORTED;
@@ -696,6 +783,41 @@ indigo_cxn_connection_config_get(
     return INDIGO_ERROR_NONE;
 }
 
+/**
+ * Change the socket options of a connection
+ *
+ * The options are applied to the current socket, to the auxiliary
+ * connections and to every socket created or accepted later.
+ */
+indigo_error_t
+ind_cxn_socket_params_set(indigo_cxn_id_t cxn_id,
+                          const indigo_cxn_socket_params_t *params)
+{
+    connection_t *cxn, *aux_cxn;
+    indigo_cxn_id_t aux_id;
+
+    if (!CXN_ID_VALID(cxn_id) || !CXN_ID_ACTIVE(cxn_id)) {
+        LOG_ERROR("Socket params id %d invalid or not active", cxn_id);
+        return INDIGO_ERROR_PARAM;
+    }
+
+    cxn = CXN_ID_TO_CONNECTION(cxn_id);
+    if (!memcmp(&cxn->config_params.socket, params, sizeof(*params))) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    LOG_INFO("Socket options change: %s", cxn_id_ip_string(cxn_id));
+    cxn->config_params.socket = *params;
+    ind_cxn_socket_options_apply(cxn);
+
+    FOREACH_AUXILIARY_CXN(aux_id, aux_cxn, cxn) {
+        aux_cxn->config_params.socket = *params;
+        ind_cxn_socket_options_apply(aux_cxn);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
 /* Return the status of a specific connection */
 indigo_error_t
 indigo_cxn_connection_status_get(
@@ -718,7 +840,7 @@ indigo_cxn_connection_status_get(
  * These are sent when a controller's role changes for any reason
  * other than it directly sending a role request message.
  */
-void
+static void
 ind_cxn_send_role_status(connection_t *cxn, int reason)
 {
     /* Need to make translate_to_openflow_role public */
@@ -738,12 +860,50 @@ ind_cxn_send_role_status(connection_t *cxn, int reason)
     }
 }
 
+/*
+ * Send the role status messages owed since the last loop iteration.
+ * A connection downgraded and upgraded again in between is not told.
+ */
+static void
+ind_cxn_role_status_flush(void *cookie)
+{
+    uint32_t pending = cxn_role_status_pending;
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+
+    cxn_role_status_pending = 0;
+
+    while (pending != 0) {
+        cxn_id = __builtin_ctz(pending);
+        pending &= pending - 1;
+        cxn = &connection[cxn_id];
+        if (CXN_ACTIVE(cxn) &&
+            CONNECTION_STATE(cxn) == INDIGO_CXN_S_HANDSHAKE_COMPLETE &&
+            cxn->status.role == INDIGO_CXN_R_SLAVE) {
+            ind_cxn_send_role_status(
+                cxn, OFP_BSN_CONTROLLER_ROLE_REASON_MASTER_REQUEST);
+        }
+    }
+}
+
+/**
+ * Set the role of a main connection
+ */
+void
+ind_cxn_role_set(connection_t *cxn, indigo_cxn_role_t role)
+{
+    cxn->status.role = role;
+    ind_cxn_async_mask_update(cxn);
+}
+
 /**
  * Change the master connection
  *
  * @param master_id The connection id of the new master
  *
- * Downgrades the current master, if any, to a slave.
+ * Downgrades the current master, if any, to a slave. The role status
+ * messages to downgraded connections go out together at the next loop
+ * iteration.
  */
 void
 ind_cxn_change_master(indigo_cxn_id_t master_id)
@@ -753,16 +913,139 @@ ind_cxn_change_master(indigo_cxn_id_t master_id)
     FOREACH_REMOTE_ACTIVE_CXN(cxn_id, cxn) {
         if (cxn->cxn_id == master_id) {
             LOG_INFO("Upgrading cxn %s to master", cxn_id_ip_string(cxn_id));
-            cxn->status.role = INDIGO_CXN_R_MASTER;
+            ind_cxn_role_set(cxn, INDIGO_CXN_R_MASTER);
         } else if (cxn->status.role == INDIGO_CXN_R_MASTER) {
             LOG_INFO("Downgrading cxn %s to slave", cxn_id_ip_string(cxn_id));
-            cxn->status.role = INDIGO_CXN_R_SLAVE;
-            ind_cxn_send_role_status(
-                cxn, OFP_BSN_CONTROLLER_ROLE_REASON_MASTER_REQUEST);
+            ind_cxn_role_set(cxn, INDIGO_CXN_R_SLAVE);
+            if (cxn_role_status_pending == 0) {
+                ind_soc_timer_event_register_with_priority(
+                    ind_cxn_role_status_flush, NULL,
+                    IND_SOC_TIMER_IMMEDIATE, IND_CXN_EVENT_PRIORITY);
+            }
+            cxn_role_status_pending |= 1U << cxn_id;
         }
     }
 }
 
+/**
+ * Role of a connection
+ *
+ * An auxiliary connection has the role of its main connection.
+ */
+indigo_cxn_role_t
+ind_cxn_role_get(connection_t *cxn)
+{
+    if (CXN_AUXILIARY(cxn) && ACTIVE_ENTRY(cxn->main_cxn_id)) {
+        return connection[cxn->main_cxn_id].status.role;
+    }
+
+    return cxn->status.role;
+}
+
+/**
+ * Open the auxiliary connections of a main connection
+ *
+ * Called when the main connection completes its handshake. Auxiliary
+ * connections are an OpenFlow 1.3 feature and use the address of the
+ * main connection.
+ */
+static void
+cxn_auxiliary_add(connection_t *main_cxn)
+{
+    indigo_cxn_config_params_t config_params;
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+    int idx;
+
+    if (main_cxn->config_params.auxiliary_count == 0) {
+        return;
+    }
+
+    if (main_cxn->status.negotiated_version < OF_VERSION_1_3) {
+        LOG_VERBOSE("No auxiliary connections for %s, version %d",
+                    cxn_ip_string(main_cxn),
+                    main_cxn->status.negotiated_version);
+        return;
+    }
+
+    FOREACH_AUXILIARY_CXN(cxn_id, cxn, main_cxn) {
+        /* Already open */
+        return;
+    }
+
+    config_params = main_cxn->config_params;
+    config_params.auxiliary_count = 0;
+
+    for (idx = 1; idx <= main_cxn->config_params.auxiliary_count; idx++) {
+        cxn = connection_socket_setup(&main_cxn->protocol_params,
+                                      &config_params, &cxn_id, -1);
+        if (cxn == NULL) {
+            LOG_ERROR("Could not set up auxiliary connection %d for %s",
+                      idx, cxn_ip_string(main_cxn));
+            break;
+        }
+        cxn->status.auxiliary_id = idx;
+        cxn->main_cxn_id = main_cxn->cxn_id;
+        LOG_INFO("Added auxiliary connection %d for %s", idx,
+                 cxn_ip_string(cxn));
+    }
+}
+
+/**
+ * Close the auxiliary connections of a main connection
+ */
+static void
+cxn_auxiliary_remove(connection_t *main_cxn)
+{
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+
+    FOREACH_AUXILIARY_CXN(cxn_id, cxn, main_cxn) {
+        indigo_cxn_connection_remove(cxn_id);
+    }
+}
+
+/**
+ * Pick the connection to carry a packet-in for a main connection
+ *
+ * Packet-ins go to the auxiliary connections of the main connection when
+ * any are up. The Ethernet header picks the auxiliary connection, so the
+ * packet-ins of one flow stay in order.
+ */
+static connection_t *
+cxn_packet_in_channel(connection_t *main_cxn, of_object_t *obj)
+{
+    connection_t *aux[CXN_AUXILIARY_MAX];
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+    of_octets_t data;
+    uint32_t hash = 2166136261u;
+    int count = 0, i;
+
+    if (main_cxn->config_params.auxiliary_count == 0) {
+        return main_cxn;
+    }
+
+    FOREACH_AUXILIARY_CXN(cxn_id, cxn, main_cxn) {
+        if (CXN_HANDSHAKE_COMPLETE(cxn) &&
+            cxn->status.negotiated_version == obj->version &&
+            count < CXN_AUXILIARY_MAX) {
+            aux[count++] = cxn;
+        }
+    }
+
+    if (count == 0) {
+        return main_cxn;
+    }
+
+    of_packet_in_data_get(obj, &data);
+    for (i = 0; i < data.bytes && i < 14; i++) {
+        hash = (hash ^ data.data[i]) * 16777619u;
+    }
+
+    return aux[hash % count];
+}
+
 void
 ind_cxn_populate_connection_list(of_list_bsn_controller_connection_t *list)
 {
@@ -805,10 +1088,12 @@ ind_cxn_populate_connection_list(of_list_bsn_controller_connection_t *list)
 
         memset(uri, 0, sizeof(uri));
 
-        if (cxn->protocol_params.header.protocol == INDIGO_CXN_PROTO_TCP_OVER_IPV4) {
+        if (cxn->protocol_params.header.protocol == INDIGO_CXN_PROTO_TCP_OVER_IPV4 ||
+            cxn->protocol_params.header.protocol == INDIGO_CXN_PROTO_TLS_OVER_IPV4) {
             indigo_cxn_params_tcp_over_ipv4_t *proto =
                 &cxn->protocol_params.tcp_over_ipv4;
-            snprintf(uri, sizeof(uri), "tcp://%s:%d",
+            snprintf(uri, sizeof(uri), "%s://%s:%d",
+                CXN_TLS(cxn) ? "tls" : "tcp",
                 proto->controller_ip, proto->controller_port);
         }
 
@@ -828,31 +1113,17 @@ ind_cxn_populate_connection_list(of_list_bsn_controller_connection_t *list)
                            ((obj)->object_id == OF_PORT_STATUS) ||  \
                            ((obj)->object_id == OF_FLOW_REMOVED))
 
-/* Send an OpenFlow message to a controller connection
- *
- * This routine takes ownership of the object.
+/*
+ * Common checks before a message is queued on a connection
  *
- * In some cases the message may be dropped.
+ * Logs and traces the message and applies the async message throttling.
+ * Returns false if the message should be dropped for this connection.
  */
-void
-indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
+static int
+cxn_message_out_check(connection_t *cxn, of_object_t *obj)
 {
-    uint8_t *data = NULL;
-    int len;
-    connection_t *cxn;
     uint32_t xid;
 
-    if (INDIGO_CXN_INVALID(cxn_id)) {
-        LOG_ERROR("Invalid or no active connection: %d", cxn_id);
-        goto done;
-    }
-
-    cxn = CXN_ID_TO_CONNECTION(cxn_id);
-    if (!CXN_TCP_CONNECTED(cxn)) {
-        LOG_ERROR("Connection id %d is not connected", cxn_id);
-        goto done;
-    }
-
     xid = of_message_xid_get(OF_BUFFER_TO_MESSAGE(OF_OBJECT_BUFFER_INDEX(obj, 0)));
 
     LOG_VERBOSE("cxn %s: Sending %s message xid %u",
@@ -869,7 +1140,7 @@ indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
         if (IS_ASYNC_MSG(obj)) {
             LOG_TRACE("Handshake not complete; drop async msg %s",
                       of_object_id_str[obj->object_id]);
-            goto done;
+            return 0;
         }
     }
 
@@ -879,28 +1150,202 @@ indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
         if (CXN_DROP_PACKET_IN(cxn, obj)) {
             LOG_TRACE("Dropping packetIn");
             cxn->status.packet_in_drop++;
-            goto done;
+            return 0;
+        }
+        if (CXN_CONGESTED(cxn)) {
+            /* Send the first of every SAMPLE packet-ins while congested */
+            if (OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE == 0 ||
+                (cxn->packet_in_pressure_seq++ %
+                 OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE) != 0) {
+                LOG_TRACE("Dropping packetIn, output congested");
+                cxn->status.packet_in_drop++;
+                return 0;
+            }
+            cxn->status.packet_in_sampled++;
         }
     } else if (obj->object_id == OF_FLOW_REMOVED) {
         if (CXN_DROP_FLOW_REMOVED(cxn, obj)) {
             LOG_TRACE("Dropping flowRemoved");
             cxn->status.flow_removed_drop++;
-            goto done;
+            return 0;
         }
     }
 
-    /* Steal the buffer and enqueue the data */
     LOG_OBJECT(obj);
 
-    of_object_wire_buffer_steal((of_object_t *)obj, &data);
-    len = obj->length;
+    return 1;
+}
 
+static void
+cxn_message_out_count(connection_t *cxn, of_object_t *obj)
+{
     if (IS_MSG_OBJ(obj)) {
         cxn->messages_out_by_type[obj->object_id]++;
     } else {
         LOG_ERROR("Enqueue unknown msg obj id: %d", obj->object_id);
         cxn->messages_out_unknown++;
     }
+}
+
+/****************************************************************
+ *
+ * Packet-in batching
+ *
+ * See packet_in_batch_max in indigo_cxn_config_params_t. Each batching
+ * connection keeps its own batch; a task flushes every pending batch
+ * once the events that queued the packet-ins have been handled.
+ *
+ ****************************************************************/
+
+static int packet_in_batch_task_registered;
+
+/* Send the batched packet-ins of a connection */
+static void
+cxn_packet_in_batch_flush(connection_t *cxn)
+{
+    of_object_t *batch;
+    of_octets_t data;
+
+    if (cxn->packet_in_batch_count == 0) {
+        return;
+    }
+
+    data.data = cxn->packet_in_batch;
+    data.bytes = cxn->packet_in_batch_len;
+    cxn->packet_in_batch_len = 0;
+    cxn->packet_in_batch_count = 0;
+
+    batch = indigo_of_experimenter_new(cxn->status.negotiated_version,
+                                       OF_EXPERIMENTER_ID_BSN,
+                                       INDIGO_CXN_BSN_PACKET_IN_BATCH_SUBTYPE,
+                                       &data);
+    if (batch == NULL) {
+        LOG_ERROR("Failed to build packet-in batch, dropping packet-ins");
+        return;
+    }
+
+    cxn->packet_in_batches++;
+    indigo_cxn_send_controller_message(cxn->cxn_id, batch);
+}
+
+static ind_soc_task_status_t
+cxn_packet_in_batch_task(void *cookie)
+{
+    indigo_cxn_id_t cxn_id;
+
+    packet_in_batch_task_registered = 0;
+
+    for (cxn_id = 0; cxn_id < MAX_CONTROLLER_CONNECTIONS; cxn_id++) {
+        cxn_packet_in_batch_flush(&connection[cxn_id]);
+    }
+
+    return IND_SOC_TASK_FINISHED;
+}
+
+/*
+ * Queue a packet-in on a connection that batches them. The packet-in
+ * has passed cxn_message_out_check.
+ */
+static void
+cxn_packet_in_batch_append(connection_t *cxn, of_object_t *obj)
+{
+    uint8_t *data = OF_OBJECT_BUFFER_INDEX(obj, 0);
+    int len = obj->length;
+
+    if (len > OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES) {
+        /* Too big for any batch, send it by itself */
+        cxn_packet_in_batch_flush(cxn);
+        cxn_message_out_count(cxn, obj);
+        if (ind_cxn_instance_enqueue_copy(cxn, data, len) < 0) {
+            LOG_ERROR("Could not enqueue message data, disconnecting");
+            ind_cxn_disconnect(cxn);
+        }
+        return;
+    }
+
+    if (cxn->packet_in_batch_len + len > OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES) {
+        cxn_packet_in_batch_flush(cxn);
+    }
+
+    if (cxn->packet_in_batch == NULL) {
+        cxn->packet_in_batch = aim_malloc(OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES);
+    }
+
+    INDIGO_MEM_COPY(cxn->packet_in_batch + cxn->packet_in_batch_len, data, len);
+    cxn->packet_in_batch_len += len;
+    cxn->packet_in_batch_count++;
+    cxn_message_out_count(cxn, obj);
+
+    if (cxn->packet_in_batch_count >= cxn->config_params.packet_in_batch_max) {
+        cxn_packet_in_batch_flush(cxn);
+    } else if (!packet_in_batch_task_registered) {
+        if (ind_soc_task_register(cxn_packet_in_batch_task, NULL,
+                                  IND_CXN_EVENT_PRIORITY) == INDIGO_ERROR_NONE) {
+            packet_in_batch_task_registered = 1;
+        } else {
+            LOG_ERROR("Failed to register packet-in batch task");
+            cxn_packet_in_batch_flush(cxn);
+        }
+    }
+}
+
+/*
+ * Queue a packet-in on the targets that batch packet-ins and remove them
+ * from 'targets'. Returns the number of targets left.
+ */
+static int
+cxn_packet_in_batch_targets(connection_t **targets, int count,
+                            of_object_t *obj)
+{
+    int i, left = 0;
+
+    for (i = 0; i < count; i++) {
+        if (targets[i]->config_params.packet_in_batch_max == 0) {
+            targets[left++] = targets[i];
+        } else if (cxn_message_out_check(targets[i], obj)) {
+            cxn_packet_in_batch_append(targets[i], obj);
+        }
+    }
+
+    return left;
+}
+
+/* Send an OpenFlow message to a controller connection
+ *
+ * This routine takes ownership of the object.
+ *
+ * In some cases the message may be dropped.
+ */
+void
+indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
+{
+    uint8_t *data = NULL;
+    int len;
+    connection_t *cxn;
+
+    if (INDIGO_CXN_INVALID(cxn_id)) {
+        LOG_ERROR("Invalid or no active connection: %d", cxn_id);
+        goto done;
+    }
+
+    cxn = CXN_ID_TO_CONNECTION(cxn_id);
+    if (!CXN_TCP_CONNECTED(cxn)) {
+        LOG_ERROR("Connection id %d is not connected", cxn_id);
+        goto done;
+    }
+
+    if (!cxn_message_out_check(cxn, obj)) {
+        goto done;
+    }
+
+    /* Keep batched packet-ins ahead of later messages */
+    cxn_packet_in_batch_flush(cxn);
+
+    /* Steal the buffer and enqueue the data */
+    of_object_wire_buffer_steal((of_object_t *)obj, &data);
+    len = obj->length;
+
+    cxn_message_out_count(cxn, obj);
 
     if (ind_cxn_instance_enqueue(cxn, data, len) < 0) {
         LOG_ERROR("Could not enqueue message data, disconnecting");
@@ -919,68 +1364,242 @@ indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
     of_object_delete(obj);
 }
 
+static cxn_async_class_t
+cxn_async_class(of_object_id_t object_id)
+{
+    switch (object_id) {
+    case OF_PACKET_IN: return CXN_ASYNC_PACKET_IN;
+    case OF_FLOW_REMOVED: return CXN_ASYNC_FLOW_REMOVED;
+    default: return CXN_ASYNC_OTHER;
+    }
+}
+
+/**
+ * Recompute which classes of async message a connection accepts
+ *
+ * Called on every state change and role change of the connection.
+ * Auxiliary connections never accept async messages themselves; packet-ins
+ * reach them through their main connection.
+ */
+void
+ind_cxn_async_mask_update(const connection_t *cxn)
+{
+    uint32_t bit = 1U << cxn->cxn_id;
+    int accepts, slave;
+    cxn_async_class_t class;
+
+    accepts = CXN_ACTIVE(cxn) && !CXN_AUXILIARY(cxn) &&
+        !cxn->config_params.local &&
+        CONNECTION_STATE(cxn) == INDIGO_CXN_S_HANDSHAKE_COMPLETE;
+    slave = cxn->status.role == INDIGO_CXN_R_SLAVE;
+
+    for (class = 0; class < CXN_ASYNC_CLASS_COUNT; class++) {
+        if (accepts && !(slave && class != CXN_ASYNC_OTHER)) {
+            cxn_async_mask[class] |= bit;
+        } else {
+            cxn_async_mask[class] &= ~bit;
+        }
+    }
+}
+
+/*
+ * Check whether the given connection is interested in async messages of
+ * the given type.
+ */
+static int
+cxn_accepts_async_id(const connection_t *cxn, of_object_id_t object_id)
+{
+    return (cxn_async_mask[cxn_async_class(object_id)] >> cxn->cxn_id) & 1;
+}
+
 /**
  * Check whether the given connection is interested in the message.
  */
 int
 ind_cxn_accepts_async_message(const connection_t *cxn, const of_object_t *obj)
 {
-    if (CONNECTION_STATE(cxn) != INDIGO_CXN_S_HANDSHAKE_COMPLETE) {
-        return 0;
+    return cxn_accepts_async_id(cxn, obj->object_id);
+}
+
+/*
+ * Send an async message to all interested connections.
+ *
+ * Unless borrowed is set this takes ownership of the object. A borrowed
+ * message is copied into each connection's output queue and stays the
+ * caller's.
+ */
+static void
+cxn_send_async(of_object_t *obj, int borrowed)
+{
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+    connection_t *targets[MAX_CONTROLLER_CONNECTIONS];
+    int count = 0, accepted = 0, i;
+    ind_cxn_shared_buf_t *sbuf;
+    uint8_t *data = NULL;
+    uint32_t mask = cxn_async_mask[cxn_async_class(obj->object_id)];
+
+    while (mask != 0) {
+        cxn_id = __builtin_ctz(mask);
+        mask &= mask - 1;
+        cxn = &connection[cxn_id];
+        if (cxn->status.negotiated_version == obj->version) {
+            if (obj->object_id == OF_PACKET_IN) {
+                cxn = cxn_packet_in_channel(cxn, obj);
+            }
+            targets[count++] = cxn;
+        }
     }
 
-    if (cxn->config_params.local) {
-        return 0;
+    if (count == 0) {
+        LOG_VERBOSE("Dropping async %s message, no interested connections",
+                    of_object_id_str[obj->object_id]);
+        goto done;
     }
 
-    if (cxn->status.role == INDIGO_CXN_R_SLAVE) {
-        if ((obj->object_id == OF_PACKET_IN) ||
-            (obj->object_id == OF_FLOW_REMOVED)) {
-            return 0;
+    if (obj->object_id == OF_PACKET_IN) {
+        count = cxn_packet_in_batch_targets(targets, count, obj);
+        if (count == 0) {
+            goto done;
         }
     }
 
-    return 1;
+    if (count == 1 && !borrowed) {
+        indigo_cxn_send_controller_message(targets[0]->cxn_id, obj);
+        return;
+    }
+
+    /* Throttling and tracing need the object, so run them before the steal */
+    for (i = 0; i < count; i++) {
+        if (cxn_message_out_check(targets[i], obj)) {
+            targets[accepted++] = targets[i];
+        }
+    }
+
+    if (accepted == 0) {
+        goto done;
+    }
+
+    if (borrowed) {
+        data = OF_OBJECT_BUFFER_INDEX(obj, 0);
+        for (i = 0; i < accepted; i++) {
+            cxn = targets[i];
+            /* Keep batched packet-ins ahead of later messages */
+            cxn_packet_in_batch_flush(cxn);
+            cxn_message_out_count(cxn, obj);
+            if (ind_cxn_instance_enqueue_copy(cxn, data, obj->length) < 0) {
+                LOG_ERROR("Could not enqueue message data, disconnecting");
+                ind_cxn_disconnect(cxn);
+            }
+        }
+        return;
+    }
+
+    of_object_wire_buffer_steal(obj, &data);
+    sbuf = ind_cxn_shared_buf_create(data);
+    if (sbuf == NULL) {
+        LOG_ERROR("Could not allocate shared buffer for async %s message",
+                  of_object_id_str[obj->object_id]);
+        aim_free(data);
+        goto done;
+    }
+
+    for (i = 0; i < accepted; i++) {
+        cxn = targets[i];
+        /* Keep batched packet-ins ahead of later messages */
+        cxn_packet_in_batch_flush(cxn);
+        cxn_message_out_count(cxn, obj);
+        if (ind_cxn_instance_enqueue_shared(cxn, sbuf, obj->length) < 0) {
+            LOG_ERROR("Could not enqueue message data, disconnecting");
+            ind_cxn_disconnect(cxn);
+        }
+    }
+
+    ind_cxn_shared_buf_release(sbuf);
+
+ done:
+    if (!borrowed) {
+        of_object_delete(obj);
+    }
 }
 
 /**
  * Send an async message to all interested connections.
+ *
+ * The message is encoded once. When several connections accept it they
+ * all queue a reference to the same wire buffer rather than a copy of the
+ * object each.
  */
 void
 indigo_cxn_send_async_message(of_object_t *obj)
 {
-    indigo_cxn_id_t cxn_id;
-    connection_t *cxn;
+    cxn_send_async(obj, 0);
+}
 
-    /*
-     * The connection that will end up sending the original 'obj',
-     * rather than a duplicate. indigo_cxn_send_controller_message
-     * consumes the LOCI object so we need to call it on the
-     * original last.
-     */
-    indigo_cxn_id_t first_cxn_id = INDIGO_CXN_ID_UNSPECIFIED;
+/**
+ * Send an async message the caller keeps to all interested connections.
+ *
+ * The message is copied into the output queues, small messages into the
+ * shared arenas, so a caller building messages in preallocated storage
+ * sends them without a heap allocation per message.
+ */
+void
+indigo_cxn_send_async_message_copy(of_object_t *obj)
+{
+    cxn_send_async(obj, 1);
+}
 
-    FOREACH_ACTIVE_CXN(cxn_id, cxn) {
-        if (ind_cxn_accepts_async_message(cxn, obj) &&
-            (cxn->status.negotiated_version == obj->version)) {
-            if (first_cxn_id == INDIGO_CXN_ID_UNSPECIFIED) {
-                first_cxn_id = cxn->cxn_id;
-            } else {
-                of_object_t *dup = of_object_dup(obj);
-                if (dup != NULL) {
-                    indigo_cxn_send_controller_message(cxn->cxn_id, dup);
-                }
+/**
+ * Get OpenFlow version for async messages of the given type.
+ *
+ * Returns an error if no connection would accept such a message, so the
+ * caller can skip building it.
+ */
+indigo_error_t
+indigo_cxn_get_async_version_for(of_object_id_t object_id,
+                                 of_version_t *of_version)
+{
+    static const indigo_cxn_role_t roles[] = {
+        INDIGO_CXN_R_MASTER,
+        INDIGO_CXN_R_EQUAL,
+        INDIGO_CXN_R_SLAVE,
+        INDIGO_CXN_R_UNKNOWN,
+    };
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+    int i;
+
+    /* Same preference order as indigo_cxn_get_async_version */
+    for (i = 0; i < AIM_ARRAYSIZE(roles); i++) {
+        FOREACH_HS_COMPLETE_CXN_WITH_ROLE(cxn_id, cxn, roles[i]) {
+            if (cxn_accepts_async_id(cxn, object_id)) {
+                *of_version = cxn->status.negotiated_version;
+                return INDIGO_ERROR_NONE;
             }
         }
     }
 
-    if (first_cxn_id != INDIGO_CXN_ID_UNSPECIFIED) {
-        indigo_cxn_send_controller_message(first_cxn_id, obj);
-    } else {
-        LOG_VERBOSE("Dropping async %s message, no interested connections",
-                    of_object_id_str[obj->object_id]);
-        of_object_delete(obj);
+    return INDIGO_ERROR_NOT_FOUND;
+}
+
+/**
+ * Is the connection's output queue above the high watermark?
+ */
+int
+indigo_cxn_send_congested(indigo_cxn_id_t cxn_id)
+{
+    connection_t *cxn;
+
+    if (INDIGO_CXN_INVALID(cxn_id)) {
+        return 0;
     }
+
+    cxn = CXN_ID_TO_CONNECTION(cxn_id);
+    if (!CXN_TCP_CONNECTED(cxn)) {
+        return 0;
+    }
+
+    return CXN_CONGESTED(cxn);
 }
 
 /**
@@ -1108,6 +1727,7 @@ ind_cxn_init(ind_cxn_config_t *config)
     INDIGO_MEM_COPY(&cxn_config, config, sizeof(*config));
 
     module_init();
+    ind_cxn_trace_init();
 
     init_done = 1;
 
@@ -1169,6 +1789,7 @@ ind_cxn_finish(void)
 {
     LOG_TRACE("Indigo connection manager fini");
     ind_cxn_enable_set(0);
+    ind_cxn_capture_stop();
     return INDIGO_ERROR_NONE;
 }
 
@@ -1190,6 +1811,56 @@ ind_cxn_finish(void)
  * directly in the wire buffer.
  */
 
+/*
+ * Queue an error reply without allocating a LOCI object
+ *
+ * The header and error fields are the same in every OpenFlow version,
+ * so the message is built on the stack and copied into the output
+ * arena. Returns false, leaving it to the caller, when the reply is too
+ * large for the arena or the connection is being traced.
+ */
+static int
+error_reply_send_copy(indigo_cxn_id_t cxn_id, of_version_t version,
+                      uint32_t xid, uint16_t type, uint16_t code,
+                      of_octets_t *payload)
+{
+    uint8_t buf[COALESCE_MSG_MAX];
+    of_message_t msg = OF_BUFFER_TO_MESSAGE(buf);
+    connection_t *cxn;
+    int len;
+
+    len = OF_MESSAGE_MIN_ERROR_LENGTH + payload->bytes;
+    if (INDIGO_CXN_INVALID(cxn_id) || len > sizeof(buf)) {
+        return 0;
+    }
+
+    cxn = CXN_ID_TO_CONNECTION(cxn_id);
+    if (!CXN_TCP_CONNECTED(cxn) || cxn->trace_pvs) {
+        return 0;
+    }
+
+    buf[OF_MESSAGE_VERSION_OFFSET] = version;
+    buf[OF_MESSAGE_TYPE_OFFSET] = OF_OBJ_TYPE_ERROR;
+    of_message_length_set(msg, len);
+    buf_u32_set(buf + OF_MESSAGE_XID_OFFSET, xid);
+    buf_u16_set(buf + OF_MESSAGE_ERROR_TYPE_OFFSET, type);
+    buf_u16_set(buf + OF_MESSAGE_ERROR_TYPE_OFFSET + 2, code);
+    memcpy(buf + OF_MESSAGE_MIN_ERROR_LENGTH, payload->data, payload->bytes);
+
+    LOG_VERBOSE("cxn %s: Sending error message xid %u",
+                cxn_ip_string(cxn), xid);
+
+    if (ind_cxn_instance_enqueue_copy(cxn, buf, len) < 0) {
+        LOG_ERROR("Could not enqueue message data, disconnecting");
+        ind_cxn_disconnect(cxn);
+        return 1;
+    }
+
+    cxn->messages_out_by_type[of_message_to_object_id(msg, len)]++;
+
+    return 1;
+}
+
 void
 indigo_cxn_send_error_reply(indigo_cxn_id_t cxn_id, of_object_t *orig,
                             uint16_t type, uint16_t code)
@@ -1206,6 +1877,11 @@ indigo_cxn_send_error_reply(indigo_cxn_id_t cxn_id, of_object_t *orig,
     LOG_TRACE("Sending error msg to %s. type %d. code %d.",
               cxn_id_ip_string(cxn_id), type, code);
 
+    if (error_reply_send_copy(cxn_id, orig->version, xid, type, code,
+                              &payload)) {
+        return;
+    }
+
     if ((msg = of_hello_failed_error_msg_new(orig->version)) == NULL) {
         LOG_ERROR("Could not allocate error message");
         return;
@@ -1389,12 +2065,40 @@ ind_cxn_reset(indigo_cxn_id_t cxn_id)
 }
 
 /**
- * Show the stats for each connection.  If details
- * is true, show per-message data
+ * Show a latency histogram on one line, skipping empty buckets
  */
 
-void
-ind_cxn_stats_show(aim_pvs_t *pvs, int details)
+static void
+cxn_latency_hist_show(aim_pvs_t *pvs, const char *name,
+                      const cxn_latency_hist_t *hist)
+{
+    int bucket;
+
+    if (hist->count == 0) {
+        return;
+    }
+
+    aim_printf(pvs, "    %s: %"PRIu64", max %"PRIu64" us;",
+               name, hist->count, hist->max_us);
+    for (bucket = 0; bucket < CXN_LATENCY_BUCKETS; bucket++) {
+        if (hist->buckets[bucket] == 0) {
+            continue;
+        }
+        if (bucket == 0) {
+            aim_printf(pvs, " <1us:%"PRIu64, hist->buckets[bucket]);
+        } else if (bucket == CXN_LATENCY_BUCKETS - 1) {
+            aim_printf(pvs, " >=%uus:%"PRIu64, 1u << (bucket - 1),
+                       hist->buckets[bucket]);
+        } else {
+            aim_printf(pvs, " <%uus:%"PRIu64, 1u << bucket,
+                       hist->buckets[bucket]);
+        }
+    }
+    aim_printf(pvs, "\n");
+}
+
+static void
+cxn_stats_write(aim_pvs_t *pvs, int details)
 {
     indigo_cxn_id_t cxn_id;
     connection_t *cxn;
@@ -1419,12 +2123,49 @@ ind_cxn_stats_show(aim_pvs_t *pvs, int details)
                    CXN_LISTEN(cxn) ? " listening" : "",
                    cxn_ip_string(cxn));
         aim_printf(pvs, "    Id: %d.\n", cxn_id);
+        if (CXN_AUXILIARY(cxn)) {
+            aim_printf(pvs, "    Auxiliary id: %d of connection %d.\n",
+                       cxn->status.auxiliary_id, cxn->main_cxn_id);
+        }
         aim_printf(pvs, "    State: %s.\n", CXN_HANDSHAKE_COMPLETE(cxn) ?
                    "Connected" : "Not connected");
         aim_printf(pvs, "    Packet ins: %"PRIu64"\n",
                    cxn->packet_ins);
         aim_printf(pvs, "    Packet in drops: %"PRIu64"\n",
                    cxn->status.packet_in_drop);
+        aim_printf(pvs, "    Packet ins sampled while congested: %"PRIu64"\n",
+                   cxn->status.packet_in_sampled);
+        if (cxn->config_params.packet_in_batch_max > 0) {
+            aim_printf(pvs, "    Packet in batches: %"PRIu64"\n",
+                       cxn->packet_in_batches);
+        }
+        aim_printf(pvs, "    Output queue: %d bytes, %d pkts%s\n",
+                   cxn->bytes_enqueued, cxn->pkts_enqueued,
+                   CXN_CONGESTED(cxn) ? " (congested)" : "");
+        aim_printf(pvs, "    Output congestion events: %"PRIu64"\n",
+                   cxn->status.congestion_count);
+        if (cxn->sd >= 0) {
+            /* Effective values; the kernel doubles the buffer sizes */
+            aim_printf(pvs, "    Socket: sndbuf %d rcvbuf %d nodelay %d "
+                       "quickack %s busy_poll %d us priority %d\n",
+                       cxn_sockopt_get(cxn->sd, SOL_SOCKET, SO_SNDBUF),
+                       cxn_sockopt_get(cxn->sd, SOL_SOCKET, SO_RCVBUF),
+                       cxn_sockopt_get(cxn->sd, IPPROTO_TCP, TCP_NODELAY),
+                       cxn->config_params.socket.quickack > 0 ? "on" : "off",
+#ifdef SO_BUSY_POLL
+                       cxn_sockopt_get(cxn->sd, SOL_SOCKET, SO_BUSY_POLL),
+#else
+                       -1,
+#endif
+                       cxn_sockopt_get(cxn->sd, SOL_SOCKET, SO_PRIORITY));
+        }
+        if (CXN_TLS(cxn)) {
+            aim_printf(pvs, "    TLS handshakes: %"PRIu64" (%"PRIu64
+                       " resumed), records out: %"PRIu64"%s\n",
+                       cxn->tls_handshakes, cxn->tls_resumed,
+                       cxn->tls_records,
+                       cxn->tls_ktls ? ", kernel TLS" : "");
+        }
 
         aim_printf(pvs, "    Messages in, current connection: %"PRIu64"\n",
                    cxn->status.messages_in);
@@ -1467,12 +2208,171 @@ ind_cxn_stats_show(aim_pvs_t *pvs, int details)
             aim_printf(pvs, "        Unknown type: %"PRIu64"\n",
                        cxn->messages_out_unknown);
         }
+        aim_printf(pvs, "    Output flushes: %"PRIu64"\n",
+                   cxn->output_flushes);
+        aim_printf(pvs, "    Coalesced messages out: %"PRIu64
+                   " (%"PRIu64" bytes)\n",
+                   cxn->coalesced_msgs, cxn->coalesced_bytes);
+        if (cxn->output_flushes) {
+            aim_printf(pvs, "    Coalesced per flush: %"PRIu64" messages, "
+                       "%"PRIu64" bytes\n",
+                       cxn->coalesced_msgs / cxn->output_flushes,
+                       cxn->coalesced_bytes / cxn->output_flushes);
+        }
+        aim_printf(pvs, "    Shared messages out: %"PRIu64
+                   " (%"PRIu64" bytes)\n",
+                   cxn->shared_msgs, cxn->shared_bytes);
+        aim_printf(pvs, "    Barriers behind stats requests only: %"PRIu64"\n",
+                   cxn->barrier.background_cnt);
+        aim_printf(pvs, "    Echo requests answered on read: %"PRIu64"\n",
+                   cxn->keepalive.fast_replies);
+        cxn_latency_hist_show(pvs, "Echo reply lag", &cxn->keepalive.reply_lag);
+        cxn_latency_hist_show(pvs, "Echo round trip", &cxn->keepalive.rtt);
     }
     if (!cxn_count) {
         aim_printf(pvs, "No active connections\n");
     }
 }
 
+/**
+ * Show the stats for each connection.  If details
+ * is true, show per-message data
+ */
+
+void
+ind_cxn_stats_show(aim_pvs_t *pvs, int details)
+{
+    /* One write per chunk rather than per line */
+    aim_pvs_t *out = aim_pvs_chunked_create(pvs, 0);
+
+    cxn_stats_write(out, details);
+    aim_pvs_destroy(out);
+}
+
+/* Per connection counter families; the value is read from each connection */
+typedef struct cxn_metric_s {
+    const char *name;
+    const char *type;
+    const char *help;
+    uint64_t (*get)(connection_t *cxn);
+} cxn_metric_t;
+
+static uint64_t cxn_metric_packet_ins(connection_t *cxn) { return cxn->packet_ins; }
+static uint64_t cxn_metric_packet_in_drops(connection_t *cxn) { return cxn->status.packet_in_drop; }
+static uint64_t cxn_metric_output_bytes(connection_t *cxn) { return cxn->bytes_enqueued; }
+static uint64_t cxn_metric_congestion(connection_t *cxn) { return cxn->status.congestion_count; }
+static uint64_t cxn_metric_flushes(connection_t *cxn) { return cxn->output_flushes; }
+
+static const cxn_metric_t cxn_metrics[] = {
+    { "indigo_cxn_packet_ins", "counter", "Packet-ins offered to the connection.",
+      cxn_metric_packet_ins },
+    { "indigo_cxn_packet_in_drops", "counter", "Packet-ins dropped for the connection.",
+      cxn_metric_packet_in_drops },
+    { "indigo_cxn_output_queue_bytes", "gauge", "Bytes waiting in the output queue.",
+      cxn_metric_output_bytes },
+    { "indigo_cxn_congestion_events", "counter", "Times the output queue became congested.",
+      cxn_metric_congestion },
+    { "indigo_cxn_output_flushes", "counter", "Socket writes of queued output.",
+      cxn_metric_flushes },
+};
+
+static void
+cxn_metric_labels(aim_pvs_t *pvs, indigo_cxn_id_t cxn_id, connection_t *cxn)
+{
+    aim_printf(pvs, "cxn=\"%d\",remote=\"%s\"", cxn_id, cxn_ip_string(cxn));
+}
+
+static void
+cxn_metric_messages_write(aim_pvs_t *pvs, const char *name, const char *help,
+                          int out)
+{
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+    int idx;
+
+    aim_printf(pvs, "# TYPE %s counter\n# HELP %s %s\n", name, name, help);
+    FOREACH_ACTIVE_CXN(cxn_id, cxn) {
+        uint64_t *by_type = out ? cxn->messages_out_by_type :
+            cxn->messages_in_by_type;
+        for (idx = 0; idx < OF_MESSAGE_OBJECT_COUNT; idx++) {
+            if (by_type[idx] == 0) {
+                continue;
+            }
+            aim_printf(pvs, "%s_total{", name);
+            cxn_metric_labels(pvs, cxn_id, cxn);
+            aim_printf(pvs, ",type=\"%s\"} %"PRIu64"\n",
+                       of_object_id_str[idx], by_type[idx]);
+        }
+    }
+}
+
+/* The histogram keeps no sum, which OpenMetrics allows to be left out */
+static void
+cxn_metric_hist_write(aim_pvs_t *pvs, indigo_cxn_id_t cxn_id,
+                      connection_t *cxn, const char *name,
+                      const cxn_latency_hist_t *hist)
+{
+    uint64_t cumulative = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < CXN_LATENCY_BUCKETS - 1; bucket++) {
+        cumulative += hist->buckets[bucket];
+        aim_printf(pvs, "%s_bucket{", name);
+        cxn_metric_labels(pvs, cxn_id, cxn);
+        aim_printf(pvs, ",le=\"%.6f\"} %"PRIu64"\n",
+                   (1u << bucket) / 1e6, cumulative);
+    }
+
+    aim_printf(pvs, "%s_bucket{", name);
+    cxn_metric_labels(pvs, cxn_id, cxn);
+    aim_printf(pvs, ",le=\"+Inf\"} %"PRIu64"\n", hist->count);
+    aim_printf(pvs, "%s_count{", name);
+    cxn_metric_labels(pvs, cxn_id, cxn);
+    aim_printf(pvs, "} %"PRIu64"\n", hist->count);
+}
+
+void
+ind_cxn_metrics_write(aim_pvs_t *pvs)
+{
+    indigo_cxn_id_t cxn_id;
+    connection_t *cxn;
+    int i;
+
+    aim_printf(pvs, "# TYPE indigo_cxn_internal_errors counter\n"
+               "# HELP indigo_cxn_internal_errors Connection internal errors and socket disconnects.\n"
+               "indigo_cxn_internal_errors_total %u\n", ind_cxn_internal_errors);
+    aim_printf(pvs, "# TYPE indigo_cxn_handshakes counter\n"
+               "# HELP indigo_cxn_handshakes Completed connection handshakes.\n"
+               "indigo_cxn_handshakes_total %d\n", successful_handshakes);
+    aim_printf(pvs, "# TYPE indigo_cxn_remote_connections gauge\n"
+               "# HELP indigo_cxn_remote_connections Connected remote controllers.\n"
+               "indigo_cxn_remote_connections %d\n", remote_connection_count);
+
+    cxn_metric_messages_write(pvs, "indigo_cxn_messages_in",
+                              "Messages received per type.", 0);
+    cxn_metric_messages_write(pvs, "indigo_cxn_messages_out",
+                              "Messages sent per type.", 1);
+
+    for (i = 0; i < AIM_ARRAYSIZE(cxn_metrics); i++) {
+        const cxn_metric_t *metric = &cxn_metrics[i];
+        int counter = strcmp(metric->type, "counter") == 0;
+        aim_printf(pvs, "# TYPE %s %s\n# HELP %s %s\n",
+                   metric->name, metric->type, metric->name, metric->help);
+        FOREACH_ACTIVE_CXN(cxn_id, cxn) {
+            aim_printf(pvs, "%s%s{", metric->name, counter ? "_total" : "");
+            cxn_metric_labels(pvs, cxn_id, cxn);
+            aim_printf(pvs, "} %"PRIu64"\n", metric->get(cxn));
+        }
+    }
+
+    aim_printf(pvs, "# TYPE indigo_cxn_echo_rtt_seconds histogram\n"
+               "# HELP indigo_cxn_echo_rtt_seconds Round trip of echo requests to the controller.\n");
+    FOREACH_ACTIVE_CXN(cxn_id, cxn) {
+        cxn_metric_hist_write(pvs, cxn_id, cxn, "indigo_cxn_echo_rtt_seconds",
+                              &cxn->keepalive.rtt);
+    }
+}
+
 /**
  * Get OpenFlow version for async messages.
  */
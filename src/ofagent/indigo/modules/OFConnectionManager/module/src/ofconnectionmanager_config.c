@@ -33,6 +33,7 @@
 #include "ofconnectionmanager_int.h"
 #include "ofconnectionmanager_log.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <cjson/cJSON.h>
 #include <Configuration/configuration.h>
 
@@ -76,6 +77,11 @@ ofconnectionmanager_config_settings_t ofconnectionmanager_config_settings[] =
 #else
 { OFCONNECTIONMANAGER_CONFIG_INCLUDE_UCLI(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
 #endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_INCLUDE_TLS(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
 #ifdef OFCONNECTIONMANAGER_CONFIG_ECHO_OPTIMIZATION
     { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_ECHO_OPTIMIZATION), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_ECHO_OPTIMIZATION) },
 #else
@@ -85,6 +91,36 @@ ofconnectionmanager_config_settings_t ofconnectionmanager_config_settings[] =
     { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_OF_VERSION), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_OF_VERSION) },
 #else
 { OFCONNECTIONMANAGER_CONFIG_OF_VERSION(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_PACKET_IN_PRESSURE_SAMPLE(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS
+    { __ofconnectionmanager_config_STRINGIFY_NAME(OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS), __ofconnectionmanager_config_STRINGIFY_VALUE(OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS) },
+#else
+{ OFCONNECTIONMANAGER_CONFIG_RETRY_MAX_MS(__ofconnectionmanager_config_STRINGIFY_NAME), "__undefined__" },
 #endif
     { NULL, NULL }
 };
@@ -130,6 +166,60 @@ static struct config {
     struct controller controllers[MAX_CONTROLLERS];
 } staged_config, current_config;
 
+/*
+ * Parse the optional "socket" object of a controller spec, e.g.
+ * "socket": { "sndbuf": 4194304, "rcvbuf": 4194304, "nodelay": true,
+ *             "quickack": true, "busy_poll_us": 50, "priority": 6 }
+ * Missing keys keep the system defaults.
+ */
+static indigo_error_t
+parse_socket_params(indigo_cxn_socket_params_t *params, cJSON *root)
+{
+    static const struct {
+        const char *key;
+        size_t offset;
+        int is_bool;
+    } options[] = {
+        { "socket.nodelay", offsetof(indigo_cxn_socket_params_t, nodelay), 1 },
+        { "socket.quickack", offsetof(indigo_cxn_socket_params_t, quickack), 1 },
+        { "socket.sndbuf", offsetof(indigo_cxn_socket_params_t, sndbuf), 0 },
+        { "socket.rcvbuf", offsetof(indigo_cxn_socket_params_t, rcvbuf), 0 },
+        { "socket.busy_poll_us", offsetof(indigo_cxn_socket_params_t, busy_poll_us), 0 },
+        { "socket.priority", offsetof(indigo_cxn_socket_params_t, priority), 0 },
+    };
+    indigo_error_t err;
+    int i, value;
+
+    memset(params, 0, sizeof(*params));
+
+    for (i = 0; i < AIM_ARRAYSIZE(options); i++) {
+        if (options[i].is_bool) {
+            err = ind_cfg_lookup_bool(root, options[i].key, &value);
+            /* 0 means the default, so an explicit false is negative */
+            value = value ? 1 : -1;
+        } else {
+            err = ind_cfg_lookup_int(root, options[i].key, &value);
+        }
+
+        if (err == INDIGO_ERROR_NOT_FOUND) {
+            continue;
+        } else if (err < 0) {
+            AIM_LOG_ERROR("Config: '%s' must be %s", options[i].key,
+                          options[i].is_bool ? "a boolean" : "an integer");
+            return err;
+        }
+
+        if (value < 0 && !options[i].is_bool) {
+            AIM_LOG_ERROR("Config: Invalid '%s': %d", options[i].key, value);
+            return INDIGO_ERROR_PARAM;
+        }
+
+        *(int *)((char *)params + options[i].offset) = value;
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
 /* Parse a controller string like "tcp:127.0.0.1:6633". */
 static indigo_error_t
 parse_controller(struct controller *controller, cJSON *root)
@@ -163,7 +253,7 @@ parse_controller(struct controller *controller, cJSON *root)
     }
 
     /* @TODO support more protocol types */
-    if (strcmp(proto_str, "tcp")) {
+    if (strcmp(proto_str, "tcp") && strcmp(proto_str, "tls")) {
         AIM_LOG_ERROR("Config: Invalid controller protocol: %s", proto_str);
         return INDIGO_ERROR_PARAM;
     }
@@ -204,10 +294,16 @@ parse_controller(struct controller *controller, cJSON *root)
         return err;
     }
 
+    err = parse_socket_params(&controller->config.socket, root);
+    if (err < 0) {
+        return err;
+    }
+
     /* TODO validate IP */
 
     proto = &controller->proto.tcp_over_ipv4;
-    proto->protocol = INDIGO_CXN_PROTO_TCP_OVER_IPV4;
+    proto->protocol = strcmp(proto_str, "tls") ?
+        INDIGO_CXN_PROTO_TCP_OVER_IPV4 : INDIGO_CXN_PROTO_TLS_OVER_IPV4;
     strncpy(proto->controller_ip, ip, sizeof(proto->controller_ip));
     proto->controller_port = port;
     controller->config.listen = listen;
@@ -330,7 +426,7 @@ ind_cxn_cfg_commit(void)
     if ((lobj = aim_log_find("ofconnectionmanager")) == NULL) {
         AIM_LOG_WARN("Could not find log module");
     } else {
-        lobj->common_flags = staged_config.log_flags;
+        aim_log_common_flags_set(lobj, staged_config.log_flags);
     }
 
     for (i = 0; i < staged_config.num_controllers; i++) {
@@ -345,6 +441,7 @@ ind_cxn_cfg_commit(void)
         if ((old_controller = find_controller(&current_config, &c->proto))) {
             c->cxn_id = old_controller->cxn_id;
             /* TODO apply keepalive_period to existing connection. */
+            (void) ind_cxn_socket_params_set(c->cxn_id, &c->config.socket);
             continue;
         }
 
@@ -367,7 +464,16 @@ ind_cxn_cfg_commit(void)
     current_config = staged_config;
 }
 
+/* Reloads that change none of these skip this module */
+static const char * const ind_cxn_cfg_keys[] = {
+    "logging.connection",
+    "keepalive_period_ms",
+    "controllers",
+    NULL
+};
+
 const struct ind_cfg_ops ind_cxn_cfg_ops = {
     .stage = ind_cxn_cfg_stage,
     .commit = ind_cxn_cfg_commit,
+    .keys = ind_cxn_cfg_keys,
 };
@@ -31,6 +31,7 @@
 #include "ofconnectionmanager_log.h"
 #include "cxn_instance.h"
 #include <cjson/cJSON.h>
+#include <AIM/aim_trace.h>
 
 /* Very verbose for debugging */
 /* #define OF_CXN_DUMP_ALL_OBJECTS 1 */
@@ -76,7 +77,7 @@ connection_t* cookie_to_cxn(void* cookie);
 /*
  * Priority for sockets and timers registered with SocketManager.
  */
-#define IND_CXN_EVENT_PRIORITY 10
+#define IND_CXN_EVENT_PRIORITY IND_SOC_PRIORITY_CONTROL
 
 extern void indigo_cxn_socket_ready_callback(int socket_id,
                                              void *cookie,
@@ -99,6 +100,15 @@ extern void cxn_message_track_setup(connection_t *cxn, of_object_t *obj);
 
 void ind_cxn_change_master(indigo_cxn_id_t master_id);
 
+void ind_cxn_role_set(connection_t *cxn, indigo_cxn_role_t role);
+
+void ind_cxn_async_mask_update(const connection_t *cxn);
+
+indigo_cxn_role_t ind_cxn_role_get(connection_t *cxn);
+
+indigo_error_t ind_cxn_socket_params_set(indigo_cxn_id_t cxn_id,
+                                         const indigo_cxn_socket_params_t *params);
+
 void ind_cxn_populate_connection_list(of_list_bsn_controller_connection_t *list);
 
 /**
@@ -135,6 +145,62 @@ extern void ind_cxn_state_timeout(void *cookie);
 
 extern void ind_cxn_stats_show(aim_pvs_t* pvs, int details);
 
+
+/****************************************************************
+ * Binary message trace
+ ****************************************************************/
+
+#define IND_CXN_TRACE_RX 1
+#define IND_CXN_TRACE_TX 2
+
+/* NULL if OFCONNECTIONMANAGER_CONFIG_MESSAGE_TRACE_SIZE is 0 */
+extern aim_trace_ring_t *ind_cxn_trace_ring;
+
+extern void ind_cxn_trace_init(void);
+
+/**
+ * Record a message in the trace
+ * @param event IND_CXN_TRACE_RX or IND_CXN_TRACE_TX
+ * @param cxn The connection
+ * @param buf The message
+ * @param len Length of the message
+ * @param start For RX, the time processing started (aim_trace_now)
+ */
+extern void ind_cxn_trace_message(uint32_t event, connection_t *cxn,
+                                  uint8_t *buf, int len, uint64_t start);
+
+#define IND_CXN_TRACE(event, cxn, buf, len, start) do {                 \
+        if (ind_cxn_trace_ring != NULL) {                               \
+            ind_cxn_trace_message(event, cxn, buf, len, start);         \
+        }                                                               \
+    } while (0)
+
+/****************************************************************
+ * Controller session capture
+ ****************************************************************/
+
+#define IND_CXN_CAPTURE_DATA 1
+#define IND_CXN_CAPTURE_CLOSE 2
+
+/* NULL unless a capture is running */
+extern FILE *ind_cxn_capture_fp;
+
+/**
+ * Record data read from a connection, or the end of its session
+ * @param event IND_CXN_CAPTURE_DATA or IND_CXN_CAPTURE_CLOSE
+ * @param cxn The connection
+ * @param buf The data read
+ * @param len Length of the data, 0 for IND_CXN_CAPTURE_CLOSE
+ */
+extern void ind_cxn_capture_record(uint32_t event, connection_t *cxn,
+                                   const uint8_t *buf, int len);
+
+#define IND_CXN_CAPTURE(event, cxn, buf, len) do {                      \
+        if (ind_cxn_capture_fp != NULL) {                               \
+            ind_cxn_capture_record(event, cxn, buf, len);               \
+        }                                                               \
+    } while (0)
+
 /**
  * @brief Update the configuration of the connection manager
  * @param config Pointer to the implementation specific configuration
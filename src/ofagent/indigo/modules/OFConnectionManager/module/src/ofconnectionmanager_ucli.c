@@ -72,6 +72,76 @@ ofconnectionmanager_ucli_ucli__stats__(ucli_context_t *uc)
     return UCLI_STATUS_OK;
 }
 
+static ucli_status_t
+ofconnectionmanager_ucli_ucli__trace__(ucli_context_t *uc)
+{
+    int count = 0;
+
+    UCLI_COMMAND_INFO(uc,
+                      "trace", -1,
+                      "$summary#Show the binary message trace."
+                      "$args#[count]");
+    if (uc->pargs->count == 1) {
+        UCLI_ARGPARSE_OR_RETURN(uc, "i", &count);
+    } else if (uc->pargs->count > 1) {
+        return UCLI_STATUS_E_ARG;
+    }
+
+    ind_cxn_trace_show(&uc->pvs, count);
+
+    return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ofconnectionmanager_ucli_ucli__trace_save__(ucli_context_t *uc)
+{
+    char *filename;
+
+    UCLI_COMMAND_INFO(uc,
+                      "trace_save", 1,
+                      "$summary#Save the binary message trace for offline decoding."
+                      "$args#<filename>");
+    UCLI_ARGPARSE_OR_RETURN(uc, "s", &filename);
+
+    if (ind_cxn_trace_save(filename) < 0) {
+        return ucli_error(uc, "could not save the message trace to %s",
+                          filename);
+    }
+
+    return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ofconnectionmanager_ucli_ucli__capture_start__(ucli_context_t *uc)
+{
+    char *filename;
+
+    UCLI_COMMAND_INFO(uc,
+                      "capture_start", 1,
+                      "$summary#Capture the controller sessions for replay."
+                      "$args#<filename>");
+    UCLI_ARGPARSE_OR_RETURN(uc, "s", &filename);
+
+    if (ind_cxn_capture_start(filename) < 0) {
+        return ucli_error(uc, "could not capture the sessions to %s",
+                          filename);
+    }
+
+    return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ofconnectionmanager_ucli_ucli__capture_stop__(ucli_context_t *uc)
+{
+    UCLI_COMMAND_INFO(uc,
+                      "capture_stop", 0,
+                      "$summary#Stop the session capture.");
+
+    ind_cxn_capture_stop();
+
+    return UCLI_STATUS_OK;
+}
+
 
 /* <auto.ucli.handlers.start> */
 /******************************************************************************
@@ -84,6 +154,10 @@ static ucli_command_handler_f ofconnectionmanager_ucli_ucli_handlers__[] =
 {
     ofconnectionmanager_ucli_ucli__config__,
     ofconnectionmanager_ucli_ucli__stats__,
+    ofconnectionmanager_ucli_ucli__trace__,
+    ofconnectionmanager_ucli_ucli__trace_save__,
+    ofconnectionmanager_ucli_ucli__capture_start__,
+    ofconnectionmanager_ucli_ucli__capture_stop__,
     NULL
 };
 /******************************************************************************/
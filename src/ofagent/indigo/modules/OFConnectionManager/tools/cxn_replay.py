@@ -0,0 +1,403 @@
+#!/usr/bin/env python
+################################################################
+#
+#        Copyright 2013, Big Switch Networks, Inc.
+#
+# Licensed under the Eclipse Public License, Version 1.0 (the
+# "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+#        http://www.eclipse.org/legal/epl-v10.html
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific
+# language governing permissions and limitations under the
+# License.
+#
+################################################################
+
+###############################################################################
+#
+# Replay controller sessions captured by ind_cxn_capture_start() (ofagentapp
+# --cxncapture, uCli "ofconnectionmanager capture_start <file>") against an
+# agent, playing the controller.
+#
+# Each captured session gets its own TCP connection. By default the tool
+# listens and the agent connects to it as to its controller, one connection
+# per session, taken in the order the sessions start; with --connect it
+# connects to an agent started with --listen. The messages are sent at the
+# pace they were captured (--speed scales it) or, with --max, as fast as the
+# agent reads them. Echo requests from the agent are answered; all else it
+# sends is only matched against the requests by xid.
+#
+# Reports per session and in total the messages sent, the throughput, the
+# errors the agent returned and the latency of each request type, from the
+# request being written to the socket to its reply arriving. Works the same
+# with OF-DPA or a mock driver behind the agent.
+#
+# The file layout is described in module/src/cxn_capture.c.
+#
+###############################################################################
+import optparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+MAGIC = b"OFCXNCAP"
+BYTE_ORDER = 0x01020304
+DATA = 1
+CLOSE = 2
+
+OF_VERSION_1_0 = 1
+
+# Message types answered by the agent, and the type of the reply
+REPLIES_OF10 = {
+    2: 3,       # echo
+    5: 6,       # features
+    7: 8,       # get_config
+    16: 17,     # stats
+    18: 19,     # barrier
+    20: 21,     # queue_get_config
+}
+
+REPLIES_OF11 = {
+    2: 3,       # echo
+    5: 6,       # features
+    7: 8,       # get_config
+    18: 19,     # multipart
+    20: 21,     # barrier
+    22: 23,     # queue_get_config
+    24: 25,     # role
+    26: 27,     # get_async
+}
+
+TYPE_NAMES = {
+    2: "echo_request", 5: "features_request", 7: "get_config_request",
+}
+
+TYPE_NAMES_OF10 = dict(TYPE_NAMES)
+TYPE_NAMES_OF10.update({16: "stats_request", 18: "barrier_request",
+                        20: "queue_get_config_request"})
+
+TYPE_NAMES_OF11 = dict(TYPE_NAMES)
+TYPE_NAMES_OF11.update({18: "multipart_request", 20: "barrier_request",
+                        22: "queue_get_config_request", 24: "role_request",
+                        26: "get_async_request"})
+
+ERROR = 1
+ECHO_REQUEST = 2
+ECHO_REPLY = 3
+
+
+def replies(version):
+    return REPLIES_OF10 if version == OF_VERSION_1_0 else REPLIES_OF11
+
+
+def type_name(version, type_):
+    names = TYPE_NAMES_OF10 if version == OF_VERSION_1_0 else TYPE_NAMES_OF11
+    return names.get(type_, "type(%d)" % type_)
+
+
+class Session(object):
+    """The messages one controller connection sent, with their arrival
+    time in ns"""
+
+    def __init__(self, cxn_id):
+        self.cxn_id = cxn_id
+        self.messages = []
+        self.partial = b""
+        self.partial_time = 0
+
+    def add_data(self, timestamp, data):
+        if not self.partial:
+            self.partial_time = timestamp
+        buf = self.partial + data
+        offset = 0
+        while len(buf) - offset >= 8:
+            length = struct.unpack("!H", buf[offset + 2:offset + 4])[0]
+            if length < 8 or len(buf) - offset < length:
+                break
+            self.messages.append((self.partial_time,
+                                  buf[offset:offset + length]))
+            self.partial_time = timestamp
+            offset += length
+        self.partial = buf[offset:]
+
+    def start(self):
+        return self.messages[0][0]
+
+
+def load(filename):
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    if data[:8] != MAGIC:
+        raise ValueError("%s is not a session capture" % filename)
+
+    for endian in "<>":
+        order, size = struct.unpack(endian + "II", data[8:16])
+        if order == BYTE_ORDER:
+            break
+    else:
+        raise ValueError("%s: unknown byte order" % filename)
+
+    fmt = endian + "QIIII"
+    if size != struct.calcsize(fmt):
+        raise ValueError("%s: unexpected record size %d" % (filename, size))
+
+    sessions = []
+    open_sessions = {}
+    offset = 16
+    while offset + size <= len(data):
+        timestamp, cxn_id, event, length, _ = \
+            struct.unpack(fmt, data[offset:offset + size])
+        offset += size
+        if event == DATA:
+            if cxn_id not in open_sessions:
+                open_sessions[cxn_id] = Session(cxn_id)
+                sessions.append(open_sessions[cxn_id])
+            open_sessions[cxn_id].add_data(timestamp,
+                                           data[offset:offset + length])
+        elif event == CLOSE:
+            open_sessions.pop(cxn_id, None)
+        offset += length
+
+    return sorted([s for s in sessions if s.messages], key=Session.start)
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+class Replay(object):
+    """Plays one session over a connected socket"""
+
+    def __init__(self, session, sock, opts, base_time, base_wall):
+        self.session = session
+        self.sock = sock
+        self.opts = opts
+        self.base_time = base_time
+        self.base_wall = base_wall
+        self.lock = threading.Lock()
+        self.pending = {}       # (reply type, xid) -> [(send time, name)]
+        self.latency = {}       # request name -> [us]
+        self.sent = 0
+        self.sent_bytes = 0
+        self.received = 0
+        self.errors = 0
+        self.outstanding = 0
+        self.done = threading.Event()
+        self.first_send = None
+        self.last_activity = None
+
+    def expect(self, message, now):
+        version, type_ = struct.unpack("!BB", message[:2])
+        reply = replies(version).get(type_)
+        if reply is None:
+            return
+        xid = struct.unpack("!I", message[4:8])[0]
+        with self.lock:
+            self.pending.setdefault((reply, xid), []).append(
+                (now, type_name(version, type_)))
+            self.outstanding += 1
+
+    def send(self):
+        batch = []
+        batch_bytes = 0
+        for timestamp, message in self.session.messages:
+            if not self.opts.max:
+                due = self.base_wall + \
+                    (timestamp - self.base_time) / 1e9 / self.opts.speed
+                delay = due - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+            batch.append(message)
+            batch_bytes += len(message)
+            if not self.opts.max or batch_bytes >= 65536:
+                self.flush(batch)
+                batch = []
+                batch_bytes = 0
+        self.flush(batch)
+
+        # Wait for the replies still outstanding
+        deadline = time.time() + self.opts.wait
+        while time.time() < deadline:
+            with self.lock:
+                if self.outstanding == 0:
+                    break
+            time.sleep(0.01)
+
+    def flush(self, batch):
+        if not batch:
+            return
+        now = time.time()
+        for message in batch:
+            self.expect(message, now)
+        if self.first_send is None:
+            self.first_send = now
+        self.sock.sendall(b"".join(batch))
+        self.sent += len(batch)
+        self.sent_bytes += sum(len(m) for m in batch)
+        with self.lock:
+            self.last_activity = max(self.last_activity or 0, time.time())
+
+    def receive(self):
+        buf = b""
+        while not self.done.is_set():
+            try:
+                data = self.sock.recv(1 << 20)
+            except socket.timeout:
+                continue
+            except socket.error:
+                break
+            if not data:
+                break
+            now = time.time()
+            buf += data
+            offset = 0
+            while len(buf) - offset >= 8:
+                version, type_, length, xid = \
+                    struct.unpack("!BBHI", buf[offset:offset + 8])
+                if length < 8 or len(buf) - offset < length:
+                    break
+                self.handle(version, type_, xid,
+                            buf[offset:offset + length], now)
+                offset += length
+            buf = buf[offset:]
+
+    def handle(self, version, type_, xid, message, now):
+        self.received += 1
+        if type_ == ECHO_REQUEST:
+            self.sock.sendall(struct.pack("!BBHI", version, ECHO_REPLY,
+                                          len(message), xid) + message[8:])
+            return
+        if type_ == ERROR:
+            self.errors += 1
+        with self.lock:
+            waiting = self.pending.get((type_, xid))
+            if not waiting:
+                return
+            sent, name = waiting.pop(0)
+            if not waiting:
+                del self.pending[(type_, xid)]
+            self.outstanding -= 1
+            self.last_activity = max(self.last_activity or 0, now)
+        self.latency.setdefault(name, []).append((now - sent) * 1e6)
+
+    def run(self):
+        self.sock.settimeout(0.1)
+        receiver = threading.Thread(target=self.receive)
+        receiver.daemon = True
+        receiver.start()
+        try:
+            self.send()
+        except socket.error as e:
+            sys.stderr.write("session %d: %s\n" % (self.session.cxn_id, e))
+        self.done.set()
+        receiver.join()
+        self.sock.close()
+
+
+def report(name, replays, out):
+    sent = sum(r.sent for r in replays)
+    sent_bytes = sum(r.sent_bytes for r in replays)
+    # From the first message sent to the last one sent or the last reply
+    # received, whichever is later
+    started = [r for r in replays if r.first_send is not None]
+    if started:
+        elapsed = (max(r.last_activity for r in started) -
+                   min(r.first_send for r in started))
+    else:
+        elapsed = 0.0
+    elapsed = elapsed or 1e-9
+    out.write("%s: %d messages, %d bytes in %.3f s, %.0f msg/s, %.1f Mbit/s, "
+              "%d received, %d errors, %d unanswered\n" %
+              (name, sent, sent_bytes, elapsed, sent / elapsed,
+               sent_bytes * 8 / elapsed / 1e6,
+               sum(r.received for r in replays),
+               sum(r.errors for r in replays),
+               sum(r.outstanding for r in replays)))
+
+    latency = {}
+    for r in replays:
+        for request, values in r.latency.items():
+            latency.setdefault(request, []).extend(values)
+    if not latency:
+        return
+    out.write("  %-26s %-8s %-10s %-10s %-10s %s\n" %
+              ("request", "count", "p50(us)", "p99(us)", "max(us)",
+               "avg(us)"))
+    for request in sorted(latency):
+        v = sorted(latency[request])
+        out.write("  %-26s %-8d %-10.0f %-10.0f %-10.0f %.0f\n" %
+                  (request, len(v), percentile(v, 50), percentile(v, 99),
+                   v[-1], sum(v) / len(v)))
+
+
+def main():
+    parser = optparse.OptionParser(usage="%prog [options] <capture file>")
+    parser.add_option("-l", "--listen", default="0.0.0.0:6653",
+                      help="Address the agent connects to [%default]")
+    parser.add_option("-c", "--connect", metavar="IP:PORT",
+                      help="Connect to an agent listening on IP:PORT")
+    parser.add_option("-m", "--max", action="store_true",
+                      help="Send as fast as the agent reads")
+    parser.add_option("-s", "--speed", type="float", default=1.0,
+                      help="Pace multiplier when not --max [%default]")
+    parser.add_option("-w", "--wait", type="float", default=5.0,
+                      help="Seconds to wait for replies at the end "
+                      "[%default]")
+    opts, args = parser.parse_args()
+    if len(args) != 1:
+        parser.error("expected one capture file")
+    if opts.speed <= 0:
+        parser.error("speed must be positive")
+
+    sessions = load(args[0])
+    if not sessions:
+        sys.stderr.write("%s: no sessions\n" % args[0])
+        return 1
+
+    socks = []
+    if opts.connect:
+        host, port = opts.connect.rsplit(":", 1)
+        for _ in sessions:
+            socks.append(socket.create_connection((host, int(port))))
+    else:
+        host, port = opts.listen.rsplit(":", 1)
+        listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        listener.bind((host, int(port)))
+        listener.listen(len(sessions))
+        sys.stderr.write("Waiting for %d agent connections on %s\n" %
+                         (len(sessions), opts.listen))
+        for _ in sessions:
+            socks.append(listener.accept()[0])
+        listener.close()
+    for sock in socks:
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    base_time = sessions[0].start()
+    base_wall = time.time()
+    replays = [Replay(s, sock, opts, base_time, base_wall)
+               for s, sock in zip(sessions, socks)]
+    threads = [threading.Thread(target=r.run) for r in replays]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    for r in replays:
+        report("session %d (cxn %d)" % (replays.index(r), r.session.cxn_id),
+               [r], sys.stdout)
+    if len(replays) > 1:
+        report("total", replays, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,183 @@
+#!/usr/bin/env python
+################################################################
+#
+#        Copyright 2013, Big Switch Networks, Inc.
+#
+# Licensed under the Eclipse Public License, Version 1.0 (the
+# "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+#        http://www.eclipse.org/legal/epl-v10.html
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+# either express or implied. See the License for the specific
+# language governing permissions and limitations under the
+# License.
+#
+################################################################
+
+###############################################################################
+#
+# Decode a message trace saved by ind_cxn_trace_save() (uCli:
+# "ofconnectionmanager trace_save <file>").
+#
+# Prints one line per message, then the agent latency of each request
+# that has a reply: from the start of processing to the reply being
+# queued, matched by connection and xid.
+#
+# The record layout is described in module/src/cxn_trace.c.
+#
+###############################################################################
+import struct
+import sys
+import optparse
+
+MAGIC = b"OFCXNTRC"
+BYTE_ORDER = 0x01020304
+RX = 1
+TX = 2
+
+TYPES_OF10 = [
+    "hello", "error", "echo_request", "echo_reply", "vendor",
+    "features_request", "features_reply", "get_config_request",
+    "get_config_reply", "set_config", "packet_in", "flow_removed",
+    "port_status", "packet_out", "flow_mod", "port_mod",
+    "stats_request", "stats_reply", "barrier_request", "barrier_reply",
+    "queue_get_config_request", "queue_get_config_reply",
+]
+
+TYPES_OF11 = [
+    "hello", "error", "echo_request", "echo_reply", "experimenter",
+    "features_request", "features_reply", "get_config_request",
+    "get_config_reply", "set_config", "packet_in", "flow_removed",
+    "port_status", "packet_out", "flow_mod", "group_mod", "port_mod",
+    "table_mod", "stats_request", "stats_reply", "barrier_request",
+    "barrier_reply", "queue_get_config_request", "queue_get_config_reply",
+    "role_request", "role_reply", "get_async_request", "get_async_reply",
+    "set_async", "meter_mod",
+]
+
+# Messages which are never answered
+UNSOLICITED = set(["packet_in", "flow_removed", "port_status", "hello"])
+
+
+def type_name(version, type_):
+    names = TYPES_OF10 if version == 1 else TYPES_OF11
+    if type_ < len(names):
+        return names[type_]
+    return "unknown(%d)" % type_
+
+
+class Record(object):
+    def __init__(self, fields):
+        (seq, self.timestamp, self.event, self.xid,
+         info, self.start) = fields
+        self.seq = seq - 1
+        self.cxn_id = info >> 32
+        self.version = (info >> 24) & 0xff
+        self.type = type_name(self.version, (info >> 16) & 0xff)
+        self.length = info & 0xffff
+
+    def handler_us(self):
+        if self.event == RX and self.start:
+            return (self.timestamp - self.start) / 1000.0
+        return None
+
+
+def load(filename):
+    with open(filename, "rb") as f:
+        data = f.read()
+
+    if data[:8] != MAGIC:
+        raise ValueError("%s is not a message trace" % filename)
+
+    for endian in "<>":
+        order, size = struct.unpack(endian + "II", data[8:16])
+        if order == BYTE_ORDER:
+            break
+    else:
+        raise ValueError("%s: unknown byte order" % filename)
+
+    fmt = endian + "QQIIQQ"
+    if size != struct.calcsize(fmt):
+        raise ValueError("%s: unexpected record size %d" % (filename, size))
+
+    records = []
+    for offset in range(16, len(data) - size + 1, size):
+        records.append(Record(struct.unpack(fmt, data[offset:offset + size])))
+    return records
+
+
+def show(records, out):
+    base = records[0].timestamp if records else 0
+    out.write("%-10s %-14s %-4s %-3s %-3s %-24s %-10s %-6s %s\n" %
+              ("seq", "time(ms)", "cxn", "dir", "ver", "type", "xid", "len",
+               "handler(us)"))
+    for r in records:
+        handler = r.handler_us()
+        out.write("%-10d %-14.3f %-4d %-3s %-3d %-24s %-10d %-6d %s\n" %
+                  (r.seq, (r.timestamp - base) / 1e6, r.cxn_id,
+                   "rx" if r.event == RX else "tx", r.version, r.type,
+                   r.xid, r.length,
+                   "%.3f" % handler if handler is not None else ""))
+
+
+def latency(records, out):
+    # A reply queued from inside the handler is recorded before the
+    # request itself, so match on timestamps rather than record order
+    replies = {}
+    for r in records:
+        if r.event == TX:
+            replies.setdefault((r.cxn_id, r.xid), []).append(r)
+
+    results = []
+    for req in records:
+        if req.event != RX or req.type in UNSOLICITED or not req.start:
+            continue
+        candidates = replies.get((req.cxn_id, req.xid), [])
+        for i, reply in enumerate(candidates):
+            if reply.timestamp >= req.start:
+                del candidates[i]
+                results.append((req, (reply.timestamp - req.start) / 1000.0))
+                break
+
+    if not results:
+        out.write("\nNo request/reply pairs\n")
+        return
+
+    out.write("\n%-4s %-10s %-24s %s\n" % ("cxn", "xid", "request",
+                                         "latency(us)"))
+    for req, us in results:
+        out.write("%-4d %-10d %-24s %.3f\n" % (req.cxn_id, req.xid,
+                                               req.type, us))
+
+    by_type = {}
+    for req, us in results:
+        by_type.setdefault(req.type, []).append(us)
+    out.write("\n%-24s %-8s %-12s %-12s %s\n" % ("request", "count",
+                                                 "min(us)", "avg(us)",
+                                                 "max(us)"))
+    for name in sorted(by_type):
+        v = by_type[name]
+        out.write("%-24s %-8d %-12.3f %-12.3f %.3f\n" %
+                  (name, len(v), min(v), sum(v) / len(v), max(v)))
+
+
+def main():
+    parser = optparse.OptionParser(usage="%prog [options] <trace file>")
+    parser.add_option("-l", "--latency-only", action="store_true",
+                      help="Only show request latencies")
+    opts, args = parser.parse_args()
+    if len(args) != 1:
+        parser.error("expected one trace file")
+
+    records = load(args[0])
+    if not opts.latency_only:
+        show(records, sys.stdout)
+    latency(records, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -43,6 +43,10 @@
 
 #define OK(op)  INDIGO_ASSERT((op) == INDIGO_ERROR_NONE)
 
+/* Defined in pktin_bench.c */
+int pktin_bench(int argc, char *argv[]);
+int pktin_bench_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj);
+
 void
 indigo_core_connection_count_notify(int new_count)
 {
@@ -133,9 +137,17 @@ void
 indigo_core_receive_controller_message(indigo_cxn_id_t cxn_id,
                                        of_object_t *obj)
 {
+    if (pktin_bench_controller_message(cxn_id, obj)) {
+        return;
+    }
     cxn_msg_rx(cxn_id, obj);
 }
 
+void
+indigo_core_receive_controller_flush(void)
+{
+}
+
 int main(int argc, char* argv[])
 {
     int cxn_id;
@@ -147,8 +159,18 @@ int main(int argc, char* argv[])
 
     OK(ind_cxn_init(&cm_config));
 
+    /* Not a test, see pktin_bench.c */
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        OK(ind_cxn_enable_set(1));
+        return pktin_bench(argc - 1, argv + 1);
+    }
+
     OK(indigo_cxn_status_change_register(cxn_status_change, NULL));
 
+    OK(ind_cxn_capture_start("/tmp/ofconnectionmanager_utest.cap"));
+    INDIGO_ASSERT(ind_cxn_capture_start("/tmp/ofconnectionmanager_utest.cap") ==
+                  INDIGO_ERROR_EXISTS);
+
     OK(ind_cxn_enable_set(1));
     INDIGO_ASSERT((cxn_id = setup_cxn()) >= 0);
 
@@ -165,6 +187,11 @@ int main(int argc, char* argv[])
 
     OK(indigo_cxn_connection_remove(cxn_id));
 
+    /* Whatever the connections exchanged is in the message trace */
+    ind_cxn_trace_show(&aim_pvs_stdout, 0);
+    OK(ind_cxn_trace_save("/tmp/ofconnectionmanager_utest.trace"));
+    ind_cxn_capture_stop();
+
     OK(ind_cxn_enable_set(0));
     OK(ind_cxn_finish());
 
@@ -0,0 +1,716 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Packet-in throughput and latency benchmark
+ *
+ * Not part of the unit test; run "utest_OFConnectionManager bench
+ * [OPTIONS] [RATE...]" or "make bench" in targets/utests/OFConnectionManager.
+ *
+ * An injector thread stands in for the switch CPU queue. It writes
+ * punted packets at a fixed rate into a datagram socket, the way
+ * ofdpaPktReceive is fed, and drops them when the socket is full. The
+ * event loop drains the socket as ind_ofdpa_pkt_receive does: each packet
+ * goes through a PIMU configured like the agent's packet-in rate limiter,
+ * is built into a packet-in in preallocated storage, and is handed to
+ * indigo_cxn_send_async_message_copy as indigo_core_packet_in_copy would. A
+ * controller thread reads the packet-ins off a real TCP connection.
+ *
+ * The packet carries its injection time, so latency covers the punt
+ * queue, the event loop, the connection output queue and TCP. Packets
+ * are counted where they are dropped: the punt queue, the rate limiter
+ * and the connection manager's packet-in throttling. Heap allocations
+ * per packet are counted where the C library allows it.
+ */
+
+#include <OFConnectionManager/ofconnectionmanager.h>
+#include <SocketManager/socketmanager.h>
+#include <indigo/of_connection_manager.h>
+#include <indigo/of_state_manager.h>
+#include <indigo/of_message.h>
+#include <AIM/aim.h>
+#include <pimu/pimu.h>
+#include <indigo/of_fast.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define BENCH_ETHERTYPE          0x88b5
+#define BENCH_MIN_SIZE           (14 + sizeof(bench_stamp_t))
+#define BENCH_MAX_SIZE           9216
+#define BENCH_DRAIN_US           500000
+
+/* Agent defaults for the PIMU flow cache, see ind_ofdpa_pktin_rl.c */
+#define BENCH_PIMU_BLOCK_SIZE    4
+#define BENCH_PIMU_ENTRIES       1024
+
+static const uint32_t bench_default_rates[] = { 1000, 10000, 50000, 100000, 200000 };
+
+/* What the OF-DPA packet socket gives the agent for a punted packet */
+typedef struct {
+    uint32_t in_port;
+    uint32_t reason;
+    uint32_t table_id;
+} bench_punt_t;
+
+/* Written into the payload by the injector */
+typedef struct {
+    uint64_t seq;
+    uint64_t sent_ns;
+} bench_stamp_t;
+
+static struct {
+    uint32_t duration_ms;
+    uint32_t size;
+    uint32_t ports;
+    uint32_t global_pps;
+    uint32_t port_pps;
+    int queue_bytes;
+    uint16_t batch;
+} bench_cfg = {
+    .duration_ms = 2000,
+    .size = 128,
+    .ports = 48,
+};
+
+/* Per run state */
+static int punt_fd[2] = { -1, -1 };
+static pimu_t *bench_pimu;
+static uint8_t bench_rx_buf[sizeof(bench_punt_t) + BENCH_MAX_SIZE];
+static of_object_storage_t bench_pkt_in_storage;
+static uint8_t bench_pkt_in_buf[BENCH_MAX_SIZE + 512];
+
+static volatile int injector_done;
+static uint32_t injector_rate;
+static uint64_t injected;
+static uint64_t queue_drops;
+
+static uint64_t drained;
+static uint64_t rl_drops;
+static uint64_t build_failures;
+
+static int controller_listen_fd = -1;
+static int controller_fd = -1;
+static volatile int controller_ready;
+static uint64_t delivered;
+static uint64_t *latency_us;
+static uint64_t latency_max;
+static uint64_t latency_count;
+
+/****************************************************************
+ * Allocation counting
+ ****************************************************************/
+
+static volatile int alloc_counting;
+static uint64_t alloc_count;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+#define ALLOC_COUNTED()                                                 \
+    do {                                                                \
+        if (alloc_counting) {                                           \
+            __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);      \
+        }                                                               \
+    } while (0)
+
+void *
+malloc(size_t size)
+{
+    ALLOC_COUNTED();
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    ALLOC_COUNTED();
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    ALLOC_COUNTED();
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+#define ALLOC_COUNT_SUPPORTED 1
+#else
+#define ALLOC_COUNT_SUPPORTED 0
+#endif
+
+static uint64_t
+bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/****************************************************************
+ * Injector: the switch CPU queue
+ ****************************************************************/
+
+static void *
+injector_main(void *arg)
+{
+    uint8_t pkt[sizeof(bench_punt_t) + BENCH_MAX_SIZE];
+    bench_punt_t *punt = (bench_punt_t *)pkt;
+    uint8_t *frame = pkt + sizeof(*punt);
+    bench_stamp_t stamp;
+    uint64_t start, now, due, seq = 0;
+    struct timespec pause = { 0, 20000 };
+
+    MEMSET(pkt, 0, sizeof(pkt));
+    MEMSET(frame, 0xff, 6);
+    frame[6] = 0x02;
+    frame[11] = 0x01;
+    frame[12] = BENCH_ETHERTYPE >> 8;
+    frame[13] = BENCH_ETHERTYPE & 0xff;
+
+    start = bench_now_ns();
+    for (;;) {
+        now = bench_now_ns();
+        if (now - start >= (uint64_t)bench_cfg.duration_ms * 1000000) {
+            break;
+        }
+
+        due = (now - start) * injector_rate / 1000000000;
+        if (seq >= due) {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        while (seq < due) {
+            punt->in_port = (seq % bench_cfg.ports) + 1;
+            punt->reason = 1;       /* OFDPA_PACKET_IN_REASON_ACTION */
+            punt->table_id = 60;    /* ACL policy */
+            stamp.seq = seq;
+            stamp.sent_ns = bench_now_ns();
+            MEMCPY(frame + 14, &stamp, sizeof(stamp));
+
+            if (send(punt_fd[1], pkt, sizeof(*punt) + bench_cfg.size,
+                     MSG_DONTWAIT) < 0) {
+                queue_drops++;
+            }
+            injected++;
+            seq++;
+        }
+    }
+
+    injector_done = 1;
+    return NULL;
+}
+
+/****************************************************************
+ * Agent side: drain the punt socket in the event loop
+ ****************************************************************/
+
+/* As ind_ofdpa_pkt_in_match_set: write the OF 1.3 in_port match directly */
+static void
+bench_packet_in_match_set(of_packet_in_t *obj, uint32_t in_port)
+{
+    of_wire_buffer_t *wbuf = OF_OBJECT_TO_WBUF(obj);
+    int offset = OF_OBJECT_ABSOLUTE_OFFSET(obj, 24);
+    uint8_t tlv[16];
+
+    memset(tlv, 0, sizeof(tlv));
+    buf_u16_set(tlv, OF_MATCH_TYPE_OXM);
+    buf_u16_set(tlv + 2, 12);
+    buf_u32_set(tlv + 4, 0x80000004);
+    buf_u32_set(tlv + 8, in_port);
+
+    /* Replaces the empty match, 4 bytes padded to 8 */
+    of_wire_buffer_replace_data(wbuf, offset, 8, tlv, sizeof(tlv));
+    of_object_parent_length_update(obj, sizeof(tlv) - 8);
+}
+
+/* As ind_ofdpa_fwd_pkt_in_build: build in the preallocated buffer */
+static of_packet_in_t *
+bench_packet_in_build(bench_punt_t *punt, uint8_t *data, int len)
+{
+    of_octets_t octets = { .data = data, .bytes = len };
+    of_packet_in_t *obj;
+
+    obj = indigo_of_message_new_preallocated(&bench_pkt_in_storage,
+                                             OF_PACKET_IN, OF_VERSION_1_3,
+                                             bench_pkt_in_buf,
+                                             sizeof(bench_pkt_in_buf));
+    if (obj == NULL) {
+        return NULL;
+    }
+
+    indigo_of_packet_in_fixed_set(obj, OF_BUFFER_ID_NO_BUFFER, len,
+                                  punt->reason, punt->table_id,
+                                  0xffffffffffffffffULL);
+    bench_packet_in_match_set(obj, punt->in_port);
+    if (of_packet_in_data_set(obj, &octets) != OF_ERROR_NONE) {
+        return NULL;
+    }
+
+    return obj;
+}
+
+static void
+punt_socket_ready(int socket_id, void *cookie,
+                  int read_ready, int write_ready, int error_seen)
+{
+    bench_punt_t *punt = (bench_punt_t *)bench_rx_buf;
+    uint8_t *frame = bench_rx_buf + sizeof(*punt);
+    of_packet_in_t *packet_in;
+    pimu_action_t action;
+    int gid;
+    ssize_t len;
+
+    while ((len = recv(socket_id, bench_rx_buf, sizeof(bench_rx_buf),
+                       MSG_DONTWAIT)) >= (ssize_t)sizeof(*punt)) {
+        drained++;
+        len -= sizeof(*punt);
+
+        if (bench_pimu != NULL) {
+            gid = punt->in_port < PIMU_CONFIG_GROUP_COUNT ? (int)punt->in_port : -1;
+            action = pimu_packet_in(bench_pimu, punt->in_port, gid, frame, len,
+                                    bench_now_ns() / 1000);
+            if (action == PIMU_ACTION_DROP) {
+                rl_drops++;
+                continue;
+            }
+        }
+
+        packet_in = bench_packet_in_build(punt, frame, len);
+        if (packet_in == NULL) {
+            build_failures++;
+            continue;
+        }
+
+        indigo_cxn_send_async_message_copy(packet_in);
+    }
+}
+
+/****************************************************************
+ * Controller side
+ ****************************************************************/
+
+static int
+controller_send(int fd, of_object_t *obj)
+{
+    int rv = 0;
+
+    if (send(fd, OF_OBJECT_TO_MESSAGE(obj), obj->length, MSG_NOSIGNAL) != obj->length) {
+        rv = -1;
+    }
+    of_object_delete(obj);
+    return rv;
+}
+
+/* Offset of the data in an OpenFlow 1.3 packet-in: 24 bytes of fixed
+   fields, the match padded to 8 bytes and 2 bytes of pad */
+static int
+packet_in_data_offset(const uint8_t *msg, int len)
+{
+    int match_len;
+
+    if (len < 28) {
+        return -1;
+    }
+    match_len = (msg[26] << 8) | msg[27];
+    return 24 + ((match_len + 7) & ~7) + 2;
+}
+
+static void
+controller_message(uint8_t *msg, int len)
+{
+    bench_stamp_t stamp;
+    uint64_t now;
+    int off;
+
+    switch (msg[1]) {
+    case 2:     /* echo request */
+        msg[1] = 3;
+        (void)send(controller_fd, msg, len, MSG_NOSIGNAL);
+        break;
+
+    case 4:     /* experimenter: a BSN packet-in batch */
+        if (len < 16 ||
+            ((msg[8] << 24) | (msg[9] << 16) | (msg[10] << 8) | msg[11]) !=
+                OF_EXPERIMENTER_ID_BSN ||
+            ((msg[12] << 24) | (msg[13] << 16) | (msg[14] << 8) | msg[15]) !=
+                INDIGO_CXN_BSN_PACKET_IN_BATCH_SUBTYPE) {
+            break;
+        }
+        for (off = 16; off + 8 <= len; off += (msg[off + 2] << 8) | msg[off + 3]) {
+            if (((msg[off + 2] << 8) | msg[off + 3]) < 8) {
+                break;
+            }
+            controller_message(msg + off, (msg[off + 2] << 8) | msg[off + 3]);
+        }
+        break;
+
+    case 10:    /* packet-in */
+        off = packet_in_data_offset(msg, len);
+        if (off < 0 || off + 14 + (int)sizeof(stamp) > len) {
+            break;
+        }
+        MEMCPY(&stamp, msg + off + 14, sizeof(stamp));
+        now = bench_now_ns();
+        delivered++;
+        if (latency_count < latency_max) {
+            latency_us[latency_count++] = (now - stamp.sent_ns) / 1000;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void *
+controller_main(void *arg)
+{
+    static uint8_t buf[1024 * 1024];
+    int fill = 0, off, msg_len, one = 1;
+    ssize_t n;
+
+    controller_fd = accept(controller_listen_fd, NULL, NULL);
+    if (controller_fd < 0) {
+        return NULL;
+    }
+    setsockopt(controller_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (controller_send(controller_fd, of_hello_new(OF_VERSION_1_3)) < 0 ||
+        controller_send(controller_fd, of_features_request_new(OF_VERSION_1_3)) < 0) {
+        return NULL;
+    }
+    controller_ready = 1;
+
+    while ((n = recv(controller_fd, buf + fill, sizeof(buf) - fill, 0)) > 0) {
+        fill += n;
+        off = 0;
+        while (fill - off >= 8) {
+            msg_len = (buf[off + 2] << 8) | buf[off + 3];
+            if (msg_len < 8 || fill - off < msg_len) {
+                break;
+            }
+            controller_message(buf + off, msg_len);
+            off += msg_len;
+        }
+        memmove(buf, buf + off, fill - off);
+        fill -= off;
+    }
+
+    return NULL;
+}
+
+/* Called for messages from the controller while the benchmark runs; only
+   the handshake needs an answer */
+int
+pktin_bench_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
+{
+    of_features_reply_t *reply;
+    uint32_t xid;
+
+    if (controller_listen_fd < 0) {
+        return 0;
+    }
+
+    if (obj->object_id == OF_FEATURES_REQUEST) {
+        of_features_request_xid_get(obj, &xid);
+        reply = of_features_reply_new(obj->version);
+        if (reply != NULL) {
+            of_features_reply_xid_set(reply, xid);
+            of_features_reply_datapath_id_set(reply, 1);
+            indigo_cxn_send_controller_message(cxn_id, reply);
+        }
+    }
+    return 1;
+}
+
+/****************************************************************
+ * Runs
+ ****************************************************************/
+
+static int
+bench_u64_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t
+bench_percentile(double percent)
+{
+    uint64_t idx;
+
+    if (latency_count == 0) {
+        return 0;
+    }
+    idx = (uint64_t)(latency_count * percent / 100);
+    return latency_us[idx < latency_count ? idx : latency_count - 1];
+}
+
+static uint32_t
+bench_burst(uint32_t pps)
+{
+    /* Same burst as the agent: a tenth of a second */
+    return pps >= 10 ? pps / 10 : 1;
+}
+
+static int
+bench_run(indigo_cxn_id_t cxn_id, uint32_t rate)
+{
+    pthread_t injector;
+    indigo_cxn_status_t status_before, status_after;
+    uint64_t end, allocs;
+    uint64_t cxn_drops, lost;
+    int i;
+
+    injected = queue_drops = drained = rl_drops = build_failures = 0;
+    delivered = latency_count = 0;
+    latency_max = (uint64_t)rate * bench_cfg.duration_ms / 1000 + 1;
+    latency_us = aim_zmalloc(latency_max * sizeof(*latency_us));
+
+    if (bench_cfg.global_pps != 0 || bench_cfg.port_pps != 0) {
+        bench_pimu = pimu_create(BENCH_PIMU_BLOCK_SIZE, BENCH_PIMU_ENTRIES);
+        pimu_global_pps_set(bench_pimu, bench_cfg.global_pps,
+                            bench_burst(bench_cfg.global_pps));
+        for (i = 0; i < PIMU_CONFIG_GROUP_COUNT; i++) {
+            pimu_group_pps_set(bench_pimu, i, bench_cfg.port_pps,
+                               bench_burst(bench_cfg.port_pps));
+        }
+    }
+
+    indigo_cxn_connection_status_get(cxn_id, &status_before);
+
+    injector_rate = rate;
+    injector_done = 0;
+    alloc_count = 0;
+    alloc_counting = 1;
+    if (pthread_create(&injector, NULL, injector_main, NULL) != 0) {
+        printf("Cannot start the injector\n");
+        return -1;
+    }
+
+    while (!injector_done) {
+        ind_soc_select_and_run(10);
+    }
+    pthread_join(injector, NULL);
+
+    /* Let the queues drain */
+    end = bench_now_ns() + (uint64_t)BENCH_DRAIN_US * 1000;
+    while (bench_now_ns() < end) {
+        ind_soc_select_and_run(10);
+    }
+    alloc_counting = 0;
+    allocs = alloc_count;
+
+    indigo_cxn_connection_status_get(cxn_id, &status_after);
+    cxn_drops = status_after.packet_in_drop - status_before.packet_in_drop;
+    lost = injected - queue_drops - rl_drops - build_failures - cxn_drops - delivered;
+
+    qsort(latency_us, latency_count, sizeof(*latency_us), bench_u64_cmp);
+
+    printf("%8u %9"PRIu64" %8"PRIu64" %8"PRIu64" %8"PRIu64" %8"PRIu64" %9"PRIu64" %9.0f %8"PRIu64" %8"PRIu64" %8"PRIu64,
+           rate, injected, queue_drops, rl_drops, cxn_drops, lost, delivered,
+           delivered * 1000.0 / bench_cfg.duration_ms,
+           bench_percentile(50), bench_percentile(99),
+           latency_count ? latency_us[latency_count - 1] : 0);
+    if (ALLOC_COUNT_SUPPORTED && drained != 0) {
+        printf(" %8.2f", (double)allocs / drained);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    aim_free(latency_us);
+    latency_us = NULL;
+    if (bench_pimu != NULL) {
+        pimu_destroy(bench_pimu);
+        bench_pimu = NULL;
+    }
+
+    return 0;
+}
+
+static int
+bench_setup(indigo_cxn_id_t *cxn_id)
+{
+    indigo_cxn_protocol_params_t proto;
+    indigo_cxn_config_params_t config;
+    indigo_cxn_status_t status;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    pthread_t controller;
+    uint64_t deadline;
+    int one = 1;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, punt_fd) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+    if (bench_cfg.queue_bytes != 0) {
+        setsockopt(punt_fd[1], SOL_SOCKET, SO_SNDBUF,
+                   &bench_cfg.queue_bytes, sizeof(bench_cfg.queue_bytes));
+    }
+    fcntl(punt_fd[0], F_SETFL, O_NONBLOCK);
+    if (ind_soc_socket_register(punt_fd[0], punt_socket_ready, NULL) < 0) {
+        printf("Cannot register the punt socket\n");
+        return -1;
+    }
+
+    controller_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(controller_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    MEMSET(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(controller_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(controller_listen_fd, 1) < 0 ||
+        getsockname(controller_listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        perror("controller socket");
+        return -1;
+    }
+    if (pthread_create(&controller, NULL, controller_main, NULL) != 0) {
+        printf("Cannot start the controller\n");
+        return -1;
+    }
+    pthread_detach(controller);
+
+    MEMSET(&proto, 0, sizeof(proto));
+    MEMSET(&config, 0, sizeof(config));
+    config.version = OF_VERSION_1_3;
+    config.packet_in_batch_max = bench_cfg.batch;
+    proto.tcp_over_ipv4.protocol = INDIGO_CXN_PROTO_TCP_OVER_IPV4;
+    sprintf(proto.tcp_over_ipv4.controller_ip, "127.0.0.1");
+    proto.tcp_over_ipv4.controller_port = ntohs(addr.sin_port);
+    if (indigo_cxn_connection_add(&proto, &config, cxn_id) < 0) {
+        printf("Cannot add the controller connection\n");
+        return -1;
+    }
+
+    deadline = bench_now_ns() + 5000000000ULL;
+    do {
+        ind_soc_select_and_run(10);
+        indigo_cxn_connection_status_get(*cxn_id, &status);
+        if (bench_now_ns() > deadline) {
+            printf("Controller handshake did not complete\n");
+            return -1;
+        }
+    } while (status.state != INDIGO_CXN_S_HANDSHAKE_COMPLETE);
+
+    return 0;
+}
+
+/**
+ * Run the benchmark at each rate after the options in argv, in packets
+ * per second, or at 1k, 10k, 50k, 100k and 200k pps. argv[0] is the
+ * "bench" command.
+ *
+ * -d MSEC   injection time per rate (default 2000)
+ * -s BYTES  punted frame size (default 128)
+ * -p PORTS  ports the packets are spread over (default 48)
+ * -g PPS    switch-wide rate limit, as ofagentapp --pktinpps
+ * -P PPS    per port rate limit, as ofagentapp --pktinportpps
+ * -q BYTES  punt queue size in bytes (default: the socket default)
+ * -b COUNT  packet-ins per BSN packet-in batch message (default 0, none)
+ */
+int
+pktin_bench(int argc, char *argv[])
+{
+    indigo_cxn_id_t cxn_id;
+    int opt, i, rate, rv = 0;
+
+    optind = 0;
+    while ((opt = getopt(argc, argv, "d:s:p:g:P:q:b:")) != -1) {
+        switch (opt) {
+        case 'd': bench_cfg.duration_ms = strtoul(optarg, NULL, 0); break;
+        case 's': bench_cfg.size = strtoul(optarg, NULL, 0); break;
+        case 'p': bench_cfg.ports = strtoul(optarg, NULL, 0); break;
+        case 'g': bench_cfg.global_pps = strtoul(optarg, NULL, 0); break;
+        case 'P': bench_cfg.port_pps = strtoul(optarg, NULL, 0); break;
+        case 'q': bench_cfg.queue_bytes = strtoul(optarg, NULL, 0); break;
+        case 'b': bench_cfg.batch = strtoul(optarg, NULL, 0); break;
+        default:
+            printf("Bad option\n");
+            return 1;
+        }
+    }
+    if (bench_cfg.size < BENCH_MIN_SIZE || bench_cfg.size > BENCH_MAX_SIZE ||
+        bench_cfg.ports == 0 || bench_cfg.duration_ms == 0) {
+        printf("Frame size must be %d to %d bytes, ports and duration nonzero\n",
+               (int)BENCH_MIN_SIZE, BENCH_MAX_SIZE);
+        return 1;
+    }
+
+    if (bench_setup(&cxn_id) < 0) {
+        return 1;
+    }
+
+    printf("%u byte frames over %u ports, %u ms per rate, rate limit %u pps global %u pps per port, %u packet-ins per batch\n",
+           bench_cfg.size, bench_cfg.ports, bench_cfg.duration_ms,
+           bench_cfg.global_pps, bench_cfg.port_pps, bench_cfg.batch);
+    printf("%8s %9s %8s %8s %8s %8s %9s %9s %8s %8s %8s%s\n",
+           "rate", "injected", "queue", "ratelim", "cxn", "lost", "delivered",
+           "pps", "p50 us", "p99 us", "max us",
+           ALLOC_COUNT_SUPPORTED ? "  allocs" : "");
+
+    if (optind >= argc) {
+        for (i = 0; i < AIM_ARRAYSIZE(bench_default_rates); i++) {
+            rv |= bench_run(cxn_id, bench_default_rates[i]);
+        }
+    } else {
+        for (i = optind; i < argc; i++) {
+            rate = atoi(argv[i]);
+            if (rate <= 0) {
+                printf("Bad rate %s\n", argv[i]);
+                return 1;
+            }
+            rv |= bench_run(cxn_id, rate);
+        }
+    }
+
+    indigo_cxn_connection_remove(cxn_id);
+    ind_soc_socket_unregister(punt_fd[0]);
+    close(punt_fd[0]);
+    close(punt_fd[1]);
+    close(controller_listen_fd);
+    controller_listen_fd = -1;
+
+    return rv < 0 ? 1 : 0;
+}
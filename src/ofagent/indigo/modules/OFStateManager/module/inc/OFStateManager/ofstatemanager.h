@@ -47,11 +47,29 @@
 #define IND_CORE_DP_DESC_DEFAULT "Virtual forwarding module"
 #define IND_CORE_SERIAL_NUM_DEFAULT "11235813213455"
 
+/**
+ * @brief BSN flow stats request flag: reply with only the flows whose
+ * counters changed since the previous such request on the connection
+ *
+ * The first such request on a connection gets every matching flow.
+ */
+
+#define IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED 0x8000
+
 typedef struct ind_core_config_s {
     int expire_flows;   /**< Boolean, should state mgr manage flow expires */
+    int hardware_expiry; /**< Boolean, forwarding ages flows instead; see
+                              indigo_core_flow_removed_batch */
     int stats_check_ms; /**< How frequently to check stats for expire, etc */
     indigo_core_disconnected_mode_t disconnected_mode;
     int max_flowtable_entries; /**< Maximum number of entries in the flowtable */
+    int cookie_index_shift; /**< Lowest cookie bit of the cookie range index */
+    int cookie_index_bits;  /**< Width of the cookie range index, 0 for none */
+    int content_checksums;  /**< Boolean, checksum flows by contents, not cookie */
+    int lpm_table_id;       /**< Table indexed by destination prefix, 0 for none */
+    int l2_table_id;        /**< Table indexed by VLAN ID and egress, 0 for none */
+    int stats_threads;      /**< Threads that help encode flow stats replies,
+                                 0 to encode them on the event loop only */
 } ind_core_config_t;
 
 
@@ -95,23 +113,153 @@ indigo_error_t ind_core_mfr_desc_get(of_desc_str_t desc);
 indigo_error_t ind_core_serial_num_set(of_serial_num_t serial_num);
 indigo_error_t ind_core_serial_num_get(of_serial_num_t serial_num);
 
+/**
+ * @brief Flow and group mod bundles
+ * @param cxn_id Connection the bundle belongs to
+ * @param bundle_id Controller assigned bundle ID
+ *
+ * While a bundle is open, flow and group mods received on the connection
+ * are staged. Commit validates the staged group mods and applies the
+ * whole bundle, groups before the flows that use them; a bundle that
+ * fails validation is discarded without applying anything. Discard drops
+ * the staged messages. One bundle can be open per connection, and it is
+ * discarded when the connection closes.
+ *
+ * Controllers reach the same bundles through the ONF bundle extension
+ * messages, which stage only the messages added to the bundle.
+ */
+
+indigo_error_t ind_core_bundle_open(indigo_cxn_id_t cxn_id, uint32_t bundle_id);
+indigo_error_t ind_core_bundle_commit(indigo_cxn_id_t cxn_id, uint32_t bundle_id);
+indigo_error_t ind_core_bundle_discard(indigo_cxn_id_t cxn_id, uint32_t bundle_id);
+
+/**
+ * @brief Warm restart
+ * @param filename Checkpoint file
+ *
+ * ind_core_warm_save writes the groups, meters and flows to a checkpoint,
+ * for example on shutdown. ind_core_warm_restore, called after
+ * ind_core_init and before any controller connects, reads the checkpoint
+ * back without reprogramming Forwarding, keeping the flow IDs and
+ * cookies, and removes the file. Only indigo_fwd_group_restore,
+ * indigo_fwd_meter_restore and indigo_fwd_flow_restore are called, so
+ * Forwarding can check each object is still installed as saved.
+ *
+ * A controller adding an object identical to a restored one leaves the
+ * installed object untouched. A different one replaces it as usual.
+ * Restored objects not added again within
+ * OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS of the first controller
+ * connecting, or by the time ind_core_warm_reconcile_end is called, are
+ * deleted.
+ */
+
+indigo_error_t ind_core_warm_save(const char *filename);
+indigo_error_t ind_core_warm_restore(const char *filename);
+void ind_core_warm_reconcile_end(void);
+
 /**
  * Dump all entries in the flow table.
- * This is verbose.
+ * This is verbose, and blocks until the whole table is written; see
+ * ind_core_ft_dump_start.
  */
 void ind_core_ft_dump(aim_pvs_t* pvs);
 
 /**
  * Show all entries in the flow table.
- * Human readable.
+ * Human readable. Blocks like ind_core_ft_dump.
  */
 void ind_core_ft_show(aim_pvs_t* pvs);
 
+/**
+ * Output formats of ind_core_ft_dump_start
+ */
+typedef enum ind_core_ft_dump_format_e {
+    IND_CORE_FT_DUMP_VERBOSE,   /**< As ind_core_ft_dump */
+    IND_CORE_FT_DUMP_SHOW,      /**< As ind_core_ft_show */
+    IND_CORE_FT_DUMP_COMPACT,   /**< One line per flow without the effects:
+                                     id table priority cookie idle/hard match */
+} ind_core_ft_dump_format_t;
+
+/**
+ * Flows written by ind_core_ft_dump_start
+ */
+typedef struct ind_core_ft_dump_filter_s {
+    int table_id;           /**< -1 for every table */
+    uint64_t cookie;
+    uint64_t cookie_mask;   /**< 0 for every cookie */
+    int priority;           /**< -1 for every priority */
+} ind_core_ft_dump_filter_t;
+
+/**
+ * Called when a flow table dump is complete
+ * @param cookie The cookie passed to ind_core_ft_dump_start
+ * @param count The number of flows written
+ */
+typedef void (*ind_core_ft_dump_done_f)(void *cookie, int count);
+
+/**
+ * Write the flow table from a SocketManager task
+ * @param pvs Output, which must stay valid until done is called
+ * @param format See ind_core_ft_dump_format_t
+ * @param filter The flows to write, or NULL for all of them
+ * @param done Called when the dump is complete, or NULL
+ * @param cookie Passed to done
+ *
+ * The flows are written as the task goes, in chunks of
+ * AIM_PVS_CHUNKED_DEFAULT_SIZE bytes, and the task yields to other
+ * events between them, so a large table does not stall the event loop.
+ * All output is written by the time done is called.
+ * A table, cookie or priority filter walks the matching flow table
+ * index rather than the whole table. Flows added or removed during the
+ * dump may or may not be written.
+ */
+indigo_error_t ind_core_ft_dump_start(aim_pvs_t *pvs,
+                                      ind_core_ft_dump_format_t format,
+                                      const ind_core_ft_dump_filter_t *filter,
+                                      ind_core_ft_dump_done_f done,
+                                      void *cookie);
+
+/**
+ * Called when ind_core_clear_all is complete
+ * @param cookie The cookie passed to ind_core_clear_all
+ * @param flows The number of flows deleted
+ * @param rv INDIGO_ERROR_NONE if no group is left
+ */
+typedef void (*ind_core_clear_all_done_f)(void *cookie, int flows,
+                                          indigo_error_t rv);
+
+/**
+ * Delete every flow and group from a SocketManager task
+ * @param done Called when the flows and groups are deleted, or NULL
+ * @param cookie Passed to done
+ *
+ * The flows are deleted in batches through indigo_fwd_flow_delete_batch,
+ * a table at a time in descending table ID order, as a flow delete
+ * matching everything would, and flow removed messages are sent as
+ * usual. The groups are then deleted once each, referencing groups
+ * before the groups they reference.
+ */
+indigo_error_t ind_core_clear_all(ind_core_clear_all_done_f done,
+                                  void *cookie);
+
 /**
  * Show basic stats about a flow table
  */
 void ind_core_ft_stats(aim_pvs_t* pvs);
 
+/**
+ * Show the handler latency of each message type
+ */
+void ind_core_message_stats_show(aim_pvs_t* pvs);
+
+/**
+ * Write the state manager counters, handler latency histograms and
+ * memory accounting in OpenMetrics text format
+ *
+ * Only counters are read; the flow table is not walked.
+ */
+void ind_core_metrics_write(aim_pvs_t* pvs);
+
 #ifdef OFDPA_FIXUP
 /**
  * Handles flow expiry that occured in the datapath.
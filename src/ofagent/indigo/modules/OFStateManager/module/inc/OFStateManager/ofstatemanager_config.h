@@ -119,6 +119,66 @@
 #define OFSTATEMANAGER_CONFIG_DPID_DEFAULT 55930
 #endif
 
+/**
+ * OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX
+ *
+ * Maximum number of flow adds collected before they are submitted to the forwarding layer. 0 disables batching. */
+
+
+#ifndef OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX
+#define OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX 256
+#endif
+
+/**
+ * OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX
+ *
+ * Maximum number of consecutive packet-outs collected before they are submitted to the forwarding layer. The packet data is not copied, so the connection manager must call indigo_core_receive_controller_flush before reusing its read buffer. 0 disables batching. */
+
+
+#ifndef OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX
+#define OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX 64
+#endif
+
+/**
+ * OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP
+ *
+ * Resolve packet-outs to OFPP_TABLE with a software lookup of the flow table where possible. */
+
+
+#ifndef OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP
+#define OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP 1
+#endif
+
+/**
+ * OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS
+ *
+ * Time after the first controller connects following a warm restart after which restored state the controller has not re-added is deleted. */
+
+
+#ifndef OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS
+#define OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS 60000
+#endif
+
+/**
+ * OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX
+ *
+ * Number of flow-mod errors sent to a controller in a burst of failures. Further errors are counted and reported in a single experimenter error message once the burst is over. 0 sends every error. */
+
+
+#ifndef OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX
+#define OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX 32
+#endif
+
+/**
+ * OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS
+ *
+ * Keep the flows of each table in a flow table instance of its own, so that writers of different tables share no lists or hash buckets. 0 keeps the flows of all tables in a single instance. */
+
+
+#ifndef OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS
+#define OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS 1
+#endif
+
 
 
 /**
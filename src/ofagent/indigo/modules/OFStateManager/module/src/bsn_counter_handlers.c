@@ -19,7 +19,7 @@
 
 /**
  * @file
- * @brief OpenFlow message handlers for BSN port/VLAN stats messages
+ * @brief OpenFlow message handlers for BSN port/VLAN/debug counter stats messages
  */
 
 #include "ofstatemanager_log.h"
@@ -28,12 +28,24 @@
 #include <indigo/indigo.h>
 #include <indigo/forwarding.h>
 #include <indigo/port_manager.h>
+#include <indigo/of_state_manager.h>
 #include <loci/loci.h>
 #include "handlers.h"
 
 /* TODO move into LOXI */
 #define OF_BSN_VLAN_ALL 0xffff
 
+#define MAX_DEBUG_COUNTERS 256
+
+struct indigo_core_debug_counter_s {
+    uint64_t counter_id;
+    of_str64_t name;
+    of_desc_str_t description;
+    const uint64_t *value;
+};
+
+static indigo_core_debug_counter_t *debug_counters[MAX_DEBUG_COUNTERS];
+
 static void
 append_uint64(of_list_uint64_t *list, uint64_t value)
 {
@@ -84,6 +96,7 @@ ind_core_bsn_vlan_counter_stats_request_handler(of_object_t *_obj,
     of_bsn_vlan_counter_stats_reply_t *reply;
     of_list_bsn_vlan_counter_stats_entry_t entries;
     of_bsn_vlan_counter_stats_entry_t *entry;
+    aim_bitmap4096_t active;
     uint32_t xid;
     uint16_t vlan_vid;
 
@@ -108,7 +121,17 @@ ind_core_bsn_vlan_counter_stats_request_handler(of_object_t *_obj,
     AIM_TRUE_OR_DIE(entry != NULL);
 
     if (vlan_vid == OF_BSN_VLAN_ALL) {
+        /* Only report the VLANs the forwarding module has counters for */
+        AIM_BITMAP_INIT(&active, 4095);
+        if (indigo_fwd_vlan_active_get(&active.hdr) != INDIGO_ERROR_NONE) {
+            aim_bitmap_set_all(&active.hdr);
+        }
+
         for (vlan_vid = 1; vlan_vid < 4096; vlan_vid++) {
+            if (!aim_bitmap_get(&active.hdr, vlan_vid)) {
+                continue;
+            }
+
             ind_core_bsn_vlan_counter_stats_entry_populate(entry, vlan_vid);
 
             if (of_list_append(&entries, entry) < 0) {
@@ -247,3 +270,158 @@ ind_core_bsn_port_counter_stats_request_handler(of_object_t *_obj,
 
     indigo_cxn_send_controller_message(cxn_id, reply);
 }
+
+/*
+ * Debug counters
+ *
+ * The counter ID is the registry slot plus one, so it is stable while the
+ * counter stays registered.
+ */
+
+indigo_error_t
+indigo_core_debug_counter_register(const char *name,
+                                   const char *description,
+                                   const uint64_t *value,
+                                   indigo_core_debug_counter_t **counter)
+{
+    indigo_core_debug_counter_t *c;
+    int i;
+
+    for (i = 0; i < MAX_DEBUG_COUNTERS; i++) {
+        if (debug_counters[i] == NULL) {
+            break;
+        }
+    }
+
+    if (i == MAX_DEBUG_COUNTERS) {
+        AIM_LOG_ERROR("Too many debug counters, not registering \"%s\"", name);
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    c = aim_zmalloc(sizeof(*c));
+    c->counter_id = i + 1;
+    strncpy(c->name, name, sizeof(c->name) - 1);
+    strncpy(c->description, description, sizeof(c->description) - 1);
+    c->value = value;
+
+    debug_counters[i] = c;
+    *counter = c;
+    return INDIGO_ERROR_NONE;
+}
+
+void
+indigo_core_debug_counter_unregister(indigo_core_debug_counter_t *counter)
+{
+    AIM_TRUE_OR_DIE(debug_counters[counter->counter_id - 1] == counter);
+    debug_counters[counter->counter_id - 1] = NULL;
+    aim_free(counter);
+}
+
+void
+ind_core_bsn_debug_counter_desc_stats_request_handler(of_object_t *_obj,
+                                                      indigo_cxn_id_t cxn_id)
+{
+    of_bsn_debug_counter_desc_stats_request_t *obj = _obj;
+    of_bsn_debug_counter_desc_stats_reply_t *reply;
+    of_list_bsn_debug_counter_desc_stats_entry_t entries;
+    of_bsn_debug_counter_desc_stats_entry_t *entry;
+    uint32_t xid;
+    int i;
+
+    reply = of_bsn_debug_counter_desc_stats_reply_new(obj->version);
+    AIM_TRUE_OR_DIE(reply != NULL);
+
+    of_bsn_debug_counter_desc_stats_request_xid_get(obj, &xid);
+    of_bsn_debug_counter_desc_stats_reply_xid_set(reply, xid);
+    of_bsn_debug_counter_desc_stats_reply_entries_bind(reply, &entries);
+
+    entry = of_bsn_debug_counter_desc_stats_entry_new(entries.version);
+    AIM_TRUE_OR_DIE(entry != NULL);
+
+    for (i = 0; i < MAX_DEBUG_COUNTERS; i++) {
+        indigo_core_debug_counter_t *counter = debug_counters[i];
+        if (counter == NULL) {
+            continue;
+        }
+
+        of_bsn_debug_counter_desc_stats_entry_counter_id_set(entry, counter->counter_id);
+        of_bsn_debug_counter_desc_stats_entry_name_set(entry, counter->name);
+        of_bsn_debug_counter_desc_stats_entry_description_set(entry, counter->description);
+
+        if (of_list_append(&entries, entry) < 0) {
+            /* This entry didn't fit, send out the current message and
+             * allocate a new one. */
+            of_bsn_debug_counter_desc_stats_reply_flags_set(
+                reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+            indigo_cxn_send_controller_message(cxn_id, reply);
+
+            reply = of_bsn_debug_counter_desc_stats_reply_new(obj->version);
+            AIM_TRUE_OR_DIE(reply != NULL);
+
+            of_bsn_debug_counter_desc_stats_reply_xid_set(reply, xid);
+            of_bsn_debug_counter_desc_stats_reply_entries_bind(reply, &entries);
+
+            if (of_list_append(&entries, entry) < 0) {
+                AIM_DIE("unexpected failure appending single bsn_debug_counter_desc stats entry");
+            }
+        }
+    }
+
+    of_object_delete(entry);
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+void
+ind_core_bsn_debug_counter_stats_request_handler(of_object_t *_obj,
+                                                 indigo_cxn_id_t cxn_id)
+{
+    of_bsn_debug_counter_stats_request_t *obj = _obj;
+    of_bsn_debug_counter_stats_reply_t *reply;
+    of_list_bsn_debug_counter_stats_entry_t entries;
+    of_bsn_debug_counter_stats_entry_t *entry;
+    uint32_t xid;
+    int i;
+
+    reply = of_bsn_debug_counter_stats_reply_new(obj->version);
+    AIM_TRUE_OR_DIE(reply != NULL);
+
+    of_bsn_debug_counter_stats_request_xid_get(obj, &xid);
+    of_bsn_debug_counter_stats_reply_xid_set(reply, xid);
+    of_bsn_debug_counter_stats_reply_entries_bind(reply, &entries);
+
+    entry = of_bsn_debug_counter_stats_entry_new(entries.version);
+    AIM_TRUE_OR_DIE(entry != NULL);
+
+    for (i = 0; i < MAX_DEBUG_COUNTERS; i++) {
+        indigo_core_debug_counter_t *counter = debug_counters[i];
+        if (counter == NULL) {
+            continue;
+        }
+
+        of_bsn_debug_counter_stats_entry_counter_id_set(entry, counter->counter_id);
+        of_bsn_debug_counter_stats_entry_value_set(entry, *counter->value);
+
+        if (of_list_append(&entries, entry) < 0) {
+            /* This entry didn't fit, send out the current message and
+             * allocate a new one. */
+            of_bsn_debug_counter_stats_reply_flags_set(
+                reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+            indigo_cxn_send_controller_message(cxn_id, reply);
+
+            reply = of_bsn_debug_counter_stats_reply_new(obj->version);
+            AIM_TRUE_OR_DIE(reply != NULL);
+
+            of_bsn_debug_counter_stats_reply_xid_set(reply, xid);
+            of_bsn_debug_counter_stats_reply_entries_bind(reply, &entries);
+
+            if (of_list_append(&entries, entry) < 0) {
+                AIM_DIE("unexpected failure appending single bsn_debug_counter stats entry");
+            }
+        }
+    }
+
+    of_object_delete(entry);
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
@@ -0,0 +1,597 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Flow, group and gentable mod bundles
+ *
+ * While a bundle is open on a connection, the flow and group mods and
+ * gentable entry adds and deletes received on it are staged instead of
+ * applied. Commit checks the staged group mods against the group table,
+ * then applies the group adds and modifies, the flow mods in the order
+ * received and finally the group deletes, so a flow never refers to a
+ * group that does not exist yet. The flow adds go through the batched
+ * flow add path. The gentable messages are applied in batches, in the
+ * order received, between the flow mods and the group deletes.
+ *
+ * A validation failure rejects the whole bundle before anything is
+ * applied. Errors from the forwarding layer while applying are reported
+ * per message, as they would be outside a bundle; messages already
+ * applied are not rolled back.
+ *
+ * Controllers use the OpenFlow 1.3 bundle extension (ONF EXT-230), whose
+ * control and add messages LOCI decodes as plain experimenter messages.
+ * A bundle opened that way holds only the messages added to it; other
+ * messages on the connection are applied as they arrive.
+ */
+
+#include "ofstatemanager_log.h"
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <OFStateManager/ofstatemanager.h>
+#include <indigo/indigo.h>
+#include <indigo/of_state_manager.h>
+#include <indigo/of_message.h>
+#include <loci/loci.h>
+#include "ofstatemanager_decs.h"
+#include "ofstatemanager_int.h"
+#include "handlers.h"
+#include <AIM/aim_list.h>
+
+typedef struct ind_core_bundle_s {
+    list_links_t links;
+    indigo_cxn_id_t cxn_id;
+    uint32_t bundle_id;
+    bool failed;                /* A message could not be staged */
+    bool onf;                   /* Opened by an ONF bundle control */
+    bool closed;                /* Closed by an ONF bundle control */
+    int count;
+    int allocated;
+    of_object_t **msgs;
+} ind_core_bundle_t;
+
+static LIST_DEFINE(ind_core_bundles);
+
+static ind_core_bundle_t *
+bundle_find(indigo_cxn_id_t cxn_id)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(&ind_core_bundles, cur) {
+        ind_core_bundle_t *bundle = container_of(cur, links, ind_core_bundle_t);
+        if (bundle->cxn_id == cxn_id) {
+            return bundle;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+bundle_free(ind_core_bundle_t *bundle)
+{
+    int i;
+
+    list_remove(&bundle->links);
+    for (i = 0; i < bundle->count; i++) {
+        of_object_delete(bundle->msgs[i]);
+    }
+    aim_free(bundle->msgs);
+    aim_free(bundle);
+}
+
+static bool
+bundle_is_group_mod(of_object_t *obj)
+{
+    return obj->object_id == OF_GROUP_ADD ||
+        obj->object_id == OF_GROUP_MODIFY ||
+        obj->object_id == OF_GROUP_DELETE;
+}
+
+static bool
+bundle_is_flow_mod(of_object_t *obj)
+{
+    return obj->object_id == OF_FLOW_ADD ||
+        obj->object_id == OF_FLOW_MODIFY ||
+        obj->object_id == OF_FLOW_MODIFY_STRICT ||
+        obj->object_id == OF_FLOW_DELETE ||
+        obj->object_id == OF_FLOW_DELETE_STRICT;
+}
+
+static bool
+bundle_is_gentable_mod(of_object_t *obj)
+{
+    return obj->object_id == OF_BSN_GENTABLE_ENTRY_ADD ||
+        obj->object_id == OF_BSN_GENTABLE_ENTRY_DELETE;
+}
+
+static uint32_t
+bundle_group_id(of_object_t *obj)
+{
+    uint32_t id;
+
+    of_group_mod_group_id_get(obj, &id);
+    return id;
+}
+
+/*
+ * Check the staged group mod at 'idx' against the group table and the
+ * group mods staged before it. Returns 0 or an OFPGMFC code.
+ */
+static uint16_t
+bundle_group_check(ind_core_bundle_t *bundle, int idx)
+{
+    of_object_t *obj = bundle->msgs[idx];
+    uint32_t id = bundle_group_id(obj);
+    bool exists;
+    int i;
+
+    if (obj->object_id == OF_GROUP_DELETE) {
+        /* The group delete handler reports anything else */
+        return 0;
+    }
+
+    if (id > OF_GROUP_MAX) {
+        return OF_GROUP_MOD_FAILED_INVALID_GROUP;
+    }
+
+    exists = ind_core_group_exists(id);
+    for (i = 0; i < idx; i++) {
+        of_object_t *prev = bundle->msgs[i];
+        if (!bundle_is_group_mod(prev)) {
+            continue;
+        }
+        if (prev->object_id == OF_GROUP_DELETE) {
+            /* Deletes are applied last, after this add or modify */
+            if (bundle_group_id(prev) == id ||
+                    bundle_group_id(prev) == OF_GROUP_ALL) {
+                return OF_GROUP_MOD_FAILED_EPERM;
+            }
+        } else if (prev->object_id == OF_GROUP_ADD &&
+                   bundle_group_id(prev) == id) {
+            exists = true;
+        }
+    }
+
+    if (obj->object_id == OF_GROUP_ADD && exists) {
+        return OF_GROUP_MOD_FAILED_GROUP_EXISTS;
+    } else if (obj->object_id == OF_GROUP_MODIFY && !exists) {
+        return OF_GROUP_MOD_FAILED_UNKNOWN_GROUP;
+    }
+
+    return 0;
+}
+
+static bool
+bundle_is_stageable(of_object_t *obj)
+{
+    return bundle_is_flow_mod(obj) || bundle_is_group_mod(obj) ||
+        bundle_is_gentable_mod(obj);
+}
+
+/* Takes ownership of obj */
+static void
+bundle_append(ind_core_bundle_t *bundle, of_object_t *obj)
+{
+    if (bundle->failed) {
+        of_object_delete(obj);
+        return;
+    }
+
+    if (bundle->count == bundle->allocated) {
+        int allocated = bundle->allocated ? bundle->allocated * 2 : 64;
+        of_object_t **msgs = aim_realloc(bundle->msgs,
+                                         allocated * sizeof(*msgs));
+        if (msgs == NULL) {
+            LOG_ERROR("Failed to grow bundle %u", bundle->bundle_id);
+            bundle->failed = true;
+            of_object_delete(obj);
+            return;
+        }
+        bundle->msgs = msgs;
+        bundle->allocated = allocated;
+    }
+
+    bundle->msgs[bundle->count++] = obj;
+}
+
+bool
+ind_core_bundle_stage(indigo_cxn_id_t cxn_id, of_object_t *obj)
+{
+    ind_core_bundle_t *bundle;
+    of_object_t *dup;
+
+    if (list_empty(&ind_core_bundles) || !bundle_is_stageable(obj)) {
+        return false;
+    }
+
+    if ((bundle = bundle_find(cxn_id)) == NULL || bundle->onf) {
+        return false;
+    }
+
+    if (bundle->failed) {
+        return true;
+    }
+
+    if ((dup = of_object_dup(obj)) == NULL) {
+        LOG_ERROR("Failed to stage %s in bundle %u",
+                  of_object_id_str[obj->object_id], bundle->bundle_id);
+        bundle->failed = true;
+        return true;
+    }
+
+    bundle_append(bundle, dup);
+
+    return true;
+}
+
+indigo_error_t
+ind_core_bundle_open(indigo_cxn_id_t cxn_id, uint32_t bundle_id)
+{
+    ind_core_bundle_t *bundle;
+
+    if (bundle_find(cxn_id) != NULL) {
+        return INDIGO_ERROR_EXISTS;
+    }
+
+    bundle = aim_zmalloc(sizeof(*bundle));
+    bundle->cxn_id = cxn_id;
+    bundle->bundle_id = bundle_id;
+    list_push(&ind_core_bundles, &bundle->links);
+
+    LOG_VERBOSE("Opened bundle %u on cxn %d", bundle_id, cxn_id);
+
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+ind_core_bundle_discard(indigo_cxn_id_t cxn_id, uint32_t bundle_id)
+{
+    ind_core_bundle_t *bundle = bundle_find(cxn_id);
+
+    if (bundle == NULL || bundle->bundle_id != bundle_id) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    LOG_VERBOSE("Discarding bundle %u on cxn %d, %d messages",
+                bundle_id, cxn_id, bundle->count);
+    bundle_free(bundle);
+
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+ind_core_bundle_commit(indigo_cxn_id_t cxn_id, uint32_t bundle_id)
+{
+    ind_core_bundle_t *bundle = bundle_find(cxn_id);
+    uint16_t err_code;
+    int i;
+
+    if (bundle == NULL || bundle->bundle_id != bundle_id) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    if (bundle->failed) {
+        LOG_ERROR("Bundle %u on cxn %d is incomplete, discarding",
+                  bundle_id, cxn_id);
+        bundle_free(bundle);
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    for (i = 0; i < bundle->count; i++) {
+        if (!bundle_is_group_mod(bundle->msgs[i])) {
+            continue;
+        }
+        if ((err_code = bundle_group_check(bundle, i)) != 0) {
+            LOG_VERBOSE("Rejecting bundle %u on cxn %d", bundle_id, cxn_id);
+            indigo_cxn_send_error_reply(cxn_id, bundle->msgs[i],
+                                        OF_ERROR_TYPE_GROUP_MOD_FAILED,
+                                        err_code);
+            bundle_free(bundle);
+            return INDIGO_ERROR_PARAM;
+        }
+    }
+
+    LOG_VERBOSE("Committing bundle %u on cxn %d, %d messages",
+                bundle_id, cxn_id, bundle->count);
+
+    /* Groups first, so the flows can refer to them */
+    for (i = 0; i < bundle->count; i++) {
+        of_object_t *obj = bundle->msgs[i];
+        if (bundle_is_group_mod(obj) && obj->object_id != OF_GROUP_DELETE) {
+            ind_core_message_dispatch(cxn_id, obj);
+        }
+    }
+
+    for (i = 0; i < bundle->count; i++) {
+        if (bundle_is_flow_mod(bundle->msgs[i])) {
+            ind_core_message_dispatch(cxn_id, bundle->msgs[i]);
+        }
+    }
+
+    ind_core_gentable_entry_batch(cxn_id, bundle->msgs, bundle->count);
+
+    /* Group deletes last, once the flows using them are gone */
+    for (i = 0; i < bundle->count; i++) {
+        if (bundle->msgs[i]->object_id == OF_GROUP_DELETE) {
+            ind_core_message_dispatch(cxn_id, bundle->msgs[i]);
+        }
+    }
+
+    ind_core_flow_add_flush();
+
+    bundle_free(bundle);
+
+    return INDIGO_ERROR_NONE;
+}
+
+/****************************************************************
+ * OpenFlow 1.3 bundle extension (ONF EXT-230)
+ ****************************************************************/
+
+#define ONF_EXPERIMENTER_ID 0x4f4e4600
+#define ONF_ET_BUNDLE_CONTROL 2300
+#define ONF_ET_BUNDLE_ADD_MESSAGE 2301
+
+/* Bundle control types */
+#define ONF_BCT_OPEN_REQUEST 0
+#define ONF_BCT_OPEN_REPLY 1
+#define ONF_BCT_CLOSE_REQUEST 2
+#define ONF_BCT_CLOSE_REPLY 3
+#define ONF_BCT_COMMIT_REQUEST 4
+#define ONF_BCT_COMMIT_REPLY 5
+#define ONF_BCT_DISCARD_REQUEST 6
+#define ONF_BCT_DISCARD_REPLY 7
+
+/* bundle_id, type and flags of a control; bundle_id, pad and flags
+   ahead of an added message */
+#define ONF_BUNDLE_HEADER_BYTES 8
+
+static uint32_t
+bundle_get_u32(const uint8_t *buf)
+{
+    return ((uint32_t)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static uint16_t
+bundle_get_u16(const uint8_t *buf)
+{
+    return (buf[0] << 8) | buf[1];
+}
+
+static void
+bundle_onf_reply(of_object_t *request, indigo_cxn_id_t cxn_id,
+                 uint32_t bundle_id, uint16_t type, uint16_t flags)
+{
+    uint8_t body[ONF_BUNDLE_HEADER_BYTES] = {
+        bundle_id >> 24, bundle_id >> 16, bundle_id >> 8, bundle_id,
+        type >> 8, type, flags >> 8, flags,
+    };
+    of_octets_t data = { .data = body, .bytes = sizeof(body) };
+    of_experimenter_t *reply;
+    uint32_t xid;
+
+    reply = indigo_of_experimenter_new(request->version, ONF_EXPERIMENTER_ID,
+                                       ONF_ET_BUNDLE_CONTROL, &data);
+    if (reply == NULL) {
+        LOG_ERROR("Failed to build bundle control reply");
+        return;
+    }
+
+    of_experimenter_xid_get(request, &xid);
+    of_experimenter_xid_set(reply, xid);
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+/*
+ * Errors are sent as bad request errors; LOCI has no encoding of the
+ * extension's experimenter errors
+ */
+static void
+bundle_onf_error(of_object_t *request, indigo_cxn_id_t cxn_id, uint16_t code)
+{
+    indigo_cxn_send_error_reply(cxn_id, request,
+                                OF_ERROR_TYPE_BAD_REQUEST, code);
+}
+
+static void
+bundle_onf_control(of_object_t *obj, indigo_cxn_id_t cxn_id,
+                   of_octets_t *data)
+{
+    ind_core_bundle_t *bundle;
+    uint32_t bundle_id;
+    uint16_t type, flags;
+    indigo_error_t rv;
+
+    if (data->bytes < ONF_BUNDLE_HEADER_BYTES) {
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_LEN);
+        return;
+    }
+
+    bundle_id = bundle_get_u32(data->data);
+    type = bundle_get_u16(data->data + 4);
+    flags = bundle_get_u16(data->data + 6);
+
+    switch (type) {
+    case ONF_BCT_OPEN_REQUEST:
+        rv = ind_core_bundle_open(cxn_id, bundle_id);
+        if (rv == INDIGO_ERROR_NONE) {
+            bundle_find(cxn_id)->onf = true;
+        }
+        break;
+    case ONF_BCT_CLOSE_REQUEST:
+        bundle = bundle_find(cxn_id);
+        if (bundle == NULL || bundle->bundle_id != bundle_id ||
+                bundle->closed) {
+            rv = INDIGO_ERROR_NOT_FOUND;
+        } else {
+            bundle->closed = true;
+            rv = INDIGO_ERROR_NONE;
+        }
+        break;
+    case ONF_BCT_COMMIT_REQUEST:
+        rv = ind_core_bundle_commit(cxn_id, bundle_id);
+        break;
+    case ONF_BCT_DISCARD_REQUEST:
+        rv = ind_core_bundle_discard(cxn_id, bundle_id);
+        break;
+    default:
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_EXPERIMENTER_TYPE);
+        return;
+    }
+
+    if (rv < 0) {
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_EPERM);
+        return;
+    }
+
+    /* Each reply type follows its request type */
+    bundle_onf_reply(obj, cxn_id, bundle_id, type + 1, flags);
+}
+
+static void
+bundle_onf_add(of_object_t *obj, indigo_cxn_id_t cxn_id, of_octets_t *data)
+{
+    ind_core_bundle_t *bundle;
+    uint32_t bundle_id;
+    const uint8_t *msg;
+    uint16_t length;
+    of_object_t *inner;
+    uint8_t *buf;
+
+    if (data->bytes < ONF_BUNDLE_HEADER_BYTES + OF_MESSAGE_MIN_LENGTH) {
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_LEN);
+        return;
+    }
+
+    bundle_id = bundle_get_u32(data->data);
+    msg = data->data + ONF_BUNDLE_HEADER_BYTES;
+    length = bundle_get_u16(msg + 2);
+    if (length < OF_MESSAGE_MIN_LENGTH ||
+            length > data->bytes - ONF_BUNDLE_HEADER_BYTES) {
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_LEN);
+        return;
+    }
+    if (msg[0] != obj->version) {
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_VERSION);
+        return;
+    }
+
+    /* Adding to a bundle that is not open opens it */
+    if ((bundle = bundle_find(cxn_id)) == NULL) {
+        if (ind_core_bundle_open(cxn_id, bundle_id) < 0) {
+            bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_EPERM);
+            return;
+        }
+        bundle = bundle_find(cxn_id);
+        bundle->onf = true;
+    } else if (bundle->bundle_id != bundle_id || !bundle->onf ||
+               bundle->closed) {
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_EPERM);
+        return;
+    }
+
+    /* LOCI frees the message buffer with free() */
+    if ((buf = malloc(length)) == NULL) {
+        LOG_ERROR("Failed to stage a message in bundle %u", bundle_id);
+        bundle->failed = true;
+        return;
+    }
+    memcpy(buf, msg, length);
+    if ((inner = of_object_new_from_message(OF_BUFFER_TO_MESSAGE(buf),
+                                            length)) == NULL) {
+        free(buf);
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_LEN);
+        return;
+    }
+
+    if (!bundle_is_stageable(inner)) {
+        LOG_VERBOSE("Refusing %s in bundle %u",
+                    of_object_id_str[inner->object_id], bundle_id);
+        of_object_delete(inner);
+        bundle_onf_error(obj, cxn_id, OF_REQUEST_FAILED_BAD_TYPE);
+        return;
+    }
+
+    bundle_append(bundle, inner);
+}
+
+void
+ind_core_bundle_experimenter_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
+{
+    uint32_t experimenter, subtype;
+    of_octets_t data;
+
+    of_experimenter_experimenter_get(obj, &experimenter);
+    of_experimenter_subtype_get(obj, &subtype);
+
+    if (experimenter != ONF_EXPERIMENTER_ID) {
+        ind_core_experimenter_handler(obj, cxn_id);
+        return;
+    }
+
+    of_experimenter_data_get(obj, &data);
+    if (subtype == ONF_ET_BUNDLE_CONTROL) {
+        bundle_onf_control(obj, cxn_id, &data);
+    } else if (subtype == ONF_ET_BUNDLE_ADD_MESSAGE) {
+        bundle_onf_add(obj, cxn_id, &data);
+    } else {
+        ind_core_experimenter_handler(obj, cxn_id);
+    }
+}
+
+/* A bundle does not outlive its connection */
+static void
+bundle_cxn_status_change(indigo_cxn_id_t cxn_id,
+                         indigo_cxn_protocol_params_t *cxn_proto_params,
+                         indigo_cxn_state_t state,
+                         void *cookie)
+{
+    ind_core_bundle_t *bundle;
+
+    if (state == INDIGO_CXN_S_CLOSING || state == INDIGO_CXN_S_DISCONNECTED) {
+        if ((bundle = bundle_find(cxn_id)) != NULL) {
+            LOG_VERBOSE("Connection %d closed, discarding bundle %u",
+                        cxn_id, bundle->bundle_id);
+            bundle_free(bundle);
+        }
+    }
+}
+
+void
+ind_core_bundle_init(void)
+{
+    if (indigo_cxn_status_change_register(bundle_cxn_status_change,
+                                          NULL) < 0) {
+        LOG_ERROR("Failed to register for connection status changes");
+    }
+}
+
+void
+ind_core_bundle_finish(void)
+{
+    list_links_t *cur, *next;
+
+    indigo_cxn_status_change_unregister(bundle_cxn_status_change, NULL);
+
+    LIST_FOREACH_SAFE(&ind_core_bundles, cur, next) {
+        bundle_free(container_of(cur, links, ind_core_bundle_t));
+    }
+}
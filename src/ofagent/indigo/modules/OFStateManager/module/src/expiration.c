@@ -33,7 +33,20 @@
 
 static void send_idle_notification(ft_entry_t *entry);
 
-static LIST_DEFINE(expiration_queue);
+/*
+ * Flows are kept in a hashed timing wheel. Each slot covers
+ * EXPIRATION_WHEEL_TICK_MS of time and holds every flow whose expiration
+ * time falls in that tick modulo the wheel size. Flows further out than
+ * one revolution share a slot with nearer ones and are simply skipped
+ * until their time comes around.
+ */
+#define EXPIRATION_WHEEL_TICK_MS 100
+#define EXPIRATION_WHEEL_SLOTS 4096
+
+static list_head_t expiration_wheel[EXPIRATION_WHEEL_SLOTS];
+static bool wheel_initialized = false;
+static indigo_time_t wheel_tick; /* Next tick to be processed */
+static int wheel_count;
 static bool task_running = false;
 
 static indigo_time_t
@@ -58,100 +71,231 @@ calc_expiration_time(ft_entry_t *entry, int *reason)
     }
 }
 
+static void
+expiration_wheel_init(void)
+{
+    int i;
+
+    for (i = 0; i < EXPIRATION_WHEEL_SLOTS; i++) {
+        list_init(&expiration_wheel[i]);
+    }
+    wheel_tick = INDIGO_LOOP_TIME / EXPIRATION_WHEEL_TICK_MS;
+    wheel_initialized = true;
+}
+
+static list_head_t *
+expiration_wheel_slot(indigo_time_t tick)
+{
+    return &expiration_wheel[tick % EXPIRATION_WHEEL_SLOTS];
+}
+
 void
 ind_core_expiration_add(ft_entry_t *entry)
 {
     int reason;
-    indigo_time_t expiration_time = calc_expiration_time(entry, &reason);
-    list_links_t *cur;
-
-    /* Iterate over list in reverse order */
-    for (cur = expiration_queue.links.prev;
-         cur != &expiration_queue.links;
-         cur = cur->prev) {
-        ft_entry_t *other = FT_ENTRY_CONTAINER(cur, expiration);
-        if (calc_expiration_time(other, &reason) <= expiration_time) {
-            /* 'other' expires before us. Insert after it. */
-            list_insert_after(cur, &entry->expiration_links);
-            return;
-        }
+    indigo_time_t tick;
+
+    if (ind_core_config.hardware_expiry) {
+        /* Forwarding ages the flow */
+        return;
+    }
+
+    if (!wheel_initialized) {
+        expiration_wheel_init();
     }
 
-    /* Lowest expiration time. Insert at front of list. */
-    list_unshift(&expiration_queue, &entry->expiration_links);
+    if (wheel_count == 0) {
+        /* Nothing to catch up on; skip ahead to the present */
+        wheel_tick = INDIGO_LOOP_TIME / EXPIRATION_WHEEL_TICK_MS;
+    }
+
+    tick = calc_expiration_time(entry, &reason) / EXPIRATION_WHEEL_TICK_MS;
+    if (tick < wheel_tick) {
+        /* Already expired; handle on the next pass */
+        tick = wheel_tick;
+    }
+
+    list_push(expiration_wheel_slot(tick), &entry->expiration_links);
+    wheel_count++;
 }
 
 void
 ind_core_expiration_remove(ft_entry_t *entry)
 {
+    if (ind_core_config.hardware_expiry) {
+        return;
+    }
     list_remove(&entry->expiration_links);
+    wheel_count--;
+}
+
+static void
+expire_flow_hard(ft_entry_t *entry)
+{
+    LOG_TRACE("Hard TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
+              entry->hard_timeout,
+              INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+    ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_HARD_TIMEOUT);
 }
 
 static void
-expire_flow(ft_entry_t *entry, int reason)
+expire_flow_idle(ft_entry_t *entry, indigo_error_t rv, bool hit)
 {
-    if (reason == INDIGO_FLOW_REMOVED_HARD_TIMEOUT) {
-        LOG_TRACE("Hard TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
-                  entry->hard_timeout,
-                  INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
-        ind_core_flow_entry_delete(entry, reason);
-    } else if (reason == OF_FLOW_REMOVED_REASON_IDLE_TIMEOUT) {
-        int rv;
-        bool hit;
-
-        /* Get hit status for idle timeouts */
-        ind_core_table_t *table = ind_core_table_get(entry->table_id);
-        if (table != NULL) {
-            rv = table->ops->entry_hit_status_get(table->priv, entry->priv, &hit);
+    if (rv != INDIGO_ERROR_NONE) {
+        LOG_ERROR("Failed to get hit status for flow "
+                  INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
+                  entry->id, indigo_strerror(rv));
+        return;
+    }
+
+    if (hit || entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
+        /* Reinsert entry into the expiration list */
+        entry->last_counter_change = INDIGO_LOOP_TIME;
+        ind_core_expiration_remove(entry);
+        ind_core_expiration_add(entry);
+    }
+
+    if (!hit) {
+        if (entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
+            send_idle_notification(entry);
         } else {
-            rv = indigo_fwd_flow_hit_status_get(entry->id, &hit);
+            LOG_TRACE("Idle TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
+                      entry->idle_timeout,
+                      INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+            ind_core_flow_entry_delete(entry,
+                                       INDIGO_FLOW_REMOVED_IDLE_TIMEOUT);
         }
+    }
+}
 
-        if (rv != INDIGO_ERROR_NONE) {
-            LOG_ERROR("Failed to get hit status for flow "
-                      INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
-                      entry->id, indigo_strerror(rv));
-            return;
+/*
+ * Idle timeout candidates found in a pass are collected here so their
+ * hit status can be fetched with one call per table.
+ */
+#define EXPIRATION_HIT_BATCH_MAX 256
+
+static struct {
+    int count;
+    ft_entry_t *entries[EXPIRATION_HIT_BATCH_MAX];
+    bool resolved[EXPIRATION_HIT_BATCH_MAX];
+    bool hits[EXPIRATION_HIT_BATCH_MAX];
+    indigo_error_t results[EXPIRATION_HIT_BATCH_MAX];
+} idle_batch;
+
+/* Fetch hit status for the batched entries that share a table */
+static void
+idle_batch_resolve(int first)
+{
+    ind_core_table_t *table = ind_core_table_get(idle_batch.entries[first]->table_id);
+    int idx[EXPIRATION_HIT_BATCH_MAX];
+    indigo_cookie_t flow_ids[EXPIRATION_HIT_BATCH_MAX];
+    void *privs[EXPIRATION_HIT_BATCH_MAX];
+    bool hits[EXPIRATION_HIT_BATCH_MAX];
+    indigo_error_t results[EXPIRATION_HIT_BATCH_MAX];
+    indigo_error_t rv;
+    int count = 0;
+    int i;
+
+    for (i = first; i < idle_batch.count; i++) {
+        ft_entry_t *entry = idle_batch.entries[i];
+        if (!idle_batch.resolved[i] &&
+                ind_core_table_get(entry->table_id) == table) {
+            idx[count] = i;
+            flow_ids[count] = entry->id;
+            privs[count] = entry->priv;
+            hits[count] = false;
+            count++;
         }
+    }
 
-        if (hit || entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
-            /* Reinsert entry into the expiration list */
-            entry->last_counter_change = INDIGO_CURRENT_TIME;
-            ind_core_expiration_remove(entry);
-            ind_core_expiration_add(entry);
+    if (table == NULL) {
+        rv = indigo_fwd_flow_hit_status_get_batch(count, flow_ids, hits,
+                                                  results);
+    } else if (table->ops->entry_hit_status_get_batch != NULL) {
+        rv = table->ops->entry_hit_status_get_batch(table->priv, count, privs,
+                                                    hits, results);
+    } else {
+        for (i = 0; i < count; i++) {
+            results[i] = table->ops->entry_hit_status_get(table->priv,
+                                                          privs[i], &hits[i]);
         }
+        rv = INDIGO_ERROR_NONE;
+    }
 
-        if (!hit) {
-            if (entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
-                send_idle_notification(entry);
-            } else {
-                LOG_TRACE("Idle TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
-                          entry->idle_timeout,
-                          INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
-                ind_core_flow_entry_delete(entry, reason);
-            }
+    for (i = 0; i < count; i++) {
+        idle_batch.resolved[idx[i]] = true;
+        idle_batch.hits[idx[i]] = hits[i];
+        idle_batch.results[idx[i]] = (rv == INDIGO_ERROR_NONE) ? results[i] : rv;
+    }
+}
+
+static void
+idle_batch_flush(void)
+{
+    int count = idle_batch.count;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (!idle_batch.resolved[i]) {
+            idle_batch_resolve(i);
         }
     }
+
+    idle_batch.count = 0;
+
+    for (i = 0; i < count; i++) {
+        expire_flow_idle(idle_batch.entries[i], idle_batch.results[i],
+                         idle_batch.hits[i]);
+    }
+}
+
+static void
+idle_batch_add(ft_entry_t *entry)
+{
+    idle_batch.entries[idle_batch.count] = entry;
+    idle_batch.resolved[idle_batch.count] = false;
+    idle_batch.count++;
+
+    if (idle_batch.count == EXPIRATION_HIT_BATCH_MAX) {
+        idle_batch_flush();
+    }
 }
 
 static ind_soc_task_status_t
 expiration_task(void *cookie)
 {
-    indigo_time_t current_time = INDIGO_CURRENT_TIME;
+    indigo_time_t current_time = INDIGO_LOOP_TIME;
+    indigo_time_t current_tick = current_time / EXPIRATION_WHEEL_TICK_MS;
     (void) cookie;
 
-    while (!list_empty(&expiration_queue)) {
-        int reason;
-        list_links_t *links = expiration_queue.links.next;
-        ft_entry_t *entry = FT_ENTRY_CONTAINER(links, expiration);
-        if (calc_expiration_time(entry, &reason) <= current_time) {
-            expire_flow(entry, reason);
-        } else {
-            break;
+    while (wheel_count > 0 && wheel_tick <= current_tick) {
+        list_head_t *slot = expiration_wheel_slot(wheel_tick);
+        list_links_t *cur, *next;
+
+        LIST_FOREACH_SAFE(slot, cur, next) {
+            int reason;
+            ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, expiration);
+            if (calc_expiration_time(entry, &reason) <= current_time) {
+                if (reason == OF_FLOW_REMOVED_REASON_HARD_TIMEOUT) {
+                    expire_flow_hard(entry);
+                } else {
+                    idle_batch_add(entry);
+                }
+            }
+            if (ind_soc_should_yield()) {
+                /* Resume with this slot on the next run */
+                idle_batch_flush();
+                return IND_SOC_TASK_CONTINUE;
+            }
         }
-        if (ind_soc_should_yield()) {
-            return IND_SOC_TASK_CONTINUE;
+
+        idle_batch_flush();
+
+        if (wheel_tick == current_tick) {
+            /* Entries in this slot may still expire later in the tick */
+            break;
         }
+        wheel_tick++;
     }
 
     task_running = false;
@@ -170,7 +314,7 @@ ind_core_expiration_timer(void *cookie)
     }
 
     if ((rv = ind_soc_task_register(expiration_task, NULL,
-                                    IND_SOC_DEFAULT_PRIORITY)) < 0) {
+                                    IND_SOC_PRIORITY_FLOW)) < 0) {
         AIM_LOG_ERROR("Failed to start flow expiration task: %s",
                       indigo_strerror(rv));
     } else {
@@ -187,10 +331,11 @@ static void
 send_idle_notification(ft_entry_t *entry)
 {
     of_bsn_flow_idle_t *msg;
+    of_match_t match;
     of_version_t ver;
 
-    if (indigo_cxn_get_async_version(&ver) < 0) {
-        /* No controllers connected */
+    if (indigo_cxn_get_async_version_for(OF_BSN_FLOW_IDLE, &ver) < 0) {
+        /* No controllers want it */
         return;
     }
 
@@ -203,7 +348,8 @@ send_idle_notification(ft_entry_t *entry)
     of_bsn_flow_idle_priority_set(msg, entry->priority);
     of_bsn_flow_idle_table_id_set(msg, entry->table_id);
 
-    if (of_bsn_flow_idle_match_set(msg, &entry->match)) {
+    ft_entry_match_get(entry, &match);
+    if (of_bsn_flow_idle_match_set(msg, &match)) {
         LOG_ERROR("Failed to set match in idle notification");
         of_object_delete(msg);
         return;
@@ -24,52 +24,1194 @@
 
 #include <OFStateManager/ofstatemanager_config.h>
 #include <indigo/indigo.h>
+#include <indigo/of_connection_manager.h>
+#include <indigo/of_state_manager.h>
 #include <murmur/murmur.h>
+#include <BigHash/bighash.h>
 
 #include "ofstatemanager_log.h"
 #include "ft.h"
+#include "ft_lpm.h"
 #include "expiration.h"
 
-static indigo_error_t ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry_p);
+static indigo_error_t ft_entry_create(ft_instance_t ft, indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry_p);
 static void ft_entry_destroy(ft_instance_t ft, ft_entry_t *entry);
-static indigo_error_t ft_entry_set_effects(ft_entry_t *entry, of_flow_modify_t *flow_mod);
+static indigo_error_t ft_entry_set_effects(ft_instance_t ft, ft_entry_t *entry, of_flow_modify_t *flow_mod);
 static void ft_entry_link(ft_instance_t ft, ft_entry_t *entry);
 static void ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry);
-static int ft_entry_has_out_port(ft_entry_t *entry, of_port_no_t port);
+static void ft_iterators_entry_moving(ft_instance_t ft, ft_entry_t *entry, int links_offset);
+static void ft_iterators_entry_unlinking(ft_instance_t ft, ft_entry_t *entry);
+static int ft_entry_has_egress(ft_entry_t *entry, uint64_t egress);
+static int ft_entry_egress_count(ft_entry_t *entry, uint64_t *egress);
 
 #define FT_HASH_SEED 0
 
+#define FT_FINGERPRINT_PRIME 0x9e3779b97f4a7c15ULL
+#define FT_FINGERPRINT_LANES 4
+
+/**
+ * Fingerprint of a match
+ *
+ * A multiply-xor hash over the sparse encoding, so only the fields that
+ * are present are hashed. The words are spread over independent lanes
+ * that the compiler can vectorize.
+ */
+
+static uint32_t
+ft_match_fingerprint(const ft_match_t *match)
+{
+    uint64_t lanes[FT_FINGERPRINT_LANES] = { 1, 2, 3, 4 };
+    int words = 2 * match->count;
+    int idx, lane;
+    uint64_t h;
+
+    for (idx = 0; idx + FT_FINGERPRINT_LANES <= words;
+         idx += FT_FINGERPRINT_LANES) {
+        for (lane = 0; lane < FT_FINGERPRINT_LANES; lane++) {
+            lanes[lane] = (lanes[lane] ^ match->words[idx + lane]) *
+                FT_FINGERPRINT_PRIME;
+        }
+    }
+    for (lane = 0; idx < words; idx++, lane++) {
+        lanes[lane] = (lanes[lane] ^ match->words[idx]) * FT_FINGERPRINT_PRIME;
+    }
+
+    h = (match->present ^ match->version) * FT_FINGERPRINT_PRIME;
+    for (lane = 0; lane < FT_FINGERPRINT_LANES; lane++) {
+        h = (h ^ lanes[lane]) * FT_FINGERPRINT_PRIME;
+    }
+
+    return h ^ (h >> 32);
+}
+
+static uint32_t
+ft_strict_match_hash(uint32_t fingerprint, uint16_t priority)
+{
+    uint32_t h = fingerprint ^ ((uint32_t)priority * 0x9e3779b1);
+    return h ^ (h >> 16);
+}
+
+static int
+ft_strict_match_to_bucket_index(ft_instance_t ft,
+                                uint32_t fingerprint,
+                                uint16_t priority)
+{
+    return ft_strict_match_hash(fingerprint, priority) %
+        ft->config.strict_match_bucket_count;
+}
+
+static uint32_t
+ft_flow_id_hash(indigo_flow_id_t *flow_id)
+{
+    return bighash_hash_u64(*flow_id);
+}
+
+static int
+ft_flow_id_to_bucket_index(ft_instance_t ft, indigo_flow_id_t *flow_id)
+{
+    return ft_flow_id_hash(flow_id) % ft->config.flow_id_bucket_count;
+}
+
+static int
+ft_cookie_to_bucket_index(ft_instance_t ft, uint64_t cookie)
+{
+    return cookie >> (64-FT_COOKIE_PREFIX_LEN);
+}
+
+static int
+ft_cookie_range_to_bucket_index(ft_instance_t ft, uint64_t cookie)
+{
+    uint64_t key = cookie & ft->cookie_range_mask;
+    return bighash_hash_u64(key) %
+        ft->cookie_range_bucket_count;
+}
+
+/* Add or remove a flow's checksum from the checksums of its table */
+static void
+ft_checksum_update(ft_instance_t ft, uint8_t table_id, uint64_t value)
+{
+    ft_checksum_t *checksum = &ft->checksums[table_id];
+
+    checksum->checksum ^= value;
+    if (checksum->buckets != NULL) {
+        checksum->buckets[value >> checksum->shift] ^= value;
+    }
+}
+
+#define FT_FNV_OFFSET 0xcbf29ce484222325ULL
+#define FT_FNV_PRIME 0x100000001b3ULL
+
+static uint64_t
+ft_fnv1a(uint64_t hash, const uint8_t *data, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * FT_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* The checksum of an entry's contents; see ft_checksum_t */
+static uint64_t
+ft_entry_content_checksum(ft_entry_t *entry)
+{
+    uint8_t priority[2] = { entry->priority >> 8, entry->priority & 0xff };
+    of_object_t *effects = entry->effects.actions;
+    uint64_t hash = FT_FNV_OFFSET;
+
+    hash = ft_fnv1a(hash, priority, sizeof(priority));
+
+    if (entry->match_wire != NULL) {
+        hash = ft_fnv1a(hash, entry->match_wire, entry->match_wire_len);
+    }
+
+    if (effects != NULL) {
+        hash = ft_fnv1a(hash, OF_OBJECT_BUFFER_INDEX(effects, 0),
+                        effects->length);
+    }
+
+    return hash;
+}
+
+static uint64_t
+ft_entry_checksum(ft_instance_t ft, ft_entry_t *entry)
+{
+    return ft->config.content_checksums ?
+        ft_entry_content_checksum(entry) : entry->cookie;
+}
+
+static int
+ft_priority_to_bucket_index(ft_instance_t ft, uint8_t table_id,
+                            uint16_t priority)
+{
+    uint32_t key = (table_id << 16) | priority;
+    return bighash_hash_u32(key) %
+        FT_PRIORITY_BUCKET_COUNT;
+}
+
+/****************************************************************
+ * Sparse match encoding
+ ****************************************************************/
+
+AIM_STATIC_ASSERT(FT_MATCH_WORDS, FT_MATCH_WORDS <= 64);
+
+/* Space for the encoding of any match */
+typedef union ft_match_buf_u {
+    ft_match_t match;
+    uint8_t bytes[FT_MATCH_BYTES(FT_MATCH_WORDS)];
+} ft_match_buf_t;
+
+static uint64_t
+ft_match_word_get(const of_match_fields_t *fields, int idx)
+{
+    uint64_t word = 0;
+    int offset = idx * sizeof(word);
+    int bytes = sizeof(*fields) - offset;
+
+    memcpy(&word, (const uint8_t *)fields + offset,
+           bytes < sizeof(word) ? bytes : sizeof(word));
+    return word;
+}
+
+static void
+ft_match_word_set(of_match_fields_t *fields, int idx, uint64_t word)
+{
+    int offset = idx * sizeof(word);
+    int bytes = sizeof(*fields) - offset;
+
+    memcpy((uint8_t *)fields + offset, &word,
+           bytes < sizeof(word) ? bytes : sizeof(word));
+}
+
+static void
+ft_match_encode(const of_match_t *match, ft_match_t *out)
+{
+    uint64_t field, mask;
+    int idx;
+
+    out->present = 0;
+    out->version = match->version;
+    out->count = 0;
+
+    for (idx = 0; idx < FT_MATCH_WORDS; idx++) {
+        field = ft_match_word_get(&match->fields, idx);
+        mask = ft_match_word_get(&match->masks, idx);
+        if (field == 0 && mask == 0) {
+            continue;
+        }
+        out->present |= (uint64_t)1 << idx;
+        out->words[2 * out->count] = field;
+        out->words[2 * out->count + 1] = mask;
+        out->count++;
+    }
+}
+
+static void
+ft_match_decode(const ft_match_t *in, of_match_t *match)
+{
+    int idx, pos = 0;
+
+    memset(match, 0, sizeof(*match));
+    match->version = in->version;
+
+    for (idx = 0; idx < FT_MATCH_WORDS; idx++) {
+        if (in->present & ((uint64_t)1 << idx)) {
+            ft_match_word_set(&match->fields, idx, in->words[pos++]);
+            ft_match_word_set(&match->masks, idx, in->words[pos++]);
+        }
+    }
+}
+
+void
+ft_entry_match_get(ft_entry_t *entry, of_match_t *match)
+{
+    ft_match_decode(entry->match, match);
+}
+
+/****************************************************************
+ * Packet match index
+ *
+ * A tuple space search: the flows of each table are grouped by mask into
+ * tuples, see ft_tuple_t, and hashed within a tuple by their masked
+ * fields. Only the mask words that are non-zero are hashed.
+ ****************************************************************/
+
+#define FT_TUPLE_BUCKET_COUNT 16
+
+/* Key of an entry: the non-zero mask words and the masked fields */
+static int
+ft_tuple_entry_key(const ft_match_t *match, uint64_t *masked,
+                   uint64_t *masks, uint64_t *key)
+{
+    uint64_t field, mask;
+    int idx, pos = 0, count = 0;
+
+    *masked = 0;
+    for (idx = 0; idx < FT_MATCH_WORDS; idx++) {
+        if (!(match->present & ((uint64_t)1 << idx))) {
+            continue;
+        }
+        field = match->words[pos++];
+        mask = match->words[pos++];
+        if (mask == 0) {
+            continue;
+        }
+        *masked |= (uint64_t)1 << idx;
+        if (masks != NULL) {
+            masks[count] = mask;
+        }
+        key[count++] = field & mask;
+    }
+
+    return count;
+}
+
+/* Key of a packet in a tuple */
+static void
+ft_tuple_packet_key(const ft_tuple_t *tuple, const of_match_fields_t *fields,
+                    uint64_t *key)
+{
+    uint64_t masked = tuple->masked;
+    int idx, count = 0;
+
+    for (idx = 0; masked != 0; idx++, masked >>= 1) {
+        if (masked & 1) {
+            key[count] = ft_match_word_get(fields, idx) & tuple->masks[count];
+            count++;
+        }
+    }
+}
+
+static uint32_t
+ft_tuple_hash(const uint64_t *key, int count)
+{
+    return murmur_hash(key, count * sizeof(*key), FT_HASH_SEED);
+}
+
+static bool
+ft_tuple_entry_equal(ft_entry_t *entry, const uint64_t *key, int count)
+{
+    uint64_t masked;
+    uint64_t entry_key[FT_MATCH_WORDS];
+
+    ft_tuple_entry_key(entry->match, &masked, NULL, entry_key);
+    return !memcmp(entry_key, key, count * sizeof(*key));
+}
+
+/* Move a tuple to its place in the list, by descending max_priority */
+static void
+ft_tuple_reorder(list_head_t *tuples, ft_tuple_t *tuple)
+{
+    list_links_t *cur;
+    ft_tuple_t *other;
+
+    list_remove(&tuple->links);
+    LIST_FOREACH(tuples, cur) {
+        other = container_of(cur, links, ft_tuple_t);
+        if (other->max_priority < tuple->max_priority) {
+            list_insert_before(cur, &tuple->links);
+            return;
+        }
+    }
+    list_push(tuples, &tuple->links);
+}
+
+static void
+ft_tuple_index_add(ft_instance_t ft, ft_entry_t *entry)
+{
+    list_head_t *tuples = &ft->tuple_buckets[entry->table_id];
+    uint64_t masks[FT_MATCH_WORDS];
+    uint64_t key[FT_MATCH_WORDS];
+    uint64_t masked;
+    ft_tuple_t *tuple = NULL;
+    list_links_t *cur;
+    int count;
+
+    count = ft_tuple_entry_key(entry->match, &masked, masks, key);
+
+    LIST_FOREACH(tuples, cur) {
+        ft_tuple_t *t = container_of(cur, links, ft_tuple_t);
+        if (t->masked == masked &&
+                !memcmp(t->masks, masks, count * sizeof(*masks))) {
+            tuple = t;
+            break;
+        }
+    }
+
+    if (tuple == NULL) {
+        tuple = aim_zmalloc(sizeof(*tuple));
+        tuple->masked = masked;
+        tuple->count = count;
+        tuple->max_priority = entry->priority;
+        memcpy(tuple->masks, masks, count * sizeof(*masks));
+        tuple->entries = bighash_table_create_growable(FT_TUPLE_BUCKET_COUNT);
+        list_push(tuples, &tuple->links);
+        ft_tuple_reorder(tuples, tuple);
+    } else if (entry->priority > tuple->max_priority) {
+        tuple->max_priority = entry->priority;
+        ft_tuple_reorder(tuples, tuple);
+    }
+
+    entry->tuple = tuple;
+    bighash_insert(tuple->entries, &entry->tuple_hash_entry,
+                   ft_tuple_hash(key, count));
+
+    if (ft->lpm != NULL && entry->table_id == ft_lpm_table_id(ft->lpm)) {
+        ft_lpm_add(ft->lpm, entry);
+    }
+}
+
+static void
+ft_tuple_index_remove(ft_instance_t ft, ft_entry_t *entry)
+{
+    ft_tuple_t *tuple = entry->tuple;
+
+    if (tuple == NULL) {
+        return;
+    }
+
+    bighash_remove(tuple->entries, &entry->tuple_hash_entry);
+    entry->tuple = NULL;
+
+    if (ft->lpm != NULL && entry->table_id == ft_lpm_table_id(ft->lpm)) {
+        ft_lpm_remove(ft->lpm, entry);
+    }
+
+    if (bighash_entry_count(tuple->entries) == 0) {
+        list_remove(&tuple->links);
+        bighash_table_destroy(tuple->entries, NULL);
+        aim_free(tuple);
+    }
+}
+
+/* True if the tuple only masks bits of known fields */
+static bool
+ft_tuple_known(const ft_tuple_t *tuple, const of_match_fields_t *known)
+{
+    uint64_t masked = tuple->masked;
+    int idx, count = 0;
+
+    for (idx = 0; masked != 0; idx++, masked >>= 1) {
+        if (masked & 1) {
+            if (tuple->masks[count++] & ~ft_match_word_get(known, idx)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+indigo_error_t
+ft_packet_match(ft_instance_t ft, uint8_t table_id,
+                const of_match_fields_t *fields,
+                const of_match_fields_t *known, ft_entry_t **entry_ptr)
+{
+    uint64_t key[FT_MATCH_WORDS];
+    ft_entry_t *best = NULL;
+    ft_entry_t *entry;
+    ft_tuple_t *tuple;
+    bighash_entry_t *e;
+    list_links_t *cur;
+
+    if (ft->tuple_buckets == NULL) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    if (ft->lpm != NULL && table_id == ft_lpm_table_id(ft->lpm) &&
+            ft_lpm_complete(ft->lpm)) {
+        return ft_lpm_packet_match(ft->lpm, fields, known, entry_ptr);
+    }
+
+    LIST_FOREACH(&ft->tuple_buckets[table_id], cur) {
+        tuple = container_of(cur, links, ft_tuple_t);
+        if (best != NULL && tuple->max_priority <= best->priority) {
+            /* No later tuple can hold a better match */
+            break;
+        }
+        if (known != NULL && !ft_tuple_known(tuple, known)) {
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+
+        ft_tuple_packet_key(tuple, fields, key);
+        for (e = bighash_first(tuple->entries, ft_tuple_hash(key, tuple->count));
+                e != NULL; e = bighash_next(e)) {
+            entry = container_of(e, tuple_hash_entry, ft_entry_t);
+            if ((best == NULL || entry->priority > best->priority) &&
+                    ft_tuple_entry_equal(entry, key, tuple->count)) {
+                best = entry;
+            }
+        }
+    }
+
+    if (best == NULL) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    *entry_ptr = best;
+    return INDIGO_ERROR_NONE;
+}
+
+/****************************************************************
+ * L2 table index
+ *
+ * Flushing the MAC addresses of a VLAN or a port is a non-strict delete
+ * of the L2 table by VLAN ID, out_port or out_group. Rather than walking
+ * the whole table, such a query iterates the entries of one VLAN ID or
+ * one egress. An entry that forwards to several ports or groups could
+ * match a query for any of them; while the table has one, the egress
+ * index is not used.
+ ****************************************************************/
+
+/* VLAN ID bits of the vlan_vid field, without OFPVID_PRESENT */
+#define FT_VLAN_VID_MASK 0x0fff
+
+static int
+ft_egress_to_bucket_index(uint64_t egress)
+{
+    return bighash_hash_u64(egress) % FT_EGRESS_BUCKET_COUNT;
+}
+
+static void
+ft_l2_egress_add(ft_instance_t ft, ft_entry_t *entry)
+{
+    int count;
+
+    if (ft->egress_buckets == NULL || entry->table_id != ft->config.l2_table_id) {
+        return;
+    }
+
+    count = ft_entry_egress_count(entry, &entry->egress);
+    if (count == 1) {
+        list_push(&ft->egress_buckets[ft_egress_to_bucket_index(entry->egress)],
+                  &entry->egress_links);
+        entry->l2_index |= FT_L2_INDEX_EGRESS;
+    } else if (count > 1) {
+        ft->l2_multi_egress_count++;
+        entry->l2_index |= FT_L2_INDEX_MULTI_EGRESS;
+    }
+}
+
+static void
+ft_l2_egress_remove(ft_instance_t ft, ft_entry_t *entry)
+{
+    if (entry->l2_index & FT_L2_INDEX_EGRESS) {
+        list_remove(&entry->egress_links);
+    } else if (entry->l2_index & FT_L2_INDEX_MULTI_EGRESS) {
+        ft->l2_multi_egress_count--;
+    }
+    entry->l2_index &= ~(FT_L2_INDEX_EGRESS | FT_L2_INDEX_MULTI_EGRESS);
+}
+
+static void
+ft_l2_index_add(ft_instance_t ft, ft_entry_t *entry)
+{
+    of_match_t match;
+
+    if (ft->vlan_buckets == NULL || entry->table_id != ft->config.l2_table_id) {
+        return;
+    }
+
+    ft_entry_match_get(entry, &match);
+    if ((match.masks.vlan_vid & FT_VLAN_VID_MASK) == FT_VLAN_VID_MASK) {
+        list_push(&ft->vlan_buckets[match.fields.vlan_vid & FT_VLAN_VID_MASK],
+                  &entry->vlan_links);
+        entry->l2_index |= FT_L2_INDEX_VLAN;
+    }
+
+    ft_l2_egress_add(ft, entry);
+}
+
+static void
+ft_l2_index_remove(ft_instance_t ft, ft_entry_t *entry)
+{
+    if (entry->l2_index & FT_L2_INDEX_VLAN) {
+        list_remove(&entry->vlan_links);
+    }
+    ft_l2_egress_remove(ft, entry);
+    entry->l2_index = 0;
+}
+
+/*
+ * Point an iterator at the L2 table index list holding every entry the
+ * query can match. Returns false if the query cannot use the index.
+ */
+static bool
+ft_l2_index_select(ft_instance_t ft, of_meta_match_t *query,
+                   ft_iterator_t *iter)
+{
+    uint64_t egress;
+
+    if (ft->vlan_buckets == NULL || query->table_id != ft->config.l2_table_id) {
+        return false;
+    }
+
+    /* Only these modes require a matching egress and an equal VLAN ID */
+    if (query->mode != OF_MATCH_NON_STRICT && query->mode != OF_MATCH_STRICT) {
+        return false;
+    }
+
+    if (ft->l2_multi_egress_count == 0 &&
+            (query->check_out_group || query->out_port != OF_PORT_DEST_WILDCARD)) {
+        egress = query->check_out_group ? FT_EGRESS_GROUP(query->out_group) :
+            FT_EGRESS_PORT(query->out_port);
+        iter->head = &ft->egress_buckets[ft_egress_to_bucket_index(egress)];
+        iter->links_offset = offsetof(ft_entry_t, egress_links);
+        return true;
+    }
+
+    /* An entry more specific than the query matches the VLAN ID exactly */
+    if ((query->match.masks.vlan_vid & FT_VLAN_VID_MASK) == FT_VLAN_VID_MASK) {
+        iter->head = &ft->vlan_buckets[query->match.fields.vlan_vid &
+                                       FT_VLAN_VID_MASK];
+        iter->links_offset = offsetof(ft_entry_t, vlan_links);
+        return true;
+    }
+
+    return false;
+}
+
+/****************************************************************
+ * Flow entry storage
+ *
+ * Each flow table owns the memory of its entries, their matches and its
+ * interned effects, so nothing is shared between tables and a table
+ * needs no locking beyond that of its owner. Entries are carved out of
+ * slabs of FT_ENTRY_SLAB_ENTRIES and recycled through a free list.
+ * Encoded and serialized matches come from chunks of FT_ARENA_CHUNK_BYTES
+ * in size classes of FT_ARENA_ALIGN bytes, each with its own free list;
+ * larger blocks are allocated directly. ft_destroy releases all of it.
+ ****************************************************************/
+
+#define FT_ENTRY_SLAB_ENTRIES 1024
+
+#define FT_ARENA_ALIGN 8
+#define FT_ARENA_CLASSES 128            /* Blocks of up to 1KB */
+#define FT_ARENA_CHUNK_BYTES (64 * 1024)
+
+/* Must be a power of 2 */
+#define FT_EFFECTS_BUCKET_COUNT 4096
+
+typedef union ft_entry_slot_u {
+    ft_entry_t entry;
+    union ft_entry_slot_u *next_free;
+} ft_entry_slot_t;
+
+typedef struct ft_entry_slab_s {
+    struct ft_entry_slab_s *next;
+    ft_entry_slot_t slots[FT_ENTRY_SLAB_ENTRIES];
+} ft_entry_slab_t;
+
+typedef struct ft_arena_chunk_s {
+    struct ft_arena_chunk_s *next;
+    uint64_t data[FT_ARENA_CHUNK_BYTES / sizeof(uint64_t)];
+} ft_arena_chunk_t;
+
+typedef struct ft_arena_block_s {
+    struct ft_arena_block_s *next;
+} ft_arena_block_t;
+
+struct ft_arena_s {
+    ft_entry_slab_t *slabs;
+    ft_entry_slot_t *entry_free_list;
+    ft_arena_chunk_t *chunks;
+    uint32_t chunk_used;           /* Bytes used in the first chunk */
+    ft_arena_block_t *free_blocks[FT_ARENA_CLASSES];
+    list_head_t effects_buckets[FT_EFFECTS_BUCKET_COUNT];
+    int effects_count;
+};
+
+static ft_arena_t *
+ft_arena_create(void)
+{
+    ft_arena_t *arena = aim_zmalloc(sizeof(*arena));
+    int idx;
+
+    for (idx = 0; idx < FT_EFFECTS_BUCKET_COUNT; idx++) {
+        list_init(&arena->effects_buckets[idx]);
+    }
+
+    return arena;
+}
+
+/* Every entry must have been freed */
+static void
+ft_arena_destroy(ft_arena_t *arena)
+{
+    ft_entry_slab_t *slab;
+    ft_arena_chunk_t *chunk;
+
+    AIM_ASSERT(arena->effects_count == 0);
+
+    while ((slab = arena->slabs) != NULL) {
+        arena->slabs = slab->next;
+        aim_free(slab);
+    }
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        aim_free(chunk);
+    }
+    aim_free(arena);
+}
+
+static void *
+ft_arena_alloc(ft_arena_t *arena, uint32_t bytes)
+{
+    uint32_t class = (bytes + FT_ARENA_ALIGN - 1) / FT_ARENA_ALIGN;
+    uint32_t size = class * FT_ARENA_ALIGN;
+    ft_arena_block_t *block;
+    ft_arena_chunk_t *chunk;
+
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_FLOW_ENTRY, bytes);
+
+    if (class == 0 || class > FT_ARENA_CLASSES) {
+        return aim_malloc(bytes);
+    }
+
+    if ((block = arena->free_blocks[class - 1]) != NULL) {
+        arena->free_blocks[class - 1] = block->next;
+        return block;
+    }
+
+    if (arena->chunks == NULL ||
+            arena->chunk_used + size > FT_ARENA_CHUNK_BYTES) {
+        chunk = aim_malloc(sizeof(*chunk));
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->chunk_used = 0;
+    }
+
+    block = (ft_arena_block_t *)((uint8_t *)arena->chunks->data +
+                                 arena->chunk_used);
+    arena->chunk_used += size;
+    return block;
+}
+
+static void
+ft_arena_free(ft_arena_t *arena, void *ptr, uint32_t bytes)
+{
+    uint32_t class = (bytes + FT_ARENA_ALIGN - 1) / FT_ARENA_ALIGN;
+    ft_arena_block_t *block = ptr;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    indigo_mem_account_free(INDIGO_MEM_TAG_FLOW_ENTRY, bytes);
+
+    if (class == 0 || class > FT_ARENA_CLASSES) {
+        aim_free(ptr);
+        return;
+    }
+
+    block->next = arena->free_blocks[class - 1];
+    arena->free_blocks[class - 1] = block;
+}
+
+static ft_entry_t *
+ft_entry_alloc(ft_instance_t ft)
+{
+    ft_arena_t *arena = ft->shared->arena;
+    ft_entry_slot_t *slot;
+    int idx;
+
+    if (arena->entry_free_list == NULL) {
+        ft_entry_slab_t *slab = aim_malloc(sizeof(*slab));
+        for (idx = 0; idx < FT_ENTRY_SLAB_ENTRIES; idx++) {
+            slab->slots[idx].next_free = arena->entry_free_list;
+            arena->entry_free_list = &slab->slots[idx];
+        }
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+    }
+
+    slot = arena->entry_free_list;
+    arena->entry_free_list = slot->next_free;
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_FLOW_ENTRY, sizeof(slot->entry));
+
+    memset(&slot->entry, 0, sizeof(slot->entry));
+    return &slot->entry;
+}
+
+static void
+ft_entry_free(ft_instance_t ft, ft_entry_t *entry)
+{
+    ft_entry_slot_t *slot = (ft_entry_slot_t *)entry;
+
+    slot->next_free = ft->shared->arena->entry_free_list;
+    ft->shared->arena->entry_free_list = slot;
+    indigo_mem_account_free(INDIGO_MEM_TAG_FLOW_ENTRY, sizeof(slot->entry));
+}
+
+/****************************************************************
+ * Interned effects
+ *
+ * Many flows carry the same actions or instructions, for example a few
+ * write-actions/goto-table sets shared by all bridging flows. Each distinct
+ * list is kept once per flow table, reference counted by the entries
+ * using it.
+ ****************************************************************/
+
+typedef struct ft_effects_s {
+    list_links_t links;
+    uint32_t hash;
+    uint32_t refcount;
+    of_object_t *list;
+} ft_effects_t;
+
+/* Accounted size of an interned list */
+#define FT_EFFECTS_BYTES(_list) \
+    (sizeof(ft_effects_t) + sizeof(of_object_t) + (_list)->length)
+
+static uint32_t
+ft_effects_hash(of_object_t *list)
+{
+    uint32_t h = FT_HASH_SEED;
+    h = murmur_hash(&list->version, sizeof(list->version), h);
+    h = murmur_hash(&list->object_id, sizeof(list->object_id), h);
+    return murmur_hash(OF_OBJECT_BUFFER_INDEX(list, 0), list->length, h);
+}
+
+static bool
+ft_effects_equal(of_object_t *a, of_object_t *b)
+{
+    return a->version == b->version &&
+        a->object_id == b->object_id &&
+        a->length == b->length &&
+        memcmp(OF_OBJECT_BUFFER_INDEX(a, 0),
+               OF_OBJECT_BUFFER_INDEX(b, 0), a->length) == 0;
+}
+
+/**
+ * Return the shared copy of an effects list
+ *
+ * Takes ownership of list, which is deleted if an equal list is already
+ * interned.
+ */
+static ft_effects_t *
+ft_effects_intern(ft_instance_t ft, of_object_t *list)
+{
+    ft_arena_t *arena = ft->shared->arena;
+    ft_effects_t *effects;
+    list_head_t *bucket;
+    list_links_t *cur;
+    uint32_t hash;
+
+    hash = ft_effects_hash(list);
+    bucket = &arena->effects_buckets[hash & (FT_EFFECTS_BUCKET_COUNT - 1)];
+
+    LIST_FOREACH(bucket, cur) {
+        effects = container_of(cur, links, ft_effects_t);
+        if (effects->hash == hash && ft_effects_equal(effects->list, list)) {
+            effects->refcount++;
+            of_object_delete(list);
+            return effects;
+        }
+    }
+
+    effects = aim_malloc(sizeof(*effects));
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_FLOW_EFFECTS, FT_EFFECTS_BYTES(list));
+    effects->hash = hash;
+    effects->refcount = 1;
+    effects->list = list;
+    list_push(bucket, &effects->links);
+    arena->effects_count++;
+
+    return effects;
+}
+
+static void
+ft_effects_release(ft_instance_t ft, ft_effects_t *effects)
+{
+    if (effects == NULL || --effects->refcount > 0) {
+        return;
+    }
+
+    list_remove(&effects->links);
+    indigo_mem_account_free(INDIGO_MEM_TAG_FLOW_EFFECTS, FT_EFFECTS_BYTES(effects->list));
+    of_object_delete(effects->list);
+    aim_free(effects);
+    ft->shared->arena->effects_count--;
+}
+
+int
+ft_shared_effects_count(ft_instance_t ft)
+{
+    return ft->shared->arena->effects_count;
+}
+
+/****************************************************************
+ * Hash index resizing
+ ****************************************************************/
+
+struct ft_rehash_task_s {
+    ft_instance_t ft;              /* NULL once the flow table is destroyed */
+};
+
+typedef uint32_t (*ft_entry_hash_f)(ft_entry_t *entry);
+
+static uint32_t
+ft_entry_strict_match_hash(ft_entry_t *entry)
+{
+    return ft_strict_match_hash(entry->match_fingerprint, entry->priority);
+}
+
+static uint32_t
+ft_entry_flow_id_hash(ft_entry_t *entry)
+{
+    return ft_flow_id_hash(&entry->id);
+}
+
+static list_head_t *
+ft_buckets_alloc(int bucket_count)
+{
+    list_head_t *buckets;
+    int idx;
+
+    buckets = aim_zmalloc(sizeof(list_head_t) * bucket_count);
+    for (idx = 0; idx < bucket_count; idx++) {
+        list_init(&buckets[idx]);
+    }
+
+    return buckets;
+}
+
+/* Return the bucket count the index should have for the given load */
+static int
+ft_rehash_target(int bucket_count, int min_bucket_count, int entries)
+{
+    if (entries > bucket_count * FT_HASH_MAX_LOAD) {
+        return bucket_count * 2;
+    }
+
+    if (bucket_count > min_bucket_count &&
+            entries < bucket_count / FT_HASH_SHRINK_DIVISOR) {
+        bucket_count /= 2;
+        return bucket_count > min_bucket_count ? bucket_count : min_bucket_count;
+    }
+
+    return bucket_count;
+}
+
+/* Start a resize if the load calls for one and none is in progress */
+static bool
+ft_rehash_begin(ft_rehash_t *rehash, list_head_t **buckets,
+                int *bucket_count, int min_bucket_count, int entries)
+{
+    int new_count;
+
+    if (rehash->buckets != NULL) {
+        return false;
+    }
+
+    new_count = ft_rehash_target(*bucket_count, min_bucket_count, entries);
+    if (new_count == *bucket_count) {
+        return false;
+    }
+
+    rehash->buckets = *buckets;
+    rehash->bucket_count = *bucket_count;
+    rehash->next_bucket = 0;
+
+    *buckets = ft_buckets_alloc(new_count);
+    *bucket_count = new_count;
+
+    return true;
+}
+
+/* Move the entries of up to max_buckets old buckets to the new buckets */
+static void
+ft_rehash_move(ft_rehash_t *rehash, list_head_t *buckets, int bucket_count,
+               int links_offset, ft_entry_hash_f hash, int max_buckets)
+{
+    list_links_t *cur, *next;
+    list_head_t *old;
+    ft_entry_t *entry;
+
+    if (rehash->buckets == NULL) {
+        return;
+    }
+
+    while (max_buckets-- > 0 && rehash->next_bucket < rehash->bucket_count) {
+        old = &rehash->buckets[rehash->next_bucket++];
+        LIST_FOREACH_SAFE(old, cur, next) {
+            entry = (ft_entry_t *)(((char *)cur) - links_offset);
+            list_remove(cur);
+            list_push(&buckets[hash(entry) % bucket_count], cur);
+        }
+    }
+
+    if (rehash->next_bucket == rehash->bucket_count) {
+        aim_free(rehash->buckets);
+        rehash->buckets = NULL;
+    }
+}
+
+/* Returns true once no resize is in progress */
+static bool
+ft_rehash_step(ft_instance_t ft)
+{
+    ft_rehash_move(&ft->strict_match_rehash, ft->strict_match_buckets,
+                   ft->config.strict_match_bucket_count,
+                   offsetof(ft_entry_t, strict_match_links),
+                   ft_entry_strict_match_hash, FT_REHASH_BUCKETS_PER_STEP);
+    ft_rehash_move(&ft->flow_id_rehash, ft->flow_id_buckets,
+                   ft->config.flow_id_bucket_count,
+                   offsetof(ft_entry_t, flow_id_links),
+                   ft_entry_flow_id_hash, FT_REHASH_BUCKETS_PER_STEP);
+
+    return ft->strict_match_rehash.buckets == NULL &&
+        ft->flow_id_rehash.buckets == NULL;
+}
+
+static void ft_resize_check(ft_instance_t ft);
+
+static ind_soc_task_status_t
+ft_rehash_task_callback(void *cookie)
+{
+    struct ft_rehash_task_s *task = cookie;
+    ft_instance_t ft = task->ft;
+
+    if (ft == NULL) {
+        aim_free(task);
+        return IND_SOC_TASK_FINISHED;
+    }
+
+    while (!ft_rehash_step(ft)) {
+        if (ind_soc_should_yield()) {
+            return IND_SOC_TASK_CONTINUE;
+        }
+    }
+
+    ft->rehash_task = NULL;
+    aim_free(task);
+
+    /* The load may have changed enough for another resize */
+    ft_resize_check(ft);
+
+    return IND_SOC_TASK_FINISHED;
+}
+
 /**
- * @fixme Consider using something other than murmur for small data
- * hash calculations.  Multiplying by a prime is a good option
+ * Resize the hashed indexes if their load is out of bounds
+ *
+ * Called after each add and delete.
  */
 
-static int
-ft_strict_match_to_bucket_index(ft_instance_t ft,
-                                of_match_t *match,
-                                uint16_t priority)
+static void
+ft_resize_check(ft_instance_t ft)
 {
-    uint32_t h = FT_HASH_SEED;
-    h = murmur_hash(match, sizeof(*match), h);
-    h = murmur_hash(&priority, sizeof(priority), h);
-    return h % ft->config.strict_match_bucket_count;
+    int entries = ft->status.current_count;
+
+    if (ft_rehash_begin(&ft->strict_match_rehash, &ft->strict_match_buckets,
+                        &ft->config.strict_match_bucket_count,
+                        ft->min_config.strict_match_bucket_count, entries)) {
+        ft->status.index_resizes++;
+    }
+    if (ft_rehash_begin(&ft->flow_id_rehash, &ft->flow_id_buckets,
+                        &ft->config.flow_id_bucket_count,
+                        ft->min_config.flow_id_bucket_count, entries)) {
+        ft->status.index_resizes++;
+    }
+
+    if (ft->rehash_task != NULL ||
+            (ft->strict_match_rehash.buckets == NULL &&
+             ft->flow_id_rehash.buckets == NULL)) {
+        return;
+    }
+
+    ft->rehash_task = aim_zmalloc(sizeof(*ft->rehash_task));
+    ft->rehash_task->ft = ft;
+    if (ind_soc_task_register(ft_rehash_task_callback, ft->rehash_task,
+                              IND_SOC_DEFAULT_PRIORITY) != INDIGO_ERROR_NONE) {
+        LOG_ERROR("Failed to start flow table resize task");
+        aim_free(ft->rehash_task);
+        ft->rehash_task = NULL;
+        while (!ft_rehash_step(ft)) {
+        }
+    }
 }
 
-static int
-ft_flow_id_to_bucket_index(ft_instance_t ft, indigo_flow_id_t *flow_id)
+/* Chain length classes: 0, 1, 2-3, 4-7, 8-15, 16+ */
+#define FT_BUCKET_HISTOGRAM_SIZE 6
+
+static void
+ft_bucket_histogram_show(aim_pvs_t *pvs, const char *name,
+                         list_head_t *buckets, int bucket_count)
 {
-    return (murmur_hash(flow_id, sizeof(*flow_id), FT_HASH_SEED) %
-            ft->config.flow_id_bucket_count);
+    int histogram[FT_BUCKET_HISTOGRAM_SIZE] = { 0 };
+    int idx, len, cls, max_len = 0;
+
+    for (idx = 0; idx < bucket_count; idx++) {
+        len = list_length(&buckets[idx]);
+        for (cls = 0; cls < FT_BUCKET_HISTOGRAM_SIZE - 1 &&
+                 len >= (1 << cls); cls++) {
+        }
+        histogram[cls]++;
+        if (len > max_len) {
+            max_len = len;
+        }
+    }
+
+    aim_printf(pvs, "  %-13s %d buckets, max chain %d: "
+               "0:%d 1:%d 2-3:%d 4-7:%d 8-15:%d 16+:%d\n",
+               name, bucket_count, max_len,
+               histogram[0], histogram[1], histogram[2],
+               histogram[3], histogram[4], histogram[5]);
 }
 
-static int
-ft_cookie_to_bucket_index(ft_instance_t ft, uint64_t cookie)
+void
+ft_bucket_stats_show(ft_instance_t ft, aim_pvs_t *pvs)
 {
-    return cookie >> (64-FT_COOKIE_PREFIX_LEN);
+    aim_printf(pvs, "Bucket chain lengths:\n");
+    ft_bucket_histogram_show(pvs, "strict_match", ft->strict_match_buckets,
+                             ft->config.strict_match_bucket_count);
+    if (ft->strict_match_rehash.buckets != NULL) {
+        aim_printf(pvs, "    resizing from %d buckets, %d moved\n",
+                   ft->strict_match_rehash.bucket_count,
+                   ft->strict_match_rehash.next_bucket);
+    }
+    ft_bucket_histogram_show(pvs, "flow_id", ft->flow_id_buckets,
+                             ft->config.flow_id_bucket_count);
+    if (ft->flow_id_rehash.buckets != NULL) {
+        aim_printf(pvs, "    resizing from %d buckets, %d moved\n",
+                   ft->flow_id_rehash.bucket_count,
+                   ft->flow_id_rehash.next_bucket);
+    }
+    ft_bucket_histogram_show(pvs, "cookie", ft->cookie_buckets,
+                             1 << FT_COOKIE_PREFIX_LEN);
+    if (ft->cookie_range_buckets != NULL) {
+        ft_bucket_histogram_show(pvs, "cookie_range", ft->cookie_range_buckets,
+                                 ft->cookie_range_bucket_count);
+    }
+    ft_bucket_histogram_show(pvs, "priority", ft->priority_buckets,
+                             FT_PRIORITY_BUCKET_COUNT);
+    if (ft->lpm != NULL) {
+        ft_lpm_stats_show(ft->lpm, pvs);
+    }
+    if (ft->vlan_buckets != NULL) {
+        ft_bucket_histogram_show(pvs, "vlan", ft->vlan_buckets,
+                                 FT_VLAN_BUCKET_COUNT);
+        ft_bucket_histogram_show(pvs, "egress", ft->egress_buckets,
+                                 FT_EGRESS_BUCKET_COUNT);
+        aim_printf(pvs, "    %d L2 entries with several egresses\n",
+                   ft->l2_multi_egress_count);
+    }
+}
+
+indigo_error_t
+ft_checksum_buckets_set(ft_instance_t ft, uint8_t table_id,
+                        uint32_t bucket_count)
+{
+    ft_checksum_t *checksum = &ft->checksums[table_id];
+    list_links_t *cur;
+
+    if (bucket_count == 0 || (bucket_count & (bucket_count - 1)) != 0 ||
+            bucket_count > FT_CHECKSUM_BUCKETS_MAX) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    if (bucket_count == checksum->bucket_count) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    aim_free(checksum->buckets);
+    checksum->buckets = NULL;
+    checksum->bucket_count = bucket_count;
+    if (bucket_count == 1) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    checksum->buckets = aim_zmalloc(bucket_count * sizeof(*checksum->buckets));
+    checksum->shift = 64 - __builtin_ctz(bucket_count);
+
+    LIST_FOREACH(&ft->table_id_buckets[table_id], cur) {
+        ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, table_id);
+        checksum->buckets[entry->checksum >> checksum->shift] ^= entry->checksum;
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+ft_shared_t *
+ft_shared_create(void)
+{
+    ft_shared_t *shared = aim_zmalloc(sizeof(*shared));
+
+    shared->arena = ft_arena_create();
+    shared->refcount = 1;
+
+    return shared;
+}
+
+void
+ft_shared_release(ft_shared_t *shared)
+{
+    INDIGO_ASSERT(shared->refcount > 0);
+
+    if (--shared->refcount > 0) {
+        return;
+    }
+
+    ft_arena_destroy(shared->arena);
+    aim_free(shared);
 }
 
 ft_instance_t
 ft_create(ft_config_t *config)
+{
+    ft_shared_t *shared = ft_shared_create();
+    ft_instance_t ft = ft_create_shared(config, shared);
+
+    ft_shared_release(shared);
+
+    return ft;
+}
+
+ft_instance_t
+ft_create_shared(ft_config_t *config, ft_shared_t *shared)
 {
     ft_instance_t ft;
     int bytes;
@@ -78,21 +1220,17 @@ ft_create(ft_config_t *config)
     /* Allocate the flow table itself */
     ft = aim_zmalloc(sizeof(*ft));
     INDIGO_MEM_COPY(&ft->config,  config, sizeof(ft_config_t));
+    INDIGO_MEM_COPY(&ft->min_config,  config, sizeof(ft_config_t));
 
     list_init(&ft->all_list);
+    list_init(&ft->iterators);
+    list_init(&ft->retired);
+    ft->shared = shared;
+    shared->refcount++;
 
     /* Allocate and init buckets for each search type */
-    bytes = sizeof(list_head_t) * config->strict_match_bucket_count;
-    ft->strict_match_buckets = aim_zmalloc(bytes);
-    for (idx = 0; idx < config->strict_match_bucket_count; idx++) {
-        list_init(&ft->strict_match_buckets[idx]);
-    }
-
-    bytes = sizeof(list_head_t) * config->flow_id_bucket_count;
-    ft->flow_id_buckets = aim_zmalloc(bytes);
-    for (idx = 0; idx < config->flow_id_bucket_count; idx++) {
-        list_init(&ft->flow_id_buckets[idx]);
-    }
+    ft->strict_match_buckets = ft_buckets_alloc(config->strict_match_bucket_count);
+    ft->flow_id_buckets = ft_buckets_alloc(config->flow_id_bucket_count);
 
     bytes = sizeof(list_head_t) * (1 << FT_COOKIE_PREFIX_LEN);
     ft->cookie_buckets = aim_zmalloc(bytes);
@@ -100,6 +1238,50 @@ ft_create(ft_config_t *config)
         list_init(&ft->cookie_buckets[idx]);
     }
 
+    if (config->cookie_index_bits > 0) {
+        if (config->cookie_index_shift < 0 || config->cookie_index_bits > 64 ||
+                config->cookie_index_shift + config->cookie_index_bits > 64) {
+            LOG_ERROR("Invalid cookie index bits %d-%d, not indexing cookie range",
+                      config->cookie_index_shift,
+                      config->cookie_index_shift + config->cookie_index_bits - 1);
+        } else {
+            ft->cookie_range_mask = (config->cookie_index_bits == 64) ? ~(uint64_t)0 :
+                (((uint64_t)1 << config->cookie_index_bits) - 1) <<
+                config->cookie_index_shift;
+            /* No more buckets than distinct values */
+            ft->cookie_range_bucket_count = config->flow_id_bucket_count;
+            if (config->cookie_index_bits < 30 &&
+                    (1 << config->cookie_index_bits) < ft->cookie_range_bucket_count) {
+                ft->cookie_range_bucket_count = 1 << config->cookie_index_bits;
+            }
+            ft->cookie_range_buckets = ft_buckets_alloc(ft->cookie_range_bucket_count);
+        }
+    }
+
+    bytes = sizeof(list_head_t) * FT_PRIORITY_BUCKET_COUNT;
+    ft->priority_buckets = aim_zmalloc(bytes);
+    for (idx = 0; idx < FT_PRIORITY_BUCKET_COUNT; idx++) {
+        list_init(&ft->priority_buckets[idx]);
+    }
+
+    bytes = sizeof(list_head_t) * FT_TABLE_ID_BUCKET_COUNT;
+    ft->table_id_buckets = aim_zmalloc(bytes);
+    ft->tuple_buckets = aim_zmalloc(bytes);
+    for (idx = 0; idx < FT_TABLE_ID_BUCKET_COUNT; idx++) {
+        list_init(&ft->table_id_buckets[idx]);
+        list_init(&ft->tuple_buckets[idx]);
+        ft->checksums[idx].bucket_count = 1;
+    }
+
+    if (config->lpm_table_id > 0 && config->lpm_table_id < FT_TABLE_ID_BUCKET_COUNT) {
+        ft->lpm = ft_lpm_create(config->lpm_table_id);
+    }
+
+    if (config->l2_table_id > 0 && config->l2_table_id < FT_TABLE_ID_BUCKET_COUNT) {
+        ft->vlan_buckets = ft_buckets_alloc(FT_VLAN_BUCKET_COUNT);
+        ft->egress_buckets = ft_buckets_alloc(FT_EGRESS_BUCKET_COUNT);
+    }
+
     return ft;
 }
 
@@ -124,6 +1306,7 @@ ft_destroy(ft_instance_t ft)
 {
     ft_entry_t *entry;
     list_links_t *cur, *next;
+    int idx;
 
     if (ft == NULL) {
         return;
@@ -134,6 +1317,13 @@ ft_destroy(ft_instance_t ft)
         ft_entry_destroy(ft, entry);
     }
 
+    if (ft->rehash_task != NULL) {
+        /* The task frees itself on its next run */
+        ft->rehash_task->ft = NULL;
+    }
+    aim_free(ft->strict_match_rehash.buckets);
+    aim_free(ft->flow_id_rehash.buckets);
+
     if (ft->strict_match_buckets != NULL) {
         CHECK_BUCKETS(strict_match);
         aim_free(ft->strict_match_buckets);
@@ -148,7 +1338,41 @@ ft_destroy(ft_instance_t ft)
         aim_free(ft->cookie_buckets);
         ft->cookie_buckets = NULL;
     }
+    if (ft->cookie_range_buckets != NULL) {
+        aim_free(ft->cookie_range_buckets);
+        ft->cookie_range_buckets = NULL;
+    }
+    if (ft->priority_buckets != NULL) {
+        aim_free(ft->priority_buckets);
+        ft->priority_buckets = NULL;
+    }
+    if (ft->table_id_buckets != NULL) {
+        aim_free(ft->table_id_buckets);
+        ft->table_id_buckets = NULL;
+    }
+    if (ft->tuple_buckets != NULL) {
+        aim_free(ft->tuple_buckets);
+        ft->tuple_buckets = NULL;
+    }
+    ft_lpm_destroy(ft->lpm);
+    ft->lpm = NULL;
+    aim_free(ft->vlan_buckets);
+    ft->vlan_buckets = NULL;
+    aim_free(ft->egress_buckets);
+    ft->egress_buckets = NULL;
+
+    for (idx = 0; idx < FT_TABLE_ID_BUCKET_COUNT; idx++) {
+        aim_free(ft->checksums[idx].buckets);
+    }
+
+    /* Iterators still active are abandoned with the instance */
+    while (!list_empty(&ft->retired)) {
+        entry = FT_ENTRY_CONTAINER(list_first(&ft->retired), retired);
+        list_remove(&entry->retired_links);
+        ft_entry_free(ft, entry);
+    }
 
+    ft_shared_release(ft->shared);
     aim_free(ft);
 }
 
@@ -166,13 +1390,15 @@ ft_add(ft_instance_t ft, indigo_flow_id_t id,
         return INDIGO_ERROR_EXISTS;
     }
 
-    if ((rv = ft_entry_create(id, flow_add, &entry)) < 0) {
+    if ((rv = ft_entry_create(ft, id, flow_add, &entry)) < 0) {
         return rv;
     }
+    entry->checksum = ft_entry_checksum(ft, entry);
 
     ft_entry_link(ft, entry);
     ft->status.adds += 1;
     ft->status.current_count += 1;
+    ft_resize_check(ft);
 
     if (entry_p != NULL) {
         *entry_p = entry;
@@ -191,31 +1417,246 @@ ft_delete(ft_instance_t ft, ft_entry_t *entry)
 
     ft->status.current_count -= 1;
     ft->status.deletes += 1;
+    ft_resize_check(ft);
+}
+
+/* Search one strict match bucket */
+static ft_entry_t *
+ft_strict_match_bucket(list_head_t *bucket, of_meta_match_t *query,
+                       uint32_t fingerprint)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(bucket, cur) {
+        ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, strict_match);
+        /* Equal matches have equal encodings */
+        if (entry->match_fingerprint != fingerprint ||
+                entry->priority != query->priority) {
+            continue;
+        }
+        if (ft_entry_meta_match(query, entry)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+indigo_error_t
+ft_strict_match(ft_instance_t instance,
+               of_meta_match_t *query,
+               ft_entry_t **entry_ptr)
+{
+    int bucket_idx;
+    ft_match_buf_t match;
+    uint32_t fingerprint;
+    ft_rehash_t *rehash = &instance->strict_match_rehash;
+    ft_entry_t *entry;
+
+    INDIGO_ASSERT(query->mode == OF_MATCH_STRICT);
+
+    ft_match_encode(&query->match, &match.match);
+    fingerprint = ft_match_fingerprint(&match.match);
+    bucket_idx = ft_strict_match_to_bucket_index(instance, fingerprint,
+                                                 query->priority);
+
+    entry = ft_strict_match_bucket(&instance->strict_match_buckets[bucket_idx],
+                                   query, fingerprint);
+    if (entry == NULL && rehash->buckets != NULL) {
+        /* Not moved yet by a resize */
+        bucket_idx = ft_strict_match_hash(fingerprint, query->priority) %
+            rehash->bucket_count;
+        entry = ft_strict_match_bucket(&rehash->buckets[bucket_idx],
+                                       query, fingerprint);
+    }
+
+    if (entry == NULL) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    *entry_ptr = entry;
+    return INDIGO_ERROR_NONE;
+}
+
+/*
+ * Cheap test on the fields most often matched exactly. Returns true if
+ * the two matches cannot overlap because one of these fields is
+ * specified by both with conflicting values.
+ */
+static bool
+ft_match_exact_fields_conflict(of_match_t *a, of_match_t *b)
+{
+    uint32_t port_mask = a->masks.in_port & b->masks.in_port;
+    uint16_t vlan_mask = a->masks.vlan_vid & b->masks.vlan_vid;
+    int i;
+
+    if ((a->fields.in_port & port_mask) != (b->fields.in_port & port_mask)) {
+        return true;
+    }
+
+    if ((a->fields.vlan_vid & vlan_mask) != (b->fields.vlan_vid & vlan_mask)) {
+        return true;
+    }
+
+    for (i = 0; i < OF_MAC_ADDR_BYTES; i++) {
+        uint8_t mask = a->masks.eth_dst.addr[i] & b->masks.eth_dst.addr[i];
+        if ((a->fields.eth_dst.addr[i] & mask) !=
+                (b->fields.eth_dst.addr[i] & mask)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static indigo_error_t
+ft_overlap_find_bucket(ft_instance_t instance, of_meta_match_t *query,
+                       uint8_t table_id, ft_entry_t **entry_ptr)
+{
+    list_links_t *cur;
+    of_match_t match;
+    int bucket_idx = ft_priority_to_bucket_index(instance, table_id,
+                                                 query->priority);
+    list_head_t *bucket = &instance->priority_buckets[bucket_idx];
+    ft_entry_t *entry;
+    indigo_error_t rv;
+
+    /* A routing table may have thousands of prefixes at one priority */
+    if (instance->lpm != NULL && table_id == ft_lpm_table_id(instance->lpm) &&
+            ft_lpm_complete(instance->lpm)) {
+        rv = ft_lpm_overlap_find(instance->lpm, &query->match,
+                                 query->priority, &entry);
+        if (rv == INDIGO_ERROR_NOT_FOUND) {
+            return rv;
+        }
+        if (rv == INDIGO_ERROR_NONE && ft_entry_meta_match(query, entry)) {
+            *entry_ptr = entry;
+            return rv;
+        }
+    }
+
+    LIST_FOREACH(bucket, cur) {
+        entry = FT_ENTRY_CONTAINER(cur, priority);
+        if (entry->table_id != table_id ||
+                entry->priority != query->priority) {
+            continue;
+        }
+        ft_entry_match_get(entry, &match);
+        if (ft_match_exact_fields_conflict(&match, &query->match)) {
+            continue;
+        }
+        if (ft_entry_meta_match(query, entry)) {
+            *entry_ptr = entry;
+            return INDIGO_ERROR_NONE;
+        }
+    }
+
+    return INDIGO_ERROR_NOT_FOUND;
+}
+
+indigo_error_t
+ft_overlap_find(ft_instance_t instance,
+                of_meta_match_t *query,
+                ft_entry_t **entry_ptr)
+{
+    int table_id;
+
+    INDIGO_ASSERT(query->mode == OF_MATCH_OVERLAP);
+
+    if (query->table_id != TABLE_ID_ANY) {
+        return ft_overlap_find_bucket(instance, query, query->table_id,
+                                      entry_ptr);
+    }
+
+    for (table_id = 0; table_id < TABLE_ID_ANY; table_id++) {
+        if (ft_overlap_find_bucket(instance, query, table_id,
+                                   entry_ptr) == INDIGO_ERROR_NONE) {
+            return INDIGO_ERROR_NONE;
+        }
+    }
+
+    return INDIGO_ERROR_NOT_FOUND;
+}
+
+void
+ft_entry_table_id_set(ft_instance_t ft, ft_entry_t *entry, uint8_t table_id)
+{
+    int idx;
+
+    if (entry->table_id == table_id) {
+        return;
+    }
+
+    /* Keep iterators on the per-table lists from following the entry */
+    if (ft->priority_buckets) {
+        ft_iterators_entry_moving(ft, entry, offsetof(ft_entry_t, priority_links));
+    }
+    if (ft->table_id_buckets) {
+        ft_iterators_entry_moving(ft, entry, offsetof(ft_entry_t, table_id_links));
+    }
+    if (entry->l2_index & FT_L2_INDEX_VLAN) {
+        ft_iterators_entry_moving(ft, entry, offsetof(ft_entry_t, vlan_links));
+    }
+    if (entry->l2_index & FT_L2_INDEX_EGRESS) {
+        ft_iterators_entry_moving(ft, entry, offsetof(ft_entry_t, egress_links));
+    }
+
+    if (ft->priority_buckets) {
+        list_remove(&entry->priority_links);
+    }
+    if (ft->table_id_buckets) {
+        list_remove(&entry->table_id_links);
+    }
+    if (ft->tuple_buckets) {
+        ft_tuple_index_remove(ft, entry);
+    }
+    ft_l2_index_remove(ft, entry);
+    ft_checksum_update(ft, entry->table_id, entry->checksum);
+
+    entry->table_id = table_id;
+
+    ft_checksum_update(ft, entry->table_id, entry->checksum);
+
+    if (ft->priority_buckets) {
+        idx = ft_priority_to_bucket_index(ft, entry->table_id, entry->priority);
+        list_push(&ft->priority_buckets[idx], &entry->priority_links);
+    }
+    if (ft->table_id_buckets) {
+        list_push(&ft->table_id_buckets[entry->table_id],
+                  &entry->table_id_links);
+    }
+    if (ft->tuple_buckets) {
+        ft_tuple_index_add(ft, entry);
+    }
+    ft_l2_index_add(ft, entry);
 }
 
-indigo_error_t
-ft_strict_match(ft_instance_t instance,
-               of_meta_match_t *query,
-               ft_entry_t **entry_ptr)
+void
+ft_entry_move(ft_instance_t from, ft_instance_t to, ft_entry_t *entry,
+              uint8_t table_id)
 {
-    int bucket_idx;
-    list_links_t *cur;
+    uint64_t add_epoch = entry->add_epoch;
+    uint64_t counter_generation = entry->counter_generation;
 
-    INDIGO_ASSERT(query->mode == OF_MATCH_STRICT);
+    if (from == to) {
+        ft_entry_table_id_set(from, entry, table_id);
+        return;
+    }
 
-    bucket_idx = ft_strict_match_to_bucket_index(instance, &query->match,
-                                                 query->priority);
-    list_head_t *bucket = &instance->strict_match_buckets[bucket_idx];
+    INDIGO_ASSERT(from->shared == to->shared);
 
-    LIST_FOREACH(bucket, cur) {
-        ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, strict_match);
-        if (ft_entry_meta_match(query, entry)) {
-            *entry_ptr = entry;
-            return INDIGO_ERROR_NONE;
-        }
-    }
+    /* Unlinking advances the iterators of the old instance past it */
+    ft_entry_unlink(from, entry);
+    from->status.current_count -= 1;
+    ft_resize_check(from);
 
-    return INDIGO_ERROR_NOT_FOUND;
+    entry->table_id = table_id;
+
+    ft_entry_link(to, entry);
+    entry->add_epoch = add_epoch;
+    entry->counter_generation = counter_generation;
+    to->status.current_count += 1;
+    ft_resize_check(to);
 }
 
 ft_entry_t *
@@ -232,6 +1673,18 @@ ft_lookup(ft_instance_t ft, indigo_flow_id_t id)
         }
     }
 
+    if (ft->flow_id_rehash.buckets != NULL) {
+        /* Not moved yet by a resize */
+        bucket_idx = ft_flow_id_hash(&id) % ft->flow_id_rehash.bucket_count;
+        bucket = &ft->flow_id_rehash.buckets[bucket_idx];
+        LIST_FOREACH(bucket, cur) {
+            ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, flow_id);
+            if (entry->id == id) {
+                return entry;
+            }
+        }
+    }
+
     return NULL;
 }
 
@@ -239,6 +1692,7 @@ int
 ft_entry_meta_match(of_meta_match_t *query, ft_entry_t *entry)
 {
     uint64_t mask;
+    of_match_t match;
     int rv = 0; /* Default is no match */
 
     if ((mask = query->cookie_mask)) {
@@ -259,25 +1713,39 @@ ft_entry_meta_match(of_meta_match_t *query, ft_entry_t *entry)
         }
     }
 
+    if (query->mode != OF_MATCH_COOKIE_ONLY) {
+        ft_entry_match_get(entry, &match);
+    }
+
     switch (query->mode) {
     case OF_MATCH_NON_STRICT:
         /* Check if the entry's match is more specific than the query's */
-        if (!of_match_more_specific(&entry->match, &query->match)) {
+        if (!of_match_more_specific(&match, &query->match)) {
             break;
         }
         if (query->out_port != OF_PORT_DEST_WILDCARD) {
-            if (!ft_entry_has_out_port(entry, query->out_port)) {
+            if (!ft_entry_has_egress(entry, FT_EGRESS_PORT(query->out_port))) {
+                break;
+            }
+        }
+        if (query->check_out_group) {
+            if (!ft_entry_has_egress(entry, FT_EGRESS_GROUP(query->out_group))) {
                 break;
             }
         }
         rv = 1;
         break;
     case OF_MATCH_STRICT:
-        if (!of_match_eq(&entry->match, &query->match)) {
+        if (!of_match_eq(&match, &query->match)) {
             break;
         }
         if (query->out_port != OF_PORT_DEST_WILDCARD) {
-            if (!ft_entry_has_out_port(entry, query->out_port)) {
+            if (!ft_entry_has_egress(entry, FT_EGRESS_PORT(query->out_port))) {
+                break;
+            }
+        }
+        if (query->check_out_group) {
+            if (!ft_entry_has_egress(entry, FT_EGRESS_GROUP(query->out_group))) {
                 break;
             }
         }
@@ -288,7 +1756,7 @@ ft_entry_meta_match(of_meta_match_t *query, ft_entry_t *entry)
         rv = 1;
         break;
     case OF_MATCH_OVERLAP:
-        if (!of_match_overlap(&entry->match, &query->match)) {
+        if (!of_match_overlap(&match, &query->match)) {
             break;
         }
         rv = 1;
@@ -312,14 +1780,85 @@ ft_entry_modify_effects(ft_instance_t instance,
     LOG_TRACE("Modifying effects of entry " INDIGO_FLOW_ID_PRINTF_FORMAT,
               entry->id);
 
-    err = ft_entry_set_effects(entry, flow_mod);
+    err = ft_entry_set_effects(instance, entry, flow_mod);
     if (err == INDIGO_ERROR_NONE) {
+        if (entry->l2_index & FT_L2_INDEX_EGRESS) {
+            ft_iterators_entry_moving(instance, entry,
+                                      offsetof(ft_entry_t, egress_links));
+        }
+        ft_l2_egress_remove(instance, entry);
+        ft_l2_egress_add(instance, entry);
+
+        /* A controller modify confirms a restored entry */
+        entry->stale = 0;
         instance->status.updates += 1;
+        if (instance->config.content_checksums) {
+            ft_checksum_update(instance, entry->table_id, entry->checksum);
+            entry->checksum = ft_entry_content_checksum(entry);
+            ft_checksum_update(instance, entry->table_id, entry->checksum);
+        }
     }
 
     return err;
 }
 
+void
+ft_entry_overwrite(ft_instance_t instance,
+                   ft_entry_t *entry,
+                   of_flow_add_t *flow_add)
+{
+    uint64_t cookie;
+
+    LOG_TRACE("Overwriting entry " INDIGO_FLOW_ID_PRINTF_FORMAT, entry->id);
+
+    if (entry->idle_timeout || entry->hard_timeout) {
+        ind_core_expiration_remove(entry);
+    }
+
+    of_flow_add_cookie_get(flow_add, &cookie);
+    if (cookie != entry->cookie) {
+        if (instance->cookie_buckets) {
+            ft_iterators_entry_moving(instance, entry,
+                                      offsetof(ft_entry_t, cookie_links));
+            list_remove(&entry->cookie_links);
+        }
+        if (instance->cookie_range_buckets) {
+            ft_iterators_entry_moving(instance, entry,
+                                      offsetof(ft_entry_t, cookie_range_links));
+            list_remove(&entry->cookie_range_links);
+        }
+        entry->cookie = cookie;
+        if (instance->cookie_buckets) {
+            list_push(&instance->cookie_buckets[
+                ft_cookie_to_bucket_index(instance, cookie)], &entry->cookie_links);
+        }
+        if (instance->cookie_range_buckets) {
+            list_push(&instance->cookie_range_buckets[
+                ft_cookie_range_to_bucket_index(instance, cookie)],
+                &entry->cookie_range_links);
+        }
+
+        if (!instance->config.content_checksums) {
+            ft_checksum_update(instance, entry->table_id, entry->checksum);
+            entry->checksum = ft_entry_checksum(instance, entry);
+            ft_checksum_update(instance, entry->table_id, entry->checksum);
+        }
+    }
+
+    of_flow_add_idle_timeout_get(flow_add, &entry->idle_timeout);
+    of_flow_add_hard_timeout_get(flow_add, &entry->hard_timeout);
+
+    /* The overwritten flow's duration starts over, its counters do not */
+    entry->insert_time = INDIGO_LOOP_TIME;
+    entry->last_counter_change = entry->insert_time;
+    entry->stale = 0;
+    instance->status.overwrites += 1;
+
+    if (entry->idle_timeout || entry->hard_timeout) {
+        ind_core_expiration_add(entry);
+    }
+}
+
 /*
  * Flowtable iterator task
  *
@@ -334,20 +1873,102 @@ ft_entry_modify_effects(ft_instance_t instance,
 struct ft_iter_task_state {
     ft_iter_task_callback_f callback;
     void *cookie;
-    ft_iterator_t iter;
+    ft_iterator_t iter;     /* Over instances[next_instance - 1] */
+    bool started;           /* Whether 'iter' is initialized */
+    bool snapshot;
+    uint64_t epoch;         /* Entries added since are skipped in a snapshot */
+    bool use_query;
+    of_meta_match_t query;
+    int next_instance;
+    int instance_count;
+    indigo_cxn_id_t cxn_id; /* Reply connection, or -1 */
+    int priority;
+    ft_instance_t instances[];
 };
 
+/* How often a paused reply task checks whether its connection drained */
+#define FT_ITER_TASK_RESUME_MS 10
+
+static ind_soc_task_status_t ft_iter_task_callback(void *cookie);
+
+static int
+ft_iter_task_paused(struct ft_iter_task_state *state)
+{
+    return state->cxn_id >= 0 && indigo_cxn_send_congested(state->cxn_id);
+}
+
+static void
+ft_iter_task_resume(void *cookie)
+{
+    struct ft_iter_task_state *state = cookie;
+
+    if (ft_iter_task_paused(state)) {
+        return;
+    }
+
+    ind_soc_timer_event_unregister(ft_iter_task_resume, state);
+    if (ind_soc_task_register(ft_iter_task_callback, state,
+                              state->priority) != INDIGO_ERROR_NONE) {
+        /* Try again on the next tick */
+        LOG_ERROR("Failed to resume flowtable iter task");
+        ind_soc_timer_event_register(ft_iter_task_resume, state,
+                                     FT_ITER_TASK_RESUME_MS);
+    }
+}
+
+/* Next entry of the current instance, moving on to the next instance */
+static ft_entry_t *
+ft_iter_task_next(struct ft_iter_task_state *state)
+{
+    ft_entry_t *entry;
+
+    while (1) {
+        if (state->started) {
+            while ((entry = ft_iterator_next(&state->iter)) != NULL) {
+                if (!state->snapshot || entry->add_epoch < state->epoch) {
+                    return entry;
+                }
+            }
+            ft_iterator_cleanup(&state->iter);
+            state->started = false;
+        }
+
+        if (state->next_instance >= state->instance_count) {
+            return NULL;
+        }
+
+        ft_iterator_init(&state->iter, state->instances[state->next_instance++],
+                         state->use_query ? &state->query : NULL);
+        state->started = true;
+    }
+}
+
 static ind_soc_task_status_t
 ft_iter_task_callback(void *cookie)
 {
     struct ft_iter_task_state *state = cookie;
 
     do {
-        ft_entry_t *entry = ft_iterator_next(&state->iter);
+        ft_entry_t *entry;
+
+        if (ft_iter_task_paused(state)) {
+            /*
+             * The reply connection is past its high watermark. Stop the
+             * task rather than queue more output; the timer restarts it
+             * once the queue drains to the low watermark.
+             */
+            if (ind_soc_timer_event_register(ft_iter_task_resume, state,
+                                             FT_ITER_TASK_RESUME_MS) == INDIGO_ERROR_NONE) {
+                return IND_SOC_TASK_FINISHED;
+            }
+            /* No timer; carry on rather than stall the reply forever */
+            state->cxn_id = -1;
+        }
+
+        entry = ft_iter_task_next(state);
         if (entry == NULL) {
             /* Finished */
             state->callback(state->cookie, NULL);
-            ft_iterator_cleanup(&state->iter);
             aim_free(state);
             return IND_SOC_TASK_FINISHED;
         } else {
@@ -359,20 +1980,39 @@ ft_iter_task_callback(void *cookie)
 }
 
 indigo_error_t
-ft_spawn_iter_task(ft_instance_t instance,
-                   of_meta_match_t *query,
-                   ft_iter_task_callback_f callback,
-                   void *cookie,
-                   int priority)
+ft_spawn_instances_iter_task(ft_instance_t *instances,
+                             int count,
+                             of_meta_match_t *query,
+                             ft_iter_task_callback_f callback,
+                             void *cookie,
+                             int priority,
+                             indigo_cxn_id_t cxn_id)
 {
     indigo_error_t rv;
 
-    struct ft_iter_task_state *state = aim_malloc(sizeof(*state));
+    struct ft_iter_task_state *state =
+        aim_zmalloc(sizeof(*state) + count * sizeof(state->instances[0]));
 
     state->callback = callback;
     state->cookie = cookie;
+    state->cxn_id = cxn_id;
+    state->priority = priority;
+    state->instance_count = count;
+    INDIGO_MEM_COPY(state->instances, instances, count * sizeof(instances[0]));
+
+    if (query != NULL) {
+        state->query = *query;
+        state->use_query = true;
+    }
 
-    ft_iterator_init(&state->iter, instance, query);
+    if (cxn_id >= 0 && count > 0) {
+        /*
+         * A reply is a snapshot. The instances share their epochs, so
+         * entries added to any of them from now on are in a later epoch.
+         */
+        state->snapshot = true;
+        state->epoch = ++instances[0]->shared->epoch;
+    }
 
     rv = ind_soc_task_register(ft_iter_task_callback, state, priority);
     if (rv != INDIGO_ERROR_NONE) {
@@ -383,6 +2023,29 @@ ft_spawn_iter_task(ft_instance_t instance,
     return INDIGO_ERROR_NONE;
 }
 
+indigo_error_t
+ft_spawn_iter_task(ft_instance_t instance,
+                   of_meta_match_t *query,
+                   ft_iter_task_callback_f callback,
+                   void *cookie,
+                   int priority)
+{
+    return ft_spawn_instances_iter_task(&instance, 1, query, callback, cookie,
+                                        priority, -1);
+}
+
+indigo_error_t
+ft_spawn_reply_iter_task(ft_instance_t instance,
+                         of_meta_match_t *query,
+                         ft_iter_task_callback_f callback,
+                         void *cookie,
+                         int priority,
+                         indigo_cxn_id_t cxn_id)
+{
+    return ft_spawn_instances_iter_task(&instance, 1, query, callback, cookie,
+                                        priority, cxn_id);
+}
+
 static ft_entry_t *
 ft_iterator_links_to_entry(ft_iterator_t *iter, list_links_t *links)
 {
@@ -395,9 +2058,94 @@ ft_iterator_entry_to_links(ft_iterator_t *iter, ft_entry_t *entry)
     return (list_links_t *)(((char *)entry) + iter->links_offset);
 }
 
+/* Move an iterator about to return an entry on to the entry's successor */
+static void
+ft_iterator_skip(ft_iterator_t *iter, ft_entry_t *entry)
+{
+    list_links_t *links = ft_iterator_entry_to_links(iter, entry);
+
+    iter->next_entry = links->next == &iter->head->links ? NULL :
+        ft_iterator_links_to_entry(iter, links->next);
+}
+
+/*
+ * Keep iterators from following the given links of an entry about to move
+ * to another list by advancing those about to return it. Iterators only
+ * ever follow the links of live entries, so nothing else leads into the
+ * entry's old list.
+ */
+static void
+ft_iterators_entry_moving(ft_instance_t ft, ft_entry_t *entry, int links_offset)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(&ft->iterators, cur) {
+        ft_iterator_t *iter = container_of(cur, links, ft_iterator_t);
+        if (iter->next_entry == entry && iter->links_offset == links_offset) {
+            ft_iterator_skip(iter, entry);
+        }
+    }
+}
+
+/* Same as ft_iterators_entry_moving, for an entry leaving every list */
+static void
+ft_iterators_entry_unlinking(ft_instance_t ft, ft_entry_t *entry)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(&ft->iterators, cur) {
+        ft_iterator_t *iter = container_of(cur, links, ft_iterator_t);
+        if (iter->next_entry == entry) {
+            ft_iterator_skip(iter, entry);
+        }
+    }
+}
+
+/*
+ * Free the retired entries no active iterator is old enough to reach
+ */
+static void
+ft_retired_reclaim(ft_instance_t ft)
+{
+    uint64_t oldest = UINT64_MAX;
+    ft_iterator_t *iter;
+    ft_entry_t *entry;
+
+    if (!list_empty(&ft->iterators)) {
+        iter = container_of(list_first(&ft->iterators), links, ft_iterator_t);
+        oldest = iter->epoch;
+    }
+
+    while (!list_empty(&ft->retired)) {
+        entry = FT_ENTRY_CONTAINER(list_first(&ft->retired), retired);
+        if (entry->retire_epoch >= oldest) {
+            break;
+        }
+        list_remove(&entry->retired_links);
+        ft_entry_free(ft, entry);
+    }
+}
+
+/*
+ * Free an unlinked entry, or retire it if an iterator may reach it
+ */
+static void
+ft_entry_retire(ft_instance_t ft, ft_entry_t *entry)
+{
+    if (list_empty(&ft->iterators)) {
+        ft_entry_free(ft, entry);
+        return;
+    }
+
+    entry->retire_epoch = ft->shared->epoch;
+    list_push(&ft->retired, &entry->retired_links);
+}
+
 void
 ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query)
 {
+    bool use_prefix, use_range;
+
     if (query != NULL) {
         iter->query = *query;
         iter->use_query = true;
@@ -405,10 +2153,38 @@ ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query)
         iter->use_query = false;
     }
 
-    if (query && (query->cookie_mask & FT_COOKIE_PREFIX_MASK) == FT_COOKIE_PREFIX_MASK) {
+    use_prefix = query &&
+        (query->cookie_mask & FT_COOKIE_PREFIX_MASK) == FT_COOKIE_PREFIX_MASK;
+    use_range = query && ft->cookie_range_buckets != NULL &&
+        (query->cookie_mask & ft->cookie_range_mask) == ft->cookie_range_mask;
+
+    /* Use the more selective cookie index if both apply */
+    if (use_prefix && use_range &&
+            ft->config.cookie_index_bits <= FT_COOKIE_PREFIX_LEN) {
+        use_range = false;
+    }
+
+    if (use_range) {
+        /* Using cookie range bucket */
+        iter->head = &ft->cookie_range_buckets[
+            ft_cookie_range_to_bucket_index(ft, query->cookie)];
+        iter->links_offset = offsetof(ft_entry_t, cookie_range_links);
+    } else if (use_prefix) {
         /* Using cookie bucket */
         iter->head = &ft->cookie_buckets[ft_cookie_to_bucket_index(ft, query->cookie)];
         iter->links_offset = offsetof(ft_entry_t, cookie_links);
+    } else if (query && ft_l2_index_select(ft, query, iter)) {
+        /* Using VLAN or egress list of the L2 table */
+    } else if (query && query->check_priority &&
+               query->table_id != TABLE_ID_ANY) {
+        /* Using (table, priority) bucket */
+        iter->head = &ft->priority_buckets[
+            ft_priority_to_bucket_index(ft, query->table_id, query->priority)];
+        iter->links_offset = offsetof(ft_entry_t, priority_links);
+    } else if (query && query->table_id != TABLE_ID_ANY) {
+        /* Using per-table list */
+        iter->head = &ft->table_id_buckets[query->table_id];
+        iter->links_offset = offsetof(ft_entry_t, table_id_links);
     } else {
         iter->head = &ft->all_list;
         iter->links_offset = offsetof(ft_entry_t, table_links);
@@ -418,17 +2194,25 @@ ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query)
         iter->next_entry = NULL;
     } else {
         iter->next_entry = ft_iterator_links_to_entry(iter, iter->head->links.next);
-        list_push(&iter->next_entry->iterators, &iter->entry_links);
     }
+
+    iter->ft = ft;
+    iter->epoch = ++ft->shared->epoch;
+    iter->snapshot = false;
+    list_push(&ft->iterators, &iter->links);
+}
+
+void
+ft_iterator_init_snapshot(ft_iterator_t *iter, ft_instance_t ft,
+                          of_meta_match_t *query)
+{
+    ft_iterator_init(iter, ft, query);
+    iter->snapshot = true;
 }
 
 ft_entry_t *
 ft_iterator_next(ft_iterator_t *iter)
 {
-    if (iter->next_entry != NULL) {
-        list_remove(&iter->entry_links);
-    }
-
     while (iter->next_entry != NULL) {
         ft_entry_t *entry = iter->next_entry;
 
@@ -440,12 +2224,13 @@ ft_iterator_next(ft_iterator_t *iter)
             iter->next_entry = ft_iterator_links_to_entry(iter, next_links);
         }
 
-        if (iter->use_query && !ft_entry_meta_match(&iter->query, entry)) {
+        if (iter->snapshot && entry->add_epoch >= iter->epoch) {
+            /* Added after the iterator started */
             continue;
         }
 
-        if (iter->next_entry != NULL) {
-            list_push(&iter->next_entry->iterators, &iter->entry_links);
+        if (iter->use_query && !ft_entry_meta_match(&iter->query, entry)) {
+            continue;
         }
 
         return entry;
@@ -457,10 +2242,16 @@ ft_iterator_next(ft_iterator_t *iter)
 void
 ft_iterator_cleanup(ft_iterator_t *iter)
 {
-    if (iter->next_entry != NULL) {
-        list_remove(&iter->entry_links);
-        iter->next_entry = NULL;
+    ft_instance_t ft = iter->ft;
+
+    iter->next_entry = NULL;
+    if (ft == NULL) {
+        return;
     }
+
+    list_remove(&iter->links);
+    iter->ft = NULL;
+    ft_retired_reclaim(ft);
 }
 
 /**
@@ -481,7 +2272,8 @@ ft_entry_link(ft_instance_t ft, ft_entry_t *entry)
     list_push(&ft->all_list, &entry->table_links);
 
     if (ft->strict_match_buckets) { /* Strict match hash */
-        idx = ft_strict_match_to_bucket_index(ft, &entry->match, entry->priority);
+        idx = ft_strict_match_to_bucket_index(ft, entry->match_fingerprint,
+                                              entry->priority);
         list_push(&ft->strict_match_buckets[idx], &entry->strict_match_links);
     }
     if (ft->flow_id_buckets) { /* Flow ID hash */
@@ -492,8 +2284,26 @@ ft_entry_link(ft_instance_t ft, ft_entry_t *entry)
         idx = ft_cookie_to_bucket_index(ft, entry->cookie);
         list_push(&ft->cookie_buckets[idx], &entry->cookie_links);
     }
+    if (ft->cookie_range_buckets) { /* Cookie range */
+        idx = ft_cookie_range_to_bucket_index(ft, entry->cookie);
+        list_push(&ft->cookie_range_buckets[idx], &entry->cookie_range_links);
+    }
+    if (ft->priority_buckets) { /* Table and priority */
+        idx = ft_priority_to_bucket_index(ft, entry->table_id, entry->priority);
+        list_push(&ft->priority_buckets[idx], &entry->priority_links);
+    }
+    if (ft->table_id_buckets) { /* Table ID */
+        list_push(&ft->table_id_buckets[entry->table_id],
+                  &entry->table_id_links);
+    }
+    if (ft->tuple_buckets) { /* Packet match */
+        ft_tuple_index_add(ft, entry);
+    }
+    ft_l2_index_add(ft, entry); /* VLAN and egress */
+    ft_checksum_update(ft, entry->table_id, entry->checksum);
 
-    list_init(&entry->iterators);
+    entry->add_epoch = ft->shared->epoch;
+    entry->counter_generation = ft->shared->counter_generation + 1;
 
     if (entry->idle_timeout || entry->hard_timeout) {
         ind_core_expiration_add(entry);
@@ -514,22 +2324,22 @@ ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry)
 
     INDIGO_ASSERT(!list_empty(&ft->all_list));
 
-    /* Advance iterators pointing to this entry */
-    list_links_t *cur, *next;
-    LIST_FOREACH_SAFE(&entry->iterators, cur, next) {
-        ft_iterator_next(container_of(cur, entry_links, ft_iterator_t));
-    }
+    /* Advance iterators about to return this entry */
+    ft_iterators_entry_unlinking(ft, entry);
 
     /* Remove from full table iteration */
     list_remove(&entry->table_links);
 
     if (ft->strict_match_buckets) { /* Strict match hash */
-        INDIGO_ASSERT(!list_empty(&ft->strict_match_buckets[
-            ft_strict_match_to_bucket_index(ft, &entry->match, entry->priority)]));
+        INDIGO_ASSERT(ft->strict_match_rehash.buckets != NULL ||
+            !list_empty(&ft->strict_match_buckets[
+            ft_strict_match_to_bucket_index(ft, entry->match_fingerprint,
+                                            entry->priority)]));
         list_remove(&entry->strict_match_links);
     }
     if (ft->flow_id_buckets) { /* Flow ID hash */
-        INDIGO_ASSERT(!list_empty(&ft->flow_id_buckets[ft_flow_id_to_bucket_index(ft,
+        INDIGO_ASSERT(ft->flow_id_rehash.buckets != NULL ||
+            !list_empty(&ft->flow_id_buckets[ft_flow_id_to_bucket_index(ft,
             &entry->id)]));
         list_remove(&entry->flow_id_links);
     }
@@ -538,15 +2348,54 @@ ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry)
             entry->cookie)]));
         list_remove(&entry->cookie_links);
     }
+    if (ft->cookie_range_buckets) { /* Cookie range */
+        list_remove(&entry->cookie_range_links);
+    }
+    if (ft->priority_buckets) { /* Table and priority */
+        list_remove(&entry->priority_links);
+    }
+    if (ft->table_id_buckets) { /* Table ID */
+        INDIGO_ASSERT(!list_empty(&ft->table_id_buckets[entry->table_id]));
+        list_remove(&entry->table_id_links);
+    }
+    if (ft->tuple_buckets) { /* Packet match */
+        ft_tuple_index_remove(ft, entry);
+    }
+    ft_l2_index_remove(ft, entry); /* VLAN and egress */
+    ft_checksum_update(ft, entry->table_id, entry->checksum);
 
     if (entry->idle_timeout || entry->hard_timeout) {
         ind_core_expiration_remove(entry);
     }
 }
 
+/*
+ * Keep the serialized match of an entry, so replies copy it rather than
+ * serialize the match of every flow they carry
+ */
+static void
+ft_entry_match_wire_set(ft_instance_t ft, ft_entry_t *entry,
+                        const of_match_t *match)
+{
+    of_octets_t octets;
+
+    if (of_match_serialize(entry->match->version, (of_match_t *)match,
+                           &octets) != OF_ERROR_NONE) {
+        LOG_ERROR("Failed to serialize match of flow " INDIGO_FLOW_ID_PRINTF_FORMAT,
+                  INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+        return;
+    }
+
+    entry->match_wire = ft_arena_alloc(ft->shared->arena, octets.bytes);
+    memcpy(entry->match_wire, octets.data, octets.bytes);
+    entry->match_wire_len = octets.bytes;
+    FREE(octets.data);
+}
+
 /**
  * Allocate and initialize a new flowtable entry
  *
+ * @param ft The flow table the entry will be added to
  * @param id The flow ID to use
  * @param flow_add Pointer to the flow add object for the entry
  * @param_p entry Populated with pointer to new flowtable entry on success
@@ -554,32 +2403,51 @@ ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry)
  * The list links are not modified by this call.
  */
 static indigo_error_t
-ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry_p)
+ft_entry_create(ft_instance_t ft, indigo_flow_id_t id, of_flow_add_t *flow_add,
+                ft_entry_t **entry_p)
 {
     indigo_error_t err;
     ft_entry_t *entry;
+    of_match_t storage;
+    const of_match_t *match;
+    ft_match_buf_t encoded;
+
+    /* Usually already decoded by the flow-mod handler */
+    match = indigo_core_flow_mod_match_get(flow_add, &storage);
+    if (match == NULL) {
+        return INDIGO_ERROR_UNKNOWN;
+    }
+    ft_match_encode(match, &encoded.match);
 
-    entry = aim_zmalloc(sizeof(*entry));
+    entry = ft_entry_alloc(ft);
 
     entry->id = id;
+    list_init(&entry->group_refs);
 
-    if (of_flow_add_match_get(flow_add, &entry->match) < 0) {
-        aim_free(entry);
-        return INDIGO_ERROR_UNKNOWN;
-    }
+    entry->match = ft_arena_alloc(ft->shared->arena, FT_MATCH_BYTES(encoded.match.count));
+    memcpy(entry->match, &encoded.match, FT_MATCH_BYTES(encoded.match.count));
+    entry->match_fingerprint = ft_match_fingerprint(entry->match);
+    ft_entry_match_wire_set(ft, entry, match);
     of_flow_add_cookie_get(flow_add, &entry->cookie);
     of_flow_add_priority_get(flow_add, &entry->priority);
     of_flow_add_flags_get(flow_add, &entry->flags);
     of_flow_add_idle_timeout_get(flow_add, &entry->idle_timeout);
     of_flow_add_hard_timeout_get(flow_add, &entry->hard_timeout);
+    if (flow_add->version >= OF_VERSION_1_1) {
+        /* May be changed by the forwarding layer, see ft_entry_table_id_set */
+        of_flow_add_table_id_get(flow_add, &entry->table_id);
+    }
 
-    err = ft_entry_set_effects(entry, flow_add);
+    err = ft_entry_set_effects(ft, entry, flow_add);
     if (err != INDIGO_ERROR_NONE) {
-        aim_free(entry);
+        ft_arena_free(ft->shared->arena, entry->match,
+                      FT_MATCH_BYTES(entry->match->count));
+        ft_arena_free(ft->shared->arena, entry->match_wire, entry->match_wire_len);
+        ft_entry_free(ft, entry);
         return err;
     }
 
-    entry->insert_time = INDIGO_CURRENT_TIME;
+    entry->insert_time = INDIGO_LOOP_TIME;
     entry->last_counter_change = entry->insert_time;
 
     *entry_p = entry;
@@ -597,96 +2465,167 @@ ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry
 static void
 ft_entry_destroy(ft_instance_t ft, ft_entry_t *entry)
 {
-    if (entry->effects.actions != NULL) {
-        of_list_action_delete(entry->effects.actions);
-        entry->effects.actions = NULL;
-    }
+    ind_core_group_flow_unref(entry);
+
+    ft_effects_release(ft, entry->shared_effects);
+    entry->shared_effects = NULL;
+    entry->effects.actions = NULL;
 
-    aim_free(entry);
+    ft_arena_free(ft->shared->arena, entry->match,
+                  FT_MATCH_BYTES(entry->match->count));
+    ft_arena_free(ft->shared->arena, entry->match_wire, entry->match_wire_len);
+    ft_entry_retire(ft, entry);
 }
 
 /* Populate the output port list and effects */
 static indigo_error_t
-ft_entry_set_effects(ft_entry_t *entry,
-                    of_flow_modify_t *flow_mod)
+ft_entry_set_effects(ft_instance_t ft, ft_entry_t *entry,
+                     of_flow_modify_t *flow_mod)
 {
+    of_object_t *list;
+    ft_effects_t *effects;
+
     if (flow_mod->version == OF_VERSION_1_0)
     {
-        of_list_action_t *actions;
-        if ((actions = of_flow_modify_actions_get(flow_mod)) == NULL) {
+        if ((list = of_flow_modify_actions_get(flow_mod)) == NULL) {
             LOG_ERROR("Could not get action list");
             return INDIGO_ERROR_RESOURCE;
         }
-        of_list_action_delete(entry->effects.actions);
-        entry->effects.actions = actions;
     } else {
-        of_list_instruction_t *instructions;
-        if ((instructions = of_flow_modify_instructions_get(flow_mod)) == NULL) {
+        if ((list = of_flow_modify_instructions_get(flow_mod)) == NULL) {
             LOG_ERROR("Could not get instruction list");
             return INDIGO_ERROR_RESOURCE;
         }
-        of_list_instruction_delete(entry->effects.instructions);
-        entry->effects.instructions = instructions;
     }
 
+    effects = ft_effects_intern(ft, list);
+    ft_effects_release(ft, entry->shared_effects);
+    entry->shared_effects = effects;
+    entry->effects.actions = effects->list;
+
+    ind_core_group_flow_unref(entry);
+    ind_core_group_flow_ref(entry);
+
     return INDIGO_ERROR_NONE;
 }
 
-static int
-action_list_has_out_port(of_list_action_t *actions, of_port_no_t port)
+/* The egress key of a forwarding action, or 0 */
+static uint64_t
+action_egress(of_action_t *act)
 {
-    of_action_t act;
-    int loop_rv;
-    of_port_no_t out_port;
-
-    OF_LIST_ACTION_ITER(actions, &act, loop_rv) {
-        if (act.header.object_id == OF_ACTION_OUTPUT) {
-            of_action_output_port_get(&act.output, &out_port);
-            if (out_port == port) {
-                return 1;
-            }
-        }
+    of_port_no_t port;
+    uint32_t group_id;
+
+    if (act->header.object_id == OF_ACTION_OUTPUT) {
+        of_action_output_port_get(&act->output, &port);
+        return FT_EGRESS_PORT(port);
+    } else if (act->header.object_id == OF_ACTION_GROUP) {
+        of_action_group_group_id_get(&act->group, &group_id);
+        return FT_EGRESS_GROUP(group_id);
     }
 
     return 0;
 }
 
-static int
-instruction_list_has_out_port(of_list_instruction_t *instructions, of_port_no_t port)
+/*
+ * Call the callback with the egress key of each output and group action
+ * of the effects, until it returns false
+ */
+static void
+ft_entry_egress_foreach(ft_entry_t *entry,
+                        bool (*callback)(void *cookie, uint64_t egress),
+                        void *cookie)
 {
+    of_list_action_t actions;
     of_instruction_t inst;
-    int loop_rv;
+    of_action_t act;
+    int loop_rv, act_rv;
+    uint64_t egress;
+
+    if (entry->effects.actions->version == OF_VERSION_1_0) {
+        OF_LIST_ACTION_ITER(entry->effects.actions, &act, act_rv) {
+            if ((egress = action_egress(&act)) != 0 && !callback(cookie, egress)) {
+                return;
+            }
+        }
+        return;
+    }
 
-    OF_LIST_INSTRUCTION_ITER(instructions, &inst, loop_rv) {
+    OF_LIST_INSTRUCTION_ITER(entry->effects.instructions, &inst, loop_rv) {
         if (inst.header.object_id == OF_INSTRUCTION_APPLY_ACTIONS) {
-            of_list_action_t actions;
             of_instruction_apply_actions_actions_bind(&inst.apply_actions, &actions);
-            if (action_list_has_out_port(&actions, port)) {
-                return 1;
-            }
         } else if (inst.header.object_id == OF_INSTRUCTION_WRITE_ACTIONS) {
-            of_list_action_t actions;
             of_instruction_write_actions_actions_bind(&inst.write_actions, &actions);
-            if (action_list_has_out_port(&actions, port)) {
-                return 1;
+        } else {
+            continue;
+        }
+        OF_LIST_ACTION_ITER(&actions, &act, act_rv) {
+            if ((egress = action_egress(&act)) != 0 && !callback(cookie, egress)) {
+                return;
             }
         }
     }
+}
 
-    return 0;
+struct ft_egress_find_s {
+    uint64_t egress;
+    int count;
+};
+
+static bool
+ft_egress_find_cb(void *cookie, uint64_t egress)
+{
+    struct ft_egress_find_s *find = cookie;
+
+    if (egress == find->egress) {
+        find->count = 1;
+        return false;
+    }
+
+    return true;
 }
 
 /**
- * Determine if the given entry has port as an output port
+ * Determine if the given entry outputs to a port or group
  */
 static int
-ft_entry_has_out_port(ft_entry_t *entry, of_port_no_t port)
+ft_entry_has_egress(ft_entry_t *entry, uint64_t egress)
 {
-    if (entry->effects.actions->version == OF_VERSION_1_0) {
-        return action_list_has_out_port(entry->effects.actions, port);
-    } else {
-        return instruction_list_has_out_port(entry->effects.instructions, port);
+    struct ft_egress_find_s find = { egress, 0 };
+
+    ft_entry_egress_foreach(entry, ft_egress_find_cb, &find);
+
+    return find.count;
+}
+
+static bool
+ft_egress_count_cb(void *cookie, uint64_t egress)
+{
+    struct ft_egress_find_s *find = cookie;
+
+    if (find->count == 0) {
+        find->egress = egress;
+        find->count = 1;
+    } else if (egress != find->egress) {
+        /* Two is enough to rule out the egress index */
+        find->count = 2;
+        return false;
     }
 
-    return 0;
+    return true;
+}
+
+/**
+ * Count the distinct ports and groups the given entry outputs to, up to 2
+ * @param egress (out) The first of them
+ */
+static int
+ft_entry_egress_count(ft_entry_t *entry, uint64_t *egress)
+{
+    struct ft_egress_find_s find = { 0, 0 };
+
+    ft_entry_egress_foreach(entry, ft_egress_count_cb, &find);
+    *egress = find.egress;
+
+    return find.count;
 }
@@ -52,6 +52,7 @@
 #include <loci/loci.h>
 #include <BigList/biglist.h>
 #include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
 #include <stdbool.h>
 
 #include "ft_entry.h"
@@ -62,11 +63,41 @@
 #define FT_COOKIE_PREFIX_LEN 8
 #define FT_COOKIE_PREFIX_MASK (~(uint64_t)0 << (64-FT_COOKIE_PREFIX_LEN))
 
+/**
+ * Number of buckets for the (table_id, priority) index used by overlap checks.
+ */
+#define FT_PRIORITY_BUCKET_COUNT 4096
+
+/**
+ * Number of per-table lists; indexed directly by table ID.
+ */
+#define FT_TABLE_ID_BUCKET_COUNT 256
+
+/**
+ * Buckets of the L2 table index: one per VLAN ID, and hashed by egress.
+ */
+#define FT_VLAN_BUCKET_COUNT 4096
+#define FT_EGRESS_BUCKET_COUNT 4096
+
+/**
+ * Resizing of the strict match and flow ID indexes.
+ *
+ * An index doubles when it holds more than FT_HASH_MAX_LOAD entries per
+ * bucket, and halves, down to the configured size, below one entry per
+ * FT_HASH_SHRINK_DIVISOR buckets. The entries move to the new buckets
+ * FT_REHASH_BUCKETS_PER_STEP old buckets at a time in a SocketManager task;
+ * lookups search both bucket arrays until the move is complete.
+ */
+#define FT_HASH_MAX_LOAD 2
+#define FT_HASH_SHRINK_DIVISOR 8
+#define FT_REHASH_BUCKETS_PER_STEP 16
+
 /**
  * Forward declaration of flowtable handle for other typedefs
  */
 
 typedef struct ft_public_s ft_public_t;
+typedef struct ft_arena_s ft_arena_t;
 
 /**
  * A handle is a pointer to an instance.
@@ -74,6 +105,27 @@ typedef struct ft_public_s ft_public_t;
 
 typedef ft_public_t *ft_instance_t;
 
+/**
+ * State common to flow table instances that exchange entries
+ *
+ * Entries are allocated from the arena, and stamped with the epoch and
+ * counter generation, of the shared state rather than of their instance,
+ * so an entry can move to another instance sharing it (see
+ * ft_entry_move) and iterators of the instances agree on which entries
+ * are older. See ft_create_shared.
+ *
+ * This should be treated as read-only outside of the
+ * flow table instance implementation
+ */
+
+typedef struct ft_shared_s {
+    ft_arena_t *arena;             /* Entries, matches and shared effects */
+    uint64_t epoch;                /* Epoch of the newest iterator */
+    uint64_t counter_generation;   /* Generation of the newest changed-only
+                                      flow stats request */
+    int refcount;                  /* Instances and other owners */
+} ft_shared_t;
+
 /****************************************************************
  * Managing a flow table instance: Configuration, status, handle
  ****************************************************************/
@@ -83,11 +135,29 @@ typedef ft_public_t *ft_instance_t;
  * @param max_entries Maximum number of entries to support
  * @param strict_match_bucket_count How many buckets for strict_match hash table
  * @param flow_id_bucket_count How many buckets for flow_id hash table
+ * @param cookie_index_shift Lowest cookie bit covered by the cookie range index
+ * @param cookie_index_bits Number of cookie bits covered by the cookie range
+ * index; 0 for no cookie range index
+ * @param content_checksums Boolean, checksum flows by their contents
+ * rather than their cookies; see ft_checksum_t
+ * @param lpm_table_id Table indexed by destination prefix; 0 for none.
+ * See ft_lpm.h
+ * @param l2_table_id Table indexed by VLAN ID and by egress; 0 for none.
+ * See ft_entry_t.egress
+ *
+ * The cookie range index hashes the given bits of the cookie, for
+ * controllers that keep an application or tenant ID in a field of the
+ * cookie other than the top FT_COOKIE_PREFIX_LEN bits.
  */
 
 typedef struct ft_config_s {
     int strict_match_bucket_count;
     int flow_id_bucket_count;
+    int cookie_index_shift;
+    int cookie_index_bits;
+    int content_checksums;
+    int lpm_table_id;
+    int l2_table_id;
 } ft_config_t;
 
 /**
@@ -101,10 +171,12 @@ typedef struct ft_config_s {
  * @param idle_expires Number of idle timeouts
  * @param updates Number of calls that modified a flow entry, e.g.
  * effects_modify.
+ * @param overwrites Number of adds that replaced an entry in place
  * @param table_full_errors Number of adds that failed due to no space
  * in the table.
  * @param forwarding_add_errors Number of adds that failed due to a
  * failure in the forwarding layer.
+ * @param index_resizes Number of times a hash index was resized
  */
 
 typedef struct ft_status_s {
@@ -114,10 +186,80 @@ typedef struct ft_status_s {
     uint64_t hard_expires;
     uint64_t idle_expires;
     uint64_t updates;
+    uint64_t overwrites;
     uint64_t table_full_errors;
     uint64_t forwarding_add_errors;
+    uint64_t index_resizes;
 } ft_status_t;
 
+/**
+ * The old buckets of an index being resized
+ * @param buckets Bucket array being emptied; NULL if no resize is in progress
+ * @param bucket_count Number of buckets in the old array
+ * @param next_bucket Next old bucket to move
+ */
+
+typedef struct ft_rehash_s {
+    list_head_t *buckets;
+    int bucket_count;
+    int next_bucket;
+} ft_rehash_t;
+
+/* Largest checksum bucket count a controller may set for a table */
+#define FT_CHECKSUM_BUCKETS_MAX (1 << 20)
+
+/**
+ * Flow checksums of one table
+ * @param checksum XOR of the checksums of the flows in the table
+ * @param buckets Same, per bucket indexed by the top checksum bits; NULL
+ * when the table is a single bucket
+ * @param bucket_count Number of buckets, a power of 2
+ * @param shift Right shift from a checksum to its bucket index
+ *
+ * By default a flow's checksum is its cookie: as with the BSN flow
+ * checksum extension, the controller chooses cookies that are checksums
+ * of the flow contents, and the differing buckets are cookie ranges it
+ * can dump with a cookie-masked flow stats request.
+ *
+ * With content_checksums the agent computes the checksum itself, as the
+ * 64 bit FNV-1a hash of the priority (network byte order), the wire
+ * encoding of the match and then that of the actions or instructions.
+ * A controller that computes the same hash can verify the table without
+ * encoding checksums in its cookies.
+ */
+
+typedef struct ft_checksum_s {
+    uint64_t checksum;
+    uint64_t *buckets;
+    uint32_t bucket_count;
+    uint8_t shift;
+} ft_checksum_t;
+
+/**
+ * A tuple of the packet match index
+ * @param links In the tuple list of the table, by descending max_priority
+ * @param masked Bit i is set if word i of the masks is non-zero
+ * @param count Number of bits set in masked
+ * @param max_priority Upper bound on the priorities of the entries
+ * @param entries The entries, hashed by their masked fields
+ * @param masks The non-zero mask words, in word order
+ *
+ * Every flow in a tuple masks the same bits, so a packet is looked up in
+ * a tuple with one hash probe. Packet matching probes the tuples of a
+ * table in order and stops at the first tuple whose max_priority is below
+ * the best match so far. max_priority is not lowered when entries are
+ * removed; it is still a bound, and the tuple is freed once empty.
+ */
+
+typedef struct ft_tuple_s {
+    list_links_t links;
+    uint64_t masked;
+    uint16_t max_priority;
+    uint8_t count;
+    bighash_table_t *entries;
+    uint64_t masks[FT_MATCH_WORDS];
+} ft_tuple_t;
+
 /**
  * The public view of the instance for easier dereference
  *
@@ -125,14 +267,40 @@ typedef struct ft_status_s {
  * flow table instance implementation
  */
 struct ft_public_s {
-    ft_config_t config;
+    ft_config_t config;            /* Current index sizes */
+    ft_config_t min_config;        /* Configured index sizes */
     ft_status_t status;
 
     list_head_t all_list;          /* Single list of all current entries */
 
+    list_head_t iterators;         /* Active iterators, oldest first */
+    list_head_t retired;           /* Deleted entries not yet freed, oldest
+                                      first */
+    ft_shared_t *shared;           /* Arena, epoch and counter generation */
+
     list_head_t *strict_match_buckets;  /* Array of strict match based buckets */
     list_head_t *flow_id_buckets;  /* Array of flow_id based buckets */
     list_head_t *cookie_buckets;   /* Array of cookie (prefix) based buckets */
+    list_head_t *cookie_range_buckets; /* Array of cookie range based buckets,
+                                          NULL without a cookie range index */
+    int cookie_range_bucket_count;
+    uint64_t cookie_range_mask;    /* Cookie bits covered by the range index */
+    list_head_t *priority_buckets; /* Array of (table_id, priority) based buckets */
+    list_head_t *table_id_buckets; /* Array of per-table_id lists */
+    list_head_t *tuple_buckets;    /* Array of per-table_id tuple lists */
+    struct ft_lpm_s *lpm;          /* Prefix index of config.lpm_table_id,
+                                      NULL without one */
+    list_head_t *vlan_buckets;     /* Entries of config.l2_table_id by VLAN ID,
+                                      NULL without an L2 table */
+    list_head_t *egress_buckets;   /* Entries of config.l2_table_id by egress */
+    int l2_multi_egress_count;     /* L2 table entries with several egresses,
+                                      which are not in egress_buckets */
+
+    ft_rehash_t strict_match_rehash;
+    ft_rehash_t flow_id_rehash;
+    struct ft_rehash_task_s *rehash_task; /* NULL if no task is running */
+
+    ft_checksum_t checksums[FT_TABLE_ID_BUCKET_COUNT]; /* Per table */
 };
 
 #define FT_CONFIG(_ft) (&(_ft)->config)
@@ -143,13 +311,23 @@ struct ft_public_s {
  *
  * See ft_iterator_init, ft_iterator_next, and ft_iterator_cleanup.
  *
+ * Each iterator starts a new epoch. An iterator about to return an entry
+ * that is deleted, or that moves to another list, is advanced past it, so
+ * iterators only follow the links of live entries. A deleted entry is
+ * still not freed while iterators are active, since the entries they
+ * returned may be held across a yield; it is freed once every iterator of
+ * its epoch or older has been cleaned up.
+ *
  * This struct should be treated as opaque.
  */
 typedef struct ft_iterator_s {
     list_head_t *head;             /* List head for this iteration */
     ft_entry_t *next_entry;        /* Entry to be returned on next() */
     int links_offset;              /* Offset of the links we're using in the flowtable entry */
-    list_links_t entry_links;      /* Linked into next_entry->iterators if next_entry != NULL */
+    ft_instance_t ft;              /* Instance, NULL once cleaned up */
+    list_links_t links;            /* In the instance's iterator list */
+    uint64_t epoch;                /* Epoch started by this iterator */
+    bool snapshot;                 /* Skip entries added in later epochs */
     bool use_query;                /* Whether 'query' is valid */
     of_meta_match_t query;         /* Optional query to filter by */
 } ft_iterator_t;
@@ -184,6 +362,30 @@ typedef struct ft_iterator_s {
 
 ft_instance_t ft_create(ft_config_t *config);
 
+/**
+ * Create state to be shared by flow table instances
+ *
+ * The caller holds a reference; see ft_shared_release.
+ */
+
+ft_shared_t *ft_shared_create(void);
+
+/**
+ * Drop a reference to shared state, freeing it with the last one
+ */
+
+void ft_shared_release(ft_shared_t *shared);
+
+/**
+ * Create a flow table instance using the given shared state
+ *
+ * Same as ft_create, except that entries are allocated from, and
+ * stamped by, 'shared'. The instance holds a reference to it until
+ * ft_destroy.
+ */
+
+ft_instance_t ft_create_shared(ft_config_t *config, ft_shared_t *shared);
+
 /**
  * Delete a flow table instance and free resources
  * @param ft A handle for the flow table instance to be deleted
@@ -230,6 +432,64 @@ indigo_error_t ft_strict_match(ft_instance_t instance,
                                of_meta_match_t *query,
                                ft_entry_t **entry_ptr);
 
+/**
+ * Query the flow table for an entry overlapping the query
+ * @param ft Handle for a flow table instance
+ * @param query The meta-match data for the query (OF_MATCH_OVERLAP)
+ * @param entry_ptr (out) Pointer to where to store the result if found
+ * @returns INDIGO_ERROR_NONE if found; otherwise INDIGO_ERROR_NOT_FOUND
+ *
+ * Only entries with the same table ID and priority are examined.
+ */
+
+indigo_error_t ft_overlap_find(ft_instance_t instance,
+                               of_meta_match_t *query,
+                               ft_entry_t **entry_ptr);
+
+/**
+ * Set the table ID of an entry already in the flow table
+ * @param ft The flow table handle
+ * @param entry Pointer to the entry to update
+ * @param table_id Table the forwarding layer placed the entry in
+ */
+
+void ft_entry_table_id_set(ft_instance_t ft, ft_entry_t *entry,
+                           uint8_t table_id);
+
+/**
+ * Move an entry to another flow table instance
+ * @param from The instance holding the entry
+ * @param to The instance to move it to; may be from
+ * @param entry Pointer to the entry to move
+ * @param table_id Table ID of the entry in its new instance
+ *
+ * The instances must share their state (see ft_create_shared). The
+ * entry keeps its address, ID, counters and epochs. Iterators of the
+ * old instance skip it from then on. Neither instance counts an add or
+ * a delete.
+ */
+
+void ft_entry_move(ft_instance_t from, ft_instance_t to, ft_entry_t *entry,
+                   uint8_t table_id);
+
+/**
+ * Find the flow a packet matches in a table
+ * @param ft The flow table handle
+ * @param table_id The table to search
+ * @param fields The packet fields
+ * @param known Mask of the fields that were set from the packet, or NULL
+ * if all were
+ * @param entry_ptr (out) The highest priority matching entry
+ * @returns INDIGO_ERROR_NONE if found; INDIGO_ERROR_NOT_FOUND if no entry
+ * matches; INDIGO_ERROR_NOT_SUPPORTED if an entry that would take priority
+ * over any match found matches on a field outside of known
+ */
+
+indigo_error_t ft_packet_match(ft_instance_t ft, uint8_t table_id,
+                               const of_match_fields_t *fields,
+                               const of_match_fields_t *known,
+                               ft_entry_t **entry_ptr);
+
 /**
  * Look up a flow by ID
  *
@@ -254,6 +514,21 @@ ft_entry_modify_effects(ft_instance_t instance,
                         ft_entry_t *entry,
                         of_flow_modify_t *flow_mod);
 
+/**
+ * Overwrite a flow entry in the table with an add of the same match
+ * @param ft The flow table handle
+ * @param entry Pointer to the entry to update
+ * @param flow_add The LOCI flow add object replacing the entry
+ *
+ * The cookie and timeouts are taken from the add and the duration is
+ * restarted. The effects are left alone; see ft_entry_modify_effects.
+ */
+
+void
+ft_entry_overwrite(ft_instance_t instance,
+                   ft_entry_t *entry,
+                   of_flow_add_t *flow_add);
+
 /*
  * Spawn a task that iterates over the flowtable
  *
@@ -282,6 +557,49 @@ ft_spawn_iter_task(ft_instance_t instance,
                    void *cookie,
                    int priority);
 
+/**
+ * Spawn a task that iterates over the flowtable to build a reply
+ *
+ * Same as ft_spawn_iter_task, except that the task pauses while the
+ * output queue of connection 'cxn_id' is congested (see
+ * indigo_cxn_send_congested) and resumes once it has drained. Use for
+ * multipart replies, which can otherwise queue the whole flowtable.
+ *
+ * The iteration is a snapshot (see ft_iterator_init_snapshot), so a
+ * statistics reply covers the flows as of the request even though
+ * flow-mods keep being applied while it is built.
+ */
+
+indigo_error_t
+ft_spawn_reply_iter_task(ft_instance_t instance,
+                         of_meta_match_t *query,
+                         ft_iter_task_callback_f callback,
+                         void *cookie,
+                         int priority,
+                         indigo_cxn_id_t cxn_id);
+
+/**
+ * Spawn a task that iterates over several flowtables in turn
+ *
+ * @param instances The instances, which must share their state
+ * @param count Number of instances; may be 0
+ * @param cxn_id Reply connection, or -1
+ *
+ * Same as ft_spawn_iter_task over each instance in the order given, or
+ * as ft_spawn_reply_iter_task if 'cxn_id' is a connection. The snapshot
+ * of a reply covers all the instances as of the call. The array is
+ * copied.
+ */
+
+indigo_error_t
+ft_spawn_instances_iter_task(ft_instance_t *instances,
+                             int count,
+                             of_meta_match_t *query,
+                             ft_iter_task_callback_f callback,
+                             void *cookie,
+                             int priority,
+                             indigo_cxn_id_t cxn_id);
+
 /**
  * Initialize a flowtable iterator
  *
@@ -296,6 +614,17 @@ ft_spawn_iter_task(ft_instance_t instance,
 void
 ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query);
 
+/**
+ * Initialize a flowtable iterator over the flows present now
+ *
+ * Same as ft_iterator_init, except that flows added during the iteration
+ * are never returned. Flows deleted during the iteration are not returned
+ * either, and the fields of a flow are as of when it is returned.
+ */
+void
+ft_iterator_init_snapshot(ft_iterator_t *iter, ft_instance_t ft,
+                          of_meta_match_t *query);
+
 /**
  * Yield the next entry from an iterator
  *
@@ -310,4 +639,40 @@ ft_iterator_next(ft_iterator_t *iter);
 void
 ft_iterator_cleanup(ft_iterator_t *iter);
 
+/**
+ * Show the bucket chain length histograms of the flow table indexes
+ */
+void
+ft_bucket_stats_show(ft_instance_t ft, aim_pvs_t *pvs);
+
+/**
+ * Set the number of checksum buckets of a table
+ * @param ft The flow table instance
+ * @param table_id The table
+ * @param bucket_count A power of 2, at most FT_CHECKSUM_BUCKETS_MAX
+ *
+ * The bucket checksums are recomputed from the flows in the table.
+ */
+indigo_error_t
+ft_checksum_buckets_set(ft_instance_t ft, uint8_t table_id,
+                        uint32_t bucket_count);
+
+/**
+ * Checksum of a bucket of a table
+ */
+static inline uint64_t
+ft_checksum_bucket_get(ft_instance_t ft, uint8_t table_id, uint32_t bucket)
+{
+    const ft_checksum_t *checksum = &ft->checksums[table_id];
+
+    return checksum->buckets ? checksum->buckets[bucket] : checksum->checksum;
+}
+
+/**
+ * Number of distinct effects lists shared by the flow entries of the
+ * instances sharing the state of this one (see ft_create_shared)
+ */
+int
+ft_shared_effects_count(ft_instance_t ft);
+
 #endif /* _OFSTATEMANAGER_FT_H_ */
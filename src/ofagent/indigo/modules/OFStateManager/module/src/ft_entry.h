@@ -21,6 +21,7 @@
 #define _OFSTATEMANAGER_FT_ENTRY_H_
 
 #include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
 #include <indigo/indigo.h>
 #include <loci/loci.h>
 
@@ -30,11 +31,41 @@
  * The flow entry structure
  ****************************************************************/
 
+/**
+ * Number of 64-bit words in the fields (or masks) of an of_match_t
+ */
+#define FT_MATCH_WORDS ((sizeof(of_match_fields_t) + 7) / 8)
+
+/**
+ * Sparse encoding of a match
+ *
+ * @param present Bit i is set if word i of the fields or masks is non-zero
+ * @param version The OpenFlow version of the match
+ * @param count Number of words set in present
+ * @param words (field, mask) pairs of the present words, in word order
+ *
+ * A flow usually matches a handful of fields, so only a small part of the
+ * of_match_t is kept. Use ft_entry_match_get to get the full match back.
+ */
+
+typedef struct ft_match_s {
+    uint64_t present;
+    uint8_t version;
+    uint8_t count;
+    uint64_t words[];
+} ft_match_t;
+
+#define FT_MATCH_BYTES(_count) \
+    (sizeof(ft_match_t) + 2 * (_count) * sizeof(uint64_t))
+
 /**
  * The data in a flow table entry
  *
  * @param id The externally determined flow ID; primary key
- * @param match The match structure recorded from the original add
+ * @param match The sparse encoding of the match from the original add
+ * @param match_wire The match serialized for its version, as replies
+ * carry it; NULL if it could not be serialized
+ * @param match_wire_len Length of match_wire in bytes
  * @param priority The priority, from the original add
  * @param idle_timeout The idle_timeout, from the original add
  * @param hard_timeout The hard_timeout, from the original add
@@ -43,23 +74,46 @@
  * @param cookie The cookie, from the original or as updated
  * @param effects The actions or instructions from the add or as updated.
  * See below.
+ * @param shared_effects The interned copy of the effects
+ * @param stale Restored by a warm restart and not yet re-added by a controller
+ * @param match_fingerprint Hash of the match, for the strict match index
+ * @param checksum Contribution to the table checksums; see ft_checksum_t
  * @param insert_time The timestamp when the entry was inserted
  * @param packets Number of packets matched by the entry
  * @param bytes Number of bytes matched by the entry
  * @param last_counter_change Last update when counters changed
+ * @param counter_packets Packet count last read for a flow stats reply
+ * @param counter_bytes Byte count last read for a flow stats reply
+ * @param counter_generation ft_public_t.counter_generation by which the
+ * counters last read had changed; see the flow stats handler
  * @param table_links For iterating across the flow table
  * @param prio_links Search by priority
  * @param match_links Search by strict match
  * @param flow_id_links Search by flow id
+ * @param tuple The packet match tuple of the entry; see ft_tuple_t
+ * @param tuple_hash_entry Search by masked fields within the tuple
+ * @param lpm_node The prefix index node of the entry, NULL if not indexed
+ * @param lpm_links In the entries of lpm_node, by descending priority
+ * @param l2_index FT_L2_INDEX_* flags, the L2 table index lists the
+ * entry is in
+ * @param egress The port or group the effects forward to, for the L2
+ * table index; see FT_EGRESS_PORT and FT_EGRESS_GROUP
+ * @param vlan_links In the L2 table entries of an exact VLAN ID
+ * @param egress_links In the L2 table entries of an egress hash
+ * @param group_refs References to the groups used by the effects
  *
  * The effects (actions or instructions) are tied to a specific OpenFlow
  * version. For example, a flow may be added using OpenFlow 1.0 but
  * modified using OpenFlow 1.3. Either union member may be used to check
  * the version and LOCI object type.
  *
- * The match, priority, timeouts and flags are invariant once the entry
- * has been added to the table.  The cookie and effects may be updated by
- * modify commands.
+ * The match, priority and flags are invariant once the entry has been
+ * added to the table.  The cookie and effects may be updated by modify
+ * commands, and the cookie and timeouts by an add that overwrites the
+ * entry.
+ *
+ * Identical effects are shared between entries, so the effects must be
+ * treated as read-only.
  */
 
 typedef struct ft_entry_s {
@@ -67,7 +121,9 @@ typedef struct ft_entry_s {
     indigo_flow_id_t     id;
 
     /* Invariant */
-    of_match_t match;
+    ft_match_t *match;
+    uint8_t *match_wire;
+    uint16_t match_wire_len;
     uint16_t priority;
     uint16_t idle_timeout;
     uint16_t hard_timeout;
@@ -80,22 +136,60 @@ typedef struct ft_entry_s {
         of_list_action_t *actions;
         of_list_instruction_t *instructions;
     } effects;
+    struct ft_effects_s *shared_effects;
 
     /* Updated by implementation */
     uint8_t table_id;
+    uint8_t stale;
+    uint8_t l2_index;
+    uint32_t match_fingerprint;
+    uint64_t checksum;
     indigo_time_t insert_time;
     indigo_time_t last_counter_change;
+    uint64_t counter_packets;
+    uint64_t counter_bytes;
+    uint64_t counter_generation;
 
     /* For linked list maintance */
     list_links_t table_links;      /* For iterating across the flow table */
     list_links_t strict_match_links;  /* Search by strict match */
     list_links_t flow_id_links;    /* Search by flow id */
     list_links_t cookie_links;     /* Search by cookie */
+    list_links_t cookie_range_links; /* Search by cookie range */
+    list_links_t table_id_links;   /* Search by table ID */
+    list_links_t priority_links;   /* Search by table and priority */
     list_links_t expiration_links; /* Expiration list entry */
-    list_head_t iterators;         /* List of ft_iterator_t objects
-                                      pointing to this entry */
+    struct ft_tuple_s *tuple;      /* Packet match tuple */
+    bighash_entry_t tuple_hash_entry; /* Search by masked fields */
+    struct ft_lpm_node_s *lpm_node; /* Prefix index node */
+    list_links_t lpm_links;        /* Search by destination prefix */
+    uint64_t egress;               /* Port or group forwarded to */
+    list_links_t vlan_links;       /* Search by VLAN ID in the L2 table */
+    list_links_t egress_links;     /* Search by egress in the L2 table */
+    list_links_t retired_links;    /* In the retired list once deleted */
+    uint64_t retire_epoch;         /* Epoch it was deleted in, 0 if live */
+    uint64_t add_epoch;            /* Epoch it was added in */
+    list_head_t group_refs;        /* Groups referenced by the effects */
 } ft_entry_t;
 
+/**
+ * Flags of ft_entry_t.l2_index
+ *
+ * Only entries of the L2 table are indexed. An entry is in the VLAN
+ * index if it matches the VLAN ID exactly, and in the egress index if
+ * its effects output to exactly one port or group. One that outputs to
+ * several is counted in ft_public_t.l2_multi_egress_count instead.
+ */
+#define FT_L2_INDEX_VLAN         0x1
+#define FT_L2_INDEX_EGRESS       0x2
+#define FT_L2_INDEX_MULTI_EGRESS 0x4
+
+/**
+ * Egress keys of the L2 table index
+ */
+#define FT_EGRESS_PORT(_port) (((uint64_t)1 << 32) | (uint32_t)(_port))
+#define FT_EGRESS_GROUP(_group) (((uint64_t)2 << 32) | (uint32_t)(_group))
+
 /**
  * Get the container of a links pointer
  * @param link_ptr Pointer to the list_links_t of interest
@@ -105,6 +199,14 @@ typedef struct ft_entry_s {
 #define FT_ENTRY_CONTAINER(links_ptr, type)             \
     container_of((links_ptr), type ## _links, ft_entry_t)
 
+/**
+ * @brief Decode the match of an entry
+ * @param entry Pointer to the flow table entry
+ * @param match Filled in with the match from the original add
+ */
+
+extern void ft_entry_match_get(ft_entry_t *entry, of_match_t *match);
+
 /***** MATCHING *****/
 
 /**
@@ -119,8 +221,8 @@ typedef struct ft_entry_s {
  * (2) Query for a set of flow entries:  Use meta-match criteria including
  * the entry's match structure as well as cookies, priority or time since added.
  *
- * For core, the first is only needed for the "table" action on packet out,
- * and possibly not even then.  We do not currently optimize for this case.
+ * For core, the first is only needed for the "table" action on packet out.
+ * It uses a tuple space search over each table; see ft_packet_match.
  *
  * For the second, we can use "flow space" to describe the relationship.
  * This is described more fully elsewhere.  In short: Given a match, M,
@@ -163,6 +265,8 @@ typedef struct of_meta_match_s {
     int check_priority;     /* Boolean; should priority be checked */
     int check_overlap;      /* Boolean, for adds */
     of_port_no_t out_port;  /* OFPP_ANY means do not match */
+    uint32_t out_group;
+    int check_out_group;    /* Boolean; should out_group be checked */
     uint8_t table_id;       /* Set to TABLE_ID_ANY to wildcard */
 } of_meta_match_t;
 
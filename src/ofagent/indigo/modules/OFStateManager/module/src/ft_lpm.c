@@ -0,0 +1,673 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Longest prefix match index of a routing table
+ *
+ * The tries are path compressed: a node without entries always has two
+ * children, so a trie has fewer nodes than twice its prefixes and a
+ * lookup visits at most one node per distinct prefix length on the
+ * path. Entries with the same prefix share a node, highest priority
+ * first. A lookup keeps the highest priority entry seen on the path,
+ * which is the longest prefix when priorities follow prefix length, as
+ * they do in a routing table, and still the right flow when they do not.
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <loci/loci.h>
+
+#include "ofstatemanager_log.h"
+#include "ofstatemanager_int.h"
+#include "ft_lpm.h"
+
+#define FT_LPM_ETH_TYPE_IPV4 0x0800
+#define FT_LPM_ETH_TYPE_IPV6 0x86dd
+
+#define FT_LPM_ADDR_MAX 16
+
+typedef struct ft_lpm_node_s {
+    struct ft_lpm_node_s *parent;
+    struct ft_lpm_node_s *child[2];
+    struct ft_lpm_trie_s *trie;
+    list_head_t entries;        /* By descending priority */
+    uint8_t len;
+    uint8_t prefix[FT_LPM_ADDR_MAX];
+} ft_lpm_node_t;
+
+/* The entries whose match, but for the destination, is rest */
+typedef struct ft_lpm_trie_s {
+    list_links_t links;
+    of_match_t rest;            /* Fields are masked */
+    int addr_len;               /* 4 or 16 bytes */
+    int count;
+    int word_count;             /* Non-zero mask words of rest */
+    uint8_t words[FT_MATCH_WORDS];
+    ft_lpm_node_t *root;
+} ft_lpm_trie_t;
+
+struct ft_lpm_s {
+    uint8_t table_id;
+    list_head_t tries;
+    int entries;
+    int unindexed;              /* Entries of the table not prefix matches */
+    uint64_t shadowed_adds;
+    uint64_t lookups;
+};
+
+static uint64_t
+ft_lpm_word(const of_match_fields_t *fields, int idx)
+{
+    uint64_t word = 0;
+    int offset = idx * sizeof(word);
+    int bytes = sizeof(*fields) - offset;
+
+    memcpy(&word, (const uint8_t *)fields + offset,
+           bytes < sizeof(word) ? bytes : sizeof(word));
+    return word;
+}
+
+static int
+ft_lpm_bit(const uint8_t *addr, int i)
+{
+    return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/* Length of a prefix mask, -1 if the mask is not contiguous */
+static int
+ft_lpm_mask_len(const uint8_t *mask, int bytes)
+{
+    int len = 0, i;
+
+    while (len < bytes * 8 && ft_lpm_bit(mask, len)) {
+        len++;
+    }
+    for (i = len; i < bytes * 8; i++) {
+        if (ft_lpm_bit(mask, i)) {
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+static void
+ft_lpm_ipv4_bytes(uint32_t ip, uint8_t *addr)
+{
+    addr[0] = ip >> 24;
+    addr[1] = ip >> 16;
+    addr[2] = ip >> 8;
+    addr[3] = ip;
+}
+
+/*
+ * Split a match into its destination prefix and the rest. Returns the
+ * prefix length, or -1 if the match is not an IPv4 or IPv6 prefix match.
+ */
+static int
+ft_lpm_key(const of_match_t *match, of_match_t *rest, uint8_t *prefix,
+           int *addr_len)
+{
+    uint8_t mask[FT_LPM_ADDR_MAX];
+    uint8_t *fields = (uint8_t *)&rest->fields;
+    const uint8_t *masks = (const uint8_t *)&rest->masks;
+    int len, i;
+
+    if (match->masks.eth_type != 0xffff) {
+        return -1;
+    }
+
+    memset(prefix, 0, FT_LPM_ADDR_MAX);
+    if (match->fields.eth_type == FT_LPM_ETH_TYPE_IPV4) {
+        if (memcmp(&match->masks.ipv6_dst, &of_ipv6_all_zeros, OF_IPV6_BYTES)) {
+            return -1;
+        }
+        ft_lpm_ipv4_bytes(match->fields.ipv4_dst, prefix);
+        ft_lpm_ipv4_bytes(match->masks.ipv4_dst, mask);
+        *addr_len = 4;
+    } else if (match->fields.eth_type == FT_LPM_ETH_TYPE_IPV6) {
+        if (match->masks.ipv4_dst != 0) {
+            return -1;
+        }
+        memcpy(prefix, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
+        memcpy(mask, match->masks.ipv6_dst.addr, OF_IPV6_BYTES);
+        *addr_len = 16;
+    } else {
+        return -1;
+    }
+
+    if ((len = ft_lpm_mask_len(mask, *addr_len)) < 0) {
+        return -1;
+    }
+    for (i = 0; i < *addr_len; i++) {
+        prefix[i] &= mask[i];
+    }
+
+    *rest = *match;
+    rest->version = 0;
+    rest->fields.ipv4_dst = rest->masks.ipv4_dst = 0;
+    memset(&rest->fields.ipv6_dst, 0, sizeof(rest->fields.ipv6_dst));
+    memset(&rest->masks.ipv6_dst, 0, sizeof(rest->masks.ipv6_dst));
+    for (i = 0; i < sizeof(rest->fields); i++) {
+        fields[i] &= masks[i];
+    }
+
+    return len;
+}
+
+/* True if the first len bits of a and b are the same */
+static bool
+ft_lpm_prefix_equal(const uint8_t *a, const uint8_t *b, int len)
+{
+    int bytes = len / 8, bits = len % 8;
+
+    if (memcmp(a, b, bytes)) {
+        return false;
+    }
+    return bits == 0 || ((a[bytes] ^ b[bytes]) & (0xff << (8 - bits)) & 0xff) == 0;
+}
+
+/* True if addr starts with the prefix of node */
+static bool
+ft_lpm_node_covers(const ft_lpm_node_t *node, const uint8_t *addr)
+{
+    return ft_lpm_prefix_equal(node->prefix, addr, node->len);
+}
+
+static ft_entry_t *
+ft_lpm_node_best(ft_lpm_node_t *node)
+{
+    if (list_empty(&node->entries)) {
+        return NULL;
+    }
+    return container_of(list_first(&node->entries), lpm_links, ft_entry_t);
+}
+
+static ft_lpm_node_t *
+ft_lpm_node_new(ft_lpm_trie_t *trie, ft_lpm_node_t *parent,
+                const uint8_t *prefix, int len)
+{
+    ft_lpm_node_t *node = aim_zmalloc(sizeof(*node));
+    int i;
+
+    node->trie = trie;
+    node->parent = parent;
+    node->len = len;
+    list_init(&node->entries);
+    for (i = 0; i < len; i++) {
+        if (ft_lpm_bit(prefix, i)) {
+            node->prefix[i >> 3] |= 0x80 >> (i & 7);
+        }
+    }
+
+    return node;
+}
+
+/* Find or add the node of a prefix */
+static ft_lpm_node_t *
+ft_lpm_node_get(ft_lpm_trie_t *trie, const uint8_t *prefix, int len)
+{
+    ft_lpm_node_t **link = &trie->root;
+    ft_lpm_node_t *parent = NULL, *node, *branch, *leaf;
+    int common;
+
+    while ((node = *link) != NULL) {
+        for (common = 0; common < node->len && common < len &&
+                 ft_lpm_bit(node->prefix, common) == ft_lpm_bit(prefix, common);
+             common++) {
+        }
+
+        if (common == node->len) {
+            if (node->len == len) {
+                return node;
+            }
+            parent = node;
+            link = &node->child[ft_lpm_bit(prefix, node->len)];
+            continue;
+        }
+
+        /* The prefix covers node, or both branch off a shorter prefix */
+        branch = ft_lpm_node_new(trie, node->parent, prefix, common);
+        branch->child[ft_lpm_bit(node->prefix, common)] = node;
+        node->parent = branch;
+        *link = branch;
+        if (common == len) {
+            return branch;
+        }
+
+        leaf = ft_lpm_node_new(trie, branch, prefix, len);
+        branch->child[ft_lpm_bit(prefix, common)] = leaf;
+        return leaf;
+    }
+
+    leaf = ft_lpm_node_new(trie, parent, prefix, len);
+    *link = leaf;
+    return leaf;
+}
+
+/* Free the nodes that are no longer needed, from node up */
+static void
+ft_lpm_node_prune(ft_lpm_trie_t *trie, ft_lpm_node_t *node)
+{
+    ft_lpm_node_t *parent, *child;
+
+    while (node != NULL && list_empty(&node->entries) &&
+           (node->child[0] == NULL || node->child[1] == NULL)) {
+        parent = node->parent;
+        child = node->child[0] != NULL ? node->child[0] : node->child[1];
+        if (parent == NULL) {
+            trie->root = child;
+        } else {
+            parent->child[parent->child[0] == node ? 0 : 1] = child;
+        }
+        if (child != NULL) {
+            child->parent = parent;
+        }
+        aim_free(node);
+
+        /* The parent only changes shape if it lost a child */
+        node = child == NULL ? parent : NULL;
+    }
+}
+
+static void
+ft_lpm_node_destroy(ft_lpm_node_t *node)
+{
+    if (node == NULL) {
+        return;
+    }
+    ft_lpm_node_destroy(node->child[0]);
+    ft_lpm_node_destroy(node->child[1]);
+    aim_free(node);
+}
+
+static ft_lpm_trie_t *
+ft_lpm_trie_get(ft_lpm_t *lpm, const of_match_t *rest, int addr_len)
+{
+    ft_lpm_trie_t *trie;
+    list_links_t *cur;
+    int idx;
+
+    LIST_FOREACH(&lpm->tries, cur) {
+        trie = container_of(cur, links, ft_lpm_trie_t);
+        if (trie->addr_len == addr_len &&
+                !memcmp(&trie->rest.fields, &rest->fields, sizeof(rest->fields)) &&
+                !memcmp(&trie->rest.masks, &rest->masks, sizeof(rest->masks))) {
+            return trie;
+        }
+    }
+
+    trie = aim_zmalloc(sizeof(*trie));
+    trie->rest = *rest;
+    trie->addr_len = addr_len;
+    for (idx = 0; idx < FT_MATCH_WORDS; idx++) {
+        if (ft_lpm_word(&rest->masks, idx) != 0) {
+            trie->words[trie->word_count++] = idx;
+        }
+    }
+    list_push(&lpm->tries, &trie->links);
+
+    return trie;
+}
+
+/* True if the packet matches the rest of the trie */
+static bool
+ft_lpm_trie_rest_match(const ft_lpm_trie_t *trie, const of_match_fields_t *fields)
+{
+    int i, idx;
+
+    for (i = 0; i < trie->word_count; i++) {
+        idx = trie->words[i];
+        if ((ft_lpm_word(fields, idx) & ft_lpm_word(&trie->rest.masks, idx)) !=
+                ft_lpm_word(&trie->rest.fields, idx)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* True if the rest of the trie only masks known fields */
+static bool
+ft_lpm_trie_known(const ft_lpm_trie_t *trie, const of_match_fields_t *known)
+{
+    int i, idx;
+
+    for (i = 0; i < trie->word_count; i++) {
+        idx = trie->words[i];
+        if (ft_lpm_word(&trie->rest.masks, idx) & ~ft_lpm_word(known, idx)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* True if some packet can match both rests */
+static bool
+ft_lpm_rest_overlap(const of_match_t *a, const of_match_t *b)
+{
+    int idx;
+
+    for (idx = 0; idx < FT_MATCH_WORDS; idx++) {
+        if ((ft_lpm_word(&a->fields, idx) ^ ft_lpm_word(&b->fields, idx)) &
+                ft_lpm_word(&a->masks, idx) & ft_lpm_word(&b->masks, idx)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Highest priority entry of the trie covering addr */
+static ft_entry_t *
+ft_lpm_trie_lookup(ft_lpm_trie_t *trie, const uint8_t *addr, int *prefix_len)
+{
+    ft_lpm_node_t *node = trie->root;
+    ft_entry_t *best = NULL, *entry;
+
+    while (node != NULL && ft_lpm_node_covers(node, addr)) {
+        entry = ft_lpm_node_best(node);
+        if (entry != NULL && (best == NULL || entry->priority > best->priority)) {
+            best = entry;
+            if (prefix_len != NULL) {
+                *prefix_len = node->len;
+            }
+        }
+        if (node->len == trie->addr_len * 8) {
+            break;
+        }
+        node = node->child[ft_lpm_bit(addr, node->len)];
+    }
+
+    return best;
+}
+
+static ft_entry_t *
+ft_lpm_node_priority_find(ft_lpm_node_t *node, uint16_t priority)
+{
+    list_links_t *cur;
+    ft_entry_t *entry;
+
+    LIST_FOREACH(&node->entries, cur) {
+        entry = container_of(cur, lpm_links, ft_entry_t);
+        if (entry->priority == priority) {
+            return entry;
+        }
+        if (entry->priority < priority) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static ft_entry_t *
+ft_lpm_subtree_priority_find(ft_lpm_node_t *node, uint16_t priority)
+{
+    ft_entry_t *entry;
+
+    if (node == NULL) {
+        return NULL;
+    }
+    if ((entry = ft_lpm_node_priority_find(node, priority)) != NULL) {
+        return entry;
+    }
+    if ((entry = ft_lpm_subtree_priority_find(node->child[0], priority)) != NULL) {
+        return entry;
+    }
+    return ft_lpm_subtree_priority_find(node->child[1], priority);
+}
+
+ft_lpm_t *
+ft_lpm_create(uint8_t table_id)
+{
+    ft_lpm_t *lpm = aim_zmalloc(sizeof(*lpm));
+
+    lpm->table_id = table_id;
+    list_init(&lpm->tries);
+
+    return lpm;
+}
+
+void
+ft_lpm_destroy(ft_lpm_t *lpm)
+{
+    list_links_t *cur, *next;
+    ft_lpm_trie_t *trie;
+
+    if (lpm == NULL) {
+        return;
+    }
+
+    LIST_FOREACH_SAFE(&lpm->tries, cur, next) {
+        trie = container_of(cur, links, ft_lpm_trie_t);
+        ft_lpm_node_destroy(trie->root);
+        aim_free(trie);
+    }
+    aim_free(lpm);
+}
+
+uint8_t
+ft_lpm_table_id(ft_lpm_t *lpm)
+{
+    return lpm->table_id;
+}
+
+void
+ft_lpm_add(ft_lpm_t *lpm, ft_entry_t *entry)
+{
+    of_match_t match, rest;
+    uint8_t prefix[FT_LPM_ADDR_MAX];
+    ft_lpm_trie_t *trie;
+    ft_lpm_node_t *node;
+    ft_entry_t *other;
+    list_links_t *cur;
+    int len, addr_len;
+
+    entry->lpm_node = NULL;
+    ft_entry_match_get(entry, &match);
+    if ((len = ft_lpm_key(&match, &rest, prefix, &addr_len)) < 0) {
+        lpm->unindexed++;
+        return;
+    }
+
+    trie = ft_lpm_trie_get(lpm, &rest, addr_len);
+    node = ft_lpm_node_get(trie, prefix, len);
+
+    LIST_FOREACH(&node->entries, cur) {
+        other = container_of(cur, lpm_links, ft_entry_t);
+        if (other->priority < entry->priority) {
+            break;
+        }
+    }
+    if (cur == &node->entries.links) {
+        list_push(&node->entries, &entry->lpm_links);
+    } else {
+        list_insert_before(cur, &entry->lpm_links);
+    }
+    entry->lpm_node = node;
+    trie->count++;
+    lpm->entries++;
+
+    /* A covering prefix of higher priority takes every packet */
+    for (; node != NULL; node = node->parent) {
+        other = ft_lpm_node_best(node);
+        if (other != NULL && other->priority > entry->priority) {
+            lpm->shadowed_adds++;
+            LOG_VERBOSE("Flow " INDIGO_FLOW_ID_PRINTF_FORMAT " in table %u is "
+                        "shadowed by flow " INDIGO_FLOW_ID_PRINTF_FORMAT,
+                        INDIGO_FLOW_ID_PRINTF_ARG(entry->id), lpm->table_id,
+                        INDIGO_FLOW_ID_PRINTF_ARG(other->id));
+            break;
+        }
+    }
+}
+
+void
+ft_lpm_remove(ft_lpm_t *lpm, ft_entry_t *entry)
+{
+    ft_lpm_node_t *node = entry->lpm_node;
+    ft_lpm_trie_t *trie;
+
+    if (node == NULL) {
+        lpm->unindexed--;
+        return;
+    }
+
+    trie = node->trie;
+    list_remove(&entry->lpm_links);
+    entry->lpm_node = NULL;
+    lpm->entries--;
+
+    ft_lpm_node_prune(trie, node);
+    if (--trie->count == 0) {
+        list_remove(&trie->links);
+        aim_free(trie);
+    }
+}
+
+bool
+ft_lpm_complete(ft_lpm_t *lpm)
+{
+    return lpm->unindexed == 0;
+}
+
+indigo_error_t
+ft_lpm_packet_match(ft_lpm_t *lpm, const of_match_fields_t *fields,
+                    const of_match_fields_t *known, ft_entry_t **entry_ptr)
+{
+    uint8_t addr4[4];
+    ft_entry_t *best = NULL, *entry;
+    ft_lpm_trie_t *trie;
+    list_links_t *cur;
+    const uint8_t *addr;
+
+    lpm->lookups++;
+    ft_lpm_ipv4_bytes(fields->ipv4_dst, addr4);
+
+    LIST_FOREACH(&lpm->tries, cur) {
+        trie = container_of(cur, links, ft_lpm_trie_t);
+        if (known != NULL) {
+            if (!ft_lpm_trie_known(trie, known) ||
+                    (trie->addr_len == 4 && known->ipv4_dst != 0xffffffff) ||
+                    (trie->addr_len == 16 &&
+                     memcmp(&known->ipv6_dst, &of_ipv6_all_ones, OF_IPV6_BYTES))) {
+                return INDIGO_ERROR_NOT_SUPPORTED;
+            }
+        }
+        if (!ft_lpm_trie_rest_match(trie, fields)) {
+            continue;
+        }
+
+        addr = trie->addr_len == 4 ? addr4 : fields->ipv6_dst.addr;
+        entry = ft_lpm_trie_lookup(trie, addr, NULL);
+        if (entry != NULL && (best == NULL || entry->priority > best->priority)) {
+            best = entry;
+        }
+    }
+
+    if (best == NULL) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    *entry_ptr = best;
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+ft_lpm_overlap_find(ft_lpm_t *lpm, const of_match_t *match, uint16_t priority,
+                    ft_entry_t **entry_ptr)
+{
+    of_match_t rest;
+    uint8_t prefix[FT_LPM_ADDR_MAX];
+    ft_lpm_trie_t *trie;
+    ft_lpm_node_t *node;
+    ft_entry_t *entry = NULL;
+    list_links_t *cur;
+    int len, addr_len;
+
+    if ((len = ft_lpm_key(match, &rest, prefix, &addr_len)) < 0) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    LIST_FOREACH(&lpm->tries, cur) {
+        trie = container_of(cur, links, ft_lpm_trie_t);
+        if (trie->addr_len != addr_len || !ft_lpm_rest_overlap(&trie->rest, &rest)) {
+            continue;
+        }
+
+        /* Prefixes overlap when one covers the other */
+        for (node = trie->root; node != NULL && node->len < len &&
+                 ft_lpm_node_covers(node, prefix);
+             node = node->child[ft_lpm_bit(prefix, node->len)]) {
+            if ((entry = ft_lpm_node_priority_find(node, priority)) != NULL) {
+                break;
+            }
+        }
+        if (entry == NULL && node != NULL &&
+                ft_lpm_prefix_equal(node->prefix, prefix,
+                                    len < node->len ? len : node->len)) {
+            /* The query covers node and its subtree */
+            entry = ft_lpm_subtree_priority_find(node, priority);
+        }
+        if (entry != NULL) {
+            *entry_ptr = entry;
+            return INDIGO_ERROR_NONE;
+        }
+    }
+
+    return INDIGO_ERROR_NOT_FOUND;
+}
+
+int
+ft_lpm_route_lookup(ft_lpm_t *lpm, uint16_t eth_type, const uint8_t *addr,
+                    ft_lpm_route_f callback, void *cookie)
+{
+    int addr_len = eth_type == FT_LPM_ETH_TYPE_IPV4 ? 4 : 16;
+    ft_lpm_trie_t *trie;
+    ft_entry_t *entry;
+    list_links_t *cur;
+    int prefix_len, count = 0;
+
+    LIST_FOREACH(&lpm->tries, cur) {
+        trie = container_of(cur, links, ft_lpm_trie_t);
+        if (trie->addr_len != addr_len || trie->rest.fields.eth_type != eth_type) {
+            continue;
+        }
+        if ((entry = ft_lpm_trie_lookup(trie, addr, &prefix_len)) != NULL) {
+            callback(cookie, entry, prefix_len);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void
+ft_lpm_stats_show(ft_lpm_t *lpm, aim_pvs_t *pvs)
+{
+    aim_printf(pvs, "Prefix index of table %u: %d entries in %d tries, "
+               "%d not indexed%s\n", lpm->table_id, lpm->entries,
+               list_length(&lpm->tries), lpm->unindexed,
+               ft_lpm_complete(lpm) ? "" : " (packet lookups use tuples)");
+    aim_printf(pvs, "  %"PRIu64" packet lookups, %"PRIu64" shadowed adds\n",
+               lpm->lookups, lpm->shadowed_adds);
+}
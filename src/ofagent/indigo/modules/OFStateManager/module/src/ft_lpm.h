@@ -0,0 +1,125 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Longest prefix match index of a routing table
+ *
+ * The flows of one table that match an IPv4 or IPv6 ethertype exactly
+ * and the destination address by prefix are kept in binary tries, one
+ * trie per value of the rest of their match (typically the VRF). A
+ * packet is looked up by walking its destination address down each trie
+ * whose other fields it matches, instead of probing one tuple per
+ * prefix length.
+ *
+ * Flows of the table that do not have this shape are counted but not
+ * indexed; while there are any, packet and overlap lookups fall back to
+ * the tuple and priority indexes.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_LPM_H_
+#define _OFSTATEMANAGER_FT_LPM_H_
+
+#include <indigo/indigo.h>
+#include <loci/loci.h>
+#include <AIM/aim_pvs.h>
+#include <stdbool.h>
+
+#include "ft_entry.h"
+
+typedef struct ft_lpm_s ft_lpm_t;
+
+/**
+ * Create the index of a table
+ * @param table_id The table indexed
+ */
+
+ft_lpm_t *ft_lpm_create(uint8_t table_id);
+
+void ft_lpm_destroy(ft_lpm_t *lpm);
+
+uint8_t ft_lpm_table_id(ft_lpm_t *lpm);
+
+/**
+ * Add an entry of the indexed table
+ *
+ * An entry covered by a shorter prefix of higher priority can never be
+ * hit; it is indexed anyway and counted as shadowed.
+ */
+
+void ft_lpm_add(ft_lpm_t *lpm, ft_entry_t *entry);
+
+void ft_lpm_remove(ft_lpm_t *lpm, ft_entry_t *entry);
+
+/**
+ * True if every entry of the table is in the index
+ */
+
+bool ft_lpm_complete(ft_lpm_t *lpm);
+
+/**
+ * Find the highest priority entry matching a packet
+ * @param lpm The index
+ * @param fields The packet fields
+ * @param known The fields set in fields, or NULL if all are
+ * @param entry_ptr (out) The entry
+ * @returns INDIGO_ERROR_NOT_SUPPORTED if an entry that could match masks
+ * a field not in known; only meaningful if ft_lpm_complete
+ */
+
+indigo_error_t ft_lpm_packet_match(ft_lpm_t *lpm,
+                                   const of_match_fields_t *fields,
+                                   const of_match_fields_t *known,
+                                   ft_entry_t **entry_ptr);
+
+/**
+ * Find an entry of the given priority that overlaps a match
+ * @returns INDIGO_ERROR_NOT_SUPPORTED if the match is not a prefix match
+ * the index can answer for; only meaningful if ft_lpm_complete
+ */
+
+indigo_error_t ft_lpm_overlap_find(ft_lpm_t *lpm, const of_match_t *match,
+                                   uint16_t priority, ft_entry_t **entry_ptr);
+
+/**
+ * Callback for ft_lpm_route_lookup
+ * @param cookie The caller's cookie
+ * @param entry The best entry of a trie
+ * @param prefix_len Prefix length of the entry
+ */
+
+typedef void (*ft_lpm_route_f)(void *cookie, ft_entry_t *entry, int prefix_len);
+
+/**
+ * Look an address up in every trie of its ethertype, ignoring the
+ * other fields of the tries
+ * @param lpm The index
+ * @param eth_type 0x0800 or 0x86dd
+ * @param addr The address, 4 or 16 bytes in network order
+ * @param callback Called with the best entry of each trie that has one
+ * @param cookie Passed to callback
+ * @returns The number of calls made
+ */
+
+int ft_lpm_route_lookup(ft_lpm_t *lpm, uint16_t eth_type, const uint8_t *addr,
+                        ft_lpm_route_f callback, void *cookie);
+
+void ft_lpm_stats_show(ft_lpm_t *lpm, aim_pvs_t *pvs);
+
+#endif /* _OFSTATEMANAGER_FT_LPM_H_ */
@@ -0,0 +1,282 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Flow table sharded by table ID
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <loci/loci.h>
+
+#include "ofstatemanager_log.h"
+#include "ft_shard.h"
+
+static int
+ft_shard_bucket_count(int bucket_count)
+{
+    bucket_count /= FT_SHARD_BUCKET_DIVISOR;
+    return bucket_count < FT_SHARD_MIN_BUCKETS ? FT_SHARD_MIN_BUCKETS : bucket_count;
+}
+
+ft_shards_t *
+ft_shards_create(ft_config_t *config, bool sharded)
+{
+    ft_shards_t *shards = aim_zmalloc(sizeof(*shards));
+    ft_instance_t ft;
+    int i;
+
+    INDIGO_MEM_COPY(&shards->config, config, sizeof(ft_config_t));
+    shards->shared = ft_shared_create();
+    shards->sharded = sharded;
+
+    if (!sharded) {
+        ft = ft_create_shared(config, shards->shared);
+        for (i = 0; i < FT_TABLE_ID_BUCKET_COUNT; i++) {
+            shards->shards[i] = ft;
+        }
+        shards->instances[shards->count++] = ft;
+    }
+
+    return shards;
+}
+
+void
+ft_shards_destroy(ft_shards_t *shards)
+{
+    int i;
+
+    if (shards == NULL) {
+        return;
+    }
+
+    for (i = 0; i < shards->count; i++) {
+        ft_destroy(shards->instances[i]);
+    }
+
+    ft_shared_release(shards->shared);
+    aim_free(shards);
+}
+
+ft_instance_t
+ft_shards_get(ft_shards_t *shards, uint8_t table_id)
+{
+    ft_config_t config;
+    ft_instance_t ft;
+    int i;
+
+    if (shards->shards[table_id] != NULL) {
+        return shards->shards[table_id];
+    }
+
+    INDIGO_MEM_COPY(&config, &shards->config, sizeof(config));
+    config.strict_match_bucket_count =
+        ft_shard_bucket_count(config.strict_match_bucket_count);
+    config.flow_id_bucket_count =
+        ft_shard_bucket_count(config.flow_id_bucket_count);
+
+    /* The LPM and L2 indexes belong to the shard of their table */
+    if (config.lpm_table_id != table_id) {
+        config.lpm_table_id = 0;
+    }
+    if (config.l2_table_id != table_id) {
+        config.l2_table_id = 0;
+    }
+
+    ft = ft_create_shared(&config, shards->shared);
+    shards->shards[table_id] = ft;
+
+    /* Keep the instances in table ID order */
+    shards->count = 0;
+    for (i = 0; i < FT_TABLE_ID_BUCKET_COUNT; i++) {
+        if (shards->shards[i] != NULL) {
+            shards->instances[shards->count++] = shards->shards[i];
+        }
+    }
+
+    LOG_VERBOSE("Created flow table shard for table %d", table_id);
+
+    return ft;
+}
+
+indigo_error_t
+ft_shards_add(ft_shards_t *shards, indigo_flow_id_t id,
+              of_flow_add_t *flow_add, ft_entry_t **entry_p)
+{
+    uint8_t table_id = 0;
+
+    if (shards->sharded && ft_shards_lookup(shards, id) != NULL) {
+        return INDIGO_ERROR_EXISTS;
+    }
+
+    if (flow_add->version >= OF_VERSION_1_1) {
+        of_flow_add_table_id_get(flow_add, &table_id);
+    }
+
+    return ft_add(ft_shards_get(shards, table_id), id, flow_add, entry_p);
+}
+
+void
+ft_shards_delete(ft_shards_t *shards, ft_entry_t *entry)
+{
+    ft_delete(ft_shards_entry_shard(shards, entry), entry);
+}
+
+void
+ft_shards_entry_table_id_set(ft_shards_t *shards, ft_entry_t *entry,
+                             uint8_t table_id)
+{
+    ft_entry_move(ft_shards_entry_shard(shards, entry),
+                  ft_shards_get(shards, table_id), entry, table_id);
+}
+
+ft_entry_t *
+ft_shards_lookup(ft_shards_t *shards, indigo_flow_id_t id)
+{
+    ft_entry_t *entry;
+    int i;
+
+    for (i = 0; i < shards->count; i++) {
+        entry = ft_lookup(shards->instances[i], id);
+        if (entry != NULL) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+indigo_error_t
+ft_shards_strict_match(ft_shards_t *shards, of_meta_match_t *query,
+                       ft_entry_t **entry_ptr)
+{
+    ft_instance_t ft;
+    int i;
+
+    if (query->table_id != TABLE_ID_ANY) {
+        ft = ft_shards_find(shards, query->table_id);
+        if (ft == NULL) {
+            return INDIGO_ERROR_NOT_FOUND;
+        }
+        return ft_strict_match(ft, query, entry_ptr);
+    }
+
+    for (i = 0; i < shards->count; i++) {
+        if (ft_strict_match(shards->instances[i], query,
+                            entry_ptr) == INDIGO_ERROR_NONE) {
+            return INDIGO_ERROR_NONE;
+        }
+    }
+
+    return INDIGO_ERROR_NOT_FOUND;
+}
+
+indigo_error_t
+ft_shards_overlap_find(ft_shards_t *shards, of_meta_match_t *query,
+                       ft_entry_t **entry_ptr)
+{
+    ft_instance_t ft;
+    int i;
+
+    if (query->table_id != TABLE_ID_ANY) {
+        ft = ft_shards_find(shards, query->table_id);
+        if (ft == NULL) {
+            return INDIGO_ERROR_NOT_FOUND;
+        }
+        return ft_overlap_find(ft, query, entry_ptr);
+    }
+
+    for (i = 0; i < shards->count; i++) {
+        if (ft_overlap_find(shards->instances[i], query,
+                            entry_ptr) == INDIGO_ERROR_NONE) {
+            return INDIGO_ERROR_NONE;
+        }
+    }
+
+    return INDIGO_ERROR_NOT_FOUND;
+}
+
+void
+ft_shards_status_get(ft_shards_t *shards, ft_status_t *status)
+{
+    ft_status_t *shard;
+    int i;
+
+    INDIGO_MEM_COPY(status, &shards->status, sizeof(*status));
+
+    for (i = 0; i < shards->count; i++) {
+        shard = FT_STATUS(shards->instances[i]);
+        status->current_count += shard->current_count;
+        status->adds += shard->adds;
+        status->deletes += shard->deletes;
+        status->hard_expires += shard->hard_expires;
+        status->idle_expires += shard->idle_expires;
+        status->updates += shard->updates;
+        status->overwrites += shard->overwrites;
+        status->table_full_errors += shard->table_full_errors;
+        status->forwarding_add_errors += shard->forwarding_add_errors;
+        status->index_resizes += shard->index_resizes;
+    }
+}
+
+static indigo_error_t
+ft_shards_iter_task_spawn(ft_shards_t *shards,
+                          of_meta_match_t *query,
+                          ft_iter_task_callback_f callback,
+                          void *cookie,
+                          int priority,
+                          indigo_cxn_id_t cxn_id)
+{
+    ft_instance_t ft;
+
+    if (query != NULL && query->table_id != TABLE_ID_ANY) {
+        /* Still finish through the task if the table has no shard */
+        ft = ft_shards_find(shards, query->table_id);
+        return ft_spawn_instances_iter_task(&ft, ft != NULL, query, callback,
+                                            cookie, priority, cxn_id);
+    }
+
+    return ft_spawn_instances_iter_task(shards->instances, shards->count,
+                                        query, callback, cookie, priority,
+                                        cxn_id);
+}
+
+indigo_error_t
+ft_shards_spawn_iter_task(ft_shards_t *shards,
+                          of_meta_match_t *query,
+                          ft_iter_task_callback_f callback,
+                          void *cookie,
+                          int priority)
+{
+    return ft_shards_iter_task_spawn(shards, query, callback, cookie,
+                                     priority, -1);
+}
+
+indigo_error_t
+ft_shards_spawn_reply_iter_task(ft_shards_t *shards,
+                                of_meta_match_t *query,
+                                ft_iter_task_callback_f callback,
+                                void *cookie,
+                                int priority,
+                                indigo_cxn_id_t cxn_id)
+{
+    return ft_shards_iter_task_spawn(shards, query, callback, cookie,
+                                     priority, cxn_id);
+}
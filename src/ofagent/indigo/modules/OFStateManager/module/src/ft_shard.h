@@ -0,0 +1,241 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Flow table sharded by table ID
+ *
+ * A sharded flow table keeps the flows of each table in a flow table
+ * instance of its own, created when the table gets its first flow. The
+ * shard of a table can be handed to a writer that programs only that
+ * table, e.g. one for bridging and one for routing, without locking
+ * the others: none of its lists, hash buckets or counters are shared
+ * with another shard.
+ *
+ * An entry is always in the shard of its table_id. Queries that name a
+ * table go to its shard; flow ID lookups and queries on TABLE_ID_ANY
+ * visit every shard, in table ID order. Flow IDs are unique across the
+ * shards.
+ *
+ * The shards share their state (see ft_create_shared): the entry
+ * allocator, the shared effects and the epochs are common to all of
+ * them, as is the expiration list, so writers of different shards still
+ * need to serialise on those.
+ *
+ * Unsharded, every table maps to a single instance and the router only
+ * forwards to it; see OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_SHARD_H_
+#define _OFSTATEMANAGER_FT_SHARD_H_
+
+#include "ft.h"
+
+/**
+ * Index sizes of a shard are those of the configuration divided by
+ * FT_SHARD_BUCKET_DIVISOR, but at least FT_SHARD_MIN_BUCKETS; shards
+ * grow as their tables fill, see FT_HASH_MAX_LOAD.
+ */
+#define FT_SHARD_BUCKET_DIVISOR 16
+#define FT_SHARD_MIN_BUCKETS 64
+
+/**
+ * A sharded flow table
+ * @param config Configuration the shards are created from
+ * @param shared State common to the shards
+ * @param status Counters kept by the users of the router rather than by
+ * a shard, e.g. errors for flows that never got in; see
+ * ft_shards_status_get
+ * @param sharded Whether each table has a shard of its own
+ * @param shards Shard of each table ID, NULL before its first flow
+ * @param instances The distinct shards, in table ID order
+ * @param count Number of distinct shards
+ *
+ * Treat as read-only outside of ft_shard.c, except for status.
+ */
+
+typedef struct ft_shards_s {
+    ft_config_t config;
+    ft_shared_t *shared;
+    ft_status_t status;
+    bool sharded;
+    ft_instance_t shards[FT_TABLE_ID_BUCKET_COUNT];
+    ft_instance_t instances[FT_TABLE_ID_BUCKET_COUNT];
+    int count;
+} ft_shards_t;
+
+/**
+ * Iterate over the distinct shards
+ * @param _shards The sharded flow table
+ * @param _ft ft_instance_t set to each shard in turn
+ * @param _i int bookkeeping, do not reference
+ *
+ * Shards must not be created during the iteration.
+ */
+
+#define FT_SHARDS_FOREACH(_shards, _ft, _i)                             \
+    for ((_i) = 0;                                                      \
+         (_i) < (_shards)->count && ((_ft) = (_shards)->instances[_i]); \
+         (_i)++)
+
+/**
+ * Create a sharded flow table
+ * @param config Configuration of the whole flow table
+ * @param sharded Whether to give each table a shard; if not, a single
+ * instance with 'config' holds every table
+ */
+
+ft_shards_t *ft_shards_create(ft_config_t *config, bool sharded);
+
+void ft_shards_destroy(ft_shards_t *shards);
+
+/**
+ * Shard of a table, created if the table has none
+ */
+
+ft_instance_t ft_shards_get(ft_shards_t *shards, uint8_t table_id);
+
+/**
+ * Shard of a table, or NULL if the table has none
+ */
+
+static inline ft_instance_t
+ft_shards_find(ft_shards_t *shards, uint8_t table_id)
+{
+    return shards->shards[table_id];
+}
+
+/**
+ * Shard holding an entry
+ */
+
+static inline ft_instance_t
+ft_shards_entry_shard(ft_shards_t *shards, ft_entry_t *entry)
+{
+    return shards->shards[entry->table_id];
+}
+
+/**
+ * Number of flows in all the shards
+ */
+
+static inline int
+ft_shards_current_count(ft_shards_t *shards)
+{
+    int count = 0;
+    int i;
+
+    for (i = 0; i < shards->count; i++) {
+        count += shards->instances[i]->status.current_count;
+    }
+
+    return count;
+}
+
+/**
+ * Start a new epoch in all the shards
+ * @returns The epoch; flows added from now on are in it or a later one
+ */
+
+static inline uint64_t
+ft_shards_epoch_start(ft_shards_t *shards)
+{
+    return ++shards->shared->epoch;
+}
+
+/**
+ * Add a flow entry to the shard of the table of the flow add
+ *
+ * Same as ft_add; the flow ID must not be used in any shard.
+ */
+
+indigo_error_t ft_shards_add(ft_shards_t *shards,
+                             indigo_flow_id_t id,
+                             of_flow_add_t *flow_add,
+                             ft_entry_t **entry_p);
+
+void ft_shards_delete(ft_shards_t *shards, ft_entry_t *entry);
+
+/**
+ * Set the table ID of an entry, moving it to the shard of that table
+ */
+
+void ft_shards_entry_table_id_set(ft_shards_t *shards, ft_entry_t *entry,
+                                  uint8_t table_id);
+
+/**
+ * Look up a flow by ID in every shard
+ */
+
+ft_entry_t *ft_shards_lookup(ft_shards_t *shards, indigo_flow_id_t id);
+
+/**
+ * Same as ft_strict_match, in the shard of query->table_id or in every
+ * shard for TABLE_ID_ANY
+ */
+
+indigo_error_t ft_shards_strict_match(ft_shards_t *shards,
+                                      of_meta_match_t *query,
+                                      ft_entry_t **entry_ptr);
+
+/**
+ * Same as ft_overlap_find, in the shard of query->table_id or in every
+ * shard for TABLE_ID_ANY
+ */
+
+indigo_error_t ft_shards_overlap_find(ft_shards_t *shards,
+                                      of_meta_match_t *query,
+                                      ft_entry_t **entry_ptr);
+
+/**
+ * Sum of the status of the shards and of the router
+ */
+
+void ft_shards_status_get(ft_shards_t *shards, ft_status_t *status);
+
+/**
+ * Same as ft_spawn_iter_task, over the shard of query->table_id or over
+ * every shard for TABLE_ID_ANY
+ *
+ * Shards created after the task is spawned are not visited. A flow
+ * moved to another shard during the iteration (see
+ * ft_shards_entry_table_id_set) may be missed or returned twice.
+ */
+
+indigo_error_t
+ft_shards_spawn_iter_task(ft_shards_t *shards,
+                          of_meta_match_t *query,
+                          ft_iter_task_callback_f callback,
+                          void *cookie,
+                          int priority);
+
+/**
+ * Same as ft_spawn_reply_iter_task, over the shard of query->table_id
+ * or over every shard for TABLE_ID_ANY
+ */
+
+indigo_error_t
+ft_shards_spawn_reply_iter_task(ft_shards_t *shards,
+                                of_meta_match_t *query,
+                                ft_iter_task_callback_f callback,
+                                void *cookie,
+                                int priority,
+                                indigo_cxn_id_t cxn_id);
+
+#endif /* _OFSTATEMANAGER_FT_SHARD_H_ */
@@ -26,7 +26,6 @@
  * TODO:
  *  - Reduce LOCI allocation overhead per entry.
  *  - Reuse stats entry during stats tasks.
- *  - Automatically resize key hashtable buckets.
  */
 
 #include "ofstatemanager_log.h"
@@ -38,9 +37,14 @@
 #include "ofstatemanager_int.h"
 #include "handlers.h"
 #include <murmur/murmur.h>
+#include <limits.h>
 
 #define MAX_GENTABLES 16
 
+/* See "Bucket resizing" */
+#define GENTABLE_RESIZE_BATCH 64
+#define GENTABLE_KEY_BUCKET_LOAD 2
+
 struct ind_core_gentable_entry;
 
 typedef void (*ind_core_gentable_iter_task_callback_f)(
@@ -51,12 +55,20 @@ static uint16_t alloc_table_id(void);
 static uint8_t calc_checksum_buckets_shift(uint32_t checksum_buckets_size);
 static struct ind_core_gentable_checksum_bucket *find_checksum_bucket(indigo_core_gentable_t *gentable, of_checksum_128_t *checksum);
 static void update_checksum(of_checksum_128_t *dst, const of_checksum_128_t *src);
-static uint32_t hash_key(of_list_bsn_tlv_t *key);
+static uint32_t hash_key(const uint8_t *key_data, uint16_t key_len);
 static list_head_t *find_key_bucket(indigo_core_gentable_t *gentable, uint32_t key_hash);
 static indigo_error_t delete_entry(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry);
 static struct ind_core_gentable_entry *find_entry_by_key(indigo_core_gentable_t *gentable, of_list_bsn_tlv_t *key);
-static bool key_equality(of_list_bsn_tlv_t *a, of_list_bsn_tlv_t *b);
+static struct ind_core_gentable_entry *new_entry(indigo_core_gentable_t *gentable, of_list_bsn_tlv_t *key);
+static void free_entry(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry);
+static of_object_t *dup_value(of_object_t *value);
+static void delete_value(of_object_t *value);
+static void checksum_bucket_insert(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry);
+static void checksum_bucket_remove(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry);
 static indigo_error_t ind_core_gentable_spawn_iter_task(indigo_core_gentable_t *gentable, ind_core_gentable_iter_task_callback_f callback, void *cookie, int priority, of_checksum_128_t checksum_prefix, of_checksum_128_t checksum_mask);
+static void checksum_buckets_resize(indigo_core_gentable_t *gentable, uint32_t buckets_size);
+static void key_buckets_grow(indigo_core_gentable_t *gentable);
+static of_checksum_128_t checksum_bucket_checksum(indigo_core_gentable_t *gentable, uint32_t idx);
 
 struct ind_core_gentable_checksum_bucket {
     of_checksum_128_t checksum;
@@ -77,16 +89,39 @@ struct indigo_core_gentable {
     uint8_t checksum_buckets_shift; /* see checksum_buckets_shift */
     of_checksum_128_t checksum;
     of_table_name_t name;
+
+    /*
+     * While the buckets are resized, the entries are moved from the old
+     * arrays a few at a time by gentable_resize_task. Old buckets before
+     * the migrate index are empty.
+     */
+    list_head_t *old_key_buckets; /* NULL unless resizing */
+    uint32_t old_key_buckets_size;
+    uint32_t key_migrate_next;
+    struct ind_core_gentable_checksum_bucket *old_checksum_buckets; /* NULL unless resizing */
+    uint32_t old_checksum_buckets_size;
+    uint32_t checksum_migrate_next;
+    uint8_t old_checksum_buckets_shift;
+    uint32_t checksum_generation; /* of checksum_buckets */
+    bool resize_task; /* gentable_resize_task is registered */
 };
 
 struct ind_core_gentable_entry {
     list_links_t key_links;
     list_links_t checksum_links;
     uint32_t key_hash;
+    uint16_t key_len;
+    bool pending; /* in the gentable batch, see gentable_batch_flush */
+    uint32_t checksum_generation; /* in old_checksum_buckets if not current */
     void *priv;
     of_list_bsn_tlv_t *key;
     of_list_bsn_tlv_t *value;
     of_checksum_128_t checksum;
+    /*
+     * Wire encoding of the key, compared on lookup so a bucket walk does
+     * not follow entry->key into a separate allocation
+     */
+    uint8_t key_data[];
 };
 
 static indigo_core_gentable_t *gentables[MAX_GENTABLES];
@@ -164,9 +199,12 @@ indigo_core_gentable_unregister(indigo_core_gentable_t *gentable)
     AIM_TRUE_OR_DIE(gentables[gentable->table_id] == gentable);
 
     /* Delete all entries */
-    for (i = 0; i < gentable->key_buckets_size; i++) {
+    for (i = 0; i < gentable->key_buckets_size + gentable->old_key_buckets_size; i++) {
         list_links_t *cur, *next;
-        LIST_FOREACH_SAFE(&gentable->key_buckets[i], cur, next) {
+        list_head_t *bucket = i < gentable->key_buckets_size ?
+            &gentable->key_buckets[i] :
+            &gentable->old_key_buckets[i - gentable->key_buckets_size];
+        LIST_FOREACH_SAFE(bucket, cur, next) {
             struct ind_core_gentable_entry *entry =
                 container_of(cur, key_links, struct ind_core_gentable_entry);
             rv = delete_entry(gentable, entry);
@@ -180,6 +218,8 @@ indigo_core_gentable_unregister(indigo_core_gentable_t *gentable)
 
     aim_free(gentable->key_buckets);
     aim_free(gentable->checksum_buckets);
+    aim_free(gentable->old_key_buckets);
+    aim_free(gentable->old_checksum_buckets);
     aim_free(gentable);
 }
 
@@ -196,7 +236,6 @@ ind_core_bsn_gentable_entry_add_handler(
     of_list_bsn_tlv_t key, value;
     void *priv = NULL;
     indigo_error_t rv;
-    struct ind_core_gentable_checksum_bucket *checksum_bucket;
     struct ind_core_gentable_entry *entry;
 
     of_bsn_gentable_entry_add_table_id_get(obj, &table_id);
@@ -224,16 +263,9 @@ ind_core_bsn_gentable_entry_add_handler(
             goto error;
         }
 
-        /* Allocate new entry */
-        entry = aim_zmalloc(sizeof(*entry));
-        entry->key = of_object_dup(&key);
-
-        entry->key_hash = hash_key(&key);
+        entry = new_entry(gentable, &key);
         entry->priv = priv;
 
-        /* Insert into key bucket */
-        list_push(find_key_bucket(gentable, entry->key_hash), &entry->key_links);
-
         gentable->num_entries++;
     } else {
         /* Modifying an existing entry */
@@ -244,27 +276,17 @@ ind_core_bsn_gentable_entry_add_handler(
             goto error;
         }
 
-        of_object_delete(entry->value);
+        delete_value(entry->value);
 
-        /* Remove from old checksum bucket */
-        checksum_bucket = find_checksum_bucket(gentable, &entry->checksum);
-        list_remove(&entry->checksum_links);
-        update_checksum(&checksum_bucket->checksum, &entry->checksum);
-
-        /* Remove from table checksum */
+        checksum_bucket_remove(gentable, entry);
         update_checksum(&gentable->checksum, &entry->checksum);
     }
 
     /* Update value and checksum */
-    entry->value = of_object_dup(&value);
+    entry->value = dup_value(&value);
     of_bsn_gentable_entry_add_checksum_get(obj, &entry->checksum);
 
-    /* Insert into checksum bucket */
-    checksum_bucket = find_checksum_bucket(gentable, &entry->checksum);
-    list_push(&checksum_bucket->entries, &entry->checksum_links);
-    update_checksum(&checksum_bucket->checksum, &entry->checksum);
-
-    /* Add to table checksum */
+    checksum_bucket_insert(gentable, entry);
     update_checksum(&gentable->checksum, &entry->checksum);
 
     return;
@@ -381,7 +403,7 @@ ind_core_bsn_gentable_clear_request_handler(
 
     struct ind_core_gentable_clear_state *state = aim_zmalloc(sizeof(*state));
     state->cxn_id = cxn_id;
-    state->request = ind_core_dup_tracking(obj, cxn_id);
+    state->request = ind_core_dup_header_tracking(obj, cxn_id);
 
     rv = ind_core_gentable_spawn_iter_task(gentable, clear_iter, state,
                                            IND_SOC_DEFAULT_PRIORITY,
@@ -402,9 +424,6 @@ ind_core_bsn_gentable_set_buckets_size_handler(
     indigo_core_gentable_t *gentable;
     uint32_t xid;
     uint32_t new_buckets_size;
-    uint32_t old_buckets_size;
-    struct ind_core_gentable_checksum_bucket *old_buckets;
-    int i;
 
     of_bsn_gentable_set_buckets_size_xid_get(obj, &xid);
     of_bsn_gentable_set_buckets_size_table_id_get(obj, &table_id);
@@ -434,42 +453,7 @@ ind_core_bsn_gentable_set_buckets_size_handler(
         return;
     }
 
-    old_buckets_size = gentable->checksum_buckets_size;
-    old_buckets = gentable->checksum_buckets;
-
-    gentable->checksum_buckets_size = new_buckets_size;
-    gentable->checksum_buckets = aim_malloc(sizeof(*gentable->checksum_buckets) *
-                                            gentable->checksum_buckets_size);
-
-    gentable->checksum_buckets_shift =
-        calc_checksum_buckets_shift(gentable->checksum_buckets_size);
-
-    for (i = 0; i < gentable->checksum_buckets_size; i++) {
-        struct ind_core_gentable_checksum_bucket *bucket =
-            &gentable->checksum_buckets[i];
-        bucket->checksum.lo = 0;
-        bucket->checksum.hi = 0;
-        list_init(&bucket->entries);
-    }
-
-    for (i = 0; i < old_buckets_size; i++) {
-        list_links_t *cur, *next;
-        LIST_FOREACH_SAFE(&old_buckets[i].entries, cur, next) {
-            struct ind_core_gentable_entry *entry =
-                container_of(cur, checksum_links, struct ind_core_gentable_entry);
-
-            /* Remove from old bucket */
-            list_remove(&entry->checksum_links);
-
-            /* Insert into new bucket */
-            struct ind_core_gentable_checksum_bucket *new_bucket;
-            new_bucket = find_checksum_bucket(gentable, &entry->checksum);
-            list_push(&new_bucket->entries, &entry->checksum_links);
-            update_checksum(&new_bucket->checksum, &entry->checksum);
-        }
-    }
-
-    aim_free(old_buckets);
+    checksum_buckets_resize(gentable, new_buckets_size);
 }
 
 struct ind_core_gentable_entry_stats_state {
@@ -486,17 +470,22 @@ entry_stats_iter(void *cookie, indigo_core_gentable_t *gentable,
 
     if (entry != NULL) {
         of_list_bsn_gentable_entry_stats_entry_t stats_entries;
-        of_bsn_gentable_entry_stats_entry_t *stats_entry;
+        of_bsn_gentable_entry_stats_entry_t stats_entry;
         of_list_bsn_tlv_t stats;
 
-        stats_entry = of_bsn_gentable_entry_stats_entry_new(OF_VERSION_1_3);
-        AIM_TRUE_OR_DIE(of_bsn_gentable_entry_stats_entry_key_set(stats_entry, entry->key) == 0);
-        of_bsn_gentable_entry_stats_entry_stats_bind(stats_entry, &stats);
+        /* Build the entry in place at the end of the reply */
+        of_bsn_gentable_entry_stats_reply_entries_bind(state->reply, &stats_entries);
+        of_bsn_gentable_entry_stats_entry_init(&stats_entry, state->reply->version, -1, 1);
+        if (of_list_bsn_gentable_entry_stats_entry_append_bind(&stats_entries, &stats_entry) < 0) {
+            AIM_DIE("unexpected failure appending to a gentable entry stats reply");
+        }
+
+        AIM_TRUE_OR_DIE(of_bsn_gentable_entry_stats_entry_key_set(&stats_entry, entry->key) == 0);
+        of_bsn_gentable_entry_stats_entry_stats_bind(&stats_entry, &stats);
 
         gentable->ops->get_stats(gentable->priv, entry->priv, entry->key, &stats);
 
-        of_bsn_gentable_entry_stats_reply_entries_bind(state->reply, &stats_entries);
-        if (of_list_append(&stats_entries, stats_entry) < 0) {
+        if (state->reply->length > (1 << 15)) { /* Next entry might not fit */
             of_bsn_gentable_entry_stats_reply_flags_set(state->reply,
                                                         OF_STATS_REPLY_FLAG_REPLY_MORE);
             indigo_cxn_send_controller_message(state->cxn_id, state->reply);
@@ -506,14 +495,7 @@ entry_stats_iter(void *cookie, indigo_core_gentable_t *gentable,
             uint32_t xid;
             of_bsn_gentable_entry_stats_request_xid_get(state->request, &xid);
             of_bsn_gentable_entry_stats_reply_xid_set(state->reply, xid);
-
-            of_bsn_gentable_entry_stats_reply_entries_bind(state->reply, &stats_entries);
-            if (of_list_append(&stats_entries, stats_entry) < 0) {
-                AIM_DIE("unexpected failure appending to an empty stats list");
-            }
         }
-
-        of_object_delete(stats_entry);
     } else {
         indigo_cxn_send_controller_message(state->cxn_id, state->reply);
         of_object_delete(state->request);
@@ -554,7 +536,7 @@ ind_core_bsn_gentable_entry_stats_request_handler(
 
     state = aim_zmalloc(sizeof(*state));
     state->cxn_id = cxn_id;
-    state->request = ind_core_dup_tracking(obj, cxn_id);
+    state->request = ind_core_dup_header_tracking(obj, cxn_id);
     state->reply = reply;
 
     rv = ind_core_gentable_spawn_iter_task(gentable, entry_stats_iter, state,
@@ -582,15 +564,20 @@ entry_desc_stats_iter(void *cookie, indigo_core_gentable_t *gentable,
 
     if (entry != NULL) {
         of_list_bsn_gentable_entry_desc_stats_entry_t stats_entries;
-        of_bsn_gentable_entry_desc_stats_entry_t *stats_entry;
-
-        stats_entry = of_bsn_gentable_entry_desc_stats_entry_new(OF_VERSION_1_3);
-        of_bsn_gentable_entry_desc_stats_entry_checksum_set(stats_entry, entry->checksum);
-        AIM_TRUE_OR_DIE(of_bsn_gentable_entry_desc_stats_entry_key_set(stats_entry, entry->key) == 0);
-        AIM_TRUE_OR_DIE(of_bsn_gentable_entry_desc_stats_entry_value_set(stats_entry, entry->value) == 0);
+        of_bsn_gentable_entry_desc_stats_entry_t stats_entry;
 
+        /* Build the entry in place at the end of the reply */
         of_bsn_gentable_entry_desc_stats_reply_entries_bind(state->reply, &stats_entries);
-        if (of_list_append(&stats_entries, stats_entry) < 0) {
+        of_bsn_gentable_entry_desc_stats_entry_init(&stats_entry, state->reply->version, -1, 1);
+        if (of_list_bsn_gentable_entry_desc_stats_entry_append_bind(&stats_entries, &stats_entry) < 0) {
+            AIM_DIE("unexpected failure appending to a gentable entry desc stats reply");
+        }
+
+        of_bsn_gentable_entry_desc_stats_entry_checksum_set(&stats_entry, entry->checksum);
+        AIM_TRUE_OR_DIE(of_bsn_gentable_entry_desc_stats_entry_key_set(&stats_entry, entry->key) == 0);
+        AIM_TRUE_OR_DIE(of_bsn_gentable_entry_desc_stats_entry_value_set(&stats_entry, entry->value) == 0);
+
+        if (state->reply->length > (1 << 15)) { /* Next entry might not fit */
             of_bsn_gentable_entry_desc_stats_reply_flags_set(state->reply,
                                                              OF_STATS_REPLY_FLAG_REPLY_MORE);
             indigo_cxn_send_controller_message(state->cxn_id, state->reply);
@@ -600,14 +587,7 @@ entry_desc_stats_iter(void *cookie, indigo_core_gentable_t *gentable,
             uint32_t xid;
             of_bsn_gentable_entry_desc_stats_request_xid_get(state->request, &xid);
             of_bsn_gentable_entry_desc_stats_reply_xid_set(state->reply, xid);
-
-            of_bsn_gentable_entry_desc_stats_reply_entries_bind(state->reply, &stats_entries);
-            if (of_list_append(&stats_entries, stats_entry) < 0) {
-                AIM_DIE("unexpected failure appending to an empty stats list");
-            }
         }
-
-        of_object_delete(stats_entry);
     } else {
         indigo_cxn_send_controller_message(state->cxn_id, state->reply);
         of_object_delete(state->request);
@@ -648,7 +628,7 @@ ind_core_bsn_gentable_entry_desc_stats_request_handler(
 
     state = aim_zmalloc(sizeof(*state));
     state->cxn_id = cxn_id;
-    state->request = ind_core_dup_tracking(obj, cxn_id);
+    state->request = ind_core_dup_header_tracking(obj, cxn_id);
     state->reply = reply;
 
     rv = ind_core_gentable_spawn_iter_task(gentable, entry_desc_stats_iter, state,
@@ -773,9 +753,6 @@ ind_core_bsn_gentable_bucket_stats_request_handler(
     }
 
     for (i = 0; i < gentable->checksum_buckets_size; i++) {
-        struct ind_core_gentable_checksum_bucket *bucket =
-            &gentable->checksum_buckets[i];
-
         of_bsn_gentable_bucket_stats_entry_t stats_entry;
         of_bsn_gentable_bucket_stats_entry_init(&stats_entry, reply->version, -1, 1);
         if (of_list_bsn_gentable_bucket_stats_entry_append_bind(&stats_entries, &stats_entry)) {
@@ -791,7 +768,8 @@ ind_core_bsn_gentable_bucket_stats_request_handler(
             }
         }
 
-        of_bsn_gentable_bucket_stats_entry_checksum_set(&stats_entry, bucket->checksum);
+        of_bsn_gentable_bucket_stats_entry_checksum_set(
+            &stats_entry, checksum_bucket_checksum(gentable, i));
     }
 
     indigo_cxn_send_controller_message(cxn_id, reply);
@@ -862,9 +840,9 @@ update_checksum(of_checksum_128_t *dst, const of_checksum_128_t *src)
 }
 
 static uint32_t
-hash_key(of_list_bsn_tlv_t *key)
+hash_key(const uint8_t *key_data, uint16_t key_len)
 {
-    return murmur_hash(OF_OBJECT_BUFFER_INDEX(key, 0), key->length, 0);
+    return murmur_hash(key_data, key_len, 0);
 }
 
 static list_head_t *
@@ -873,46 +851,141 @@ find_key_bucket(indigo_core_gentable_t *gentable, uint32_t key_hash)
     return &gentable->key_buckets[key_hash & (gentable->key_buckets_size - 1)];
 }
 
+/* The old key bucket of a hash while resizing, NULL if it has been moved */
+static list_head_t *
+find_old_key_bucket(indigo_core_gentable_t *gentable, uint32_t key_hash)
+{
+    uint32_t idx;
+
+    if (gentable->old_key_buckets == NULL) {
+        return NULL;
+    }
+
+    idx = key_hash & (gentable->old_key_buckets_size - 1);
+    if (idx < gentable->key_migrate_next) {
+        return NULL;
+    }
+
+    return &gentable->old_key_buckets[idx];
+}
+
 static indigo_error_t
 delete_entry(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry)
 {
     indigo_error_t rv;
-    struct ind_core_gentable_checksum_bucket *checksum_bucket;
 
     rv = gentable->ops->del(gentable->priv, entry->priv, entry->key);
     if (rv < 0) {
         return rv;
     }
 
-    list_remove(&entry->key_links);
-    list_remove(&entry->checksum_links);
+    checksum_bucket_remove(gentable, entry);
+    update_checksum(&gentable->checksum, &entry->checksum);
 
-    checksum_bucket = find_checksum_bucket(gentable, &entry->checksum);
+    free_entry(gentable, entry);
+    gentable->num_entries--;
 
-    update_checksum(&checksum_bucket->checksum, &entry->checksum);
-    update_checksum(&gentable->checksum, &entry->checksum);
+    return INDIGO_ERROR_NONE;
+}
+
+/* Accounted size of an entry with its key, and of a value */
+#define GENTABLE_ENTRY_BYTES(_key_len) \
+    (sizeof(struct ind_core_gentable_entry) + sizeof(of_object_t) + 2 * (_key_len))
+#define GENTABLE_VALUE_BYTES(_value) (sizeof(of_object_t) + (_value)->length)
+
+/* Allocate an entry for 'key' and insert it into its key bucket */
+static struct ind_core_gentable_entry *
+new_entry(indigo_core_gentable_t *gentable, of_list_bsn_tlv_t *key)
+{
+    struct ind_core_gentable_entry *entry =
+        aim_zmalloc(sizeof(*entry) + key->length);
+
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_GENTABLE,
+                             GENTABLE_ENTRY_BYTES(key->length));
+
+    entry->key = of_object_dup(key);
+    entry->key_len = key->length;
+    memcpy(entry->key_data, OF_OBJECT_BUFFER_INDEX(key, 0), key->length);
+    entry->key_hash = hash_key(entry->key_data, entry->key_len);
+
+    if (gentable->num_entries >= gentable->key_buckets_size * GENTABLE_KEY_BUCKET_LOAD &&
+            gentable->old_key_buckets == NULL) {
+        key_buckets_grow(gentable);
+    }
+
+    list_push(find_key_bucket(gentable, entry->key_hash), &entry->key_links);
+
+    return entry;
+}
 
+/* Remove an entry from its key bucket and free it */
+static void
+free_entry(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry)
+{
+    list_remove(&entry->key_links);
     of_object_delete(entry->key);
-    of_object_delete(entry->value);
+    if (entry->value != NULL) {
+        delete_value(entry->value);
+    }
+    indigo_mem_account_free(INDIGO_MEM_TAG_GENTABLE,
+                            GENTABLE_ENTRY_BYTES(entry->key_len));
     aim_free(entry);
+}
 
-    gentable->num_entries--;
+static of_object_t *
+dup_value(of_object_t *value)
+{
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_GENTABLE, GENTABLE_VALUE_BYTES(value));
+    return of_object_dup(value);
+}
 
-    return INDIGO_ERROR_NONE;
+static void
+delete_value(of_object_t *value)
+{
+    indigo_mem_account_free(INDIGO_MEM_TAG_GENTABLE, GENTABLE_VALUE_BYTES(value));
+    of_object_delete(value);
 }
 
-static struct ind_core_gentable_entry *
-find_entry_by_key(indigo_core_gentable_t *gentable, of_list_bsn_tlv_t *key)
+/* Entries are always inserted into the current checksum buckets */
+static void
+checksum_bucket_insert(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry)
 {
-    list_links_t *cur, *next;
+    struct ind_core_gentable_checksum_bucket *checksum_bucket =
+        find_checksum_bucket(gentable, &entry->checksum);
+
+    list_push(&checksum_bucket->entries, &entry->checksum_links);
+    update_checksum(&checksum_bucket->checksum, &entry->checksum);
+    entry->checksum_generation = gentable->checksum_generation;
+}
+
+static void
+checksum_bucket_remove(indigo_core_gentable_t *gentable, struct ind_core_gentable_entry *entry)
+{
+    struct ind_core_gentable_checksum_bucket *checksum_bucket;
+
+    if (entry->checksum_generation != gentable->checksum_generation) {
+        /* Not moved out of the old buckets yet */
+        checksum_bucket = &gentable->old_checksum_buckets[
+            entry->checksum.hi >> gentable->old_checksum_buckets_shift];
+    } else {
+        checksum_bucket = find_checksum_bucket(gentable, &entry->checksum);
+    }
+
+    list_remove(&entry->checksum_links);
+    update_checksum(&checksum_bucket->checksum, &entry->checksum);
+}
 
-    uint32_t hash = hash_key(key);
-    list_head_t *bucket = find_key_bucket(gentable, hash);
+static struct ind_core_gentable_entry *
+find_entry_in_key_bucket(list_head_t *bucket, uint32_t hash,
+                         const uint8_t *key_data, uint16_t key_len)
+{
+    list_links_t *cur;
 
-    LIST_FOREACH_SAFE(bucket, cur, next) {
+    LIST_FOREACH(bucket, cur) {
         struct ind_core_gentable_entry *entry =
             container_of(cur, key_links, struct ind_core_gentable_entry);
-        if (entry->key_hash == hash && key_equality(key, entry->key)) {
+        if (entry->key_hash == hash && entry->key_len == key_len &&
+            memcmp(entry->key_data, key_data, key_len) == 0) {
             return entry;
         }
     }
@@ -920,15 +993,461 @@ find_entry_by_key(indigo_core_gentable_t *gentable, of_list_bsn_tlv_t *key)
     return NULL;
 }
 
+static struct ind_core_gentable_entry *
+find_entry_by_key(indigo_core_gentable_t *gentable, of_list_bsn_tlv_t *key)
+{
+    struct ind_core_gentable_entry *entry;
+    const uint8_t *key_data = OF_OBJECT_BUFFER_INDEX(key, 0);
+    uint16_t key_len = key->length;
+    uint32_t hash = hash_key(key_data, key_len);
+    list_head_t *old_bucket;
+
+    entry = find_entry_in_key_bucket(find_key_bucket(gentable, hash),
+                                     hash, key_data, key_len);
+
+    /* While resizing, the entry may not have been moved yet */
+    if (entry == NULL && (old_bucket = find_old_key_bucket(gentable, hash)) != NULL) {
+        entry = find_entry_in_key_bucket(old_bucket, hash, key_data, key_len);
+    }
+
+    return entry;
+}
+
+
+/*
+ * Bucket resizing
+ *
+ * A resize allocates the new bucket array and keeps the old one until a
+ * task has moved every entry across, GENTABLE_RESIZE_BATCH entries at a
+ * time, so resizing a large gentable does not hold the event loop. In
+ * the meantime new entries go into the new buckets and lookups also
+ * check the old bucket of their key. An entry's checksum_generation
+ * tells which checksum bucket array it is in.
+ *
+ * The key buckets double whenever the gentable averages
+ * GENTABLE_KEY_BUCKET_LOAD entries per bucket; the controller sets the
+ * checksum buckets size.
+ */
+
+struct gentable_resize_task_state {
+    uint16_t table_id;
+    uint64_t generation_id;
+};
+
+/*
+ * Move up to 'max' entries out of the old buckets. Returns true once
+ * both old arrays are gone.
+ */
 static bool
-key_equality(of_list_bsn_tlv_t *a, of_list_bsn_tlv_t *b)
+gentable_migrate(indigo_core_gentable_t *gentable, int max)
 {
-    if (a->length != b->length) {
-        return false;
+    list_links_t *cur;
+
+    while (max > 0 && gentable->old_key_buckets != NULL) {
+        max--;
+        cur = list_shift(&gentable->old_key_buckets[gentable->key_migrate_next]);
+        if (cur == NULL) {
+            if (++gentable->key_migrate_next == gentable->old_key_buckets_size) {
+                aim_free(gentable->old_key_buckets);
+                gentable->old_key_buckets = NULL;
+                gentable->old_key_buckets_size = 0;
+            }
+            continue;
+        }
+
+        struct ind_core_gentable_entry *entry =
+            container_of(cur, key_links, struct ind_core_gentable_entry);
+        list_push(find_key_bucket(gentable, entry->key_hash), &entry->key_links);
     }
 
-    return memcmp(OF_OBJECT_BUFFER_INDEX(a, 0),
-                  OF_OBJECT_BUFFER_INDEX(b, 0), a->length) == 0;
+    while (max > 0 && gentable->old_checksum_buckets != NULL) {
+        struct ind_core_gentable_checksum_bucket *old_bucket =
+            &gentable->old_checksum_buckets[gentable->checksum_migrate_next];
+
+        max--;
+        cur = list_first(&old_bucket->entries);
+        if (cur == NULL) {
+            if (++gentable->checksum_migrate_next == gentable->old_checksum_buckets_size) {
+                aim_free(gentable->old_checksum_buckets);
+                gentable->old_checksum_buckets = NULL;
+                gentable->old_checksum_buckets_size = 0;
+            }
+            continue;
+        }
+
+        struct ind_core_gentable_entry *entry =
+            container_of(cur, checksum_links, struct ind_core_gentable_entry);
+        checksum_bucket_remove(gentable, entry);
+        checksum_bucket_insert(gentable, entry);
+    }
+
+    return gentable->old_key_buckets == NULL && gentable->old_checksum_buckets == NULL;
+}
+
+static ind_soc_task_status_t
+gentable_resize_task(void *cookie)
+{
+    struct gentable_resize_task_state *state = cookie;
+    indigo_core_gentable_t *gentable = find_gentable_by_id(state->table_id);
+
+    if (gentable == NULL || gentable->generation_id != state->generation_id) {
+        /* Unregistered */
+        aim_free(state);
+        return IND_SOC_TASK_FINISHED;
+    }
+
+    do {
+        if (gentable_migrate(gentable, GENTABLE_RESIZE_BATCH)) {
+            gentable->resize_task = false;
+            aim_free(state);
+            return IND_SOC_TASK_FINISHED;
+        }
+    } while (!ind_soc_should_yield());
+
+    return IND_SOC_TASK_CONTINUE;
+}
+
+static void
+gentable_resize_task_start(indigo_core_gentable_t *gentable)
+{
+    struct gentable_resize_task_state *state;
+
+    if (gentable->resize_task) {
+        return;
+    }
+
+    state = aim_zmalloc(sizeof(*state));
+    state->table_id = gentable->table_id;
+    state->generation_id = gentable->generation_id;
+
+    if (ind_soc_task_register(gentable_resize_task, state,
+                              IND_SOC_DEFAULT_PRIORITY) < 0) {
+        AIM_LOG_ERROR("Failed to create %s gentable resize task, resizing at once",
+                      gentable->name);
+        aim_free(state);
+        while (!gentable_migrate(gentable, INT_MAX));
+        return;
+    }
+
+    gentable->resize_task = true;
+}
+
+static void
+key_buckets_grow(indigo_core_gentable_t *gentable)
+{
+    int i;
+
+    gentable->old_key_buckets = gentable->key_buckets;
+    gentable->old_key_buckets_size = gentable->key_buckets_size;
+    gentable->key_migrate_next = 0;
+
+    gentable->key_buckets_size *= 2;
+    gentable->key_buckets = aim_malloc(sizeof(*gentable->key_buckets) *
+                                       gentable->key_buckets_size);
+    for (i = 0; i < gentable->key_buckets_size; i++) {
+        list_init(&gentable->key_buckets[i]);
+    }
+
+    gentable_resize_task_start(gentable);
+}
+
+static void
+checksum_buckets_resize(indigo_core_gentable_t *gentable, uint32_t buckets_size)
+{
+    int i;
+
+    /* Finish the previous resize first */
+    while (gentable->old_checksum_buckets != NULL) {
+        gentable_migrate(gentable, INT_MAX);
+    }
+
+    gentable->old_checksum_buckets = gentable->checksum_buckets;
+    gentable->old_checksum_buckets_size = gentable->checksum_buckets_size;
+    gentable->old_checksum_buckets_shift = gentable->checksum_buckets_shift;
+    gentable->checksum_migrate_next = 0;
+    gentable->checksum_generation++;
+
+    gentable->checksum_buckets_size = buckets_size;
+    gentable->checksum_buckets = aim_malloc(sizeof(*gentable->checksum_buckets) *
+                                            gentable->checksum_buckets_size);
+
+    gentable->checksum_buckets_shift =
+        calc_checksum_buckets_shift(gentable->checksum_buckets_size);
+
+    for (i = 0; i < gentable->checksum_buckets_size; i++) {
+        struct ind_core_gentable_checksum_bucket *bucket =
+            &gentable->checksum_buckets[i];
+        bucket->checksum.lo = 0;
+        bucket->checksum.hi = 0;
+        list_init(&bucket->entries);
+    }
+
+    gentable_resize_task_start(gentable);
+}
+
+/*
+ * The checksum of a bucket of the current size, including the entries
+ * still in the old buckets
+ */
+static of_checksum_128_t
+checksum_bucket_checksum(indigo_core_gentable_t *gentable, uint32_t idx)
+{
+    of_checksum_128_t checksum = gentable->checksum_buckets[idx].checksum;
+    uint64_t mask = ~(uint64_t)0 << gentable->checksum_buckets_shift;
+    uint64_t start = (uint64_t)idx << gentable->checksum_buckets_shift;
+    uint32_t old_idx, old_last;
+    list_links_t *cur;
+
+    if (gentable->old_checksum_buckets == NULL) {
+        return checksum;
+    }
+
+    old_idx = start >> gentable->old_checksum_buckets_shift;
+    old_last = (start | ~mask) >> gentable->old_checksum_buckets_shift;
+    if (old_idx < gentable->checksum_migrate_next) {
+        old_idx = gentable->checksum_migrate_next;
+    }
+
+    for (; old_idx <= old_last; old_idx++) {
+        struct ind_core_gentable_checksum_bucket *old_bucket =
+            &gentable->old_checksum_buckets[old_idx];
+
+        if (gentable->old_checksum_buckets_shift <= gentable->checksum_buckets_shift) {
+            /* Shrinking, the old bucket is all in this one */
+            update_checksum(&checksum, &old_bucket->checksum);
+            continue;
+        }
+
+        LIST_FOREACH(&old_bucket->entries, cur) {
+            struct ind_core_gentable_entry *entry =
+                container_of(cur, checksum_links, struct ind_core_gentable_entry);
+            if ((entry->checksum.hi & mask) == start) {
+                update_checksum(&checksum, &entry->checksum);
+            }
+        }
+    }
+
+    return checksum;
+}
+
+
+/*
+ * Gentable batches
+ *
+ * The gentable entry adds and deletes committed in a bundle are applied
+ * here. Consecutive messages for the same table are collected and handed
+ * to the table's batch operation in one call, or to its add, modify and
+ * del operations in turn if it has none. The table checksum is updated
+ * once per call.
+ *
+ * A message for a key already in the pending batch flushes it first, so
+ * a key appears at most once per call. A new entry is in the key
+ * hashtable from the time it is batched so that this also holds for
+ * repeated adds; it is removed again if the add fails.
+ */
+
+#define GENTABLE_BATCH_MAX 256
+
+static struct {
+    indigo_core_gentable_t *gentable;
+    indigo_cxn_id_t cxn_id;
+    int count;
+    indigo_core_gentable_op_t ops[GENTABLE_BATCH_MAX];
+    struct ind_core_gentable_entry *entries[GENTABLE_BATCH_MAX];
+    of_object_t *msgs[GENTABLE_BATCH_MAX];
+    of_list_bsn_tlv_t keys[GENTABLE_BATCH_MAX];
+    of_list_bsn_tlv_t values[GENTABLE_BATCH_MAX];
+} gentable_batch;
+
+static void
+gentable_batch_flush(void)
+{
+    indigo_core_gentable_t *gentable = gentable_batch.gentable;
+    of_checksum_128_t checksum_delta = { 0, 0 };
+    int count = gentable_batch.count;
+    int i;
+
+    if (count == 0) {
+        return;
+    }
+    gentable_batch.count = 0;
+
+    if (gentable->ops->batch != NULL) {
+        gentable->ops->batch(gentable->priv, gentable_batch.ops, count);
+    } else {
+        for (i = 0; i < count; i++) {
+            indigo_core_gentable_op_t *op = &gentable_batch.ops[i];
+            switch (op->type) {
+            case INDIGO_CORE_GENTABLE_OP_ADD:
+                op->result = gentable->ops->add(gentable->priv, op->key,
+                                                op->value, &op->entry_priv);
+                break;
+            case INDIGO_CORE_GENTABLE_OP_MODIFY:
+                op->result = gentable->ops->modify(gentable->priv, op->entry_priv,
+                                                   op->key, op->value);
+                break;
+            case INDIGO_CORE_GENTABLE_OP_DELETE:
+                op->result = gentable->ops->del(gentable->priv, op->entry_priv,
+                                                op->key);
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        indigo_core_gentable_op_t *op = &gentable_batch.ops[i];
+        struct ind_core_gentable_entry *entry = gentable_batch.entries[i];
+        of_object_t *obj = gentable_batch.msgs[i];
+
+        entry->pending = false;
+
+        if (op->result != INDIGO_ERROR_NONE) {
+            AIM_LOG_ERROR("%s gentable %s failed: %s", gentable->name,
+                          op->type == INDIGO_CORE_GENTABLE_OP_ADD ? "add" :
+                          op->type == INDIGO_CORE_GENTABLE_OP_MODIFY ? "modify" : "delete",
+                          indigo_strerror(op->result));
+            if (op->type == INDIGO_CORE_GENTABLE_OP_ADD) {
+                free_entry(gentable, entry);
+            }
+            indigo_cxn_send_error_reply(
+                gentable_batch.cxn_id, obj,
+                OF_ERROR_TYPE_BAD_REQUEST,
+                OF_REQUEST_FAILED_EPERM);
+            continue;
+        }
+
+        switch (op->type) {
+        case INDIGO_CORE_GENTABLE_OP_ADD:
+            entry->priv = op->entry_priv;
+            gentable->num_entries++;
+            break;
+        case INDIGO_CORE_GENTABLE_OP_MODIFY:
+            checksum_bucket_remove(gentable, entry);
+            update_checksum(&checksum_delta, &entry->checksum);
+            delete_value(entry->value);
+            break;
+        case INDIGO_CORE_GENTABLE_OP_DELETE:
+            checksum_bucket_remove(gentable, entry);
+            update_checksum(&checksum_delta, &entry->checksum);
+            free_entry(gentable, entry);
+            gentable->num_entries--;
+            continue;
+        }
+
+        entry->value = dup_value(op->value);
+        of_bsn_gentable_entry_add_checksum_get(obj, &entry->checksum);
+        checksum_bucket_insert(gentable, entry);
+        update_checksum(&checksum_delta, &entry->checksum);
+    }
+
+    update_checksum(&gentable->checksum, &checksum_delta);
+}
+
+static void
+gentable_batch_append(indigo_cxn_id_t cxn_id, of_object_t *obj)
+{
+    bool is_add = obj->object_id == OF_BSN_GENTABLE_ENTRY_ADD;
+    indigo_core_gentable_t *gentable;
+    indigo_core_gentable_op_t *op;
+    struct ind_core_gentable_entry *entry;
+    of_list_bsn_tlv_t *key, *value;
+    uint16_t table_id;
+    int idx;
+
+    if (is_add) {
+        of_bsn_gentable_entry_add_table_id_get(obj, &table_id);
+    } else {
+        of_bsn_gentable_entry_delete_table_id_get(obj, &table_id);
+    }
+
+    gentable = find_gentable_by_id(table_id);
+    if (gentable == NULL) {
+        AIM_LOG_ERROR("Nonexistent gentable id %d", table_id);
+        indigo_cxn_send_error_reply(
+            cxn_id, obj,
+            OF_ERROR_TYPE_BAD_REQUEST,
+            OF_REQUEST_FAILED_BAD_TABLE_ID);
+        return;
+    }
+
+    if (gentable != gentable_batch.gentable || cxn_id != gentable_batch.cxn_id ||
+        gentable_batch.count == GENTABLE_BATCH_MAX) {
+        gentable_batch_flush();
+        gentable_batch.gentable = gentable;
+        gentable_batch.cxn_id = cxn_id;
+    }
+
+    idx = gentable_batch.count;
+    key = &gentable_batch.keys[idx];
+    value = &gentable_batch.values[idx];
+    if (is_add) {
+        of_bsn_gentable_entry_add_key_bind(obj, key);
+        of_bsn_gentable_entry_add_value_bind(obj, value);
+    } else {
+        of_bsn_gentable_entry_delete_key_bind(obj, key);
+    }
+
+    entry = find_entry_by_key(gentable, key);
+    if (entry != NULL && entry->pending) {
+        gentable_batch_flush();
+        /* The key and value stay bound to obj */
+        gentable_batch.keys[0] = *key;
+        gentable_batch.values[0] = *value;
+        idx = 0;
+        key = &gentable_batch.keys[0];
+        value = &gentable_batch.values[0];
+        entry = find_entry_by_key(gentable, key);
+    }
+
+    op = &gentable_batch.ops[idx];
+    memset(op, 0, sizeof(*op));
+
+    if (is_add) {
+        op->key = key;
+        op->value = value;
+        if (entry == NULL) {
+            op->type = INDIGO_CORE_GENTABLE_OP_ADD;
+            entry = new_entry(gentable, key);
+        } else {
+            op->type = INDIGO_CORE_GENTABLE_OP_MODIFY;
+            op->entry_priv = entry->priv;
+        }
+    } else {
+        if (entry == NULL) {
+            AIM_LOG_TRACE("Nonexistent %s gentable entry", gentable->name);
+            return;
+        }
+        op->type = INDIGO_CORE_GENTABLE_OP_DELETE;
+        op->key = entry->key;
+        op->entry_priv = entry->priv;
+    }
+
+    entry->pending = true;
+    gentable_batch.entries[idx] = entry;
+    gentable_batch.msgs[idx] = obj;
+    gentable_batch.count = idx + 1;
+}
+
+/**
+ * Apply the gentable entry adds and deletes among 'msgs' in batches
+ *
+ * Other messages are skipped. The messages must not be freed before
+ * this returns.
+ */
+void
+ind_core_gentable_entry_batch(indigo_cxn_id_t cxn_id, of_object_t **msgs, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (msgs[i]->object_id == OF_BSN_GENTABLE_ENTRY_ADD ||
+            msgs[i]->object_id == OF_BSN_GENTABLE_ENTRY_DELETE) {
+            gentable_batch_append(cxn_id, msgs[i]);
+        }
+    }
+
+    gentable_batch_flush();
+    gentable_batch.gentable = NULL;
 }
 
 
@@ -953,6 +1472,40 @@ struct ind_core_gentable_iter_task_state {
     of_checksum_128_t checksum_mask;
 };
 
+/* Visit the entries of a bucket in the step from next_checksum */
+static void
+ind_core_gentable_iter_bucket(struct ind_core_gentable_iter_task_state *state,
+                              indigo_core_gentable_t *gentable,
+                              struct ind_core_gentable_checksum_bucket *bucket,
+                              uint64_t step_mask)
+{
+    list_links_t *cur, *next;
+    LIST_FOREACH_SAFE(&bucket->entries, cur, next) {
+        struct ind_core_gentable_entry *entry =
+            container_of(cur, checksum_links, struct ind_core_gentable_entry);
+
+        if (entry->checksum.hi < state->next_checksum.hi) {
+            /* Buckets were shrunk */
+            continue;
+        }
+
+        if ((entry->checksum.hi & step_mask) != (state->next_checksum.hi & step_mask)) {
+            /* Beyond the step while resizing */
+            continue;
+        }
+
+        if ((entry->checksum.hi & state->checksum_mask.hi) != state->checksum_prefix.hi) {
+            continue;
+        }
+
+        if ((entry->checksum.lo & state->checksum_mask.lo) != state->checksum_prefix.lo) {
+            continue;
+        }
+
+        state->callback(state->cookie, gentable, entry);
+    }
+}
+
 static ind_soc_task_status_t
 ind_core_gentable_iter_task_callback(void *cookie)
 {
@@ -975,36 +1528,36 @@ ind_core_gentable_iter_task_callback(void *cookie)
      * checksum in the next bucket. If the buckets were shrunk then this may be
      * somewhere in the middle of the checksum range of a bucket, in which case
      * we'll ignore the entries we've already seen.
+     *
+     * While the buckets are being resized each step covers the range of the
+     * smaller of an old and a new bucket, and visits the entries in that
+     * range in both.
      */
 
     do {
-        struct ind_core_gentable_checksum_bucket *bucket =
-            find_checksum_bucket(gentable, &state->next_checksum);
+        uint8_t shift = gentable->checksum_buckets_shift;
 
-        list_links_t *cur, *next;
-        LIST_FOREACH_SAFE(&bucket->entries, cur, next) {
-            struct ind_core_gentable_entry *entry =
-                container_of(cur, checksum_links, struct ind_core_gentable_entry);
+        if (gentable->old_checksum_buckets != NULL &&
+                gentable->old_checksum_buckets_shift < shift) {
+            shift = gentable->old_checksum_buckets_shift;
+        }
 
-            if (entry->checksum.hi < state->next_checksum.hi) {
-                /* Buckets were shrunk */
-                continue;
-            }
+        const uint64_t bucket_interval = (uint64_t)1 << shift;
+        const uint64_t bucket_mask = ~(uint64_t)0 << shift;
 
-            if ((entry->checksum.hi & state->checksum_mask.hi) != state->checksum_prefix.hi) {
-                continue;
-            }
+        ind_core_gentable_iter_bucket(
+            state, gentable, find_checksum_bucket(gentable, &state->next_checksum),
+            bucket_mask);
 
-            if ((entry->checksum.lo & state->checksum_mask.lo) != state->checksum_prefix.lo) {
-                continue;
+        if (gentable->old_checksum_buckets != NULL) {
+            uint32_t old_idx = state->next_checksum.hi >> gentable->old_checksum_buckets_shift;
+            if (old_idx >= gentable->checksum_migrate_next) {
+                ind_core_gentable_iter_bucket(
+                    state, gentable, &gentable->old_checksum_buckets[old_idx],
+                    bucket_mask);
             }
-
-            state->callback(state->cookie, gentable, entry);
         }
 
-        const uint64_t bucket_interval = (uint64_t)1 << gentable->checksum_buckets_shift;
-        const uint64_t bucket_mask = ~(uint64_t)0 << gentable->checksum_buckets_shift;
-
         /* Advance to next bucket */
         state->next_checksum.hi += bucket_interval;
 
@@ -35,28 +35,337 @@
 #include "ofstatemanager_decs.h"
 #include "ofstatemanager_int.h"
 #include "handlers.h"
-#include <BigHash/bighash.h>
+#include <BigHash/bighash_oa.h>
+#include <AIM/aim_list.h>
+#include "ft.h"
+
+/*
+ * Group reference graph
+ *
+ * Each group records the groups its buckets forward to (children), how
+ * many group actions in other groups point at it, and the flows whose
+ * instructions reference it. This lets a delete of a group that is still
+ * in use be refused without a round trip to Forwarding, lets a delete of
+ * all groups proceed from the top of the chains down, and answers which
+ * flows use a group without walking the flowtable.
+ */
 
 typedef struct ind_core_group_s {
-    bighash_entry_t hash_entry;
     uint32_t id;
     uint32_t type;
     of_list_bucket_t *buckets;
     indigo_time_t creation_time;
+
+    /* Groups referenced by group actions in the buckets */
+    uint32_t *children;
+    int num_children;
+
+    /* Group actions in other groups that reference this group */
+    uint32_t group_refs;
+
+    /* ind_core_group_flow_ref_t for each flow referencing this group */
+    list_head_t flow_refs;
+    uint32_t num_flow_refs;
+
+    /* Restored by a warm restart and not yet re-added by a controller */
+    bool stale;
 } ind_core_group_t;
 
+typedef struct ind_core_group_flow_ref_s {
+    list_links_t group_links;   /* In ind_core_group_t.flow_refs */
+    list_links_t flow_links;    /* In ft_entry_t.group_refs */
+    ind_core_group_t *group;
+    ft_entry_t *entry;
+} ind_core_group_flow_ref_t;
+
+/* Accounted size of a bucket list */
+#define GROUP_BUCKETS_BYTES(_buckets) (sizeof(of_object_t) + (_buckets)->length)
+
 #define TEMPLATE_NAME group_hashtable
 #define TEMPLATE_OBJ_TYPE ind_core_group_t
 #define TEMPLATE_KEY_FIELD id
-#define TEMPLATE_ENTRY_FIELD hash_entry
-#include <BigHash/bighash_template.h>
+#include <BigHash/bighash_oa_template.h>
 
-static bighash_table_t *ind_core_group_hashtable;
+static bighash_oa_table_t *ind_core_group_hashtable;
 
 static ind_core_group_t *
 ind_core_group_lookup(uint32_t id)
 {
-    return group_hashtable_first(ind_core_group_hashtable, &id);
+    return group_hashtable_lookup(ind_core_group_hashtable, &id);
+}
+
+/* Growable list of group IDs */
+struct group_id_list {
+    uint32_t *ids;
+    int count;
+    int size;
+};
+
+static void
+group_id_list_append(struct group_id_list *list, uint32_t id)
+{
+    if (list->count == list->size) {
+        list->size = list->size ? list->size * 2 : 4;
+        list->ids = aim_realloc(list->ids, list->size * sizeof(*list->ids));
+    }
+    list->ids[list->count++] = id;
+}
+
+static void
+group_id_list_add_actions(struct group_id_list *list, of_list_action_t *actions)
+{
+    of_action_t act;
+    int loop_rv;
+    uint32_t group_id;
+
+    OF_LIST_ACTION_ITER(actions, &act, loop_rv) {
+        if (act.header.object_id == OF_ACTION_GROUP) {
+            of_action_group_group_id_get(&act.group, &group_id);
+            group_id_list_append(list, group_id);
+        }
+    }
+}
+
+static void
+group_id_list_add_buckets(struct group_id_list *list, of_list_bucket_t *buckets)
+{
+    of_bucket_t bucket;
+    of_list_action_t actions;
+    int loop_rv;
+
+    OF_LIST_BUCKET_ITER(buckets, &bucket, loop_rv) {
+        of_bucket_actions_bind(&bucket, &actions);
+        group_id_list_add_actions(list, &actions);
+    }
+}
+
+static void
+group_id_list_add_instructions(struct group_id_list *list,
+                               of_list_instruction_t *instructions)
+{
+    of_instruction_t inst;
+    of_list_action_t actions;
+    int loop_rv;
+
+    OF_LIST_INSTRUCTION_ITER(instructions, &inst, loop_rv) {
+        if (inst.header.object_id == OF_INSTRUCTION_APPLY_ACTIONS) {
+            of_instruction_apply_actions_actions_bind(&inst.apply_actions, &actions);
+            group_id_list_add_actions(list, &actions);
+        } else if (inst.header.object_id == OF_INSTRUCTION_WRITE_ACTIONS) {
+            of_instruction_write_actions_actions_bind(&inst.write_actions, &actions);
+            group_id_list_add_actions(list, &actions);
+        }
+    }
+}
+
+/* Return true if group 'id' is reachable from any of the given groups */
+static bool
+ind_core_group_reaches(uint32_t *children, int num_children, uint32_t id)
+{
+    int i;
+
+    for (i = 0; i < num_children; i++) {
+        ind_core_group_t *child;
+        if (children[i] == id) {
+            return true;
+        }
+        child = ind_core_group_lookup(children[i]);
+        if (child != NULL &&
+                ind_core_group_reaches(child->children, child->num_children, id)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Check the groups referenced by buckets for group 'id'. On success the
+ * referenced IDs are returned in 'list'.
+ */
+static uint16_t
+ind_core_group_children_check(uint32_t id, of_list_bucket_t *buckets,
+                              struct group_id_list *list)
+{
+    int i;
+
+    group_id_list_add_buckets(list, buckets);
+
+    for (i = 0; i < list->count; i++) {
+        if (list->ids[i] == id) {
+            return OF_GROUP_MOD_FAILED_LOOP;
+        }
+        if (ind_core_group_lookup(list->ids[i]) == NULL) {
+            return OF_GROUP_MOD_FAILED_INVALID_GROUP;
+        }
+    }
+
+    if (ind_core_group_reaches(list->ids, list->count, id)) {
+        return OF_GROUP_MOD_FAILED_LOOP;
+    }
+
+    return 0;
+}
+
+static void
+ind_core_group_children_unref(ind_core_group_t *group)
+{
+    int i;
+
+    for (i = 0; i < group->num_children; i++) {
+        ind_core_group_t *child = ind_core_group_lookup(group->children[i]);
+        /* The child may have been replaced after a failed modify */
+        if (child != NULL && child->group_refs > 0) {
+            child->group_refs--;
+        }
+    }
+
+    aim_free(group->children);
+    group->children = NULL;
+    group->num_children = 0;
+}
+
+/* Takes ownership of list->ids */
+static void
+ind_core_group_children_set(ind_core_group_t *group, struct group_id_list *list)
+{
+    int i;
+
+    ind_core_group_children_unref(group);
+
+    group->children = list->ids;
+    group->num_children = list->count;
+
+    for (i = 0; i < group->num_children; i++) {
+        ind_core_group_t *child = ind_core_group_lookup(group->children[i]);
+        if (child != NULL) {
+            child->group_refs++;
+        }
+    }
+}
+
+static bool
+ind_core_group_in_use_internal(ind_core_group_t *group)
+{
+    return group->group_refs > 0 || group->num_flow_refs > 0;
+}
+
+bool
+ind_core_group_in_use(uint32_t id)
+{
+    ind_core_group_t *group = ind_core_group_lookup(id);
+    return group != NULL && ind_core_group_in_use_internal(group);
+}
+
+bool
+ind_core_group_exists(uint32_t id)
+{
+    return ind_core_group_lookup(id) != NULL;
+}
+
+of_list_bucket_t *
+ind_core_group_buckets_get(uint32_t id, uint32_t *type)
+{
+    ind_core_group_t *group = ind_core_group_lookup(id);
+
+    if (group == NULL) {
+        return NULL;
+    }
+
+    *type = group->type;
+    return group->buckets;
+}
+
+void
+ind_core_group_flow_ref(ft_entry_t *entry)
+{
+    struct group_id_list list = { NULL, 0, 0 };
+    int i;
+
+    if (entry->effects.instructions == NULL ||
+            entry->effects.instructions->version == OF_VERSION_1_0) {
+        return;
+    }
+
+    group_id_list_add_instructions(&list, entry->effects.instructions);
+
+    for (i = 0; i < list.count; i++) {
+        ind_core_group_t *group = ind_core_group_lookup(list.ids[i]);
+        ind_core_group_flow_ref_t *ref;
+        if (group == NULL) {
+            continue;
+        }
+        ref = indigo_mem_zalloc(INDIGO_MEM_TAG_GROUP, sizeof(*ref));
+        ref->group = group;
+        ref->entry = entry;
+        list_push(&group->flow_refs, &ref->group_links);
+        list_push(&entry->group_refs, &ref->flow_links);
+        group->num_flow_refs++;
+    }
+
+    aim_free(list.ids);
+}
+
+static void
+ind_core_group_flow_ref_free(ind_core_group_flow_ref_t *ref)
+{
+    list_remove(&ref->group_links);
+    list_remove(&ref->flow_links);
+    ref->group->num_flow_refs--;
+    indigo_mem_free(INDIGO_MEM_TAG_GROUP, ref, sizeof(*ref));
+}
+
+void
+ind_core_group_flow_unref(ft_entry_t *entry)
+{
+    list_links_t *cur, *next;
+
+    LIST_FOREACH_SAFE(&entry->group_refs, cur, next) {
+        ind_core_group_flow_ref_free(
+            container_of(cur, flow_links, ind_core_group_flow_ref_t));
+    }
+}
+
+int
+ind_core_group_flows_foreach(uint32_t id, ind_core_group_flow_iter_f callback,
+                             void *cookie)
+{
+    ind_core_group_t *group = ind_core_group_lookup(id);
+    list_links_t *cur, *next;
+    int count = 0;
+
+    if (group == NULL) {
+        return 0;
+    }
+
+    LIST_FOREACH_SAFE(&group->flow_refs, cur, next) {
+        ind_core_group_flow_ref_t *ref =
+            container_of(cur, group_links, ind_core_group_flow_ref_t);
+        callback(cookie, ref->entry);
+        count++;
+    }
+
+    return count;
+}
+
+/* Drop the group from the graph and the table */
+static void
+ind_core_group_free(ind_core_group_t *group)
+{
+    list_links_t *cur, *next;
+
+    ind_core_group_children_unref(group);
+
+    /* Only reached if Forwarding deleted a group that was still in use */
+    LIST_FOREACH_SAFE(&group->flow_refs, cur, next) {
+        ind_core_group_flow_ref_free(
+            container_of(cur, group_links, ind_core_group_flow_ref_t));
+    }
+
+    indigo_mem_account_free(INDIGO_MEM_TAG_GROUP, GROUP_BUCKETS_BYTES(group->buckets));
+    of_object_delete(group->buckets);
+    group_hashtable_remove(ind_core_group_hashtable, group);
+    indigo_mem_free(INDIGO_MEM_TAG_GROUP, group, sizeof(*group));
 }
 
 #ifdef OFDPA_FIXUP
@@ -66,22 +375,168 @@ ind_core_group_delete_one(ind_core_group_t *group)
     indigo_error_t result;
     result = indigo_fwd_group_delete(group->id);
     if (result >= 0) {
-      of_object_delete(group->buckets);
-      bighash_remove(ind_core_group_hashtable, &group->hash_entry);
-      aim_free(group);
+      ind_core_group_free(group);
     }
     return result;
 }
 #else
-static void
+static indigo_error_t
 ind_core_group_delete_one(ind_core_group_t *group)
 {
     indigo_fwd_group_delete(group->id);
-    of_object_delete(group->buckets);
-    bighash_remove(ind_core_group_hashtable, &group->hash_entry);
-    aim_free(group);
+    ind_core_group_free(group);
+    return INDIGO_ERROR_NONE;
+}
+#endif
+
+/*
+ * Delete every group that is not used by a flow, referencing groups
+ * before the groups they reference. Groups used by flows, and the groups
+ * below them, are left in place.
+ */
+uint16_t
+ind_core_group_delete_all(void)
+{
+    struct group_id_list ready = { NULL, 0, 0 };
+    bighash_oa_iter_t iter;
+    ind_core_group_t *group;
+    uint16_t err_code = 0;
+    int i;
+
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group; group = bighash_oa_iter_next(&iter)) {
+        if (!ind_core_group_in_use_internal(group)) {
+            group_id_list_append(&ready, group->id);
+        }
+    }
+
+    /* 'ready' grows as groups lose their last reference */
+    for (i = 0; i < ready.count; i++) {
+        uint32_t *children;
+        int num_children, j;
+
+        group = ind_core_group_lookup(ready.ids[i]);
+        AIM_ASSERT(group != NULL);
+
+        /* Keep the children past the free */
+        children = group->children;
+        num_children = group->num_children;
+        group->children = NULL;
+        group->num_children = 0;
+
+        if (ind_core_group_delete_one(group) < 0) {
+            err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
+            group->children = children;
+            group->num_children = num_children;
+            continue;
+        }
+
+        for (j = 0; j < num_children; j++) {
+            ind_core_group_t *child = ind_core_group_lookup(children[j]);
+            if (child != NULL && child->group_refs > 0) {
+                child->group_refs--;
+                if (!ind_core_group_in_use_internal(child)) {
+                    group_id_list_append(&ready, child->id);
+                }
+            }
+        }
+        aim_free(children);
+    }
+
+    aim_free(ready.ids);
+
+    if (err_code == 0 && bighash_oa_entry_count(ind_core_group_hashtable) > 0) {
+        err_code = OF_GROUP_MOD_FAILED_CHAINED_GROUP;
+    }
+
+    return err_code;
+}
+
+/*
+ * Put a group's previous type and buckets back into Forwarding after a
+ * failed update. 'readd' is set when the update had already deleted the
+ * group. The group's references are left as they were; a group that
+ * cannot be restored is dropped only if nothing references it.
+ */
+static void
+ind_core_group_rollback(ind_core_group_t *group, bool readd)
+{
+    indigo_error_t result;
+
+    if (readd) {
+        result = indigo_fwd_group_add(group->id, group->type, group->buckets);
+    } else {
+        result = indigo_fwd_group_modify(group->id, group->buckets);
+    }
+
+    if (result < 0) {
+        AIM_LOG_ERROR("Failed to restore group %u: %s",
+                      group->id, indigo_strerror(result));
+        if (!ind_core_group_in_use_internal(group)) {
+            if (readd) {
+                ind_core_group_free(group);
+            } else {
+                ind_core_group_delete_one(group);
+            }
+        }
+    }
 }
+
+/*
+ * Replace the type and buckets of a group. Returns 0 or the group mod
+ * failed code. On failure the previous buckets and references are kept;
+ * the group is deleted only if they cannot be restored and it is unused.
+ */
+static uint16_t
+ind_core_group_update(ind_core_group_t *group, uint8_t type,
+                      of_list_bucket_t *buckets)
+{
+    struct group_id_list children = { NULL, 0, 0 };
+    uint32_t id = group->id;
+    indigo_error_t result;
+    uint16_t err_code;
+
+    if ((err_code = ind_core_group_children_check(id, buckets, &children)) != 0) {
+        aim_free(children.ids);
+        return err_code;
+    }
+
+    if (group->type == type) {
+        result = indigo_fwd_group_modify(id, buckets);
+        if (result < 0) {
+            aim_free(children.ids);
+            ind_core_group_rollback(group, false);
+            return OF_GROUP_MOD_FAILED_INVALID_GROUP;
+        }
+    } else {
+#ifdef OFDPA_FIXUP
+        result = indigo_fwd_group_delete(id);
+        if (result < 0) {
+            aim_free(children.ids);
+            return OF_GROUP_MOD_FAILED_INVALID_GROUP;
+        }
+#else
+        indigo_fwd_group_delete(id);
 #endif
+        result = indigo_fwd_group_add(id, type, buckets);
+        if (result < 0) {
+            aim_free(children.ids);
+            ind_core_group_rollback(group, true);
+            return OF_GROUP_MOD_FAILED_INVALID_GROUP;
+        }
+    }
+
+    group->type = type;
+    indigo_mem_account_free(INDIGO_MEM_TAG_GROUP, GROUP_BUCKETS_BYTES(group->buckets));
+    of_object_delete(group->buckets);
+    group->buckets = of_object_dup(buckets);
+    AIM_TRUE_OR_DIE(group->buckets != NULL);
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_GROUP, GROUP_BUCKETS_BYTES(group->buckets));
+    group->stale = false;
+    ind_core_group_children_set(group, &children);
+
+    return 0;
+}
 
 void
 ind_core_group_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
@@ -95,6 +550,7 @@ ind_core_group_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     uint16_t err_type = OF_ERROR_TYPE_GROUP_MOD_FAILED;
     uint16_t err_code = OF_GROUP_MOD_FAILED_EPERM;
     indigo_error_t result;
+    struct group_id_list children = { NULL, 0, 0 };
 
     of_group_add_xid_get(obj, &xid);
     of_group_add_group_type_get(obj, &type);
@@ -105,6 +561,20 @@ ind_core_group_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         group = ind_core_group_lookup(id);
     }
 
+    if (group != NULL && group->stale) {
+        /* Re-added after a warm restart; the controller's copy wins */
+        group->stale = false;
+        if (group->type == type &&
+                ind_core_warm_list_equal(group->buckets, &buckets)) {
+            ind_core_warm_confirmed();
+            return;
+        }
+        if ((err_code = ind_core_group_update(group, type, &buckets)) != 0) {
+            goto error;
+        }
+        return;
+    }
+
     if (group != NULL) {
         err_code = OF_GROUP_MOD_FAILED_GROUP_EXISTS;
         goto error;
@@ -113,24 +583,37 @@ ind_core_group_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         goto error;
     }
 
+    if ((err_code = ind_core_group_children_check(id, &buckets, &children)) != 0) {
+        goto error;
+    }
+
+    if (indigo_fwd_group_space_check(id) == INDIGO_ERROR_TABLE_FULL) {
+        err_code = OF_GROUP_MOD_FAILED_OUT_OF_GROUPS;
+        goto error;
+    }
+
     result = indigo_fwd_group_add(id, type, &buckets);
     if (result < 0) {
         err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
         goto error;
     }
 
-    group = aim_malloc(sizeof(*group));
+    group = indigo_mem_zalloc(INDIGO_MEM_TAG_GROUP, sizeof(*group));
     group->id = id;
     group->type = type;
     group->buckets = of_object_dup(&buckets);
     AIM_TRUE_OR_DIE(group->buckets != NULL);
-    group->creation_time = INDIGO_CURRENT_TIME;
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_GROUP, GROUP_BUCKETS_BYTES(group->buckets));
+    group->creation_time = INDIGO_LOOP_TIME;
+    list_init(&group->flow_refs);
 
     group_hashtable_insert(ind_core_group_hashtable, group);
+    ind_core_group_children_set(group, &children);
 
     return;
 
 error:
+    aim_free(children.ids);
     indigo_cxn_send_error_reply(cxn_id, obj, err_type, err_code);
 }
 
@@ -145,7 +628,6 @@ ind_core_group_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     ind_core_group_t *group = NULL;
     uint16_t err_type = OF_ERROR_TYPE_GROUP_MOD_FAILED;
     uint16_t err_code = OF_GROUP_MOD_FAILED_EPERM;
-    indigo_error_t result;
 
     of_group_modify_xid_get(obj, &xid);
     of_group_modify_group_type_get(obj, &type);
@@ -161,38 +643,10 @@ ind_core_group_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         goto error;
     }
 
-    if (group->type == type) {
-        result = indigo_fwd_group_modify(id, &buckets);
-#ifdef OFDPA_FIXUP
-        if (result < 0) {
-            err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
-            ind_core_group_delete_one(group);
-            goto error;
-        }
-#endif
-    } else {
-#ifdef OFDPA_FIXUP
-        result = indigo_fwd_group_delete(id);
-        if (result < 0) {
-            err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
-            goto error;
-        }
-#else
-        indigo_fwd_group_delete(id);
-#endif
-        result = indigo_fwd_group_add(id, type, &buckets);
-    }
-
-    if (result < 0) {
-        err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
+    if ((err_code = ind_core_group_update(group, type, &buckets)) != 0) {
         goto error;
     }
 
-    group->type = type;
-    of_object_delete(group->buckets);
-    group->buckets = of_object_dup(&buckets);
-    AIM_TRUE_OR_DIE(group->buckets != NULL);
-
     return;
 
 error:
@@ -208,9 +662,6 @@ ind_core_group_delete_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     ind_core_group_t *group = NULL;
     uint16_t err_type = OF_ERROR_TYPE_GROUP_MOD_FAILED;
     uint16_t err_code = OF_GROUP_MOD_FAILED_EPERM;
-#ifdef OFDPA_FIXUP
-    indigo_error_t result;
-#endif /* OFDPA_FIXUP */
 
     of_group_delete_xid_get(obj, &xid);
     of_group_delete_group_id_get(obj, &id);
@@ -220,29 +671,19 @@ ind_core_group_delete_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     }
 
     if (id == OF_GROUP_ALL) {
-        bighash_iter_t iter;
-        for (group = bighash_iter_start(ind_core_group_hashtable, &iter);
-                group; group = bighash_iter_next(&iter)) {
-#ifdef OFDPA_FIXUP
-            result = ind_core_group_delete_one(group);
-            if (result < 0) {
-                err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
-                goto error;
-            }
-#else				
-            ind_core_group_delete_one(group)
-#endif /* OFDPA_FIXUP */
+        if ((err_code = ind_core_group_delete_all()) != 0) {
+            goto error;
         }
     } else if (group != NULL) {
-#ifdef OFDPA_FIXUP
-            result = ind_core_group_delete_one(group);
-            if (result < 0) {
-                err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
-                goto error;
-            }
-#else
-            ind_core_group_delete_one(group);
-#endif
+        /* Forwarding would refuse to delete it anyway */
+        if (ind_core_group_in_use_internal(group)) {
+            err_code = OF_GROUP_MOD_FAILED_CHAINED_GROUP;
+            goto error;
+        }
+        if (ind_core_group_delete_one(group) < 0) {
+            err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
+            goto error;
+        }
     } else if (id > OF_GROUP_MAX) {
         err_code = OF_GROUP_MOD_FAILED_INVALID_GROUP;
         goto error;
@@ -270,7 +711,132 @@ ind_core_group_stats_entry_populate(of_group_stats_entry_t *entry,
     indigo_fwd_group_stats_get(group->id, entry);
 }
 
-/* TODO segment long replies */
+/* Extra room for groups that forwarding has but the agent did not add */
+#define GROUP_STATS_SNAPSHOT_SLACK 16
+
+struct ind_core_group_stats_state {
+    indigo_cxn_id_t cxn_id;
+    of_object_t *request;
+    of_object_t *reply;
+    indigo_time_t current_time;
+    indigo_fwd_group_stats_t *stats;
+    uint32_t count;
+    uint32_t next;
+    bool bulk;                  /* stats filled in by forwarding */
+};
+
+/*
+ * Take a snapshot of the group stats. If forwarding has no bulk path
+ * only the group IDs are recorded and the stats are read per group
+ * while building the reply.
+ */
+static void
+ind_core_group_stats_snapshot(struct ind_core_group_stats_state *state)
+{
+    uint32_t max = bighash_oa_entry_count(ind_core_group_hashtable) +
+        GROUP_STATS_SNAPSHOT_SLACK;
+    indigo_error_t rv;
+
+    while (1) {
+        state->stats = aim_malloc(max * sizeof(*state->stats));
+        rv = indigo_fwd_group_stats_bulk_get(state->stats, max, &state->count);
+        if (rv < 0 || state->count < max) {
+            break;
+        }
+        /* Possibly truncated */
+        aim_free(state->stats);
+        max *= 2;
+    }
+
+    if (rv == INDIGO_ERROR_NONE) {
+        state->bulk = true;
+        return;
+    }
+
+    if (rv != INDIGO_ERROR_NOT_SUPPORTED) {
+        AIM_LOG_ERROR("Failed to get group stats: %s", indigo_strerror(rv));
+    }
+
+    bighash_oa_iter_t iter;
+    ind_core_group_t *group;
+    state->bulk = false;
+    state->count = 0;
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group && state->count < max; group = bighash_oa_iter_next(&iter)) {
+        state->stats[state->count++].id = group->id;
+    }
+}
+
+static void
+ind_core_group_stats_append(struct ind_core_group_stats_state *state,
+                            of_group_stats_entry_t *entry)
+{
+    of_list_group_stats_entry_t entries;
+    uint32_t xid;
+
+    of_group_stats_reply_entries_bind(state->reply, &entries);
+    if (of_list_append(&entries, entry) < 0) {
+        of_group_stats_reply_flags_set(state->reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+        indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+
+        state->reply = of_group_stats_reply_new(state->request->version);
+        AIM_TRUE_OR_DIE(state->reply != NULL);
+        of_group_stats_request_xid_get(state->request, &xid);
+        of_group_stats_reply_xid_set(state->reply, xid);
+
+        of_group_stats_reply_entries_bind(state->reply, &entries);
+        if (of_list_append(&entries, entry) < 0) {
+            AIM_DIE("unexpected failure appending to an empty stats list");
+        }
+    }
+}
+
+static ind_soc_task_status_t
+ind_core_group_stats_task(void *cookie)
+{
+    struct ind_core_group_stats_state *state = cookie;
+    of_group_stats_entry_t *entry;
+
+    while (state->next < state->count) {
+        indigo_fwd_group_stats_t *stats = &state->stats[state->next++];
+        ind_core_group_t *group = ind_core_group_lookup(stats->id);
+
+        /* Deleted since the snapshot, or not added by the agent */
+        if (group == NULL) {
+            continue;
+        }
+
+        entry = of_group_stats_entry_new(state->request->version);
+        AIM_TRUE_OR_DIE(entry != NULL);
+
+        if (state->bulk) {
+            uint32_t duration_sec, duration_nsec;
+            of_group_stats_entry_group_id_set(entry, group->id);
+            calc_duration(state->current_time, group->creation_time,
+                          &duration_sec, &duration_nsec);
+            of_group_stats_entry_duration_nsec_set(entry, duration_nsec);
+            of_group_stats_entry_ref_count_set(entry, stats->ref_count);
+            of_group_stats_entry_duration_sec_set(entry, stats->duration_sec);
+        } else {
+            ind_core_group_stats_entry_populate(entry, group, state->current_time);
+        }
+
+        ind_core_group_stats_append(state, entry);
+        of_object_delete(entry);
+
+        if (ind_soc_should_yield()) {
+            return IND_SOC_TASK_CONTINUE;
+        }
+    }
+
+    indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+    of_object_delete(state->request);
+    aim_free(state->stats);
+    aim_free(state);
+
+    return IND_SOC_TASK_FINISHED;
+}
+
 void
 ind_core_group_stats_request_handler(of_object_t *_obj,
                                      indigo_cxn_id_t cxn_id)
@@ -281,7 +847,7 @@ ind_core_group_stats_request_handler(of_object_t *_obj,
     of_group_stats_entry_t *entry;
     uint32_t xid;
     uint32_t id;
-    indigo_time_t current_time = INDIGO_CURRENT_TIME;
+    indigo_time_t current_time = INDIGO_LOOP_TIME;
 
     of_group_stats_request_group_id_get(obj, &id);
 
@@ -290,28 +856,32 @@ ind_core_group_stats_request_handler(of_object_t *_obj,
 
     of_group_stats_request_xid_get(obj, &xid);
     of_group_stats_reply_xid_set(reply, xid);
+
+    if (id == OF_GROUP_ALL) {
+        struct ind_core_group_stats_state *state = aim_zmalloc(sizeof(*state));
+        state->cxn_id = cxn_id;
+        state->request = ind_core_dup_header_tracking(obj, cxn_id);
+        state->reply = reply;
+        state->current_time = current_time;
+        ind_core_group_stats_snapshot(state);
+
+        if (ind_soc_task_register(ind_core_group_stats_task, state,
+                                  IND_SOC_DEFAULT_PRIORITY) < 0) {
+            AIM_LOG_ERROR("Failed to create group stats task");
+            of_object_delete(state->request);
+            of_object_delete(state->reply);
+            aim_free(state->stats);
+            aim_free(state);
+        }
+        return;
+    }
+
     of_group_stats_reply_entries_bind(reply, &entries);
 
     entry = of_group_stats_entry_new(entries.version);
     AIM_TRUE_OR_DIE(entry != NULL);
 
-    if (id == OF_GROUP_ALL) {
-        bighash_iter_t iter;
-        ind_core_group_t *group;
-        for (group = bighash_iter_start(ind_core_group_hashtable, &iter);
-                group; group = bighash_iter_next(&iter)) {
-            ind_core_group_stats_entry_populate(entry, group, current_time);
-
-            if (of_list_append(&entries, entry) < 0) {
-                break;
-            }
-
-            /* HACK unable to truncate existing object */
-            of_object_delete(entry);
-            entry = of_group_stats_entry_new(entries.version);
-            AIM_TRUE_OR_DIE(entry != NULL);
-        }
-    } else if (id <= OF_GROUP_MAX) {
+    if (id <= OF_GROUP_MAX) {
         ind_core_group_t *group = ind_core_group_lookup(id);
         if (group != NULL) {
             ind_core_group_stats_entry_populate(entry, group, current_time);
@@ -327,45 +897,135 @@ ind_core_group_stats_request_handler(of_object_t *_obj,
     indigo_cxn_send_controller_message(cxn_id, reply);
 }
 
-/* TODO segment long replies */
-void
-ind_core_group_desc_stats_request_handler(of_object_t *_obj,
-                                          indigo_cxn_id_t cxn_id)
+/* A group desc reply gets no more entries once it is longer than this */
+#define GROUP_DESC_REPLY_MAX (1 << 15)
+
+struct ind_core_group_desc_stats_state {
+    indigo_cxn_id_t cxn_id;
+    of_object_t *request;
+    of_object_t *reply;         /* NULL until an entry is appended */
+    of_object_t *entry;         /* Reused for each group */
+    struct group_id_list ids;   /* Groups when the request arrived */
+    int next;
+};
+
+static of_group_desc_stats_reply_t *
+ind_core_group_desc_stats_reply_new(struct ind_core_group_desc_stats_state *state)
 {
-    of_group_desc_stats_request_t *obj = _obj;
     of_group_desc_stats_reply_t *reply;
-    of_list_group_desc_stats_entry_t entries;
-    of_group_desc_stats_entry_t *entry;
     uint32_t xid;
-    ind_core_group_t *group;
-    bighash_iter_t iter;
 
-    reply = of_group_desc_stats_reply_new(obj->version);
+    reply = of_group_desc_stats_reply_new(state->request->version);
     AIM_TRUE_OR_DIE(reply != NULL);
-
-    of_group_desc_stats_request_xid_get(obj, &xid);
+    of_group_desc_stats_request_xid_get(state->request, &xid);
     of_group_desc_stats_reply_xid_set(reply, xid);
-    of_group_desc_stats_reply_entries_bind(reply, &entries);
 
-    entry = of_group_desc_stats_entry_new(entries.version);
-    AIM_TRUE_OR_DIE(entry != NULL);
+    return reply;
+}
 
-    for (group = bighash_iter_start(ind_core_group_hashtable, &iter);
-            group; group = bighash_iter_next(&iter)) {
-        of_group_desc_stats_entry_group_type_set(entry, group->type);
-        of_group_desc_stats_entry_group_id_set(entry, group->id);
-        if (of_group_desc_stats_entry_buckets_set(entry, group->buckets) < 0) {
-            AIM_DIE("unexpected failure setting group desc stats entry buckets");
+/*
+ * Append the entry of a group to the reply, sending the reply first if
+ * it is full. The bucket list is kept encoded in the group, so it is
+ * copied into the entry as is.
+ */
+static void
+ind_core_group_desc_stats_append(struct ind_core_group_desc_stats_state *state,
+                                 ind_core_group_t *group)
+{
+    of_list_group_desc_stats_entry_t entries;
+
+    of_group_desc_stats_entry_group_type_set(state->entry, group->type);
+    of_group_desc_stats_entry_group_id_set(state->entry, group->id);
+    if (of_group_desc_stats_entry_buckets_set(state->entry, group->buckets) < 0) {
+        AIM_DIE("unexpected failure setting group desc stats entry buckets");
+    }
+
+    if (state->reply == NULL) {
+        state->reply = ind_core_group_desc_stats_reply_new(state);
+    }
+
+    of_group_desc_stats_reply_entries_bind(state->reply, &entries);
+    if (of_list_append(&entries, state->entry) < 0) {
+        of_group_desc_stats_reply_flags_set(state->reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+        indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+
+        state->reply = ind_core_group_desc_stats_reply_new(state);
+        of_group_desc_stats_reply_entries_bind(state->reply, &entries);
+        if (of_list_append(&entries, state->entry) < 0) {
+            AIM_DIE("unexpected failure appending to an empty group desc stats list");
         }
+    }
 
-        if (of_list_append(&entries, entry) < 0) {
-            break;
+    if (state->reply->length > GROUP_DESC_REPLY_MAX) {
+        of_group_desc_stats_reply_flags_set(state->reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+        indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+        state->reply = NULL;
+    }
+}
+
+static void
+ind_core_group_desc_stats_state_free(struct ind_core_group_desc_stats_state *state)
+{
+    of_object_delete(state->request);
+    of_object_delete(state->entry);
+    aim_free(state->ids.ids);
+    aim_free(state);
+}
+
+static ind_soc_task_status_t
+ind_core_group_desc_stats_task(void *cookie)
+{
+    struct ind_core_group_desc_stats_state *state = cookie;
+
+    while (state->next < state->ids.count) {
+        ind_core_group_t *group = ind_core_group_lookup(state->ids.ids[state->next++]);
+
+        /* Deleted since the request arrived */
+        if (group == NULL) {
+            continue;
+        }
+
+        ind_core_group_desc_stats_append(state, group);
+
+        if (ind_soc_should_yield()) {
+            return IND_SOC_TASK_CONTINUE;
         }
     }
 
-    of_object_delete(entry);
+    if (state->reply == NULL) {
+        state->reply = ind_core_group_desc_stats_reply_new(state);
+    }
+    indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+    ind_core_group_desc_stats_state_free(state);
 
-    indigo_cxn_send_controller_message(cxn_id, reply);
+    return IND_SOC_TASK_FINISHED;
+}
+
+void
+ind_core_group_desc_stats_request_handler(of_object_t *_obj,
+                                          indigo_cxn_id_t cxn_id)
+{
+    of_group_desc_stats_request_t *obj = _obj;
+    struct ind_core_group_desc_stats_state *state;
+    ind_core_group_t *group;
+    bighash_oa_iter_t iter;
+
+    state = aim_zmalloc(sizeof(*state));
+    state->cxn_id = cxn_id;
+    state->request = ind_core_dup_header_tracking(obj, cxn_id);
+    state->entry = of_group_desc_stats_entry_new(obj->version);
+    AIM_TRUE_OR_DIE(state->entry != NULL);
+
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group; group = bighash_oa_iter_next(&iter)) {
+        group_id_list_append(&state->ids, group->id);
+    }
+
+    if (ind_soc_task_register(ind_core_group_desc_stats_task, state,
+                              IND_SOC_DEFAULT_PRIORITY) < 0) {
+        AIM_LOG_ERROR("Failed to create group desc stats task");
+        ind_core_group_desc_stats_state_free(state);
+    }
 }
 
 void
@@ -376,9 +1036,155 @@ ind_core_group_features_stats_request_handler(of_object_t *_obj,
     ind_core_unhandled_message(obj, cxn_id);
 }
 
+/*
+ * Warm restart
+ *
+ * Groups are restored before the flows and without their children, as a
+ * group may be read before the groups it references;
+ * ind_core_group_warm_link then builds the reference graph.
+ */
+
+void
+ind_core_group_warm_save(ind_core_warm_write_f write, void *cookie)
+{
+    bighash_oa_iter_t iter;
+    ind_core_group_t *group;
+    of_group_add_t *obj;
+
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group; group = bighash_oa_iter_next(&iter)) {
+        obj = of_group_add_new(group->buckets->version);
+        AIM_TRUE_OR_DIE(obj != NULL);
+        of_group_add_group_type_set(obj, group->type);
+        of_group_add_group_id_set(obj, group->id);
+        if (of_group_add_buckets_set(obj, group->buckets) < 0) {
+            LOG_ERROR("Failed to save group %u", group->id);
+        } else {
+            write(cookie, obj, 0, 0);
+        }
+        of_object_delete(obj);
+    }
+}
+
+indigo_error_t
+ind_core_group_warm_restore(of_object_t *_obj)
+{
+    of_group_add_t *obj = _obj;
+    uint8_t type;
+    uint32_t id;
+    of_list_bucket_t buckets;
+    ind_core_group_t *group;
+    indigo_error_t rv;
+
+    of_group_add_group_type_get(obj, &type);
+    of_group_add_group_id_get(obj, &id);
+    of_group_add_buckets_bind(obj, &buckets);
+
+    if (id > OF_GROUP_MAX) {
+        return INDIGO_ERROR_PARAM;
+    }
+    if (ind_core_group_lookup(id) != NULL) {
+        return INDIGO_ERROR_EXISTS;
+    }
+
+    if ((rv = indigo_fwd_group_restore(id, type, &buckets)) < 0) {
+        return rv;
+    }
+
+    group = indigo_mem_zalloc(INDIGO_MEM_TAG_GROUP, sizeof(*group));
+    group->id = id;
+    group->type = type;
+    group->buckets = of_object_dup(&buckets);
+    AIM_TRUE_OR_DIE(group->buckets != NULL);
+    indigo_mem_account_alloc(INDIGO_MEM_TAG_GROUP, GROUP_BUCKETS_BYTES(group->buckets));
+    group->creation_time = INDIGO_LOOP_TIME;
+    group->stale = true;
+    list_init(&group->flow_refs);
+
+    group_hashtable_insert(ind_core_group_hashtable, group);
+
+    return INDIGO_ERROR_NONE;
+}
+
+void
+ind_core_group_warm_link(void)
+{
+    bighash_oa_iter_t iter;
+    ind_core_group_t *group;
+
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group; group = bighash_oa_iter_next(&iter)) {
+        struct group_id_list children = { NULL, 0, 0 };
+        group_id_list_add_buckets(&children, group->buckets);
+        ind_core_group_children_set(group, &children);
+    }
+}
+
+/*
+ * Delete the stale groups no longer used, top of the chains first.
+ * Returns the number deleted.
+ */
+int
+ind_core_group_warm_sweep(void)
+{
+    bighash_oa_iter_t iter;
+    ind_core_group_t *group;
+    int deleted = 0;
+    int progress = 1;
+
+    while (progress) {
+        struct group_id_list ready = { NULL, 0, 0 };
+        int i;
+
+        for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+                group; group = bighash_oa_iter_next(&iter)) {
+            if (group->stale && !ind_core_group_in_use_internal(group)) {
+                group_id_list_append(&ready, group->id);
+            }
+        }
+
+        progress = 0;
+        for (i = 0; i < ready.count; i++) {
+            group = ind_core_group_lookup(ready.ids[i]);
+            if (group != NULL && ind_core_group_delete_one(group) >= 0) {
+                deleted++;
+                progress = 1;
+            }
+        }
+        aim_free(ready.ids);
+    }
+
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group; group = bighash_oa_iter_next(&iter)) {
+        if (group->stale) {
+            LOG_WARN("Stale group %u kept, still in use", group->id);
+            group->stale = false;
+        }
+    }
+
+    return deleted;
+}
+
+/* Mark every group stale; returns the number marked */
+int
+ind_core_group_warm_mark(void)
+{
+    bighash_oa_iter_t iter;
+    ind_core_group_t *group;
+    int marked = 0;
+
+    for (group = bighash_oa_iter_start(ind_core_group_hashtable, &iter);
+            group; group = bighash_oa_iter_next(&iter)) {
+        group->stale = true;
+        marked++;
+    }
+
+    return marked;
+}
+
 void
 ind_core_group_init(void)
 {
-    ind_core_group_hashtable = bighash_table_create(1024);
+    ind_core_group_hashtable = group_hashtable_create(1024);
     AIM_TRUE_OR_DIE(ind_core_group_hashtable != NULL);
 }
@@ -32,18 +32,30 @@
 #include <indigo/of_state_manager.h>
 #include <indigo/port_manager.h>
 #include <indigo/forwarding.h>
+#include <indigo/of_message.h>
 #include <loci/loci.h>
 #include <loci/loci_obj_dump.h>
+#include <indigo/of_fast.h>
 #include "ofstatemanager_decs.h"
 #include "ofstatemanager_int.h"
 #include "handlers.h"
-#include "ft.h"
+#include "ft_shard.h"
 #include "table.h"
+#include "pipeline.h"
+#include "workers.h"
+#include <murmur/murmur.h>
 
 static void
 flow_mod_err_msg_send(indigo_error_t indigo_err, of_version_t ver,
                       indigo_cxn_id_t cxn_id, of_flow_modify_t *flow_mod);
 
+static void
+flow_mod_error_report(indigo_cxn_id_t cxn_id, of_object_t *flow_mod,
+                      uint16_t type, uint16_t code);
+
+static bool table_full_check(uint8_t table_id, of_object_t *flow_add);
+static void table_full_mark(uint8_t table_id, of_object_t *flow_add);
+
 /****************************************************************
  *
  * Message handling
@@ -67,22 +79,256 @@ ind_core_unhandled_message(of_object_t *obj, indigo_cxn_id_t cxn_id)
 
 /****************************************************************/
 
+/****************************************************************
+ *
+ * Packet-out results
+ *
+ * A packet-out the forwarding layer fails is answered with a bad
+ * request error. The forwarding layer may instead return
+ * INDIGO_ERROR_PENDING and report the result later through
+ * indigo_core_packet_out_complete, in submission order. The start of
+ * each pending message is kept in a FIFO for that error reply.
+ *
+ ****************************************************************/
+
+/* Message bytes kept for the error reply; errors carry at most 64 */
+#define PACKET_OUT_PENDING_BYTES 64
+
+typedef struct packet_out_pending_s {
+    indigo_cxn_id_t cxn_id;
+    uint16_t bytes;
+    uint8_t data[PACKET_OUT_PENDING_BYTES];
+} packet_out_pending_t;
+
+static struct {
+    packet_out_pending_t *entries;
+    uint32_t size;              /* Power of 2 */
+    uint32_t head;              /* Oldest pending packet-out */
+    uint32_t count;
+} packet_out_pending;
+
+static void
+packet_out_error_send(indigo_cxn_id_t cxn_id, of_packet_out_t *obj,
+                      indigo_error_t result)
+{
+    uint16_t code;
+
+    if (result == INDIGO_ERROR_NOT_FOUND) {
+        code = OF_REQUEST_FAILED_BUFFER_UNKNOWN;
+    } else if (OF_REQUEST_FAILED_BAD_PACKET_SUPPORTED(obj->version)) {
+        code = OF_REQUEST_FAILED_BAD_PACKET;
+    } else {
+        code = OF_REQUEST_FAILED_EPERM;
+    }
+
+    LOG_TRACE("Packet-out from cxn %d failed: %s",
+              cxn_id, indigo_strerror(result));
+    indigo_cxn_send_error_reply(cxn_id, obj, OF_ERROR_TYPE_BAD_REQUEST, code);
+}
+
+static void
+packet_out_pending_push(indigo_cxn_id_t cxn_id, of_packet_out_t *obj)
+{
+    packet_out_pending_t *pending;
+
+    if (packet_out_pending.count == packet_out_pending.size) {
+        uint32_t size = packet_out_pending.size ? packet_out_pending.size * 2 : 64;
+        packet_out_pending_t *entries = aim_malloc(size * sizeof(*entries));
+        uint32_t i;
+
+        for (i = 0; i < packet_out_pending.count; i++) {
+            entries[i] = packet_out_pending.entries[
+                (packet_out_pending.head + i) & (packet_out_pending.size - 1)];
+        }
+        aim_free(packet_out_pending.entries);
+        packet_out_pending.entries = entries;
+        packet_out_pending.size = size;
+        packet_out_pending.head = 0;
+    }
+
+    pending = &packet_out_pending.entries[
+        (packet_out_pending.head + packet_out_pending.count++) &
+        (packet_out_pending.size - 1)];
+    pending->cxn_id = cxn_id;
+    pending->bytes = obj->length < PACKET_OUT_PENDING_BYTES ?
+        obj->length : PACKET_OUT_PENDING_BYTES;
+    memcpy(pending->data, OF_OBJECT_BUFFER_INDEX(obj, 0), pending->bytes);
+}
+
+static void
+packet_out_result(indigo_cxn_id_t cxn_id, of_packet_out_t *obj,
+                  indigo_error_t result)
+{
+    if (result == INDIGO_ERROR_PENDING) {
+        packet_out_pending_push(cxn_id, obj);
+    } else if (result != INDIGO_ERROR_NONE) {
+        packet_out_error_send(cxn_id, obj, result);
+    }
+}
+
+void
+indigo_core_packet_out_complete(uint32_t count, indigo_error_t result)
+{
+    if (count > packet_out_pending.count) {
+        LOG_ERROR("Completing %u packet-outs with only %u pending",
+                  count, packet_out_pending.count);
+        count = packet_out_pending.count;
+    }
+
+    while (count-- > 0) {
+        packet_out_pending_t *pending =
+            &packet_out_pending.entries[packet_out_pending.head];
+
+        packet_out_pending.head =
+            (packet_out_pending.head + 1) & (packet_out_pending.size - 1);
+        packet_out_pending.count--;
+
+        if (result != INDIGO_ERROR_NONE) {
+            of_object_storage_t storage;
+            of_packet_out_t *obj;
+
+            /* The copy may be truncated; make the header length match */
+            of_message_length_set(pending->data, pending->bytes);
+            obj = indigo_of_object_new_from_validated_message(
+                &storage, pending->data, pending->bytes);
+            if (obj == NULL) {
+                LOG_ERROR("Could not parse pending packet-out");
+                continue;
+            }
+            packet_out_error_send(pending->cxn_id, obj, result);
+        }
+    }
+}
+
+/****************************************************************/
+
+/****************************************************************
+ *
+ * Packet-out batching
+ *
+ * Consecutive packet-outs are collected and submitted with a single
+ * indigo_fwd_packet_out_batch call. Only the location of each message
+ * is kept; the data stays in the connection's read buffer, which is
+ * not reused before the connection manager calls
+ * indigo_core_receive_controller_flush. The batch is also flushed
+ * when it is full and before any other message is processed.
+ *
+ ****************************************************************/
+
+#if OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX > 0
+
+static struct {
+    int count;
+    indigo_cxn_id_t cxn_ids[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+    uint8_t *bufs[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+    int lens[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+    of_object_storage_t storage[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+    of_packet_out_t *packet_outs[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+    indigo_cxn_id_t packet_out_cxn_ids[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+    indigo_error_t results[OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX];
+} packet_out_batch;
+
+static void
+packet_out_batch_append(indigo_cxn_id_t cxn_id, of_packet_out_t *obj)
+{
+    int idx = packet_out_batch.count++;
+
+    packet_out_batch.cxn_ids[idx] = cxn_id;
+    packet_out_batch.bufs[idx] = OF_OBJECT_BUFFER_INDEX(obj, 0);
+    packet_out_batch.lens[idx] = obj->length;
+
+    if (packet_out_batch.count >= OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX) {
+        ind_core_packet_out_flush();
+    }
+}
+
+#endif /* OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX > 0 */
+
+/**
+ * Submit all pending packet-outs to the forwarding layer
+ */
+
+void
+ind_core_packet_out_flush(void)
+{
+#if OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX > 0
+    int count, i, n = 0;
+    indigo_error_t rv;
+
+    count = packet_out_batch.count;
+    if (count == 0) {
+        return;
+    }
+    packet_out_batch.count = 0;
+
+    LOG_TRACE("Flushing %d batched packet-outs", count);
+
+    /*
+     * Objects over the original messages, not copies of them. The
+     * connection validated these when it parsed them, so only the
+     * header is checked again.
+     */
+    for (i = 0; i < count; i++) {
+        packet_out_batch.packet_outs[n] =
+            indigo_of_object_new_from_validated_message(
+                &packet_out_batch.storage[n], packet_out_batch.bufs[i],
+                packet_out_batch.lens[i]);
+        if (packet_out_batch.packet_outs[n] == NULL) {
+            LOG_ERROR("Could not parse batched packet-out");
+            continue;
+        }
+        packet_out_batch.packet_out_cxn_ids[n] = packet_out_batch.cxn_ids[i];
+        n++;
+    }
+
+    if (n == 0) {
+        return;
+    }
+
+    rv = indigo_fwd_packet_out_batch(n, packet_out_batch.packet_outs,
+                                     packet_out_batch.results);
+
+    for (i = 0; i < n; i++) {
+        packet_out_result(packet_out_batch.packet_out_cxn_ids[i],
+                          packet_out_batch.packet_outs[i],
+                          rv == INDIGO_ERROR_NONE ? packet_out_batch.results[i] : rv);
+    }
+#endif
+}
+
 /**
  * Handle a packet_out message
  * @param cxn_id Connection handler for the owning connection
  * @param _obj Generic type object for the message to be coerced
  * @returns Error code
  *
- * Note: Ownership of the message is not transferred, so data from obj
- * should be copied.
+ * Note: Ownership of the message is not transferred. With batching the
+ * message is referenced until ind_core_packet_out_flush.
  */
 
 void
 ind_core_packet_out_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 {
     of_packet_out_t *obj = _obj;
+#if OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP == 1
+    of_packet_out_t *resolved;
+
+    if (ind_core_pipeline_packet_out_resolve(ind_core_ft, obj,
+                                             &resolved) == INDIGO_ERROR_NONE) {
+        /* Send in order with the packet-outs already batched */
+        ind_core_packet_out_flush();
+        /* Errors echo the message the controller sent */
+        packet_out_result(cxn_id, obj, indigo_fwd_packet_out(resolved));
+        of_object_delete(resolved);
+        return;
+    }
+#endif
 
-    (void)indigo_fwd_packet_out(obj);
+#if OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX > 0
+    packet_out_batch_append(cxn_id, obj);
+#else
+    packet_out_result(cxn_id, obj, indigo_fwd_packet_out(obj));
+#endif
 }
 
 /****************************************************************/
@@ -112,7 +358,12 @@ ind_core_port_mod_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
                 cxn_id, obj,
                 OF_ERROR_TYPE_PORT_MOD_FAILED_BY_VERSION(ver),
                 OF_PORT_MOD_FAILED_BAD_PORT);
+        return;
     }
+
+    /* The port config is part of the port descriptions */
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_FEATURES);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_PORT_DESC);
 }
 
 /****************************************************************/
@@ -254,6 +505,88 @@ ind_core_queue_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     }
 }
 
+/****************************************************************
+ *
+ * Flow-mod match sharing
+ *
+ * The match of a flow-mod is decoded once, when its handler starts,
+ * and a pointer to the result is kept in the object metadata. The
+ * flowtable and the forwarding layer get it from there with
+ * indigo_core_flow_mod_match_get instead of decoding the OXM list
+ * again. Copies made with ind_core_dup_tracking start without one and
+ * are given their own when they outlive the handler.
+ *
+ ****************************************************************/
+
+/* Match of the flow-mod being handled */
+static of_match_t flow_mod_match;
+
+static const of_match_t *
+flow_mod_match_attached(of_object_t *obj)
+{
+    const of_match_t *match;
+
+    memcpy(&match, obj->metadata, sizeof(match));
+    return match;
+}
+
+static void
+flow_mod_match_set(of_object_t *obj, const of_match_t *match)
+{
+    memcpy(obj->metadata, &match, sizeof(match));
+}
+
+/**
+ * Decode the match of a flow-mod into storage and attach it
+ *
+ * Returns 1 if it was attached here, 0 if the object already had one
+ * and -1 if the match could not be parsed.
+ */
+
+static int
+flow_mod_match_attach(of_object_t *obj, of_match_t *storage)
+{
+    if (flow_mod_match_attached(obj) != NULL) {
+        return 0;
+    }
+
+    if (of_flow_modify_match_get(obj, storage) < 0) {
+        LOG_ERROR("Failed to extract match from flow");
+        return -1;
+    }
+    flow_mod_match_set(obj, storage);
+
+    return 1;
+}
+
+/* Give a copy of a flow-mod its own copy of the decoded match */
+static void
+flow_mod_match_copy(of_object_t *dst, of_object_t *src, of_match_t *storage)
+{
+    const of_match_t *match = flow_mod_match_attached(src);
+
+    if (match != NULL) {
+        *storage = *match;
+        flow_mod_match_set(dst, storage);
+    }
+}
+
+const of_match_t *
+indigo_core_flow_mod_match_get(of_object_t *obj, of_match_t *match)
+{
+    const of_match_t *attached = flow_mod_match_attached(obj);
+
+    if (attached != NULL) {
+        return attached;
+    }
+
+    if (of_flow_modify_match_get(obj, match) < 0) {
+        return NULL;
+    }
+
+    return match;
+}
+
 /****************************************************************/
 
 static indigo_error_t
@@ -262,16 +595,22 @@ flow_mod_setup_query(of_flow_modify_t *obj, /* Works with add, mod, del */
                      int query_mode,
                      int force_wildcard_port)
 {
+    const of_match_t *match;
+
     INDIGO_MEM_SET(query, 0, sizeof(*query));
     if (obj->version > OF_VERSION_1_0) {
         of_flow_modify_table_id_get(obj, &query->table_id);
     } else {
         query->table_id = TABLE_ID_ANY;
     }
-    if (of_flow_modify_match_get(obj, &(query->match)) < 0) {
+    match = indigo_core_flow_mod_match_get(obj, &query->match);
+    if (match == NULL) {
         LOG_ERROR("Failed to extract match from flow");
         return INDIGO_ERROR_UNKNOWN;
     }
+    if (match != &query->match) {
+        query->match = *match;
+    }
     query->mode = query_mode;
     if ((query_mode == OF_MATCH_STRICT) || (query_mode == OF_MATCH_OVERLAP)) {
         query->check_priority = 1;
@@ -282,6 +621,10 @@ flow_mod_setup_query(of_flow_modify_t *obj, /* Works with add, mod, del */
     } else {
         /* Could check object_id is delete or delete_strict */
         of_flow_add_out_port_get(obj, &(query->out_port));
+        if (obj->version >= OF_VERSION_1_1) {
+            of_flow_add_out_group_get(obj, &query->out_group);
+            query->check_out_group = query->out_group != OF_GROUP_ANY;
+        }
     }
     if (query_mode != OF_MATCH_OVERLAP && obj->version >= OF_VERSION_1_1) {
         of_flow_add_cookie_get(obj, &query->cookie);
@@ -301,25 +644,19 @@ static int
 overlap_found(of_flow_modify_t *obj)
 {
     ft_entry_t *entry;
-    list_links_t *cur, *next;
     of_meta_match_t query;
 
     _TRY(flow_mod_setup_query(obj, &query, OF_MATCH_OVERLAP, 1));
 
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        if (ft_entry_meta_match(&query, entry)) {
-            return 1;
-        }
-    }
-
-    return 0;
+    return ft_shards_overlap_find(ind_core_ft, &query,
+                                  &entry) == INDIGO_ERROR_NONE;
 }
 
+static indigo_flow_id_t next_flow_id = 1;
+
 static indigo_flow_id_t
 flow_id_next(void)
 {
-    static indigo_flow_id_t next_flow_id = 1;
-
     indigo_flow_id_t result = next_flow_id;
 
     if (++next_flow_id == 0)  next_flow_id = 1;
@@ -327,15 +664,248 @@ flow_id_next(void)
     return (result);
 }
 
+/* Keep new flow IDs clear of one restored by a warm restart */
+void
+ind_core_flow_id_reserve(indigo_flow_id_t id)
+{
+    if (id >= next_flow_id) {
+        next_flow_id = id + 1;
+        if (next_flow_id == 0)  next_flow_id = 1;
+    }
+}
+
+/****************************************************************
+ *
+ * Flow add batching
+ *
+ * Flow adds destined for the forwarding layer are collected here
+ * and submitted with a single indigo_fwd_flow_create_batch call, as
+ * are those for a registered table with an entry_create_batch
+ * operation. A batch holds flows for one destination only, so a flow
+ * for another one flushes it first. The batch is also flushed when it
+ * is full, before any other message is
+ * processed, and from a task once the connection input goes idle
+ * (including while it is paused by a barrier). Each request is a
+ * tracked duplicate so barrier replies wait for the flush.
+ *
+ ****************************************************************/
+
+#if OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX > 0
+
+static struct {
+    int count;
+    int task_registered;
+    ind_core_table_t *table;    /* NULL for the forwarding layer */
+    indigo_cxn_id_t cxn_ids[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+    indigo_flow_id_t flow_ids[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+    of_flow_add_t *requests[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+    of_match_t matches[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+    uint8_t table_ids[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+    void *privs[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+    indigo_error_t results[OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX];
+} flow_add_batch;
+
+static ind_soc_task_status_t
+flow_add_batch_task(void *cookie)
+{
+    flow_add_batch.task_registered = 0;
+    ind_core_flow_add_flush();
+    return IND_SOC_TASK_FINISHED;
+}
+
+static void
+flow_add_batch_append(ind_core_table_t *table, uint8_t table_id,
+                      indigo_flow_id_t flow_id, of_flow_modify_t *obj,
+                      indigo_cxn_id_t cxn_id)
+{
+    int idx;
+
+    if (flow_add_batch.count > 0 && flow_add_batch.table != table) {
+        ind_core_flow_add_flush();
+    }
+
+    idx = flow_add_batch.count++;
+    flow_add_batch.table = table;
+    flow_add_batch.table_ids[idx] = table_id;
+    flow_add_batch.privs[idx] = NULL;
+    flow_add_batch.cxn_ids[idx] = cxn_id;
+    flow_add_batch.flow_ids[idx] = flow_id;
+    flow_add_batch.requests[idx] = ind_core_dup_tracking(obj, cxn_id);
+    flow_mod_match_copy(flow_add_batch.requests[idx], obj,
+                        &flow_add_batch.matches[idx]);
+
+    if (flow_add_batch.count >= OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX) {
+        ind_core_flow_add_flush();
+    } else if (!flow_add_batch.task_registered) {
+        if (ind_soc_task_register(flow_add_batch_task, NULL,
+                                  IND_SOC_PRIORITY_FLOW) ==
+                INDIGO_ERROR_NONE) {
+            flow_add_batch.task_registered = 1;
+        } else {
+            LOG_ERROR("Failed to register flow add batch task");
+            ind_core_flow_add_flush();
+        }
+    }
+}
+
+#endif /* OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX > 0 */
+
 /**
- * Handle a flow_add message
- * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
- * @returns Error code
+ * Submit all pending flow adds to the forwarding layer or table
+ *
+ * Flows the forwarding layer or table rejects are removed from the flowtable
+ * and an error is sent to the requesting connection.
  */
 
 void
-ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+ind_core_flow_add_flush(void)
+{
+#if OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX > 0
+    indigo_error_t rv;
+    ind_core_table_t *table = flow_add_batch.table;
+    ft_entry_t *entry;
+    int count, i;
+
+    count = flow_add_batch.count;
+    if (count == 0) {
+        return;
+    }
+    flow_add_batch.count = 0;
+
+    LOG_TRACE("Flushing %d batched flow adds", count);
+
+    if (table == NULL) {
+        rv = indigo_fwd_flow_create_batch(count, flow_add_batch.flow_ids,
+                                          flow_add_batch.requests,
+                                          flow_add_batch.table_ids,
+                                          flow_add_batch.results);
+    } else {
+        rv = table->ops->entry_create_batch(table->priv, count,
+                                            flow_add_batch.requests,
+                                            flow_add_batch.flow_ids,
+                                            flow_add_batch.privs,
+                                            flow_add_batch.results);
+    }
+    if (rv != INDIGO_ERROR_NONE) {
+        LOG_ERROR("Error from Forwarding while inserting flow batch: %s",
+                  indigo_strerror(rv));
+        for (i = 0; i < count; i++) {
+            flow_add_batch.results[i] = rv;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        of_flow_add_t *obj = flow_add_batch.requests[i];
+
+        entry = ft_shards_lookup(ind_core_ft, flow_add_batch.flow_ids[i]);
+        if (entry == NULL) {
+            LOG_ERROR("Batched flow " INDIGO_FLOW_ID_PRINTF_FORMAT
+                      " no longer in flowtable", flow_add_batch.flow_ids[i]);
+        } else if (flow_add_batch.results[i] == INDIGO_ERROR_NONE) {
+            entry->priv = flow_add_batch.privs[i];
+            ft_shards_entry_table_id_set(ind_core_ft, entry,
+                                  flow_add_batch.table_ids[i]);
+        } else { /* Error during insertion at forwarding layer */
+            LOG_ERROR("Error from Forwarding while inserting flow: %s",
+                      indigo_strerror(flow_add_batch.results[i]));
+            ind_core_ft->status.forwarding_add_errors += 1;
+
+            flow_mod_err_msg_send(flow_add_batch.results[i], obj->version,
+                                  flow_add_batch.cxn_ids[i],
+                                  (of_flow_modify_t *)obj);
+
+            /* Free entry in local flow table */
+            ft_shards_delete(ind_core_ft, entry);
+
+            if (flow_add_batch.results[i] == INDIGO_ERROR_RESOURCE ||
+                flow_add_batch.results[i] == INDIGO_ERROR_TABLE_FULL) {
+                ind_core_ft->status.table_full_errors += 1;
+                table_full_mark(flow_add_batch.table_ids[i], obj);
+            }
+        }
+
+        of_object_delete(obj);
+    }
+
+    LOG_TRACE("Flow table now has %d entries",
+              ft_shards_current_count(ind_core_ft));
+#endif
+}
+
+/*
+ * Replace an existing flow with an add of the same match and priority,
+ * keeping its flow ID and counters. Forwarding is only asked to modify
+ * the flow when the effects differ. Returns false if the flow must be
+ * deleted and added again instead.
+ *
+ * Forwarding may expire flows itself and a modify does not carry
+ * timeouts, so a flow with timeouts, before or after, is always added
+ * again; that also restarts its duration in forwarding.
+ */
+static bool
+flow_overwrite(ft_entry_t *entry, of_flow_modify_t *obj)
+{
+    indigo_error_t rv;
+    uint16_t flags;
+    uint16_t idle_timeout, hard_timeout;
+    uint8_t table_id = 0;
+    of_object_t *list;
+    bool equal;
+
+    of_flow_modify_flags_get(obj, &flags);
+    of_flow_modify_idle_timeout_get(obj, &idle_timeout);
+    of_flow_modify_hard_timeout_get(obj, &hard_timeout);
+    if (obj->version >= OF_VERSION_1_1) {
+        of_flow_modify_table_id_get(obj, &table_id);
+    }
+
+    if (idle_timeout != 0 || hard_timeout != 0 ||
+        entry->idle_timeout != 0 || entry->hard_timeout != 0) {
+        return false;
+    }
+
+    if (flags != entry->flags ||
+        (OF_FLOW_MOD_FLAG_RESET_COUNTS_SUPPORTED(obj->version) &&
+         (flags & OF_FLOW_MOD_FLAG_RESET_COUNTS_BY_VERSION(obj->version))) ||
+        (obj->version >= OF_VERSION_1_1 && table_id != entry->table_id)) {
+        return false;
+    }
+
+    if (obj->version == OF_VERSION_1_0) {
+        list = of_flow_modify_actions_get(obj);
+    } else {
+        list = of_flow_modify_instructions_get(obj);
+    }
+    if (list == NULL) {
+        return false;
+    }
+    equal = ind_core_warm_list_equal(entry->effects.actions, list);
+    of_object_delete(list);
+
+    if (!equal) {
+        ind_core_table_t *table = ind_core_table_get(entry->table_id);
+        if (table != NULL) {
+            rv = table->ops->entry_modify(table->priv, entry->priv, obj);
+        } else {
+            rv = indigo_fwd_flow_modify(entry->id, obj);
+        }
+        if (rv != INDIGO_ERROR_NONE) {
+            LOG_VERBOSE("Error from Forwarding while overwriting flow: %s",
+                        indigo_strerror(rv));
+            return false;
+        }
+        ft_entry_modify_effects(ft_shards_entry_shard(ind_core_ft, entry),
+                                entry, obj);
+    }
+
+    ft_entry_overwrite(ft_shards_entry_shard(ind_core_ft, entry), entry,
+                       (of_flow_add_t *)obj);
+
+    return true;
+}
+
+static void
+flow_add_handle(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 {
     indigo_error_t rv = INDIGO_ERROR_NONE;
     of_flow_modify_t *obj = _obj; /* Coerce to flow_modify object */
@@ -358,7 +928,7 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     if (flags & OF_FLOW_MOD_FLAG_CHECK_OVERLAP_BY_VERSION(ver)) {
         if (overlap_found(obj)) {
             LOG_TRACE("Overlap found when adding flow");
-            indigo_cxn_send_error_reply(
+            flow_mod_error_report(
                     cxn_id, obj,
                     OF_ERROR_TYPE_FLOW_MOD_FAILED_BY_VERSION(ver),
                     OF_FLOW_MOD_FAILED_OVERLAP_BY_VERSION(ver));
@@ -369,7 +939,7 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     if ((flags & OF_FLOW_MOD_FLAG_EMERG_BY_VERSION(ver)) &&
         (idle_timeout != 0 || hard_timeout != 0)) {
         LOG_TRACE("Attempted to set timeout on an emergency flow");
-        indigo_cxn_send_error_reply(
+        flow_mod_error_report(
                 cxn_id, obj,
                 OF_ERROR_TYPE_FLOW_MOD_FAILED_BY_VERSION(ver),
                 OF_FLOW_MOD_FAILED_BAD_EMERG_TIMEOUT_BY_VERSION(ver));
@@ -379,13 +949,36 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     /* Search table; if match found, replace entry */
     rv = flow_mod_setup_query(obj, &query, OF_MATCH_STRICT, 1);
     if (rv != INDIGO_ERROR_NONE) {
-        /* TODO send error */
+        flow_mod_err_msg_send(rv, ver, cxn_id, obj);
         return;
     }
 
-    /* Delete existing flow if any */
-    if (ft_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
-        ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_OVERWRITE);
+    /* Overwrite existing flow if any */
+    if (ft_shards_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
+        /* Re-added unchanged after a warm restart; keep the installed flow */
+        if (entry->stale && ind_core_warm_flow_confirm(entry, obj)) {
+            return;
+        }
+        /* The existing flow may still be waiting in the batch */
+        ind_core_flow_add_flush();
+        if (ft_shards_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
+            if (flow_overwrite(entry, obj)) {
+                return;
+            }
+            ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_OVERWRITE);
+        }
+    }
+
+    table_id = 0;
+    if (obj->version >= OF_VERSION_1_1) {
+        of_flow_add_table_id_get(obj, &table_id);
+    }
+
+    if (table_full_check(table_id, obj)) {
+        LOG_TRACE("Table %u is full", table_id);
+        ind_core_ft->status.table_full_errors += 1;
+        flow_mod_err_msg_send(INDIGO_ERROR_TABLE_FULL, ver, cxn_id, obj);
+        return;
     }
 
     /* No match found, add as normal */
@@ -393,20 +986,21 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 
     flow_id = flow_id_next();
 
-    rv = ft_add(ind_core_ft, flow_id, obj, &entry);
+    rv = ft_shards_add(ind_core_ft, flow_id, obj, &entry);
     if (rv != INDIGO_ERROR_NONE) {
         LOG_ERROR("Failed to insert flow in OFStateManager flowtable: %s",
                   indigo_strerror(rv));
-        /* TODO send error */
+        flow_mod_err_msg_send(rv, ver, cxn_id, obj);
         return;
     }
 
-    table_id = 0;
-    if (obj->version >= OF_VERSION_1_1) {
-        of_flow_add_table_id_get(obj, &table_id);
-    }
-
     ind_core_table_t *table = ind_core_table_get(table_id);
+#if OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX > 0
+    if (table == NULL || table->ops->entry_create_batch != NULL) {
+        flow_add_batch_append(table, table_id, flow_id, obj, cxn_id);
+        return;
+    }
+#endif
     if (table != NULL) {
         rv = table->ops->entry_create(table->priv, obj, flow_id, &entry->priv);
     } else {
@@ -415,8 +1009,8 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 
     if (rv == INDIGO_ERROR_NONE) {
         LOG_TRACE("Flow table now has %d entries",
-                  FT_STATUS(ind_core_ft)->current_count);
-        entry->table_id = table_id;
+                  ft_shards_current_count(ind_core_ft));
+        ft_shards_entry_table_id_set(ind_core_ft, entry, table_id);
     } else { /* Error during insertion at forwarding layer */
        uint32_t xid;
 
@@ -429,22 +1023,52 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
                              (of_flow_modify_t *)obj);
 
        /* Free entry in local flow table */
-       ft_delete(ind_core_ft, entry);
+       ft_shards_delete(ind_core_ft, entry);
+
+       if (rv == INDIGO_ERROR_RESOURCE || rv == INDIGO_ERROR_TABLE_FULL) {
+           ind_core_ft->status.table_full_errors += 1;
+           table_full_mark(table_id, obj);
+       }
     }
 }
 
 /**
- * Translate the error status into the correct error code for the given
- * OpenFlow version, and send the error message to the controller.
- *
- * WARNING: we only generate 1.0 and 1.3 errors; 
- * 1.1 and 1.2 errors will be mapped to 1.0 errors.
- *
- * @param indigo_err Error status
- * @param ver OpenFlow version
- * @param cxn_id Connection to send to
- * @param flow_mod Request that failed
- */
+ * Handle a flow_add message
+ * @param cxn_id Connection handler for the owning connection
+ * @param obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
+
+void
+ind_core_flow_add_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
+{
+    int attached;
+
+    attached = flow_mod_match_attach(obj, &flow_mod_match);
+    if (attached < 0) {
+        flow_mod_err_msg_send(INDIGO_ERROR_UNKNOWN, obj->version, cxn_id, obj);
+        return;
+    }
+
+    flow_add_handle(obj, cxn_id);
+
+    if (attached) {
+        flow_mod_match_set(obj, NULL);
+    }
+}
+
+/**
+ * Translate the error status into the correct error code for the given
+ * OpenFlow version, and send the error message to the controller.
+ *
+ * WARNING: we only generate 1.0 and 1.3 errors; 
+ * 1.1 and 1.2 errors will be mapped to 1.0 errors.
+ *
+ * @param indigo_err Error status
+ * @param ver OpenFlow version
+ * @param cxn_id Connection to send to
+ * @param flow_mod Request that failed
+ */
 static void
 flow_mod_err_msg_send(indigo_error_t indigo_err, of_version_t ver,
                       indigo_cxn_id_t cxn_id, of_flow_modify_t *flow_mod)
@@ -530,19 +1154,333 @@ flow_mod_err_msg_send(indigo_error_t indigo_err, of_version_t ver,
     }
  
     if (errmsgf) {
+        flow_mod_error_report(cxn_id, flow_mod, type, code);
+    }
+}
+
+/****************************************************************
+ *
+ * Flow-mod error coalescing
+ *
+ * When many flow-mods fail together, as when a batch of adds fills a
+ * table, only the first OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX
+ * errors of the burst are sent. The rest are counted and reported in
+ * one BSN experimenter error when the connection input goes idle,
+ * which ends the burst. The summary's xid is that of the last flow-mod
+ * it covers, and its data is
+ *
+ *   uint32_t count;       number of errors not sent
+ *   uint16_t type, code;  of the last of them
+ *   uint32_t first_xid;
+ *   uint32_t last_xid;
+ *
+ * A tracked copy of the first unsent flow-mod is held until the
+ * summary is queued, so a barrier is not answered before it. OpenFlow
+ * 1.0 and 1.1 have no experimenter errors; every error is sent.
+ *
+ ****************************************************************/
+
+#define FLOW_MOD_ERROR_SUMMARY_SUBTYPE 0x1
+#define FLOW_MOD_ERROR_SUMMARY_BYTES 16
+
+static struct {
+    indigo_cxn_id_t cxn_id;
+    int errors;                 /* Errors in the current burst */
+    uint32_t suppressed;        /* Of those, not sent */
+    uint16_t type;
+    uint16_t code;
+    uint32_t first_xid;
+    uint32_t last_xid;
+    of_object_t *held;          /* Copy of the first unsent flow-mod */
+    int task_registered;
+} flow_mod_errors;
+
+static uint64_t flow_mod_errors_suppressed;
+static uint64_t flow_mod_error_summaries;
+
+/**
+ * End the current error burst, sending the summary if errors were held
+ */
+
+void
+ind_core_flow_mod_error_flush(void)
+{
+    of_experimenter_error_msg_t *msg;
+    uint8_t data[FLOW_MOD_ERROR_SUMMARY_BYTES];
+    of_octets_t octets = { data, sizeof(data) };
+
+    flow_mod_errors.errors = 0;
+    if (flow_mod_errors.suppressed == 0) {
+        return;
+    }
+
+    LOG_VERBOSE("Summarizing %u flow-mod errors to cxn %d",
+                flow_mod_errors.suppressed, flow_mod_errors.cxn_id);
+
+    buf_u32_set(data, flow_mod_errors.suppressed);
+    buf_u16_set(data + 4, flow_mod_errors.type);
+    buf_u16_set(data + 6, flow_mod_errors.code);
+    buf_u32_set(data + 8, flow_mod_errors.first_xid);
+    buf_u32_set(data + 12, flow_mod_errors.last_xid);
+
+    msg = of_experimenter_error_msg_new(flow_mod_errors.held->version);
+    if (msg == NULL) {
+        LOG_ERROR("Could not allocate flow-mod error summary");
+    } else {
+        of_experimenter_error_msg_xid_set(msg, flow_mod_errors.last_xid);
+        of_experimenter_error_msg_subtype_set(msg,
+                                              FLOW_MOD_ERROR_SUMMARY_SUBTYPE);
+        of_experimenter_error_msg_experimenter_set(msg,
+                                                   OF_EXPERIMENTER_ID_BSN);
+        if (of_experimenter_error_msg_data_set(msg, &octets) < 0) {
+            LOG_ERROR("Could not set flow-mod error summary data");
+            of_object_delete(msg);
+        } else {
+            indigo_cxn_send_controller_message(flow_mod_errors.cxn_id, msg);
+            flow_mod_error_summaries++;
+        }
+    }
+
+    /* Releases a barrier waiting on the summary */
+    of_object_delete(flow_mod_errors.held);
+    flow_mod_errors.held = NULL;
+    flow_mod_errors.suppressed = 0;
+}
+
+static ind_soc_task_status_t
+flow_mod_error_task(void *cookie)
+{
+    flow_mod_errors.task_registered = 0;
+    ind_core_flow_mod_error_flush();
+    return IND_SOC_TASK_FINISHED;
+}
+
+/**
+ * Send or count an error reply to a flow-mod
+ */
+
+static void
+flow_mod_error_report(indigo_cxn_id_t cxn_id, of_object_t *flow_mod,
+                      uint16_t type, uint16_t code)
+{
+    uint32_t xid;
+
+    if (OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX == 0 ||
+        flow_mod->version < OF_VERSION_1_2) {
         indigo_cxn_send_error_reply(cxn_id, flow_mod, type, code);
+        return;
+    }
+
+    if (flow_mod_errors.errors > 0 && flow_mod_errors.cxn_id != cxn_id) {
+        ind_core_flow_mod_error_flush();
+    }
+    flow_mod_errors.cxn_id = cxn_id;
+
+    if (flow_mod_errors.errors++ < OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX) {
+        indigo_cxn_send_error_reply(cxn_id, flow_mod, type, code);
+    } else {
+        of_object_xid_get(flow_mod, &xid);
+        if (flow_mod_errors.suppressed++ == 0) {
+            flow_mod_errors.held =
+                ind_core_dup_header_tracking(flow_mod, cxn_id);
+            flow_mod_errors.first_xid = xid;
+        }
+        flow_mod_errors.last_xid = xid;
+        flow_mod_errors.type = type;
+        flow_mod_errors.code = code;
+        flow_mod_errors_suppressed++;
+    }
+
+    if (!flow_mod_errors.task_registered) {
+        if (ind_soc_task_register(flow_mod_error_task, NULL,
+                                  IND_SOC_PRIORITY_FLOW) ==
+                INDIGO_ERROR_NONE) {
+            flow_mod_errors.task_registered = 1;
+        } else {
+            LOG_ERROR("Failed to register flow-mod error task");
+            ind_core_flow_mod_error_flush();
+        }
+    }
+}
+
+/****************************************************************
+ *
+ * Table full fast reject
+ *
+ * Adds to a table the forwarding layer reports full through
+ * indigo_fwd_flow_space_check are rejected without calling it.
+ *
+ * After the forwarding layer rejects an add for lack of space, further
+ * adds to the same table with the same match masks are rejected
+ * without calling it, until a flow is deleted from forwarding. Keying on
+ * the masks keeps, say, host routes going when only the LPM space of the
+ * routing table is exhausted.
+ *
+ * While the flow table holds more than the soft limit of the FLOW_ENTRY
+ * memory tag, every add is rejected as if its table were full.
+ *
+ ****************************************************************/
+
+#define TABLE_FULL_SLOTS 16
+
+static struct {
+    int count;
+    struct {
+        uint8_t table_id;
+        uint32_t masks_hash;
+    } slots[TABLE_FULL_SLOTS];
+} table_full;
+
+static uint64_t table_full_rejects;
+
+static bool
+table_full_key(of_object_t *flow_add, uint32_t *masks_hash)
+{
+    const of_match_t *match = flow_mod_match_attached(flow_add);
+
+    if (match == NULL) {
+        return false;
+    }
+
+    *masks_hash = murmur_hash(&match->masks, sizeof(match->masks), 0);
+    return true;
+}
+
+static bool
+table_full_check(uint8_t table_id, of_object_t *flow_add)
+{
+    uint32_t masks_hash;
+    int i;
+
+    if (indigo_mem_soft_limit_exceeded(INDIGO_MEM_TAG_FLOW_ENTRY)) {
+        table_full_rejects++;
+        return true;
+    }
+
+    if (ind_core_table_get(table_id) == NULL &&
+        indigo_fwd_flow_space_check(table_id) == INDIGO_ERROR_TABLE_FULL) {
+        table_full_rejects++;
+        return true;
+    }
+
+    if (table_full.count == 0) {
+        return false;
+    }
+
+    if (!table_full_key(flow_add, &masks_hash)) {
+        return false;
+    }
+
+    for (i = 0; i < table_full.count; i++) {
+        if (table_full.slots[i].table_id == table_id &&
+            table_full.slots[i].masks_hash == masks_hash) {
+            table_full_rejects++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+table_full_mark(uint8_t table_id, of_object_t *flow_add)
+{
+    uint32_t masks_hash;
+    int i;
+
+    if (!table_full_key(flow_add, &masks_hash)) {
+        return;
+    }
+
+    for (i = 0; i < table_full.count; i++) {
+        if (table_full.slots[i].table_id == table_id &&
+            table_full.slots[i].masks_hash == masks_hash) {
+            return;
+        }
+    }
+
+    if (table_full.count < TABLE_FULL_SLOTS) {
+        i = table_full.count++;
+    } else {
+        i = masks_hash % TABLE_FULL_SLOTS;
     }
+    table_full.slots[i].table_id = table_id;
+    table_full.slots[i].masks_hash = masks_hash;
+}
+
+/* A flow left the forwarding layer; the full tables may have space */
+void
+ind_core_table_full_clear(void)
+{
+    table_full.count = 0;
+}
+
+void
+ind_core_flow_mod_errors_show(aim_pvs_t *pvs)
+{
+    aim_printf(pvs, "  Errors Unsent:  %"PRIu64" in %"PRIu64" summaries\n",
+               flow_mod_errors_suppressed, flow_mod_error_summaries);
+    aim_printf(pvs, "  Full Rejects:   %"PRIu64"\n", table_full_rejects);
 }
 
 /****************************************************************/
 
-/* State for non-strict flow-modify iteration */
+/* Flows changed per call to Forwarding by a non-strict flow modify */
+#define FLOW_MODIFY_BATCH_MAX 256
+
+/*
+ * State for non-strict flow-modify iteration. As for a flow delete, the
+ * matching flows are collected by ID and modified a batch at a time, and
+ * a flow removed while the task yields is skipped.
+ */
 struct flow_modify_state {
     of_flow_modify_t *request;
+    of_match_t match;           /* Decoded match of the request */
     indigo_cxn_id_t cxn_id;
     int num_matched;
+    int count;
+    indigo_flow_id_t flow_ids[FLOW_MODIFY_BATCH_MAX];
 };
 
+static void
+flow_modify_batch_flush(struct flow_modify_state *state)
+{
+    ft_entry_t *entries[FLOW_MODIFY_BATCH_MAX];
+    indigo_cookie_t flow_ids[FLOW_MODIFY_BATCH_MAX];
+    indigo_error_t results[FLOW_MODIFY_BATCH_MAX];
+    indigo_error_t rv;
+    int i, count = 0;
+
+    for (i = 0; i < state->count; i++) {
+        ft_entry_t *entry = ft_shards_lookup(ind_core_ft, state->flow_ids[i]);
+        if (entry != NULL) {
+            entries[count] = entry;
+            flow_ids[count++] = entry->id;
+        }
+    }
+    state->count = 0;
+    if (count == 0) {
+        return;
+    }
+
+    rv = indigo_fwd_flow_modify_batch(count, flow_ids, state->request, results);
+    for (i = 0; i < count; i++) {
+        if (rv != INDIGO_ERROR_NONE) {
+            results[i] = rv;
+        }
+        if (results[i] == INDIGO_ERROR_NONE) {
+            ft_entry_modify_effects(ft_shards_entry_shard(ind_core_ft,
+                                                          entries[i]),
+                                    entries[i], state->request);
+        } else {
+            LOG_ERROR("Error from Forwarding while modifying flow: %s",
+                      indigo_strerror(results[i]));
+            flow_mod_err_msg_send(results[i], state->request->version,
+                                  state->cxn_id, state->request);
+        }
+    }
+}
+
 /* Flowtable iterator for ind_core_flow_modify_handler */
 static void
 modify_iter_cb(void *cookie, ft_entry_t *entry)
@@ -553,13 +1491,17 @@ modify_iter_cb(void *cookie, ft_entry_t *entry)
         indigo_error_t rv;
         state->num_matched++;
         ind_core_table_t *table = ind_core_table_get(entry->table_id);
-        if (table != NULL) {
-            rv = table->ops->entry_modify(table->priv, entry->priv, state->request);
-        } else {
-            rv = indigo_fwd_flow_modify(entry->id, state->request);
+        if (table == NULL) {
+            state->flow_ids[state->count++] = entry->id;
+            if (state->count == FLOW_MODIFY_BATCH_MAX) {
+                flow_modify_batch_flush(state);
+            }
+            return;
         }
+        rv = table->ops->entry_modify(table->priv, entry->priv, state->request);
         if (rv == INDIGO_ERROR_NONE) {
-            ft_entry_modify_effects(ind_core_ft, entry, state->request);
+            ft_entry_modify_effects(ft_shards_entry_shard(ind_core_ft, entry),
+                                    entry, state->request);
         } else {
             LOG_ERROR("Error from Forwarding while modifying flow: %d",
                       indigo_strerror(rv));
@@ -567,6 +1509,7 @@ modify_iter_cb(void *cookie, ft_entry_t *entry)
                                   state->cxn_id, state->request);
         }
     } else {
+        flow_modify_batch_flush(state);
         if (state->num_matched == 0) {
             LOG_TRACE("No entries to modify, treat as add");
             /* OpenFlow 1.0.0, section 4.6, page 14.  Treat as an add */
@@ -596,8 +1539,16 @@ ind_core_flow_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     struct flow_modify_state *state = aim_malloc(sizeof(*state));
     state->request = ind_core_dup_tracking(obj, cxn_id);
     state->num_matched = 0;
+    state->count = 0;
     state->cxn_id = cxn_id;
 
+    /* Shared by every entry the iteration modifies */
+    if (flow_mod_match_attach(state->request, &state->match) < 0) {
+        of_object_delete(state->request);
+        aim_free(state);
+        return;
+    }
+
     rv = flow_mod_setup_query(state->request, &query, OF_MATCH_NON_STRICT, 1);
     if (rv != INDIGO_ERROR_NONE) {
         of_object_delete(state->request);
@@ -605,8 +1556,8 @@ ind_core_flow_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         return;
     }
 
-    rv = ft_spawn_iter_task(ind_core_ft, &query, modify_iter_cb, state,
-                            IND_SOC_DEFAULT_PRIORITY);
+    rv = ft_shards_spawn_iter_task(ind_core_ft, &query, modify_iter_cb, state,
+                                   IND_SOC_DEFAULT_PRIORITY);
     if (rv != INDIGO_ERROR_NONE) {
         of_object_delete(state->request);
         aim_free(state);
@@ -614,18 +1565,8 @@ ind_core_flow_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     }
 }
 
-/**
- * Handle a flow_modify_strict message
- * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
- * @returns Error code
- *
- * Checks that only one entry in local table matches.  See modify_handler
- * above for more info.
- */
-
-void
-ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+static void
+flow_modify_strict_handle(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 {
     of_flow_modify_strict_t *obj = _obj;
     indigo_error_t rv;
@@ -635,11 +1576,11 @@ ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     /* Form the query */
     rv = flow_mod_setup_query(obj, &query, OF_MATCH_STRICT, 1);
     if (rv != INDIGO_ERROR_NONE) {
-        /* TODO send error */
+        flow_mod_err_msg_send(rv, obj->version, cxn_id, obj);
         return;
     }
 
-    rv = ft_strict_match(ind_core_ft, &query, &entry);
+    rv = ft_shards_strict_match(ind_core_ft, &query, &entry);
     if (rv == INDIGO_ERROR_NOT_FOUND) {
         LOG_TRACE("No entries to modify strict, treat as add.");
         /* OpenFlow 1.0.0, section 4.6, page 14.  Treat as an add */
@@ -655,7 +1596,8 @@ ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     }
 
     if (rv == INDIGO_ERROR_NONE) {
-        ft_entry_modify_effects(ind_core_ft, entry, obj);
+        ft_entry_modify_effects(ft_shards_entry_shard(ind_core_ft, entry),
+                                entry, obj);
     } else {
         LOG_ERROR("Error from Forwarding while modifying flow: %d",
                   indigo_strerror(rv));
@@ -663,93 +1605,303 @@ ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     }
 }
 
-/****************************************************************/
-
-/* Flowtable iterator for ind_core_flow_delete_handler */
-static void
-delete_iter_cb(void *cookie, ft_entry_t *entry)
-{
-    struct flow_modify_state *state = cookie;
-
-    if (entry != NULL) {
-        ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_DELETE);
-    } else {
-        LOG_TRACE("Finished flow delete task");
-        of_object_delete(state->request);
-        aim_free(state);
-    }
-}
-
-
 /**
- * Handle a flow_delete message
+ * Handle a flow_modify_strict message
  * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
+ * @param obj Generic type object for the message to be coerced
  * @returns Error code
+ *
+ * Checks that only one entry in local table matches.  See modify_handler
+ * above for more info.
  */
 
 void
-ind_core_flow_delete_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
+ind_core_flow_modify_strict_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
 {
-    of_meta_match_t query;
-    indigo_error_t rv;
-
-    struct flow_modify_state *state = aim_malloc(sizeof(*state));
-    state->request = ind_core_dup_tracking(obj, cxn_id);
-    state->num_matched = 0;
-    state->cxn_id = cxn_id;
+    int attached;
 
-    rv = flow_mod_setup_query(obj, &query, OF_MATCH_NON_STRICT, 0);
-    if (rv != INDIGO_ERROR_NONE) {
-        of_object_delete(state->request);
-        aim_free(state);
+    attached = flow_mod_match_attach(obj, &flow_mod_match);
+    if (attached < 0) {
+        flow_mod_err_msg_send(INDIGO_ERROR_UNKNOWN, obj->version, cxn_id, obj);
         return;
     }
 
-    rv = ft_spawn_iter_task(ind_core_ft, &query, delete_iter_cb, state,
-                            IND_SOC_DEFAULT_PRIORITY);
-    if (rv != INDIGO_ERROR_NONE) {
-        of_object_delete(state->request);
-        aim_free(state);
-        return;
+    flow_modify_strict_handle(obj, cxn_id);
+
+    if (attached) {
+        flow_mod_match_set(obj, NULL);
     }
 }
 
-/**
- * Handle a flow_delete_strict message
- * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
- * @returns Error code
+/****************************************************************/
+
+/* Flows removed per call to Forwarding by a flow delete */
+#define FLOW_DELETE_BATCH_MAX 256
+
+/*
+ * The matching flows are collected by ID and deleted a batch at a time.
+ * The task may yield before a batch is full, so a flow removed meanwhile
+ * by something else is skipped when the batch is deleted.
  */
+struct flow_delete_state {
+    of_flow_modify_t *request;
+    ind_core_clear_all_done_f done;     /* Set by ind_core_clear_all */
+    void *done_cookie;
+    int deleted;
+    int table_id;                       /* Table a delete-all is emptying */
+    uint64_t epoch;                     /* Flows added since are kept */
+    ft_iterator_t iter;
+    int count;
+    indigo_flow_id_t flow_ids[FLOW_DELETE_BATCH_MAX];
+};
 
-void
-ind_core_flow_delete_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+static void
+flow_delete_batch_flush(struct flow_delete_state *state)
 {
-    of_flow_delete_strict_t *obj = _obj;
-    int rv;
-    of_meta_match_t query;
-    ft_entry_t *entry;
+    ft_entry_t *entries[FLOW_DELETE_BATCH_MAX];
+    int i, count = 0;
 
-    rv = flow_mod_setup_query((of_flow_modify_t *)obj, &query, OF_MATCH_STRICT, 0);
-    if (rv != INDIGO_ERROR_NONE) {
-        /* TODO send error */
-        return;
+    for (i = 0; i < state->count; i++) {
+        ft_entry_t *entry = ft_shards_lookup(ind_core_ft, state->flow_ids[i]);
+        if (entry != NULL) {
+            entries[count++] = entry;
+        }
     }
+    state->count = 0;
+    state->deleted += count;
 
-    if (ft_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
-        ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_DELETE);
-    }
+    ind_core_flow_entry_delete_batch(entries, count,
+                                     INDIGO_FLOW_REMOVED_DELETE);
 }
 
+/* True if a flow delete matches every flow of every table */
+static bool
+flow_delete_matches_all(const of_meta_match_t *query)
+{
+    static const of_match_fields_t no_masks;
 
-/****************************************************************/
+    return query->table_id == TABLE_ID_ANY &&
+        query->cookie_mask == 0 &&
+        query->out_port == OF_PORT_DEST_WILDCARD &&
+        !query->check_out_group &&
+        !memcmp(&query->match.masks, &no_masks, sizeof(no_masks));
+}
 
-/**
- * Handle a get_config_request message
- * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
- * @returns Error code
- */
+/* Second half of ind_core_clear_all, once no flow uses a group */
+static void
+clear_all_groups(struct flow_delete_state *state)
+{
+    indigo_error_t rv = INDIGO_ERROR_NONE;
+    uint16_t err_code;
+
+    if ((err_code = ind_core_group_delete_all()) != 0) {
+        LOG_ERROR("Failed to delete all groups: group mod failed code %u",
+                  err_code);
+        rv = INDIGO_ERROR_UNKNOWN;
+    }
+
+    LOG_VERBOSE("Cleared %d flows", state->deleted);
+
+    if (state->done != NULL) {
+        state->done(state->done_cookie, state->deleted, rv);
+    }
+}
+
+static void
+flow_delete_all_table_start(struct flow_delete_state *state)
+{
+    of_meta_match_t query;
+    ft_instance_t ft;
+
+    ft = ft_shards_find(ind_core_ft, state->table_id);
+    if (ft == NULL) {
+        /* No flows; a cleaned up iterator returns none */
+        memset(&state->iter, 0, sizeof(state->iter));
+        return;
+    }
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.match.version = OF_VERSION_1_3;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = state->table_id;
+
+    ft_iterator_init(&state->iter, ft, &query);
+}
+
+/*
+ * Task deleting every flow present when it was spawned. The tables are
+ * emptied a batch at a time in descending table ID order, which for
+ * OF-DPA is the reverse of the pipeline: egress and ACL first, then
+ * routing and bridging, then termination MAC, then VLAN. A group delete
+ * that follows the barrier then finds no flow still using a group.
+ */
+static ind_soc_task_status_t
+flow_delete_all_task(void *cookie)
+{
+    struct flow_delete_state *state = cookie;
+    ft_entry_t *entry;
+
+    do {
+        entry = ft_iterator_next(&state->iter);
+        if (entry != NULL) {
+            if (entry->add_epoch >= state->epoch) {
+                continue;
+            }
+            state->flow_ids[state->count++] = entry->id;
+            if (state->count == FLOW_DELETE_BATCH_MAX) {
+                flow_delete_batch_flush(state);
+            }
+            continue;
+        }
+
+        flow_delete_batch_flush(state);
+        ft_iterator_cleanup(&state->iter);
+        if (--state->table_id < 0) {
+            LOG_TRACE("Finished flow delete-all task");
+            if (state->request != NULL) {
+                of_object_delete(state->request);
+            } else {
+                clear_all_groups(state);
+            }
+            aim_free(state);
+            return IND_SOC_TASK_FINISHED;
+        }
+        flow_delete_all_table_start(state);
+    } while (!ind_soc_should_yield());
+
+    return IND_SOC_TASK_CONTINUE;
+}
+
+/* Takes ownership of state */
+static indigo_error_t
+flow_delete_all_spawn(struct flow_delete_state *state)
+{
+    indigo_error_t rv;
+
+    /* Flows added from now on have this epoch or a later one */
+    state->epoch = ft_shards_epoch_start(ind_core_ft);
+    /* No flow is in table ALL, and a query for it matches every table */
+    state->table_id = TABLE_ID_ANY - 1;
+    flow_delete_all_table_start(state);
+
+    rv = ind_soc_task_register(flow_delete_all_task, state,
+                               IND_SOC_DEFAULT_PRIORITY);
+    if (rv != INDIGO_ERROR_NONE) {
+        ft_iterator_cleanup(&state->iter);
+        if (state->request != NULL) {
+            of_object_delete(state->request);
+        }
+        aim_free(state);
+    }
+
+    return rv;
+}
+
+/* Flowtable iterator for ind_core_flow_delete_handler */
+static void
+delete_iter_cb(void *cookie, ft_entry_t *entry)
+{
+    struct flow_delete_state *state = cookie;
+
+    if (entry != NULL) {
+        state->flow_ids[state->count++] = entry->id;
+        if (state->count == FLOW_DELETE_BATCH_MAX) {
+            flow_delete_batch_flush(state);
+        }
+    } else {
+        flow_delete_batch_flush(state);
+        LOG_TRACE("Finished flow delete task");
+        of_object_delete(state->request);
+        aim_free(state);
+    }
+}
+
+
+/**
+ * Handle a flow_delete message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
+
+void
+ind_core_flow_delete_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
+{
+    of_meta_match_t query;
+    indigo_error_t rv;
+
+    struct flow_delete_state *state = aim_zmalloc(sizeof(*state));
+    state->request = ind_core_dup_tracking(obj, cxn_id);
+
+    rv = flow_mod_setup_query(obj, &query, OF_MATCH_NON_STRICT, 0);
+    if (rv != INDIGO_ERROR_NONE) {
+        of_object_delete(state->request);
+        aim_free(state);
+        return;
+    }
+
+    if (flow_delete_matches_all(&query)) {
+        (void) flow_delete_all_spawn(state);
+        return;
+    }
+
+    rv = ft_shards_spawn_iter_task(ind_core_ft, &query, delete_iter_cb, state,
+                                   IND_SOC_DEFAULT_PRIORITY);
+    if (rv != INDIGO_ERROR_NONE) {
+        of_object_delete(state->request);
+        aim_free(state);
+        return;
+    }
+}
+
+indigo_error_t
+ind_core_clear_all(ind_core_clear_all_done_f done, void *cookie)
+{
+    struct flow_delete_state *state;
+
+    state = aim_zmalloc(sizeof(*state));
+    state->done = done;
+    state->done_cookie = cookie;
+
+    return flow_delete_all_spawn(state);
+}
+
+/**
+ * Handle a flow_delete_strict message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
+
+void
+ind_core_flow_delete_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    of_flow_delete_strict_t *obj = _obj;
+    int rv;
+    of_meta_match_t query;
+    ft_entry_t *entry;
+
+    rv = flow_mod_setup_query((of_flow_modify_t *)obj, &query, OF_MATCH_STRICT, 0);
+    if (rv != INDIGO_ERROR_NONE) {
+        flow_mod_err_msg_send(rv, obj->version, cxn_id, (of_flow_modify_t *)obj);
+        return;
+    }
+
+    if (ft_shards_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
+        ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_DELETE);
+    }
+}
+
+
+/****************************************************************/
+
+/**
+ * Handle a get_config_request message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
 
 void
 ind_core_get_config_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
@@ -777,70 +1929,239 @@ ind_core_get_config_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 
 /****************************************************************/
 
+/*
+ * With stats threads, flows are gathered a slice at a time on the event
+ * loop, which reads their counters, and the slice is split into jobs
+ * encoded in parallel. Each job's replies are sent in turn.
+ */
+#define FLOW_STATS_SLICE_ITEMS 4096
+
+/*
+ * Flows matched by a flow or aggregate stats request have their counters
+ * read this many at a time, with one call per table. See
+ * ind_core_flow_entry_stats_get_batch.
+ */
+#define FLOW_STATS_READ_MAX 256
+#define FLOW_STATS_JOB_ITEMS 256
+
+struct flow_stats_item {
+    ft_entry_t *entry;
+    indigo_fi_flow_stats_t stats;
+    uint32_t secs;
+    uint32_t nsecs;
+};
+
 struct ind_core_flow_stats_state {
     indigo_cxn_id_t cxn_id;
     of_flow_stats_request_t *req;
     indigo_time_t current_time;
     of_flow_stats_reply_t *reply;
+
+    /* Flows waiting for their counters to be read */
+    ft_entry_t *pending[FLOW_STATS_READ_MAX];
+    int pending_count;
+
+    /* With IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED */
+    bool changed_only;
+    uint64_t generation;                /* Of this request */
+    uint64_t since;                     /* Of the connection's previous one */
+
+    /* Only with stats threads */
+    struct flow_stats_item *items;      /* FLOW_STATS_SLICE_ITEMS */
+    int count;
+    of_flow_stats_reply_t **segments;   /* Replies of job j from
+                                           j * FLOW_STATS_JOB_ITEMS */
+    int *segment_counts;                /* Per job */
 };
 
+/*
+ * Changed-only flow stats
+ *
+ * Each changed-only request starts a new counter generation, and the
+ * connection remembers the generation of its last one. Reading the
+ * counters of a flow for any flow stats reply stamps the flow with the
+ * generation by which they had changed, and a changed-only reply gets
+ * the flows stamped after the connection's previous request.
+ */
+typedef struct flow_stats_cxn_s {
+    list_links_t links;
+    indigo_cxn_id_t cxn_id;
+    uint64_t generation;
+} flow_stats_cxn_t;
+
+static LIST_DEFINE(flow_stats_cxns);
+
+/*
+ * Record a changed-only request of a connection. Returns the generation
+ * of its previous one, 0 if none.
+ */
+static uint64_t
+flow_stats_cxn_generation_swap(indigo_cxn_id_t cxn_id, uint64_t generation)
+{
+    flow_stats_cxn_t *cxn;
+    list_links_t *cur;
+    uint64_t since;
+
+    LIST_FOREACH(&flow_stats_cxns, cur) {
+        cxn = container_of(cur, links, flow_stats_cxn_t);
+        if (cxn->cxn_id == cxn_id) {
+            since = cxn->generation;
+            cxn->generation = generation;
+            return since;
+        }
+    }
+
+    cxn = aim_zmalloc(sizeof(*cxn));
+    cxn->cxn_id = cxn_id;
+    cxn->generation = generation;
+    list_push(&flow_stats_cxns, &cxn->links);
+
+    return 0;
+}
+
+/* A reconnecting controller starts over with every flow */
 static void
-ind_core_flow_stats_iter(void *cookie, ft_entry_t *entry)
+flow_stats_cxn_status_change(indigo_cxn_id_t cxn_id,
+                             indigo_cxn_protocol_params_t *cxn_proto_params,
+                             indigo_cxn_state_t state,
+                             void *cookie)
 {
-    struct ind_core_flow_stats_state *state = cookie;
-    uint32_t secs, nsecs;
-    indigo_error_t rv;
+    list_links_t *cur, *next;
 
-    /* Allocate a reply if we don't already have one. */
-    if (state->reply == NULL) {
-        uint32_t xid;
+    if (state != INDIGO_CXN_S_CLOSING && state != INDIGO_CXN_S_DISCONNECTED) {
+        return;
+    }
 
-        state->reply = of_flow_stats_reply_new(state->req->version);
-        if (state->reply == NULL) {
-            LOG_ERROR("Failed to allocate of_flow_stats_reply.");
-            if (entry == NULL) {
-                /* This is the last callback, so need to clean up
-                 * before returning. */
-                of_flow_stats_request_delete(state->req);
-                aim_free(state);
-            }
-            return;
+    LIST_FOREACH_SAFE(&flow_stats_cxns, cur, next) {
+        flow_stats_cxn_t *cxn = container_of(cur, links, flow_stats_cxn_t);
+        if (cxn->cxn_id == cxn_id) {
+            list_remove(&cxn->links);
+            aim_free(cxn);
         }
+    }
+}
 
-        of_flow_stats_request_xid_get(state->req, &xid);
-        of_flow_stats_reply_xid_set(state->reply, xid);
-        of_flow_stats_reply_flags_set(state->reply, 1);
+void
+ind_core_flow_stats_init(void)
+{
+    if (indigo_cxn_status_change_register(flow_stats_cxn_status_change,
+                                          NULL) < 0) {
+        LOG_ERROR("Failed to register for connection status changes");
     }
+}
 
-    if (entry == NULL) {
-        /* Send last reply */
-        of_flow_stats_reply_flags_set(state->reply, 0);
-        indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+void
+ind_core_flow_stats_finish(void)
+{
+    list_links_t *cur, *next;
 
-        /* Clean up state */
-        of_flow_stats_request_delete(state->req);
-        aim_free(state);
-        return;
+    indigo_cxn_status_change_unregister(flow_stats_cxn_status_change, NULL);
+
+    LIST_FOREACH_SAFE(&flow_stats_cxns, cur, next) {
+        list_remove(cur);
+        aim_free(container_of(cur, links, flow_stats_cxn_t));
     }
+}
 
-    indigo_fi_flow_stats_t flow_stats = {
-        .flow_id = entry->id,
-        .duration_ns = 0,
-        .packets = -1,
-        .bytes = -1,
-    };
+/*
+ * Stamp a flow whose counters changed since they were last read, and
+ * tell whether a changed-only reply includes it.
+ *
+ * The newest changed-only request stamps the flows it reports with its
+ * own generation so the next request on its connection leaves them out.
+ * Any other read stamps them with the next generation, since a newer
+ * request may already have passed them.
+ */
+static bool
+flow_stats_counters_changed(struct ind_core_flow_stats_state *state,
+                            ft_entry_t *entry,
+                            indigo_fi_flow_stats_t *stats)
+{
+    if (stats->packets != entry->counter_packets ||
+            stats->bytes != entry->counter_bytes) {
+        entry->counter_packets = stats->packets;
+        entry->counter_bytes = stats->bytes;
+        if (state->changed_only &&
+                state->generation == ind_core_ft->shared->counter_generation) {
+            entry->counter_generation = state->generation;
+        } else {
+            entry->counter_generation = ind_core_ft->shared->counter_generation + 1;
+        }
+    }
 
-    ind_core_table_t *table = ind_core_table_get(entry->table_id);
-    if (table != NULL) {
-        rv = table->ops->entry_stats_get(table->priv, entry->priv, &flow_stats);
+    return !state->changed_only || entry->counter_generation > state->since;
+}
+
+/*
+ * Copy the serialized match of a flow into a flow stats entry of the same
+ * version, as of_flow_stats_entry_match_set would serialize it. Not for
+ * OpenFlow 1.1, whose standard match LOCI sets differently.
+ */
+static void
+flow_stats_entry_match_wire_set(of_flow_stats_entry_t *stats_entry,
+                                ft_entry_t *entry)
+{
+    of_wire_buffer_t *wbuf = OF_OBJECT_TO_WBUF(stats_entry);
+    int offset = stats_entry->version == OF_VERSION_1_0 ? 4 : 48;
+    int abs_offset = OF_OBJECT_ABSOLUTE_OFFSET(stats_entry, offset);
+    int cur_len;
+    uint16_t len;
+
+    if (stats_entry->version == OF_VERSION_1_0) {
+        /* Fixed size */
+        cur_len = entry->match_wire_len;
     } else {
-        rv = indigo_fwd_flow_stats_get(entry->id, &flow_stats);
+        /* An OXM match of a new entry may not have its length set yet */
+        of_wire_buffer_u16_get(wbuf, abs_offset + 2, &len);
+        cur_len = OF_MATCH_BYTES(len == 0 ? 4 : len);
     }
 
+    of_wire_buffer_replace_data(wbuf, abs_offset, cur_len,
+                                entry->match_wire, entry->match_wire_len);
+    if (entry->match_wire_len != cur_len) {
+        of_object_parent_length_update(stats_entry,
+                                       entry->match_wire_len - cur_len);
+    }
+}
+
+/* A reply gets no more entries once it is longer than this */
+#define FLOW_STATS_REPLY_MAX (1 << 15)
+
+static of_flow_stats_reply_t *
+flow_stats_reply_new(struct ind_core_flow_stats_state *state)
+{
+    of_flow_stats_reply_t *reply;
+    uint32_t xid;
+
+    reply = of_flow_stats_reply_new(state->req->version);
+    if (reply == NULL) {
+        LOG_ERROR("Failed to allocate of_flow_stats_reply.");
+        return NULL;
+    }
+
+    of_flow_stats_request_xid_get(state->req, &xid);
+    of_flow_stats_reply_xid_set(reply, xid);
+    of_flow_stats_reply_flags_set(reply, 1);
+
+    return reply;
+}
+
+/*
+ * Take the counters read for a flow and work out its duration
+ * Returns false if the flow is left out of the reply.
+ */
+static bool
+flow_stats_item_get(struct ind_core_flow_stats_state *state,
+                    ft_entry_t *entry, const indigo_fi_flow_stats_t *stats,
+                    indigo_error_t rv, struct flow_stats_item *item)
+{
+    item->entry = entry;
+    item->stats = *stats;
+
     if (rv != INDIGO_ERROR_NONE) {
         LOG_ERROR("Failed to get stats for flow "INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
                   entry->id, indigo_strerror(rv));
-        return;
+        return false;
     }
 
     /* Skip entry if stats request version is not equal to entry version */
@@ -848,66 +2169,268 @@ ind_core_flow_stats_iter(void *cookie, ft_entry_t *entry)
         LOG_TRACE("Stats request version (%d) differs from entry version (%d). "
                   "Entry is skipped.",
                   state->req->version, entry->effects.actions->version);
-        return;
+        return false;
     }
 
-    /* TODO use time from flow_stats? */
-    calc_duration(state->current_time, entry->insert_time, &secs, &nsecs);
+    if (!flow_stats_counters_changed(state, entry, &item->stats)) {
+        return false;
+    }
 
-    /* Set up the structures to append an entry to the list */
-    {
-        of_list_flow_stats_entry_t list;
-        of_flow_stats_entry_t stats_entry;
-        of_flow_stats_reply_entries_bind(state->reply, &list);
-        of_flow_stats_entry_init(&stats_entry, state->reply->version, -1, 1);
-        if (of_list_flow_stats_entry_append_bind(&list, &stats_entry)) {
-            LOG_ERROR("failed to append to flow stats list");
+    /* Prefer the duration reported by the forwarding layer. Either way it
+     * is the duration when the counters were read; see indigo_fi_flow_stats_t. */
+    if (item->stats.duration_ns != 0) {
+        item->secs = item->stats.duration_ns / 1000000000;
+        item->nsecs = item->stats.duration_ns % 1000000000;
+    } else {
+        indigo_time_t sampled = state->current_time;
+        uint64_t age_ms = item->stats.counters_age_ns / 1000000;
+
+        sampled = (sampled - entry->insert_time > age_ms) ?
+            sampled - age_ms : entry->insert_time;
+        calc_duration(sampled, entry->insert_time, &item->secs, &item->nsecs);
+    }
+
+    return true;
+}
+
+/* Append the stats entry of a flow to a reply */
+static void
+flow_stats_item_append(of_flow_stats_reply_t *reply,
+                       struct flow_stats_item *item)
+{
+    ft_entry_t *entry = item->entry;
+    of_list_flow_stats_entry_t list;
+    of_flow_stats_entry_t stats_entry;
+    of_match_t match;
+
+    of_flow_stats_reply_entries_bind(reply, &list);
+    of_flow_stats_entry_init(&stats_entry, reply->version, -1, 1);
+    if (of_list_flow_stats_entry_append_bind(&list, &stats_entry)) {
+        LOG_ERROR("failed to append to flow stats list");
+        return;
+    }
+
+    if (entry->match_wire != NULL &&
+            stats_entry.version != OF_VERSION_1_1) {
+        flow_stats_entry_match_wire_set(&stats_entry, entry);
+    } else {
+        ft_entry_match_get(entry, &match);
+        if (of_flow_stats_entry_match_set(&stats_entry, &match)) {
+            LOG_ERROR("Failed to set match in flow stats entry");
             return;
         }
+    }
 
-        of_flow_stats_entry_cookie_set(&stats_entry, entry->cookie);
-        of_flow_stats_entry_priority_set(&stats_entry, entry->priority);
-        of_flow_stats_entry_idle_timeout_set(&stats_entry, entry->idle_timeout);
-        of_flow_stats_entry_hard_timeout_set(&stats_entry, entry->hard_timeout);
+    if (stats_entry.version == entry->effects.actions->version) {
+        if (stats_entry.version == OF_VERSION_1_0) {
+            if (of_flow_stats_entry_actions_set(
+                    &stats_entry, entry->effects.actions) < 0) {
+                LOG_ERROR("Failed to set actions list of flow stats entry");
+                return;
+            }
+        } else {
+            if (of_flow_stats_entry_instructions_set(
+                    &stats_entry, entry->effects.instructions) < 0) {
+                LOG_ERROR("Failed to set instructions list of flow stats entry");
+                return;
+            }
+        }
+    }
+
+    indigo_of_flow_stats_entry_fixed_set(&stats_entry, entry->table_id,
+                                         item->secs, item->nsecs,
+                                         entry->priority, entry->idle_timeout,
+                                         entry->hard_timeout, entry->flags,
+                                         entry->cookie, item->stats.packets,
+                                         item->stats.bytes);
+}
+
+/*
+ * Encode one job's share of the waiting flows into replies, on a stats
+ * thread or the event loop
+ */
+static void
+flow_stats_encode_job(void *cookie, int job)
+{
+    struct ind_core_flow_stats_state *state = cookie;
+    int start = job * FLOW_STATS_JOB_ITEMS;
+    int end = start + FLOW_STATS_JOB_ITEMS;
+    of_flow_stats_reply_t **segments = &state->segments[start];
+    of_flow_stats_reply_t *reply = NULL;
+    int count = 0;
+    int i;
+
+    if (end > state->count) {
+        end = state->count;
+    }
 
-        if (stats_entry.version >= OF_VERSION_1_3) {
-            of_flow_stats_entry_flags_set(&stats_entry, entry->flags);
+    for (i = start; i < end; i++) {
+        struct flow_stats_item *item = &state->items[i];
+
+        if (item->entry->retire_epoch != 0) {
+            /* Deleted since its counters were read */
+            continue;
         }
 
-        if (of_flow_stats_entry_match_set(&stats_entry, &entry->match)) {
-            LOG_ERROR("Failed to set match in flow stats entry");
-            return;
+        if (reply == NULL && (reply = flow_stats_reply_new(state)) == NULL) {
+            break;
         }
 
-        if (stats_entry.version == entry->effects.actions->version) {
-            if (stats_entry.version == OF_VERSION_1_0) {
-                if (of_flow_stats_entry_actions_set(
-                        &stats_entry, entry->effects.actions) < 0) {
-                    LOG_ERROR("Failed to set actions list of flow stats entry");
-                    return;
-                }
-            } else {
-                if (of_flow_stats_entry_instructions_set(
-                        &stats_entry, entry->effects.instructions) < 0) {
-                    LOG_ERROR("Failed to set instructions list of flow stats entry");
-                    return;
-                }
+        flow_stats_item_append(reply, item);
+        if (reply->length > FLOW_STATS_REPLY_MAX) {
+            segments[count++] = reply;
+            reply = NULL;
+        }
+    }
+
+    if (reply != NULL) {
+        segments[count++] = reply;
+    }
+    state->segment_counts[job] = count;
+}
+
+/*
+ * Encode the waiting flows on the stats threads and send the replies in
+ * flow order. After the last flow, the final reply goes out without the
+ * more flag.
+ */
+static void
+flow_stats_flush(struct ind_core_flow_stats_state *state, bool last)
+{
+    of_flow_stats_reply_t *held = NULL;
+    int jobs = (state->count + FLOW_STATS_JOB_ITEMS - 1) / FLOW_STATS_JOB_ITEMS;
+    int job, i;
+
+    ind_core_workers_run(jobs, flow_stats_encode_job, state);
+
+    for (job = 0; job < jobs; job++) {
+        for (i = 0; i < state->segment_counts[job]; i++) {
+            if (held != NULL) {
+                indigo_cxn_send_controller_message(state->cxn_id, held);
             }
+            held = state->segments[job * FLOW_STATS_JOB_ITEMS + i];
+        }
+    }
+    state->count = 0;
+
+    if (!last) {
+        if (held != NULL) {
+            indigo_cxn_send_controller_message(state->cxn_id, held);
+        }
+        return;
+    }
+
+    if (held == NULL && (held = flow_stats_reply_new(state)) == NULL) {
+        return;
+    }
+    of_flow_stats_reply_flags_set(held, 0);
+    indigo_cxn_send_controller_message(state->cxn_id, held);
+}
+
+static void
+flow_stats_state_free(struct ind_core_flow_stats_state *state)
+{
+    of_flow_stats_request_delete(state->req);
+    aim_free(state->items);
+    aim_free(state->segments);
+    aim_free(state->segment_counts);
+    aim_free(state);
+}
+
+/* Add a flow whose counters have been read to the replies */
+static void
+flow_stats_item_add(struct ind_core_flow_stats_state *state, ft_entry_t *entry,
+                    const indigo_fi_flow_stats_t *stats, indigo_error_t rv)
+{
+    struct flow_stats_item item;
+
+    if (state->items != NULL) {
+        /* Encoded a slice at a time with the stats threads */
+        if (flow_stats_item_get(state, entry, stats, rv,
+                                &state->items[state->count]) &&
+                ++state->count == FLOW_STATS_SLICE_ITEMS) {
+            flow_stats_flush(state, false);
         }
+        return;
+    }
 
-        of_flow_stats_entry_table_id_set(&stats_entry, entry->table_id);
-        of_flow_stats_entry_duration_sec_set(&stats_entry, secs);
-        of_flow_stats_entry_duration_nsec_set(&stats_entry, nsecs);
-        of_flow_stats_entry_packet_count_set(&stats_entry, flow_stats.packets);
-        of_flow_stats_entry_byte_count_set(&stats_entry, flow_stats.bytes);
+    if (!flow_stats_item_get(state, entry, stats, rv, &item)) {
+        return;
+    }
+
+    /* Allocate a reply if we don't already have one. */
+    if (state->reply == NULL) {
+        state->reply = flow_stats_reply_new(state);
+        if (state->reply == NULL) {
+            return;
+        }
     }
 
-    if (state->reply->length > (1 << 15)) { /* Last object would get too big */
+    flow_stats_item_append(state->reply, &item);
+
+    if (state->reply->length > FLOW_STATS_REPLY_MAX) { /* Last object would get too big */
         indigo_cxn_send_controller_message(state->cxn_id, state->reply);
         state->reply = NULL;
     }
 }
 
+/*
+ * Read the counters of the waiting flows. The iterator may have yielded
+ * since they were queued, so flows deleted meanwhile are left out.
+ */
+static void
+flow_stats_pending_flush(struct ind_core_flow_stats_state *state)
+{
+    indigo_fi_flow_stats_t stats[FLOW_STATS_READ_MAX];
+    indigo_error_t results[FLOW_STATS_READ_MAX];
+    int i, count = 0;
+
+    for (i = 0; i < state->pending_count; i++) {
+        if (state->pending[i]->retire_epoch == 0) {
+            state->pending[count++] = state->pending[i];
+        }
+    }
+    state->pending_count = 0;
+
+    ind_core_flow_entry_stats_get_batch(state->pending, count, stats, results);
+
+    for (i = 0; i < count; i++) {
+        flow_stats_item_add(state, state->pending[i], &stats[i], results[i]);
+    }
+}
+
+static void
+ind_core_flow_stats_iter(void *cookie, ft_entry_t *entry)
+{
+    struct ind_core_flow_stats_state *state = cookie;
+
+    if (entry != NULL) {
+        state->pending[state->pending_count++] = entry;
+        if (state->pending_count == FLOW_STATS_READ_MAX) {
+            flow_stats_pending_flush(state);
+        }
+        return;
+    }
+
+    flow_stats_pending_flush(state);
+
+    if (state->items != NULL) {
+        flow_stats_flush(state, true);
+    } else {
+        /* Send last reply */
+        if (state->reply == NULL) {
+            state->reply = flow_stats_reply_new(state);
+        }
+        if (state->reply != NULL) {
+            of_flow_stats_reply_flags_set(state->reply, 0);
+            indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+        }
+    }
+
+    /* Clean up state */
+    flow_stats_state_free(state);
+}
+
 /**
  * Handle a flow_stats_request message
  * @param _obj Generic type object for the message to be coerced
@@ -922,6 +2445,7 @@ ind_core_flow_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     of_meta_match_t query;
     struct ind_core_flow_stats_state *state;
     indigo_error_t rv;
+    uint16_t flags;
 
     /* Set up the query structure */
     INDIGO_MEM_SET(&query, 0, sizeof(query));
@@ -934,23 +2458,45 @@ ind_core_flow_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     if (obj->version >= OF_VERSION_1_1) {
         of_flow_stats_request_cookie_get(obj, &query.cookie);
         of_flow_stats_request_cookie_mask_get(obj, &query.cookie_mask);
+        of_flow_stats_request_out_group_get(obj, &query.out_group);
+        query.check_out_group = query.out_group != OF_GROUP_ANY;
     }
 
     /* Non strict; do not check priority or overlap */
     query.mode = OF_MATCH_NON_STRICT;
 
     state = aim_malloc(sizeof(*state));
-    state->req = ind_core_dup_tracking(obj, cxn_id);
+    state->req = ind_core_dup_header_tracking(obj, cxn_id);
     state->cxn_id = cxn_id;
-    state->current_time = INDIGO_CURRENT_TIME;
+    state->current_time = INDIGO_LOOP_TIME;
     state->reply = NULL;
-
-    rv = ft_spawn_iter_task(ind_core_ft, &query, ind_core_flow_stats_iter,
-                            state, IND_SOC_DEFAULT_PRIORITY);
+    state->pending_count = 0;
+    of_flow_stats_request_flags_get(obj, &flags);
+    state->changed_only = (flags & IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) != 0;
+    state->since = 0;
+    if (state->changed_only) {
+        state->since = flow_stats_cxn_generation_swap(
+            cxn_id, ++ind_core_ft->shared->counter_generation);
+    }
+    state->generation = ind_core_ft->shared->counter_generation;
+    state->items = NULL;
+    state->count = 0;
+    state->segments = NULL;
+    state->segment_counts = NULL;
+    if (ind_core_workers_count() > 0) {
+        state->items = aim_malloc(FLOW_STATS_SLICE_ITEMS * sizeof(*state->items));
+        state->segments = aim_malloc(FLOW_STATS_SLICE_ITEMS * sizeof(*state->segments));
+        state->segment_counts = aim_malloc(
+            (FLOW_STATS_SLICE_ITEMS / FLOW_STATS_JOB_ITEMS) *
+            sizeof(*state->segment_counts));
+    }
+
+    rv = ft_shards_spawn_reply_iter_task(ind_core_ft, &query,
+                                         ind_core_flow_stats_iter, state,
+                                         IND_SOC_DEFAULT_PRIORITY, cxn_id);
     if (rv != INDIGO_ERROR_NONE) {
         LOG_ERROR("Failed to start flow stats iter: %s", indigo_strerror(rv));
-        of_object_delete(state->req);
-        aim_free(state);
+        flow_stats_state_free(state);
     }
 }
 
@@ -962,39 +2508,53 @@ struct ind_core_aggregate_stats_state {
     uint32_t flows;
     indigo_cxn_id_t cxn_id;
     of_aggregate_stats_request_t *req;
+    ft_entry_t *pending[FLOW_STATS_READ_MAX];
+    int pending_count;
 };
 
+/* As flow_stats_pending_flush */
 static void
-ind_core_aggregate_stats_iter(void *cookie, ft_entry_t *entry)
+aggregate_stats_pending_flush(struct ind_core_aggregate_stats_state *state)
 {
-    struct ind_core_aggregate_stats_state *state = cookie;
-    indigo_error_t rv;
+    indigo_fi_flow_stats_t stats[FLOW_STATS_READ_MAX];
+    indigo_error_t results[FLOW_STATS_READ_MAX];
+    int i, count = 0;
 
-    if (entry != NULL) {
-        indigo_fi_flow_stats_t flow_stats = {
-            .flow_id = entry->id,
-            .duration_ns = 0,
-            .packets = -1,
-            .bytes = -1,
-        };
-
-        ind_core_table_t *table = ind_core_table_get(entry->table_id);
-        if (table != NULL) {
-            rv = table->ops->entry_stats_get(table->priv, entry->priv, &flow_stats);
-        } else {
-            rv = indigo_fwd_flow_stats_get(entry->id, &flow_stats);
+    for (i = 0; i < state->pending_count; i++) {
+        if (state->pending[i]->retire_epoch == 0) {
+            state->pending[count++] = state->pending[i];
         }
+    }
+    state->pending_count = 0;
 
-        if (rv != INDIGO_ERROR_NONE) {
+    ind_core_flow_entry_stats_get_batch(state->pending, count, stats, results);
+
+    for (i = 0; i < count; i++) {
+        if (results[i] != INDIGO_ERROR_NONE) {
             LOG_ERROR("Failed to get stats for flow "INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
-                      entry->id, indigo_strerror(rv));
-            return;
+                      state->pending[i]->id, indigo_strerror(results[i]));
+            continue;
         }
 
-        state->bytes += flow_stats.bytes;
-        state->packets += flow_stats.packets;
+        state->bytes += stats[i].bytes;
+        state->packets += stats[i].packets;
         state->flows += 1;
+    }
+}
+
+static void
+ind_core_aggregate_stats_iter(void *cookie, ft_entry_t *entry)
+{
+    struct ind_core_aggregate_stats_state *state = cookie;
+
+    if (entry != NULL) {
+        state->pending[state->pending_count++] = entry;
+        if (state->pending_count == FLOW_STATS_READ_MAX) {
+            aggregate_stats_pending_flush(state);
+        }
     } else {
+        aggregate_stats_pending_flush(state);
+
         uint32_t xid;
         of_aggregate_stats_reply_t* reply;
         of_aggregate_stats_request_xid_get(state->req, &xid);
@@ -1040,6 +2600,8 @@ ind_core_aggregate_stats_request_handler(of_object_t *_obj,
     if (obj->version >= OF_VERSION_1_1) {
         of_aggregate_stats_request_cookie_get(obj, &query.cookie);
         of_aggregate_stats_request_cookie_mask_get(obj, &query.cookie_mask);
+        of_aggregate_stats_request_out_group_get(obj, &query.out_group);
+        query.check_out_group = query.out_group != OF_GROUP_ANY;
     }
 
     /* Non strict; do not check priority or overlap */
@@ -1047,56 +2609,270 @@ ind_core_aggregate_stats_request_handler(of_object_t *_obj,
 
     state = aim_malloc(sizeof(*state));
     state->cxn_id = cxn_id;
-    state->req = ind_core_dup_tracking(obj, cxn_id);
+    state->req = ind_core_dup_header_tracking(obj, cxn_id);
     state->packets = 0;
     state->bytes = 0;
     state->flows = 0;
+    state->pending_count = 0;
 
-    rv = ft_spawn_iter_task(ind_core_ft, &query, ind_core_aggregate_stats_iter,
-                            state, IND_SOC_DEFAULT_PRIORITY);
+    rv = ft_shards_spawn_reply_iter_task(ind_core_ft, &query,
+                                         ind_core_aggregate_stats_iter, state,
+                                         IND_SOC_DEFAULT_PRIORITY, cxn_id);
     if (rv != INDIGO_ERROR_NONE) {
         LOG_ERROR("Failed to start aggregate stats iter: %s", indigo_strerror(rv));
         of_object_delete(state->req);
         aim_free(state);
         return;
     }
-}
+}
+
+/****************************************************************
+ *
+ * Reply cache
+ *
+ * Replies that only change with the switch configuration are kept
+ * encoded, one per reply type and OpenFlow version. A request is
+ * answered with a copy of the cached reply, with the XID and any
+ * per-connection field set on the copy, so the forwarding and port
+ * modules are only asked again after an invalidation.
+ *
+ ****************************************************************/
+
+static of_object_t *ind_core_reply_cache[IND_CORE_REPLY_CACHE_COUNT][OF_VERSION_ARRAY_MAX];
+
+/* Copy of the cached reply, or NULL if there is none */
+static of_object_t *
+ind_core_reply_cache_get(ind_core_reply_cache_t cache, of_version_t version)
+{
+    of_object_t *reply = ind_core_reply_cache[cache][version];
+
+    if (reply == NULL) {
+        return NULL;
+    }
+
+    return of_object_dup(reply);
+}
+
+/* Cache a copy of a reply built before its XID is set */
+static void
+ind_core_reply_cache_put(ind_core_reply_cache_t cache, of_object_t *reply)
+{
+    of_object_t **entry = &ind_core_reply_cache[cache][reply->version];
+
+    if (*entry != NULL) {
+        of_object_delete(*entry);
+    }
+
+    /* Not caching on allocation failure is harmless */
+    *entry = of_object_dup(reply);
+}
+
+void
+ind_core_reply_cache_invalidate(ind_core_reply_cache_t cache)
+{
+    int version;
+
+    for (version = 0; version < OF_VERSION_ARRAY_MAX; version++) {
+        if (ind_core_reply_cache[cache][version] != NULL) {
+            of_object_delete(ind_core_reply_cache[cache][version]);
+            ind_core_reply_cache[cache][version] = NULL;
+        }
+    }
+}
+
+void
+ind_core_reply_cache_finish(void)
+{
+    int cache;
+
+    for (cache = 0; cache < IND_CORE_REPLY_CACHE_COUNT; cache++) {
+        ind_core_reply_cache_invalidate(cache);
+    }
+}
+
+/****************************************************************/
+
+/**
+ * Handle a desc_stats_request message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
+
+void
+ind_core_desc_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    of_desc_stats_request_t *obj = _obj;
+    of_desc_stats_reply_t *reply;
+    uint32_t xid;
+    ind_core_desc_stats_t *data;
+
+    reply = ind_core_reply_cache_get(IND_CORE_REPLY_CACHE_DESC, obj->version);
+    if (reply == NULL) {
+        /* Create reply and send to controller */
+        if ((reply = of_desc_stats_reply_new(obj->version)) == NULL) {
+            LOG_ERROR("Failed to create desc stats reply message");
+            return;
+        }
+
+        data = &ind_core_of_config.desc_stats;
+        of_desc_stats_reply_sw_desc_set(reply, data->sw_desc);
+        of_desc_stats_reply_hw_desc_set(reply, data->hw_desc);
+        of_desc_stats_reply_dp_desc_set(reply, data->dp_desc);
+        of_desc_stats_reply_mfr_desc_set(reply, data->mfr_desc);
+        of_desc_stats_reply_serial_num_set(reply, data->serial_num);
+        of_desc_stats_reply_flags_set(reply, 0);
+
+        ind_core_reply_cache_put(IND_CORE_REPLY_CACHE_DESC, reply);
+    }
+
+    of_desc_stats_request_xid_get(obj, &xid);
+    of_desc_stats_reply_xid_set(reply, xid);
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+/****************************************************************/
+
+/**
+ * Handle a bsn_table_checksum_stats_request message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ *
+ * Reports the flow checksum of each table holding flows.
+ */
+
+void
+ind_core_bsn_table_checksum_stats_request_handler(of_object_t *_obj,
+                                                  indigo_cxn_id_t cxn_id)
+{
+    of_bsn_table_checksum_stats_request_t *obj = _obj;
+    of_bsn_table_checksum_stats_reply_t *reply;
+    of_list_bsn_table_checksum_stats_entry_t entries;
+    uint32_t xid;
+    int i;
+
+    of_bsn_table_checksum_stats_request_xid_get(obj, &xid);
+
+    reply = of_bsn_table_checksum_stats_reply_new(obj->version);
+    if (reply == NULL) {
+        LOG_ERROR("Failed to allocate table checksum stats reply");
+        return;
+    }
+    of_bsn_table_checksum_stats_reply_xid_set(reply, xid);
+    of_bsn_table_checksum_stats_reply_entries_bind(reply, &entries);
+
+    for (i = 0; i < FT_TABLE_ID_BUCKET_COUNT; i++) {
+        of_bsn_table_checksum_stats_entry_t entry;
+        ft_instance_t ft = ft_shards_find(ind_core_ft, i);
+
+        if (ft == NULL || list_empty(&ft->table_id_buckets[i])) {
+            continue;
+        }
+
+        of_bsn_table_checksum_stats_entry_init(&entry, reply->version, -1, 1);
+        if (of_list_bsn_table_checksum_stats_entry_append_bind(&entries, &entry)) {
+            /* 256 entries always fit */
+            AIM_DIE("unexpected failure appending to table checksum stats list");
+        }
+        of_bsn_table_checksum_stats_entry_table_id_set(&entry, i);
+        of_bsn_table_checksum_stats_entry_checksum_set(
+            &entry, ft->checksums[i].checksum);
+    }
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+/**
+ * Handle a bsn_flow_checksum_bucket_stats_request message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ */
+
+void
+ind_core_bsn_flow_checksum_bucket_stats_request_handler(of_object_t *_obj,
+                                                        indigo_cxn_id_t cxn_id)
+{
+    of_bsn_flow_checksum_bucket_stats_request_t *obj = _obj;
+    of_bsn_flow_checksum_bucket_stats_reply_t *reply;
+    of_list_bsn_flow_checksum_bucket_stats_entry_t entries;
+    ft_instance_t ft;
+    uint32_t xid;
+    uint8_t table_id;
+    uint32_t bucket_count;
+    uint32_t i;
+
+    of_bsn_flow_checksum_bucket_stats_request_xid_get(obj, &xid);
+    of_bsn_flow_checksum_bucket_stats_request_table_id_get(obj, &table_id);
+
+    /* A table without a shard has no flows and a single bucket */
+    ft = ft_shards_find(ind_core_ft, table_id);
+    bucket_count = ft != NULL ? ft->checksums[table_id].bucket_count : 1;
+
+    reply = of_bsn_flow_checksum_bucket_stats_reply_new(obj->version);
+    if (reply == NULL) {
+        LOG_ERROR("Failed to allocate flow checksum bucket stats reply");
+        return;
+    }
+    of_bsn_flow_checksum_bucket_stats_reply_xid_set(reply, xid);
+    of_bsn_flow_checksum_bucket_stats_reply_entries_bind(reply, &entries);
+
+    for (i = 0; i < bucket_count; i++) {
+        of_bsn_flow_checksum_bucket_stats_entry_t entry;
+
+        of_bsn_flow_checksum_bucket_stats_entry_init(&entry, reply->version, -1, 1);
+        if (of_list_bsn_flow_checksum_bucket_stats_entry_append_bind(&entries, &entry)) {
+            of_bsn_flow_checksum_bucket_stats_reply_flags_set(
+                reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+            indigo_cxn_send_controller_message(cxn_id, reply);
+
+            reply = of_bsn_flow_checksum_bucket_stats_reply_new(obj->version);
+            of_bsn_flow_checksum_bucket_stats_reply_xid_set(reply, xid);
+            of_bsn_flow_checksum_bucket_stats_reply_entries_bind(reply, &entries);
+
+            if (of_list_bsn_flow_checksum_bucket_stats_entry_append_bind(&entries, &entry)) {
+                AIM_DIE("unexpected failure appending to an empty bucket stats list");
+            }
+        }
+        of_bsn_flow_checksum_bucket_stats_entry_checksum_set(
+            &entry, ft != NULL ? ft_checksum_bucket_get(ft, table_id, i) : 0);
+    }
 
-/****************************************************************/
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
 
 /**
- * Handle a desc_stats_request message
+ * Handle a bsn_table_set_buckets_size message
  * @param cxn_id Connection handler for the owning connection
  * @param _obj Generic type object for the message to be coerced
- * @returns Error code
  */
 
 void
-ind_core_desc_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+ind_core_bsn_table_set_buckets_size_handler(of_object_t *_obj,
+                                            indigo_cxn_id_t cxn_id)
 {
-    of_desc_stats_request_t *obj = _obj;
-    of_desc_stats_reply_t *reply;
-    uint32_t xid;
-    ind_core_desc_stats_t *data;
+    of_bsn_table_set_buckets_size_t *obj = _obj;
+    uint16_t table_id;
+    uint32_t buckets_size;
 
-    /* Create reply and send to controller */
-    if ((reply = of_desc_stats_reply_new(obj->version)) == NULL) {
-        LOG_ERROR("Failed to create desc stats reply message");
+    of_bsn_table_set_buckets_size_table_id_get(obj, &table_id);
+    of_bsn_table_set_buckets_size_buckets_size_get(obj, &buckets_size);
+
+    if (table_id >= FT_TABLE_ID_BUCKET_COUNT) {
+        indigo_cxn_send_error_reply(cxn_id, obj,
+                                    OF_ERROR_TYPE_BAD_REQUEST,
+                                    OF_REQUEST_FAILED_BAD_TABLE_ID);
         return;
     }
 
-    of_desc_stats_request_xid_get(obj, &xid);
-    of_desc_stats_reply_xid_set(reply, xid);
-
-    data = &ind_core_of_config.desc_stats;
-    of_desc_stats_reply_sw_desc_set(reply, data->sw_desc);
-    of_desc_stats_reply_hw_desc_set(reply, data->hw_desc);
-    of_desc_stats_reply_dp_desc_set(reply, data->dp_desc);
-    of_desc_stats_reply_mfr_desc_set(reply, data->mfr_desc);
-    of_desc_stats_reply_serial_num_set(reply, data->serial_num);
-    of_desc_stats_reply_flags_set(reply, 0);
-
-    indigo_cxn_send_controller_message(cxn_id, reply);
+    if (ft_checksum_buckets_set(ft_shards_get(ind_core_ft, table_id), table_id,
+                                buckets_size) < 0) {
+        LOG_ERROR("Invalid checksum buckets size %u for table %u",
+                  buckets_size, table_id);
+        indigo_cxn_send_error_reply(cxn_id, obj,
+                                    OF_ERROR_TYPE_BAD_REQUEST,
+                                    OF_REQUEST_FAILED_EPERM);
+    }
 }
 
 /****************************************************************/
@@ -1127,6 +2903,50 @@ ind_core_table_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 
 /****************************************************************/
 
+/**
+ * Handle a table_features_stats_request message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ *
+ * A request carrying a table list would reconfigure the pipeline, which
+ * is not supported.
+ */
+
+void
+ind_core_table_features_stats_request_handler(of_object_t *_obj,
+                                              indigo_cxn_id_t cxn_id)
+{
+    of_table_features_stats_request_t *obj = _obj;
+    of_table_features_stats_reply_t *reply = NULL;
+    of_list_table_features_t entries;
+    indigo_error_t rv;
+
+    of_table_features_stats_request_entries_bind(obj, &entries);
+    if (entries.length != 0) {
+        indigo_cxn_send_error_reply(cxn_id, obj,
+                                    OF_ERROR_TYPE_BAD_REQUEST,
+                                    OF_REQUEST_FAILED_EPERM);
+        return;
+    }
+
+    rv = indigo_fwd_table_features_get(obj, &reply);
+    if (rv == INDIGO_ERROR_NOT_SUPPORTED) {
+        ind_core_unhandled_message(obj, cxn_id);
+        return;
+    } else if (rv < 0) {
+        LOG_ERROR("Table features failed: %s", indigo_strerror(rv));
+        indigo_cxn_send_error_reply(cxn_id, obj,
+                                    OF_ERROR_TYPE_BAD_REQUEST,
+                                    OF_REQUEST_FAILED_MULTIPART_BUFFER_OVERFLOW);
+        return;
+    }
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+/****************************************************************/
+
 /**
  * Handle a port_desc_stats_request message
  * @param cxn_id Connection handler for the owning connection
@@ -1141,96 +2961,212 @@ ind_core_port_desc_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_
     of_port_desc_stats_request_t *obj = _obj;
     of_port_desc_stats_reply_t *reply;
 
-    /* Generate a port_desc_stats reply and send to controller */
-    if ((reply = of_port_desc_stats_reply_new(obj->version)) == NULL) {
-        LOG_ERROR("Failed to create port_desc_stats reply message");
-        return;
+    reply = ind_core_reply_cache_get(IND_CORE_REPLY_CACHE_PORT_DESC,
+                                     obj->version);
+    if (reply == NULL) {
+        /* Generate a port_desc_stats reply and send to controller */
+        if ((reply = of_port_desc_stats_reply_new(obj->version)) == NULL) {
+            LOG_ERROR("Failed to create port_desc_stats reply message");
+            return;
+        }
+
+        if (indigo_port_desc_stats_get(reply) == INDIGO_ERROR_NONE) {
+            ind_core_reply_cache_put(IND_CORE_REPLY_CACHE_PORT_DESC, reply);
+        }
     }
 
     of_port_desc_stats_request_xid_get(obj, &xid);
     of_port_desc_stats_reply_xid_set(reply, xid);
-    indigo_port_desc_stats_get(reply);
 
     indigo_cxn_send_controller_message(cxn_id, reply);
 }
 #ifdef OFDPA_FIXUP
 /****************************************************************/
 
+/*
+ * OF-DPA experimenter multiparts, indexed by subtype. Subtypes 4 to 6 are
+ * the remark action tables, which share a message layout.
+ */
+typedef struct ind_core_ofdpa_multipart_s {
+  of_object_id_t request_id;
+  of_object_t *(*reply_new)(of_version_t version);
+  void (*flags_set)(of_object_t *reply, uint16_t flags);
+  void (*get)(of_object_t *request, of_object_t *reply);
+  indigo_error_t (*next)(of_object_t *reply, int first);
+} ind_core_ofdpa_multipart_t;
+
+static const ind_core_ofdpa_multipart_t ind_core_ofdpa_multiparts[] = {
+  [1] = { /* OFDPA_ACTION_TABLE_TYPE_MPLS_SET_QOS */
+    OFDPA_MPLS_SET_QOS_ACTION_MULTIPART_REQUEST,
+    ofdpa_mpls_set_qos_action_multipart_reply_new,
+    ofdpa_mpls_set_qos_action_multipart_reply_flags_set,
+    indigo_set_mpls_qos_get_multipart,
+    indigo_set_mpls_qos_next_multipart,
+  },
+  [2] = { /* OFDPA_ACTION_TABLE_TYPE_OAM_DATAPLANE_COUNTER */
+    OFDPA_OAM_DATAPLANE_CTR_MULTIPART_REQUEST,
+    ofdpa_oam_dataplane_ctr_multipart_reply_new,
+    ofdpa_oam_dataplane_ctr_multipart_reply_flags_set,
+    indigo_oam_dataplane_get_multipart,
+    indigo_oam_dataplane_next_multipart,
+  },
+  [3] = { /* OFDPA_ACTION_TABLE_TYPE_DROP_STATUS */
+    OFDPA_OAM_DROP_STATUS_MULTIPART_REQUEST,
+    ofdpa_oam_drop_status_multipart_reply_new,
+    ofdpa_oam_drop_status_multipart_reply_flags_set,
+    indigo_drop_status_get_multipart,
+    indigo_drop_status_next_multipart,
+  },
+  [4] = { /* OFDPA_ACTION_TABLE_TYPE_MPLS_VPN_LABEL_REMARK */
+    OFDPA_MPLS_VPN_LABEL_REMARK_ACTION_MULTIPART_REQUEST,
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_new,
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_flags_set,
+    indigo_remark_action_get_multipart,
+    indigo_remark_action_next_multipart,
+  },
+  [5] = { /* OFDPA_ACTION_TABLE_TYPE_MPLS_TUNNEL_LABEL_REMARK */
+    OFDPA_MPLS_VPN_LABEL_REMARK_ACTION_MULTIPART_REQUEST,
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_new,
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_flags_set,
+    indigo_remark_action_get_multipart,
+    indigo_remark_action_next_multipart,
+  },
+  [6] = { /* OFDPA_ACTION_TABLE_TYPE_L2_INTERFACE_REMARK */
+    OFDPA_MPLS_VPN_LABEL_REMARK_ACTION_MULTIPART_REQUEST,
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_new,
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_flags_set,
+    indigo_remark_action_get_multipart,
+    indigo_remark_action_next_multipart,
+  },
+};
+
+struct ind_core_ofdpa_dump_state {
+  ind_soc_coro_t coro;
+  indigo_cxn_id_t cxn_id;
+  of_object_t *request;
+  const ind_core_ofdpa_multipart_t *mp;
+  of_object_t *cursor;        /* Holds the entry last read */
+  of_object_t *pending;       /* Copy of the cursor not sent yet */
+};
+
+/*
+ * Each entry is sent in its own reply. A reply is held back until the
+ * next entry is read, so the last one goes out with the more flag clear.
+ */
+static ind_soc_coro_status_t
+ind_core_ofdpa_dump_coro(ind_soc_coro_t *coro, void *cookie)
+{
+  struct ind_core_ofdpa_dump_state *state = cookie;
+
+  IND_SOC_CORO_BEGIN(coro);
+
+  if (state->mp->next(state->cursor, 1) == INDIGO_ERROR_NONE)
+  {
+    state->pending = of_object_dup(state->cursor);
+    AIM_TRUE_OR_DIE(state->pending != NULL);
+    IND_SOC_CORO_YIELD_IF_NEEDED(coro);
+
+    while (state->mp->next(state->cursor, 0) == INDIGO_ERROR_NONE)
+    {
+      state->mp->flags_set(state->pending, OF_STATS_REPLY_FLAG_REPLY_MORE);
+      indigo_cxn_send_controller_message(state->cxn_id, state->pending);
+      state->pending = of_object_dup(state->cursor);
+      AIM_TRUE_OR_DIE(state->pending != NULL);
+      IND_SOC_CORO_YIELD_IF_NEEDED(coro);
+    }
+  }
+  else
+  {
+    /* An empty table is answered like a lookup that found nothing */
+    state->pending = state->cursor;
+    state->cursor = NULL;
+  }
+
+  indigo_cxn_send_controller_message(state->cxn_id, state->pending);
+  of_object_delete(state->cursor);
+  of_object_delete(state->request);
+  aim_free(state);
+
+  IND_SOC_CORO_END(coro);
+}
+
 /**
  * Handle a experimenter_stats_request message
  * @param cxn_id Connection handler for the owning connection
  * @param _obj Generic type object for the message to be coerced
  * @returns Error code
+ *
+ * A request with IND_CORE_OFDPA_MULTIPART_REQUEST_ALL in its flags dumps
+ * the whole table from a task, one entry per reply, instead of looking up
+ * the entry keyed by the request.
  */
 void
 ind_core_experimenter_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 {
-  uint32_t xid;
+  of_experimenter_stats_request_t *obj = _obj;
+  const ind_core_ofdpa_multipart_t *mp;
+  struct ind_core_ofdpa_dump_state *state;
+  of_object_t request;
+  of_object_t *reply;
   uint32_t experimenter_id;
-  of_experimenter_multipart_request_ofdpa_t *obj = _obj;
-
   uint32_t subtype;
-  
-  ofdpa_mpls_set_qos_action_multipart_request_t *ofdpa_mpls_set_qos_action_multipart_request;
-  ofdpa_mpls_set_qos_action_multipart_reply_t ofdpa_mpls_set_qos_action_multipart_reply;
-  
-  ofdpa_oam_dataplane_ctr_multipart_request_t *ofdpa_oam_dataplane_ctr_multipart_request;
-  ofdpa_oam_dataplane_ctr_multipart_reply_t ofdpa_oam_dataplane_ctr_multipart_reply;
-  
-  ofdpa_oam_drop_status_multipart_request_t *ofdpa_oam_drop_status_multipart_request;
-  ofdpa_oam_drop_status_multipart_reply_t ofdpa_oam_drop_status_multipart_reply;
-  
-  ofdpa_mpls_vpn_label_remark_action_multipart_request_t *ofdpa_mpls_vpn_label_remark_action_multipart_request;
-  ofdpa_mpls_vpn_label_remark_action_multipart_reply_t ofdpa_mpls_vpn_label_remark_action_multipart_reply;
- 
-  of_experimenter_multipart_request_ofdpa_experimenter_get(obj, &experimenter_id);
+  uint32_t xid;
+  uint16_t flags;
+
+  of_experimenter_stats_request_experimenter_get(obj, &experimenter_id);
   if(experimenter_id != 0x1018)
   {
     LOG_ERROR("Wrong experimenter id 0x%x", experimenter_id);
   }
-   
-  of_experimenter_ofdpa_subtype_get(obj, &xid);
-  of_experimenter_ofdpa_subtype_get(obj, &subtype);
 
-  switch(subtype)
+  of_experimenter_stats_request_xid_get(obj, &xid);
+  of_experimenter_stats_request_subtype_get(obj, &subtype);
+  of_experimenter_stats_request_flags_get(obj, &flags);
+
+  if (subtype >= AIM_ARRAYSIZE(ind_core_ofdpa_multiparts) ||
+      ind_core_ofdpa_multiparts[subtype].reply_new == NULL)
+  {
+    LOG_ERROR("experimenter subtype 0x%x unsupported", subtype);
+    return;
+  }
+  mp = &ind_core_ofdpa_multiparts[subtype];
+
+  if ((reply = mp->reply_new(obj->version)) == NULL)
+  {
+    LOG_ERROR("Failed to create experimenter multipart reply");
+    return;
+  }
+  of_object_xid_set(reply, xid);
+  if (mp->request_id == OFDPA_MPLS_VPN_LABEL_REMARK_ACTION_MULTIPART_REQUEST)
+  {
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_subtype_set(reply, subtype);
+  }
+
+  if (!(flags & IND_CORE_OFDPA_MULTIPART_REQUEST_ALL))
+  {
+    /* Read the request through the accessors of its subtype */
+    request = *obj;
+    request.wire_object.owned = 0;
+    of_object_init_map[mp->request_id](&request, obj->version, obj->length, 0);
+
+    mp->get(&request, reply);
+    indigo_cxn_send_controller_message(cxn_id, reply);
+    return;
+  }
+
+  state = aim_zmalloc(sizeof(*state));
+  state->cxn_id = cxn_id;
+  state->request = ind_core_dup_header_tracking(obj, cxn_id);
+  state->mp = mp;
+  state->cursor = reply;
+
+  if (ind_soc_coro_start(&state->coro, ind_core_ofdpa_dump_coro, state,
+                         IND_SOC_DEFAULT_PRIORITY) < 0)
   {
-    case 1: //OFDPA_ACTION_TABLE_TYPE_MPLS_SET_QOS
-      ofdpa_mpls_set_qos_action_multipart_request = _obj;
-      
-      indigo_set_mpls_qos_get_multipart(ofdpa_mpls_set_qos_action_multipart_request, 
-        &ofdpa_mpls_set_qos_action_multipart_reply);
-      
-      ofdpa_mpls_set_qos_action_multipart_reply_xid_set(&ofdpa_mpls_set_qos_action_multipart_reply, xid);
-      indigo_cxn_send_controller_message(cxn_id, &ofdpa_mpls_set_qos_action_multipart_reply);
-      break;
-      
-    case 2: //OFDPA_ACTION_TABLE_TYPE_OAM_DATAPLANE_COUNTER
-      ofdpa_oam_dataplane_ctr_multipart_request = _obj;
-      indigo_oam_dataplane_get_multipart(ofdpa_oam_dataplane_ctr_multipart_request, 
-        &ofdpa_oam_dataplane_ctr_multipart_reply);
-      ofdpa_oam_dataplane_ctr_multipart_reply_xid_set(&ofdpa_oam_dataplane_ctr_multipart_reply, xid);
-      indigo_cxn_send_controller_message(cxn_id, &ofdpa_oam_dataplane_ctr_multipart_reply);      
-      break;
-      
-    case 3: //OFDPA_ACTION_TABLE_TYPE_DROP_STATUS
-      ofdpa_oam_drop_status_multipart_request = _obj;
-      indigo_drop_status_get_multipart(ofdpa_oam_drop_status_multipart_request, 
-        &ofdpa_oam_drop_status_multipart_reply);
-      ofdpa_oam_drop_status_multipart_reply_xid_set(&ofdpa_oam_drop_status_multipart_reply, xid);
-      indigo_cxn_send_controller_message(cxn_id, &ofdpa_oam_drop_status_multipart_reply);      
-      break;
-      
-    case 4: //OFDPA_ACTION_TABLE_TYPE_MPLS_VPN_LABEL_REMARK
-    case 5: //OFDPA_ACTION_TABLE_TYPE_MPLS_TUNNEL_LABEL_REMARK
-    case 6: //OFDPA_ACTION_TABLE_TYPE_L2_INTERFACE_REMARK
-      ofdpa_mpls_vpn_label_remark_action_multipart_request = _obj;
-      indigo_remark_action_get_multipart(ofdpa_mpls_vpn_label_remark_action_multipart_request, 
-        &ofdpa_mpls_vpn_label_remark_action_multipart_reply);
-      ofdpa_mpls_set_qos_action_multipart_reply_xid_set(&ofdpa_mpls_vpn_label_remark_action_multipart_reply, xid);
-      indigo_cxn_send_controller_message(cxn_id, &ofdpa_mpls_vpn_label_remark_action_multipart_reply);      
-      break;
-    default:
-      LOG_ERROR("experimenter subtype 0x%x unsupported", subtype);
+    LOG_ERROR("Failed to create experimenter multipart dump task");
+    of_object_delete(state->request);
+    of_object_delete(state->cursor);
+    aim_free(state);
   }
 }
 #endif
@@ -1250,19 +3186,32 @@ ind_core_features_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     uint32_t xid;
     of_dpid_t dpid;
 
-    /* Generate a features reply and send to controller */
-    if ((reply = of_features_reply_new(obj->version)) == NULL) {
-        LOG_ERROR("Failed to create features reply message");
-        return;
+    reply = ind_core_reply_cache_get(IND_CORE_REPLY_CACHE_FEATURES,
+                                     obj->version);
+    if (reply == NULL) {
+        /* Generate a features reply and send to controller */
+        if ((reply = of_features_reply_new(obj->version)) == NULL) {
+            LOG_ERROR("Failed to create features reply message");
+            return;
+        }
+
+        _TRY_NR(indigo_core_dpid_get(&dpid));
+        of_features_reply_datapath_id_set(reply, dpid);
+        of_features_reply_n_buffers_set(reply, 0);
+        _TRY_NR(indigo_fwd_forwarding_features_get(reply));
+        _TRY_NR(indigo_port_features_get(reply));
+
+        ind_core_reply_cache_put(IND_CORE_REPLY_CACHE_FEATURES, reply);
     }
 
     of_features_request_xid_get(obj, &xid);
     of_features_reply_xid_set(reply, xid);
-    _TRY_NR(indigo_core_dpid_get(&dpid));
-    of_features_reply_datapath_id_set(reply, dpid);
-    of_features_reply_n_buffers_set(reply, 0);
-    _TRY_NR(indigo_fwd_forwarding_features_get(reply));
-    _TRY_NR(indigo_port_features_get(reply));
+    if (obj->version >= OF_VERSION_1_3) {
+        indigo_cxn_status_t status;
+        if (indigo_cxn_connection_status_get(cxn_id, &status) == INDIGO_ERROR_NONE) {
+            of_features_reply_auxiliary_id_set(reply, status.auxiliary_id);
+        }
+    }
 
     indigo_cxn_send_controller_message(cxn_id, reply);
 }
@@ -1587,6 +3536,7 @@ typedef struct ind_core_meter_s {
     uint32_t flag;
     of_list_meter_band_t *meters;
     indigo_time_t creation_time;
+    bool stale;                 /* Restored by a warm restart, not re-added */
 } ind_core_meter_t;
 
 #define TEMPLATE_NAME meter_hashtable
@@ -1616,6 +3566,50 @@ ind_core_meter_delete_one(ind_core_meter_t *meter)
     return result;
 }
 
+/*
+ * Replace the flags and bands of a meter. Returns 0 or the meter mod
+ * failed code; the meter may have been deleted on failure.
+ */
+static uint16_t
+ind_core_meter_update(ind_core_meter_t *meter, uint16_t flag,
+                      of_list_meter_band_t *meters)
+{
+    uint32_t id = meter->id;
+    indigo_error_t result;
+
+    if (meter->flag == flag && ind_core_warm_list_equal(meter->meters, meters)) {
+        /* Nothing to program; flows using the meter are not disturbed */
+        meter->stale = false;
+        return 0;
+    }
+
+    if (meter->flag == flag) {
+        result = indigo_fwd_meter_modify(id, flag, meters);
+        if (result < 0) {
+            ind_core_meter_delete_one(meter);
+            return OF_METER_MOD_FAILED_INVALID_METER;
+        }
+    } else {
+        result = indigo_fwd_meter_delete(id);
+        if (result < 0) {
+            return OF_METER_MOD_FAILED_INVALID_METER;
+        }
+        result = indigo_fwd_meter_add(id, flag, meters);
+    }
+
+    if (result < 0) {
+        return OF_METER_MOD_FAILED_INVALID_METER;
+    }
+
+    meter->flag = flag;
+    of_object_delete(meter->meters);
+    meter->meters = of_object_dup(meters);
+    AIM_TRUE_OR_DIE(meter->meters != NULL);
+    meter->stale = false;
+
+    return 0;
+}
+
 void
 ind_core_meter_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 {
@@ -1639,6 +3633,20 @@ ind_core_meter_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         meter = ind_core_meter_lookup(id);
     }
 
+    if (meter != NULL && meter->stale) {
+        /* Re-added after a warm restart; the controller's copy wins */
+        meter->stale = false;
+        if (meter->flag == flag &&
+                ind_core_warm_list_equal(meter->meters, &meters)) {
+            ind_core_warm_confirmed();
+            return;
+        }
+        if ((err_code = ind_core_meter_update(meter, flag, &meters)) != 0) {
+            goto error;
+        }
+        return;
+    }
+
     if (meter != NULL) {
         err_code = OF_METER_MOD_FAILED_METER_EXISTS;
         goto error;
@@ -1653,12 +3661,12 @@ ind_core_meter_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         goto error;
     }
 
-    meter = aim_malloc(sizeof(*meter));
+    meter = aim_zmalloc(sizeof(*meter));
     meter->id = id;
     meter->flag = flag;
     meter->meters = of_object_dup(&meters);
     AIM_TRUE_OR_DIE(meter->meters != NULL);
-    meter->creation_time = INDIGO_CURRENT_TIME;
+    meter->creation_time = INDIGO_LOOP_TIME;
 
     meter_hashtable_insert(ind_core_meter_hashtable, meter);
 
@@ -1679,7 +3687,6 @@ ind_core_meter_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     ind_core_meter_t *meter = NULL;
     uint16_t err_type = OF_ERROR_TYPE_METER_MOD_FAILED;
     uint16_t err_code = OF_METER_MOD_FAILED_UNKNOWN;
-    indigo_error_t result;
 
     of_meter_add_xid_get(obj, &xid);
     of_meter_add_flags_get(obj, &flag);
@@ -1695,32 +3702,10 @@ ind_core_meter_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         goto error;
     }
 
-    if (meter->flag == flag) {
-        result = indigo_fwd_meter_modify(id, flag, &meters);
-        if (result < 0) {
-            err_code = OF_METER_MOD_FAILED_INVALID_METER;
-            ind_core_meter_delete_one(meter);
-            goto error;
-        }
-    } else {
-        result = indigo_fwd_meter_delete(id);
-        if (result < 0) {
-            err_code = OF_METER_MOD_FAILED_INVALID_METER;
-            goto error;
-        }
-        result = indigo_fwd_meter_add(id, flag, &meters);
-    }
-
-    if (result < 0) {
-        err_code = OF_METER_MOD_FAILED_INVALID_METER;
+    if ((err_code = ind_core_meter_update(meter, flag, &meters)) != 0) {
         goto error;
     }
 
-    meter->flag = flag;
-    of_object_delete(meter->meters);
-    meter->meters = of_object_dup(&meters);
-    AIM_TRUE_OR_DIE(meter->meters != NULL);
-
     return;
 
 error:
@@ -1772,10 +3757,231 @@ error:
     indigo_cxn_send_error_reply(cxn_id, obj, err_type, err_code);
 }
 
+/* Replies are split once they pass this many bytes */
+#define IND_CORE_METER_REPLY_SPLIT_BYTES (1 << 15)
+
+void
+ind_core_meter_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    of_meter_stats_request_t *obj = _obj;
+    of_meter_stats_reply_t *reply;
+    of_list_meter_stats_t entries;
+    ind_core_meter_t *meter;
+    bighash_iter_t iter;
+    uint32_t xid;
+    uint32_t id;
+    indigo_error_t rv;
+
+    of_meter_stats_request_xid_get(obj, &xid);
+    of_meter_stats_request_meter_id_get(obj, &id);
+
+    reply = of_meter_stats_reply_new(obj->version);
+    AIM_TRUE_OR_DIE(reply != NULL);
+    of_meter_stats_reply_xid_set(reply, xid);
+    of_meter_stats_reply_entries_bind(reply, &entries);
+
+    if (id != OF_METER_ALL) {
+        if (id <= OF_METER_MAX && ind_core_meter_lookup(id) != NULL) {
+            rv = indigo_fwd_meter_stats_get(id, &entries);
+            if (rv < 0) {
+                LOG_ERROR("Failed to get stats for meter %u: %s",
+                          id, indigo_strerror(rv));
+            }
+        }
+        indigo_cxn_send_controller_message(cxn_id, reply);
+        return;
+    }
+
+    /* The forwarding layer reads from its counter snapshot, one lookup
+       per meter is cheap */
+    for (meter = bighash_iter_start(ind_core_meter_hashtable, &iter);
+            meter; meter = bighash_iter_next(&iter)) {
+        if (entries.length > IND_CORE_METER_REPLY_SPLIT_BYTES) {
+            of_meter_stats_reply_flags_set(reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+            indigo_cxn_send_controller_message(cxn_id, reply);
+
+            reply = of_meter_stats_reply_new(obj->version);
+            AIM_TRUE_OR_DIE(reply != NULL);
+            of_meter_stats_reply_xid_set(reply, xid);
+            of_meter_stats_reply_entries_bind(reply, &entries);
+        }
+
+        rv = indigo_fwd_meter_stats_get(meter->id, &entries);
+        if (rv < 0) {
+            LOG_ERROR("Failed to get stats for meter %u: %s",
+                      meter->id, indigo_strerror(rv));
+        }
+    }
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+/* Configuration is served from the meter table, without the forwarding layer */
+void
+ind_core_meter_config_stats_request_handler(of_object_t *_obj,
+                                            indigo_cxn_id_t cxn_id)
+{
+    of_meter_config_stats_request_t *obj = _obj;
+    of_meter_config_stats_reply_t *reply;
+    of_list_meter_band_t entries;       /* LOCI types the entries as bands */
+    of_meter_config_t *entry;
+    ind_core_meter_t *meter;
+    bighash_iter_t iter;
+    uint32_t xid;
+    uint32_t id;
+
+    of_meter_config_stats_request_xid_get(obj, &xid);
+    of_meter_config_stats_request_meter_id_get(obj, &id);
+
+    reply = of_meter_config_stats_reply_new(obj->version);
+    AIM_TRUE_OR_DIE(reply != NULL);
+    of_meter_config_stats_reply_xid_set(reply, xid);
+    of_meter_config_stats_reply_entries_bind(reply, &entries);
+
+    entry = of_meter_config_new(entries.version);
+    AIM_TRUE_OR_DIE(entry != NULL);
+
+    for (meter = bighash_iter_start(ind_core_meter_hashtable, &iter);
+            meter; meter = bighash_iter_next(&iter)) {
+        if (id != OF_METER_ALL && meter->id != id) {
+            continue;
+        }
+
+        of_meter_config_flags_set(entry, meter->flag);
+        of_meter_config_meter_id_set(entry, meter->id);
+        if (of_meter_config_entries_set(entry, meter->meters) < 0) {
+            AIM_DIE("unexpected failure setting meter config bands");
+        }
+        /* No length accessor is generated for meter config */
+        of_u16_len_wire_length_set(entry, entry->length);
+
+        if (of_list_append(&entries, entry) < 0) {
+            of_meter_config_stats_reply_flags_set(reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+            indigo_cxn_send_controller_message(cxn_id, reply);
+
+            reply = of_meter_config_stats_reply_new(obj->version);
+            AIM_TRUE_OR_DIE(reply != NULL);
+            of_meter_config_stats_reply_xid_set(reply, xid);
+            of_meter_config_stats_reply_entries_bind(reply, &entries);
+
+            if (of_list_append(&entries, entry) < 0) {
+                AIM_DIE("unexpected failure appending to an empty meter config list");
+            }
+        }
+    }
+
+    of_object_delete(entry);
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+/* Warm restart; see warm.c */
+
+void
+ind_core_meter_warm_save(ind_core_warm_write_f write, void *cookie)
+{
+    bighash_iter_t iter;
+    ind_core_meter_t *meter;
+    of_meter_add_t *obj;
+
+    for (meter = bighash_iter_start(ind_core_meter_hashtable, &iter);
+            meter; meter = bighash_iter_next(&iter)) {
+        obj = of_meter_add_new(meter->meters->version);
+        AIM_TRUE_OR_DIE(obj != NULL);
+        of_meter_add_flags_set(obj, meter->flag);
+        of_meter_add_meter_id_set(obj, meter->id);
+        if (of_meter_add_meters_set(obj, meter->meters) < 0) {
+            LOG_ERROR("Failed to save meter %u", meter->id);
+        } else {
+            write(cookie, obj, 0, 0);
+        }
+        of_object_delete(obj);
+    }
+}
+
+indigo_error_t
+ind_core_meter_warm_restore(of_object_t *_obj)
+{
+    of_meter_add_t *obj = _obj;
+    uint16_t flag;
+    uint32_t id;
+    of_list_meter_band_t meters;
+    ind_core_meter_t *meter;
+    indigo_error_t rv;
+
+    of_meter_add_flags_get(obj, &flag);
+    of_meter_add_meter_id_get(obj, &id);
+    of_meter_add_meters_bind(obj, &meters);
+
+    if (id > OF_METER_MAX) {
+        return INDIGO_ERROR_PARAM;
+    }
+    if (ind_core_meter_lookup(id) != NULL) {
+        return INDIGO_ERROR_EXISTS;
+    }
+
+    if ((rv = indigo_fwd_meter_restore(id, flag, &meters)) < 0) {
+        return rv;
+    }
+
+    meter = aim_zmalloc(sizeof(*meter));
+    meter->id = id;
+    meter->flag = flag;
+    meter->meters = of_object_dup(&meters);
+    AIM_TRUE_OR_DIE(meter->meters != NULL);
+    meter->creation_time = INDIGO_LOOP_TIME;
+    meter->stale = true;
+
+    meter_hashtable_insert(ind_core_meter_hashtable, meter);
+
+    return INDIGO_ERROR_NONE;
+}
+
+/* Mark every meter stale; returns the number marked */
+int
+ind_core_meter_warm_mark(void)
+{
+    bighash_iter_t iter;
+    ind_core_meter_t *meter;
+    int marked = 0;
+
+    for (meter = bighash_iter_start(ind_core_meter_hashtable, &iter);
+            meter; meter = bighash_iter_next(&iter)) {
+        meter->stale = true;
+        marked++;
+    }
+
+    return marked;
+}
+
+/* Delete the stale meters; returns the number deleted */
+int
+ind_core_meter_warm_sweep(void)
+{
+    bighash_iter_t iter;
+    ind_core_meter_t *meter;
+    int deleted = 0;
+
+    for (meter = bighash_iter_start(ind_core_meter_hashtable, &iter);
+            meter; meter = bighash_iter_next(&iter)) {
+        if (!meter->stale) {
+            continue;
+        }
+        meter->stale = false;
+        if (ind_core_meter_delete_one(meter) < 0) {
+            LOG_WARN("Stale meter %u kept, delete failed", meter->id);
+        } else {
+            deleted++;
+        }
+    }
+
+    return deleted;
+}
+
 void
 ind_core_meter_init(void)
 {
-    ind_core_meter_hashtable = bighash_table_create(1024);
+    ind_core_meter_hashtable = meter_hashtable_create(1024);
     AIM_TRUE_OR_DIE(ind_core_meter_hashtable != NULL);
 }
 #endif
@@ -81,6 +81,9 @@ extern void ind_core_desc_stats_request_handler(
 extern void ind_core_table_stats_request_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn);
+extern void ind_core_table_features_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn);
 extern void ind_core_port_desc_stats_request_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn_id);
@@ -119,6 +122,24 @@ extern void indigo_drop_status_get_multipart(
 extern void indigo_remark_action_get_multipart(
     ofdpa_mpls_vpn_label_remark_action_multipart_request_t *request, 
     ofdpa_mpls_vpn_label_remark_action_multipart_reply_t *reply);      
+
+/*
+ * Experimenter multipart request flag asking for every entry of the table
+ * rather than the one keyed by the request
+ */
+#define IND_CORE_OFDPA_MULTIPART_REQUEST_ALL 0x8000
+
+extern indigo_error_t indigo_set_mpls_qos_next_multipart(
+    ofdpa_mpls_set_qos_action_multipart_reply_t *reply, int first);
+
+extern indigo_error_t indigo_oam_dataplane_next_multipart(
+    ofdpa_oam_dataplane_ctr_multipart_reply_t *reply, int first);
+
+extern indigo_error_t indigo_drop_status_next_multipart(
+    ofdpa_oam_drop_status_multipart_reply_t *reply, int first);
+
+extern indigo_error_t indigo_remark_action_next_multipart(
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_t *reply, int first);
     
 #endif   
 extern void ind_core_bsn_get_ip_mask_request_handler(
@@ -140,6 +161,18 @@ extern void ind_core_bsn_sw_pipeline_stats_request_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn_id);
 
+extern void ind_core_bsn_table_checksum_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
+
+extern void ind_core_bsn_flow_checksum_bucket_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
+
+extern void ind_core_bsn_table_set_buckets_size_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
+
 /* group_handlers.c */
 void ind_core_group_add_handler(
     of_object_t *_obj,
@@ -171,6 +204,12 @@ void ind_core_meter_modify_handler(
 void ind_core_meter_delete_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn_id);
+void ind_core_meter_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
+void ind_core_meter_config_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
 #endif
 
 /* bsn_counter_handlers.c */
@@ -180,6 +219,12 @@ void ind_core_bsn_vlan_counter_stats_request_handler(
 void ind_core_bsn_port_counter_stats_request_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn_id);
+void ind_core_bsn_debug_counter_desc_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
+void ind_core_bsn_debug_counter_stats_request_handler(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
 
 /* gentable_handlers.c */
 void ind_core_bsn_gentable_entry_add_handler(
@@ -26,6 +26,8 @@
 #include <OFStateManager/ofstatemanager.h>
 #include <indigo/indigo.h>
 #include <BigList/biglist.h>
+#include <AIM/aim_memory.h>
+#include <AIM/aim_bitmap.h>
 
 #include "ofstatemanager_log.h"
 #include "listener.h"
@@ -34,24 +36,211 @@ static biglist_t *packet_in_listeners;
 static biglist_t *port_status_listeners;
 static biglist_t *message_listeners;
 
-/* Packet in */
+/*
+ * Packet in
+ *
+ * Listeners are called in registration order. The parts of a packet-in
+ * that any registered filter uses are read once per packet-in, and each
+ * filtered listener is checked against them before it is called.
+ */
 
-indigo_error_t
-indigo_core_packet_in_listener_register(indigo_core_packet_in_listener_f fn)
+typedef struct packet_in_listener_s {
+    indigo_core_packet_in_listener_f fn;
+    bool filtered;
+    indigo_core_packet_in_filter_t filter;
+} packet_in_listener_t;
+
+/* What packet_in_listener_t.filter uses */
+#define PACKET_IN_FILTER_ETH_TYPE 0x1
+#define PACKET_IN_FILTER_IN_PORT  0x2
+
+struct packet_in_fields {
+    uint16_t eth_type;          /* 0 if the packet is too short */
+    of_port_no_t in_port;
+    uint8_t reason;
+    bool has_table_id;
+    uint8_t table_id;
+};
+
+static biglist_t *packet_in_listeners;
+static int packet_in_filter_uses;
+
+static packet_in_listener_t *
+packet_in_listener_find(indigo_core_packet_in_listener_f fn)
 {
-    if (biglist_find(packet_in_listeners, fn)) {
+    biglist_t *cur;
+    packet_in_listener_t *listener;
+
+    BIGLIST_FOREACH_DATA(cur, packet_in_listeners, packet_in_listener_t *, listener) {
+        if (listener->fn == fn) {
+            return listener;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+packet_in_filter_uses_update(void)
+{
+    biglist_t *cur;
+    packet_in_listener_t *listener;
+
+    packet_in_filter_uses = 0;
+    BIGLIST_FOREACH_DATA(cur, packet_in_listeners, packet_in_listener_t *, listener) {
+        if (!listener->filtered) {
+            continue;
+        }
+        if (listener->filter.eth_type_count > 0) {
+            packet_in_filter_uses |= PACKET_IN_FILTER_ETH_TYPE;
+        }
+        if (listener->filter.in_port_count > 0) {
+            packet_in_filter_uses |= PACKET_IN_FILTER_IN_PORT;
+        }
+    }
+}
+
+static indigo_error_t
+packet_in_listener_add(indigo_core_packet_in_listener_f fn,
+                       const indigo_core_packet_in_filter_t *filter)
+{
+    packet_in_listener_t *listener;
+
+    if (packet_in_listener_find(fn)) {
         return INDIGO_ERROR_EXISTS;
     }
 
-    packet_in_listeners = biglist_append(packet_in_listeners, fn);
+    listener = aim_zmalloc(sizeof(*listener));
+    listener->fn = fn;
+    if (filter != NULL) {
+        listener->filtered = true;
+        listener->filter = *filter;
+    }
+    packet_in_listeners = biglist_append(packet_in_listeners, listener);
+    packet_in_filter_uses_update();
 
     return INDIGO_ERROR_NONE;
 }
 
+indigo_error_t
+indigo_core_packet_in_listener_register(indigo_core_packet_in_listener_f fn)
+{
+    return packet_in_listener_add(fn, NULL);
+}
+
+indigo_error_t
+indigo_core_packet_in_listener_filtered_register(
+    indigo_core_packet_in_listener_f fn,
+    const indigo_core_packet_in_filter_t *filter)
+{
+    if (filter->eth_type_count < 0 ||
+            filter->eth_type_count > INDIGO_CORE_PACKET_IN_FILTER_ETH_TYPES ||
+            filter->in_port_count < 0 ||
+            filter->in_port_count > INDIGO_CORE_PACKET_IN_FILTER_IN_PORTS) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    return packet_in_listener_add(fn, filter);
+}
+
 void
 indigo_core_packet_in_listener_unregister(indigo_core_packet_in_listener_f fn)
 {
-    packet_in_listeners = biglist_remove(packet_in_listeners, fn);
+    packet_in_listener_t *listener = packet_in_listener_find(fn);
+
+    if (listener != NULL) {
+        packet_in_listeners = biglist_remove(packet_in_listeners, listener);
+        aim_free(listener);
+        packet_in_filter_uses_update();
+    }
+}
+
+/* The ethertype after any VLAN tags */
+static uint16_t
+packet_in_eth_type(of_packet_in_t *packet_in)
+{
+    of_octets_t data;
+    uint16_t eth_type;
+    int offset = 12;
+
+    of_packet_in_data_get(packet_in, &data);
+    while (offset + 2 <= data.bytes) {
+        eth_type = (data.data[offset] << 8) | data.data[offset + 1];
+        if (eth_type != 0x8100 && eth_type != 0x88a8) {
+            return eth_type;
+        }
+        offset += 4;
+    }
+
+    return 0;
+}
+
+static void
+packet_in_fields_get(of_packet_in_t *packet_in, struct packet_in_fields *fields)
+{
+    of_packet_in_reason_get(packet_in, &fields->reason);
+
+    fields->has_table_id = packet_in->version >= OF_VERSION_1_1;
+    if (fields->has_table_id) {
+        of_packet_in_table_id_get(packet_in, &fields->table_id);
+    }
+
+    if (packet_in_filter_uses & PACKET_IN_FILTER_ETH_TYPE) {
+        fields->eth_type = packet_in_eth_type(packet_in);
+    }
+
+    if (packet_in_filter_uses & PACKET_IN_FILTER_IN_PORT) {
+        if (packet_in->version <= OF_VERSION_1_1) {
+            of_packet_in_in_port_get(packet_in, &fields->in_port);
+        } else {
+            of_match_t match;
+            if (of_packet_in_match_get(packet_in, &match) < 0) {
+                fields->in_port = OF_PORT_DEST_NONE;
+            } else {
+                fields->in_port = match.fields.in_port;
+            }
+        }
+    }
+}
+
+static bool
+packet_in_filter_matches(const indigo_core_packet_in_filter_t *filter,
+                         const struct packet_in_fields *fields)
+{
+    int i;
+
+    if (filter->match_reason && filter->reason != fields->reason) {
+        return false;
+    }
+
+    if (filter->match_table_id &&
+            (!fields->has_table_id || filter->table_id != fields->table_id)) {
+        return false;
+    }
+
+    if (filter->eth_type_count > 0) {
+        for (i = 0; i < filter->eth_type_count; i++) {
+            if (filter->eth_types[i] == fields->eth_type) {
+                break;
+            }
+        }
+        if (i == filter->eth_type_count) {
+            return false;
+        }
+    }
+
+    if (filter->in_port_count > 0) {
+        for (i = 0; i < filter->in_port_count; i++) {
+            if (filter->in_ports[i] == fields->in_port) {
+                break;
+            }
+        }
+        if (i == filter->in_port_count) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 indigo_core_listener_result_t
@@ -59,10 +248,21 @@ ind_core_packet_in_notify(of_packet_in_t *packet_in)
 {
     indigo_core_listener_result_t result = INDIGO_CORE_LISTENER_RESULT_PASS;
     biglist_t *cur;
-    indigo_core_packet_in_listener_f fn;
+    packet_in_listener_t *listener;
+    struct packet_in_fields fields;
+    bool have_fields = false;
 
-    BIGLIST_FOREACH_DATA(cur, packet_in_listeners, indigo_core_packet_in_listener_f, fn) {
-        result |= fn(packet_in);
+    BIGLIST_FOREACH_DATA(cur, packet_in_listeners, packet_in_listener_t *, listener) {
+        if (listener->filtered) {
+            if (!have_fields) {
+                packet_in_fields_get(packet_in, &fields);
+                have_fields = true;
+            }
+            if (!packet_in_filter_matches(&listener->filter, &fields)) {
+                continue;
+            }
+        }
+        result |= listener->fn(packet_in);
     }
 
     return result;
@@ -102,24 +302,112 @@ ind_core_port_status_notify(of_port_status_t *port_status)
     return result;
 }
 
-/* Message from controller */
+/*
+ * Message from controller
+ *
+ * Each listener has the message types it is called for, all of them if it
+ * did not subscribe to some. Their union is checked before walking the
+ * listeners.
+ */
 
-indigo_error_t
-indigo_core_message_listener_register(indigo_core_message_listener_f fn)
+typedef struct message_listener_s {
+    indigo_core_message_listener_f fn;
+    aim_bitmap_t *types;        /* NULL for every type */
+} message_listener_t;
+
+static biglist_t *message_listeners;
+static aim_bitmap_t *message_listener_types;
+
+static message_listener_t *
+message_listener_find(indigo_core_message_listener_f fn)
+{
+    biglist_t *cur;
+    message_listener_t *listener;
+
+    BIGLIST_FOREACH_DATA(cur, message_listeners, message_listener_t *, listener) {
+        if (listener->fn == fn) {
+            return listener;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+message_listener_types_update(void)
 {
-    if (biglist_find(message_listeners, fn)) {
+    biglist_t *cur;
+    message_listener_t *listener;
+    int bit;
+
+    if (message_listener_types == NULL) {
+        message_listener_types = aim_bitmap_alloc(NULL, OF_MESSAGE_OBJECT_COUNT);
+    }
+
+    aim_bitmap_clr_all(&message_listener_types->hdr);
+    BIGLIST_FOREACH_DATA(cur, message_listeners, message_listener_t *, listener) {
+        if (listener->types == NULL) {
+            aim_bitmap_set_all(&message_listener_types->hdr);
+            return;
+        }
+        for (bit = 0; bit < OF_MESSAGE_OBJECT_COUNT; bit++) {
+            if (aim_bitmap_get(&listener->types->hdr, bit)) {
+                aim_bitmap_set(&message_listener_types->hdr, bit);
+            }
+        }
+    }
+}
+
+static indigo_error_t
+message_listener_add(indigo_core_message_listener_f fn, aim_bitmap_hdr_t *types)
+{
+    message_listener_t *listener;
+    int bit;
+
+    if (message_listener_find(fn)) {
         return INDIGO_ERROR_EXISTS;
     }
 
-    message_listeners = biglist_append(message_listeners, fn);
+    listener = aim_zmalloc(sizeof(*listener));
+    listener->fn = fn;
+    if (types != NULL) {
+        listener->types = aim_bitmap_alloc(NULL, OF_MESSAGE_OBJECT_COUNT);
+        for (bit = 0; bit < OF_MESSAGE_OBJECT_COUNT && bit <= types->maxbit; bit++) {
+            if (aim_bitmap_get(types, bit)) {
+                aim_bitmap_set(&listener->types->hdr, bit);
+            }
+        }
+    }
+    message_listeners = biglist_append(message_listeners, listener);
+    message_listener_types_update();
 
     return INDIGO_ERROR_NONE;
 }
 
+indigo_error_t
+indigo_core_message_listener_register(indigo_core_message_listener_f fn)
+{
+    return message_listener_add(fn, NULL);
+}
+
+indigo_error_t
+indigo_core_message_listener_subscribe(indigo_core_message_listener_f fn,
+                                       aim_bitmap_hdr_t *types)
+{
+    return message_listener_add(fn, types);
+}
+
 void
 indigo_core_message_listener_unregister(indigo_core_message_listener_f fn)
 {
-    message_listeners = biglist_remove(message_listeners, fn);
+    message_listener_t *listener = message_listener_find(fn);
+
+    if (listener != NULL) {
+        message_listeners = biglist_remove(message_listeners, listener);
+        aim_bitmap_free(listener->types);
+        aim_free(listener);
+        message_listener_types_update();
+    }
 }
 
 indigo_core_listener_result_t
@@ -127,10 +415,18 @@ ind_core_message_notify(indigo_cxn_id_t cxn_id, of_object_t *message)
 {
     indigo_core_listener_result_t result = INDIGO_CORE_LISTENER_RESULT_PASS;
     biglist_t *cur;
-    indigo_core_message_listener_f fn;
+    message_listener_t *listener;
+    int type = message->object_id;
+
+    if (message_listener_types == NULL || type >= OF_MESSAGE_OBJECT_COUNT ||
+            !aim_bitmap_get(&message_listener_types->hdr, type)) {
+        return result;
+    }
 
-    BIGLIST_FOREACH_DATA(cur, message_listeners, indigo_core_message_listener_f, fn) {
-        result |= fn(cxn_id, message);
+    BIGLIST_FOREACH_DATA(cur, message_listeners, message_listener_t *, listener) {
+        if (listener->types == NULL || aim_bitmap_get(&listener->types->hdr, type)) {
+            result |= listener->fn(cxn_id, message);
+        }
     }
 
     return result;
@@ -0,0 +1,160 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Memory accounting gentable
+ *
+ * Exports the indigo memory accounting tags to the controller. The
+ * controller adds an entry for each tag it wants to monitor and reads it
+ * with bsn_gentable_entry_stats.
+ *
+ * Key:
+ *  - udf_id: tag number, INDIGO_MEM_TAG_*
+ *
+ * Value: empty
+ *
+ * Stats:
+ *  - rx_packets: live bytes
+ *  - tx_packets: peak bytes
+ *  - miss_packets: soft limit hits
+ *
+ * There are no byte counter TLVs, so the packet counters carry bytes.
+ */
+
+#include "ofstatemanager_log.h"
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <indigo/of_state_manager.h>
+#include <loci/loci.h>
+#include "ofstatemanager_int.h"
+
+static indigo_core_gentable_t *ind_core_memory_gentable;
+
+static indigo_error_t
+parse_key(of_list_bsn_tlv_t *key, indigo_mem_tag_t *tag)
+{
+    of_bsn_tlv_t tlv;
+    uint16_t value;
+
+    if (of_list_bsn_tlv_first(key, &tlv) < 0) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    if (tlv.header.object_id != OF_BSN_TLV_UDF_ID) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    of_bsn_tlv_udf_id_value_get(&tlv.udf_id, &value);
+    if (value >= INDIGO_MEM_TAG_COUNT) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    if (of_list_bsn_tlv_next(key, &tlv) == 0) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    *tag = value;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+ind_core_memory_gentable_add(void *table_priv, of_list_bsn_tlv_t *key,
+                             of_list_bsn_tlv_t *value, void **entry_priv)
+{
+    indigo_mem_tag_t tag;
+    indigo_error_t rv;
+
+    rv = parse_key(key, &tag);
+    if (rv < 0) {
+        return rv;
+    }
+
+    if (value->length != 0) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    *entry_priv = (void *)(uintptr_t)tag;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+ind_core_memory_gentable_modify(void *table_priv, void *entry_priv,
+                                of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *value)
+{
+    return value->length == 0 ? INDIGO_ERROR_NONE : INDIGO_ERROR_PARAM;
+}
+
+static indigo_error_t
+ind_core_memory_gentable_delete(void *table_priv, void *entry_priv,
+                                of_list_bsn_tlv_t *key)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+static void
+ind_core_memory_gentable_get_stats(void *table_priv, void *entry_priv,
+                                   of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *stats)
+{
+    indigo_mem_stats_t mem;
+    of_object_t *tlv;
+
+    indigo_mem_stats_get((indigo_mem_tag_t)(uintptr_t)entry_priv, &mem);
+
+    if ((tlv = of_bsn_tlv_rx_packets_new(stats->version)) != NULL) {
+        of_bsn_tlv_rx_packets_value_set(tlv, mem.live_bytes);
+        of_list_append(stats, tlv);
+        of_object_delete(tlv);
+    }
+
+    if ((tlv = of_bsn_tlv_tx_packets_new(stats->version)) != NULL) {
+        of_bsn_tlv_tx_packets_value_set(tlv, mem.peak_bytes);
+        of_list_append(stats, tlv);
+        of_object_delete(tlv);
+    }
+
+    if ((tlv = of_bsn_tlv_miss_packets_new(stats->version)) != NULL) {
+        of_bsn_tlv_miss_packets_value_set(tlv, mem.limit_hits);
+        of_list_append(stats, tlv);
+        of_object_delete(tlv);
+    }
+}
+
+static indigo_core_gentable_ops_t ind_core_memory_gentable_ops = {
+    .add = ind_core_memory_gentable_add,
+    .modify = ind_core_memory_gentable_modify,
+    .del = ind_core_memory_gentable_delete,
+    .get_stats = ind_core_memory_gentable_get_stats,
+};
+
+void
+ind_core_memory_gentable_init(void)
+{
+    indigo_core_gentable_register("memory", &ind_core_memory_gentable_ops,
+                                  NULL, INDIGO_MEM_TAG_COUNT, 16,
+                                  &ind_core_memory_gentable);
+}
+
+void
+ind_core_memory_gentable_finish(void)
+{
+    indigo_core_gentable_unregister(ind_core_memory_gentable);
+    ind_core_memory_gentable = NULL;
+}
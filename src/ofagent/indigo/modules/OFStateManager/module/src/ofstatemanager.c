@@ -32,16 +32,19 @@
 #include <indigo/forwarding.h>
 #include <indigo/indigo.h>
 #include <indigo/of_state_manager.h>
+#include <indigo/of_message.h>
 #include <loci/loci_dump.h>
 #include <loci/loci_show.h>
+#include <AIM/aim_trace.h>
 #include "ofstatemanager_int.h"
 #include "ofstatemanager_log.h"
 #include "ofstatemanager_decs.h"
 #include "handlers.h"
-#include "ft.h"
+#include "ft_shard.h"
 #include "expiration.h"
 #include "listener.h"
 #include "table.h"
+#include "workers.h"
 
 static void
 process_flow_removal(ft_entry_t *entry,
@@ -62,7 +65,7 @@ ind_core_of_config_t ind_core_of_config;
 /**
  * @brief Core flow table instance
  */
-ft_instance_t ind_core_ft;
+ft_shards_t *ind_core_ft;
 
 int ind_core_init_done = 0;
 int ind_core_module_enabled = 0;
@@ -98,13 +101,18 @@ static int ind_core_connection_count;
     } while(0)
 
 
-/* Handle a packet in from forwarding */
-indigo_error_t
-indigo_core_packet_in(of_packet_in_t *packet_in)
+/*
+ * Run the listeners on a packet-in and send it to the controllers. Unless
+ * copy is set the packet-in is consumed.
+ */
+static indigo_error_t
+packet_in_process(of_packet_in_t *packet_in, int copy)
 {
     if (!ind_core_module_enabled) {
         LOG_TRACE("Packet in called when not enabled");
-        of_object_delete(packet_in);
+        if (!copy) {
+            of_object_delete(packet_in);
+        }
         return INDIGO_ERROR_INIT;
     }
 
@@ -113,18 +121,46 @@ indigo_core_packet_in(of_packet_in_t *packet_in)
 
     if (ind_core_packet_in_notify(packet_in) == INDIGO_CORE_LISTENER_RESULT_DROP) {
         LOG_TRACE("Listener dropped packet-in");
-        of_object_delete(packet_in);
+        if (!copy) {
+            of_object_delete(packet_in);
+        }
         return INDIGO_ERROR_NONE;
     }
 
-    indigo_cxn_send_async_message(packet_in);
+    if (copy) {
+        indigo_cxn_send_async_message_copy(packet_in);
+    } else {
+        indigo_cxn_send_async_message(packet_in);
+    }
 
     return INDIGO_ERROR_NONE;
 }
 
+/* Handle a packet in from forwarding */
+indigo_error_t
+indigo_core_packet_in(of_packet_in_t *packet_in)
+{
+    return packet_in_process(packet_in, 0);
+}
+
+/* Handle a packet in from forwarding that stays the caller's */
+indigo_error_t
+indigo_core_packet_in_copy(of_packet_in_t *packet_in)
+{
+    return packet_in_process(packet_in, 1);
+}
+
 
 /****************************************************************/
 
+/*
+ * Flow-removed messages are built here and copied into the connection
+ * output queues, so a flow expiring or being deleted does not allocate
+ * a loci object and a maximum-length wire buffer.
+ */
+static of_object_storage_t flow_removed_storage;
+static uint8_t flow_removed_buf[OF_WIRE_BUFFER_MAX_LENGTH];
+
 /**
  * @brief Send a flow removed message for the given entry
  * @param entry The local flow table entry
@@ -136,21 +172,26 @@ send_flow_removed_message(ft_entry_t *entry,
                           indigo_fi_flow_stats_t *final_stats)
 {
     of_flow_removed_t *msg;
+    of_match_t match;
     uint32_t secs;
     uint32_t nsecs;
     indigo_time_t current;
     uint64_t packets, bytes;
     of_version_t ver;
 
-    current = INDIGO_CURRENT_TIME;
-
-    if (indigo_cxn_get_async_version(&ver) < 0) {
-        /* No controllers connected */
+    /* Skip encoding entirely if no connection wants the message */
+    if (indigo_cxn_get_async_version_for(OF_FLOW_REMOVED, &ver) < 0) {
         return;
     }
 
-    if ((msg = of_flow_removed_new(ver)) == NULL) {
-        LOG_ERROR("Failed to allocate flow_removed message");
+    current = INDIGO_LOOP_TIME;
+
+    msg = indigo_of_message_new_preallocated(&flow_removed_storage,
+                                             OF_FLOW_REMOVED, ver,
+                                             flow_removed_buf,
+                                             sizeof(flow_removed_buf));
+    if (msg == NULL) {
+        LOG_ERROR("Failed to initialize flow_removed message");
         return;
     }
 
@@ -168,9 +209,9 @@ send_flow_removed_message(ft_entry_t *entry,
         of_flow_removed_hard_timeout_set(msg, entry->hard_timeout);
     }
 
-    if (of_flow_removed_match_set(msg, &entry->match)) {
+    ft_entry_match_get(entry, &match);
+    if (of_flow_removed_match_set(msg, &match)) {
         LOG_ERROR("Failed to set match in flow removed message");
-        of_object_delete(msg);
         return;
     }
 
@@ -193,7 +234,7 @@ send_flow_removed_message(ft_entry_t *entry,
     of_flow_removed_packet_count_set(msg, packets);
     of_flow_removed_byte_count_set(msg, bytes);
 
-    indigo_cxn_send_async_message(msg);
+    indigo_cxn_send_async_message_copy(msg);
 }
 
 
@@ -225,282 +266,420 @@ indigo_core_receive_controller_message(indigo_cxn_id_t cxn, of_object_t *obj)
         return;
     }
 
-    /* Default handlers */
-    switch (obj->object_id) {
-
-    case OF_PACKET_OUT:
-        ind_core_packet_outs++;
-        ind_core_packet_out_handler(obj, cxn);
-        break;
-
-    case OF_FLOW_ADD:
-        ind_core_flow_mods++;
-        ind_core_flow_add_handler(obj, cxn);
-        break;
-
-    case OF_FLOW_MODIFY:
-        ind_core_flow_mods++;
-        ind_core_flow_modify_handler(obj, cxn);
-        break;
-
-    case OF_FLOW_MODIFY_STRICT:
-        ind_core_flow_mods++;
-        ind_core_flow_modify_strict_handler(obj, cxn);
-        break;
-
-    case OF_FLOW_DELETE:
-        ind_core_flow_mods++;
-        ind_core_flow_delete_handler(obj, cxn);
-        break;
-
-    case OF_FLOW_DELETE_STRICT:
-        ind_core_flow_mods++;
-        ind_core_flow_delete_strict_handler(obj, cxn);
-        break;
-
-    case OF_PORT_STATS_REQUEST:
-        ind_core_port_stats_request_handler(obj, cxn);
-        break;
-
-    case OF_GET_CONFIG_REQUEST:
-        ind_core_get_config_request_handler(obj, cxn);
-        break;
-
-    case OF_SET_CONFIG:
-        ind_core_set_config_handler(obj, cxn);
-        break;
+    if (ind_core_bundle_stage(cxn, obj)) {
+        LOG_TRACE("Staged message in bundle");
+        return;
+    }
 
-    case OF_FLOW_STATS_REQUEST:
-        ind_core_flow_stats_request_handler(obj, cxn);
-        break;
+    ind_core_message_dispatch(cxn, obj);
+}
 
-    case OF_AGGREGATE_STATS_REQUEST:
-        ind_core_aggregate_stats_request_handler(obj, cxn);
-        break;
+void
+indigo_core_receive_controller_flush(void)
+{
+    ind_core_packet_out_flush();
+}
 
-    case OF_TABLE_STATS_REQUEST:
-        ind_core_table_stats_request_handler(obj, cxn);
-        break;
+/**
+ * Default message handlers, indexed by object id
+ *
+ * Message types without an entry get ind_core_unhandled_message.
+ * The counter, if set, is one of the debug statistics returned by
+ * indigo_core_stats_get.
+ */
 
-    case OF_DESC_STATS_REQUEST:
-        ind_core_desc_stats_request_handler(obj, cxn);
-        break;
+typedef void (*ind_core_message_handler_f)(of_object_t *obj,
+                                           indigo_cxn_id_t cxn);
+
+typedef struct ind_core_message_type_s {
+    ind_core_message_handler_f handler;
+    uint32_t *counter;
+} ind_core_message_type_t;
+
+static void ind_core_cxn_message_handler(of_object_t *obj,
+                                         indigo_cxn_id_t cxn);
+
+static const ind_core_message_type_t
+ind_core_message_types[OF_MESSAGE_OBJECT_COUNT] = {
+    [OF_PACKET_OUT] = { ind_core_packet_out_handler, &ind_core_packet_outs },
+    [OF_FLOW_ADD] = { ind_core_flow_add_handler, &ind_core_flow_mods },
+    [OF_FLOW_MODIFY] = { ind_core_flow_modify_handler, &ind_core_flow_mods },
+    [OF_FLOW_MODIFY_STRICT] = { ind_core_flow_modify_strict_handler,
+                                &ind_core_flow_mods },
+    [OF_FLOW_DELETE] = { ind_core_flow_delete_handler, &ind_core_flow_mods },
+    [OF_FLOW_DELETE_STRICT] = { ind_core_flow_delete_strict_handler,
+                                &ind_core_flow_mods },
+    [OF_PORT_STATS_REQUEST] = { ind_core_port_stats_request_handler },
+    [OF_GET_CONFIG_REQUEST] = { ind_core_get_config_request_handler },
+    [OF_SET_CONFIG] = { ind_core_set_config_handler },
+    [OF_FLOW_STATS_REQUEST] = { ind_core_flow_stats_request_handler },
+    [OF_AGGREGATE_STATS_REQUEST] = { ind_core_aggregate_stats_request_handler },
+    [OF_TABLE_STATS_REQUEST] = { ind_core_table_stats_request_handler },
+    [OF_TABLE_FEATURES_STATS_REQUEST] = {
+        ind_core_table_features_stats_request_handler },
+    [OF_DESC_STATS_REQUEST] = { ind_core_desc_stats_request_handler },
+    [OF_PORT_DESC_STATS_REQUEST] = { ind_core_port_desc_stats_request_handler },
+    [OF_FEATURES_REQUEST] = { ind_core_features_request_handler },
+    /* Includes the ONF bundle control and add messages */
+    [OF_EXPERIMENTER] = { ind_core_bundle_experimenter_handler },
+    [OF_PORT_MOD] = { ind_core_port_mod_handler },
+    [OF_QUEUE_GET_CONFIG_REQUEST] = {
+        ind_core_queue_get_config_request_handler },
+    [OF_QUEUE_STATS_REQUEST] = { ind_core_queue_stats_request_handler },
 
-    case OF_PORT_DESC_STATS_REQUEST:
-        ind_core_port_desc_stats_request_handler(obj, cxn);
-        break;
+    /****************************************************************
+     * Group messages
+     ****************************************************************/
 
-    case OF_FEATURES_REQUEST:
-        ind_core_features_request_handler(obj, cxn);
-        break;
+    [OF_GROUP_ADD] = { ind_core_group_add_handler },
+    [OF_GROUP_MODIFY] = { ind_core_group_modify_handler },
+    [OF_GROUP_DELETE] = { ind_core_group_delete_handler },
+    [OF_GROUP_STATS_REQUEST] = { ind_core_group_stats_request_handler },
+    [OF_GROUP_DESC_STATS_REQUEST] = {
+        ind_core_group_desc_stats_request_handler },
+    [OF_GROUP_FEATURES_STATS_REQUEST] = {
+        ind_core_group_features_stats_request_handler },
 
-    case OF_EXPERIMENTER:
-        ind_core_experimenter_handler(obj, cxn);
-        break;
+#ifdef OFDPA_FIXUP
+    /****************************************************************
+     * Meter messages
+     ****************************************************************/
 
-    case OF_PORT_MOD:
-        ind_core_port_mod_handler(obj, cxn);
-        break;
+    [OF_METER_ADD] = { ind_core_meter_add_handler },
+    [OF_METER_MODIFY] = { ind_core_meter_modify_handler },
+    [OF_METER_DELETE] = { ind_core_meter_delete_handler },
+    [OF_METER_STATS_REQUEST] = { ind_core_meter_stats_request_handler },
+    [OF_METER_CONFIG_STATS_REQUEST] = {
+        ind_core_meter_config_stats_request_handler },
 
-    case OF_QUEUE_GET_CONFIG_REQUEST:
-        ind_core_queue_get_config_request_handler(obj, cxn);
-        break;
+    [OF_EXPERIMENTER_STATS_REQUEST] = {
+        ind_core_experimenter_stats_request_handler },
 
-    case OF_QUEUE_STATS_REQUEST:
-        ind_core_queue_stats_request_handler(obj, cxn);
-        break;
+    /* OF-DPA experimenter messages LOCI has no class for */
+    [OF_EXPERIMENTER_OFDPA] = { ind_core_experimenter_handler },
+#endif
 
     /****************************************************************
-     * Group messages
+     * Gentable messages
      ****************************************************************/
 
-    case OF_GROUP_ADD:
-        ind_core_group_add_handler(obj, cxn);
-        break;
+    [OF_BSN_GENTABLE_ENTRY_ADD] = { ind_core_bsn_gentable_entry_add_handler },
+    [OF_BSN_GENTABLE_ENTRY_DELETE] = {
+        ind_core_bsn_gentable_entry_delete_handler },
+    [OF_BSN_GENTABLE_CLEAR_REQUEST] = {
+        ind_core_bsn_gentable_clear_request_handler },
+    [OF_BSN_GENTABLE_SET_BUCKETS_SIZE] = {
+        ind_core_bsn_gentable_set_buckets_size_handler },
+    [OF_BSN_GENTABLE_ENTRY_STATS_REQUEST] = {
+        ind_core_bsn_gentable_entry_stats_request_handler },
+    [OF_BSN_GENTABLE_ENTRY_DESC_STATS_REQUEST] = {
+        ind_core_bsn_gentable_entry_desc_stats_request_handler },
+    [OF_BSN_GENTABLE_DESC_STATS_REQUEST] = {
+        ind_core_bsn_gentable_desc_stats_request_handler },
+    [OF_BSN_GENTABLE_STATS_REQUEST] = {
+        ind_core_bsn_gentable_stats_request_handler },
+    [OF_BSN_GENTABLE_BUCKET_STATS_REQUEST] = {
+        ind_core_bsn_gentable_bucket_stats_request_handler },
 
-    case OF_GROUP_MODIFY:
-        ind_core_group_modify_handler(obj, cxn);
-        break;
-
-    case OF_GROUP_DELETE:
-        ind_core_group_delete_handler(obj, cxn);
-        break;
-
-    case OF_GROUP_STATS_REQUEST:
-        ind_core_group_stats_request_handler(obj, cxn);
-        break;
-
-    case OF_GROUP_DESC_STATS_REQUEST:
-        ind_core_group_desc_stats_request_handler(obj, cxn);
-        break;
+    /****************************************************************
+     * Extension messages
+     ****************************************************************/
 
-    case OF_GROUP_FEATURES_STATS_REQUEST:
-        ind_core_group_features_stats_request_handler(obj, cxn);
-        break;
+    [OF_BSN_SET_IP_MASK] = { ind_core_bsn_set_ip_mask_handler },
+    [OF_BSN_GET_IP_MASK_REQUEST] = { ind_core_bsn_get_ip_mask_request_handler },
+    [OF_BSN_HYBRID_GET_REQUEST] = { ind_core_bsn_hybrid_get_request_handler },
+    [OF_BSN_GET_SWITCH_PIPELINE_REQUEST] = {
+        ind_core_bsn_sw_pipeline_get_request_handler },
+    [OF_BSN_SET_SWITCH_PIPELINE_REQUEST] = {
+        ind_core_bsn_sw_pipeline_set_request_handler },
+    [OF_BSN_SWITCH_PIPELINE_STATS_REQUEST] = {
+        ind_core_bsn_sw_pipeline_stats_request_handler },
+    [OF_BSN_VLAN_COUNTER_STATS_REQUEST] = {
+        ind_core_bsn_vlan_counter_stats_request_handler },
+    [OF_BSN_PORT_COUNTER_STATS_REQUEST] = {
+        ind_core_bsn_port_counter_stats_request_handler },
+    [OF_BSN_DEBUG_COUNTER_DESC_STATS_REQUEST] = {
+        ind_core_bsn_debug_counter_desc_stats_request_handler },
+    [OF_BSN_DEBUG_COUNTER_STATS_REQUEST] = {
+        ind_core_bsn_debug_counter_stats_request_handler },
 
-#ifdef OFDPA_FIXUP
     /****************************************************************
-     * Meter messages
+     * Flow checksum messages
      ****************************************************************/
 
-    case OF_METER_ADD:
-        ind_core_meter_add_handler(obj, cxn);
-        break;
+    [OF_BSN_TABLE_CHECKSUM_STATS_REQUEST] = {
+        ind_core_bsn_table_checksum_stats_request_handler },
+    [OF_BSN_FLOW_CHECKSUM_BUCKET_STATS_REQUEST] = {
+        ind_core_bsn_flow_checksum_bucket_stats_request_handler },
+    [OF_BSN_TABLE_SET_BUCKETS_SIZE] = {
+        ind_core_bsn_table_set_buckets_size_handler },
 
-    case OF_METER_MODIFY:
-        ind_core_meter_modify_handler(obj, cxn);
-        break;
+    /* These all use the experimenter handler */
+    [OF_BSN_GET_MIRRORING_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_SET_MIRRORING] = { ind_core_experimenter_handler },
+    [OF_BSN_SHELL_COMMAND] = { ind_core_experimenter_handler },
+    [OF_BSN_GET_INTERFACES_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_SET_PKTIN_SUPPRESSION_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_SET_L2_TABLE_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_GET_L2_TABLE_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_VIRTUAL_PORT_CREATE_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_VIRTUAL_PORT_REMOVE_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_BW_CLEAR_DATA_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_BW_ENABLE_GET_REQUEST] = { ind_core_experimenter_handler },
+    [OF_BSN_BW_ENABLE_SET_REQUEST] = { ind_core_experimenter_handler },
 
-    case OF_METER_DELETE:
-        ind_core_meter_delete_handler(obj, cxn);
-        break;
+    /*
+     * Not yet implemented: OF_TABLE_MOD. Never handled by a switch: the
+     * replies and async messages. Both are left to the default.
+     */
 
-#endif
-    /****************************************************************
-     * Gentable messages
-     ****************************************************************/
+    /* These are implemented in OFConnectionManager */
+    [OF_HELLO] = { ind_core_cxn_message_handler },
+    [OF_ECHO_REQUEST] = { ind_core_cxn_message_handler },
+    [OF_ECHO_REPLY] = { ind_core_cxn_message_handler },
+    [OF_BARRIER_REQUEST] = { ind_core_cxn_message_handler },
+    [OF_NICIRA_CONTROLLER_ROLE_REQUEST] = { ind_core_cxn_message_handler },
+};
 
-    case OF_BSN_GENTABLE_ENTRY_ADD:
-        ind_core_bsn_gentable_entry_add_handler(obj, cxn);
-        break;
+/**
+ * Handler latency, per message type
+ *
+ * Bucket 0 counts handlers that took under 1 us; bucket n > 0 those
+ * that took [2^(n-1), 2^n) us. The last bucket takes everything longer.
+ */
 
-    case OF_BSN_GENTABLE_ENTRY_DELETE:
-        ind_core_bsn_gentable_entry_delete_handler(obj, cxn);
-        break;
+#define IND_CORE_MESSAGE_LATENCY_BUCKETS 20
 
-    case OF_BSN_GENTABLE_CLEAR_REQUEST:
-        ind_core_bsn_gentable_clear_request_handler(obj, cxn);
-        break;
+typedef struct ind_core_message_stats_s {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t latency[IND_CORE_MESSAGE_LATENCY_BUCKETS];
+} ind_core_message_stats_t;
 
-    case OF_BSN_GENTABLE_SET_BUCKETS_SIZE:
-        ind_core_bsn_gentable_set_buckets_size_handler(obj, cxn);
-        break;
+static ind_core_message_stats_t ind_core_message_stats[OF_MESSAGE_OBJECT_COUNT];
 
-    case OF_BSN_GENTABLE_ENTRY_STATS_REQUEST:
-        ind_core_bsn_gentable_entry_stats_request_handler(obj, cxn);
-        break;
+static void
+ind_core_cxn_message_handler(of_object_t *obj, indigo_cxn_id_t cxn)
+{
+    LOG_ERROR("Expected OFConnectionManager to handle %s",
+              of_object_id_str[obj->object_id]);
+    ind_core_unhandled_message(obj, cxn);
+}
 
-    case OF_BSN_GENTABLE_ENTRY_DESC_STATS_REQUEST:
-        ind_core_bsn_gentable_entry_desc_stats_request_handler(obj, cxn);
-        break;
+static void
+ind_core_message_latency_record(of_object_id_t object_id, uint64_t elapsed_ns)
+{
+    ind_core_message_stats_t *stats = &ind_core_message_stats[object_id];
+    uint64_t us = elapsed_ns / 1000;
+    int bucket = 0;
 
-    case OF_BSN_GENTABLE_DESC_STATS_REQUEST:
-        ind_core_bsn_gentable_desc_stats_request_handler(obj, cxn);
-        break;
+    while (us != 0 && bucket < IND_CORE_MESSAGE_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
 
-    case OF_BSN_GENTABLE_STATS_REQUEST:
-        ind_core_bsn_gentable_stats_request_handler(obj, cxn);
-        break;
+    stats->count++;
+    stats->total_ns += elapsed_ns;
+    if (elapsed_ns > stats->max_ns) {
+        stats->max_ns = elapsed_ns;
+    }
+    stats->latency[bucket]++;
+}
 
-    case OF_BSN_GENTABLE_BUCKET_STATS_REQUEST:
-        ind_core_bsn_gentable_bucket_stats_request_handler(obj, cxn);
-        break;
+/**
+ * @brief Run the default handler for an OF message
+ * @param cxn The connection id from which the request came
+ * @param obj The generic LOXI object holding the message
+ *
+ * Used for received messages and for those applied from a bundle.
+ */
 
-    /****************************************************************
-     * Extension messages
-     ****************************************************************/
+void
+ind_core_message_dispatch(indigo_cxn_id_t cxn, of_object_t *obj)
+{
+    const ind_core_message_type_t *type;
+    uint64_t start, elapsed;
 
-    case OF_BSN_SET_IP_MASK:
-        ind_core_bsn_set_ip_mask_handler(obj, cxn);
-        break;
+    /* Anything other than another flow add must see the batched flows */
+    if (obj->object_id != OF_FLOW_ADD) {
+        ind_core_flow_add_flush();
+    }
 
-    case OF_BSN_GET_IP_MASK_REQUEST:
-        ind_core_bsn_get_ip_mask_request_handler(obj, cxn);
-        break;
+    /* Packet-outs are sent in order with everything else */
+    if (obj->object_id != OF_PACKET_OUT) {
+        ind_core_packet_out_flush();
+    }
 
-    case OF_BSN_HYBRID_GET_REQUEST:
-        ind_core_bsn_hybrid_get_request_handler(obj, cxn);
-        break;
+    if (obj->object_id < 0 || obj->object_id >= OF_MESSAGE_OBJECT_COUNT ||
+        ind_core_message_types[obj->object_id].handler == NULL) {
+        ind_core_unhandled_message(obj, cxn);
+        return;
+    }
 
-    case OF_BSN_GET_SWITCH_PIPELINE_REQUEST:
-        ind_core_bsn_sw_pipeline_get_request_handler(obj, cxn);
-        break;
+    type = &ind_core_message_types[obj->object_id];
+    if (type->counter != NULL) {
+        (*type->counter)++;
+    }
 
-    case OF_BSN_SET_SWITCH_PIPELINE_REQUEST:
-        ind_core_bsn_sw_pipeline_set_request_handler(obj, cxn);
-        break;
+    IND_SOC_RECORD(IND_SOC_RECORD_HANDLER_START, cxn,
+                   (uintptr_t)of_object_id_str[obj->object_id], 0);
+    start = aim_trace_now();
+    type->handler(obj, cxn);
+    elapsed = aim_trace_now() - start;
+    ind_core_message_latency_record(obj->object_id, elapsed);
+    IND_SOC_RECORD(IND_SOC_RECORD_HANDLER_END, cxn,
+                   (uintptr_t)of_object_id_str[obj->object_id], elapsed / 1000);
+}
 
-    case OF_BSN_SWITCH_PIPELINE_STATS_REQUEST:
-        ind_core_bsn_sw_pipeline_stats_request_handler(obj, cxn);
-        break;
+/**
+ * Show the handler latency of each message type seen so far,
+ * costliest in total first
+ */
 
-    case OF_BSN_VLAN_COUNTER_STATS_REQUEST:
-        ind_core_bsn_vlan_counter_stats_request_handler(obj, cxn);
-        break;
+void
+ind_core_message_stats_show(aim_pvs_t *pvs)
+{
+    int order[OF_MESSAGE_OBJECT_COUNT];
+    int count = 0;
+    int i, j, bucket;
 
-    case OF_BSN_PORT_COUNTER_STATS_REQUEST:
-        ind_core_bsn_port_counter_stats_request_handler(obj, cxn);
-        break;
+    for (i = 0; i < OF_MESSAGE_OBJECT_COUNT; i++) {
+        if (ind_core_message_stats[i].count == 0) {
+            continue;
+        }
+        for (j = count; j > 0 && ind_core_message_stats[order[j - 1]].total_ns <
+                 ind_core_message_stats[i].total_ns; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+        count++;
+    }
 
-    /* These all use the experimenter handler */
-    case OF_BSN_GET_MIRRORING_REQUEST:
-    case OF_BSN_SET_MIRRORING:
-    case OF_BSN_SHELL_COMMAND:
-    case OF_BSN_GET_INTERFACES_REQUEST:
-    case OF_BSN_SET_PKTIN_SUPPRESSION_REQUEST:
-    case OF_BSN_SET_L2_TABLE_REQUEST:
-    case OF_BSN_GET_L2_TABLE_REQUEST:
-    case OF_BSN_VIRTUAL_PORT_CREATE_REQUEST:
-    case OF_BSN_VIRTUAL_PORT_REMOVE_REQUEST:
-    case OF_BSN_BW_CLEAR_DATA_REQUEST:
-    case OF_BSN_BW_ENABLE_GET_REQUEST:
-    case OF_BSN_BW_ENABLE_SET_REQUEST:
-        ind_core_experimenter_handler(obj, cxn);
-        break;
+    aim_printf(pvs, "Message handler latency:\n");
+    for (i = 0; i < count; i++) {
+        ind_core_message_stats_t *stats = &ind_core_message_stats[order[i]];
+        aim_printf(pvs, "  %s: %"PRIu64" handled, total %"PRIu64" us, "
+                   "avg %"PRIu64" us, max %"PRIu64" us\n",
+                   of_object_id_str[order[i]], stats->count,
+                   stats->total_ns / 1000,
+                   stats->total_ns / 1000 / stats->count,
+                   stats->max_ns / 1000);
+        aim_printf(pvs, "   ");
+        for (bucket = 0; bucket < IND_CORE_MESSAGE_LATENCY_BUCKETS; bucket++) {
+            if (stats->latency[bucket] == 0) {
+                continue;
+            }
+            if (bucket == 0) {
+                aim_printf(pvs, " <1us:%"PRIu64, stats->latency[bucket]);
+            } else {
+                aim_printf(pvs, " %s%uus:%"PRIu64,
+                           bucket == IND_CORE_MESSAGE_LATENCY_BUCKETS - 1 ?
+                           ">=" : "<",
+                           bucket == IND_CORE_MESSAGE_LATENCY_BUCKETS - 1 ?
+                           1u << (bucket - 1) : 1u << bucket,
+                           stats->latency[bucket]);
+            }
+        }
+        aim_printf(pvs, "\n");
+    }
+}
 
-    /****************************************************************
-     * These are not yet implemented
-     ****************************************************************/
-    case OF_TABLE_MOD:
-      ind_core_unhandled_message(obj, cxn);
-      break;
-    case OF_EXPERIMENTER_STATS_REQUEST:
-    #ifdef OFDPA_FIXUP
-      ind_core_experimenter_stats_request_handler(obj, cxn);
-    #else
-      ind_core_unhandled_message(obj, cxn);
-    #endif
-      break;
+/* One OpenMetrics counter or gauge without labels */
+static void
+ind_core_metric_write(aim_pvs_t *pvs, const char *name, const char *type,
+                      const char *help, uint64_t value)
+{
+    aim_printf(pvs, "# TYPE %s %s\n# HELP %s %s\n%s%s %"PRIu64"\n",
+               name, type, name, help, name,
+               strcmp(type, "counter") == 0 ? "_total" : "", value);
+}
 
-    /****************************************************************
-     * These will never be handled by a switch
-     ****************************************************************/
-    case OF_AGGREGATE_STATS_REPLY:
-    case OF_BARRIER_REPLY:
-    case OF_DESC_STATS_REPLY:
-    case OF_ERROR_MSG:
-    case OF_EXPERIMENTER_STATS_REPLY:
-    case OF_FEATURES_REPLY:
-    case OF_FLOW_REMOVED:
-    case OF_FLOW_STATS_REPLY:
-    case OF_GET_CONFIG_REPLY:
-    case OF_GROUP_DESC_STATS_REPLY:
-    case OF_GROUP_FEATURES_STATS_REPLY:
-    case OF_GROUP_STATS_REPLY:
-    case OF_PACKET_IN:
-    case OF_PORT_STATS_REPLY:
-    case OF_PORT_STATUS:
-    case OF_QUEUE_GET_CONFIG_REPLY:
-    case OF_QUEUE_STATS_REPLY:
-    case OF_ROLE_REPLY:
-    case OF_TABLE_STATS_REPLY:
-        ind_core_unhandled_message(obj, cxn);
-        break;
+void
+ind_core_metrics_write(aim_pvs_t *pvs)
+{
+    ft_status_t ft_status;
+    ft_status_t *status = NULL;
+    indigo_mem_stats_t mem;
+    uint64_t cumulative;
+    int i, bucket, tag;
+
+    if (ind_core_ft != NULL) {
+        ft_shards_status_get(ind_core_ft, &ft_status);
+        status = &ft_status;
+    }
 
-    /* These are implemented in OFConnectionManager */
-    case OF_HELLO:
-    case OF_ECHO_REQUEST:
-    case OF_ECHO_REPLY:
-    case OF_BARRIER_REQUEST:
-    case OF_NICIRA_CONTROLLER_ROLE_REQUEST:
-        LOG_ERROR("Expected OFConnectionManager to handle %s",
-                  of_object_id_str[obj->object_id]);
-        ind_core_unhandled_message(obj, cxn);
-        break;
+    ind_core_metric_write(pvs, "indigo_flow_mods", "counter",
+                          "Flow mod messages received.", ind_core_flow_mods);
+    ind_core_metric_write(pvs, "indigo_packet_ins", "counter",
+                          "Packet-ins received from forwarding.", ind_core_packet_ins);
+    ind_core_metric_write(pvs, "indigo_packet_outs", "counter",
+                          "Packet-out messages received.", ind_core_packet_outs);
+
+    if (status != NULL) {
+        ind_core_metric_write(pvs, "indigo_flows", "gauge",
+                              "Flows in the flow table.", status->current_count);
+        ind_core_metric_write(pvs, "indigo_flow_adds", "counter",
+                              "Flows added.", status->adds);
+        ind_core_metric_write(pvs, "indigo_flow_deletes", "counter",
+                              "Flows deleted.", status->deletes);
+        ind_core_metric_write(pvs, "indigo_flow_hard_expires", "counter",
+                              "Flows removed by hard timeout.", status->hard_expires);
+        ind_core_metric_write(pvs, "indigo_flow_idle_expires", "counter",
+                              "Flows removed by idle timeout.", status->idle_expires);
+        ind_core_metric_write(pvs, "indigo_flow_updates", "counter",
+                              "Flows modified.", status->updates);
+        ind_core_metric_write(pvs, "indigo_flow_overwrites", "counter",
+                              "Flows replaced in place by an add.", status->overwrites);
+        ind_core_metric_write(pvs, "indigo_flow_table_full_errors", "counter",
+                              "Flow adds rejected as table full.", status->table_full_errors);
+        ind_core_metric_write(pvs, "indigo_flow_forwarding_add_errors", "counter",
+                              "Flow adds failed by forwarding.", status->forwarding_add_errors);
+        ind_core_metric_write(pvs, "indigo_flow_index_resizes", "counter",
+                              "Flow table index resizes.", status->index_resizes);
+    }
 
-    default:
-        ind_core_unhandled_message(obj, cxn);
-        break;
+    aim_printf(pvs, "# TYPE indigo_message_handler_seconds histogram\n"
+               "# HELP indigo_message_handler_seconds Handler time per message type.\n");
+    for (i = 0; i < OF_MESSAGE_OBJECT_COUNT; i++) {
+        ind_core_message_stats_t *stats = &ind_core_message_stats[i];
+        if (stats->count == 0) {
+            continue;
+        }
+        cumulative = 0;
+        for (bucket = 0; bucket < IND_CORE_MESSAGE_LATENCY_BUCKETS - 1; bucket++) {
+            cumulative += stats->latency[bucket];
+            aim_printf(pvs, "indigo_message_handler_seconds_bucket{type=\"%s\",le=\"%.6f\"} %"PRIu64"\n",
+                       of_object_id_str[i], (1u << bucket) / 1e6, cumulative);
+        }
+        aim_printf(pvs, "indigo_message_handler_seconds_bucket{type=\"%s\",le=\"+Inf\"} %"PRIu64"\n"
+                   "indigo_message_handler_seconds_sum{type=\"%s\"} %.9f\n"
+                   "indigo_message_handler_seconds_count{type=\"%s\"} %"PRIu64"\n",
+                   of_object_id_str[i], stats->count,
+                   of_object_id_str[i], stats->total_ns / 1e9,
+                   of_object_id_str[i], stats->count);
+    }
+
+    aim_printf(pvs, "# TYPE indigo_memory_live_bytes gauge\n"
+               "# HELP indigo_memory_live_bytes Bytes held per accounting tag.\n");
+    for (tag = 0; tag < INDIGO_MEM_TAG_COUNT; tag++) {
+        indigo_mem_stats_get(tag, &mem);
+        aim_printf(pvs, "indigo_memory_live_bytes{tag=\"%s\"} %"PRIu64"\n",
+                   indigo_mem_tag_name(tag), mem.live_bytes);
+    }
+    aim_printf(pvs, "# TYPE indigo_memory_peak_bytes gauge\n"
+               "# HELP indigo_memory_peak_bytes High watermark of held bytes per accounting tag.\n");
+    for (tag = 0; tag < INDIGO_MEM_TAG_COUNT; tag++) {
+        indigo_mem_stats_get(tag, &mem);
+        aim_printf(pvs, "indigo_memory_peak_bytes{tag=\"%s\"} %"PRIu64"\n",
+                   indigo_mem_tag_name(tag), mem.peak_bytes);
+    }
+    aim_printf(pvs, "# TYPE indigo_memory_limit_hits counter\n"
+               "# HELP indigo_memory_limit_hits Degradations caused by a memory soft limit.\n");
+    for (tag = 0; tag < INDIGO_MEM_TAG_COUNT; tag++) {
+        indigo_mem_stats_get(tag, &mem);
+        aim_printf(pvs, "indigo_memory_limit_hits_total{tag=\"%s\"} %"PRIu64"\n",
+                   indigo_mem_tag_name(tag), mem.limit_hits);
     }
 }
 
@@ -513,6 +692,7 @@ indigo_core_dpid_set(of_dpid_t dpid)
     if (ind_core_dpid != dpid) {
         LOG_INFO("Changing switch DPID to %016llx", dpid);
         INDIGO_MEM_COPY(&ind_core_dpid, &dpid, sizeof(ind_core_dpid));
+        ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_FEATURES);
         ind_cxn_reset(IND_CXN_RESET_ALL);
     } else {
         LOG_VERBOSE("Switch DPID set called but unchanged");
@@ -569,20 +749,33 @@ ind_core_init(ind_core_config_t *config)
     }
     ft_config.strict_match_bucket_count = config->max_flowtable_entries;
     ft_config.flow_id_bucket_count = config->max_flowtable_entries;
-
-    if ((ind_core_ft = ft_create(&ft_config)) == NULL) {
+    ft_config.cookie_index_shift = config->cookie_index_shift;
+    ft_config.cookie_index_bits = config->cookie_index_bits;
+    ft_config.content_checksums = config->content_checksums;
+    ft_config.lpm_table_id = config->lpm_table_id;
+    ft_config.l2_table_id = config->l2_table_id;
+
+    if ((ind_core_ft = ft_shards_create(&ft_config,
+            OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS)) == NULL) {
         LOG_ERROR("Unable to allocate flow table");
         return INDIGO_ERROR_RESOURCE;
     }
 
     ind_core_connection_count = 0;
 
+    if (ind_core_workers_init(config->stats_threads) != INDIGO_ERROR_NONE) {
+        LOG_ERROR("Unable to start stats threads, encoding stats on the event loop");
+    }
+
     ind_core_group_init();
 #ifdef OFDPA_FIXUP
     ind_core_meter_init();
 #endif
+    ind_core_bundle_init();
+    ind_core_flow_stats_init();
 
     ind_core_test_gentable_init();
+    ind_core_memory_gentable_init();
 
     ind_core_init_done = 1;
 
@@ -630,6 +823,157 @@ ind_core_flow_entry_delete(ft_entry_t *entry, indigo_fi_flow_removed_t reason)
     process_flow_removal(entry, &flow_stats, reason);
 }
 
+/*
+ * Delete or read the counters of a set of flow entries with one call per
+ * table: a batch call into forwarding for the flows it holds, the batch
+ * operation of a registered table if it has one, and otherwise the
+ * per-entry operation. 'flow_stats' must be set up by the caller.
+ */
+static void
+flow_entries_call(ft_entry_t **entries, int count, bool delete,
+                  indigo_fi_flow_stats_t *flow_stats, indigo_error_t *results)
+{
+    int *idx = aim_malloc(count * sizeof(*idx));
+    bool *done = aim_zmalloc(count * sizeof(*done));
+    indigo_cookie_t *flow_ids = aim_malloc(count * sizeof(*flow_ids));
+    void **privs = aim_malloc(count * sizeof(*privs));
+    indigo_fi_flow_stats_t *stats = aim_malloc(count * sizeof(*stats));
+    indigo_error_t *rvs = aim_malloc(count * sizeof(*rvs));
+    const indigo_core_table_ops_t *ops;
+    ind_core_table_t *table;
+    indigo_error_t rv;
+    int first, i, n;
+
+    for (first = 0; first < count; first++) {
+        if (done[first]) {
+            continue;
+        }
+
+        table = ind_core_table_get(entries[first]->table_id);
+        n = 0;
+        for (i = first; i < count; i++) {
+            if (!done[i] && ind_core_table_get(entries[i]->table_id) == table) {
+                done[i] = true;
+                idx[n] = i;
+                flow_ids[n] = entries[i]->id;
+                privs[n] = entries[i]->priv;
+                stats[n] = flow_stats[i];
+                n++;
+            }
+        }
+
+        rv = INDIGO_ERROR_NONE;
+        if (table == NULL) {
+            if (delete) {
+                rv = indigo_fwd_flow_delete_batch(n, flow_ids, stats, rvs);
+            } else {
+                for (i = 0; i < n; i++) {
+                    rvs[i] = indigo_fwd_flow_stats_get(flow_ids[i], &stats[i]);
+                }
+            }
+        } else {
+            ops = table->ops;
+            if (delete && ops->entry_delete_batch != NULL) {
+                rv = ops->entry_delete_batch(table->priv, n, privs, stats, rvs);
+            } else if (!delete && ops->entry_stats_get_batch != NULL) {
+                rv = ops->entry_stats_get_batch(table->priv, n, privs, stats, rvs);
+            } else {
+                for (i = 0; i < n; i++) {
+                    rvs[i] = delete ?
+                        ops->entry_delete(table->priv, privs[i], &stats[i]) :
+                        ops->entry_stats_get(table->priv, privs[i], &stats[i]);
+                }
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            flow_stats[idx[i]] = stats[i];
+            results[idx[i]] = (rv == INDIGO_ERROR_NONE) ? rvs[i] : rv;
+        }
+    }
+
+    aim_free(idx);
+    aim_free(done);
+    aim_free(flow_ids);
+    aim_free(privs);
+    aim_free(stats);
+    aim_free(rvs);
+}
+
+/**
+ * @brief Delete a set of flow entries with one call per table
+ *
+ * Same as ind_core_flow_entry_delete for each entry.
+ */
+
+void
+ind_core_flow_entry_delete_batch(ft_entry_t **entries, int count,
+                                 indigo_fi_flow_removed_t reason)
+{
+    indigo_fi_flow_stats_t *flow_stats;
+    indigo_error_t *results;
+    int i;
+
+    if (count == 0) {
+        return;
+    }
+
+    flow_stats = aim_malloc(count * sizeof(*flow_stats));
+    results = aim_malloc(count * sizeof(*results));
+
+    for (i = 0; i < count; i++) {
+        flow_stats[i].flow_id = entries[i]->id;
+        flow_stats[i].duration_ns = 0;
+        flow_stats[i].packets = -1;
+        flow_stats[i].bytes = -1;
+    }
+
+    LOG_TRACE("Removing %d flows", count);
+
+    flow_entries_call(entries, count, true, flow_stats, results);
+
+    for (i = 0; i < count; i++) {
+        if (results[i] != INDIGO_ERROR_NONE) {
+            LOG_ERROR("Error deleting flow " INDIGO_FLOW_ID_PRINTF_FORMAT ": %s",
+                      INDIGO_FLOW_ID_PRINTF_ARG(entries[i]->id),
+                      indigo_strerror(results[i]));
+            /* Ignoring failure */
+        }
+        process_flow_removal(entries[i], &flow_stats[i], reason);
+    }
+
+    aim_free(flow_stats);
+    aim_free(results);
+}
+
+/**
+ * @brief Read the counters of a set of flow entries with one call per table
+ *
+ * Same as calling entry_stats_get or indigo_fwd_flow_stats_get for each
+ * entry. Sets up 'flow_stats' first.
+ */
+
+void
+ind_core_flow_entry_stats_get_batch(ft_entry_t **entries, int count,
+                                    indigo_fi_flow_stats_t *flow_stats,
+                                    indigo_error_t *results)
+{
+    int i;
+
+    if (count == 0) {
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        flow_stats[i].flow_id = entries[i]->id;
+        flow_stats[i].duration_ns = 0;
+        flow_stats[i].packets = -1;
+        flow_stats[i].bytes = -1;
+    }
+
+    flow_entries_call(entries, count, false, flow_stats, results);
+}
+
 /**
  * @brief Process a flow removal from the local flow table
  */
@@ -639,6 +983,14 @@ process_flow_removal(ft_entry_t *entry,
                      indigo_fi_flow_stats_t *final_stats,
                      indigo_fi_flow_removed_t reason)
 {
+    ind_core_table_full_clear();
+
+    if (reason == INDIGO_FLOW_REMOVED_HARD_TIMEOUT) {
+        ind_core_ft->status.hard_expires += 1;
+    } else if (reason == INDIGO_FLOW_REMOVED_IDLE_TIMEOUT) {
+        ind_core_ft->status.idle_expires += 1;
+    }
+
     if (entry->flags & OF_FLOW_MOD_FLAG_SEND_FLOW_REM) {
         /* See OF spec 1.0.1, section 3.5, page 6 */
         if (reason != INDIGO_FLOW_REMOVED_OVERWRITE) {
@@ -646,10 +998,10 @@ process_flow_removal(ft_entry_t *entry,
         }
     }
 
-    ft_delete(ind_core_ft, entry);
+    ft_shards_delete(ind_core_ft, entry);
 
     LOG_TRACE("Flow table now has %d entries",
-              FT_STATUS(ind_core_ft)->current_count);
+              ft_shards_current_count(ind_core_ft));
 }
 
 /**
@@ -674,7 +1026,7 @@ indigo_core_flow_removed(indigo_fi_flow_removed_t reason,
               INDIGO_FLOW_ID_PRINTF_ARG((indigo_cookie_t) stats->flow_id));
 
     /* After entry look up, this looks like ind_core_flow_entry_delete */
-    entry = ft_lookup(ind_core_ft, stats->flow_id);
+    entry = ft_shards_lookup(ind_core_ft, stats->flow_id);
     if (entry == NULL) {
         LOG_TRACE("Async flow removed: did not find entry in SM table. id "
                   INDIGO_FLOW_ID_PRINTF_FORMAT,
@@ -685,8 +1037,35 @@ indigo_core_flow_removed(indigo_fi_flow_removed_t reason,
     process_flow_removal(entry, stats, reason);
 }
 
+void
+indigo_core_flow_removed_batch(int count,
+                               indigo_fi_flow_removed_t *reasons,
+                               indigo_fi_flow_stats_t *stats)
+{
+    ft_entry_t *entry;
+    int i;
+
+    if (!ind_core_init_done) {
+        return;
+    }
+
+    LOG_TRACE("Async flow removed batch of %d flows", count);
+
+    for (i = 0; i < count; i++) {
+        entry = ft_shards_lookup(ind_core_ft, stats[i].flow_id);
+        if (entry == NULL) {
+            LOG_TRACE("Async flow removed: did not find entry in SM table. id "
+                      INDIGO_FLOW_ID_PRINTF_FORMAT,
+                      INDIGO_FLOW_ID_PRINTF_ARG((indigo_cookie_t) stats[i].flow_id));
+            continue;
+        }
+        process_flow_removal(entry, &stats[i], reasons[i]);
+    }
+}
+
 #define CORE_EXPIRES_FLOWS(_cfg) \
-    ((_cfg)->expire_flows && ((_cfg)->stats_check_ms > 0))
+    ((_cfg)->expire_flows && ((_cfg)->stats_check_ms > 0) && \
+     !(_cfg)->hardware_expiry)
 
 indigo_error_t
 ind_core_enable_set(int enable)
@@ -742,9 +1121,17 @@ ind_core_finish(void)
         ind_core_enable_set(0);
     }
 
-    ft_destroy(ind_core_ft);
+    ind_core_bundle_finish();
+    ind_core_flow_stats_finish();
+    ind_core_flow_add_flush();
+    ind_core_flow_mod_error_flush();
+    ind_core_packet_out_flush();
+    ft_shards_destroy(ind_core_ft);
+    ind_core_workers_finish();
+    ind_core_reply_cache_finish();
 
     ind_core_test_gentable_finish();
+    ind_core_memory_gentable_finish();
 
     ind_core_init_done = 0;
 
@@ -761,6 +1148,7 @@ ind_core_sw_desc_set(of_desc_str_t desc)
 
     INDIGO_MEM_COPY(ind_core_of_config.desc_stats.sw_desc,
                     desc, OF_DESC_STR_LEN);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_DESC);
 
     return INDIGO_ERROR_NONE;
 }
@@ -790,6 +1178,7 @@ ind_core_hw_desc_set(of_desc_str_t desc)
 
     INDIGO_MEM_COPY(ind_core_of_config.desc_stats.hw_desc,
                     desc, OF_DESC_STR_LEN);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_DESC);
 
     return INDIGO_ERROR_NONE;
 }
@@ -819,6 +1208,7 @@ ind_core_dp_desc_set(of_desc_str_t desc)
 
     INDIGO_MEM_COPY(ind_core_of_config.desc_stats.dp_desc,
                     desc, OF_DESC_STR_LEN);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_DESC);
 
     return INDIGO_ERROR_NONE;
 }
@@ -848,6 +1238,7 @@ ind_core_mfr_desc_set(of_desc_str_t desc)
 
     INDIGO_MEM_COPY(ind_core_of_config.desc_stats.mfr_desc,
                     desc, OF_DESC_STR_LEN);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_DESC);
 
     return INDIGO_ERROR_NONE;
 }
@@ -877,6 +1268,7 @@ ind_core_serial_num_set(of_serial_num_t serial_num)
 
     INDIGO_MEM_COPY(ind_core_of_config.desc_stats.serial_num,
                     serial_num, OF_SERIAL_NUM_LEN);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_DESC);
 
     return INDIGO_ERROR_NONE;
 }
@@ -911,6 +1303,7 @@ indigo_core_disconnected_mode_set(indigo_core_disconnected_mode_t mode)
     switch (mode) {
     case INDIGO_CORE_DISCONNECTED_MODE_STICKY:
     case INDIGO_CORE_DISCONNECTED_MODE_CLOSED:
+    case INDIGO_CORE_DISCONNECTED_MODE_RECONCILE:
         break;
     default:
         LOG_ERROR("Bad disconnect mode set; %d", mode);
@@ -959,13 +1352,21 @@ indigo_core_connection_count_notify(int new_count)
 
     if (new_count == 0) {
         if (ind_core_config.disconnected_mode ==
-                INDIGO_CORE_DISCONNECTED_MODE_STICKY) {
+                INDIGO_CORE_DISCONNECTED_MODE_STICKY ||
+            ind_core_config.disconnected_mode ==
+                INDIGO_CORE_DISCONNECTED_MODE_RECONCILE) {
             /* Notify forwarding of change in behavior */
             indigo_fwd_expiration_enable_set(0);
         }
+        if (ind_core_config.disconnected_mode ==
+                INDIGO_CORE_DISCONNECTED_MODE_RECONCILE) {
+            ind_core_warm_disconnect_mark();
+        }
     } else {
         indigo_fwd_expiration_enable_set(1);
     }
+
+    ind_core_warm_connection_notify(new_count);
 }
 
 
@@ -978,6 +1379,10 @@ indigo_core_port_status_update(of_port_status_t *of_port_status)
 
     LOG_TRACE("OF state mgr port status update");
 
+    /* Features replies list the ports before OpenFlow 1.3 */
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_FEATURES);
+    ind_core_reply_cache_invalidate(IND_CORE_REPLY_CACHE_PORT_DESC);
+
     if (ind_core_port_status_notify(of_port_status) == INDIGO_CORE_LISTENER_RESULT_DROP) {
         LOG_TRACE("Listener dropped port status update");
         of_object_delete(of_port_status);
@@ -987,92 +1392,257 @@ indigo_core_port_status_update(of_port_status_t *of_port_status)
     indigo_cxn_send_async_message(of_port_status);
 }
 
+static void
+ft_entry_dump(aim_pvs_t *pvs, ft_entry_t *entry)
+{
+    of_match_t match;
+
+    ft_entry_match_get(entry, &match);
+    aim_printf(pvs, "Flow %d:\n", entry->id);
+    loci_dump_match((loci_writer_f)aim_printf, pvs, &match);
+    aim_printf(pvs, "cookie: 0x%016"PRIx64"\n", entry->cookie);
+    aim_printf(pvs, "checksum: 0x%016"PRIx64"\n", entry->checksum);
+    aim_printf(pvs, "idle_timeout: %hu\n", entry->idle_timeout);
+    aim_printf(pvs, "hard_timeout: %hu\n", entry->hard_timeout);
+    aim_printf(pvs, "priority: %hu\n", entry->priority);
+    aim_printf(pvs, "flags: %hu\n", entry->flags);
+    aim_printf(pvs, "table_id: %hhu\n", entry->table_id);
+
+    if (match.version == OF_VERSION_1_0) {
+        int rv;
+        of_action_t elt;
+        OF_LIST_ACTION_ITER(entry->effects.actions, &elt, rv) {
+            of_object_dump((loci_writer_f)aim_printf, pvs, &elt.header);
+        }
+    } else {
+        int rv;
+        of_instruction_t inst;
+        OF_LIST_INSTRUCTION_ITER(entry->effects.instructions, &inst, rv) {
+            of_object_dump((loci_writer_f)aim_printf, pvs, &inst.header);
+        }
+    }
+
+    aim_printf(pvs, "\n");
+}
+
+static void
+ft_entry_show(aim_pvs_t *pvs, ft_entry_t *entry)
+{
+    of_match_t match;
+
+    ft_entry_match_get(entry, &match);
+    aim_printf(pvs, "Flow %d: ", entry->id);
+    loci_show_match((loci_writer_f)aim_printf, pvs, &match);
+    aim_printf(pvs, "cookie=0x%016"PRIx64" ", entry->cookie);
+    aim_printf(pvs, "priority=%hu ", entry->priority);
+    aim_printf(pvs, "table_id=%hhu ", entry->table_id);
+
+    if (match.version == OF_VERSION_1_0) {
+        int rv;
+        of_action_t elt;
+        OF_LIST_ACTION_ITER(entry->effects.actions, &elt, rv) {
+            aim_printf(pvs, "%s(", of_object_id_str[elt.header.object_id]);
+            of_object_show((loci_writer_f)aim_printf, pvs, &elt.header);
+            aim_printf(pvs, ") ");
+        }
+    } else {
+        int rv;
+        of_instruction_t inst;
+        OF_LIST_INSTRUCTION_ITER(entry->effects.instructions, &inst, rv) {
+            aim_printf(pvs, "%s(", of_object_id_str[inst.header.object_id]);
+            of_object_show((loci_writer_f)aim_printf, pvs, &inst.header);
+            aim_printf(pvs, ") ");
+        }
+    }
+
+    aim_printf(pvs, "\n");
+}
+
+/* Fixed columns and the match; the effects are left out */
+static void
+ft_entry_compact(aim_pvs_t *pvs, ft_entry_t *entry)
+{
+    of_match_t match;
+
+    ft_entry_match_get(entry, &match);
+    aim_pvs_u64(pvs, entry->id);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_u64(pvs, entry->table_id);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_u64(pvs, entry->priority);
+    aim_pvs_puts(pvs, " 0x");
+    aim_pvs_printf(pvs, "%"PRIx64, entry->cookie);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_u64(pvs, entry->idle_timeout);
+    aim_pvs_puts(pvs, "/");
+    aim_pvs_u64(pvs, entry->hard_timeout);
+    aim_pvs_puts(pvs, entry->stale ? " stale " : " ");
+    loci_show_match((loci_writer_f)aim_printf, pvs, &match);
+    aim_pvs_puts(pvs, "\n");
+}
+
+static void
+ft_entry_format(aim_pvs_t *pvs, ind_core_ft_dump_format_t format,
+                ft_entry_t *entry)
+{
+    switch (format) {
+    case IND_CORE_FT_DUMP_VERBOSE:
+        ft_entry_dump(pvs, entry);
+        break;
+    case IND_CORE_FT_DUMP_SHOW:
+        ft_entry_show(pvs, entry);
+        break;
+    default:
+        ft_entry_compact(pvs, entry);
+        break;
+    }
+}
+
 void
 ind_core_ft_dump(aim_pvs_t* pvs)
 {
+    ft_instance_t ft;
     ft_entry_t *entry;
     list_links_t *cur, *next;
+    aim_pvs_t *out = aim_pvs_chunked_create(pvs, 0);
+    int i;
 
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        aim_printf(pvs, "Flow %d:\n", entry->id);
-        loci_dump_match((loci_writer_f)aim_printf, pvs, &entry->match);
-        aim_printf(pvs, "cookie: 0x%016"PRIx64"\n", entry->cookie);
-        aim_printf(pvs, "idle_timeout: %hu\n", entry->idle_timeout);
-        aim_printf(pvs, "hard_timeout: %hu\n", entry->hard_timeout);
-        aim_printf(pvs, "priority: %hu\n", entry->priority);
-        aim_printf(pvs, "flags: %hu\n", entry->flags);
-        aim_printf(pvs, "table_id: %hhu\n", entry->table_id);
-
-        if (entry->match.version == OF_VERSION_1_0) {
-            int rv;
-            of_action_t elt;
-            OF_LIST_ACTION_ITER(entry->effects.actions, &elt, rv) {
-                of_object_dump((loci_writer_f)aim_printf, pvs, &elt.header);
-            }
-        } else {
-            int rv;
-            of_instruction_t inst;
-            OF_LIST_INSTRUCTION_ITER(entry->effects.instructions, &inst, rv) {
-                of_object_dump((loci_writer_f)aim_printf, pvs, &inst.header);
-            }
+    FT_SHARDS_FOREACH(ind_core_ft, ft, i) {
+        FT_ITER(ft, entry, cur, next) {
+            ft_entry_dump(out, entry);
         }
-
-        aim_printf(pvs, "\n");
     }
+
+    aim_pvs_destroy(out);
 }
 
 void
 ind_core_ft_show(aim_pvs_t* pvs)
 {
+    ft_instance_t ft;
     ft_entry_t *entry;
     list_links_t *cur, *next;
+    aim_pvs_t *out = aim_pvs_chunked_create(pvs, 0);
+    int i;
 
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        aim_printf(pvs, "Flow %d: ", entry->id);
-        loci_show_match((loci_writer_f)aim_printf, pvs, &entry->match);
-        aim_printf(pvs, "cookie=0x%016"PRIx64" ", entry->cookie);
-        aim_printf(pvs, "priority=%hu ", entry->priority);
-        aim_printf(pvs, "table_id=%hhu ", entry->table_id);
-
-        if (entry->match.version == OF_VERSION_1_0) {
-            int rv;
-            of_action_t elt;
-            OF_LIST_ACTION_ITER(entry->effects.actions, &elt, rv) {
-                aim_printf(pvs, "%s(", of_object_id_str[elt.header.object_id]);
-                of_object_show((loci_writer_f)aim_printf, pvs, &elt.header);
-                aim_printf(pvs, ") ");
-            }
-        } else {
-            int rv;
-            of_instruction_t inst;
-            OF_LIST_INSTRUCTION_ITER(entry->effects.instructions, &inst, rv) {
-                aim_printf(pvs, "%s(", of_object_id_str[inst.header.object_id]);
-                of_object_show((loci_writer_f)aim_printf, pvs, &inst.header);
-                aim_printf(pvs, ") ");
+    FT_SHARDS_FOREACH(ind_core_ft, ft, i) {
+        FT_ITER(ft, entry, cur, next) {
+            ft_entry_show(out, entry);
+        }
+    }
+
+    aim_pvs_destroy(out);
+}
+
+struct ft_dump_state {
+    aim_pvs_t *pvs;
+    ind_core_ft_dump_format_t format;
+    int count;
+    ind_core_ft_dump_done_f done;
+    void *cookie;
+};
+
+static void
+ft_dump_iter_cb(void *cookie, ft_entry_t *entry)
+{
+    struct ft_dump_state *state = cookie;
+
+    if (entry != NULL) {
+        ft_entry_format(state->pvs, state->format, entry);
+        state->count++;
+    } else {
+        /* Writes out the last chunk */
+        aim_pvs_destroy(state->pvs);
+        if (state->done != NULL) {
+            state->done(state->cookie, state->count);
+        }
+        aim_free(state);
+    }
+}
+
+indigo_error_t
+ind_core_ft_dump_start(aim_pvs_t *pvs, ind_core_ft_dump_format_t format,
+                       const ind_core_ft_dump_filter_t *filter,
+                       ind_core_ft_dump_done_f done, void *cookie)
+{
+    struct ft_dump_state *state;
+    of_meta_match_t query;
+    indigo_error_t rv;
+
+    /* An all-wildcard non-strict query matches every flow */
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.match.version = OF_VERSION_1_3;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = TABLE_ID_ANY;
+    if (filter != NULL) {
+        if (filter->table_id >= 0) {
+            if (filter->table_id >= TABLE_ID_ANY) {
+                return INDIGO_ERROR_PARAM;
             }
+            query.table_id = filter->table_id;
+        }
+        query.cookie = filter->cookie;
+        query.cookie_mask = filter->cookie_mask;
+        if (filter->priority >= 0) {
+            query.check_priority = 1;
+            query.priority = filter->priority;
         }
+    }
 
-        aim_printf(pvs, "\n");
+    state = aim_zmalloc(sizeof(*state));
+    state->pvs = aim_pvs_chunked_create(pvs, 0);
+    state->format = format;
+    state->done = done;
+    state->cookie = cookie;
+
+    rv = ft_shards_spawn_iter_task(ind_core_ft, &query, ft_dump_iter_cb, state,
+                                   IND_SOC_PRIORITY_STATS);
+    if (rv != INDIGO_ERROR_NONE) {
+        aim_pvs_destroy(state->pvs);
+        aim_free(state);
     }
+
+    return rv;
 }
 
 void
 ind_core_ft_stats(aim_pvs_t *pvs)
 {
+    ft_status_t status;
     ft_instance_t ft;
+    int i;
 
-    ft = ind_core_ft;
+    ft_shards_status_get(ind_core_ft, &status);
     aim_printf(pvs, "Flow table stats:\n");
-    aim_printf(pvs, "  Current count:  %d\n", ft->status.current_count);
-    aim_printf(pvs, "  Adds:           %d\n", (int)ft->status.adds);
-    aim_printf(pvs, "  Deletes:        %d\n", (int)ft->status.deletes);
-    aim_printf(pvs, "  Hard Exp:       %d\n", (int)ft->status.hard_expires);
-    aim_printf(pvs, "  Idle Exp:       %d\n", (int)ft->status.idle_expires);
-    aim_printf(pvs, "  Updates:        %d\n", (int)ft->status.updates);
+    aim_printf(pvs, "  Current count:  %d\n", status.current_count);
+    aim_printf(pvs, "  Adds:           %d\n", (int)status.adds);
+    aim_printf(pvs, "  Deletes:        %d\n", (int)status.deletes);
+    aim_printf(pvs, "  Hard Exp:       %d\n", (int)status.hard_expires);
+    aim_printf(pvs, "  Idle Exp:       %d\n", (int)status.idle_expires);
+    aim_printf(pvs, "  Updates:        %d\n", (int)status.updates);
+    aim_printf(pvs, "  Overwrites:     %d\n", (int)status.overwrites);
     aim_printf(pvs, "  Full Errors:    %d\n",
-               (int)ft->status.table_full_errors);
+               (int)status.table_full_errors);
     aim_printf(pvs, "  Fwd Add Errors: %d\n",
-               (int)ft->status.forwarding_add_errors);
+               (int)status.forwarding_add_errors);
+    ind_core_flow_mod_errors_show(pvs);
+    aim_printf(pvs, "  Shared Effects: %d\n", ind_core_ft->count > 0 ?
+               ft_shared_effects_count(ind_core_ft->instances[0]) : 0);
+    aim_printf(pvs, "  Index Resizes:  %d\n", (int)status.index_resizes);
+    aim_printf(pvs, "  Shards:         %d\n", ind_core_ft->count);
+
+    if (!ind_core_ft->sharded) {
+        ft_bucket_stats_show(ind_core_ft->instances[0], pvs);
+        return;
+    }
+
+    for (i = 0; i < FT_TABLE_ID_BUCKET_COUNT; i++) {
+        if ((ft = ft_shards_find(ind_core_ft, i)) != NULL) {
+            aim_printf(pvs, "Table %d: %d flows\n", i, ft->status.current_count);
+            ft_bucket_stats_show(ft, pvs);
+        }
+    }
 }
 
 
@@ -1088,7 +1658,7 @@ indigo_core_stats_get(uint32_t *total_flows,
                       uint32_t *packet_ins,
                       uint32_t *packet_outs)
 {
-    *total_flows = ind_core_ft->status.current_count;
+    *total_flows = ft_shards_current_count(ind_core_ft);
     *flow_mods = ind_core_flow_mods;
     *packet_ins = ind_core_packet_ins;
     *packet_outs = ind_core_packet_outs;
@@ -1118,6 +1688,33 @@ ind_core_dup_tracking(of_object_t *obj, indigo_cxn_id_t cxn_id)
     return new_obj;
 }
 
+/**
+ * Copy the OpenFlow header of a request and set up tracking
+ *
+ * For handlers that only need the xid and version of the request after
+ * it returns, such as the stats handlers replying from a task. The copy
+ * keeps the request's type, so the header accessors work on it, but
+ * nothing past the header may be read. This avoids duplicating the
+ * match and other contents of the request.
+ *
+ * This function does not return NULL.
+ */
+
+of_object_t *
+ind_core_dup_header_tracking(of_object_t *obj, indigo_cxn_id_t cxn_id)
+{
+    of_object_t *new_obj = of_object_new(OF_MESSAGE_HEADER_LENGTH);
+    AIM_TRUE_OR_DIE(new_obj != NULL);
+    of_object_init_map[obj->object_id](new_obj, obj->version,
+                                       OF_MESSAGE_HEADER_LENGTH, 0);
+    INDIGO_MEM_COPY(OF_OBJECT_BUFFER_INDEX(new_obj, 0),
+                    OF_OBJECT_BUFFER_INDEX(obj, 0),
+                    OF_MESSAGE_HEADER_LENGTH);
+    indigo_error_t rv = ind_cxn_message_track_setup(cxn_id, new_obj);
+    AIM_TRUE_OR_DIE(rv == INDIGO_ERROR_NONE);
+    return new_obj;
+}
+
 #ifdef OFDPA_FIXUP
 /**
  * Handles flow expiry that occured in the datapath.
@@ -1127,7 +1724,7 @@ void ind_core_flow_expiry_handler(indigo_flow_id_t id,
 {
   ft_entry_t *entry = NULL;
 
-  if ((entry = ft_lookup(ind_core_ft, id)) == NULL) 
+  if ((entry = ft_shards_lookup(ind_core_ft, id)) == NULL) 
   {
     /* could not find the flow. */
     LOG_ERROR("Could not find the flow id = 0x%x", id);
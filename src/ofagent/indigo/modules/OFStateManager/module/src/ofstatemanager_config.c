@@ -78,6 +78,36 @@ ofstatemanager_config_settings_t ofstatemanager_config_settings[] =
     { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_DPID_DEFAULT), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_DPID_DEFAULT) },
 #else
 { OFSTATEMANAGER_CONFIG_DPID_DEFAULT(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX
+    { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX) },
+#else
+{ OFSTATEMANAGER_CONFIG_FLOW_ADD_BATCH_MAX(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX
+    { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX) },
+#else
+{ OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP
+    { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP) },
+#else
+{ OFSTATEMANAGER_CONFIG_PACKET_OUT_TABLE_LOOKUP(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS
+    { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS) },
+#else
+{ OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX
+    { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX) },
+#else
+{ OFSTATEMANAGER_CONFIG_FLOW_MOD_ERRORS_MAX(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS
+    { __ofstatemanager_config_STRINGIFY_NAME(OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS), __ofstatemanager_config_STRINGIFY_VALUE(OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS) },
+#else
+{ OFSTATEMANAGER_CONFIG_FLOWTABLE_SHARDS(__ofstatemanager_config_STRINGIFY_NAME), "__undefined__" },
 #endif
     { NULL, NULL }
 };
@@ -136,9 +166,11 @@ parse_disconnected_mode(const char *str)
         return INDIGO_CORE_DISCONNECTED_MODE_LOCKDOWN;
     } else if (!strcmp(str, "local")) {
         return INDIGO_CORE_DISCONNECTED_MODE_LOCAL;
+    } else if (!strcmp(str, "reconcile")) {
+        return INDIGO_CORE_DISCONNECTED_MODE_RECONCILE;
     } else {
         AIM_LOG_ERROR("Config: unrecognized disconnected_mode %s", str);
-        AIM_LOG_ERROR("  Must be sticky, closed, disabled, lockdown or local");
+        AIM_LOG_ERROR("  Must be sticky, closed, disabled, lockdown, local or reconcile");
         return -1;
     }
 }
@@ -249,7 +281,7 @@ ind_core_cfg_commit(void)
     if ((lobj = aim_log_find("ofstatemanager")) == NULL) {
         AIM_LOG_WARN("Could not find log module");
     } else {
-        lobj->common_flags = staged_config.log_flags;
+        aim_log_common_flags_set(lobj, staged_config.log_flags);
     }
 
     /* Set whether or not changed */
@@ -262,7 +294,21 @@ ind_core_cfg_commit(void)
     (void)indigo_core_disconnected_mode_set(staged_config.disconnected_mode);
 }
 
+/* Reloads that change none of these skip this module */
+static const char * const ind_core_cfg_keys[] = {
+    "logging.flowtable",
+    "of_hw_desc",
+    "of_sw_desc",
+    "of_mfr_desc",
+    "of_dp_desc",
+    "of_serial_num",
+    "of_datapath_id",
+    "disconnected_mode",
+    NULL
+};
+
 const struct ind_cfg_ops ind_core_cfg_ops = {
     .stage = ind_core_cfg_stage,
     .commit = ind_core_cfg_commit,
+    .keys = ind_core_cfg_keys,
 };
@@ -28,21 +28,33 @@
 #include "ofstatemanager_int.h"
 
 #include "ft.h"
+#include "ft_shard.h"
 
 extern int ind_core_init_done;
 extern int ind_core_module_enabled;
 
 /* State manager configuration data, shared within module */
 extern ind_core_of_config_t ind_core_of_config;
+extern ind_core_config_t ind_core_config;
 
-/* The flow table instance visible to all parts of the module */
-extern ft_instance_t ind_core_ft;
+/* The flow table visible to all parts of the module, sharded by table */
+extern ft_shards_t *ind_core_ft;
 
 extern void ind_core_flow_entry_delete(ft_entry_t *entry,
                                        indigo_fi_flow_removed_t reason);
 
+extern void ind_core_flow_entry_delete_batch(ft_entry_t **entries, int count,
+                                             indigo_fi_flow_removed_t reason);
+
+extern void ind_core_flow_entry_stats_get_batch(ft_entry_t **entries, int count,
+                                                indigo_fi_flow_stats_t *flow_stats,
+                                                indigo_error_t *results);
+
 void ind_core_group_init(void);
 
+/* Returns 0 or the group mod failed code */
+uint16_t ind_core_group_delete_all(void);
+
 #ifdef OFDPA_FIXUP
 void ind_core_meter_init(void);
 #endif
@@ -121,7 +121,123 @@ extern const struct ind_cfg_ops ind_core_cfg_ops;
 void ind_core_test_gentable_init(void);
 void ind_core_test_gentable_finish(void);
 
+void ind_core_memory_gentable_init(void);
+void ind_core_memory_gentable_finish(void);
+
 of_object_t *ind_core_dup_tracking(of_object_t *obj, indigo_cxn_id_t cxn_id);
+of_object_t *ind_core_dup_header_tracking(of_object_t *obj, indigo_cxn_id_t cxn_id);
+
+/* Submit pending batched flow adds to the forwarding layer */
+void ind_core_flow_add_flush(void);
+
+/* Submit pending batched packet-outs to the forwarding layer */
+void ind_core_packet_out_flush(void);
+
+/* Send the summary of the flow-mod errors held back in this burst */
+void ind_core_flow_mod_error_flush(void);
+
+/* Forget which tables the forwarding layer reported full */
+void ind_core_table_full_clear(void);
+
+void ind_core_flow_mod_errors_show(aim_pvs_t *pvs);
+
+struct ft_entry_s;
+
+/* Record the groups referenced by a flow's instructions */
+void ind_core_group_flow_ref(struct ft_entry_s *entry);
+
+/* Drop the group references of a flow */
+void ind_core_group_flow_unref(struct ft_entry_s *entry);
+
+/* True if a group is referenced by another group or by a flow */
+bool ind_core_group_in_use(uint32_t id);
+
+/* True if a group is in the group table */
+bool ind_core_group_exists(uint32_t id);
+
+/* Type and buckets of a group, or NULL if it is not in the group table */
+of_list_bucket_t *ind_core_group_buckets_get(uint32_t id, uint32_t *type);
+
+/* Replies kept encoded by the request handlers */
+typedef enum ind_core_reply_cache_e {
+    IND_CORE_REPLY_CACHE_DESC,
+    IND_CORE_REPLY_CACHE_FEATURES,
+    IND_CORE_REPLY_CACHE_PORT_DESC,
+    IND_CORE_REPLY_CACHE_COUNT
+} ind_core_reply_cache_t;
+
+/* Drop a cached reply, for every version, once what it reports changed */
+void ind_core_reply_cache_invalidate(ind_core_reply_cache_t cache);
+
+void ind_core_reply_cache_finish(void);
+
+/* Run the default handler for a controller message */
+void ind_core_message_dispatch(indigo_cxn_id_t cxn, of_object_t *obj);
+
+/* Stage a flow, group or gentable mod if a bundle is open on the connection */
+bool ind_core_bundle_stage(indigo_cxn_id_t cxn_id, of_object_t *obj);
+
+/* Handle the ONF bundle control and add messages; other experimenter
+   messages go to ind_core_experimenter_handler */
+void ind_core_bundle_experimenter_handler(of_object_t *obj, indigo_cxn_id_t cxn_id);
+
+void ind_core_bundle_init(void);
+void ind_core_bundle_finish(void);
+
+void ind_core_flow_stats_init(void);
+void ind_core_flow_stats_finish(void);
+
+/* Apply the gentable entry adds and deletes among 'msgs' in batches */
+void ind_core_gentable_entry_batch(indigo_cxn_id_t cxn_id, of_object_t **msgs, int count);
+
+typedef void (*ind_core_group_flow_iter_f)(void *cookie, struct ft_entry_s *entry);
+
+/* Call 'callback' for each flow referencing a group; returns the count */
+int ind_core_group_flows_foreach(uint32_t id, ind_core_group_flow_iter_f callback,
+                                 void *cookie);
+
+/*
+ * Warm restart (warm.c)
+ *
+ * The group and meter tables save themselves through a callback, and
+ * restore the objects read back without calling Forwarding. Restored
+ * objects are stale until a controller adds them again.
+ */
+
+/* Write one add message to the checkpoint; flow_id and table_id are for flows */
+typedef void (*ind_core_warm_write_f)(void *cookie, of_object_t *obj,
+                                      indigo_flow_id_t flow_id, uint8_t table_id);
+
+/* True if two lists have the same wire encoding */
+bool ind_core_warm_list_equal(of_object_t *a, of_object_t *b);
+
+/* Count a stale object the controller added again unchanged */
+void ind_core_warm_confirmed(void);
+
+/* Clear a stale flow if a flow add leaves it unchanged; true if it did */
+bool ind_core_warm_flow_confirm(struct ft_entry_s *entry, of_flow_modify_t *obj);
+
+/* Make later flow IDs larger than a restored one */
+void ind_core_flow_id_reserve(indigo_flow_id_t id);
+
+void ind_core_group_warm_save(ind_core_warm_write_f write, void *cookie);
+indigo_error_t ind_core_group_warm_restore(of_object_t *obj);
+void ind_core_group_warm_link(void);
+int ind_core_group_warm_sweep(void);
+int ind_core_group_warm_mark(void);
+
+#ifdef OFDPA_FIXUP
+void ind_core_meter_warm_save(ind_core_warm_write_f write, void *cookie);
+indigo_error_t ind_core_meter_warm_restore(of_object_t *obj);
+int ind_core_meter_warm_sweep(void);
+int ind_core_meter_warm_mark(void);
+#endif
+
+/* Start the reconcile timer once a controller is connected */
+void ind_core_warm_connection_notify(int count);
+
+/* Mark all state stale on the loss of the last controller */
+void ind_core_warm_disconnect_mark(void);
 
 #include <OFStateManager/ofstatemanager.h>
 
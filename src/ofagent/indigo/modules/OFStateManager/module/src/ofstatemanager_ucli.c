@@ -34,9 +34,32 @@
 #include <uCli/ucli.h>
 #include <uCli/ucli_argparse.h>
 #include <uCli/ucli_handler_macros.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <AIM/aim_pvs_file.h>
+#include <OFStateManager/ofstatemanager.h>
+#include "ofstatemanager_decs.h"
+#include "ft_lpm.h"
 
 
 
+static ucli_status_t
+ofstatemanager_ucli_ucli__clear_all__(ucli_context_t* uc)
+{
+    UCLI_COMMAND_INFO(uc,
+                      "clear_all", 0,
+                      "$summary#Delete every flow and group in the background.");
+
+    if (ind_core_clear_all(NULL, NULL) != INDIGO_ERROR_NONE) {
+        return ucli_error(uc, "failed to start clearing");
+    }
+    ucli_printf(uc, "Deleting %d flows\n",
+                ft_shards_current_count(ind_core_ft));
+
+    return UCLI_STATUS_OK;
+}
+
 static ucli_status_t
 ofstatemanager_ucli_ucli__config__(ucli_context_t* uc)
 {
@@ -48,6 +71,226 @@ ofstatemanager_ucli_ucli__config__(ucli_context_t* uc)
     return UCLI_STATUS_OK;
 }
 
+static void
+flow_dump_done(void *cookie, int count)
+{
+    aim_pvs_t *pvs = cookie;
+
+    aim_pvs_destroy(pvs);
+}
+
+static ucli_status_t
+ofstatemanager_ucli_ucli__flow_dump__(ucli_context_t* uc)
+{
+    ind_core_ft_dump_filter_t filter = { -1, 0, 0, -1 };
+    ind_core_ft_dump_format_t format = IND_CORE_FT_DUMP_COMPACT;
+    const char *file, *arg;
+    char *end;
+    aim_pvs_t *pvs;
+    int i;
+
+    UCLI_COMMAND_INFO(uc,
+                      "flow_dump", -1,
+                      "$summary#Write the flow table to a file in the background."
+                      "$args#<file> [verbose|show|compact] [table=<id>] "
+                      "[cookie=<value>[/<mask>]] [priority=<priority>]");
+    if (uc->pargs->count < 1) {
+        return UCLI_STATUS_E_ARG;
+    }
+    file = uc->pargs->args[0];
+
+    for (i = 1; i < uc->pargs->count; i++) {
+        arg = uc->pargs->args[i];
+        if (!strcmp(arg, "verbose")) {
+            format = IND_CORE_FT_DUMP_VERBOSE;
+        } else if (!strcmp(arg, "show")) {
+            format = IND_CORE_FT_DUMP_SHOW;
+        } else if (!strcmp(arg, "compact")) {
+            format = IND_CORE_FT_DUMP_COMPACT;
+        } else if (!strncmp(arg, "table=", 6)) {
+            filter.table_id = strtol(arg + 6, &end, 0);
+            if (*end != '\0' || filter.table_id < 0 || filter.table_id > 254) {
+                return ucli_error(uc, "invalid table %s", arg + 6);
+            }
+        } else if (!strncmp(arg, "cookie=", 7)) {
+            filter.cookie = strtoull(arg + 7, &end, 0);
+            filter.cookie_mask = ~(uint64_t)0;
+            if (*end == '/') {
+                filter.cookie_mask = strtoull(end + 1, &end, 0);
+            }
+            if (*end != '\0') {
+                return ucli_error(uc, "invalid cookie %s", arg + 7);
+            }
+        } else if (!strncmp(arg, "priority=", 9)) {
+            filter.priority = strtol(arg + 9, &end, 0);
+            if (*end != '\0' || filter.priority < 0 || filter.priority > 0xffff) {
+                return ucli_error(uc, "invalid priority %s", arg + 9);
+            }
+        } else {
+            return ucli_error(uc, "invalid argument %s", arg);
+        }
+    }
+
+    if ((pvs = aim_pvs_fopen(file, "w")) == NULL) {
+        return ucli_error(uc, "cannot open %s", file);
+    }
+
+    /* The task owns the file from here on */
+    if (ind_core_ft_dump_start(pvs, format, &filter, flow_dump_done,
+                               pvs) != INDIGO_ERROR_NONE) {
+        aim_pvs_destroy(pvs);
+        return ucli_error(uc, "failed to start the dump");
+    }
+    ucli_printf(uc, "Writing %d flows to %s\n",
+                ft_shards_current_count(ind_core_ft), file);
+
+    return UCLI_STATUS_OK;
+}
+
+static void
+group_flows_show(void *cookie, struct ft_entry_s *entry)
+{
+    ucli_context_t *uc = cookie;
+    ucli_printf(uc, "  flow " INDIGO_FLOW_ID_PRINTF_FORMAT " table %u cookie 0x%" PRIx64 "\n",
+                INDIGO_FLOW_ID_PRINTF_ARG(entry->id), entry->table_id, entry->cookie);
+}
+
+static ucli_status_t
+ofstatemanager_ucli_ucli__group_flows__(ucli_context_t* uc)
+{
+    uint32_t id;
+    int count;
+
+    UCLI_COMMAND_INFO(uc,
+                      "group_flows", 1,
+                      "$summary#Show the flows that reference a group."
+                      "$args#<group_id>");
+    UCLI_ARGPARSE_OR_RETURN(uc, "i", &id);
+
+    count = ind_core_group_flows_foreach(id, group_flows_show, uc);
+    ucli_printf(uc, "%d flows, group %s\n", count,
+                ind_core_group_in_use(id) ? "in use" : "not in use");
+
+    return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ofstatemanager_ucli_ucli__mem__(ucli_context_t* uc)
+{
+    indigo_mem_stats_t stats;
+    int tag;
+
+    UCLI_COMMAND_INFO(uc,
+                      "mem", -1,
+                      "$summary#Show the memory held by each accounting tag."
+                      "$args#[reset]");
+    if (uc->pargs->count > 0) {
+        if (strcmp(uc->pargs->args[0], "reset") != 0) {
+            return UCLI_STATUS_E_ARG;
+        }
+        indigo_mem_peak_reset();
+    }
+
+    ucli_printf(uc, "%-14s %12s %12s %12s %10s  %s\n",
+                "tag", "live", "peak", "soft limit", "limit hits",
+                "description");
+    for (tag = 0; tag < INDIGO_MEM_TAG_COUNT; tag++) {
+        indigo_mem_stats_get(tag, &stats);
+        ucli_printf(uc, "%-14s %12"PRIu64" %12"PRIu64" %12"PRIu64" %10"PRIu64"  %s\n",
+                    indigo_mem_tag_name(tag), stats.live_bytes,
+                    stats.peak_bytes, stats.soft_limit, stats.limit_hits,
+                    indigo_mem_tag_desc(tag));
+    }
+
+    return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ofstatemanager_ucli_ucli__mem_limit__(ucli_context_t* uc)
+{
+    char *name, *str, *end;
+    uint64_t bytes;
+    int tag;
+
+    UCLI_COMMAND_INFO(uc,
+                      "mem_limit", 2,
+                      "$summary#Set the soft limit of an accounting tag, 0 for none."
+                      "$args#<tag> <bytes>");
+    UCLI_ARGPARSE_OR_RETURN(uc, "ss", &name, &str);
+
+    bytes = strtoull(str, &end, 0);
+    if (*str == '\0' || *end != '\0') {
+        return ucli_error(uc, "invalid byte count %s", str);
+    }
+
+    for (tag = 0; tag < INDIGO_MEM_TAG_COUNT; tag++) {
+        if (strcasecmp(name, indigo_mem_tag_name(tag)) == 0) {
+            indigo_mem_soft_limit_set(tag, bytes);
+            return UCLI_STATUS_OK;
+        }
+    }
+
+    return ucli_error(uc, "unknown tag %s", name);
+}
+
+static ucli_status_t
+ofstatemanager_ucli_ucli__message_stats__(ucli_context_t* uc)
+{
+    UCLI_COMMAND_INFO(uc,
+                      "message_stats", 0,
+                      "$summary#Show the handler latency of each message type.");
+
+    ind_core_message_stats_show(&uc->pvs);
+
+    return UCLI_STATUS_OK;
+}
+
+static void
+route_lookup_show(void *cookie, struct ft_entry_s *entry, int prefix_len)
+{
+    ucli_context_t *uc = cookie;
+    ucli_printf(uc, "  /%d flow " INDIGO_FLOW_ID_PRINTF_FORMAT " priority %u cookie 0x%" PRIx64 "\n",
+                prefix_len, INDIGO_FLOW_ID_PRINTF_ARG(entry->id),
+                entry->priority, entry->cookie);
+}
+
+static ucli_status_t
+ofstatemanager_ucli_ucli__route_lookup__(ucli_context_t* uc)
+{
+    char *str;
+    uint8_t addr[16];
+    uint16_t eth_type;
+    ft_instance_t ft = NULL;
+    int count;
+
+    UCLI_COMMAND_INFO(uc,
+                      "route_lookup", 1,
+                      "$summary#Show the longest prefix match of an address in each VRF."
+                      "$args#<ipv4 or ipv6 address>");
+    UCLI_ARGPARSE_OR_RETURN(uc, "s", &str);
+
+    if (ind_core_ft != NULL && ind_core_ft->config.lpm_table_id > 0) {
+        ft = ft_shards_find(ind_core_ft, ind_core_ft->config.lpm_table_id);
+    }
+    if (ft == NULL || ft->lpm == NULL) {
+        return ucli_error(uc, "no table is indexed by prefix");
+    }
+    if (inet_pton(AF_INET, str, addr) == 1) {
+        eth_type = 0x0800;
+    } else if (inet_pton(AF_INET6, str, addr) == 1) {
+        eth_type = 0x86dd;
+    } else {
+        return ucli_error(uc, "invalid address %s", str);
+    }
+
+    count = ft_lpm_route_lookup(ft->lpm, eth_type, addr,
+                                route_lookup_show, uc);
+    ucli_printf(uc, "%d matches in table %u\n", count,
+                ft_lpm_table_id(ft->lpm));
+
+    return UCLI_STATUS_OK;
+}
+
 
 /* <auto.ucli.handlers.start> */
 /******************************************************************************
@@ -58,7 +301,14 @@ ofstatemanager_ucli_ucli__config__(ucli_context_t* uc)
  *****************************************************************************/
 static ucli_command_handler_f ofstatemanager_ucli_ucli_handlers__[] =
 {
+    ofstatemanager_ucli_ucli__clear_all__,
     ofstatemanager_ucli_ucli__config__,
+    ofstatemanager_ucli_ucli__flow_dump__,
+    ofstatemanager_ucli_ucli__group_flows__,
+    ofstatemanager_ucli_ucli__mem__,
+    ofstatemanager_ucli_ucli__mem_limit__,
+    ofstatemanager_ucli_ucli__message_stats__,
+    ofstatemanager_ucli_ucli__route_lookup__,
     NULL
 };
 /******************************************************************************/
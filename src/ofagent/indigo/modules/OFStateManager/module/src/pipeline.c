@@ -0,0 +1,759 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Software pipeline lookup for packet-outs
+ *
+ * The packet is parsed into match fields once, then looked up table by
+ * table with ft_packet_match in the shard of each table, following
+ * goto-table instructions. Only
+ * the actions that decide where the packet goes and its VLAN tag are
+ * modelled: output, group, push/pop VLAN and set-field of the VLAN ID.
+ * Anything else, a table miss, or a flow that matches a field the parser
+ * does not set, leaves the packet-out to Forwarding.
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <loci/loci.h>
+
+#include "ofstatemanager_log.h"
+#include "ofstatemanager_int.h"
+#include "ft_shard.h"
+#include "pipeline.h"
+
+/* Bound on goto-table hops and on nested groups */
+#define PIPELINE_MAX_DEPTH 16
+
+/* Ports above this are reserved */
+#define PIPELINE_PORT_MAX 0xffffff00
+
+/* OXM header of an exact match VLAN ID */
+#define PIPELINE_OXM_VLAN_VID 0x80000c02
+
+#define ETH_TYPE_VLAN 0x8100
+#define ETH_TYPE_QINQ 0x88a8
+#define ETH_TYPE_IPV4 0x0800
+#define ETH_TYPE_ARP  0x0806
+#define ETH_TYPE_IPV6 0x86dd
+
+#define IP_PROTO_ICMP   1
+#define IP_PROTO_TCP    6
+#define IP_PROTO_UDP    17
+#define IP_PROTO_ICMPV6 58
+#define IP_PROTO_SCTP   132
+
+#define RD16(_p) ((uint16_t)((_p)[0] << 8 | (_p)[1]))
+#define RD32(_p) ((uint32_t)(_p)[0] << 24 | (uint32_t)(_p)[1] << 16 | \
+                  (uint32_t)(_p)[2] << 8 | (uint32_t)(_p)[3])
+
+/* The VLAN tag of the packet */
+typedef struct pipeline_tag_s {
+    bool present;
+    uint16_t vid;
+    uint8_t pcp;
+} pipeline_tag_t;
+
+typedef struct pipeline_state_s {
+    of_version_t version;
+    of_match_fields_t fields;
+    pipeline_tag_t tag;
+
+    /* Set by the output action */
+    of_port_no_t out_port;      /* OF_PORT_DEST_NONE until output */
+    pipeline_tag_t out_tag;
+
+    /* Action set */
+    bool set_pop_vlan;
+    bool set_vlan_vid;
+    uint16_t set_vid;
+    bool set_group;
+    uint32_t set_group_id;
+    bool set_output;
+    of_port_no_t set_port;
+} pipeline_state_t;
+
+/* Fields set by ind_core_pipeline_fields_parse */
+static of_match_fields_t pipeline_known;
+static bool pipeline_known_initialized;
+
+#define PIPELINE_KNOWN(_field) \
+    memset(&pipeline_known._field, 0xff, sizeof(pipeline_known._field))
+
+static void
+pipeline_known_init(void)
+{
+    PIPELINE_KNOWN(in_port);
+    PIPELINE_KNOWN(metadata);
+    PIPELINE_KNOWN(eth_dst);
+    PIPELINE_KNOWN(eth_src);
+    PIPELINE_KNOWN(eth_type);
+    PIPELINE_KNOWN(vlan_vid);
+    PIPELINE_KNOWN(vlan_pcp);
+    PIPELINE_KNOWN(ip_dscp);
+    PIPELINE_KNOWN(ip_ecn);
+    PIPELINE_KNOWN(ip_proto);
+    PIPELINE_KNOWN(ipv4_src);
+    PIPELINE_KNOWN(ipv4_dst);
+    PIPELINE_KNOWN(tcp_dst);
+    PIPELINE_KNOWN(tcp_src);
+    PIPELINE_KNOWN(udp_dst);
+    PIPELINE_KNOWN(udp_src);
+    PIPELINE_KNOWN(sctp_dst);
+    PIPELINE_KNOWN(sctp_src);
+    PIPELINE_KNOWN(icmpv4_type);
+    PIPELINE_KNOWN(icmpv4_code);
+    PIPELINE_KNOWN(arp_op);
+    PIPELINE_KNOWN(arp_spa);
+    PIPELINE_KNOWN(arp_tpa);
+    PIPELINE_KNOWN(arp_sha);
+    PIPELINE_KNOWN(arp_tha);
+    PIPELINE_KNOWN(ipv6_src);
+    PIPELINE_KNOWN(ipv6_dst);
+    PIPELINE_KNOWN(ipv6_flabel);
+    PIPELINE_KNOWN(icmpv6_type);
+    PIPELINE_KNOWN(icmpv6_code);
+    pipeline_known_initialized = true;
+}
+
+/* Encode the VLAN tag in the match fields */
+static void
+pipeline_vlan_fields_set(pipeline_state_t *state)
+{
+    if (state->tag.present) {
+        state->fields.vlan_vid = state->tag.vid;
+        if (state->version >= OF_VERSION_1_2) {
+            state->fields.vlan_vid |= OF_VLAN_TAG_PRESENT;
+        }
+        state->fields.vlan_pcp = state->tag.pcp;
+    } else {
+        state->fields.vlan_vid = OF_VLAN_UNTAGGED_BY_VERSION(state->version);
+        state->fields.vlan_pcp = 0;
+    }
+}
+
+static void
+pipeline_l4_parse(uint8_t proto, const uint8_t *p, int len,
+                  of_match_fields_t *fields)
+{
+    switch (proto) {
+    case IP_PROTO_TCP:
+        if (len >= 4) {
+            fields->tcp_src = RD16(p);
+            fields->tcp_dst = RD16(p + 2);
+        }
+        break;
+    case IP_PROTO_UDP:
+        if (len >= 4) {
+            fields->udp_src = RD16(p);
+            fields->udp_dst = RD16(p + 2);
+        }
+        break;
+    case IP_PROTO_SCTP:
+        if (len >= 4) {
+            fields->sctp_src = RD16(p);
+            fields->sctp_dst = RD16(p + 2);
+        }
+        break;
+    case IP_PROTO_ICMP:
+        if (len >= 2) {
+            fields->icmpv4_type = p[0];
+            fields->icmpv4_code = p[1];
+        }
+        break;
+    case IP_PROTO_ICMPV6:
+        if (len >= 2) {
+            fields->icmpv6_type = p[0];
+            fields->icmpv6_code = p[1];
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void
+ind_core_pipeline_fields_parse(of_version_t version, of_port_no_t in_port,
+                               const uint8_t *data, int len,
+                               of_match_fields_t *fields)
+{
+    const uint8_t *p = data;
+    int hlen;
+
+    memset(fields, 0, sizeof(*fields));
+    fields->in_port = in_port;
+    fields->vlan_vid = OF_VLAN_UNTAGGED_BY_VERSION(version);
+
+    if (len < 14) {
+        return;
+    }
+
+    memcpy(fields->eth_dst.addr, p, OF_MAC_ADDR_BYTES);
+    memcpy(fields->eth_src.addr, p + 6, OF_MAC_ADDR_BYTES);
+    fields->eth_type = RD16(p + 12);
+    p += 14;
+    len -= 14;
+
+    if (fields->eth_type == ETH_TYPE_VLAN || fields->eth_type == ETH_TYPE_QINQ) {
+        if (len < 4) {
+            return;
+        }
+        fields->vlan_vid = RD16(p) & 0xfff;
+        if (version >= OF_VERSION_1_2) {
+            fields->vlan_vid |= OF_VLAN_TAG_PRESENT;
+        }
+        fields->vlan_pcp = p[0] >> 5;
+        fields->eth_type = RD16(p + 2);
+        p += 4;
+        len -= 4;
+    }
+
+    switch (fields->eth_type) {
+    case ETH_TYPE_IPV4:
+        if (len < 20 || (hlen = (p[0] & 0xf) * 4) < 20 || len < hlen) {
+            return;
+        }
+        fields->ip_dscp = p[1] >> 2;
+        fields->ip_ecn = p[1] & 0x3;
+        fields->ip_proto = p[9];
+        fields->ipv4_src = RD32(p + 12);
+        fields->ipv4_dst = RD32(p + 16);
+        if ((RD16(p + 6) & 0x1fff) == 0) {
+            /* Not a later fragment */
+            pipeline_l4_parse(fields->ip_proto, p + hlen, len - hlen, fields);
+        }
+        break;
+    case ETH_TYPE_IPV6:
+        if (len < 40) {
+            return;
+        }
+        fields->ip_dscp = (RD16(p) >> 6) & 0x3f;
+        fields->ip_ecn = (p[1] >> 4) & 0x3;
+        fields->ipv6_flabel = RD32(p) & 0xfffff;
+        fields->ip_proto = p[6];
+        memcpy(fields->ipv6_src.addr, p + 8, OF_IPV6_BYTES);
+        memcpy(fields->ipv6_dst.addr, p + 24, OF_IPV6_BYTES);
+        pipeline_l4_parse(fields->ip_proto, p + 40, len - 40, fields);
+        break;
+    case ETH_TYPE_ARP:
+        if (len < 28 || RD16(p) != 1 || RD16(p + 2) != ETH_TYPE_IPV4) {
+            return;
+        }
+        fields->arp_op = RD16(p + 6);
+        memcpy(fields->arp_sha.addr, p + 8, OF_MAC_ADDR_BYTES);
+        fields->arp_spa = RD32(p + 14);
+        memcpy(fields->arp_tha.addr, p + 18, OF_MAC_ADDR_BYTES);
+        fields->arp_tpa = RD32(p + 24);
+        break;
+    default:
+        break;
+    }
+}
+
+/* True if the packet is something the parser does not fully decode */
+static bool
+pipeline_packet_unsupported(const uint8_t *data, int len)
+{
+    uint16_t eth_type;
+    uint8_t next;
+
+    if (len < 14) {
+        return true;
+    }
+    eth_type = RD16(data + 12);
+    if (eth_type == ETH_TYPE_VLAN || eth_type == ETH_TYPE_QINQ) {
+        if (len < 18) {
+            return true;
+        }
+        data += 4;
+        len -= 4;
+        eth_type = RD16(data + 12);
+        if (eth_type == ETH_TYPE_VLAN || eth_type == ETH_TYPE_QINQ) {
+            /* Only the outer tag is modelled */
+            return true;
+        }
+    }
+    if (eth_type == ETH_TYPE_IPV6 && len >= 54) {
+        /* IPv6 extension headers would hide the upper layer protocol */
+        next = data[14 + 6];
+        if (next != IP_PROTO_TCP && next != IP_PROTO_UDP &&
+                next != IP_PROTO_SCTP && next != IP_PROTO_ICMPV6) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static indigo_error_t pipeline_actions_apply(
+    pipeline_state_t *state, of_list_action_t *actions, int depth);
+
+static indigo_error_t
+pipeline_output(pipeline_state_t *state, of_port_no_t port)
+{
+    if (port >= PIPELINE_PORT_MAX || port == state->fields.in_port) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+    if (state->out_port != OF_PORT_DEST_NONE) {
+        /* Forwarding sends a packet-out to a single port */
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    state->out_port = port;
+    state->out_tag = state->tag;
+    return INDIGO_ERROR_NONE;
+}
+
+/* A group with a single bucket, run on a copy of the packet */
+static indigo_error_t
+pipeline_group_apply(pipeline_state_t *state, uint32_t group_id, int depth)
+{
+    of_list_bucket_t *buckets;
+    of_bucket_t bucket;
+    of_list_action_t actions;
+    pipeline_state_t copy;
+    uint32_t type;
+    int count = 0;
+    int loop_rv;
+    indigo_error_t rv;
+
+    if (depth >= PIPELINE_MAX_DEPTH) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+    if ((buckets = ind_core_group_buckets_get(group_id, &type)) == NULL) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+    if (type != OF_GROUP_TYPE_ALL && type != OF_GROUP_TYPE_INDIRECT &&
+            type != OF_GROUP_TYPE_SELECT) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    OF_LIST_BUCKET_ITER(buckets, &bucket, loop_rv) {
+        count++;
+    }
+    if (count != 1) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    OF_LIST_BUCKET_ITER(buckets, &bucket, loop_rv) {
+        copy = *state;
+        of_bucket_actions_bind(&bucket, &actions);
+        if ((rv = pipeline_actions_apply(&copy, &actions, depth + 1)) < 0) {
+            return rv;
+        }
+        state->out_port = copy.out_port;
+        state->out_tag = copy.out_tag;
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+/* VLAN ID of a set-field action, or -1 for any other field */
+static int
+pipeline_set_field_vid(of_action_set_field_t *set_field)
+{
+    of_octets_t field;
+
+    of_action_set_field_field_get(set_field, &field);
+    if (field.bytes < 6 || RD32(field.data) != PIPELINE_OXM_VLAN_VID) {
+        return -1;
+    }
+
+    return RD16(field.data + 4) & 0xfff;
+}
+
+static void
+pipeline_vid_set(pipeline_state_t *state, uint16_t vid)
+{
+    if (!state->tag.present) {
+        /* As OF-DPA does for untagged packets */
+        state->tag.present = true;
+        state->tag.pcp = 0;
+    }
+    state->tag.vid = vid;
+    pipeline_vlan_fields_set(state);
+}
+
+static indigo_error_t
+pipeline_actions_apply(pipeline_state_t *state, of_list_action_t *actions,
+                       int depth)
+{
+    of_action_t act;
+    of_port_no_t port;
+    uint32_t group_id;
+    uint16_t eth_type;
+    int loop_rv, vid;
+    indigo_error_t rv = INDIGO_ERROR_NONE;
+
+    OF_LIST_ACTION_ITER(actions, &act, loop_rv) {
+        switch (act.header.object_id) {
+        case OF_ACTION_OUTPUT:
+            of_action_output_port_get(&act.output, &port);
+            rv = pipeline_output(state, port);
+            break;
+        case OF_ACTION_GROUP:
+            of_action_group_group_id_get(&act.group, &group_id);
+            rv = pipeline_group_apply(state, group_id, depth);
+            break;
+        case OF_ACTION_POP_VLAN:
+            if (!state->tag.present) {
+                return INDIGO_ERROR_NOT_SUPPORTED;
+            }
+            state->tag.present = false;
+            pipeline_vlan_fields_set(state);
+            break;
+        case OF_ACTION_PUSH_VLAN:
+            of_action_push_vlan_ethertype_get(&act.push_vlan, &eth_type);
+            if (eth_type != ETH_TYPE_VLAN || state->tag.present) {
+                return INDIGO_ERROR_NOT_SUPPORTED;
+            }
+            state->tag.present = true;
+            state->tag.vid = 0;
+            state->tag.pcp = 0;
+            pipeline_vlan_fields_set(state);
+            break;
+        case OF_ACTION_SET_FIELD:
+            if ((vid = pipeline_set_field_vid(&act.set_field)) < 0) {
+                return INDIGO_ERROR_NOT_SUPPORTED;
+            }
+            pipeline_vid_set(state, vid);
+            break;
+        default:
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+
+        if (rv < 0) {
+            return rv;
+        }
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+pipeline_action_set_write(pipeline_state_t *state, of_list_action_t *actions)
+{
+    of_action_t act;
+    int loop_rv, vid;
+
+    OF_LIST_ACTION_ITER(actions, &act, loop_rv) {
+        switch (act.header.object_id) {
+        case OF_ACTION_OUTPUT:
+            state->set_output = true;
+            of_action_output_port_get(&act.output, &state->set_port);
+            break;
+        case OF_ACTION_GROUP:
+            state->set_group = true;
+            of_action_group_group_id_get(&act.group, &state->set_group_id);
+            break;
+        case OF_ACTION_POP_VLAN:
+            state->set_pop_vlan = true;
+            break;
+        case OF_ACTION_SET_FIELD:
+            if ((vid = pipeline_set_field_vid(&act.set_field)) < 0) {
+                return INDIGO_ERROR_NOT_SUPPORTED;
+            }
+            state->set_vlan_vid = true;
+            state->set_vid = vid;
+            break;
+        default:
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+/* Run the action set, in the order given by the OpenFlow spec */
+static indigo_error_t
+pipeline_action_set_apply(pipeline_state_t *state)
+{
+    if (state->set_pop_vlan) {
+        if (!state->tag.present) {
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+        state->tag.present = false;
+        pipeline_vlan_fields_set(state);
+    }
+    if (state->set_vlan_vid) {
+        pipeline_vid_set(state, state->set_vid);
+    }
+    if (state->set_group) {
+        return pipeline_group_apply(state, state->set_group_id, 0);
+    }
+    if (state->set_output) {
+        return pipeline_output(state, state->set_port);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+/*
+ * Run the instructions of a flow. The instructions are run in the order
+ * given by the OpenFlow spec, not the order they were sent in.
+ */
+static indigo_error_t
+pipeline_instructions_apply(pipeline_state_t *state,
+                            of_list_instruction_t *instructions,
+                            int *next_table_id)
+{
+    of_instruction_t inst;
+    of_list_action_t apply_actions, write_actions;
+    bool apply = false, clear = false, write = false;
+    of_table_id_t table_id;
+    int loop_rv;
+    indigo_error_t rv;
+
+    *next_table_id = -1;
+
+    OF_LIST_INSTRUCTION_ITER(instructions, &inst, loop_rv) {
+        switch (inst.header.object_id) {
+        case OF_INSTRUCTION_APPLY_ACTIONS:
+            of_instruction_apply_actions_actions_bind(&inst.apply_actions,
+                                                      &apply_actions);
+            apply = true;
+            break;
+        case OF_INSTRUCTION_CLEAR_ACTIONS:
+            clear = true;
+            break;
+        case OF_INSTRUCTION_WRITE_ACTIONS:
+            of_instruction_write_actions_actions_bind(&inst.write_actions,
+                                                      &write_actions);
+            write = true;
+            break;
+        case OF_INSTRUCTION_GOTO_TABLE:
+            of_instruction_goto_table_table_id_get(&inst.goto_table, &table_id);
+            *next_table_id = table_id;
+            break;
+        default:
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+    }
+
+    if (apply && (rv = pipeline_actions_apply(state, &apply_actions, 0)) < 0) {
+        return rv;
+    }
+    if (clear) {
+        state->set_pop_vlan = false;
+        state->set_vlan_vid = false;
+        state->set_group = false;
+        state->set_output = false;
+    }
+    if (write && (rv = pipeline_action_set_write(state, &write_actions)) < 0) {
+        return rv;
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+/* Copy the packet with the VLAN tag it is sent with */
+static uint8_t *
+pipeline_packet_build(pipeline_state_t *state, const uint8_t *data, int len,
+                      int *out_len)
+{
+    bool tagged = RD16(data + 12) == ETH_TYPE_VLAN ||
+        RD16(data + 12) == ETH_TYPE_QINQ;
+    uint16_t tci;
+    uint8_t *out;
+
+    out = aim_malloc(len + 4);
+
+    if (tagged && state->out_tag.present) {
+        memcpy(out, data, len);
+        tci = (RD16(data + 14) & 0x1000) | state->out_tag.pcp << 13 |
+            state->out_tag.vid;
+        out[14] = tci >> 8;
+        out[15] = tci & 0xff;
+        *out_len = len;
+    } else if (tagged) {
+        memcpy(out, data, 12);
+        memcpy(out + 12, data + 16, len - 16);
+        *out_len = len - 4;
+    } else if (state->out_tag.present) {
+        tci = state->out_tag.pcp << 13 | state->out_tag.vid;
+        memcpy(out, data, 12);
+        out[12] = ETH_TYPE_VLAN >> 8;
+        out[13] = ETH_TYPE_VLAN & 0xff;
+        out[14] = tci >> 8;
+        out[15] = tci & 0xff;
+        memcpy(out + 16, data + 12, len - 12);
+        *out_len = len + 4;
+    } else {
+        memcpy(out, data, len);
+        *out_len = len;
+    }
+
+    return out;
+}
+
+static of_packet_out_t *
+pipeline_packet_out_build(pipeline_state_t *state, of_port_no_t in_port,
+                          of_octets_t *data)
+{
+    of_packet_out_t *packet_out;
+    of_list_action_t *actions;
+    of_action_output_t *output;
+    of_octets_t octets;
+    int ok;
+
+    packet_out = of_packet_out_new(state->version);
+    actions = of_list_action_new(state->version);
+    output = of_action_output_new(state->version);
+    if (packet_out == NULL || actions == NULL || output == NULL) {
+        of_object_delete(packet_out);
+        of_object_delete(actions);
+        of_object_delete(output);
+        return NULL;
+    }
+
+    of_packet_out_buffer_id_set(packet_out, OF_BUFFER_ID_NO_BUFFER);
+    of_packet_out_in_port_set(packet_out, in_port);
+    of_action_output_port_set(output, state->out_port);
+
+    octets.data = pipeline_packet_build(state, data->data, data->bytes,
+                                        &octets.bytes);
+
+    ok = of_list_append(actions, output) == 0 &&
+        of_packet_out_actions_set(packet_out, actions) == 0 &&
+        of_packet_out_data_set(packet_out, &octets) == 0;
+
+    aim_free(octets.data);
+    of_object_delete(actions);
+    of_object_delete(output);
+
+    if (!ok) {
+        of_object_delete(packet_out);
+        return NULL;
+    }
+
+    return packet_out;
+}
+
+/* True if the packet-out is a single output to OFPP_TABLE */
+static bool
+pipeline_packet_out_to_table(of_packet_out_t *packet_out)
+{
+    of_list_action_t actions;
+    of_action_t act;
+    of_port_no_t port;
+    int count = 0, loop_rv;
+    bool to_table = false;
+
+    of_packet_out_actions_bind(packet_out, &actions);
+    OF_LIST_ACTION_ITER(&actions, &act, loop_rv) {
+        count++;
+        if (act.header.object_id == OF_ACTION_OUTPUT) {
+            of_action_output_port_get(&act.output, &port);
+            to_table = (port == OF_PORT_DEST_USE_TABLE);
+        }
+    }
+
+    return count == 1 && to_table;
+}
+
+indigo_error_t
+ind_core_pipeline_packet_out_resolve(ft_shards_t *shards,
+                                     of_packet_out_t *packet_out,
+                                     of_packet_out_t **resolved)
+{
+    pipeline_state_t state;
+    ft_instance_t ft;
+    ft_entry_t *entry;
+    of_port_no_t in_port;
+    uint32_t buffer_id;
+    of_octets_t data;
+    int table_id = 0, next_table_id, depth;
+    indigo_error_t rv;
+
+    if (!pipeline_packet_out_to_table(packet_out)) {
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    of_packet_out_buffer_id_get(packet_out, &buffer_id);
+    of_packet_out_in_port_get(packet_out, &in_port);
+    of_packet_out_data_get(packet_out, &data);
+    if (buffer_id != OF_BUFFER_ID_NO_BUFFER ||
+            pipeline_packet_unsupported(data.data, data.bytes)) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    if (!pipeline_known_initialized) {
+        pipeline_known_init();
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.version = packet_out->version;
+    state.out_port = OF_PORT_DEST_NONE;
+    ind_core_pipeline_fields_parse(state.version, in_port, data.data,
+                                   data.bytes, &state.fields);
+    if (RD16(data.data + 12) == ETH_TYPE_VLAN ||
+            RD16(data.data + 12) == ETH_TYPE_QINQ) {
+        state.tag.present = true;
+        state.tag.vid = RD16(data.data + 14) & 0xfff;
+        state.tag.pcp = data.data[14] >> 5;
+    }
+
+    for (depth = 0; depth < PIPELINE_MAX_DEPTH; depth++) {
+        ft = ft_shards_find(shards, table_id);
+        if (ft == NULL) {
+            rv = INDIGO_ERROR_NOT_FOUND;
+        } else {
+            rv = ft_packet_match(ft, table_id, &state.fields, &pipeline_known,
+                                 &entry);
+        }
+        if (rv < 0) {
+            /* Table misses are left to Forwarding */
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+
+        if (entry->effects.actions->version == OF_VERSION_1_0) {
+            next_table_id = -1;
+            rv = pipeline_actions_apply(&state, entry->effects.actions, 0);
+        } else {
+            rv = pipeline_instructions_apply(&state, entry->effects.instructions,
+                                             &next_table_id);
+        }
+        if (rv < 0) {
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+
+        if (next_table_id < 0) {
+            break;
+        }
+        if (next_table_id <= table_id) {
+            return INDIGO_ERROR_NOT_SUPPORTED;
+        }
+        table_id = next_table_id;
+    }
+
+    if (depth == PIPELINE_MAX_DEPTH ||
+            pipeline_action_set_apply(&state) < 0 ||
+            state.out_port == OF_PORT_DEST_NONE) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    LOG_TRACE("Packet-out to table resolved to port %u", state.out_port);
+
+    if ((*resolved = pipeline_packet_out_build(&state, in_port, &data)) == NULL) {
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    return INDIGO_ERROR_NONE;
+}
@@ -0,0 +1,68 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Software pipeline lookup for packet-outs
+ *
+ * A packet-out to OFPP_TABLE is run through the flow table in software.
+ * When the flows it hits send it, unmodified but for its VLAN tag, out
+ * of a single port, the packet-out is rewritten to output to that port
+ * and Forwarding does not need to run its own pipeline lookup.
+ */
+
+#ifndef _OFSTATEMANAGER_PIPELINE_H_
+#define _OFSTATEMANAGER_PIPELINE_H_
+
+#include <indigo/indigo.h>
+#include <loci/loci.h>
+
+#include "ft_shard.h"
+
+/**
+ * Resolve a packet-out to OFPP_TABLE
+ * @param shards The flow table
+ * @param packet_out The packet-out message
+ * @param resolved (out) A new packet-out to the port the flows selected,
+ * to be deleted by the caller
+ * @returns INDIGO_ERROR_NONE if resolved; INDIGO_ERROR_NOT_FOUND if the
+ * packet-out does not output to OFPP_TABLE; INDIGO_ERROR_NOT_SUPPORTED if
+ * the pipeline does something the software lookup does not model
+ *
+ * The flow counters are not updated for resolved packets.
+ */
+
+indigo_error_t ind_core_pipeline_packet_out_resolve(
+    ft_shards_t *shards, of_packet_out_t *packet_out,
+    of_packet_out_t **resolved);
+
+/**
+ * Parse a packet into match fields
+ * @param version The OpenFlow version for the VLAN encoding
+ * @param in_port The ingress port
+ * @param data The packet
+ * @param len Length of the packet
+ * @param fields (out) The fields
+ */
+
+void ind_core_pipeline_fields_parse(of_version_t version, of_port_no_t in_port,
+                                    const uint8_t *data, int len,
+                                    of_match_fields_t *fields);
+
+#endif /* _OFSTATEMANAGER_PIPELINE_H_ */
@@ -22,6 +22,7 @@
 #include <AIM/aim_string.h>
 #include "ft.h"
 #include "ofstatemanager_decs.h"
+#include "ofstatemanager_int.h"
 #include "ofstatemanager_log.h"
 
 static ind_core_table_t *ind_core_tables[256];
@@ -32,18 +33,46 @@ ind_core_table_get(uint8_t table_id)
     return ind_core_tables[table_id];
 }
 
+/* Entries removed per delete call when emptying a table */
+#define TABLE_DELETE_BATCH_MAX 256
+
+static void
+table_entries_delete(uint8_t table_id)
+{
+    ft_entry_t *entries[TABLE_DELETE_BATCH_MAX];
+    ft_instance_t ft;
+    list_head_t *head;
+    list_links_t *cur;
+    int count;
+
+    /* Flow adds still waiting in the batch are in the table too */
+    ind_core_flow_add_flush();
+
+    if ((ft = ft_shards_find(ind_core_ft, table_id)) == NULL) {
+        return;
+    }
+    head = &ft->table_id_buckets[table_id];
+
+    while (!list_empty(head)) {
+        count = 0;
+        LIST_FOREACH(head, cur) {
+            entries[count++] = FT_ENTRY_CONTAINER(cur, table_id);
+            if (count == TABLE_DELETE_BATCH_MAX) {
+                break;
+            }
+        }
+        /* Removes them from the list */
+        ind_core_flow_entry_delete_batch(entries, count,
+                                         OF_FLOW_REMOVED_REASON_DELETE);
+    }
+}
+
 void indigo_core_table_register(uint8_t table_id, const char *name,
                                 const indigo_core_table_ops_t *ops, void *priv)
 {
     AIM_TRUE_OR_DIE(strlen(name) <= OF_MAX_TABLE_NAME_LEN);
 
-    list_links_t *cur, *next;
-    ft_entry_t *entry;
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        if (entry->table_id == table_id) {
-            ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_DELETE);
-        }
-    }
+    table_entries_delete(table_id);
 
     ind_core_table_t *table = aim_zmalloc(sizeof(*table));
     table->name = aim_strdup(name);
@@ -61,13 +90,7 @@ void indigo_core_table_unregister(uint8_t table_id)
     ind_core_table_t *table = ind_core_tables[table_id];
     AIM_TRUE_OR_DIE(table != NULL);
 
-    list_links_t *cur, *next;
-    ft_entry_t *entry;
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        if (entry->table_id == table_id) {
-            ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_DELETE);
-        }
-    }
+    table_entries_delete(table_id);
 
     aim_free(table->name);
     aim_free(table);
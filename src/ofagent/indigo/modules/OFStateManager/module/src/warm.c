@@ -0,0 +1,543 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Warm restart
+ *
+ * The checkpoint holds the state as the add messages which would
+ * recreate it: every group, then every meter, then every flow. Each
+ * message is preceded by a record header carrying the flow ID and table
+ * of flows, so that the cookie Forwarding programmed the flow with is
+ * kept, and the age of flows, so that their durations carry on from
+ * before the restart. The file is in host byte order and is only meant to be read back
+ * by the same build.
+ *
+ * Forwarding is asked to check each restored group, meter and flow is
+ * still installed; one that is not is left out.
+ *
+ * Restored objects are marked stale. An add from a controller that
+ * matches a stale object clears the mark without touching Forwarding;
+ * anything else goes through the usual handlers. When the reconcile
+ * window closes the objects still stale are deleted, flows first so the
+ * groups and meters they used are free.
+ */
+
+#include "ofstatemanager_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <OFStateManager/ofstatemanager.h>
+#include <SocketManager/socketmanager.h>
+#include <indigo/indigo.h>
+#include <indigo/forwarding.h>
+#include <loci/loci.h>
+
+#include "ofstatemanager_decs.h"
+#include "ofstatemanager_int.h"
+#include "ft_entry.h"
+#include "expiration.h"
+
+#define WARM_FILE_MAGIC "OFSMWARM"
+#define WARM_FILE_BYTE_ORDER 0x01020304
+
+typedef struct warm_file_header_s {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t count;             /* Number of records */
+} warm_file_header_t;
+
+typedef struct warm_record_header_s {
+    indigo_flow_id_t flow_id;   /* Flows only */
+    uint64_t age_ms;            /* Flows only: time since the flow was added */
+    uint32_t length;            /* Length of the message that follows */
+    uint8_t table_id;           /* Flows only */
+    uint8_t pad[3];
+} warm_record_header_t;
+
+typedef struct warm_writer_s {
+    FILE *fp;
+    uint32_t count;
+    bool failed;
+    indigo_time_t now;
+    ft_entry_t *flow;           /* Flow being written, if any */
+} warm_writer_t;
+
+/* True from a restore until the end of the reconcile window */
+static bool warm_pending;
+static bool warm_timer_running;
+
+static void ind_core_warm_reconcile_timer(void *cookie);
+
+static struct {
+    uint32_t restored;
+    uint32_t dropped;           /* Flows Forwarding no longer has */
+    uint32_t confirmed;
+} warm_stats;
+
+static void
+warm_write(void *cookie, of_object_t *obj, indigo_flow_id_t flow_id,
+           uint8_t table_id)
+{
+    warm_writer_t *writer = cookie;
+    warm_record_header_t hdr;
+
+    if (writer->failed) {
+        return;
+    }
+
+    INDIGO_MEM_CLEAR(&hdr, sizeof(hdr));
+    hdr.flow_id = flow_id;
+    hdr.length = obj->length;
+    hdr.table_id = table_id;
+    if (writer->flow != NULL && writer->now > writer->flow->insert_time) {
+        hdr.age_ms = writer->now - writer->flow->insert_time;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, writer->fp) != 1 ||
+        fwrite(OF_OBJECT_TO_MESSAGE(obj), obj->length, 1, writer->fp) != 1) {
+        writer->failed = true;
+        return;
+    }
+
+    writer->count++;
+}
+
+static void
+warm_flows_save(warm_writer_t *writer)
+{
+    list_links_t *cur, *next;
+    ft_instance_t ft;
+    ft_entry_t *entry;
+    of_flow_add_t *obj;
+    of_match_t match;
+    int i;
+
+    FT_SHARDS_FOREACH(ind_core_ft, ft, i) {
+        FT_ITER(ft, entry, cur, next) {
+            obj = of_flow_add_new(entry->effects.actions->version);
+            AIM_TRUE_OR_DIE(obj != NULL);
+
+            of_flow_add_cookie_set(obj, entry->cookie);
+            of_flow_add_priority_set(obj, entry->priority);
+            of_flow_add_idle_timeout_set(obj, entry->idle_timeout);
+            of_flow_add_hard_timeout_set(obj, entry->hard_timeout);
+            of_flow_add_flags_set(obj, entry->flags);
+            if (obj->version >= OF_VERSION_1_1) {
+                of_flow_add_table_id_set(obj, entry->table_id);
+            }
+
+            ft_entry_match_get(entry, &match);
+            if (of_flow_add_match_set(obj, &match) < 0 ||
+                (obj->version == OF_VERSION_1_0 ?
+                 of_flow_add_actions_set(obj, entry->effects.actions) :
+                 of_flow_add_instructions_set(obj, entry->effects.instructions)) < 0) {
+                LOG_ERROR("Failed to save flow " INDIGO_FLOW_ID_PRINTF_FORMAT,
+                          INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+            } else {
+                writer->flow = entry;
+                warm_write(writer, obj, entry->id, entry->table_id);
+                writer->flow = NULL;
+            }
+
+            of_object_delete(obj);
+        }
+    }
+}
+
+/**
+ * Write the state to a checkpoint for ind_core_warm_restore
+ */
+
+indigo_error_t
+ind_core_warm_save(const char *filename)
+{
+    warm_file_header_t hdr;
+    warm_writer_t writer = { NULL, 0, false, INDIGO_CURRENT_TIME, NULL };
+    char tmp[256];
+
+    if (!ind_core_init_done) {
+        return INDIGO_ERROR_INIT;
+    }
+
+    /* Anything still batched would otherwise be lost */
+    ind_core_flow_add_flush();
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp)) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    if ((writer.fp = fopen(tmp, "wb")) == NULL) {
+        LOG_ERROR("Could not open %s for the warm restart state", tmp);
+        return INDIGO_ERROR_PARAM;
+    }
+
+    /* The count is filled in once known */
+    INDIGO_MEM_CLEAR(&hdr, sizeof(hdr));
+    if (fwrite(&hdr, sizeof(hdr), 1, writer.fp) != 1) {
+        writer.failed = true;
+    }
+
+    ind_core_group_warm_save(warm_write, &writer);
+#ifdef OFDPA_FIXUP
+    ind_core_meter_warm_save(warm_write, &writer);
+#endif
+    warm_flows_save(&writer);
+
+    INDIGO_MEM_COPY(hdr.magic, WARM_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = WARM_FILE_BYTE_ORDER;
+    hdr.count = writer.count;
+    if (fseek(writer.fp, 0, SEEK_SET) != 0 ||
+        fwrite(&hdr, sizeof(hdr), 1, writer.fp) != 1) {
+        writer.failed = true;
+    }
+
+    if (fclose(writer.fp) != 0 || writer.failed ||
+        rename(tmp, filename) != 0) {
+        LOG_ERROR("Error writing the warm restart state to %s", filename);
+        unlink(tmp);
+        return INDIGO_ERROR_UNKNOWN;
+    }
+
+    LOG_INFO("Saved %u objects for warm restart to %s", writer.count, filename);
+
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+warm_flow_restore(of_flow_add_t *obj, warm_record_header_t *hdr)
+{
+    indigo_flow_id_t flow_id = hdr->flow_id;
+    ft_entry_t *entry;
+    uint8_t table_id = 0;
+    indigo_error_t rv;
+
+    if ((rv = ft_shards_add(ind_core_ft, flow_id, obj, &entry)) < 0) {
+        return rv;
+    }
+
+    /* Durations and hard timeouts count from the original add */
+    if (hdr->age_ms > 0 && entry->insert_time > hdr->age_ms) {
+        if (entry->idle_timeout || entry->hard_timeout) {
+            ind_core_expiration_remove(entry);
+            entry->insert_time -= hdr->age_ms;
+            ind_core_expiration_add(entry);
+        } else {
+            entry->insert_time -= hdr->age_ms;
+        }
+    }
+
+    rv = indigo_fwd_flow_restore(flow_id, obj, &table_id);
+    if (rv < 0) {
+        ft_shards_delete(ind_core_ft, entry);
+        return rv;
+    }
+
+    ft_shards_entry_table_id_set(ind_core_ft, entry, table_id);
+    entry->stale = 1;
+    ind_core_flow_id_reserve(flow_id);
+
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+warm_record_restore(of_object_t *obj, warm_record_header_t *hdr)
+{
+    switch (obj->object_id) {
+    case OF_GROUP_ADD:
+        return ind_core_group_warm_restore(obj);
+#ifdef OFDPA_FIXUP
+    case OF_METER_ADD:
+        return ind_core_meter_warm_restore(obj);
+#endif
+    case OF_FLOW_ADD:
+        return warm_flow_restore(obj, hdr);
+    default:
+        return INDIGO_ERROR_PARAM;
+    }
+}
+
+/**
+ * Restore the state saved by ind_core_warm_save
+ */
+
+indigo_error_t
+ind_core_warm_restore(const char *filename)
+{
+    warm_file_header_t hdr;
+    warm_record_header_t rec;
+    bool groups_linked = false;
+    indigo_error_t rv = INDIGO_ERROR_NONE;
+    of_object_t *obj;
+    uint8_t *buf;
+    uint32_t i;
+    FILE *fp;
+
+    if (!ind_core_init_done) {
+        return INDIGO_ERROR_INIT;
+    }
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        LOG_INFO("No warm restart state in %s", filename);
+        return INDIGO_ERROR_NOT_FOUND;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, WARM_FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.byte_order != WARM_FILE_BYTE_ORDER) {
+        LOG_ERROR("%s is not a warm restart state file", filename);
+        fclose(fp);
+        return INDIGO_ERROR_PARAM;
+    }
+
+    INDIGO_MEM_CLEAR(&warm_stats, sizeof(warm_stats));
+
+    for (i = 0; i < hdr.count; i++) {
+        if (fread(&rec, sizeof(rec), 1, fp) != 1 ||
+            rec.length < OF_MESSAGE_MIN_LENGTH ||
+            rec.length > 0xffff) {
+            rv = INDIGO_ERROR_PARSE;
+            break;
+        }
+
+        /* LOCI frees the message buffer with free() */
+        buf = malloc(rec.length);
+        AIM_TRUE_OR_DIE(buf != NULL);
+        if (fread(buf, rec.length, 1, fp) != 1) {
+            free(buf);
+            rv = INDIGO_ERROR_PARSE;
+            break;
+        }
+
+        /* The object owns the buffer from here */
+        if ((obj = of_object_new_from_message(OF_BUFFER_TO_MESSAGE(buf),
+                                              rec.length)) == NULL) {
+            free(buf);
+            rv = INDIGO_ERROR_PARSE;
+            break;
+        }
+
+        /* Groups come first; link them up before any flow refers to one */
+        if (!groups_linked && obj->object_id != OF_GROUP_ADD) {
+            ind_core_group_warm_link();
+            groups_linked = true;
+        }
+
+        if (warm_record_restore(obj, &rec) == INDIGO_ERROR_NONE) {
+            warm_stats.restored++;
+        } else if (obj->object_id == OF_FLOW_ADD) {
+            LOG_VERBOSE("Flow " INDIGO_FLOW_ID_PRINTF_FORMAT " not restored",
+                        INDIGO_FLOW_ID_PRINTF_ARG(rec.flow_id));
+            warm_stats.dropped++;
+        } else {
+            LOG_WARN("Could not restore %s", of_object_id_str[obj->object_id]);
+        }
+
+        of_object_delete(obj);
+    }
+
+    if (!groups_linked) {
+        ind_core_group_warm_link();
+    }
+
+    fclose(fp);
+    unlink(filename);
+
+    if (rv != INDIGO_ERROR_NONE) {
+        LOG_ERROR("Truncated warm restart state in %s after %u records",
+                  filename, i);
+    }
+
+    LOG_INFO("Warm restart: restored %u objects, %u flows no longer installed",
+             warm_stats.restored, warm_stats.dropped);
+
+    warm_pending = warm_stats.restored > 0;
+
+    return rv;
+}
+
+bool
+ind_core_warm_list_equal(of_object_t *a, of_object_t *b)
+{
+    return a->version == b->version &&
+        a->length == b->length &&
+        memcmp(OF_OBJECT_BUFFER_INDEX(a, 0),
+               OF_OBJECT_BUFFER_INDEX(b, 0), a->length) == 0;
+}
+
+void
+ind_core_warm_confirmed(void)
+{
+    warm_stats.confirmed++;
+}
+
+bool
+ind_core_warm_flow_confirm(ft_entry_t *entry, of_flow_modify_t *obj)
+{
+    uint64_t cookie;
+    uint16_t idle_timeout, hard_timeout, flags;
+    uint8_t table_id = 0;
+    of_object_t *list;
+    bool equal;
+
+    of_flow_modify_cookie_get(obj, &cookie);
+    of_flow_modify_idle_timeout_get(obj, &idle_timeout);
+    of_flow_modify_hard_timeout_get(obj, &hard_timeout);
+    of_flow_modify_flags_get(obj, &flags);
+    if (obj->version >= OF_VERSION_1_1) {
+        of_flow_modify_table_id_get(obj, &table_id);
+    }
+
+    if (cookie != entry->cookie || idle_timeout != entry->idle_timeout ||
+        hard_timeout != entry->hard_timeout || flags != entry->flags ||
+        (obj->version >= OF_VERSION_1_1 && table_id != entry->table_id)) {
+        return false;
+    }
+
+    if (obj->version == OF_VERSION_1_0) {
+        list = of_flow_modify_actions_get(obj);
+    } else {
+        list = of_flow_modify_instructions_get(obj);
+    }
+    if (list == NULL) {
+        return false;
+    }
+
+    equal = ind_core_warm_list_equal(entry->effects.actions, list);
+    of_object_delete(list);
+
+    if (equal) {
+        entry->stale = 0;
+        warm_stats.confirmed++;
+    }
+
+    return equal;
+}
+
+/**
+ * Delete whatever was restored and not added again by a controller
+ */
+
+void
+ind_core_warm_reconcile_end(void)
+{
+    list_links_t *cur, *next;
+    ft_instance_t ft;
+    ft_entry_t *entry;
+    int flows = 0, groups, meters = 0;
+    int i;
+
+    if (warm_timer_running) {
+        ind_soc_timer_event_unregister(ind_core_warm_reconcile_timer, NULL);
+        warm_timer_running = false;
+    }
+
+    if (!warm_pending) {
+        return;
+    }
+    warm_pending = false;
+
+    ind_core_flow_add_flush();
+
+    FT_SHARDS_FOREACH(ind_core_ft, ft, i) {
+        FT_ITER(ft, entry, cur, next) {
+            if (entry->stale) {
+                ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_DELETE);
+                flows++;
+            }
+        }
+    }
+
+#ifdef OFDPA_FIXUP
+    meters = ind_core_meter_warm_sweep();
+#endif
+    groups = ind_core_group_warm_sweep();
+
+    LOG_INFO("State reconciled: %u confirmed; deleted %d flows, "
+             "%d groups, %d meters", warm_stats.confirmed,
+             flows, groups, meters);
+}
+
+static void
+ind_core_warm_reconcile_timer(void *cookie)
+{
+    ind_core_warm_reconcile_end();
+}
+
+/**
+ * Mark all state stale when the last controller disconnects in
+ * INDIGO_CORE_DISCONNECTED_MODE_RECONCILE. Nothing is removed from
+ * Forwarding; the next controller to connect reconciles the state as it
+ * would a restored checkpoint.
+ */
+
+void
+ind_core_warm_disconnect_mark(void)
+{
+    list_links_t *cur, *next;
+    ft_instance_t ft;
+    ft_entry_t *entry;
+    uint32_t marked = 0;
+    int i;
+
+    /* A window still open from an earlier reconnect starts over */
+    if (warm_timer_running) {
+        ind_soc_timer_event_unregister(ind_core_warm_reconcile_timer, NULL);
+        warm_timer_running = false;
+    }
+
+    ind_core_flow_add_flush();
+
+    FT_SHARDS_FOREACH(ind_core_ft, ft, i) {
+        FT_ITER(ft, entry, cur, next) {
+            entry->stale = 1;
+            marked++;
+        }
+    }
+    marked += ind_core_group_warm_mark();
+#ifdef OFDPA_FIXUP
+    marked += ind_core_meter_warm_mark();
+#endif
+
+    INDIGO_MEM_CLEAR(&warm_stats, sizeof(warm_stats));
+    warm_stats.restored = marked;
+    warm_pending = marked > 0;
+
+    LOG_INFO("Controllers disconnected, keeping %u objects to reconcile", marked);
+}
+
+void
+ind_core_warm_connection_notify(int count)
+{
+    if (!warm_pending || warm_timer_running || count <= 0) {
+        return;
+    }
+
+    if (ind_soc_timer_event_register(ind_core_warm_reconcile_timer, NULL,
+                                     OFSTATEMANAGER_CONFIG_WARM_RECONCILE_MS)
+        == INDIGO_ERROR_NONE) {
+        warm_timer_running = true;
+    } else {
+        LOG_ERROR("Could not start the warm restart reconcile timer");
+    }
+}
@@ -45,6 +45,13 @@ indigo_fwd_vlan_stats_get(
     /* All counters default to -1 */
 }
 
+WEAK indigo_error_t
+indigo_fwd_vlan_active_get(
+    aim_bitmap_hdr_t *vlans)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
 WEAK void
 indigo_port_extended_stats_get(
     of_port_no_t port_no,
@@ -62,6 +69,126 @@ indigo_fwd_flow_create(
     return INDIGO_ERROR_BAD_TABLE_ID;
 }
 
+WEAK indigo_error_t
+indigo_fwd_flow_create_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    of_flow_add_t **flow_adds,
+    uint8_t *table_ids,
+    indigo_error_t *results)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        results[i] = indigo_fwd_flow_create(flow_ids[i], flow_adds[i],
+                                            &table_ids[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_flow_modify_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    of_flow_modify_t *flow_modify,
+    indigo_error_t *results)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        results[i] = indigo_fwd_flow_modify(flow_ids[i], flow_modify);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_flow_delete_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    indigo_fi_flow_stats_t *flow_stats,
+    indigo_error_t *results)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        results[i] = indigo_fwd_flow_delete(flow_ids[i], &flow_stats[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_packet_out_batch(
+    int count,
+    of_packet_out_t **packet_outs,
+    indigo_error_t *results)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        results[i] = indigo_fwd_packet_out(packet_outs[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_table_features_get(
+    of_table_features_stats_request_t *table_features_request,
+    of_table_features_stats_reply_t **table_features_reply)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+WEAK indigo_error_t
+indigo_fwd_flow_space_check(
+    uint8_t table_id)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_group_space_check(
+    uint32_t id)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_flow_restore(
+    indigo_cookie_t flow_id,
+    of_flow_add_t *flow_add,
+    uint8_t *table_id)
+{
+    *table_id = 0;
+    if (flow_add->version >= OF_VERSION_1_1) {
+        of_flow_add_table_id_get(flow_add, table_id);
+    }
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK indigo_error_t
+indigo_fwd_group_restore(
+    uint32_t id,
+    uint8_t group_type,
+    of_list_bucket_t *buckets)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+#ifdef OFDPA_FIXUP
+WEAK indigo_error_t
+indigo_fwd_meter_restore(
+    uint32_t id,
+    uint16_t flag,
+    of_list_meter_band_t *meters)
+{
+    return INDIGO_ERROR_NONE;
+}
+#endif
+
 WEAK indigo_error_t
 indigo_fwd_flow_modify(
     indigo_cookie_t flow_id,
@@ -94,4 +221,21 @@ indigo_fwd_flow_hit_status_get(
     return INDIGO_ERROR_BAD_TABLE_ID;
 }
 
+WEAK indigo_error_t
+indigo_fwd_flow_hit_status_get_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    bool *hit_status,
+    indigo_error_t *results)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        results[i] = indigo_fwd_flow_hit_status_get(flow_ids[i],
+                                                    &hit_status[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
 #endif
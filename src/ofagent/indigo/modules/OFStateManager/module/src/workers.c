@@ -0,0 +1,181 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Worker threads for CPU bound reply encoding
+ *
+ * The threads sleep until ind_core_workers_run posts a batch of jobs.
+ * Jobs are handed out by index under the lock; the caller takes jobs
+ * too, then waits for the workers to finish the ones they took.
+ */
+
+#include <pthread.h>
+#include <AIM/aim.h>
+
+#include "ofstatemanager_log.h"
+#include "ofstatemanager_int.h"
+#include "workers.h"
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t posted;      /* A batch was posted, or stopping */
+    pthread_cond_t finished;    /* The last job of the batch finished */
+    pthread_t *threads;
+    int count;
+    int stopping;
+
+    /* The current batch */
+    uint64_t generation;
+    ind_core_worker_job_f fn;
+    void *cookie;
+    int jobs;
+    int next_job;
+    int running;                /* Jobs taken but not finished */
+} workers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .posted = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+};
+
+/* Take and run jobs of the current batch until none are left; locked */
+static void
+workers_drain(void)
+{
+    while (workers.next_job < workers.jobs) {
+        int job = workers.next_job++;
+        ind_core_worker_job_f fn = workers.fn;
+        void *cookie = workers.cookie;
+
+        workers.running++;
+        pthread_mutex_unlock(&workers.lock);
+        fn(cookie, job);
+        pthread_mutex_lock(&workers.lock);
+        if (--workers.running == 0 && workers.next_job == workers.jobs) {
+            pthread_cond_signal(&workers.finished);
+        }
+    }
+}
+
+static void *
+workers_main(void *arg)
+{
+    uint64_t generation = 0;
+
+    (void)arg;
+
+    pthread_mutex_lock(&workers.lock);
+    while (!workers.stopping) {
+        if (workers.generation == generation) {
+            pthread_cond_wait(&workers.posted, &workers.lock);
+            continue;
+        }
+        generation = workers.generation;
+        workers_drain();
+    }
+    pthread_mutex_unlock(&workers.lock);
+
+    return NULL;
+}
+
+indigo_error_t
+ind_core_workers_init(int count)
+{
+    int i;
+
+    if (count <= 0 || workers.threads != NULL) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    workers.threads = aim_zmalloc(count * sizeof(pthread_t));
+    workers.stopping = 0;
+    for (i = 0; i < count; i++) {
+        if (pthread_create(&workers.threads[i], NULL, workers_main, NULL) != 0) {
+            LOG_ERROR("Failed to start worker thread %d", i);
+            break;
+        }
+    }
+    workers.count = i;
+
+    if (workers.count == 0) {
+        aim_free(workers.threads);
+        workers.threads = NULL;
+        return INDIGO_ERROR_RESOURCE;
+    }
+
+    LOG_INFO("Started %d worker threads", workers.count);
+    return INDIGO_ERROR_NONE;
+}
+
+void
+ind_core_workers_finish(void)
+{
+    int i;
+
+    if (workers.threads == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&workers.lock);
+    workers.stopping = 1;
+    pthread_cond_broadcast(&workers.posted);
+    pthread_mutex_unlock(&workers.lock);
+
+    for (i = 0; i < workers.count; i++) {
+        pthread_join(workers.threads[i], NULL);
+    }
+
+    aim_free(workers.threads);
+    workers.threads = NULL;
+    workers.count = 0;
+}
+
+int
+ind_core_workers_count(void)
+{
+    return workers.count;
+}
+
+void
+ind_core_workers_run(int jobs, ind_core_worker_job_f fn, void *cookie)
+{
+    int job;
+
+    if (workers.count == 0 || jobs <= 1) {
+        for (job = 0; job < jobs; job++) {
+            fn(cookie, job);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&workers.lock);
+    workers.fn = fn;
+    workers.cookie = cookie;
+    workers.jobs = jobs;
+    workers.next_job = 0;
+    workers.running = 0;
+    workers.generation++;
+    pthread_cond_broadcast(&workers.posted);
+
+    workers_drain();
+    while (workers.running > 0) {
+        pthread_cond_wait(&workers.finished, &workers.lock);
+    }
+    pthread_mutex_unlock(&workers.lock);
+}
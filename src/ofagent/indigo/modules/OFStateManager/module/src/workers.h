@@ -0,0 +1,63 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Worker threads for CPU bound reply encoding
+ *
+ * The state manager runs on the event loop thread. A few jobs, such as
+ * encoding a large flow stats reply, only read state that the loop does
+ * not change while they run, and can be split across worker threads.
+ * ind_core_workers_run blocks the loop until every job is done, so the
+ * jobs see the flowtable as it is and need no locking.
+ */
+
+#ifndef _OFSTATEMANAGER_WORKERS_H_
+#define _OFSTATEMANAGER_WORKERS_H_
+
+#include <indigo/indigo.h>
+
+typedef void (*ind_core_worker_job_f)(void *cookie, int job);
+
+/**
+ * Start the worker threads
+ * @param count Number of threads, 0 to run every job on the caller
+ */
+indigo_error_t ind_core_workers_init(int count);
+
+/**
+ * Stop the worker threads
+ */
+void ind_core_workers_finish(void);
+
+/**
+ * Number of worker threads running
+ */
+int ind_core_workers_count(void);
+
+/**
+ * Run fn(cookie, job) for each job in [0, jobs) on the worker threads
+ * and the calling thread, and return once all of them have finished
+ *
+ * The jobs must not change state owned by the event loop or send
+ * messages.
+ */
+void ind_core_workers_run(int jobs, ind_core_worker_job_f fn, void *cookie);
+
+#endif /* _OFSTATEMANAGER_WORKERS_H_ */
@@ -0,0 +1,395 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Flow expiration benchmark
+ *
+ * Not part of the unit test; run "utest_OFStateManager expiration-bench
+ * [FLOWS...]" or "make expiration-bench" in targets/utests/OFStateManager.
+ *
+ * The flows of flow_bench.c are added to the agent's flowtable with a mix
+ * of timeouts: a quarter idle only, a quarter hard only and half both.
+ * They are put in a table registered here, whose hit status operation
+ * reports a fixed share of the flows as hit. For each flow count and hit
+ * share:
+ *
+ * add: ind_core_expiration_add, with the flows aged so that all of them
+ * are due, spread over the last EXPIRATION_BENCH_SPREAD_MS.
+ *
+ * expire: the expiration task run from the event loop until every flow
+ * has been deleted or found hit. Per op is per flow. The loop iterations
+ * it took and the longest and mean iteration are the time the loop was
+ * kept from everything else.
+ */
+
+#define AIM_LOG_MODULE_NAME ofstatemanager_utest
+#include <AIM/aim_log.h>
+
+#include <OFStateManager/ofstatemanager.h>
+#include <indigo/of_state_manager.h>
+#include <SocketManager/socketmanager.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <loci/loci.h>
+#include <ft.h>
+#include <expiration.h>
+
+#include "ofstatemanager_decs.h"
+
+/* Defined in flow_bench.c */
+void bench_mix_init(void);
+of_flow_modify_t *bench_flow_new(of_object_id_t type, uint32_t idx,
+                                 int version);
+
+#define EXPIRATION_BENCH_TABLE 30
+
+/* The flows are due over this much time before the task runs */
+#define EXPIRATION_BENCH_SPREAD_MS 2000
+
+/* Give up on a run after this many loop iterations */
+#define EXPIRATION_BENCH_MAX_ITERATIONS 10000000
+
+static const int expiration_bench_default_counts[] = { 100000, 1000000 };
+
+/* Percent of the idle timeout candidates reported as hit */
+static const int expiration_bench_hit_percents[] = { 0, 50, 90 };
+
+static struct {
+    int hit_percent;
+    uint64_t deletes;
+    uint64_t hits;
+    uint64_t hit_calls;         /* Batch calls */
+} expiration_bench_table;
+
+static uint64_t
+expiration_bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Deterministic per flow value in [0, 100) */
+static int
+expiration_bench_percentile(uint32_t idx)
+{
+    return ((idx * 2654435761u) >> 8) % 100;
+}
+
+/****************************************************************
+ * Table operations
+ *
+ * Entries are added with ft_add, not through the table, so the entry
+ * private data is set to the flow index plus one.
+ ****************************************************************/
+
+static indigo_error_t
+expiration_bench_entry_create(void *table_priv, of_flow_add_t *obj,
+                              indigo_cookie_t flow_id, void **entry_priv)
+{
+    *entry_priv = NULL;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+expiration_bench_entry_modify(void *table_priv, void *entry_priv,
+                              of_flow_modify_strict_t *obj)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+expiration_bench_entry_delete(void *table_priv, void *entry_priv,
+                              indigo_fi_flow_stats_t *flow_stats)
+{
+    expiration_bench_table.deletes++;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+expiration_bench_entry_stats_get(void *table_priv, void *entry_priv,
+                                 indigo_fi_flow_stats_t *flow_stats)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+expiration_bench_entry_hit_status_get(void *table_priv, void *entry_priv,
+                                      bool *hit_status)
+{
+    uint32_t idx = (uintptr_t)entry_priv - 1;
+
+    *hit_status = expiration_bench_percentile(idx) <
+        expiration_bench_table.hit_percent;
+    if (*hit_status) {
+        expiration_bench_table.hits++;
+    }
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+expiration_bench_entry_hit_status_get_batch(void *table_priv, int count,
+                                            void **entry_privs,
+                                            bool *hit_status,
+                                            indigo_error_t *results)
+{
+    int i;
+
+    expiration_bench_table.hit_calls++;
+    for (i = 0; i < count; i++) {
+        results[i] = expiration_bench_entry_hit_status_get(
+            table_priv, entry_privs[i], &hit_status[i]);
+    }
+    return INDIGO_ERROR_NONE;
+}
+
+static const indigo_core_table_ops_t expiration_bench_ops = {
+    .entry_create = expiration_bench_entry_create,
+    .entry_modify = expiration_bench_entry_modify,
+    .entry_delete = expiration_bench_entry_delete,
+    .entry_stats_get = expiration_bench_entry_stats_get,
+    .entry_hit_status_get = expiration_bench_entry_hit_status_get,
+    .entry_hit_status_get_batch = expiration_bench_entry_hit_status_get_batch,
+};
+
+/****************************************************************
+ * Runs
+ ****************************************************************/
+
+/* Timeouts of flow idx, in seconds */
+static void
+expiration_bench_timeouts(uint32_t idx, uint16_t *idle_timeout,
+                          uint16_t *hard_timeout)
+{
+    int r = expiration_bench_percentile(idx ^ 0x5a5a5a5a);
+
+    *idle_timeout = 0;
+    *hard_timeout = 0;
+    switch (idx % 4) {
+    case 0:
+        *idle_timeout = 10 + r / 2;
+        break;
+    case 1:
+        *hard_timeout = 30 + r * 6;
+        break;
+    default:
+        *idle_timeout = 10 + r / 2;
+        *hard_timeout = 300 + r * 36;
+        break;
+    }
+}
+
+static void
+expiration_bench_populate(int count, ft_entry_t **entries)
+{
+    of_flow_add_t *obj;
+    uint16_t idle_timeout, hard_timeout;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        obj = bench_flow_new(OF_FLOW_ADD, i, 0);
+        expiration_bench_timeouts(i, &idle_timeout, &hard_timeout);
+        of_flow_add_table_id_set(obj, EXPIRATION_BENCH_TABLE);
+        of_flow_add_idle_timeout_set(obj, idle_timeout);
+        of_flow_add_hard_timeout_set(obj, hard_timeout);
+
+        AIM_TRUE_OR_DIE(ft_shards_add(ind_core_ft, i + 1, obj,
+                                      &entries[i]) == INDIGO_ERROR_NONE);
+        ft_shards_entry_table_id_set(ind_core_ft, entries[i],
+                                     EXPIRATION_BENCH_TABLE);
+        entries[i]->priv = (void *)(uintptr_t)(i + 1);
+
+        of_object_delete(obj);
+    }
+}
+
+/*
+ * Age every flow past the timeout it expires by, spread over the last
+ * EXPIRATION_BENCH_SPREAD_MS, and time adding them back to the wheel.
+ * Returns the nanoseconds taken by ind_core_expiration_add.
+ */
+static uint64_t
+expiration_bench_age(int count, ft_entry_t **entries)
+{
+    indigo_time_t now, late;
+    uint64_t start;
+    ft_entry_t *entry;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        ind_core_expiration_remove(entries[i]);
+    }
+
+    now = indigo_loop_time_refresh();
+    for (i = 0; i < count; i++) {
+        entry = entries[i];
+        late = 1 + expiration_bench_percentile(i) *
+            EXPIRATION_BENCH_SPREAD_MS / 100;
+        if (entry->idle_timeout) {
+            entry->last_counter_change = now - entry->idle_timeout * 1000 - late;
+            entry->insert_time = entry->last_counter_change;
+        } else {
+            entry->insert_time = now - entry->hard_timeout * 1000 - late;
+        }
+    }
+
+    start = expiration_bench_now_ns();
+    for (i = 0; i < count; i++) {
+        ind_core_expiration_add(entries[i]);
+    }
+    return expiration_bench_now_ns() - start;
+}
+
+static int
+expiration_bench_run(int count, int hit_percent, ft_entry_t **entries)
+{
+    uint64_t add_ns, start, elapsed, total_ns = 0, max_ns = 0;
+    uint64_t iterations = 0;
+    list_links_t *cur, *next;
+    ft_instance_t ft;
+    ft_entry_t *entry;
+    int i, rv = 0;
+
+    MEMSET(&expiration_bench_table, 0, sizeof(expiration_bench_table));
+    expiration_bench_table.hit_percent = hit_percent;
+
+    expiration_bench_populate(count, entries);
+    add_ns = expiration_bench_age(count, entries);
+
+    ind_core_expiration_timer(NULL);
+    while (expiration_bench_table.deletes + expiration_bench_table.hits <
+               (uint64_t)count &&
+           iterations < EXPIRATION_BENCH_MAX_ITERATIONS) {
+        start = expiration_bench_now_ns();
+        ind_soc_select_and_run(0);
+        elapsed = expiration_bench_now_ns() - start;
+        total_ns += elapsed;
+        if (elapsed > max_ns) {
+            max_ns = elapsed;
+        }
+        iterations++;
+    }
+
+    if (expiration_bench_table.deletes + expiration_bench_table.hits !=
+            (uint64_t)count) {
+        AIM_LOG_ERROR("Expired %"PRIu64" and kept %"PRIu64" of %d flows",
+                      expiration_bench_table.deletes,
+                      expiration_bench_table.hits, count);
+        rv = -1;
+    }
+
+    printf("%9d %5d%% %10.1f %10.1f %10"PRIu64" %10.3f %10.3f %10"PRIu64"\n",
+           count, hit_percent, (double)add_ns / count,
+           (double)total_ns / count, iterations,
+           (double)max_ns / 1e6,
+           iterations ? (double)total_ns / iterations / 1e6 : 0.0,
+           expiration_bench_table.hit_calls);
+    fflush(stdout);
+
+    /* The flows found hit are still in the table */
+    FT_SHARDS_FOREACH(ind_core_ft, ft, i) {
+        FT_ITER(ft, entry, cur, next) {
+            ft_delete(ft, entry);
+        }
+    }
+
+    /* Let the task see the wheel is empty */
+    ind_soc_select_and_run(0);
+
+    return rv;
+}
+
+static int
+expiration_bench_count(int count)
+{
+    ft_entry_t **entries = aim_zmalloc(count * sizeof(*entries));
+    int i, rv = 0;
+
+    for (i = 0; i < AIM_ARRAYSIZE(expiration_bench_hit_percents); i++) {
+        rv |= expiration_bench_run(count, expiration_bench_hit_percents[i],
+                                   entries);
+    }
+
+    aim_free(entries);
+    return rv;
+}
+
+/**
+ * Run the benchmark for each flow count in argv, or for 100k and 1M
+ * flows.
+ */
+int
+expiration_bench(int argc, char *argv[])
+{
+    ind_core_config_t core;
+    int i, count, max_count = 0, rv = 0;
+
+    for (i = 0; i < argc; i++) {
+        count = atoi(argv[i]);
+        if (count <= 0) {
+            AIM_LOG_ERROR("Bad flow count %s", argv[i]);
+            return 1;
+        }
+        if (count > max_count) {
+            max_count = count;
+        }
+    }
+    if (argc == 0) {
+        max_count = expiration_bench_default_counts[
+            AIM_ARRAYSIZE(expiration_bench_default_counts) - 1];
+    }
+
+    /* The expiration timer is not registered; the task is started here */
+    MEMSET(&core, 0, sizeof(core));
+    core.max_flowtable_entries = max_count;
+    if (ind_core_init(&core) < 0) {
+        AIM_LOG_ERROR("Failed to start OFStateManager");
+        return 1;
+    }
+    indigo_core_table_register(EXPIRATION_BENCH_TABLE, "expiration bench",
+                               &expiration_bench_ops, NULL);
+
+    bench_mix_init();
+
+    printf("Timeouts: 25%% idle, 25%% hard, 50%% both; all due within %d ms\n",
+           EXPIRATION_BENCH_SPREAD_MS);
+    printf("%9s %6s %10s %10s %10s %10s %10s %10s\n", "flows", "hit",
+           "add ns/op", "exp ns/op", "iters", "max ms", "mean ms",
+           "hit calls");
+
+    if (argc == 0) {
+        for (i = 0; i < AIM_ARRAYSIZE(expiration_bench_default_counts); i++) {
+            rv |= expiration_bench_count(expiration_bench_default_counts[i]);
+        }
+    } else {
+        for (i = 0; i < argc; i++) {
+            rv |= expiration_bench_count(atoi(argv[i]));
+        }
+    }
+
+    indigo_core_table_unregister(EXPIRATION_BENCH_TABLE);
+    ind_core_finish();
+
+    return rv < 0 ? 1 : 0;
+}
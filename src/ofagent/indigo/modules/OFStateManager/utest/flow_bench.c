@@ -0,0 +1,414 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Flow-mod install rate benchmark
+ *
+ * Not part of the unit test; run "utest_OFStateManager bench [FLOWS...]"
+ * or "make bench" in targets/utests/OFStateManager.
+ *
+ * For each flow count an OF-DPA like mix of flows is added, modified
+ * and deleted through indigo_core_receive_controller_message, against
+ * the stub forwarding functions in main.c. The rates cover the handlers,
+ * the flowtable and LOCI parsing, but not a driver. Building the
+ * messages is timed on its own and taken out of the rates.
+ */
+
+#define AIM_LOG_MODULE_NAME ofstatemanager_utest
+#include <AIM/aim_log.h>
+
+#include <OFStateManager/ofstatemanager.h>
+#include <OFStateManager/ofstatemanager_config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <loci/loci.h>
+#include <indigo/forwarding.h>
+
+#include "ofstatemanager_decs.h"
+
+extern void handle_message(of_object_t *obj);
+extern int do_barrier(void);
+
+enum bench_kind {
+    BENCH_VLAN,
+    BENCH_TERMINATION_MAC,
+    BENCH_UNICAST_24,
+    BENCH_UNICAST_32,
+    BENCH_BRIDGING,
+    BENCH_ACL,
+    BENCH_KIND_COUNT
+};
+
+/* Flow mix, in percent of the flows of a run */
+static const struct {
+    const char *name;
+    uint8_t table_id;
+    uint16_t priority;
+    int percent;
+} bench_mix[BENCH_KIND_COUNT] = {
+    [BENCH_VLAN]            = { "vlan",         10,  0, 10 },
+    [BENCH_TERMINATION_MAC] = { "term-mac",     20,  0,  5 },
+    [BENCH_UNICAST_24]      = { "unicast/24",   30, 24, 30 },
+    [BENCH_UNICAST_32]      = { "unicast/32",   30, 32, 30 },
+    [BENCH_BRIDGING]        = { "bridging",     50,  0, 20 },
+    [BENCH_ACL]             = { "acl",          60, 10,  5 },
+};
+
+static const int bench_default_counts[] = { 10000, 100000, 1000000 };
+
+/* Kind of each flow in a block of 100, and its rank among that kind */
+static uint8_t bench_kind[100];
+static uint8_t bench_rank[100];
+
+void
+bench_mix_init(void)
+{
+    int kind, i, pos = 0;
+
+    for (kind = 0; kind < BENCH_KIND_COUNT; kind++) {
+        for (i = 0; i < bench_mix[kind].percent; i++) {
+            bench_kind[pos] = kind;
+            bench_rank[pos] = i;
+            pos++;
+        }
+    }
+    AIM_TRUE_OR_DIE(pos == 100, "flow mix does not add up to 100%%");
+}
+
+static uint64_t
+bench_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t
+bench_heap_used(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return (unsigned int)mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static void
+bench_action_append(of_list_action_t *actions, of_object_t *action)
+{
+    of_list_append(actions, action);
+    of_object_delete(action);
+}
+
+static void
+bench_instruction_append(of_list_instruction_t *insts, of_object_t *inst)
+{
+    of_list_append(insts, inst);
+    of_object_delete(inst);
+}
+
+/* The instructions OF-DPA takes in each table; version changes the
+   group or port written so a modify has something to change */
+static void
+bench_instructions_set(of_flow_modify_t *obj, int kind, uint32_t key,
+                       int version)
+{
+    of_list_instruction_t *insts;
+    of_list_action_t *actions;
+    of_object_t *inst, *action;
+    uint8_t next_table_id = 0;
+
+    insts = of_list_instruction_new(OF_VERSION_1_3);
+    actions = of_list_action_new(OF_VERSION_1_3);
+
+    switch (kind) {
+    case BENCH_VLAN:
+        next_table_id = bench_mix[BENCH_TERMINATION_MAC].table_id;
+        break;
+    case BENCH_TERMINATION_MAC:
+        next_table_id = bench_mix[BENCH_UNICAST_24].table_id;
+        break;
+    case BENCH_UNICAST_24:
+    case BENCH_UNICAST_32:
+        /* L3 unicast group */
+        action = of_action_group_new(OF_VERSION_1_3);
+        of_action_group_group_id_set(action,
+            0x20000000 | ((key + version) & 0xfffffff));
+        bench_action_append(actions, action);
+        next_table_id = bench_mix[BENCH_ACL].table_id;
+        break;
+    case BENCH_BRIDGING:
+        /* L2 interface group */
+        action = of_action_group_new(OF_VERSION_1_3);
+        of_action_group_group_id_set(action,
+            (((key % 4094) + 1) << 16) | ((key + version) % 48 + 1));
+        bench_action_append(actions, action);
+        next_table_id = bench_mix[BENCH_ACL].table_id;
+        break;
+    case BENCH_ACL:
+        action = of_action_output_new(OF_VERSION_1_3);
+        of_action_output_port_set(action, (key + version) % 48 + 1);
+        bench_action_append(actions, action);
+        break;
+    }
+
+    if (actions->length > 0) {
+        inst = of_instruction_write_actions_new(OF_VERSION_1_3);
+        AIM_TRUE_OR_DIE(of_instruction_write_actions_actions_set(
+                            inst, actions) == OF_ERROR_NONE);
+        bench_instruction_append(insts, inst);
+    }
+
+    if (next_table_id != 0) {
+        inst = of_instruction_goto_table_new(OF_VERSION_1_3);
+        of_instruction_goto_table_table_id_set(inst, next_table_id);
+        bench_instruction_append(insts, inst);
+    }
+
+    AIM_TRUE_OR_DIE(of_flow_modify_instructions_set(obj, insts) ==
+                    OF_ERROR_NONE);
+    of_object_delete(actions);
+    of_object_delete(insts);
+}
+
+/* Flow idx of the mix, as an add, strict modify or strict delete. Every
+   idx has a match of its own. Also used by ft_bench.c. */
+of_flow_modify_t *
+bench_flow_new(of_object_id_t type, uint32_t idx, int version)
+{
+    of_flow_modify_t *obj;
+    of_match_t match;
+    int kind = bench_kind[idx % 100];
+    uint32_t key = (idx / 100) * bench_mix[kind].percent + bench_rank[idx % 100];
+
+    switch (type) {
+    case OF_FLOW_ADD:
+        obj = of_flow_add_new(OF_VERSION_1_3);
+        break;
+    case OF_FLOW_MODIFY_STRICT:
+        obj = of_flow_modify_strict_new(OF_VERSION_1_3);
+        break;
+    default:
+        obj = of_flow_delete_strict_new(OF_VERSION_1_3);
+        break;
+    }
+    AIM_TRUE_OR_DIE(obj != NULL);
+
+    MEMSET(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+
+    switch (kind) {
+    case BENCH_VLAN:
+        match.fields.in_port = key / 4094 + 1;
+        match.masks.in_port = 0xffffffff;
+        match.fields.vlan_vid = 0x1000 | (key % 4094 + 1);
+        match.masks.vlan_vid = 0x1fff;
+        break;
+    case BENCH_TERMINATION_MAC:
+        match.fields.eth_type = 0x0800;
+        match.masks.eth_type = 0xffff;
+        match.fields.eth_dst.addr[0] = 0x00;
+        match.fields.eth_dst.addr[1] = 0x00;
+        match.fields.eth_dst.addr[2] = 0x5e;
+        match.fields.eth_dst.addr[3] = key >> 16;
+        match.fields.eth_dst.addr[4] = key >> 8;
+        match.fields.eth_dst.addr[5] = key;
+        MEMSET(&match.masks.eth_dst, 0xff, sizeof(match.masks.eth_dst));
+        break;
+    case BENCH_UNICAST_24:
+        match.fields.eth_type = 0x0800;
+        match.masks.eth_type = 0xffff;
+        match.fields.ofdpa_vrf = key >> 16;
+        match.masks.ofdpa_vrf = 0xffff;
+        match.fields.ipv4_dst = 0x0a000000 | ((key & 0xffff) << 8);
+        match.masks.ipv4_dst = 0xffffff00;
+        break;
+    case BENCH_UNICAST_32:
+        match.fields.eth_type = 0x0800;
+        match.masks.eth_type = 0xffff;
+        match.fields.ofdpa_vrf = key >> 24;
+        match.masks.ofdpa_vrf = 0xffff;
+        match.fields.ipv4_dst = 0xac000000 | (key & 0xffffff);
+        match.masks.ipv4_dst = 0xffffffff;
+        break;
+    case BENCH_BRIDGING:
+        match.fields.vlan_vid = 0x1000 | (key % 4094 + 1);
+        match.masks.vlan_vid = 0x1fff;
+        match.fields.eth_dst.addr[0] = 0x02;
+        match.fields.eth_dst.addr[2] = key >> 24;
+        match.fields.eth_dst.addr[3] = key >> 16;
+        match.fields.eth_dst.addr[4] = key >> 8;
+        match.fields.eth_dst.addr[5] = key;
+        MEMSET(&match.masks.eth_dst, 0xff, sizeof(match.masks.eth_dst));
+        break;
+    case BENCH_ACL:
+        match.fields.in_port = key % 48 + 1;
+        match.masks.in_port = 0xffffffff;
+        match.fields.eth_type = 0x0800;
+        match.masks.eth_type = 0xffff;
+        match.fields.ipv4_src = 0xc0a80000 + key;
+        match.masks.ipv4_src = 0xffffffff;
+        match.fields.ip_proto = 6;
+        match.masks.ip_proto = 0xff;
+        match.fields.tcp_dst = 80;
+        match.masks.tcp_dst = 0xffff;
+        break;
+    }
+
+    of_flow_modify_table_id_set(obj, bench_mix[kind].table_id);
+    of_flow_modify_priority_set(obj, bench_mix[kind].priority);
+    of_flow_modify_cookie_set(obj, idx);
+    AIM_TRUE_OR_DIE(of_flow_modify_match_set(obj, &match) == OF_ERROR_NONE);
+
+    if (type == OF_FLOW_DELETE_STRICT) {
+        of_flow_modify_out_port_set(obj, OF_PORT_DEST_WILDCARD);
+        of_flow_modify_out_group_set(obj, OF_GROUP_ANY);
+    } else {
+        bench_instructions_set(obj, kind, key, version);
+    }
+
+    return obj;
+}
+
+/* Time sending count flow mods of type; the time to build them is
+   timed separately and taken out */
+static uint64_t
+bench_phase(of_object_id_t type, int count, int version)
+{
+    uint64_t start, build_us, total_us;
+    int idx;
+
+    start = bench_now_us();
+    for (idx = 0; idx < count; idx++) {
+        of_object_delete(bench_flow_new(type, idx, version));
+    }
+    build_us = bench_now_us() - start;
+
+    start = bench_now_us();
+    for (idx = 0; idx < count; idx++) {
+        handle_message(bench_flow_new(type, idx, version));
+    }
+    do_barrier();
+    total_us = bench_now_us() - start;
+
+    return total_us > build_us ? total_us - build_us : 1;
+}
+
+static double
+bench_rate(int count, uint64_t us)
+{
+    return (double)count * 1000000 / us;
+}
+
+static int
+bench_run(int count)
+{
+    ind_core_config_t core;
+    int64_t heap_start, heap_added;
+    uint64_t add_us, modify_us, delete_us;
+    int rv = 0;
+
+    heap_start = bench_heap_used();
+
+    /* A flowtable sized for the run, as the agent would be configured */
+    MEMSET(&core, 0, sizeof(core));
+    core.expire_flows = 1;
+    core.stats_check_ms = 1000;
+    core.max_flowtable_entries = count;
+    if (ind_core_init(&core) < 0 || ind_core_enable_set(1) < 0) {
+        AIM_LOG_ERROR("Failed to start OFStateManager for %d flows", count);
+        return -1;
+    }
+
+    add_us = bench_phase(OF_FLOW_ADD, count, 0);
+    heap_added = bench_heap_used() - heap_start;
+    if (ft_shards_current_count(ind_core_ft) != count) {
+        AIM_LOG_ERROR("%d flows added, %d in the flowtable",
+                      count, ft_shards_current_count(ind_core_ft));
+        rv = -1;
+    }
+
+    modify_us = bench_phase(OF_FLOW_MODIFY_STRICT, count, 1);
+    if (ft_shards_current_count(ind_core_ft) != count) {
+        AIM_LOG_ERROR("%d flows after modify, %d in the flowtable",
+                      count, ft_shards_current_count(ind_core_ft));
+        rv = -1;
+    }
+
+    delete_us = bench_phase(OF_FLOW_DELETE_STRICT, count, 0);
+    if (ft_shards_current_count(ind_core_ft) != 0) {
+        AIM_LOG_ERROR("%d flows left after delete", ft_shards_current_count(ind_core_ft));
+        rv = -1;
+    }
+
+    printf("%9d %12.0f %12.0f %12.0f %12.0f\n", count,
+           bench_rate(count, add_us), bench_rate(count, modify_us),
+           bench_rate(count, delete_us), (double)heap_added / count);
+    fflush(stdout);
+
+    ind_core_enable_set(0);
+    ind_core_finish();
+
+    return rv;
+}
+
+/**
+ * Run the benchmark for each flow count in argv, or for 10k, 100k and
+ * 1M flows.
+ */
+int
+flow_bench(int argc, char *argv[])
+{
+    int i, count, rv = 0;
+
+    bench_mix_init();
+
+    printf("Flow mix:");
+    for (i = 0; i < BENCH_KIND_COUNT; i++) {
+        printf(" %s %d%%", bench_mix[i].name, bench_mix[i].percent);
+    }
+    printf("\n%9s %12s %12s %12s %12s\n",
+           "flows", "adds/s", "modifies/s", "deletes/s", "bytes/flow");
+
+    if (argc == 0) {
+        for (i = 0; i < AIM_ARRAYSIZE(bench_default_counts); i++) {
+            rv |= bench_run(bench_default_counts[i]);
+        }
+    } else {
+        for (i = 0; i < argc; i++) {
+            count = atoi(argv[i]);
+            if (count <= 0) {
+                AIM_LOG_ERROR("Bad flow count %s", argv[i]);
+                return 1;
+            }
+            rv |= bench_run(count);
+        }
+    }
+
+    return rv < 0 ? 1 : 0;
+}
@@ -0,0 +1,465 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Flowtable data structure benchmark
+ *
+ * Not part of the unit test; run "utest_OFStateManager ft-bench
+ * [FLOWS...]" or "make ft-bench" in targets/utests/OFStateManager.
+ *
+ * Unlike flow_bench.c this calls ft.c directly, with the flow mix of
+ * flow_bench.c, so the numbers are those of the flowtable indexes alone.
+ * The flowtable is sized as ind_core_init sizes it, and the core is
+ * running so that ft_add can resolve groups. For each flow count:
+ *
+ * add, strict, lookup, delete: ft_add (with ft_entry_table_id_set, as the
+ * flow-add handler calls it), ft_strict_match on the match of a random
+ * flow, ft_lookup of a random flow ID, and ft_delete.
+ *
+ * iter/...: walking the flowtable with ft_iterator_next for the queries of
+ * flow stats requests: everything, one table, a cookie prefix (the top
+ * byte of each cookie is the table ID) and an output port. Per op is per
+ * flow returned.
+ *
+ * Operations are timed in batches so the clock is not read per call.
+ * Cache misses per op are counted with perf_event_open where the kernel
+ * allows it. Memory per entry is the heap growth while adding.
+ */
+
+#define AIM_LOG_MODULE_NAME ofstatemanager_utest
+#include <AIM/aim_log.h>
+
+#include <OFStateManager/ofstatemanager.h>
+#include <indigo/of_state_manager.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include <loci/loci.h>
+#include <ft.h>
+
+/* Defined in flow_bench.c */
+void bench_mix_init(void);
+int64_t bench_heap_used(void);
+of_flow_modify_t *bench_flow_new(of_object_id_t type, uint32_t idx,
+                                 int version);
+
+#define FT_BENCH_BATCH 1024
+
+/* Most strict match and lookup calls timed per flow count */
+#define FT_BENCH_MAX_QUERIES 1000000
+
+/* Table of the table-scoped query (unicast routing, 60% of the mix) */
+#define FT_BENCH_QUERY_TABLE 30
+
+/* Cookie prefix of the cookie-masked query (ACL policy, 5% of the mix) */
+#define FT_BENCH_QUERY_COOKIE_TABLE 60
+
+/* Output port of the out_port query; only ACL flows output to a port */
+#define FT_BENCH_QUERY_OUT_PORT 5
+
+static const int ft_bench_default_counts[] = { 10000, 100000, 1000000 };
+
+static uint64_t
+ft_bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Cheap PRNG for picking flows at random */
+static uint32_t
+ft_bench_random(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *state >> 33;
+}
+
+/****************************************************************
+ * Cache miss counter
+ ****************************************************************/
+
+static int ft_bench_perf_fd = -1;
+
+static void
+ft_bench_perf_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    ft_bench_perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static uint64_t
+ft_bench_perf_read(void)
+{
+    uint64_t value = 0;
+
+    if (ft_bench_perf_fd >= 0 &&
+            read(ft_bench_perf_fd, &value, sizeof(value)) != sizeof(value)) {
+        value = 0;
+    }
+
+    return value;
+}
+
+/****************************************************************
+ * Measurements
+ ****************************************************************/
+
+typedef struct ft_bench_result_s {
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t misses;
+} ft_bench_result_t;
+
+static uint64_t ft_bench_start_ns;
+static uint64_t ft_bench_start_misses;
+
+static void
+ft_bench_start(void)
+{
+    ft_bench_start_misses = ft_bench_perf_read();
+    ft_bench_start_ns = ft_bench_now_ns();
+}
+
+static void
+ft_bench_stop(ft_bench_result_t *result, uint64_t ops)
+{
+    result->ns += ft_bench_now_ns() - ft_bench_start_ns;
+    result->misses += ft_bench_perf_read() - ft_bench_start_misses;
+    result->ops += ops;
+}
+
+static void
+ft_bench_report(const char *name, const ft_bench_result_t *result)
+{
+    uint64_t ops = result->ops ? result->ops : 1;
+
+    if (ft_bench_perf_fd >= 0) {
+        printf("  %-16s %9"PRIu64" %10.1f %10.2f\n", name, result->ops,
+               (double)result->ns / ops, (double)result->misses / ops);
+    } else {
+        printf("  %-16s %9"PRIu64" %10.1f %10s\n", name, result->ops,
+               (double)result->ns / ops, "-");
+    }
+}
+
+/****************************************************************
+ * Operations
+ ****************************************************************/
+
+static void
+ft_bench_add(ft_instance_t ft, int count, ft_entry_t **entries,
+             ft_bench_result_t *result)
+{
+    of_flow_add_t *batch[FT_BENCH_BATCH];
+    uint8_t table_ids[FT_BENCH_BATCH];
+    int base, n, i;
+
+    for (base = 0; base < count; base += n) {
+        n = count - base < FT_BENCH_BATCH ? count - base : FT_BENCH_BATCH;
+
+        for (i = 0; i < n; i++) {
+            batch[i] = bench_flow_new(OF_FLOW_ADD, base + i, 0);
+            of_flow_add_table_id_get(batch[i], &table_ids[i]);
+            of_flow_add_cookie_set(batch[i],
+                                   ((uint64_t)table_ids[i] << 56) | (base + i));
+        }
+
+        ft_bench_start();
+        for (i = 0; i < n; i++) {
+            AIM_TRUE_OR_DIE(ft_add(ft, base + i + 1, batch[i],
+                                   &entries[base + i]) == INDIGO_ERROR_NONE);
+            ft_entry_table_id_set(ft, entries[base + i], table_ids[i]);
+        }
+        ft_bench_stop(result, n);
+
+        for (i = 0; i < n; i++) {
+            of_object_delete(batch[i]);
+        }
+    }
+}
+
+/* The strict match query of a flow-modify-strict for flow idx */
+static void
+ft_bench_strict_query(of_meta_match_t *query, uint32_t idx)
+{
+    of_flow_modify_t *obj = bench_flow_new(OF_FLOW_MODIFY_STRICT, idx, 0);
+
+    MEMSET(query, 0, sizeof(*query));
+    AIM_TRUE_OR_DIE(of_flow_modify_match_get(obj, &query->match) == 0);
+    of_flow_modify_priority_get(obj, &query->priority);
+    of_flow_modify_table_id_get(obj, &query->table_id);
+    query->check_priority = 1;
+    query->out_port = OF_PORT_DEST_WILDCARD;
+    query->mode = OF_MATCH_STRICT;
+
+    of_object_delete(obj);
+}
+
+static void
+ft_bench_strict(ft_instance_t ft, int count, ft_entry_t **entries,
+                ft_bench_result_t *result)
+{
+    static of_meta_match_t queries[FT_BENCH_BATCH];
+    uint32_t idx[FT_BENCH_BATCH];
+    uint64_t seed = 1;
+    ft_entry_t *entry;
+    int total, done, n, i;
+
+    total = count < FT_BENCH_MAX_QUERIES ? count : FT_BENCH_MAX_QUERIES;
+
+    for (done = 0; done < total; done += n) {
+        n = total - done < FT_BENCH_BATCH ? total - done : FT_BENCH_BATCH;
+
+        for (i = 0; i < n; i++) {
+            idx[i] = ft_bench_random(&seed) % count;
+            ft_bench_strict_query(&queries[i], idx[i]);
+        }
+
+        ft_bench_start();
+        for (i = 0; i < n; i++) {
+            if (ft_strict_match(ft, &queries[i], &entry) != INDIGO_ERROR_NONE) {
+                entry = NULL;
+            }
+            AIM_TRUE_OR_DIE(entry == entries[idx[i]],
+                            "strict match of flow %u failed", idx[i]);
+        }
+        ft_bench_stop(result, n);
+    }
+}
+
+static void
+ft_bench_lookup(ft_instance_t ft, int count, ft_entry_t **entries,
+                ft_bench_result_t *result)
+{
+    uint32_t idx[FT_BENCH_BATCH];
+    uint64_t seed = 2;
+    int total, done, n, i;
+
+    total = count < FT_BENCH_MAX_QUERIES ? count : FT_BENCH_MAX_QUERIES;
+
+    for (done = 0; done < total; done += n) {
+        n = total - done < FT_BENCH_BATCH ? total - done : FT_BENCH_BATCH;
+
+        for (i = 0; i < n; i++) {
+            idx[i] = ft_bench_random(&seed) % count;
+        }
+
+        ft_bench_start();
+        for (i = 0; i < n; i++) {
+            AIM_TRUE_OR_DIE(ft_lookup(ft, idx[i] + 1) == entries[idx[i]]);
+        }
+        ft_bench_stop(result, n);
+    }
+}
+
+/* Walk the flows matching query, or all of them if NULL */
+static void
+ft_bench_iterate(ft_instance_t ft, of_meta_match_t *query,
+                 ft_bench_result_t *result)
+{
+    ft_iterator_t iter;
+    uint64_t found = 0;
+
+    ft_bench_start();
+    ft_iterator_init(&iter, ft, query);
+    while (ft_iterator_next(&iter) != NULL) {
+        found++;
+    }
+    ft_iterator_cleanup(&iter);
+    ft_bench_stop(result, found);
+}
+
+/* A flow stats request query matching all flows */
+static void
+ft_bench_query_init(of_meta_match_t *query)
+{
+    MEMSET(query, 0, sizeof(*query));
+    query->match.version = OF_VERSION_1_3;
+    query->mode = OF_MATCH_NON_STRICT;
+    query->out_port = OF_PORT_DEST_WILDCARD;
+    query->table_id = TABLE_ID_ANY;
+}
+
+static void
+ft_bench_delete(ft_instance_t ft, int count, ft_entry_t **entries,
+                ft_bench_result_t *result)
+{
+    int base, n, i;
+
+    for (base = 0; base < count; base += n) {
+        n = count - base < FT_BENCH_BATCH ? count - base : FT_BENCH_BATCH;
+
+        ft_bench_start();
+        for (i = 0; i < n; i++) {
+            ft_delete(ft, entries[base + i]);
+        }
+        ft_bench_stop(result, n);
+    }
+}
+
+static int
+ft_bench_run(int count)
+{
+    ft_config_t config;
+    ft_instance_t ft;
+    ft_entry_t **entries;
+    ft_bench_result_t result;
+    of_meta_match_t query;
+    int64_t heap_start, heap_added;
+    int rv = 0;
+
+    entries = aim_zmalloc(count * sizeof(*entries));
+
+    /* Sized as ind_core_init sizes the agent's flowtable */
+    MEMSET(&config, 0, sizeof(config));
+    config.strict_match_bucket_count = count;
+    config.flow_id_bucket_count = count;
+
+    heap_start = bench_heap_used();
+    ft = ft_create(&config);
+    AIM_TRUE_OR_DIE(ft != NULL);
+
+    printf("%d flows\n", count);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_add(ft, count, entries, &result);
+    heap_added = bench_heap_used() - heap_start;
+    ft_bench_report("add", &result);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_strict(ft, count, entries, &result);
+    ft_bench_report("strict", &result);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_lookup(ft, count, entries, &result);
+    ft_bench_report("lookup", &result);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_iterate(ft, NULL, &result);
+    ft_bench_report("iter/all", &result);
+    if (result.ops != (uint64_t)count) {
+        AIM_LOG_ERROR("Iterated %"PRIu64" of %d flows", result.ops, count);
+        rv = -1;
+    }
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_query_init(&query);
+    query.table_id = FT_BENCH_QUERY_TABLE;
+    ft_bench_iterate(ft, &query, &result);
+    ft_bench_report("iter/table", &result);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_query_init(&query);
+    query.cookie = (uint64_t)FT_BENCH_QUERY_COOKIE_TABLE << 56;
+    query.cookie_mask = FT_COOKIE_PREFIX_MASK;
+    ft_bench_iterate(ft, &query, &result);
+    ft_bench_report("iter/cookie", &result);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_query_init(&query);
+    query.out_port = FT_BENCH_QUERY_OUT_PORT;
+    ft_bench_iterate(ft, &query, &result);
+    ft_bench_report("iter/out_port", &result);
+
+    MEMSET(&result, 0, sizeof(result));
+    ft_bench_delete(ft, count, entries, &result);
+    ft_bench_report("delete", &result);
+    if (ft->status.current_count != 0) {
+        AIM_LOG_ERROR("%d flows left after delete", ft->status.current_count);
+        rv = -1;
+    }
+
+    printf("  %-16s %9d %10.0f bytes/entry\n", "memory", count,
+           (double)heap_added / count);
+    fflush(stdout);
+
+    ft_destroy(ft);
+    aim_free(entries);
+
+    return rv;
+}
+
+/**
+ * Run the benchmark for each flow count in argv, or for 10k, 100k and
+ * 1M flows.
+ */
+int
+ft_bench(int argc, char *argv[])
+{
+    ind_core_config_t core;
+    int i, count, rv = 0;
+
+    /* ft_add resolves the groups the effects reference */
+    MEMSET(&core, 0, sizeof(core));
+    if (ind_core_init(&core) < 0) {
+        AIM_LOG_ERROR("Failed to start OFStateManager");
+        return 1;
+    }
+
+    bench_mix_init();
+    ft_bench_perf_open();
+
+    printf("  %-16s %9s %10s %10s\n", "op", "ops", "ns/op", "misses/op");
+    if (ft_bench_perf_fd < 0) {
+        printf("  (cache misses not available, perf_event_open failed)\n");
+    }
+
+    if (argc == 0) {
+        for (i = 0; i < AIM_ARRAYSIZE(ft_bench_default_counts); i++) {
+            rv |= ft_bench_run(ft_bench_default_counts[i]);
+        }
+    } else {
+        for (i = 0; i < argc; i++) {
+            count = atoi(argv[i]);
+            if (count <= 0) {
+                AIM_LOG_ERROR("Bad flow count %s", argv[i]);
+                return 1;
+            }
+            rv |= ft_bench_run(count);
+        }
+    }
+
+    if (ft_bench_perf_fd >= 0) {
+        close(ft_bench_perf_fd);
+    }
+
+    ind_core_finish();
+
+    return rv < 0 ? 1 : 0;
+}
@@ -0,0 +1,441 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Gentable scaling benchmark
+ *
+ * Not part of the unit test; run "utest_OFStateManager gentable-bench
+ * [ENTRIES...]" or "make gentable-bench" in targets/utests/OFStateManager.
+ *
+ * For each entry count a gentable is registered with trivial operations
+ * and filled with L2 like entries (port, vlan and mac key; port and mac
+ * value) with random checksums. Messages go through
+ * indigo_core_receive_controller_message; building them is not timed.
+ *
+ * add, modify, delete: entry add and delete messages. A modify is an add
+ * of a key already in the table, so it covers the key lookup.
+ *
+ * bucket stats: the bucket stats request, per bucket.
+ *
+ * bucket desc: entry desc stats for the single checksum bucket the
+ * controller asks for during a sync, per request, event loop included.
+ *
+ * full desc: entry desc stats for the whole table, per entry. The loop
+ * iterations it took and the longest one are the time the loop was kept
+ * from everything else.
+ */
+
+#define AIM_LOG_MODULE_NAME ofstatemanager_utest
+#include <AIM/aim_log.h>
+
+#include <OFStateManager/ofstatemanager.h>
+#include <indigo/of_state_manager.h>
+#include <SocketManager/socketmanager.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <loci/loci.h>
+
+extern void handle_message(of_object_t *obj);
+extern int do_barrier(void);
+
+/* Defined in flow_bench.c */
+int64_t bench_heap_used(void);
+
+/* Defined in main.c */
+extern int gentable_desc_entry_count;
+extern int gentable_desc_final_count;
+
+/* Ids 0 and 1 are the "test" and "memory" gentables of ind_core_init */
+#define GENTABLE_BENCH_TABLE_ID 2
+
+/* As configured for the L2 table, before the controller resizes it */
+#define GENTABLE_BENCH_BUCKETS 65536
+
+/* Messages built ahead of each timed batch */
+#define GENTABLE_BENCH_BATCH 1024
+
+/* Single bucket desc stats requests per run */
+#define GENTABLE_BENCH_BUCKET_REQUESTS 1024
+
+/* Give up on a desc stats request after this many loop iterations */
+#define GENTABLE_BENCH_MAX_ITERATIONS 10000000
+
+static const int gentable_bench_default_counts[] = { 10000, 100000, 1000000 };
+
+static struct {
+    uint64_t adds;
+    uint64_t modifies;
+    uint64_t deletes;
+} gentable_bench_table;
+
+static uint64_t
+gentable_bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Deterministic per entry hash, splitmix64 */
+static uint64_t
+gentable_bench_hash(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/****************************************************************
+ * Gentable operations
+ ****************************************************************/
+
+static indigo_error_t
+gentable_bench_add(void *table_priv, of_list_bsn_tlv_t *key,
+                   of_list_bsn_tlv_t *value, void **entry_priv)
+{
+    gentable_bench_table.adds++;
+    *entry_priv = NULL;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+gentable_bench_modify(void *table_priv, void *entry_priv,
+                      of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *value)
+{
+    gentable_bench_table.modifies++;
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+gentable_bench_del(void *table_priv, void *entry_priv,
+                   of_list_bsn_tlv_t *key)
+{
+    gentable_bench_table.deletes++;
+    return INDIGO_ERROR_NONE;
+}
+
+static void
+gentable_bench_get_stats(void *table_priv, void *entry_priv,
+                         of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *stats)
+{
+}
+
+static const indigo_core_gentable_ops_t gentable_bench_ops = {
+    .add = gentable_bench_add,
+    .modify = gentable_bench_modify,
+    .del = gentable_bench_del,
+    .get_stats = gentable_bench_get_stats,
+};
+
+/****************************************************************
+ * Messages
+ ****************************************************************/
+
+static void
+gentable_bench_append(of_list_bsn_tlv_t *list, of_object_t *tlv)
+{
+    of_list_append(list, tlv);
+    of_object_delete(tlv);
+}
+
+static of_list_bsn_tlv_t *
+gentable_bench_key_new(uint32_t idx)
+{
+    of_list_bsn_tlv_t *list = of_list_bsn_tlv_new(OF_VERSION_1_3);
+    of_object_t *tlv;
+    of_mac_addr_t mac = { { 0x02, 0x00, idx >> 24, idx >> 16, idx >> 8, idx } };
+
+    tlv = of_bsn_tlv_port_new(OF_VERSION_1_3);
+    of_bsn_tlv_port_value_set(tlv, 1 + idx % 48);
+    gentable_bench_append(list, tlv);
+
+    tlv = of_bsn_tlv_vlan_vid_new(OF_VERSION_1_3);
+    of_bsn_tlv_vlan_vid_value_set(tlv, 1 + idx % 4000);
+    gentable_bench_append(list, tlv);
+
+    tlv = of_bsn_tlv_mac_new(OF_VERSION_1_3);
+    of_bsn_tlv_mac_value_set(tlv, mac);
+    gentable_bench_append(list, tlv);
+
+    return list;
+}
+
+static of_object_t *
+gentable_bench_add_new(uint32_t idx, int version)
+{
+    of_object_t *obj = of_bsn_gentable_entry_add_new(OF_VERSION_1_3);
+    of_list_bsn_tlv_t *list;
+    of_object_t *tlv;
+    of_checksum_128_t checksum;
+    of_mac_addr_t mac = { { 0x02, 0x01, version, idx >> 16, idx >> 8, idx } };
+
+    of_bsn_gentable_entry_add_xid_set(obj, idx);
+    of_bsn_gentable_entry_add_table_id_set(obj, GENTABLE_BENCH_TABLE_ID);
+    checksum.hi = gentable_bench_hash(idx);
+    checksum.lo = gentable_bench_hash(checksum.hi) + version;
+    of_bsn_gentable_entry_add_checksum_set(obj, checksum);
+
+    list = gentable_bench_key_new(idx);
+    AIM_TRUE_OR_DIE(of_bsn_gentable_entry_add_key_set(obj, list) == 0);
+    of_object_delete(list);
+
+    list = of_list_bsn_tlv_new(OF_VERSION_1_3);
+    tlv = of_bsn_tlv_port_new(OF_VERSION_1_3);
+    of_bsn_tlv_port_value_set(tlv, 1 + (idx + version) % 48);
+    gentable_bench_append(list, tlv);
+    tlv = of_bsn_tlv_mac_new(OF_VERSION_1_3);
+    of_bsn_tlv_mac_value_set(tlv, mac);
+    gentable_bench_append(list, tlv);
+    AIM_TRUE_OR_DIE(of_bsn_gentable_entry_add_value_set(obj, list) == 0);
+    of_object_delete(list);
+
+    return obj;
+}
+
+static of_object_t *
+gentable_bench_delete_new(uint32_t idx)
+{
+    of_object_t *obj = of_bsn_gentable_entry_delete_new(OF_VERSION_1_3);
+    of_list_bsn_tlv_t *list;
+
+    of_bsn_gentable_entry_delete_xid_set(obj, idx);
+    of_bsn_gentable_entry_delete_table_id_set(obj, GENTABLE_BENCH_TABLE_ID);
+
+    list = gentable_bench_key_new(idx);
+    AIM_TRUE_OR_DIE(of_bsn_gentable_entry_delete_key_set(obj, list) == 0);
+    of_object_delete(list);
+
+    return obj;
+}
+
+/*
+ * Send count add (version 0 or 1) or delete (version -1) messages.
+ * Returns the nanoseconds taken by handling them.
+ */
+static uint64_t
+gentable_bench_phase(int count, int version)
+{
+    of_object_t *msgs[GENTABLE_BENCH_BATCH];
+    uint64_t start, total_ns = 0;
+    int idx, i, n;
+
+    for (idx = 0; idx < count; idx += n) {
+        n = count - idx < GENTABLE_BENCH_BATCH ? count - idx : GENTABLE_BENCH_BATCH;
+        for (i = 0; i < n; i++) {
+            msgs[i] = version < 0 ? gentable_bench_delete_new(idx + i) :
+                gentable_bench_add_new(idx + i, version);
+        }
+
+        start = gentable_bench_now_ns();
+        for (i = 0; i < n; i++) {
+            handle_message(msgs[i]);
+        }
+        total_ns += gentable_bench_now_ns() - start;
+
+        /* Let the key bucket resize task run, as the agent would */
+        ind_soc_select_and_run(0);
+    }
+    do_barrier();
+
+    return total_ns;
+}
+
+static uint64_t
+gentable_bench_bucket_stats(void)
+{
+    of_object_t *obj = of_bsn_gentable_bucket_stats_request_new(OF_VERSION_1_3);
+    uint64_t start;
+
+    of_bsn_gentable_bucket_stats_request_xid_set(obj, 1);
+    of_bsn_gentable_bucket_stats_request_table_id_set(obj, GENTABLE_BENCH_TABLE_ID);
+
+    start = gentable_bench_now_ns();
+    handle_message(obj);
+    return gentable_bench_now_ns() - start;
+}
+
+/*
+ * Request the entries matching checksum and mask and run the event loop
+ * until the last reply is sent. Adds the loop iterations to *iterations
+ * and keeps the longest in *max_ns. Returns the nanoseconds taken.
+ */
+static uint64_t
+gentable_bench_desc_stats(of_checksum_128_t checksum,
+                          of_checksum_128_t checksum_mask,
+                          uint64_t *iterations, uint64_t *max_ns)
+{
+    of_object_t *obj = of_bsn_gentable_entry_desc_stats_request_new(OF_VERSION_1_3);
+    int final_count = gentable_desc_final_count;
+    uint64_t start, iter_start, elapsed, n = 0;
+
+    of_bsn_gentable_entry_desc_stats_request_xid_set(obj, 1);
+    of_bsn_gentable_entry_desc_stats_request_table_id_set(obj, GENTABLE_BENCH_TABLE_ID);
+    of_bsn_gentable_entry_desc_stats_request_checksum_set(obj, checksum);
+    of_bsn_gentable_entry_desc_stats_request_checksum_mask_set(obj, checksum_mask);
+
+    start = gentable_bench_now_ns();
+    handle_message(obj);
+    while (gentable_desc_final_count == final_count &&
+           n < GENTABLE_BENCH_MAX_ITERATIONS) {
+        iter_start = gentable_bench_now_ns();
+        ind_soc_select_and_run(0);
+        elapsed = gentable_bench_now_ns() - iter_start;
+        if (elapsed > *max_ns) {
+            *max_ns = elapsed;
+        }
+        n++;
+    }
+    elapsed = gentable_bench_now_ns() - start;
+
+    *iterations += n;
+    return elapsed;
+}
+
+/****************************************************************
+ * Runs
+ ****************************************************************/
+
+static int
+gentable_bench_run(int count)
+{
+    indigo_core_gentable_t *gentable;
+    of_checksum_128_t checksum, checksum_mask;
+    int64_t heap_start, heap_added;
+    uint64_t add_ns, modify_ns, delete_ns, bucket_stats_ns;
+    uint64_t bucket_ns = 0, bucket_iterations = 0, bucket_max_ns = 0;
+    uint64_t full_ns, full_iterations = 0, full_max_ns = 0;
+    int entry_count, shift = 64 - 16; /* 65536 buckets */
+    int i, rv = 0;
+
+    MEMSET(&gentable_bench_table, 0, sizeof(gentable_bench_table));
+    heap_start = bench_heap_used();
+
+    indigo_core_gentable_register("bench", &gentable_bench_ops, NULL,
+                                  count, GENTABLE_BENCH_BUCKETS, &gentable);
+
+    add_ns = gentable_bench_phase(count, 0);
+    heap_added = bench_heap_used() - heap_start;
+    modify_ns = gentable_bench_phase(count, 1);
+    if (gentable_bench_table.adds != (uint64_t)count ||
+            gentable_bench_table.modifies != (uint64_t)count) {
+        AIM_LOG_ERROR("%"PRIu64" adds and %"PRIu64" modifies of %d entries",
+                      gentable_bench_table.adds,
+                      gentable_bench_table.modifies, count);
+        rv = -1;
+    }
+
+    bucket_stats_ns = gentable_bench_bucket_stats();
+
+    /* Buckets spread over the table, as a sync asks for the stale ones */
+    for (i = 0; i < GENTABLE_BENCH_BUCKET_REQUESTS; i++) {
+        checksum.hi = (uint64_t)(i * (GENTABLE_BENCH_BUCKETS /
+                                      GENTABLE_BENCH_BUCKET_REQUESTS)) << shift;
+        checksum.lo = 0;
+        checksum_mask.hi = ~(uint64_t)0 << shift;
+        checksum_mask.lo = 0;
+        bucket_ns += gentable_bench_desc_stats(checksum, checksum_mask,
+                                               &bucket_iterations,
+                                               &bucket_max_ns);
+    }
+
+    entry_count = gentable_desc_entry_count;
+    MEMSET(&checksum, 0, sizeof(checksum));
+    MEMSET(&checksum_mask, 0, sizeof(checksum_mask));
+    full_ns = gentable_bench_desc_stats(checksum, checksum_mask,
+                                        &full_iterations, &full_max_ns);
+    if (gentable_desc_entry_count - entry_count != count) {
+        AIM_LOG_ERROR("Desc stats returned %d of %d entries",
+                      gentable_desc_entry_count - entry_count, count);
+        rv = -1;
+    }
+
+    delete_ns = gentable_bench_phase(count, -1);
+    if (gentable_bench_table.deletes != (uint64_t)count) {
+        AIM_LOG_ERROR("%"PRIu64" deletes of %d entries",
+                      gentable_bench_table.deletes, count);
+        rv = -1;
+    }
+
+    printf("%9d %9.0f %9.0f %9.0f %9.1f %9.1f %9.1f %9"PRIu64" %9.3f %9.0f\n",
+           count,
+           (double)add_ns / count, (double)modify_ns / count,
+           (double)delete_ns / count,
+           (double)bucket_stats_ns / GENTABLE_BENCH_BUCKETS,
+           (double)bucket_ns / GENTABLE_BENCH_BUCKET_REQUESTS / 1000,
+           (double)full_ns / count, full_iterations,
+           (double)full_max_ns / 1e6, (double)heap_added / count);
+    fflush(stdout);
+
+    indigo_core_gentable_unregister(gentable);
+
+    return rv;
+}
+
+/**
+ * Run the benchmark for each entry count in argv, or for 10k, 100k and
+ * 1M entries.
+ */
+int
+gentable_bench(int argc, char *argv[])
+{
+    ind_core_config_t core;
+    int i, count, rv = 0;
+
+    for (i = 0; i < argc; i++) {
+        count = atoi(argv[i]);
+        if (count <= 0) {
+            AIM_LOG_ERROR("Bad entry count %s", argv[i]);
+            return 1;
+        }
+    }
+
+    MEMSET(&core, 0, sizeof(core));
+    core.max_flowtable_entries = 1024;
+    if (ind_core_init(&core) < 0 || ind_core_enable_set(1) < 0) {
+        AIM_LOG_ERROR("Failed to start OFStateManager");
+        return 1;
+    }
+
+    printf("Key port, vlan and mac; value port and mac; %d checksum buckets\n",
+           GENTABLE_BENCH_BUCKETS);
+    printf("%9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "entries",
+           "add ns", "mod ns", "del ns", "bkt st ns", "bkt ds us",
+           "full ns", "iters", "max ms", "bytes");
+
+    if (argc == 0) {
+        for (i = 0; i < AIM_ARRAYSIZE(gentable_bench_default_counts); i++) {
+            rv |= gentable_bench_run(gentable_bench_default_counts[i]);
+        }
+    } else {
+        for (i = 0; i < argc; i++) {
+            rv |= gentable_bench_run(atoi(argv[i]));
+        }
+    }
+
+    ind_core_enable_set(0);
+    ind_core_finish();
+
+    return rv < 0 ? 1 : 0;
+}
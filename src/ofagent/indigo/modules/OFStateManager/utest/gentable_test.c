@@ -39,7 +39,8 @@
 #include <locitest/test_common.h>
 #include <SocketManager/socketmanager.h>
 
-#define TABLE_ID 1
+/* Ids 0 and 1 are the "test" and "memory" gentables of ind_core_init */
+#define TABLE_ID 2
 #define NUM_ENTRIES 10
 
 extern void handle_message(of_object_t *obj);
@@ -63,6 +64,7 @@ struct test_entry {
 
 struct test_table {
     int count_op;
+    int count_batch;
     int count_add;
     int count_modify;
     int count_delete;
@@ -73,6 +75,7 @@ struct test_table {
 static struct test_table table;
 
 static indigo_core_gentable_ops_t test_ops;
+static indigo_core_gentable_ops_t test_batch_ops;
 
 static const of_mac_addr_t mac1 = { { 0xab, 0xcd, 0xef, 0xff, 0xff, 0x01 } };
 static const of_mac_addr_t mac2 = { { 0xab, 0xcd, 0xef, 0xff, 0xff, 0x02 } };
@@ -302,6 +305,96 @@ test_gentable_long_running_task(void)
     return TEST_PASS;
 }
 
+/* Entries stay reachable while the buckets are migrated by a task */
+static int
+test_gentable_resize(void)
+{
+    int i;
+    indigo_core_gentable_t *gentable;
+    of_table_name_t name = "gentable 0";
+
+    memset(&table, 0, sizeof(table));
+    indigo_core_gentable_register(name, &test_ops, &table, 10, 1, &gentable);
+
+    /* Grows the key buckets without running the migration task */
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        do_add(i, mac1, i << 4);
+    }
+    AIM_TRUE_OR_DIE(table.count_add == NUM_ENTRIES);
+
+    do_set_buckets_size(16);
+    do_barrier();
+
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        do_add(i, mac2, i << 4);
+    }
+    AIM_TRUE_OR_DIE(table.count_add == NUM_ENTRIES);
+    AIM_TRUE_OR_DIE(table.count_modify == NUM_ENTRIES);
+
+    do_delete(3);
+    AIM_TRUE_OR_DIE(table.entries[3].count_delete == 1);
+
+    /* Let the migration finish */
+    for (i = 0; i < 4; i++) {
+        ind_soc_select_and_run(0);
+    }
+
+    memset(&table, 0, sizeof(table));
+    do_entry_stats();
+    for (i = 0; i < 4; i++) {
+        ind_soc_select_and_run(0);
+    }
+    AIM_TRUE_OR_DIE(table.count_stats == NUM_ENTRIES - 1);
+    AIM_TRUE_OR_DIE(table.entries[3].count_stats == 0);
+
+    memset(&table, 0, sizeof(table));
+    indigo_core_gentable_unregister(gentable);
+    AIM_TRUE_OR_DIE(table.count_delete == NUM_ENTRIES - 1);
+
+    return TEST_PASS;
+}
+
+/* Gentable messages committed in a bundle go through the batch operation */
+static int
+test_gentable_bundle(void)
+{
+    indigo_core_gentable_t *gentable;
+    of_table_name_t name = "gentable 0";
+
+    memset(&table, 0, sizeof(table));
+    indigo_core_gentable_register(name, &test_batch_ops, &table, 10, 8, &gentable);
+
+    do_add(1, mac1, 0);
+    AIM_TRUE_OR_DIE(table.count_batch == 0);
+    AIM_TRUE_OR_DIE(table.count_add == 1);
+
+    memset(&table, 0, sizeof(table));
+    TEST_INDIGO_OK(ind_core_bundle_open(0, 1));
+    do_add(2, mac2, 0);
+    do_add(3, mac3, 0);
+    do_add(1, mac2, 0);
+    do_delete(3); /* key already in the batch, flushes it */
+    do_delete(4); /* nonexistent */
+    AIM_TRUE_OR_DIE(table.count_op == 0);
+
+    TEST_INDIGO_OK(ind_core_bundle_commit(0, 1));
+    AIM_TRUE_OR_DIE(table.count_batch == 2);
+    AIM_TRUE_OR_DIE(table.count_add == 2);
+    AIM_TRUE_OR_DIE(table.count_modify == 1);
+    AIM_TRUE_OR_DIE(table.count_delete == 1);
+    AIM_TRUE_OR_DIE(!memcmp(&table.entries[1].mac, &mac2, sizeof(of_mac_addr_t)));
+    AIM_TRUE_OR_DIE(table.entries[3].count_add == 1);
+    AIM_TRUE_OR_DIE(table.entries[3].count_delete == 1);
+
+    memset(&table, 0, sizeof(table));
+    indigo_core_gentable_unregister(gentable);
+    AIM_TRUE_OR_DIE(table.count_delete == 2);
+    AIM_TRUE_OR_DIE(table.entries[1].count_delete == 1);
+    AIM_TRUE_OR_DIE(table.entries[2].count_delete == 1);
+
+    return TEST_PASS;
+}
+
 int
 test_gentable(void)
 {
@@ -311,6 +404,8 @@ test_gentable(void)
     RUN_TEST(gentable_clear);
     RUN_TEST(gentable_entry_stats);
     RUN_TEST(gentable_long_running_task);
+    RUN_TEST(gentable_resize);
+    RUN_TEST(gentable_bundle);
     return TEST_PASS;
 }
 
@@ -571,9 +666,41 @@ test_gentable_get_stats(void *table_priv, void *entry_priv, of_list_bsn_tlv_t *k
     } while (INDIGO_TIME_DIFF_ms(start_time, INDIGO_CURRENT_TIME) < 10);
 }
 
+static void
+test_gentable_batch(void *table_priv, indigo_core_gentable_op_t *ops, int count)
+{
+    struct test_table *table = table_priv;
+    int i;
+
+    table->count_batch++;
+
+    for (i = 0; i < count; i++) {
+        indigo_core_gentable_op_t *op = &ops[i];
+        switch (op->type) {
+        case INDIGO_CORE_GENTABLE_OP_ADD:
+            op->result = test_gentable_add(table_priv, op->key, op->value, &op->entry_priv);
+            break;
+        case INDIGO_CORE_GENTABLE_OP_MODIFY:
+            op->result = test_gentable_modify(table_priv, op->entry_priv, op->key, op->value);
+            break;
+        case INDIGO_CORE_GENTABLE_OP_DELETE:
+            op->result = test_gentable_delete(table_priv, op->entry_priv, op->key);
+            break;
+        }
+    }
+}
+
 static indigo_core_gentable_ops_t test_ops = {
     test_gentable_add,
     test_gentable_modify,
     test_gentable_delete,
     test_gentable_get_stats,
 };
+
+static indigo_core_gentable_ops_t test_batch_ops = {
+    test_gentable_add,
+    test_gentable_modify,
+    test_gentable_delete,
+    test_gentable_get_stats,
+    test_gentable_batch,
+};
@@ -26,11 +26,13 @@
  *****************************************************************************/
 #define AIM_LOG_MODULE_NAME ofstatemanager_utest
 #include <AIM/aim_log.h>
+#include <AIM/aim_pvs_buffer.h>
 
 #include <OFStateManager/ofstatemanager.h>
 #include <OFStateManager/ofstatemanager_config.h>
 #include <indigo/of_connection_manager.h>
 #include <indigo/of_state_manager.h>
+#include <indigo/of_message.h>
 #include <indigo/forwarding.h>
 #include <indigo/port_manager.h>
 #include <stdio.h>
@@ -39,6 +41,9 @@
 
 #include <unistd.h>
 #include <ft.h>
+#include <ft_shard.h>
+#include <pipeline.h>
+#include <workers.h>
 
 #include <loci/loci.h>
 #include <locitest/unittest.h>
@@ -52,6 +57,21 @@ int test_gentable(void);
 /* Defined in table_test.c */
 int test_table(void);
 
+/* Defined in flow_bench.c */
+int flow_bench(int argc, char *argv[]);
+
+/* Defined in ft_bench.c */
+int ft_bench(int argc, char *argv[]);
+
+/* Defined in expiration_bench.c */
+int expiration_bench(int argc, char *argv[]);
+
+/* Defined in gentable_bench.c */
+int gentable_bench(int argc, char *argv[]);
+
+static ft_status_t *core_ft_status(void);
+static int delete_all_entries(void);
+
 /* Must be an even number */
 #define TEST_FLOW_COUNT 1000
 
@@ -85,6 +105,8 @@ int test_table(void);
  */
 static int outstanding_op_cnt;
 static void message_deleted(of_object_t *obj);
+static int modify_count;
+static indigo_cookie_t last_created_id;
 
 /****************************************************************
  * Stubs
@@ -94,6 +116,7 @@ indigo_fwd_flow_modify(indigo_cookie_t flow_id,
                        of_flow_modify_t *flow_modify)
 {
     AIM_LOG_VERBOSE("flow modify called\n");
+    modify_count++;
     return INDIGO_ERROR_NONE;
 }
 
@@ -103,13 +126,22 @@ indigo_error_t create_error = INDIGO_ERROR_NONE;
    if (create_error == INDIGO_ERROR_NONE) \
        TEST_ASSERT((status)->current_count == (count))
 
+/* Tables of the flows deleted, in order */
+#define DELETED_TABLES_MAX 64
+static int deleted_tables[DELETED_TABLES_MAX];
+static int deleted_count;
+
 indigo_error_t
 indigo_fwd_flow_create(indigo_cookie_t flow_id,
                        of_flow_add_t *flow_add,
                        uint8_t *table_id)
 {
     AIM_LOG_VERBOSE("flow create called\n");
+    last_created_id = flow_id;
     *table_id = 0;
+    if (flow_add->version >= OF_VERSION_1_1) {
+        of_flow_add_table_id_get(flow_add, table_id);
+    }
     return INDIGO_ERROR_NONE;
 }
 
@@ -129,17 +161,31 @@ indigo_error_t
 indigo_fwd_flow_delete(indigo_cookie_t flow_id,
                        indigo_fi_flow_stats_t *flow_stats)
 {
+    ft_entry_t *entry = ft_shards_lookup(ind_core_ft, flow_id);
+
     AIM_LOG_VERBOSE("flow delete called\n");
+    if (entry != NULL) {
+        deleted_tables[deleted_count++ % DELETED_TABLES_MAX] = entry->table_id;
+    }
     memset(flow_stats, 0, sizeof(*flow_stats));
     return INDIGO_ERROR_NONE;
 }
 
+/* The one flow whose packet count is not 0 */
+static indigo_flow_id_t counted_flow_id = -1;
+static uint64_t counted_flow_packets;
+static uint64_t counted_flow_age_ns;
+
 indigo_error_t indigo_fwd_flow_stats_get(
     indigo_cookie_t flow_id,
     indigo_fi_flow_stats_t *flow_stats)
 {
     AIM_LOG_VERBOSE("flow stats get called\n");
     memset(flow_stats, 0, sizeof(*flow_stats));
+    if (flow_id == counted_flow_id) {
+        flow_stats->packets = counted_flow_packets;
+        flow_stats->counters_age_ns = counted_flow_age_ns;
+    }
     return INDIGO_ERROR_NONE;
 }
 
@@ -152,17 +198,25 @@ indigo_fwd_flow_hit_status_get(indigo_cookie_t flow_id,
     return INDIGO_ERROR_NONE;
 }
 
+static int packet_out_count;
+static indigo_error_t packet_out_rv;
+
 indigo_error_t
 indigo_fwd_packet_out(of_packet_out_t *of_packet_out)
 {
     AIM_LOG_VERBOSE("packet out called\n");
-    return INDIGO_ERROR_NONE;
+    packet_out_count++;
+    return packet_out_rv;
 }
 
+static int port_features_get_count;
+static int port_desc_stats_get_count;
+
 indigo_error_t
 indigo_port_features_get(of_features_reply_t *features)
 {
     AIM_LOG_VERBOSE("port features get called\n");
+    port_features_get_count++;
     return INDIGO_ERROR_NONE;
 }
 
@@ -181,22 +235,119 @@ ind_cxn_reset(indigo_cxn_id_t cxn_id)
     return;
 }
 
+/* Count and code of the error replies sent */
+static int error_reply_count;
+static uint16_t last_error_code;
+
 void
 indigo_cxn_send_error_reply(indigo_cxn_id_t cxn_id, of_object_t *orig,
                             uint16_t type, uint16_t code)
 {
     AIM_LOG_VERBOSE("Send error msg called for cxn id %d\n",
                       cxn_id);
+    error_reply_count++;
+    last_error_code = code;
 }
 
 static int controller_message_counters[OF_MESSAGE_OBJECT_COUNT];
 
+/* XID of the last message sent to the controller */
+static uint32_t controller_message_xid;
+
+/* sw_desc of the last desc stats reply */
+static of_desc_str_t last_sw_desc;
+
+/* Flow stats entries sent, and flow stats replies without the more flag */
+static int flow_stats_entry_count;
+static int flow_stats_final_count;
+
+/* Duration reported for the last flow with a packet count */
+static uint32_t counted_flow_duration_sec;
+
+/* Group desc stats entries and replies sent, and replies without the more flag */
+static int group_desc_entry_count;
+static int group_desc_reply_count;
+static int group_desc_final_count;
+
+/* Gentable entry desc stats entries sent, and replies without the more flag.
+   Read by gentable_bench.c */
+int gentable_desc_entry_count;
+int gentable_desc_final_count;
+
+/* Debug counter stats entries sent and the sum of their values */
+static int debug_counter_entry_count;
+static uint64_t debug_counter_value_sum;
+
 void
 indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
 {
     AIM_LOG_VERBOSE("Send msg called for cxn id %d, obj type %d\n",
                       cxn_id, obj->object_id);
     controller_message_counters[obj->object_id]++;
+    controller_message_xid = of_message_xid_get(OF_OBJECT_TO_MESSAGE(obj));
+    if (obj->object_id == OF_FLOW_STATS_REPLY) {
+        of_list_flow_stats_entry_t list;
+        of_flow_stats_entry_t entry;
+        uint16_t flags;
+        int rv;
+
+        of_flow_stats_reply_entries_bind(obj, &list);
+        OF_LIST_FLOW_STATS_ENTRY_ITER(&list, &entry, rv) {
+            uint64_t packets;
+            flow_stats_entry_count++;
+            of_flow_stats_entry_packet_count_get(&entry, &packets);
+            if (packets != 0) {
+                of_flow_stats_entry_duration_sec_get(&entry, &counted_flow_duration_sec);
+            }
+        }
+        of_flow_stats_reply_flags_get(obj, &flags);
+        if (flags == 0) {
+            flow_stats_final_count++;
+        }
+    } else if (obj->object_id == OF_DESC_STATS_REPLY) {
+        of_desc_stats_reply_sw_desc_get(obj, &last_sw_desc);
+    } else if (obj->object_id == OF_GROUP_DESC_STATS_REPLY) {
+        of_list_group_desc_stats_entry_t list;
+        of_group_desc_stats_entry_t entry;
+        uint16_t flags;
+        int rv;
+
+        of_group_desc_stats_reply_entries_bind(obj, &list);
+        OF_LIST_GROUP_DESC_STATS_ENTRY_ITER(&list, &entry, rv) {
+            group_desc_entry_count++;
+        }
+        group_desc_reply_count++;
+        of_group_desc_stats_reply_flags_get(obj, &flags);
+        if (flags == 0) {
+            group_desc_final_count++;
+        }
+    } else if (obj->object_id == OF_BSN_GENTABLE_ENTRY_DESC_STATS_REPLY) {
+        of_list_bsn_gentable_entry_desc_stats_entry_t list;
+        of_bsn_gentable_entry_desc_stats_entry_t entry;
+        uint16_t flags;
+        int rv;
+
+        of_bsn_gentable_entry_desc_stats_reply_entries_bind(obj, &list);
+        OF_LIST_BSN_GENTABLE_ENTRY_DESC_STATS_ENTRY_ITER(&list, &entry, rv) {
+            gentable_desc_entry_count++;
+        }
+        of_bsn_gentable_entry_desc_stats_reply_flags_get(obj, &flags);
+        if (flags == 0) {
+            gentable_desc_final_count++;
+        }
+    } else if (obj->object_id == OF_BSN_DEBUG_COUNTER_STATS_REPLY) {
+        of_list_bsn_debug_counter_stats_entry_t list;
+        of_bsn_debug_counter_stats_entry_t entry;
+        uint64_t value;
+        int rv;
+
+        of_bsn_debug_counter_stats_reply_entries_bind(obj, &list);
+        OF_LIST_BSN_DEBUG_COUNTER_STATS_ENTRY_ITER(&list, &entry, rv) {
+            of_bsn_debug_counter_stats_entry_value_get(&entry, &value);
+            debug_counter_entry_count++;
+            debug_counter_value_sum += value;
+        }
+    }
     of_object_delete(obj);
 }
 
@@ -211,6 +362,30 @@ indigo_cxn_send_async_message(of_object_t *obj)
     of_object_delete(obj);
 }
 
+void
+indigo_cxn_send_async_message_copy(of_object_t *obj)
+{
+    AIM_LOG_VERBOSE("Send async msg copy called for type %s",
+                    of_object_id_str[obj->object_id]);
+    /* The caller keeps the object; the encoded length must be final */
+    INDIGO_ASSERT(of_message_length_get(OF_OBJECT_TO_MESSAGE(obj)) == obj->length);
+    async_message_counters[obj->object_id]++;
+}
+
+int
+indigo_cxn_send_congested(indigo_cxn_id_t cxn_id)
+{
+    return 0;
+}
+
+indigo_error_t
+indigo_cxn_connection_status_get(indigo_cxn_id_t cxn_id,
+                                 indigo_cxn_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    return INDIGO_ERROR_NONE;
+}
+
 indigo_error_t
 indigo_cxn_get_async_version(of_version_t *ver)
 {
@@ -218,6 +393,27 @@ indigo_cxn_get_async_version(of_version_t *ver)
     return INDIGO_ERROR_NONE;
 }
 
+indigo_error_t
+indigo_cxn_get_async_version_for(of_object_id_t object_id, of_version_t *ver)
+{
+    *ver = OF_VERSION_1_0;
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+indigo_cxn_status_change_register(indigo_cxn_status_change_f handler,
+                                  void *cookie)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+indigo_cxn_status_change_unregister(indigo_cxn_status_change_f handler,
+                                    void *cookie)
+{
+    return INDIGO_ERROR_NONE;
+}
+
 indigo_error_t
 ind_cxn_message_track_setup(indigo_cxn_id_t cxn_id, of_object_t *obj)
 {
@@ -313,19 +509,27 @@ indigo_error_t indigo_port_desc_stats_get(
     of_port_desc_stats_reply_t *port_desc_stats_reply)
 {
     AIM_LOG_VERBOSE("port desc stats get called");
+    port_desc_stats_get_count++;
     return INDIGO_ERROR_NONE;
 }
 
 indigo_error_t
 indigo_fwd_group_add(uint32_t id, uint8_t group_type, of_list_bucket_t *buckets)
 {
-    return INDIGO_ERROR_NOT_SUPPORTED;
+    return INDIGO_ERROR_NONE;
 }
 
+/* Result of group modifies; the first 'group_modify_failures' fail */
+static int group_modify_failures;
+
 indigo_error_t
 indigo_fwd_group_modify(uint32_t id, of_list_bucket_t *buckets)
 {
-    return INDIGO_ERROR_NOT_SUPPORTED;
+    if (group_modify_failures > 0) {
+        group_modify_failures--;
+        return INDIGO_ERROR_UNKNOWN;
+    }
+    return INDIGO_ERROR_NONE;
 }
 
 void
@@ -338,6 +542,13 @@ indigo_fwd_group_stats_get(uint32_t id, of_group_stats_entry_t *entry)
 {
 }
 
+indigo_error_t
+indigo_fwd_group_stats_bulk_get(indigo_fwd_group_stats_t *stats,
+                                uint32_t max, uint32_t *count)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
 void
 indigo_fwd_pipeline_get(of_desc_str_t pipeline)
 {
@@ -419,13 +630,15 @@ depopulate_table(ft_instance_t ft)
 {
     int idx;
     ft_entry_t *entry;
+    of_match_t match;
     int count;
 
     count = ft->status.current_count;
     for (idx = 0; idx < count; ++idx) {
         entry = ft_lookup(ft, TEST_KEY(idx));
         TEST_ASSERT(entry != NULL);
-        TEST_ASSERT(entry->match.fields.eth_type == TEST_ETH_TYPE(idx));
+        ft_entry_match_get(entry, &match);
+        TEST_ASSERT(match.fields.eth_type == TEST_ETH_TYPE(idx));
         ft_delete(ft, entry);
         TEST_ASSERT(check_table_entry_states(ft) == 0);
     }
@@ -452,14 +665,32 @@ check_bucket_counts(ft_instance_t ft, int expected)
     for (idx = 0; idx < ft->config.flow_id_bucket_count; idx++) {
         count += list_length(&ft->flow_id_buckets[idx]);
     }
+    if (ft->flow_id_rehash.buckets != NULL) {
+        for (idx = 0; idx < ft->flow_id_rehash.bucket_count; idx++) {
+            count += list_length(&ft->flow_id_rehash.buckets[idx]);
+        }
+    }
     TEST_ASSERT(count == expected);
 
     count = 0;
     for (idx = 0; idx < ft->config.strict_match_bucket_count; idx++) {
         count += list_length(&ft->strict_match_buckets[idx]);
     }
+    if (ft->strict_match_rehash.buckets != NULL) {
+        for (idx = 0; idx < ft->strict_match_rehash.bucket_count; idx++) {
+            count += list_length(&ft->strict_match_rehash.buckets[idx]);
+        }
+    }
     TEST_ASSERT(count == expected);
 
+    if (ft->cookie_range_buckets != NULL) {
+        count = 0;
+        for (idx = 0; idx < ft->cookie_range_bucket_count; idx++) {
+            count += list_length(&ft->cookie_range_buckets[idx]);
+        }
+        TEST_ASSERT(count == expected);
+    }
+
     return 0;
 }
 
@@ -540,6 +771,7 @@ test_ft_hash(void)
     uint64_t orig_cookie;
     uint16_t orig_eth_type;
     int idx;
+    int shared_effects;
     ft_entry_t *lookup_entry;
 
     /* Test edge cases for create/destroy */
@@ -674,9 +906,15 @@ test_ft_hash(void)
     /* Create a new flow table and add TEST_FLOW_COUNT entries. Do some queries */
     ft = ft_create(&config);
     TEST_ASSERT(ft != NULL);
+    shared_effects = ft_shared_effects_count(ft);
     TEST_OK(populate_table(ft, TEST_FLOW_COUNT, &query.match));
     orig_eth_type = query.match.fields.eth_type; /* Last ethtype added */
 
+    /* The flows differ only in the match, so they share one actions list */
+    TEST_ASSERT(ft_shared_effects_count(ft) == shared_effects + 1);
+    TEST_ASSERT(ft_lookup(ft, TEST_KEY(0))->effects.actions ==
+                ft_lookup(ft, TEST_KEY(1))->effects.actions);
+
     /* Query table and expect to get all results */
     query.out_port                      = OF_PORT_DEST_WILDCARD;
     query.mode                          = OF_MATCH_NON_STRICT;
@@ -719,6 +957,7 @@ test_ft_hash(void)
 
     TEST_OK(depopulate_table(ft));
     TEST_ASSERT(check_bucket_counts(ft, 0) == 0);
+    TEST_ASSERT(ft_shared_effects_count(ft) == shared_effects);
     ft_destroy(ft);
     ft = NULL;
 
@@ -857,6 +1096,46 @@ test_ft_iterator(void)
         ft_iterator_cleanup(&iter);
     }
 
+    /* A snapshot does not return entries added after it started */
+    {
+        ft_entry_t *entry;
+        ft_iterator_t iter;
+        ft_iterator_init_snapshot(&iter, ft, NULL);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[1]);
+        TEST_OK(add_flow(ft, 3, &entry));
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[2]);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[0]);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        ft_iterator_cleanup(&iter);
+        ft_delete(ft, entry);
+    }
+
+    /* Delete the entry about to be returned; it is not freed until cleanup */
+    /* Implementation dependent */
+    {
+        ft_entry_t *entry;
+        ft_iterator_t iter;
+        ft_iterator_init(&iter, ft, NULL);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[1]);
+        ft_delete(ft, entries[2]);
+        TEST_OK(add_flow(ft, 2, &entry));
+        TEST_ASSERT(entry != entries[2]);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[0]);
+        TEST_ASSERT(ft_iterator_next(&iter) == entry);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        TEST_ASSERT(!list_empty(&ft->retired));
+        ft_iterator_cleanup(&iter);
+        TEST_ASSERT(list_empty(&ft->retired));
+        ft_delete(ft, entries[0]);
+        ft_delete(ft, entries[1]);
+        ft_delete(ft, entry);
+    }
+
+    /* Repopulate table */
+    for (i = 0; i < num_flows; i++) {
+        TEST_OK(add_flow(ft, i, &entries[i]));
+    }
+
     /* Check query by cookie */
     /* Wildcards lowest cookie bit, so cookies 0 and 1 match while 2 does not */
     {
@@ -891,6 +1170,46 @@ test_ft_iterator(void)
         ft_iterator_cleanup(&iter);
     }
 
+    /* Check query by table ID */
+    /* Entry 1 is moved to table 5, entries 0 and 2 stay in table 0 */
+    {
+        of_meta_match_t query;
+        ft_iterator_t iter;
+        TEST_OK(add_flow(ft, 0, &entries[0]));
+        TEST_OK(add_flow(ft, 1, &entries[1]));
+        ft_entry_table_id_set(ft, entries[1], 5);
+        memset(&query, 0, sizeof(query));
+        query.mode = OF_MATCH_NON_STRICT;
+        query.out_port = OF_PORT_DEST_WILDCARD;
+        query.table_id = 5;
+        ft_iterator_init(&iter, ft, &query);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[1]);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        ft_iterator_cleanup(&iter);
+
+        query.table_id = 0;
+        ft_iterator_init(&iter, ft, &query);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[2]);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[0]);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        ft_iterator_cleanup(&iter);
+
+        /* Moving the next entry to another table skips it */
+        ft_iterator_init(&iter, ft, &query);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[2]);
+        ft_entry_table_id_set(ft, entries[0], 5);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        ft_iterator_cleanup(&iter);
+
+        /* Also when reached through a deleted entry */
+        ft_entry_table_id_set(ft, entries[0], 0);
+        ft_iterator_init(&iter, ft, &query);
+        ft_delete(ft, entries[2]);
+        ft_entry_table_id_set(ft, entries[0], 5);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        ft_iterator_cleanup(&iter);
+    }
+
     ft_destroy(ft);
 
     return TEST_PASS;
@@ -959,144 +1278,1588 @@ test_ft_iter_task(void)
     return TEST_PASS;
 }
 
+/* Grow the indexes of a small table, then shrink them back */
 static int
-test_hello(void)
+test_ft_resize(void)
 {
-    of_hello_t *hello;
+    ft_instance_t ft;
+    ft_config_t config = {
+        16, /* strict_match buckets */
+        16, /* flow_id buckets */
+    };
+    of_meta_match_t query;
+    ft_entry_t *entry;
+    int idx;
 
-    hello = of_hello_new(OF_VERSION_1_0);
-    indigo_core_receive_controller_message(0, hello);
-    of_object_delete(hello);
+    ft = ft_create(&config);
+    TEST_OK(populate_table(ft, TEST_FLOW_COUNT, &query.match));
+    TEST_ASSERT(ft->status.index_resizes > 0);
+    TEST_ASSERT(check_bucket_counts(ft, TEST_FLOW_COUNT) == 0);
+
+    /* Lookups see entries not yet moved by the resize */
+    memset(&query, 0, sizeof(query));
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        entry = ft_lookup(ft, TEST_KEY(idx));
+        TEST_ASSERT(entry != NULL);
+        ft_entry_match_get(entry, &query.match);
+        query.mode = OF_MATCH_STRICT;
+        query.table_id = TABLE_ID_ANY;
+        query.out_port = OF_PORT_DEST_WILDCARD;
+        query.check_priority = 1;
+        query.priority = entry->priority;
+        TEST_INDIGO_OK(ft_strict_match(ft, &query, &entry));
+        TEST_ASSERT(entry->id == TEST_KEY(idx));
+    }
+
+    while (ft->rehash_task != NULL) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(ft->config.strict_match_bucket_count * FT_HASH_MAX_LOAD >=
+                TEST_FLOW_COUNT);
+    TEST_ASSERT(ft->config.flow_id_bucket_count * FT_HASH_MAX_LOAD >=
+                TEST_FLOW_COUNT);
+    TEST_ASSERT(check_bucket_counts(ft, TEST_FLOW_COUNT) == 0);
+
+    TEST_OK(depopulate_table(ft));
+    while (ft->rehash_task != NULL) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(ft->config.strict_match_bucket_count == 16);
+    TEST_ASSERT(ft->config.flow_id_bucket_count == 16);
+    TEST_ASSERT(check_bucket_counts(ft, 0) == 0);
+
+    ft_destroy(ft);
 
     return TEST_PASS;
 }
 
+/* Table and bucket checksums follow flow adds and deletes */
 static int
-test_packet_out(void)
+test_ft_checksum(void)
 {
-    of_packet_out_t *pkt_out;
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_flow_add_t *flow_add;
+    ft_entry_t *entries[8];
+    uint64_t cookie, expected = 0, buckets[4] = { 0 };
+    int i;
 
-    pkt_out = of_packet_out_new(OF_VERSION_1_0);
-    /* Could add params, but core doesn't do anything with them */
-    indigo_core_receive_controller_message(0, pkt_out);
-    of_object_delete(pkt_out);
+    ft = ft_create(&config);
+
+    for (i = 0; i < 8; i++) {
+        cookie = ((uint64_t)(i % 4) << 62) | (i + 1);
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        of_flow_add_OF_VERSION_1_0_populate(flow_add, i);
+        of_flow_add_flags_set(flow_add, 0);
+        of_flow_add_cookie_set(flow_add, cookie);
+        TEST_INDIGO_OK(ft_add(ft, i, flow_add, &entries[i]));
+        of_object_delete(flow_add);
+        expected ^= cookie;
+        buckets[i % 4] ^= cookie;
+    }
+    TEST_ASSERT(ft->checksums[0].checksum == expected);
+    TEST_ASSERT(ft_checksum_bucket_get(ft, 0, 0) == expected);
+
+    TEST_ASSERT(ft_checksum_buckets_set(ft, 0, 3) == INDIGO_ERROR_PARAM);
+    TEST_INDIGO_OK(ft_checksum_buckets_set(ft, 0, 4));
+    for (i = 0; i < 4; i++) {
+        TEST_ASSERT(ft_checksum_bucket_get(ft, 0, i) == buckets[i]);
+    }
+
+    cookie = entries[5]->cookie;
+    ft_delete(ft, entries[5]);
+    TEST_ASSERT(ft->checksums[0].checksum == (expected ^ cookie));
+    TEST_ASSERT(ft_checksum_bucket_get(ft, 0, 1) == (buckets[1] ^ cookie));
+
+    ft_destroy(ft);
 
     return TEST_PASS;
 }
 
+/* Content checksums follow the effects of a flow */
 static int
-test_packet_in(void)
+test_ft_content_checksum(void)
 {
-    of_packet_in_t *pkt_in;
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+        0,    /* cookie_index_shift */
+        0,    /* cookie_index_bits */
+        1,    /* content_checksums */
+    };
+    of_flow_add_t *flow_add;
+    of_flow_modify_t *flow_mod;
+    ft_entry_t *entry;
+    uint64_t checksum;
 
-    pkt_in = of_packet_in_new(OF_VERSION_1_0);
-    /* Could add params, but core doesn't do anything with them */
-    TEST_INDIGO_OK(indigo_core_packet_in(pkt_in));
+    ft = ft_create(&config);
+
+    flow_add = of_flow_add_new(OF_VERSION_1_0);
+    of_flow_add_OF_VERSION_1_0_populate(flow_add, 1);
+    of_flow_add_flags_set(flow_add, 0);
+    TEST_INDIGO_OK(ft_add(ft, 1, flow_add, &entry));
+    of_object_delete(flow_add);
+
+    checksum = entry->checksum;
+    TEST_ASSERT(checksum != entry->cookie);
+    TEST_ASSERT(ft->checksums[0].checksum == checksum);
+
+    flow_mod = of_flow_modify_new(OF_VERSION_1_0);
+    of_flow_modify_OF_VERSION_1_0_populate(flow_mod, 2);
+    TEST_INDIGO_OK(ft_entry_modify_effects(ft, entry, flow_mod));
+    of_object_delete(flow_mod);
+
+    TEST_ASSERT(entry->checksum != checksum);
+    TEST_ASSERT(ft->checksums[0].checksum == entry->checksum);
+
+    ft_destroy(ft);
 
     return TEST_PASS;
 }
 
+/* Cookie masked queries use the cookie range index when it covers the mask */
 static int
-test_experimenter(void)
+test_ft_cookie_range(void)
 {
-    of_experimenter_t *exp;
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+        16,   /* cookie_index_shift */
+        16,   /* cookie_index_bits */
+    };
+    of_meta_match_t query;
+    ft_iterator_t iter;
+    ft_entry_t *entry;
+    int app, i, seen;
 
-    exp = of_experimenter_new(OF_VERSION_1_0);
-    /* Could add params, but core doesn't do anything with them */
-    indigo_core_receive_controller_message(0, exp);
-    of_object_delete(exp);
+    ft = ft_create(&config);
+    TEST_ASSERT(ft->cookie_range_buckets != NULL);
+
+    for (app = 0; app < 4; app++) {
+        for (i = 0; i < 4; i++) {
+            TEST_OK(add_flow(ft, (app << 16) | i, &entry));
+        }
+    }
+    TEST_ASSERT(check_bucket_counts(ft, 16) == 0);
+
+    memset(&query, 0, sizeof(query));
+    query.table_id = TABLE_ID_ANY;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.cookie = 2 << 16;
+    query.cookie_mask = 0xffff0000ULL;
+
+    ft_iterator_init(&iter, ft, &query);
+    TEST_ASSERT(iter.links_offset == offsetof(ft_entry_t, cookie_range_links));
+    seen = 0;
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        TEST_ASSERT((entry->cookie >> 16) == 2);
+        seen++;
+    }
+    ft_iterator_cleanup(&iter);
+    TEST_ASSERT(seen == 4);
+
+    /* The prefix index is used when the mask does not cover the range */
+    query.cookie_mask = 0xff00000000000000ULL;
+    ft_iterator_init(&iter, ft, &query);
+    TEST_ASSERT(iter.links_offset == offsetof(ft_entry_t, cookie_links));
+    ft_iterator_cleanup(&iter);
+
+    ft_destroy(ft);
 
     return TEST_PASS;
 }
 
 static int
-test_desc_strings(void)
+add_match_flow(ft_instance_t ft, int id, uint8_t table_id, uint16_t priority,
+               of_match_t *match, of_port_no_t out_port)
 {
-    of_desc_str_t desc_get;
-    of_desc_str_t desc_set;
-    of_serial_num_t ser_num_set;
-    of_serial_num_t ser_num_get;
+    of_version_t version = OF_VERSION_1_3;
+    of_flow_add_t *flow_add;
+    of_list_instruction_t *instructions;
+    of_instruction_apply_actions_t *apply;
+    of_list_action_t *actions;
+    of_action_output_t *output;
+
+    flow_add = of_flow_add_new(version);
+    of_flow_add_table_id_set(flow_add, table_id);
+    of_flow_add_priority_set(flow_add, priority);
+    match->version = version;
+    TEST_OK(of_flow_add_match_set(flow_add, match));
+
+    instructions = of_list_instruction_new(version);
+    apply = of_instruction_apply_actions_new(version);
+    actions = of_list_action_new(version);
+    output = of_action_output_new(version);
+    of_action_output_port_set(output, out_port);
+    TEST_OK(of_list_append(actions, output));
+    TEST_OK(of_instruction_apply_actions_actions_set(apply, actions));
+    TEST_OK(of_list_append(instructions, apply));
+    TEST_OK(of_flow_add_instructions_set(flow_add, instructions));
+    of_object_delete(output);
+    of_object_delete(actions);
+    of_object_delete(apply);
+    of_object_delete(instructions);
+
+    TEST_INDIGO_OK(ft_add(ft, id, flow_add, NULL));
+    of_object_delete(flow_add);
+    return 0;
+}
 
-    INDIGO_MEM_SET(ser_num_set, 0xee, OF_SERIAL_NUM_LEN);
-    INDIGO_MEM_CLEAR(ser_num_get, OF_SERIAL_NUM_LEN);
-    TEST_INDIGO_OK(ind_core_serial_num_set(ser_num_set));
-    TEST_INDIGO_OK(ind_core_serial_num_get(ser_num_get));
+static int
+test_ft_packet_match(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_match_t match;
+    of_match_fields_t fields, known;
+    ft_entry_t *entry;
+
+    ft = ft_create(&config);
+
+    /* IPv4 at 10, 10.0.0.1 at 20, everything else at 0 */
+    memset(&match, 0, sizeof(match));
+    TEST_OK(add_match_flow(ft, 3, 1, 0, &match, 3));
+    match.fields.eth_type = 0x0800;
+    match.masks.eth_type = 0xffff;
+    TEST_OK(add_match_flow(ft, 1, 1, 10, &match, 1));
+    TEST_OK(add_match_flow(ft, 4, 2, 100, &match, 4));
+    match.fields.ipv4_dst = 0x0a000001;
+    match.masks.ipv4_dst = 0xffffffff;
+    TEST_OK(add_match_flow(ft, 2, 1, 20, &match, 2));
+
+    memset(&fields, 0, sizeof(fields));
+    fields.eth_type = 0x0800;
+    fields.ipv4_dst = 0x0a000001;
+    TEST_INDIGO_OK(ft_packet_match(ft, 1, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 2);
+    fields.ipv4_dst = 0x0a000002;
+    TEST_INDIGO_OK(ft_packet_match(ft, 1, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 1);
+    fields.eth_type = 0x0806;
+    TEST_INDIGO_OK(ft_packet_match(ft, 1, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 3);
+    TEST_ASSERT(ft_packet_match(ft, 3, &fields, NULL, &entry) ==
+                INDIGO_ERROR_NOT_FOUND);
+
+    /* Removing the best match exposes the next one */
+    ft_delete(ft, ft_lookup(ft, 2));
+    fields.eth_type = 0x0800;
+    fields.ipv4_dst = 0x0a000001;
+    TEST_INDIGO_OK(ft_packet_match(ft, 1, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 1);
+
+    /* Entries follow their table ID */
+    ft_entry_table_id_set(ft, ft_lookup(ft, 4), 1);
+    TEST_INDIGO_OK(ft_packet_match(ft, 1, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 4);
+    TEST_ASSERT(ft_packet_match(ft, 2, &fields, NULL, &entry) ==
+                INDIGO_ERROR_NOT_FOUND);
+
+    /* A better flow on a field the packet did not set */
+    memset(&match, 0, sizeof(match));
+    match.fields.tunnel_id = 5;
+    match.masks.tunnel_id = ~(uint64_t)0;
+    TEST_OK(add_match_flow(ft, 5, 1, 200, &match, 5));
+    memset(&known, 0, sizeof(known));
+    known.eth_type = 0xffff;
+    known.ipv4_dst = 0xffffffff;
+    TEST_ASSERT(ft_packet_match(ft, 1, &fields, &known, &entry) ==
+                INDIGO_ERROR_NOT_SUPPORTED);
+    TEST_INDIGO_OK(ft_packet_match(ft, 1, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 4);
+
+    ft_destroy(ft);
+
+    return TEST_PASS;
+}
+
+static int
+add_route_flow(ft_instance_t ft, int id, uint32_t vrf, uint32_t dst, int len,
+               uint16_t priority)
+{
+    of_match_t match;
+
+    memset(&match, 0, sizeof(match));
+    match.fields.eth_type = 0x0800;
+    match.masks.eth_type = 0xffff;
+    match.fields.bsn_vrf = vrf;
+    match.masks.bsn_vrf = 0xffffffff;
+    match.masks.ipv4_dst = len == 0 ? 0 : ~(uint32_t)0 << (32 - len);
+    match.fields.ipv4_dst = dst & match.masks.ipv4_dst;
+    return add_match_flow(ft, id, 30, priority, &match, id);
+}
+
+static int
+route_overlap_find(ft_instance_t ft, uint32_t vrf, uint32_t dst, int len,
+                   uint16_t priority, ft_entry_t **entry)
+{
+    of_meta_match_t query;
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_OVERLAP;
+    query.table_id = 30;
+    query.check_priority = 1;
+    query.priority = priority;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.match.version = OF_VERSION_1_3;
+    query.match.fields.eth_type = 0x0800;
+    query.match.masks.eth_type = 0xffff;
+    query.match.fields.bsn_vrf = vrf;
+    query.match.masks.bsn_vrf = 0xffffffff;
+    query.match.masks.ipv4_dst = len == 0 ? 0 : ~(uint32_t)0 << (32 - len);
+    query.match.fields.ipv4_dst = dst & query.match.masks.ipv4_dst;
+    return ft_overlap_find(ft, &query, entry);
+}
+
+static int
+test_ft_lpm(void)
+{
+    ft_instance_t ft, plain;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_match_t match;
+    of_match_fields_t fields;
+    ft_entry_t *entry, *expected;
+    indigo_error_t rv;
+    uint32_t dst, vrf;
+    uint16_t priority;
+    int i, id, len;
+
+    plain = ft_create(&config);
+    config.lpm_table_id = 30;
+    ft = ft_create(&config);
+    TEST_ASSERT(ft->lpm != NULL && plain->lpm == NULL);
+
+    /* Priority follows prefix length, as in a routing table */
+    TEST_OK(add_route_flow(ft, 1, 1, 0, 0, 0));
+    TEST_OK(add_route_flow(ft, 2, 1, 0x0a000000, 8, 8));
+    TEST_OK(add_route_flow(ft, 3, 1, 0x0a010000, 16, 16));
+    TEST_OK(add_route_flow(ft, 4, 1, 0x0a010200, 24, 24));
+    TEST_OK(add_route_flow(ft, 5, 2, 0x0a000000, 8, 8));
+
+    memset(&fields, 0, sizeof(fields));
+    fields.eth_type = 0x0800;
+    fields.bsn_vrf = 1;
+    fields.ipv4_dst = 0x0a010203;
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 4);
+    fields.ipv4_dst = 0x0a010303;
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 3);
+    fields.ipv4_dst = 0x0b000001;
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 1);
+    fields.bsn_vrf = 2;
+    fields.ipv4_dst = 0x0a010203;
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 5);
+    fields.bsn_vrf = 3;
+    TEST_ASSERT(ft_packet_match(ft, 30, &fields, NULL, &entry) ==
+                INDIGO_ERROR_NOT_FOUND);
+
+    /* Overlap needs the same priority and one prefix covering the other */
+    TEST_INDIGO_OK(route_overlap_find(ft, 1, 0x0a010000, 16, 24, &entry));
+    TEST_ASSERT(entry->id == 4);
+    TEST_INDIGO_OK(route_overlap_find(ft, 1, 0x0a010280, 25, 8, &entry));
+    TEST_ASSERT(entry->id == 2);
+    TEST_ASSERT(route_overlap_find(ft, 1, 0x0a020000, 16, 24, &entry) ==
+                INDIGO_ERROR_NOT_FOUND);
+    TEST_ASSERT(route_overlap_find(ft, 3, 0x0a000000, 8, 8, &entry) ==
+                INDIGO_ERROR_NOT_FOUND);
+
+    /* Removing a route exposes the covering one */
+    ft_delete(ft, ft_lookup(ft, 4));
+    fields.bsn_vrf = 1;
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 3);
+
+    /* A flow that is not a prefix match falls back to the tuples */
+    memset(&match, 0, sizeof(match));
+    match.fields.in_port = 7;
+    match.masks.in_port = 0xffffffff;
+    TEST_OK(add_match_flow(ft, 6, 30, 100, &match, 6));
+    fields.in_port = 7;
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 6);
+    ft_delete(ft, ft_lookup(ft, 6));
+    TEST_INDIGO_OK(ft_packet_match(ft, 30, &fields, NULL, &entry));
+    TEST_ASSERT(entry->id == 3);
+    ft_delete(ft, ft_lookup(ft, 1));
+    ft_delete(ft, ft_lookup(ft, 2));
+    ft_delete(ft, ft_lookup(ft, 3));
+    ft_delete(ft, ft_lookup(ft, 5));
+
+    /* Random routes, with priorities unrelated to length, match as tuples do */
+    srand(1);
+    for (id = 1; id <= 2000; id++) {
+        if (id > 500 && rand() % 3 == 0) {
+            i = 1 + rand() % id;
+            if ((entry = ft_lookup(ft, i)) != NULL) {
+                ft_delete(ft, entry);
+                ft_delete(plain, ft_lookup(plain, i));
+            }
+            continue;
+        }
+        vrf = rand() % 2;
+        dst = (uint32_t)(rand() & 0xf) << 28 | (rand() & 0xff) << 8;
+        len = rand() % 33;
+        priority = len + rand() % 8;
+        TEST_OK(add_route_flow(ft, id, vrf, dst, len, priority));
+        TEST_OK(add_route_flow(plain, id, vrf, dst, len, priority));
+    }
+
+    for (i = 0; i < 2000; i++) {
+        fields.in_port = 0;
+        fields.bsn_vrf = rand() % 3;
+        fields.ipv4_dst = (uint32_t)(rand() & 0xf) << 28 |
+            (rand() & 0xff) << 8 | (rand() & 0xff);
+        rv = ft_packet_match(plain, 30, &fields, NULL, &expected);
+        TEST_ASSERT(ft_packet_match(ft, 30, &fields, NULL, &entry) == rv);
+        TEST_ASSERT(rv != INDIGO_ERROR_NONE || entry->priority == expected->priority);
+
+        vrf = fields.bsn_vrf;
+        len = rand() % 33;
+        priority = len + rand() % 8;
+        rv = route_overlap_find(plain, vrf, fields.ipv4_dst, len, priority, &expected);
+        TEST_ASSERT(route_overlap_find(ft, vrf, fields.ipv4_dst, len, priority,
+                                       &entry) == rv);
+    }
+
+    ft_destroy(ft);
+    ft_destroy(plain);
+
+    return TEST_PASS;
+}
+
+/* Set the effects of an entry to output to one or two ports */
+static int
+set_flow_outputs(ft_instance_t ft, ft_entry_t *entry, of_port_no_t port,
+                 of_port_no_t port2)
+{
+    of_version_t version = OF_VERSION_1_3;
+    of_flow_modify_t *flow_mod;
+    of_list_instruction_t *instructions;
+    of_instruction_apply_actions_t *apply;
+    of_list_action_t *actions;
+    of_action_output_t *output;
+
+    flow_mod = of_flow_modify_new(version);
+    instructions = of_list_instruction_new(version);
+    apply = of_instruction_apply_actions_new(version);
+    actions = of_list_action_new(version);
+    output = of_action_output_new(version);
+    of_action_output_port_set(output, port);
+    TEST_OK(of_list_append(actions, output));
+    if (port2 != 0) {
+        of_action_output_port_set(output, port2);
+        TEST_OK(of_list_append(actions, output));
+    }
+    TEST_OK(of_instruction_apply_actions_actions_set(apply, actions));
+    TEST_OK(of_list_append(instructions, apply));
+    TEST_OK(of_flow_modify_instructions_set(flow_mod, instructions));
+    of_object_delete(output);
+    of_object_delete(actions);
+    of_object_delete(apply);
+    of_object_delete(instructions);
+
+    TEST_INDIGO_OK(ft_entry_modify_effects(ft, entry, flow_mod));
+    of_object_delete(flow_mod);
+    return 0;
+}
+
+/*
+ * Count the entries of table 50 a non-strict query by VLAN ID and out
+ * port returns; vid or port 0 for none
+ */
+static int
+l2_query_count(ft_instance_t ft, uint16_t vid, of_port_no_t port,
+               bool *indexed)
+{
+    of_meta_match_t query;
+    ft_iterator_t iter;
+    int count = 0;
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.table_id = 50;
+    query.out_port = port != 0 ? port : OF_PORT_DEST_WILDCARD;
+    query.match.version = OF_VERSION_1_3;
+    if (vid != 0) {
+        query.match.fields.vlan_vid = 0x1000 | vid;
+        query.match.masks.vlan_vid = 0x1fff;
+    }
+
+    ft_iterator_init(&iter, ft, &query);
+    *indexed = iter.head != &ft->table_id_buckets[50];
+    while (ft_iterator_next(&iter) != NULL) {
+        count++;
+    }
+    ft_iterator_cleanup(&iter);
+
+    return count;
+}
+
+static int
+test_ft_l2_index(void)
+{
+    ft_instance_t ft, plain;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_match_t match;
+    ft_entry_t *entry;
+    bool indexed;
+    uint16_t vid;
+    of_port_no_t port;
+    int id, count;
+
+    plain = ft_create(&config);
+    config.l2_table_id = 50;
+    ft = ft_create(&config);
+    TEST_ASSERT(ft->vlan_buckets != NULL && plain->vlan_buckets == NULL);
+
+    /* MACs learned on 8 ports in 4 VLANs, and a flood entry per VLAN */
+    for (id = 1; id <= 400; id++) {
+        memset(&match, 0, sizeof(match));
+        match.fields.vlan_vid = 0x1000 | (10 + id % 4);
+        match.masks.vlan_vid = 0x1fff;
+        match.fields.eth_dst.addr[4] = id >> 8;
+        match.fields.eth_dst.addr[5] = id;
+        memset(&match.masks.eth_dst, 0xff, sizeof(match.masks.eth_dst));
+        TEST_OK(add_match_flow(ft, id, 50, 2, &match, 1 + id % 8));
+        TEST_OK(add_match_flow(plain, id, 50, 2, &match, 1 + id % 8));
+    }
+    for (vid = 10; vid < 14; vid++) {
+        memset(&match, 0, sizeof(match));
+        match.fields.vlan_vid = 0x1000 | vid;
+        match.masks.vlan_vid = 0x1fff;
+        TEST_OK(add_match_flow(ft, 1000 + vid, 50, 1, &match, 9));
+        TEST_OK(add_match_flow(plain, 1000 + vid, 50, 1, &match, 9));
+    }
+
+    /* The same entries are found with and without the index */
+    for (vid = 9; vid < 14; vid++) {
+        for (port = 0; port <= 9; port++) {
+            count = l2_query_count(plain, vid == 9 ? 0 : vid, port, &indexed);
+            TEST_ASSERT(l2_query_count(ft, vid == 9 ? 0 : vid, port,
+                                       &indexed) == count);
+            TEST_ASSERT(indexed == (vid != 9 || port != 0));
+        }
+    }
+    TEST_ASSERT(l2_query_count(ft, 0, 1, &indexed) == 50);
+    TEST_ASSERT(l2_query_count(ft, 11, 0, &indexed) == 101);
+
+    /* A modify moves the entry to its new egress */
+    entry = ft_lookup(ft, 8);
+    TEST_OK(set_flow_outputs(ft, entry, 2, 0));
+    TEST_ASSERT(l2_query_count(ft, 0, 1, &indexed) == 49);
+    TEST_ASSERT(l2_query_count(ft, 0, 2, &indexed) == 51);
+
+    /* An entry with two egresses turns the egress index off */
+    TEST_OK(set_flow_outputs(ft, entry, 1, 2));
+    TEST_ASSERT(ft->l2_multi_egress_count == 1);
+    TEST_ASSERT(l2_query_count(ft, 0, 1, &indexed) == 50);
+    TEST_ASSERT(!indexed);
+    TEST_ASSERT(l2_query_count(ft, 10, 2, &indexed) == 1);
+    TEST_ASSERT(indexed);
+    ft_delete(ft, entry);
+    TEST_ASSERT(ft->l2_multi_egress_count == 0);
+    TEST_ASSERT(l2_query_count(ft, 0, 1, &indexed) == 49);
+    TEST_ASSERT(indexed);
+
+    /* Deleting while iterating the egress list */
+    {
+        of_meta_match_t query;
+        ft_iterator_t iter;
+        memset(&query, 0, sizeof(query));
+        query.mode = OF_MATCH_NON_STRICT;
+        query.table_id = 50;
+        query.out_port = 3;
+        query.match.version = OF_VERSION_1_3;
+        ft_iterator_init(&iter, ft, &query);
+        count = 0;
+        while ((entry = ft_iterator_next(&iter)) != NULL) {
+            ft_delete(ft, entry);
+            count++;
+        }
+        ft_iterator_cleanup(&iter);
+        TEST_ASSERT(count == 50);
+        TEST_ASSERT(l2_query_count(ft, 0, 3, &indexed) == 0);
+        TEST_ASSERT(FT_STATUS(ft)->current_count == 404 - 1 - 50);
+    }
+
+    ft_destroy(ft);
+    ft_destroy(plain);
+
+    return TEST_PASS;
+}
+
+static int
+add_shard_flow(ft_shards_t *shards, int id, uint8_t table_id,
+               uint16_t eth_type)
+{
+    of_flow_add_t *flow_add;
+    of_match_t match;
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.fields.eth_type = eth_type;
+    match.masks.eth_type = 0xffff;
+
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_table_id_set(flow_add, table_id);
+    of_flow_add_cookie_set(flow_add, id);
+    TEST_OK(of_flow_add_match_set(flow_add, &match));
+    TEST_INDIGO_OK(ft_shards_add(shards, id, flow_add, NULL));
+    of_object_delete(flow_add);
+    return 0;
+}
+
+struct shard_iter_state {
+    ft_shards_t *shards;
+    int finished;
+    int entries_seen;
+    int table_id;
+};
+
+/* Delete the even flows, check the table of the others */
+static void
+shard_iter_cb(void *cookie, ft_entry_t *entry)
+{
+    struct shard_iter_state *state = cookie;
+    if (entry != NULL) {
+        state->entries_seen++;
+        if (state->table_id >= 0 && entry->table_id != state->table_id) {
+            state->finished = -2;
+        }
+        if (entry->id % 2 == 0) {
+            ft_shards_delete(state->shards, entry);
+        }
+    } else if (state->finished == 0) {
+        state->finished = 1;
+    }
+}
+
+static int
+test_ft_shards(void)
+{
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    ft_shards_t *shards;
+    struct shard_iter_state state;
+    of_meta_match_t query;
+    of_flow_add_t *flow_add;
+    ft_status_t status;
+    ft_entry_t *entry;
+    int id;
+
+    config.lpm_table_id = 30;
+    config.l2_table_id = 50;
+    shards = ft_shards_create(&config, true);
+
+    /* Bridging, routing and ACL flows each land in their own shard */
+    for (id = 1; id <= 300; id++) {
+        TEST_OK(add_shard_flow(shards, id, id % 3 == 0 ? 60 : id % 3 == 1 ? 50 : 30,
+                               0x800 + id));
+    }
+    TEST_ASSERT(shards->count == 3);
+    TEST_ASSERT(ft_shards_current_count(shards) == 300);
+    TEST_ASSERT(FT_STATUS(ft_shards_find(shards, 50))->current_count == 100);
+    TEST_ASSERT(ft_shards_find(shards, 30)->lpm != NULL);
+    TEST_ASSERT(ft_shards_find(shards, 50)->lpm == NULL);
+    TEST_ASSERT(ft_shards_find(shards, 50)->vlan_buckets != NULL);
+    TEST_ASSERT(ft_shards_find(shards, 60)->vlan_buckets == NULL);
+    TEST_ASSERT(ft_shards_find(shards, 10) == NULL);
+    TEST_ASSERT(FT_CONFIG(ft_shards_find(shards, 60))->flow_id_bucket_count ==
+                FT_SHARD_MIN_BUCKETS);
+    TEST_ASSERT(ft_shards_find(shards, 30)->shared == ft_shards_find(shards, 60)->shared);
+
+    /* Flow IDs are unique across shards */
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_table_id_set(flow_add, 10);
+    TEST_ASSERT(ft_shards_add(shards, 3, flow_add, NULL) == INDIGO_ERROR_EXISTS);
+    of_object_delete(flow_add);
+    TEST_ASSERT(ft_shards_find(shards, 10) == NULL);
+
+    entry = ft_shards_lookup(shards, 3);
+    TEST_ASSERT(entry != NULL && entry->table_id == 60);
+    TEST_ASSERT(ft_shards_lookup(shards, 301) == NULL);
+
+    /* Strict match in the shard of the table, or in all of them */
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.match.version = OF_VERSION_1_3;
+    query.match.fields.eth_type = 0x800 + 4;
+    query.match.masks.eth_type = 0xffff;
+    query.table_id = 50;
+    TEST_ASSERT(ft_shards_strict_match(shards, &query, &entry) == INDIGO_ERROR_NONE);
+    TEST_ASSERT(entry->id == 4);
+    query.table_id = 30;
+    TEST_ASSERT(ft_shards_strict_match(shards, &query, &entry) == INDIGO_ERROR_NOT_FOUND);
+    query.table_id = 20;
+    TEST_ASSERT(ft_shards_strict_match(shards, &query, &entry) == INDIGO_ERROR_NOT_FOUND);
+    query.table_id = TABLE_ID_ANY;
+    TEST_ASSERT(ft_shards_strict_match(shards, &query, &entry) == INDIGO_ERROR_NONE);
+    TEST_ASSERT(entry->id == 4);
+
+    /* Moving an entry to another table moves it to that shard */
+    ft_shards_entry_table_id_set(shards, entry, 10);
+    TEST_ASSERT(shards->count == 4);
+    TEST_ASSERT(entry->table_id == 10);
+    TEST_ASSERT(FT_STATUS(ft_shards_find(shards, 50))->current_count == 99);
+    TEST_ASSERT(ft_lookup(ft_shards_find(shards, 50), 4) == NULL);
+    TEST_ASSERT(ft_lookup(ft_shards_find(shards, 10), 4) == entry);
+    TEST_ASSERT(ft_shards_lookup(shards, 4) == entry);
+    query.table_id = 10;
+    TEST_ASSERT(ft_shards_strict_match(shards, &query, &entry) == INDIGO_ERROR_NONE);
+    TEST_ASSERT(entry->id == 4);
+
+    ft_shards_status_get(shards, &status);
+    TEST_ASSERT(status.current_count == 300);
+    TEST_ASSERT(status.adds == 300);
+
+    /* Iterate all shards, deleting as we go */
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.match.version = OF_VERSION_1_3;
+    query.table_id = TABLE_ID_ANY;
+    state = (struct shard_iter_state) { .shards = shards, .table_id = -1 };
+    TEST_INDIGO_OK(ft_shards_spawn_iter_task(shards, &query, shard_iter_cb,
+                                             &state, IND_SOC_DEFAULT_PRIORITY));
+    while (state.finished == 0) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(state.finished == 1);
+    TEST_ASSERT(state.entries_seen == 300);
+
+    /* Iterate the shard of one table */
+    query.table_id = 60;
+    state = (struct shard_iter_state) { .shards = shards, .table_id = 60 };
+    TEST_INDIGO_OK(ft_shards_spawn_iter_task(shards, &query, shard_iter_cb,
+                                             &state, IND_SOC_DEFAULT_PRIORITY));
+    while (state.finished == 0) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(state.finished == 1);
+    TEST_ASSERT(state.entries_seen == 50);
+
+    /* A table without a shard still finishes the task */
+    query.table_id = 20;
+    state = (struct shard_iter_state) { .shards = shards, .table_id = 20 };
+    TEST_INDIGO_OK(ft_shards_spawn_iter_task(shards, &query, shard_iter_cb,
+                                             &state, IND_SOC_DEFAULT_PRIORITY));
+    while (state.finished == 0) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(state.finished == 1);
+    TEST_ASSERT(state.entries_seen == 0);
+    TEST_ASSERT(ft_shards_find(shards, 20) == NULL);
+
+    ft_shards_status_get(shards, &status);
+    TEST_ASSERT(status.current_count == 150);
+    TEST_ASSERT(status.deletes == 150);
+
+    ft_shards_destroy(shards);
+
+    /* Unsharded, every table maps to the one instance */
+    shards = ft_shards_create(&config, false);
+    TEST_ASSERT(shards->count == 1);
+    TEST_ASSERT(ft_shards_find(shards, 10) == ft_shards_find(shards, 60));
+    TEST_ASSERT(ft_shards_find(shards, 10)->lpm != NULL);
+    TEST_OK(add_shard_flow(shards, 1, 10, 0x800));
+    TEST_OK(add_shard_flow(shards, 2, 60, 0x806));
+    TEST_ASSERT(shards->count == 1);
+    TEST_ASSERT(ft_shards_current_count(shards) == 2);
+    ft_shards_destroy(shards);
+
+    return TEST_PASS;
+}
+
+static int
+test_pipeline_packet_out(void)
+{
+    of_version_t version = OF_VERSION_1_3;
+    ft_shards_t *shards;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    uint8_t pkt[60] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x00, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+        0x08, 0x00, 0x45, 0x00, 0x00, 0x2e, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11,
+        0x00, 0x00, 0x0a, 0x00, 0x00, 0x02, 0x0a, 0x00, 0x00, 0x01, 0x04, 0x00,
+        0x00, 0x35,
+    };
+    of_packet_out_t *packet_out, *resolved;
+    of_list_action_t *actions, list;
+    of_action_output_t *output;
+    of_action_t act;
+    of_octets_t data;
+    of_match_fields_t fields;
+    of_match_t match;
+    of_port_no_t port;
+    int loop_rv;
+
+    ind_core_pipeline_fields_parse(version, 7, pkt, sizeof(pkt), &fields);
+    TEST_ASSERT(fields.in_port == 7);
+    TEST_ASSERT(fields.eth_type == 0x0800);
+    TEST_ASSERT(fields.vlan_vid == 0);
+    TEST_ASSERT(fields.ip_proto == 17);
+    TEST_ASSERT(fields.ipv4_src == 0x0a000002);
+    TEST_ASSERT(fields.ipv4_dst == 0x0a000001);
+    TEST_ASSERT(fields.udp_src == 1024);
+    TEST_ASSERT(fields.udp_dst == 53);
+
+    shards = ft_shards_create(&config, true);
+    memset(&match, 0, sizeof(match));
+    match.fields.ipv4_dst = 0x0a000001;
+    match.masks.ipv4_dst = 0xffffffff;
+    TEST_OK(add_match_flow(ft_shards_get(shards, 0), 1, 0, 10, &match, 9));
+
+    packet_out = of_packet_out_new(version);
+    of_packet_out_buffer_id_set(packet_out, OF_BUFFER_ID_NO_BUFFER);
+    of_packet_out_in_port_set(packet_out, OF_PORT_DEST_CONTROLLER);
+    actions = of_list_action_new(version);
+    output = of_action_output_new(version);
+    of_action_output_port_set(output, OF_PORT_DEST_USE_TABLE);
+    TEST_OK(of_list_append(actions, output));
+    TEST_OK(of_packet_out_actions_set(packet_out, actions));
+    data.data = pkt;
+    data.bytes = sizeof(pkt);
+    TEST_OK(of_packet_out_data_set(packet_out, &data));
+    of_object_delete(output);
+    of_object_delete(actions);
+
+    TEST_INDIGO_OK(ind_core_pipeline_packet_out_resolve(shards, packet_out,
+                                                        &resolved));
+    of_packet_out_actions_bind(resolved, &list);
+    port = 0;
+    OF_LIST_ACTION_ITER(&list, &act, loop_rv) {
+        TEST_ASSERT(act.header.object_id == OF_ACTION_OUTPUT);
+        of_action_output_port_get(&act.output, &port);
+    }
+    TEST_ASSERT(port == 9);
+    of_packet_out_data_get(resolved, &data);
+    TEST_ASSERT(data.bytes == sizeof(pkt));
+    TEST_ASSERT(memcmp(data.data, pkt, sizeof(pkt)) == 0);
+    of_object_delete(resolved);
+
+    /* A miss is left to Forwarding */
+    pkt[33] = 0x02;
+    data.data = pkt;
+    TEST_OK(of_packet_out_data_set(packet_out, &data));
+    TEST_ASSERT(ind_core_pipeline_packet_out_resolve(shards, packet_out,
+                                                     &resolved) ==
+                INDIGO_ERROR_NOT_SUPPORTED);
+
+    of_object_delete(packet_out);
+    ft_shards_destroy(shards);
+
+    return TEST_PASS;
+}
+
+/* Stage n flows in a bundle, commit it, then stage and discard another */
+static int
+test_bundle(void)
+{
+    of_flow_add_t *flow_add;
+    int idx;
+
+
+    TEST_INDIGO_OK(ind_core_bundle_open(0, 1));
+    TEST_ASSERT(ind_core_bundle_open(0, 2) == INDIGO_ERROR_EXISTS);
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+
+    TEST_ASSERT(ind_core_bundle_commit(0, 2) == INDIGO_ERROR_NOT_FOUND);
+    TEST_INDIGO_OK(ind_core_bundle_commit(0, 1));
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+
+    TEST_INDIGO_OK(ind_core_bundle_open(0, 3));
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(ind_core_bundle_discard(0, 3));
+    TEST_ASSERT(ind_core_bundle_commit(0, 3) == INDIGO_ERROR_NOT_FOUND);
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(outstanding_op_cnt == 0);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+
+    return TEST_PASS;
+}
+
+static of_object_t *
+make_onf_bundle_msg(uint32_t subtype, uint32_t bundle_id, uint16_t type,
+                    of_object_t *inner)
+{
+    uint8_t buf[256] = {
+        bundle_id >> 24, bundle_id >> 16, bundle_id >> 8, bundle_id,
+        type >> 8, type,
+    };
+    of_octets_t data = { .data = buf, .bytes = 8 };
+    of_experimenter_t *obj = of_experimenter_new(OF_VERSION_1_3);
+
+    AIM_TRUE_OR_DIE(obj != NULL);
+    of_experimenter_experimenter_set(obj, 0x4f4e4600);
+    of_experimenter_subtype_set(obj, subtype);
+    if (inner != NULL) {
+        AIM_TRUE_OR_DIE(inner->length <= sizeof(buf) - data.bytes);
+        memcpy(buf + data.bytes, OF_OBJECT_BUFFER_INDEX(inner, 0),
+               inner->length);
+        data.bytes += inner->length;
+        of_object_delete(inner);
+    }
+    AIM_TRUE_OR_DIE(of_experimenter_data_set(obj, &data) == 0);
+
+    return obj;
+}
+
+/* Bundles driven by the ONF bundle extension messages */
+static int
+test_onf_bundle(void)
+{
+    of_flow_add_t *flow_add;
+    int idx;
+
+    controller_message_counters[OF_EXPERIMENTER] = 0;
+    error_reply_count = 0;
+
+    handle_message(make_onf_bundle_msg(2300, 7, 0, NULL));
+    for (idx = 0; idx < 4; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_3);
+        TEST_ASSERT(flow_add != NULL);
+        of_flow_add_priority_set(flow_add, idx);
+        handle_message(make_onf_bundle_msg(2301, 7, 0, flow_add));
+    }
+
+    /* Messages outside the bundle are applied as they arrive */
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    TEST_ASSERT(flow_add != NULL);
+    of_flow_add_priority_set(flow_add, 100);
+    handle_message(flow_add);
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 1);
+
+    /* Nothing can be added once the bundle is closed */
+    handle_message(make_onf_bundle_msg(2300, 7, 2, NULL));
+    handle_message(make_onf_bundle_msg(2301, 7, 0,
+                                       of_flow_add_new(OF_VERSION_1_3)));
+    TEST_ASSERT(error_reply_count == 1);
+
+    handle_message(make_onf_bundle_msg(2300, 7, 4, NULL));
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 5);
+
+    /* Open, close and commit replies */
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER] == 3);
+
+    /* The bundle is gone after the commit */
+    handle_message(make_onf_bundle_msg(2300, 7, 6, NULL));
+    TEST_ASSERT(error_reply_count == 2);
+
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+
+    return TEST_PASS;
+}
+
+static int
+test_hello(void)
+{
+    of_hello_t *hello;
+
+    hello = of_hello_new(OF_VERSION_1_0);
+    indigo_core_receive_controller_message(0, hello);
+    of_object_delete(hello);
+
+    return TEST_PASS;
+}
+
+static int
+test_packet_out(void)
+{
+    of_packet_out_t *pkt_out;
+
+    packet_out_count = 0;
+    pkt_out = of_packet_out_new(OF_VERSION_1_0);
+    /* Could add params, but core doesn't do anything with them */
+    indigo_core_receive_controller_message(0, pkt_out);
+#if OFSTATEMANAGER_CONFIG_PACKET_OUT_BATCH_MAX > 0
+    /* Batched until the connection manager is done with the message */
+    TEST_ASSERT(packet_out_count == 0);
+#endif
+    indigo_core_receive_controller_flush();
+    TEST_ASSERT(packet_out_count == 1);
+
+    /* A failed packet-out is answered with an error */
+    error_reply_count = 0;
+    packet_out_rv = INDIGO_ERROR_UNKNOWN;
+    indigo_core_receive_controller_message(0, pkt_out);
+    indigo_core_receive_controller_flush();
+    TEST_ASSERT(error_reply_count == 1);
+    TEST_ASSERT(last_error_code == OF_REQUEST_FAILED_EPERM);
+
+    /* Pending packet-outs are answered when completed, oldest first */
+    error_reply_count = 0;
+    packet_out_rv = INDIGO_ERROR_PENDING;
+    indigo_core_receive_controller_message(0, pkt_out);
+    indigo_core_receive_controller_message(0, pkt_out);
+    indigo_core_receive_controller_flush();
+    TEST_ASSERT(error_reply_count == 0);
+    indigo_core_packet_out_complete(1, INDIGO_ERROR_NONE);
+    TEST_ASSERT(error_reply_count == 0);
+    indigo_core_packet_out_complete(1, INDIGO_ERROR_NOT_FOUND);
+    TEST_ASSERT(error_reply_count == 1);
+    TEST_ASSERT(last_error_code == OF_REQUEST_FAILED_BUFFER_UNKNOWN);
+
+    packet_out_rv = INDIGO_ERROR_NONE;
+    of_object_delete(pkt_out);
+
+    return TEST_PASS;
+}
+
+static int
+test_packet_in(void)
+{
+    of_packet_in_t *pkt_in;
+
+    pkt_in = of_packet_in_new(OF_VERSION_1_0);
+    /* Could add params, but core doesn't do anything with them */
+    TEST_INDIGO_OK(indigo_core_packet_in(pkt_in));
+
+    return TEST_PASS;
+}
+
+/* A packet-in built in preallocated storage is sent as a copy */
+static int
+test_packet_in_copy(void)
+{
+    of_object_storage_t storage;
+    uint8_t buf[256];
+    uint8_t frame[64];
+    of_octets_t data = { .data = frame, .bytes = sizeof(frame) };
+    of_packet_in_t *pkt_in;
+    int sent = async_message_counters[OF_PACKET_IN];
+
+    memset(frame, 0xab, sizeof(frame));
+    pkt_in = indigo_of_message_new_preallocated(&storage, OF_PACKET_IN,
+                                                OF_VERSION_1_3, buf, sizeof(buf));
+    TEST_ASSERT(pkt_in != NULL);
+    TEST_ASSERT(of_packet_in_data_set(pkt_in, &data) == 0);
+    TEST_INDIGO_OK(indigo_core_packet_in_copy(pkt_in));
+    TEST_ASSERT(async_message_counters[OF_PACKET_IN] == sent + 1);
+
+    /* The buffer bounds the message */
+    pkt_in = indigo_of_message_new_preallocated(&storage, OF_PACKET_IN,
+                                                OF_VERSION_1_3, buf, 16);
+    TEST_ASSERT(pkt_in == NULL);
+
+    return TEST_PASS;
+}
+
+static int
+test_experimenter(void)
+{
+    of_experimenter_t *exp;
+
+    exp = of_experimenter_new(OF_VERSION_1_0);
+    /* Could add params, but core doesn't do anything with them */
+    indigo_core_receive_controller_message(0, exp);
+    of_object_delete(exp);
+
+    return TEST_PASS;
+}
+
+/* Desc, features and port desc replies are built again only when invalidated */
+static int
+test_reply_cache(void)
+{
+    of_object_t *req;
+    of_desc_str_t desc;
+    of_port_status_t *port_status;
+
+    memset(controller_message_counters, 0, sizeof(controller_message_counters));
+    port_features_get_count = 0;
+    port_desc_stats_get_count = 0;
+
+    req = of_features_request_new(OF_VERSION_1_0);
+    of_features_request_xid_set(req, 100);
+    handle_message(req);
+    req = of_features_request_new(OF_VERSION_1_0);
+    of_features_request_xid_set(req, 101);
+    handle_message(req);
+    TEST_ASSERT(controller_message_counters[OF_FEATURES_REPLY] == 2);
+    TEST_ASSERT(controller_message_xid == 101);
+    TEST_ASSERT(port_features_get_count == 1);
+
+    /* Cached per version */
+    handle_message(of_features_request_new(OF_VERSION_1_3));
+    TEST_ASSERT(port_features_get_count == 2);
+    handle_message(of_features_request_new(OF_VERSION_1_0));
+    TEST_ASSERT(port_features_get_count == 2);
+
+    TEST_INDIGO_OK(indigo_core_dpid_set(0x1234));
+    handle_message(of_features_request_new(OF_VERSION_1_0));
+    TEST_ASSERT(port_features_get_count == 3);
+
+    handle_message(of_port_desc_stats_request_new(OF_VERSION_1_3));
+    handle_message(of_port_desc_stats_request_new(OF_VERSION_1_3));
+    TEST_ASSERT(controller_message_counters[OF_PORT_DESC_STATS_REPLY] == 2);
+    TEST_ASSERT(port_desc_stats_get_count == 1);
+
+    /* A port change invalidates both */
+    port_status = of_port_status_new(OF_VERSION_1_3);
+    indigo_core_port_status_update(port_status);
+    handle_message(of_port_desc_stats_request_new(OF_VERSION_1_3));
+    handle_message(of_features_request_new(OF_VERSION_1_0));
+    TEST_ASSERT(port_desc_stats_get_count == 2);
+    TEST_ASSERT(port_features_get_count == 4);
+
+    handle_message(of_desc_stats_request_new(OF_VERSION_1_3));
+    req = of_desc_stats_request_new(OF_VERSION_1_3);
+    of_desc_stats_request_xid_set(req, 200);
+    handle_message(req);
+    TEST_ASSERT(controller_message_counters[OF_DESC_STATS_REPLY] == 2);
+    TEST_ASSERT(controller_message_xid == 200);
+
+    /* A desc set shows in the next reply */
+    INDIGO_MEM_CLEAR(desc, OF_DESC_STR_LEN);
+    INDIGO_MEM_COPY(desc, "cached", 6);
+    TEST_INDIGO_OK(ind_core_sw_desc_set(desc));
+    handle_message(of_desc_stats_request_new(OF_VERSION_1_3));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(last_sw_desc, desc, OF_DESC_STR_LEN) == 0);
+
+    return TEST_PASS;
+}
+
+static int
+test_debug_counters(void)
+{
+    indigo_core_debug_counter_t *counters[2];
+    uint64_t values[2] = { 3, 40 };
+    of_object_t *obj;
+
+    TEST_INDIGO_OK(indigo_core_debug_counter_register(
+        "test.first", "First test counter", &values[0], &counters[0]));
+    TEST_INDIGO_OK(indigo_core_debug_counter_register(
+        "test.second", "Second test counter", &values[1], &counters[1]));
+
+    controller_message_counters[OF_BSN_DEBUG_COUNTER_DESC_STATS_REPLY] = 0;
+    obj = of_bsn_debug_counter_desc_stats_request_new(OF_VERSION_1_3);
+    indigo_core_receive_controller_message(0, obj);
+    TEST_ASSERT(controller_message_counters[OF_BSN_DEBUG_COUNTER_DESC_STATS_REPLY] == 1);
+
+    values[1]++;
+    debug_counter_entry_count = 0;
+    debug_counter_value_sum = 0;
+    obj = of_bsn_debug_counter_stats_request_new(OF_VERSION_1_3);
+    indigo_core_receive_controller_message(0, obj);
+    TEST_ASSERT(debug_counter_entry_count == 2);
+    TEST_ASSERT(debug_counter_value_sum == 44);
+
+    indigo_core_debug_counter_unregister(counters[0]);
+    debug_counter_entry_count = 0;
+    debug_counter_value_sum = 0;
+    obj = of_bsn_debug_counter_stats_request_new(OF_VERSION_1_3);
+    indigo_core_receive_controller_message(0, obj);
+    TEST_ASSERT(debug_counter_entry_count == 1);
+    TEST_ASSERT(debug_counter_value_sum == 41);
+
+    indigo_core_debug_counter_unregister(counters[1]);
+
+    return TEST_PASS;
+}
+
+static int
+test_desc_strings(void)
+{
+    of_desc_str_t desc_get;
+    of_desc_str_t desc_set;
+    of_serial_num_t ser_num_set;
+    of_serial_num_t ser_num_get;
+
+    INDIGO_MEM_SET(ser_num_set, 0xee, OF_SERIAL_NUM_LEN);
+    INDIGO_MEM_CLEAR(ser_num_get, OF_SERIAL_NUM_LEN);
+    TEST_INDIGO_OK(ind_core_serial_num_set(ser_num_set));
+    TEST_INDIGO_OK(ind_core_serial_num_get(ser_num_get));
     TEST_ASSERT(INDIGO_MEM_COMPARE(ser_num_set, ser_num_get,
                                    OF_SERIAL_NUM_LEN) == 0);
 
-    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
-    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
-    TEST_INDIGO_OK(ind_core_sw_desc_set(desc_set));
-    TEST_INDIGO_OK(ind_core_sw_desc_get(desc_get));
-    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
+    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
+    TEST_INDIGO_OK(ind_core_sw_desc_set(desc_set));
+    TEST_INDIGO_OK(ind_core_sw_desc_get(desc_get));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+
+    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
+    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
+    TEST_INDIGO_OK(ind_core_hw_desc_set(desc_set));
+    TEST_INDIGO_OK(ind_core_hw_desc_get(desc_get));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+
+    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
+    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
+    TEST_INDIGO_OK(ind_core_dp_desc_set(desc_set));
+    TEST_INDIGO_OK(ind_core_dp_desc_get(desc_get));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+
+    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
+    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
+    TEST_INDIGO_OK(ind_core_dp_desc_set(desc_set));
+    TEST_INDIGO_OK(ind_core_dp_desc_get(desc_get));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+
+    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
+    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
+    TEST_INDIGO_OK(ind_core_mfr_desc_set(desc_set));
+    TEST_INDIGO_OK(ind_core_mfr_desc_get(desc_get));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+
+    return TEST_PASS;
+}
+
+/* Status of the state manager's flow table, summed over its shards */
+static ft_status_t *
+core_ft_status(void)
+{
+    static ft_status_t status;
+
+    ft_shards_status_get(ind_core_ft, &status);
+
+    return &status;
+}
+
+static int
+delete_all_entries(void)
+{
+    of_flow_delete_t *flow_del;
+    of_match_t match;
+
+    INDIGO_MEM_CLEAR(&match, sizeof(match));
+    flow_del = of_flow_delete_new(OF_VERSION_1_0);
+    TEST_ASSERT(flow_del != NULL);
+    of_flow_delete_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
+    TEST_OK(of_flow_delete_match_set(flow_del, &match));
+    handle_message(flow_del);
+    TEST_INDIGO_OK(do_barrier());
+
+    TEST_ASSERT(ft_shards_current_count(ind_core_ft) == 0);
+
+    return TEST_PASS;
+}
+
+/* Add n flows, delete them all */
+int
+test_simple_add_del(void)
+{
+    of_flow_add_t *flow_add;
+    int idx;
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+        TEST_INDIGO_OK(do_barrier());
+        CHECK_FLOW_COUNT(core_ft_status(), idx + 1);
+    }
+
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+
+    return TEST_PASS;
+}
+
+static void
+ft_dump_done(void *cookie, int count)
+{
+    *(int *)cookie = count;
+}
+
+/* Run a compact dump to completion, returning the lines written */
+static int
+ft_dump_run(aim_pvs_t *pvs, ind_core_ft_dump_filter_t *filter, int *count)
+{
+    char *text, *c;
+    int lines = 0;
+
+    aim_pvs_buffer_reset(pvs);
+    *count = -1;
+    TEST_INDIGO_OK(ind_core_ft_dump_start(pvs, IND_CORE_FT_DUMP_COMPACT,
+                                          filter, ft_dump_done, count));
+    while (*count < 0) {
+        ind_soc_select_and_run(0);
+    }
+
+    text = aim_pvs_buffer_get(pvs);
+    for (c = text; *c != '\0'; c++) {
+        lines += *c == '\n';
+    }
+    aim_free(text);
+
+    return lines;
+}
+
+/* Dump the table from a task, whole and by table, priority and cookie */
+int
+test_ft_dump(void)
+{
+    of_flow_add_t *flow_add;
+    ind_core_ft_dump_filter_t filter = { -1, 0, 0, -1 };
+    ft_entry_t *first, *entry;
+    list_links_t *cur, *next;
+    ft_instance_t ft;
+    aim_pvs_t *pvs;
+    int idx, count, expected;
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
+
+    pvs = aim_pvs_buffer_create();
+    TEST_ASSERT(ft_dump_run(pvs, NULL, &count) == TEST_FLOW_COUNT);
+    TEST_ASSERT(count == TEST_FLOW_COUNT);
+
+    /* OpenFlow 1.0 flows are all in the shard of table 0 */
+    ft = ft_shards_find(ind_core_ft, 0);
+    TEST_ASSERT(ft != NULL);
+    first = FT_ENTRY_CONTAINER(ft->all_list.links.next, table);
+    filter.table_id = first->table_id;
+    filter.priority = first->priority;
+    expected = 0;
+    FT_ITER(ft, entry, cur, next) {
+        expected += entry->table_id == first->table_id &&
+            entry->priority == first->priority;
+    }
+    TEST_ASSERT(ft_dump_run(pvs, &filter, &count) == expected);
+    TEST_ASSERT(count == expected && expected > 0);
+
+    filter.table_id = -1;
+    filter.priority = -1;
+    filter.cookie = first->cookie;
+    filter.cookie_mask = ~(uint64_t)0;
+    expected = 0;
+    FT_ITER(ft, entry, cur, next) {
+        expected += entry->cookie == first->cookie;
+    }
+    TEST_ASSERT(ft_dump_run(pvs, &filter, &count) == expected);
+    TEST_ASSERT(count == expected && expected > 0);
+
+    aim_pvs_destroy(pvs);
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+
+    return TEST_PASS;
+}
+
+static void
+clear_all_done(void *cookie, int flows, indigo_error_t rv)
+{
+    *(int *)cookie = rv == INDIGO_ERROR_NONE ? flows : -2;
+}
+
+/* Delete every flow from a task */
+int
+test_clear_all(void)
+{
+    of_flow_add_t *flow_add;
+    int idx, flows = -1;
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
+
+    TEST_INDIGO_OK(ind_core_clear_all(clear_all_done, &flows));
+    while (flows == -1) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(flows == TEST_FLOW_COUNT);
+    CHECK_FLOW_COUNT(core_ft_status(), 0);
+
+    return TEST_PASS;
+}
 
-    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
-    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
-    TEST_INDIGO_OK(ind_core_hw_desc_set(desc_set));
-    TEST_INDIGO_OK(ind_core_hw_desc_get(desc_get));
-    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+/* A wildcard delete of every table empties it last table first */
+int
+test_delete_all_order(void)
+{
+    static const uint8_t tables[] = { 10, 60, 20, 50, 30 };
+    of_version_t version = OF_VERSION_1_3;
+    of_flow_add_t *flow_add;
+    of_flow_delete_t *flow_del;
+    of_match_t match;
+    int idx, count = 0;
+
+    for (idx = 0; idx < 20; idx++) {
+        memset(&match, 0, sizeof(match));
+        match.version = version;
+        match.fields.in_port = idx + 1;
+        match.masks.in_port = 0xffffffff;
+        flow_add = of_flow_add_new(version);
+        TEST_ASSERT(flow_add != NULL);
+        of_flow_add_table_id_set(flow_add, tables[idx % AIM_ARRAYSIZE(tables)]);
+        of_flow_add_priority_set(flow_add, 100);
+        TEST_OK(of_flow_add_match_set(flow_add, &match));
+        handle_message(flow_add);
+        count++;
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), count);
 
-    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
-    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
-    TEST_INDIGO_OK(ind_core_dp_desc_set(desc_set));
-    TEST_INDIGO_OK(ind_core_dp_desc_get(desc_get));
-    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+    deleted_count = 0;
+    memset(&match, 0, sizeof(match));
+    match.version = version;
+    flow_del = of_flow_delete_new(version);
+    TEST_ASSERT(flow_del != NULL);
+    of_flow_delete_table_id_set(flow_del, TABLE_ID_ANY);
+    of_flow_delete_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
+    of_flow_delete_out_group_set(flow_del, OF_GROUP_ANY);
+    TEST_OK(of_flow_delete_match_set(flow_del, &match));
+    handle_message(flow_del);
 
-    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
-    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
-    TEST_INDIGO_OK(ind_core_dp_desc_set(desc_set));
-    TEST_INDIGO_OK(ind_core_dp_desc_get(desc_get));
-    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+    /* Added after the delete; kept */
+    memset(&match, 0, sizeof(match));
+    match.version = version;
+    match.fields.in_port = 100;
+    match.masks.in_port = 0xffffffff;
+    flow_add = of_flow_add_new(version);
+    TEST_ASSERT(flow_add != NULL);
+    of_flow_add_table_id_set(flow_add, 10);
+    of_flow_add_priority_set(flow_add, 100);
+    TEST_OK(of_flow_add_match_set(flow_add, &match));
+    handle_message(flow_add);
+
+    /* The barrier waits for the delete task */
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 1);
+    TEST_ASSERT(deleted_count == count);
+    for (idx = 1; idx < count; idx++) {
+        TEST_ASSERT(deleted_tables[idx] <= deleted_tables[idx - 1]);
+    }
+    TEST_ASSERT(deleted_tables[0] == 60);
+    TEST_ASSERT(deleted_tables[count - 1] == 10);
 
-    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
-    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
-    TEST_INDIGO_OK(ind_core_mfr_desc_set(desc_set));
-    TEST_INDIGO_OK(ind_core_mfr_desc_get(desc_get));
-    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
 
     return TEST_PASS;
 }
 
-static int
-delete_all_entries(ft_instance_t ft)
+/* Flows are accounted under FLOW_ENTRY and refused past its soft limit */
+int
+test_mem_accounting(void)
 {
+    of_version_t version = OF_VERSION_1_3;
+    indigo_mem_stats_t before, stats;
+    of_flow_add_t *flow_add;
     of_flow_delete_t *flow_del;
     of_match_t match;
+    int idx;
 
-    INDIGO_MEM_CLEAR(&match, sizeof(match));
-    flow_del = of_flow_delete_new(OF_VERSION_1_0);
+    indigo_mem_stats_get(INDIGO_MEM_TAG_FLOW_ENTRY, &before);
+
+    for (idx = 0; idx < 11; idx++) {
+        if (idx == 10) {
+            indigo_mem_soft_limit_set(INDIGO_MEM_TAG_FLOW_ENTRY, 1);
+        }
+        memset(&match, 0, sizeof(match));
+        match.version = version;
+        match.fields.in_port = idx + 1;
+        match.masks.in_port = 0xffffffff;
+        flow_add = of_flow_add_new(version);
+        TEST_ASSERT(flow_add != NULL);
+        of_flow_add_table_id_set(flow_add, 10);
+        of_flow_add_priority_set(flow_add, 100);
+        TEST_OK(of_flow_add_match_set(flow_add, &match));
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 10);
+
+    indigo_mem_stats_get(INDIGO_MEM_TAG_FLOW_ENTRY, &stats);
+    TEST_ASSERT(stats.live_bytes >= before.live_bytes + 10 * sizeof(ft_entry_t));
+    TEST_ASSERT(stats.peak_bytes >= stats.live_bytes);
+    TEST_ASSERT(stats.limit_hits == before.limit_hits + 1);
+    indigo_mem_soft_limit_set(INDIGO_MEM_TAG_FLOW_ENTRY, 0);
+
+    memset(&match, 0, sizeof(match));
+    match.version = version;
+    flow_del = of_flow_delete_new(version);
     TEST_ASSERT(flow_del != NULL);
+    of_flow_delete_table_id_set(flow_del, TABLE_ID_ANY);
     of_flow_delete_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
+    of_flow_delete_out_group_set(flow_del, OF_GROUP_ANY);
     TEST_OK(of_flow_delete_match_set(flow_del, &match));
     handle_message(flow_del);
     TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 0);
 
-    TEST_OK(depopulate_table(ft));
+    indigo_mem_stats_get(INDIGO_MEM_TAG_FLOW_ENTRY, &stats);
+    TEST_ASSERT(stats.live_bytes == before.live_bytes);
 
     return TEST_PASS;
 }
 
-/* Add n flows, delete them all */
+/* Add n flows without intermediate barriers, delete them all */
 int
-test_simple_add_del(void)
+test_batched_add_del(void)
 {
     of_flow_add_t *flow_add;
-    ft_status_t *status;
     int idx;
 
-    status = FT_STATUS(ind_core_ft);
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
         flow_add = of_flow_add_new(OF_VERSION_1_0);
         TEST_ASSERT(flow_add != NULL);
         TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
         of_flow_add_flags_set(flow_add, 0);
         handle_message(flow_add);
-        TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, idx + 1);
+        CHECK_FLOW_COUNT(core_ft_status(), idx + 1);
     }
 
-    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
-    TEST_ASSERT(status->current_count == 0);
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(outstanding_op_cnt == 0);
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
+
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
 
     return TEST_PASS;
 }
@@ -1108,12 +2871,10 @@ test_exact_add_del(void)
     of_flow_add_t *flow_add_keep[TEST_FLOW_COUNT];
     of_flow_add_t *flow_add;
     of_flow_delete_t *flow_del;
-    ft_status_t *status;
     int idx;
     of_match_t match;
     uint16_t prio;
 
-    status = FT_STATUS(ind_core_ft);
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
         flow_add = of_flow_add_new(OF_VERSION_1_0);
         TEST_ASSERT(flow_add != NULL);
@@ -1122,7 +2883,7 @@ test_exact_add_del(void)
         flow_add_keep[idx] = of_object_dup(flow_add);
         handle_message(flow_add);
         TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, idx + 1);
+        CHECK_FLOW_COUNT(core_ft_status(), idx + 1);
     }
 
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
@@ -1137,10 +2898,10 @@ test_exact_add_del(void)
         TEST_OK(of_flow_delete_strict_match_set(flow_del, &match));
         handle_message(flow_del);
         TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT - (idx + 1));
+        CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT - (idx + 1));
         of_flow_add_delete(flow_add_keep[idx]);
     }
-    TEST_ASSERT(status->current_count == 0);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
 
     return TEST_PASS;
 }
@@ -1152,12 +2913,10 @@ test_modify(void)
     of_flow_add_t *flow_add_keep[TEST_FLOW_COUNT];
     of_flow_add_t *flow_add;
     of_flow_modify_t *flow_mod;
-    ft_status_t *status;
     int idx;
     of_match_t match;
     uint16_t prio;
 
-    status = FT_STATUS(ind_core_ft);
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
         flow_add = of_flow_add_new(OF_VERSION_1_0);
         TEST_ASSERT(flow_add != NULL);
@@ -1166,7 +2925,7 @@ test_modify(void)
         flow_add_keep[idx] = of_object_dup(flow_add);
         handle_message(flow_add);
         TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, idx + 1);
+        CHECK_FLOW_COUNT(core_ft_status(), idx + 1);
     }
 
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
@@ -1181,13 +2940,13 @@ test_modify(void)
         TEST_OK(of_flow_modify_match_set(flow_mod, &match));
         handle_message(flow_mod);
         TEST_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT);
+        CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
         of_flow_add_delete(flow_add_keep[idx]);
     }
-    CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT);
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
     /* Delete all the entries */
-    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
-    TEST_ASSERT(status->current_count == 0);
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
 
     return TEST_PASS;
 }
@@ -1199,12 +2958,10 @@ test_modify_strict(void)
     of_flow_add_t *flow_add_keep[TEST_FLOW_COUNT];
     of_flow_add_t *flow_add;
     of_flow_modify_strict_t *flow_mod;
-    ft_status_t *status;
     int idx;
     of_match_t match;
     uint16_t prio;
 
-    status = FT_STATUS(ind_core_ft);
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
         flow_add = of_flow_add_new(OF_VERSION_1_0);
         TEST_ASSERT(flow_add != NULL);
@@ -1213,7 +2970,7 @@ test_modify_strict(void)
         flow_add_keep[idx] = of_object_dup(flow_add);
         handle_message(flow_add);
         TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, idx + 1);
+        CHECK_FLOW_COUNT(core_ft_status(), idx + 1);
     }
 
     for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
@@ -1228,21 +2985,388 @@ test_modify_strict(void)
         TEST_OK(of_flow_modify_strict_match_set(flow_mod, &match));
         handle_message(flow_mod);
         TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT);
+        CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
         of_flow_add_delete(flow_add_keep[idx]);
     }
-    CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT);
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
 
-    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
-    TEST_ASSERT(status->current_count == 0);
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
 
     return TEST_PASS;
 }
 
+/* Re-add a flow unchanged, with a new cookie, new actions and timeouts */
+int
+test_overwrite(void)
+{
+    of_flow_add_t *flow_add;
+    of_list_action_t *actions;
+    ft_entry_t *entry;
+    indigo_cookie_t flow_id;
+    uint64_t overwrites;
+    int deletes, modifies;
+
+    flow_add = of_flow_add_new(OF_VERSION_1_0);
+    TEST_ASSERT(flow_add != NULL);
+    TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, 1) != 0);
+    of_flow_add_flags_set(flow_add, 0);
+    handle_message(of_object_dup(flow_add));
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 1);
+    flow_id = last_created_id;
+
+    overwrites = core_ft_status()->overwrites;
+    deletes = deleted_count;
+    modifies = modify_count;
+
+    /* Identical; nothing reaches forwarding */
+    handle_message(of_object_dup(flow_add));
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 1);
+    TEST_ASSERT(core_ft_status()->overwrites == overwrites + 1);
+    TEST_ASSERT(deleted_count == deletes);
+    TEST_ASSERT(modify_count == modifies);
+
+    /* New cookie; the entry keeps its flow ID */
+    of_flow_add_cookie_set(flow_add, 0x1234);
+    handle_message(of_object_dup(flow_add));
+    TEST_INDIGO_OK(do_barrier());
+    entry = ft_shards_lookup(ind_core_ft, flow_id);
+    TEST_ASSERT(entry != NULL);
+    TEST_ASSERT(entry->cookie == 0x1234);
+    TEST_ASSERT(core_ft_status()->overwrites == overwrites + 2);
+    TEST_ASSERT(modify_count == modifies);
+
+    /* New actions; forwarding modifies the flow */
+    actions = of_list_action_new(OF_VERSION_1_0);
+    TEST_ASSERT(actions != NULL);
+    TEST_OK(of_flow_add_actions_set(flow_add, actions));
+    of_object_delete(actions);
+    handle_message(of_object_dup(flow_add));
+    TEST_INDIGO_OK(do_barrier());
+    entry = ft_shards_lookup(ind_core_ft, flow_id);
+    TEST_ASSERT(entry != NULL);
+    TEST_ASSERT(entry->effects.actions->length == 0);
+    TEST_ASSERT(core_ft_status()->overwrites == overwrites + 3);
+    TEST_ASSERT(deleted_count == deletes);
+    TEST_ASSERT(modify_count == modifies + 1);
+
+    /* New timeouts; forwarding gets the flow again with them */
+    of_flow_add_idle_timeout_set(flow_add, 30);
+    of_flow_add_hard_timeout_set(flow_add, 60);
+    handle_message(of_object_dup(flow_add));
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 1);
+    TEST_ASSERT(ft_shards_lookup(ind_core_ft, flow_id) == NULL);
+    TEST_ASSERT(core_ft_status()->overwrites == overwrites + 3);
+    TEST_ASSERT(deleted_count == deletes + 1);
+    flow_id = last_created_id;
+    entry = ft_shards_lookup(ind_core_ft, flow_id);
+    TEST_ASSERT(entry != NULL);
+    TEST_ASSERT(entry->idle_timeout == 30);
+    TEST_ASSERT(entry->hard_timeout == 60);
+
+    /* Same timeouts; the duration restarts in forwarding too */
+    handle_message(of_object_dup(flow_add));
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), 1);
+    TEST_ASSERT(ft_shards_lookup(ind_core_ft, flow_id) == NULL);
+    TEST_ASSERT(deleted_count == deletes + 2);
+
+    of_flow_add_delete(flow_add);
+
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+
+    return TEST_PASS;
+}
+
+/* Forwarding reports a burst of expiries at once */
+int
+test_flow_removed_batch(void)
+{
+    indigo_fi_flow_removed_t reasons[2] = {
+        INDIGO_FLOW_REMOVED_HARD_TIMEOUT, INDIGO_FLOW_REMOVED_IDLE_TIMEOUT };
+    indigo_fi_flow_stats_t stats[2];
+    of_flow_add_t *flow_add;
+    uint64_t hard_expires, idle_expires;
+    int deletes, idx, flow_removed;
+
+    INDIGO_MEM_CLEAR(stats, sizeof(stats));
+    for (idx = 0; idx < 2; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        /* Only the first flow asks for a flow-removed message */
+        of_flow_add_flags_set(flow_add, idx == 0 ? OF_FLOW_MOD_FLAG_SEND_FLOW_REM : 0);
+        handle_message(flow_add);
+        TEST_INDIGO_OK(do_barrier());
+        stats[idx].flow_id = last_created_id;
+    }
+    CHECK_FLOW_COUNT(core_ft_status(), 2);
 
+    hard_expires = core_ft_status()->hard_expires;
+    idle_expires = core_ft_status()->idle_expires;
+    deletes = deleted_count;
+    flow_removed = async_message_counters[OF_FLOW_REMOVED];
+
+    /* Already gone from forwarding, so not deleted again */
+    indigo_core_flow_removed_batch(2, reasons, stats);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+    TEST_ASSERT(core_ft_status()->hard_expires == hard_expires + 1);
+    TEST_ASSERT(core_ft_status()->idle_expires == idle_expires + 1);
+    TEST_ASSERT(deleted_count == deletes);
+    TEST_ASSERT(async_message_counters[OF_FLOW_REMOVED] == flow_removed + 1);
+
+    return TEST_PASS;
+}
+
+/* Dump all flows and return the number of entries in the replies */
+static int
+flow_stats_dump(uint16_t flags)
+{
+    of_flow_stats_request_t *req;
+    of_match_t match;
+    int idx;
+
+    flow_stats_entry_count = 0;
+    flow_stats_final_count = 0;
+    req = of_flow_stats_request_new(OF_VERSION_1_0);
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_0;
+    TEST_ASSERT(of_flow_stats_request_match_set(req, &match) == 0);
+    of_flow_stats_request_table_id_set(req, TABLE_ID_ANY);
+    of_flow_stats_request_out_port_set(req, OF_PORT_DEST_WILDCARD);
+    of_flow_stats_request_flags_set(req, flags);
+    handle_message(req);
+
+    for (idx = 0; idx < 1000 && flow_stats_final_count == 0; idx++) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(flow_stats_final_count == 1);
+
+    return flow_stats_entry_count;
+}
+
+/* Dump the flows in one flow stats reply, with and without stats threads */
 int
 test_flow_stats(void)
 {
+    of_flow_add_t *flow_add;
+    int threads, idx;
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
+
+    for (threads = 0; threads <= 2; threads += 2) {
+        TEST_INDIGO_OK(ind_core_workers_init(threads));
+        TEST_ASSERT(ind_core_workers_count() == threads);
+
+        TEST_ASSERT(flow_stats_dump(0) == TEST_FLOW_COUNT);
+
+        ind_core_workers_finish();
+    }
+
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+
+    return TEST_PASS;
+}
+
+/* Changed-only flow stats leave out the flows whose counters held still */
+int
+test_flow_stats_changed(void)
+{
+    of_flow_add_t *flow_add;
+    ft_entry_t *entry;
+    int idx;
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(core_ft_status(), TEST_FLOW_COUNT);
+
+    /* The first changed-only dump has every flow */
+    TEST_ASSERT(flow_stats_dump(IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) ==
+                TEST_FLOW_COUNT);
+    TEST_ASSERT(flow_stats_dump(IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) == 0);
+
+    entry = FT_ENTRY_CONTAINER(
+        ft_shards_find(ind_core_ft, 0)->all_list.links.next, table);
+    counted_flow_id = entry->id;
+    counted_flow_packets = 10;
+    TEST_ASSERT(flow_stats_dump(IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) == 1);
+    TEST_ASSERT(flow_stats_dump(IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) == 0);
+
+    /* A change seen by a full dump is still reported */
+    counted_flow_packets = 20;
+    TEST_ASSERT(flow_stats_dump(0) == TEST_FLOW_COUNT);
+    TEST_ASSERT(flow_stats_dump(IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) == 1);
+
+    /* So is a flow added since */
+    flow_add = of_flow_add_new(OF_VERSION_1_0);
+    TEST_ASSERT(flow_add != NULL);
+    TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, TEST_FLOW_COUNT) != 0);
+    of_flow_add_flags_set(flow_add, 0);
+    handle_message(flow_add);
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(flow_stats_dump(IND_CORE_FLOW_STATS_REQUEST_FLAG_BSN_CHANGED) == 1);
+
+    /* Cached counters are reported with the duration they were read at */
+    entry->insert_time -= 10000;
+    counted_flow_age_ns = 4000000000ULL;
+    TEST_ASSERT(flow_stats_dump(0) == TEST_FLOW_COUNT + 1);
+    TEST_ASSERT(counted_flow_duration_sec == 6);
+    counted_flow_age_ns = 0;
+
+    counted_flow_id = -1;
+    TEST_ASSERT(delete_all_entries() == TEST_PASS);
+    TEST_ASSERT(core_ft_status()->current_count == 0);
+
+    return TEST_PASS;
+}
+
+#define TEST_GROUP_COUNT 5000
+
+/* Group desc stats of a large group table span several replies */
+int
+test_group_desc_stats(void)
+{
+    of_group_add_t *group_add;
+    of_group_delete_t *group_del;
+    of_group_desc_stats_request_t *req;
+    int idx;
+
+    for (idx = 0; idx < TEST_GROUP_COUNT; idx++) {
+        group_add = of_group_add_new(OF_VERSION_1_3);
+        TEST_ASSERT(group_add != NULL);
+        of_group_add_group_type_set(group_add, OF_GROUP_TYPE_ALL);
+        of_group_add_group_id_set(group_add, idx);
+        handle_message(group_add);
+    }
+
+    group_desc_entry_count = 0;
+    group_desc_reply_count = 0;
+    group_desc_final_count = 0;
+    req = of_group_desc_stats_request_new(OF_VERSION_1_3);
+    TEST_ASSERT(req != NULL);
+    handle_message(req);
+
+    for (idx = 0; idx < 1000 && group_desc_final_count == 0; idx++) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(group_desc_final_count == 1);
+    TEST_ASSERT(group_desc_reply_count > 1);
+    TEST_ASSERT(group_desc_entry_count == TEST_GROUP_COUNT);
+
+    group_del = of_group_delete_new(OF_VERSION_1_3);
+    TEST_ASSERT(group_del != NULL);
+    of_group_delete_group_id_set(group_del, OF_GROUP_ALL);
+    handle_message(group_del);
+
+    return TEST_PASS;
+}
+
+static of_object_t *
+make_group_mod(of_object_id_t type, uint32_t id, uint32_t child)
+{
+    of_object_t *obj;
+    of_list_bucket_t buckets;
+    of_bucket_t *bucket;
+    of_list_action_t actions;
+    of_action_group_t *action;
+
+    if (type == OF_GROUP_ADD) {
+        obj = of_group_add_new(OF_VERSION_1_3);
+        AIM_TRUE_OR_DIE(obj != NULL);
+        of_group_add_group_type_set(obj, OF_GROUP_TYPE_ALL);
+        of_group_add_group_id_set(obj, id);
+        of_group_add_buckets_bind(obj, &buckets);
+    } else {
+        obj = of_group_modify_new(OF_VERSION_1_3);
+        AIM_TRUE_OR_DIE(obj != NULL);
+        of_group_modify_group_type_set(obj, OF_GROUP_TYPE_ALL);
+        of_group_modify_group_id_set(obj, id);
+        of_group_modify_buckets_bind(obj, &buckets);
+    }
+
+    if (child != OF_GROUP_ANY) {
+        bucket = of_bucket_new(OF_VERSION_1_3);
+        action = of_action_group_new(OF_VERSION_1_3);
+        AIM_TRUE_OR_DIE(bucket != NULL && action != NULL);
+        of_action_group_group_id_set(action, child);
+        of_bucket_actions_bind(bucket, &actions);
+        AIM_TRUE_OR_DIE(of_list_append(&actions, action) == 0);
+        AIM_TRUE_OR_DIE(of_list_bucket_append(&buckets, bucket) == 0);
+        of_object_delete(action);
+        of_object_delete(bucket);
+    }
+
+    return obj;
+}
+
+static void
+send_group_delete(uint32_t id)
+{
+    of_group_delete_t *group_del = of_group_delete_new(OF_VERSION_1_3);
+    AIM_TRUE_OR_DIE(group_del != NULL);
+    of_group_delete_group_id_set(group_del, id);
+    handle_message(group_del);
+}
+
+/* Groups referenced by other groups stay referenced across failed modifies */
+int
+test_group_refs(void)
+{
+    /* Group 2 references group 1 */
+    handle_message(make_group_mod(OF_GROUP_ADD, 1, OF_GROUP_ANY));
+    handle_message(make_group_mod(OF_GROUP_ADD, 2, 1));
+    TEST_ASSERT(ind_core_group_in_use(1));
+    TEST_ASSERT(!ind_core_group_in_use(2));
+
+    /* A referenced group cannot be deleted */
+    error_reply_count = 0;
+    send_group_delete(1);
+    TEST_ASSERT(error_reply_count == 1);
+    TEST_ASSERT(last_error_code == OF_GROUP_MOD_FAILED_CHAINED_GROUP);
+    TEST_ASSERT(ind_core_group_exists(1));
+
+    /* A failed modify keeps the old reference */
+    handle_message(make_group_mod(OF_GROUP_ADD, 3, OF_GROUP_ANY));
+    group_modify_failures = 1;
+    error_reply_count = 0;
+    handle_message(make_group_mod(OF_GROUP_MODIFY, 2, 3));
+    TEST_ASSERT(error_reply_count == 1);
+    TEST_ASSERT(ind_core_group_exists(2));
+    TEST_ASSERT(ind_core_group_in_use(1));
+    TEST_ASSERT(!ind_core_group_in_use(3));
+
+    /* A successful modify moves it */
+    error_reply_count = 0;
+    handle_message(make_group_mod(OF_GROUP_MODIFY, 2, 3));
+    TEST_ASSERT(error_reply_count == 0);
+    TEST_ASSERT(!ind_core_group_in_use(1));
+    TEST_ASSERT(ind_core_group_in_use(3));
+
+    send_group_delete(2);
+    TEST_ASSERT(!ind_core_group_in_use(3));
+    send_group_delete(OF_GROUP_ALL);
+    TEST_ASSERT(!ind_core_group_exists(1));
+    TEST_ASSERT(!ind_core_group_exists(3));
+
     return TEST_PASS;
 }
 
@@ -1324,6 +3448,92 @@ test_packet_in_listeners(void)
     return TEST_PASS;
 }
 
+static of_packet_in_t *
+packet_in_make(uint16_t eth_type, bool tagged, of_port_no_t in_port,
+               uint8_t reason)
+{
+    of_packet_in_t *packet_in = of_packet_in_new(OF_VERSION_1_0);
+    uint8_t frame[64];
+    of_octets_t data = { .data = frame, .bytes = sizeof(frame) };
+    int offset = 12;
+
+    memset(frame, 0, sizeof(frame));
+    if (tagged) {
+        frame[offset++] = 0x81;
+        frame[offset++] = 0x00;
+        offset += 2;
+    }
+    frame[offset++] = eth_type >> 8;
+    frame[offset++] = eth_type & 0xff;
+
+    of_packet_in_in_port_set(packet_in, in_port);
+    of_packet_in_reason_set(packet_in, reason);
+    if (of_packet_in_data_set(packet_in, &data) < 0) {
+        of_packet_in_delete(packet_in);
+        return NULL;
+    }
+
+    return packet_in;
+}
+
+int
+test_packet_in_filtered_listeners(void)
+{
+    indigo_core_packet_in_filter_t lldp_filter, port_filter;
+
+    memset(&lldp_filter, 0, sizeof(lldp_filter));
+    lldp_filter.eth_type_count = 1;
+    lldp_filter.eth_types[0] = 0x88cc;
+
+    memset(&port_filter, 0, sizeof(port_filter));
+    port_filter.in_port_count = 2;
+    port_filter.in_ports[0] = 5;
+    port_filter.in_ports[1] = 7;
+    port_filter.match_reason = true;
+    port_filter.reason = OF_PACKET_IN_REASON_ACTION;
+
+    TEST_INDIGO_OK(indigo_core_packet_in_listener_filtered_register(
+        (indigo_core_packet_in_listener_f)listener0, &lldp_filter));
+    TEST_INDIGO_OK(indigo_core_packet_in_listener_filtered_register(
+        (indigo_core_packet_in_listener_f)listener1, &port_filter));
+    TEST_INDIGO_OK(indigo_core_packet_in_listener_register(
+        (indigo_core_packet_in_listener_f)listener2));
+    TEST_ASSERT(indigo_core_packet_in_listener_register(
+        (indigo_core_packet_in_listener_f)listener0) == INDIGO_ERROR_EXISTS);
+
+    memset(listener_states, 0, sizeof(listener_states));
+
+    /* LLDP behind a VLAN tag */
+    TEST_INDIGO_OK(indigo_core_packet_in(
+        packet_in_make(0x88cc, true, 1, OF_PACKET_IN_REASON_NO_MATCH)));
+    TEST_ASSERT(listener_states[0].count == 1);
+    TEST_ASSERT(listener_states[1].count == 0);
+    TEST_ASSERT(listener_states[2].count == 1);
+
+    /* IPv4 sent to the controller by an action on port 7 */
+    TEST_INDIGO_OK(indigo_core_packet_in(
+        packet_in_make(0x0800, false, 7, OF_PACKET_IN_REASON_ACTION)));
+    TEST_ASSERT(listener_states[0].count == 1);
+    TEST_ASSERT(listener_states[1].count == 1);
+    TEST_ASSERT(listener_states[2].count == 2);
+
+    /* Right port, wrong reason */
+    TEST_INDIGO_OK(indigo_core_packet_in(
+        packet_in_make(0x0800, false, 5, OF_PACKET_IN_REASON_NO_MATCH)));
+    TEST_ASSERT(listener_states[0].count == 1);
+    TEST_ASSERT(listener_states[1].count == 1);
+    TEST_ASSERT(listener_states[2].count == 3);
+
+    indigo_core_packet_in_listener_unregister(
+        (indigo_core_packet_in_listener_f)listener0);
+    indigo_core_packet_in_listener_unregister(
+        (indigo_core_packet_in_listener_f)listener1);
+    indigo_core_packet_in_listener_unregister(
+        (indigo_core_packet_in_listener_f)listener2);
+
+    return TEST_PASS;
+}
+
 int
 test_port_status_listeners(void)
 {
@@ -1424,6 +3634,46 @@ test_message_listeners(void)
     return TEST_PASS;
 }
 
+/* A subscribed listener sees only its message types */
+int
+test_message_listener_subscribe(void)
+{
+    aim_bitmap256_t types;
+
+    AIM_BITMAP_INIT(&types, 255);
+    aim_bitmap_set(&types.hdr, OF_ECHO_REQUEST);
+
+    TEST_INDIGO_OK(indigo_core_message_listener_subscribe(
+        (indigo_core_message_listener_f)listener0, &types.hdr));
+    TEST_INDIGO_OK(indigo_core_message_listener_register(
+        (indigo_core_message_listener_f)listener1));
+    TEST_ASSERT(indigo_core_message_listener_subscribe(
+        (indigo_core_message_listener_f)listener1, &types.hdr) == INDIGO_ERROR_EXISTS);
+
+    memset(listener_states, 0, sizeof(listener_states));
+
+    handle_message(of_features_request_new(OF_VERSION_1_0));
+    TEST_ASSERT(listener_states[0].count == 0);
+    TEST_ASSERT(listener_states[1].count == 1);
+
+    handle_message(of_echo_request_new(OF_VERSION_1_0));
+    TEST_ASSERT(listener_states[0].count == 1);
+    TEST_ASSERT(listener_states[1].count == 2);
+
+    indigo_core_message_listener_unregister(
+        (indigo_core_message_listener_f)listener1);
+
+    handle_message(of_features_request_new(OF_VERSION_1_0));
+    handle_message(of_echo_request_new(OF_VERSION_1_0));
+    TEST_ASSERT(listener_states[0].count == 2);
+    TEST_ASSERT(listener_states[1].count == 2);
+
+    indigo_core_message_listener_unregister(
+        (indigo_core_message_listener_f)listener0);
+
+    return TEST_PASS;
+}
+
 int
 aim_main(int argc, char* argv[])
 {
@@ -1433,9 +3683,38 @@ aim_main(int argc, char* argv[])
     ind_soc_init(&soc_cfg);
     ind_soc_enable_set(1);
 
+    /* Not a test, see flow_bench.c */
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return flow_bench(argc - 2, argv + 2);
+    }
+
+    /* Not a test, see ft_bench.c */
+    if (argc > 1 && strcmp(argv[1], "ft-bench") == 0) {
+        return ft_bench(argc - 2, argv + 2);
+    }
+
+    /* Not a test, see expiration_bench.c */
+    if (argc > 1 && strcmp(argv[1], "expiration-bench") == 0) {
+        return expiration_bench(argc - 2, argv + 2);
+    }
+
+    /* Not a test, see gentable_bench.c */
+    if (argc > 1 && strcmp(argv[1], "gentable-bench") == 0) {
+        return gentable_bench(argc - 2, argv + 2);
+    }
+
     RUN_TEST(ft_hash);
     RUN_TEST(ft_iterator);
     RUN_TEST(ft_iter_task);
+    RUN_TEST(ft_resize);
+    RUN_TEST(ft_cookie_range);
+    RUN_TEST(ft_checksum);
+    RUN_TEST(ft_content_checksum);
+    RUN_TEST(ft_packet_match);
+    RUN_TEST(ft_lpm);
+    RUN_TEST(ft_l2_index);
+    RUN_TEST(ft_shards);
+    RUN_TEST(pipeline_packet_out);
 
     /* Init Core */
     MEMSET(&core, 0, sizeof(core));
@@ -1449,16 +3728,34 @@ aim_main(int argc, char* argv[])
     RUN_TEST(hello);
     RUN_TEST(packet_out);
     RUN_TEST(packet_in);
+    RUN_TEST(packet_in_copy);
     RUN_TEST(experimenter);
     RUN_TEST(desc_strings);
+    RUN_TEST(debug_counters);
+    RUN_TEST(reply_cache);
     RUN_TEST(simple_add_del);
+    RUN_TEST(batched_add_del);
     RUN_TEST(exact_add_del);
     RUN_TEST(modify);
     RUN_TEST(modify_strict);
+    RUN_TEST(overwrite);
+    RUN_TEST(flow_removed_batch);
+    RUN_TEST(flow_stats);
+    RUN_TEST(flow_stats_changed);
+    RUN_TEST(group_desc_stats);
+    RUN_TEST(group_refs);
+    RUN_TEST(bundle);
+    RUN_TEST(onf_bundle);
+    RUN_TEST(ft_dump);
+    RUN_TEST(clear_all);
+    RUN_TEST(delete_all_order);
+    RUN_TEST(mem_accounting);
 
     RUN_TEST(packet_in_listeners);
+    RUN_TEST(packet_in_filtered_listeners);
     RUN_TEST(port_status_listeners);
     RUN_TEST(message_listeners);
+    RUN_TEST(message_listener_subscribe);
 
     if (test_gentable() != TEST_PASS) {
         return 1;
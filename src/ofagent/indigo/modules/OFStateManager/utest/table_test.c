@@ -42,6 +42,7 @@ extern void handle_message(of_object_t *obj);
 extern int do_barrier(void);
 
 static void do_add(uint32_t port, uint32_t meter);
+static void send_add(uint32_t port, uint32_t meter);
 static void do_modify(uint32_t port, uint32_t meter) __attribute__((unused));
 static void do_delete(uint32_t port) __attribute__((unused));
 static void do_entry_stats(void) __attribute__((unused));
@@ -75,6 +76,7 @@ struct test_table_stats {
     int count_delete;
     int count_stats;
     int count_hit_status;
+    int count_batch;
     struct test_entry_stats entries[NUM_ENTRIES];
 };
 
@@ -82,6 +84,7 @@ static struct test_table table;
 static struct test_table_stats stats;
 
 static indigo_core_table_ops_t test_ops;
+static indigo_core_table_ops_t test_batch_ops;
 
 static int
 test_table_entry_add(void)
@@ -211,6 +214,39 @@ test_table_entry_stats(void)
     return TEST_PASS;
 }
 
+/* Tables with batch operations get one call for several entries */
+static int
+test_table_batch(void)
+{
+    memset(&table, 0, sizeof(table));
+    memset(&stats, 0, sizeof(stats));
+    table.magic = TABLE_MAGIC;
+    indigo_core_table_register(TABLE_ID, "test", &test_batch_ops, &table);
+
+    send_add(1, 1000);
+    send_add(2, 2000);
+    send_add(3, 3000);
+    AIM_TRUE_OR_DIE(stats.count_add == 0);
+    do_barrier();
+    AIM_TRUE_OR_DIE(stats.count_batch == 1);
+    AIM_TRUE_OR_DIE(stats.count_add == 3);
+    AIM_TRUE_OR_DIE(table.entries[3].meter == 3000);
+
+    memset(&stats, 0, sizeof(stats));
+    do_entry_stats();
+    AIM_TRUE_OR_DIE(stats.count_batch == 1);
+    AIM_TRUE_OR_DIE(stats.count_stats == 3);
+    AIM_TRUE_OR_DIE(stats.entries[2].count_stats == 1);
+
+    memset(&stats, 0, sizeof(stats));
+    indigo_core_table_unregister(TABLE_ID);
+    AIM_TRUE_OR_DIE(stats.count_batch == 1);
+    AIM_TRUE_OR_DIE(stats.count_delete == 3);
+    AIM_TRUE_OR_DIE(stats.entries[1].count_delete == 1);
+
+    return TEST_PASS;
+}
+
 int
 test_table(void)
 {
@@ -218,6 +254,7 @@ test_table(void)
     RUN_TEST(table_entry_delete);
     RUN_TEST(table_entry_modify);
     RUN_TEST(table_entry_stats);
+    RUN_TEST(table_batch);
     return TEST_PASS;
 }
 
@@ -225,6 +262,14 @@ test_table(void)
 
 static void
 do_add(uint32_t port, uint32_t meter)
+{
+    send_add(port, meter);
+    do_barrier();
+}
+
+/* Without waiting for a barrier, so the flow add may be batched */
+static void
+send_add(uint32_t port, uint32_t meter)
 {
     of_object_t *obj = of_flow_add_new(OF_VERSION_1_3);
     of_flow_add_xid_set(obj, 0x12345678);
@@ -251,7 +296,6 @@ do_add(uint32_t port, uint32_t meter)
     }
 
     handle_message(obj);
-    do_barrier();
 }
 
 static void
@@ -454,3 +498,53 @@ static indigo_core_table_ops_t test_ops = {
     op_entry_stats_get,
     op_entry_hit_status_get,
 };
+
+static indigo_error_t
+op_entry_create_batch(void *table_priv, int count, of_flow_add_t **objs, indigo_cookie_t *flow_ids, void **entry_privs, indigo_error_t *results)
+{
+    int i;
+
+    stats.count_batch++;
+    for (i = 0; i < count; i++) {
+        results[i] = op_entry_create(table_priv, objs[i], flow_ids[i], &entry_privs[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+op_entry_delete_batch(void *table_priv, int count, void **entry_privs, indigo_fi_flow_stats_t *flow_stats, indigo_error_t *results)
+{
+    int i;
+
+    stats.count_batch++;
+    for (i = 0; i < count; i++) {
+        results[i] = op_entry_delete(table_priv, entry_privs[i], &flow_stats[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t
+op_entry_stats_get_batch(void *table_priv, int count, void **entry_privs, indigo_fi_flow_stats_t *flow_stats, indigo_error_t *results)
+{
+    int i;
+
+    stats.count_batch++;
+    for (i = 0; i < count; i++) {
+        results[i] = op_entry_stats_get(table_priv, entry_privs[i], &flow_stats[i]);
+    }
+
+    return INDIGO_ERROR_NONE;
+}
+
+static indigo_core_table_ops_t test_batch_ops = {
+    .entry_create = op_entry_create,
+    .entry_modify = op_entry_modify,
+    .entry_delete = op_entry_delete,
+    .entry_stats_get = op_entry_stats_get,
+    .entry_hit_status_get = op_entry_hit_status_get,
+    .entry_create_batch = op_entry_create_batch,
+    .entry_delete_batch = op_entry_delete_batch,
+    .entry_stats_get_batch = op_entry_stats_get_batch,
+};
@@ -37,6 +37,8 @@
 #include "socketmanager_config.h"
 
 #include <indigo/error.h>
+#include <AIM/aim_pvs.h>
+#include <AIM/aim_trace.h>
 #include <stdint.h>
 #include <limits.h>
 
@@ -51,6 +53,24 @@
 #define IND_SOC_HIGHEST_PRIORITY INT_MAX
 #define IND_SOC_LOWEST_PRIORITY  INT_MIN
 
+/*
+ * Priority classes, from most to least latency sensitive. Event sources
+ * pick the class of the work they do:
+ *
+ * CONTROL: controller connections; keepalives, barriers and the
+ *   connection state machine.
+ * PACKET_IN: packets punted to the controller.
+ * FLOW: flow programming and the driver events that follow it.
+ * STATS: statistics collection and everything else.
+ *
+ * Ready work of a lower class that has waited SOCKETMANAGER_CONFIG_AGING_MS
+ * is run ahead of higher classes, so none of them is starved for good.
+ */
+#define IND_SOC_PRIORITY_CONTROL   30
+#define IND_SOC_PRIORITY_PACKET_IN 20
+#define IND_SOC_PRIORITY_FLOW      10
+#define IND_SOC_PRIORITY_STATS     IND_SOC_DEFAULT_PRIORITY
+
 /**
  * Run status.
  *
@@ -284,9 +304,184 @@ indigo_error_t ind_soc_task_register(
     ind_soc_task_callback_f callback,
     void *cookie, int priority);
 
+/**
+ * Use SOCKETMANAGER_CONFIG_TIMESLICE_MS as the task budget
+ */
+#define IND_SOC_TASK_BUDGET_DEFAULT 0
+
+/**
+ * Register a task with its own time slice
+ *
+ * @param callback Task callback function
+ * @param cookie Opaque data passed to callback
+ * @param priority Priority level
+ * @param budget_ms Time after which ind_soc_should_yield returns true
+ * in this task, or IND_SOC_TASK_BUDGET_DEFAULT
+ *
+ * A background task given a small budget yields to other work at the
+ * same priority sooner than one given a large budget.
+ */
+
+indigo_error_t ind_soc_task_register_with_budget(
+    ind_soc_task_callback_f callback,
+    void *cookie, int priority, int budget_ms);
+
+/****************************************************************
+ * Coroutines
+ ****************************************************************/
+
+/**
+ * A coroutine is a task written as straight-line code that can yield
+ * to the event loop and wait for asynchronous completions in the
+ * middle, instead of a callback that saves its position in a state
+ * machine by hand:
+ *
+ *   static ind_soc_coro_status_t
+ *   batch_coro(ind_soc_coro_t *coro, void *cookie)
+ *   {
+ *       struct batch_state *state = cookie;
+ *
+ *       IND_SOC_CORO_BEGIN(coro);
+ *       for (state->i = 0; state->i < state->count; state->i++) {
+ *           ind_soc_coro_pending_add(coro, 1);
+ *           start_async_op(state->ops[state->i], coro);
+ *           IND_SOC_CORO_YIELD_IF_NEEDED(coro);
+ *       }
+ *       IND_SOC_CORO_AWAIT(coro);
+ *       send_reply(state);
+ *       aim_free(state);
+ *       IND_SOC_CORO_END(coro);
+ *   }
+ *
+ * where the completion of each operation calls ind_soc_coro_wake.
+ *
+ * The coroutines are stackless: the function returns at each yield and
+ * is called again to resume, continuing after the yield. Local
+ * variables do not survive a yield or an await; keep anything needed
+ * afterwards in the state the cookie points to. A switch statement
+ * must not span a yield, and the yield macros can only be used in the
+ * coroutine function itself, between IND_SOC_CORO_BEGIN and
+ * IND_SOC_CORO_END.
+ *
+ * The function may free the ind_soc_coro_t and its state just before
+ * IND_SOC_CORO_END or a return of IND_SOC_CORO_FINISHED; neither is
+ * touched afterwards.
+ *
+ * All calls are made on the event loop thread.
+ */
+
+typedef enum ind_soc_coro_status {
+    IND_SOC_CORO_CONTINUE,      /* Run again after other ready work */
+    IND_SOC_CORO_SUSPENDED,     /* Waiting for ind_soc_coro_wake */
+    IND_SOC_CORO_FINISHED,
+} ind_soc_coro_status_t;
+
+typedef struct ind_soc_coro_s ind_soc_coro_t;
+
+typedef ind_soc_coro_status_t (*ind_soc_coro_f)(
+    ind_soc_coro_t *coro, void *cookie);
+
+/**
+ * Coroutine handle, usually embedded in the coroutine's state.
+ * Treat as opaque.
+ */
+
+struct ind_soc_coro_s {
+    ind_soc_coro_f fn;
+    void *cookie;
+    int priority;
+    int resume;                 /* Where to resume; 0 to start */
+    int pending;                /* Completions not yet woken for */
+    int suspended;              /* Not a task until woken */
+};
+
+/**
+ * Start a coroutine
+ *
+ * @param coro Handle, valid until the coroutine finishes
+ * @param fn Coroutine function
+ * @param cookie Opaque data passed to fn
+ * @param priority Priority level of the task running it
+ *
+ * fn first runs from the event loop like a task registered now.
+ */
+
+indigo_error_t ind_soc_coro_start(
+    ind_soc_coro_t *coro, ind_soc_coro_f fn, void *cookie, int priority);
+
+/**
+ * Count completions the coroutine will wait for with IND_SOC_CORO_AWAIT
+ */
+
+static inline void
+ind_soc_coro_pending_add(ind_soc_coro_t *coro, int count)
+{
+    coro->pending += count;
+}
+
+/**
+ * Report a completion the coroutine counted with ind_soc_coro_pending_add
+ *
+ * Once none is pending, a coroutine suspended in IND_SOC_CORO_AWAIT is
+ * resumed from the event loop. A completion may also come before the
+ * coroutine awaits it.
+ */
+
+void ind_soc_coro_wake(ind_soc_coro_t *coro);
+
+/* Suspend the coroutine unless no completion is pending */
+int ind_soc_coro_suspend(ind_soc_coro_t *coro);
+
+#define IND_SOC_CORO_BEGIN(coro) \
+    switch ((coro)->resume) { case 0:
+
+#define IND_SOC_CORO_END(coro) \
+    } return IND_SOC_CORO_FINISHED
+
+/**
+ * Let other ready work run, then continue
+ */
+
+#define IND_SOC_CORO_YIELD(coro) do {                                   \
+        (coro)->resume = __LINE__;                                      \
+        return IND_SOC_CORO_CONTINUE;                                   \
+    case __LINE__:;                                                     \
+    } while (0)
+
+/**
+ * Yield if the coroutine has used up its time slice, see
+ * ind_soc_should_yield
+ */
+
+#define IND_SOC_CORO_YIELD_IF_NEEDED(coro) do {                         \
+        if (ind_soc_should_yield()) {                                   \
+            IND_SOC_CORO_YIELD(coro);                                   \
+        }                                                               \
+    } while (0)
+
+/**
+ * Wait until every completion counted with ind_soc_coro_pending_add has
+ * been reported with ind_soc_coro_wake
+ */
+
+#define IND_SOC_CORO_AWAIT(coro) do {                                   \
+        (coro)->resume = __LINE__;                                      \
+        if (ind_soc_coro_suspend(coro)) {                               \
+            return IND_SOC_CORO_SUSPENDED;                              \
+        }                                                               \
+    case __LINE__:;                                                     \
+    } while (0)
+
+
+/**
+ * Use epoll(7) rather than poll(2) to wait for socket events. The cost of
+ * each wakeup is then proportional to the number of ready sockets rather
+ * than the number registered. Falls back to poll if epoll is unavailable.
+ */
+#define IND_SOC_CONFIG_F_EPOLL (1 << 0)
 
 typedef struct ind_soc_config_s {
-    uint32_t flags; /* Ignored */
+    uint32_t flags; /* IND_SOC_CONFIG_F_* */
 } ind_soc_config_t;
 
 /****************************************************************
@@ -341,7 +536,8 @@ extern void ind_soc_run_status_set(ind_soc_run_status_t status);
  * Check whether the current callback should yield
  *
  * This function will return true if too much time has passed
- * since the callback began.
+ * since the callback began: the task's budget for tasks, and
+ * SOCKETMANAGER_CONFIG_TIMESLICE_MS for other callbacks.
  *
  * This should be only called after the callback has done some
  * minimal amount of work to ensure forward progress.
@@ -353,6 +549,135 @@ extern void ind_soc_run_status_set(ind_soc_run_status_t status);
 
 int ind_soc_should_yield(void);
 
+/**
+ * Show the number of calls, the time used and latency percentiles of each
+ * socket, timer and task callback
+ *
+ * @param pvs Output stream
+ */
+
+void ind_soc_stats_show(aim_pvs_t *pvs);
+
+/**
+ * Show the callback profile: the event processing time per loop iteration
+ * and, with details, the callback stats of each socket, timer and task
+ * including their nonzero latency histogram buckets
+ *
+ * @param pvs Output stream
+ * @param details If true, also show the callbacks and histogram buckets
+ */
+
+void ind_soc_profile_show(aim_pvs_t *pvs, int details);
+
+/**
+ * Clear the callback profile
+ */
+
+void ind_soc_profile_reset(void);
+
+/**
+ * Cumulative event loop time, split by phase. Each iteration first scans
+ * the ready sockets, expired timers and tasks for the highest ready
+ * priority, then runs the socket, timer and task callbacks at that priority.
+ * The phase times include the callbacks they run.
+ */
+
+typedef struct ind_soc_loop_stats_s {
+    uint64_t iterations;
+    uint64_t scan_ns;
+    uint64_t sockets_ns;
+    uint64_t timers_ns;
+    uint64_t tasks_ns;
+} ind_soc_loop_stats_t;
+
+/**
+ * Get the event loop phase times accumulated since the last
+ * ind_soc_profile_reset()
+ *
+ * @param stats Filled in with the current totals
+ */
+
+void ind_soc_loop_stats_get(ind_soc_loop_stats_t *stats);
+
+
+/****************************************************************
+ *
+ * Flight recorder
+ *
+ * Recent control plane events are kept in a trace ring. When one
+ * event loop iteration takes longer than the configured budget, the
+ * ring is frozen and written to a file, so a stall can be analysed
+ * after the fact without reproducing it.
+ *
+ ****************************************************************/
+
+/**
+ * Flight recorder event ids. Durations are in microseconds; names
+ * are pointers to strings with static lifetime.
+ */
+
+typedef enum ind_soc_record_id_e {
+    IND_SOC_RECORD_SOCKET = 1,    /* arg1 callback, arg2 run time */
+    IND_SOC_RECORD_TIMER,         /* arg1 callback, arg2 run time */
+    IND_SOC_RECORD_TASK,          /* arg1 callback, arg2 run time */
+    IND_SOC_RECORD_LOOP,          /* arg0 priority, arg2 processing time */
+    IND_SOC_RECORD_MSG_RX,        /* arg0 cxn, arg1 message name, arg2 xid */
+    IND_SOC_RECORD_HANDLER_START, /* arg0 cxn, arg1 message name */
+    IND_SOC_RECORD_HANDLER_END,   /* arg0 cxn, arg1 message name, arg2 run time */
+    IND_SOC_RECORD_RPC_START,     /* arg1 function name */
+    IND_SOC_RECORD_RPC_END,       /* arg0 return code, arg1 function name */
+} ind_soc_record_id_t;
+
+/* NULL while the recorder is disabled or frozen */
+extern aim_trace_ring_t *ind_soc_recorder_ring;
+
+/**
+ * Record an event in the flight recorder
+ *
+ * Safe to call from any thread.
+ */
+
+#define IND_SOC_RECORD(_id, _arg0, _arg1, _arg2) do {                   \
+        aim_trace_ring_t *_ring = ind_soc_recorder_ring;                \
+        if (_ring != NULL) {                                            \
+            aim_trace_event(_ring, _id, _arg0, _arg1, _arg2);           \
+        }                                                               \
+    } while (0)
+
+/**
+ * Start the flight recorder
+ *
+ * @param size Number of events kept
+ * @param budget_ms Processing time of one loop iteration above which
+ * the events are dumped, or 0 to only dump on request
+ * @param filename File the events are written to on an overrun
+ */
+
+indigo_error_t ind_soc_recorder_enable(uint32_t size, int budget_ms,
+                                       const char *filename);
+
+/**
+ * Stop the flight recorder and free its events
+ */
+
+void ind_soc_recorder_disable(void);
+
+/**
+ * Write the recorded events, oldest first
+ *
+ * @param pvs Output stream
+ */
+
+void ind_soc_recorder_dump(aim_pvs_t *pvs);
+
+/**
+ * Show the overrun and dump counts
+ *
+ * @param pvs Output stream
+ */
+
+void ind_soc_recorder_show(aim_pvs_t *pvs);
+
 
 /**
  * Enable the socket manager
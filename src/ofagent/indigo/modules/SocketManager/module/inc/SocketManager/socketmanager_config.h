@@ -128,6 +128,16 @@
 #define SOCKETMANAGER_CONFIG_MAX_TIMERS 48
 #endif
 
+/**
+ * SOCKETMANAGER_CONFIG_AGING_MS
+ *
+ * Milliseconds ready work may wait behind higher priority work before its priority is run anyway. 0 disables aging. */
+
+
+#ifndef SOCKETMANAGER_CONFIG_AGING_MS
+#define SOCKETMANAGER_CONFIG_AGING_MS 100
+#endif
+
 
 
 /**
@@ -29,6 +29,11 @@
  * loop processes one priority level before polling for potential new high
  * priority events.
  *
+ * Ready events that have waited SOCKETMANAGER_CONFIG_AGING_MS behind higher
+ * priority events age: the iteration processes the priority of the one
+ * that has waited longest instead, so a busy high priority socket cannot
+ * starve the rest of the loop.
+ *
  * @todo Make the max socket ID supported a parameter to the module
  * @todo Make the max timer events supported a parameter to the module
  *
@@ -57,13 +62,17 @@
 #include <AIM/aim_list.h>
 
 #include <poll.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
+#include <inttypes.h>
 
-static void before_callback(void);
-static void after_callback(void);
+static void before_callback(int budget_ms);
+static void after_callback(ind_soc_callback_stats_t *stats,
+                           ind_soc_profile_kind_t kind, void *callback);
 
 static int init_done = 0;
 static int module_enabled = 0;
@@ -85,6 +94,8 @@ typedef struct soc_map_s {
     int priority;
     ind_soc_socket_ready_callback_f callback;
     void *cookie;
+    indigo_time_t ready_since; /* Ready and not yet run, 0 if not */
+    ind_soc_callback_stats_t stats;
 } soc_map_t;
 
 /* Indexed by socket descriptor */
@@ -94,6 +105,16 @@ static soc_map_t soc_map[SOCKET_COUNT_MAX];
 static struct pollfd pollfds[SOCKET_COUNT_MAX];
 static int num_pollfds = 0;
 
+/*
+ * epoll(7) backend, selected with IND_SOC_CONFIG_F_EPOLL. The pollfds array
+ * remains the record of the events each socket is interested in; the epoll
+ * set mirrors it. epoll_events holds the sockets reported ready by the last
+ * epoll_wait so that dispatch only visits those sockets.
+ */
+static int epoll_fd = -1;
+static struct epoll_event epoll_events[SOCKET_COUNT_MAX];
+static int num_epoll_events = 0;
+
 #define IS_ACTIVE_SOCKET_ID(_id) (soc_map[_id].socket_id == (_id))
 #define IS_LEGAL_SOCKET_ID(_id) (((_id) >= 0) && ((_id) < SOCKET_COUNT_MAX))
 #define POLLFD_INDEX(_id) soc_map[(_id)].pollfd_index
@@ -101,6 +122,10 @@ static int num_pollfds = 0;
 /*
  * Timer event structure
  * Lookup is (callback, cookie)
+ *
+ * Active timers are kept in a binary min-heap ordered by deadline so that
+ * the event loop only visits expired timers. A hash on (callback, cookie)
+ * finds the slot for re-registration and unregistration.
  */
 typedef struct timer_event_s {
     ind_soc_timer_callback_f callback;
@@ -108,15 +133,29 @@ typedef struct timer_event_s {
     int repeat_time_ms;
     int priority;
     indigo_time_t last_call;
+    indigo_time_t deadline; /* last_call + repeat_time_ms */
+    int heap_index;         /* Position in timer_heap */
+    int next;               /* Next slot in hash chain or free list */
+    ind_soc_callback_stats_t stats;
 } timer_event_t;
 
 static timer_event_t timer_event[SOCKETMANAGER_CONFIG_MAX_TIMERS];
 
+/* Timers that were not registered any more once their callback returned */
+static ind_soc_callback_stats_t oneshot_timer_stats;
+
 #define TIMER_EVENT_VALID(idx) (timer_event[idx].callback != NULL)
 
-#define FOREACH_TIMER_EVENT(idx)                        \
-    for ((idx) = 0; (idx) < SOCKETMANAGER_CONFIG_MAX_TIMERS; (idx)++)   \
-        if (TIMER_EVENT_VALID(idx))
+/* Slot indices of active timers, heap ordered by deadline */
+static int timer_heap[SOCKETMANAGER_CONFIG_MAX_TIMERS];
+static int timer_heap_count = 0;
+
+#define TIMER_HEAP_DEADLINE(pos) timer_event[timer_heap[(pos)]].deadline
+
+/* Must be a power of 2 */
+#define TIMER_HASH_BUCKETS 64
+static int timer_hash[TIMER_HASH_BUCKETS];
+static int timer_free_head = -1;
 
 /*
  * Task structure
@@ -126,11 +165,75 @@ typedef struct ind_soc_task_s {
     ind_soc_task_callback_f callback;
     void *cookie;
     int priority;
+    int budget_ms; /* Time slice for ind_soc_should_yield */
+    indigo_time_t last_run;
+    ind_soc_callback_stats_t stats;
 } ind_soc_task_t;
 
 /* Sorted in descending priority order */
 static list_head_t tasks;
 
+/* Iterations that ran a priority because its events had aged */
+static uint64_t aged_iterations;
+
+
+static int
+timer_hash_bucket(ind_soc_timer_callback_f callback, void *cookie)
+{
+    uintptr_t h = (uintptr_t)callback ^ ((uintptr_t)cookie * 0x9e3779b1);
+    h ^= h >> 16;
+    return h & (TIMER_HASH_BUCKETS - 1);
+}
+
+static void
+timer_heap_swap(int a, int b)
+{
+    int tmp = timer_heap[a];
+    timer_heap[a] = timer_heap[b];
+    timer_heap[b] = tmp;
+    timer_event[timer_heap[a]].heap_index = a;
+    timer_event[timer_heap[b]].heap_index = b;
+}
+
+/* Restore the heap property after the deadline at pos changed */
+static void
+timer_heap_fix(int pos)
+{
+    int parent, child;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (TIMER_HEAP_DEADLINE(parent) <= TIMER_HEAP_DEADLINE(pos)) {
+            break;
+        }
+        timer_heap_swap(parent, pos);
+        pos = parent;
+    }
+
+    while ((child = 2 * pos + 1) < timer_heap_count) {
+        if (child + 1 < timer_heap_count &&
+                TIMER_HEAP_DEADLINE(child + 1) < TIMER_HEAP_DEADLINE(child)) {
+            child++;
+        }
+        if (TIMER_HEAP_DEADLINE(pos) <= TIMER_HEAP_DEADLINE(child)) {
+            break;
+        }
+        timer_heap_swap(pos, child);
+        pos = child;
+    }
+}
+
+static void
+timer_heap_remove(int idx)
+{
+    int pos = timer_event[idx].heap_index;
+
+    timer_heap_count--;
+    if (pos != timer_heap_count) {
+        timer_heap_swap(pos, timer_heap_count);
+        timer_heap_fix(pos);
+    }
+}
 
 /* Return index for timer; -1 if not found.  Use only with valid callback */
 static int
@@ -138,7 +241,8 @@ timer_event_find(ind_soc_timer_callback_f callback, void *cookie)
 {
     int idx;
 
-    FOREACH_TIMER_EVENT(idx) {
+    for (idx = timer_hash[timer_hash_bucket(callback, cookie)];
+            idx >= 0; idx = timer_event[idx].next) {
         if ((timer_event[idx].callback == callback) &&
                 (timer_event[idx].cookie == cookie)) {
             return idx;
@@ -148,19 +252,87 @@ timer_event_find(ind_soc_timer_callback_f callback, void *cookie)
     return -1;
 }
 
-/* Return index of first free timer slot */
+/* Set the next deadline of an active timer relative to now */
+static void
+timer_event_schedule(int idx, indigo_time_t now)
+{
+    timer_event[idx].last_call = now;
+    timer_event[idx].deadline = now + timer_event[idx].repeat_time_ms;
+    timer_heap_fix(timer_event[idx].heap_index);
+}
+
+/* Allocate and activate a timer slot; -1 if none are free */
 static int
-timer_event_free_slot(void)
+timer_event_alloc(ind_soc_timer_callback_f callback, void *cookie)
 {
-    int idx;
+    int idx, bucket;
 
-    for (idx = 0; idx < SOCKETMANAGER_CONFIG_MAX_TIMERS; idx++) {
-        if (timer_event[idx].callback == NULL) {
-            return idx;
+    if ((idx = timer_free_head) < 0) {
+        return -1;
+    }
+    timer_free_head = timer_event[idx].next;
+
+    bucket = timer_hash_bucket(callback, cookie);
+    timer_event[idx].callback = callback;
+    timer_event[idx].cookie = cookie;
+    memset(&timer_event[idx].stats, 0, sizeof(timer_event[idx].stats));
+    timer_event[idx].next = timer_hash[bucket];
+    timer_hash[bucket] = idx;
+
+    timer_event[idx].heap_index = timer_heap_count;
+    timer_heap[timer_heap_count++] = idx;
+
+    return idx;
+}
+
+static void
+timer_event_free(int idx)
+{
+    int *link;
+
+    timer_heap_remove(idx);
+
+    link = &timer_hash[timer_hash_bucket(timer_event[idx].callback,
+                                         timer_event[idx].cookie)];
+    while (*link != idx) {
+        link = &timer_event[*link].next;
+    }
+    *link = timer_event[idx].next;
+
+    timer_event[idx].callback = NULL;
+    timer_event[idx].next = timer_free_head;
+    timer_free_head = idx;
+}
+
+/*
+ * Fill in the slot indices of the timers expired at now and return their
+ * number. Only the expired part of the heap is visited.
+ */
+static int
+timer_events_expired(indigo_time_t now, int *expired)
+{
+    int stack[SOCKETMANAGER_CONFIG_MAX_TIMERS];
+    int depth = 0, count = 0, pos;
+
+    if (timer_heap_count > 0) {
+        stack[depth++] = 0;
+    }
+
+    while (depth > 0) {
+        pos = stack[--depth];
+        if (TIMER_HEAP_DEADLINE(pos) > now) {
+            continue;
+        }
+        expired[count++] = timer_heap[pos];
+        if (2 * pos + 1 < timer_heap_count) {
+            stack[depth++] = 2 * pos + 1;
+        }
+        if (2 * pos + 2 < timer_heap_count) {
+            stack[depth++] = 2 * pos + 2;
         }
     }
 
-    return -1;
+    return count;
 }
 
 static void
@@ -173,11 +345,65 @@ soc_mgr_init(void)
 
     for (idx = 0; idx < SOCKETMANAGER_CONFIG_MAX_TIMERS; idx++) {
         timer_event[idx].callback = NULL;
+        timer_event[idx].next = idx + 1 < SOCKETMANAGER_CONFIG_MAX_TIMERS ?
+            idx + 1 : -1;
+    }
+    timer_free_head = 0;
+    timer_heap_count = 0;
+
+    for (idx = 0; idx < TIMER_HASH_BUCKETS; idx++) {
+        timer_hash[idx] = -1;
     }
 
     list_init(&tasks);
 }
 
+static uint32_t
+epoll_events_from_poll(short events)
+{
+    uint32_t ev = 0;
+    if (events & POLLIN) ev |= EPOLLIN;
+    if (events & POLLOUT) ev |= EPOLLOUT;
+    return ev;
+}
+
+static short
+poll_events_from_epoll(uint32_t ev)
+{
+    short events = 0;
+    if (ev & EPOLLIN) events |= POLLIN;
+    if (ev & EPOLLOUT) events |= POLLOUT;
+    if (ev & EPOLLERR) events |= POLLERR;
+    if (ev & EPOLLHUP) events |= POLLHUP;
+    return events;
+}
+
+/*
+ * Change the events a socket is polled for, updating the epoll set if
+ * the mask changed
+ */
+static void
+socket_events_set(int socket_id, short events)
+{
+    struct pollfd *pfd = &pollfds[POLLFD_INDEX(socket_id)];
+    struct epoll_event ev;
+
+    if (pfd->events == events) {
+        return;
+    }
+    pfd->events = events;
+
+    if (epoll_fd >= 0) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = epoll_events_from_poll(events);
+        ev.data.fd = socket_id;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, socket_id, &ev) < 0) {
+            LOG_ERROR("epoll_ctl MOD failed for socket %d: %s",
+                      socket_id, strerror(errno));
+        }
+    }
+}
+
 
 indigo_error_t
 ind_soc_socket_register_with_priority(int socket_id,
@@ -204,11 +430,25 @@ ind_soc_socket_register_with_priority(int socket_id,
     }
 
     INDIGO_ASSERT(soc_map[socket_id].socket_id == INVALID_SOCKET_ID);
+
+    if (epoll_fd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = socket_id;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_id, &ev) < 0) {
+            LOG_ERROR("epoll_ctl ADD failed for socket %d: %s",
+                      socket_id, strerror(errno));
+            return INDIGO_ERROR_UNKNOWN;
+        }
+    }
+
     soc_map[socket_id].socket_id = socket_id;
     soc_map[socket_id].pollfd_index = num_pollfds;
     soc_map[socket_id].callback = callback;
     soc_map[socket_id].cookie = cookie;
     soc_map[socket_id].priority = priority;
+    soc_map[socket_id].ready_since = 0;
 
     INDIGO_ASSERT(num_pollfds < SOCKET_COUNT_MAX);
     pfd = &pollfds[num_pollfds++];
@@ -241,7 +481,8 @@ ind_soc_data_out_ready(int socket_id)
         return INDIGO_ERROR_PARAM;
     }
 
-    pollfds[POLLFD_INDEX(socket_id)].events |= POLLOUT;
+    socket_events_set(socket_id,
+                      pollfds[POLLFD_INDEX(socket_id)].events | POLLOUT);
 
     return INDIGO_ERROR_NONE;
 }
@@ -259,7 +500,8 @@ ind_soc_data_out_clear(int socket_id)
         return INDIGO_ERROR_PARAM;
     }
 
-    pollfds[POLLFD_INDEX(socket_id)].events &= ~POLLOUT;
+    socket_events_set(socket_id,
+                      pollfds[POLLFD_INDEX(socket_id)].events & ~POLLOUT);
 
     return INDIGO_ERROR_NONE;
 }
@@ -277,7 +519,8 @@ ind_soc_data_in_pause(int socket_id)
         return INDIGO_ERROR_PARAM;
     }
 
-    pollfds[POLLFD_INDEX(socket_id)].events &= ~POLLIN;
+    socket_events_set(socket_id,
+                      pollfds[POLLFD_INDEX(socket_id)].events & ~POLLIN);
 
     return INDIGO_ERROR_NONE;
 }
@@ -295,7 +538,8 @@ ind_soc_data_in_resume(int socket_id)
         return INDIGO_ERROR_PARAM;
     }
 
-    pollfds[POLLFD_INDEX(socket_id)].events |= POLLIN;
+    socket_events_set(socket_id,
+                      pollfds[POLLFD_INDEX(socket_id)].events | POLLIN);
 
     return INDIGO_ERROR_NONE;
 }
@@ -319,6 +563,11 @@ ind_soc_socket_unregister(int socket_id)
         return INDIGO_ERROR_PARAM;
     }
 
+    if (epoll_fd >= 0) {
+        /* Fails harmlessly if the socket was already closed */
+        (void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket_id, NULL);
+    }
+
     /*
      * Need to maintain the dense property of the pollfds array.
      * Move the element at the end to the index being freed.
@@ -361,16 +610,14 @@ ind_soc_run_status_set(ind_soc_run_status_t s)
 static int
 find_next_timer_expiration(indigo_time_t now)
 {
-    int idx;
-    int next_ms = -1, elapsed, tmp_ms;
-    FOREACH_TIMER_EVENT(idx) {
-        elapsed = INDIGO_TIME_DIFF_ms(timer_event[idx].last_call, now);
-        tmp_ms = timer_event[idx].repeat_time_ms - elapsed; /* Time to next */
-        if (next_ms == -1 || tmp_ms < next_ms) {
-            next_ms = tmp_ms > 0 ? tmp_ms : 0;
-        }
+    indigo_time_t deadline;
+
+    if (timer_heap_count == 0) {
+        return -1;
     }
-    return next_ms;
+
+    deadline = TIMER_HEAP_DEADLINE(0);
+    return deadline > now ? INDIGO_TIME_DIFF_ms(now, deadline) : 0;
 }
 
 /*
@@ -379,41 +626,50 @@ find_next_timer_expiration(indigo_time_t now)
 static void
 process_timers(int priority)
 {
-    int idx;
+    int i, idx, count;
+    int expired[SOCKETMANAGER_CONFIG_MAX_TIMERS];
     indigo_time_t now;
-    int elapsed, tmp_ms;
     ind_soc_timer_callback_f callback;
+    void *cookie;
 
     now = INDIGO_CURRENT_TIME;
 
-    FOREACH_TIMER_EVENT(idx) {
+    count = timer_events_expired(now, expired);
+
+    for (i = 0; i < count; i++) {
         if(ind_soc_run_status__ == IND_SOC_RUN_STATUS_EXIT) {
             break;
         }
 
-        if (timer_event[idx].priority != priority) {
+        /* An earlier callback may have changed this timer */
+        idx = expired[i];
+        if (!TIMER_EVENT_VALID(idx) ||
+                timer_event[idx].priority != priority ||
+                timer_event[idx].deadline > now) {
             continue;
         }
 
-        elapsed = INDIGO_TIME_DIFF_ms(timer_event[idx].last_call, now);
-        tmp_ms = timer_event[idx].repeat_time_ms - elapsed; /* Time to next */
-        if (tmp_ms <= 0) {
-            timer_event[idx].last_call = now;
+        /* The callback may change its registration, so need to track
+         * current value if this is one-shot.
+         */
 
-            /* The callback may change its registration, so need to track
-             * current value if this is one-shot.
-             */
-
-            callback = timer_event[idx].callback;
-            if (timer_event[idx].repeat_time_ms == IND_SOC_TIMER_IMMEDIATE) {
-                /* De-register one-shot immediate timers */
-                timer_event[idx].callback = NULL;
-            }
-
-            before_callback();
-            callback(timer_event[idx].cookie);
-            after_callback();
+        callback = timer_event[idx].callback;
+        cookie = timer_event[idx].cookie;
+        if (timer_event[idx].repeat_time_ms == IND_SOC_TIMER_IMMEDIATE) {
+            /* De-register one-shot immediate timers */
+            timer_event_free(idx);
+        } else {
+            timer_event_schedule(idx, now);
         }
+
+        before_callback(SOCKETMANAGER_CONFIG_TIMESLICE_MS);
+        callback(cookie);
+        /* The callback may have unregistered the timer */
+        after_callback((TIMER_EVENT_VALID(idx) &&
+                        timer_event[idx].callback == callback &&
+                        timer_event[idx].cookie == cookie) ?
+                       &timer_event[idx].stats : &oneshot_timer_stats,
+                       IND_SOC_PROFILE_TIMER, (void *)callback);
     }
 }
 
@@ -436,19 +692,17 @@ ind_soc_timer_event_register_with_priority(
     if ((idx = timer_event_find(callback, cookie)) >= 0) {
         LOG_TRACE("Resetting event timer for %p to %d", callback, repeat_time_ms);
         timer_event[idx].repeat_time_ms = repeat_time_ms;
-        timer_event[idx].last_call = INDIGO_CURRENT_TIME;
+        timer_event_schedule(idx, INDIGO_CURRENT_TIME);
         return INDIGO_ERROR_NONE;
     }
-    if ((idx = timer_event_free_slot()) < 0) {
+    if ((idx = timer_event_alloc(callback, cookie)) < 0) {
         LOG_ERROR("No space for timer event %p, %p", callback, cookie);
         return INDIGO_ERROR_RESOURCE;
     }
 
     timer_event[idx].repeat_time_ms = repeat_time_ms;
-    timer_event[idx].callback = callback;
-    timer_event[idx].cookie = cookie;
-    timer_event[idx].last_call = INDIGO_CURRENT_TIME;
     timer_event[idx].priority = priority;
+    timer_event_schedule(idx, INDIGO_CURRENT_TIME);
 
     return INDIGO_ERROR_NONE;
 }
@@ -473,7 +727,7 @@ ind_soc_timer_event_unregister(ind_soc_timer_callback_f callback, void *cookie)
         return INDIGO_ERROR_NOT_FOUND;
     }
 
-    timer_event[idx].callback = NULL;
+    timer_event_free(idx);
 
     return INDIGO_ERROR_NONE;
 }
@@ -508,7 +762,7 @@ calculate_next_timeout(indigo_time_t start, indigo_time_t current,
             remaining_ms = 0;
         }
         if (next_event_ms >= 0) {
-            min_val = remaining_ms < next_event_ms ? run_for_ms : next_event_ms;
+            min_val = remaining_ms < next_event_ms ? remaining_ms : next_event_ms;
         } else {
             min_val = remaining_ms;
         }
@@ -523,13 +777,29 @@ calculate_next_timeout(indigo_time_t start, indigo_time_t current,
 indigo_error_t
 ind_soc_task_register(ind_soc_task_callback_f callback,
                       void *cookie, int priority)
+{
+    return ind_soc_task_register_with_budget(callback, cookie, priority,
+                                             IND_SOC_TASK_BUDGET_DEFAULT);
+}
+
+indigo_error_t
+ind_soc_task_register_with_budget(ind_soc_task_callback_f callback,
+                                  void *cookie, int priority, int budget_ms)
 {
     list_links_t *cur;
 
-    ind_soc_task_t *task = aim_malloc(sizeof(*task));
+    if (budget_ms < 0) {
+        LOG_ERROR("Invalid budget for task register: %d", budget_ms);
+        return INDIGO_ERROR_PARAM;
+    }
+
+    ind_soc_task_t *task = aim_zmalloc(sizeof(*task));
     task->callback = callback;
     task->cookie = cookie;
     task->priority = priority;
+    task->budget_ms = budget_ms == IND_SOC_TASK_BUDGET_DEFAULT ?
+        SOCKETMANAGER_CONFIG_TIMESLICE_MS : budget_ms;
+    task->last_run = INDIGO_LOOP_TIME;
 
     /* Maintain descending priority order */
     LIST_FOREACH(&tasks, cur) {
@@ -558,8 +828,24 @@ ind_soc_init(ind_soc_config_t *config)
     ind_cfg_register(&ind_soc_cfg_ops);
 
     soc_mgr_init();
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    num_pollfds = 0;
+    num_epoll_events = 0;
+
+    if (config != NULL && (config->flags & IND_SOC_CONFIG_F_EPOLL)) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            LOG_WARN("epoll_create1 failed, using poll: %s", strerror(errno));
+        } else {
+            LOG_VERBOSE("Using epoll backend");
+        }
+    }
+
     init_done = 1;
-    (void)config;
 
     return INDIGO_ERROR_NONE;
 }
@@ -602,6 +888,12 @@ ind_soc_finish(void)
 {
     LOG_INFO("Shutting down socket manager");
     soc_mgr_init();
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    num_pollfds = 0;
+    num_epoll_events = 0;
     init_done = 0;
 
     return INDIGO_ERROR_NONE;
@@ -609,21 +901,52 @@ ind_soc_finish(void)
 
 /* Time since the current callback started */
 static indigo_time_t callback_start_time;
+static uint64_t callback_start_us;
+
+/* Time slice of the current callback */
+static int callback_budget_ms = SOCKETMANAGER_CONFIG_TIMESLICE_MS;
+
+static uint64_t
+monotonic_ns(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static uint64_t
+monotonic_us(void)
+{
+    return monotonic_ns() / 1000;
+}
 
 static void
-before_callback(void)
+before_callback(int budget_ms)
 {
+    callback_budget_ms = budget_ms;
     callback_start_time = INDIGO_CURRENT_TIME;
+    callback_start_us = monotonic_us();
 }
 
 static void
-after_callback(void)
+after_callback(ind_soc_callback_stats_t *stats,
+               ind_soc_profile_kind_t kind, void *callback)
 {
+    uint64_t elapsed_us = monotonic_us() - callback_start_us;
     indigo_time_t elapsed =
         INDIGO_TIME_DIFF_ms(callback_start_time, INDIGO_CURRENT_TIME);
-    if (elapsed >= SOCKETMANAGER_CONFIG_TIMESLICE_MS * 2) {
+
+    if (stats != NULL) {
+        ind_soc_callback_stats_record(stats, elapsed_us);
+    }
+
+    /* The record ids follow ind_soc_profile_kind_t */
+    IND_SOC_RECORD(IND_SOC_RECORD_SOCKET + kind, 0, (uintptr_t)callback,
+                   elapsed_us);
+
+    if (elapsed >= callback_budget_ms * 2) {
         LOG_VERBOSE("Callback exceeded 2x timeslice (ran for %d ms, timeslice is %d ms)",
-                    (int)elapsed, SOCKETMANAGER_CONFIG_TIMESLICE_MS);
+                    (int)elapsed, callback_budget_ms);
     }
 }
 
@@ -632,7 +955,121 @@ ind_soc_should_yield(void)
 {
     indigo_time_t elapsed =
         INDIGO_TIME_DIFF_ms(callback_start_time, INDIGO_CURRENT_TIME);
-    return elapsed >= SOCKETMANAGER_CONFIG_TIMESLICE_MS;
+    return elapsed >= callback_budget_ms;
+}
+
+void
+ind_soc_callbacks_show(aim_pvs_t *pvs, int details)
+{
+    struct list_links *cur;
+    int i;
+
+    aim_printf(pvs, "Sockets:\n");
+    for (i = 0; i < num_pollfds; i++) {
+        soc_map_t *soc = &soc_map[pollfds[i].fd];
+        aim_printf(pvs, "  fd %d priority %d callback %p: ",
+                   soc->socket_id, soc->priority, soc->callback);
+        ind_soc_callback_stats_show(pvs, &soc->stats, details);
+    }
+
+    aim_printf(pvs, "Timers:\n");
+    for (i = 0; i < SOCKETMANAGER_CONFIG_MAX_TIMERS; i++) {
+        timer_event_t *timer = &timer_event[i];
+        if (TIMER_EVENT_VALID(i) && timer->stats.calls != 0) {
+            aim_printf(pvs, "  callback %p cookie %p priority %d: ",
+                       timer->callback, timer->cookie, timer->priority);
+            ind_soc_callback_stats_show(pvs, &timer->stats, details);
+        }
+    }
+    if (oneshot_timer_stats.calls != 0) {
+        aim_printf(pvs, "  one-shot: ");
+        ind_soc_callback_stats_show(pvs, &oneshot_timer_stats, details);
+    }
+
+    aim_printf(pvs, "Tasks:\n");
+    LIST_FOREACH(&tasks, cur) {
+        ind_soc_task_t *task = container_of(cur, links, ind_soc_task_t);
+        aim_printf(pvs, "  callback %p cookie %p priority %d budget %d ms: ",
+                   task->callback, task->cookie, task->priority, task->budget_ms);
+        ind_soc_callback_stats_show(pvs, &task->stats, details);
+    }
+}
+
+void
+ind_soc_callbacks_reset(void)
+{
+    struct list_links *cur;
+    int i;
+
+    for (i = 0; i < num_pollfds; i++) {
+        memset(&soc_map[pollfds[i].fd].stats, 0, sizeof(soc_map[0].stats));
+    }
+    for (i = 0; i < SOCKETMANAGER_CONFIG_MAX_TIMERS; i++) {
+        memset(&timer_event[i].stats, 0, sizeof(timer_event[i].stats));
+    }
+    memset(&oneshot_timer_stats, 0, sizeof(oneshot_timer_stats));
+    LIST_FOREACH(&tasks, cur) {
+        ind_soc_task_t *task = container_of(cur, links, ind_soc_task_t);
+        memset(&task->stats, 0, sizeof(task->stats));
+    }
+}
+
+void
+ind_soc_stats_show(aim_pvs_t *pvs)
+{
+    ind_soc_callbacks_show(pvs, 0);
+    aim_printf(pvs, "Aged iterations: %"PRIu64"\n", aged_iterations);
+}
+
+/*
+ * Sockets that may have events after the last wait. With poll this is the
+ * whole pollfds array; with epoll only the sockets epoll_wait reported.
+ */
+static int
+ready_socket_count(void)
+{
+    return (epoll_fd >= 0) ? num_epoll_events : num_pollfds;
+}
+
+/*
+ * Return the socket ID and received events of the i'th ready socket, or -1
+ * if it has been unregistered since the wait. Events the socket is no
+ * longer interested in are masked out.
+ */
+static int
+ready_socket_get(int i, short *revents)
+{
+    int fd;
+
+    if (epoll_fd < 0) {
+        *revents = pollfds[i].revents;
+        return pollfds[i].fd;
+    }
+
+    fd = epoll_events[i].data.fd;
+    if (!IS_LEGAL_SOCKET_ID(fd) || !IS_ACTIVE_SOCKET_ID(fd)) {
+        return -1;
+    }
+    *revents = poll_events_from_epoll(epoll_events[i].events) &
+        (pollfds[POLLFD_INDEX(fd)].events | POLLERR | POLLHUP);
+    return fd;
+}
+
+/*
+ * Wait for socket events, as poll(2) does
+ */
+static int
+wait_for_events(int timeout_ms)
+{
+    int rv;
+
+    if (epoll_fd < 0) {
+        return poll(pollfds, num_pollfds, timeout_ms);
+    }
+
+    rv = epoll_wait(epoll_fd, epoll_events, SOCKET_COUNT_MAX, timeout_ms);
+    num_epoll_events = (rv > 0) ? rv : 0;
+    return rv;
 }
 
 /*
@@ -641,27 +1078,32 @@ ind_soc_should_yield(void)
 static void
 process_sockets(int priority)
 {
-    int i;
-    for (i = 0; i < num_pollfds; i++) {
-        struct pollfd *pfd = &pollfds[i];
+    int i, fd;
+    short revents;
+    for (i = 0; i < ready_socket_count(); i++) {
         int read_ready, write_ready, error_seen;
 
         if (ind_soc_run_status__ == IND_SOC_RUN_STATUS_EXIT) {
             break;
         }
 
-        if (soc_map[pfd->fd].priority != priority) {
+        fd = ready_socket_get(i, &revents);
+        if (fd < 0 || soc_map[fd].priority != priority) {
             continue;
         }
 
-        read_ready = (pfd->revents & POLLIN) != 0;
-        write_ready = (pfd->revents & POLLOUT) != 0;
-        error_seen = (pfd->revents & POLLERR) != 0;
+        read_ready = (revents & POLLIN) != 0;
+        write_ready = (revents & POLLOUT) != 0;
+        error_seen = (revents & POLLERR) != 0;
         if (read_ready || write_ready || error_seen) {
-            before_callback();
-            soc_map[pfd->fd].callback(pfd->fd, soc_map[pfd->fd].cookie,
-                    read_ready, write_ready, error_seen);
-            after_callback();
+            ind_soc_socket_ready_callback_f callback = soc_map[fd].callback;
+            soc_map[fd].ready_since = 0;
+            before_callback(SOCKETMANAGER_CONFIG_TIMESLICE_MS);
+            callback(fd, soc_map[fd].cookie,
+                     read_ready, write_ready, error_seen);
+            /* The callback may have unregistered the socket */
+            after_callback(IS_ACTIVE_SOCKET_ID(fd) ? &soc_map[fd].stats : NULL,
+                           IND_SOC_PROFILE_SOCKET, (void *)callback);
         }
     }
 }
@@ -673,60 +1115,99 @@ static void
 process_tasks(int priority)
 {
     struct list_links *cur, *next;
+    ind_soc_task_status_t status;
     LIST_FOREACH_SAFE(&tasks, cur, next) {
         ind_soc_task_t *task = container_of(cur, links, ind_soc_task_t);
         if (task->priority < priority) {
             break;
         }
-        before_callback();
-        if (task->callback(task->cookie) == IND_SOC_TASK_FINISHED) {
+        task->last_run = INDIGO_LOOP_TIME;
+        before_callback(task->budget_ms);
+        status = task->callback(task->cookie);
+        after_callback(&task->stats, IND_SOC_PROFILE_TASK,
+                       (void *)task->callback);
+        if (status == IND_SOC_TASK_FINISHED) {
             list_remove(&task->links);
             aim_free(task);
         }
-        after_callback();
+    }
+}
+
+/*
+ * Track the ready event that has waited longest. Only events waiting
+ * past the aging limit count.
+ */
+static void
+aging_note(indigo_time_t now, indigo_time_t since, int priority,
+           indigo_time_t *oldest, int *oldest_priority)
+{
+    if (SOCKETMANAGER_CONFIG_AGING_MS <= 0 ||
+            INDIGO_TIME_DIFF_ms(since, now) < SOCKETMANAGER_CONFIG_AGING_MS) {
+        return;
+    }
+
+    if (*oldest == 0 || since < *oldest) {
+        *oldest = since;
+        *oldest_priority = priority;
     }
 }
 
 /*
  * This function returns the priority level the event loop should process
- * on the current iteration. It assumes poll() has been called on the global
- * pollfds array.
+ * on the current iteration. It assumes wait_for_events() has been called.
+ *
+ * This is the highest priority with a ready event, unless an event has
+ * aged, in which case it is the priority of the oldest one.
  */
 static int
 find_highest_ready_priority(void)
 {
-    int idx;
+    int idx, fd, count;
+    int expired[SOCKETMANAGER_CONFIG_MAX_TIMERS];
+    short revents;
     indigo_time_t now;
-    int elapsed, tmp_ms;
+    indigo_time_t oldest = 0;
+    int oldest_priority = INT_MIN;
     int priority = INT_MIN;
+    struct list_links *cur;
 
-    now = INDIGO_CURRENT_TIME;
-
-    for (idx = 0; idx < num_pollfds; idx++) {
-        struct pollfd *pfd = &pollfds[idx];
+    now = INDIGO_LOOP_TIME;
 
-        if (pfd->revents == 0) {
+    for (idx = 0; idx < ready_socket_count(); idx++) {
+        fd = ready_socket_get(idx, &revents);
+        if (fd < 0 || revents == 0) {
             continue;
         }
 
-        priority = aim_imax(priority, soc_map[pfd->fd].priority);
-    }
+        priority = aim_imax(priority, soc_map[fd].priority);
 
-    FOREACH_TIMER_EVENT(idx) {
-        if (timer_event[idx].priority <= priority) {
-            continue;
+        if (soc_map[fd].ready_since == 0) {
+            soc_map[fd].ready_since = now;
         }
+        aging_note(now, soc_map[fd].ready_since, soc_map[fd].priority,
+                   &oldest, &oldest_priority);
+    }
 
-        elapsed = INDIGO_TIME_DIFF_ms(timer_event[idx].last_call, now);
-        tmp_ms = timer_event[idx].repeat_time_ms - elapsed; /* Time to next */
-        if (tmp_ms <= 0) {
-            priority = timer_event[idx].priority;
-        }
+    count = timer_events_expired(now, expired);
+    for (idx = 0; idx < count; idx++) {
+        timer_event_t *timer = &timer_event[expired[idx]];
+        priority = aim_imax(priority, timer->priority);
+        aging_note(now, timer->deadline, timer->priority,
+                   &oldest, &oldest_priority);
     }
 
-    if (!list_empty(&tasks)) {
-        ind_soc_task_t *task = container_of(tasks.links.next, links, ind_soc_task_t);
+    LIST_FOREACH(&tasks, cur) {
+        ind_soc_task_t *task = container_of(cur, links, ind_soc_task_t);
         priority = aim_imax(priority, task->priority);
+        aging_note(now, task->last_run, task->priority,
+                   &oldest, &oldest_priority);
+    }
+
+    if (oldest != 0 && oldest_priority < priority) {
+        LOG_TRACE("priority %d aged, running it ahead of %d",
+                  oldest_priority, priority);
+        aged_iterations++;
+        return oldest_priority;
     }
 
     return priority;
@@ -746,6 +1227,7 @@ ind_soc_select_and_run(int run_for_ms)
     int elapsed;
     int next_timer_ms, timeout_ms;
     int priority;
+    uint64_t t_start, t_scan, t_sockets, t_timers, t_tasks;
 
     ind_soc_run_status_set(IND_SOC_RUN_STATUS_OK);
 
@@ -763,7 +1245,7 @@ ind_soc_select_and_run(int run_for_ms)
                                             run_for_ms, next_timer_ms);
 
         LOG_TRACE("polling %d fds, timeout %d ms", num_pollfds, timeout_ms);
-        rv = poll(pollfds, num_pollfds, timeout_ms);
+        rv = wait_for_events(timeout_ms);
         LOG_TRACE("poll returned %d", rv);
 
         if (rv < 0 && errno != EINTR) {
@@ -771,12 +1253,24 @@ ind_soc_select_and_run(int run_for_ms)
             return INDIGO_ERROR_UNKNOWN;
         }
 
+        /* Timestamps taken while handling this iteration's events */
+        indigo_loop_time_refresh();
+
+        t_start = monotonic_ns();
         priority = find_highest_ready_priority();
         LOG_TRACE("processing priority %d", priority);
+        t_scan = monotonic_ns();
 
         process_sockets(priority);
+        t_sockets = monotonic_ns();
         process_timers(priority);
+        t_timers = monotonic_ns();
         process_tasks(priority);
+        t_tasks = monotonic_ns();
+
+        ind_soc_profile_loop_record(t_scan - t_start, t_sockets - t_scan,
+                                    t_timers - t_sockets, t_tasks - t_timers);
+        ind_soc_recorder_loop(priority, (t_tasks - t_start) / 1000);
 
         if (ind_soc_run_status__ == IND_SOC_RUN_STATUS_EXIT) {
             return INDIGO_ERROR_NONE;
@@ -83,6 +83,11 @@ socketmanager_config_settings_t socketmanager_config_settings[] =
     { __socketmanager_config_STRINGIFY_NAME(SOCKETMANAGER_CONFIG_MAX_TIMERS), __socketmanager_config_STRINGIFY_VALUE(SOCKETMANAGER_CONFIG_MAX_TIMERS) },
 #else
 { SOCKETMANAGER_CONFIG_MAX_TIMERS(__socketmanager_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef SOCKETMANAGER_CONFIG_AGING_MS
+    { __socketmanager_config_STRINGIFY_NAME(SOCKETMANAGER_CONFIG_AGING_MS), __socketmanager_config_STRINGIFY_VALUE(SOCKETMANAGER_CONFIG_AGING_MS) },
+#else
+{ SOCKETMANAGER_CONFIG_AGING_MS(__socketmanager_config_STRINGIFY_NAME), "__undefined__" },
 #endif
     { NULL, NULL }
 };
@@ -145,11 +150,18 @@ ind_soc_cfg_commit(void)
     if ((lobj = aim_log_find("socketmanager")) == NULL) {
         AIM_LOG_WARN("Could not find log module");
     } else {
-        lobj->common_flags = staged_config.log_flags;
+        aim_log_common_flags_set(lobj, staged_config.log_flags);
     }
 }
 
+/* Reloads that change none of these skip this module */
+static const char * const ind_soc_cfg_keys[] = {
+    "logging.connection",
+    NULL
+};
+
 const struct ind_cfg_ops ind_soc_cfg_ops = {
     .stage = ind_soc_cfg_stage,
     .commit = ind_soc_cfg_commit,
+    .keys = ind_soc_cfg_keys,
 };
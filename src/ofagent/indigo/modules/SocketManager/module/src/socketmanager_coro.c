@@ -0,0 +1,93 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ * SocketManager coroutines
+ *
+ * A running coroutine is a task whose callback calls the coroutine
+ * function. A coroutine suspended in IND_SOC_CORO_AWAIT finishes its task
+ * and costs nothing until the last pending completion registers a new one.
+ *
+ *****************************************************************************/
+
+#include "socketmanager_log.h"
+#include "socketmanager_int.h"
+
+static ind_soc_task_status_t
+coro_task_callback(void *cookie)
+{
+    ind_soc_coro_t *coro = cookie;
+
+    switch (coro->fn(coro, coro->cookie)) {
+    case IND_SOC_CORO_CONTINUE:
+        return IND_SOC_TASK_CONTINUE;
+    case IND_SOC_CORO_SUSPENDED:
+        /* Registered again by ind_soc_coro_wake */
+        return IND_SOC_TASK_FINISHED;
+    default:
+        /* The coroutine may have been freed */
+        return IND_SOC_TASK_FINISHED;
+    }
+}
+
+indigo_error_t
+ind_soc_coro_start(ind_soc_coro_t *coro, ind_soc_coro_f fn, void *cookie,
+                   int priority)
+{
+    coro->fn = fn;
+    coro->cookie = cookie;
+    coro->priority = priority;
+    coro->resume = 0;
+    coro->pending = 0;
+    coro->suspended = 0;
+
+    return ind_soc_task_register(coro_task_callback, coro, priority);
+}
+
+int
+ind_soc_coro_suspend(ind_soc_coro_t *coro)
+{
+    if (coro->pending == 0) {
+        return 0;
+    }
+
+    coro->suspended = 1;
+    return 1;
+}
+
+void
+ind_soc_coro_wake(ind_soc_coro_t *coro)
+{
+    if (coro->pending <= 0) {
+        AIM_LOG_ERROR("Coroutine woken with no completion pending");
+        return;
+    }
+
+    if (--coro->pending > 0 || !coro->suspended) {
+        return;
+    }
+
+    coro->suspended = 0;
+    if (ind_soc_task_register(coro_task_callback, coro,
+                              coro->priority) != INDIGO_ERROR_NONE) {
+        /* Only fails for a bad budget, which is not used here */
+        AIM_LOG_ERROR("Failed to resume coroutine");
+    }
+}
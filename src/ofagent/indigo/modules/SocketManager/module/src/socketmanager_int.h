@@ -36,4 +36,48 @@
 
 extern const struct ind_cfg_ops ind_soc_cfg_ops;
 
+typedef enum ind_soc_profile_kind_e {
+    IND_SOC_PROFILE_SOCKET,
+    IND_SOC_PROFILE_TIMER,
+    IND_SOC_PROFILE_TASK,
+    IND_SOC_PROFILE_KIND_COUNT,
+} ind_soc_profile_kind_t;
+
+#define IND_SOC_HISTOGRAM_SUB_BUCKET_BITS 3
+#define IND_SOC_HISTOGRAM_SUB_BUCKETS (1 << IND_SOC_HISTOGRAM_SUB_BUCKET_BITS)
+
+/* Covers values up to 2^32 us */
+#define IND_SOC_HISTOGRAM_BUCKETS \
+    ((32 - IND_SOC_HISTOGRAM_SUB_BUCKET_BITS + 1) * IND_SOC_HISTOGRAM_SUB_BUCKETS)
+
+/* Time used by the callbacks of a socket, timer or task, for finding who
+   is using the event loop */
+typedef struct ind_soc_callback_stats_s {
+    uint64_t calls;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint32_t buckets[IND_SOC_HISTOGRAM_BUCKETS]; /* Latency histogram */
+} ind_soc_callback_stats_t;
+
+/* Record the run time of one callback */
+void ind_soc_callback_stats_record(ind_soc_callback_stats_t *stats,
+                                   uint64_t elapsed_us);
+
+/* Show the totals and percentiles, and the histogram if details is set */
+void ind_soc_callback_stats_show(aim_pvs_t *pvs,
+                                 const ind_soc_callback_stats_t *stats,
+                                 int details);
+
+/* Show or clear the stats of every socket, timer and task */
+void ind_soc_callbacks_show(aim_pvs_t *pvs, int details);
+void ind_soc_callbacks_reset(void);
+
+/* Record the event processing time of one loop iteration, per phase */
+void ind_soc_profile_loop_record(uint64_t scan_ns, uint64_t sockets_ns,
+                                 uint64_t timers_ns, uint64_t tasks_ns);
+
+/* Record the end of one loop iteration and dump the flight recorder if it
+   overran its budget */
+void ind_soc_recorder_loop(int priority, uint64_t elapsed_us);
+
 #endif /* __SOCKETMANAGER_INT_H__ */
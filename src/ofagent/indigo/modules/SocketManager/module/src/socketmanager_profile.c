@@ -0,0 +1,189 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ * SocketManager callback profiler
+ *
+ * The callback stats of each socket, timer and task carry a latency
+ * histogram next to the call count and total and maximum run time. The
+ * time the loop spends processing events between waits is recorded in a
+ * histogram of its own, and its phases (finding the ready priority, then
+ * running sockets, timers and tasks) are summed in nanoseconds so the
+ * per-iteration overhead of the loop itself is visible.
+ *
+ * The histograms are HDR style: values below 2^SUB_BUCKET_BITS microseconds
+ * get a bucket each, and each higher power of two is split into
+ * 2^SUB_BUCKET_BITS buckets, so the relative error is bounded at every
+ * magnitude.
+ *
+ *****************************************************************************/
+
+#include "socketmanager_log.h"
+#include "socketmanager_int.h"
+
+#include <AIM/aim.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define SUB_BUCKET_BITS IND_SOC_HISTOGRAM_SUB_BUCKET_BITS
+#define SUB_BUCKETS IND_SOC_HISTOGRAM_SUB_BUCKETS
+#define HISTOGRAM_BUCKETS IND_SOC_HISTOGRAM_BUCKETS
+
+/* Event processing time per loop iteration */
+static ind_soc_callback_stats_t profile_loop;
+
+/* Time per loop phase */
+static ind_soc_loop_stats_t profile_loop_stats;
+
+static int
+histogram_bucket(uint64_t value)
+{
+    int exp;
+
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    if (value > UINT32_MAX) {
+        value = UINT32_MAX;
+    }
+
+    exp = 63 - __builtin_clzll(value);
+    return (exp - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+        ((value >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* Largest value counted in a bucket */
+static uint64_t
+histogram_bucket_max(int bucket)
+{
+    int shift;
+
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+
+    shift = bucket / SUB_BUCKETS - 1;
+    return ((uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void
+ind_soc_callback_stats_record(ind_soc_callback_stats_t *stats, uint64_t value)
+{
+    stats->calls++;
+    stats->total_us += value;
+    if (value > stats->max_us) {
+        stats->max_us = value;
+    }
+    stats->buckets[histogram_bucket(value)]++;
+}
+
+/* Return the value below which the given fraction (per mille) of samples fall */
+static uint64_t
+histogram_percentile(const ind_soc_callback_stats_t *stats, int per_mille)
+{
+    uint64_t target, seen = 0;
+    int i;
+
+    if (stats->calls == 0) {
+        return 0;
+    }
+
+    target = (stats->calls * per_mille + 999) / 1000;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= target) {
+            uint64_t value = histogram_bucket_max(i);
+            return value < stats->max_us ? value : stats->max_us;
+        }
+    }
+
+    return stats->max_us;
+}
+
+void
+ind_soc_callback_stats_show(aim_pvs_t *pvs,
+                            const ind_soc_callback_stats_t *stats, int details)
+{
+    int i;
+
+    aim_printf(pvs, "calls %"PRIu64" total %"PRIu64" us avg %"PRIu64
+               " us p50 %"PRIu64" p99 %"PRIu64" p999 %"PRIu64" max %"PRIu64" us\n",
+               stats->calls, stats->total_us,
+               stats->calls ? stats->total_us / stats->calls : 0,
+               histogram_percentile(stats, 500),
+               histogram_percentile(stats, 990),
+               histogram_percentile(stats, 999),
+               stats->max_us);
+
+    if (details) {
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            if (stats->buckets[i] != 0) {
+                aim_printf(pvs, "      <= %"PRIu64" us: %u\n",
+                           histogram_bucket_max(i), stats->buckets[i]);
+            }
+        }
+    }
+}
+
+void
+ind_soc_profile_loop_record(uint64_t scan_ns, uint64_t sockets_ns,
+                            uint64_t timers_ns, uint64_t tasks_ns)
+{
+    profile_loop_stats.iterations++;
+    profile_loop_stats.scan_ns += scan_ns;
+    profile_loop_stats.sockets_ns += sockets_ns;
+    profile_loop_stats.timers_ns += timers_ns;
+    profile_loop_stats.tasks_ns += tasks_ns;
+
+    ind_soc_callback_stats_record(&profile_loop,
+                                  (scan_ns + sockets_ns + timers_ns + tasks_ns) / 1000);
+}
+
+void
+ind_soc_loop_stats_get(ind_soc_loop_stats_t *stats)
+{
+    *stats = profile_loop_stats;
+}
+
+void
+ind_soc_profile_show(aim_pvs_t *pvs, int details)
+{
+    const ind_soc_loop_stats_t *loop = &profile_loop_stats;
+    uint64_t n = loop->iterations ? loop->iterations : 1;
+
+    aim_printf(pvs, "Event loop processing per iteration:\n    ");
+    ind_soc_callback_stats_show(pvs, &profile_loop, details);
+    aim_printf(pvs, "    avg scan %"PRIu64" ns sockets %"PRIu64
+               " ns timers %"PRIu64" ns tasks %"PRIu64" ns\n",
+               loop->scan_ns / n, loop->sockets_ns / n,
+               loop->timers_ns / n, loop->tasks_ns / n);
+
+    if (details) {
+        ind_soc_callbacks_show(pvs, details);
+    }
+}
+
+void
+ind_soc_profile_reset(void)
+{
+    ind_soc_callbacks_reset();
+    memset(&profile_loop, 0, sizeof(profile_loop));
+    memset(&profile_loop_stats, 0, sizeof(profile_loop_stats));
+}
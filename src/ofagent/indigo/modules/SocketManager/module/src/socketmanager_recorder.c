@@ -0,0 +1,228 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ * SocketManager flight recorder
+ *
+ * The event loop records every callback it runs and the processing time of
+ * every iteration; the connection manager, state manager and forwarding
+ * driver add message receipt, handler and driver RPC events. The events go
+ * to an AIM trace ring, so recording costs one atomic increment and never
+ * blocks, from any thread.
+ *
+ * An iteration that takes longer than the budget freezes the ring by
+ * clearing ind_soc_recorder_ring, writes its events to the dump file and
+ * resumes recording. Dumps are at least RECORDER_DUMP_INTERVAL_MS apart so
+ * a sustained overload does not keep rewriting the file; the overruns in
+ * between are only counted.
+ *
+ *****************************************************************************/
+
+#include "socketmanager_log.h"
+#include "socketmanager_int.h"
+
+#include <AIM/aim.h>
+#include <AIM/aim_pvs_file.h>
+#include <indigo/time.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define RECORDER_DUMP_INTERVAL_MS 10000
+
+aim_trace_ring_t *ind_soc_recorder_ring;
+
+/* Set while enabled, also while frozen */
+static aim_trace_ring_t *recorder_ring;
+static uint64_t recorder_budget_us;
+static char recorder_filename[256];
+
+static uint64_t recorder_overruns;
+static uint64_t recorder_dumps;
+static uint64_t recorder_max_us;
+static indigo_time_t recorder_last_dump;
+
+static aim_map_si_t recorder_id_map[] = {
+    { "socket", IND_SOC_RECORD_SOCKET },
+    { "timer", IND_SOC_RECORD_TIMER },
+    { "task", IND_SOC_RECORD_TASK },
+    { "loop", IND_SOC_RECORD_LOOP },
+    { "msg_rx", IND_SOC_RECORD_MSG_RX },
+    { "handler_start", IND_SOC_RECORD_HANDLER_START },
+    { "handler_end", IND_SOC_RECORD_HANDLER_END },
+    { "rpc_start", IND_SOC_RECORD_RPC_START },
+    { "rpc_end", IND_SOC_RECORD_RPC_END },
+    { NULL, 0 }
+};
+
+indigo_error_t
+ind_soc_recorder_enable(uint32_t size, int budget_ms, const char *filename)
+{
+    if (recorder_ring != NULL) {
+        return INDIGO_ERROR_EXISTS;
+    }
+    if (size == 0 || budget_ms < 0 || filename == NULL ||
+            strlen(filename) >= sizeof(recorder_filename)) {
+        return INDIGO_ERROR_PARAM;
+    }
+
+    recorder_ring = aim_trace_ring_create("flight recorder", size,
+                                          recorder_id_map);
+    recorder_budget_us = (uint64_t)budget_ms * 1000;
+    strcpy(recorder_filename, filename);
+    ind_soc_recorder_ring = recorder_ring;
+
+    return INDIGO_ERROR_NONE;
+}
+
+void
+ind_soc_recorder_disable(void)
+{
+    ind_soc_recorder_ring = NULL;
+    aim_trace_ring_destroy(recorder_ring);
+    recorder_ring = NULL;
+}
+
+void
+ind_soc_recorder_dump(aim_pvs_t *pvs)
+{
+    aim_trace_record_t record;
+    uint64_t cursor = 0;
+    uint64_t first = 0;
+    const char *name;
+
+    if (recorder_ring == NULL) {
+        aim_printf(pvs, "Flight recorder disabled.\n");
+        return;
+    }
+
+    while (aim_trace_ring_read(recorder_ring, &cursor, &record)) {
+        if (first == 0) {
+            first = record.timestamp;
+        }
+        name = NULL;
+        aim_map_si_i(&name, record.id, recorder_id_map, 0);
+        aim_printf(pvs, "%12.3f ms %-13s ",
+                   (record.timestamp - first) / 1e6, name ? name : "?");
+
+        switch (record.id) {
+        case IND_SOC_RECORD_SOCKET:
+        case IND_SOC_RECORD_TIMER:
+        case IND_SOC_RECORD_TASK:
+            aim_printf(pvs, "callback %p ran %"PRIu64" us\n",
+                       (void *)(uintptr_t)record.arg1, record.arg2);
+            break;
+        case IND_SOC_RECORD_LOOP:
+            aim_printf(pvs, "priority %d took %"PRIu64" us\n",
+                       (int)record.arg0, record.arg2);
+            break;
+        case IND_SOC_RECORD_MSG_RX:
+            aim_printf(pvs, "cxn %u %s xid %"PRIu64"\n", record.arg0,
+                       (const char *)(uintptr_t)record.arg1, record.arg2);
+            break;
+        case IND_SOC_RECORD_HANDLER_START:
+            aim_printf(pvs, "cxn %u %s\n", record.arg0,
+                       (const char *)(uintptr_t)record.arg1);
+            break;
+        case IND_SOC_RECORD_HANDLER_END:
+            aim_printf(pvs, "cxn %u %s ran %"PRIu64" us\n", record.arg0,
+                       (const char *)(uintptr_t)record.arg1, record.arg2);
+            break;
+        case IND_SOC_RECORD_RPC_START:
+            aim_printf(pvs, "%s\n", (const char *)(uintptr_t)record.arg1);
+            break;
+        case IND_SOC_RECORD_RPC_END:
+            aim_printf(pvs, "%s returned %d\n",
+                       (const char *)(uintptr_t)record.arg1, (int)record.arg0);
+            break;
+        default:
+            aim_printf(pvs, "0x%x 0x%"PRIx64" 0x%"PRIx64"\n",
+                       record.arg0, record.arg1, record.arg2);
+            break;
+        }
+    }
+}
+
+static void
+recorder_overrun_dump(uint64_t elapsed_us)
+{
+    aim_pvs_t *pvs;
+
+    pvs = aim_pvs_fopen(recorder_filename, "w");
+    if (pvs == NULL) {
+        AIM_LOG_ERROR("Failed to open flight recorder dump %s",
+                      recorder_filename);
+        return;
+    }
+
+    /* Writers see the ring as disabled until the dump is complete */
+    ind_soc_recorder_ring = NULL;
+    aim_printf(pvs, "Loop iteration took %"PRIu64" us, budget %"PRIu64" us\n",
+               elapsed_us, recorder_budget_us);
+    ind_soc_recorder_dump(pvs);
+    ind_soc_recorder_ring = recorder_ring;
+
+    aim_pvs_destroy(pvs);
+    recorder_dumps++;
+
+    AIM_LOG_WARN("Loop iteration took %"PRIu64" us, flight recorder written to %s",
+                 elapsed_us, recorder_filename);
+}
+
+void
+ind_soc_recorder_loop(int priority, uint64_t elapsed_us)
+{
+    indigo_time_t now;
+
+    if (recorder_ring == NULL) {
+        return;
+    }
+
+    aim_trace_event(recorder_ring, IND_SOC_RECORD_LOOP, priority, 0,
+                    elapsed_us);
+
+    if (elapsed_us > recorder_max_us) {
+        recorder_max_us = elapsed_us;
+    }
+
+    if (recorder_budget_us == 0 || elapsed_us <= recorder_budget_us) {
+        return;
+    }
+
+    recorder_overruns++;
+    now = INDIGO_CURRENT_TIME;
+    if (recorder_dumps == 0 ||
+            INDIGO_TIME_DIFF_ms(recorder_last_dump, now) >= RECORDER_DUMP_INTERVAL_MS) {
+        recorder_last_dump = now;
+        recorder_overrun_dump(elapsed_us);
+    }
+}
+
+void
+ind_soc_recorder_show(aim_pvs_t *pvs)
+{
+    if (recorder_ring == NULL) {
+        return;
+    }
+
+    aim_printf(pvs, "Flight recorder: %u events, budget %"PRIu64" us, "
+               "longest iteration %"PRIu64" us, %"PRIu64" overruns, %"PRIu64" dumps to %s\n",
+               recorder_ring->size, recorder_budget_us, recorder_max_us,
+               recorder_overruns, recorder_dumps, recorder_filename);
+}
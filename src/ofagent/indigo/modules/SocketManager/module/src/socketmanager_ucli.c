@@ -33,6 +33,8 @@
 #include <uCli/ucli.h>
 #include <uCli/ucli_argparse.h>
 #include <uCli/ucli_handler_macros.h>
+#include <SocketManager/socketmanager.h>
+#include <string.h>
 
 
 
@@ -58,6 +60,35 @@ socketmanager_ucli_ucli__foo__(ucli_context_t* uc)
     return UCLI_STATUS_OK;
 }
 
+static ucli_status_t
+socketmanager_ucli_ucli__profile__(ucli_context_t* uc)
+{
+    char *str;
+    int details = 0;
+
+    UCLI_COMMAND_INFO(uc,
+                      "profile", -1,
+                      "$summary#Show or reset the callback profile."
+                      "$args#[detail|reset]");
+    if (uc->pargs->count == 1) {
+        UCLI_ARGPARSE_OR_RETURN(uc, "s", &str);
+        if (!strcmp(str, "reset")) {
+            ind_soc_profile_reset();
+            return UCLI_STATUS_OK;
+        } else if (!strncmp(str, "detail", 6)) { /* Allow detail or details */
+            details = 1;
+        } else {
+            return UCLI_STATUS_E_ARG;
+        }
+    } else if (uc->pargs->count > 1) {
+        return UCLI_STATUS_E_ARG;
+    }
+
+    ind_soc_profile_show(&uc->pvs, details);
+
+    return UCLI_STATUS_OK;
+}
+
 
 /* <auto.ucli.handlers.start> */
 /******************************************************************************
@@ -70,6 +101,7 @@ static ucli_command_handler_f socketmanager_ucli_ucli_handlers__[] =
 {
     socketmanager_ucli_ucli__config__,
     socketmanager_ucli_ucli__foo__,
+    socketmanager_ucli_ucli__profile__,
     NULL
 };
 /******************************************************************************/
@@ -30,6 +30,7 @@
 
 #include <SocketManager/socketmanager.h>
 #include <stdio.h>
+#include <string.h>
 #include <indigo/assert.h>
 #include <indigo/time.h>
 #include <unistd.h>
@@ -43,6 +44,9 @@
 
 #include "socketmanager_log.h"
 
+/* Defined in soc_bench.c */
+int soc_bench(int argc, char *argv[]);
+
 static int sigalrm_write_fd = -1;
 static int task_counter_limit = 1;
 
@@ -327,6 +331,28 @@ test_periodic_timer(void)
     ind_soc_select_and_run(1000);
     INDIGO_ASSERT(count == 1);
     INDIGO_ASSERT(ind_soc_timer_event_unregister(timer_callback_unregister, &count) < 0);
+
+    /* Timers with different periods fire independently */
+    {
+        int counts[3] = { 0, 0, 0 };
+        ind_soc_timer_event_register(timer_callback, &counts[0], 500);
+        ind_soc_timer_event_register(timer_callback, &counts[1], 100);
+        ind_soc_timer_event_register(timer_callback, &counts[2], 1500);
+        ind_soc_select_and_run(1000);
+        INDIGO_ASSERT(counts[0] >= 1 && counts[0] <= 2);
+        INDIGO_ASSERT(counts[1] >= 9 && counts[1] <= 11);
+        INDIGO_ASSERT(counts[2] == 0);
+
+        /* Unregistering one should not disturb the others */
+        INDIGO_ASSERT(ind_soc_timer_event_unregister(timer_callback, &counts[1]) == 0);
+        counts[0] = counts[1] = 0;
+        ind_soc_select_and_run(1100);
+        INDIGO_ASSERT(counts[0] >= 2 && counts[0] <= 3);
+        INDIGO_ASSERT(counts[1] == 0);
+        INDIGO_ASSERT(counts[2] == 1);
+        INDIGO_ASSERT(ind_soc_timer_event_unregister(timer_callback, &counts[0]) == 0);
+        INDIGO_ASSERT(ind_soc_timer_event_unregister(timer_callback, &counts[2]) == 0);
+    }
 }
 
 static void
@@ -491,6 +517,26 @@ test_task(void)
     INDIGO_ASSERT(i >= 10); /* (100 units * 1+ ms/unit) / 10 ms/timeslice >= 10 timeslices */
     INDIGO_ASSERT(100 / i >= 5); /* average at least 5 units per timeslice */
 
+    /* Task with a 30 ms budget should yield after 30 ms */
+    INDIGO_ASSERT(ind_soc_task_register_with_budget(
+        task_callback_yield, &counters[0], 0, 30) == INDIGO_ERROR_NONE);
+    memset(counters, 0, sizeof(counters));
+    i = 0;
+    while (counters[0] < 100) {
+        int tmp;
+        tmp = counters[0];
+        ind_soc_select_and_run(0);
+        tmp = counters[0] - tmp;
+        INDIGO_ASSERT(tmp <= 30);
+        i++;
+    }
+    INDIGO_ASSERT(i >= 4);
+    INDIGO_ASSERT(100 / i >= 15); /* average at least 15 units per timeslice */
+
+    /* Negative budgets are rejected */
+    INDIGO_ASSERT(ind_soc_task_register_with_budget(
+        task_callback_yield, &counters[0], 0, -1) == INDIGO_ERROR_PARAM);
+
     /* Excessively long callback should trigger a warning (not checked) */
     INDIGO_ASSERT(ind_soc_task_register(task_callback_long, &counters[0], 0) == INDIGO_ERROR_NONE);
     memset(counters, 0, sizeof(counters));
@@ -641,11 +687,190 @@ test_priority(void)
     }
 }
 
+static void
+test_aging(void)
+{
+    int read_fds[2], write_fds[2];
+    struct sock_counters counters[2];
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            perror("pipe");
+            abort();
+        }
+        read_fds[i] = fds[0];
+        write_fds[i] = fds[1];
+    }
+
+    INDIGO_ASSERT(ind_soc_socket_register_with_priority(
+        read_fds[0], socket_callback, &counters[0],
+        IND_SOC_PRIORITY_CONTROL) == 0);
+    INDIGO_ASSERT(ind_soc_socket_register_with_priority(
+        read_fds[1], socket_callback, &counters[1],
+        IND_SOC_PRIORITY_STATS) == 0);
+
+    /* Keep the high priority socket ready; the low one must still run */
+    memset(counters, 0, sizeof(counters));
+    write(write_fds[1], "x", 1);
+    for (i = 0; i < 10 * SOCKETMANAGER_CONFIG_AGING_MS; i++) {
+        write(write_fds[0], "x", 1);
+        ind_soc_select_and_run(0);
+        if (counters[1].read > 0) {
+            break;
+        }
+        usleep(1000);
+    }
+    INDIGO_ASSERT(counters[1].read == 1);
+    INDIGO_ASSERT(counters[0].read > 1);
+
+    INDIGO_ASSERT(ind_soc_socket_unregister(read_fds[0]) == 0);
+    INDIGO_ASSERT(ind_soc_socket_unregister(read_fds[1]) == 0);
+
+    for (i = 0; i < 2; i++) {
+        close(read_fds[i]);
+        close(write_fds[i]);
+    }
+}
+
+/*
+ * A coroutine that starts 'ops' operations, yielding between them, and
+ * waits for a timer to complete each one
+ */
+struct coro_state {
+    ind_soc_coro_t coro;
+    int ops;
+    int started;
+    int completed;
+    int step;                   /* Progress, checked by the test */
+};
+
+static void
+coro_op_timer(void *cookie)
+{
+    struct coro_state *state = cookie;
+
+    state->completed++;
+    ind_soc_coro_wake(&state->coro);
+}
+
+static ind_soc_coro_status_t
+coro_fn(ind_soc_coro_t *coro, void *cookie)
+{
+    struct coro_state *state = cookie;
+
+    IND_SOC_CORO_BEGIN(coro);
+
+    state->step = 1;
+    for (state->started = 0; state->started < state->ops; state->started++) {
+        ind_soc_coro_pending_add(coro, 1);
+        INDIGO_ASSERT(ind_soc_timer_event_register(
+            coro_op_timer, state, IND_SOC_TIMER_IMMEDIATE) == 0);
+        IND_SOC_CORO_YIELD(coro);
+    }
+
+    state->step = 2;
+    IND_SOC_CORO_AWAIT(coro);
+    INDIGO_ASSERT(state->completed == state->ops);
+
+    state->step = 3;
+    IND_SOC_CORO_END(coro);
+}
+
+static void
+test_coro(void)
+{
+    struct coro_state state;
+    int i;
+
+    /* Completions that come in before the await do not suspend it */
+    memset(&state, 0, sizeof(state));
+    state.ops = 3;
+    INDIGO_ASSERT(ind_soc_coro_start(&state.coro, coro_fn, &state, 0) == 0);
+    INDIGO_ASSERT(state.step == 0);
+    for (i = 0; i < 20 && state.step != 3; i++) {
+        ind_soc_select_and_run(0);
+    }
+    INDIGO_ASSERT(state.step == 3);
+    INDIGO_ASSERT(state.completed == 3);
+
+    /* Nothing pending: the await falls through */
+    memset(&state, 0, sizeof(state));
+    INDIGO_ASSERT(ind_soc_coro_start(&state.coro, coro_fn, &state, 0) == 0);
+    ind_soc_select_and_run(0);
+    INDIGO_ASSERT(state.step == 3);
+
+    /* A suspended coroutine waits for the last completion */
+    memset(&state, 0, sizeof(state));
+    state.ops = 1;
+    INDIGO_ASSERT(ind_soc_coro_start(&state.coro, coro_fn, &state, 0) == 0);
+    ind_soc_coro_pending_add(&state.coro, 1);
+    for (i = 0; i < 20 && state.completed < 1; i++) {
+        ind_soc_select_and_run(0);
+    }
+    ind_soc_select_and_run(0);
+    INDIGO_ASSERT(state.step == 2);
+    INDIGO_ASSERT(state.coro.suspended);
+    ind_soc_select_and_run(10);
+    INDIGO_ASSERT(state.step == 2);
+    ind_soc_coro_wake(&state.coro);
+    ind_soc_select_and_run(0);
+    INDIGO_ASSERT(state.step == 3);
+}
+
+static void
+timer_callback_stall(void *cookie)
+{
+    usleep(20 * 1000);
+    IND_SOC_RECORD(IND_SOC_RECORD_RPC_START, 0, (uintptr_t)"stall_rpc", 0);
+}
+
+static void
+test_recorder(void)
+{
+    const char *filename = "/tmp/socketmanager_utest_recorder.txt";
+    char buf[8192];
+    FILE *f;
+    int n;
+
+    unlink(filename);
+    INDIGO_ASSERT(ind_soc_recorder_enable(64, 10, filename) == 0);
+    INDIGO_ASSERT(ind_soc_recorder_enable(64, 10, filename) < 0);
+
+    /* Within budget: nothing is written */
+    ind_soc_select_and_run(50);
+    INDIGO_ASSERT(access(filename, F_OK) < 0);
+
+    /* An iteration over budget dumps the events leading up to it */
+    INDIGO_ASSERT(ind_soc_timer_event_register(
+        timer_callback_stall, NULL, IND_SOC_TIMER_IMMEDIATE) == 0);
+    ind_soc_select_and_run(0);
+    f = fopen(filename, "r");
+    INDIGO_ASSERT(f != NULL);
+    n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    INDIGO_ASSERT(strstr(buf, "Loop iteration took") == buf);
+    INDIGO_ASSERT(strstr(buf, "rpc_start") != NULL);
+    INDIGO_ASSERT(strstr(buf, "stall_rpc") != NULL);
+    INDIGO_ASSERT(strstr(buf, "timer") != NULL);
+
+    ind_soc_recorder_show(&aim_pvs_stdout);
+    ind_soc_recorder_disable();
+    unlink(filename);
+}
+
 int
 main(int argc, char* argv[])
 {
     ind_soc_config_t config = {0};
 
+    /* Not a test, see soc_bench.c */
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return soc_bench(argc - 1, argv + 1);
+    }
+
     printf("Init returned %d\n", ind_soc_init(&config));
 
     test_timer_mgmt();
@@ -654,6 +879,22 @@ main(int argc, char* argv[])
     test_socket();
     test_socket_mgmt();
     test_task();
+    test_coro();
+    test_priority();
+    test_aging();
+    test_recorder();
+
+    ind_soc_stats_show(&aim_pvs_stdout);
+    ind_soc_profile_show(&aim_pvs_stdout, 1);
+    ind_soc_profile_reset();
+
+    /* Repeat the socket tests with the epoll backend */
+    ind_soc_finish();
+    config.flags = IND_SOC_CONFIG_F_EPOLL;
+    printf("Init with epoll returned %d\n", ind_soc_init(&config));
+
+    test_socket();
+    test_socket_mgmt();
     test_priority();
 
     return 0;
@@ -0,0 +1,400 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Event loop microbenchmarks
+ *
+ * Not part of the unit test; run "utest_SocketManager bench [OPTIONS]
+ * [COUNT...]" or "make bench" in targets/utests/SocketManager.
+ *
+ * Each workload is run with each COUNT (default 1, 100 and 1000):
+ *
+ * sockets: COUNT eventfds are registered and one of them is kept
+ * readable, so every iteration of ind_soc_select_and_run runs exactly one
+ * callback while the loop has COUNT sockets to look through. Run with
+ * both the poll and epoll backends.
+ *
+ * timers: COUNT periodic timers share one period. The jitter of a timer
+ * is how far the time between two of its callbacks is from the period.
+ *
+ * tasks: COUNT tasks that never finish, so every iteration runs all of
+ * them.
+ *
+ * The per-iteration cost of each loop phase comes from
+ * ind_soc_loop_stats_get: "scan" is find_highest_ready_priority, the
+ * others are the time spent dispatching sockets, timers and tasks,
+ * callbacks included. The callbacks here do next to nothing, so what is
+ * measured is the event loop itself.
+ */
+
+#include <SocketManager/socketmanager_config.h>
+#include <SocketManager/socketmanager.h>
+#include <AIM/aim.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+/* Must stay below SOCKET_COUNT_MAX with room for stdio and the epoll fd */
+#define MAX_SOCKETS 1000
+
+#define DEFAULT_ITERATIONS 100000
+#define DEFAULT_TIMER_PERIOD_MS 10
+#define DEFAULT_TIMER_RUN_MS 2000
+
+static int iterations = DEFAULT_ITERATIONS;
+static int timer_period_ms = DEFAULT_TIMER_PERIOD_MS;
+static int timer_run_ms = DEFAULT_TIMER_RUN_MS;
+
+static uint64_t
+bench_now_ns(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static void
+bench_init(uint32_t flags)
+{
+    ind_soc_config_t config = { .flags = flags };
+
+    ind_soc_finish();
+    if (ind_soc_init(&config) < 0) {
+        fprintf(stderr, "ind_soc_init failed\n");
+        exit(1);
+    }
+    ind_soc_profile_reset();
+}
+
+static void
+bench_report_loop(const char *name, int count, uint64_t elapsed_ns)
+{
+    ind_soc_loop_stats_t stats;
+    uint64_t n;
+
+    ind_soc_loop_stats_get(&stats);
+    n = stats.iterations ? stats.iterations : 1;
+
+    printf("%-14s %6d %10"PRIu64" %9"PRIu64" %9"PRIu64" %9"PRIu64
+           " %9"PRIu64" %9"PRIu64"\n",
+           name, count, stats.iterations,
+           stats.scan_ns / n, stats.sockets_ns / n,
+           stats.timers_ns / n, stats.tasks_ns / n,
+           elapsed_ns / n);
+}
+
+static void
+bench_loop_header(void)
+{
+    printf("%-14s %6s %10s %9s %9s %9s %9s %9s\n",
+           "workload", "count", "iterations",
+           "scan ns", "socket ns", "timer ns", "task ns", "total ns");
+}
+
+/* Sockets */
+
+static uint64_t socket_callbacks;
+
+static void
+bench_socket_ready(int socket_id, void *cookie,
+                   int read_ready, int write_ready, int error_seen)
+{
+    /* Leave the counter set so the eventfd stays readable */
+    socket_callbacks++;
+}
+
+static void
+bench_sockets(const char *name, uint32_t flags, int count)
+{
+    int fds[MAX_SOCKETS];
+    uint64_t one = 1, start;
+    int i;
+
+    bench_init(flags);
+
+    for (i = 0; i < count; i++) {
+        fds[i] = eventfd(0, EFD_NONBLOCK);
+        if (fds[i] < 0) {
+            perror("eventfd");
+            exit(1);
+        }
+        if (ind_soc_socket_register(fds[i], bench_socket_ready, NULL) < 0) {
+            fprintf(stderr, "failed to register socket %d\n", fds[i]);
+            exit(1);
+        }
+    }
+
+    /* The last one registered is the last one polled */
+    if (write(fds[count - 1], &one, sizeof(one)) != sizeof(one)) {
+        perror("write");
+        exit(1);
+    }
+
+    socket_callbacks = 0;
+    ind_soc_profile_reset();
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++) {
+        ind_soc_select_and_run(0);
+    }
+    bench_report_loop(name, count, bench_now_ns() - start);
+
+    if (socket_callbacks != (uint64_t)iterations) {
+        fprintf(stderr, "expected %d socket callbacks, got %"PRIu64"\n",
+                iterations, socket_callbacks);
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++) {
+        ind_soc_socket_unregister(fds[i]);
+        close(fds[i]);
+    }
+}
+
+/* Timers */
+
+struct bench_timer {
+    uint64_t last_ns;
+};
+
+static uint64_t *jitter_samples;
+static int jitter_count;
+static int jitter_max_count;
+
+static void
+bench_timer_fired(void *cookie)
+{
+    struct bench_timer *timer = cookie;
+    uint64_t now = bench_now_ns();
+
+    if (timer->last_ns != 0 && jitter_count < jitter_max_count) {
+        int64_t diff = (int64_t)(now - timer->last_ns) -
+            (int64_t)timer_period_ms * 1000000;
+        jitter_samples[jitter_count++] = diff < 0 ? -diff : diff;
+    }
+    timer->last_ns = now;
+}
+
+static int
+uint64_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void
+bench_timers(int count)
+{
+    struct bench_timer *timers;
+    uint64_t total = 0, start;
+    int i;
+
+    if (count > SOCKETMANAGER_CONFIG_MAX_TIMERS) {
+        printf("%-14s %6d skipped, SOCKETMANAGER_CONFIG_MAX_TIMERS is %d\n",
+               "timers", count, SOCKETMANAGER_CONFIG_MAX_TIMERS);
+        return;
+    }
+
+    bench_init(0);
+
+    timers = calloc(count, sizeof(*timers));
+    jitter_max_count = count * (timer_run_ms / timer_period_ms + 1);
+    jitter_samples = calloc(jitter_max_count, sizeof(*jitter_samples));
+    jitter_count = 0;
+    if (timers == NULL || jitter_samples == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (ind_soc_timer_event_register(bench_timer_fired, &timers[i],
+                                         timer_period_ms) < 0) {
+            fprintf(stderr, "failed to register timer %d\n", i);
+            exit(1);
+        }
+    }
+
+    start = bench_now_ns();
+    ind_soc_select_and_run(timer_run_ms);
+    bench_report_loop("timers", count, bench_now_ns() - start);
+
+    for (i = 0; i < count; i++) {
+        ind_soc_timer_event_unregister(bench_timer_fired, &timers[i]);
+    }
+
+    if (jitter_count > 0) {
+        qsort(jitter_samples, jitter_count, sizeof(*jitter_samples),
+              uint64_compare);
+        for (i = 0; i < jitter_count; i++) {
+            total += jitter_samples[i];
+        }
+        printf("%-14s %6d %10d jitter avg %"PRIu64" us p99 %"PRIu64
+               " us max %"PRIu64" us\n",
+               "", count, jitter_count,
+               total / jitter_count / 1000,
+               jitter_samples[(uint64_t)jitter_count * 99 / 100] / 1000,
+               jitter_samples[jitter_count - 1] / 1000);
+    }
+
+    free(jitter_samples);
+    jitter_samples = NULL;
+    free(timers);
+}
+
+/* Tasks */
+
+static uint64_t task_callbacks;
+static int tasks_stop;
+
+static ind_soc_task_status_t
+bench_task(void *cookie)
+{
+    task_callbacks++;
+    return tasks_stop ? IND_SOC_TASK_FINISHED : IND_SOC_TASK_CONTINUE;
+}
+
+static void
+bench_tasks(int count)
+{
+    uint64_t start;
+    int i;
+
+    bench_init(0);
+
+    tasks_stop = 0;
+    for (i = 0; i < count; i++) {
+        if (ind_soc_task_register(bench_task, NULL,
+                                  IND_SOC_DEFAULT_PRIORITY) < 0) {
+            fprintf(stderr, "failed to register task %d\n", i);
+            exit(1);
+        }
+    }
+
+    task_callbacks = 0;
+    start = bench_now_ns();
+    for (i = 0; i < iterations; i++) {
+        ind_soc_select_and_run(0);
+    }
+    bench_report_loop("tasks", count, bench_now_ns() - start);
+    printf("%-14s %6d %10"PRIu64" task callbacks\n",
+           "", count, task_callbacks);
+
+    /* Let every task finish so none leak into the next run */
+    tasks_stop = 1;
+    ind_soc_select_and_run(0);
+}
+
+static void
+bench_raise_fd_limit(void)
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: bench [-n iterations] [-t timer period ms] "
+            "[-r timer run ms] [COUNT...]\n");
+}
+
+/*
+ * argv[0] is the "bench" that selected this, as getopt expects a
+ * program name there
+ */
+int
+soc_bench(int argc, char *argv[])
+{
+    static const int default_counts[] = { 1, 100, 1000 };
+    int counts[16];
+    int num_counts = 0;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "n:t:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 't':
+            timer_period_ms = atoi(optarg);
+            break;
+        case 'r':
+            timer_run_ms = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (iterations <= 0 || timer_period_ms <= 0 || timer_run_ms <= 0) {
+        usage();
+        return 1;
+    }
+
+    for (i = optind; i < argc && num_counts < (int)AIM_ARRAYSIZE(counts); i++) {
+        int count = atoi(argv[i]);
+        if (count <= 0 || count > MAX_SOCKETS) {
+            fprintf(stderr, "count must be between 1 and %d\n", MAX_SOCKETS);
+            return 1;
+        }
+        counts[num_counts++] = count;
+    }
+
+    if (num_counts == 0) {
+        for (i = 0; i < (int)AIM_ARRAYSIZE(default_counts); i++) {
+            counts[num_counts++] = default_counts[i];
+        }
+    }
+
+    bench_raise_fd_limit();
+
+    printf("%d iterations, timers every %d ms for %d ms\n\n",
+           iterations, timer_period_ms, timer_run_ms);
+    bench_loop_header();
+
+    for (i = 0; i < num_counts; i++) {
+        bench_sockets("sockets/poll", 0, counts[i]);
+    }
+    for (i = 0; i < num_counts; i++) {
+        bench_sockets("sockets/epoll", IND_SOC_CONFIG_F_EPOLL, counts[i]);
+    }
+    for (i = 0; i < num_counts; i++) {
+        bench_timers(counts[i]);
+    }
+    for (i = 0; i < num_counts; i++) {
+        bench_tasks(counts[i]);
+    }
+
+    ind_soc_finish();
+
+    return 0;
+}
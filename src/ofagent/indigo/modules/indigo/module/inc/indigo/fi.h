@@ -58,6 +58,14 @@ typedef enum indigo_fi_flow_removed_e {
  * Not all implementations will support duration_ns.  It must be 0 if not used.
  * It is provided for implementations that do timing events such as flow
  * expirations in the forwarding module.
+ *
+ * counters_age_ns is how long before the call the counters were read, for
+ * implementations that serve them from a cache. It is 0 if they were read
+ * by the call. duration_ns is then the duration when the counters were
+ * read, not at the call. Flow stats replies report that duration, so the
+ * duration and counters of an entry always belong together, and a
+ * controller can tell how old the counters are from the time it added
+ * the flow.
  */
 
 typedef struct indigo_fi_flow_stats {
@@ -65,6 +73,7 @@ typedef struct indigo_fi_flow_stats {
     uint64_t duration_ns;     /**< Time in ns flow exists or existed */
     uint64_t packets;         /**< Number of packets in flow  */
     uint64_t bytes;           /**< Number of bytes in flow  */
+    uint64_t counters_age_ns; /**< Time in ns since the counters were read */
 } indigo_fi_flow_stats_t;
 
 /**
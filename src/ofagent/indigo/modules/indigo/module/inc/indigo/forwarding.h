@@ -36,6 +36,7 @@
 #include <indigo/types.h>
 #include <loci/loci.h>
 #include <indigo/fi.h>
+#include <AIM/aim_bitmap.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +72,63 @@ extern indigo_error_t indigo_fwd_flow_create(
     of_flow_add_t *flow_add,
     uint8_t *table_id);
 
+/**
+ * @brief Flow create, batched
+ * @param count Number of flows in the batch
+ * @param flow_ids Flow IDs, one per flow_add
+ * @param flow_adds The original LOCI requests
+ * @param [out] table_ids Table each flow was inserted into
+ * @param [out] results Per-flow result
+ *
+ * Create a set of flows in one call to the forwarding engine. A
+ * failure of one entry does not affect the others; the result for
+ * each flow is returned in the corresponding element of results.
+ * The return value is not INDIGO_ERROR_NONE only if the batch as a
+ * whole could not be processed.
+ *
+ * Ownership of the flow_add LOXI objects is maintained by the
+ * caller (OF state manager).
+ */
+
+extern indigo_error_t indigo_fwd_flow_create_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    of_flow_add_t **flow_adds,
+    uint8_t *table_ids,
+    indigo_error_t *results);
+
+/**
+ * @brief Check a table has room for another flow
+ * @param table_id Table the flow would be added to
+ *
+ * Called before each flow add. Return INDIGO_ERROR_TABLE_FULL when the
+ * table is known to be full, and the add is refused without calling
+ * indigo_fwd_flow_create. This must not query the hardware; answer
+ * from counts the forwarding engine already keeps, and return
+ * INDIGO_ERROR_NONE when in doubt, including for tables where a flow
+ * does not take exactly one hardware entry.
+ */
+
+extern indigo_error_t indigo_fwd_flow_space_check(
+    uint8_t table_id);
+
+/**
+ * @brief Take back a flow installed before a warm restart
+ * @param flow_id The flow ID the flow was created with
+ * @param flow_add The flow as it was originally added
+ * @param [out] table_id Table the flow is installed in
+ *
+ * Called by the state manager for each flow it restores. The flow is
+ * not reprogrammed; the forwarding engine checks it still has the flow
+ * and rebuilds any state it keeps about it. Returns
+ * INDIGO_ERROR_NOT_FOUND if the flow is no longer installed.
+ */
+
+extern indigo_error_t indigo_fwd_flow_restore(
+    indigo_cookie_t flow_id,
+    of_flow_add_t *flow_add,
+    uint8_t *table_id);
+
 /**
  * @brief Modify an existing flow.
  * @param flow_id Flow identifier
@@ -88,6 +146,29 @@ extern indigo_error_t indigo_fwd_flow_modify(
     indigo_cookie_t flow_id,
     of_flow_modify_t *flow_modify);
 
+/**
+ * @brief Modify existing flows, batched
+ * @param count Number of flows in the batch
+ * @param flow_ids Flow identifiers
+ * @param flow_modify The original LOCI message, the same for every flow
+ * @param [out] results Per-flow result
+ *
+ * Apply one non-strict flow modify to a set of the flows it matched in
+ * one call to the forwarding engine, so the request need only be
+ * translated once per table. A failure of one entry does not affect the
+ * others. The return value is not INDIGO_ERROR_NONE only if the batch as
+ * a whole could not be processed.
+ *
+ * Ownership of the flow_modify LOXI object is maintained by the
+ * caller (OF state manager).
+ */
+
+extern indigo_error_t indigo_fwd_flow_modify_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    of_flow_modify_t *flow_modify,
+    indigo_error_t *results);
+
 /**
  * @brief Flow delete
  * @param flow_id Flow identifier
@@ -100,6 +181,26 @@ extern indigo_error_t indigo_fwd_flow_delete(
     indigo_cookie_t flow_id,
     indigo_fi_flow_stats_t *flow_stats);
 
+/**
+ * @brief Flow delete, batched
+ * @param count Number of flows in the batch
+ * @param flow_ids Flow identifiers
+ * @param [out] flow_stats Statistics for each flow
+ * @param [out] results Per-flow result
+ *
+ * Delete a set of flows in one call to the forwarding engine, as when
+ * a non-strict flow delete flushes the entries of a VLAN or a port. A
+ * failure of one entry does not affect the others. The return value
+ * is not INDIGO_ERROR_NONE only if the batch as a whole could not be
+ * processed.
+ */
+
+extern indigo_error_t indigo_fwd_flow_delete_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    indigo_fi_flow_stats_t *flow_stats,
+    indigo_error_t *results);
+
 /**
  * @brief Flow stats
  * @param flow_id The ID of the flow whose stats are to be retrieved
@@ -125,6 +226,24 @@ extern indigo_error_t indigo_fwd_flow_hit_status_get(
     indigo_cookie_t flow_id,
     bool *hit_status);
 
+/**
+ * @brief Flow hit status, batched
+ * @param count Number of flows
+ * @param flow_ids The IDs of the flows whose hit status is to be retrieved
+ * @param [out] hit_status True if entry hit since last time API was called
+ * @param [out] results Per-flow result
+ *
+ * Get the hit status of a set of existing flows in one call. The
+ * return value is not INDIGO_ERROR_NONE only if the batch as a whole
+ * could not be processed.
+ */
+
+extern indigo_error_t indigo_fwd_flow_hit_status_get_batch(
+    int count,
+    indigo_cookie_t *flow_ids,
+    bool *hit_status,
+    indigo_error_t *results);
+
 /**
  * @brief Table stats
  * @param table_stats_request The LOXI request
@@ -139,6 +258,24 @@ extern indigo_error_t indigo_fwd_table_stats_get(
     of_table_stats_request_t *table_stats_request,
     of_table_stats_reply_t **table_stats_reply);
 
+/**
+ * @brief Table features
+ * @param table_features_request The LOXI request
+ * @param [out] table_features_reply The LOXI reply
+ * @return Return code from operation
+ *
+ * Only requests without a table list are passed to the forwarding
+ * module; reconfiguring the pipeline is refused by the OF state manager.
+ * INDIGO_ERROR_NOT_SUPPORTED makes the request unhandled.
+ *
+ * Ownership of the table_features_request LOXI object is maintained by
+ * the caller (OF state manager).
+ */
+
+extern indigo_error_t indigo_fwd_table_features_get(
+    of_table_features_stats_request_t *table_features_request,
+    of_table_features_stats_reply_t **table_features_reply);
+
 /**
  * @brief VLAN stats
  * @param vlan_vid The ID of the VLAN whose stats are to be retrieved
@@ -154,17 +291,55 @@ void indigo_fwd_vlan_stats_get(
     uint16_t vlan_vid,
     indigo_fi_vlan_stats_t *vlan_stats);
 
+/**
+ * @brief Active VLANs
+ * @param [out] vlans Bitmap of at least 4096 bits, cleared by the caller
+ *
+ * Set the bit of every VLAN that has counters, so that a request for
+ * all VLANs only asks indigo_fwd_vlan_stats_get for those.
+ *
+ * INDIGO_ERROR_NOT_SUPPORTED makes the caller ask for every VLAN.
+ */
+
+extern indigo_error_t indigo_fwd_vlan_active_get(
+    aim_bitmap_hdr_t *vlans);
+
 /**
  * @brief Packet out operation
  * @param packet_out The LOXI packet out message
  *
  * Ownership of the packet_out LOXI object is maintained by the
  * caller (OF state manager).
+ *
+ * INDIGO_ERROR_PENDING means the packet was accepted and its result
+ * will be reported with indigo_core_packet_out_complete. Any other
+ * error is sent to the controller.
  */
 
 extern indigo_error_t indigo_fwd_packet_out(
     of_packet_out_t *packet_out);
 
+/**
+ * @brief Send a batch of packet outs
+ * @param count Number of packet outs
+ * @param packet_outs The LOXI packet out messages, in the order received
+ * @param [out] results Per-packet result
+ *
+ * Send a set of packet outs in one call to the forwarding engine. A
+ * failure of one packet does not affect the others. The return value
+ * is not INDIGO_ERROR_NONE only if the batch as a whole could not be
+ * processed. Results are interpreted as for indigo_fwd_packet_out.
+ *
+ * The packet data is in the connection's read buffer and is only
+ * valid for the duration of the call. Ownership of the packet_out
+ * LOXI objects is maintained by the caller (OF state manager).
+ */
+
+extern indigo_error_t indigo_fwd_packet_out_batch(
+    int count,
+    of_packet_out_t **packet_outs,
+    indigo_error_t *results);
+
 /**
  * @brief Experimenter (vendor) extension
  * @param experimenter The message from the controller
@@ -203,6 +378,15 @@ extern indigo_error_t indigo_fwd_expiration_enable_get(int *is_enabled);
  */
 indigo_error_t indigo_fwd_group_add(uint32_t id, uint8_t group_type, of_list_bucket_t *buckets);
 
+/**
+ * @brief Check there is room for another group
+ * @param id Group ID of the group to be added
+ *
+ * As indigo_fwd_flow_space_check, for group adds. The ID is passed
+ * because the group table may be split by a type encoded in it.
+ */
+indigo_error_t indigo_fwd_group_space_check(uint32_t id);
+
 /**
  * @brief Modify an existing group
  * @param id Group ID
@@ -210,6 +394,19 @@ indigo_error_t indigo_fwd_group_add(uint32_t id, uint8_t group_type, of_list_buc
  */
 indigo_error_t indigo_fwd_group_modify(uint32_t id, of_list_bucket_t *buckets);
 
+/**
+ * @brief Take back a group installed before a warm restart
+ * @param id Group ID
+ * @param group_type OpenFlow group type
+ * @param buckets LOCI bucket list the group was last programmed with
+ *
+ * As indigo_fwd_flow_restore, for groups. The forwarding engine checks
+ * it still has the group, reprograms it if it no longer matches the
+ * buckets, and rebuilds any state it keeps about it. Returns
+ * INDIGO_ERROR_NOT_FOUND if the group is no longer installed.
+ */
+indigo_error_t indigo_fwd_group_restore(uint32_t id, uint8_t group_type, of_list_bucket_t *buckets);
+
 /**
  * @brief Delete an existing group
  * @param id Group ID
@@ -229,6 +426,27 @@ void indigo_fwd_group_delete(uint32_t id);
  */
 void indigo_fwd_group_stats_get(uint32_t id, of_group_stats_entry_t *entry);
 
+/**
+ * @brief Statistics for one group, filled in by indigo_fwd_group_stats_bulk_get
+ */
+typedef struct indigo_fwd_group_stats_s {
+    uint32_t id;
+    uint32_t ref_count;
+    uint32_t duration_sec;
+} indigo_fwd_group_stats_t;
+
+/**
+ * @brief Retrieve stats for all groups in one pass
+ * @param stats Array to be filled in, in ascending group ID order
+ * @param max Number of entries in stats
+ * @param count Set to the number of entries filled in
+ *
+ * Forwarding may return INDIGO_ERROR_NOT_SUPPORTED, in which case
+ * indigo_fwd_group_stats_get is called for each group instead.
+ */
+indigo_error_t indigo_fwd_group_stats_bulk_get(indigo_fwd_group_stats_t *stats,
+                                               uint32_t max, uint32_t *count);
+
 #ifdef OFDPA_FIXUP
 /**
  * Meter management
@@ -256,11 +474,30 @@ indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_ba
  */
 indigo_error_t indigo_fwd_meter_modify(uint32_t id, uint16_t flag, of_list_meter_band_t *meters);
 
+/**
+ * @brief Take back a meter installed before a warm restart
+ * @param id Meter ID
+ * @param flag OpenFlow meter flag
+ * @param meters LOCI meter_band list the meter was last programmed with
+ *
+ * As indigo_fwd_group_restore, for meters.
+ */
+indigo_error_t indigo_fwd_meter_restore(uint32_t id, uint16_t flag, of_list_meter_band_t *meters);
+
 /**
  * @brief Delete an existing meter
  * @param id Meter ID
  */
 indigo_error_t indigo_fwd_meter_delete(uint32_t id);
+
+/**
+ * @brief Get meter statistics
+ * @param id Meter ID, or OF_METER_ALL
+ * @param entries LOCI meter_stats list to append to
+ *
+ * An unknown meter ID appends nothing.
+ */
+indigo_error_t indigo_fwd_meter_stats_get(uint32_t id, of_list_meter_stats_t *entries);
 #endif
 
 /**
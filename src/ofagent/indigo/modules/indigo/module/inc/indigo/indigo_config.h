@@ -40,6 +40,47 @@
 
 
 /* <auto.start.cdefs(INDIGO_CONFIG_HEADER).header> */
+#include <AIM/aim.h>
+/**
+ * INDIGO_CONFIG_OF13_ONLY
+ *
+ * Build for agents that only negotiate OpenFlow 1.3. The fixed-field encoders in indigo/of_fast.h then write the OF 1.3 layout without checking the object version. */
+
+
+#ifndef INDIGO_CONFIG_OF13_ONLY
+#define INDIGO_CONFIG_OF13_ONLY 0
+#endif
+
+
+
+/**
+ * All compile time options can be queried or displayed
+ */
+
+/** Configuration settings structure. */
+typedef struct indigo_config_settings_s {
+    /** name */
+    const char* name;
+    /** value */
+    const char* value;
+} indigo_config_settings_t;
+
+/** Configuration settings table. */
+/** indigo_config_settings table. */
+extern indigo_config_settings_t indigo_config_settings[];
+
+/**
+ * @brief Lookup a configuration setting.
+ * @param setting The name of the configuration option to lookup.
+ */
+const char* indigo_config_lookup(const char* setting);
+
+/**
+ * @brief Show the compile-time configuration.
+ * @param pvs The output stream.
+ */
+int indigo_config_show(struct aim_pvs_s* pvs);
+
 /* <auto.end.cdefs(INDIGO_CONFIG_HEADER).header> */
 
 
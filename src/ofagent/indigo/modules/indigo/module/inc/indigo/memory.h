@@ -43,4 +43,121 @@
 
 #endif /* INDIGO_MEM_STDLIB */
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Memory accounting tags
+ *
+ * Modules report the bytes they hold for their main data structures
+ * under one of these tags. Each entry is MEM_TAG(name, description).
+ */
+
+#define INDIGO_MEM_TAGS \
+    MEM_TAG(FLOW_ENTRY, "flow table entries") \
+    MEM_TAG(FLOW_EFFECTS, "flow actions and instructions") \
+    MEM_TAG(CXN_QUEUE, "connection output queues") \
+    MEM_TAG(GENTABLE, "gentable entries") \
+    MEM_TAG(GROUP, "groups and buckets") \
+    MEM_TAG(PACKET, "packet buffers")
+
+typedef enum indigo_mem_tag_e {
+#define MEM_TAG(name, description) INDIGO_MEM_TAG_##name,
+    INDIGO_MEM_TAGS
+#undef MEM_TAG
+    INDIGO_MEM_TAG_COUNT
+} indigo_mem_tag_t;
+
+/**
+ * Accounting state of a tag
+ */
+
+typedef struct indigo_mem_stats_s {
+    uint64_t live_bytes;   /**< Bytes currently held */
+    uint64_t peak_bytes;   /**< High watermark of live_bytes */
+    uint64_t allocs;       /**< Allocations reported */
+    uint64_t frees;        /**< Frees reported */
+    uint64_t soft_limit;   /**< Live bytes above which users degrade, 0 if none */
+    uint64_t limit_hits;   /**< Times a user degraded because of the limit */
+} indigo_mem_stats_t;
+
+/**
+ * @brief Name of a tag, for example "FLOW_ENTRY"
+ */
+
+const char *indigo_mem_tag_name(indigo_mem_tag_t tag);
+
+/**
+ * @brief Description of a tag
+ */
+
+const char *indigo_mem_tag_desc(indigo_mem_tag_t tag);
+
+/**
+ * @brief Report memory taken by a tag
+ * @param tag The tag
+ * @param bytes Number of bytes allocated
+ */
+
+void indigo_mem_account_alloc(indigo_mem_tag_t tag, size_t bytes);
+
+/**
+ * @brief Report memory given back by a tag
+ * @param tag The tag
+ * @param bytes Number of bytes freed, as reported when allocated
+ */
+
+void indigo_mem_account_free(indigo_mem_tag_t tag, size_t bytes);
+
+/**
+ * @brief aim_malloc and account the allocation
+ */
+
+void *indigo_mem_alloc(indigo_mem_tag_t tag, size_t bytes);
+
+/**
+ * @brief aim_zmalloc and account the allocation
+ */
+
+void *indigo_mem_zalloc(indigo_mem_tag_t tag, size_t bytes);
+
+/**
+ * @brief aim_free memory from indigo_mem_alloc or indigo_mem_zalloc
+ * @param tag The tag the memory was allocated with
+ * @param ptr The memory, may be NULL
+ * @param bytes The size it was allocated with
+ */
+
+void indigo_mem_free(indigo_mem_tag_t tag, void *ptr, size_t bytes);
+
+/**
+ * @brief Set the soft limit of a tag
+ * @param tag The tag
+ * @param bytes Limit on live bytes, 0 for no limit
+ *
+ * Nothing is refused by the accounting itself. Users of a tag check
+ * indigo_mem_soft_limit_exceeded before growing and degrade instead.
+ */
+
+void indigo_mem_soft_limit_set(indigo_mem_tag_t tag, uint64_t bytes);
+
+/**
+ * @brief Check a tag against its soft limit
+ * @returns 1 if the tag holds more than its limit, counting a limit hit
+ */
+
+int indigo_mem_soft_limit_exceeded(indigo_mem_tag_t tag);
+
+/**
+ * @brief Get the accounting state of a tag
+ */
+
+void indigo_mem_stats_get(indigo_mem_tag_t tag, indigo_mem_stats_t *stats);
+
+/**
+ * @brief Restart the high watermark of every tag at its live bytes
+ */
+
+void indigo_mem_peak_reset(void);
+
 #endif /* _INDIGO_MEMORY_H_ */
@@ -76,11 +76,14 @@
  *
  * INDIGO_CXN_PROTO_INVALID A marker used to indicate an undefined protocol
  * INDIGO_CXN_PROTO_TCP_OVER_IPV4 Use TCP over IPv4 for the connection
+ * INDIGO_CXN_PROTO_TLS_OVER_IPV4 Use TLS over TCP over IPv4; takes the
+ * same parameters as TCP over IPv4
  */
 
 typedef enum indigo_cxn_protocol_e {
     INDIGO_CXN_PROTO_INVALID            = -1,
-    INDIGO_CXN_PROTO_TCP_OVER_IPV4      = 0
+    INDIGO_CXN_PROTO_TCP_OVER_IPV4      = 0,
+    INDIGO_CXN_PROTO_TLS_OVER_IPV4      = 1
 } indigo_cxn_protocol_t;
 
 /**
@@ -131,6 +134,14 @@ typedef union indigo_cxn_protocol_params_u {
  * set to 0 to disable.
  * @param reset_echo_count For non-local connections, if this number of
  * consecutive echo replies is not received, the connection is closed.
+ * @param auxiliary_count For remote connections, the number of OpenFlow 1.3
+ * auxiliary connections opened to the same controller address once the
+ * handshake completes; see below.
+ * @param socket Socket options applied whenever a socket is created or
+ * accepted for the connection; see indigo_cxn_socket_params_t.
+ * @param packet_in_batch_max For remote connections whose controller
+ * understands them, the most packet-ins sent in one BSN packet-in batch
+ * message; 0 sends each packet-in on its own. See below.
  *
  * For listen connections, the parameters of the original connection
  * instance are copied to the new connections.
@@ -153,8 +164,52 @@ typedef union indigo_cxn_protocol_params_u {
  * Remote connections are usually active connect (non-listen) controller
  * connections that require a handshake to continue processing.  Echo
  * requests may be done on these connections as a keepalive.
+ *
+ * Auxiliary connections carry the packet-ins of their main connection so
+ * punted traffic does not queue behind flow programming replies. They
+ * take the role of the main connection, report their auxiliary_id in the
+ * features reply and are closed when the main connection closes. The
+ * controller may send packet-outs on them.
+ *
+ * Packet-in batching trades a little latency for fewer messages and
+ * socket writes during punt bursts. The packet-ins for the connection,
+ * after throttling, are collected into an experimenter message with the
+ * BSN experimenter ID and subtype INDIGO_CXN_BSN_PACKET_IN_BATCH_SUBTYPE
+ * whose data is the packet-in messages back to back, each with its own
+ * header. A batch is sent once it holds packet_in_batch_max packet-ins
+ * or OFCONNECTIONMANAGER_CONFIG_PACKET_IN_BATCH_BYTES, before any other
+ * message to the connection, and at the latest once the event loop has
+ * handled the events pending when its first packet-in was queued.
  */
 
+#define INDIGO_CXN_BSN_PACKET_IN_BATCH_SUBTYPE 0x8001
+
+/**
+ * Socket options for a connection
+ * @param nodelay TCP_NODELAY; 0 keeps the default (set), negative clears it
+ * @param quickack If positive, TCP_QUICKACK is set again after every read
+ * since the kernel clears it as soon as it leaves quick ack mode
+ * @param sndbuf SO_SNDBUF in bytes; 0 keeps the system default
+ * @param rcvbuf SO_RCVBUF in bytes; 0 keeps the system default
+ * @param busy_poll_us SO_BUSY_POLL in microseconds; 0 keeps the default
+ * @param priority SO_PRIORITY; 0 keeps the default
+ *
+ * The kernel doubles the buffer sizes for its own bookkeeping and caps
+ * them at net.core.wmem_max and rmem_max unless the process has
+ * CAP_NET_ADMIN. A busy poll time above net.core.busy_read and a
+ * priority above 6 also need CAP_NET_ADMIN. Options that cannot be set
+ * are logged and the connection proceeds with the system values.
+ */
+
+typedef struct indigo_cxn_socket_params_s {
+    int nodelay;
+    int quickack;
+    int sndbuf;
+    int rcvbuf;
+    int busy_poll_us;
+    int priority;
+} indigo_cxn_socket_params_t;
+
 typedef struct indigo_cxn_config_params_s {
     of_version_t version;
     int cxn_priority;
@@ -162,6 +217,9 @@ typedef struct indigo_cxn_config_params_s {
     int listen;
     uint32_t periodic_echo_ms;
     uint32_t reset_echo_count;
+    uint8_t auxiliary_count;
+    indigo_cxn_socket_params_t socket;
+    uint16_t packet_in_batch_max;
 } indigo_cxn_config_params_t;
 
 /****************************************************************
@@ -212,6 +270,12 @@ typedef enum indigo_cxn_role_e {
  *    bytes_out Number of bytes written in since last connect
  *    messages_in Number of messages received since last connect
  *    messages_out Number of messages sent to controller since last connect
+ *    packet_in_drop Packet-ins dropped for this connection
+ *    flow_removed_drop Flow removed messages dropped for this connection
+ *    packet_in_sampled Packet-ins sent while the connection was congested
+ *    congestion_count Number of times the output queue passed the high
+ *        watermark
+ *    auxiliary_id Auxiliary connection id; 0 for a main connection
  */
 
 typedef struct indigo_cxn_status_s {
@@ -227,6 +291,9 @@ typedef struct indigo_cxn_status_s {
     uint64_t messages_out;
     uint64_t packet_in_drop;
     uint64_t flow_removed_drop;
+    uint64_t packet_in_sampled;
+    uint64_t congestion_count;
+    uint8_t auxiliary_id;
 } indigo_cxn_status_t;
 
 /****************************************************************
@@ -350,6 +417,33 @@ extern void indigo_cxn_send_controller_message(
 
 extern void indigo_cxn_send_async_message(of_object_t *obj);
 
+/**
+ * Send an async OpenFlow message the caller keeps
+ *
+ * @param obj The LOCI object representing the message
+ *
+ * As indigo_cxn_send_async_message, but the message is copied and the
+ * caller keeps responsibility for obj, which may use preallocated storage.
+ */
+
+extern void indigo_cxn_send_async_message_copy(of_object_t *obj);
+
+/**
+ * Check whether a controller connection's output queue is congested
+ *
+ * @param cxn_id The id of the connection
+ *
+ * A connection becomes congested when its queued output passes
+ * OFCONNECTIONMANAGER_CONFIG_OUTPUT_HIGH_WATERMARK and stays congested
+ * until the queue drains to OFCONNECTIONMANAGER_CONFIG_OUTPUT_LOW_WATERMARK.
+ * Long multipart replies should pause while this returns true rather than
+ * keep queueing.
+ *
+ * Returns 0 for an invalid or disconnected connection.
+ */
+
+extern int indigo_cxn_send_congested(indigo_cxn_id_t cxn_id);
+
 /**
  * Send an error message to a controller connection
  *
@@ -404,5 +498,16 @@ void indigo_cxn_list_destroy(indigo_cxn_info_t* list);
 extern indigo_error_t
 indigo_cxn_get_async_version(of_version_t* of_version);
 
+/**
+ * @brief Get OpenFlow version for an async message of the given type.
+ * @param object_id Type of the async message
+ * @param [out] of_version OpenFlow version
+ * Fails if no connection would accept the message, so the caller can
+ * skip building it.
+ */
+extern indigo_error_t
+indigo_cxn_get_async_version_for(of_object_id_t object_id,
+                                 of_version_t* of_version);
+
 #endif /* _INDIGO_OF_CONNECTION_MANAGER_H_ */
 /* @} */
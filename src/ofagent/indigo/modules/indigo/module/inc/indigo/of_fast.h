@@ -0,0 +1,148 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Fast encoders for the fixed fields of hot message types
+ *
+ * The generated LOCI accessors switch on the object version for every
+ * field to find its offset. These set all fixed fields of an object in
+ * one call with the OF 1.3 offsets written out, so the version is checked
+ * once, or not at all with INDIGO_CONFIG_OF13_ONLY. Objects of other
+ * versions go through the generated accessors.
+ */
+
+#ifndef _INDIGO_OF_FAST_H_
+#define _INDIGO_OF_FAST_H_
+
+#include <indigo/indigo_config.h>
+#include <indigo/assert.h>
+#include <loci/loci.h>
+
+#if INDIGO_CONFIG_OF13_ONLY
+#define INDIGO_OF_FAST_IS_1_3(obj) 1
+#else
+#define INDIGO_OF_FAST_IS_1_3(obj) ((obj)->version == OF_VERSION_1_3)
+#endif
+
+/**
+ * Set the fixed fields of a flow stats entry
+ *
+ * The match and instructions are set separately.
+ */
+
+static inline void
+indigo_of_flow_stats_entry_fixed_set(
+    of_flow_stats_entry_t *obj,
+    uint8_t table_id,
+    uint32_t duration_sec,
+    uint32_t duration_nsec,
+    uint16_t priority,
+    uint16_t idle_timeout,
+    uint16_t hard_timeout,
+    uint16_t flags,
+    uint64_t cookie,
+    uint64_t packet_count,
+    uint64_t byte_count)
+{
+    of_wire_buffer_t *wbuf;
+    int base;
+
+    INDIGO_ASSERT(obj->object_id == OF_FLOW_STATS_ENTRY);
+    INDIGO_ASSERT(!INDIGO_CONFIG_OF13_ONLY || obj->version == OF_VERSION_1_3);
+
+    if (!INDIGO_OF_FAST_IS_1_3(obj)) {
+        of_flow_stats_entry_table_id_set(obj, table_id);
+        of_flow_stats_entry_duration_sec_set(obj, duration_sec);
+        of_flow_stats_entry_duration_nsec_set(obj, duration_nsec);
+        of_flow_stats_entry_priority_set(obj, priority);
+        of_flow_stats_entry_idle_timeout_set(obj, idle_timeout);
+        of_flow_stats_entry_hard_timeout_set(obj, hard_timeout);
+        if (obj->version >= OF_VERSION_1_3) {
+            of_flow_stats_entry_flags_set(obj, flags);
+        }
+        of_flow_stats_entry_cookie_set(obj, cookie);
+        of_flow_stats_entry_packet_count_set(obj, packet_count);
+        of_flow_stats_entry_byte_count_set(obj, byte_count);
+        return;
+    }
+
+    wbuf = OF_OBJECT_TO_WBUF(obj);
+    INDIGO_ASSERT(wbuf != NULL);
+    base = OF_OBJECT_ABSOLUTE_OFFSET(obj, 0);
+
+    of_wire_buffer_u8_set(wbuf, base + 2, table_id);
+    of_wire_buffer_u32_set(wbuf, base + 4, duration_sec);
+    of_wire_buffer_u32_set(wbuf, base + 8, duration_nsec);
+    of_wire_buffer_u16_set(wbuf, base + 12, priority);
+    of_wire_buffer_u16_set(wbuf, base + 14, idle_timeout);
+    of_wire_buffer_u16_set(wbuf, base + 16, hard_timeout);
+    of_wire_buffer_u16_set(wbuf, base + 18, flags);
+    of_wire_buffer_u64_set(wbuf, base + 24, cookie);
+    of_wire_buffer_u64_set(wbuf, base + 32, packet_count);
+    of_wire_buffer_u64_set(wbuf, base + 40, byte_count);
+}
+
+/**
+ * Set the fixed fields of a packet-in
+ *
+ * The match and data are set separately. The table id and cookie are
+ * not present before OF 1.1 and OF 1.3 respectively.
+ */
+
+static inline void
+indigo_of_packet_in_fixed_set(
+    of_packet_in_t *obj,
+    uint32_t buffer_id,
+    uint16_t total_len,
+    uint8_t reason,
+    uint8_t table_id,
+    uint64_t cookie)
+{
+    of_wire_buffer_t *wbuf;
+    int base;
+
+    INDIGO_ASSERT(obj->object_id == OF_PACKET_IN);
+    INDIGO_ASSERT(!INDIGO_CONFIG_OF13_ONLY || obj->version == OF_VERSION_1_3);
+
+    if (!INDIGO_OF_FAST_IS_1_3(obj)) {
+        of_packet_in_buffer_id_set(obj, buffer_id);
+        of_packet_in_total_len_set(obj, total_len);
+        of_packet_in_reason_set(obj, reason);
+        if (obj->version >= OF_VERSION_1_1) {
+            of_packet_in_table_id_set(obj, table_id);
+        }
+        if (obj->version >= OF_VERSION_1_3) {
+            of_packet_in_cookie_set(obj, cookie);
+        }
+        return;
+    }
+
+    wbuf = OF_OBJECT_TO_WBUF(obj);
+    INDIGO_ASSERT(wbuf != NULL);
+    base = OF_OBJECT_ABSOLUTE_OFFSET(obj, 0);
+
+    of_wire_buffer_u32_set(wbuf, base + 8, buffer_id);
+    of_wire_buffer_u16_set(wbuf, base + 12, total_len);
+    of_wire_buffer_u8_set(wbuf, base + 14, reason);
+    of_wire_buffer_u8_set(wbuf, base + 15, table_id);
+    of_wire_buffer_u64_set(wbuf, base + 16, cookie);
+}
+
+#endif /* _INDIGO_OF_FAST_H_ */
@@ -0,0 +1,84 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief OpenFlow message construction helpers
+ */
+
+#ifndef _INDIGO_OF_MESSAGE_H_
+#define _INDIGO_OF_MESSAGE_H_
+
+#include <loci/loci.h>
+
+/**
+ * Allocate an experimenter message carrying opaque data
+ *
+ * @param version OpenFlow version of the message
+ * @param experimenter Experimenter id
+ * @param subtype Experimenter subtype
+ * @param data Message body after the experimenter header
+ * @returns The message, or NULL if it could not be allocated
+ *
+ * The generic LOCI experimenter class leaves the version and type of
+ * the OpenFlow header unset; they are filled in here.
+ */
+of_experimenter_t *indigo_of_experimenter_new(of_version_t version,
+                                              uint32_t experimenter,
+                                              uint32_t subtype,
+                                              of_octets_t *data);
+
+/**
+ * Parse a message that was already validated, without allocating memory
+ *
+ * @param storage Pointer to an uninitialized of_object_storage_t
+ * @param buf Pointer to the message
+ * @param len Length of buf
+ * @returns Pointer to an initialized of_object_t, or NULL if the header
+ * does not describe the message
+ *
+ * Only the header is checked. This is for re-parsing a message that
+ * of_object_new_from_message_preallocated accepted earlier, or a
+ * truncated copy of one when only its header is used. The LOCI
+ * accessors do not bounds check a message that was never validated.
+ */
+of_object_t *indigo_of_object_new_from_validated_message(
+    of_object_storage_t *storage, uint8_t *buf, int len);
+
+/**
+ * Initialize a message in caller-provided storage
+ *
+ * @param storage Pointer to an uninitialized of_object_storage_t
+ * @param object_id Message class
+ * @param version OpenFlow version of the message
+ * @param buf Buffer the message is encoded into
+ * @param bytes Size of buf
+ * @returns Pointer to an initialized of_object_t, or NULL if the class
+ * does not exist in the version or its fixed part does not fit in buf
+ *
+ * The message is set up as the generated of_*_new constructor would, but
+ * without allocating memory. Appends fail once buf is full. The object
+ * must not be passed to of_object_delete or to a function that takes
+ * ownership of it.
+ */
+of_object_t *indigo_of_message_new_preallocated(
+    of_object_storage_t *storage, of_object_id_t object_id,
+    of_version_t version, uint8_t *buf, int bytes);
+
+#endif /* _INDIGO_OF_MESSAGE_H_ */
@@ -50,6 +50,8 @@
  * DISABLED:    Clear flowtable
  * LOCKDOWN:    Clear flowtable, disable ports
  * LOCAL:       Enable local controller
+ * RECONCILE:   Keep flowtable, stop processing expires; on reconnect keep
+ *              what the controller adds again unchanged and delete the rest
  */
 
 typedef enum indigo_core_disconnected_e {
@@ -58,7 +60,8 @@ typedef enum indigo_core_disconnected_e {
     INDIGO_CORE_DISCONNECTED_MODE_DISABLED   = 2,
     INDIGO_CORE_DISCONNECTED_MODE_LOCKDOWN   = 3,
     INDIGO_CORE_DISCONNECTED_MODE_LOCAL      = 4,
-    IND_CORE_DISCONNECTED_MODE_COUNT         = 5   /* Last entry */
+    INDIGO_CORE_DISCONNECTED_MODE_RECONCILE  = 5,
+    IND_CORE_DISCONNECTED_MODE_COUNT         = 6   /* Last entry */
 } indigo_core_disconnected_mode_t;
 
 /****************************************************************
@@ -74,6 +77,17 @@ typedef enum indigo_core_disconnected_e {
 
 extern indigo_error_t indigo_core_packet_in(of_packet_in_t *packet_in);
 
+/**
+ * Handle a packet in the forwarding module keeps
+ * @param packet_in Pointer to the packet in object
+ *
+ * As indigo_core_packet_in, but the message is copied where it is queued
+ * and the caller keeps responsibility for the object. This lets the
+ * forwarding module encode packet-ins in preallocated storage.
+ */
+
+extern indigo_error_t indigo_core_packet_in_copy(of_packet_in_t *packet_in);
+
 
 /****************************************************************
  * Controller message handling by the state manager
@@ -94,6 +108,35 @@ extern void indigo_core_receive_controller_message(
     indigo_cxn_id_t cxn,
     of_object_t *obj);
 
+/**
+ * Finish processing the messages passed in so far
+ *
+ * Provided by state manager, required by connection manager
+ *
+ * Batched packet-outs reference the message passed to
+ * indigo_core_receive_controller_message instead of copying it. The
+ * connection manager calls this before it reuses or frees the buffer
+ * it passed messages from.
+ */
+
+extern void indigo_core_receive_controller_flush(void);
+
+/**
+ * Report the result of packet-outs accepted with INDIGO_ERROR_PENDING
+ * @param count Number of pending packet-outs completed
+ * @param result Their result
+ *
+ * Provided by state manager, required by forwarding
+ *
+ * Completes the oldest pending packet-outs first. A failure is answered
+ * with an error message on the connection the packet-out came from.
+ * Must be called from the event loop thread.
+ */
+
+extern void indigo_core_packet_out_complete(
+    uint32_t count,
+    indigo_error_t result);
+
 
 /****************************************************************
  * Configuration Interface functions provided by the state manager
@@ -155,6 +198,38 @@ extern void indigo_core_flow_removed(
     indigo_fi_flow_removed_t reason,
     indigo_fi_flow_stats_t *stats);
 
+/**
+ * @brief Notify state manager that a set of flows has been removed
+ * @param count Number of flows removed
+ * @param reasons The reason each flow was removed
+ * @param stats Stats structures identifying the flows
+ *
+ * Same as indigo_core_flow_removed for each flow, for forwarding modules
+ * that age flows themselves and read a burst of expiries at once. The
+ * flow removed messages are all queued before any is written out.
+ */
+
+extern void indigo_core_flow_removed_batch(
+    int count,
+    indigo_fi_flow_removed_t *reasons,
+    indigo_fi_flow_stats_t *stats);
+
+/**
+ * @brief Get the match of a flow-mod
+ * @param obj A flow_add, flow_modify or flow_delete object
+ * @param match Storage used if the match has to be decoded
+ * @return The match, or NULL if it could not be parsed
+ *
+ * The state manager decodes the match of each flow-mod it handles once.
+ * Objects it passes to indigo_fwd_flow_create and indigo_fwd_flow_modify
+ * carry the result, which is returned without decoding the OXM list
+ * again. The returned match must not be modified or kept past the call.
+ */
+
+extern const of_match_t *indigo_core_flow_mod_match_get(
+    of_object_t *obj,
+    of_match_t *match);
+
 /****************************************************************
  * Asynchronous connection manager notification, disconnection mode
  ****************************************************************/
@@ -222,6 +297,30 @@ indigo_core_stats_get(uint32_t *total_flows,
  */
 typedef struct indigo_core_gentable indigo_core_gentable_t;
 
+/**
+ * @brief Kinds of operation in a gentable batch
+ */
+typedef enum indigo_core_gentable_op_type {
+    INDIGO_CORE_GENTABLE_OP_ADD,
+    INDIGO_CORE_GENTABLE_OP_MODIFY,
+    INDIGO_CORE_GENTABLE_OP_DELETE,
+} indigo_core_gentable_op_type_t;
+
+/**
+ * @brief One operation in a gentable batch
+ *
+ * The arguments are those of the matching add, modify or del operation.
+ * entry_priv is an output for an add and an input otherwise; value is
+ * NULL for a delete.
+ */
+typedef struct indigo_core_gentable_op {
+    indigo_core_gentable_op_type_t type;
+    of_list_bsn_tlv_t *key;
+    of_list_bsn_tlv_t *value;
+    void *entry_priv;
+    indigo_error_t result;
+} indigo_core_gentable_op_t;
+
 /**
  * @brief Operations on a gentable
  */
@@ -261,6 +360,18 @@ typedef struct indigo_core_gentable_ops {
      * @param stats Stats list to be filled in
      */
     void (*get_stats)(void *table_priv, void *entry_priv, of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *stats);
+
+    /**
+     * @brief Apply several operations (optional)
+     * @param table_priv Table private data
+     * @param ops Operations, to be applied in order
+     * @param count Number of operations
+     *
+     * Used for the gentable messages committed in a bundle. Each op's
+     * result must be set. Each key appears at most once per call. If
+     * NULL, add, modify and del are called for each operation instead.
+     */
+    void (*batch)(void *table_priv, indigo_core_gentable_op_t *ops, int count);
 } indigo_core_gentable_ops_t;
 
 /*
@@ -295,6 +406,42 @@ void
 indigo_core_gentable_unregister(indigo_core_gentable_t *gentable);
 
 
+/**
+ * Debug counters
+ *
+ * Named counters reported to the controller by bsn_debug_counter_desc and
+ * bsn_debug_counter stats requests, for drops and other events that have
+ * no place in the standard statistics.
+ */
+
+typedef struct indigo_core_debug_counter_s indigo_core_debug_counter_t;
+
+/*
+ * @brief Register a debug counter
+ * @param name Counter name, truncated to 63 characters.
+ * @param description Counter description, truncated to 255 characters.
+ * @param value The counter. Read on each stats request, so it must stay
+ *              valid until the counter is unregistered.
+ * @param [out] counter Handle to be passed to
+ *                      indigo_core_debug_counter_unregister.
+ */
+
+indigo_error_t
+indigo_core_debug_counter_register(
+    const char *name,
+    const char *description,
+    const uint64_t *value,
+    indigo_core_debug_counter_t **counter);
+
+/*
+ * @brief Unregister a debug counter
+ * @param counter
+ */
+
+void
+indigo_core_debug_counter_unregister(indigo_core_debug_counter_t *counter);
+
+
 /**
  * Listener interfaces
  *
@@ -319,6 +466,34 @@ typedef indigo_core_listener_result_t (*indigo_core_packet_in_listener_f)(of_pac
 indigo_error_t indigo_core_packet_in_listener_register(indigo_core_packet_in_listener_f fn);
 void indigo_core_packet_in_listener_unregister(indigo_core_packet_in_listener_f fn);
 
+/**
+ * Packet-in listener filter
+ *
+ * A listener registered with a filter is only called for the packet-ins
+ * that match every part of the filter in use: the ethertype (after any
+ * VLAN tags) is one of eth_types, the ingress port is one of in_ports,
+ * and the reason and table ID are equal. An OpenFlow 1.0 packet-in has no
+ * table ID and never matches one. Zero the filter and set only the parts
+ * that matter. The filter is copied.
+ */
+#define INDIGO_CORE_PACKET_IN_FILTER_ETH_TYPES 4
+#define INDIGO_CORE_PACKET_IN_FILTER_IN_PORTS 8
+
+typedef struct indigo_core_packet_in_filter_s {
+    int eth_type_count;         /* 0 for any ethertype */
+    uint16_t eth_types[INDIGO_CORE_PACKET_IN_FILTER_ETH_TYPES];
+    int in_port_count;          /* 0 for any port */
+    of_port_no_t in_ports[INDIGO_CORE_PACKET_IN_FILTER_IN_PORTS];
+    bool match_reason;
+    uint8_t reason;
+    bool match_table_id;
+    uint8_t table_id;
+} indigo_core_packet_in_filter_t;
+
+indigo_error_t indigo_core_packet_in_listener_filtered_register(
+    indigo_core_packet_in_listener_f fn,
+    const indigo_core_packet_in_filter_t *filter);
+
 /**
  * Port status listener registration
  */
@@ -333,6 +508,18 @@ typedef indigo_core_listener_result_t (*indigo_core_message_listener_f)(indigo_c
 indigo_error_t indigo_core_message_listener_register(indigo_core_message_listener_f fn);
 void indigo_core_message_listener_unregister(indigo_core_message_listener_f fn);
 
+/**
+ * Message listener registration for some message types only
+ *
+ * The listener is only called for messages whose object ID is set in
+ * 'types', a bitmap of OF_MESSAGE_OBJECT_COUNT bits. The bitmap is
+ * copied. Messages of types no listener subscribes to skip the listeners
+ * with a single bit test. Unregister with
+ * indigo_core_message_listener_unregister.
+ */
+indigo_error_t indigo_core_message_listener_subscribe(
+    indigo_core_message_listener_f fn, aim_bitmap_hdr_t *types);
+
 
 /****************************************************************
  *
@@ -407,6 +594,59 @@ typedef struct indigo_core_table_ops_s {
      * @param [out] hit_status True if entry hit since last time API was called
      */
     indigo_error_t (*entry_hit_status_get)(void *table_priv, void *entry_priv, bool *hit_status);
+
+    /**
+     * Retrieve and reset hit status for a set of entries
+     * @param table_priv Private data passed to indigo_core_table_register
+     * @param count Number of entries
+     * @param entry_privs Private data returned by the entry_create operation
+     * @param [out] hit_status True if entry hit since last time API was called
+     * @param [out] results Per-entry result
+     *
+     * Optional. If NULL, entry_hit_status_get is called for each entry.
+     */
+    indigo_error_t (*entry_hit_status_get_batch)(void *table_priv, int count, void **entry_privs, bool *hit_status, indigo_error_t *results);
+
+    /**
+     * Add a set of entries to the table
+     * @param table_priv Private data passed to indigo_core_table_register
+     * @param count Number of entries
+     * @param objs Flow-add messages
+     * @param flow_ids Flow IDs (only for use with indigo_core_flow_removed)
+     * @param [out] entry_privs Private data for each flow
+     * @param [out] results Per-entry result
+     *
+     * Optional. If NULL, entry_create is called for each entry. Flow adds
+     * for the table are collected like those for indigo_fwd_flow_create_batch.
+     * The return value is not INDIGO_ERROR_NONE only if the batch as a
+     * whole failed, in which case no entry was added.
+     */
+    indigo_error_t (*entry_create_batch)(void *table_priv, int count, of_flow_add_t **objs, indigo_cookie_t *flow_ids, void **entry_privs, indigo_error_t *results);
+
+    /**
+     * Delete a set of entries from the table
+     * @param table_priv Private data passed to indigo_core_table_register
+     * @param count Number of entries
+     * @param entry_privs Private data returned by the entry_create operation
+     * @param [out] flow_stats Final stats of each entry
+     * @param [out] results Per-entry result
+     *
+     * Optional. If NULL, entry_delete is called for each entry. As with
+     * entry_delete, the entries are gone whatever the result.
+     */
+    indigo_error_t (*entry_delete_batch)(void *table_priv, int count, void **entry_privs, indigo_fi_flow_stats_t *flow_stats, indigo_error_t *results);
+
+    /**
+     * Retrieve stats for a set of entries
+     * @param table_priv Private data passed to indigo_core_table_register
+     * @param count Number of entries
+     * @param entry_privs Private data returned by the entry_create operation
+     * @param [out] flow_stats Current stats of each entry
+     * @param [out] results Per-entry result
+     *
+     * Optional. If NULL, entry_stats_get is called for each entry.
+     */
+    indigo_error_t (*entry_stats_get_batch)(void *table_priv, int count, void **entry_privs, indigo_fi_flow_stats_t *flow_stats, indigo_error_t *results);
 } indigo_core_table_ops_t;
 
 /**
@@ -93,6 +93,31 @@ indigo_current_time(void) {
 }
 #endif
 
+/**
+ * Get the event loop's cached timestamp
+ *
+ * The SocketManager loop reads the clock once per iteration, after poll
+ * returns, so this is the time the iteration's events began to be
+ * handled. Use it for the timestamps taken while handling events, such
+ * as flow insert times. Use INDIGO_CURRENT_TIME to measure durations and
+ * yield deadlines, and outside the event loop thread.
+ */
+#define INDIGO_LOOP_TIME indigo_loop_time_get()
+
+/* Updated by indigo_loop_time_refresh; 0 until the loop first runs */
+extern indigo_time_t indigo_loop_time;
+
+static inline indigo_time_t
+indigo_loop_time_get(void) {
+    return indigo_loop_time != 0 ? indigo_loop_time : indigo_current_time();
+}
+
+static inline indigo_time_t
+indigo_loop_time_refresh(void) {
+    indigo_loop_time = indigo_current_time();
+    return indigo_loop_time;
+}
+
 /* Printing time to a string */
 #define INDIGO_TIME_FORMAT "%b %d %T"
 #define INDIGO_TIME_BYTES 32
@@ -145,6 +170,7 @@ indigo_time_str(indigo_time_t itime, char *buf, int len) {
 #if defined(INDIGO_STUB_TIME)
 typedef uint64_t indigo_time_t;
 #define INDIGO_CURRENT_TIME (0)
+#define INDIGO_LOOP_TIME (0)
 #define INDIGO_TIME_DIFF_ms(_a,_b) (0)
 #endif
 
@@ -31,6 +31,42 @@
 #include <string.h>
 
 /* <auto.start.cdefs(INDIGO_CONFIG_HEADER).source> */
+#define __indigo_config_STRINGIFY_NAME(_x) #_x
+#define __indigo_config_STRINGIFY_VALUE(_x) __indigo_config_STRINGIFY_NAME(_x)
+indigo_config_settings_t indigo_config_settings[] =
+{
+#ifdef INDIGO_CONFIG_OF13_ONLY
+    { __indigo_config_STRINGIFY_NAME(INDIGO_CONFIG_OF13_ONLY), __indigo_config_STRINGIFY_VALUE(INDIGO_CONFIG_OF13_ONLY) },
+#else
+{ INDIGO_CONFIG_OF13_ONLY(__indigo_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+    { NULL, NULL }
+};
+#undef __indigo_config_STRINGIFY_VALUE
+#undef __indigo_config_STRINGIFY_NAME
+
+const char*
+indigo_config_lookup(const char* setting)
+{
+    int i;
+    for(i = 0; indigo_config_settings[i].name; i++) {
+        if(strcmp(indigo_config_settings[i].name, setting)) {
+            return indigo_config_settings[i].value;
+        }
+    }
+    return NULL;
+}
+
+int
+indigo_config_show(struct aim_pvs_s* pvs)
+{
+    int i;
+    for(i = 0; indigo_config_settings[i].name; i++) {
+        aim_printf(pvs, "%s = %s\n", indigo_config_settings[i].name, indigo_config_settings[i].value);
+    }
+    return i;
+}
+
 /* <auto.end.cdefs(INDIGO_CONFIG_HEADER).source> */
 
 void
@@ -0,0 +1,144 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ *  /module/src/memory.c
+ *
+ *  Per-tag memory accounting
+ *
+ *  Only counters are kept: callers report the sizes they allocate and
+ *  free, so tagged memory costs nothing extra per allocation.
+ *
+ *****************************************************************************/
+#include <AIM/aim.h>
+#include <indigo/indigo_config.h>
+#include <indigo/indigo.h>
+
+static indigo_mem_stats_t mem_stats[INDIGO_MEM_TAG_COUNT];
+
+static const char *mem_tag_names[INDIGO_MEM_TAG_COUNT] = {
+#define MEM_TAG(name, description) [INDIGO_MEM_TAG_##name] = #name,
+    INDIGO_MEM_TAGS
+#undef MEM_TAG
+};
+
+static const char *mem_tag_descs[INDIGO_MEM_TAG_COUNT] = {
+#define MEM_TAG(name, description) [INDIGO_MEM_TAG_##name] = description,
+    INDIGO_MEM_TAGS
+#undef MEM_TAG
+};
+
+const char *
+indigo_mem_tag_name(indigo_mem_tag_t tag)
+{
+    if (tag >= INDIGO_MEM_TAG_COUNT) {
+        return "UNKNOWN";
+    }
+    return mem_tag_names[tag];
+}
+
+const char *
+indigo_mem_tag_desc(indigo_mem_tag_t tag)
+{
+    if (tag >= INDIGO_MEM_TAG_COUNT) {
+        return "unknown";
+    }
+    return mem_tag_descs[tag];
+}
+
+void
+indigo_mem_account_alloc(indigo_mem_tag_t tag, size_t bytes)
+{
+    indigo_mem_stats_t *stats = &mem_stats[tag];
+
+    stats->live_bytes += bytes;
+    stats->allocs++;
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
+    }
+}
+
+void
+indigo_mem_account_free(indigo_mem_tag_t tag, size_t bytes)
+{
+    indigo_mem_stats_t *stats = &mem_stats[tag];
+
+    AIM_ASSERT(stats->live_bytes >= bytes);
+    stats->live_bytes -= bytes;
+    stats->frees++;
+}
+
+void *
+indigo_mem_alloc(indigo_mem_tag_t tag, size_t bytes)
+{
+    indigo_mem_account_alloc(tag, bytes);
+    return aim_malloc(bytes);
+}
+
+void *
+indigo_mem_zalloc(indigo_mem_tag_t tag, size_t bytes)
+{
+    indigo_mem_account_alloc(tag, bytes);
+    return aim_zmalloc(bytes);
+}
+
+void
+indigo_mem_free(indigo_mem_tag_t tag, void *ptr, size_t bytes)
+{
+    if (ptr != NULL) {
+        indigo_mem_account_free(tag, bytes);
+        aim_free(ptr);
+    }
+}
+
+void
+indigo_mem_soft_limit_set(indigo_mem_tag_t tag, uint64_t bytes)
+{
+    mem_stats[tag].soft_limit = bytes;
+}
+
+int
+indigo_mem_soft_limit_exceeded(indigo_mem_tag_t tag)
+{
+    indigo_mem_stats_t *stats = &mem_stats[tag];
+
+    if (stats->soft_limit == 0 || stats->live_bytes <= stats->soft_limit) {
+        return 0;
+    }
+
+    stats->limit_hits++;
+    return 1;
+}
+
+void
+indigo_mem_stats_get(indigo_mem_tag_t tag, indigo_mem_stats_t *stats)
+{
+    *stats = mem_stats[tag];
+}
+
+void
+indigo_mem_peak_reset(void)
+{
+    int i;
+
+    for (i = 0; i < INDIGO_MEM_TAG_COUNT; i++) {
+        mem_stats[i].peak_bytes = mem_stats[i].live_bytes;
+    }
+}
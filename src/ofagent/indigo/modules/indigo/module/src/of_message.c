@@ -0,0 +1,141 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ *  /module/src/of_message.c
+ *
+ *  OpenFlow message construction helpers
+ *
+ *****************************************************************************/
+#include <indigo/indigo_config.h>
+#include <indigo/of_message.h>
+#include <string.h>
+
+of_experimenter_t *
+indigo_of_experimenter_new(of_version_t version, uint32_t experimenter,
+                           uint32_t subtype, of_octets_t *data)
+{
+    of_experimenter_t *msg;
+    uint8_t *buf;
+
+    if ((msg = of_experimenter_new(version)) == NULL) {
+        return NULL;
+    }
+
+    buf = OF_OBJECT_BUFFER_INDEX(msg, 0);
+    buf[OF_MESSAGE_VERSION_OFFSET] = msg->version;
+    buf[OF_MESSAGE_TYPE_OFFSET] = OF_OBJ_TYPE_EXPERIMENTER;
+    of_experimenter_experimenter_set(msg, experimenter);
+    of_experimenter_subtype_set(msg, subtype);
+    if (of_experimenter_data_set(msg, data) < 0) {
+        of_object_delete(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+of_object_t *
+indigo_of_object_new_from_validated_message(of_object_storage_t *storage,
+                                            uint8_t *buf, int len)
+{
+    of_object_t *obj = &storage->obj;
+    of_wire_buffer_t *wbuf = &storage->wbuf;
+    of_version_t version;
+    of_object_id_t object_id;
+
+    memset(storage, 0, sizeof(*storage));
+
+    version = of_message_version_get(buf);
+    if (!OF_VERSION_OKAY(version)) {
+        return NULL;
+    }
+
+    if (len < OF_MESSAGE_HEADER_LENGTH || of_message_length_get(buf) != len) {
+        return NULL;
+    }
+
+    obj->version = version;
+    obj->wire_object.wbuf = wbuf;
+    wbuf->buf = buf;
+    wbuf->alloc_bytes = len;
+    wbuf->current_bytes = len;
+
+    of_header_wire_object_id_get(obj, &object_id);
+    of_object_init_map[object_id](obj, version, len, 0);
+
+    return obj;
+}
+
+/*
+ * Offset of the OXM match in message classes that carry one, or -1. The
+ * generated constructors initialize its TLV header for OF 1.2 and later.
+ */
+static int
+message_match_offset(of_object_id_t object_id, of_version_t version)
+{
+    switch (object_id) {
+    case OF_PACKET_IN: return version >= OF_VERSION_1_3 ? 24 : 16;
+    case OF_FLOW_REMOVED: return 48;
+    default: return -1;
+    }
+}
+
+of_object_t *
+indigo_of_message_new_preallocated(of_object_storage_t *storage,
+                                   of_object_id_t object_id,
+                                   of_version_t version,
+                                   uint8_t *buf, int bytes)
+{
+    of_object_t *obj = &storage->obj;
+    of_wire_buffer_t *wbuf = &storage->wbuf;
+    int len, match_offset;
+
+    if (!OF_VERSION_OKAY(version) || object_id >= OF_MESSAGE_OBJECT_COUNT) {
+        return NULL;
+    }
+
+    len = of_object_fixed_len[version][object_id];
+    if (len < 0) {
+        return NULL;
+    }
+    len += of_object_extra_len[version][object_id];
+    if (len > bytes) {
+        return NULL;
+    }
+
+    memset(storage, 0, sizeof(*storage));
+    memset(buf, 0, len);
+
+    obj->wire_object.wbuf = wbuf;
+    wbuf->buf = buf;
+    wbuf->alloc_bytes = bytes;
+
+    of_object_init_map[object_id](obj, version, len, 0);
+    obj->wire_type_set(obj);
+    of_message_length_set(OF_OBJECT_TO_MESSAGE(obj), obj->length);
+
+    match_offset = message_match_offset(object_id, version);
+    if (match_offset >= 0 && version >= OF_VERSION_1_2) {
+        of_wire_buffer_u16_set(wbuf, OF_OBJECT_ABSOLUTE_OFFSET(obj, match_offset + 2), 4);
+    }
+
+    return obj;
+}
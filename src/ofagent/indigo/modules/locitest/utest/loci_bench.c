@@ -0,0 +1,819 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*
+ * Encode and decode throughput of the messages on the agent's hot paths
+ *
+ * Not part of the unit test; run "utest_locitest bench [OPTIONS]
+ * [CASE...]" or "make bench" in targets/utests/locitest.
+ *
+ * Messages are built the way the agent builds them and parsed the way it
+ * parses them: encoding starts from of_*_new and ends with the wire
+ * bytes, decoding binds preallocated storage to a received buffer as
+ * cxn_instance.c does and reads every field the agent would use. The
+ * flow-add is an OF-DPA ACL policy flow with apply, write and meter
+ * instructions. 1000 flow stats entries do not fit in one message, so
+ * they are split into replies at 32KB the way handlers.c splits them.
+ *
+ * Each case runs until it has taken at least the target time and reports
+ * ns/op and heap allocations/op. Allocation counts do not depend on the
+ * machine, so "-c" fails when a case allocates more than its budget
+ * below; with "-b FILE" it also fails when a case is more than "-T"
+ * percent slower than in FILE, the saved output of an earlier run. "make
+ * bench-check" runs the former and is quick enough for CI.
+ */
+
+#include <loci/loci.h>
+#include <loci/of_object.h>
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FLOW_STATS_ENTRIES 1000
+#define PORT_STATS_ENTRIES 48
+#define PACKET_IN_BYTES 128
+
+/* handlers.c starts a new flow stats reply past this length */
+#define STATS_REPLY_SPLIT (1 << 15)
+
+#define MAX_STATS_REPLIES 8
+
+static int target_ms = 200;
+
+/*
+ * Heap allocation counting
+ *
+ * loci allocates with malloc, so the C library entry points are wrapped.
+ * Not possible with a sanitizer, which has its own allocator.
+ */
+
+static int alloc_counting;
+static uint64_t alloc_count;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *
+malloc(size_t size)
+{
+    alloc_count += alloc_counting;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    alloc_count += alloc_counting;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    alloc_count += alloc_counting;
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+#define ALLOC_COUNT_SUPPORTED 1
+#else
+#define ALLOC_COUNT_SUPPORTED 0
+#endif
+
+static uint64_t
+bench_now_ns(void)
+{
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+#define BENCH_CHECK(cond)                                               \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: %s failed\n",                       \
+                    __FILE__, __LINE__, #cond);                         \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+/*
+ * Wire copies of each message, made once and parsed by the decode cases
+ */
+
+typedef struct bench_wire_s {
+    uint8_t *buf;
+    int len;
+} bench_wire_t;
+
+static bench_wire_t packet_in_wire;
+static bench_wire_t flow_add_wire;
+static bench_wire_t port_stats_wire;
+static bench_wire_t flow_stats_wire[MAX_STATS_REPLIES];
+static int flow_stats_wire_count;
+static of_octets_t match_wire;
+
+static of_match_t acl_match;
+static of_list_instruction_t *acl_instructions;
+
+static of_object_t *packet_in_obj;
+static of_object_t *flow_add_obj;
+static of_object_t *flow_stats_obj;
+
+/* Keeps the decode loops from being optimized away */
+static volatile uint64_t sink;
+
+static void
+bench_wire_save(bench_wire_t *wire, of_object_t *obj)
+{
+    wire->len = obj->length;
+    wire->buf = malloc(wire->len);
+    BENCH_CHECK(wire->buf != NULL);
+    memcpy(wire->buf, OF_OBJECT_TO_MESSAGE(obj), wire->len);
+}
+
+static void
+acl_match_init(of_match_t *match, uint32_t key)
+{
+    memset(match, 0, sizeof(*match));
+    match->version = OF_VERSION_1_3;
+    match->fields.in_port = key % 48 + 1;
+    match->masks.in_port = 0xffffffff;
+    match->fields.eth_type = 0x0800;
+    match->masks.eth_type = 0xffff;
+    match->fields.vlan_vid = 0x1000 | 100;
+    match->masks.vlan_vid = 0x1fff;
+    match->fields.ipv4_src = 0xc0a80000 | (key & 0xffff);
+    match->masks.ipv4_src = 0xffffffff;
+    match->fields.ipv4_dst = 0x0a000000;
+    match->masks.ipv4_dst = 0xff000000;
+    match->fields.ip_proto = 6;
+    match->masks.ip_proto = 0xff;
+    match->fields.tcp_dst = 80;
+    match->masks.tcp_dst = 0xffff;
+}
+
+/* An OF-DPA ACL policy flow: copy to the controller, set the queue and
+ * group, and meter */
+static of_list_instruction_t *
+acl_instructions_new(void)
+{
+    of_list_instruction_t *insts = of_list_instruction_new(OF_VERSION_1_3);
+    of_list_action_t *actions;
+    of_object_t *inst, *action;
+
+    actions = of_list_action_new(OF_VERSION_1_3);
+    action = of_action_output_new(OF_VERSION_1_3);
+    of_action_output_port_set(action, OF_PORT_DEST_CONTROLLER);
+    of_action_output_max_len_set(action, 0xffff);
+    of_list_append(actions, action);
+    of_object_delete(action);
+    inst = of_instruction_apply_actions_new(OF_VERSION_1_3);
+    BENCH_CHECK(of_instruction_apply_actions_actions_set(inst, actions) == 0);
+    of_list_append(insts, inst);
+    of_object_delete(inst);
+    of_object_delete(actions);
+
+    actions = of_list_action_new(OF_VERSION_1_3);
+    action = of_action_set_queue_new(OF_VERSION_1_3);
+    of_action_set_queue_queue_id_set(action, 3);
+    of_list_append(actions, action);
+    of_object_delete(action);
+    action = of_action_group_new(OF_VERSION_1_3);
+    of_action_group_group_id_set(action, 0x00010005);
+    of_list_append(actions, action);
+    of_object_delete(action);
+    inst = of_instruction_write_actions_new(OF_VERSION_1_3);
+    BENCH_CHECK(of_instruction_write_actions_actions_set(inst, actions) == 0);
+    of_list_append(insts, inst);
+    of_object_delete(inst);
+    of_object_delete(actions);
+
+    inst = of_instruction_meter_new(OF_VERSION_1_3);
+    of_instruction_meter_meter_id_set(inst, 7);
+    of_list_append(insts, inst);
+    of_object_delete(inst);
+
+    return insts;
+}
+
+/* Read everything the agent reads from a list of instructions */
+static uint64_t
+instructions_walk(of_list_instruction_t *insts)
+{
+    of_instruction_t inst;
+    of_list_action_t actions;
+    of_action_t act;
+    uint64_t sum = 0;
+    uint32_t u32;
+    int rv, rv2;
+
+    OF_LIST_INSTRUCTION_ITER(insts, &inst, rv) {
+        switch (inst.header.object_id) {
+        case OF_INSTRUCTION_APPLY_ACTIONS:
+        case OF_INSTRUCTION_WRITE_ACTIONS:
+            if (inst.header.object_id == OF_INSTRUCTION_APPLY_ACTIONS) {
+                of_instruction_apply_actions_actions_bind(
+                    &inst.apply_actions, &actions);
+            } else {
+                of_instruction_write_actions_actions_bind(
+                    &inst.write_actions, &actions);
+            }
+            OF_LIST_ACTION_ITER(&actions, &act, rv2) {
+                switch (act.header.object_id) {
+                case OF_ACTION_OUTPUT: {
+                    of_port_no_t port;
+                    of_action_output_port_get(&act.output, &port);
+                    sum += port;
+                    break;
+                }
+                case OF_ACTION_SET_QUEUE:
+                    of_action_set_queue_queue_id_get(&act.set_queue, &u32);
+                    sum += u32;
+                    break;
+                case OF_ACTION_GROUP:
+                    of_action_group_group_id_get(&act.group, &u32);
+                    sum += u32;
+                    break;
+                default:
+                    break;
+                }
+            }
+            break;
+        case OF_INSTRUCTION_METER:
+            of_instruction_meter_meter_id_get(&inst.meter, &u32);
+            sum += u32;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return sum;
+}
+
+/*
+ * packet-in
+ */
+
+static uint8_t packet_in_frame[PACKET_IN_BYTES];
+
+static of_object_t *
+packet_in_build(void)
+{
+    of_object_t *obj = of_packet_in_new(OF_VERSION_1_3);
+    of_octets_t data = { .data = packet_in_frame, .bytes = PACKET_IN_BYTES };
+    of_match_t match;
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.fields.in_port = 17;
+    match.masks.in_port = 0xffffffff;
+
+    of_packet_in_xid_set(obj, 0);
+    of_packet_in_buffer_id_set(obj, OF_BUFFER_ID_NO_BUFFER);
+    of_packet_in_total_len_set(obj, PACKET_IN_BYTES);
+    of_packet_in_reason_set(obj, OF_PACKET_IN_REASON_ACTION);
+    of_packet_in_table_id_set(obj, 60);
+    of_packet_in_cookie_set(obj, 0x1234);
+    BENCH_CHECK(of_packet_in_match_set(obj, &match) == 0);
+    BENCH_CHECK(of_packet_in_data_set(obj, &data) == 0);
+
+    return obj;
+}
+
+static void
+packet_in_encode(void)
+{
+    of_object_t *obj = packet_in_build();
+    sink += obj->length;
+    of_object_delete(obj);
+}
+
+static void
+packet_in_decode(void)
+{
+    of_object_storage_t storage;
+    of_object_t *obj;
+    of_match_t match;
+    of_octets_t data;
+    uint64_t cookie;
+
+    obj = of_object_new_from_message_preallocated(
+        &storage, packet_in_wire.buf, packet_in_wire.len);
+    BENCH_CHECK(obj != NULL);
+    BENCH_CHECK(of_packet_in_match_get(obj, &match) == 0);
+    of_packet_in_cookie_get(obj, &cookie);
+    of_packet_in_data_get(obj, &data);
+    sink += match.fields.in_port + cookie + data.bytes;
+}
+
+/*
+ * flow-add
+ */
+
+static of_object_t *
+flow_add_build(void)
+{
+    of_object_t *obj = of_flow_add_new(OF_VERSION_1_3);
+
+    of_flow_add_xid_set(obj, 0);
+    of_flow_add_table_id_set(obj, 60);
+    of_flow_add_cookie_set(obj, 0x1000);
+    of_flow_add_priority_set(obj, 1000);
+    of_flow_add_buffer_id_set(obj, OF_BUFFER_ID_NO_BUFFER);
+    of_flow_add_flags_set(obj, OF_FLOW_MOD_FLAG_SEND_FLOW_REM_BY_VERSION(
+                              OF_VERSION_1_3));
+    BENCH_CHECK(of_flow_add_match_set(obj, &acl_match) == 0);
+    BENCH_CHECK(of_flow_add_instructions_set(obj, acl_instructions) == 0);
+
+    return obj;
+}
+
+static void
+flow_add_encode(void)
+{
+    of_object_t *obj = flow_add_build();
+    sink += obj->length;
+    of_object_delete(obj);
+}
+
+static void
+flow_add_decode(void)
+{
+    of_object_storage_t storage;
+    of_object_t *obj;
+    of_list_instruction_t insts;
+    of_match_t match;
+    uint64_t cookie;
+    uint16_t priority;
+
+    obj = of_object_new_from_message_preallocated(
+        &storage, flow_add_wire.buf, flow_add_wire.len);
+    BENCH_CHECK(obj != NULL);
+    BENCH_CHECK(of_flow_add_match_get(obj, &match) == 0);
+    of_flow_add_cookie_get(obj, &cookie);
+    of_flow_add_priority_get(obj, &priority);
+    of_flow_add_instructions_bind(obj, &insts);
+    sink += match.fields.ipv4_src + cookie + priority +
+        instructions_walk(&insts);
+}
+
+/*
+ * flow stats reply with FLOW_STATS_ENTRIES entries
+ */
+
+static void
+flow_stats_entry_append(of_object_t *reply, uint32_t key)
+{
+    of_list_flow_stats_entry_t list;
+    of_flow_stats_entry_t entry;
+    of_match_t match;
+
+    of_flow_stats_reply_entries_bind(reply, &list);
+    of_flow_stats_entry_init(&entry, reply->version, -1, 1);
+    BENCH_CHECK(of_list_flow_stats_entry_append_bind(&list, &entry) == 0);
+
+    of_flow_stats_entry_cookie_set(&entry, key);
+    of_flow_stats_entry_priority_set(&entry, 1000);
+    of_flow_stats_entry_idle_timeout_set(&entry, 0);
+    of_flow_stats_entry_hard_timeout_set(&entry, 0);
+    of_flow_stats_entry_flags_set(&entry, 0);
+    acl_match_init(&match, key);
+    BENCH_CHECK(of_flow_stats_entry_match_set(&entry, &match) == 0);
+    BENCH_CHECK(of_flow_stats_entry_instructions_set(
+                    &entry, acl_instructions) == 0);
+    of_flow_stats_entry_table_id_set(&entry, 60);
+    of_flow_stats_entry_duration_sec_set(&entry, key);
+    of_flow_stats_entry_duration_nsec_set(&entry, 0);
+    of_flow_stats_entry_packet_count_set(&entry, key * 10);
+    of_flow_stats_entry_byte_count_set(&entry, key * 640);
+}
+
+/* Calls done with each finished reply, which it must delete */
+static void
+flow_stats_build(void (*done)(of_object_t *reply))
+{
+    of_object_t *reply = NULL;
+    uint32_t key;
+
+    for (key = 0; key < FLOW_STATS_ENTRIES; key++) {
+        if (reply == NULL) {
+            reply = of_flow_stats_reply_new(OF_VERSION_1_3);
+            of_flow_stats_reply_xid_set(reply, 0);
+            of_flow_stats_reply_flags_set(reply, OF_STATS_REPLY_FLAG_REPLY_MORE);
+        }
+        flow_stats_entry_append(reply, key);
+        if (reply->length > STATS_REPLY_SPLIT) {
+            done(reply);
+            reply = NULL;
+        }
+    }
+
+    if (reply != NULL) {
+        of_flow_stats_reply_flags_set(reply, 0);
+        done(reply);
+    }
+}
+
+static void
+flow_stats_done_delete(of_object_t *reply)
+{
+    sink += reply->length;
+    of_object_delete(reply);
+}
+
+static void
+flow_stats_done_save(of_object_t *reply)
+{
+    BENCH_CHECK(flow_stats_wire_count < MAX_STATS_REPLIES);
+    bench_wire_save(&flow_stats_wire[flow_stats_wire_count++], reply);
+    if (flow_stats_obj == NULL) {
+        flow_stats_obj = reply;
+    } else {
+        of_object_delete(reply);
+    }
+}
+
+static void
+flow_stats_encode(void)
+{
+    flow_stats_build(flow_stats_done_delete);
+}
+
+static void
+flow_stats_decode(void)
+{
+    of_object_storage_t storage;
+    of_object_t *obj;
+    of_list_flow_stats_entry_t list;
+    of_flow_stats_entry_t entry;
+    of_list_instruction_t insts;
+    of_match_t match;
+    uint64_t packets, bytes;
+    int i, rv, entries = 0;
+
+    for (i = 0; i < flow_stats_wire_count; i++) {
+        obj = of_object_new_from_message_preallocated(
+            &storage, flow_stats_wire[i].buf, flow_stats_wire[i].len);
+        BENCH_CHECK(obj != NULL);
+        of_flow_stats_reply_entries_bind(obj, &list);
+        OF_LIST_FLOW_STATS_ENTRY_ITER(&list, &entry, rv) {
+            BENCH_CHECK(of_flow_stats_entry_match_get(&entry, &match) == 0);
+            of_flow_stats_entry_packet_count_get(&entry, &packets);
+            of_flow_stats_entry_byte_count_get(&entry, &bytes);
+            of_flow_stats_entry_instructions_bind(&entry, &insts);
+            sink += match.fields.ipv4_src + packets + bytes +
+                instructions_walk(&insts);
+            entries++;
+        }
+    }
+
+    BENCH_CHECK(entries == FLOW_STATS_ENTRIES);
+}
+
+/*
+ * port stats reply with PORT_STATS_ENTRIES entries
+ */
+
+static of_object_t *
+port_stats_build(void)
+{
+    of_object_t *reply = of_port_stats_reply_new(OF_VERSION_1_3);
+    of_list_port_stats_entry_t list;
+    of_port_stats_entry_t entry;
+    uint32_t port;
+
+    of_port_stats_reply_xid_set(reply, 0);
+    of_port_stats_reply_entries_bind(reply, &list);
+
+    /* As ind_ofdpa_port_stats_set fills them in */
+    for (port = 1; port <= PORT_STATS_ENTRIES; port++) {
+        of_port_stats_entry_init(&entry, reply->version, -1, 1);
+        BENCH_CHECK(of_list_port_stats_entry_append_bind(&list, &entry) == 0);
+        of_port_stats_entry_port_no_set(&entry, port);
+        of_port_stats_entry_rx_packets_set(&entry, port * 1000);
+        of_port_stats_entry_tx_packets_set(&entry, port * 1000);
+        of_port_stats_entry_rx_bytes_set(&entry, port * 64000);
+        of_port_stats_entry_tx_bytes_set(&entry, port * 64000);
+        of_port_stats_entry_rx_dropped_set(&entry, 0);
+        of_port_stats_entry_tx_dropped_set(&entry, 0);
+        of_port_stats_entry_rx_errors_set(&entry, 0);
+        of_port_stats_entry_tx_errors_set(&entry, 0);
+        of_port_stats_entry_rx_frame_err_set(&entry, 0);
+        of_port_stats_entry_rx_over_err_set(&entry, 0);
+        of_port_stats_entry_rx_crc_err_set(&entry, 0);
+        of_port_stats_entry_collisions_set(&entry, 0);
+        of_port_stats_entry_duration_sec_set(&entry, port);
+        of_port_stats_entry_duration_nsec_set(&entry, 0);
+    }
+
+    return reply;
+}
+
+static void
+port_stats_encode(void)
+{
+    of_object_t *obj = port_stats_build();
+    sink += obj->length;
+    of_object_delete(obj);
+}
+
+static void
+port_stats_decode(void)
+{
+    of_object_storage_t storage;
+    of_object_t *obj;
+    of_list_port_stats_entry_t list;
+    of_port_stats_entry_t entry;
+    of_port_no_t port;
+    uint64_t packets, bytes;
+    int rv, entries = 0;
+
+    obj = of_object_new_from_message_preallocated(
+        &storage, port_stats_wire.buf, port_stats_wire.len);
+    BENCH_CHECK(obj != NULL);
+    of_port_stats_reply_entries_bind(obj, &list);
+    OF_LIST_PORT_STATS_ENTRY_ITER(&list, &entry, rv) {
+        of_port_stats_entry_port_no_get(&entry, &port);
+        of_port_stats_entry_rx_packets_get(&entry, &packets);
+        of_port_stats_entry_tx_bytes_get(&entry, &bytes);
+        sink += port + packets + bytes;
+        entries++;
+    }
+
+    BENCH_CHECK(entries == PORT_STATS_ENTRIES);
+}
+
+/*
+ * of_match_t to and from OXM
+ */
+
+static void
+match_serialize(void)
+{
+    of_octets_t octets;
+
+    BENCH_CHECK(of_match_serialize(OF_VERSION_1_3, &acl_match, &octets) == 0);
+    sink += octets.bytes;
+    FREE(octets.data);
+}
+
+static void
+match_deserialize(void)
+{
+    of_match_t match;
+
+    BENCH_CHECK(of_match_deserialize(OF_VERSION_1_3, &match,
+                                     &match_wire) == 0);
+    sink += match.fields.ipv4_src;
+}
+
+/*
+ * of_object_dup
+ */
+
+static void
+packet_in_dup(void)
+{
+    of_object_t *obj = of_object_dup(packet_in_obj);
+    BENCH_CHECK(obj != NULL);
+    of_object_delete(obj);
+}
+
+static void
+flow_add_dup(void)
+{
+    of_object_t *obj = of_object_dup(flow_add_obj);
+    BENCH_CHECK(obj != NULL);
+    of_object_delete(obj);
+}
+
+static void
+flow_stats_dup(void)
+{
+    of_object_t *obj = of_object_dup(flow_stats_obj);
+    BENCH_CHECK(obj != NULL);
+    of_object_delete(obj);
+}
+
+/*
+ * Cases
+ *
+ * max_allocs is the allocation budget checked by "-c", what each case
+ * takes with the object pool warm. Raise it only along with a change that
+ * needs the allocations.
+ */
+
+typedef struct bench_case_s {
+    const char *name;
+    void (*op)(void);
+    double max_allocs;
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    { "packet_in_encode", packet_in_encode, 1 },
+    { "packet_in_decode", packet_in_decode, 0 },
+    { "packet_in_dup", packet_in_dup, 1 },
+    { "flow_add_encode", flow_add_encode, 1 },
+    { "flow_add_decode", flow_add_decode, 0 },
+    { "flow_add_dup", flow_add_dup, 1 },
+    { "flow_stats_encode", flow_stats_encode, FLOW_STATS_ENTRIES },
+    { "flow_stats_decode", flow_stats_decode, 0 },
+    { "flow_stats_dup", flow_stats_dup, 1 },
+    { "port_stats_encode", port_stats_encode, 0 },
+    { "port_stats_decode", port_stats_decode, 0 },
+    { "match_serialize", match_serialize, 1 },
+    { "match_deserialize", match_deserialize, 0 },
+};
+
+static void
+bench_setup(void)
+{
+    of_object_t *obj;
+
+    acl_match_init(&acl_match, 1);
+    acl_instructions = acl_instructions_new();
+
+    packet_in_obj = packet_in_build();
+    bench_wire_save(&packet_in_wire, packet_in_obj);
+
+    flow_add_obj = flow_add_build();
+    bench_wire_save(&flow_add_wire, flow_add_obj);
+
+    flow_stats_build(flow_stats_done_save);
+
+    obj = port_stats_build();
+    bench_wire_save(&port_stats_wire, obj);
+    of_object_delete(obj);
+
+    BENCH_CHECK(of_match_serialize(OF_VERSION_1_3, &acl_match,
+                                   &match_wire) == 0);
+}
+
+/* Run op until it has taken target_ms, return ns/op and allocs/op */
+static void
+bench_run(const bench_case_t *c, double *ns_per_op, double *allocs_per_op)
+{
+    uint64_t batch = 1, ops = 0, i, start, elapsed;
+
+    /* Warm up */
+    c->op();
+
+    alloc_count = 0;
+    alloc_counting = 1;
+    start = bench_now_ns();
+    do {
+        for (i = 0; i < batch; i++) {
+            c->op();
+        }
+        ops += batch;
+        batch *= 2;
+        elapsed = bench_now_ns() - start;
+    } while (elapsed < (uint64_t)target_ms * 1000000);
+    alloc_counting = 0;
+
+    *ns_per_op = (double)elapsed / ops;
+    *allocs_per_op = (double)alloc_count / ops;
+}
+
+/* Return the ns/op of the named case in a saved run, or 0 */
+static double
+baseline_get(const char *path, const char *name)
+{
+    char line[256], case_name[64];
+    double ns;
+    FILE *f;
+
+    if ((f = fopen(path, "r")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%63s %lf", case_name, &ns) == 2 &&
+                strcmp(case_name, name) == 0) {
+            fclose(f);
+            return ns;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: bench [-t target ms] [-c] [-b baseline file "
+            "[-T tolerance %%]] [CASE...]\n");
+}
+
+/*
+ * argv[0] is the "bench" that selected this, as getopt expects a
+ * program name there
+ */
+int
+loci_bench(int argc, char *argv[])
+{
+    const char *baseline = NULL;
+    int check = 0, tolerance = 25, failures = 0;
+    int opt, i, j;
+
+    while ((opt = getopt(argc, argv, "t:cb:T:")) != -1) {
+        switch (opt) {
+        case 't':
+            target_ms = atoi(optarg);
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'b':
+            baseline = optarg;
+            break;
+        case 'T':
+            tolerance = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (target_ms <= 0 || tolerance < 0) {
+        usage();
+        return 1;
+    }
+
+    bench_setup();
+
+    printf("%-20s %12s %10s\n", "case", "ns/op", "allocs/op");
+
+    for (i = 0; i < (int)(sizeof(bench_cases) / sizeof(bench_cases[0])); i++) {
+        const bench_case_t *c = &bench_cases[i];
+        double ns, allocs, base;
+
+        if (optind < argc) {
+            for (j = optind; j < argc; j++) {
+                if (strcmp(argv[j], c->name) == 0) {
+                    break;
+                }
+            }
+            if (j == argc) {
+                continue;
+            }
+        }
+
+        bench_run(c, &ns, &allocs);
+        if (ALLOC_COUNT_SUPPORTED) {
+            printf("%-20s %12.1f %10.2f\n", c->name, ns, allocs);
+        } else {
+            printf("%-20s %12.1f %10s\n", c->name, ns, "-");
+        }
+
+        if (check && ALLOC_COUNT_SUPPORTED && allocs > c->max_allocs) {
+            printf("FAIL %s: %.2f allocs/op, budget %.0f\n",
+                   c->name, allocs, c->max_allocs);
+            failures++;
+        }
+
+        if (baseline != NULL &&
+                (base = baseline_get(baseline, c->name)) > 0 &&
+                ns > base * (100 + tolerance) / 100) {
+            printf("FAIL %s: %.1f ns/op, baseline %.1f\n",
+                   c->name, ns, base);
+            failures++;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -25,6 +25,7 @@
 
 #include <locitest/unittest.h>
 #include <locitest/test_common.h>
+#include <string.h>
 
 #if !defined(__APPLE__)
 #include <mcheck.h>
@@ -33,9 +34,17 @@
 #define MCHECK_INIT do { } while (0)
 #endif
 
+/* Defined in loci_bench.c */
+int loci_bench(int argc, char *argv[]);
+
 int
 main(int argc, char *argv[])
 {
+    /* Not a test, see loci_bench.c */
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return loci_bench(argc - 1, argv + 1);
+    }
+
     MCHECK_INIT;
 
     RUN_TEST(ident_macros);
@@ -44,12 +44,25 @@ typedef struct bighash_table_s {
 #define BIGHASH_TABLE_F_TABLE_ALLOCATED   0x1
     /** The hash bucket array was allocated */
 #define BIGHASH_TABLE_F_BUCKETS_ALLOCATED 0x2
+    /** The bucket count doubles as entries are added */
+#define BIGHASH_TABLE_F_AUTOGROW          0x4
 
     /** Table Flags */
     uint32_t flags;
 
     /** Current number of entries in this table. */
     int entry_count;
+
+    /**
+     * Buckets of a growable table before its last resize, or NULL.
+     * Old buckets below migrate_bucket have been moved to the new
+     * buckets; each insert moves a few more.
+     */
+    struct bighash_entry_s **old_buckets;
+    /** Number of old buckets */
+    int old_bucket_count;
+    /** Next old bucket to move */
+    int migrate_bucket;
 } bighash_table_t;
 
 
@@ -86,6 +99,18 @@ typedef struct bighash_entry_s {
  */
 bighash_table_t *bighash_table_create(int bucket_count);
 
+/**
+ * @brief Create a hash table that grows with its entries.
+ * @param bucket_count Initial number of buckets, rounded up to a power of 2.
+ * @returns The new hash table.
+ * @note The bucket count doubles once there are more than two entries per
+ * bucket. The entries are moved to the new buckets a few buckets at a time
+ * by later inserts, so no single insert pays for the whole resize. An
+ * insert may move entries between buckets, so a growable table must not
+ * be inserted into while it is iterated.
+ */
+bighash_table_t *bighash_table_create_growable(int bucket_count);
+
 /**
  * @brief Initialize a hash table structure.
  * @param table The table to initialize.
@@ -192,5 +217,33 @@ int bighash_entry_count(bighash_table_t *table);
  */
 int bighash_entries_move(bighash_table_t *dst, bighash_table_t *src);
 
+/**
+ * @brief Hash a 32-bit integer key.
+ * @param key The key.
+ * @returns The hash.
+ * @note This is a single multiply-shift. The upper half of the product is
+ * returned, so both the low bits used by power of 2 tables and the value
+ * modulo any bucket count depend on every bit of the key.
+ */
+static inline uint32_t
+bighash_hash_u32(uint32_t key)
+{
+    return (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+/**
+ * @brief Hash a 64-bit integer key.
+ * @param key The key.
+ * @returns The hash.
+ * @note The halves are folded together before the multiply-shift so the
+ * upper half of the key is not lost.
+ */
+static inline uint32_t
+bighash_hash_u64(uint64_t key)
+{
+    key ^= key >> 32;
+    return (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
 #endif /* __BIGHASH__ */
 /* @} */
@@ -0,0 +1,208 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ***************************************************************/
+/************************************************************//**
+ *
+ * @file
+ * @addtogroup bighash-bighash
+ * @{
+ *
+ * Open addressing hash tables.
+ *
+ * Slots are kept in groups of BIGHASH_OA_GROUP_SIZE. Each slot has a
+ * control byte in a dense array, holding either 7 bits of the hash of its
+ * object or one of the EMPTY and DELETED markers. A lookup compares a whole
+ * group of control bytes at once, using SSE2 where available, and only
+ * looks at the objects whose control byte matches. Most lookups read one
+ * cache line of control bytes and one slot.
+ *
+ * Objects are not linked into the table, so they need no embedded entry.
+ * Keys must be unique. Use bighash_oa_template.h for typed wrappers.
+ *
+ ***************************************************************/
+
+#ifndef __BIGHASH_OA_H__
+#define __BIGHASH_OA_H__
+
+#include <BigHash/bighash_config.h>
+#include <BigHash/bighash.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/** Slots per group, one SSE2 register of control bytes */
+#define BIGHASH_OA_GROUP_SIZE 16
+
+/** Control byte of a slot never used since the last rehash */
+#define BIGHASH_OA_CTRL_EMPTY   0x80
+/** Control byte of a slot whose object was removed */
+#define BIGHASH_OA_CTRL_DELETED 0xfe
+
+/**
+ * Open addressing hash table.
+ */
+typedef struct bighash_oa_table_s {
+    /** Control bytes, one per slot */
+    uint8_t *ctrl;
+    /** Objects */
+    void **slots;
+    /** Full hash of each object, used when rehashing */
+    uint32_t *hashes;
+    /** Number of groups minus one, the group count is a power of 2 */
+    uint32_t group_mask;
+    /** Current number of objects */
+    int entry_count;
+    /** Number of slots that may still be taken from EMPTY */
+    int growth_left;
+} bighash_oa_table_t;
+
+/**
+ * Iterator over the objects of an open addressing table
+ */
+typedef struct bighash_oa_iter_s {
+    /** Hashtable. Must not be freed during iteration */
+    bighash_oa_table_t *table;
+    /** Current slot in the iteration */
+    int slot;
+} bighash_oa_iter_t;
+
+/**
+ * @brief Create an open addressing hash table.
+ * @param capacity Number of objects to make room for.
+ * @returns The new hash table.
+ * @note The table grows past this as needed. It holds at most 7/8 of its
+ * slots, so every probe sequence ends at an EMPTY slot.
+ */
+bighash_oa_table_t *bighash_oa_table_create(int capacity);
+
+/**
+ * @brief Destroy an open addressing hash table.
+ * @param table The hash table.
+ * @param ofree Called on each object, if not NULL.
+ */
+void bighash_oa_table_destroy(bighash_oa_table_t *table, void (*ofree)(void *));
+
+/**
+ * @brief Insert an object.
+ * @param table The hash table.
+ * @param obj The object.
+ * @param hash The hash value of the object's key.
+ * @note No object with an equal key may be in the table. An insert may
+ * rehash the table, so a table must not be inserted into while it is
+ * iterated.
+ */
+void bighash_oa_insert(bighash_oa_table_t *table, void *obj, uint32_t hash);
+
+/**
+ * @brief Remove an object.
+ * @param table The hash table.
+ * @param obj The object.
+ * @param hash The hash value the object was inserted with.
+ * @returns 0 if the object was found, -1 if not.
+ * @note The object may be removed while iterating.
+ */
+int bighash_oa_remove(bighash_oa_table_t *table, void *obj, uint32_t hash);
+
+/**
+ * @brief Get the number of objects in the table.
+ * @param table The hash table.
+ * @returns The count.
+ */
+int bighash_oa_entry_count(bighash_oa_table_t *table);
+
+/**
+ * @brief Start iterating over the objects of a table.
+ * @param table The hash table.
+ * @param iter The iterator.
+ * @returns The first object, or NULL if empty.
+ */
+void *bighash_oa_iter_start(bighash_oa_table_t *table, bighash_oa_iter_t *iter);
+
+/**
+ * @brief Get the next object.
+ * @param iter The iterator.
+ * @returns The next object, or NULL at the end.
+ */
+void *bighash_oa_iter_next(bighash_oa_iter_t *iter);
+
+/**
+ * @brief The control byte of objects with this hash.
+ */
+static inline uint8_t
+bighash_oa_tag(uint32_t hash)
+{
+    return hash & 0x7f;
+}
+
+/**
+ * @brief The first group probed for this hash.
+ */
+static inline uint32_t
+bighash_oa_group(const bighash_oa_table_t *table, uint32_t hash)
+{
+    return (hash >> 7) & table->group_mask;
+}
+
+/**
+ * @brief Bitmask of the slots of a group whose control byte is 'ctrl'.
+ * @param group The control bytes of the group.
+ * @param ctrl The control byte to look for.
+ */
+static inline uint32_t
+bighash_oa_group_match(const uint8_t *group, uint8_t ctrl)
+{
+#if defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ctrl)));
+#else
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < BIGHASH_OA_GROUP_SIZE; i++) {
+        if (group[i] == ctrl) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Bitmask of the EMPTY and DELETED slots of a group.
+ * @param group The control bytes of the group.
+ * @note Only those control bytes have the top bit set.
+ */
+static inline uint32_t
+bighash_oa_group_match_free(const uint8_t *group)
+{
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < BIGHASH_OA_GROUP_SIZE; i++) {
+        if (group[i] & 0x80) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+#endif /* __BIGHASH_OA_H__ */
+/* @} */
@@ -0,0 +1,153 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ***************************************************************/
+/*
+ * BigHash open addressing template
+ *
+ * This template creates wrappers around the open addressing interfaces in
+ * bighash_oa.h specialized for particular object and key types, like
+ * bighash_template.h does for chained tables. The key is embedded at a
+ * fixed offset in the object and is compared as an opaque byte array.
+ * Keys must be unique.
+ *
+ * The following macros must be defined before including this file:
+ *   TEMPLATE_NAME - prefix for the created functions
+ *   TEMPLATE_OBJ_TYPE - type (not a pointer) of the stored object
+ *   TEMPLATE_KEY_FIELD - field name of the key
+ *
+ * The following macro may be defined to override the hash function:
+ *   TEMPLATE_HASH - function taking a const pointer to the key and
+ *                   returning a uint32_t hash
+ *
+ * Without TEMPLATE_HASH, 4 and 8 byte keys are hashed with a multiply-shift
+ * and all other keys with murmur. The choice is made at compile time.
+ *
+ * The above macros will be automatically undefined by this file.
+ *
+ * This file is intended to be included by a header that defines the parameter
+ * macros. It should also use a guard to prevent multiple inclusion, because
+ * this file deliberately does not.
+ */
+
+#include <string.h>
+#include <BigHash/bighash_oa.h>
+#include <murmur/murmur.h>
+
+#ifndef TEMPLATE_NAME
+#error "Must define TEMPLATE_NAME"
+#endif
+
+#ifndef TEMPLATE_OBJ_TYPE
+#error "Must define TEMPLATE_OBJ_TYPE"
+#endif
+
+#ifndef TEMPLATE_KEY_FIELD
+#error "Must define TEMPLATE_KEY_FIELD"
+#endif
+
+/* Macro to create a function name */
+#define BHT_NAME_PASTE(X,Y) X ## _ ## Y
+#define BHT_NAME_EXPAND(X, Y) BHT_NAME_PASTE(X, Y)
+#define BHT_NAME(X) BHT_NAME_EXPAND(TEMPLATE_NAME, X)
+
+/* Derive the key type from the object type and field */
+#define TEMPLATE_KEY_TYPE typeof(((TEMPLATE_OBJ_TYPE *)0)->TEMPLATE_KEY_FIELD)
+
+/* Hash a key */
+static inline uint32_t
+BHT_NAME(hash)(const TEMPLATE_KEY_TYPE *key)
+{
+#ifdef TEMPLATE_HASH
+    return TEMPLATE_HASH(key);
+#else
+    /* The key may be a struct, so it is copied rather than dereferenced */
+    if (sizeof(*key) == sizeof(uint32_t)) {
+        uint32_t k;
+        memcpy(&k, key, sizeof(k));
+        return bighash_hash_u32(k);
+    } else if (sizeof(*key) == sizeof(uint64_t)) {
+        uint64_t k;
+        memcpy(&k, key, sizeof(k));
+        return bighash_hash_u64(k);
+    } else {
+        return murmur_hash(key, sizeof(*key), 0);
+    }
+#endif
+}
+
+/* Create a hashtable with room for 'capacity' objects */
+static inline bighash_oa_table_t *
+BHT_NAME(create)(int capacity)
+{
+    return bighash_oa_table_create(capacity);
+}
+
+/* Insert an object, no object with the same key may be in the table */
+static inline void
+BHT_NAME(insert)(bighash_oa_table_t *table, TEMPLATE_OBJ_TYPE *obj)
+{
+    bighash_oa_insert(table, obj, BHT_NAME(hash)(&obj->TEMPLATE_KEY_FIELD));
+}
+
+/* Remove an object */
+static inline void
+BHT_NAME(remove)(bighash_oa_table_t *table, TEMPLATE_OBJ_TYPE *obj)
+{
+    bighash_oa_remove(table, obj, BHT_NAME(hash)(&obj->TEMPLATE_KEY_FIELD));
+}
+
+/* Return the object matching 'key', or NULL */
+static inline TEMPLATE_OBJ_TYPE *
+BHT_NAME(lookup)(bighash_oa_table_t *table, const TEMPLATE_KEY_TYPE *key)
+{
+    uint32_t hash = BHT_NAME(hash)(key);
+    uint32_t group = bighash_oa_group(table, hash);
+    uint8_t tag = bighash_oa_tag(hash);
+    uint32_t step = 0;
+
+    for (;;) {
+        const uint8_t *ctrl = &table->ctrl[group * BIGHASH_OA_GROUP_SIZE];
+        uint32_t mask = bighash_oa_group_match(ctrl, tag);
+
+        while (mask != 0) {
+            TEMPLATE_OBJ_TYPE *obj =
+                table->slots[group * BIGHASH_OA_GROUP_SIZE + __builtin_ctz(mask)];
+            if (!memcmp(&obj->TEMPLATE_KEY_FIELD, key, sizeof(*key))) {
+                return obj;
+            }
+            mask &= mask - 1;
+        }
+
+        if (bighash_oa_group_match(ctrl, BIGHASH_OA_CTRL_EMPTY) != 0) {
+            return NULL;
+        }
+        step++;
+        group = (group + step) & table->group_mask;
+    }
+}
+
+#undef BHT_NAME_PASTE
+#undef BHT_NAME_EXPAND
+#undef BHT_NAME
+
+#undef TEMPLATE_KEY_TYPE
+
+#undef TEMPLATE_NAME
+#undef TEMPLATE_OBJ_TYPE
+#undef TEMPLATE_KEY_FIELD
+#undef TEMPLATE_HASH
@@ -30,6 +30,13 @@
  *   TEMPLATE_KEY_FIELD - field name of the key
  *   TEMPLATE_ENTRY_FIELD - field name of the bighash_entry_t
  *
+ * The following macro may be defined to override the hash function:
+ *   TEMPLATE_HASH - function taking a const pointer to the key and
+ *                   returning a uint32_t hash
+ *
+ * Without TEMPLATE_HASH, 4 and 8 byte keys are hashed with a multiply-shift
+ * and all other keys with murmur. The choice is made at compile time.
+ *
  * The above macros will be automatically undefined by this file.
  *
  * This file is intended to be included by a header that defines the parameter
@@ -37,6 +44,7 @@
  * this file deliberately does not.
  */
 
+#include <string.h>
 #include <BigHash/bighash.h>
 #include <murmur/murmur.h>
 
@@ -68,7 +76,29 @@
 static inline uint32_t
 BHT_NAME(hash)(const TEMPLATE_KEY_TYPE *key)
 {
-    return murmur_hash(key, sizeof(*key), 0);
+#ifdef TEMPLATE_HASH
+    return TEMPLATE_HASH(key);
+#else
+    /* The key may be a struct, so it is copied rather than dereferenced */
+    if (sizeof(*key) == sizeof(uint32_t)) {
+        uint32_t k;
+        memcpy(&k, key, sizeof(k));
+        return bighash_hash_u32(k);
+    } else if (sizeof(*key) == sizeof(uint64_t)) {
+        uint64_t k;
+        memcpy(&k, key, sizeof(k));
+        return bighash_hash_u64(k);
+    } else {
+        return murmur_hash(key, sizeof(*key), 0);
+    }
+#endif
+}
+
+/* Create a hashtable that grows with the number of objects */
+static inline bighash_table_t *
+BHT_NAME(create)(int bucket_count)
+{
+    return bighash_table_create_growable(bucket_count);
 }
 
 /* Insert an object into the hashtable */
@@ -121,3 +151,4 @@ BHT_NAME(next)(TEMPLATE_OBJ_TYPE *prev)
 #undef TEMPLATE_OBJ_TYPE
 #undef TEMPLATE_KEY_FIELD
 #undef TEMPLATE_ENTRY_FIELD
+#undef TEMPLATE_HASH
@@ -21,6 +21,12 @@
 #include <BigHash/bighash.h>
 #include "bighash_log.h"
 
+/* A growable table doubles once it holds this many entries per bucket */
+#define BIGHASH_GROW_LOAD 2
+
+/* Number of old buckets moved by each insert while a resize is running */
+#define BIGHASH_MIGRATE_BUCKETS 4
+
 bighash_table_t *
 bighash_table_create(int bucket_count)
 {
@@ -30,6 +36,21 @@ bighash_table_create(int bucket_count)
     return table;
 }
 
+bighash_table_t *
+bighash_table_create_growable(int bucket_count)
+{
+    int count = 1;
+    bighash_table_t *table;
+
+    while (count < bucket_count) {
+        count <<= 1;
+    }
+
+    table = bighash_table_create(count);
+    table->flags |= BIGHASH_TABLE_F_AUTOGROW;
+    return table;
+}
+
 int
 bighash_table_init_static(bighash_table_t *table)
 {
@@ -78,6 +99,26 @@ bighash_table_destroy(bighash_table_t *table, bighash_entry_free_f efree)
         }
     }
 
+    for(b = table->migrate_bucket; b < table->old_bucket_count; b++) {
+        bighash_entry_t *cur, *next;
+        cur = table->old_buckets[b];
+        while (cur != NULL) {
+            next = cur->next;
+            cur->next = NULL;
+            cur->hash = 0;
+            if(efree) {
+                efree(cur);
+            }
+            cur = next;
+        }
+    }
+    if(table->old_buckets != NULL) {
+        aim_free(table->old_buckets);
+        table->old_buckets = NULL;
+        table->old_bucket_count = 0;
+        table->migrate_bucket = 0;
+    }
+
     if(table->flags & BIGHASH_TABLE_F_BUCKETS_ALLOCATED) {
         aim_free(table->buckets);
         table->buckets = NULL;
@@ -90,17 +131,92 @@ bighash_table_destroy(bighash_table_t *table, bighash_entry_free_f efree)
 }
 
 
+static inline int
+bucket_index__(int bucket_count, uint32_t hash)
+{
+    if ((bucket_count & (bucket_count - 1)) == 0) {
+        return hash & (bucket_count - 1);
+    }
+    return hash % bucket_count;
+}
+
 bighash_entry_t **
 bighash_bucket(bighash_table_t *table, uint32_t hash)
 {
-    int bucket = hash % table->bucket_count;
-    return &table->buckets[bucket];
+    if (table->old_buckets != NULL) {
+        /* Old buckets not yet moved still hold their entries */
+        int old = bucket_index__(table->old_bucket_count, hash);
+        if (old >= table->migrate_bucket) {
+            return &table->old_buckets[old];
+        }
+    }
+
+    return &table->buckets[bucket_index__(table->bucket_count, hash)];
+}
+
+/*
+ * Move the next few old buckets of a resize to the new buckets. Whole
+ * buckets are moved so that entries with the same hash stay on one chain.
+ */
+static void
+migrate__(bighash_table_t *table)
+{
+    int i;
+
+    for (i = 0; i < BIGHASH_MIGRATE_BUCKETS; i++) {
+        bighash_entry_t *cur = table->old_buckets[table->migrate_bucket];
+        while (cur != NULL) {
+            bighash_entry_t *next = cur->next;
+            bighash_entry_t **bucket =
+                &table->buckets[bucket_index__(table->bucket_count, cur->hash)];
+            cur->next = *bucket;
+            *bucket = cur;
+            cur = next;
+        }
+        table->old_buckets[table->migrate_bucket] = NULL;
+
+        if (++table->migrate_bucket == table->old_bucket_count) {
+            aim_free(table->old_buckets);
+            table->old_buckets = NULL;
+            table->old_bucket_count = 0;
+            table->migrate_bucket = 0;
+            return;
+        }
+    }
+}
+
+/* Double the buckets of a growable table, the entries are moved later */
+static void
+grow__(bighash_table_t *table)
+{
+    bighash_entry_t **buckets;
+    int count = table->bucket_count * 2;
+
+    buckets = aim_zmalloc(sizeof(buckets[0]) * count);
+
+    table->old_buckets = table->buckets;
+    table->old_bucket_count = table->bucket_count;
+    table->migrate_bucket = 0;
+    table->buckets = buckets;
+    table->bucket_count = count;
 }
 
 void
 bighash_insert(bighash_table_t *table, bighash_entry_t *e, uint32_t hash)
 {
-    bighash_entry_t **bucket = bighash_bucket(table, hash);
+    bighash_entry_t **bucket;
+
+    if (table->flags & BIGHASH_TABLE_F_AUTOGROW) {
+        if (table->old_buckets != NULL) {
+            migrate__(table);
+        } else if (table->entry_count >= table->bucket_count * BIGHASH_GROW_LOAD &&
+                   (table->flags & BIGHASH_TABLE_F_BUCKETS_ALLOCATED)) {
+            grow__(table);
+            migrate__(table);
+        }
+    }
+
+    bucket = bighash_bucket(table, hash);
     e->next = *bucket;
     e->hash = hash;
     *bucket = e;
@@ -168,14 +284,46 @@ bighash_table_utilization_show(bighash_table_t *table, aim_pvs_t *pvs)
         aim_printf(pvs, "    %.4d: %d \n", i, c);
         count += c;
     }
+
+    if (table->old_buckets != NULL) {
+        aim_printf(pvs, "resizing: %d of %d old buckets moved\n",
+                   table->migrate_bucket, table->old_bucket_count);
+        for(i = table->migrate_bucket; i < table->old_bucket_count; i++) {
+            int c = 0;
+            bighash_entry_t *cur = table->old_buckets[i];
+            while (cur != NULL) {
+                c++;
+                cur = cur->next;
+            }
+            aim_printf(pvs, "    old %.4d: %d \n", i, c);
+            count += c;
+        }
+    }
+}
+
+/*
+ * Buckets are numbered for iteration as the new buckets followed by the
+ * old buckets of a running resize.
+ */
+static bighash_entry_t *
+iter_bucket__(bighash_table_t *table, int b)
+{
+    if (b < table->bucket_count) {
+        return table->buckets[b];
+    }
+    return table->old_buckets[b - table->bucket_count];
 }
 
 static int
 next_nonempty_bucket__(bighash_table_t *table, int current)
 {
     int b;
-    for(b = current+1; b < table->bucket_count; b++) {
-        if(table->buckets[b] != NULL) {
+    int count = table->bucket_count;
+    if (table->old_buckets != NULL) {
+        count += table->old_bucket_count;
+    }
+    for(b = current+1; b < count; b++) {
+        if(iter_bucket__(table, b) != NULL) {
             return b;
         }
     }
@@ -204,7 +352,7 @@ bighash_iter_next(bighash_iter_t *iter)
             return NULL;
         }
         iter->current_bucket = next_bucket;
-        cur = iter->table->buckets[iter->current_bucket];
+        cur = iter_bucket__(iter->table, iter->current_bucket);
     }
 
     iter->next_entry = cur->next;
@@ -0,0 +1,228 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ***************************************************************/
+
+#include <BigHash/bighash_config.h>
+#include <BigHash/bighash_oa.h>
+#include <string.h>
+#include "bighash_log.h"
+
+static inline int
+slot_count__(const bighash_oa_table_t *table)
+{
+    return (table->group_mask + 1) * BIGHASH_OA_GROUP_SIZE;
+}
+
+/* At most 7/8 of the slots are used, leaving EMPTY slots to end probes */
+static inline int
+max_load__(int slot_count)
+{
+    return slot_count - slot_count / 8;
+}
+
+static void
+alloc__(bighash_oa_table_t *table, int slot_count)
+{
+    table->ctrl = aim_malloc(slot_count);
+    memset(table->ctrl, BIGHASH_OA_CTRL_EMPTY, slot_count);
+    table->slots = aim_zmalloc(sizeof(table->slots[0]) * slot_count);
+    table->hashes = aim_zmalloc(sizeof(table->hashes[0]) * slot_count);
+    table->group_mask = slot_count / BIGHASH_OA_GROUP_SIZE - 1;
+    table->growth_left = max_load__(slot_count) - table->entry_count;
+}
+
+/*
+ * Find a free slot for this hash. The groups are probed by triangular
+ * numbers, which visits every group of a power of 2 group count.
+ */
+static int
+find_free__(bighash_oa_table_t *table, uint32_t hash)
+{
+    uint32_t group = bighash_oa_group(table, hash);
+    uint32_t step = 0;
+
+    for (;;) {
+        uint32_t mask = bighash_oa_group_match_free(
+            &table->ctrl[group * BIGHASH_OA_GROUP_SIZE]);
+        if (mask != 0) {
+            return group * BIGHASH_OA_GROUP_SIZE + __builtin_ctz(mask);
+        }
+        step++;
+        group = (group + step) & table->group_mask;
+    }
+}
+
+static void
+place__(bighash_oa_table_t *table, int slot, void *obj, uint32_t hash)
+{
+    if (table->ctrl[slot] == BIGHASH_OA_CTRL_EMPTY) {
+        table->growth_left--;
+    }
+    table->ctrl[slot] = bighash_oa_tag(hash);
+    table->slots[slot] = obj;
+    table->hashes[slot] = hash;
+    table->entry_count++;
+}
+
+/*
+ * Rebuild the table without DELETED slots. The slot count doubles unless
+ * most of the used slots were DELETED.
+ */
+static void
+rehash__(bighash_oa_table_t *table)
+{
+    uint8_t *ctrl = table->ctrl;
+    void **slots = table->slots;
+    uint32_t *hashes = table->hashes;
+    int old_count = slot_count__(table);
+    int new_count = old_count;
+    int i;
+
+    if (table->entry_count >= max_load__(old_count) / 2) {
+        new_count *= 2;
+    }
+
+    table->entry_count = 0;
+    alloc__(table, new_count);
+
+    for (i = 0; i < old_count; i++) {
+        if (!(ctrl[i] & 0x80)) {
+            place__(table, find_free__(table, hashes[i]), slots[i], hashes[i]);
+        }
+    }
+
+    aim_free(ctrl);
+    aim_free(slots);
+    aim_free(hashes);
+}
+
+bighash_oa_table_t *
+bighash_oa_table_create(int capacity)
+{
+    bighash_oa_table_t *table = aim_zmalloc(sizeof(*table));
+    int slot_count = BIGHASH_OA_GROUP_SIZE;
+
+    while (max_load__(slot_count) < capacity) {
+        slot_count *= 2;
+    }
+
+    alloc__(table, slot_count);
+    return table;
+}
+
+void
+bighash_oa_table_destroy(bighash_oa_table_t *table, void (*ofree)(void *))
+{
+    int i;
+
+    if (ofree) {
+        for (i = 0; i < slot_count__(table); i++) {
+            if (!(table->ctrl[i] & 0x80)) {
+                ofree(table->slots[i]);
+            }
+        }
+    }
+
+    aim_free(table->ctrl);
+    aim_free(table->slots);
+    aim_free(table->hashes);
+    aim_free(table);
+}
+
+void
+bighash_oa_insert(bighash_oa_table_t *table, void *obj, uint32_t hash)
+{
+    int slot = find_free__(table, hash);
+
+    if (table->ctrl[slot] == BIGHASH_OA_CTRL_EMPTY && table->growth_left == 0) {
+        rehash__(table);
+        slot = find_free__(table, hash);
+    }
+
+    place__(table, slot, obj, hash);
+}
+
+int
+bighash_oa_remove(bighash_oa_table_t *table, void *obj, uint32_t hash)
+{
+    uint32_t group = bighash_oa_group(table, hash);
+    uint8_t tag = bighash_oa_tag(hash);
+    uint32_t step = 0;
+
+    for (;;) {
+        uint8_t *ctrl = &table->ctrl[group * BIGHASH_OA_GROUP_SIZE];
+        uint32_t mask = bighash_oa_group_match(ctrl, tag);
+        uint32_t empty = bighash_oa_group_match(ctrl, BIGHASH_OA_CTRL_EMPTY);
+
+        while (mask != 0) {
+            int i = __builtin_ctz(mask);
+            int slot = group * BIGHASH_OA_GROUP_SIZE + i;
+            if (table->slots[slot] == obj) {
+                /*
+                 * Probes stop at a group with an EMPTY slot, so none can
+                 * pass through this one and the slot may become EMPTY.
+                 */
+                if (empty != 0) {
+                    ctrl[i] = BIGHASH_OA_CTRL_EMPTY;
+                    table->growth_left++;
+                } else {
+                    ctrl[i] = BIGHASH_OA_CTRL_DELETED;
+                }
+                table->slots[slot] = NULL;
+                table->entry_count--;
+                return 0;
+            }
+            mask &= mask - 1;
+        }
+
+        if (empty != 0) {
+            return -1;
+        }
+        step++;
+        group = (group + step) & table->group_mask;
+    }
+}
+
+int
+bighash_oa_entry_count(bighash_oa_table_t *table)
+{
+    return table->entry_count;
+}
+
+void *
+bighash_oa_iter_start(bighash_oa_table_t *table, bighash_oa_iter_t *iter)
+{
+    iter->table = table;
+    iter->slot = -1;
+    return bighash_oa_iter_next(iter);
+}
+
+void *
+bighash_oa_iter_next(bighash_oa_iter_t *iter)
+{
+    bighash_oa_table_t *table = iter->table;
+    int count = slot_count__(table);
+
+    while (++iter->slot < count) {
+        if (!(table->ctrl[iter->slot] & 0x80)) {
+            return table->slots[iter->slot];
+        }
+    }
+
+    return NULL;
+}
@@ -174,7 +174,7 @@ int test_table_data__(bighash_table_t *table, biglist_t** entry_list)
 int
 test_template(void)
 {
-    bighash_table_t *table = bighash_table_create(16);
+    bighash_table_t *table = test_hashtable_create(16);
     test_entry_t entry1a = { 1, 0 };
     test_entry_t entry1b = { 1, 0 };
     test_entry_t entry2a = { 2, 0 };
@@ -203,6 +203,132 @@ test_template(void)
     fe = test_hashtable_first(table, &key);
     assert(fe == NULL);
 
+    /* 32-bit keys use the integer hash */
+    assert(test_hashtable_hash(&key) == bighash_hash_u32(key));
+
+    bighash_table_destroy(table, NULL);
+    return 0;
+}
+
+int
+test_template_hash(void)
+{
+    bighash_table_t *table = test_const_hashtable_create(16);
+    test_entry_t entry1 = { 1, 0 };
+    test_entry_t entry2 = { 2, 0 };
+    uint32_t key;
+
+    test_const_hashtable_insert(table, &entry1);
+    test_const_hashtable_insert(table, &entry2);
+    assert(entry1.hash_entry.hash == 7);
+    assert(entry2.hash_entry.hash == 7);
+
+    key = 1;
+    assert(test_const_hashtable_first(table, &key) == &entry1);
+    assert(test_const_hashtable_next(&entry1) == NULL);
+    key = 2;
+    assert(test_const_hashtable_first(table, &key) == &entry2);
+    key = 3;
+    assert(test_const_hashtable_first(table, &key) == NULL);
+
+    bighash_table_destroy(table, NULL);
+    return 0;
+}
+
+static void
+free_test_obj(void *obj)
+{
+    aim_free(obj);
+}
+
+int
+test_oa(void)
+{
+    bighash_oa_table_t *table = test_oa_hashtable_create(4);
+    bighash_oa_iter_t iter;
+    test_entry_t *te;
+    uint32_t id;
+    int count = 10000;
+    int c, round;
+
+    for (id = 0; id < count; id++) {
+        te = aim_zmalloc(sizeof(*te));
+        te->id = id;
+        test_oa_hashtable_insert(table, te);
+        if (test_oa_hashtable_lookup(table, &id) != te) {
+            AIM_DIE("inserted entry was not found, id=%d", id);
+        }
+    }
+    if (bighash_oa_entry_count(table) != count) {
+        AIM_DIE("Entry count mismatch: %d", bighash_oa_entry_count(table));
+    }
+
+    /* Every object is enumerated once */
+    c = 0;
+    for (te = bighash_oa_iter_start(table, &iter); te; te = bighash_oa_iter_next(&iter)) {
+        if (te->found++) {
+            AIM_DIE("Entry %d was already enumerated.", te->id);
+        }
+        c++;
+    }
+    if (c != count) {
+        AIM_DIE("Enumeration error: count=%d", c);
+    }
+
+    /*
+     * Remove the odd ids while iterating and insert them again, several
+     * times, to leave DELETED slots behind for the rehash to clear.
+     */
+    for (round = 0; round < 4; round++) {
+        for (te = bighash_oa_iter_start(table, &iter); te; te = bighash_oa_iter_next(&iter)) {
+            if (te->id & 1) {
+                test_oa_hashtable_remove(table, te);
+                aim_free(te);
+            }
+        }
+        if (bighash_oa_entry_count(table) != count / 2) {
+            AIM_DIE("Entry count mismatch after removal: %d",
+                    bighash_oa_entry_count(table));
+        }
+        for (id = 0; id < count; id++) {
+            te = test_oa_hashtable_lookup(table, &id);
+            if ((te == NULL) != (id & 1)) {
+                AIM_DIE("Lookup error after removal, id=%d", id);
+            }
+        }
+        for (id = 1; id < count; id += 2) {
+            te = aim_zmalloc(sizeof(*te));
+            te->id = id;
+            test_oa_hashtable_insert(table, te);
+        }
+        for (id = 0; id < count; id++) {
+            te = test_oa_hashtable_lookup(table, &id);
+            if (te == NULL || te->id != id) {
+                AIM_DIE("Lookup error after reinsertion, id=%d", id);
+            }
+        }
+    }
+
+    bighash_oa_table_destroy(table, free_test_obj);
+
+    /* Colliding keys probe past each other */
+    {
+        test_entry_t entries[64];
+        table = test_oa_const_hashtable_create(16);
+        for (id = 0; id < 64; id++) {
+            entries[id].id = id;
+            test_oa_const_hashtable_insert(table, &entries[id]);
+        }
+        test_oa_const_hashtable_remove(table, &entries[10]);
+        for (id = 0; id < 64; id++) {
+            te = test_oa_const_hashtable_lookup(table, &id);
+            assert(te == (id == 10 ? NULL : &entries[id]));
+        }
+        id = 64;
+        assert(test_oa_const_hashtable_lookup(table, &id) == NULL);
+        bighash_oa_table_destroy(table, NULL);
+    }
+
     return 0;
 }
 
@@ -281,6 +407,34 @@ int main(int argc, char *argv[])
         bighash_table_destroy(dst, NULL);
     }
 
+    /** Growable table -- lookups and iteration across resizes */
+    {
+        bighash_table_t *gtable;
+        gtable = bighash_table_create_growable(3);
+        if(gtable->bucket_count != 4) {
+            AIM_DIE("Growable bucket count not rounded up (%d)",
+                    gtable->bucket_count);
+        }
+        insert__(gtable, 10000, &entries);
+        if(gtable->bucket_count < 10000/2) {
+            AIM_DIE("Growable table did not grow (%d buckets)",
+                    gtable->bucket_count);
+        }
+        test_table_data__(gtable, &entries);
+        bighash_table_destroy(gtable, NULL);
+    }
+
+    /** Growable table -- destroy while resizing */
+    {
+        bighash_table_t *gtable;
+        gtable = bighash_table_create_growable(64);
+        insert__(gtable, 129, NULL);
+        if(gtable->old_buckets == NULL) {
+            AIM_DIE("Growable table is not resizing.");
+        }
+        bighash_table_destroy(gtable, free_test_entry);
+    }
+
     /** Check utilization and automatic element destruction */
     bighash_table_init_static(&static_table);
     insert__(&static_table, 100000, 0);
@@ -288,6 +442,8 @@ int main(int argc, char *argv[])
     bighash_table_destroy(&static_table, free_test_entry);
 
     test_template();
+    test_template_hash();
+    test_oa();
 
     return 0;
 }
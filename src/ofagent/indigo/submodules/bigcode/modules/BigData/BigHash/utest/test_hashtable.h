@@ -25,4 +25,29 @@
 #define TEMPLATE_ENTRY_FIELD hash_entry
 #include <BigHash/bighash_template.h>
 
+/* Every key collides, the template must still tell the keys apart */
+static inline uint32_t
+test_hash_const(const uint32_t *key)
+{
+    return 7;
+}
+
+#define TEMPLATE_NAME test_const_hashtable
+#define TEMPLATE_OBJ_TYPE test_entry_t
+#define TEMPLATE_KEY_FIELD id
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#define TEMPLATE_HASH test_hash_const
+#include <BigHash/bighash_template.h>
+
+#define TEMPLATE_NAME test_oa_hashtable
+#define TEMPLATE_OBJ_TYPE test_entry_t
+#define TEMPLATE_KEY_FIELD id
+#include <BigHash/bighash_oa_template.h>
+
+#define TEMPLATE_NAME test_oa_const_hashtable
+#define TEMPLATE_OBJ_TYPE test_entry_t
+#define TEMPLATE_KEY_FIELD id
+#define TEMPLATE_HASH test_hash_const
+#include <BigHash/bighash_oa_template.h>
+
 #endif
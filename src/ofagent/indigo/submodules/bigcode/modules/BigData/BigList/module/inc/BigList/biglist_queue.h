@@ -0,0 +1,126 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/*************************************************************//**
+ *
+ * module/inc/biglist_queue.h
+ *
+ * @file
+ * @brief Pooled Queue Interface
+ *
+ * @addtogroup biglist-queue
+ * @{
+ *
+ ****************************************************************/
+
+#ifndef __BIGLIST_QUEUE_H__
+#define __BIGLIST_QUEUE_H__
+
+#include <BigList/biglist_config.h>
+#include <BigList/biglist.h>
+
+/**
+ * Queue head.
+ *
+ * The elements are ordinary biglist_t links, so BIGLIST_FOREACH and
+ * BIGLIST_FOREACH_DATA work on the head. Appends, prepends, shifts and
+ * splices are constant time, and links are reused from a free pool kept
+ * by the queue instead of being allocated for each element.
+ *
+ * Like biglist_t, a queue does no locking of its own.
+ */
+typedef struct biglist_queue_s {
+    /** First element */
+    biglist_t* head;
+    /** Last element */
+    biglist_t* tail;
+    /** Number of elements */
+    int length;
+
+    /** Free links, chained through next */
+    biglist_t* pool;
+    /** Number of free links */
+    int pool_count;
+    /** Free links kept, the rest are freed */
+    int pool_max;
+} biglist_queue_t;
+
+/**
+ * @brief Initialize a queue.
+ * @param q The queue.
+ * @param pool_max The maximum number of free links to keep.
+ */
+void biglist_queue_init(biglist_queue_t* q, int pool_max);
+
+/**
+ * @brief Append to the queue.
+ * @param q The queue.
+ * @param data The data to append.
+ */
+void biglist_queue_append(biglist_queue_t* q, void* data);
+
+/**
+ * @brief Prepend to the queue.
+ * @param q The queue.
+ * @param data The data to prepend.
+ */
+void biglist_queue_prepend(biglist_queue_t* q, void* data);
+
+/**
+ * @brief Remove the first element from the queue.
+ * @param q The queue.
+ * @returns The client data of the element, or NULL if empty.
+ */
+void* biglist_queue_shift(biglist_queue_t* q);
+
+/**
+ * @brief Remove a link from the queue.
+ * @param q The queue.
+ * @param blink The link to remove.
+ * @note The link goes back to the pool. The client data is NOT freed.
+ */
+void biglist_queue_remove_link(biglist_queue_t* q, biglist_t* blink);
+
+/**
+ * @brief Move all elements of one queue to the end of another.
+ * @param dst The destination queue.
+ * @param src The source queue, left empty.
+ * @note This is constant time. The free pools are not moved.
+ */
+void biglist_queue_splice(biglist_queue_t* dst, biglist_queue_t* src);
+
+/**
+ * @brief Get the number of elements in the queue.
+ * @param q The queue.
+ */
+int biglist_queue_length(biglist_queue_t* q);
+
+/**
+ * @brief Free all elements and pooled links of a queue.
+ * @param q The queue.
+ * @param free_function The function to free each client data pointer,
+ * or NULL.
+ * @returns The number of elements freed.
+ * @note The queue is left empty and may be used again.
+ */
+int biglist_queue_free_all(biglist_queue_t* q, biglist_free_f free_function);
+
+#endif /* __BIGLIST_QUEUE_H__ */
+
+/* @} */
@@ -23,6 +23,13 @@
 #include <BigList/biglist_config.h>
 #include <BigList/biglist.h>
 #include <BigList/biglist_locked.h>
+#include <BigList/biglist_queue.h>
+
+/** Take a link from the queue's pool, or allocate one */
+biglist_t* biglist_queue_link_get__(biglist_queue_t* q, void* data);
+
+/** Return a link to the queue's pool, or free it if the pool is full */
+void biglist_queue_link_put__(biglist_queue_t* q, biglist_t* ble);
 
 
 #endif /* __BIGLIST_INT_H__ */
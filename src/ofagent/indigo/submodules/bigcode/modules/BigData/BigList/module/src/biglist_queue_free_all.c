@@ -0,0 +1,38 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+#include "biglist_int.h"
+
+int
+biglist_queue_free_all(biglist_queue_t* q, biglist_free_f free_function)
+{
+    int rv;
+    if(free_function) {
+        rv = biglist_free_all(q->head, free_function);
+    }
+    else {
+        rv = biglist_free(q->head);
+    }
+    biglist_free(q->pool);
+
+    biglist_queue_init(q, q->pool_max);
+    return rv;
+}
+
+
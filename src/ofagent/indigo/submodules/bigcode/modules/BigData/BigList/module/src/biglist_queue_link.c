@@ -0,0 +1,52 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+#include "biglist_int.h"
+
+biglist_t*
+biglist_queue_link_get__(biglist_queue_t* q, void* data)
+{
+    biglist_t* ble = q->pool;
+    if(ble == NULL) {
+        return biglist_alloc(data, NULL, NULL);
+    }
+    q->pool = ble->next;
+    q->pool_count--;
+    ble->data = data;
+    ble->next = NULL;
+    ble->previous = NULL;
+    return ble;
+}
+
+void
+biglist_queue_link_put__(biglist_queue_t* q, biglist_t* ble)
+{
+    ble->data = NULL;
+    ble->previous = NULL;
+    ble->next = NULL;
+    if(q->pool_count >= q->pool_max) {
+        biglist_free(ble);
+        return;
+    }
+    ble->next = q->pool;
+    q->pool = ble;
+    q->pool_count++;
+}
+
+
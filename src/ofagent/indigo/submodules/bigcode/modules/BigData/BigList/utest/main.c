@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include <BigList/biglist.h>
+#include <BigList/biglist_queue.h>
 
 #define FAIL(list, fmt, ...)                                        \
     do {                                                            \
@@ -320,6 +321,82 @@ int utest_BigList(void)
     return 0;
 }
 
+static int
+utest_biglist_queue(void)
+{
+    biglist_queue_t q;
+    biglist_queue_t q2;
+    biglist_t* ble;
+    void* data;
+    int i;
+
+    biglist_queue_init(&q, 4);
+    biglist_queue_init(&q2, 4);
+
+    for(i = 0; i < 10; i++) {
+        biglist_queue_append(&q, IP(i));
+    }
+    biglist_queue_prepend(&q, IP(-1));
+    if((i=biglist_queue_length(&q)) != 11) {
+        FAIL(q.head, "biglist_queue_length is %d, should be 11", i);
+    }
+    if(PI(q.head->data) != -1 || PI(q.tail->data) != 9) {
+        FAIL(q.head, "queue ends are %d and %d, should be -1 and 9",
+             PI(q.head->data), PI(q.tail->data));
+    }
+
+    /* Removing the tail keeps the tail pointer valid */
+    biglist_queue_remove_link(&q, q.tail);
+    biglist_queue_append(&q, IP(9));
+    if(PI(q.tail->data) != 9 || PI(q.tail->previous->data) != 8) {
+        FAIL(q.head, "queue tail is %d, should be 9", PI(q.tail->data));
+    }
+
+    for(i = -1; i < 5; i++) {
+        data = biglist_queue_shift(&q);
+        if(PI(data) != i) {
+            FAIL(q.head, "biglist_queue_shift returned %d, should be %d",
+                 PI(data), i);
+        }
+    }
+    if(q.pool_count != 4) {
+        FAIL(q.head, "pool_count is %d, should be 4", q.pool_count);
+    }
+
+    /* Appends take links from the pool */
+    ble = q.pool;
+    biglist_queue_append(&q2, IP(100));
+    biglist_queue_append(&q, IP(10));
+    if(q.tail != ble || q.pool_count != 3) {
+        FAIL(q.head, "append did not reuse a pooled link, pool_count=%d",
+             q.pool_count);
+    }
+
+    biglist_queue_splice(&q2, &q);
+    if(biglist_queue_length(&q) != 0 || q.head != NULL || q.tail != NULL) {
+        FATAL("splice source not empty, length=%d", biglist_queue_length(&q));
+    }
+    if((i=biglist_queue_length(&q2)) != 7) {
+        FAIL(q2.head, "biglist_queue_length is %d, should be 7", i);
+    }
+    i = 0;
+    BIGLIST_FOREACH(ble, q2.head) {
+        if(ble->next == NULL && ble != q2.tail) {
+            FAIL(q2.head, "spliced tail mismatch at %d", PI(ble->data));
+        }
+        i++;
+    }
+    if(i != 7 || PI(q2.head->data) != 100 || PI(q2.tail->data) != 10) {
+        FAIL(q2.head, "spliced queue is wrong, count=%d", i);
+    }
+
+    if((i=biglist_queue_free_all(&q2, NULL)) != 7) {
+        FATAL("biglist_queue_free_all freed %d, should be 7", i);
+    }
+    biglist_queue_free_all(&q, NULL);
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     int rc;
@@ -331,6 +408,10 @@ int main(int argc, char* argv[])
     if(rc < 0) {
         return rc;
     }
+    rc = utest_biglist_queue();
+    if(rc < 0) {
+        return rc;
+    }
     printf("PASS\n");
     return 0;
 }
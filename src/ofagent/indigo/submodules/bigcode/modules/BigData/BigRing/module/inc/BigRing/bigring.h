@@ -59,6 +59,27 @@ void bigring_aim_free_entry(void* entry);
  */
 bigring_t* bigring_create(int size, bigring_free_entry_f free_entry);
 
+/** One thread pushes to the lock-free ring */
+#define BIGRING_F_SPSC 0x0
+/** Any number of threads push to the lock-free ring */
+#define BIGRING_F_MPSC 0x1
+
+/**
+ * @brief Create a lock-free bigring buffer
+ * @param size The minimum size of the buffer, rounded up to a power of 2.
+ * @param free_entry The entry deallocator.
+ * @param flags BIGRING_F_SPSC or BIGRING_F_MPSC.
+ * @note One thread shifts from the ring and one (SPSC) or many (MPSC)
+ * threads push to it, without taking the lock. The head and tail indexes
+ * are kept on separate cache lines.
+ * @note Unlike a locked ring, a full lock-free ring keeps its oldest
+ * entries: bigring_push() frees the new entry and bigring_push_batch()
+ * pushes what fits.
+ * @note Entries must not be NULL.
+ */
+bigring_t* bigring_create_lockfree(int size, bigring_free_entry_f free_entry,
+                                   uint32_t flags);
+
 /**
  * @brief Destroy a bigring buffer.
  * @param br The bigring object.
@@ -116,11 +137,60 @@ void bigring_push(bigring_t* br, void* entry);
  */
 void* bigring_shift(bigring_t* br);
 
+/**
+ * @brief Add entries to the ring buffer.
+ * @param br The bigring object.
+ * @param entries The entries to add.
+ * @param count The number of entries.
+ * @returns The number of entries added, from the start of 'entries'.
+ * @note A lock-free ring publishes the entries with one index update and
+ * at most one wakeup. The entries that did not fit are left to the caller.
+ * A locked ring adds all entries.
+ */
+int bigring_push_batch(bigring_t* br, void** entries, int count);
+
+/**
+ * @brief Remove the next elements from the ring buffer.
+ * @param br The bigring object.
+ * @param entries Filled with the removed entries.
+ * @param max The maximum number of entries to remove.
+ * @returns The number of entries removed.
+ */
+int bigring_shift_batch(bigring_t* br, void** entries, int max);
+
+/**
+ * @brief Get the wakeup descriptor of a lock-free ring.
+ * @param br The bigring object.
+ * @returns An eventfd, or -1 if the ring has none.
+ * @note The descriptor becomes readable when entries are pushed after the
+ * last bigring_wait_clear(). It can be registered with an event loop such
+ * as SocketManager. The ring owns the descriptor.
+ */
+int bigring_wait_fd(bigring_t* br);
+
+/**
+ * @brief Rearm the wakeup of a lock-free ring.
+ * @param br The bigring object.
+ * @note Call this from the shifting thread when woken, then shift until
+ * the ring is empty. Producers only write the eventfd once per rearm.
+ */
+void bigring_wait_clear(bigring_t* br);
+
+/**
+ * @brief Wait for entries in a lock-free ring.
+ * @param br The bigring object.
+ * @param timeout_ms The timeout, or -1 to wait forever.
+ * @returns 1 if entries may be available, 0 on timeout.
+ * @note Called from the shifting thread.
+ */
+int bigring_wait(bigring_t* br, int timeout_ms);
+
 /**
  * @brief Begin iteration over all elements.
  * @param br The bigring object.
  * @param iter Iterator cookie.
- * @note You must lock and unlock the ring before and after.
+ * @note You must lock and unlock the ring before and after. A lock-free
+ * ring must not be pushed to or shifted from while iterating.
  */
 void bigring_iter_start(bigring_t* br, int* iter);
 
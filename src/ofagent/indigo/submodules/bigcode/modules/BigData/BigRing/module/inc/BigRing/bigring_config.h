@@ -117,6 +117,16 @@
 #define BIGRING_CONFIG_INCLUDE_LOCKING 1
 #endif
 
+/**
+ * BIGRING_CONFIG_INCLUDE_EVENTFD
+ *
+ * Include eventfd wakeups for lock-free rings. */
+
+
+#ifndef BIGRING_CONFIG_INCLUDE_EVENTFD
+#define BIGRING_CONFIG_INCLUDE_EVENTFD 1
+#endif
+
 
 
 /**
@@ -25,6 +25,18 @@
 #include <OS/os_sem.h>
 #endif
 
+#if BIGRING_CONFIG_INCLUDE_EVENTFD == 1
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/* Keeps the lock-free head and tail indexes on separate cache lines */
+#define BIGRING_CACHE_LINE 64
+
+/* Ring created by bigring_create_lockfree() */
+#define BIGRING_F_LOCKFREE__ 0x80000000
+
 
 struct bigring_s {
     /** The ring buffer size */
@@ -51,8 +63,33 @@ struct bigring_s {
 
 #endif
 
+    /*
+     * Lock-free mode. The indexes count up and are masked into the ring.
+     * A slot is published by storing its entry and freed by storing NULL,
+     * so the consumer never reads the tail and producers never write
+     * the head.
+     */
+    uint32_t flags;
+    /** Ring size - 1, the size is a power of 2 */
+    uint32_t mask;
+    /** Wakeup eventfd, or -1 */
+    int notify_fd;
+
+    char pad0__[BIGRING_CACHE_LINE];
+    /** Next slot to push, written by producers */
+    uint32_t lf_tail;
+    /** Set once the eventfd was written, cleared by the consumer */
+    uint32_t notify_pending;
+
+    char pad1__[BIGRING_CACHE_LINE];
+    /** Next slot to shift, written by the consumer */
+    uint32_t lf_head;
+    char pad2__[BIGRING_CACHE_LINE];
+
 }; /* bigring_t */
 
+#define BIGRING_LOCKFREE(_br) ((_br)->flags & BIGRING_F_LOCKFREE__)
+
 
 
 
@@ -78,6 +115,37 @@ bigring_create(int size, bigring_free_entry_f free_entry)
     br->head = 0;
     br->tail = 0;
 
+    br->notify_fd = -1;
+
+#if BIGRING_CONFIG_INCLUDE_LOCKING == 1
+    br->lock = os_sem_create(1);
+#endif
+    return br;
+}
+
+bigring_t*
+bigring_create_lockfree(int size, bigring_free_entry_f free_entry,
+                        uint32_t flags)
+{
+    bigring_t* br = aim_zmalloc(sizeof(*br));
+    int count = 1;
+
+    /* Full and empty are told apart by the indexes, no empty slot needed */
+    while(count < size) {
+        count <<= 1;
+    }
+
+    br->ring = aim_zmalloc(sizeof(void*)*count);
+    br->size = count;
+    br->mask = count - 1;
+    br->free_entry = free_entry;
+    br->flags = flags | BIGRING_F_LOCKFREE__;
+    br->notify_fd = -1;
+
+#if BIGRING_CONFIG_INCLUDE_EVENTFD == 1
+    br->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+
 #if BIGRING_CONFIG_INCLUDE_LOCKING == 1
     br->lock = os_sem_create(1);
 #endif
@@ -113,6 +181,12 @@ bigring_destroy(bigring_t* br)
     os_sem_destroy(br->lock);
 #endif
 
+#if BIGRING_CONFIG_INCLUDE_EVENTFD == 1
+    if(br->notify_fd >= 0) {
+        close(br->notify_fd);
+    }
+#endif
+
     AIM_FREE(br->ring);
     AIM_FREE(br);
 }
@@ -136,6 +210,12 @@ bigring_unlock(bigring_t* br)
 int
 bigring_count_locked(bigring_t* br)
 {
+    if(BIGRING_LOCKFREE(br)) {
+        /* May include slots reserved by producers but not yet written */
+        return __atomic_load_n(&br->lf_tail, __ATOMIC_RELAXED) -
+            __atomic_load_n(&br->lf_head, __ATOMIC_RELAXED);
+    }
+
     if(br->head == br->tail) {
         return 0;
     }
@@ -151,6 +231,9 @@ int
 bigring_count(bigring_t* br)
 {
     int rv;
+    if(BIGRING_LOCKFREE(br)) {
+        return bigring_count_locked(br);
+    }
     BIGRING_LOCK(br);
     rv = bigring_count_locked(br);
     BIGRING_UNLOCK(br);
@@ -174,9 +257,107 @@ bigring_push_locked__(bigring_t* br, void* entry)
     }
 }
 
+/*
+ * Write the eventfd unless it was already written since the consumer last
+ * cleared notify_pending. The fence orders the slot stores before the read
+ * of notify_pending, pairing with the one in bigring_wait_clear().
+ */
+static void
+bigring_notify__(bigring_t* br)
+{
+#if BIGRING_CONFIG_INCLUDE_EVENTFD == 1
+    uint64_t one = 1;
+
+    if(br->notify_fd < 0) {
+        return;
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&br->notify_pending, __ATOMIC_RELAXED) == 0 &&
+       __atomic_exchange_n(&br->notify_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        if(write(br->notify_fd, &one, sizeof(one)) < 0) {
+            /* The counter cannot overflow at one write per wakeup */
+        }
+    }
+#endif
+}
+
+static int
+bigring_push_lockfree__(bigring_t* br, void** entries, int count)
+{
+    uint32_t tail, head, space, n;
+    uint32_t i;
+
+    if(br->flags & BIGRING_F_MPSC) {
+        tail = __atomic_load_n(&br->lf_tail, __ATOMIC_RELAXED);
+        do {
+            head = __atomic_load_n(&br->lf_head, __ATOMIC_ACQUIRE);
+            space = br->size - (tail - head);
+            n = ((uint32_t)count < space) ? (uint32_t)count : space;
+            if(n == 0) {
+                return 0;
+            }
+        } while(!__atomic_compare_exchange_n(&br->lf_tail, &tail, tail + n, 1,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+    else {
+        tail = br->lf_tail;
+        head = __atomic_load_n(&br->lf_head, __ATOMIC_ACQUIRE);
+        space = br->size - (tail - head);
+        n = ((uint32_t)count < space) ? (uint32_t)count : space;
+        if(n == 0) {
+            return 0;
+        }
+        __atomic_store_n(&br->lf_tail, tail + n, __ATOMIC_RELAXED);
+    }
+
+    /*
+     * The consumer NULLs a slot before moving the head past it, so
+     * every reserved slot is free.
+     */
+    for(i = 0; i < n; i++) {
+        __atomic_store_n(&br->ring[(tail + i) & br->mask], entries[i],
+                         __ATOMIC_RELEASE);
+    }
+
+    bigring_notify__(br);
+    return n;
+}
+
+static int
+bigring_shift_lockfree__(bigring_t* br, void** entries, int max)
+{
+    uint32_t head = br->lf_head;
+    int n;
+
+    /* Stops at a slot reserved by a producer that has not written it yet */
+    for(n = 0; n < max; n++) {
+        void** slot = &br->ring[(head + n) & br->mask];
+        void* entry = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if(entry == NULL) {
+            break;
+        }
+        entries[n] = entry;
+        __atomic_store_n(slot, NULL, __ATOMIC_RELAXED);
+    }
+
+    if(n > 0) {
+        __atomic_store_n(&br->lf_head, head + n, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
 void
 bigring_push(bigring_t* br, void* entry)
 {
+    if(BIGRING_LOCKFREE(br)) {
+        if(bigring_push_lockfree__(br, &entry, 1) == 0 && br->free_entry) {
+            /* Full -- drop the new entry */
+            br->free_entry(entry);
+        }
+        return;
+    }
+
     BIGRING_LOCK(br);
     bigring_push_locked__(br, entry);
     BIGRING_UNLOCK(br);
@@ -198,12 +379,104 @@ void*
 bigring_shift(bigring_t* br)
 {
     void* rv;
+    if(BIGRING_LOCKFREE(br)) {
+        return bigring_shift_lockfree__(br, &rv, 1) ? rv : NULL;
+    }
     BIGRING_LOCK(br);
     rv = bigring_shift_locked__(br);
     BIGRING_UNLOCK(br);
     return rv;
 }
 
+int
+bigring_push_batch(bigring_t* br, void** entries, int count)
+{
+    int i;
+    if(BIGRING_LOCKFREE(br)) {
+        return bigring_push_lockfree__(br, entries, count);
+    }
+    BIGRING_LOCK(br);
+    for(i = 0; i < count; i++) {
+        bigring_push_locked__(br, entries[i]);
+    }
+    BIGRING_UNLOCK(br);
+    return count;
+}
+
+int
+bigring_shift_batch(bigring_t* br, void** entries, int max)
+{
+    int n;
+    if(BIGRING_LOCKFREE(br)) {
+        return bigring_shift_lockfree__(br, entries, max);
+    }
+    BIGRING_LOCK(br);
+    for(n = 0; n < max; n++) {
+        entries[n] = bigring_shift_locked__(br);
+        if(entries[n] == NULL) {
+            break;
+        }
+    }
+    BIGRING_UNLOCK(br);
+    return n;
+}
+
+int
+bigring_wait_fd(bigring_t* br)
+{
+    return br->notify_fd;
+}
+
+void
+bigring_wait_clear(bigring_t* br)
+{
+#if BIGRING_CONFIG_INCLUDE_EVENTFD == 1
+    uint64_t value;
+
+    if(br->notify_fd < 0) {
+        return;
+    }
+
+    if(read(br->notify_fd, &value, sizeof(value)) < 0) {
+        /* Not written since the last clear */
+    }
+    __atomic_store_n(&br->notify_pending, 0, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+static int
+bigring_lockfree_empty__(bigring_t* br)
+{
+    return __atomic_load_n(&br->ring[br->lf_head & br->mask],
+                           __ATOMIC_ACQUIRE) == NULL;
+}
+
+int
+bigring_wait(bigring_t* br, int timeout_ms)
+{
+#if BIGRING_CONFIG_INCLUDE_EVENTFD == 1
+    struct pollfd pfd;
+
+    if(BIGRING_LOCKFREE(br) && br->notify_fd >= 0) {
+        bigring_wait_clear(br);
+        if(!bigring_lockfree_empty__(br)) {
+            return 1;
+        }
+
+        pfd.fd = br->notify_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, timeout_ms) > 0) {
+            return 1;
+        }
+        return !bigring_lockfree_empty__(br);
+    }
+#endif
+
+    return bigring_count(br) > 0;
+}
+
 
 /**
  * These assume the ring is already locked.
@@ -211,6 +484,10 @@ bigring_shift(bigring_t* br)
 void
 bigring_iter_start(bigring_t* br, int* iter)
 {
+    if(BIGRING_LOCKFREE(br)) {
+        *iter = br->lf_head;
+        return;
+    }
     *iter = br->head;
 }
 
@@ -218,6 +495,13 @@ void*
 bigring_iter_next(bigring_t* br, int* iter)
 {
     void* rv = NULL;
+    if(BIGRING_LOCKFREE(br)) {
+        if((uint32_t)*iter != br->lf_tail) {
+            rv = br->ring[*iter & br->mask];
+            *iter = (uint32_t)*iter + 1;
+        }
+        return rv;
+    }
     if(*iter != br->tail) {
         rv = br->ring[*iter];
         RING_INCREMENT(br, *iter);
@@ -234,6 +518,9 @@ bigring_aim_free_entry(void* entry)
 int
 bigring_size(bigring_t* br)
 {
+    if(BIGRING_LOCKFREE(br)) {
+        return br->size;
+    }
     /* Account for empty slot */
     return br->size-1;
 }
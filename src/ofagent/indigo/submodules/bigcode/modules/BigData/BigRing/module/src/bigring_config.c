@@ -63,6 +63,11 @@ bigring_config_settings_t bigring_config_settings[] =
     { __bigring_config_STRINGIFY_NAME(BIGRING_CONFIG_INCLUDE_LOCKING), __bigring_config_STRINGIFY_VALUE(BIGRING_CONFIG_INCLUDE_LOCKING) },
 #else
 { BIGRING_CONFIG_INCLUDE_LOCKING(__bigring_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef BIGRING_CONFIG_INCLUDE_EVENTFD
+    { __bigring_config_STRINGIFY_NAME(BIGRING_CONFIG_INCLUDE_EVENTFD), __bigring_config_STRINGIFY_VALUE(BIGRING_CONFIG_INCLUDE_EVENTFD) },
+#else
+{ BIGRING_CONFIG_INCLUDE_EVENTFD(__bigring_config_STRINGIFY_NAME), "__undefined__" },
 #endif
     { NULL, NULL }
 };
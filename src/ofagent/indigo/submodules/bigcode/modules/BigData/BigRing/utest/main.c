@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <AIM/aim.h>
 
 #define AIM_LOG_MODULE_NAME BigRingTest
@@ -223,6 +224,128 @@ bigring_str_test(int size, bigring_free_entry_f fef)
 }
 
 
+static void
+bigring_lockfree_test(void)
+{
+    bigring_t* br = bigring_create_lockfree(5, NULL, BIGRING_F_SPSC);
+    void* entries[16];
+    intptr_t c;
+    int n;
+
+    if(bigring_size(br) != 8) {
+        AIM_LOG_ERROR("lock-free size not rounded up -- is %d", bigring_size(br));
+        abort();
+    }
+
+    /* A full ring keeps its oldest entries */
+    for(c = 1; c <= 10; c++) {
+        bigring_push(br, (void*)c);
+    }
+    ASSERT_COUNT(bigring_count(br), 8, 8);
+    for(c = 1; c <= 8; c++) {
+        if((intptr_t)bigring_shift(br) != c) {
+            AIM_LOG_ERROR("lock-free shift mismatch, expected %d", (int)c);
+            abort();
+        }
+    }
+    if(bigring_shift(br) != NULL) {
+        AIM_LOG_ERROR("lock-free shift of an empty ring returned an entry");
+        abort();
+    }
+
+    /* Batches push what fits and wrap around the ring */
+    for(c = 0; c < 16; c++) {
+        entries[c] = (void*)(c + 1);
+    }
+    n = bigring_push_batch(br, entries, 5);
+    ASSERT_COUNT(n, 5, 16);
+    n = bigring_push_batch(br, entries + 5, 11);
+    ASSERT_COUNT(n, 3, 16);
+    n = bigring_shift_batch(br, entries, 16);
+    ASSERT_COUNT(n, 8, 16);
+    for(c = 0; c < n; c++) {
+        if((intptr_t)entries[c] != c + 1) {
+            AIM_LOG_ERROR("lock-free batch mismatch @%d", (int)c);
+            abort();
+        }
+    }
+    ASSERT_COUNT(bigring_count(br), 0, 8);
+
+    /* Nothing pushed, the wait times out */
+    if(bigring_wait_fd(br) >= 0 && bigring_wait(br, 0) != 0) {
+        AIM_LOG_ERROR("lock-free wait on an empty ring did not time out");
+        abort();
+    }
+
+    bigring_destroy(br);
+}
+
+#define LOCKFREE_THREAD_COUNT 10000
+
+static void*
+bigring_lockfree_producer__(void* arg)
+{
+    bigring_t* br = arg;
+    void* entries[4];
+    intptr_t c = 1;
+    int i, n, done = 0;
+
+    while(c <= LOCKFREE_THREAD_COUNT) {
+        for(i = 0; i < 4 && c + i <= LOCKFREE_THREAD_COUNT; i++) {
+            entries[i] = (void*)(c + i);
+        }
+        for(done = 0; done < i; done += n) {
+            n = bigring_push_batch(br, entries + done, i - done);
+        }
+        c += i;
+    }
+    return NULL;
+}
+
+/* Producers push 1..N each; every value must arrive once per producer */
+static void
+bigring_lockfree_thread_test(uint32_t flags, int producers)
+{
+    bigring_t* br = bigring_create_lockfree(64, NULL, flags);
+    pthread_t threads[4];
+    intptr_t* last = aim_zmalloc(sizeof(*last) * (LOCKFREE_THREAD_COUNT + 1));
+    void* entries[16];
+    int received = 0;
+    int i, n;
+
+    for(i = 0; i < producers; i++) {
+        pthread_create(&threads[i], NULL, bigring_lockfree_producer__, br);
+    }
+
+    while(received < producers * LOCKFREE_THREAD_COUNT) {
+        if(bigring_wait_fd(br) >= 0) {
+            bigring_wait(br, 1000);
+        }
+        while((n = bigring_shift_batch(br, entries, 16)) > 0) {
+            for(i = 0; i < n; i++) {
+                intptr_t v = (intptr_t)entries[i];
+                if(v < 1 || v > LOCKFREE_THREAD_COUNT || ++last[v] > producers) {
+                    AIM_LOG_ERROR("lock-free thread test: unexpected entry %d", (int)v);
+                    abort();
+                }
+            }
+            received += n;
+        }
+    }
+
+    for(i = 0; i < producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for(i = 1; i <= LOCKFREE_THREAD_COUNT; i++) {
+        if(last[i] != producers) {
+            AIM_LOG_ERROR("lock-free thread test: entry %d seen %d times", i, (int)last[i]);
+            abort();
+        }
+    }
+    aim_free(last);
+    bigring_destroy(br);
+}
+
 int aim_main(int argc, char* argv[])
 {
     int size_min = 1, size_max = 65;
@@ -244,6 +367,12 @@ int aim_main(int argc, char* argv[])
         AIM_LOG_MSG("StrTest(%d, default)", s);
         bigring_str_test(s, bigring_aim_free_entry);
     }
+    AIM_LOG_MSG("LockFreeTest");
+    bigring_lockfree_test();
+    AIM_LOG_MSG("LockFreeThreadTest(SPSC)");
+    bigring_lockfree_thread_test(BIGRING_F_SPSC, 1);
+    AIM_LOG_MSG("LockFreeThreadTest(MPSC)");
+    bigring_lockfree_thread_test(BIGRING_F_MPSC, 4);
     bigring_config_show(&aim_pvs_stdout);
     return 0;
 }
@@ -62,6 +62,16 @@
     #endif
 #endif
 
+#ifndef FME_MEMCMP
+    #if defined(GLOBAL_MEMCMP)
+        #define FME_MEMCMP GLOBAL_MEMCMP
+    #elif FME_CONFIG_PORTING_STDLIB == 1
+        #define FME_MEMCMP memcmp
+    #else
+        #error The macro FME_MEMCMP is required but cannot be defined.
+    #endif
+#endif
+
 #ifndef FME_MEMMOVE
     #if defined(GLOBAL_MEMMOVE)
         #define FME_MEMMOVE GLOBAL_MEMMOVE
@@ -36,6 +36,7 @@
 
 #include <PPE/ppe_types.h>
 #include <BigList/biglist.h>
+#include <BigHash/bighash.h>
 
 /*
  * Fixme -- assumes availability of uint64_t
@@ -123,6 +124,15 @@ typedef struct fme_entry_s {
     /** Client entry dumper */
     fme_entry_cookie_dump_f cdumper;
 
+    /** The FME this entry has been added to, or NULL. */
+    struct fme_s* fme;
+
+    /** The tuple this entry is indexed under. */
+    struct fme_tuple_s* tuple;
+
+    /** Tuple hash table linkage. */
+    bighash_entry_t hash_entry;
+
 } fme_entry_t;
 
 /**
@@ -145,6 +155,13 @@ typedef struct fme_s {
     /** The entry table. */
     fme_entry_t** entries;
 
+    /**
+     * Tuple space index. Entries are grouped by keymask, size and
+     * masks, and hashed by their values within each group. Sorted by
+     * descending priority.
+     */
+    biglist_t* tuples;
+
 } fme_t;
 
 
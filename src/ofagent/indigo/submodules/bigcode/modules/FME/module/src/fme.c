@@ -22,6 +22,9 @@
 #include "fme_int.h"
 #include <stdlib.h>
 #include <IOF/iof.h>
+#include <AIM/aim_list.h>
+#include <BigList/biglist_queue.h>
+#include <murmur/murmur.h>
 #include "fme_log.h"
 
 static int fme_key_dump_default__(fme_key_t* key, aim_pvs_t* ap);
@@ -38,13 +41,35 @@ fme_create(fme_t** rv, const char* name, int max_entries)
     return 0;
 }
 
+static void
+fme_index_destroy__(fme_t* fme)
+{
+    biglist_t* ble;
+    fme_tuple_t* t;
+    int i;
+
+    BIGLIST_FOREACH_DATA(ble, fme->tuples, fme_tuple_t*, t) {
+        bighash_table_destroy(t->entries, NULL);
+        aim_free(t);
+    }
+    biglist_free(fme->tuples);
+    fme->tuples = NULL;
+
+    for(i = 0; i < fme->num_entries; i++) {
+        fme->entries[i]->fme = NULL;
+        fme->entries[i]->tuple = NULL;
+    }
+}
+
 void
 fme_destroy_all(fme_t* fme)
 {
     int i;
+    fme_index_destroy__(fme);
     for(i = 0; i < fme->num_entries; i++) {
         fme_entry_destroy(fme->entries[i]);
     }
+    fme->num_entries = 0;
     if(fme->log_string) {
         aim_free((void*)fme->log_string);
     }
@@ -54,6 +79,7 @@ fme_destroy_all(fme_t* fme)
 void
 fme_destroy(fme_t* fme)
 {
+    fme_index_destroy__(fme);
     aim_free(fme->entries);
     aim_free(fme);
 }
@@ -79,13 +105,126 @@ fme_entry_destroy(fme_entry_t* entry)
 }
 
 
+/**************************************************************************//**
+ *
+ * Tuple space index
+ *
+ * Entries with the same keymask, size and masks share a tuple. Within a
+ * tuple an entry can only match keys whose masked values equal its own,
+ * so a lookup hashes the masked key once per tuple and compares only the
+ * entries in that hash chain.
+ *
+ *****************************************************************************/
+
+static uint32_t
+fme_tuple_hash__(fme_tuple_t* t, const uint8_t* values)
+{
+    uint32_t words[FME_CONFIG_KEY_SIZE_WORDS];
+    const uint32_t* vp = (const uint32_t*)values;
+    const uint32_t* mp = (const uint32_t*)t->masks;
+    int i;
+
+    for(i = 0; i < t->size/4; i++) {
+        words[i] = vp[i] & mp[i];
+    }
+    return murmur_hash(words, t->size, t->keymask);
+}
+
+static int
+fme_tuple_compare__(const void* a, const void* b)
+{
+    const fme_tuple_t* ta = a;
+    const fme_tuple_t* tb = b;
+    if(ta->max_prio > tb->max_prio) {
+        return -1;
+    }
+    return ta->max_prio < tb->max_prio;
+}
+
+static void
+fme_tuple_max_prio_update__(fme_tuple_t* t)
+{
+    bighash_iter_t iter;
+    bighash_entry_t* he;
+
+    t->max_prio = INT_MIN;
+    for(he = bighash_iter_start(t->entries, &iter); he;
+        he = bighash_iter_next(&iter)) {
+        fme_entry_t* fe = container_of(he, hash_entry, fme_entry_t);
+        if(fe->prio > t->max_prio) {
+            t->max_prio = fe->prio;
+        }
+    }
+}
+
+static void
+fme_index_add__(fme_t* fme, fme_entry_t* entry)
+{
+    biglist_t* ble;
+    fme_tuple_t* t;
+    fme_key_t* key = &entry->key;
+
+    BIGLIST_FOREACH_DATA(ble, fme->tuples, fme_tuple_t*, t) {
+        if(t->keymask == key->keymask && t->size == key->size &&
+           !FME_MEMCMP(t->masks, key->masks, key->size)) {
+            break;
+        }
+    }
+    if(ble == NULL) {
+        t = aim_zmalloc(sizeof(*t));
+        t->keymask = key->keymask;
+        t->size = key->size;
+        FME_MEMCPY(t->masks, key->masks, key->size);
+        t->entries = bighash_table_create_growable(16);
+        t->max_prio = INT_MIN;
+        fme->tuples = biglist_prepend(fme->tuples, t);
+    }
+
+    bighash_insert(t->entries, &entry->hash_entry,
+                   fme_tuple_hash__(t, key->values));
+    entry->tuple = t;
+    if(entry->prio > t->max_prio) {
+        t->max_prio = entry->prio;
+        fme->tuples = biglist_sort(fme->tuples, fme_tuple_compare__);
+    }
+}
+
+static void
+fme_index_remove__(fme_t* fme, fme_entry_t* entry)
+{
+    fme_tuple_t* t = entry->tuple;
+
+    if(t == NULL) {
+        return;
+    }
+    bighash_remove(t->entries, &entry->hash_entry);
+    entry->tuple = NULL;
+
+    if(bighash_entry_count(t->entries) == 0) {
+        fme->tuples = biglist_remove(fme->tuples, t);
+        bighash_table_destroy(t->entries, NULL);
+        aim_free(t);
+    }
+    else if(entry->prio == t->max_prio) {
+        fme_tuple_max_prio_update__(t);
+        fme->tuples = biglist_sort(fme->tuples, fme_tuple_compare__);
+    }
+}
+
 int
 fme_entry_key_set(fme_entry_t* entry, fme_key_t* key)
 {
+    if(entry->fme) {
+        /* Reindex the entry under its new key */
+        fme_index_remove__(entry->fme, entry);
+    }
     FME_MEMCPY(&entry->key, key, sizeof(*key));
     if(entry->key.dumper == NULL) {
         entry->key.dumper = fme_key_dump_default__;
     }
+    if(entry->fme) {
+        fme_index_add__(entry->fme, entry);
+    }
     return 0;
 }
 
@@ -122,21 +261,21 @@ fme_entry_timeout_status(fme_entry_t* entry, fme_timeval_t now)
 int
 fme_entry_timeouts(fme_t* fme, fme_timeval_t now, biglist_t** list)
 {
-    biglist_t* rv = NULL;
+    biglist_queue_t rv;
     int i;
-    int count = 0;
 
     if(list == NULL || now == 0) {
         return 0;
     }
-    for(i = 0; fme->num_entries; i++) {
+    /* No pool; the links are handed to the caller as a plain biglist */
+    biglist_queue_init(&rv, 0);
+    for(i = 0; i < fme->num_entries; i++) {
         if(fme_entry_timeout_status(fme->entries[i], now)) {
-            rv = biglist_prepend(rv, fme->entries[i]);
-            count++;
+            biglist_queue_append(&rv, fme->entries[i]);
         }
     }
-    *list = rv;
-    return count;
+    *list = rv.head;
+    return biglist_queue_length(&rv);
 }
 
 static void
@@ -157,6 +296,9 @@ fme_add_entry(fme_t* fme, fme_entry_t* entry)
         return -1;
     }
 
+    entry->fme = fme;
+    fme_index_add__(fme, entry);
+
     if(fme->num_entries == 0) {
         fme->entries[fme->num_entries++] = entry;
         return 0;
@@ -186,6 +328,8 @@ fme_remove_entry(fme_t* fme, fme_entry_t* entry)
 {
     if(fme->entries[entry->index] == entry) {
         int msize = fme->num_entries - entry->index - 1;
+        fme_index_remove__(fme, entry);
+        entry->fme = NULL;
         --fme->num_entries;
         if(msize) {
             FME_MEMMOVE(fme->entries+(entry->index),
@@ -237,9 +381,11 @@ fme_key_match__(fme_key_t* value, fme_key_t* matchkey)
     return 1;
 }
 
-static
-int fme_entry_match__(fme_entry_t* entry, fme_key_t* key, fme_timeval_t now,
-                      int size)
+/*
+ * Check an entry against a key without touching its counters.
+ */
+static int
+fme_entry_check__(fme_entry_t* entry, fme_key_t* key, fme_timeval_t now)
 {
     if(entry->enabled == 0) {
         /* entry is disabled */
@@ -250,24 +396,45 @@ int fme_entry_match__(fme_entry_t* entry, fme_key_t* key, fme_timeval_t now,
         entry->enabled = 0;
         return 0;
     }
-    if(fme_key_match__(key, &entry->key) == 0) {
+    if(fme_key_match__(key, &entry->key) != 1) {
         /* no match */
         return 0;
     }
+    return 1;
+}
 
-    /* entry has matched */
+static void
+fme_entry_hit__(fme_entry_t* entry, fme_timeval_t now, int size)
+{
     ++entry->counters.matches;
     entry->counters.bytes += size;
     entry->timestamp = now;
-    return 1;
+}
+
+/*
+ * Entries are ordered by descending priority, then by table index.
+ */
+static inline int
+fme_entry_before__(fme_entry_t* a, fme_entry_t* b)
+{
+    return a->prio > b->prio || (a->prio == b->prio && a->index < b->index);
+}
+
+static int
+fme_entry_index_compare__(const void* a, const void* b)
+{
+    const fme_entry_t* ea = a;
+    const fme_entry_t* eb = b;
+    return ea->index - eb->index;
 }
 
 int
 fme_match(fme_t* fme, fme_key_t* key, fme_timeval_t now, int size,
           fme_entry_t** matched)
 {
-    int i;
-    int rv = 0;
+    biglist_t* ble;
+    fme_tuple_t* t;
+    fme_entry_t* best = NULL;
     iof_t iof;
 
     if(AIM_LOG_ENABLED(VERBOSE)) {
@@ -282,19 +449,27 @@ fme_match(fme_t* fme, fme_key_t* key, fme_timeval_t now, int size,
     }
 
     /*
-     * Find the first match, in priority order
+     * Find the first match, in priority order. Tuples are sorted by
+     * their highest priority, so the search stops at the first tuple
+     * which cannot hold a better match.
      */
-    for(i = 0; i < fme->num_entries; i++) {
-        fme_entry_t* fe = fme->entries[i];
-        if(fe == NULL) {
-            AIM_LOG_INTERNAL("entry is null");
+    BIGLIST_FOREACH_DATA(ble, fme->tuples, fme_tuple_t*, t) {
+        bighash_entry_t* he;
+
+        if(best && t->max_prio < best->prio) {
+            break;
+        }
+        if(t->size != key->size ||
+           (key->keymask & t->keymask) != t->keymask) {
             continue;
         }
-        if(fme_entry_match__(fe, key, now, size)) {
-            *matched = fe;
-            AIM_LOG_VERBOSE("matched index %d", fe->index);
-            rv = 1;
-            break;
+        for(he = bighash_first(t->entries, fme_tuple_hash__(t, key->values));
+            he; he = bighash_next(he)) {
+            fme_entry_t* fe = container_of(he, hash_entry, fme_entry_t);
+            if((best == NULL || fme_entry_before__(fe, best)) &&
+               fme_entry_check__(fe, key, now)) {
+                best = fe;
+            }
         }
     }
 
@@ -302,38 +477,49 @@ fme_match(fme_t* fme, fme_key_t* key, fme_timeval_t now, int size,
         iof_pop(&iof);
     }
 
-    if(rv == 0) {
+    if(best == NULL) {
         /* no match */
         AIM_LOG_VERBOSE("no match.");
+        return 0;
     }
 
-    return rv;
+    fme_entry_hit__(best, now, size);
+    *matched = best;
+    AIM_LOG_VERBOSE("matched index %d", best->index);
+    return 1;
 }
 
 int
 fme_matches(fme_t* fme, fme_key_t* key, fme_timeval_t now, int size,
             biglist_t** matches)
 {
-    int i;
+    biglist_t* ble;
+    fme_tuple_t* t;
     int count = 0;
     biglist_t* rv = NULL;
 
     /*
      * Find all matches
      */
-    for(i = 0; i < fme->num_entries; i++) {
-        fme_entry_t* fe = fme->entries[i];
-        if(fme->entries[i] == NULL) {
-            AIM_LOG_INTERNAL("entry is null");
+    BIGLIST_FOREACH_DATA(ble, fme->tuples, fme_tuple_t*, t) {
+        bighash_entry_t* he;
+
+        if(t->size != key->size ||
+           (key->keymask & t->keymask) != t->keymask) {
             continue;
         }
-        if(fme_entry_match__(fe, key, now, size)) {
-            rv = biglist_prepend(rv, fe);
-            count++;
+        for(he = bighash_first(t->entries, fme_tuple_hash__(t, key->values));
+            he; he = bighash_next(he)) {
+            fme_entry_t* fe = container_of(he, hash_entry, fme_entry_t);
+            if(fme_entry_check__(fe, key, now)) {
+                fme_entry_hit__(fe, now, size);
+                rv = biglist_prepend(rv, fe);
+                count++;
+            }
         }
     }
     if(count > 1) {
-        rv = biglist_reverse(rv);
+        rv = biglist_sort(rv, fme_entry_index_compare__);
     }
     *matches = rv;
     return count;
@@ -23,4 +23,23 @@
 #include <FME/fme_config.h>
 #include <FME/fme.h>
 
+/**
+ * A group of entries which share a keymask, key size and key masks.
+ * A lookup hashes the masked key once per tuple instead of comparing it
+ * against every entry.
+ */
+typedef struct fme_tuple_s {
+    /** Entry keymask */
+    uint32_t keymask;
+    /** Entry key size */
+    int size;
+    /** Entry key masks */
+    uint8_t masks[FME_CONFIG_KEY_SIZE_WORDS*4];
+
+    /** Entries, hashed by their masked key values */
+    bighash_table_t* entries;
+    /** Highest entry priority */
+    int max_prio;
+} fme_tuple_t;
+
 #endif /* __FME_INT_H__ */
@@ -181,6 +181,47 @@ ucli_block_t fme_utests[] =
       "match 0xFF DEADBEEF 0 0",
     },
   },
+  {
+    "tuple-priority",
+    {
+      "entry 0",
+      "key 0x1 DEADBEEF FFFFFFFF",
+      "entry 5",
+      "key 0x1 DEAD0000 FFFF0000",
+      "entry 3",
+      "key 0x1 DEADBEE0 FFFFFFF0",
+      "expect 5",
+      "match 0x1 DEADBEEF 0 0",
+    },
+  },
+  {
+    "tuple-rekey",
+    {
+      "entry 0",
+      "key 0x1 DEADBEEF FFFFFFFF",
+      "entry 5",
+      "key 0x1 DEAD0000 FFFF0000",
+      "key 0x1 CAFE0000 FFFF0000",
+      "expect 0",
+      "match 0x1 DEADBEEF 0 0",
+    },
+  },
+  {
+    "tuple-remove-best",
+    {
+      "entry 0",
+      "key 0x1 DEADBEEF FFFFFFFF",
+      "entry 5",
+      "key 0x1 DEAD0000 FFFF0000",
+      "entry 6",
+      "key 0x1 DEAD0000 FFFF0000",
+      "remove",
+      "entry 5",
+      "remove",
+      "expect 0",
+      "match 0x1 DEADBEEF 0 0",
+    },
+  },
   {
     "perf-10000-10000-0",
     {
@@ -65,6 +65,84 @@ void ppe_packet_denit(ppe_packet_t* ppep);
 int ppe_parse(ppe_packet_t* ppep);
 
 
+/**
+ * Number of leading packet bytes examined by ppe_classify().
+ */
+#define PPE_CLASSIFY_WINDOW 64
+
+/**
+ * Punted packet classes reported by ppe_classify().
+ */
+typedef enum ppe_class_e {
+    PPE_CLASS_OTHER,
+    PPE_CLASS_ARP,
+    PPE_CLASS_LLDP,
+    PPE_CLASS_LACP,
+    PPE_CLASS_OAM,
+    PPE_CLASS_DHCP,
+    PPE_CLASS_IP4,
+    PPE_CLASS_IP6,
+    PPE_CLASS_COUNT
+} ppe_class_t;
+
+/**
+ * Result of ppe_classify().
+ */
+typedef struct ppe_classify_s {
+    /** Packet class */
+    ppe_class_t pclass;
+    /** Ethertype after the VLAN tags, 0 for 802.3 frames */
+    uint16_t ethertype;
+    /** Number of VLAN tags, at most 2 */
+    uint8_t vlan_count;
+    /** VLAN IDs, outermost first */
+    uint16_t vlan[2];
+    /** Offset of the L3 header */
+    uint8_t l3_offset;
+    /** Offset of the L4 header, 0 if unknown */
+    uint8_t l4_offset;
+    /** IP protocol or IPv6 next header, 0 if not IP */
+    uint8_t ip_protocol;
+    /** L4 ports, 0 if not TCP or UDP or outside the window */
+    uint16_t l4_src_port;
+    uint16_t l4_dst_port;
+} ppe_classify_t;
+
+/**
+ * @brief Classify a packet in one pass over its first
+ * PPE_CLASSIFY_WINDOW bytes.
+ *
+ * This is a lighter alternative to ppe_parse() for sorting punted
+ * packets. It needs no ppe_packet_t and sets no header pointers.
+ *
+ * @param data The packet data, starting at the Ethernet header.
+ * @param size The size of the packet data.
+ * @param [out] rv Receives the classification.
+ *
+ * @returns 0 if successful, negative if the packet is too short.
+ */
+int ppe_classify(const uint8_t* data, int size, ppe_classify_t* rv);
+
+/**
+ * @brief Classify several packets.
+ * @param data Array of packet data pointers.
+ * @param sizes Array of packet sizes.
+ * @param count Number of packets.
+ * @param [out] rv Array of count results.
+ *
+ * @returns The number of packets classified. Packets which are too short
+ * are reported as PPE_CLASS_OTHER and are not counted.
+ */
+int ppe_classify_batch(uint8_t* const* data, const int* sizes, int count,
+                       ppe_classify_t* rv);
+
+/**
+ * @brief Get the name of a packet class.
+ * @param pclass The class.
+ */
+const char* ppe_class_name(ppe_class_t pclass);
+
+
 /**
  * @brief Duplicate a packet.
  * @param dst The destination packet.
@@ -134,6 +134,16 @@
 #define PPE_CONFIG_INCLUDE_UTM 0
 #endif
 
+/**
+ * PPE_CONFIG_INCLUDE_SIMD
+ *
+ * Use SSE2 or NEON lookups in ppe_classify() when available. */
+
+
+#ifndef PPE_CONFIG_INCLUDE_SIMD
+#define PPE_CONFIG_INCLUDE_SIMD 1
+#endif
+
 
 
 /**
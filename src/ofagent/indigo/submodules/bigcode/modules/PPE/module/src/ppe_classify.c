@@ -0,0 +1,244 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ***************************************************************/
+
+/******************************************************************************
+ *
+ * Single pass packet classification.
+ *
+ * ppe_classify() reads fixed offsets from a window of the first
+ * PPE_CLASSIFY_WINDOW bytes. Packets shorter than the window are copied
+ * into a zeroed buffer first, so no read needs its own bounds check.
+ *
+ * Ethertypes are looked up in an eight entry table. With SSE2 or NEON the
+ * lookup is a single vector compare.
+ *
+ *****************************************************************************/
+
+#include <PPE/ppe_config.h>
+#include <PPE/ppe.h>
+#include <PPE/ppe_porting.h>
+
+#if PPE_CONFIG_INCLUDE_SIMD == 1
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PPE_CLASSIFY_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PPE_CLASSIFY_NEON
+#endif
+#endif
+
+/*
+ * Ethertype lookup table. The order must match the indexes below.
+ */
+#define PPE_CLASSIFY_ETYPE_8021Q         0
+#define PPE_CLASSIFY_ETYPE_8021AD        1
+#define PPE_CLASSIFY_ETYPE_ARP           2
+#define PPE_CLASSIFY_ETYPE_IP4           3
+#define PPE_CLASSIFY_ETYPE_IP6           4
+#define PPE_CLASSIFY_ETYPE_LLDP          5
+#define PPE_CLASSIFY_ETYPE_SLOW          6
+#define PPE_CLASSIFY_ETYPE_CFM           7
+
+static const uint16_t ppe_classify_etypes__[8]
+#if defined(__GNUC__)
+__attribute__((aligned(16)))
+#endif
+= {
+    0x8100, 0x88A8, 0x0806, 0x0800, 0x86DD, 0x88CC, 0x8809, 0x8902
+};
+
+static inline int
+ppe_classify_etype__(uint16_t etype)
+{
+#if defined(PPE_CLASSIFY_SSE2)
+    __m128i table = _mm_load_si128((const __m128i*)ppe_classify_etypes__);
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(table,
+                                                 _mm_set1_epi16((short)etype)));
+    return mask ? __builtin_ctz(mask) >> 1 : -1;
+#elif defined(PPE_CLASSIFY_NEON)
+    uint16x8_t eq = vceqq_u16(vld1q_u16(ppe_classify_etypes__),
+                              vdupq_n_u16(etype));
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+    return mask ? __builtin_ctzll(mask) >> 3 : -1;
+#else
+    int i;
+    for(i = 0; i < 8; i++) {
+        if(ppe_classify_etypes__[i] == etype) {
+            return i;
+        }
+    }
+    return -1;
+#endif
+}
+
+#define RD16(_p, _o) ( (uint16_t)((_p)[_o] << 8 | (_p)[(_o)+1]) )
+
+/* Slow protocol subtypes */
+#define PPE_CLASSIFY_SLOW_LACP   1
+#define PPE_CLASSIFY_SLOW_OAM    3
+
+static inline int
+ppe_classify_dhcp_port__(uint16_t port)
+{
+    return port == 67 || port == 68 || port == 546 || port == 547;
+}
+
+int
+ppe_classify(const uint8_t* data, int size, ppe_classify_t* rv)
+{
+    uint8_t pad[PPE_CLASSIFY_WINDOW];
+    const uint8_t* p = data;
+    int off = 12;
+    int l4 = 0;
+    int idx;
+    uint16_t etype;
+
+    if(rv == NULL) {
+        return -1;
+    }
+    PPE_MEMSET(rv, 0, sizeof(*rv));
+
+    if(data == NULL || size < 14) {
+        return -1;
+    }
+
+    if(size < PPE_CLASSIFY_WINDOW) {
+        PPE_MEMCPY(pad, data, size);
+        PPE_MEMSET(pad + size, 0, sizeof(pad) - size);
+        p = pad;
+    }
+
+    etype = RD16(p, off);
+    idx = ppe_classify_etype__(etype);
+
+    /* Up to two VLAN tags, 802.1Q or 802.1ad */
+    while((idx == PPE_CLASSIFY_ETYPE_8021Q || idx == PPE_CLASSIFY_ETYPE_8021AD)
+          && rv->vlan_count < 2) {
+        rv->vlan[rv->vlan_count++] = RD16(p, off + 2) & 0xFFF;
+        off += 4;
+        etype = RD16(p, off);
+        idx = ppe_classify_etype__(etype);
+    }
+
+    if(etype < 0x600) {
+        /* 802.3 frame, no ethertype */
+        rv->l3_offset = off + 2;
+        return 0;
+    }
+
+    rv->ethertype = etype;
+    rv->l3_offset = off + 2;
+    p += rv->l3_offset;
+
+    switch(idx)
+        {
+        case PPE_CLASSIFY_ETYPE_ARP:
+            rv->pclass = PPE_CLASS_ARP;
+            return 0;
+        case PPE_CLASSIFY_ETYPE_LLDP:
+            rv->pclass = PPE_CLASS_LLDP;
+            return 0;
+        case PPE_CLASSIFY_ETYPE_CFM:
+            rv->pclass = PPE_CLASS_OAM;
+            return 0;
+        case PPE_CLASSIFY_ETYPE_SLOW:
+            if(p[0] == PPE_CLASSIFY_SLOW_LACP) {
+                rv->pclass = PPE_CLASS_LACP;
+            }
+            else if(p[0] == PPE_CLASSIFY_SLOW_OAM) {
+                rv->pclass = PPE_CLASS_OAM;
+            }
+            return 0;
+        case PPE_CLASSIFY_ETYPE_IP4:
+            rv->pclass = PPE_CLASS_IP4;
+            rv->ip_protocol = p[9];
+            if((p[0] & 0xF) < 5 || (RD16(p, 6) & 0x1FFF)) {
+                /* Bad header size or a non-initial fragment */
+                return 0;
+            }
+            l4 = rv->l3_offset + (p[0] & 0xF) * 4;
+            break;
+        case PPE_CLASSIFY_ETYPE_IP6:
+            rv->pclass = PPE_CLASS_IP6;
+            rv->ip_protocol = p[6];
+            l4 = rv->l3_offset + 40;
+            break;
+        default:
+            return 0;
+        }
+
+    if(rv->ip_protocol != PPE_IP_PROTOCOL_TCP &&
+       rv->ip_protocol != PPE_IP_PROTOCOL_UDP) {
+        return 0;
+    }
+    rv->l4_offset = l4;
+    if(l4 + 4 > PPE_CLASSIFY_WINDOW) {
+        /* Ports are past the window */
+        return 0;
+    }
+
+    p = (size < PPE_CLASSIFY_WINDOW) ? pad : data;
+    rv->l4_src_port = RD16(p, l4);
+    rv->l4_dst_port = RD16(p, l4 + 2);
+
+    if(rv->ip_protocol == PPE_IP_PROTOCOL_UDP &&
+       (ppe_classify_dhcp_port__(rv->l4_src_port) ||
+        ppe_classify_dhcp_port__(rv->l4_dst_port))) {
+        rv->pclass = PPE_CLASS_DHCP;
+    }
+    return 0;
+}
+
+int
+ppe_classify_batch(uint8_t* const* data, const int* sizes, int count,
+                   ppe_classify_t* rv)
+{
+    int i;
+    int classified = 0;
+
+    if(data == NULL || sizes == NULL || rv == NULL) {
+        return 0;
+    }
+
+    for(i = 0; i < count; i++) {
+#if defined(__GNUC__)
+        if(i + 1 < count) {
+            __builtin_prefetch(data[i+1]);
+        }
+#endif
+        if(ppe_classify(data[i], sizes[i], rv + i) == 0) {
+            classified++;
+        }
+    }
+    return classified;
+}
+
+static const char* ppe_class_names__[PPE_CLASS_COUNT] = {
+    "OTHER", "ARP", "LLDP", "LACP", "OAM", "DHCP", "IP4", "IP6"
+};
+
+const char*
+ppe_class_name(ppe_class_t pclass)
+{
+    if((int)pclass < 0 || pclass >= PPE_CLASS_COUNT) {
+        return "-invalid value for ppe_class";
+    }
+    return ppe_class_names__[pclass];
+}
@@ -74,6 +74,11 @@ ppe_config_settings_t ppe_config_settings[] =
     { __ppe_config_STRINGIFY_NAME(PPE_CONFIG_INCLUDE_UTM), __ppe_config_STRINGIFY_VALUE(PPE_CONFIG_INCLUDE_UTM) },
 #else
 { PPE_CONFIG_INCLUDE_UTM(__ppe_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef PPE_CONFIG_INCLUDE_SIMD
+    { __ppe_config_STRINGIFY_NAME(PPE_CONFIG_INCLUDE_SIMD), __ppe_config_STRINGIFY_VALUE(PPE_CONFIG_INCLUDE_SIMD) },
+#else
+{ PPE_CONFIG_INCLUDE_SIMD(__ppe_config_STRINGIFY_NAME), "__undefined__" },
 #endif
     { NULL, NULL }
 };
@@ -24,6 +24,7 @@
 #include <PPE/uCli/ppe_utm.h>
 #include <uCli/ucli_argparse.h>
 #include "ppe_util.h"
+#include <string.h>
 
 
 /**
@@ -371,6 +372,34 @@ ppe_ucli_utm__missing__(ucli_context_t* uc)
     }
 }
 
+static ucli_status_t
+ppe_ucli_utm__classify__(ucli_context_t* uc)
+{
+    char* cname;
+    int sport;
+    int dport;
+    ppe_classify_t pc;
+
+    UCLI_COMMAND_INFO(uc,
+                      "classify", 3,
+                      "Check the ppe_classify() class and L4 ports of the packet.");
+
+    UCLI_ARGPARSE_OR_RETURN(uc, "sii", &cname, &sport, &dport);
+
+    if(ppe_classify(ppec->ppep.data, ppec->ppep.size, &pc) < 0) {
+        return ucli_e_internal(uc, "ppe_classify()");
+    }
+    if(strcmp(cname, ppe_class_name(pc.pclass))) {
+        return ucli_error(uc, "class is %s, expected %s",
+                          ppe_class_name(pc.pclass), cname);
+    }
+    if(pc.l4_src_port != sport || pc.l4_dst_port != dport) {
+        return ucli_error(uc, "ports are %d/%d, expected %d/%d",
+                          pc.l4_src_port, pc.l4_dst_port, sport, dport);
+    }
+    return UCLI_STATUS_OK;
+}
+
 static ucli_status_t
 ppe_ucli_utm__checkf__(ucli_context_t* uc)
 {
@@ -720,6 +749,7 @@ static ucli_command_handler_f ppe_ucli_utm_handlers__[] =
     ppe_ucli_utm__dump__,
     ppe_ucli_utm__data__,
     ppe_ucli_utm__missing__,
+    ppe_ucli_utm__classify__,
     ppe_ucli_utm__checkf__,
     ppe_ucli_utm__check__,
     ppe_ucli_utm__checkw__,
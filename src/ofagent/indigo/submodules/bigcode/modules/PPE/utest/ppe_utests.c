@@ -459,6 +459,62 @@ ucli_block_t ppe_utests[] =
       "checkw DHCP_CHADDR == 000b8201fc4200000000000000000000", 
     },
   },
+  {
+    "CLASSIFY_ARP", 
+    {
+      "data {000000000001}{000000000002}{8100}{13FE}{0806}{00112233445566778899AABBCCDDEEFF}", 
+      "classify ARP 0 0", 
+    },
+  },
+  {
+    "CLASSIFY_LACP", 
+    {
+      "data 0180C2000002000E8316F5108809010101148000000E8316F500000D800000193C000000021480000013C4120F00000D800000160D0000000310800000000000000000000000000001020000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000", 
+      "classify LACP 0 0", 
+    },
+  },
+  {
+    "CLASSIFY_LLDP", 
+    {
+      "data 0180C200000E000130F9ADA088CC020704000130F9ADA0040405312F3106020078081753756D6D69743330302D34382D506F72742031303031000A0D53756D6D69743330302D3438000C4C53756D6D69743330302D3438202D2056657273696F6E20372E34652E3120284275696C642035292062792052656C656173655F4D61737465722030352F32372F30352030343A35333A3131000E0400140014100E0706000130F9ADA002000003E900FE0700120F02070100FE0900120F01036C000010FE0900120F030100000000FE0600120F0405F2FE060080C20101E8FE070080C202010000FE170080C20301E81076322D303438382D30332D3035303500FE050080C204000000", 
+      "classify LLDP 0 0", 
+    },
+  },
+  {
+    "CLASSIFY_DHCP", 
+    {
+      "data ffffffffffff000b8201fc4208004500012ca8360000fa11178b00000000ffffffff004400430118591f0101060000003d1d0000000000000000000000000000000000000000000b8201fc4200000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000638253633501013d0701000b8201fc4232040000000037040103062aff00000000000000", 
+      "classify DHCP 68 67", 
+    },
+  },
+  {
+    "CLASSIFY_ICMP", 
+    {
+      "data 005056e01449000c29340bde08004500003cd743000080012b73c0a89e8bae892a4d08002a5c020021006162636465666768696a6b6c6d6e6f7071727374757677616263646566676869", 
+      "classify IP4 0 0", 
+    },
+  },
+  {
+    "CLASSIFY_QINQ_UDP", 
+    {
+      "data {000000000001}{000000000002}{88A8}{0064}{8100}{03FE}{0800}{45000020}{00004000}{40110000}{0A000001}{0A000002}{04D2}{0DC8}{000C0000}", 
+      "classify IP4 1234 3528", 
+    },
+  },
+  {
+    "CLASSIFY_IP6_TCP", 
+    {
+      "data {000000000001}{000000000002}{86DD}{60000000}{00140640}{20010DB8000000000000000000000001}{20010DB8000000000000000000000002}{C350}{00B3}{0000000000000000}", 
+      "classify IP6 50000 179", 
+    },
+  },
+  {
+    "CLASSIFY_CFM", 
+    {
+      "data {0180C2000030}{000000000002}{8902}{00010446}{0000000000000000}", 
+      "classify OAM 0 0", 
+    },
+  },
   { (void*)0 }
 };
 int ppe_utests_count = sizeof(ppe_utests)/sizeof(ppe_utests[0]); 
@@ -31,6 +31,7 @@
 
 #include <VPI/vpi_config.h>
 #include <VPI/vpi_protocol.h>
+#include <sys/uio.h>
 
 /**
  * @brief Initialize the VPI module.
@@ -100,6 +101,29 @@ int vpi_unref(vpi_t vpi);
  */
 int vpi_send(vpi_t vpi, uint8_t* data, uint32_t size);
 
+/**
+ * A packet of a batch send, gathered from iovcnt buffers.
+ */
+typedef struct vpi_send_vec_s {
+    /** The packet buffers */
+    struct iovec* iov;
+    /** Number of buffers, at most VPI_CONFIG_SEND_IOV_MAX */
+    int iovcnt;
+} vpi_send_vec_t;
+
+/**
+ * @brief Send a batch of packets on a VPI
+ * @param vpi The VPI object.
+ * @param packets The packets.
+ * @param count The number of packets.
+ * @returns The number of packets sent, or -1 if none could be sent.
+ * @note Interfaces with a batch send hand each group of up to
+ * VPI_CONFIG_SEND_BATCH_MAX packets to the kernel in one call; the
+ * others send the packets one by one, without copying single-buffer
+ * packets. Listeners get the packets that were sent.
+ */
+int vpi_send_batch(vpi_t vpi, vpi_send_vec_t* packets, int count);
+
 
 /**************************************************************************//**
  *
@@ -238,6 +238,26 @@
 #define VPI_CONFIG_MAX_PACKET 10000
 #endif
 
+/**
+ * VPI_CONFIG_SEND_BATCH_MAX
+ *
+ * Maximum number of packets handed to an interface in one batch send. */
+
+
+#ifndef VPI_CONFIG_SEND_BATCH_MAX
+#define VPI_CONFIG_SEND_BATCH_MAX 32
+#endif
+
+/**
+ * VPI_CONFIG_SEND_IOV_MAX
+ *
+ * Maximum number of iovecs in one packet of a batch send. */
+
+
+#ifndef VPI_CONFIG_SEND_IOV_MAX
+#define VPI_CONFIG_SEND_IOV_MAX 8
+#endif
+
 /**
  * VPI_CONFIG_CREATE_SPEC_MAX
  *
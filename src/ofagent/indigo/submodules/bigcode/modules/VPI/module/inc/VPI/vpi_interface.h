@@ -106,6 +106,15 @@ struct vpi_interface_s {
     /** Cookie [Optional] */
     void* cookie;
 
+    /**
+     * Send a batch of packets on this interface [Optional]
+     *
+     * Returns the number of packets sent, or -1 if none could be sent.
+     * Packets are already in the VPI protocol format, if applicable.
+     */
+    int (*send_batch)(vpi_interface_t* vi, vpi_send_vec_t* packets,
+                      int count);
+
 };
 
 
@@ -74,6 +74,15 @@ typedef struct vpi_packet_s {
 vpi_packet_t*
 vpi_protocol_msg_create(vpi_header_t* hdr, uint8_t* data, int size);
 
+/**
+ * @brief Write the header of a VPI protocol message in network byte order.
+ * @param dst Receives the header; the message data follows it.
+ * @param hdr The VPI protocol header information.
+ * @param data_size The size of the message data.
+ */
+void
+vpi_protocol_hdr_pack(vpi_header_t* dst, vpi_header_t* hdr, int data_size);
+
 /**
  * @brief Free a VPI packet structure.
  * @param p The packet structure.
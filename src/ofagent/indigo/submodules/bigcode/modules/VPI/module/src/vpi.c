@@ -117,20 +117,14 @@ vpi_init(void)
 }
 
 static int
-vpi_destroy_locked_list__(biglist_locked_t* ll)
+vpi_destroy_list__(vpi_list_t* list)
 {
     /*
      * Destroy all VPI interfaces in the list
      */
-    biglist_t* ble;
-    biglist_lock(ll);
-    for(ble = ll->list; ble; ble = biglist_next(ble)) {
-        BIGLIST_GET_DATA(vpi_t, vpi, ble);
-        vpi_destroy__(vpi);
-    }
-    biglist_free(ll->list);
-    ll->list = NULL;
-    biglist_unlock(ll);
+    vpi_list_lock(list);
+    vpi_list_clear_locked(list, vpi_destroy__);
+    vpi_list_unlock(list);
     return 0;
 }
 
@@ -473,9 +467,9 @@ vpi_create__(const char* create_spec)
      */
     aim_snprintf(nvpi->name, sizeof(nvpi->name), "%s", nvpi->create_spec);
 
-    nvpi->recv_listeners = biglist_locked_create();
-    nvpi->send_listeners = biglist_locked_create();
-    nvpi->sendrecv_listeners = biglist_locked_create();
+    nvpi->recv_listeners = vpi_list_create();
+    nvpi->send_listeners = vpi_list_create();
+    nvpi->sendrecv_listeners = vpi_list_create();
 
     if ((rv = ic->creator(&nvpi->interface, args,
                           0, nvpi->name)) == 0) {
@@ -527,17 +521,33 @@ vpi_create__(const char* create_spec)
  *
  *****************************************************************************/
 static int
-vpi_send_list__(biglist_locked_t* ll, uint8_t* data, uint32_t len, int flag)
+vpi_send_list__(vpi_list_t* list, uint8_t* data, uint32_t len, int flag)
 {
-    biglist_t* ble;
-    biglist_lock(ll);
-    for(ble = ll->list; ble; ble = biglist_next(ble)) {
-        BIGLIST_GET_DATA(vpi_t, vpi, ble);
+    vpi_list_snapshot_t* snapshot = vpi_list_read_begin(list);
+    int i;
+    for(i = 0; snapshot && i < snapshot->count; i++) {
+        vpi_t vpi = snapshot->entries[i];
         vpi->interface->flags |= flag;
         vpi_send(vpi, data, len);
         vpi->interface->flags &= ~flag;
     }
-    biglist_unlock(ll);
+    vpi_list_read_end(list);
+    return 0;
+}
+
+static int
+vpi_send_list_batch__(vpi_list_t* list, vpi_send_vec_t* packets, int count,
+                      int flag)
+{
+    vpi_list_snapshot_t* snapshot = vpi_list_read_begin(list);
+    int i;
+    for(i = 0; snapshot && i < snapshot->count; i++) {
+        vpi_t vpi = snapshot->entries[i];
+        vpi->interface->flags |= flag;
+        vpi_send_batch(vpi, packets, count);
+        vpi->interface->flags &= ~flag;
+    }
+    vpi_list_read_end(list);
     return 0;
 }
 
@@ -597,11 +607,11 @@ vpi_send(vpi_t vpi, uint8_t* data, uint32_t len)
          * is intentionally supported. Allows permanent recv-only endpoints
          * with transient peers.
          */
-        if(rv >= 0 && vpi->send_listeners->list) {
+        if(rv >= 0 && !vpi_list_empty(vpi->send_listeners)) {
             vpi_send_list__(vpi->send_listeners, data, len,
                             VPI_INTERFACE_FLAG_SEND_LISTENING);
         }
-        if(rv >= 0 && vpi->sendrecv_listeners->list) {
+        if(rv >= 0 && !vpi_list_empty(vpi->sendrecv_listeners)) {
             vpi_send_list__(vpi->sendrecv_listeners, data, len,
                             VPI_INTERFACE_FLAG_SEND_LISTENING);
         }
@@ -612,6 +622,169 @@ vpi_send(vpi_t vpi, uint8_t* data, uint32_t len)
     }
 }
 
+/******************************************************************************
+ *
+ * Send a batch of packets on a VPI
+ *
+ *
+ *****************************************************************************/
+static int
+vpi_send_vec_length__(vpi_send_vec_t* packet)
+{
+    int i, len = 0;
+    for(i = 0; i < packet->iovcnt; i++) {
+        len += packet->iov[i].iov_len;
+    }
+    return len;
+}
+
+/*
+ * Gather a packet into buf.
+ * Returns the packet length, or -1 if it does not fit.
+ */
+static int
+vpi_send_vec_gather__(vpi_send_vec_t* packet, uint8_t* buf, int size)
+{
+    int i, len = 0;
+    for(i = 0; i < packet->iovcnt; i++) {
+        if(len + (int)packet->iov[i].iov_len > size) {
+            return -1;
+        }
+        VPI_MEMCPY(buf + len, packet->iov[i].iov_base, packet->iov[i].iov_len);
+        len += packet->iov[i].iov_len;
+    }
+    return len;
+}
+
+/*
+ * Send up to VPI_CONFIG_SEND_BATCH_MAX packets on the interface.
+ */
+static int
+vpi_send_batch__(vpi_t vpi, vpi_send_vec_t* packets, int count)
+{
+    vpi_interface_t* vi = vpi->interface;
+    vpi_header_t hdrs[VPI_CONFIG_SEND_BATCH_MAX];
+    struct iovec iovs[VPI_CONFIG_SEND_BATCH_MAX][VPI_CONFIG_SEND_IOV_MAX+1];
+    vpi_send_vec_t vecs[VPI_CONFIG_SEND_BATCH_MAX];
+    uint8_t buf[VPI_CONFIG_MAX_PACKET + sizeof(vpi_header_t)];
+    int i, len, rv;
+
+    if(vi->flags & VPI_INTERFACE_FLAG_PROTOCOL) {
+        /*
+         * Prepend the protocol header as a buffer of its own instead
+         * of copying the packet data behind it.
+         */
+        for(i = 0; i < count; i++) {
+            vpi_header_t hdr;
+            VPI_MEMSET(&hdr, 0, sizeof(hdr));
+            hdr.opcode = VPI_PROTOCOL_OPCODE_PACKET;
+            vpi_protocol_hdr_pack(&hdrs[i], &hdr,
+                                  vpi_send_vec_length__(&packets[i]));
+
+            iovs[i][0].iov_base = &hdrs[i];
+            iovs[i][0].iov_len = sizeof(hdrs[i]);
+            VPI_MEMCPY(&iovs[i][1], packets[i].iov,
+                       packets[i].iovcnt * sizeof(struct iovec));
+            vecs[i].iov = iovs[i];
+            vecs[i].iovcnt = packets[i].iovcnt + 1;
+        }
+        packets = vecs;
+    }
+
+    if(vi->send_batch) {
+        return vi->send_batch(vi, packets, count);
+    }
+
+    for(i = 0; i < count; i++) {
+        if(packets[i].iovcnt == 1) {
+            /* Send in place */
+            rv = vi->send(vi, packets[i].iov[0].iov_base,
+                          packets[i].iov[0].iov_len);
+        }
+        else if( (len = vpi_send_vec_gather__(&packets[i], buf,
+                                              sizeof(buf))) < 0) {
+            VPI_ERROR(vpi, "packet exceeds %d bytes.", VPI_CONFIG_MAX_PACKET);
+            rv = -1;
+        }
+        else {
+            rv = vi->send(vi, buf, len);
+        }
+
+        if(rv < 0) {
+            return (i > 0) ? i : -1;
+        }
+    }
+    return count;
+}
+
+int
+vpi_send_batch(vpi_t vpi, vpi_send_vec_t* packets, int count)
+{
+    int i, n, rv;
+    int sent = 0;
+    int valid = 0;
+
+    if(vpi == NULL || count < 0) {
+        return -1;
+    }
+
+    for(valid = 0; valid < count; valid++) {
+        if(packets[valid].iovcnt < 1 ||
+           packets[valid].iovcnt > VPI_CONFIG_SEND_IOV_MAX) {
+            VPI_ERROR(vpi, "packet %d has %d iovecs (max %d).", valid,
+                      packets[valid].iovcnt, VPI_CONFIG_SEND_IOV_MAX);
+            break;
+        }
+    }
+
+    if(AIM_LOG_CUSTOM_ENABLED(VPI_LOG_FLAG_SEND)) {
+        for(i = 0; i < valid; i++) {
+            int len = vpi_send_vec_length__(&packets[i]);
+            uint8_t* data = aim_malloc(len ? len : 1);
+            char* s;
+            vpi_send_vec_gather__(&packets[i], data, len);
+            s = aim_bytes_to_string(data, len, 0);
+            VPI_LOG_SEND(vpi, "%s", s);
+            AIM_FREE(s);
+            aim_free(data);
+        }
+    }
+
+    while(sent < valid) {
+        n = valid - sent;
+        if(n > VPI_CONFIG_SEND_BATCH_MAX) {
+            n = VPI_CONFIG_SEND_BATCH_MAX;
+        }
+
+        if(vpi->interface->send || vpi->interface->send_batch) {
+            rv = vpi_send_batch__(vpi, packets + sent, n);
+        }
+        else {
+            /* Recv-only endpoint; the listeners still get the packets */
+            rv = n;
+        }
+
+        if(rv <= 0) {
+            break;
+        }
+        sent += rv;
+        if(rv < n) {
+            break;
+        }
+    }
+
+    if(sent > 0 && !vpi_list_empty(vpi->send_listeners)) {
+        vpi_send_list_batch__(vpi->send_listeners, packets, sent,
+                              VPI_INTERFACE_FLAG_SEND_LISTENING);
+    }
+    if(sent > 0 && !vpi_list_empty(vpi->sendrecv_listeners)) {
+        vpi_send_list_batch__(vpi->sendrecv_listeners, packets, sent,
+                              VPI_INTERFACE_FLAG_SEND_LISTENING);
+    }
+
+    return (sent > 0 || count == 0) ? sent : -1;
+}
+
 /******************************************************************************
  *
  * Send an ioctl message on interfaces that support it.
@@ -823,11 +996,11 @@ vpi_recv(vpi_t vpi, uint8_t* data, uint32_t len, int block)
             }
         }
 
-        if(rv > 0 && vpi->recv_listeners->list) {
+        if(rv > 0 && !vpi_list_empty(vpi->recv_listeners)) {
             vpi_send_list__(vpi->recv_listeners, data, rv,
                             VPI_INTERFACE_FLAG_RECV_LISTENING);
         }
-        if(rv > 0 && vpi->sendrecv_listeners->list) {
+        if(rv > 0 && !vpi_list_empty(vpi->sendrecv_listeners)) {
             vpi_send_list__(vpi->sendrecv_listeners, data, rv,
                             VPI_INTERFACE_FLAG_RECV_LISTENING);
         }
@@ -917,12 +1090,9 @@ vpi_destroy__(vpi_t vpi)
             }
         }
 
-        biglist_locked_free_all(vpi->recv_listeners,
-                                (biglist_free_f)vpi_destroy__);
-        biglist_locked_free_all(vpi->send_listeners,
-                                (biglist_free_f)vpi_destroy__);
-        biglist_locked_free_all(vpi->sendrecv_listeners,
-                                (biglist_free_f)vpi_destroy__);
+        vpi_list_destroy(vpi->recv_listeners, vpi_destroy__);
+        vpi_list_destroy(vpi->send_listeners, vpi_destroy__);
+        vpi_list_destroy(vpi->sendrecv_listeners, vpi_destroy__);
         aim_free(vpi);
     }
     return 0;
@@ -996,40 +1166,49 @@ vpi_type_get(vpi_t vpi)
 }
 
 
-static vpi_t
-vpi_find_spec_locked__(biglist_t* vpi_list, const char* create_spec)
+static int
+vpi_add_listener__(vpi_list_t* list, vpi_t listener)
 {
-    biglist_t* ble;
-    for(ble = vpi_list; ble; ble = biglist_next(ble)) {
-        BIGLIST_GET_DATA(vpi_t, vpi, ble);
-        if(!VPI_STRCMP(create_spec, vpi->create_spec)) {
-            return vpi;
-        }
-    }
-    return NULL;
+    vpi_list_lock(list);
+    vpi_list_prepend_locked(list, listener);
+    vpi_list_unlock(list);
+    return 0;
 }
 
 static int
-vpi_add_listener_spec__(vpi_t vpi, biglist_locked_t* ll,
+vpi_remove_listener__(vpi_list_t* list, vpi_t listener)
+{
+    vpi_list_lock(list);
+    vpi_list_remove_locked(list, listener);
+    vpi_list_unlock(list);
+    return 0;
+}
+
+static int
+vpi_add_listener_spec__(vpi_t vpi, vpi_list_t* list,
                         const char* create_spec)
 {
+    vpi_t listener;
+
     AIM_REFERENCE(vpi);
-    biglist_lock(ll);
+    vpi_list_lock(list);
 
     /*
      * Listeners can only be added once.
      * Multiple adds of the same listener are allowed to refresh
      * timeouts.
      */
-    if(vpi_find_spec_locked__(ll->list, create_spec) == NULL) {
-        ll->list = biglist_prepend(ll->list, vpi_create__(create_spec));
+    if(vpi_list_find_spec_locked(list, create_spec) == NULL) {
+        if( (listener = vpi_create__(create_spec)) != NULL) {
+            vpi_list_prepend_locked(list, listener);
+        }
     }
-    biglist_unlock(ll);
+    vpi_list_unlock(list);
     return 0;
 }
 
 static int
-vpi_remove_listener_spec__(vpi_t vpi, biglist_locked_t* ll,
+vpi_remove_listener_spec__(vpi_t vpi, vpi_list_t* list,
                         const char* create_spec)
 {
     int rv = 0;
@@ -1037,14 +1216,15 @@ vpi_remove_listener_spec__(vpi_t vpi, biglist_locked_t* ll,
 
     AIM_REFERENCE(vpi);
 
-    biglist_lock(ll);
+    vpi_list_lock(list);
 
-    listener = vpi_find_spec_locked__(ll->list, create_spec);
+    listener = vpi_list_find_spec_locked(list, create_spec);
     if(listener) {
-        ll->list = biglist_remove(ll->list, listener);
+        /* No reader is left once the remove returns */
+        vpi_list_remove_locked(list, listener);
         rv = vpi_destroy(listener);
     }
-    biglist_unlock(ll);
+    vpi_list_unlock(list);
 
     return rv;
 }
@@ -1055,7 +1235,7 @@ vpi_remove_listener_spec__(vpi_t vpi, biglist_locked_t* ll,
 int
 vpi_add_recv_listener(vpi_t vpi, vpi_t listener)
 {
-    return (vpi) ? biglist_locked_prepend(vpi->recv_listeners, listener) : -1;
+    return (vpi) ? vpi_add_listener__(vpi->recv_listeners, listener) : -1;
 }
 
 int
@@ -1067,7 +1247,7 @@ vpi_add_recv_listener_spec(vpi_t vpi, const char* spec)
 int
 vpi_remove_recv_listener(vpi_t vpi, vpi_t listener)
 {
-    return (vpi) ? biglist_locked_remove(vpi->recv_listeners, listener) : -1;
+    return (vpi) ? vpi_remove_listener__(vpi->recv_listeners, listener) : -1;
 }
 
 int
@@ -1079,13 +1259,13 @@ vpi_remove_recv_listener_spec(vpi_t vpi, const char* spec)
 int
 vpi_recv_listener_count(vpi_t vpi)
 {
-    return (vpi) ? biglist_locked_length(vpi->recv_listeners) : -1;
+    return (vpi) ? vpi_list_length(vpi->recv_listeners) : -1;
 }
 
 int
 vpi_recv_listeners_drop(vpi_t vpi)
 {
-    return vpi_destroy_locked_list__(vpi->recv_listeners);
+    return vpi_destroy_list__(vpi->recv_listeners);
 }
 
 /**
@@ -1094,7 +1274,7 @@ vpi_recv_listeners_drop(vpi_t vpi)
 int
 vpi_add_send_listener(vpi_t vpi, vpi_t listener)
 {
-    return (vpi) ? biglist_locked_prepend(vpi->send_listeners, listener) : -1;
+    return (vpi) ? vpi_add_listener__(vpi->send_listeners, listener) : -1;
 }
 
 int
@@ -1112,19 +1292,19 @@ vpi_remove_send_listener_spec(vpi_t vpi, const char* create_spec)
 int
 vpi_remove_send_listener(vpi_t vpi, vpi_t listener)
 {
-    return (vpi) ? biglist_locked_remove(vpi->send_listeners, listener) : -1;
+    return (vpi) ? vpi_remove_listener__(vpi->send_listeners, listener) : -1;
 }
 
 int
 vpi_send_listener_count(vpi_t vpi)
 {
-    return (vpi) ? biglist_locked_length(vpi->send_listeners) : -1;
+    return (vpi) ? vpi_list_length(vpi->send_listeners) : -1;
 }
 
 int
 vpi_send_listeners_drop(vpi_t vpi)
 {
-    return vpi_destroy_locked_list__(vpi->send_listeners);
+    return vpi_destroy_list__(vpi->send_listeners);
 }
 
 /**
@@ -1133,7 +1313,7 @@ vpi_send_listeners_drop(vpi_t vpi)
 int
 vpi_add_sendrecv_listener(vpi_t vpi, vpi_t listener)
 {
-    return (vpi) ? biglist_locked_prepend(vpi->sendrecv_listeners, listener) : -1;
+    return (vpi) ? vpi_add_listener__(vpi->sendrecv_listeners, listener) : -1;
 }
 
 int
@@ -1151,19 +1331,19 @@ vpi_remove_sendrecv_listener_spec(vpi_t vpi, const char* create_spec)
 int
 vpi_remove_sendrecv_listener(vpi_t vpi, vpi_t listener)
 {
-    return (vpi) ? biglist_locked_remove(vpi->sendrecv_listeners, listener) : -1;
+    return (vpi) ? vpi_remove_listener__(vpi->sendrecv_listeners, listener) : -1;
 }
 
 int
 vpi_sendrecv_listener_count(vpi_t vpi)
 {
-    return (vpi) ? biglist_locked_length(vpi->sendrecv_listeners) : -1;
+    return (vpi) ? vpi_list_length(vpi->sendrecv_listeners) : -1;
 }
 
 int
 vpi_sendrecv_listeners_drop(vpi_t vpi)
 {
-    return vpi_destroy_locked_list__(vpi->sendrecv_listeners);
+    return vpi_destroy_list__(vpi->sendrecv_listeners);
 }
 
 void
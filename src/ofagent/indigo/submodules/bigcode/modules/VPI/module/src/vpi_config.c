@@ -124,6 +124,16 @@ vpi_config_settings_t vpi_config_settings[] =
 #else
 { VPI_CONFIG_MAX_PACKET(__vpi_config_STRINGIFY_NAME), "__undefined__" },
 #endif
+#ifdef VPI_CONFIG_SEND_BATCH_MAX
+    { __vpi_config_STRINGIFY_NAME(VPI_CONFIG_SEND_BATCH_MAX), __vpi_config_STRINGIFY_VALUE(VPI_CONFIG_SEND_BATCH_MAX) },
+#else
+{ VPI_CONFIG_SEND_BATCH_MAX(__vpi_config_STRINGIFY_NAME), "__undefined__" },
+#endif
+#ifdef VPI_CONFIG_SEND_IOV_MAX
+    { __vpi_config_STRINGIFY_NAME(VPI_CONFIG_SEND_IOV_MAX), __vpi_config_STRINGIFY_VALUE(VPI_CONFIG_SEND_IOV_MAX) },
+#else
+{ VPI_CONFIG_SEND_IOV_MAX(__vpi_config_STRINGIFY_NAME), "__undefined__" },
+#endif
 #ifdef VPI_CONFIG_CREATE_SPEC_MAX
     { __vpi_config_STRINGIFY_NAME(VPI_CONFIG_CREATE_SPEC_MAX), __vpi_config_STRINGIFY_VALUE(VPI_CONFIG_CREATE_SPEC_MAX) },
 #else
@@ -30,6 +30,60 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <semaphore.h>
+#include <pthread.h>
+
+
+/**************************************************************************//**
+ *
+ * Listener lists
+ *
+ * Readers walk an immutable snapshot of the list without taking a lock.
+ * Writers serialise on the list mutex, publish a new snapshot, and wait
+ * until no reader is left before freeing the old one or destroying a
+ * removed VPI. A list must not be changed while walking it.
+ *
+ *****************************************************************************/
+
+typedef struct vpi_list_snapshot_s {
+    int count;
+    vpi_t entries[];
+} vpi_list_snapshot_t;
+
+typedef struct vpi_list_s {
+    /* Current snapshot, NULL when empty */
+    vpi_list_snapshot_t* snapshot;
+    /* Readers walking any snapshot */
+    int readers;
+    /* Serialises writers */
+    pthread_mutex_t lock;
+} vpi_list_t;
+
+vpi_list_t* vpi_list_create(void);
+
+/* Destroy the list, calling free_f on each entry */
+void vpi_list_destroy(vpi_list_t* list, int (*free_f)(vpi_t vpi));
+
+/* Start walking the list; NULL if empty. Pair with vpi_list_read_end */
+vpi_list_snapshot_t* vpi_list_read_begin(vpi_list_t* list);
+void vpi_list_read_end(vpi_list_t* list);
+
+static inline int
+vpi_list_empty(vpi_list_t* list)
+{
+    return __atomic_load_n(&list->snapshot, __ATOMIC_RELAXED) == NULL;
+}
+
+int vpi_list_length(vpi_list_t* list);
+
+/* Writer side; all but lock/unlock require the lock */
+void vpi_list_lock(vpi_list_t* list);
+void vpi_list_unlock(vpi_list_t* list);
+vpi_t vpi_list_find_spec_locked(vpi_list_t* list, const char* create_spec);
+int vpi_list_prepend_locked(vpi_list_t* list, vpi_t vpi);
+/* Returns -1 if vpi is not in the list */
+int vpi_list_remove_locked(vpi_list_t* list, vpi_t vpi);
+/* Empty the list, calling free_f on each entry once no reader is left */
+void vpi_list_clear_locked(vpi_list_t* list, int (*free_f)(vpi_t vpi));
 
 
 struct vpi_s {
@@ -48,17 +102,15 @@ struct vpi_s {
     vpi_interface_t* interface;
     volatile void* cookie;
 
-    biglist_locked_t* recv_listeners;
-    biglist_locked_t* send_listeners;
-    biglist_locked_t* sendrecv_listeners;
+    vpi_list_t* recv_listeners;
+    vpi_list_t* send_listeners;
+    vpi_list_t* sendrecv_listeners;
 
     int ref_count;
 
     uint32_t flags;
 };
 
-#include <pthread.h>
-
 #define VPI_ARG_GET(_biglist) ( (char*)(_biglist->data))
 
 extern biglist_locked_t* vpi_instances__;
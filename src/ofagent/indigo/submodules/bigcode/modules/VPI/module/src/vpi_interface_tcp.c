@@ -33,6 +33,7 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -244,6 +245,7 @@ vpi_tcp_interface_create(vpi_interface_t** vi,
 
         /* Send interface is ready to go */
         nvi->interface.send = vpi_tcp_interface_send;
+        nvi->interface.send_batch = vpi_tcp_interface_send_batch;
         vpi_free_ip_endpoint(&send_endpoint);
     }
 
@@ -397,13 +399,25 @@ vpi_tcp_interface_recv_ready(vpi_interface_t* _vi)
     return descriptor_ready__(vi->listen_fd, 0);
 }
 
-int
-vpi_tcp_interface_send(vpi_interface_t* _vi, unsigned char* data, int len)
+/*
+ * Send one packet on a connection of its own, as the length followed by
+ * the data, in a single writev() where the socket allows it.
+ */
+static int
+send_iov__(vpi_interface_tcp_t* vi, struct iovec* iov, int iovcnt)
 {
-    VICAST(vi, _vi);
+    struct iovec wiov[VPI_CONFIG_SEND_IOV_MAX+2];
+    struct iovec* wp = wiov;
+    int wcnt = iovcnt + 1;
     int rv;
     int fd;
+    int len = 0;
     int net_len;
+    int i;
+
+    for(i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
 
     VPI_TRACE(vi, "creating socket.");
     /* Create a new socket for this transmit */
@@ -424,25 +438,68 @@ vpi_tcp_interface_send(vpi_interface_t* _vi, unsigned char* data, int len)
     }
     VPI_TRACE(vi, "Connected. Writing %d", len);
 
-    /* Write the total packet size */
+    /* The total packet size, then the packet data */
     net_len = htonl(len);
-    if( (rv = write(fd, &net_len, 4)) != 4) {
-        VPI_ERROR(vi, "write() failed: %s", strerror(errno));
-        close(fd);
-        return -1;
-    }
-    VPI_TRACE(vi, "writing packet data");
-    /* Write the packet data */
-    if( (rv = write(fd, data, len)) != len) {
-        VPI_ERROR(vi, "write() return %d: %s", rv, strerror(errno));
-        close(fd);
-        return -1;
+    wiov[0].iov_base = &net_len;
+    wiov[0].iov_len = 4;
+    VPI_MEMCPY(wiov + 1, iov, iovcnt * sizeof(struct iovec));
+
+    while(wcnt > 0) {
+        if( (rv = writev(fd, wp, wcnt)) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            VPI_ERROR(vi, "writev() failed: %s", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        /* Skip what was written */
+        while(wcnt > 0 && (size_t)rv >= wp->iov_len) {
+            rv -= wp->iov_len;
+            wp++;
+            wcnt--;
+        }
+        if(wcnt > 0) {
+            wp->iov_base = (char*)wp->iov_base + rv;
+            wp->iov_len -= rv;
+        }
     }
     VPI_TRACE(vi, "done.");
     close(fd);
     return len;
 }
 
+int
+vpi_tcp_interface_send(vpi_interface_t* _vi, unsigned char* data, int len)
+{
+    VICAST(vi, _vi);
+    struct iovec iov;
+
+    iov.iov_base = data;
+    iov.iov_len = len;
+    return send_iov__(vi, &iov, 1);
+}
+
+/*
+ * The TCP protocol uses a connection per packet, so a batch is only
+ * sent without gathering each packet into one buffer.
+ */
+int
+vpi_tcp_interface_send_batch(vpi_interface_t* _vi, vpi_send_vec_t* packets,
+                             int count)
+{
+    VICAST(vi, _vi);
+    int i;
+
+    for(i = 0; i < count; i++) {
+        if(packets[i].iovcnt > VPI_CONFIG_SEND_IOV_MAX+1 ||
+           send_iov__(vi, packets[i].iov, packets[i].iovcnt) < 0) {
+            break;
+        }
+    }
+    return (i > 0 || count == 0) ? i : -1;
+}
+
 int
 vpi_tcp_interface_destroy(vpi_interface_t* _vi)
 {
@@ -17,6 +17,11 @@
  *
  ***************************************************************/
 
+/* For sendmmsg() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "vpi_int.h"
 
 #if VPI_CONFIG_INCLUDE_INTERFACE_UDP == 1
@@ -331,6 +336,7 @@ vpi_udp_interface_create(vpi_interface_t** vi,
 
         /* Send interface is ready to go */
         nvi->interface.send = vpi_udp_interface_send;
+        nvi->interface.send_batch = vpi_udp_interface_send_batch;
     }
 
     if(recv_endpoint && send_endpoint) {
@@ -410,6 +416,55 @@ vpi_udp_interface_send(vpi_interface_t* _vi, unsigned char* data, int len)
     return rv;
 }
 
+/**************************************************************************//**
+ *
+ * Send a batch of packets to our peer with one sendmmsg() per
+ * VPI_CONFIG_SEND_BATCH_MAX packets.
+ *
+ *
+ *****************************************************************************/
+int
+vpi_udp_interface_send_batch(vpi_interface_t* _vi, vpi_send_vec_t* packets,
+                             int count)
+{
+    VICAST(vi, _vi);
+    struct mmsghdr msgs[VPI_CONFIG_SEND_BATCH_MAX];
+    int i, rv;
+    int sent = 0;
+
+    while(sent < count) {
+        int n = count - sent;
+        if(n > VPI_CONFIG_SEND_BATCH_MAX) {
+            n = VPI_CONFIG_SEND_BATCH_MAX;
+        }
+
+        VPI_MEMSET(msgs, 0, n * sizeof(msgs[0]));
+        for(i = 0; i < n; i++) {
+            msgs[i].msg_hdr.msg_name = &vi->sa_remote;
+            msgs[i].msg_hdr.msg_namelen = sizeof(vi->sa_remote);
+            msgs[i].msg_hdr.msg_iov = packets[sent+i].iov;
+            msgs[i].msg_hdr.msg_iovlen = packets[sent+i].iovcnt;
+        }
+
+        rv = sendmmsg(vi->fd, msgs, n, 0);
+        VPI_TRACE(vi, "sendmmsg(%d) = %d", n, rv);
+        if(rv < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            VPI_ERROR(vi, "sendmmsg() failed: %s", strerror(errno));
+            break;
+        }
+        if(rv == 0) {
+            break;
+        }
+        /* A partial send leaves the rest for the next call */
+        sent += rv;
+    }
+
+    return (sent > 0 || count == 0) ? sent : -1;
+}
+
 int
 vpi_udp_interface_destroy(vpi_interface_t* _vi)
 {
@@ -43,6 +43,8 @@ int vpi_udp_interface_create(vpi_interface_t** nvi, char* args[], int flags,
  * Interface vectors. These would not normally be called directly.
  */
 int vpi_udp_interface_send(vpi_interface_t* vi, unsigned char* data, int len);
+int vpi_udp_interface_send_batch(vpi_interface_t* vi, vpi_send_vec_t* packets,
+                                 int count);
 int vpi_udp_interface_recv(vpi_interface_t* vi, unsigned char* data, int len);
 int vpi_udp_interface_recv_ready(vpi_interface_t* vi);
 int vpi_udp_interface_descriptor(vpi_interface_t* vi);
@@ -0,0 +1,179 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ***************************************************************/
+
+/******************************************************************************
+ *
+ * Listener lists
+ *
+ * The packet paths only read these lists, while listeners come and go
+ * rarely, so readers never lock. A writer copies the snapshot with its
+ * change applied, publishes the copy, and then waits for the readers
+ * count to drop to zero: any reader still holding the old snapshot
+ * started before the publish.
+ *
+ *****************************************************************************/
+
+#include "vpi_int.h"
+#include "vpi_log.h"
+#include <sched.h>
+
+vpi_list_t*
+vpi_list_create(void)
+{
+    vpi_list_t* list = aim_zmalloc(sizeof(*list));
+    pthread_mutex_init(&list->lock, NULL);
+    return list;
+}
+
+void
+vpi_list_destroy(vpi_list_t* list, int (*free_f)(vpi_t vpi))
+{
+    if(list) {
+        vpi_list_lock(list);
+        vpi_list_clear_locked(list, free_f);
+        vpi_list_unlock(list);
+        pthread_mutex_destroy(&list->lock);
+        aim_free(list);
+    }
+}
+
+vpi_list_snapshot_t*
+vpi_list_read_begin(vpi_list_t* list)
+{
+    __atomic_add_fetch(&list->readers, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&list->snapshot, __ATOMIC_SEQ_CST);
+}
+
+void
+vpi_list_read_end(vpi_list_t* list)
+{
+    __atomic_sub_fetch(&list->readers, 1, __ATOMIC_SEQ_CST);
+}
+
+int
+vpi_list_length(vpi_list_t* list)
+{
+    vpi_list_snapshot_t* snapshot = vpi_list_read_begin(list);
+    int count = snapshot ? snapshot->count : 0;
+    vpi_list_read_end(list);
+    return count;
+}
+
+void
+vpi_list_lock(vpi_list_t* list)
+{
+    pthread_mutex_lock(&list->lock);
+}
+
+void
+vpi_list_unlock(vpi_list_t* list)
+{
+    pthread_mutex_unlock(&list->lock);
+}
+
+/*
+ * Publish a new snapshot and wait out the readers of the old one,
+ * which is returned to the caller to free.
+ */
+static vpi_list_snapshot_t*
+vpi_list_publish__(vpi_list_t* list, vpi_list_snapshot_t* snapshot)
+{
+    vpi_list_snapshot_t* old;
+
+    old = __atomic_exchange_n(&list->snapshot, snapshot, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&list->readers, __ATOMIC_SEQ_CST) != 0) {
+        sched_yield();
+    }
+    return old;
+}
+
+vpi_t
+vpi_list_find_spec_locked(vpi_list_t* list, const char* create_spec)
+{
+    vpi_list_snapshot_t* snapshot = list->snapshot;
+    int i;
+
+    for(i = 0; snapshot && i < snapshot->count; i++) {
+        if(!VPI_STRCMP(create_spec, snapshot->entries[i]->create_spec)) {
+            return snapshot->entries[i];
+        }
+    }
+    return NULL;
+}
+
+int
+vpi_list_prepend_locked(vpi_list_t* list, vpi_t vpi)
+{
+    vpi_list_snapshot_t* old = list->snapshot;
+    vpi_list_snapshot_t* snapshot;
+    int count = old ? old->count : 0;
+
+    snapshot = aim_malloc(sizeof(*snapshot) + (count + 1) * sizeof(vpi_t));
+    snapshot->count = count + 1;
+    snapshot->entries[0] = vpi;
+    if(count) {
+        VPI_MEMCPY(snapshot->entries + 1, old->entries, count * sizeof(vpi_t));
+    }
+
+    aim_free(vpi_list_publish__(list, snapshot));
+    return 0;
+}
+
+int
+vpi_list_remove_locked(vpi_list_t* list, vpi_t vpi)
+{
+    vpi_list_snapshot_t* old = list->snapshot;
+    vpi_list_snapshot_t* snapshot = NULL;
+    int i, j;
+
+    for(i = 0; old && i < old->count; i++) {
+        if(old->entries[i] == vpi) {
+            break;
+        }
+    }
+    if(old == NULL || i == old->count) {
+        return -1;
+    }
+
+    if(old->count > 1) {
+        snapshot = aim_malloc(sizeof(*snapshot) +
+                              (old->count - 1) * sizeof(vpi_t));
+        snapshot->count = old->count - 1;
+        for(i = 0, j = 0; i < old->count; i++) {
+            if(old->entries[i] != vpi) {
+                snapshot->entries[j++] = old->entries[i];
+            }
+        }
+    }
+
+    aim_free(vpi_list_publish__(list, snapshot));
+    return 0;
+}
+
+void
+vpi_list_clear_locked(vpi_list_t* list, int (*free_f)(vpi_t vpi))
+{
+    vpi_list_snapshot_t* old = vpi_list_publish__(list, NULL);
+    int i;
+
+    for(i = 0; old && i < old->count; i++) {
+        free_f(old->entries[i]);
+    }
+    aim_free(old);
+}
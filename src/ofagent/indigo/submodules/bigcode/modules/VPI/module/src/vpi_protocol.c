@@ -52,6 +52,14 @@ vpi_hdr_htonl__(vpi_header_t* dst, vpi_header_t* src)
 }
 
 
+void
+vpi_protocol_hdr_pack(vpi_header_t* dst, vpi_header_t* hdr, int data_size)
+{
+    hdr->payload_size = data_size;
+    hdr->message_size = data_size + sizeof(*hdr);
+    vpi_hdr_htonl__(dst, hdr);
+}
+
 vpi_packet_t*
 vpi_protocol_msg_create(vpi_header_t* hdr, uint8_t* data, int data_size)
 {
@@ -68,9 +76,7 @@ vpi_protocol_msg_create(vpi_header_t* hdr, uint8_t* data, int data_size)
         return NULL;
     }
 
-    hdr->payload_size = data_size;
-    hdr->message_size = data_size + sizeof(*hdr);
-    vpi_hdr_htonl__((vpi_header_t*)p->data, hdr);
+    vpi_protocol_hdr_pack((vpi_header_t*)p->data, hdr, data_size);
 
     if(data_size) {
         VPI_MEMCPY(p->data + sizeof(vpi_header_t), data, data_size);
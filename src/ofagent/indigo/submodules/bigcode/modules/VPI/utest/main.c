@@ -274,6 +274,87 @@ loopback_test__(void)
 
 #endif /* VPI_CONFIG_INCLUDE_INTERFACE_LOOPBACK */
 
+/*
+ * Send a batch of split packets from spec0 to spec1, with a send
+ * listener on listen_spec, received by listen_recv_spec.
+ *
+ * Everything is sent before anything is received, so this does not
+ * work for TCP, which accepts one connection per packet.
+ */
+static int
+batch_test__(const char* spec0, const char* spec1,
+             const char* listen_spec, const char* listen_recv_spec)
+{
+    int i, rv;
+    unsigned char hdr[4][6];
+    unsigned char body[4][40];
+    unsigned char data[64];
+    struct iovec iov[4][2];
+    vpi_send_vec_t packets[4];
+    vpi_t v0 = vpi_create(spec0);
+    vpi_t v1 = vpi_create(spec1);
+    vpi_t l = vpi_create(listen_recv_spec);
+
+    if(v0 == NULL || v1 == NULL || l == NULL) {
+        VPI_MERROR("batch create failed.");
+        goto batch_test__error;
+    }
+    vpi_add_send_listener_spec(v0, listen_spec);
+
+    for(i = 0; i < 4; i++) {
+        memset(hdr[i], i, sizeof(hdr[i]));
+        memset(body[i], 0x80 | i, sizeof(body[i]));
+        iov[i][0].iov_base = hdr[i];
+        iov[i][0].iov_len = sizeof(hdr[i]);
+        iov[i][1].iov_base = body[i];
+        iov[i][1].iov_len = sizeof(body[i]);
+        packets[i].iov = iov[i];
+        packets[i].iovcnt = 2;
+    }
+    /* The last packet is not split */
+    packets[3].iovcnt = 1;
+
+    if( (rv = vpi_send_batch(v0, packets, 4)) != 4) {
+        VPI_ERROR(v0, "batch send returned %d.", rv);
+        goto batch_test__error;
+    }
+
+    for(i = 0; i < 8; i++) {
+        vpi_t v = (i < 4) ? v1 : l;
+        int n = i % 4;
+        int len = (n < 3) ? sizeof(hdr[n]) + sizeof(body[n]) : sizeof(hdr[n]);
+
+        if( (rv = vpi_recv(v, data, sizeof(data), 1)) != len) {
+            VPI_ERROR(v, "recv of packet %d returned %d.", n, rv);
+            goto batch_test__error;
+        }
+        if(memcmp(data, hdr[n], sizeof(hdr[n])) != 0 ||
+           (n < 3 && memcmp(data + sizeof(hdr[n]), body[n],
+                            sizeof(body[n])) != 0)) {
+            VPI_ERROR(v, "recv data mismatch for packet %d.", n);
+            goto batch_test__error;
+        }
+    }
+
+    vpi_remove_send_listener_spec(v0, listen_spec);
+    if(vpi_send_listener_count(v0) != 0) {
+        VPI_ERROR(v0, "send listener was not removed.");
+        goto batch_test__error;
+    }
+
+    VPI_INFO(v0, "PASS.");
+    vpi_destroy(v0);
+    vpi_destroy(v1);
+    vpi_destroy(l);
+    return 0;
+
+ batch_test__error:
+    vpi_destroy(v0);
+    vpi_destroy(v1);
+    vpi_destroy(l);
+    return -1;
+}
+
 void
 makeveths__(void)
 {
@@ -373,6 +454,18 @@ main(int argc, char* argv[])
     }
 #endif
 
+#if VPI_CONFIG_INCLUDE_INTERFACE_UDP == 1
+    if(argc == 1 || strstr("udp|batch", argv[1])) {
+        test_count++;
+        if(batch_test__("udp|send:127.0.0.1:10021|recv:127.0.0.1:10020",
+                        "udp|recv:127.0.0.1:10021",
+                        "udp|send:127.0.0.1:10022",
+                        "udp|recv:127.0.0.1:10022") < 0) {
+            fail_count++;
+        }
+    }
+#endif
+
     /* Loopback Test */
     printf("\n*** Results, VPI loopback: %d PASSED, %d FAILED, %d TOTAL\n\n",
            test_count-fail_count, fail_count, test_count);
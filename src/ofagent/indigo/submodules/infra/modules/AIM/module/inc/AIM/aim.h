@@ -35,6 +35,7 @@
 #include <AIM/aim_pvs.h>
 #include <AIM/aim_pvs_file.h>
 #include <AIM/aim_pvs_buffer.h>
+#include <AIM/aim_pvs_chunked.h>
 #include <AIM/aim_valist.h>
 #include <AIM/aim_utils.h>
 #include <AIM/aim_string.h>
@@ -47,6 +48,7 @@
 #include <AIM/aim_bitmap.h>
 #include <AIM/aim_daemon.h>
 #include <AIM/aim_memory.h>
+#include <AIM/aim_trace.h>
 
 #endif /* __AIM_H__ */
 /*@}*/
@@ -122,6 +122,16 @@ struct aim_pvs_s;
 #define AIM_CONFIG_LOG_INCLUDE_TTY_COLOR AIM_CONFIG_PVS_INCLUDE_TTY
 #endif
 
+/**
+ * AIM_CONFIG_LOG_INCLUDE_TRACE
+ *
+ * Include verbose, trace and ftrace log messages. When 0 these are compiled out, along with AIM_TRACE() events. */
+
+
+#ifndef AIM_CONFIG_LOG_INCLUDE_TRACE
+#define AIM_CONFIG_LOG_INCLUDE_TRACE 1
+#endif
+
 /**
  * AIM_CONFIG_INCLUDE_MODULES_INIT
  *
@@ -196,7 +196,7 @@ typedef struct aim_log_s {
     /** AIM Options */
     uint32_t options;
 
-    /** Common flags */
+    /** Common flags. Change these through the setters below. */
     uint32_t common_flags;
 
     /** Custom flag map (optional) */
@@ -214,6 +214,14 @@ typedef struct aim_log_s {
     /** Internal */
     uint32_t env;
 
+    /**
+     * Internal: common flags which may be enabled. Never clear for a
+     * flag aim_log_enabled() would accept, so the log macros can test it
+     * inline before evaluating their arguments. Starts out as all ones
+     * until the first call into aim_log_enabled().
+     */
+    uint32_t enabled;
+
 } aim_log_t;
 
 /**
@@ -224,7 +232,7 @@ typedef struct aim_log_s {
     aim_log_t AIM_LOG_STRUCT = {                             \
         AIM_LOG_MODULE_NAME_STR,                             \
         _options, _common_flags, _custom_map, _custom_flags, \
-        &aim_pvs_stderr, NULL, 0                             \
+        &aim_pvs_stderr, NULL, 0, 0xFFFFFFFF                 \
     }
 
 /**
@@ -354,6 +362,13 @@ int aim_log_fid_set(aim_log_t* lobj, aim_log_flag_t fid, int value);
  */
 int aim_log_fid_set_all(aim_log_flag_t fid, int value);
 
+/**
+ * @brief Replace all common log flags.
+ * @param lobj The log object.
+ * @param flags The new common flag bits.
+ */
+int aim_log_common_flags_set(aim_log_t* lobj, uint32_t flags);
+
 
 
 /**
@@ -572,11 +587,37 @@ extern aim_log_t AIM_LOG_STRUCT;
 #define AIM_LOG_STRUCT_REGISTER() \
     aim_log_register(AIM_LOG_STRUCT_POINTER)
 
+/**
+ * Common flags which are compiled in.
+ */
+#if AIM_CONFIG_LOG_INCLUDE_TRACE == 1
+#define AIM_LOG_BITS_COMPILED 0xFFFFFFFF
+#else
+#define AIM_LOG_BITS_COMPILED                                           \
+    (~(AIM_LOG_BIT_VERBOSE | AIM_LOG_BIT_TRACE | AIM_LOG_BIT_FTRACE))
+#endif
+
+/**
+ * Inline filter for a log message (internal).
+ *
+ * Messages whose flag is compiled out fold to a constant zero. Otherwise
+ * only the module's cached enabled mask is read; MSG and FATAL are always
+ * output. Arguments are evaluated only when this passes.
+ */
+#define AIM_LOG_FLAG_ACTIVE__(_flag)                                    \
+    ((AIM_LOG_BITS_COMPILED & (1 << AIM_LOG_FLAG_##_flag)) &&          \
+     (AIM_LOG_FLAG_##_flag == AIM_LOG_FLAG_MSG ||                       \
+      AIM_LOG_FLAG_##_flag == AIM_LOG_FLAG_FATAL ||                     \
+      AIM_UNLIKELY(AIM_LOG_STRUCT.enabled &                             \
+                   (1 << AIM_LOG_FLAG_##_flag))))
+
 /**
  * Determine whether a log setting is enabled.
  */
 #define AIM_LOG_ENABLED(_flag)                                          \
-    aim_log_enabled(AIM_LOG_STRUCT_POINTER, AIM_LOG_FLAG_##_flag)
+    ((AIM_LOG_BITS_COMPILED & (1 << AIM_LOG_FLAG_##_flag)) &&          \
+     (AIM_LOG_STRUCT.enabled & (1 << AIM_LOG_FLAG_##_flag)) &&          \
+     aim_log_enabled(AIM_LOG_STRUCT_POINTER, AIM_LOG_FLAG_##_flag))
 
 /**
  * Determine whether a custom log setting is enabled.
@@ -599,11 +640,15 @@ extern aim_log_t AIM_LOG_STRUCT;
  * Issue a common log message with rate-limiting.
  */
 #define AIM_LOG_MOD_RL_COMMON(_flag, _rl, _time, ...)                   \
-    aim_log_common(AIM_LOG_STRUCT_POINTER, AIM_LOG_FLAG_##_flag,        \
-                   _rl, _time,                                          \
-                   __func__, __FILE__, __LINE__,                        \
-                   AIM_LOG_MODULE_NAME_STR AIM_LOG_PREFIX1 AIM_LOG_PREFIX2 \
-                   ": " #_flag ": " AIM_VA_ARGS_FIRST(__VA_ARGS__) AIM_VA_ARGS_REST(__VA_ARGS__))
+    do {                                                                \
+        if(AIM_LOG_FLAG_ACTIVE__(_flag)) {                              \
+            aim_log_common(AIM_LOG_STRUCT_POINTER, AIM_LOG_FLAG_##_flag, \
+                           _rl, _time,                                  \
+                           __func__, __FILE__, __LINE__,                \
+                           AIM_LOG_MODULE_NAME_STR AIM_LOG_PREFIX1 AIM_LOG_PREFIX2 \
+                           ": " #_flag ": " AIM_VA_ARGS_FIRST(__VA_ARGS__) AIM_VA_ARGS_REST(__VA_ARGS__)); \
+        }                                                               \
+    } while(0)
 
 /**
  * Issue a common log message, no rate limiting.
@@ -638,11 +683,15 @@ extern aim_log_t AIM_LOG_STRUCT;
  * Issue a common object log message with rate limiting.
  */
 #define AIM_LOG_OBJ_RL_COMMON(_obj, _flag, _rl, _time, ...)             \
-    aim_log_common(AIM_LOG_STRUCT_POINTER, AIM_LOG_FLAG_##_flag,        \
-                   _rl, _time,                                          \
-                   __func__, __FILE__, __LINE__,                        \
-                   AIM_LOG_MODULE_NAME_STR AIM_LOG_PREFIX1 AIM_LOG_PREFIX2 "(%s)" \
-                   ": " #_flag ": " AIM_VA_ARGS_FIRST(__VA_ARGS__),  (_obj)->log_string AIM_VA_ARGS_REST(__VA_ARGS__))
+    do {                                                                \
+        if(AIM_LOG_FLAG_ACTIVE__(_flag)) {                              \
+            aim_log_common(AIM_LOG_STRUCT_POINTER, AIM_LOG_FLAG_##_flag, \
+                           _rl, _time,                                  \
+                           __func__, __FILE__, __LINE__,                \
+                           AIM_LOG_MODULE_NAME_STR AIM_LOG_PREFIX1 AIM_LOG_PREFIX2 "(%s)" \
+                           ": " #_flag ": " AIM_VA_ARGS_FIRST(__VA_ARGS__),  (_obj)->log_string AIM_VA_ARGS_REST(__VA_ARGS__)); \
+        }                                                               \
+    } while(0)
 
 
 /**
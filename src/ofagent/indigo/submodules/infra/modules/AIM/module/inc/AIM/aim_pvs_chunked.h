@@ -0,0 +1,103 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+
+/**************************************************************************//**
+ *
+ *  /module/inc/AIM/aim_pvs_chunked.h
+ *
+ *
+ * @file
+ * @brief AIM Chunked PVS
+ *
+ * A chunked PVS formats output into a growable buffer and writes it to
+ * another PVS in chunks, so a large dump costs one write per chunk rather
+ * than one per aim_printf() call and format specifier.
+ *
+ * The field writers below append common fields without going through
+ * vsnprintf when the PVS is chunked, and fall back to printf-style output
+ * on any other PVS.
+ *
+ * @addtogroup aim-pvs-chunked
+ * @{
+ *
+ *****************************************************************************/
+#ifndef __AIM_PVS_CHUNKED_H__
+#define __AIM_PVS_CHUNKED_H__
+
+#include <AIM/aim_pvs.h>
+#include <stdint.h>
+
+/**
+ * Default chunk size.
+ */
+#define AIM_PVS_CHUNKED_DEFAULT_SIZE 16384
+
+/**
+ * @brief Create a PVS which buffers output for another PVS.
+ * @param dst The PVS the chunks are written to.
+ * @param chunk_size Buffered bytes that trigger a write, or 0 for
+ * AIM_PVS_CHUNKED_DEFAULT_SIZE.
+ * @note aim_pvs_destroy() writes out what is still buffered. The
+ * destination PVS is not destroyed.
+ */
+aim_pvs_t* aim_pvs_chunked_create(aim_pvs_t* dst, int chunk_size);
+
+/**
+ * @brief Write out all buffered output.
+ * @param pvs The chunked PVS.
+ */
+void aim_pvs_chunked_flush(aim_pvs_t* pvs);
+
+/**
+ * @brief Append raw bytes.
+ * @param pvs The PVS.
+ * @param data The bytes.
+ * @param len Number of bytes.
+ * @returns The number of bytes written.
+ */
+int aim_pvs_write(aim_pvs_t* pvs, const char* data, int len);
+
+/**
+ * @brief Append a NUL terminated string.
+ */
+int aim_pvs_puts(aim_pvs_t* pvs, const char* s);
+
+/**
+ * @brief Append an unsigned decimal integer.
+ */
+int aim_pvs_u64(aim_pvs_t* pvs, uint64_t value);
+
+/**
+ * @brief Append an integer as 0x followed by 16 hex digits.
+ */
+int aim_pvs_hex64(aim_pvs_t* pvs, uint64_t value);
+
+/**
+ * @brief Append a MAC address as xx:xx:xx:xx:xx:xx.
+ */
+int aim_pvs_mac(aim_pvs_t* pvs, const uint8_t mac[6]);
+
+/**
+ * @brief Append an IPv4 address, in host byte order, as a dotted quad.
+ */
+int aim_pvs_ipv4(aim_pvs_t* pvs, uint32_t ip);
+
+#endif /* __AIM_PVS_CHUNKED_H__ */
+/*@}*/
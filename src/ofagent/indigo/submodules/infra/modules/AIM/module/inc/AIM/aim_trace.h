@@ -0,0 +1,143 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**************************************************************************//**
+ *
+ * @file
+ * @brief AIM Binary Trace Rings
+ *
+ * A trace ring records fixed size binary events for paths which run
+ * too often for text logging. Writers never block or allocate: each
+ * event claims a slot with one atomic increment and overwrites the
+ * oldest record once the ring is full. Formatting is deferred until
+ * the ring is dumped.
+ *
+ * @addtogroup aim-trace
+ * @{
+ *
+ *****************************************************************************/
+#ifndef __AIM_TRACE_H__
+#define __AIM_TRACE_H__
+
+#include <AIM/aim_config.h>
+#include <AIM/aim_pvs.h>
+#include <AIM/aim_map.h>
+#include <AIM/aim_utils.h>
+
+/**
+ * A single trace event.
+ */
+typedef struct aim_trace_record_s {
+    /** Sequence number + 1 once written, 0 while being written. */
+    uint64_t seq;
+    /** Monotonic timestamp in nanoseconds (0 if unavailable). */
+    uint64_t timestamp;
+    /** Event id */
+    uint32_t id;
+    /** Event arguments */
+    uint32_t arg0;
+    uint64_t arg1;
+    uint64_t arg2;
+} aim_trace_record_t;
+
+/**
+ * Trace ring object.
+ */
+typedef struct aim_trace_ring_s {
+    /** Ring name, for dumps. */
+    const char* name;
+    /** Optional event id names, for dumps. */
+    aim_map_si_t* id_map;
+    /** Number of records, a power of 2. */
+    uint32_t size;
+    /** Next sequence number to claim. */
+    uint64_t head;
+    /** The records. */
+    aim_trace_record_t* records;
+} aim_trace_ring_t;
+
+
+/**
+ * @brief Create a trace ring.
+ * @param name The ring name.
+ * @param size The number of records, rounded up to a power of 2.
+ * @param id_map Optional map of event ids to names.
+ */
+aim_trace_ring_t* aim_trace_ring_create(const char* name, uint32_t size,
+                                        aim_map_si_t* id_map);
+
+/**
+ * @brief Destroy a trace ring.
+ * @param ring The trace ring.
+ */
+void aim_trace_ring_destroy(aim_trace_ring_t* ring);
+
+/**
+ * @brief The clock used for trace timestamps.
+ * @returns Monotonic time in nanoseconds, or 0 if unavailable.
+ */
+uint64_t aim_trace_now(void);
+
+/**
+ * @brief Record an event.
+ * @param ring The trace ring.
+ * @param id The event id.
+ * @param arg0 Event argument.
+ * @param arg1 Event argument.
+ * @param arg2 Event argument.
+ *
+ * Safe to call from any number of threads concurrently.
+ */
+void aim_trace_event(aim_trace_ring_t* ring, uint32_t id, uint32_t arg0,
+                     uint64_t arg1, uint64_t arg2);
+
+/**
+ * @brief Read the next event.
+ * @param ring The trace ring.
+ * @param cursor Sequence number to read from, advanced past the event
+ * returned. Start from 0. Events already overwritten are skipped.
+ * @param record (out) The event.
+ * @returns 1 if an event was read, 0 if there are no more events.
+ */
+int aim_trace_ring_read(aim_trace_ring_t* ring, uint64_t* cursor,
+                        aim_trace_record_t* record);
+
+/**
+ * @brief Dump the events currently in a ring, oldest first.
+ * @param ring The trace ring.
+ * @param pvs The output pvs.
+ */
+void aim_trace_ring_dump(aim_trace_ring_t* ring, aim_pvs_t* pvs);
+
+/**
+ * Record an event if the ring exists. Compiled out with trace logging.
+ */
+#if AIM_CONFIG_LOG_INCLUDE_TRACE == 1
+#define AIM_TRACE(_ring, _id, _arg0, _arg1, _arg2)                      \
+    do {                                                                \
+        if(AIM_LIKELY((_ring) != NULL)) {                               \
+            aim_trace_event(_ring, _id, _arg0, _arg1, _arg2);           \
+        }                                                               \
+    } while(0)
+#else
+#define AIM_TRACE(_ring, _id, _arg0, _arg1, _arg2) do { } while(0)
+#endif
+
+#endif /* __AIM_TRACE_H__ */
+/* @} */
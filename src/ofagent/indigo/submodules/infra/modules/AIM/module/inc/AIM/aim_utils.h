@@ -145,6 +145,17 @@
 #define AIM_BIT_GET(_src, _bit)                 \
     ( ((_src) & (1 << (_bit))) ? 1 : 0 )
 
+/**
+ * Branch prediction hints.
+ */
+#if defined(__GNUC__)
+#define AIM_LIKELY(_x) __builtin_expect(!!(_x), 1)
+#define AIM_UNLIKELY(_x) __builtin_expect(!!(_x), 0)
+#else
+#define AIM_LIKELY(_x) (_x)
+#define AIM_UNLIKELY(_x) (_x)
+#endif
+
 /**
  * Assert a condition at compile time.
  * The _name argument must be a valid C identifier and
@@ -77,6 +77,11 @@ aim_config_settings_t aim_config_settings[] =
 #else
 { AIM_CONFIG_LOG_INCLUDE_TTY_COLOR(__aim_config_STRINGIFY_NAME), "__undefined__" },
 #endif
+#ifdef AIM_CONFIG_LOG_INCLUDE_TRACE
+    { __aim_config_STRINGIFY_NAME(AIM_CONFIG_LOG_INCLUDE_TRACE), __aim_config_STRINGIFY_VALUE(AIM_CONFIG_LOG_INCLUDE_TRACE) },
+#else
+{ AIM_CONFIG_LOG_INCLUDE_TRACE(__aim_config_STRINGIFY_NAME), "__undefined__" },
+#endif
 #ifdef AIM_CONFIG_INCLUDE_MODULES_INIT
     { __aim_config_STRINGIFY_NAME(AIM_CONFIG_INCLUDE_MODULES_INIT), __aim_config_STRINGIFY_VALUE(AIM_CONFIG_INCLUDE_MODULES_INIT) },
 #else
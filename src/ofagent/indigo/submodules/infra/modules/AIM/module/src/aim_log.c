@@ -37,6 +37,29 @@
 static void aim_log_env_init__(aim_log_t* l);
 #endif
 
+/**
+ * Recompute the cached enabled mask after any change to the
+ * common flags or the pvs.
+ */
+static void
+aim_log_cache_update__(aim_log_t* l)
+{
+    l->enabled = (l->pvs) ? l->common_flags : 0;
+}
+
+/**
+ * First use of a log object.
+ */
+static void
+aim_log_init__(aim_log_t* l)
+{
+#if AIM_CONFIG_LOG_INCLUDE_ENV_VARIABLES == 1
+    aim_log_env_init__(l);
+#endif
+    l->env = 1;
+    aim_log_cache_update__(l);
+}
+
 /**
  * Log colors.
  * This is done functionality (instead of through a static array)
@@ -138,10 +161,7 @@ aim_log_register(aim_log_t* log)
     log->next = aim_log_list__;
     aim_log_list__ = log;
 
-#if AIM_CONFIG_LOG_INCLUDE_ENV_VARIABLES == 1
-    aim_log_env_init__(log);
-#endif
-
+    aim_log_init__(log);
 }
 
 /**
@@ -253,6 +273,7 @@ aim_log_pvs_set(aim_log_t* lobj, aim_pvs_t* pvs)
     if(lobj) {
         rv = lobj->pvs;
         lobj->pvs = pvs;
+        aim_log_cache_update__(lobj);
     }
     return rv;
 }
@@ -350,6 +371,7 @@ aim_log_flag_set(aim_log_t* lobj, const char* flag, int value)
         if(custom) {
             AIM_BITS_SET(lobj->custom_flags, custom, value);
         }
+        aim_log_cache_update__(lobj);
         return 1;
     }
     return 0;
@@ -373,6 +395,7 @@ aim_log_fid_set(aim_log_t* lobj, aim_log_flag_t fid, int value)
 {
     if(lobj) {
         AIM_BIT_SET(lobj->common_flags, fid, value);
+        aim_log_cache_update__(lobj);
         return 1;
     }
     return 0;
@@ -388,6 +411,20 @@ aim_log_fid_set_all(aim_log_flag_t fid, int value)
     return 0;
 }
 
+/**
+ * Replace the common log flags.
+ */
+int
+aim_log_common_flags_set(aim_log_t* lobj, uint32_t flags)
+{
+    if(lobj) {
+        lobj->common_flags = flags;
+        aim_log_cache_update__(lobj);
+        return 1;
+    }
+    return 0;
+}
+
 /**
  * Set a custom log flag.
  */
@@ -587,22 +624,18 @@ aim_log_env_init__(aim_log_t* l)
 int
 aim_log_enabled(aim_log_t* l, aim_log_flag_t flag)
 {
-#if AIM_CONFIG_LOG_INCLUDE_ENV_VARIABLES == 1
     if(l->env == 0) {
-        aim_log_env_init__(l);
+        aim_log_init__(l);
     }
-#endif
     return (l && l->pvs && AIM_BIT_GET(l->common_flags, flag));
 }
 
 int
 aim_log_custom_enabled(aim_log_t* l, int fid)
 {
-#if AIM_CONFIG_LOG_INCLUDE_ENV_VARIABLES == 1
     if(l->env == 0) {
-        aim_log_env_init__(l);
+        aim_log_init__(l);
     }
-#endif
     return (l && l->pvs && AIM_BIT_GET(l->custom_flags, fid));
 }
 
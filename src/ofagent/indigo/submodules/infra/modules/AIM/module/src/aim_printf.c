@@ -180,13 +180,20 @@ pull_format_argument__(const char* fmt, aim_va_list_t* vargs)
 int
 aim_vprintf(aim_pvs_t* pvs, const char* fmt, va_list _vargs)
 {
-    char* fmt_ = aim_strdup(fmt);
-    int   len = AIM_STRLEN(fmt);
+    char* fmt_;
+    int   len;
     const char* src;
     char* dst;
     int count = 0;
     aim_va_list_t vargs;
 
+    /* Without custom datatypes the format goes to the PVS in one call */
+    if(AIM_STRSTR(fmt, "%{") == NULL) {
+        return aim_pvs_vprintf(pvs, fmt, _vargs);
+    }
+
+    fmt_ = aim_strdup(fmt);
+    len = AIM_STRLEN(fmt);
     va_copy(vargs.val, _vargs);
 
 #define NEXT_TOKEN()                            \
@@ -196,6 +196,9 @@ aim_pvs_buffer_reset(aim_pvs_t* _pvs)
         aim_free(pvs->list);
         pvs->list = next;
     }
+    pvs->last = NULL;
+    pvs->next = NULL;
+    pvs->size = 0;
 }
 
 void
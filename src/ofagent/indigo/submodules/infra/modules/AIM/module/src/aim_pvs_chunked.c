@@ -0,0 +1,255 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+
+/**************************************************************************//**
+ *
+ * Chunked PVS and fast field writers.
+ *
+ *****************************************************************************/
+#include <AIM/aim_config.h>
+#include <AIM/aim_pvs.h>
+#include <AIM/aim_pvs_chunked.h>
+#include <AIM/aim_utils.h>
+#include <AIM/aim_string.h>
+#include <AIM/aim_memory.h>
+#include "aim_util.h"
+
+AIM_OBJECT_ID_DEFINE(aim_pvs_chunked_obj, "aim_pvs_chunked");
+
+typedef struct aim_pvs_chunked_s {
+    aim_pvs_t pvs;
+    aim_pvs_t* dst;
+    char* data;
+    int size;       /* Allocated bytes */
+    int len;        /* Buffered bytes */
+    int chunk_size;
+} aim_pvs_chunked_t;
+
+/**
+ * Room reserved past the chunk size, so that most writes fit without
+ * growing the buffer.
+ */
+#define AIM_PVS_CHUNKED_SLACK 1024
+
+static void aim_pvs_chunked_destroy__(aim_object_t* obj);
+
+static void
+reserve__(aim_pvs_chunked_t* pvs, int count)
+{
+    if(pvs->len + count > pvs->size) {
+        while(pvs->len + count > pvs->size) {
+            pvs->size *= 2;
+        }
+        pvs->data = aim_realloc(pvs->data, pvs->size);
+    }
+}
+
+static void
+written__(aim_pvs_chunked_t* pvs, int count)
+{
+    pvs->len += count;
+    if(pvs->len >= pvs->chunk_size) {
+        aim_pvs_chunked_flush(&pvs->pvs);
+    }
+}
+
+static int
+aim_pvs_chunked_vprintf__(aim_pvs_t* _pvs, const char* fmt, va_list vargs)
+{
+    aim_pvs_chunked_t* pvs = (aim_pvs_chunked_t*)_pvs;
+    int count;
+    va_list vacopy;
+
+    /* Format in place; only output larger than the free space is formatted twice */
+    va_copy(vacopy, vargs);
+    count = aim_vsnprintf(pvs->data + pvs->len, pvs->size - pvs->len,
+                          fmt, vacopy);
+    va_end(vacopy);
+
+    if(count < 0) {
+        return count;
+    }
+
+    if(count >= pvs->size - pvs->len) {
+        reserve__(pvs, count + 1);
+        aim_vsnprintf(pvs->data + pvs->len, pvs->size - pvs->len,
+                      fmt, vargs);
+    }
+
+    written__(pvs, count);
+    return count;
+}
+
+static int
+aim_pvs_chunked_isatty__(aim_pvs_t* _pvs)
+{
+    aim_pvs_chunked_t* pvs = (aim_pvs_chunked_t*)_pvs;
+    return aim_pvs_isatty(pvs->dst);
+}
+
+aim_pvs_t*
+aim_pvs_chunked_create(aim_pvs_t* dst, int chunk_size)
+{
+    aim_pvs_chunked_t* rv = aim_zmalloc(sizeof(*rv));
+
+    if(chunk_size <= 0) {
+        chunk_size = AIM_PVS_CHUNKED_DEFAULT_SIZE;
+    }
+
+    AIM_OBJECT_INIT(rv, aim_pvs_chunked_obj, 0, NULL, aim_pvs_chunked_destroy__);
+    rv->pvs.enabled = 1;
+    rv->pvs.vprintf = aim_pvs_chunked_vprintf__;
+    rv->pvs.isatty = aim_pvs_chunked_isatty__;
+    rv->pvs.description = "{chunked}";
+    rv->dst = dst;
+    rv->chunk_size = chunk_size;
+    rv->size = chunk_size + AIM_PVS_CHUNKED_SLACK;
+    rv->data = aim_zmalloc(rv->size);
+    return (aim_pvs_t*)rv;
+}
+
+void
+aim_pvs_chunked_flush(aim_pvs_t* _pvs)
+{
+    aim_pvs_chunked_t* pvs = (aim_pvs_chunked_t*)(_pvs);
+
+    if(AIM_OBJECT_IS_NOT(pvs, aim_pvs_chunked_obj)) {
+        return;
+    }
+
+    if(pvs->len > 0) {
+        aim_pvs_printf(pvs->dst, "%.*s", pvs->len, pvs->data);
+        pvs->len = 0;
+    }
+}
+
+static void
+aim_pvs_chunked_destroy__(aim_object_t* obj)
+{
+    aim_pvs_chunked_t* pvs = (aim_pvs_chunked_t*)obj;
+
+    aim_pvs_chunked_flush(&pvs->pvs);
+    aim_free(pvs->data);
+    aim_free(pvs);
+}
+
+int
+aim_pvs_write(aim_pvs_t* _pvs, const char* data, int len)
+{
+    aim_pvs_chunked_t* pvs = (aim_pvs_chunked_t*)(_pvs);
+
+    if(pvs == NULL || len <= 0) {
+        return 0;
+    }
+
+    if(AIM_OBJECT_IS_NOT(pvs, aim_pvs_chunked_obj)) {
+        return aim_pvs_printf(_pvs, "%.*s", len, data);
+    }
+
+    _pvs->counter++;
+    if(_pvs->enabled == 0) {
+        return 0;
+    }
+
+    reserve__(pvs, len);
+    AIM_MEMCPY(pvs->data + pvs->len, data, len);
+    written__(pvs, len);
+    return len;
+}
+
+int
+aim_pvs_puts(aim_pvs_t* pvs, const char* s)
+{
+    return aim_pvs_write(pvs, s, AIM_STRLEN(s));
+}
+
+static const char hex_digits__[] = "0123456789abcdef";
+
+/* Decimal digits of 'value' at the end of 'end'; returns the first digit */
+static char*
+u64_format__(char* end, uint64_t value)
+{
+    do {
+        *--end = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    return end;
+}
+
+int
+aim_pvs_u64(aim_pvs_t* pvs, uint64_t value)
+{
+    char buf[20];
+    char* p = u64_format__(buf + sizeof(buf), value);
+    return aim_pvs_write(pvs, p, buf + sizeof(buf) - p);
+}
+
+int
+aim_pvs_hex64(aim_pvs_t* pvs, uint64_t value)
+{
+    char buf[18];
+    int i;
+
+    buf[0] = '0';
+    buf[1] = 'x';
+    for(i = 17; i >= 2; i--) {
+        buf[i] = hex_digits__[value & 0xf];
+        value >>= 4;
+    }
+    return aim_pvs_write(pvs, buf, sizeof(buf));
+}
+
+int
+aim_pvs_mac(aim_pvs_t* pvs, const uint8_t mac[6])
+{
+    char buf[17];
+    char* p = buf;
+    int i;
+
+    for(i = 0; i < 6; i++) {
+        if(i) {
+            *p++ = ':';
+        }
+        *p++ = hex_digits__[mac[i] >> 4];
+        *p++ = hex_digits__[mac[i] & 0xf];
+    }
+    return aim_pvs_write(pvs, buf, sizeof(buf));
+}
+
+int
+aim_pvs_ipv4(aim_pvs_t* pvs, uint32_t ip)
+{
+    char buf[15];
+    char octet[3];
+    char* p = buf;
+    char* d;
+    int i;
+
+    for(i = 3; i >= 0; i--) {
+        d = u64_format__(octet + sizeof(octet), (ip >> (i * 8)) & 0xff);
+        while(d < octet + sizeof(octet)) {
+            *p++ = *d++;
+        }
+        if(i) {
+            *p++ = '.';
+        }
+    }
+    return aim_pvs_write(pvs, buf, p - buf);
+}
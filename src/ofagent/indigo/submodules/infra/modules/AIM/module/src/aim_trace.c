@@ -0,0 +1,173 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ *  /module/src/aim_trace.c
+ *
+ *  AIM Binary Trace Rings
+ *
+ *  Each record is published like a seqlock: the writer clears its
+ *  sequence, fills in the payload and then stores the new sequence with
+ *  release semantics. Readers accept a record only if the sequence is
+ *  the one expected both before and after copying it.
+ *
+ *****************************************************************************/
+#include <AIM/aim_config.h>
+#include <AIM/aim.h>
+#include <AIM/aim_trace.h>
+#include <inttypes.h>
+
+#if AIM_CONFIG_LOG_INCLUDE_LINUX_TIMESTAMP == 1
+#include <time.h>
+#endif
+
+uint64_t
+aim_trace_now(void)
+{
+#if AIM_CONFIG_LOG_INCLUDE_LINUX_TIMESTAMP == 1
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+aim_trace_ring_t*
+aim_trace_ring_create(const char* name, uint32_t size, aim_map_si_t* id_map)
+{
+    aim_trace_ring_t* ring;
+
+    if(size < 2) {
+        size = 2;
+    }
+    if(!aim_is_pow2_u32(size)) {
+        size = 1U << (aim_log2_u32(size) + 1);
+    }
+
+    ring = aim_zmalloc(sizeof(*ring));
+    ring->name = name;
+    ring->id_map = id_map;
+    ring->size = size;
+    ring->records = aim_zmalloc(sizeof(*ring->records) * size);
+    return ring;
+}
+
+void
+aim_trace_ring_destroy(aim_trace_ring_t* ring)
+{
+    if(ring) {
+        aim_free(ring->records);
+        aim_free(ring);
+    }
+}
+
+void
+aim_trace_event(aim_trace_ring_t* ring, uint32_t id, uint32_t arg0,
+                uint64_t arg1, uint64_t arg2)
+{
+    uint64_t seq = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    aim_trace_record_t* r = ring->records + (seq & (ring->size - 1));
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r->timestamp = aim_trace_now();
+    r->id = id;
+    r->arg0 = arg0;
+    r->arg1 = arg1;
+    r->arg2 = arg2;
+
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+int
+aim_trace_ring_read(aim_trace_ring_t* ring, uint64_t* cursor,
+                    aim_trace_record_t* record)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    while(*cursor < head) {
+        aim_trace_record_t* r;
+        uint64_t seq;
+
+        if(head - *cursor > ring->size) {
+            /* Overwritten */
+            *cursor = head - ring->size;
+        }
+
+        r = ring->records + (*cursor & (ring->size - 1));
+        seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+        if(seq == *cursor + 1) {
+            *record = *r;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq) {
+                (*cursor)++;
+                return 1;
+            }
+            /* Overwritten while copying */
+            (*cursor)++;
+        }
+        else if(seq > *cursor + 1) {
+            /* Already reused by a later event */
+            (*cursor)++;
+        }
+        else {
+            /* Claimed but not yet written */
+            break;
+        }
+    }
+    return 0;
+}
+
+void
+aim_trace_ring_dump(aim_trace_ring_t* ring, aim_pvs_t* pvs)
+{
+    aim_trace_record_t record;
+    uint64_t cursor = 0;
+    int count = 0;
+
+    aim_printf(pvs, "%s: size=%u events=%" PRIu64 "\n",
+               ring->name ? ring->name : "trace", ring->size,
+               __atomic_load_n(&ring->head, __ATOMIC_RELAXED));
+
+    while(aim_trace_ring_read(ring, &cursor, &record)) {
+        const char* name = NULL;
+        if(ring->id_map) {
+            aim_map_si_i(&name, record.id, ring->id_map, 0);
+        }
+        aim_printf(pvs, "%8" PRIu64 " %" PRIu64 ".%09" PRIu64 " ",
+                   record.seq - 1, record.timestamp / 1000000000ULL,
+                   record.timestamp % 1000000000ULL);
+        if(name) {
+            aim_printf(pvs, "%s", name);
+        }
+        else {
+            aim_printf(pvs, "%u", record.id);
+        }
+        aim_printf(pvs, " 0x%x 0x%" PRIx64 " 0x%" PRIx64 "\n",
+                   record.arg0, record.arg1, record.arg2);
+        count++;
+    }
+
+    if(count == 0) {
+        aim_printf(pvs, "none.\n");
+    }
+}
@@ -38,6 +38,8 @@
 AIM_LOG_STRUCT_DEFINE(1, 0xFFFF, NULL, 0);
 
 extern int utest_list(void);
+extern int utest_log(void);
+extern int utest_pvs(void);
 
 int aim_main(int argc, char* argv[])
 {
@@ -73,6 +75,8 @@ int aim_main(int argc, char* argv[])
     }
 
     utest_list();
+    utest_log();
+    utest_pvs();
 
     AIM_LOG_MSG("Should print 1-27");
     AIM_LOG_MSG("%d %d %d %d %d %d %d %d %d "
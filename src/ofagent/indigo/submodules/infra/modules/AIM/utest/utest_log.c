@@ -0,0 +1,152 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/******************************************************************************
+ *
+ *  log fast path and trace ring Unit Testing
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <AIM/aim.h>
+#include <AIM/aim_trace.h>
+
+#define AIM_LOG_MODULE_NAME aim_utest_log
+#include <AIM/aim_log.h>
+
+AIM_LOG_STRUCT_DEFINE(0, AIM_LOG_BITS_BASELINE, NULL, 0);
+
+static int evaluated;
+
+static int
+count_eval(void)
+{
+    return ++evaluated;
+}
+
+static aim_map_si_t trace_ids[] = {
+    { "rx", 1 },
+    { "tx", 2 },
+    { NULL, 0 }
+};
+
+int utest_log(void)
+{
+    aim_log_t* l = AIM_LOG_STRUCT_POINTER;
+    aim_pvs_t* pvs = aim_pvs_buffer_create();
+    char* s;
+
+    aim_log_pvs_set(l, pvs);
+
+    /* Disabled levels do not evaluate their arguments */
+    {
+        evaluated = 0;
+        AIM_LOG_TRACE("%d", count_eval());
+        AIM_LOG_VERBOSE("%d", count_eval());
+        assert(evaluated == 0);
+        assert(!AIM_LOG_ENABLED(TRACE));
+
+        AIM_LOG_ERROR("%d", count_eval());
+        assert(evaluated == 1);
+    }
+
+    /* Cache follows the setters */
+    {
+        evaluated = 0;
+        aim_log_fid_set(l, AIM_LOG_FLAG_TRACE, 1);
+#if AIM_CONFIG_LOG_INCLUDE_TRACE == 1
+        assert(AIM_LOG_ENABLED(TRACE));
+        AIM_LOG_TRACE("%d", count_eval());
+        assert(evaluated == 1);
+#endif
+        aim_log_flag_set(l, "trace", 0);
+        AIM_LOG_TRACE("%d", count_eval());
+        assert(!AIM_LOG_ENABLED(TRACE));
+
+        aim_log_common_flags_set(l, 0);
+        AIM_LOG_ERROR("%d", count_eval());
+        AIM_LOG_MSG("%d", count_eval());
+#if AIM_CONFIG_LOG_INCLUDE_TRACE == 1
+        assert(evaluated == 2);
+#else
+        assert(evaluated == 1);
+#endif
+        aim_log_common_flags_set(l, AIM_LOG_BITS_BASELINE);
+    }
+
+    /* No pvs, nothing enabled */
+    {
+        evaluated = 0;
+        aim_log_pvs_set(l, NULL);
+        assert(!AIM_LOG_ENABLED(ERROR));
+        AIM_LOG_ERROR("%d", count_eval());
+        assert(evaluated == 0);
+        aim_log_pvs_set(l, pvs);
+    }
+
+    s = aim_pvs_buffer_get(pvs);
+    assert(strstr(s, "ERROR: 1"));
+    aim_free(s);
+    aim_log_pvs_set(l, NULL);
+    aim_pvs_destroy(pvs);
+
+    /* Trace ring wraps and keeps the newest records */
+    {
+        aim_trace_ring_t* ring = aim_trace_ring_create("utest", 5, trace_ids);
+        aim_trace_record_t record;
+        uint64_t cursor = 0;
+        int i;
+
+        assert(ring->size == 8);
+        assert(aim_trace_ring_read(ring, &cursor, &record) == 0);
+
+        for(i = 0; i < 10; i++) {
+            AIM_TRACE(ring, 1 + (i & 1), i, i * 2, i * 3);
+        }
+
+#if AIM_CONFIG_LOG_INCLUDE_TRACE == 1
+        for(i = 2; i < 10; i++) {
+            assert(aim_trace_ring_read(ring, &cursor, &record) == 1);
+            assert(record.seq == (uint64_t)i + 1);
+            assert(record.id == 1 + (i & 1));
+            assert(record.arg0 == (uint32_t)i);
+            assert(record.arg1 == (uint64_t)i * 2);
+            assert(record.arg2 == (uint64_t)i * 3);
+        }
+        assert(cursor == 10);
+#endif
+        assert(aim_trace_ring_read(ring, &cursor, &record) == 0);
+
+        pvs = aim_pvs_buffer_create();
+        aim_trace_ring_dump(ring, pvs);
+        s = aim_pvs_buffer_get(pvs);
+#if AIM_CONFIG_LOG_INCLUDE_TRACE == 1
+        assert(strstr(s, " tx 0x9 0x12 0x1b"));
+#endif
+        aim_free(s);
+        aim_pvs_destroy(pvs);
+
+        aim_trace_ring_destroy(ring);
+    }
+
+    return 0;
+}
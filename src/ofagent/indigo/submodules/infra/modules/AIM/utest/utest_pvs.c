@@ -0,0 +1,91 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+
+/******************************************************************************
+ *
+ *  chunked pvs Unit Testing
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <AIM/aim.h>
+
+int utest_pvs(void)
+{
+    aim_pvs_t* dst = aim_pvs_buffer_create();
+    aim_pvs_t* pvs = aim_pvs_chunked_create(dst, 64);
+    uint8_t mac[6] = { 0x00, 0x1b, 0xa0, 0xff, 0x0c, 0x09 };
+    char big[200];
+    char* s;
+    int i;
+
+    /* Buffered until flushed */
+    aim_printf(pvs, "%d-%s ", 42, "x");
+    aim_pvs_u64(pvs, 0);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_u64(pvs, 18446744073709551615ULL);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_hex64(pvs, 0xabcULL);
+    assert(aim_pvs_buffer_size(dst) == 0);
+    aim_pvs_chunked_flush(pvs);
+    s = aim_pvs_buffer_get(dst);
+    assert(!strcmp(s, "42-x 0 18446744073709551615 0x0000000000000abc"));
+    aim_free(s);
+    aim_pvs_buffer_reset(dst);
+
+    aim_pvs_mac(pvs, mac);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_ipv4(pvs, 0x0a00ff01);
+    aim_pvs_puts(pvs, " ");
+    aim_pvs_ipv4(pvs, 0);
+    aim_pvs_chunked_flush(pvs);
+    s = aim_pvs_buffer_get(dst);
+    assert(!strcmp(s, "00:1b:a0:ff:0c:09 10.0.255.1 0.0.0.0"));
+    aim_free(s);
+    aim_pvs_buffer_reset(dst);
+
+    /* Written out in chunks once full, and output larger than the buffer */
+    memset(big, 'a', sizeof(big) - 1);
+    big[sizeof(big) - 1] = 0;
+    for(i = 0; i < 10; i++) {
+        aim_printf(pvs, "%d", i);
+    }
+    assert(aim_pvs_buffer_size(dst) == 0);
+    aim_printf(pvs, "%s", big);
+    assert(aim_pvs_buffer_size(dst) == 10 + 199);
+    aim_pvs_puts(pvs, "end");
+    aim_pvs_destroy(pvs);
+    assert(aim_pvs_buffer_size(dst) == 10 + 199 + 3);
+    aim_pvs_buffer_reset(dst);
+
+    /* The field writers work on any pvs */
+    aim_pvs_hex64(dst, 1);
+    aim_pvs_puts(dst, " ");
+    aim_pvs_ipv4(dst, 0xc0a80001);
+    s = aim_pvs_buffer_get(dst);
+    assert(!strcmp(s, "0x0000000000000001 192.168.0.1"));
+    aim_free(s);
+    aim_pvs_destroy(dst);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_l2_learn.h
+*
+* @purpose      Wire format of the MAC learning summaries
+*
+* @component    OF-DPA
+*
+* @comments     The summary is an asynchronous OF-DPA experimenter message
+*               (experimenter 0x1018) sent after each learning batch that
+*               learned, moved or aged out a MAC address. Its data is laid
+*               out as below, all fields in network byte order.
+*
+*               learned (4), moved (4), aged (4), records (2), flags (2),
+*               then one record per learned or moved address:
+*               VLAN id (2), flags (2), port (4), MAC address (6),
+*               reserved (2)
+*
+*               The counts cover the whole batch. At most
+*               IND_OFDPA_L2_LEARN_NOTIFY_RECORDS records are carried; the
+*               TRUNCATED flag is set when there were more.
+*
+* @create       14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_IND_OFDPA_L2_LEARN_H
+#define INCLUDE_IND_OFDPA_L2_LEARN_H
+
+#define IND_OFDPA_L2_LEARN_NOTIFY_EXPERIMENTER  0x1018
+#define IND_OFDPA_L2_LEARN_NOTIFY_SUBTYPE       0x21
+
+#define IND_OFDPA_L2_LEARN_NOTIFY_HDR_LEN       16
+#define IND_OFDPA_L2_LEARN_NOTIFY_RECORD_LEN    16
+#define IND_OFDPA_L2_LEARN_NOTIFY_RECORDS       64
+
+/* Summary flags */
+#define IND_OFDPA_L2_LEARN_NOTIFY_TRUNCATED     0x1
+
+/* Record flags */
+#define IND_OFDPA_L2_LEARN_RECORD_MOVED         0x1
+
+#endif /* INCLUDE_IND_OFDPA_L2_LEARN_H */
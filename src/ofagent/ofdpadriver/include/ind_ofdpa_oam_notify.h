@@ -0,0 +1,67 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_oam_notify.h
+*
+* @purpose      Wire format of the OAM fault notifications
+*
+* @component    OF-DPA
+*
+* @comments     The notification is an asynchronous OF-DPA experimenter
+*               message (experimenter 0x1018) whose data is laid out as
+*               below. All fields are in network byte order.
+*
+*               reason (2), reserved (2), local MEP id (4), MEG index (4),
+*               OAM event mask (4), remote MEPs (2), remote MEPs up (2),
+*               remote MEPs failed (2), reserved (2), detect time (8),
+*               send time (8)
+*
+*               A REMOTE notification is sent when the walk of the MEP
+*               finds its remote MEP state changed; the MEG index and event
+*               mask are 0. An EVENT notification is sent for each OF-DPA
+*               OAM event; the remote MEP counts are those of the last
+*               walk. FAILOVER and RESTORE notifications are sent after
+*               the agent set the liveness port of a protected MEP down or
+*               up again; the MEG index field holds the liveness port and
+*               the event mask is 0.
+*
+*               The detect time is when the agent read the state or
+*               received the event, the send time when the message was
+*               queued to the controllers, both in microseconds since the
+*               epoch.
+*
+* @create       14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_IND_OFDPA_OAM_NOTIFY_H
+#define INCLUDE_IND_OFDPA_OAM_NOTIFY_H
+
+#define IND_OFDPA_OAM_NOTIFY_EXPERIMENTER  0x1018
+#define IND_OFDPA_OAM_NOTIFY_SUBTYPE       0x20
+
+#define IND_OFDPA_OAM_NOTIFY_LEN           40
+
+/* Notification reasons */
+#define IND_OFDPA_OAM_NOTIFY_REMOTE        1
+#define IND_OFDPA_OAM_NOTIFY_EVENT         2
+#define IND_OFDPA_OAM_NOTIFY_FAILOVER      3
+#define IND_OFDPA_OAM_NOTIFY_RESTORE       4
+
+#endif /* INCLUDE_IND_OFDPA_OAM_NOTIFY_H */
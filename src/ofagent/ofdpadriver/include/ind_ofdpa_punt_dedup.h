@@ -0,0 +1,59 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_punt_dedup.h
+*
+* @purpose      Wire format of the duplicate punt summaries
+*
+* @component    OF-DPA
+*
+* @comments     The summary is an asynchronous OF-DPA experimenter message
+*               (experimenter 0x1018) sent every
+*               IND_OFDPA_PUNT_DEDUP_NOTIFY_MS in which duplicate punts
+*               were dropped. Its data is laid out as below, all fields in
+*               network byte order.
+*
+*               dropped (4), window in ms (4), records (2), flags (2),
+*               reserved (4), then one record per port that dropped
+*               duplicates: port (4), dropped (4)
+*
+*               The counts cover the time since the previous summary.
+*               At most IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORDS records are
+*               carried; the TRUNCATED flag is set when there were more.
+*
+* @create       14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_IND_OFDPA_PUNT_DEDUP_H
+#define INCLUDE_IND_OFDPA_PUNT_DEDUP_H
+
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_EXPERIMENTER  0x1018
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_SUBTYPE       0x22
+
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_MS            1000
+
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_HDR_LEN       16
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORD_LEN    8
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORDS       64
+
+/* Summary flags */
+#define IND_OFDPA_PUNT_DEDUP_NOTIFY_TRUNCATED     0x1
+
+#endif /* INCLUDE_IND_OFDPA_PUNT_DEDUP_H */
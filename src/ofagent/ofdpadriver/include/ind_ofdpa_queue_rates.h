@@ -0,0 +1,56 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_queue_rates.h
+*
+* @purpose      Wire format of the bulk queue rate message
+*
+* @component    OF-DPA
+*
+* @comments     The message is an OF-DPA experimenter message (experimenter
+*               0x1018) from the controller setting the minimum and
+*               maximum rates of any number of port queues at once. Its
+*               data is laid out as below, all fields in network byte
+*               order.
+*
+*               count (4), reserved (4), then count records:
+*               port (4), queue id (4), min rate (4), max rate (4)
+*
+*               The whole message is checked before any rate is set. A
+*               record failing to apply does not stop the ones after it;
+*               a single queue operation error is returned for the
+*               message if any did.
+*
+* @create       15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_IND_OFDPA_QUEUE_RATES_H
+#define INCLUDE_IND_OFDPA_QUEUE_RATES_H
+
+#define IND_OFDPA_QUEUE_RATES_EXPERIMENTER  0x1018
+#define IND_OFDPA_QUEUE_RATES_SUBTYPE       0x23
+
+/* Offset of the data in the OpenFlow 1.3 message */
+#define IND_OFDPA_QUEUE_RATES_DATA_OFFSET   16
+
+#define IND_OFDPA_QUEUE_RATES_HDR_LEN       8
+#define IND_OFDPA_QUEUE_RATES_RECORD_LEN    16
+
+#endif /* INCLUDE_IND_OFDPA_QUEUE_RATES_H */
@@ -0,0 +1,169 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_spsc.h
+*
+* @purpose      Lock-free single producer, single consumer queue
+*
+* @component    OF-DPA
+*
+* @comments     Fixed size elements are copied in and out of a ring of
+*               slots, or filled and read in place with reserve/commit and
+*               peek/release. Exactly one thread may push and exactly one
+*               thread may pop. The producer only writes tail and the consumer
+*               only writes head, so no lock is needed.
+*
+* @create       14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_IND_OFDPA_SPSC_H
+#define INCLUDE_IND_OFDPA_SPSC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/error.h"
+
+#define IND_OFDPA_SPSC_CACHE_LINE 64
+
+typedef struct
+{
+  uint32_t size;             /* number of slots, a power of 2 */
+  uint32_t elemSize;
+  uint8_t *slots;
+  /* Kept on separate cache lines so producer and consumer do not share one */
+  uint32_t head __attribute__((aligned(IND_OFDPA_SPSC_CACHE_LINE)));  /* next slot popped */
+  uint32_t tail __attribute__((aligned(IND_OFDPA_SPSC_CACHE_LINE)));  /* next slot pushed */
+} ind_ofdpa_spsc_t;
+
+/* Size is rounded up to a power of 2 */
+static inline indigo_error_t ind_ofdpa_spsc_init(ind_ofdpa_spsc_t *q,
+                                                 uint32_t size, uint32_t elemSize)
+{
+  uint32_t slots = 1;
+
+  while (slots < size)
+  {
+    slots <<= 1;
+  }
+
+  memset(q, 0, sizeof(*q));
+  q->slots = calloc(slots, elemSize);
+  if (q->slots == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  q->size = slots;
+  q->elemSize = elemSize;
+
+  return INDIGO_ERROR_NONE;
+}
+
+static inline void ind_ofdpa_spsc_free(ind_ofdpa_spsc_t *q)
+{
+  free(q->slots);
+  q->slots = NULL;
+  q->size = 0;
+}
+
+/* Producer side. Returns 0 if the queue is full. */
+static inline int ind_ofdpa_spsc_push(ind_ofdpa_spsc_t *q, const void *elem)
+{
+  uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+  if ((tail - head) == q->size)
+  {
+    return 0;
+  }
+
+  memcpy(q->slots + ((tail & (q->size - 1)) * q->elemSize), elem, q->elemSize);
+  __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+/* Consumer side. Returns 0 if the queue is empty. */
+static inline int ind_ofdpa_spsc_pop(ind_ofdpa_spsc_t *q, void *elem)
+{
+  uint32_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+  if (head == tail)
+  {
+    return 0;
+  }
+
+  memcpy(elem, q->slots + ((head & (q->size - 1)) * q->elemSize), q->elemSize);
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+
+  return 1;
+}
+
+/* Producer side. Slot to fill in place and then push with
+   ind_ofdpa_spsc_commit, or NULL if the queue is full. */
+static inline void *ind_ofdpa_spsc_reserve(ind_ofdpa_spsc_t *q)
+{
+  uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+  if ((tail - head) == q->size)
+  {
+    return NULL;
+  }
+
+  return q->slots + ((tail & (q->size - 1)) * q->elemSize);
+}
+
+static inline void ind_ofdpa_spsc_commit(ind_ofdpa_spsc_t *q)
+{
+  __atomic_store_n(&q->tail, __atomic_load_n(&q->tail, __ATOMIC_RELAXED) + 1,
+                   __ATOMIC_RELEASE);
+}
+
+/* Consumer side. Oldest slot, read in place until ind_ofdpa_spsc_release,
+   or NULL if the queue is empty. */
+static inline void *ind_ofdpa_spsc_peek(ind_ofdpa_spsc_t *q)
+{
+  uint32_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+  if (head == tail)
+  {
+    return NULL;
+  }
+
+  return q->slots + ((head & (q->size - 1)) * q->elemSize);
+}
+
+static inline void ind_ofdpa_spsc_release(ind_ofdpa_spsc_t *q)
+{
+  __atomic_store_n(&q->head, __atomic_load_n(&q->head, __ATOMIC_RELAXED) + 1,
+                   __ATOMIC_RELEASE);
+}
+
+/* Consumer side */
+static inline int ind_ofdpa_spsc_empty(ind_ofdpa_spsc_t *q)
+{
+  return (__atomic_load_n(&q->head, __ATOMIC_RELAXED) ==
+          __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE));
+}
+
+#endif /* INCLUDE_IND_OFDPA_SPSC_H */
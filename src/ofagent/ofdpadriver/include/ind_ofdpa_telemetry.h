@@ -0,0 +1,75 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_telemetry.h
+*
+* @purpose      Wire format of the counter telemetry datagrams
+*
+* @component    OF-DPA
+*
+* @comments     Every datagram starts with a header followed by a number
+*               of fixed size records of the class given in the header.
+*               All fields are in network byte order.
+*
+*               header: magic (2), version (1), class (1), sequence (4),
+*                       generation (4), record count (2), reserved (2)
+*
+*               port:   port (4), rx packets, tx packets, rx bytes,
+*                       tx bytes, rx drops, tx drops (8 each); the change
+*                       since the previous snapshot
+*               flow:   cookie (8), packets (8), bytes (8); the change
+*                       since the previous snapshot
+*               group:  group id (4), reference count (4)
+*               oam:    local MEP id (4), CCMs sent (4), CCMs received (4),
+*                       remote MEPs up (2), remote MEPs failed (2)
+*
+*               Port and flow records with no change are not sent; every
+*               group is. OAM records are only sent for MEPs whose remote
+*               MEP state changed. The sequence number counts datagrams, so
+*               receivers can detect loss. The generation is that of the
+*               collector snapshot the records were taken from.
+*
+* @create       14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef INCLUDE_IND_OFDPA_TELEMETRY_H
+#define INCLUDE_IND_OFDPA_TELEMETRY_H
+
+#define IND_OFDPA_TELEMETRY_MAGIC         0x4f54
+#define IND_OFDPA_TELEMETRY_VERSION       1
+
+#define IND_OFDPA_TELEMETRY_HEADER_LEN    16
+#define IND_OFDPA_TELEMETRY_PORT_LEN      52
+#define IND_OFDPA_TELEMETRY_FLOW_LEN      24
+#define IND_OFDPA_TELEMETRY_GROUP_LEN     8
+#define IND_OFDPA_TELEMETRY_OAM_LEN       16
+
+/* Largest datagram, kept below a typical path MTU */
+#define IND_OFDPA_TELEMETRY_DATAGRAM_MAX  1400
+
+/* Record classes, also the bits of the sampling set */
+#define IND_OFDPA_TELEMETRY_CLASS_PORT    1
+#define IND_OFDPA_TELEMETRY_CLASS_FLOW    2
+#define IND_OFDPA_TELEMETRY_CLASS_GROUP   3
+#define IND_OFDPA_TELEMETRY_CLASS_OAM     4
+
+#define IND_OFDPA_TELEMETRY_SET(cls)      (1u << (cls))
+
+#endif /* INCLUDE_IND_OFDPA_TELEMETRY_H */
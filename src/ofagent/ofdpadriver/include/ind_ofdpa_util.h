@@ -29,11 +29,15 @@
 * @end
 *
 **********************************************************************/
+#include <pthread.h>
 #include <linux/if_ether.h>
 #include "indigo/error.h"
+#include "indigo/fi.h"
+#include "indigo/forwarding.h"
 #include "loci/of_match.h"
 #include "loci/loci.h"
 #include "ofdpa_api.h"
+#include <SocketManager/socketmanager.h>
 
 #define IND_OFDPA_IP_DSCP_MASK     0xfc
 #define IND_OFDPA_IP_ECN_MASK      0x03
@@ -44,6 +48,82 @@
 
 #define IND_OFDPA_NANO_SEC 1000000000
 
+/* Profiling of the OF-DPA client RPCs, see ind_ofdpa_rpc.c */
+typedef struct ind_ofdpa_rpc_stats_s ind_ofdpa_rpc_stats_t;
+extern int ind_ofdpa_rpc_profiling;
+void ind_ofdpa_rpc_record(ind_ofdpa_rpc_stats_t **site, const char *name,
+                          OFDPA_ERROR_t rv, uint64_t startNs);
+void ind_ofdpa_rpc_profile_set(int enable);
+void ind_ofdpa_rpc_stats_reset(void);
+void ind_ofdpa_rpc_stats_show(aim_pvs_t *pvs);
+
+/* Driver uCli node, NULL unless built with IND_OFDPA_CONFIG_INCLUDE_UCLI */
+#ifndef IND_OFDPA_CONFIG_INCLUDE_UCLI
+#define IND_OFDPA_CONFIG_INCLUDE_UCLI 0
+#endif
+void *ind_ofdpa_ucli_node_create(void);
+
+/* Make an OF-DPA client RPC, recording its start and end in the
+   SocketManager flight recorder and, while profiling is on, its latency.
+   The calls that only encode IDs locally and the blocking event and packet
+   receives are made directly. */
+#define IND_OFDPA_RPC(_fn, ...) ({                                          \
+      static ind_ofdpa_rpc_stats_t *_rpc_site;                              \
+      uint64_t _rpc_start = 0;                                              \
+      OFDPA_ERROR_t _rpc_rv;                                                \
+      IND_SOC_RECORD(IND_SOC_RECORD_RPC_START, 0, (uintptr_t)#_fn, 0);      \
+      if (ind_ofdpa_rpc_profiling)                                          \
+      {                                                                     \
+        _rpc_start = aim_trace_now();                                       \
+      }                                                                     \
+      _rpc_rv = _fn(__VA_ARGS__);                                           \
+      if (_rpc_start != 0)                                                  \
+      {                                                                     \
+        ind_ofdpa_rpc_record(&_rpc_site, #_fn, _rpc_rv, _rpc_start);        \
+      }                                                                     \
+      IND_SOC_RECORD(IND_SOC_RECORD_RPC_END, _rpc_rv, (uintptr_t)#_fn, 0);  \
+      _rpc_rv; })
+
+/* Default refresh interval of the flow counter cache; 0 disables it */
+#define IND_OFDPA_FLOW_STATS_CACHE_INTERVAL_MS 1000
+/* Walks stop after this long without a read of the cache */
+#define IND_OFDPA_FLOW_STATS_CACHE_IDLE_MS     60000
+
+/* Default refresh interval of the port counter collector; 0 disables it */
+#define IND_OFDPA_PORT_STATS_CACHE_INTERVAL_MS 1000
+
+/* Default refresh interval of the meter counter collector; 0 disables it */
+#define IND_OFDPA_METER_STATS_CACHE_INTERVAL_MS 1000
+
+/* Default refresh interval of the group counter collector; 0 disables it */
+#define IND_OFDPA_GROUP_STATS_CACHE_INTERVAL_MS 1000
+
+/* Default refresh interval of the OAM MEP state collector; 0 disables it */
+#define IND_OFDPA_OAM_CACHE_INTERVAL_MS 1000
+
+/* Default window in which port state events are merged; 0 disables it */
+#define IND_OFDPA_PORT_EVENT_COALESCE_MS 100
+
+/* File written with the captured packet-ins on SIGHUP */
+#define IND_OFDPA_PKT_CAPTURE_FILE "/var/run/ofagent/pktin.pcap"
+
+/* Flight recorder dump written when the event loop overruns its budget */
+#define IND_OFDPA_STALL_RECORD_FILE "/var/run/ofagent/stall.txt"
+#define IND_OFDPA_STALL_RECORD_EVENTS 4096
+
+/* Default packet-in rate limits in packets per second; 0 disables a limit */
+#define IND_OFDPA_PKTIN_RL_GLOBAL_PPS 0
+#define IND_OFDPA_PKTIN_RL_PORT_PPS   0
+#define IND_OFDPA_PKTIN_RL_REASON_PPS 0
+
+/* Default duplicate punt suppression window; 0 disables it */
+#define IND_OFDPA_PUNT_DEDUP_WINDOW_MS 0
+/* Leading bytes of a punted frame compared to find duplicates */
+#define IND_OFDPA_PUNT_DEDUP_BYTES     64
+
+/* Most switch units with their own flow submit thread */
+#define IND_OFDPA_FLOW_SUBMIT_MAX_UNITS 8
+
 typedef struct indPacketOutActions_s
 {
   uint32_t outputPort;
@@ -334,6 +414,447 @@ typedef unsigned long long ind_ofdpa_fields_t;
 
 indigo_error_t indigoConvertOfdpaRv(OFDPA_ERROR_t result);
 
-void ind_ofdpa_port_event_receive(void);
-void ind_ofdpa_flow_event_receive(void);
+uint8_t *ind_ofdpa_put16(uint8_t *p, uint16_t v);
+uint8_t *ind_ofdpa_put32(uint8_t *p, uint32_t v);
+uint8_t *ind_ofdpa_put64(uint8_t *p, uint64_t v);
+
+int ind_ofdpa_port_event_receive(void);
+int ind_ofdpa_flow_event_receive(void);
+int ind_ofdpa_flow_event_possible(void);
 void ind_ofdpa_pkt_receive(void);
+void ind_ofdpa_port_event_process(ofdpaPortEvent_t *portEventData);
+indigo_error_t ind_ofdpa_port_event_coalesce_init(uint32_t window_ms);
+void ind_ofdpa_port_event_show(void);
+void ind_ofdpa_flow_event_process(ofdpaFlowEvent_t *flowEventData);
+void ind_ofdpa_flow_event_flush(void);
+void ind_ofdpa_flow_expiry_offload_set(int offload);
+void ind_ofdpa_flow_expiry_show(void);
+int ind_ofdpa_oam_event_receive(void);
+void ind_ofdpa_oam_event_process(ofdpaOamEvent_t *oamEventData, uint64_t rxTime);
+/* Punted packets received per batch */
+#define IND_OFDPA_PKT_RX_BATCH 32
+/* Slots in the receive ring, at least IND_OFDPA_PKT_RX_BATCH */
+#define IND_OFDPA_PKT_RX_RING 256
+/* Room for the packet-in header and match beyond the packet data */
+#define IND_OFDPA_PKT_IN_HEADROOM 512
+
+/* A receive ring slot: one punted packet and the packet-in encoded from it */
+typedef struct
+{
+  ofdpaPacket_t rxPkt;
+  char *rxBuf;
+  uint8_t *msgBuf;
+  of_object_storage_t storage;
+  of_packet_in_t *packetIn;    /* in storage, encoded into msgBuf */
+  uint64_t rxTime;             /* os_time_monotonic() at reception */
+} ind_ofdpa_pkt_rx_slot_t;
+
+int ind_ofdpa_pkt_rx_ring_fill(struct timeval *timeout, uint64_t *drops);
+ind_ofdpa_pkt_rx_slot_t *ind_ofdpa_pkt_rx_ring_peek(void);
+void ind_ofdpa_pkt_rx_ring_release(void);
+
+/* Read the event queues signalled on the OF-DPA event socket */
+void ind_ofdpa_event_dispatch(void);
+void ind_ofdpa_event_stats_show(void);
+
+/* Driver event subscription: the event classes read, and the flow tables
+   and ports whose events are delivered. An empty table or port set means
+   all of them. Ports at or above IND_OFDPA_EVENT_PORT_MAX are always
+   delivered. */
+#define IND_OFDPA_EVENT_CLASS_PORT  0x1
+#define IND_OFDPA_EVENT_CLASS_OAM   0x2
+#define IND_OFDPA_EVENT_CLASS_FLOW  0x4
+#define IND_OFDPA_EVENT_CLASS_ALL   0x7
+#define IND_OFDPA_EVENT_PORT_MAX    1024
+indigo_error_t ind_ofdpa_event_subscribe(uint32_t classes,
+                                         const uint32_t *tableIds, int numTables,
+                                         const uint32_t *ports, int numPorts);
+int ind_ofdpa_event_class_subscribed(uint32_t eventClass);
+int ind_ofdpa_event_table_subscribed(uint32_t tableId);
+int ind_ofdpa_event_port_subscribed(uint32_t port);
+void ind_ofdpa_event_subscription_show(aim_pvs_t *pvs);
+
+indigo_error_t ind_ofdpa_event_thread_start(void);
+void ind_ofdpa_event_thread_stop(void);
+
+indigo_error_t ind_ofdpa_pkt_thread_start(void);
+void ind_ofdpa_pkt_thread_stop(void);
+void ind_ofdpa_pkt_thread_show(void);
+void ind_ofdpa_pkt_thread_latency_get(uint32_t *p50, uint32_t *p99, uint32_t *p999);
+
+void ind_ofdpa_packet_out_show(void);
+
+indigo_error_t ind_ofdpa_pkt_tx_thread_start(void);
+void ind_ofdpa_pkt_tx_thread_stop(void);
+void ind_ofdpa_pkt_tx_thread_show(void);
+int ind_ofdpa_pkt_tx_thread_running(void);
+indigo_error_t ind_ofdpa_pkt_tx_thread_send(const ofdpa_buffdesc *pkt, uint32_t flags,
+                                            uint32_t outPort, uint32_t inPort);
+
+indigo_error_t ind_ofdpa_flow_submit_thread_start(int units, uint32_t unit_ports);
+void ind_ofdpa_flow_submit_thread_stop(void);
+void ind_ofdpa_flow_submit_thread_show(void);
+int ind_ofdpa_flow_submit_thread_running(void);
+void ind_ofdpa_flow_submit(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+void ind_ofdpa_flow_submit_delete(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+void ind_ofdpa_flow_submit_modify(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+void ind_ofdpa_flow_submit_wait(void);
+
+typedef enum
+{
+  IND_OFDPA_COLLECT_CONTINUE,   /* more to collect */
+  IND_OFDPA_COLLECT_FINISHED,   /* walk complete, call finish */
+  IND_OFDPA_COLLECT_ABORTED,    /* walk given up, keep the previous snapshot */
+} ind_ofdpa_collect_status_t;
+
+typedef enum
+{
+  IND_OFDPA_COLLECT_CLASS_FLOW,
+  IND_OFDPA_COLLECT_CLASS_PORT,   /* and queue */
+  IND_OFDPA_COLLECT_CLASS_METER,
+  IND_OFDPA_COLLECT_CLASS_GROUP,
+  IND_OFDPA_COLLECT_CLASS_OAM,
+  IND_OFDPA_COLLECT_CLASS_COUNT,
+} ind_ofdpa_collect_class_t;
+
+/* A counter cache refreshed by a periodic walk. start and step may run
+   on the collector thread and must only touch the snapshot being
+   collected; finish always runs on the SocketManager loop. */
+typedef struct
+{
+  const char *name;
+  ind_ofdpa_collect_class_t cls;
+  uint32_t intervalMs;
+  void (*start)(void);
+  ind_ofdpa_collect_status_t (*step)(void);
+  void (*finish)(void);
+  int walkActive;
+  int finishPending;            /* thread walk complete, finish not run yet */
+  uint64_t nextUs;              /* thread walk due time */
+  uint32_t generation;          /* completed walks */
+} ind_ofdpa_collector_t;
+
+/* Records collected by a walk. Walks return ids in ascending order, so
+   lookups binary search the uint32_t key at keyOffset in each record. */
+typedef struct
+{
+  void *entries;
+  uint32_t entrySize;
+  uint32_t count;
+  uint32_t size;
+} ind_ofdpa_snapshot_t;
+
+#define IND_OFDPA_SNAPSHOT_INIT(type) { NULL, sizeof(type), 0, 0 }
+
+void *ind_ofdpa_snapshot_append(ind_ofdpa_snapshot_t *snapshot);
+void *ind_ofdpa_snapshot_entry(const ind_ofdpa_snapshot_t *snapshot, uint32_t index);
+void *ind_ofdpa_snapshot_lookup(const ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                                uint32_t key);
+void *ind_ofdpa_snapshot_insert(ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                                uint32_t key);
+void ind_ofdpa_snapshot_remove(ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                               uint32_t key);
+void ind_ofdpa_snapshot_swap(ind_ofdpa_snapshot_t *current, ind_ofdpa_snapshot_t *next);
+
+/* Called on the SocketManager loop each time a snapshot of cls is published */
+typedef void (*ind_ofdpa_collector_listener_f)(ind_ofdpa_collect_class_t cls);
+
+indigo_error_t ind_ofdpa_collector_register(ind_ofdpa_collector_t *collector);
+indigo_error_t ind_ofdpa_collector_listen(ind_ofdpa_collect_class_t cls,
+                                          ind_ofdpa_collector_listener_f listener);
+void ind_ofdpa_collector_refresh(ind_ofdpa_collector_t *collector);
+int ind_ofdpa_collector_listened(ind_ofdpa_collect_class_t cls);
+uint32_t ind_ofdpa_stats_generation_get(ind_ofdpa_collect_class_t cls);
+int ind_ofdpa_collector_threaded(void);
+indigo_error_t ind_ofdpa_collector_thread_start(void);
+void ind_ofdpa_collector_thread_stop(void);
+
+indigo_error_t ind_ofdpa_flow_stats_cache_init(uint32_t interval_ms);
+int ind_ofdpa_flow_stats_cache_enabled(void);
+void ind_ofdpa_flow_stats_cache_add(uint64_t cookie);
+void ind_ofdpa_flow_stats_cache_remove(uint64_t cookie);
+indigo_error_t ind_ofdpa_flow_stats_cache_get(uint64_t cookie,
+                                              indigo_fi_flow_stats_t *flow_stats);
+indigo_error_t ind_ofdpa_flow_stats_final_get(uint64_t cookie, ofdpaFlowEntry_t *flow,
+                                              indigo_fi_flow_stats_t *flow_stats);
+indigo_error_t ind_ofdpa_flow_stats_cache_hit_get(uint64_t cookie, bool *hit_status);
+typedef void (*ind_ofdpa_flow_stats_delta_f)(uint64_t cookie, uint64_t packets,
+                                             uint64_t bytes, void *arg);
+void ind_ofdpa_flow_stats_cache_delta_foreach(ind_ofdpa_flow_stats_delta_f fn, void *arg);
+
+/* Change in the counters of a port between the last two snapshots */
+typedef struct
+{
+  uint64_t rxPacketsDelta;
+  uint64_t txPacketsDelta;
+  uint64_t rxBytesDelta;
+  uint64_t txBytesDelta;
+  uint64_t rxDropsDelta;
+  uint64_t txDropsDelta;
+  uint64_t rxPps;
+  uint64_t txPps;
+  uint64_t rxBps;
+  uint64_t txBps;
+} ind_ofdpa_port_stats_rate_t;
+
+indigo_error_t ind_ofdpa_port_stats_cache_init(uint32_t interval_ms);
+int ind_ofdpa_port_stats_cache_enabled(void);
+indigo_error_t ind_ofdpa_port_stats_cache_get(uint32_t port, ofdpaPortStats_t *stats);
+indigo_error_t ind_ofdpa_port_stats_cache_next(uint32_t port, uint32_t *nextPort);
+indigo_error_t ind_ofdpa_port_stats_rate_get(uint32_t port, ind_ofdpa_port_stats_rate_t *rate);
+void ind_ofdpa_port_stats_show(void);
+indigo_error_t ind_ofdpa_queue_stats_cache_get(uint32_t port, uint32_t queueId,
+                                               ofdpaPortQueueStats_t *stats);
+
+/* Ports whose counters the counter store keeps monotonic */
+#define IND_OFDPA_COUNTER_STORE_PORTS  1024
+
+indigo_error_t ind_ofdpa_counter_store_init(const char *filename);
+void ind_ofdpa_counter_store_finish(void);
+void ind_ofdpa_counter_store_port_apply(uint32_t port, ofdpaPortStats_t *stats);
+uint64_t ind_ofdpa_counter_store_created(void);
+void ind_ofdpa_counter_store_show(void);
+
+indigo_error_t ind_ofdpa_meter_stats_cache_init(uint32_t interval_ms);
+int ind_ofdpa_meter_stats_cache_enabled(void);
+
+indigo_error_t ind_ofdpa_group_stats_cache_init(uint32_t interval_ms);
+indigo_error_t ind_ofdpa_group_resilient_init(uint32_t slots);
+void ind_ofdpa_group_modify_show(void);
+int ind_ofdpa_group_stats_cache_enabled(void);
+void ind_ofdpa_group_stats_cache_foreach(void (*fn)(const indigo_fwd_group_stats_t *stats,
+                                                    void *arg),
+                                         void *arg);
+
+/* CCM counters of a local MEP and the state of its remote MEPs */
+typedef struct
+{
+  uint32_t lmepId;
+  uint32_t ccmSent;
+  uint32_t ccmReceived;
+  uint16_t remoteCount;
+  uint16_t remoteOk;
+  uint16_t remoteFailed;
+  uint32_t livenessPort;        /* protection liveness port, 0 if none */
+  int changed;                  /* remote MEP state changed in the last walk */
+  uint64_t readTime;            /* os_time_monotonic() when read */
+} ind_ofdpa_oam_mep_state_t;
+
+indigo_error_t ind_ofdpa_oam_cache_init(uint32_t interval_ms);
+int ind_ofdpa_oam_cache_enabled(void);
+void ind_ofdpa_oam_notify_send(uint16_t reason, const ind_ofdpa_oam_mep_state_t *state,
+                               uint32_t megIndex, uint32_t eventMask, uint64_t detectTime);
+void ind_ofdpa_oam_notify_show(void);
+
+indigo_error_t ind_ofdpa_oam_protection_init(int enable);
+void ind_ofdpa_oam_protection_update(const ind_ofdpa_oam_mep_state_t *state);
+void ind_ofdpa_oam_protection_sweep(void);
+void ind_ofdpa_oam_protection_show(void);
+void ind_ofdpa_oam_cache_change_foreach(void (*fn)(const ind_ofdpa_oam_mep_state_t *state,
+                                                   void *arg),
+                                        void *arg);
+
+indigo_error_t ind_ofdpa_telemetry_init(const char *dest, uint32_t sampleSet);
+
+#define IND_OFDPA_METRICS_REFRESH_MS  1000
+#define IND_OFDPA_METRICS_ADDR        "127.0.0.1"
+indigo_error_t ind_ofdpa_metrics_init(const char *addr, uint16_t port, uint32_t refreshMs);
+void ind_ofdpa_metrics_finish(void);
+void ind_ofdpa_metrics_show(void);
+
+indigo_error_t ind_ofdpa_sched_init(const char *loopCpus, const char *workerCpuList,
+                                    const char *rtPolicy, int lockMemory, int hugePages);
+void ind_ofdpa_sched_worker(pthread_t thread);
+void *ind_ofdpa_pool_alloc(size_t size);
+void ind_ofdpa_pool_free(void *pool, size_t size);
+void ind_ofdpa_sched_show(void);
+
+/* Tunnel objects programmed in bulk, see ind_ofdpa_tunnel.c. In the order
+   they are created, each type refers only to types before it. */
+typedef enum
+{
+  IND_OFDPA_TUNNEL_OBJ_NEXT_HOP = 0,
+  IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP,
+  IND_OFDPA_TUNNEL_OBJ_TENANT,
+  IND_OFDPA_TUNNEL_OBJ_PORT,
+  IND_OFDPA_TUNNEL_OBJ_COUNT
+} ind_ofdpa_tunnel_obj_type_t;
+
+typedef struct
+{
+  ind_ofdpa_tunnel_obj_type_t type;
+  uint32_t id;                  /* tunnel id, next hop id, group id or port number */
+  union
+  {
+    ofdpaTunnelTenantConfig_t tenant;
+    ofdpaTunnelNextHopConfig_t nextHop;
+    ofdpaTunnelEcmpNextHopGroupConfig_t ecmpGroup;
+    ofdpaTunnelPortConfig_t port;
+  } config;
+  char name[OFDPA_PORT_NAME_STRING_SIZE];   /* ports only */
+  uint32_t *refs;               /* group member next hops or port tenants */
+  uint32_t numRefs;
+} ind_ofdpa_tunnel_obj_t;
+
+indigo_error_t ind_ofdpa_tunnel_init(const char *filename);
+indigo_error_t ind_ofdpa_tunnel_bulk_apply(const ind_ofdpa_tunnel_obj_t *objs, uint32_t count);
+indigo_error_t ind_ofdpa_tunnel_config_reload(void);
+void ind_ofdpa_tunnel_show(void);
+
+OFDPA_ERROR_t ind_ofdpa_queue_count_get(uint32_t port, uint32_t *numQueues);
+void ind_ofdpa_queue_config_invalidate(uint32_t port);
+
+/* Rates of one port queue, as set by ind_ofdpa_queue_rates_set */
+typedef struct
+{
+  uint32_t port;
+  uint32_t queueId;
+  uint32_t minRate;
+  uint32_t maxRate;
+} ind_ofdpa_queue_rate_t;
+
+uint32_t ind_ofdpa_queue_rates_set(const ind_ofdpa_queue_rate_t *rates, uint32_t count,
+                                   OFDPA_ERROR_t *rcs);
+
+void ind_ofdpa_flow_key_add(const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_flow_key_remove(uint64_t cookie);
+indigo_error_t ind_ofdpa_flow_key_get(uint64_t cookie, ofdpaFlowEntry_t *flow);
+
+size_t ind_ofdpa_flow_data_size(uint32_t tableId);
+
+indigo_error_t ind_ofdpa_flow_template_init(void);
+int ind_ofdpa_flow_template_apply(of_flow_add_t *flow_add, const of_match_t *match,
+                                  ofdpaFlowEntry_t *flow);
+void ind_ofdpa_flow_template_add(of_flow_add_t *flow_add, const of_match_t *match,
+                                 const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_flow_template_show(void);
+
+indigo_error_t ind_ofdpa_mpls_label_init(const char *ranges);
+int ind_ofdpa_mpls_label_flow_label(const ofdpaFlowEntry_t *flow, uint32_t *label);
+void ind_ofdpa_mpls_label_flow_bind(uint32_t label, uint64_t cookie);
+void ind_ofdpa_mpls_label_flow_unbind(uint32_t label);
+void ind_ofdpa_mpls_label_group_update(uint32_t group_id,
+                                       const ofdpaGroupBucketEntry_t *buckets,
+                                       int numBuckets, int bind);
+int ind_ofdpa_mpls_label_in_use(uint32_t label);
+indigo_error_t ind_ofdpa_mpls_label_alloc(uint32_t count, uint32_t *first);
+void ind_ofdpa_mpls_label_release(uint32_t first, uint32_t count);
+void ind_ofdpa_mpls_label_show(aim_pvs_t *pvs);
+void ind_ofdpa_mpls_label_binding_show(aim_pvs_t *pvs, uint32_t label);
+
+indigo_error_t ind_ofdpa_pkt_capture_init(uint32_t ring_size, uint32_t sample_rate);
+int ind_ofdpa_pkt_capture_enabled(void);
+void ind_ofdpa_pkt_capture_record(ofdpaPacket_t *pkt);
+void ind_ofdpa_pkt_capture_show(void);
+indigo_error_t ind_ofdpa_pkt_capture_pcap_write(const char *filename);
+
+#define IND_OFDPA_L2_LEARN_AGE_SEC  300
+
+/* Cookies of the bridging entries installed by agent MAC learning */
+#define IND_OFDPA_L2_LEARN_COOKIE          (1ULL << 63)
+#define IND_OFDPA_L2_LEARN_COOKIE_IS(_c)   (((_c) & IND_OFDPA_L2_LEARN_COOKIE) != 0)
+
+indigo_error_t ind_ofdpa_l2_learn_init(uint32_t interval_ms, uint32_t age_sec);
+int ind_ofdpa_l2_learn_consume(const ofdpaPacket_t *rxPkt);
+void ind_ofdpa_l2_learn_expired(const ofdpaFlowEntry_t *flowMatch);
+void ind_ofdpa_l2_learn_show(void);
+
+void ind_ofdpa_table_stats_flow_added(uint32_t tableId, int timed);
+void ind_ofdpa_table_stats_flow_removed(uint32_t tableId, int timed);
+void ind_ofdpa_table_stats_load(uint32_t tableId, uint32_t active, uint32_t timed);
+void ind_ofdpa_table_stats_load_done(void);
+
+void ind_ofdpa_group_buckets_load(uint32_t group_id,
+                                  ofdpaGroupBucketEntry_t *buckets,
+                                  int numBuckets);
+int ind_ofdpa_port_info_preload(void);
+
+/* Rebuild the driver caches from OF-DPA with parallel walks at startup */
+indigo_error_t ind_ofdpa_startup_load(void);
+
+/* Table capability index from the OF-DPA TTP, see ind_ofdpa_ttp.c */
+indigo_error_t ind_ofdpa_ttp_init(const char *filename);
+int ind_ofdpa_ttp_table_count(void);
+indigo_error_t ind_ofdpa_ttp_flow_check(of_flow_add_t *flow_add, const of_match_t *match);
+indigo_error_t ind_ofdpa_ttp_table_features_get(of_version_t version,
+                                                of_list_table_features_t *entries);
+
+indigo_error_t ind_ofdpa_pktin_rl_init(uint32_t global_pps, uint32_t port_pps,
+                                       uint32_t reason_pps);
+int ind_ofdpa_pktin_rl_admit(ofdpaPacket_t *pkt);
+void ind_ofdpa_pktin_rl_show(void);
+
+/* Duplicate punt suppression, applied before the packet-in rate limiter */
+indigo_error_t ind_ofdpa_punt_dedup_init(uint32_t window_ms, uint32_t bytes);
+int ind_ofdpa_punt_dedup_admit(const ofdpaPacket_t *pkt);
+void ind_ofdpa_punt_dedup_show(void);
+
+/* Periodic packet transmission configured with bsn_pdu_tx_request */
+indigo_error_t ind_ofdpa_pdu_tx_init(void);
+void ind_ofdpa_pdu_tx_show(void);
+
+/* Active VLANs and their counters, tracked from the VLAN table flows */
+indigo_error_t ind_ofdpa_vlan_stats_init(void);
+void ind_ofdpa_vlan_stats_flow_added(const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_vlan_stats_flow_removed(uint64_t cookie,
+                                       const indigo_fi_flow_stats_t *flow_stats);
+void ind_ofdpa_vlan_stats_show(void);
+
+/* Cookie of the flow that punted a packet, from the flows that output
+   to the controller */
+indigo_error_t ind_ofdpa_punt_init(void);
+int ind_ofdpa_punt_table_tracked(uint32_t tableId);
+void ind_ofdpa_punt_flow_added(const ofdpaFlowEntry_t *flow, of_flow_add_t *flow_add);
+void ind_ofdpa_punt_flow_modified(const ofdpaFlowEntry_t *flow, of_flow_modify_t *flow_modify);
+void ind_ofdpa_punt_flow_removed(uint64_t cookie);
+uint64_t ind_ofdpa_punt_cookie_get(ofdpaPacket_t *pkt, uint16_t *maxLen);
+void ind_ofdpa_punt_show(void);
+
+/* Unicast Routing flows installed only where they change the forwarding
+   of the shorter prefix covering them */
+indigo_error_t ind_ofdpa_route_compress_init(int enable);
+int ind_ofdpa_route_compress_table(uint32_t tableId);
+int ind_ofdpa_route_compress_add(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+int ind_ofdpa_route_compress_modify(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+int ind_ofdpa_route_compress_delete(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats,
+                                    OFDPA_ERROR_t *rv);
+int ind_ofdpa_route_compress_stats_get(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats);
+void ind_ofdpa_route_compress_restore(const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_route_compress_expired(uint64_t cookie);
+void ind_ofdpa_route_compress_show(void);
+
+/* Cookies of the Policy ACL entries installed by ACL compilation */
+#define IND_OFDPA_ACL_COOKIE               (1ULL << 62)
+#define IND_OFDPA_ACL_COOKIE_IS(_c)        \
+  (((_c) & (IND_OFDPA_L2_LEARN_COOKIE | IND_OFDPA_ACL_COOKIE)) == IND_OFDPA_ACL_COOKIE)
+
+/* Cookies of the VLAN table entries programmed from port VLAN membership */
+#define IND_OFDPA_VLAN_MEMBER_COOKIE       (1ULL << 61)
+#define IND_OFDPA_VLAN_MEMBER_COOKIE_MAKE(_port, _vlan) \
+  (IND_OFDPA_VLAN_MEMBER_COOKIE | ((uint64_t)(_port) << 12) | (_vlan))
+
+indigo_error_t ind_ofdpa_vlan_member_init(void);
+void ind_ofdpa_vlan_member_show(void);
+
+/* Policy ACL flows compiled into fewer, merged OF-DPA entries at a few
+   priorities */
+indigo_error_t ind_ofdpa_acl_compile_init(int enable);
+int ind_ofdpa_acl_compile_table(uint32_t tableId);
+int ind_ofdpa_acl_compile_add(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+int ind_ofdpa_acl_compile_modify(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv);
+int ind_ofdpa_acl_compile_delete(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats,
+                                 OFDPA_ERROR_t *rv);
+int ind_ofdpa_acl_compile_stats_get(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats);
+void ind_ofdpa_acl_compile_restore(const ofdpaFlowEntry_t *flow, uint16_t priority);
+void ind_ofdpa_acl_compile_expired(uint64_t cookie);
+void ind_ofdpa_acl_compile_show(void);
+
+/* Packets held for packet-ins truncated to max_len */
+#define IND_OFDPA_PKT_BUFFER_LEN 9216
+indigo_error_t ind_ofdpa_pkt_buffer_init(uint32_t count);
+uint32_t ind_ofdpa_pkt_buffer_count(void);
+uint16_t ind_ofdpa_pkt_buffer_miss_send_len(void);
+uint32_t ind_ofdpa_pkt_buffer_store(uint32_t inPort, const uint8_t *data, uint32_t len);
+indigo_error_t ind_ofdpa_pkt_buffer_take(uint32_t bufferId, uint8_t *data,
+                                         uint32_t *len, uint32_t *inPort);
+void ind_ofdpa_pkt_buffer_show(void);
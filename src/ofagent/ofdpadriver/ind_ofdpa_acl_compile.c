@@ -0,0 +1,1493 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_acl_compile.c
+*
+* @purpose    Policy ACL table compilation for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   When enabled, the Policy ACL flows of the controller are
+*             rules, and the TCAM entries installed in OF-DPA are
+*             compiled from them:
+*
+*             - A rule covered by a rule of higher priority can never be
+*               hit and is not installed.
+*             - Two entries of the same priority and instructions whose
+*               matches differ only in the lowest masked bit of an
+*               address, port or DSCP field are installed as one entry
+*               with that bit wildcarded, under a cookie of the
+*               compiler. Merges repeat, so aligned port ranges and
+*               contiguous prefixes end up as one entry.
+*             - OF-DPA orders ACL entries by priority, and an insert
+*               between two priorities in use shifts the TCAM. Only
+*               overlapping entries need their relative order, so an
+*               entry takes the priority of an existing entry whenever
+*               the entries it overlaps allow, and the TCAM holds a few
+*               priority classes instead of one per controller priority.
+*               An entry that has no room is installed at the priority
+*               of its rule scaled by 2^16, moving the overlapping
+*               entries in its way to theirs.
+*
+*             Every change keeps the forwarding of the TCAM the same:
+*             a merged or moved entry is installed before the entries it
+*             replaces are deleted, and a rule is only hidden once the
+*             rule covering it is installed.
+*
+*             Rules with timeouts expire by their cookie in OF-DPA, and
+*             rules that output to the controller identify packet-ins by
+*             it, so they are installed under their own cookie at their
+*             scaled priority and never merged or moved. Rules with
+*             timeouts are not hidden and hide nothing.
+*
+*             The counters of a TCAM entry are those of the first rule
+*             in it; they move to that rule when the entry is deleted.
+*             A hidden rule has no counters of its own.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "indigo/forwarding.h"
+#include "indigo/time.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+
+#define IND_OFDPA_ACL_BUCKETS 4096
+
+/* Controller priority scaled into the OF-DPA priority */
+#define IND_OFDPA_ACL_LEVEL(_priority)  (((uint32_t)(_priority) << 16) | 0x8000)
+
+/* Byte order of a match field */
+#define IND_OFDPA_ACL_FIELD_HOST 0
+#define IND_OFDPA_ACL_FIELD_NET  1
+
+typedef struct ind_ofdpa_acl_field_s
+{
+  uint16_t valueOffset;
+  uint16_t maskOffset;
+  uint8_t size;
+  uint8_t order;
+  uint8_t mergeable;
+} ind_ofdpa_acl_field_t;
+
+#define ACL_FIELD(_value, _mask, _order, _mergeable)                            \
+  { offsetof(ofdpaPolicyAclFlowMatch_t, _value),                                \
+    offsetof(ofdpaPolicyAclFlowMatch_t, _mask),                                 \
+    sizeof(((ofdpaPolicyAclFlowMatch_t *)0)->_value), _order, _mergeable }
+
+static const ind_ofdpa_acl_field_t aclFields[] =
+{
+  ACL_FIELD(inPort,        inPortMask,        IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(mplsL2Port,    mplsL2PortMask,    IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(srcMac,        srcMacMask,        IND_OFDPA_ACL_FIELD_NET,  1),
+  ACL_FIELD(destMac,       destMacMask,       IND_OFDPA_ACL_FIELD_NET,  1),
+  ACL_FIELD(etherType,     etherTypeMask,     IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(vlanId,        vlanIdMask,        IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(vlanPcp,       vlanPcpMask,       IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(vlanDei,       vlanDeiMask,       IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(tunnelId,      tunnelIdMask,      IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(vrf,           vrfMask,           IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(sourceIp4,     sourceIp4Mask,     IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(destIp4,       destIp4Mask,       IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(sourceIp6,     sourceIp6Mask,     IND_OFDPA_ACL_FIELD_NET,  1),
+  ACL_FIELD(destIp6,       destIp6Mask,       IND_OFDPA_ACL_FIELD_NET,  1),
+  ACL_FIELD(ipv4ArpSpa,    ipv4ArpSpaMask,    IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(ipProto,       ipProtoMask,       IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(dscp,          dscpMask,          IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(ecn,           ecnMask,           IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(srcL4Port,     srcL4PortMask,     IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(destL4Port,    destL4PortMask,    IND_OFDPA_ACL_FIELD_HOST, 1),
+  ACL_FIELD(icmpType,      icmpTypeMask,      IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(icmpCode,      icmpCodeMask,      IND_OFDPA_ACL_FIELD_HOST, 0),
+  ACL_FIELD(ipv6FlowLabel, ipv6FlowLabelMask, IND_OFDPA_ACL_FIELD_HOST, 0),
+};
+
+#define IND_OFDPA_ACL_FIELD_COUNT (sizeof(aclFields) / sizeof(aclFields[0]))
+
+struct ind_ofdpa_acl_entry_s;
+
+typedef struct ind_ofdpa_acl_rule_s
+{
+  bighash_entry_t hash_entry;
+  uint64_t cookie;
+  list_links_t links;                  /* in rules, by descending priority */
+  ofdpaFlowEntry_t flow;               /* as the controller added it */
+  ofdpaPolicyAclFlowMatch_t match;     /* values masked */
+  struct ind_ofdpa_acl_entry_s *leaf;  /* NULL while hidden */
+  struct ind_ofdpa_acl_rule_s *cover;  /* the rule hiding this one */
+  list_head_t hidden;                  /* rules this one hides */
+  list_links_t cover_links;
+  indigo_time_t created;
+  uint64_t packets;                    /* of the entries it led, now gone */
+  uint64_t bytes;
+  int timed;
+  int punt;
+  int cookieInstalled;                 /* an entry uses the rule cookie */
+} ind_ofdpa_acl_rule_t;
+
+#define TEMPLATE_NAME acl_rule_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_acl_rule_t
+#define TEMPLATE_KEY_FIELD cookie
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+/* A TCAM entry: a rule, or the merge of two entries one bit apart. Only
+   the entry at the top of a merge tree is installed. */
+typedef struct ind_ofdpa_acl_entry_s
+{
+  struct ind_ofdpa_acl_entry_s *parent;
+  struct ind_ofdpa_acl_entry_s *child[2];
+  ind_ofdpa_acl_rule_t *rule;          /* leaf only */
+  list_links_t links;                  /* in entries while installed */
+  ofdpaPolicyAclFlowMatch_t match;
+  uint16_t priority;
+  uint32_t level;                      /* OF-DPA priority */
+  uint64_t hwCookie;
+  int moving;
+} ind_ofdpa_acl_entry_t;
+
+static int compileEnabled;
+static bighash_table_t *ruleTable;
+static LIST_DEFINE(rules);
+static LIST_DEFINE(entries);
+static uint64_t nextCookie;
+
+static uint32_t hiddenCount;
+static uint32_t entryCount;
+static uint64_t merges;
+static uint64_t splits;
+static uint64_t moves;
+static uint64_t hwErrors;
+
+/****************************************************************
+ * Matches
+ ****************************************************************/
+
+static const uint8_t *acl_field_value(const ofdpaPolicyAclFlowMatch_t *match,
+                                      const ind_ofdpa_acl_field_t *field)
+{
+  return (const uint8_t *)match + field->valueOffset;
+}
+
+static const uint8_t *acl_field_mask(const ofdpaPolicyAclFlowMatch_t *match,
+                                     const ind_ofdpa_acl_field_t *field)
+{
+  return (const uint8_t *)match + field->maskOffset;
+}
+
+/* Host order fields are at most 32 bits */
+static uint32_t acl_field_host_get(const uint8_t *bytes, int size)
+{
+  uint8_t u8;
+  uint16_t u16;
+  uint32_t u32;
+
+  switch (size)
+  {
+    case 1:
+      memcpy(&u8, bytes, 1);
+      return u8;
+    case 2:
+      memcpy(&u16, bytes, 2);
+      return u16;
+    default:
+      memcpy(&u32, bytes, 4);
+      return u32;
+  }
+}
+
+static void acl_match_normalize(ofdpaPolicyAclFlowMatch_t *match)
+{
+  const ind_ofdpa_acl_field_t *field;
+  uint8_t *value;
+  const uint8_t *mask;
+  int i;
+
+  for (field = aclFields; field < &aclFields[IND_OFDPA_ACL_FIELD_COUNT]; field++)
+  {
+    value = (uint8_t *)match + field->valueOffset;
+    mask = acl_field_mask(match, field);
+    for (i = 0; i < field->size; i++)
+    {
+      value[i] &= mask[i];
+    }
+  }
+}
+
+/* Every packet matching b matches a */
+static int acl_match_covers(const ofdpaPolicyAclFlowMatch_t *a,
+                            const ofdpaPolicyAclFlowMatch_t *b)
+{
+  const ind_ofdpa_acl_field_t *field;
+  const uint8_t *av, *am, *bv, *bm;
+  int i;
+
+  for (field = aclFields; field < &aclFields[IND_OFDPA_ACL_FIELD_COUNT]; field++)
+  {
+    av = acl_field_value(a, field);
+    am = acl_field_mask(a, field);
+    bv = acl_field_value(b, field);
+    bm = acl_field_mask(b, field);
+    for (i = 0; i < field->size; i++)
+    {
+      if ((am[i] & ~bm[i]) || ((av[i] ^ bv[i]) & am[i]))
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Some packet matches both */
+static int acl_match_overlap(const ofdpaPolicyAclFlowMatch_t *a,
+                             const ofdpaPolicyAclFlowMatch_t *b)
+{
+  const ind_ofdpa_acl_field_t *field;
+  const uint8_t *av, *am, *bv, *bm;
+  int i;
+
+  for (field = aclFields; field < &aclFields[IND_OFDPA_ACL_FIELD_COUNT]; field++)
+  {
+    av = acl_field_value(a, field);
+    am = acl_field_mask(a, field);
+    bv = acl_field_value(b, field);
+    bm = acl_field_mask(b, field);
+    for (i = 0; i < field->size; i++)
+    {
+      if ((av[i] ^ bv[i]) & am[i] & bm[i])
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Byte offset in the match and bit of the one bit a and b differ in, if
+   they have the same masks and that bit is the lowest masked bit of a
+   mergeable field; 0 if they cannot be merged */
+static int acl_match_merge_bit(const ofdpaPolicyAclFlowMatch_t *a,
+                               const ofdpaPolicyAclFlowMatch_t *b,
+                               int *offset, uint8_t *bit)
+{
+  const ind_ofdpa_acl_field_t *field;
+  const ind_ofdpa_acl_field_t *diffField = NULL;
+  const uint8_t *av, *am, *bv, *bm;
+  uint32_t mask, diff;
+  int diffByte = -1;
+  int low;
+  int i;
+
+  for (field = aclFields; field < &aclFields[IND_OFDPA_ACL_FIELD_COUNT]; field++)
+  {
+    av = acl_field_value(a, field);
+    am = acl_field_mask(a, field);
+    bv = acl_field_value(b, field);
+    bm = acl_field_mask(b, field);
+    if (memcmp(am, bm, field->size))
+    {
+      return 0;
+    }
+    for (i = 0; i < field->size; i++)
+    {
+      if (av[i] != bv[i])
+      {
+        if ((diffField != NULL) && (diffField != field))
+        {
+          return 0;
+        }
+        diffField = field;
+      }
+    }
+  }
+  if ((diffField == NULL) || !diffField->mergeable)
+  {
+    return 0;
+  }
+
+  av = acl_field_value(a, diffField);
+  bv = acl_field_value(b, diffField);
+  am = acl_field_mask(a, diffField);
+  if (diffField->order == IND_OFDPA_ACL_FIELD_HOST)
+  {
+    mask = acl_field_host_get(am, diffField->size);
+    diff = acl_field_host_get(av, diffField->size) ^ acl_field_host_get(bv, diffField->size);
+    if (diff != (mask & -mask))
+    {
+      return 0;
+    }
+    /* Find the byte holding it in memory */
+    for (i = 0; i < diffField->size; i++)
+    {
+      if (av[i] != bv[i])
+      {
+        diffByte = i;
+      }
+    }
+  }
+  else
+  {
+    /* Lowest masked bit is in the last masked byte */
+    for (low = diffField->size - 1; (low >= 0) && (am[low] == 0); low--)
+    {
+    }
+    for (i = 0; i < diffField->size; i++)
+    {
+      if ((av[i] != bv[i]) && (i != low))
+      {
+        return 0;
+      }
+    }
+    if ((low < 0) || ((av[low] ^ bv[low]) != (am[low] & -am[low])))
+    {
+      return 0;
+    }
+    diffByte = low;
+  }
+
+  *offset = diffField->valueOffset + diffByte;
+  *bit = av[diffByte] ^ bv[diffByte];
+  return 1;
+}
+
+/* Offset of the mask byte of a value byte */
+static int acl_match_mask_offset(int valueOffset)
+{
+  const ind_ofdpa_acl_field_t *field;
+
+  for (field = aclFields; field < &aclFields[IND_OFDPA_ACL_FIELD_COUNT]; field++)
+  {
+    if ((valueOffset >= field->valueOffset) &&
+        (valueOffset < field->valueOffset + field->size))
+    {
+      return field->maskOffset + (valueOffset - field->valueOffset);
+    }
+  }
+  return -1;
+}
+
+/****************************************************************
+ * Rules and entries
+ ****************************************************************/
+
+static int acl_same_instructions(const ofdpaPolicyAclFlowEntry_t *a,
+                                 const ofdpaPolicyAclFlowEntry_t *b)
+{
+  return ((a->vlanPcpAction == b->vlanPcpAction) &&
+          (a->vlanPcp == b->vlanPcp) &&
+          (a->trafficClassAction == b->trafficClassAction) &&
+          (a->trafficClass == b->trafficClass) &&
+          (a->colorAction == b->colorAction) &&
+          (a->color == b->color) &&
+          (a->colorEntryIdAction == b->colorEntryIdAction) &&
+          (a->colorEntryId == b->colorEntryId) &&
+          (a->ecnAction == b->ecnAction) &&
+          (a->ecn == b->ecn) &&
+          (a->dscpAction == b->dscpAction) &&
+          (a->dscp == b->dscp) &&
+          (a->groupID == b->groupID) &&
+          (a->outputTunnelPort == b->outputTunnelPort) &&
+          (a->meterIdAction == b->meterIdAction) &&
+          (a->meterId == b->meterId) &&
+          (a->gotoTable == b->gotoTable) &&
+          (a->outputPort == b->outputPort) &&
+          (a->clearAction == b->clearAction));
+}
+
+static ind_ofdpa_acl_rule_t *acl_entry_leader(const ind_ofdpa_acl_entry_t *entry)
+{
+  while (entry->rule == NULL)
+  {
+    entry = entry->child[0];
+  }
+  return entry->rule;
+}
+
+static ind_ofdpa_acl_entry_t *acl_entry_top(ind_ofdpa_acl_entry_t *entry)
+{
+  while (entry->parent != NULL)
+  {
+    entry = entry->parent;
+  }
+  return entry;
+}
+
+static int acl_timed(const ofdpaFlowEntry_t *flow)
+{
+  return ((flow->idle_time != 0) || (flow->hard_time != 0));
+}
+
+/* Under the rule cookie at the scaled priority, never merged or moved */
+static int acl_entry_pinned(const ind_ofdpa_acl_entry_t *entry)
+{
+  return ((entry->rule != NULL) && (entry->rule->timed || entry->rule->punt));
+}
+
+static uint64_t acl_cookie_new(void)
+{
+  return IND_OFDPA_ACL_COOKIE | nextCookie++;
+}
+
+/****************************************************************
+ * OF-DPA
+ ****************************************************************/
+
+static void acl_hw_flow_get(const ind_ofdpa_acl_entry_t *entry, uint64_t cookie,
+                            uint32_t level, ofdpaFlowEntry_t *flow)
+{
+  *flow = acl_entry_leader(entry)->flow;
+  flow->cookie = cookie;
+  flow->priority = level;
+  if (entry->rule == NULL)
+  {
+    flow->flowData.policyAclFlowEntry.match_criteria = entry->match;
+  }
+}
+
+static OFDPA_ERROR_t acl_hw_add(ind_ofdpa_acl_entry_t *entry, uint64_t cookie, uint32_t level)
+{
+  ofdpaFlowEntry_t flow;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  acl_hw_flow_get(entry, cookie, level, &flow);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowAdd, &flow);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Failed to install ACL entry 0x%llx. (ofdpa_rv = %d)",
+              (unsigned long long)cookie, ofdpa_rv);
+    return ofdpa_rv;
+  }
+
+  if ((entry->rule != NULL) && (cookie == entry->rule->cookie))
+  {
+    entry->rule->cookieInstalled = 1;
+  }
+  entryCount++;
+  ind_ofdpa_flow_stats_cache_add(cookie);
+  ind_ofdpa_table_stats_flow_added(flow.tableId, acl_timed(&flow));
+  return OFDPA_E_NONE;
+}
+
+/* The counters of the entry go to its leader */
+static OFDPA_ERROR_t acl_hw_delete(ind_ofdpa_acl_entry_t *entry, uint64_t cookie)
+{
+  ind_ofdpa_acl_rule_t *leader = acl_entry_leader(entry);
+  indigo_fi_flow_stats_t stats;
+  ofdpaFlowEntry_t flow;
+  ofdpaFlowEntryStats_t flowStats;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  memset(&flowStats, 0, sizeof(flowStats));
+  if (ind_ofdpa_flow_stats_cache_enabled() &&
+      (ind_ofdpa_flow_stats_cache_get(cookie, &stats) == INDIGO_ERROR_NONE))
+  {
+    flowStats.receivedPackets = stats.packets;
+    flowStats.receivedBytes = stats.bytes;
+  }
+  else
+  {
+    (void)IND_OFDPA_RPC(ofdpaFlowByCookieGet, cookie, &flow, &flowStats);
+  }
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieDelete, cookie);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to remove ACL entry 0x%llx. (ofdpa_rv = %d)",
+              (unsigned long long)cookie, ofdpa_rv);
+    hwErrors++;
+    return ofdpa_rv;
+  }
+
+  leader->packets += flowStats.receivedPackets;
+  leader->bytes += flowStats.receivedBytes;
+  if ((entry->rule != NULL) && (cookie == entry->rule->cookie))
+  {
+    entry->rule->cookieInstalled = 0;
+  }
+  entryCount--;
+  ind_ofdpa_flow_stats_cache_remove(cookie);
+  ind_ofdpa_table_stats_flow_removed(OFDPA_FLOW_TABLE_ID_ACL_POLICY,
+                                     acl_timed(&leader->flow));
+  return OFDPA_E_NONE;
+}
+
+/****************************************************************
+ * Priority levels
+ ****************************************************************/
+
+/* Levels an entry can take without reordering the entries it overlaps;
+   empty if lo > hi */
+static void acl_level_range(const ind_ofdpa_acl_entry_t *entry, int64_t *lo, int64_t *hi)
+{
+  ind_ofdpa_acl_entry_t *other;
+  list_links_t *cur;
+
+  *lo = 0;
+  *hi = UINT32_MAX;
+  LIST_FOREACH(&entries, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_entry_t);
+    if ((other == entry) || (other->priority == entry->priority) ||
+        !acl_match_overlap(&other->match, &entry->match))
+    {
+      continue;
+    }
+    if ((other->priority < entry->priority) && (other->level >= *lo))
+    {
+      *lo = (int64_t)other->level + 1;
+    }
+    else if ((other->priority > entry->priority) && (other->level <= *hi))
+    {
+      *hi = (int64_t)other->level - 1;
+    }
+  }
+}
+
+/* A level in use in [lo, hi], of the same priority if possible */
+static uint32_t acl_level_pick(const ind_ofdpa_acl_entry_t *entry, int64_t lo, int64_t hi)
+{
+  int64_t scaled = IND_OFDPA_ACL_LEVEL(entry->priority);
+  int64_t best = -1;
+  int bestSame = 0;
+  ind_ofdpa_acl_entry_t *other;
+  list_links_t *cur;
+  int same;
+
+  LIST_FOREACH(&entries, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_entry_t);
+    if ((other->level < lo) || (other->level > hi))
+    {
+      continue;
+    }
+    same = (other->priority == entry->priority);
+    if ((best < 0) || (same && !bestSame) ||
+        ((same == bestSame) && (llabs(other->level - scaled) < llabs(best - scaled))))
+    {
+      best = other->level;
+      bestSame = same;
+    }
+  }
+
+  if (best >= 0)
+  {
+    return best;
+  }
+  if ((scaled >= lo) && (scaled <= hi))
+  {
+    return scaled;
+  }
+  return lo + ((hi - lo) / 2);
+}
+
+static OFDPA_ERROR_t acl_entry_move(ind_ofdpa_acl_entry_t *entry, uint32_t level);
+
+/* Move the overlapping entries that would be out of order with the entry
+   at level to their scaled priority */
+static OFDPA_ERROR_t acl_level_make_room(ind_ofdpa_acl_entry_t *entry, uint32_t level)
+{
+  ind_ofdpa_acl_entry_t *other;
+  list_links_t *cur;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  LIST_FOREACH(&entries, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_entry_t);
+    if ((other == entry) || other->moving || (other->priority == entry->priority) ||
+        !acl_match_overlap(&other->match, &entry->match))
+    {
+      continue;
+    }
+    if (((other->priority < entry->priority) && (other->level >= level)) ||
+        ((other->priority > entry->priority) && (other->level <= level)))
+    {
+      ofdpa_rv = acl_entry_move(other, IND_OFDPA_ACL_LEVEL(other->priority));
+      if (ofdpa_rv != OFDPA_E_NONE)
+      {
+        return ofdpa_rv;
+      }
+    }
+  }
+  return OFDPA_E_NONE;
+}
+
+/* Reinstall an entry at another level; the entries in its way move
+   first, from the farthest */
+static OFDPA_ERROR_t acl_entry_move(ind_ofdpa_acl_entry_t *entry, uint32_t level)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  uint64_t cookie;
+
+  if (acl_entry_pinned(entry))
+  {
+    /* Already at its scaled priority, which is never in the way */
+    LOG_ERROR("ACL entry 0x%llx at its priority is in the way.",
+              (unsigned long long)entry->hwCookie);
+    return OFDPA_E_INTERNAL;
+  }
+
+  entry->moving = 1;
+  ofdpa_rv = acl_level_make_room(entry, level);
+  if (ofdpa_rv == OFDPA_E_NONE)
+  {
+    cookie = ((entry->rule != NULL) && !entry->rule->cookieInstalled) ?
+      entry->rule->cookie : acl_cookie_new();
+    ofdpa_rv = acl_hw_add(entry, cookie, level);
+  }
+  entry->moving = 0;
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return ofdpa_rv;
+  }
+
+  (void)acl_hw_delete(entry, entry->hwCookie);
+  entry->hwCookie = cookie;
+  entry->level = level;
+  moves++;
+  return OFDPA_E_NONE;
+}
+
+/****************************************************************
+ * Merges
+ ****************************************************************/
+
+static ind_ofdpa_acl_entry_t *acl_partner_find(const ind_ofdpa_acl_entry_t *entry,
+                                               int64_t lo, int64_t hi,
+                                               int *offset, uint8_t *bit)
+{
+  const ofdpaPolicyAclFlowEntry_t *instructions =
+    &acl_entry_leader(entry)->flow.flowData.policyAclFlowEntry;
+  ind_ofdpa_acl_entry_t *other;
+  list_links_t *cur;
+
+  LIST_FOREACH(&entries, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_entry_t);
+    if ((other->priority == entry->priority) && (other->level >= lo) &&
+        (other->level <= hi) && !acl_entry_pinned(other) &&
+        acl_same_instructions(&acl_entry_leader(other)->flow.flowData.policyAclFlowEntry,
+                              instructions) &&
+        acl_match_merge_bit(&other->match, &entry->match, offset, bit))
+    {
+      return other;
+    }
+  }
+  return NULL;
+}
+
+static ind_ofdpa_acl_entry_t *acl_cube_new(ind_ofdpa_acl_entry_t *a, ind_ofdpa_acl_entry_t *b,
+                                           int offset, uint8_t bit)
+{
+  ind_ofdpa_acl_entry_t *cube;
+
+  cube = calloc(1, sizeof(*cube));
+  if (cube == NULL)
+  {
+    return NULL;
+  }
+  cube->match = a->match;
+  ((uint8_t *)&cube->match)[offset] &= ~bit;
+  ((uint8_t *)&cube->match)[acl_match_mask_offset(offset)] &= ~bit;
+  cube->priority = a->priority;
+  cube->child[0] = a;
+  cube->child[1] = b;
+  a->parent = cube;
+  b->parent = cube;
+  return cube;
+}
+
+/* Undo the merges made above entry while it was placed */
+static ind_ofdpa_acl_entry_t *acl_cube_undo(ind_ofdpa_acl_entry_t *cube, ind_ofdpa_acl_entry_t *entry)
+{
+  ind_ofdpa_acl_entry_t *child;
+  ind_ofdpa_acl_entry_t *partner;
+
+  while (cube != entry)
+  {
+    partner = cube->child[0];
+    child = cube->child[1];
+    partner->parent = NULL;
+    list_push(&entries, &partner->links);
+    child->parent = NULL;
+    free(cube);
+    cube = child;
+  }
+  return entry;
+}
+
+/* Install an entry that is not installed, merging it with the installed
+   entries it can; the entries merged into it are deleted after */
+static OFDPA_ERROR_t acl_entry_place(ind_ofdpa_acl_entry_t *entry)
+{
+  ind_ofdpa_acl_entry_t *top = entry;
+  ind_ofdpa_acl_entry_t *partner;
+  ind_ofdpa_acl_entry_t *cube;
+  ind_ofdpa_acl_entry_t *node;
+  OFDPA_ERROR_t ofdpa_rv;
+  int64_t lo, hi;
+  uint32_t level;
+  uint64_t cookie;
+  uint8_t bit;
+  int offset;
+
+  acl_level_range(top, &lo, &hi);
+  while (!acl_entry_pinned(top) &&
+         ((partner = acl_partner_find(top, lo, hi, &offset, &bit)) != NULL))
+  {
+    cube = acl_cube_new(partner, top, offset, bit);
+    if (cube == NULL)
+    {
+      break;
+    }
+    list_remove(&partner->links);
+    top = cube;
+    acl_level_range(top, &lo, &hi);
+  }
+
+  if (acl_entry_pinned(top) || (lo > hi))
+  {
+    level = IND_OFDPA_ACL_LEVEL(top->priority);
+    ofdpa_rv = acl_level_make_room(top, level);
+  }
+  else
+  {
+    level = acl_level_pick(top, lo, hi);
+    ofdpa_rv = OFDPA_E_NONE;
+  }
+
+  if (ofdpa_rv == OFDPA_E_NONE)
+  {
+    cookie = ((top->rule != NULL) && !top->rule->cookieInstalled) ?
+      top->rule->cookie : acl_cookie_new();
+    ofdpa_rv = acl_hw_add(top, cookie, level);
+  }
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    (void)acl_cube_undo(top, entry);
+    return ofdpa_rv;
+  }
+
+  top->hwCookie = cookie;
+  top->level = level;
+  list_push(&entries, &top->links);
+
+  /* Each partner is the first child of a cube above entry */
+  for (node = entry->parent; node != NULL; node = node->parent)
+  {
+    (void)acl_hw_delete(node->child[0], node->child[0]->hwCookie);
+    merges++;
+  }
+  return OFDPA_E_NONE;
+}
+
+static ind_ofdpa_acl_entry_t *acl_sibling(ind_ofdpa_acl_entry_t *node)
+{
+  ind_ofdpa_acl_entry_t *parent = node->parent;
+
+  return parent->child[(parent->child[0] == node) ? 1 : 0];
+}
+
+/* Delete the siblings installed for the path from leaf up to stop */
+static void acl_siblings_delete(ind_ofdpa_acl_entry_t *leaf, ind_ofdpa_acl_entry_t *stop)
+{
+  ind_ofdpa_acl_entry_t *node;
+  ind_ofdpa_acl_entry_t *sibling;
+
+  for (node = leaf; node != stop; node = node->parent)
+  {
+    sibling = acl_sibling(node);
+    (void)acl_hw_delete(sibling, sibling->hwCookie);
+  }
+}
+
+/* Take a leaf out of the TCAM. The rest of its merge tree is installed
+   as separate entries at the same level before the merged entry goes;
+   nothing changes if OF-DPA refuses any of it. */
+static OFDPA_ERROR_t acl_leaf_unplace(ind_ofdpa_acl_entry_t *leaf)
+{
+  ind_ofdpa_acl_entry_t *top = acl_entry_top(leaf);
+  ind_ofdpa_acl_entry_t *node;
+  ind_ofdpa_acl_entry_t *parent;
+  ind_ofdpa_acl_entry_t *sibling;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  uint64_t cookie;
+
+  if (top == leaf)
+  {
+    ofdpa_rv = acl_hw_delete(leaf, leaf->hwCookie);
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      list_remove(&leaf->links);
+    }
+    return ofdpa_rv;
+  }
+
+  for (node = leaf; node != top; node = node->parent)
+  {
+    sibling = acl_sibling(node);
+    cookie = ((sibling->rule != NULL) && !sibling->rule->cookieInstalled) ?
+      sibling->rule->cookie : acl_cookie_new();
+    ofdpa_rv = acl_hw_add(sibling, cookie, top->level);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      hwErrors++;
+      acl_siblings_delete(leaf, node);
+      return ofdpa_rv;
+    }
+    sibling->hwCookie = cookie;
+    sibling->level = top->level;
+  }
+
+  ofdpa_rv = acl_hw_delete(top, top->hwCookie);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    acl_siblings_delete(leaf, top);
+    return ofdpa_rv;
+  }
+  list_remove(&top->links);
+
+  for (node = leaf; node != top; node = parent)
+  {
+    parent = node->parent;
+    sibling = acl_sibling(node);
+    sibling->parent = NULL;
+    list_push(&entries, &sibling->links);
+    if (node != leaf)
+    {
+      free(node);
+    }
+  }
+  free(top);
+  leaf->parent = NULL;
+  splits++;
+  return OFDPA_E_NONE;
+}
+
+/****************************************************************
+ * Hiding
+ ****************************************************************/
+
+/* An installed rule of higher priority covering the rule */
+static ind_ofdpa_acl_rule_t *acl_cover_find(const ind_ofdpa_acl_rule_t *rule,
+                                            const ind_ofdpa_acl_rule_t *except)
+{
+  ind_ofdpa_acl_rule_t *other;
+  list_links_t *cur;
+
+  if (rule->timed)
+  {
+    return NULL;
+  }
+
+  LIST_FOREACH(&rules, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_rule_t);
+    if (other->flow.priority <= rule->flow.priority)
+    {
+      break;
+    }
+    if ((other != except) && (other->leaf != NULL) && !other->timed &&
+        acl_match_covers(&other->match, &rule->match))
+    {
+      return other;
+    }
+  }
+  return NULL;
+}
+
+static void acl_rule_hide(ind_ofdpa_acl_rule_t *rule, ind_ofdpa_acl_rule_t *cover)
+{
+  rule->cover = cover;
+  list_push(&cover->hidden, &rule->cover_links);
+}
+
+/* Hide the installed rules of lower priority the rule covers, with the
+   rules they hide */
+static void acl_rule_hide_covered(ind_ofdpa_acl_rule_t *rule)
+{
+  ind_ofdpa_acl_rule_t *other;
+  ind_ofdpa_acl_rule_t *hidden;
+  list_links_t *cur;
+
+  if (rule->timed)
+  {
+    return;
+  }
+
+  LIST_FOREACH(&rules, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_rule_t);
+    if ((other->flow.priority >= rule->flow.priority) || (other->leaf == NULL) ||
+        other->timed || !acl_match_covers(&rule->match, &other->match))
+    {
+      continue;
+    }
+    if (acl_leaf_unplace(other->leaf) != OFDPA_E_NONE)
+    {
+      continue;
+    }
+    free(other->leaf);
+    other->leaf = NULL;
+    while (!list_empty(&other->hidden))
+    {
+      hidden = container_of(list_shift(&other->hidden), cover_links, ind_ofdpa_acl_rule_t);
+      hidden->cover = rule;
+      list_push(&rule->hidden, &hidden->cover_links);
+    }
+    acl_rule_hide(other, rule);
+    hiddenCount++;
+  }
+}
+
+static OFDPA_ERROR_t acl_rule_place(ind_ofdpa_acl_rule_t *rule)
+{
+  ind_ofdpa_acl_entry_t *leaf;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  leaf = calloc(1, sizeof(*leaf));
+  if (leaf == NULL)
+  {
+    return OFDPA_E_FAIL;
+  }
+  leaf->rule = rule;
+  leaf->match = rule->match;
+  leaf->priority = rule->flow.priority;
+
+  ofdpa_rv = acl_entry_place(leaf);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    free(leaf);
+    return ofdpa_rv;
+  }
+  rule->leaf = leaf;
+  return OFDPA_E_NONE;
+}
+
+/* Find a new cover for, or install, the rules the rule hides; those that
+   cannot be installed stay hidden by it */
+static OFDPA_ERROR_t acl_rule_expose(ind_ofdpa_acl_rule_t *rule)
+{
+  ind_ofdpa_acl_rule_t *hidden;
+  ind_ofdpa_acl_rule_t *other;
+  ind_ofdpa_acl_rule_t *cover;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  OFDPA_ERROR_t rv;
+  LIST_DEFINE(pending);
+  list_links_t *cur, *next;
+
+  /* By descending priority, so an exposed rule can cover the next */
+  while (!list_empty(&rule->hidden))
+  {
+    hidden = container_of(list_shift(&rule->hidden), cover_links, ind_ofdpa_acl_rule_t);
+    LIST_FOREACH(&pending, cur)
+    {
+      other = container_of(cur, cover_links, ind_ofdpa_acl_rule_t);
+      if (other->flow.priority < hidden->flow.priority)
+      {
+        break;
+      }
+    }
+    list_insert_before(cur, &hidden->cover_links);
+  }
+
+  LIST_FOREACH_SAFE(&pending, cur, next)
+  {
+    hidden = container_of(cur, cover_links, ind_ofdpa_acl_rule_t);
+    list_remove(&hidden->cover_links);
+    cover = acl_cover_find(hidden, rule);
+    if (cover == NULL)
+    {
+      rv = acl_rule_place(hidden);
+      if (rv == OFDPA_E_NONE)
+      {
+        hidden->cover = NULL;
+        hiddenCount--;
+        continue;
+      }
+      ofdpa_rv = rv;
+      cover = rule;
+    }
+    acl_rule_hide(hidden, cover);
+  }
+  return ofdpa_rv;
+}
+
+/****************************************************************
+ * Rules
+ ****************************************************************/
+
+static void acl_rule_set(ind_ofdpa_acl_rule_t *rule, const ofdpaFlowEntry_t *flow,
+                         uint16_t priority)
+{
+  rule->flow = *flow;
+  rule->flow.priority = priority;
+  rule->match = flow->flowData.policyAclFlowEntry.match_criteria;
+  acl_match_normalize(&rule->match);
+  rule->timed = acl_timed(flow);
+  rule->punt = (flow->flowData.policyAclFlowEntry.outputPort != 0);
+}
+
+static ind_ofdpa_acl_rule_t *acl_rule_insert(const ofdpaFlowEntry_t *flow, uint16_t priority)
+{
+  ind_ofdpa_acl_rule_t *rule;
+  ind_ofdpa_acl_rule_t *other;
+  list_links_t *cur;
+
+  rule = calloc(1, sizeof(*rule));
+  if (rule == NULL)
+  {
+    LOG_ERROR("Failed to allocate ACL rule.");
+    return NULL;
+  }
+
+  rule->cookie = flow->cookie;
+  acl_rule_set(rule, flow, priority);
+  list_init(&rule->hidden);
+  rule->created = INDIGO_CURRENT_TIME;
+
+  LIST_FOREACH(&rules, cur)
+  {
+    other = container_of(cur, links, ind_ofdpa_acl_rule_t);
+    if (other->flow.priority < priority)
+    {
+      break;
+    }
+  }
+  list_insert_before(cur, &rule->links);
+  acl_rule_hashtable_insert(ruleTable, rule);
+  return rule;
+}
+
+static void acl_rule_forget(ind_ofdpa_acl_rule_t *rule)
+{
+  if (rule->cover != NULL)
+  {
+    list_remove(&rule->cover_links);
+    hiddenCount--;
+  }
+  free(rule->leaf);
+  list_remove(&rule->links);
+  bighash_remove(ruleTable, &rule->hash_entry);
+  free(rule);
+}
+
+/* Remove a rule; hwGone if OF-DPA already removed its entry */
+static OFDPA_ERROR_t acl_rule_remove(ind_ofdpa_acl_rule_t *rule, int hwGone)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  ofdpa_rv = acl_rule_expose(rule);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to install the ACL rules hidden by 0x%llx. (ofdpa_rv = %d)",
+              (unsigned long long)rule->cookie, ofdpa_rv);
+    return ofdpa_rv;
+  }
+
+  if (rule->leaf != NULL)
+  {
+    if (hwGone)
+    {
+      /* Only a rule with timeouts expires, and it is never merged */
+      list_remove(&rule->leaf->links);
+      rule->cookieInstalled = 0;
+      entryCount--;
+    }
+    else
+    {
+      ofdpa_rv = acl_leaf_unplace(rule->leaf);
+      if (ofdpa_rv != OFDPA_E_NONE)
+      {
+        return ofdpa_rv;
+      }
+    }
+  }
+
+  acl_rule_forget(rule);
+  return OFDPA_E_NONE;
+}
+
+/* Change the instructions of a rule; its match and priority are the same */
+static OFDPA_ERROR_t acl_rule_update(ind_ofdpa_acl_rule_t *rule, const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_acl_entry_t *oldLeaf = rule->leaf;
+  ind_ofdpa_acl_entry_t *newLeaf;
+  ofdpaFlowEntry_t oldFlow = rule->flow;
+  ofdpaFlowEntry_t hwFlow;
+  OFDPA_ERROR_t ofdpa_rv;
+  uint64_t cookie;
+  int wasPinned;
+
+  wasPinned = (oldLeaf != NULL) && acl_entry_pinned(oldLeaf);
+  acl_rule_set(rule, flow, oldFlow.priority);
+  if (oldLeaf == NULL)
+  {
+    return OFDPA_E_NONE;
+  }
+
+  if ((oldLeaf->parent == NULL) && (wasPinned == acl_entry_pinned(oldLeaf)))
+  {
+    acl_hw_flow_get(oldLeaf, oldLeaf->hwCookie, oldLeaf->level, &hwFlow);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowModify, &hwFlow);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_TRACE("Failed to modify ACL entry 0x%llx. (ofdpa_rv = %d)",
+                (unsigned long long)oldLeaf->hwCookie, ofdpa_rv);
+      acl_rule_set(rule, &oldFlow, oldFlow.priority);
+    }
+    return ofdpa_rv;
+  }
+
+  if (acl_entry_pinned(oldLeaf) && rule->cookieInstalled)
+  {
+    /* The new entry needs the rule cookie, so the old one is copied to
+       another cookie first */
+    acl_rule_set(rule, &oldFlow, oldFlow.priority);
+    cookie = acl_cookie_new();
+    ofdpa_rv = acl_hw_add(oldLeaf, cookie, oldLeaf->level);
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      ofdpa_rv = acl_hw_delete(oldLeaf, oldLeaf->hwCookie);
+      if (ofdpa_rv == OFDPA_E_NONE)
+      {
+        oldLeaf->hwCookie = cookie;
+      }
+      else
+      {
+        (void)acl_hw_delete(oldLeaf, cookie);
+      }
+    }
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      return ofdpa_rv;
+    }
+    acl_rule_set(rule, flow, oldFlow.priority);
+  }
+
+  /* The new entry is installed before the old one is split off */
+  rule->leaf = NULL;
+  ofdpa_rv = acl_rule_place(rule);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    rule->leaf = oldLeaf;
+    acl_rule_set(rule, &oldFlow, oldFlow.priority);
+    return ofdpa_rv;
+  }
+  newLeaf = rule->leaf;
+
+  ofdpa_rv = acl_leaf_unplace(oldLeaf);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    if (acl_leaf_unplace(newLeaf) == OFDPA_E_NONE)
+    {
+      free(newLeaf);
+      rule->leaf = oldLeaf;
+      acl_rule_set(rule, &oldFlow, oldFlow.priority);
+    }
+    else
+    {
+      LOG_ERROR("ACL rule 0x%llx has two entries.", (unsigned long long)rule->cookie);
+      hwErrors++;
+    }
+    return ofdpa_rv;
+  }
+  free(oldLeaf);
+  return OFDPA_E_NONE;
+}
+
+/****************************************************************
+ * Driver
+ ****************************************************************/
+
+/* Entries of the compiler left in OF-DPA by an earlier run. The rules
+   they held are not restored and are added again. */
+static void acl_orphans_delete(void)
+{
+  ofdpaFlowEntry_t cursor, nextFlow;
+  uint64_t *cookies = NULL, *grown;
+  int count = 0, size = 0;
+  int i;
+
+  memset(&cursor, 0, sizeof(cursor));
+  cursor.tableId = OFDPA_FLOW_TABLE_ID_ACL_POLICY;
+
+  while ((IND_OFDPA_RPC(ofdpaFlowNextGet, &cursor, &nextFlow) == OFDPA_E_NONE) &&
+         (nextFlow.tableId == OFDPA_FLOW_TABLE_ID_ACL_POLICY))
+  {
+    if (IND_OFDPA_ACL_COOKIE_IS(nextFlow.cookie))
+    {
+      if (count == size)
+      {
+        size = (size == 0) ? 64 : (size * 2);
+        grown = realloc(cookies, size * sizeof(*cookies));
+        if (grown == NULL)
+        {
+          break;
+        }
+        cookies = grown;
+      }
+      cookies[count++] = nextFlow.cookie;
+    }
+    cursor = nextFlow;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (IND_OFDPA_RPC(ofdpaFlowByCookieDelete, cookies[i]) != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Failed to remove stale ACL entry 0x%llx.",
+                (unsigned long long)cookies[i]);
+    }
+  }
+  if (count != 0)
+  {
+    LOG_INFO("Removed %d stale ACL entries.", count);
+  }
+  free(cookies);
+}
+
+indigo_error_t ind_ofdpa_acl_compile_init(int enable)
+{
+  if (!enable)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  ruleTable = bighash_table_create(IND_OFDPA_ACL_BUCKETS);
+  if (ruleTable == NULL)
+  {
+    LOG_ERROR("Failed to allocate ACL rule table.");
+    return INDIGO_ERROR_RESOURCE;
+  }
+  acl_orphans_delete();
+  compileEnabled = 1;
+
+  return INDIGO_ERROR_NONE;
+}
+
+int ind_ofdpa_acl_compile_table(uint32_t tableId)
+{
+  return (compileEnabled && (tableId == OFDPA_FLOW_TABLE_ID_ACL_POLICY));
+}
+
+/* Returns 0 if the flow is left to the caller, else the result in *rv.
+   On success the entries are accounted for in the table and counter
+   caches. */
+int ind_ofdpa_acl_compile_add(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  ind_ofdpa_acl_rule_t *rule;
+  ind_ofdpa_acl_rule_t *cover;
+
+  if (!ind_ofdpa_acl_compile_table(flow->tableId))
+  {
+    return 0;
+  }
+
+  rule = acl_rule_insert(flow, flow->priority);
+  if (rule == NULL)
+  {
+    return 0;
+  }
+
+  cover = acl_cover_find(rule, NULL);
+  if (cover != NULL)
+  {
+    acl_rule_hide(rule, cover);
+    hiddenCount++;
+    *rv = OFDPA_E_NONE;
+    return 1;
+  }
+
+  *rv = acl_rule_place(rule);
+  if (*rv != OFDPA_E_NONE)
+  {
+    acl_rule_forget(rule);
+    return 1;
+  }
+  acl_rule_hide_covered(rule);
+  return 1;
+}
+
+int ind_ofdpa_acl_compile_modify(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  ind_ofdpa_acl_rule_t *rule;
+
+  if (!compileEnabled ||
+      ((rule = acl_rule_hashtable_first(ruleTable, &flow->cookie)) == NULL))
+  {
+    return 0;
+  }
+
+  *rv = acl_rule_update(rule, flow);
+  return 1;
+}
+
+int ind_ofdpa_acl_compile_delete(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats,
+                                 OFDPA_ERROR_t *rv)
+{
+  ind_ofdpa_acl_rule_t *rule;
+
+  if (!compileEnabled || ((rule = acl_rule_hashtable_first(ruleTable, &cookie)) == NULL))
+  {
+    return 0;
+  }
+
+  (void)ind_ofdpa_acl_compile_stats_get(cookie, flow_stats);
+  *rv = acl_rule_remove(rule, 0);
+  return 1;
+}
+
+/* Counters of a rule: those it kept from deleted entries, and those of
+   the entry it leads */
+int ind_ofdpa_acl_compile_stats_get(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats)
+{
+  ind_ofdpa_acl_rule_t *rule;
+  ind_ofdpa_acl_entry_t *top;
+  indigo_fi_flow_stats_t stats;
+  ofdpaFlowEntry_t flow;
+  ofdpaFlowEntryStats_t flowStats;
+
+  if (!compileEnabled || ((rule = acl_rule_hashtable_first(ruleTable, &cookie)) == NULL))
+  {
+    return 0;
+  }
+
+  flow_stats->flow_id = cookie;
+  flow_stats->packets = rule->packets;
+  flow_stats->bytes = rule->bytes;
+  flow_stats->duration_ns = (uint64_t)INDIGO_TIME_DIFF_ms(rule->created, INDIGO_CURRENT_TIME) *
+    (IND_OFDPA_NANO_SEC / 1000);
+
+  if ((rule->leaf == NULL) || (acl_entry_leader(top = acl_entry_top(rule->leaf)) != rule))
+  {
+    return 1;
+  }
+
+  if (ind_ofdpa_flow_stats_cache_enabled() &&
+      (ind_ofdpa_flow_stats_cache_get(top->hwCookie, &stats) == INDIGO_ERROR_NONE))
+  {
+    flow_stats->packets += stats.packets;
+    flow_stats->bytes += stats.bytes;
+  }
+  else
+  {
+    memset(&flowStats, 0, sizeof(flowStats));
+    if (IND_OFDPA_RPC(ofdpaFlowByCookieGet, top->hwCookie, &flow, &flowStats) == OFDPA_E_NONE)
+    {
+      flow_stats->packets += flowStats.receivedPackets;
+      flow_stats->bytes += flowStats.receivedBytes;
+    }
+  }
+  return 1;
+}
+
+/* An ACL flow found in OF-DPA under its own cookie after a restart, at
+   the OF-DPA priority it was given; priority is the one of the flow */
+void ind_ofdpa_acl_compile_restore(const ofdpaFlowEntry_t *flow, uint16_t priority)
+{
+  ind_ofdpa_acl_rule_t *rule;
+  ind_ofdpa_acl_entry_t *leaf;
+
+  if (!ind_ofdpa_acl_compile_table(flow->tableId))
+  {
+    return;
+  }
+
+  rule = acl_rule_insert(flow, priority);
+  if (rule == NULL)
+  {
+    return;
+  }
+  leaf = calloc(1, sizeof(*leaf));
+  if (leaf == NULL)
+  {
+    acl_rule_forget(rule);
+    return;
+  }
+
+  /* Already counted in the table; merged on the next change */
+  leaf->rule = rule;
+  leaf->match = rule->match;
+  leaf->priority = priority;
+  leaf->level = flow->priority;
+  leaf->hwCookie = flow->cookie;
+  list_push(&entries, &leaf->links);
+  rule->leaf = leaf;
+  rule->cookieInstalled = 1;
+  entryCount++;
+}
+
+/* OF-DPA removed an ACL flow that timed out */
+void ind_ofdpa_acl_compile_expired(uint64_t cookie)
+{
+  ind_ofdpa_acl_rule_t *rule;
+
+  if (compileEnabled && ((rule = acl_rule_hashtable_first(ruleTable, &cookie)) != NULL))
+  {
+    (void)acl_rule_remove(rule, 1);
+  }
+}
+
+void ind_ofdpa_acl_compile_show(void)
+{
+  ind_ofdpa_acl_entry_t *entry, *other;
+  list_links_t *cur, *prev;
+  uint32_t count, levels = 0;
+
+  if (!compileEnabled)
+  {
+    return;
+  }
+
+  LIST_FOREACH(&entries, cur)
+  {
+    entry = container_of(cur, links, ind_ofdpa_acl_entry_t);
+    for (prev = entries.links.next; prev != cur; prev = prev->next)
+    {
+      other = container_of(prev, links, ind_ofdpa_acl_entry_t);
+      if (other->level == entry->level)
+      {
+        break;
+      }
+    }
+    if (prev == cur)
+    {
+      levels++;
+    }
+  }
+
+  count = bighash_entry_count(ruleTable);
+  LOG_INFO("ACL compilation: %u rules, %u entries, %u hidden, %u priorities in use",
+           count, entryCount, hiddenCount, levels);
+  if (entryCount != 0)
+  {
+    LOG_INFO("  %u.%02u rules per entry", count / entryCount,
+             (uint32_t)(((uint64_t)(count % entryCount) * 100) / entryCount));
+  }
+  LOG_INFO("  %"PRIu64" entries reprogrammed: %"PRIu64" merges, %"PRIu64" splits, "
+           "%"PRIu64" moves; %"PRIu64" OF-DPA errors",
+           merges + splits + moves, merges, splits, moves, hwErrors);
+}
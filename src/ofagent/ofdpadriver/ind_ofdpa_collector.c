@@ -0,0 +1,485 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_collector.c
+*
+* @purpose    Periodic counter collection for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Each counter cache (flow, port and queue, meter, group)
+*             registers a collector. On every interval the collector
+*             starts a walk and steps it from a SocketManager task until
+*             it completes, yielding to other events in between. A walk
+*             that is still running when the next interval expires is not
+*             restarted.
+*
+*             When the collector thread is started, the walks move to
+*             that thread so the client RPCs never block the SocketManager
+*             loop. Completed walks are handed back through an eventfd and
+*             their snapshots are published on the SocketManager loop, so
+*             everything reading a snapshot stays single threaded.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <SocketManager/socketmanager.h>
+#include <OS/os_time.h>
+
+/* Longest the collector thread sleeps between checks */
+#define IND_OFDPA_COLLECTOR_TICK_US 100000
+
+static ind_ofdpa_collector_t *collectors[IND_OFDPA_COLLECT_CLASS_COUNT];
+static ind_ofdpa_collector_listener_f listeners[IND_OFDPA_COLLECT_CLASS_COUNT];
+
+static pthread_t collectorThread;
+static int collectorThreadRunning;
+static int collectorThreadStop;
+static int collectorNotifyFd = -1;
+
+/* Initial number of records in a snapshot */
+#define IND_OFDPA_SNAPSHOT_MIN_SIZE 64
+
+void *ind_ofdpa_snapshot_append(ind_ofdpa_snapshot_t *snapshot)
+{
+  void *entries;
+  uint32_t size;
+
+  if (snapshot->count == snapshot->size)
+  {
+    size = snapshot->size ? (snapshot->size * 2) : IND_OFDPA_SNAPSHOT_MIN_SIZE;
+    entries = realloc(snapshot->entries, (size_t)size * snapshot->entrySize);
+    if (entries == NULL)
+    {
+      return NULL;
+    }
+    snapshot->entries = entries;
+    snapshot->size = size;
+  }
+
+  return ind_ofdpa_snapshot_entry(snapshot, snapshot->count++);
+}
+
+void *ind_ofdpa_snapshot_entry(const ind_ofdpa_snapshot_t *snapshot, uint32_t index)
+{
+  return (char *)snapshot->entries + ((size_t)index * snapshot->entrySize);
+}
+
+static uint32_t snapshot_key(const ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                             uint32_t index)
+{
+  uint32_t key;
+
+  memcpy(&key, (char *)ind_ofdpa_snapshot_entry(snapshot, index) + keyOffset, sizeof(key));
+  return key;
+}
+
+/* Index of the first record with a key not below key */
+static uint32_t snapshot_lower_bound(const ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                                     uint32_t key)
+{
+  uint32_t lo = 0, hi = snapshot->count, mid;
+
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (snapshot_key(snapshot, keyOffset, mid) < key)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+void *ind_ofdpa_snapshot_lookup(const ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                                uint32_t key)
+{
+  uint32_t index;
+
+  index = snapshot_lower_bound(snapshot, keyOffset, key);
+  if ((index == snapshot->count) || (snapshot_key(snapshot, keyOffset, index) != key))
+  {
+    return NULL;
+  }
+
+  return ind_ofdpa_snapshot_entry(snapshot, index);
+}
+
+/* Returns the record for key, adding a zeroed one in key order if missing */
+void *ind_ofdpa_snapshot_insert(ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                                uint32_t key)
+{
+  uint32_t index;
+  char *entry;
+
+  index = snapshot_lower_bound(snapshot, keyOffset, key);
+  if ((index < snapshot->count) && (snapshot_key(snapshot, keyOffset, index) == key))
+  {
+    return ind_ofdpa_snapshot_entry(snapshot, index);
+  }
+
+  if (ind_ofdpa_snapshot_append(snapshot) == NULL)
+  {
+    return NULL;
+  }
+
+  entry = ind_ofdpa_snapshot_entry(snapshot, index);
+  memmove(entry + snapshot->entrySize, entry,
+          (size_t)(snapshot->count - 1 - index) * snapshot->entrySize);
+  memset(entry, 0, snapshot->entrySize);
+  memcpy(entry + keyOffset, &key, sizeof(key));
+
+  return entry;
+}
+
+void ind_ofdpa_snapshot_remove(ind_ofdpa_snapshot_t *snapshot, size_t keyOffset,
+                               uint32_t key)
+{
+  uint32_t index;
+  char *entry;
+
+  index = snapshot_lower_bound(snapshot, keyOffset, key);
+  if ((index == snapshot->count) || (snapshot_key(snapshot, keyOffset, index) != key))
+  {
+    return;
+  }
+
+  entry = ind_ofdpa_snapshot_entry(snapshot, index);
+  memmove(entry, entry + snapshot->entrySize,
+          (size_t)(snapshot->count - 1 - index) * snapshot->entrySize);
+  snapshot->count--;
+}
+
+/* Publishes next as current, keeping both buffers to avoid reallocating
+   on every walk */
+void ind_ofdpa_snapshot_swap(ind_ofdpa_snapshot_t *current, ind_ofdpa_snapshot_t *next)
+{
+  ind_ofdpa_snapshot_t tmp;
+
+  tmp = *current;
+  *current = *next;
+  *next = tmp;
+  next->count = 0;
+}
+
+static void collector_publish(ind_ofdpa_collector_t *collector)
+{
+  collector->finish();
+  collector->generation++;
+
+  if (listeners[collector->cls] != NULL)
+  {
+    listeners[collector->cls](collector->cls);
+  }
+}
+
+static ind_soc_task_status_t collector_walk_task(void *cookie)
+{
+  ind_ofdpa_collector_t *collector = cookie;
+
+  do
+  {
+    switch (collector->step())
+    {
+      case IND_OFDPA_COLLECT_FINISHED:
+        collector_publish(collector);
+        __atomic_store_n(&collector->walkActive, 0, __ATOMIC_RELEASE);
+        return IND_SOC_TASK_FINISHED;
+      case IND_OFDPA_COLLECT_ABORTED:
+        __atomic_store_n(&collector->walkActive, 0, __ATOMIC_RELEASE);
+        return IND_SOC_TASK_FINISHED;
+      default:
+        break;
+    }
+  } while (!ind_soc_should_yield());
+
+  return IND_SOC_TASK_CONTINUE;
+}
+
+static void collector_refresh_timer(void *cookie)
+{
+  ind_ofdpa_collector_refresh(cookie);
+}
+
+/* Start a walk now, unless one is already in progress */
+void ind_ofdpa_collector_refresh(ind_ofdpa_collector_t *collector)
+{
+  if (collectorThreadRunning)
+  {
+    __atomic_store_n(&collector->nextUs, 0, __ATOMIC_RELAXED);
+    return;
+  }
+
+  if (collector->walkActive)
+  {
+    /* Previous walk still in progress */
+    return;
+  }
+
+  collector->start();
+
+  if (ind_soc_task_register(collector_walk_task, collector,
+                            IND_SOC_DEFAULT_PRIORITY) != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register %s walk task", collector->name);
+    return;
+  }
+  collector->walkActive = 1;
+}
+
+indigo_error_t ind_ofdpa_collector_register(ind_ofdpa_collector_t *collector)
+{
+  collector->walkActive = 0;
+  collector->finishPending = 0;
+  collector->nextUs = 0;
+  collector->generation = 0;
+
+  if (ind_soc_timer_event_register(collector_refresh_timer, collector,
+                                   collector->intervalMs) != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register %s timer", collector->name);
+    return INDIGO_ERROR_UNKNOWN;
+  }
+  collectors[collector->cls] = collector;
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* One listener per class; it may be set before the collector registers */
+indigo_error_t ind_ofdpa_collector_listen(ind_ofdpa_collect_class_t cls,
+                                          ind_ofdpa_collector_listener_f listener)
+{
+  if (cls >= IND_OFDPA_COLLECT_CLASS_COUNT)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  if ((listeners[cls] != NULL) && (listener != NULL))
+  {
+    return INDIGO_ERROR_EXISTS;
+  }
+
+  listeners[cls] = listener;
+
+  return INDIGO_ERROR_NONE;
+}
+
+int ind_ofdpa_collector_listened(ind_ofdpa_collect_class_t cls)
+{
+  return (cls < IND_OFDPA_COLLECT_CLASS_COUNT) && (listeners[cls] != NULL);
+}
+
+/* Completed walks of a class; 0 until the first snapshot is published */
+uint32_t ind_ofdpa_stats_generation_get(ind_ofdpa_collect_class_t cls)
+{
+  if ((cls >= IND_OFDPA_COLLECT_CLASS_COUNT) || (collectors[cls] == NULL))
+  {
+    return 0;
+  }
+
+  return collectors[cls]->generation;
+}
+
+int ind_ofdpa_collector_threaded(void)
+{
+  return collectorThreadRunning;
+}
+
+static void collector_thread_notify(void)
+{
+  uint64_t x = 1;
+
+  if (write(collectorNotifyFd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+}
+
+/* Run one walk to completion on the collector thread */
+static void collector_thread_walk(ind_ofdpa_collector_t *collector)
+{
+  ind_ofdpa_collect_status_t status;
+
+  collector->start();
+  do
+  {
+    status = collector->step();
+  } while ((status == IND_OFDPA_COLLECT_CONTINUE) &&
+           !__atomic_load_n(&collectorThreadStop, __ATOMIC_RELAXED));
+
+  if (status == IND_OFDPA_COLLECT_FINISHED)
+  {
+    __atomic_store_n(&collector->finishPending, 1, __ATOMIC_RELEASE);
+    collector_thread_notify();
+  }
+  else
+  {
+    __atomic_store_n(&collector->walkActive, 0, __ATOMIC_RELEASE);
+  }
+}
+
+static void *collector_thread_main(void *arg)
+{
+  ind_ofdpa_collector_t *collector;
+  uint64_t nowUs;
+  int i;
+
+  while (!__atomic_load_n(&collectorThreadStop, __ATOMIC_RELAXED))
+  {
+    for (i = 0; i < IND_OFDPA_COLLECT_CLASS_COUNT; i++)
+    {
+      collector = collectors[i];
+      nowUs = os_time_monotonic();
+      if ((collector == NULL) ||
+          __atomic_load_n(&collector->walkActive, __ATOMIC_ACQUIRE) ||
+          (nowUs < __atomic_load_n(&collector->nextUs, __ATOMIC_RELAXED)))
+      {
+        continue;
+      }
+
+      __atomic_store_n(&collector->walkActive, 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&collector->nextUs,
+                       nowUs + (uint64_t)collector->intervalMs * 1000, __ATOMIC_RELAXED);
+      collector_thread_walk(collector);
+    }
+
+    usleep(IND_OFDPA_COLLECTOR_TICK_US);
+  }
+
+  return NULL;
+}
+
+/* Runs in the SocketManager loop */
+static void collector_notify_ready(int socket_id, void *cookie, int read_ready,
+                                   int write_ready, int error_seen)
+{
+  ind_ofdpa_collector_t *collector;
+  uint64_t x;
+  int i;
+
+  if (read(collectorNotifyFd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+
+  for (i = 0; i < IND_OFDPA_COLLECT_CLASS_COUNT; i++)
+  {
+    collector = collectors[i];
+    if ((collector != NULL) &&
+        __atomic_load_n(&collector->finishPending, __ATOMIC_ACQUIRE))
+    {
+      collector_publish(collector);
+      collector->finishPending = 0;
+      __atomic_store_n(&collector->walkActive, 0, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+/* Move the walks of every registered collector to a dedicated thread */
+indigo_error_t ind_ofdpa_collector_thread_start(void)
+{
+  indigo_error_t rv;
+  int i;
+
+  if (collectorThreadRunning)
+  {
+    return INDIGO_ERROR_EXISTS;
+  }
+
+  collectorNotifyFd = eventfd(0, EFD_NONBLOCK);
+  if (collectorNotifyFd < 0)
+  {
+    LOG_ERROR("Failed to allocate collector eventfd: %s", strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  rv = ind_soc_socket_register(collectorNotifyFd, collector_notify_ready, NULL);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    close(collectorNotifyFd);
+    collectorNotifyFd = -1;
+    return rv;
+  }
+
+  /* A walk already running as a SocketManager task completes there; the
+     thread skips its collector until then */
+  for (i = 0; i < IND_OFDPA_COLLECT_CLASS_COUNT; i++)
+  {
+    if (collectors[i] != NULL)
+    {
+      ind_soc_timer_event_unregister(collector_refresh_timer, collectors[i]);
+    }
+  }
+
+  collectorThreadStop = 0;
+  collectorThreadRunning = 1;
+  if (pthread_create(&collectorThread, NULL, collector_thread_main, NULL) != 0)
+  {
+    LOG_ERROR("Failed to create collector thread");
+    collectorThreadRunning = 0;
+    for (i = 0; i < IND_OFDPA_COLLECT_CLASS_COUNT; i++)
+    {
+      if (collectors[i] != NULL)
+      {
+        ind_soc_timer_event_register(collector_refresh_timer, collectors[i],
+                                     collectors[i]->intervalMs);
+      }
+    }
+    ind_soc_socket_unregister(collectorNotifyFd);
+    close(collectorNotifyFd);
+    collectorNotifyFd = -1;
+    return INDIGO_ERROR_RESOURCE;
+  }
+  ind_ofdpa_sched_worker(collectorThread);
+
+  LOG_VERBOSE("Collector thread started");
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_collector_thread_stop(void)
+{
+  if (!collectorThreadRunning)
+  {
+    return;
+  }
+
+  /* The thread notices between two steps of a walk */
+  __atomic_store_n(&collectorThreadStop, 1, __ATOMIC_RELAXED);
+  pthread_join(collectorThread, NULL);
+  collectorThreadRunning = 0;
+
+  ind_soc_socket_unregister(collectorNotifyFd);
+  close(collectorNotifyFd);
+  collectorNotifyFd = -1;
+}
@@ -0,0 +1,298 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_counter_store.c
+*
+* @purpose    Port counters that stay monotonic across restarts
+*
+* @component  OF-DPA
+*
+* @comments   The store is a file mapped shared, so what was last written
+*             survives the agent exiting or crashing. For every port it
+*             keeps the raw counters last read from OF-DPA and a base
+*             added to them. A raw counter lower than the one last read
+*             means OF-DPA restarted or the counters were cleared, and
+*             the last value is added to the base, so the counters
+*             reported never go backwards. Counts made between the last
+*             read and a restart of OF-DPA are lost.
+*
+*             The layout is that of this build; a store written by
+*             another build is started over.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_COUNTER_STORE_MAGIC    0x4f464443   /* "OFDC" */
+#define IND_OFDPA_COUNTER_STORE_VERSION  1
+
+/* Reported by OF-DPA for the counters a port does not support */
+#define IND_OFDPA_COUNTER_INVALID        0xFFFFFFFFFFFFFFFFULL
+
+typedef struct
+{
+  uint32_t port;
+  uint32_t resets;              /* times the raw counters went backwards */
+  ofdpaPortStats_t base;
+  ofdpaPortStats_t last;        /* raw counters last read */
+} ind_ofdpa_counter_store_port_t;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t maxPorts;
+  uint32_t numPorts;
+  uint32_t starts;              /* agent starts using this store */
+  uint64_t createdSec;          /* wall clock time the counters count from */
+  ind_ofdpa_counter_store_port_t ports[];   /* sorted by port */
+} ind_ofdpa_counter_store_t;
+
+/* The 64 bit counters of ofdpaPortStats_t */
+static const size_t counterOffsets[] =
+{
+  offsetof(ofdpaPortStats_t, rx_packets),
+  offsetof(ofdpaPortStats_t, tx_packets),
+  offsetof(ofdpaPortStats_t, rx_bytes),
+  offsetof(ofdpaPortStats_t, tx_bytes),
+  offsetof(ofdpaPortStats_t, rx_errors),
+  offsetof(ofdpaPortStats_t, tx_errors),
+  offsetof(ofdpaPortStats_t, rx_drops),
+  offsetof(ofdpaPortStats_t, tx_drops),
+  offsetof(ofdpaPortStats_t, rx_frame_err),
+  offsetof(ofdpaPortStats_t, rx_over_err),
+  offsetof(ofdpaPortStats_t, rx_crc_err),
+  offsetof(ofdpaPortStats_t, collisions),
+};
+
+static ind_ofdpa_counter_store_t *counterStore;
+static size_t counterStoreSize;
+
+/* The collector thread and a cache miss in the event loop may apply
+   counters at the same time */
+static pthread_mutex_t counterStoreLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int counter_store_valid(const ind_ofdpa_counter_store_t *store)
+{
+  return (store->magic == IND_OFDPA_COUNTER_STORE_MAGIC) &&
+    (store->version == IND_OFDPA_COUNTER_STORE_VERSION) &&
+    (store->recordSize == sizeof(ind_ofdpa_counter_store_port_t)) &&
+    (store->maxPorts == IND_OFDPA_COUNTER_STORE_PORTS) &&
+    (store->numPorts <= store->maxPorts);
+}
+
+indigo_error_t ind_ofdpa_counter_store_init(const char *filename)
+{
+  ind_ofdpa_counter_store_t *store;
+  struct stat st;
+  size_t size;
+  int fd;
+
+  size = sizeof(*store) + IND_OFDPA_COUNTER_STORE_PORTS * sizeof(ind_ofdpa_counter_store_port_t);
+
+  fd = open(filename, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    LOG_ERROR("Could not open counter store %s: %s", filename, strerror(errno));
+    return INDIGO_ERROR_PARAM;
+  }
+
+  if ((fstat(fd, &st) < 0) ||
+      (((size_t)st.st_size != size) && (ftruncate(fd, size) < 0)))
+  {
+    LOG_ERROR("Could not size counter store %s: %s", filename, strerror(errno));
+    close(fd);
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  store = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (store == MAP_FAILED)
+  {
+    LOG_ERROR("Could not map counter store %s: %s", filename, strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  if (((size_t)st.st_size != size) || !counter_store_valid(store))
+  {
+    if (st.st_size != 0)
+    {
+      LOG_INFO("Counter store %s is from another build, starting it over", filename);
+    }
+    memset(store, 0, size);
+    store->magic = IND_OFDPA_COUNTER_STORE_MAGIC;
+    store->version = IND_OFDPA_COUNTER_STORE_VERSION;
+    store->recordSize = sizeof(ind_ofdpa_counter_store_port_t);
+    store->maxPorts = IND_OFDPA_COUNTER_STORE_PORTS;
+    store->createdSec = time(NULL);
+  }
+  store->starts++;
+
+  counterStore = store;
+  counterStoreSize = size;
+
+  LOG_INFO("Port counters count from %"PRIu64" (%u ports, start %u)",
+           counterStore->createdSec, counterStore->numPorts, counterStore->starts);
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_counter_store_finish(void)
+{
+  if (counterStore == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&counterStoreLock);
+  (void)msync(counterStore, counterStoreSize, MS_SYNC);
+  munmap(counterStore, counterStoreSize);
+  counterStore = NULL;
+  pthread_mutex_unlock(&counterStoreLock);
+}
+
+/* Find the record of port, adding one if there is room */
+static ind_ofdpa_counter_store_port_t *counter_store_port_get(uint32_t port)
+{
+  ind_ofdpa_counter_store_port_t *record;
+  int lo = 0, hi = (int)counterStore->numPorts - 1, mid;
+
+  while (lo <= hi)
+  {
+    mid = (lo + hi) / 2;
+    if (counterStore->ports[mid].port == port)
+    {
+      return &counterStore->ports[mid];
+    }
+    if (counterStore->ports[mid].port < port)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+
+  if (counterStore->numPorts == counterStore->maxPorts)
+  {
+    return NULL;
+  }
+
+  record = &counterStore->ports[lo];
+  memmove(record + 1, record, (counterStore->numPorts - lo) * sizeof(*record));
+  memset(record, 0, sizeof(*record));
+  record->port = port;
+  counterStore->numPorts++;
+
+  return record;
+}
+
+void ind_ofdpa_counter_store_port_apply(uint32_t port, ofdpaPortStats_t *stats)
+{
+  ind_ofdpa_counter_store_port_t *record;
+  uint64_t *raw, *last, *base;
+  int reset = 0;
+  int i;
+
+  if (counterStore == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&counterStoreLock);
+
+  record = (counterStore != NULL) ? counter_store_port_get(port) : NULL;
+  if (record == NULL)
+  {
+    pthread_mutex_unlock(&counterStoreLock);
+    return;
+  }
+
+  for (i = 0; i < (int)(sizeof(counterOffsets) / sizeof(counterOffsets[0])); i++)
+  {
+    raw = (uint64_t *)((char *)stats + counterOffsets[i]);
+    last = (uint64_t *)((char *)&record->last + counterOffsets[i]);
+    base = (uint64_t *)((char *)&record->base + counterOffsets[i]);
+
+    if (*raw == IND_OFDPA_COUNTER_INVALID)
+    {
+      continue;
+    }
+    if ((*raw < *last) && (*last != IND_OFDPA_COUNTER_INVALID))
+    {
+      *base += *last;
+      reset = 1;
+    }
+    *last = *raw;
+    *raw += *base;
+  }
+
+  if (reset)
+  {
+    record->resets++;
+  }
+
+  pthread_mutex_unlock(&counterStoreLock);
+
+  if (reset)
+  {
+    LOG_VERBOSE("Port %u counters went backwards, carrying them over", port);
+  }
+}
+
+/* Wall clock time the port counters count from, 0 without a store */
+uint64_t ind_ofdpa_counter_store_created(void)
+{
+  return (counterStore != NULL) ? counterStore->createdSec : 0;
+}
+
+void ind_ofdpa_counter_store_show(void)
+{
+  uint32_t resets = 0;
+  uint32_t i;
+
+  if (counterStore == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&counterStoreLock);
+  for (i = 0; i < counterStore->numPorts; i++)
+  {
+    resets += counterStore->ports[i].resets;
+  }
+  LOG_INFO("Counter store: %u ports since %"PRIu64", %u starts, %u counter resets carried over",
+           counterStore->numPorts, counterStore->createdSec, counterStore->starts, resets);
+  pthread_mutex_unlock(&counterStoreLock);
+}
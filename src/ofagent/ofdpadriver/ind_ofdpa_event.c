@@ -0,0 +1,329 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_event.c
+*
+* @purpose    Event socket dispatcher for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The OF-DPA event socket only signals that some event is
+*             queued; ofdpaEventReceive does not say which kind. The
+*             pending notifications are drained in a batch and each event
+*             queue is then read once for the whole batch. Port and OAM
+*             queues cost one RPC when empty and are always read. Flow
+*             events are only flow expiries, so the flow tables are not
+*             read at all while no flow with a timeout is installed.
+*
+*             The event socket cannot filter what the daemon signals, so
+*             the subscription set with ind_ofdpa_event_subscribe decides
+*             which queues, flow tables and ports are read and delivered
+*             here and in the event thread.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <OS/os_time.h>
+
+/* Notifications drained per call; the socket stays readable for the rest */
+#define IND_OFDPA_EVENT_BATCH_MAX  64
+
+#define IND_OFDPA_EVENT_TABLE_MAX  256
+#define IND_OFDPA_EVENT_WORD_BITS  32
+
+/* Words are read without a lock by the event thread; an update in
+   progress may briefly mix the old and new sets */
+typedef struct
+{
+  uint32_t classes;
+  int allTables;
+  int allPorts;
+  uint32_t tables[IND_OFDPA_EVENT_TABLE_MAX / IND_OFDPA_EVENT_WORD_BITS];
+  uint32_t ports[IND_OFDPA_EVENT_PORT_MAX / IND_OFDPA_EVENT_WORD_BITS];
+} ind_ofdpa_event_subscription_t;
+
+static ind_ofdpa_event_subscription_t eventSubscription =
+{
+  .classes = IND_OFDPA_EVENT_CLASS_ALL,
+  .allTables = 1,
+  .allPorts = 1,
+};
+
+typedef enum
+{
+  IND_OFDPA_EVENT_TYPE_PORT,
+  IND_OFDPA_EVENT_TYPE_OAM,
+  IND_OFDPA_EVENT_TYPE_FLOW,
+  IND_OFDPA_EVENT_TYPE_COUNT
+} ind_ofdpa_event_type_t;
+
+typedef struct
+{
+  uint64_t reads;               /* handler invocations */
+  uint64_t events;              /* events returned (flow: tables scheduled) */
+  uint64_t skipped;             /* batches for which the handler was not run */
+  uint64_t filtered;            /* events read but not subscribed to */
+  uint64_t totalUs;
+  uint64_t maxUs;
+} ind_ofdpa_event_stats_t;
+
+static const char *eventTypeNames[IND_OFDPA_EVENT_TYPE_COUNT] =
+{
+  "port", "oam", "flow",
+};
+
+static ind_ofdpa_event_stats_t eventStats[IND_OFDPA_EVENT_TYPE_COUNT];
+static uint64_t eventBatches;
+static uint64_t eventNotifications;
+static uint64_t eventBatchMax;
+
+static void ind_ofdpa_event_account(ind_ofdpa_event_type_t type, int events, uint64_t start)
+{
+  ind_ofdpa_event_stats_t *stats = &eventStats[type];
+  uint64_t elapsed = os_time_monotonic() - start;
+
+  stats->reads++;
+  stats->events += events;
+  stats->totalUs += elapsed;
+  if (elapsed > stats->maxUs)
+  {
+    stats->maxUs = elapsed;
+  }
+}
+
+static int ind_ofdpa_event_bit_get(uint32_t *words, uint32_t bit)
+{
+  return (__atomic_load_n(&words[bit / IND_OFDPA_EVENT_WORD_BITS], __ATOMIC_RELAXED) >>
+          (bit % IND_OFDPA_EVENT_WORD_BITS)) & 1;
+}
+
+static void ind_ofdpa_event_bits_set(uint32_t *words, int numWords,
+                                     const uint32_t *bits, int numBits)
+{
+  uint32_t word;
+  int i, j;
+
+  for (i = 0; i < numWords; i++)
+  {
+    word = 0;
+    for (j = 0; j < numBits; j++)
+    {
+      if (bits[j] / IND_OFDPA_EVENT_WORD_BITS == (uint32_t)i)
+      {
+        word |= 1u << (bits[j] % IND_OFDPA_EVENT_WORD_BITS);
+      }
+    }
+    __atomic_store_n(&words[i], word, __ATOMIC_RELAXED);
+  }
+}
+
+indigo_error_t ind_ofdpa_event_subscribe(uint32_t classes,
+                                         const uint32_t *tableIds, int numTables,
+                                         const uint32_t *ports, int numPorts)
+{
+  ind_ofdpa_event_subscription_t *sub = &eventSubscription;
+  int i;
+
+  if ((classes & ~IND_OFDPA_EVENT_CLASS_ALL) != 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  for (i = 0; i < numTables; i++)
+  {
+    if (tableIds[i] >= IND_OFDPA_EVENT_TABLE_MAX)
+    {
+      return INDIGO_ERROR_PARAM;
+    }
+  }
+  for (i = 0; i < numPorts; i++)
+  {
+    if (ports[i] >= IND_OFDPA_EVENT_PORT_MAX)
+    {
+      return INDIGO_ERROR_PARAM;
+    }
+  }
+
+  ind_ofdpa_event_bits_set(sub->tables, AIM_ARRAYSIZE(sub->tables), tableIds, numTables);
+  ind_ofdpa_event_bits_set(sub->ports, AIM_ARRAYSIZE(sub->ports), ports, numPorts);
+  __atomic_store_n(&sub->allTables, numTables == 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&sub->allPorts, numPorts == 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&sub->classes, classes, __ATOMIC_RELAXED);
+
+  LOG_INFO("Driver event subscription: classes 0x%x, %d tables, %d ports",
+           classes, numTables, numPorts);
+
+  return INDIGO_ERROR_NONE;
+}
+
+int ind_ofdpa_event_class_subscribed(uint32_t eventClass)
+{
+  return (__atomic_load_n(&eventSubscription.classes, __ATOMIC_RELAXED) & eventClass) != 0;
+}
+
+int ind_ofdpa_event_table_subscribed(uint32_t tableId)
+{
+  if (__atomic_load_n(&eventSubscription.allTables, __ATOMIC_RELAXED))
+  {
+    return 1;
+  }
+  return (tableId < IND_OFDPA_EVENT_TABLE_MAX) &&
+    ind_ofdpa_event_bit_get(eventSubscription.tables, tableId);
+}
+
+/* Ports beyond the port set, e.g. logical ports, are always delivered */
+int ind_ofdpa_event_port_subscribed(uint32_t port)
+{
+  if (__atomic_load_n(&eventSubscription.allPorts, __ATOMIC_RELAXED) ||
+      (port >= IND_OFDPA_EVENT_PORT_MAX))
+  {
+    return 1;
+  }
+  if (!ind_ofdpa_event_bit_get(eventSubscription.ports, port))
+  {
+    /* Also called from the event thread */
+    __atomic_add_fetch(&eventStats[IND_OFDPA_EVENT_TYPE_PORT].filtered, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  return 1;
+}
+
+void ind_ofdpa_event_subscription_show(aim_pvs_t *pvs)
+{
+  ind_ofdpa_event_subscription_t *sub = &eventSubscription;
+  uint32_t i;
+
+  aim_printf(pvs, "classes:%s%s%s\n",
+             (sub->classes & IND_OFDPA_EVENT_CLASS_PORT) ? " port" : "",
+             (sub->classes & IND_OFDPA_EVENT_CLASS_OAM) ? " oam" : "",
+             (sub->classes & IND_OFDPA_EVENT_CLASS_FLOW) ? " flow" : "");
+
+  aim_printf(pvs, "tables:");
+  for (i = 0; !sub->allTables && i < IND_OFDPA_EVENT_TABLE_MAX; i++)
+  {
+    if (ind_ofdpa_event_bit_get(sub->tables, i))
+    {
+      aim_printf(pvs, " %u", i);
+    }
+  }
+  aim_printf(pvs, "%s\n", sub->allTables ? " all" : "");
+
+  aim_printf(pvs, "ports:");
+  for (i = 0; !sub->allPorts && i < IND_OFDPA_EVENT_PORT_MAX; i++)
+  {
+    if (ind_ofdpa_event_bit_get(sub->ports, i))
+    {
+      aim_printf(pvs, " %u", i);
+    }
+  }
+  aim_printf(pvs, "%s\n", sub->allPorts ? " all" : "");
+
+  aim_printf(pvs, "port events filtered: %"PRIu64"\n",
+             eventStats[IND_OFDPA_EVENT_TYPE_PORT].filtered);
+}
+
+void ind_ofdpa_event_dispatch(void)
+{
+  struct timeval timeout;
+  uint64_t start;
+  int count;
+  int n = 0;
+
+  do
+  {
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    if (ofdpaEventReceive(&timeout) != OFDPA_E_NONE)
+    {
+      break;
+    }
+  } while (++n < IND_OFDPA_EVENT_BATCH_MAX);
+
+  if (n == 0)
+  {
+    return;
+  }
+
+  eventBatches++;
+  eventNotifications += n;
+  if (n > eventBatchMax)
+  {
+    eventBatchMax = n;
+  }
+
+  if (ind_ofdpa_event_class_subscribed(IND_OFDPA_EVENT_CLASS_PORT))
+  {
+    start = os_time_monotonic();
+    count = ind_ofdpa_port_event_receive();
+    ind_ofdpa_event_account(IND_OFDPA_EVENT_TYPE_PORT, count, start);
+  }
+  else
+  {
+    eventStats[IND_OFDPA_EVENT_TYPE_PORT].skipped++;
+  }
+
+  if (ind_ofdpa_event_class_subscribed(IND_OFDPA_EVENT_CLASS_OAM))
+  {
+    start = os_time_monotonic();
+    count = ind_ofdpa_oam_event_receive();
+    ind_ofdpa_event_account(IND_OFDPA_EVENT_TYPE_OAM, count, start);
+  }
+  else
+  {
+    eventStats[IND_OFDPA_EVENT_TYPE_OAM].skipped++;
+  }
+
+  if (!ind_ofdpa_event_class_subscribed(IND_OFDPA_EVENT_CLASS_FLOW) ||
+      !ind_ofdpa_flow_event_possible())
+  {
+    eventStats[IND_OFDPA_EVENT_TYPE_FLOW].skipped++;
+    return;
+  }
+
+  start = os_time_monotonic();
+  count = ind_ofdpa_flow_event_receive();
+  ind_ofdpa_event_account(IND_OFDPA_EVENT_TYPE_FLOW, count, start);
+}
+
+void ind_ofdpa_event_stats_show(void)
+{
+  ind_ofdpa_event_stats_t *stats;
+  int i;
+
+  if (eventBatches == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("Driver events: %"PRIu64" notifications in %"PRIu64" batches (max %"PRIu64")",
+           eventNotifications, eventBatches, eventBatchMax);
+  for (i = 0; i < IND_OFDPA_EVENT_TYPE_COUNT; i++)
+  {
+    stats = &eventStats[i];
+    LOG_INFO("  %-4s: %"PRIu64" reads %"PRIu64" events %"PRIu64" skipped "
+             "%"PRIu64" filtered, avg %"PRIu64" us max %"PRIu64" us",
+             eventTypeNames[i], stats->reads, stats->events, stats->skipped,
+             stats->filtered,
+             stats->reads ? stats->totalUs / stats->reads : 0, stats->maxUs);
+  }
+}
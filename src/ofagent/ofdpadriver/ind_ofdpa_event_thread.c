@@ -0,0 +1,296 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_event_thread.c
+*
+* @purpose    Driver event thread for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   When enabled, a dedicated thread owns the OF-DPA event
+*             socket. It waits for events and makes the client RPCs that
+*             retrieve flow, port and OAM events, then hands the events to the
+*             SocketManager loop through an SPSC queue and an eventfd.
+*             Everything that touches Indigo state (flow expiry, port
+*             status, counters) still runs on the SocketManager loop.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_spsc.h"
+#include "ind_ofdpa_log.h"
+#include <OS/os_time.h>
+#include <SocketManager/socketmanager.h>
+
+#define IND_OFDPA_EVENT_QUEUE_SIZE     1024
+#define IND_OFDPA_EVENT_WAIT_SEC       1
+#define IND_OFDPA_MAX_FLOW_TABLES      256
+
+typedef enum
+{
+  IND_OFDPA_DRIVER_EVENT_FLOW,
+  IND_OFDPA_DRIVER_EVENT_PORT,
+  IND_OFDPA_DRIVER_EVENT_OAM,
+} ind_ofdpa_driver_event_type_t;
+
+typedef struct
+{
+  ind_ofdpa_driver_event_type_t type;
+  union
+  {
+    ofdpaFlowEvent_t flow;
+    ofdpaPortEvent_t port;
+    ofdpaOamEvent_t oam;
+  } u;
+  uint64_t rxTime;             /* os_time_monotonic() at reception, OAM only */
+} ind_ofdpa_driver_event_t;
+
+static pthread_t eventThread;
+static int eventThreadRunning;
+static int eventThreadStop;
+static int eventNotifyFd = -1;
+static ind_ofdpa_spsc_t eventQueue;
+
+static int supportedTableCount;
+static OFDPA_FLOW_TABLE_ID_t supportedTables[IND_OFDPA_MAX_FLOW_TABLES];
+
+static void event_thread_notify(void)
+{
+  uint64_t x = 1;
+
+  if (write(eventNotifyFd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+}
+
+/* Wait for space rather than drop an event; flow expiry must not be lost */
+static void event_thread_post(ind_ofdpa_driver_event_t *event)
+{
+  while (!ind_ofdpa_spsc_push(&eventQueue, event))
+  {
+    event_thread_notify();
+    if (__atomic_load_n(&eventThreadStop, __ATOMIC_RELAXED))
+    {
+      return;
+    }
+    usleep(1000);
+  }
+}
+
+static void event_thread_read(void)
+{
+  ind_ofdpa_driver_event_t event;
+  int i;
+
+  for (i = 0; i < supportedTableCount; i++)
+  {
+    if (!ind_ofdpa_event_class_subscribed(IND_OFDPA_EVENT_CLASS_FLOW))
+    {
+      break;
+    }
+    if (!ind_ofdpa_event_table_subscribed(supportedTables[i]))
+    {
+      continue;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.type = IND_OFDPA_DRIVER_EVENT_FLOW;
+    event.u.flow.flowMatch.tableId = supportedTables[i];
+
+    while (IND_OFDPA_RPC(ofdpaFlowEventNextGet, &event.u.flow) == OFDPA_E_NONE)
+    {
+      event_thread_post(&event);
+    }
+  }
+
+  if (ind_ofdpa_event_class_subscribed(IND_OFDPA_EVENT_CLASS_PORT))
+  {
+    memset(&event, 0, sizeof(event));
+    event.type = IND_OFDPA_DRIVER_EVENT_PORT;
+    while (IND_OFDPA_RPC(ofdpaPortEventNextGet, &event.u.port) == OFDPA_E_NONE)
+    {
+      if (ind_ofdpa_event_port_subscribed(event.u.port.portNum))
+      {
+        event_thread_post(&event);
+      }
+    }
+  }
+
+  if (ind_ofdpa_event_class_subscribed(IND_OFDPA_EVENT_CLASS_OAM))
+  {
+    memset(&event, 0, sizeof(event));
+    event.type = IND_OFDPA_DRIVER_EVENT_OAM;
+    while (IND_OFDPA_RPC(ofdpaOamEventNextGet, &event.u.oam) == OFDPA_E_NONE)
+    {
+      event.rxTime = os_time_monotonic();
+      event_thread_post(&event);
+    }
+  }
+}
+
+static void *event_thread_main(void *arg)
+{
+  struct timeval timeout;
+
+  while (!__atomic_load_n(&eventThreadStop, __ATOMIC_RELAXED))
+  {
+    timeout.tv_sec = IND_OFDPA_EVENT_WAIT_SEC;
+    timeout.tv_usec = 0;
+
+    if (ofdpaEventReceive(&timeout) != OFDPA_E_NONE)
+    {
+      continue;
+    }
+
+    event_thread_read();
+    event_thread_notify();
+  }
+
+  return NULL;
+}
+
+/* Runs in the SocketManager loop */
+static void event_notify_ready(int socket_id, void *cookie, int read_ready,
+                               int write_ready, int error_seen)
+{
+  ind_ofdpa_driver_event_t event;
+  uint64_t x;
+
+  if (read(eventNotifyFd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+
+  while (ind_ofdpa_spsc_pop(&eventQueue, &event))
+  {
+    if (event.type == IND_OFDPA_DRIVER_EVENT_FLOW)
+    {
+      ind_ofdpa_flow_event_process(&event.u.flow);
+    }
+    else if (event.type == IND_OFDPA_DRIVER_EVENT_OAM)
+    {
+      ind_ofdpa_oam_event_process(&event.u.oam, event.rxTime);
+    }
+    else
+    {
+      ind_ofdpa_port_event_process(&event.u.port);
+    }
+
+    if (ind_soc_should_yield())
+    {
+      /* Come back for the rest on the next iteration */
+      if (!ind_ofdpa_spsc_empty(&eventQueue))
+      {
+        event_thread_notify();
+      }
+      break;
+    }
+  }
+  ind_ofdpa_flow_event_flush();
+}
+
+indigo_error_t ind_ofdpa_event_thread_start(void)
+{
+  indigo_error_t rv;
+  int i;
+
+  if (eventThreadRunning)
+  {
+    return INDIGO_ERROR_EXISTS;
+  }
+
+  supportedTableCount = 0;
+  for (i = 0; i < IND_OFDPA_MAX_FLOW_TABLES; i++)
+  {
+    if (IND_OFDPA_RPC(ofdpaFlowTableSupported, i) == OFDPA_E_NONE)
+    {
+      supportedTables[supportedTableCount++] = i;
+    }
+  }
+
+  rv = ind_ofdpa_spsc_init(&eventQueue, IND_OFDPA_EVENT_QUEUE_SIZE,
+                           sizeof(ind_ofdpa_driver_event_t));
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to allocate driver event queue");
+    return rv;
+  }
+
+  eventNotifyFd = eventfd(0, EFD_NONBLOCK);
+  if (eventNotifyFd < 0)
+  {
+    LOG_ERROR("Failed to allocate driver event eventfd: %s", strerror(errno));
+    ind_ofdpa_spsc_free(&eventQueue);
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  rv = ind_soc_socket_register_with_priority(eventNotifyFd, event_notify_ready, NULL,
+                                             IND_SOC_PRIORITY_FLOW);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    close(eventNotifyFd);
+    eventNotifyFd = -1;
+    ind_ofdpa_spsc_free(&eventQueue);
+    return rv;
+  }
+
+  eventThreadStop = 0;
+  if (pthread_create(&eventThread, NULL, event_thread_main, NULL) != 0)
+  {
+    LOG_ERROR("Failed to create driver event thread");
+    ind_soc_socket_unregister(eventNotifyFd);
+    close(eventNotifyFd);
+    eventNotifyFd = -1;
+    ind_ofdpa_spsc_free(&eventQueue);
+    return INDIGO_ERROR_RESOURCE;
+  }
+  eventThreadRunning = 1;
+  ind_ofdpa_sched_worker(eventThread);
+
+  LOG_VERBOSE("Driver event thread started");
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_event_thread_stop(void)
+{
+  if (!eventThreadRunning)
+  {
+    return;
+  }
+
+  /* The thread notices within IND_OFDPA_EVENT_WAIT_SEC */
+  __atomic_store_n(&eventThreadStop, 1, __ATOMIC_RELAXED);
+  pthread_join(eventThread, NULL);
+  eventThreadRunning = 0;
+
+  ind_soc_socket_unregister(eventNotifyFd);
+  close(eventNotifyFd);
+  eventNotifyFd = -1;
+  ind_ofdpa_spsc_free(&eventQueue);
+}
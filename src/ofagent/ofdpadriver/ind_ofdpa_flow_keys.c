@@ -0,0 +1,150 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_flow_keys.c
+*
+* @purpose    Flow key cache for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The table, priority and timeouts of every flow added by the
+*             agent are kept by cookie, so that flow modify and delete do
+*             not need an ofdpaFlowByCookieGet round trip to find the
+*             flow. The match and instructions are always rebuilt from
+*             the flow-mod, so they are not cached.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+
+#define IND_OFDPA_FLOW_KEY_CACHE_BUCKETS 16384
+
+typedef struct ind_ofdpa_flow_key_entry_s
+{
+  bighash_entry_t hash_entry;
+  uint64_t cookie;
+  uint32_t tableId;
+  uint32_t priority;
+  uint32_t idleTime;
+  uint32_t hardTime;
+  uint32_t mplsLabel;           /* IND_OFDPA_FLOW_KEY_NO_LABEL if not an MPLS flow */
+} ind_ofdpa_flow_key_entry_t;
+
+#define IND_OFDPA_FLOW_KEY_NO_LABEL 0xFFFFFFFF
+
+#define TEMPLATE_NAME flow_key_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_flow_key_entry_t
+#define TEMPLATE_KEY_FIELD cookie
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+static bighash_table_t *flowKeyTable;
+
+void ind_ofdpa_flow_key_add(const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_key_entry_t *entry;
+  uint64_t cookie = flow->cookie;
+
+  if (flowKeyTable == NULL)
+  {
+    flowKeyTable = bighash_table_create(IND_OFDPA_FLOW_KEY_CACHE_BUCKETS);
+    if (flowKeyTable == NULL)
+    {
+      LOG_ERROR("Failed to create flow key cache");
+      return;
+    }
+  }
+
+  entry = flow_key_hashtable_first(flowKeyTable, &cookie);
+  if (entry == NULL)
+  {
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+    {
+      /* Modify and delete fall back to ofdpaFlowByCookieGet */
+      return;
+    }
+    entry->cookie = cookie;
+    entry->mplsLabel = IND_OFDPA_FLOW_KEY_NO_LABEL;
+    if (ind_ofdpa_mpls_label_flow_label(flow, &entry->mplsLabel))
+    {
+      ind_ofdpa_mpls_label_flow_bind(entry->mplsLabel, cookie);
+    }
+    flow_key_hashtable_insert(flowKeyTable, entry);
+  }
+
+  entry->tableId = flow->tableId;
+  entry->priority = flow->priority;
+  entry->idleTime = flow->idle_time;
+  entry->hardTime = flow->hard_time;
+}
+
+void ind_ofdpa_flow_key_remove(uint64_t cookie)
+{
+  ind_ofdpa_flow_key_entry_t *entry;
+
+  if (flowKeyTable == NULL)
+  {
+    return;
+  }
+
+  entry = flow_key_hashtable_first(flowKeyTable, &cookie);
+  if (entry != NULL)
+  {
+    if (entry->mplsLabel != IND_OFDPA_FLOW_KEY_NO_LABEL)
+    {
+      ind_ofdpa_mpls_label_flow_unbind(entry->mplsLabel);
+    }
+    bighash_remove(flowKeyTable, &entry->hash_entry);
+    free(entry);
+  }
+}
+
+/* Fill in the cookie, table, priority and timeouts of a cached flow */
+indigo_error_t ind_ofdpa_flow_key_get(uint64_t cookie, ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_key_entry_t *entry;
+
+  if (flowKeyTable == NULL)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  entry = flow_key_hashtable_first(flowKeyTable, &cookie);
+  if (entry == NULL)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  flow->cookie = cookie;
+  flow->tableId = entry->tableId;
+  flow->priority = entry->priority;
+  flow->idle_time = entry->idleTime;
+  flow->hard_time = entry->hardTime;
+
+  return INDIGO_ERROR_NONE;
+}
@@ -0,0 +1,464 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_flow_stats.c
+*
+* @purpose    Flow counter cache for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The counters of every flow are refreshed by walking the
+*             flow tables from a periodic SocketManager task, so that
+*             flow stats requests are answered without one client RPC
+*             per flow. The walks only run while the cache is read:
+*             after IND_OFDPA_FLOW_STATS_CACHE_IDLE_MS without a read
+*             they stop, and entries found older than two intervals are
+*             read directly until they start again.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/time.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+
+#define IND_OFDPA_MAX_FLOW_TABLES 256
+#define IND_OFDPA_FLOW_STATS_CACHE_BUCKETS 16384
+
+typedef struct ind_ofdpa_flow_stats_entry_s
+{
+  bighash_entry_t hash_entry;
+  uint64_t cookie;
+  uint32_t generation;
+  uint32_t durationSec;
+  indigo_time_t sampled;     /* when the counters were read */
+  uint64_t packets;
+  uint64_t bytes;
+  uint64_t hitPackets;       /* packet count at the last hit status check */
+  uint64_t packetsDelta;     /* change at the last update */
+  uint64_t bytesDelta;
+} ind_ofdpa_flow_stats_entry_t;
+
+#define TEMPLATE_NAME flow_stats_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_flow_stats_entry_t
+#define TEMPLATE_KEY_FIELD cookie
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+static bighash_table_t *flowStatsTable;
+static uint32_t flowStatsIntervalMs;
+static uint32_t flowStatsGeneration;
+
+/* Last read of the cache; read by walks on the collector thread */
+static indigo_time_t flowStatsLastRead;
+static int walkIdle;
+
+/* Counters read by the walk, applied to the cache when it completes */
+typedef struct
+{
+  uint64_t cookie;
+  ofdpaFlowEntryStats_t stats;
+} ind_ofdpa_flow_stats_sample_t;
+
+/* Flow table walk state */
+static int walkTableIndex;
+static ofdpaFlowEntry_t walkCursor;
+static ind_ofdpa_snapshot_t walkSamples = IND_OFDPA_SNAPSHOT_INIT(ind_ofdpa_flow_stats_sample_t);
+
+static int supportedTableCount;
+static OFDPA_FLOW_TABLE_ID_t supportedTables[IND_OFDPA_MAX_FLOW_TABLES];
+
+static ind_ofdpa_flow_stats_entry_t *flow_stats_entry_get(uint64_t cookie)
+{
+  ind_ofdpa_flow_stats_entry_t *entry;
+
+  entry = flow_stats_hashtable_first(flowStatsTable, &cookie);
+  if (entry == NULL)
+  {
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+    {
+      return NULL;
+    }
+    entry->cookie = cookie;
+    flow_stats_hashtable_insert(flowStatsTable, entry);
+  }
+  return entry;
+}
+
+static void flow_stats_entry_update(ind_ofdpa_flow_stats_entry_t *entry,
+                                    ofdpaFlowEntryStats_t *flowStats)
+{
+  /* Counters that went backwards were cleared */
+  entry->packetsDelta = (flowStats->receivedPackets >= entry->packets) ?
+    (flowStats->receivedPackets - entry->packets) : flowStats->receivedPackets;
+  entry->bytesDelta = (flowStats->receivedBytes >= entry->bytes) ?
+    (flowStats->receivedBytes - entry->bytes) : flowStats->receivedBytes;
+
+  entry->generation = flowStatsGeneration;
+  entry->durationSec = flowStats->durationSec;
+  entry->sampled = INDIGO_CURRENT_TIME;
+  entry->packets = flowStats->receivedPackets;
+  entry->bytes = flowStats->receivedBytes;
+}
+
+/* Remove entries that were neither seen by the last complete walk nor
+   added or read since the one before, which may have raced the walk */
+static void flow_stats_sweep(void)
+{
+  bighash_iter_t iter;
+  ind_ofdpa_flow_stats_entry_t *entry;
+  ind_ofdpa_flow_stats_entry_t *next;
+
+  for (entry = bighash_iter_start(flowStatsTable, &iter); entry != NULL; entry = next)
+  {
+    next = bighash_iter_next(&iter);
+    if ((flowStatsGeneration - entry->generation) > 1)
+    {
+      bighash_remove(flowStatsTable, &entry->hash_entry);
+      free(entry);
+    }
+  }
+}
+
+static void flow_stats_walk_table_start(void)
+{
+  memset(&walkCursor, 0, sizeof(walkCursor));
+  if (walkTableIndex < supportedTableCount)
+  {
+    walkCursor.tableId = supportedTables[walkTableIndex];
+  }
+}
+
+/* Only touches the walk state, so it may run on the collector thread */
+static ind_ofdpa_collect_status_t flow_stats_walk_step(void)
+{
+  ofdpaFlowEntry_t nextFlow;
+  ind_ofdpa_flow_stats_sample_t *sample;
+
+  if (walkIdle)
+  {
+    /* Nobody is reading; keep the cache as it is */
+    return IND_OFDPA_COLLECT_ABORTED;
+  }
+
+  if (walkTableIndex >= supportedTableCount)
+  {
+    return IND_OFDPA_COLLECT_FINISHED;
+  }
+
+  if (IND_OFDPA_RPC(ofdpaFlowNextGet, &walkCursor, &nextFlow) != OFDPA_E_NONE)
+  {
+    walkTableIndex++;
+    flow_stats_walk_table_start();
+    return IND_OFDPA_COLLECT_CONTINUE;
+  }
+
+  sample = ind_ofdpa_snapshot_append(&walkSamples);
+  if (sample == NULL)
+  {
+    LOG_ERROR("Failed to grow flow stats walk");
+    return IND_OFDPA_COLLECT_ABORTED;
+  }
+
+  memset(&sample->stats, 0, sizeof(sample->stats));
+  if (IND_OFDPA_RPC(ofdpaFlowStatsGet, &nextFlow, &sample->stats) == OFDPA_E_NONE)
+  {
+    sample->cookie = nextFlow.cookie;
+  }
+  else
+  {
+    walkSamples.count--;
+  }
+
+  memcpy(&walkCursor, &nextFlow, sizeof(walkCursor));
+
+  return IND_OFDPA_COLLECT_CONTINUE;
+}
+
+static void flow_stats_walk_finish(void)
+{
+  ind_ofdpa_flow_stats_sample_t *sample;
+  ind_ofdpa_flow_stats_entry_t *entry;
+  uint32_t i;
+
+  flowStatsGeneration++;
+  for (i = 0; i < walkSamples.count; i++)
+  {
+    sample = ind_ofdpa_snapshot_entry(&walkSamples, i);
+    entry = flow_stats_entry_get(sample->cookie);
+    if (entry != NULL)
+    {
+      flow_stats_entry_update(entry, &sample->stats);
+    }
+  }
+
+  flow_stats_sweep();
+  LOG_TRACE("Flow stats cache refreshed. (entries = %d)",
+            bighash_entry_count(flowStatsTable));
+}
+
+static void flow_stats_walk_start(void)
+{
+  indigo_time_t lastRead = __atomic_load_n(&flowStatsLastRead, __ATOMIC_RELAXED);
+
+  /* Telemetry streams every walk, so it always counts as a reader */
+  walkIdle = !ind_ofdpa_collector_listened(IND_OFDPA_COLLECT_CLASS_FLOW) &&
+    (INDIGO_TIME_DIFF_ms(lastRead, INDIGO_CURRENT_TIME) > IND_OFDPA_FLOW_STATS_CACHE_IDLE_MS);
+
+  walkSamples.count = 0;
+  walkTableIndex = 0;
+  flow_stats_walk_table_start();
+}
+
+static ind_ofdpa_collector_t flowStatsCollector =
+{
+  .name = "flow stats cache",
+  .cls = IND_OFDPA_COLLECT_CLASS_FLOW,
+  .start = flow_stats_walk_start,
+  .step = flow_stats_walk_step,
+  .finish = flow_stats_walk_finish,
+};
+
+/* Read counters from the client library and store them in the cache */
+static indigo_error_t flow_stats_fetch(uint64_t cookie,
+                                       ind_ofdpa_flow_stats_entry_t **entry)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaFlowEntry_t flow;
+  ofdpaFlowEntryStats_t flowStats;
+
+  memset(&flow, 0, sizeof(flow));
+  memset(&flowStats, 0, sizeof(flowStats));
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieGet, cookie, &flow, &flowStats);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  *entry = flow_stats_entry_get(cookie);
+  if (*entry == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  flow_stats_entry_update(*entry, &flowStats);
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t ind_ofdpa_flow_stats_cache_init(uint32_t interval_ms)
+{
+  int i;
+
+  flowStatsIntervalMs = interval_ms;
+  if (flowStatsIntervalMs == 0)
+  {
+    LOG_VERBOSE("Flow stats cache disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  supportedTableCount = 0;
+  for (i = 0; i < IND_OFDPA_MAX_FLOW_TABLES; i++)
+  {
+    if (IND_OFDPA_RPC(ofdpaFlowTableSupported, i) == OFDPA_E_NONE)
+    {
+      supportedTables[supportedTableCount++] = i;
+    }
+  }
+
+  flowStatsTable = bighash_table_create(IND_OFDPA_FLOW_STATS_CACHE_BUCKETS);
+  if (flowStatsTable == NULL)
+  {
+    LOG_ERROR("Failed to create flow stats cache");
+    flowStatsIntervalMs = 0;
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  flowStatsCollector.intervalMs = flowStatsIntervalMs;
+  if (ind_ofdpa_collector_register(&flowStatsCollector) != INDIGO_ERROR_NONE)
+  {
+    bighash_table_destroy(flowStatsTable, NULL);
+    flowStatsTable = NULL;
+    flowStatsIntervalMs = 0;
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+int ind_ofdpa_flow_stats_cache_enabled(void)
+{
+  return (flowStatsIntervalMs != 0);
+}
+
+/* Find the cache entry of a flow for a reader, reading the counters
+   directly if the flow is new to the cache or the walks were idle */
+static indigo_error_t flow_stats_entry_read(uint64_t cookie,
+                                            ind_ofdpa_flow_stats_entry_t **entry)
+{
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+
+  __atomic_store_n(&flowStatsLastRead, now, __ATOMIC_RELAXED);
+
+  *entry = flow_stats_hashtable_first(flowStatsTable, &cookie);
+  if ((*entry == NULL) ||
+      (INDIGO_TIME_DIFF_ms((*entry)->sampled, now) > 2 * (int)flowStatsIntervalMs))
+  {
+    return flow_stats_fetch(cookie, entry);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_flow_stats_cache_add(uint64_t cookie)
+{
+  ind_ofdpa_flow_stats_entry_t *entry;
+
+  if (!ind_ofdpa_flow_stats_cache_enabled())
+  {
+    return;
+  }
+
+  entry = flow_stats_entry_get(cookie);
+  if (entry != NULL)
+  {
+    entry->generation = flowStatsGeneration;
+    entry->durationSec = 0;
+    entry->sampled = INDIGO_CURRENT_TIME;
+    entry->packets = 0;
+    entry->bytes = 0;
+    entry->hitPackets = 0;
+    entry->packetsDelta = 0;
+    entry->bytesDelta = 0;
+  }
+}
+
+void ind_ofdpa_flow_stats_cache_remove(uint64_t cookie)
+{
+  ind_ofdpa_flow_stats_entry_t *entry;
+
+  if (!ind_ofdpa_flow_stats_cache_enabled())
+  {
+    return;
+  }
+
+  entry = flow_stats_hashtable_first(flowStatsTable, &cookie);
+  if (entry != NULL)
+  {
+    bighash_remove(flowStatsTable, &entry->hash_entry);
+    free(entry);
+  }
+}
+
+indigo_error_t ind_ofdpa_flow_stats_cache_get(uint64_t cookie,
+                                              indigo_fi_flow_stats_t *flow_stats)
+{
+  ind_ofdpa_flow_stats_entry_t *entry;
+  indigo_error_t err;
+  int age;
+
+  err = flow_stats_entry_read(cookie, &entry);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    return err;
+  }
+
+  age = INDIGO_TIME_DIFF_ms(entry->sampled, INDIGO_CURRENT_TIME);
+  if (age < 0)
+  {
+    age = 0;
+  }
+
+  flow_stats->flow_id = cookie;
+  flow_stats->duration_ns = (uint64_t)entry->durationSec * IND_OFDPA_NANO_SEC;
+  flow_stats->packets = entry->packets;
+  flow_stats->bytes = entry->bytes;
+  flow_stats->counters_age_ns = (uint64_t)age * 1000000;
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Counters for a flow that is about to be deleted. The cached counters
+   miss whatever the flow matched since the last walk, so read them from
+   OF-DPA and fall back to the cache only if that fails. */
+indigo_error_t ind_ofdpa_flow_stats_final_get(uint64_t cookie, ofdpaFlowEntry_t *flow,
+                                              indigo_fi_flow_stats_t *flow_stats)
+{
+  ofdpaFlowEntryStats_t flowStats;
+
+  memset(&flowStats, 0, sizeof(flowStats));
+  if (IND_OFDPA_RPC(ofdpaFlowStatsGet, flow, &flowStats) != OFDPA_E_NONE)
+  {
+    return ind_ofdpa_flow_stats_cache_get(cookie, flow_stats);
+  }
+
+  flow_stats->flow_id = cookie;
+  flow_stats->duration_ns = (uint64_t)flowStats.durationSec * IND_OFDPA_NANO_SEC;
+  flow_stats->packets = flowStats.receivedPackets;
+  flow_stats->bytes = flowStats.receivedBytes;
+  flow_stats->counters_age_ns = 0;
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t ind_ofdpa_flow_stats_cache_hit_get(uint64_t cookie, bool *hit_status)
+{
+  ind_ofdpa_flow_stats_entry_t *entry;
+  indigo_error_t err;
+
+  err = flow_stats_entry_read(cookie, &entry);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    return err;
+  }
+
+  *hit_status = (entry->packets != entry->hitPackets);
+  entry->hitPackets = entry->packets;
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Flows whose counters changed in the last complete walk */
+void ind_ofdpa_flow_stats_cache_delta_foreach(ind_ofdpa_flow_stats_delta_f fn, void *arg)
+{
+  bighash_iter_t iter;
+  ind_ofdpa_flow_stats_entry_t *entry;
+
+  if (flowStatsTable == NULL)
+  {
+    return;
+  }
+
+  for (entry = bighash_iter_start(flowStatsTable, &iter); entry != NULL;
+       entry = bighash_iter_next(&iter))
+  {
+    if ((entry->generation == flowStatsGeneration) &&
+        ((entry->packetsDelta != 0) || (entry->bytesDelta != 0)))
+    {
+      fn(entry->cookie, entry->packetsDelta, entry->bytesDelta, arg);
+    }
+  }
+}
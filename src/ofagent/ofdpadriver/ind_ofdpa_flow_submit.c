@@ -0,0 +1,469 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_flow_submit.c
+*
+* @purpose    Pipelined flow submission for the OF-DPA Driver
+*
+* @comments   The OF-DPA client calls block until the OF-DPA process has
+*             answered. When the submit thread is running, a flow add
+*             batch hands each flow to the thread as soon as it is
+*             translated, and the thread makes the ofdpaFlowAdd call
+*             while the SocketManager loop translates the next flow.
+*             The loop then waits for the batch to complete and does
+*             the per-flow bookkeeping itself, in order, so none of the
+*             driver caches are touched from the thread. Flow delete
+*             batches are pipelined the same way, with
+*             ofdpaFlowByCookieDelete, and flow modify batches with
+*             ofdpaFlowModify.
+*
+*             On systems with several switch units there is one submit
+*             thread per unit, so the units are programmed in parallel.
+*             A flow goes to the unit of its ingress port, or of the
+*             port of the L2 interface group a bridging flow points to,
+*             with ports numbered consecutively across the units. Flows
+*             without one are spread over the units by cookie. The flows
+*             of a batch are independent of each other, and waiting for
+*             a batch waits for every unit, so the batch is the barrier
+*             across units for controller barriers as before.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_spsc.h"
+#include "ind_ofdpa_log.h"
+#include <OS/os_time.h>
+
+#define IND_OFDPA_FLOW_SUBMIT_QUEUE_SIZE 1024
+
+typedef struct
+{
+  ofdpaFlowEntry_t *flow;
+  OFDPA_ERROR_t *rv;
+  int op;                       /* IND_OFDPA_FLOW_SUBMIT_* */
+} ind_ofdpa_flow_submit_entry_t;
+
+#define IND_OFDPA_FLOW_SUBMIT_ADD     0
+#define IND_OFDPA_FLOW_SUBMIT_DELETE  1 /* delete flow->cookie */
+#define IND_OFDPA_FLOW_SUBMIT_MODIFY  2
+
+/* The submit thread of one unit */
+typedef struct
+{
+  pthread_t thread;
+  ind_ofdpa_spsc_t queue;
+
+  /* Loop to thread: work queued */
+  int doorbellFd;
+  int doorbellPending;
+
+  uint64_t submitted;           /* written by the loop */
+  uint64_t completed;           /* written by the thread */
+} ind_ofdpa_flow_submit_unit_t;
+
+static ind_ofdpa_flow_submit_unit_t submitUnits[IND_OFDPA_FLOW_SUBMIT_MAX_UNITS];
+static int submitUnitCount;
+static uint32_t submitUnitPorts;
+static int submitThreadRunning;
+static int submitThreadStop;
+
+/* Thread to loop: a waited for batch completed on a unit */
+static int submitDoneFd = -1;
+static int submitWaiting;
+
+static uint64_t batches;
+static uint64_t waitTimeUs;     /* loop time spent waiting for the threads */
+
+static void flow_submit_doorbell(ind_ofdpa_flow_submit_unit_t *unit)
+{
+  uint64_t x = 1;
+
+  /* Only one wakeup is outstanding at a time */
+  if (__atomic_exchange_n(&unit->doorbellPending, 1, __ATOMIC_SEQ_CST) == 0)
+  {
+    if (write(unit->doorbellFd, &x, sizeof(x)) < 0)
+    {
+      /* silence warn_unused_result */
+    }
+  }
+}
+
+static void *flow_submit_thread_main(void *arg)
+{
+  ind_ofdpa_flow_submit_unit_t *unit = arg;
+  ind_ofdpa_flow_submit_entry_t entry;
+  uint64_t x = 1;
+
+  while (!__atomic_load_n(&submitThreadStop, __ATOMIC_RELAXED))
+  {
+    while (ind_ofdpa_spsc_pop(&unit->queue, &entry))
+    {
+      switch (entry.op)
+      {
+        case IND_OFDPA_FLOW_SUBMIT_DELETE:
+          *entry.rv = IND_OFDPA_RPC(ofdpaFlowByCookieDelete, entry.flow->cookie);
+          break;
+        case IND_OFDPA_FLOW_SUBMIT_MODIFY:
+          *entry.rv = IND_OFDPA_RPC(ofdpaFlowModify, entry.flow);
+          break;
+        default:
+          *entry.rv = IND_OFDPA_RPC(ofdpaFlowAdd, entry.flow);
+          break;
+      }
+      __atomic_add_fetch(&unit->completed, 1, __ATOMIC_SEQ_CST);
+
+      if (__atomic_load_n(&submitWaiting, __ATOMIC_SEQ_CST) &&
+          (__atomic_load_n(&unit->completed, __ATOMIC_RELAXED) ==
+           __atomic_load_n(&unit->submitted, __ATOMIC_RELAXED)))
+      {
+        if (write(submitDoneFd, &x, sizeof(x)) < 0)
+        {
+          /* silence warn_unused_result */
+        }
+      }
+    }
+
+    if (read(unit->doorbellFd, &x, sizeof(x)) < 0)
+    {
+      continue;
+    }
+    /* Flows queued after this point ring the doorbell again */
+    __atomic_store_n(&unit->doorbellPending, 0, __ATOMIC_SEQ_CST);
+  }
+
+  return NULL;
+}
+
+int ind_ofdpa_flow_submit_thread_running(void)
+{
+  return submitThreadRunning;
+}
+
+/* Port a flow programs, or 0 if it has none */
+static uint32_t flow_submit_port(const ofdpaFlowEntry_t *flow)
+{
+  uint32_t type, port;
+
+  switch (flow->tableId)
+  {
+    case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
+      if (flow->flowData.ingressPortFlowEntry.match_criteria.inPortMask == OFDPA_INPORT_EXACT_MASK)
+      {
+        return flow->flowData.ingressPortFlowEntry.match_criteria.inPort;
+      }
+      break;
+    case OFDPA_FLOW_TABLE_ID_VLAN:
+      return flow->flowData.vlanFlowEntry.match_criteria.inPort;
+    case OFDPA_FLOW_TABLE_ID_VLAN_1:
+      return flow->flowData.vlan1FlowEntry.match_criteria.inPort;
+    case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
+      if (flow->flowData.terminationMacFlowEntry.match_criteria.inPortMask == OFDPA_INPORT_EXACT_MASK)
+      {
+        return flow->flowData.terminationMacFlowEntry.match_criteria.inPort;
+      }
+      break;
+    case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
+      if (flow->flowData.policyAclFlowEntry.match_criteria.inPortMask == OFDPA_INPORT_EXACT_MASK)
+      {
+        return flow->flowData.policyAclFlowEntry.match_criteria.inPort;
+      }
+      break;
+    case OFDPA_FLOW_TABLE_ID_BRIDGING:
+      ofdpaGroupTypeGet(flow->flowData.bridgingFlowEntry.groupID, &type);
+      if ((type == OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE) &&
+          (ofdpaGroupPortIdGet(flow->flowData.bridgingFlowEntry.groupID, &port) == OFDPA_E_NONE))
+      {
+        return port;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return 0;
+}
+
+static ind_ofdpa_flow_submit_unit_t *flow_submit_unit(const ofdpaFlowEntry_t *flow)
+{
+  uint32_t port;
+
+  if (submitUnitCount == 1)
+  {
+    return &submitUnits[0];
+  }
+
+  if (submitUnitPorts != 0)
+  {
+    port = flow_submit_port(flow);
+    if ((port != 0) && (port <= submitUnitPorts * submitUnitCount))
+    {
+      return &submitUnits[(port - 1) / submitUnitPorts];
+    }
+  }
+
+  return &submitUnits[flow->cookie % submitUnitCount];
+}
+
+static void flow_submit_queue(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv,
+                              int op)
+{
+  ind_ofdpa_flow_submit_unit_t *unit = flow_submit_unit(flow);
+  ind_ofdpa_flow_submit_entry_t entry;
+
+  entry.flow = flow;
+  entry.rv = rv;
+  entry.op = op;
+
+  /* Counted first, so completed never runs ahead of submitted */
+  __atomic_store_n(&unit->submitted, unit->submitted + 1, __ATOMIC_SEQ_CST);
+  while (!ind_ofdpa_spsc_push(&unit->queue, &entry))
+  {
+    /* More in flight than the queue holds; the thread is busy anyway */
+    sched_yield();
+  }
+
+  flow_submit_doorbell(unit);
+}
+
+/* Queue a translated flow; *rv is set once ind_ofdpa_flow_submit_wait
+   returns. Both must stay valid until then. */
+void ind_ofdpa_flow_submit(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  flow_submit_queue(flow, rv, IND_OFDPA_FLOW_SUBMIT_ADD);
+}
+
+/* Queue the delete of the flow with cookie flow->cookie, the same way */
+void ind_ofdpa_flow_submit_delete(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  flow_submit_queue(flow, rv, IND_OFDPA_FLOW_SUBMIT_DELETE);
+}
+
+/* Queue a translated change to an existing flow, the same way */
+void ind_ofdpa_flow_submit_modify(ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  flow_submit_queue(flow, rv, IND_OFDPA_FLOW_SUBMIT_MODIFY);
+}
+
+static int flow_submit_done(void)
+{
+  int i;
+
+  for (i = 0; i < submitUnitCount; i++)
+  {
+    if (__atomic_load_n(&submitUnits[i].completed, __ATOMIC_SEQ_CST) !=
+        submitUnits[i].submitted)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Wait until every queued flow has been added, deleted or modified on
+   every unit */
+void ind_ofdpa_flow_submit_wait(void)
+{
+  uint64_t start;
+  uint64_t x;
+
+  batches++;
+  if (flow_submit_done())
+  {
+    return;
+  }
+
+  start = os_time_monotonic();
+  __atomic_store_n(&submitWaiting, 1, __ATOMIC_SEQ_CST);
+  while (!flow_submit_done())
+  {
+    /* A wakeup left over from an earlier batch, or from a unit that
+       finished first, only costs a recheck */
+    if ((read(submitDoneFd, &x, sizeof(x)) < 0) && (errno != EINTR))
+    {
+      LOG_ERROR("Failed to wait for flow submission: %s", strerror(errno));
+      break;
+    }
+  }
+  __atomic_store_n(&submitWaiting, 0, __ATOMIC_SEQ_CST);
+  waitTimeUs += os_time_monotonic() - start;
+}
+
+void ind_ofdpa_flow_submit_thread_show(void)
+{
+  uint64_t submitted = 0;
+  int i;
+
+  if (!submitThreadRunning)
+  {
+    return;
+  }
+
+  for (i = 0; i < submitUnitCount; i++)
+  {
+    submitted += submitUnits[i].submitted;
+  }
+
+  LOG_INFO("Flow submit thread: %"PRIu64" flows in %"PRIu64" batches, "
+           "%"PRIu64" us waiting for completions",
+           submitted, batches, waitTimeUs);
+  if (submitUnitCount > 1)
+  {
+    for (i = 0; i < submitUnitCount; i++)
+    {
+      LOG_INFO("  unit %d: %"PRIu64" flows", i, submitUnits[i].submitted);
+    }
+  }
+}
+
+static void flow_submit_units_free(void)
+{
+  int i;
+
+  for (i = 0; i < submitUnitCount; i++)
+  {
+    if (submitUnits[i].doorbellFd >= 0)
+    {
+      close(submitUnits[i].doorbellFd);
+      submitUnits[i].doorbellFd = -1;
+    }
+    ind_ofdpa_spsc_free(&submitUnits[i].queue);
+  }
+  if (submitDoneFd >= 0)
+  {
+    close(submitDoneFd);
+    submitDoneFd = -1;
+  }
+  submitUnitCount = 0;
+}
+
+static void flow_submit_threads_stop(int count)
+{
+  uint64_t x = 1;
+  int i;
+
+  __atomic_store_n(&submitThreadStop, 1, __ATOMIC_RELAXED);
+  for (i = 0; i < count; i++)
+  {
+    if (write(submitUnits[i].doorbellFd, &x, sizeof(x)) < 0)
+    {
+      /* silence warn_unused_result */
+    }
+    pthread_join(submitUnits[i].thread, NULL);
+  }
+}
+
+/* units threads, the first unit_ports ports on the first unit, the next
+   on the second and so on; unit_ports 0 spreads all flows by cookie */
+indigo_error_t ind_ofdpa_flow_submit_thread_start(int units, uint32_t unit_ports)
+{
+  ind_ofdpa_flow_submit_unit_t *unit;
+  indigo_error_t rv;
+  int i;
+
+  if (submitThreadRunning)
+  {
+    return INDIGO_ERROR_EXISTS;
+  }
+
+  if ((units < 1) || (units > IND_OFDPA_FLOW_SUBMIT_MAX_UNITS))
+  {
+    LOG_ERROR("Invalid flow submit unit count %d", units);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  /* Both blocking; each side sleeps in read() until the other writes */
+  submitDoneFd = eventfd(0, 0);
+  if (submitDoneFd < 0)
+  {
+    LOG_ERROR("Failed to allocate flow submit eventfd: %s", strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  memset(submitUnits, 0, sizeof(submitUnits));
+  for (submitUnitCount = 0; submitUnitCount < units; submitUnitCount++)
+  {
+    unit = &submitUnits[submitUnitCount];
+    unit->doorbellFd = eventfd(0, 0);
+    if (unit->doorbellFd < 0)
+    {
+      LOG_ERROR("Failed to allocate flow submit eventfd: %s", strerror(errno));
+      submitUnitCount++;
+      rv = INDIGO_ERROR_RESOURCE;
+      goto error;
+    }
+
+    rv = ind_ofdpa_spsc_init(&unit->queue, IND_OFDPA_FLOW_SUBMIT_QUEUE_SIZE,
+                             sizeof(ind_ofdpa_flow_submit_entry_t));
+    if (rv != INDIGO_ERROR_NONE)
+    {
+      LOG_ERROR("Failed to allocate flow submit queue");
+      submitUnitCount++;
+      goto error;
+    }
+  }
+  submitUnitPorts = unit_ports;
+
+  submitThreadStop = 0;
+  submitWaiting = 0;
+  batches = waitTimeUs = 0;
+  for (i = 0; i < units; i++)
+  {
+    if (pthread_create(&submitUnits[i].thread, NULL, flow_submit_thread_main,
+                       &submitUnits[i]) != 0)
+    {
+      LOG_ERROR("Failed to create flow submit thread");
+      flow_submit_threads_stop(i);
+      rv = INDIGO_ERROR_RESOURCE;
+      goto error;
+    }
+    ind_ofdpa_sched_worker(submitUnits[i].thread);
+  }
+  submitThreadRunning = 1;
+
+  LOG_VERBOSE("Flow submit threads started for %d units", units);
+
+  return INDIGO_ERROR_NONE;
+
+error:
+  flow_submit_units_free();
+  return rv;
+}
+
+void ind_ofdpa_flow_submit_thread_stop(void)
+{
+  if (!submitThreadRunning)
+  {
+    return;
+  }
+
+  /* Batches are always waited for, so nothing is in flight here */
+  flow_submit_threads_stop(submitUnitCount);
+  submitThreadRunning = 0;
+
+  flow_submit_units_free();
+}
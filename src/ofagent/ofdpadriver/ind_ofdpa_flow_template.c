@@ -0,0 +1,279 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_flow_template.c
+*
+* @purpose    Flow translation templates for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Controllers program the per-port tables (Ingress Port, VLAN,
+*             VLAN 1, Egress VLAN, Egress VLAN 1 and Egress DSCP PCP
+*             Remark) with flows that are the same on every port but for
+*             the port they match. Once a flow of such a table has been
+*             translated, its translation is kept as a template keyed by
+*             the match without the port and by the instruction bytes.
+*             A later flow with the same match and instructions on another
+*             port is translated by copying the template and patching in
+*             the port, without walking the match and instructions again.
+*
+*             Templates are only ever added, up to
+*             IND_OFDPA_FLOW_TEMPLATES_MAX; they hold no reference to the
+*             flows made from them. The state manager already shares one
+*             copy of identical instruction lists between flows.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+#include <murmur/murmur.h>
+
+#define IND_OFDPA_FLOW_TEMPLATES_MAX        4096
+#define IND_OFDPA_FLOW_TEMPLATE_BUCKETS     1024
+
+/* Longer instruction lists are not templated */
+#define IND_OFDPA_FLOW_TEMPLATE_INST_MAX    256
+
+typedef struct
+{
+  bighash_entry_t hash_entry;
+  uint32_t tableId;
+  uint16_t instLen;
+  uint8_t inst[IND_OFDPA_FLOW_TEMPLATE_INST_MAX];
+  of_match_t match;             /* port field cleared */
+  ofdpaFlowEntry_t flow;        /* translation, port field as translated */
+} ind_ofdpa_flow_template_t;
+
+typedef struct
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t uncached;            /* misses not kept because the table is full */
+} ind_ofdpa_flow_template_stats_t;
+
+static bighash_table_t *templateTable;
+static ind_ofdpa_flow_template_stats_t templateStats;
+
+/* Whether flows of the table are templated, and if so clear the port the
+   match depends on */
+static int flow_template_match_key(uint32_t tableId, const of_match_t *match,
+                                   of_match_t *key)
+{
+  switch (tableId)
+  {
+    case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
+    case OFDPA_FLOW_TABLE_ID_VLAN:
+    case OFDPA_FLOW_TABLE_ID_VLAN_1:
+      *key = *match;
+      key->fields.in_port = 0;
+      return 1;
+    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN:
+    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1:
+    case OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK:
+      *key = *match;
+      key->fields.onf_actset_output = 0;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Set the port of a translation copied from a template */
+static void flow_template_port_patch(const of_match_t *match, ofdpaFlowEntry_t *flow)
+{
+  switch (flow->tableId)
+  {
+    case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
+      flow->flowData.ingressPortFlowEntry.match_criteria.inPort = match->fields.in_port;
+      break;
+    case OFDPA_FLOW_TABLE_ID_VLAN:
+      flow->flowData.vlanFlowEntry.match_criteria.inPort = match->fields.in_port;
+      break;
+    case OFDPA_FLOW_TABLE_ID_VLAN_1:
+      flow->flowData.vlan1FlowEntry.match_criteria.inPort = match->fields.in_port;
+      break;
+    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN:
+      flow->flowData.egressVlanFlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
+      break;
+    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1:
+      flow->flowData.egressVlan1FlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
+      break;
+    case OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK:
+      flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.outPort =
+        match->fields.onf_actset_output;
+      break;
+    default:
+      break;
+  }
+}
+
+/* Instruction bytes of the flow-mod, NULL if too long to template */
+static const uint8_t *flow_template_inst(of_flow_add_t *flow_add, uint16_t *len)
+{
+  of_list_instruction_t insts;
+
+  of_flow_modify_instructions_bind((of_flow_modify_t *)flow_add, &insts);
+  if (insts.length > IND_OFDPA_FLOW_TEMPLATE_INST_MAX)
+  {
+    return NULL;
+  }
+  *len = insts.length;
+  return OF_OBJECT_BUFFER_INDEX(&insts, 0);
+}
+
+static uint32_t flow_template_hash(uint32_t tableId, const of_match_t *key,
+                                   const uint8_t *inst, uint16_t instLen)
+{
+  return murmur_hash(inst, instLen, murmur_hash(key, sizeof(*key), tableId));
+}
+
+static ind_ofdpa_flow_template_t *flow_template_find(uint32_t hash, uint32_t tableId,
+                                                     const of_match_t *key,
+                                                     const uint8_t *inst, uint16_t instLen)
+{
+  ind_ofdpa_flow_template_t *entry;
+  bighash_entry_t *e;
+
+  for (e = bighash_first(templateTable, hash); e != NULL; e = bighash_next(e))
+  {
+    entry = container_of(e, hash_entry, ind_ofdpa_flow_template_t);
+    if ((entry->tableId == tableId) && (entry->instLen == instLen) &&
+        (memcmp(entry->inst, inst, instLen) == 0) &&
+        (memcmp(&entry->match, key, sizeof(*key)) == 0))
+    {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+indigo_error_t ind_ofdpa_flow_template_init(void)
+{
+  templateTable = bighash_table_create(IND_OFDPA_FLOW_TEMPLATE_BUCKETS);
+  if (templateTable == NULL)
+  {
+    LOG_ERROR("Failed to create flow template table");
+    return INDIGO_ERROR_RESOURCE;
+  }
+  return INDIGO_ERROR_NONE;
+}
+
+/* Translate the match and instructions of a flow whose header fields are
+   already in flow by patching a template. Only the flowData member of the
+   table is copied. Returns 0 if there is none. */
+int ind_ofdpa_flow_template_apply(of_flow_add_t *flow_add, const of_match_t *match,
+                                  ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_template_t *entry;
+  const uint8_t *inst;
+  uint16_t instLen;
+  of_match_t key;
+
+  if ((templateTable == NULL) || !flow_template_match_key(flow->tableId, match, &key))
+  {
+    return 0;
+  }
+  inst = flow_template_inst(flow_add, &instLen);
+  if (inst == NULL)
+  {
+    return 0;
+  }
+
+  entry = flow_template_find(flow_template_hash(flow->tableId, &key, inst, instLen),
+                             flow->tableId, &key, inst, instLen);
+  if (entry == NULL)
+  {
+    templateStats.misses++;
+    return 0;
+  }
+
+  memcpy(&flow->flowData, &entry->flow.flowData, ind_ofdpa_flow_data_size(flow->tableId));
+  flow_template_port_patch(match, flow);
+  templateStats.hits++;
+
+  return 1;
+}
+
+/* Keep a complete translation as the template for its match and
+   instructions */
+void ind_ofdpa_flow_template_add(of_flow_add_t *flow_add, const of_match_t *match,
+                                 const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_template_t *entry;
+  const uint8_t *inst;
+  uint16_t instLen;
+  of_match_t key;
+  uint32_t hash;
+
+  if ((templateTable == NULL) || !flow_template_match_key(flow->tableId, match, &key))
+  {
+    return;
+  }
+  inst = flow_template_inst(flow_add, &instLen);
+  if (inst == NULL)
+  {
+    return;
+  }
+
+  hash = flow_template_hash(flow->tableId, &key, inst, instLen);
+  if (flow_template_find(hash, flow->tableId, &key, inst, instLen) != NULL)
+  {
+    return;
+  }
+
+  if (bighash_entry_count(templateTable) >= IND_OFDPA_FLOW_TEMPLATES_MAX)
+  {
+    templateStats.uncached++;
+    return;
+  }
+
+  entry = malloc(sizeof(*entry));
+  if (entry == NULL)
+  {
+    templateStats.uncached++;
+    return;
+  }
+  entry->tableId = flow->tableId;
+  entry->instLen = instLen;
+  memcpy(entry->inst, inst, instLen);
+  entry->match = key;
+  entry->flow = *flow;
+  bighash_insert(templateTable, &entry->hash_entry, hash);
+}
+
+void ind_ofdpa_flow_template_show(void)
+{
+  if ((templateTable == NULL) || (templateStats.hits + templateStats.misses == 0))
+  {
+    return;
+  }
+
+  LOG_INFO("Flow templates: %d templates, %"PRIu64" flows translated from a template, "
+           "%"PRIu64" translated in full, %"PRIu64" not kept",
+           bighash_entry_count(templateTable), templateStats.hits,
+           templateStats.misses, templateStats.uncached);
+}
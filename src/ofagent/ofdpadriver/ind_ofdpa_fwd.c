@@ -41,9 +41,15 @@
 #include "indigo/memory.h"
 #include "indigo/forwarding.h"
 #include "ind_ofdpa_log.h"
+#include "ind_ofdpa_queue_rates.h"
 #include "indigo/of_state_manager.h"
 #include "indigo/fi.h"
 #include "OFStateManager/ofstatemanager.h"
+#include <SocketManager/socketmanager.h>
+#include "indigo/of_message.h"
+#include "ind_ofdpa_spsc.h"
+#include "indigo/of_fast.h"
+#include <OS/os_time.h>
 
 
 static indigo_error_t ind_ofdpa_packet_out_actions_get(of_list_action_t *of_list_actions,
@@ -56,6 +62,169 @@ static indigo_error_t indigo_drop_status(ofdpa_oam_drop_status_mod_msg_t *oam_dr
 static indigo_error_t indigo_remark_action(ofdpa_mpls_tunnel_label_remark_action_mod_msg_t *mpls_tunnel_label_remark);
 extern int ofagent_of_version;
 
+#define IND_OFDPA_FLOW_TABLE_COUNT 256
+
+/* Per-table occupancy, maintained on flow add/delete so table stats
+   do not need to query every table. The supported tables are found once,
+   and only tables holding flows with a timeout are read for flow events.
+   The table sizes read then let adds to a full table be refused without
+   an ofdpaFlowAdd call. */
+typedef struct indTableStatsCache_s
+{
+  int      initialized;
+  int      numTables;
+  uint8_t  tableIds[IND_OFDPA_FLOW_TABLE_COUNT];
+  uint32_t activeCount[IND_OFDPA_FLOW_TABLE_COUNT];
+  uint32_t maxCount[IND_OFDPA_FLOW_TABLE_COUNT];   /* 0 if not known */
+  uint32_t timedCount[IND_OFDPA_FLOW_TABLE_COUNT];
+  uint32_t timedTotal;          /* sum of timedCount */
+  uint8_t  eventPending[IND_OFDPA_FLOW_TABLE_COUNT];
+  int      sweepAll;            /* flows from before the agent started */
+} indTableStatsCache_t;
+
+static indTableStatsCache_t tableStatsCache;
+
+/* Packet-out batch sizes are counted in power of two buckets:
+   1, 2-3, 4-7, ... and 128 or more */
+#define IND_OFDPA_PKT_OUT_BATCH_BUCKETS 8
+
+typedef struct indPacketOutStats_s
+{
+  uint64_t batches;
+  uint64_t packets;
+  uint64_t errors;
+  uint64_t sendTimeUs;          /* total time in ofdpaPktSend */
+  uint32_t sendTimeMaxUs;       /* longest single ofdpaPktSend */
+  uint64_t batchSizes[IND_OFDPA_PKT_OUT_BATCH_BUCKETS];
+} indPacketOutStats_t;
+
+static indPacketOutStats_t packetOutStats;
+
+/* Flows expired by OF-DPA are passed to the state manager in batches,
+   so their flow removed messages go out together */
+#define IND_OFDPA_FLOW_EXPIRY_BATCH_MAX 64
+
+typedef struct indFlowExpiryBatch_s
+{
+  int count;
+  indigo_fi_flow_removed_t reasons[IND_OFDPA_FLOW_EXPIRY_BATCH_MAX];
+  indigo_fi_flow_stats_t stats[IND_OFDPA_FLOW_EXPIRY_BATCH_MAX];
+  uint64_t batches;
+  uint64_t flows;
+} indFlowExpiryBatch_t;
+
+static indFlowExpiryBatch_t flowExpiry;
+static int flowExpiryOffload = 1;
+
+static void ind_ofdpa_table_stats_cache_init(void)
+{
+  ofdpaFlowTableInfo_t tableInfo;
+  int i;
+
+  if (tableStatsCache.initialized)
+  {
+    return;
+  }
+
+  memset(&tableStatsCache, 0, sizeof(tableStatsCache));
+  for (i = 0; i < IND_OFDPA_FLOW_TABLE_COUNT; i++)
+  {
+    if (IND_OFDPA_RPC(ofdpaFlowTableSupported, i) != OFDPA_E_NONE)
+    {
+      continue;
+    }
+    tableStatsCache.tableIds[tableStatsCache.numTables++] = i;
+
+    memset(&tableInfo, 0, sizeof(tableInfo));
+    if (IND_OFDPA_RPC(ofdpaFlowTableInfoGet, i, &tableInfo) == OFDPA_E_NONE)
+    {
+      tableStatsCache.activeCount[i] = tableInfo.numEntries;
+      tableStatsCache.maxCount[i] = tableInfo.maxEntries;
+    }
+  }
+  /* Timeouts of flows already in the tables are not known, so every
+     flow event reads every supported table until the startup load has
+     counted them */
+  tableStatsCache.sweepAll = 1;
+  tableStatsCache.initialized = 1;
+}
+
+static int ind_ofdpa_flow_is_timed(const ofdpaFlowEntry_t *flow)
+{
+  return ((flow->idle_time != 0) || (flow->hard_time != 0));
+}
+
+void ind_ofdpa_table_stats_flow_added(uint32_t tableId, int timed)
+{
+  ind_ofdpa_table_stats_cache_init();
+  if (tableId < IND_OFDPA_FLOW_TABLE_COUNT)
+  {
+    tableStatsCache.activeCount[tableId]++;
+    if (timed)
+    {
+      tableStatsCache.timedCount[tableId]++;
+      tableStatsCache.timedTotal++;
+    }
+  }
+}
+
+/* Only tables whose OF flows map one-to-one onto OF-DPA entries are
+   checked here. Suppressed routes and compiled ACLs may use no entry
+   or share one, so their add paths decide for themselves. */
+indigo_error_t indigo_fwd_flow_space_check(uint8_t table_id)
+{
+  if (ind_ofdpa_route_compress_table(table_id) ||
+      ind_ofdpa_acl_compile_table(table_id))
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  ind_ofdpa_table_stats_cache_init();
+  if ((tableStatsCache.maxCount[table_id] != 0) &&
+      (tableStatsCache.activeCount[table_id] >= tableStatsCache.maxCount[table_id]))
+  {
+    return INDIGO_ERROR_TABLE_FULL;
+  }
+  return INDIGO_ERROR_NONE;
+}
+
+/* Counts of a table read by the startup load */
+void ind_ofdpa_table_stats_load(uint32_t tableId, uint32_t active, uint32_t timed)
+{
+  ind_ofdpa_table_stats_cache_init();
+  if (tableId < IND_OFDPA_FLOW_TABLE_COUNT)
+  {
+    tableStatsCache.activeCount[tableId] = active;
+    tableStatsCache.timedTotal += timed - tableStatsCache.timedCount[tableId];
+    tableStatsCache.timedCount[tableId] = timed;
+  }
+}
+
+/* The timeouts of the flows from before the agent started are known */
+void ind_ofdpa_table_stats_load_done(void)
+{
+  ind_ofdpa_table_stats_cache_init();
+  tableStatsCache.sweepAll = 0;
+}
+
+void ind_ofdpa_table_stats_flow_removed(uint32_t tableId, int timed)
+{
+  ind_ofdpa_table_stats_cache_init();
+  if (tableId >= IND_OFDPA_FLOW_TABLE_COUNT)
+  {
+    return;
+  }
+  if (tableStatsCache.activeCount[tableId] > 0)
+  {
+    tableStatsCache.activeCount[tableId]--;
+  }
+  if (timed && (tableStatsCache.timedCount[tableId] > 0))
+  {
+    tableStatsCache.timedCount[tableId]--;
+    tableStatsCache.timedTotal--;
+  }
+}
+
 /*
  * Build up a record of all the match fields included in the flow_mod message. This is used to detect when the message
  * contains a match field that is not supported by the flow table. The agent is required to reject flows that request
@@ -309,568 +478,796 @@ static void ind_ofdpa_populate_flow_bitmask(const of_match_t *match, ind_ofdpa_f
   LOG_TRACE("match_fields_bitmask is 0x%llX", *ind_ofdpa_match_fields_bitmask);
 }
 
-/* Get the flow match criteria from of_match */
+/* Per-table translation of the flow match criteria from of_match */
 
-static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match, ofdpaFlowEntry_t *flow)
+typedef indigo_error_t (*ind_ofdpa_match_get_f)(const of_match_t *match,
+                                                ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                ofdpaFlowEntry_t *flow);
+
+static indigo_error_t ind_ofdpa_ingress_port_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                       ofdpaFlowEntry_t *flow)
 {
   indigo_error_t err = INDIGO_ERROR_NONE;
-  ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask;
 
-  ind_ofdpa_populate_flow_bitmask(match, &ind_ofdpa_match_fields_bitmask);
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP) != IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.ingressPortFlowEntry.match_criteria.inPort        = match->fields.in_port;
+    flow->flowData.ingressPortFlowEntry.match_criteria.inPortMask    = match->masks.in_port;
+    flow->flowData.ingressPortFlowEntry.match_criteria.tunnelId      = match->fields.tunnel_id;
+    flow->flowData.ingressPortFlowEntry.match_criteria.tunnelIdMask  = match->masks.tunnel_id;
+    flow->flowData.ingressPortFlowEntry.match_criteria.etherType     = match->fields.eth_type;
+    flow->flowData.ingressPortFlowEntry.match_criteria.etherTypeMask = match->masks.eth_type;
+    flow->flowData.ingressPortFlowEntry.match_criteria.lmepId        = match->fields.ofdpa_lmep_id;
+    flow->flowData.ingressPortFlowEntry.match_criteria.lmepIdMask    = match->masks.ofdpa_lmep_id;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_injected_oam_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                       ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-  switch (flow->tableId)
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP) != IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP)
   {
-    case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP) != IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.ingressPortFlowEntry.match_criteria.inPort        = match->fields.in_port;
-        flow->flowData.ingressPortFlowEntry.match_criteria.inPortMask    = match->masks.in_port;
-        flow->flowData.ingressPortFlowEntry.match_criteria.tunnelId      = match->fields.tunnel_id;
-        flow->flowData.ingressPortFlowEntry.match_criteria.tunnelIdMask  = match->masks.tunnel_id;
-        flow->flowData.ingressPortFlowEntry.match_criteria.etherType     = match->fields.eth_type;
-        flow->flowData.ingressPortFlowEntry.match_criteria.etherTypeMask = match->masks.eth_type;
-        flow->flowData.ingressPortFlowEntry.match_criteria.lmepId        = match->fields.ofdpa_lmep_id;
-        flow->flowData.ingressPortFlowEntry.match_criteria.lmepIdMask    = match->masks.ofdpa_lmep_id;
-      }
-      break;
+   err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP)
+  {
+   err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.injectedOamFlowEntry.match_criteria.lmepId = match->fields.ofdpa_lmep_id;
+  }
 
-    case OFDPA_FLOW_TABLE_ID_INJECTED_OAM:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP) != IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.injectedOamFlowEntry.match_criteria.lmepId = match->fields.ofdpa_lmep_id;
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_VLAN:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_VLAN_FLOW_MATCH_BITMAP) != IND_OFDPA_VLAN_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.vlanFlowEntry.match_criteria.inPort        = match->fields.in_port;
-        flow->flowData.vlanFlowEntry.match_criteria.vlanId        = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.vlanFlowEntry.match_criteria.vlanIdMask    = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-      }
-      break;
+static indigo_error_t ind_ofdpa_vlan_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                               ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-    case OFDPA_FLOW_TABLE_ID_VLAN_1:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP) != IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.vlan1FlowEntry.match_criteria.inPort        = match->fields.in_port;
-        flow->flowData.vlan1FlowEntry.match_criteria.vlanId        = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.vlan1FlowEntry.match_criteria.ovid          = match->fields.ofdpa_ovid;
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_VLAN_FLOW_MATCH_BITMAP) != IND_OFDPA_VLAN_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.vlanFlowEntry.match_criteria.inPort        = match->fields.in_port;
+    flow->flowData.vlanFlowEntry.match_criteria.vlanId        = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+    flow->flowData.vlanFlowEntry.match_criteria.vlanIdMask    = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+  }
 
-    case OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_MP_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mpFlowEntry.match_criteria.etherType          = match->fields.eth_type;
-        flow->flowData.mpFlowEntry.match_criteria.etherTypeMask      = match->masks.eth_type;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731Mdl        = match->fields.ofdpa_oam_y1731_mdl;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731MdlMask    = match->masks.ofdpa_oam_y1731_mdl & OFDPA_OAM_Y1731_MDL_EXACT_MASK;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731Opcode     = match->fields.ofdpa_oam_y1731_opcode;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731OpcodeMask = match->masks.ofdpa_oam_y1731_opcode;
-        flow->flowData.mpFlowEntry.match_criteria.inPort             = match->fields.in_port;
-        flow->flowData.mpFlowEntry.match_criteria.vlanId             = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.mpFlowEntry.match_criteria.vlanIdMask         = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+  return err;
+}
 
-        memcpy(flow->flowData.mpFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.mpFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-      }
-      break;
+static indigo_error_t ind_ofdpa_vlan_1_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                 ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-    case OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.etherType      = match->fields.eth_type;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.etherTypeMask  = match->masks.eth_type;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.tunnelId       = match->fields.tunnel_id;
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP) != IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.vlan1FlowEntry.match_criteria.inPort        = match->fields.in_port;
+    flow->flowData.vlan1FlowEntry.match_criteria.vlanId        = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+    flow->flowData.vlan1FlowEntry.match_criteria.ovid          = match->fields.ofdpa_ovid;
+  }
 
-    case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP) != IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.terminationMacFlowEntry.match_criteria.inPort     = match->fields.in_port;
-        flow->flowData.terminationMacFlowEntry.match_criteria.inPortMask = match->masks.in_port;
-        flow->flowData.terminationMacFlowEntry.match_criteria.etherType  = match->fields.eth_type;
+  return err;
+}
 
-        memcpy(flow->flowData.terminationMacFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.terminationMacFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
+static indigo_error_t ind_ofdpa_maintenance_point_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                            ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-        flow->flowData.terminationMacFlowEntry.match_criteria.vlanId     = match->fields.vlan_vid;
-        flow->flowData.terminationMacFlowEntry.match_criteria.vlanIdMask = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_MP_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.mpFlowEntry.match_criteria.etherType          = match->fields.eth_type;
+    flow->flowData.mpFlowEntry.match_criteria.etherTypeMask      = match->masks.eth_type;
+    flow->flowData.mpFlowEntry.match_criteria.oamY1731Mdl        = match->fields.ofdpa_oam_y1731_mdl;
+    flow->flowData.mpFlowEntry.match_criteria.oamY1731MdlMask    = match->masks.ofdpa_oam_y1731_mdl & OFDPA_OAM_Y1731_MDL_EXACT_MASK;
+    flow->flowData.mpFlowEntry.match_criteria.oamY1731Opcode     = match->fields.ofdpa_oam_y1731_opcode;
+    flow->flowData.mpFlowEntry.match_criteria.oamY1731OpcodeMask = match->masks.ofdpa_oam_y1731_opcode;
+    flow->flowData.mpFlowEntry.match_criteria.inPort             = match->fields.in_port;
+    flow->flowData.mpFlowEntry.match_criteria.vlanId             = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+    flow->flowData.mpFlowEntry.match_criteria.vlanIdMask         = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+
+    memcpy(flow->flowData.mpFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.mpFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
+  }
 
-    case OFDPA_FLOW_TABLE_ID_MPLS_0:
-    case OFDPA_FLOW_TABLE_ID_MPLS_1:
-    case OFDPA_FLOW_TABLE_ID_MPLS_2:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mplsFlowEntry.match_criteria.etherType               = match->fields.eth_type;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsBos                 = match->fields.mpls_bos;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsLabel               = match->fields.mpls_label;
-        flow->flowData.mplsFlowEntry.match_criteria.inPort                  = match->fields.in_port;
-        flow->flowData.mplsFlowEntry.match_criteria.inPortMask              = match->masks.in_port;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsTtl                 = match->fields.ofdpa_mpls_ttl;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsTtlMask             = match->masks.ofdpa_mpls_ttl;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsDataFirstNibble     = match->fields.ofdpa_mpls_data_first_nibble;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsDataFirstNibbleMask = match->masks.ofdpa_mpls_data_first_nibble;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsAchChannel          = match->fields.ofdpa_mpls_ach_channel;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsAchChannelMask      = match->masks.ofdpa_mpls_ach_channel;
-        flow->flowData.mplsFlowEntry.match_criteria.nextLabelIsGal          = match->fields.ofdpa_mpls_next_label_is_gal;
-        flow->flowData.mplsFlowEntry.match_criteria.nextLabelIsGalMask      = match->masks.ofdpa_mpls_next_label_is_gal;
-        flow->flowData.mplsFlowEntry.match_criteria.destIp4                 = match->fields.ipv4_dst;
-        flow->flowData.mplsFlowEntry.match_criteria.destIp4Mask             = match->masks.ipv4_dst;
-
-        memcpy(&flow->flowData.mplsFlowEntry.match_criteria.destIp6, &match->fields.ipv6_dst, OF_IPV6_BYTES);
-        memcpy(&flow->flowData.mplsFlowEntry.match_criteria.destIp6Mask, &match->masks.ipv6_dst, OF_IPV6_BYTES);
-
-        flow->flowData.mplsFlowEntry.match_criteria.ipProto        = match->fields.ip_proto;
-        flow->flowData.mplsFlowEntry.match_criteria.ipProtoMask    = match->masks.ip_proto;
-        flow->flowData.mplsFlowEntry.match_criteria.udpSrcPort     = match->fields.udp_src;
-        flow->flowData.mplsFlowEntry.match_criteria.udpSrcPortMask = match->masks.udp_src;
-        flow->flowData.mplsFlowEntry.match_criteria.udpDstPort     = match->fields.udp_dst;
-        flow->flowData.mplsFlowEntry.match_criteria.udpDstPortMask = match->masks.udp_dst;
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mplsMpFlowEntry.match_criteria.lmepId         = match->fields.ofdpa_lmep_id;
-        flow->flowData.mplsMpFlowEntry.match_criteria.oamY1731Opcode = match->fields.ofdpa_oam_y1731_opcode;
-        flow->flowData.mplsMpFlowEntry.match_criteria.etherType      = match->fields.eth_type;
-      }
-      break;
+static indigo_error_t ind_ofdpa_mpls_l2_port_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                       ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-    case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP) != IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if (((ind_ofdpa_match_fields_bitmask & IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP) &&
-               ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP))
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.etherType  = match->fields.eth_type;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.vrf        = match->fields.ofdpa_vrf;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.vrfMask    = match->masks.ofdpa_vrf;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp4     = match->fields.ipv4_dst;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp4Mask = match->masks.ipv4_dst;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.mplsL2PortFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
+    flow->flowData.mplsL2PortFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
+    flow->flowData.mplsL2PortFlowEntry.match_criteria.etherType      = match->fields.eth_type;
+    flow->flowData.mplsL2PortFlowEntry.match_criteria.etherTypeMask  = match->masks.eth_type;
+    flow->flowData.mplsL2PortFlowEntry.match_criteria.tunnelId       = match->fields.tunnel_id;
+  }
 
-        memcpy(&flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp6, &match->fields.ipv6_dst, OF_IPV6_BYTES);
-        memcpy(&flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp6Mask, &match->masks.ipv6_dst, OF_IPV6_BYTES);
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP) != IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if (((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP) &&
-               ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP))
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.etherType  = match->fields.eth_type;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.vlanId     = match->fields.vlan_vid;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.vrf        = match->fields.ofdpa_vrf;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.vrfMask    = match->masks.ofdpa_vrf;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp4     = match->fields.ipv4_src;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp4Mask = match->masks.ipv4_src;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.dstIp4     = match->fields.ipv4_dst;
+static indigo_error_t ind_ofdpa_termination_mac_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                          ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-        memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp6.s6_addr, match->fields.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp6Mask.s6_addr, match->masks.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.dstIp6.s6_addr, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP) != IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.terminationMacFlowEntry.match_criteria.inPort     = match->fields.in_port;
+    flow->flowData.terminationMacFlowEntry.match_criteria.inPortMask = match->masks.in_port;
+    flow->flowData.terminationMacFlowEntry.match_criteria.etherType  = match->fields.eth_type;
 
-    case OFDPA_FLOW_TABLE_ID_BRIDGING:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP) != IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.bridgingFlowEntry.match_criteria.vlanId       = match->fields.vlan_vid;
-        flow->flowData.bridgingFlowEntry.match_criteria.vlanIdMask   = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.bridgingFlowEntry.match_criteria.tunnelId     = match->fields.tunnel_id;
-        flow->flowData.bridgingFlowEntry.match_criteria.tunnelIdMask = match->masks.tunnel_id;
+    memcpy(flow->flowData.terminationMacFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.terminationMacFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
 
-        memcpy(flow->flowData.bridgingFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.bridgingFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-      }
-      break;
+    flow->flowData.terminationMacFlowEntry.match_criteria.vlanId     = match->fields.vlan_vid;
+    flow->flowData.terminationMacFlowEntry.match_criteria.vlanIdMask = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+  }
 
-    case OFDPA_FLOW_TABLE_ID_L2_POLICER:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP) != IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.l2PolicerFlowEntry.match_criteria.tunnelId       = match->fields.tunnel_id;
-        flow->flowData.l2PolicerFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.l2PolicerFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP) != IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.l2PolicerActionsFlowEntry.match_criteria.color             = match->fields.ofdpa_color;
-        flow->flowData.l2PolicerActionsFlowEntry.match_criteria.colorActionsIndex = match->fields.ofdpa_color_actions_index;
-      }
-      break;
+static indigo_error_t ind_ofdpa_mpls_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                               ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-    case OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP) != IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.dscpTrustFlowEntry.match_criteria.qosIndex       = match->fields.ofdpa_qos_index;
-        flow->flowData.dscpTrustFlowEntry.match_criteria.dscpValue      = match->fields.ip_dscp;
-        flow->flowData.dscpTrustFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.dscpTrustFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.mplsFlowEntry.match_criteria.etherType               = match->fields.eth_type;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsBos                 = match->fields.mpls_bos;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsLabel               = match->fields.mpls_label;
+    flow->flowData.mplsFlowEntry.match_criteria.inPort                  = match->fields.in_port;
+    flow->flowData.mplsFlowEntry.match_criteria.inPortMask              = match->masks.in_port;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsTtl                 = match->fields.ofdpa_mpls_ttl;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsTtlMask             = match->masks.ofdpa_mpls_ttl;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsDataFirstNibble     = match->fields.ofdpa_mpls_data_first_nibble;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsDataFirstNibbleMask = match->masks.ofdpa_mpls_data_first_nibble;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsAchChannel          = match->fields.ofdpa_mpls_ach_channel;
+    flow->flowData.mplsFlowEntry.match_criteria.mplsAchChannelMask      = match->masks.ofdpa_mpls_ach_channel;
+    flow->flowData.mplsFlowEntry.match_criteria.nextLabelIsGal          = match->fields.ofdpa_mpls_next_label_is_gal;
+    flow->flowData.mplsFlowEntry.match_criteria.nextLabelIsGalMask      = match->masks.ofdpa_mpls_next_label_is_gal;
+    flow->flowData.mplsFlowEntry.match_criteria.destIp4                 = match->fields.ipv4_dst;
+    flow->flowData.mplsFlowEntry.match_criteria.destIp4Mask             = match->masks.ipv4_dst;
+
+    memcpy(&flow->flowData.mplsFlowEntry.match_criteria.destIp6, &match->fields.ipv6_dst, OF_IPV6_BYTES);
+    memcpy(&flow->flowData.mplsFlowEntry.match_criteria.destIp6Mask, &match->masks.ipv6_dst, OF_IPV6_BYTES);
+
+    flow->flowData.mplsFlowEntry.match_criteria.ipProto        = match->fields.ip_proto;
+    flow->flowData.mplsFlowEntry.match_criteria.ipProtoMask    = match->masks.ip_proto;
+    flow->flowData.mplsFlowEntry.match_criteria.udpSrcPort     = match->fields.udp_src;
+    flow->flowData.mplsFlowEntry.match_criteria.udpSrcPortMask = match->masks.udp_src;
+    flow->flowData.mplsFlowEntry.match_criteria.udpDstPort     = match->fields.udp_dst;
+    flow->flowData.mplsFlowEntry.match_criteria.udpDstPortMask = match->masks.udp_dst;
+  }
 
-    case OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP) != IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.pcpTrustFlowEntry.match_criteria.qosIndex       = match->fields.ofdpa_qos_index;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.pcpValue       = match->fields.vlan_pcp;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.dei            = match->fields.ofdpa_dei;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP) != IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.policyAclFlowEntry.match_criteria.inPort         = match->fields.in_port;
-        flow->flowData.policyAclFlowEntry.match_criteria.inPortMask     = match->masks.in_port;
-        flow->flowData.policyAclFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.policyAclFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.srcMac.addr, &match->fields.eth_src, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.srcMacMask.addr, &match->masks.eth_src, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-
-        flow->flowData.policyAclFlowEntry.match_criteria.etherType     = match->fields.eth_type;
-        flow->flowData.policyAclFlowEntry.match_criteria.etherTypeMask = match->masks.eth_type;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanId        = match->fields.vlan_vid;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanIdMask    = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanPcp       = match->fields.vlan_pcp;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanPcpMask   = match->masks.vlan_pcp;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanDei       = match->fields.ofdpa_dei;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanDeiMask   = match->masks.ofdpa_dei;
-        flow->flowData.policyAclFlowEntry.match_criteria.tunnelId      = match->fields.tunnel_id;
-        flow->flowData.policyAclFlowEntry.match_criteria.tunnelIdMask  = match->masks.tunnel_id;
-        flow->flowData.policyAclFlowEntry.match_criteria.vrf           = match->fields.ofdpa_vrf;
-        flow->flowData.policyAclFlowEntry.match_criteria.vrfMask       = match->masks.ofdpa_vrf;
-        flow->flowData.policyAclFlowEntry.match_criteria.sourceIp4     = match->fields.ipv4_src;
-        flow->flowData.policyAclFlowEntry.match_criteria.sourceIp4Mask = match->masks.ipv4_src;
-        flow->flowData.policyAclFlowEntry.match_criteria.destIp4       = match->fields.ipv4_dst;
-        flow->flowData.policyAclFlowEntry.match_criteria.destIp4Mask   = match->masks.ipv4_dst;
-
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.sourceIp6.s6_addr, match->fields.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.sourceIp6Mask.s6_addr, match->masks.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destIp6.s6_addr, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destIp6Mask.s6_addr, match->masks.ipv6_dst.addr, OF_IPV6_BYTES);
-
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv4ArpSpa     = match->fields.arp_spa;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv4ArpSpaMask = match->masks.arp_spa;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipProto        = match->fields.ip_proto;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipProtoMask    = match->masks.ip_proto;
-        flow->flowData.policyAclFlowEntry.match_criteria.dscp           = match->fields.ip_dscp;
-        flow->flowData.policyAclFlowEntry.match_criteria.dscpMask       = match->masks.ip_dscp;
-        flow->flowData.policyAclFlowEntry.match_criteria.ecn            = match->fields.ip_ecn;
-        flow->flowData.policyAclFlowEntry.match_criteria.ecnMask        = match->masks.ip_ecn;
-
-        if (match->fields.ip_proto == IPPROTO_TCP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.tcp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.tcp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.tcp_dst;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.tcp_dst;
-        }
-        else if (match->fields.ip_proto == IPPROTO_UDP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.udp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.udp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.udp_dst;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.udp_dst;
-        }
-        else if (match->fields.ip_proto == IPPROTO_SCTP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.sctp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.sctp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.sctp_dst;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.sctp_dst;
-        }
+static indigo_error_t ind_ofdpa_mpls_maintenance_point_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                                 ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-        if (match->fields.ip_proto == IPPROTO_ICMP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv4_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv4_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv4_code;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv4_code;
-        }
-        else if (match->fields.ip_proto == IPPROTO_ICMPV6)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv6_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv6_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv6_code;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv6_code;
-        }
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.mplsMpFlowEntry.match_criteria.lmepId         = match->fields.ofdpa_lmep_id;
+    flow->flowData.mplsMpFlowEntry.match_criteria.oamY1731Opcode = match->fields.ofdpa_oam_y1731_opcode;
+    flow->flowData.mplsMpFlowEntry.match_criteria.etherType      = match->fields.eth_type;
+  }
 
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv6FlowLabel     = match->fields.ipv6_flabel;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv6FlowLabelMask = match->masks.ipv6_flabel;
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP) != IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.colorActionsFlowEntry.match_criteria.color = match->fields.ofdpa_color;
-        flow->flowData.colorActionsFlowEntry.match_criteria.index  = match->fields.ofdpa_color_actions_index;
-      }
-      break;
+static indigo_error_t ind_ofdpa_unicast_routing_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                          ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressVlanFlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
-        flow->flowData.egressVlanFlowEntry.match_criteria.vlanId  = match->fields.vlan_vid;
-        flow->flowData.egressVlanFlowEntry.match_criteria.allowVlanTranslation = match->fields.ofdpa_allow_vlan_translation;
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP) != IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if (((ind_ofdpa_match_fields_bitmask & IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP)
+              != IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP) &&
+           ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP)
+              != IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP))
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.unicastRoutingFlowEntry.match_criteria.etherType  = match->fields.eth_type;
+    flow->flowData.unicastRoutingFlowEntry.match_criteria.vrf        = match->fields.ofdpa_vrf;
+    flow->flowData.unicastRoutingFlowEntry.match_criteria.vrfMask    = match->masks.ofdpa_vrf;
+    flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp4     = match->fields.ipv4_dst;
+    flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp4Mask = match->masks.ipv4_dst;
+
+    memcpy(&flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp6, &match->fields.ipv6_dst, OF_IPV6_BYTES);
+    memcpy(&flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp6Mask, &match->masks.ipv6_dst, OF_IPV6_BYTES);
+  }
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressVlan1FlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
-        flow->flowData.egressVlan1FlowEntry.match_criteria.vlanId  = match->fields.vlan_vid;
-        flow->flowData.egressVlan1FlowEntry.match_criteria.ovid    = match->fields.ofdpa_ovid;
-      }
-      break;
+  return err;
+}
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP)
-              != IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressMpFlowEntry.match_criteria.outPort            = match->fields.onf_actset_output;
-        flow->flowData.egressMpFlowEntry.match_criteria.vlanId             = match->fields.vlan_vid;
-        flow->flowData.egressMpFlowEntry.match_criteria.vlanIdMask         = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.egressMpFlowEntry.match_criteria.etherType          = match->fields.eth_type;
-        flow->flowData.egressMpFlowEntry.match_criteria.etherTypeMask      = match->masks.eth_type;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731Mdl        = match->fields.ofdpa_oam_y1731_mdl;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731MdlMask    = match->masks.ofdpa_oam_y1731_mdl & OFDPA_OAM_Y1731_MDL_EXACT_MASK;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731Opcode     = match->fields.ofdpa_oam_y1731_opcode;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731OpcodeMask = match->masks.ofdpa_oam_y1731_opcode;
+static indigo_error_t ind_ofdpa_multicast_routing_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                            ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
 
-        memcpy(flow->flowData.egressMpFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.egressMpFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-      }
-      break;
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP) != IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if (((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP)
+              != IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP) &&
+           ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP)
+              != IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP))
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.etherType  = match->fields.eth_type;
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.vlanId     = match->fields.vlan_vid;
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.vrf        = match->fields.ofdpa_vrf;
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.vrfMask    = match->masks.ofdpa_vrf;
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp4     = match->fields.ipv4_src;
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp4Mask = match->masks.ipv4_src;
+    flow->flowData.multicastRoutingFlowEntry.match_criteria.dstIp4     = match->fields.ipv4_dst;
+
+    memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp6.s6_addr, match->fields.ipv6_src.addr, OF_IPV6_BYTES);
+    memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp6Mask.s6_addr, match->masks.ipv6_src.addr, OF_IPV6_BYTES);
+    memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.dstIp6.s6_addr, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
+  }
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP)
-            != IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.etherType      = match->fields.eth_type;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.etherTypeMask  = match->masks.eth_type;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.outPort        = match->fields.onf_actset_output;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.trafficClass   = match->fields.ofdpa_traffic_class;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.color          = match->fields.ofdpa_color;
-      }
-      break;
+  return err;
+}
 
-    default:
-      LOG_ERROR("Invalid table id %d", flow->tableId);
-      err = INDIGO_ERROR_PARAM;
-      break;
+static indigo_error_t ind_ofdpa_bridging_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                   ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP) != IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.bridgingFlowEntry.match_criteria.vlanId       = match->fields.vlan_vid;
+    flow->flowData.bridgingFlowEntry.match_criteria.vlanIdMask   = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+    flow->flowData.bridgingFlowEntry.match_criteria.tunnelId     = match->fields.tunnel_id;
+    flow->flowData.bridgingFlowEntry.match_criteria.tunnelIdMask = match->masks.tunnel_id;
+
+    memcpy(flow->flowData.bridgingFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.bridgingFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_l2_policer_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                     ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP) != IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP)
+  {
+   err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP)
+  {
+   err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.l2PolicerFlowEntry.match_criteria.tunnelId       = match->fields.tunnel_id;
+    flow->flowData.l2PolicerFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
+    flow->flowData.l2PolicerFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_l2_policer_actions_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                             ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP) != IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP)
+  {
+   err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP)
+  {
+   err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.l2PolicerActionsFlowEntry.match_criteria.color             = match->fields.ofdpa_color;
+    flow->flowData.l2PolicerActionsFlowEntry.match_criteria.colorActionsIndex = match->fields.ofdpa_color_actions_index;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_dscp_trust_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                     ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP) != IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.dscpTrustFlowEntry.match_criteria.qosIndex       = match->fields.ofdpa_qos_index;
+    flow->flowData.dscpTrustFlowEntry.match_criteria.dscpValue      = match->fields.ip_dscp;
+    flow->flowData.dscpTrustFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
+    flow->flowData.dscpTrustFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_pcp_trust_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                    ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP) != IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.pcpTrustFlowEntry.match_criteria.qosIndex       = match->fields.ofdpa_qos_index;
+    flow->flowData.pcpTrustFlowEntry.match_criteria.pcpValue       = match->fields.vlan_pcp;
+    flow->flowData.pcpTrustFlowEntry.match_criteria.dei            = match->fields.ofdpa_dei;
+    flow->flowData.pcpTrustFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
+    flow->flowData.pcpTrustFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_acl_policy_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                     ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP) != IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.policyAclFlowEntry.match_criteria.inPort         = match->fields.in_port;
+    flow->flowData.policyAclFlowEntry.match_criteria.inPortMask     = match->masks.in_port;
+    flow->flowData.policyAclFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
+    flow->flowData.policyAclFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
+
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.srcMac.addr, &match->fields.eth_src, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.srcMacMask.addr, &match->masks.eth_src, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
+
+    flow->flowData.policyAclFlowEntry.match_criteria.etherType     = match->fields.eth_type;
+    flow->flowData.policyAclFlowEntry.match_criteria.etherTypeMask = match->masks.eth_type;
+    flow->flowData.policyAclFlowEntry.match_criteria.vlanId        = match->fields.vlan_vid;
+    flow->flowData.policyAclFlowEntry.match_criteria.vlanIdMask    = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+    flow->flowData.policyAclFlowEntry.match_criteria.vlanPcp       = match->fields.vlan_pcp;
+    flow->flowData.policyAclFlowEntry.match_criteria.vlanPcpMask   = match->masks.vlan_pcp;
+    flow->flowData.policyAclFlowEntry.match_criteria.vlanDei       = match->fields.ofdpa_dei;
+    flow->flowData.policyAclFlowEntry.match_criteria.vlanDeiMask   = match->masks.ofdpa_dei;
+    flow->flowData.policyAclFlowEntry.match_criteria.tunnelId      = match->fields.tunnel_id;
+    flow->flowData.policyAclFlowEntry.match_criteria.tunnelIdMask  = match->masks.tunnel_id;
+    flow->flowData.policyAclFlowEntry.match_criteria.vrf           = match->fields.ofdpa_vrf;
+    flow->flowData.policyAclFlowEntry.match_criteria.vrfMask       = match->masks.ofdpa_vrf;
+    flow->flowData.policyAclFlowEntry.match_criteria.sourceIp4     = match->fields.ipv4_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.sourceIp4Mask = match->masks.ipv4_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.destIp4       = match->fields.ipv4_dst;
+    flow->flowData.policyAclFlowEntry.match_criteria.destIp4Mask   = match->masks.ipv4_dst;
+
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.sourceIp6.s6_addr, match->fields.ipv6_src.addr, OF_IPV6_BYTES);
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.sourceIp6Mask.s6_addr, match->masks.ipv6_src.addr, OF_IPV6_BYTES);
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destIp6.s6_addr, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
+    memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destIp6Mask.s6_addr, match->masks.ipv6_dst.addr, OF_IPV6_BYTES);
+
+    flow->flowData.policyAclFlowEntry.match_criteria.ipv4ArpSpa     = match->fields.arp_spa;
+    flow->flowData.policyAclFlowEntry.match_criteria.ipv4ArpSpaMask = match->masks.arp_spa;
+    flow->flowData.policyAclFlowEntry.match_criteria.ipProto        = match->fields.ip_proto;
+    flow->flowData.policyAclFlowEntry.match_criteria.ipProtoMask    = match->masks.ip_proto;
+    flow->flowData.policyAclFlowEntry.match_criteria.dscp           = match->fields.ip_dscp;
+    flow->flowData.policyAclFlowEntry.match_criteria.dscpMask       = match->masks.ip_dscp;
+    flow->flowData.policyAclFlowEntry.match_criteria.ecn            = match->fields.ip_ecn;
+    flow->flowData.policyAclFlowEntry.match_criteria.ecnMask        = match->masks.ip_ecn;
+
+    if (match->fields.ip_proto == IPPROTO_TCP)
+    {
+      flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.tcp_src;
+      flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.tcp_src;
+      flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.tcp_dst;
+      flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.tcp_dst;
+    }
+    else if (match->fields.ip_proto == IPPROTO_UDP)
+    {
+      flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.udp_src;
+      flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.udp_src;
+      flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.udp_dst;
+      flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.udp_dst;
+    }
+    else if (match->fields.ip_proto == IPPROTO_SCTP)
+    {
+      flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.sctp_src;
+      flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.sctp_src;
+      flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.sctp_dst;
+      flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.sctp_dst;
+    }
+
+    if (match->fields.ip_proto == IPPROTO_ICMP)
+    {
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv4_type;
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv4_type;
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv4_code;
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv4_code;
+    }
+    else if (match->fields.ip_proto == IPPROTO_ICMPV6)
+    {
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv6_type;
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv6_type;
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv6_code;
+      flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv6_code;
+    }
+
+    flow->flowData.policyAclFlowEntry.match_criteria.ipv6FlowLabel     = match->fields.ipv6_flabel;
+    flow->flowData.policyAclFlowEntry.match_criteria.ipv6FlowLabelMask = match->masks.ipv6_flabel;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_color_based_actions_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                              ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP) != IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.colorActionsFlowEntry.match_criteria.color = match->fields.ofdpa_color;
+    flow->flowData.colorActionsFlowEntry.match_criteria.index  = match->fields.ofdpa_color_actions_index;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_egress_vlan_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                      ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.egressVlanFlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
+    flow->flowData.egressVlanFlowEntry.match_criteria.vlanId  = match->fields.vlan_vid;
+    flow->flowData.egressVlanFlowEntry.match_criteria.allowVlanTranslation = match->fields.ofdpa_allow_vlan_translation;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_egress_vlan_1_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                        ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.egressVlan1FlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
+    flow->flowData.egressVlan1FlowEntry.match_criteria.vlanId  = match->fields.vlan_vid;
+    flow->flowData.egressVlan1FlowEntry.match_criteria.ovid    = match->fields.ofdpa_ovid;
+  }
+
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_egress_maintenance_point_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                                   ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP)
+          != IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.egressMpFlowEntry.match_criteria.outPort            = match->fields.onf_actset_output;
+    flow->flowData.egressMpFlowEntry.match_criteria.vlanId             = match->fields.vlan_vid;
+    flow->flowData.egressMpFlowEntry.match_criteria.vlanIdMask         = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
+    flow->flowData.egressMpFlowEntry.match_criteria.etherType          = match->fields.eth_type;
+    flow->flowData.egressMpFlowEntry.match_criteria.etherTypeMask      = match->masks.eth_type;
+    flow->flowData.egressMpFlowEntry.match_criteria.oamY1731Mdl        = match->fields.ofdpa_oam_y1731_mdl;
+    flow->flowData.egressMpFlowEntry.match_criteria.oamY1731MdlMask    = match->masks.ofdpa_oam_y1731_mdl & OFDPA_OAM_Y1731_MDL_EXACT_MASK;
+    flow->flowData.egressMpFlowEntry.match_criteria.oamY1731Opcode     = match->fields.ofdpa_oam_y1731_opcode;
+    flow->flowData.egressMpFlowEntry.match_criteria.oamY1731OpcodeMask = match->masks.ofdpa_oam_y1731_opcode;
+
+    memcpy(flow->flowData.egressMpFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
+    memcpy(flow->flowData.egressMpFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
   }
 
+  return err;
+}
+
+static indigo_error_t ind_ofdpa_egress_dscp_pcp_remark_match_get(const of_match_t *match, ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                                 ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+
+  if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP)
+        != IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP)
+            != IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP)
+  {
+    err = INDIGO_ERROR_COMPAT;
+  }
+  else
+  {
+    flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.etherType      = match->fields.eth_type;
+    flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.etherTypeMask  = match->masks.eth_type;
+    flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.outPort        = match->fields.onf_actset_output;
+    flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.trafficClass   = match->fields.ofdpa_traffic_class;
+    flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.color          = match->fields.ofdpa_color;
+  }
+
+  return err;
+}
+
+/*
+ * Match translators indexed by table id. Each one checks the fields its table allows and fills
+ * in its member of the flowData union, so a flow-mod costs one indirect call.
+ */
+static const ind_ofdpa_match_get_f matchGetByTable[IND_OFDPA_FLOW_TABLE_COUNT] =
+{
+  [OFDPA_FLOW_TABLE_ID_INGRESS_PORT]             = ind_ofdpa_ingress_port_match_get,
+  [OFDPA_FLOW_TABLE_ID_INJECTED_OAM]             = ind_ofdpa_injected_oam_match_get,
+  [OFDPA_FLOW_TABLE_ID_VLAN]                     = ind_ofdpa_vlan_match_get,
+  [OFDPA_FLOW_TABLE_ID_VLAN_1]                   = ind_ofdpa_vlan_1_match_get,
+  [OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT]        = ind_ofdpa_maintenance_point_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT]             = ind_ofdpa_mpls_l2_port_match_get,
+  [OFDPA_FLOW_TABLE_ID_TERMINATION_MAC]          = ind_ofdpa_termination_mac_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_0]                   = ind_ofdpa_mpls_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_1]                   = ind_ofdpa_mpls_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_2]                   = ind_ofdpa_mpls_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT]   = ind_ofdpa_mpls_maintenance_point_match_get,
+  [OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING]          = ind_ofdpa_unicast_routing_match_get,
+  [OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING]        = ind_ofdpa_multicast_routing_match_get,
+  [OFDPA_FLOW_TABLE_ID_BRIDGING]                 = ind_ofdpa_bridging_match_get,
+  [OFDPA_FLOW_TABLE_ID_L2_POLICER]               = ind_ofdpa_l2_policer_match_get,
+  [OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS]       = ind_ofdpa_l2_policer_actions_match_get,
+  [OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST]          = ind_ofdpa_dscp_trust_match_get,
+  [OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST]        = ind_ofdpa_dscp_trust_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST]          = ind_ofdpa_dscp_trust_match_get,
+  [OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST]           = ind_ofdpa_pcp_trust_match_get,
+  [OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST]         = ind_ofdpa_pcp_trust_match_get,
+  [OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST]           = ind_ofdpa_pcp_trust_match_get,
+  [OFDPA_FLOW_TABLE_ID_ACL_POLICY]               = ind_ofdpa_acl_policy_match_get,
+  [OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS]      = ind_ofdpa_color_based_actions_match_get,
+  [OFDPA_FLOW_TABLE_ID_EGRESS_VLAN]              = ind_ofdpa_egress_vlan_match_get,
+  [OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1]            = ind_ofdpa_egress_vlan_1_match_get,
+  [OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT] = ind_ofdpa_egress_maintenance_point_match_get,
+  [OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK]   = ind_ofdpa_egress_dscp_pcp_remark_match_get,
+};
+
+/*
+ * Size of the flowData member each table uses. The union is as large as a
+ * Policy ACL entry; a translation only clears and copies the member of
+ * its table.
+ */
+#define IND_OFDPA_FLOW_DATA_SIZE(_member) (sizeof(((ofdpaFlowEntry_t *)0)->flowData._member))
+
+static const uint16_t flowDataSizeByTable[IND_OFDPA_FLOW_TABLE_COUNT] =
+{
+  [OFDPA_FLOW_TABLE_ID_INGRESS_PORT]             = IND_OFDPA_FLOW_DATA_SIZE(ingressPortFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST]          = IND_OFDPA_FLOW_DATA_SIZE(dscpTrustFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST]        = IND_OFDPA_FLOW_DATA_SIZE(dscpTrustFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST]          = IND_OFDPA_FLOW_DATA_SIZE(dscpTrustFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST]           = IND_OFDPA_FLOW_DATA_SIZE(pcpTrustFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST]         = IND_OFDPA_FLOW_DATA_SIZE(pcpTrustFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST]           = IND_OFDPA_FLOW_DATA_SIZE(pcpTrustFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_INJECTED_OAM]             = IND_OFDPA_FLOW_DATA_SIZE(injectedOamFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_VLAN]                     = IND_OFDPA_FLOW_DATA_SIZE(vlanFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_VLAN_1]                   = IND_OFDPA_FLOW_DATA_SIZE(vlan1FlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT]        = IND_OFDPA_FLOW_DATA_SIZE(mpFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT]             = IND_OFDPA_FLOW_DATA_SIZE(mplsL2PortFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_L2_POLICER]               = IND_OFDPA_FLOW_DATA_SIZE(l2PolicerFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS]       = IND_OFDPA_FLOW_DATA_SIZE(l2PolicerActionsFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_TERMINATION_MAC]          = IND_OFDPA_FLOW_DATA_SIZE(terminationMacFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_0]                   = IND_OFDPA_FLOW_DATA_SIZE(mplsFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_1]                   = IND_OFDPA_FLOW_DATA_SIZE(mplsFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_2]                   = IND_OFDPA_FLOW_DATA_SIZE(mplsFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT]   = IND_OFDPA_FLOW_DATA_SIZE(mplsMpFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING]          = IND_OFDPA_FLOW_DATA_SIZE(unicastRoutingFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING]        = IND_OFDPA_FLOW_DATA_SIZE(multicastRoutingFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_BRIDGING]                 = IND_OFDPA_FLOW_DATA_SIZE(bridgingFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_ACL_POLICY]               = IND_OFDPA_FLOW_DATA_SIZE(policyAclFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS]      = IND_OFDPA_FLOW_DATA_SIZE(colorActionsFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_EGRESS_VLAN]              = IND_OFDPA_FLOW_DATA_SIZE(egressVlanFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1]            = IND_OFDPA_FLOW_DATA_SIZE(egressVlan1FlowEntry),
+  [OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT] = IND_OFDPA_FLOW_DATA_SIZE(egressMpFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK]   = IND_OFDPA_FLOW_DATA_SIZE(egressDscpPcpRemarkFlowEntry),
+  [OFDPA_FLOW_TABLE_ID_EGRESS_TPID]              = IND_OFDPA_FLOW_DATA_SIZE(egressTpidFlowEntry),
+};
+
+size_t ind_ofdpa_flow_data_size(uint32_t tableId)
+{
+  if ((tableId < IND_OFDPA_FLOW_TABLE_COUNT) && (flowDataSizeByTable[tableId] != 0))
+  {
+    return flowDataSizeByTable[tableId];
+  }
+  return sizeof(((ofdpaFlowEntry_t *)0)->flowData);
+}
+
+/* Clear a flow entry for a translation into table tableId. The rest of
+   the union is left as it is; OF-DPA only reads the member of the table. */
+static void ind_ofdpa_flow_entry_clear(ofdpaFlowEntry_t *flow, uint32_t tableId)
+{
+  flow->tableId = tableId;
+  flow->priority = 0;
+  memset(&flow->flowData, 0, ind_ofdpa_flow_data_size(tableId));
+  flow->hard_time = 0;
+  flow->idle_time = 0;
+  flow->cookie = 0;
+}
+
+/* Get the flow match criteria from of_match */
+
+static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match, ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err;
+  ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask;
+
+  if ((flow->tableId >= IND_OFDPA_FLOW_TABLE_COUNT) || (matchGetByTable[flow->tableId] == NULL))
+  {
+    LOG_ERROR("Invalid table id %d", flow->tableId);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  ind_ofdpa_populate_flow_bitmask(match, &ind_ofdpa_match_fields_bitmask);
+
+  err = matchGetByTable[flow->tableId](match, ind_ofdpa_match_fields_bitmask, flow);
   if (err == INDIGO_ERROR_COMPAT)
   {
     LOG_ERROR("Incompatible match field(s) for table %d.", flow->tableId);
@@ -879,10 +1276,165 @@ static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match,
   return err;
 }
 
+/*
+ * Action stores that need no more than a table lookup. Each line of the
+ * X-macro lists below generates a writer for one table, and the writers
+ * are gathered in tables indexed by OF-DPA table id, so an action is
+ * translated by one lookup and a direct store, and an action the table
+ * does not accept finds no writer and is rejected.
+ */
+typedef void (*ind_ofdpa_action_store_f)(ofdpaFlowEntry_t *flow, uint64_t value);
+
+/* Output action: X(table, flowData member) */
+#define IND_OFDPA_OUTPUT_STORES(X)                                      \
+  X(TERMINATION_MAC,          terminationMacFlowEntry)                 \
+  X(MAINTENANCE_POINT,        mpFlowEntry)                             \
+  X(MPLS_MAINTENANCE_POINT,   mplsMpFlowEntry)                         \
+  X(UNICAST_ROUTING,          unicastRoutingFlowEntry)                 \
+  X(ACL_POLICY,               policyAclFlowEntry)                      \
+  X(COLOR_BASED_ACTIONS,      colorActionsFlowEntry)                   \
+  X(EGRESS_MAINTENANCE_POINT, egressMpFlowEntry)
+
+/* Set-field OXMs whose translation only stores the value: X(oxm, LOCI name, value type) */
+#define IND_OFDPA_SET_FIELD_OXMS(X)                                     \
+  X(TUNNEL_ID,                     tunnel_id,                     uint64_t) \
+  X(OFDPA_MPLS_L2_PORT,            ofdpa_mpls_l2_port,            uint32_t) \
+  X(MPLS_LABEL,                    mpls_label,                    uint32_t) \
+  X(MPLS_BOS,                      mpls_bos,                      uint8_t)  \
+  X(OFDPA_MPLS_TTL,                ofdpa_mpls_ttl,                uint8_t)  \
+  X(OFDPA_MPLS_DATA_FIRST_NIBBLE,  ofdpa_mpls_data_first_nibble,  uint8_t)  \
+  X(OFDPA_MPLS_ACH_CHANNEL,        ofdpa_mpls_ach_channel,        uint16_t) \
+  X(OFDPA_VRF,                     ofdpa_vrf,                     uint16_t) \
+  X(OFDPA_OVID,                    ofdpa_ovid,                    uint16_t) \
+  X(VLAN_PCP,                      vlan_pcp,                      uint8_t)  \
+  X(OFDPA_QOS_INDEX,               ofdpa_qos_index,               uint8_t)  \
+  X(OFDPA_LMEP_ID,                 ofdpa_lmep_id,                 uint32_t) \
+  X(OFDPA_PROTECTION_INDEX,        ofdpa_protection_index,        uint8_t)  \
+  X(OFDPA_MPLS_TYPE,               ofdpa_mpls_type,               uint16_t)
+
+/* Where they are stored: X(oxm, table, flowData member, value field, action flag field) */
+#define IND_OFDPA_SET_FIELD_STORES(X)                                   \
+  X(TUNNEL_ID,              VLAN,          vlanFlowEntry,         tunnelId,      tunnelIdAction)       \
+  X(TUNNEL_ID,              VLAN_1,        vlan1FlowEntry,        tunnelId,      tunnelIdAction)       \
+  X(TUNNEL_ID,              MPLS_0,        mplsFlowEntry,         tunnelId,      tunnelIdAction)       \
+  X(TUNNEL_ID,              MPLS_1,        mplsFlowEntry,         tunnelId,      tunnelIdAction)       \
+  X(TUNNEL_ID,              MPLS_2,        mplsFlowEntry,         tunnelId,      tunnelIdAction)       \
+  X(TUNNEL_ID,              INJECTED_OAM,  injectedOamFlowEntry,  tunnelId,      tunnelIdAction)       \
+  X(OFDPA_MPLS_L2_PORT,     VLAN,          vlanFlowEntry,         mplsL2Port,    mplsL2PortAction)     \
+  X(OFDPA_MPLS_L2_PORT,     VLAN_1,        vlan1FlowEntry,        mplsL2Port,    mplsL2PortAction)     \
+  X(OFDPA_MPLS_L2_PORT,     MPLS_0,        mplsFlowEntry,         mplsL2Port,    mplsL2PortAction)     \
+  X(OFDPA_MPLS_L2_PORT,     MPLS_1,        mplsFlowEntry,         mplsL2Port,    mplsL2PortAction)     \
+  X(OFDPA_MPLS_L2_PORT,     MPLS_2,        mplsFlowEntry,         mplsL2Port,    mplsL2PortAction)     \
+  X(OFDPA_MPLS_L2_PORT,     INJECTED_OAM,  injectedOamFlowEntry,  mplsL2Port,    mplsL2PortAction)     \
+  X(MPLS_LABEL,             INJECTED_OAM,  injectedOamFlowEntry,  mplsLabel,     pushMplsLabelHdr)     \
+  X(MPLS_BOS,               INJECTED_OAM,  injectedOamFlowEntry,  mplsBOS,       pushMplsLabelHdr)     \
+  X(OFDPA_MPLS_TTL,         INJECTED_OAM,  injectedOamFlowEntry,  mplsTTL,       mplsTTLAction)        \
+  X(OFDPA_MPLS_DATA_FIRST_NIBBLE, INJECTED_OAM, injectedOamFlowEntry, mplsDataFirstNibble, mplsDataFirstNibbleAction) \
+  X(OFDPA_MPLS_ACH_CHANNEL, INJECTED_OAM,  injectedOamFlowEntry,  mplsAchChannel, mplsAchChannelAction) \
+  X(OFDPA_VRF,              INGRESS_PORT,  ingressPortFlowEntry,  vrf,           vrfAction)            \
+  X(OFDPA_VRF,              VLAN,          vlanFlowEntry,         vrf,           vrfAction)            \
+  X(OFDPA_VRF,              VLAN_1,        vlan1FlowEntry,        vrf,           vrfAction)            \
+  X(OFDPA_VRF,              MPLS_0,        mplsFlowEntry,         vrf,           vrfAction)            \
+  X(OFDPA_VRF,              MPLS_1,        mplsFlowEntry,         vrf,           vrfAction)            \
+  X(OFDPA_VRF,              MPLS_2,        mplsFlowEntry,         vrf,           vrfAction)            \
+  X(OFDPA_OVID,             VLAN,          vlanFlowEntry,         ovid,          ovidAction)           \
+  X(OFDPA_OVID,             EGRESS_VLAN,   egressVlanFlowEntry,   ovid,          ovidAction)           \
+  X(VLAN_PCP,               L2_POLICER_ACTIONS, l2PolicerActionsFlowEntry, vlanPcp, vlanPcpAction)     \
+  X(VLAN_PCP,               COLOR_BASED_ACTIONS, colorActionsFlowEntry, vlanPcp, vlanPcpAction)        \
+  X(VLAN_PCP,               ACL_POLICY,    policyAclFlowEntry,    vlanPcp,       vlanPcpAction)        \
+  X(VLAN_PCP,               EGRESS_DSCP_PCP_REMARK, egressDscpPcpRemarkFlowEntry, vlanPcp, vlanPcpAction) \
+  X(OFDPA_QOS_INDEX,        INGRESS_PORT,  ingressPortFlowEntry,  qosIndex,      qosIndexAction)       \
+  X(OFDPA_QOS_INDEX,        MPLS_L2_PORT,  mplsL2PortFlowEntry,   qosIndex,      qosIndexAction)       \
+  X(OFDPA_QOS_INDEX,        MPLS_0,        mplsFlowEntry,         qosIndex,      qosIndexAction)       \
+  X(OFDPA_QOS_INDEX,        MPLS_1,        mplsFlowEntry,         qosIndex,      qosIndexAction)       \
+  X(OFDPA_QOS_INDEX,        MPLS_2,        mplsFlowEntry,         qosIndex,      qosIndexAction)       \
+  X(OFDPA_LMEP_ID,          MAINTENANCE_POINT, mpFlowEntry,       lmepId,        lmepIdAction)         \
+  X(OFDPA_LMEP_ID,          MPLS_0,        mplsFlowEntry,         lmepId,        lmepIdAction)         \
+  X(OFDPA_LMEP_ID,          MPLS_1,        mplsFlowEntry,         lmepId,        lmepIdAction)         \
+  X(OFDPA_LMEP_ID,          MPLS_2,        mplsFlowEntry,         lmepId,        lmepIdAction)         \
+  X(OFDPA_LMEP_ID,          EGRESS_MAINTENANCE_POINT, egressMpFlowEntry, lmepId, lmepIdAction)       \
+  X(OFDPA_PROTECTION_INDEX, MPLS_0,        mplsFlowEntry,         protectionId,  protectionIdAction)   \
+  X(OFDPA_PROTECTION_INDEX, MPLS_1,        mplsFlowEntry,         protectionId,  protectionIdAction)   \
+  X(OFDPA_PROTECTION_INDEX, MPLS_2,        mplsFlowEntry,         protectionId,  protectionIdAction)   \
+  X(OFDPA_MPLS_TYPE,        MPLS_0,        mplsFlowEntry,         mplsType,      mplsTypeAction)       \
+  X(OFDPA_MPLS_TYPE,        MPLS_1,        mplsFlowEntry,         mplsType,      mplsTypeAction)       \
+  X(OFDPA_MPLS_TYPE,        MPLS_2,        mplsFlowEntry,         mplsType,      mplsTypeAction)
+
+#define IND_OFDPA_OUTPUT_WRITER(table, member)                          \
+  static void ind_ofdpa_output_store_##table(ofdpaFlowEntry_t *flow, uint64_t value) \
+  {                                                                     \
+    flow->flowData.member.outputPort = value;                          \
+  }
+IND_OFDPA_OUTPUT_STORES(IND_OFDPA_OUTPUT_WRITER)
+
+#define IND_OFDPA_OUTPUT_ENTRY(table, member)                           \
+  [OFDPA_FLOW_TABLE_ID_##table] = ind_ofdpa_output_store_##table,
+
+static const ind_ofdpa_action_store_f outputStoreByTable[IND_OFDPA_FLOW_TABLE_COUNT] =
+{
+  IND_OFDPA_OUTPUT_STORES(IND_OFDPA_OUTPUT_ENTRY)
+};
+
+#define IND_OFDPA_SET_FIELD_INDEX(oxm, name, type) IND_OFDPA_SET_FIELD_##oxm,
+typedef enum
+{
+  IND_OFDPA_SET_FIELD_OXMS(IND_OFDPA_SET_FIELD_INDEX)
+  IND_OFDPA_SET_FIELD_COUNT
+} ind_ofdpa_set_field_t;
+
+#define IND_OFDPA_SET_FIELD_WRITER(oxm, table, member, field, flag)     \
+  static void ind_ofdpa_set_field_store_##oxm##_##table(ofdpaFlowEntry_t *flow, uint64_t value) \
+  {                                                                     \
+    flow->flowData.member.field = value;                               \
+    flow->flowData.member.flag = 1;                                    \
+  }
+IND_OFDPA_SET_FIELD_STORES(IND_OFDPA_SET_FIELD_WRITER)
+
+#define IND_OFDPA_SET_FIELD_ENTRY(oxm, table, member, field, flag)      \
+  [IND_OFDPA_SET_FIELD_##oxm][OFDPA_FLOW_TABLE_ID_##table] = ind_ofdpa_set_field_store_##oxm##_##table,
+
+static const ind_ofdpa_action_store_f setFieldStoreByTable[IND_OFDPA_SET_FIELD_COUNT][IND_OFDPA_FLOW_TABLE_COUNT] =
+{
+  IND_OFDPA_SET_FIELD_STORES(IND_OFDPA_SET_FIELD_ENTRY)
+};
+
+/* IND_OFDPA_SET_FIELD_COUNT for an OXM translated case by case */
+static ind_ofdpa_set_field_t ind_ofdpa_set_field_index(of_object_id_t oxm_id)
+{
+#define IND_OFDPA_SET_FIELD_CASE(oxm, name, type)                       \
+    case OF_OXM_##oxm: return IND_OFDPA_SET_FIELD_##oxm;
+
+  switch (oxm_id)
+  {
+    IND_OFDPA_SET_FIELD_OXMS(IND_OFDPA_SET_FIELD_CASE)
+    default:
+      return IND_OFDPA_SET_FIELD_COUNT;
+  }
+}
+
+static uint64_t ind_ofdpa_set_field_value(of_oxm_t *field, ind_ofdpa_set_field_t sf)
+{
+#define IND_OFDPA_SET_FIELD_GET(oxm, name, type)                        \
+    case IND_OFDPA_SET_FIELD_##oxm:                                     \
+    {                                                                   \
+      type value;                                                       \
+      of_oxm_##name##_value_get(&field->name, &value);                  \
+      return value;                                                     \
+    }
+
+  switch (sf)
+  {
+    IND_OFDPA_SET_FIELD_OXMS(IND_OFDPA_SET_FIELD_GET)
+    default:
+      return 0;
+  }
+}
+
 static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type, of_list_action_t *actions, ofdpaFlowEntry_t *flow)
 {
   of_action_t act;
   of_port_no_t port_no;
+  ind_ofdpa_set_field_t sf;
   int rv;
 
   OF_LIST_ACTION_ITER(actions, &act, rv)
@@ -893,45 +1445,29 @@ static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type,
       case OF_ACTION_OUTPUT:
       {
         of_action_output_port_get(&act.output, &port_no);
-        switch (flow->tableId)
+        if (flow->tableId == OFDPA_FLOW_TABLE_ID_BRIDGING)
         {
-          case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
-            flow->flowData.terminationMacFlowEntry.outputPort = port_no;
-            break;
-          case OFDPA_FLOW_TABLE_ID_BRIDGING:
-            switch (type)
-            {
-              case OF_INSTRUCTION_APPLY_ACTIONS:
-                flow->flowData.bridgingFlowEntry.outputPort = port_no;
-                break;
-              case OF_INSTRUCTION_WRITE_ACTIONS:
-                flow->flowData.bridgingFlowEntry.tunnelLogicalPort = port_no;
-                break;
-              default:
-                break;
-            }
-            break;
-          case OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT:
-            flow->flowData.mpFlowEntry.outputPort = port_no;
-            break;
-          case OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT:
-            flow->flowData.mplsMpFlowEntry.outputPort = port_no;
-            break;
-          case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
-            flow->flowData.unicastRoutingFlowEntry.outputPort = port_no;
-            break;
-          case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
-            flow->flowData.policyAclFlowEntry.outputPort = port_no;
-            break;
-          case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
-            flow->flowData.colorActionsFlowEntry.outputPort = port_no;
-            break;
-          case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
-            flow->flowData.egressMpFlowEntry.outputPort = port_no;
-            break;
-          default:
-            LOG_TRACE("Unsupported output port action for Table: %d", flow->tableId);
-            return INDIGO_ERROR_COMPAT;
+          switch (type)
+          {
+            case OF_INSTRUCTION_APPLY_ACTIONS:
+              flow->flowData.bridgingFlowEntry.outputPort = port_no;
+              break;
+            case OF_INSTRUCTION_WRITE_ACTIONS:
+              flow->flowData.bridgingFlowEntry.tunnelLogicalPort = port_no;
+              break;
+            default:
+              break;
+          }
+        }
+        else if ((flow->tableId < IND_OFDPA_FLOW_TABLE_COUNT) &&
+                 (outputStoreByTable[flow->tableId] != NULL))
+        {
+          outputStoreByTable[flow->tableId](flow, port_no);
+        }
+        else
+        {
+          LOG_TRACE("Unsupported output port action for Table: %d", flow->tableId);
+          return INDIGO_ERROR_COMPAT;
         }
         break;
       }
@@ -949,218 +1485,30 @@ static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type,
           LOG_ERROR("Failed to parse set-field action");
           return INDIGO_ERROR_COMPAT;
         }
-        LOG_TRACE("set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-        switch (oxm.header.object_id)
-        {
-          case OF_OXM_TUNNEL_ID:
-          {
-            uint64_t tunnel_id;
-            of_oxm_tunnel_id_value_get(&oxm.tunnel_id, &tunnel_id);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN)
-            {
-              flow->flowData.vlanFlowEntry.tunnelIdAction = 1;
-              flow->flowData.vlanFlowEntry.tunnelId = tunnel_id;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN_1)
-            {
-              flow->flowData.vlan1FlowEntry.tunnelIdAction = 1;
-              flow->flowData.vlan1FlowEntry.tunnelId = tunnel_id;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              flow->flowData.mplsFlowEntry.tunnelIdAction = 1;
-              flow->flowData.mplsFlowEntry.tunnelId = tunnel_id;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.tunnelIdAction = 1;
-              flow->flowData.injectedOamFlowEntry.tunnelId = tunnel_id;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_MPLS_L2_PORT:
-          {
-            uint32_t mpls_l2_port;
-            of_oxm_ofdpa_mpls_l2_port_value_get(&oxm.ofdpa_mpls_l2_port, &mpls_l2_port);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN)
-            {
-              flow->flowData.vlanFlowEntry.mplsL2PortAction = 1;
-              flow->flowData.vlanFlowEntry.mplsL2Port = mpls_l2_port;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN_1)
-            {
-              flow->flowData.vlan1FlowEntry.mplsL2PortAction = 1;
-              flow->flowData.vlan1FlowEntry.mplsL2Port = mpls_l2_port;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0 ||
-                     flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                     flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              flow->flowData.mplsFlowEntry.mplsL2PortAction = 1;
-              flow->flowData.mplsFlowEntry.mplsL2Port = mpls_l2_port;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.mplsL2PortAction = 1;
-              flow->flowData.injectedOamFlowEntry.mplsL2Port = mpls_l2_port;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_MPLS_LABEL:
-          {
-            uint32_t mpls_label;
-            of_oxm_mpls_label_value_get(&oxm.mpls_label, &mpls_label);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.pushMplsLabelHdr = 1;
-              flow->flowData.injectedOamFlowEntry.mplsLabel = mpls_label;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_MPLS_BOS:
-          {
-            uint8_t mpls_bos;
-            of_oxm_mpls_bos_value_get(&oxm.mpls_bos, &mpls_bos);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.pushMplsLabelHdr = 1;
-              flow->flowData.injectedOamFlowEntry.mplsBOS = mpls_bos;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_MPLS_TTL:
-          {
-            uint8_t ofdpa_mpls_ttl;
-            of_oxm_ofdpa_mpls_ttl_value_get(&oxm.ofdpa_mpls_ttl, &ofdpa_mpls_ttl);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.mplsTTLAction = 1;
-              flow->flowData.injectedOamFlowEntry.mplsTTL = ofdpa_mpls_ttl;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_MPLS_DATA_FIRST_NIBBLE:
-          {
-            uint8_t mpls_data_first_nibble;
-            of_oxm_ofdpa_mpls_data_first_nibble_value_get(&oxm.ofdpa_mpls_data_first_nibble, &mpls_data_first_nibble);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.mplsDataFirstNibbleAction = 1;
-              flow->flowData.injectedOamFlowEntry.mplsDataFirstNibble = mpls_data_first_nibble;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_MPLS_ACH_CHANNEL:
-          {
-            uint16_t mpls_ach_channel;
-            of_oxm_ofdpa_mpls_ach_channel_value_get(&oxm.ofdpa_mpls_ach_channel, &mpls_ach_channel);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INJECTED_OAM)
-            {
-              flow->flowData.injectedOamFlowEntry.mplsAchChannelAction = 1;
-              flow->flowData.injectedOamFlowEntry.mplsAchChannel = mpls_ach_channel;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_L3_IN_PORT:
-          {
-            uint32_t l3_in_port;
-            of_oxm_ofdpa_l3_in_port_value_get(&oxm.ofdpa_l3_in_port, &l3_in_port);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              //flow->flowData.mplsFlowEntry.l3_in_port = l3_in_port;
-              //flow->flowData.mplsFlowEntry.l3_in_portAction = 1;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_VRF:
-          {
-            uint16_t vrf;
-            of_oxm_ofdpa_vrf_value_get(&oxm.ofdpa_vrf, &vrf);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INGRESS_PORT)
-            {
-              flow->flowData.ingressPortFlowEntry.vrfAction = 1;
-              flow->flowData.ingressPortFlowEntry.vrf = vrf;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN)
-            {
-              flow->flowData.vlanFlowEntry.vrfAction = 1;
-              flow->flowData.vlanFlowEntry.vrf = vrf;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN_1)
-            {
-              flow->flowData.vlan1FlowEntry.vrfAction = 1;
-              flow->flowData.vlan1FlowEntry.vrf = vrf;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0 ||
-                     flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                     flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              flow->flowData.mplsFlowEntry.vrfAction = 1;
-              flow->flowData.mplsFlowEntry.vrf = vrf;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
+        LOG_TRACE("set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
+        sf = ind_ofdpa_set_field_index(oxm.header.object_id);
+        if (sf != IND_OFDPA_SET_FIELD_COUNT)
+        {
+          if ((flow->tableId >= IND_OFDPA_FLOW_TABLE_COUNT) ||
+              (setFieldStoreByTable[sf][flow->tableId] == NULL))
+          {
+            LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
+            return INDIGO_ERROR_COMPAT;
           }
-          case OF_OXM_OFDPA_OVID:
+          setFieldStoreByTable[sf][flow->tableId](flow, ind_ofdpa_set_field_value(&oxm, sf));
+          break;
+        }
+        switch (oxm.header.object_id)
+        {
+          case OF_OXM_OFDPA_L3_IN_PORT:
           {
-            uint16_t vlan_vid;
-            of_oxm_ofdpa_ovid_value_get(&oxm.ofdpa_ovid, &vlan_vid);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_VLAN)
-            {
-              flow->flowData.vlanFlowEntry.ovidAction = 1;
-              flow->flowData.vlanFlowEntry.ovid = vlan_vid;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_EGRESS_VLAN)
+            uint32_t l3_in_port;
+            of_oxm_ofdpa_l3_in_port_value_get(&oxm.ofdpa_l3_in_port, &l3_in_port);
+            if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
+                flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
             {
-              flow->flowData.egressVlanFlowEntry.ovidAction = 1;
-              flow->flowData.egressVlanFlowEntry.ovid = vlan_vid;
+              //flow->flowData.mplsFlowEntry.l3_in_port = l3_in_port;
+              //flow->flowData.mplsFlowEntry.l3_in_portAction = 1;
             }
             else
             {
@@ -1230,37 +1578,6 @@ static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type,
             }
             break;
           }
-          case OF_OXM_VLAN_PCP:
-          {
-            uint8_t vlan_pcp;
-            of_oxm_vlan_pcp_value_get(&oxm.vlan_pcp, &vlan_pcp);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS)
-            {
-              flow->flowData.l2PolicerActionsFlowEntry.vlanPcpAction = 1;
-              flow->flowData.l2PolicerActionsFlowEntry.vlanPcp = vlan_pcp;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS)
-            {
-              flow->flowData.colorActionsFlowEntry.vlanPcpAction = 1;
-              flow->flowData.colorActionsFlowEntry.vlanPcp = vlan_pcp;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_ACL_POLICY)
-            {
-              flow->flowData.policyAclFlowEntry.vlanPcpAction = 1;
-              flow->flowData.policyAclFlowEntry.vlanPcp = vlan_pcp;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK)
-            {
-              flow->flowData.egressDscpPcpRemarkFlowEntry.vlanPcpAction = 1;
-              flow->flowData.egressDscpPcpRemarkFlowEntry.vlanPcp = vlan_pcp;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
           case OF_OXM_OFDPA_DEI:
           {
             uint8_t vlan_dei;
@@ -1511,98 +1828,6 @@ static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type,
             }
             break;
           }
-          case OF_OXM_OFDPA_QOS_INDEX:
-          {
-            uint8_t qos_index;
-            of_oxm_ofdpa_qos_index_value_get(&oxm.ofdpa_qos_index, &qos_index);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_INGRESS_PORT)
-            {
-              flow->flowData.ingressPortFlowEntry.qosIndex = qos_index;
-              flow->flowData.ingressPortFlowEntry.qosIndexAction = 1;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT)
-            {
-              flow->flowData.mplsL2PortFlowEntry.qosIndex = qos_index;
-              flow->flowData.mplsL2PortFlowEntry.qosIndexAction = 1;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              flow->flowData.mplsFlowEntry.qosIndex = qos_index;
-              flow->flowData.mplsFlowEntry.qosIndexAction = 1;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_LMEP_ID:
-          {
-            uint32_t lmep_id;
-            of_oxm_ofdpa_lmep_id_value_get(&oxm.ofdpa_lmep_id, &lmep_id);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT)
-            {
-              flow->flowData.mpFlowEntry.lmepId = lmep_id;
-              flow->flowData.mpFlowEntry.lmepIdAction = 1;
-            }
-            else if ((flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0) ||
-                     (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1) ||
-                     (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2))
-            {
-              flow->flowData.mplsFlowEntry.lmepId = lmep_id;
-              flow->flowData.mplsFlowEntry.lmepIdAction = 1;
-            }
-            else if (flow->tableId == OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT)
-            {
-              flow->flowData.egressMpFlowEntry.lmepId = lmep_id;
-              flow->flowData.egressMpFlowEntry.lmepIdAction = 1;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_PROTECTION_INDEX:
-          {
-            uint8_t protection_index;
-            of_oxm_ofdpa_protection_index_value_get(&oxm.ofdpa_protection_index, &protection_index);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              flow->flowData.mplsFlowEntry.protectionId = protection_index;
-              flow->flowData.mplsFlowEntry.protectionIdAction = 1;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
-          case OF_OXM_OFDPA_MPLS_TYPE:
-          {
-            uint16_t mpls_type;
-            of_oxm_ofdpa_mpls_type_value_get(&oxm.ofdpa_mpls_type, &mpls_type);
-            if (flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_0 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_1 ||
-                    flow->tableId == OFDPA_FLOW_TABLE_ID_MPLS_2)
-            {
-              flow->flowData.mplsFlowEntry.mplsType = mpls_type;
-              flow->flowData.mplsFlowEntry.mplsTypeAction = 1;
-            }
-            else
-            {
-              LOG_ERROR("Unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
-              return INDIGO_ERROR_COMPAT;
-            }
-            break;
-          }
           default:
             LOG_ERROR("unsupported set-field oxm %s for table %d", of_object_id_str[oxm.header.object_id], flow->tableId);
             return INDIGO_ERROR_COMPAT;
@@ -2299,8 +2524,6 @@ static indigo_error_t ind_ofdpa_packet_out_actions_get(of_list_action_t *of_list
 
 indigo_error_t indigo_fwd_forwarding_features_get(of_features_reply_t *features_reply)
 {
-  uint32_t tableId, tableCount = 0;
-
   LOG_TRACE("%s() called", __FUNCTION__);
 
   if (features_reply->version < OF_VERSION_1_3)
@@ -2310,30 +2533,63 @@ indigo_error_t indigo_fwd_forwarding_features_get(of_features_reply_t *features_
   }
 
   /* Number of tables supported by datapath. */
-  for (tableId = 0; tableId < 255; tableId++)
+  of_features_reply_n_tables_set(features_reply, ind_ofdpa_ttp_table_count());
+
+  /* Packets held for truncated packet-ins */
+  of_features_reply_n_buffers_set(features_reply, ind_ofdpa_pkt_buffer_count());
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t indigo_fwd_table_features_get(of_table_features_stats_request_t *request,
+                                             of_table_features_stats_reply_t **reply)
+{
+  of_table_features_stats_reply_t *features_reply;
+  of_list_table_features_t entries;
+  indigo_error_t err;
+  uint32_t xid;
+
+  LOG_TRACE("%s() called", __FUNCTION__);
+
+  if (request->version < OF_VERSION_1_3)
   {
-    if (ofdpaFlowTableSupported(tableId) == OFDPA_E_NONE)
-    {
-      tableCount++;
-    }
+    LOG_ERROR("Unsupported OpenFlow version 0x%x.", request->version);
+    return INDIGO_ERROR_VERSION;
+  }
+
+  features_reply = of_table_features_stats_reply_new(request->version);
+  if (features_reply == NULL)
+  {
+    LOG_ERROR("Failed to allocate table features reply.");
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  of_table_features_stats_request_xid_get(request, &xid);
+  of_table_features_stats_reply_xid_set(features_reply, xid);
+  of_table_features_stats_reply_entries_bind(features_reply, &entries);
+
+  err = ind_ofdpa_ttp_table_features_get(request->version, &entries);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    of_object_delete(features_reply);
+    return err;
   }
-  of_features_reply_n_tables_set(features_reply, tableCount);
 
+  *reply = features_reply;
   return INDIGO_ERROR_NONE;
 }
 
-indigo_error_t indigo_fwd_flow_create(indigo_cookie_t flow_id,
-                                      of_flow_add_t *flow_add,
-                                      uint8_t *table_id)
+/* Translate a LOCI flow add into an OF-DPA flow entry */
+static indigo_error_t ind_ofdpa_flow_add_translate(indigo_cookie_t flow_id,
+                                                   of_flow_add_t *flow_add,
+                                                   uint8_t *table_id,
+                                                   ofdpaFlowEntry_t *flow)
 {
   indigo_error_t err = INDIGO_ERROR_NONE;
-  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
-  ofdpaFlowEntry_t flow;
   uint16_t priority;
   uint16_t idle_timeout, hard_timeout;
   of_match_t of_match;
-
-  LOG_TRACE("Flow create called");
+  const of_match_t *match;
 
   if (flow_add->version < OF_VERSION_1_3)
   {
@@ -2341,57 +2597,297 @@ indigo_error_t indigo_fwd_flow_create(indigo_cookie_t flow_id,
     return INDIGO_ERROR_VERSION;
   }
 
-  memset(&flow, 0, sizeof(flow));
-
-  flow.cookie = flow_id;
-
   /* Get the Flow Table ID */
   of_flow_add_table_id_get(flow_add, table_id);
-  flow.tableId = (uint32_t)*table_id;
+  ind_ofdpa_flow_entry_clear(flow, *table_id);
+
+  flow->cookie = flow_id;
 
   /* ofdpa Flow priority */
   of_flow_add_priority_get(flow_add, &priority);
-  flow.priority = (uint32_t)priority;
+  flow->priority = (uint32_t)priority;
 
-  /* Get the idle time and hard time */
+  /* Get the idle time and hard time, unless the state manager ages flows */
   (void)of_flow_modify_idle_timeout_get((of_flow_modify_t *)flow_add, &idle_timeout);
   (void)of_flow_modify_hard_timeout_get((of_flow_modify_t *)flow_add, &hard_timeout);
-  flow.idle_time = (uint32_t)idle_timeout;
-  flow.hard_time = (uint32_t)hard_timeout;
+  if (flowExpiryOffload)
+  {
+    flow->idle_time = (uint32_t)idle_timeout;
+    flow->hard_time = (uint32_t)hard_timeout;
+  }
+
+  /* Normally decoded once by the state manager already */
+  match = indigo_core_flow_mod_match_get(flow_add, &of_match);
+  if (match == NULL)
+  {
+    LOG_ERROR("Error getting openflow match criteria.");
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  /* Reject what the pipeline cannot hold before translating it */
+  err = ind_ofdpa_ttp_flow_check(flow_add, match);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    return err;
+  }
+
+  /* The same flow on another port is patched from its template */
+  if (ind_ofdpa_flow_template_apply(flow_add, match, flow))
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  /* Get the match fields and masks from LOCI match structure */
+  err = ind_ofdpa_match_fields_masks_get(match, flow);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Error getting match fields and masks. (err = %d)", err);
+    return err;
+  }
+
+  /* Get the instructions set from the LOCI flow add object */
+  err = ind_ofdpa_instructions_get(flow_add, flow);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_TRACE("Failed to get flow instructions. (err = %d)", err);
+    return err;
+  }
+
+  ind_ofdpa_flow_template_add(flow_add, match, flow);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Flows of a table the driver compiles are not installed as they are */
+static int ind_ofdpa_flow_compiled(uint32_t tableId)
+{
+  return (ind_ofdpa_route_compress_table(tableId) || ind_ofdpa_acl_compile_table(tableId));
+}
+
+indigo_error_t indigo_fwd_flow_create(indigo_cookie_t flow_id,
+                                      of_flow_add_t *flow_add,
+                                      uint8_t *table_id)
+{
+  indigo_error_t err = INDIGO_ERROR_NONE;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  ofdpaFlowEntry_t flow;
+
+  LOG_TRACE("Flow create called");
+
+  err = ind_ofdpa_flow_add_translate(flow_id, flow_add, table_id, &flow);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    return err;
+  }
+
+  /* A compressed route or a compiled ACL flow is installed, or not, by
+     the route trie or the ACL compiler */
+  if (ind_ofdpa_route_compress_add(&flow, &ofdpa_rv) ||
+      ind_ofdpa_acl_compile_add(&flow, &ofdpa_rv))
+  {
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      ind_ofdpa_flow_key_add(&flow);
+      ind_ofdpa_punt_flow_added(&flow, flow_add);
+    }
+    return (indigoConvertOfdpaRv(ofdpa_rv));
+  }
+
+  /* Submit the changes to ofdpa */
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowAdd, &flow);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Failed to add flow. (ofdpa_rv = %d)", ofdpa_rv);
+  }
+  else
+  {
+    LOG_TRACE("Flow added successfully. (ofdpa_rv = %d)", ofdpa_rv);
+    ind_ofdpa_flow_stats_cache_add(flow_id);
+    ind_ofdpa_flow_key_add(&flow);
+    ind_ofdpa_table_stats_flow_added(flow.tableId, ind_ofdpa_flow_is_timed(&flow));
+    ind_ofdpa_vlan_stats_flow_added(&flow);
+    ind_ofdpa_punt_flow_added(&flow, flow_add);
+  }
+  return (indigoConvertOfdpaRv(ofdpa_rv));
+}
+
+/* Scratch for flow batches, kept from one batch to the next and grown
+   when a larger one comes. The flow entries start on a cache line. */
+typedef struct
+{
+  ofdpaFlowEntry_t *flows;
+  OFDPA_ERROR_t *rvs;
+  uint8_t *cached;
+  int capacity;
+} ind_ofdpa_flow_batch_t;
+
+#define IND_OFDPA_FLOW_BATCH_ALIGN 64
+
+static ind_ofdpa_flow_batch_t flowBatch;
+
+static indigo_error_t ind_ofdpa_flow_batch_reserve(int count)
+{
+  void *scratch;
+
+  if (count <= flowBatch.capacity)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  if (posix_memalign(&scratch, IND_OFDPA_FLOW_BATCH_ALIGN,
+                     count * (sizeof(*flowBatch.flows) + sizeof(*flowBatch.rvs) +
+                              sizeof(*flowBatch.cached))) != 0)
+  {
+    LOG_ERROR("Failed to allocate %d flow entries.", count);
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  free(flowBatch.flows);
+  flowBatch.flows = scratch;
+  flowBatch.rvs = (OFDPA_ERROR_t *)&flowBatch.flows[count];
+  flowBatch.cached = (uint8_t *)&flowBatch.rvs[count];
+  flowBatch.capacity = count;
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* OF-DPA has no bulk flow add RPC. The whole batch is translated
+   first and the entries are then submitted back to back, so the
+   client library is not interleaved with LOCI parsing. With the
+   submit thread, each flow is handed over as soon as it is translated
+   so the RPCs overlap the translation of the rest of the batch. */
+indigo_error_t indigo_fwd_flow_create_batch(int count,
+                                            indigo_cookie_t *flow_ids,
+                                            of_flow_add_t **flow_adds,
+                                            uint8_t *table_ids,
+                                            indigo_error_t *results)
+{
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  OFDPA_ERROR_t *ofdpa_rvs;
+  ofdpaFlowEntry_t *flows;
+  int pipelined;
+  int i;
+
+  LOG_TRACE("Flow create batch called. (count = %d)", count);
+
+  if (ind_ofdpa_flow_batch_reserve(count) != INDIGO_ERROR_NONE)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  flows = flowBatch.flows;
+  ofdpa_rvs = flowBatch.rvs;
+
+  pipelined = ind_ofdpa_flow_submit_thread_running();
+  for (i = 0; i < count; i++)
+  {
+    results[i] = ind_ofdpa_flow_add_translate(flow_ids[i], flow_adds[i],
+                                              &table_ids[i], &flows[i]);
+    if (pipelined && (results[i] == INDIGO_ERROR_NONE) &&
+        !ind_ofdpa_flow_compiled(flows[i].tableId))
+    {
+      ind_ofdpa_flow_submit(&flows[i], &ofdpa_rvs[i]);
+    }
+  }
+
+  if (pipelined)
+  {
+    ind_ofdpa_flow_submit_wait();
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (results[i] != INDIGO_ERROR_NONE)
+    {
+      continue;
+    }
+    if (ind_ofdpa_route_compress_add(&flows[i], &ofdpa_rv) ||
+        ind_ofdpa_acl_compile_add(&flows[i], &ofdpa_rv))
+    {
+      if (ofdpa_rv == OFDPA_E_NONE)
+      {
+        ind_ofdpa_flow_key_add(&flows[i]);
+        ind_ofdpa_punt_flow_added(&flows[i], flow_adds[i]);
+      }
+      results[i] = indigoConvertOfdpaRv(ofdpa_rv);
+      continue;
+    }
+
+    /* Flows the driver compiles are not pipelined */
+    ofdpa_rv = (pipelined && !ind_ofdpa_flow_compiled(flows[i].tableId)) ?
+      ofdpa_rvs[i] : IND_OFDPA_RPC(ofdpaFlowAdd, &flows[i]);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_TRACE("Failed to add flow 0x%llx. (ofdpa_rv = %d)",
+                (unsigned long long)flow_ids[i], ofdpa_rv);
+    }
+    else
+    {
+      ind_ofdpa_flow_stats_cache_add(flow_ids[i]);
+      ind_ofdpa_flow_key_add(&flows[i]);
+      ind_ofdpa_table_stats_flow_added(flows[i].tableId,
+                                       ind_ofdpa_flow_is_timed(&flows[i]));
+      ind_ofdpa_vlan_stats_flow_added(&flows[i]);
+      ind_ofdpa_punt_flow_added(&flows[i], flow_adds[i]);
+    }
+    results[i] = indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* The flow cookie in OF-DPA is the flow ID, so a flow that survived the
+   restart is found without translating the message again. After the
+   startup load it is normally in the key cache already. The flow is
+   already counted in its table. */
+indigo_error_t indigo_fwd_flow_restore(indigo_cookie_t flow_id,
+                                       of_flow_add_t *flow_add,
+                                       uint8_t *table_id)
+{
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  ofdpaFlowEntry_t flow;
+  ofdpaFlowEntryStats_t flowStats;
+  uint16_t priority;
+  int keyCached = 1;
 
-  memset(&of_match, 0, sizeof(of_match));
-  if (of_flow_add_match_get(flow_add, &of_match) < 0)
-  {
-    LOG_ERROR("Error getting openflow match criteria.");
-    return INDIGO_ERROR_UNKNOWN;
-  }
+  memset(&flow, 0, sizeof(flow));
+  memset(&flowStats, 0, sizeof(flowStats));
 
-  /* Get the match fields and masks from LOCI match structure */
-  err = ind_ofdpa_match_fields_masks_get(&of_match, &flow);
-  if (err != INDIGO_ERROR_NONE)
+  if (ind_ofdpa_flow_key_get(flow_id, &flow) != INDIGO_ERROR_NONE)
   {
-    LOG_ERROR("Error getting match fields and masks. (err = %d)", err);
-    return err;
+    keyCached = 0;
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieGet, flow_id, &flow, &flowStats);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_TRACE("Flow 0x%llx not restored. (ofdpa_rv = %d)",
+                (unsigned long long)flow_id, ofdpa_rv);
+      return (indigoConvertOfdpaRv(ofdpa_rv));
+    }
+    ind_ofdpa_flow_key_add(&flow);
   }
 
-  /* Get the instructions set from the LOCI flow add object */
-  err = ind_ofdpa_instructions_get(flow_add, &flow);
-  if (err != INDIGO_ERROR_NONE)
-  {
-    LOG_TRACE("Failed to get flow instructions. (err = %d)", err);
-    return err;
-  }
-  /* Submit the changes to ofdpa */
-  ofdpa_rv = ofdpaFlowAdd(&flow);
-  if (ofdpa_rv != OFDPA_E_NONE)
+  /* The key cache has no match or actions, so a VLAN table flow, a
+     compiled flow, or a flow that may output to the controller, is
+     looked up once. A route suppressed, or an ACL flow hidden or merged,
+     before the restart is not found and is added again. */
+  if (keyCached && ((flow.tableId == OFDPA_FLOW_TABLE_ID_VLAN) ||
+                    ind_ofdpa_flow_compiled(flow.tableId) ||
+                    ind_ofdpa_punt_table_tracked(flow.tableId)))
   {
-    LOG_TRACE("Failed to add flow. (ofdpa_rv = %d)", ofdpa_rv);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieGet, flow_id, &flow, &flowStats);
   }
-  else
+  if (ofdpa_rv == OFDPA_E_NONE)
   {
-    LOG_TRACE("Flow added successfully. (ofdpa_rv = %d)", ofdpa_rv);
+    ind_ofdpa_vlan_stats_flow_added(&flow);
+    ind_ofdpa_route_compress_restore(&flow);
+    of_flow_add_priority_get(flow_add, &priority);
+    ind_ofdpa_acl_compile_restore(&flow, priority);
+    ind_ofdpa_punt_flow_added(&flow, flow_add);
   }
-  return (indigoConvertOfdpaRv(ofdpa_rv));
+
+  *table_id = flow.tableId;
+  ind_ofdpa_flow_stats_cache_add(flow_id);
+
+  return INDIGO_ERROR_NONE;
 }
 
 indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
@@ -2402,6 +2898,7 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
   ofdpaFlowEntryStats_t flowStats;
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
   of_match_t of_match;
+  const of_match_t *match;
 
   LOG_TRACE("Flow modify called");
 
@@ -2411,35 +2908,42 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
     return INDIGO_ERROR_VERSION;
   }
 
-  memset(&flow, 0, sizeof(flow));
+  /* The key cache or OF-DPA fill in the header; only the table's member
+     of flowData is cleared below */
   memset(&flowStats, 0, sizeof(flowStats));
 
-  /* Get the flow entries and flow stats from the indigo cookie */
-  ofdpa_rv = ofdpaFlowByCookieGet(flow_id, &flow, &flowStats);
-  if (ofdpa_rv != OFDPA_E_NONE)
+  /* The table, priority and timeouts are known from flow create; only look
+     the flow up in OF-DPA if it is not in the key cache */
+  if (ind_ofdpa_flow_key_get(flow_id, &flow) != INDIGO_ERROR_NONE)
   {
-    if (ofdpa_rv == OFDPA_E_NOT_FOUND)
-    {
-      LOG_ERROR("Request to modify non-existent flow. (ofdpa_rv = %d)", ofdpa_rv);
-    }
-    else
+    /* Get the flow entries and flow stats from the indigo cookie */
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieGet, flow_id, &flow, &flowStats);
+    if (ofdpa_rv != OFDPA_E_NONE)
     {
-      LOG_ERROR("Invalid flow. (ofdpa_rv = %d)", ofdpa_rv);
+      if (ofdpa_rv == OFDPA_E_NOT_FOUND)
+      {
+        LOG_ERROR("Request to modify non-existent flow. (ofdpa_rv = %d)", ofdpa_rv);
+      }
+      else
+      {
+        LOG_ERROR("Invalid flow. (ofdpa_rv = %d)", ofdpa_rv);
+      }
+      return (indigoConvertOfdpaRv(ofdpa_rv));
     }
-    return (indigoConvertOfdpaRv(ofdpa_rv));
   }
 
-  memset(&of_match, 0, sizeof(of_match));
-  if (of_flow_add_match_get(flow_modify, &of_match) < 0)
+  /* Shared by every flow a non-strict modify changes */
+  match = indigo_core_flow_mod_match_get(flow_modify, &of_match);
+  if (match == NULL)
   {
     LOG_ERROR("Error getting openflow match criteria.");
     return INDIGO_ERROR_UNKNOWN;
   }
 
-  memset(&flow.flowData, 0, sizeof(flow.flowData));
+  memset(&flow.flowData, 0, ind_ofdpa_flow_data_size(flow.tableId));
 
   /* Get the match fields and masks from LOCI match structure */
-  err = ind_ofdpa_match_fields_masks_get(&of_match, &flow);
+  err = ind_ofdpa_match_fields_masks_get(match, &flow);
   if (err != INDIGO_ERROR_NONE)
   {
     LOG_ERROR("Error getting match fields and masks. (err = %d)", err);
@@ -2454,8 +2958,13 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
     return err;
   }
 
-  /* Submit the changes to ofdpa */
-  ofdpa_rv = ofdpaFlowModify(&flow);
+  /* Submit the changes to ofdpa, through the route trie for a
+     compressed route and the ACL compiler for a compiled ACL flow */
+  if (!ind_ofdpa_route_compress_modify(&flow, &ofdpa_rv) &&
+      !ind_ofdpa_acl_compile_modify(&flow, &ofdpa_rv))
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowModify, &flow);
+  }
   if (ofdpa_rv!= OFDPA_E_NONE)
   {
     LOG_TRACE("Failed to modify flow. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2463,11 +2972,163 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
   else
   {
     LOG_TRACE("Flow modified successfully. (ofdpa_rv = %d)", ofdpa_rv);
+    ind_ofdpa_punt_flow_modified(&flow, flow_modify);
   }
 
   return (indigoConvertOfdpaRv(ofdpa_rv));
 }
 
+/* Tables whose translation a modify batch keeps */
+#define IND_OFDPA_FLOW_MODIFY_TABLES_MAX 8
+
+typedef struct
+{
+  indigo_error_t err;
+  ofdpaFlowEntry_t flow;
+} ind_ofdpa_flow_modify_xlate_t;
+
+/* A non-strict modify changes every matched flow the same way, and its
+   match and instructions translate the same for every flow of a table.
+   They are translated once per table and copied into each flow found in
+   the key cache, and with the submit thread the ofdpaFlowModify calls
+   are pipelined. Flows not in the key cache, those the driver compiles
+   and those of any tables past the first IND_OFDPA_FLOW_MODIFY_TABLES_MAX
+   are modified one at a time. */
+indigo_error_t indigo_fwd_flow_modify_batch(int count,
+                                            indigo_cookie_t *flow_ids,
+                                            of_flow_modify_t *flow_modify,
+                                            indigo_error_t *results)
+{
+  ind_ofdpa_flow_modify_xlate_t xlate[IND_OFDPA_FLOW_MODIFY_TABLES_MAX];
+  ind_ofdpa_flow_modify_xlate_t *x;
+  OFDPA_ERROR_t ofdpa_rv;
+  OFDPA_ERROR_t *ofdpa_rvs;
+  ofdpaFlowEntry_t *flows;
+  of_match_t of_match;
+  const of_match_t *match;
+  uint8_t *cached;
+  int pipelined;
+  int tables = 0;
+  int i, j;
+
+  LOG_TRACE("Flow modify batch called. (count = %d)", count);
+
+  if (flow_modify->version < OF_VERSION_1_3)
+  {
+    LOG_ERROR("OpenFlow version 0x%x unsupported", flow_modify->version);
+    return INDIGO_ERROR_VERSION;
+  }
+
+  match = indigo_core_flow_mod_match_get(flow_modify, &of_match);
+  if (match == NULL)
+  {
+    LOG_ERROR("Error getting openflow match criteria.");
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  if (ind_ofdpa_flow_batch_reserve(count) != INDIGO_ERROR_NONE)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  flows = flowBatch.flows;
+  ofdpa_rvs = flowBatch.rvs;
+  cached = flowBatch.cached;
+
+  pipelined = ind_ofdpa_flow_submit_thread_running();
+  for (i = 0; i < count; i++)
+  {
+    cached[i] = (ind_ofdpa_flow_key_get(flow_ids[i], &flows[i]) == INDIGO_ERROR_NONE) &&
+      !ind_ofdpa_flow_compiled(flows[i].tableId);
+    if (!cached[i])
+    {
+      continue;
+    }
+
+    for (j = 0, x = NULL; j < tables; j++)
+    {
+      if (xlate[j].flow.tableId == flows[i].tableId)
+      {
+        x = &xlate[j];
+        break;
+      }
+    }
+    if ((x == NULL) && (tables < IND_OFDPA_FLOW_MODIFY_TABLES_MAX))
+    {
+      x = &xlate[tables++];
+      ind_ofdpa_flow_entry_clear(&x->flow, flows[i].tableId);
+      x->err = ind_ofdpa_match_fields_masks_get(match, &x->flow);
+      if (x->err == INDIGO_ERROR_NONE)
+      {
+        x->err = ind_ofdpa_instructions_get(flow_modify, &x->flow);
+      }
+      if (x->err != INDIGO_ERROR_NONE)
+      {
+        LOG_TRACE("Failed to translate flow modify for table %d. (err = %d)",
+                  x->flow.tableId, x->err);
+      }
+    }
+    if (x == NULL)
+    {
+      cached[i] = 0;
+      continue;
+    }
+
+    memcpy(&flows[i].flowData, &x->flow.flowData, ind_ofdpa_flow_data_size(flows[i].tableId));
+    if ((x->err == INDIGO_ERROR_NONE) && pipelined)
+    {
+      ind_ofdpa_flow_submit_modify(&flows[i], &ofdpa_rvs[i]);
+    }
+  }
+
+  if (pipelined)
+  {
+    ind_ofdpa_flow_submit_wait();
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (!cached[i])
+    {
+      results[i] = indigo_fwd_flow_modify(flow_ids[i], flow_modify);
+      continue;
+    }
+
+    for (j = 0; xlate[j].flow.tableId != flows[i].tableId; j++)
+      ;
+    if (xlate[j].err != INDIGO_ERROR_NONE)
+    {
+      results[i] = xlate[j].err;
+      continue;
+    }
+
+    ofdpa_rv = pipelined ? ofdpa_rvs[i] : IND_OFDPA_RPC(ofdpaFlowModify, &flows[i]);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_TRACE("Failed to modify flow 0x%llx. (ofdpa_rv = %d)",
+                (unsigned long long)flow_ids[i], ofdpa_rv);
+    }
+    else
+    {
+      ind_ofdpa_punt_flow_modified(&flows[i], flow_modify);
+    }
+    results[i] = indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Driver bookkeeping for a flow deleted from OF-DPA */
+static void ind_ofdpa_flow_deleted(indigo_cookie_t flow_id,
+                                   ofdpaFlowEntry_t *flow,
+                                   indigo_fi_flow_stats_t *flow_stats)
+{
+  ind_ofdpa_flow_stats_cache_remove(flow_id);
+  ind_ofdpa_flow_key_remove(flow_id);
+  ind_ofdpa_table_stats_flow_removed(flow->tableId, ind_ofdpa_flow_is_timed(flow));
+  ind_ofdpa_vlan_stats_flow_removed(flow_id, flow_stats);
+  ind_ofdpa_punt_flow_removed(flow_id);
+}
+
 indigo_error_t indigo_fwd_flow_delete(indigo_cookie_t flow_id,
                                       indigo_fi_flow_stats_t *flow_stats)
 {
@@ -2481,28 +3142,46 @@ indigo_error_t indigo_fwd_flow_delete(indigo_cookie_t flow_id,
   memset(&flow, 0, sizeof(flow));
   memset(&flowStats, 0, sizeof(flowStats));
 
-  ofdpa_rv = ofdpaFlowByCookieGet(flow_id, &flow, &flowStats);
-  if (ofdpa_rv != OFDPA_E_NONE)
+  if (ind_ofdpa_route_compress_delete(flow_id, flow_stats, &ofdpa_rv) ||
+      ind_ofdpa_acl_compile_delete(flow_id, flow_stats, &ofdpa_rv))
   {
-    if (ofdpa_rv == OFDPA_E_NOT_FOUND)
+    if (ofdpa_rv == OFDPA_E_NONE)
     {
-      LOG_ERROR("Request to delete non-existent flow. (ofdpa_rv = %d)", ofdpa_rv);
+      ind_ofdpa_flow_key_remove(flow_id);
+      ind_ofdpa_punt_flow_removed(flow_id);
     }
-    else
+    return (indigoConvertOfdpaRv(ofdpa_rv));
+  }
+
+  /* With both caches the flow key needs no lookup and only the final
+     counters are read before the delete */
+  if (!ind_ofdpa_flow_stats_cache_enabled() ||
+      (ind_ofdpa_flow_key_get(flow_id, &flow) != INDIGO_ERROR_NONE) ||
+      (ind_ofdpa_flow_stats_final_get(flow_id, &flow, flow_stats) != INDIGO_ERROR_NONE))
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieGet, flow_id, &flow, &flowStats);
+    if (ofdpa_rv != OFDPA_E_NONE)
     {
-      LOG_ERROR("Invalid flow. (ofdpa_rv = %d)", ofdpa_rv);
+      if (ofdpa_rv == OFDPA_E_NOT_FOUND)
+      {
+        LOG_ERROR("Request to delete non-existent flow. (ofdpa_rv = %d)", ofdpa_rv);
+      }
+      else
+      {
+        LOG_ERROR("Invalid flow. (ofdpa_rv = %d)", ofdpa_rv);
+      }
+
+      return (indigoConvertOfdpaRv(ofdpa_rv));
     }
 
-    return (indigoConvertOfdpaRv(ofdpa_rv));
+    flow_stats->flow_id = flow_id;
+    flow_stats->packets = flowStats.receivedPackets;
+    flow_stats->bytes = flowStats.receivedBytes;
+    flow_stats->duration_ns = (flowStats.durationSec)*(IND_OFDPA_NANO_SEC); /* Convert to nano seconds*/
   }
 
-  flow_stats->flow_id = flow_id;
-  flow_stats->packets = flowStats.receivedPackets;
-  flow_stats->bytes = flowStats.receivedBytes;
-  flow_stats->duration_ns = (flowStats.durationSec)*(IND_OFDPA_NANO_SEC); /* Convert to nano seconds*/
-
   /* Delete the flow entry */
-  ofdpa_rv = ofdpaFlowByCookieDelete(flow_id);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieDelete, flow_id);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to delete flow. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2510,11 +3189,83 @@ indigo_error_t indigo_fwd_flow_delete(indigo_cookie_t flow_id,
   else
   {
     LOG_TRACE("Flow deleted successfully. (ofdpa_rv = %d)", ofdpa_rv);
+    ind_ofdpa_flow_deleted(flow_id, &flow, flow_stats);
   }
 
   return (indigoConvertOfdpaRv(ofdpa_rv));
 }
 
+/* OF-DPA has no bulk flow delete RPC either. A flow whose key is cached
+   needs no lookup, only a read of its final counters, and with the
+   submit thread its delete is pipelined with the rest of the batch, so
+   flushing the MACs of a port is bounded by OF-DPA rather than by round
+   trips. The other flows, including those the driver compiles, are
+   deleted one at a time once the pipelined ones are done. */
+indigo_error_t indigo_fwd_flow_delete_batch(int count,
+                                            indigo_cookie_t *flow_ids,
+                                            indigo_fi_flow_stats_t *flow_stats,
+                                            indigo_error_t *results)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  OFDPA_ERROR_t *ofdpa_rvs;
+  ofdpaFlowEntry_t *flows;
+  uint8_t *cached;
+  int pipelined;
+  int i;
+
+  LOG_TRACE("Flow delete batch called. (count = %d)", count);
+
+  if (ind_ofdpa_flow_batch_reserve(count) != INDIGO_ERROR_NONE)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  flows = flowBatch.flows;
+  ofdpa_rvs = flowBatch.rvs;
+  cached = flowBatch.cached;
+
+  pipelined = ind_ofdpa_flow_submit_thread_running();
+  for (i = 0; i < count; i++)
+  {
+    cached[i] = ind_ofdpa_flow_stats_cache_enabled() &&
+      (ind_ofdpa_flow_key_get(flow_ids[i], &flows[i]) == INDIGO_ERROR_NONE) &&
+      !ind_ofdpa_flow_compiled(flows[i].tableId) &&
+      (ind_ofdpa_flow_stats_final_get(flow_ids[i], &flows[i], &flow_stats[i]) == INDIGO_ERROR_NONE);
+    if (cached[i] && pipelined)
+    {
+      flows[i].cookie = flow_ids[i];
+      ind_ofdpa_flow_submit_delete(&flows[i], &ofdpa_rvs[i]);
+    }
+  }
+
+  if (pipelined)
+  {
+    ind_ofdpa_flow_submit_wait();
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (!cached[i])
+    {
+      results[i] = indigo_fwd_flow_delete(flow_ids[i], &flow_stats[i]);
+      continue;
+    }
+
+    ofdpa_rv = pipelined ? ofdpa_rvs[i] : IND_OFDPA_RPC(ofdpaFlowByCookieDelete, flow_ids[i]);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Failed to delete flow 0x%llx. (ofdpa_rv = %d)",
+                (unsigned long long)flow_ids[i], ofdpa_rv);
+    }
+    else
+    {
+      ind_ofdpa_flow_deleted(flow_ids[i], &flows[i], &flow_stats[i]);
+    }
+    results[i] = indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
 indigo_error_t indigo_fwd_flow_stats_get(indigo_cookie_t flow_id,
                                          indigo_fi_flow_stats_t *flow_stats)
 {
@@ -2522,11 +3273,24 @@ indigo_error_t indigo_fwd_flow_stats_get(indigo_cookie_t flow_id,
   ofdpaFlowEntry_t flow;
   ofdpaFlowEntryStats_t flowStats;
 
+  /* A suppressed route is not in OF-DPA, and a compiled ACL flow may
+     share its entry */
+  if (ind_ofdpa_route_compress_stats_get(flow_id, flow_stats) ||
+      ind_ofdpa_acl_compile_stats_get(flow_id, flow_stats))
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  if (ind_ofdpa_flow_stats_cache_enabled())
+  {
+    return ind_ofdpa_flow_stats_cache_get(flow_id, flow_stats);
+  }
+
   memset(&flow, 0, sizeof(flow));
   memset(&flowStats, 0, sizeof(flowStats));
 
   /* Get the flow and flow stats from flow id */
-  ofdpa_rv = ofdpaFlowByCookieGet(flow_id, &flow, &flowStats);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieGet, flow_id, &flow, &flowStats);
   if (ofdpa_rv == OFDPA_E_NONE)
   {
     flow_stats->flow_id = flow_id;
@@ -2548,6 +3312,39 @@ indigo_error_t indigo_fwd_flow_stats_get(indigo_cookie_t flow_id,
   return (indigoConvertOfdpaRv(ofdpa_rv));
 }
 
+indigo_error_t indigo_fwd_flow_hit_status_get(indigo_cookie_t flow_id,
+                                              bool *hit_status)
+{
+  if (!ind_ofdpa_flow_stats_cache_enabled())
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  return ind_ofdpa_flow_stats_cache_hit_get(flow_id, hit_status);
+}
+
+/* Hit status comes from the flow counter cache, so a batch costs no
+   client RPCs unless an entry has not been sampled yet */
+indigo_error_t indigo_fwd_flow_hit_status_get_batch(int count,
+                                                    indigo_cookie_t *flow_ids,
+                                                    bool *hit_status,
+                                                    indigo_error_t *results)
+{
+  int i;
+
+  if (!ind_ofdpa_flow_stats_cache_enabled())
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    results[i] = ind_ofdpa_flow_stats_cache_hit_get(flow_ids[i], &hit_status[i]);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
 void indigo_fwd_table_mod(of_table_mod_t *of_table_mod,
                           indigo_cookie_t callback_cookie)
 {
@@ -2560,8 +3357,8 @@ indigo_error_t indigo_fwd_table_stats_get(of_table_stats_request_t *table_stats_
 {
   of_version_t version = table_stats_request->version;
   uint32_t xid;
-  uint32_t i;
-  ofdpaFlowTableInfo_t tableInfo;
+  int i;
+  uint8_t tableId;
   of_table_stats_entry_t entry[1];
   of_table_stats_reply_t *reply;
   of_list_table_stats_entry_t list[1];
@@ -2588,52 +3385,72 @@ indigo_error_t indigo_fwd_table_stats_get(of_table_stats_request_t *table_stats_
   of_table_stats_reply_entries_bind(*table_stats_reply, list);
 
 
-  for (i = 0; i < 255; i++)
+  ind_ofdpa_table_stats_cache_init();
+
+  for (i = 0; i < tableStatsCache.numTables; i++)
   {
-    if (ofdpaFlowTableSupported(i) == OFDPA_E_NONE)
-    {
-      of_table_stats_entry_init(entry, version, -1, 1);
-      (void)of_list_table_stats_entry_append_bind(list, entry);
+    tableId = tableStatsCache.tableIds[i];
 
-      /* Table Id */
-      of_table_stats_entry_table_id_set(entry, i);
+    of_table_stats_entry_init(entry, version, -1, 1);
+    (void)of_list_table_stats_entry_append_bind(list, entry);
 
-      /* Number of entries in the table */
-      if (ofdpaFlowTableInfoGet(i, &tableInfo) == OFDPA_E_NONE)
-      {
-        of_table_stats_entry_active_count_set(entry, tableInfo.numEntries);
-      }
+    /* Table Id */
+    of_table_stats_entry_table_id_set(entry, tableId);
 
-      /* Number of packets looked up in table not supported. */
-      of_table_stats_entry_lookup_count_set(entry, 0);
+    /* Number of entries in the table */
+    of_table_stats_entry_active_count_set(entry, tableStatsCache.activeCount[tableId]);
 
-      /* Number of packets that hit table not supported. */
-      of_table_stats_entry_matched_count_set(entry, 0);
-    }
+    /* Number of packets looked up in table not supported. */
+    of_table_stats_entry_lookup_count_set(entry, 0);
+
+    /* Number of packets that hit table not supported. */
+    of_table_stats_entry_matched_count_set(entry, 0);
   }
 
   return(INDIGO_ERROR_NONE);
 }
 
-indigo_error_t indigo_fwd_packet_out(of_packet_out_t *packet_out)
+static indigo_error_t ind_ofdpa_packet_out_send(of_packet_out_t *packet_out)
 {
   OFDPA_ERROR_t  ofdpa_rv = OFDPA_E_NONE;
   indigo_error_t err = INDIGO_ERROR_NONE;
   indPacketOutActions_t packetOutActions;
   ofdpa_buffdesc pkt;
+  uint64_t start;
+  uint32_t elapsed;
 
   of_port_no_t   of_port_num;
   of_list_action_t of_list_action[1];
   of_octets_t    of_octets[1];
+  uint32_t       buffer_id;
+  uint32_t       buffered_port;
+  static uint8_t buffered[IND_OFDPA_PKT_BUFFER_LEN];
 
   of_packet_out_in_port_get(packet_out, &of_port_num);
   of_packet_out_data_get(packet_out, of_octets);
   of_packet_out_actions_bind(packet_out, of_list_action);
+  of_packet_out_buffer_id_get(packet_out, &buffer_id);
 
-
+  /* The data is sent from the message buffer, not copied */
   pkt.pstart = (char *)of_octets->data;
   pkt.size = of_octets->bytes;
 
+  if (buffer_id != OF_BUFFER_ID_NO_BUFFER)
+  {
+    err = ind_ofdpa_pkt_buffer_take(buffer_id, buffered, &pkt.size, &buffered_port);
+    if (err != INDIGO_ERROR_NONE)
+    {
+      LOG_TRACE("Packet-out for unknown buffer 0x%x", buffer_id);
+      packetOutStats.errors++;
+      return err;
+    }
+    pkt.pstart = (char *)buffered;
+    if (of_port_num == OF_PORT_DEST_CONTROLLER)
+    {
+      of_port_num = buffered_port;
+    }
+  }
+
   memset(&packetOutActions, 0, sizeof(packetOutActions));
   err = ind_ofdpa_packet_out_actions_get(of_list_action, &packetOutActions);
   if (err != INDIGO_ERROR_NONE)
@@ -2642,25 +3459,128 @@ indigo_error_t indigo_fwd_packet_out(of_packet_out_t *packet_out)
     return err;
   }
 
+  if (ind_ofdpa_pkt_tx_thread_running())
+  {
+    if (packetOutActions.pipeline)
+    {
+      return ind_ofdpa_pkt_tx_thread_send(&pkt, OFDPA_PKT_LOOKUP,
+                                          packetOutActions.outputPort, of_port_num);
+    }
+    return ind_ofdpa_pkt_tx_thread_send(&pkt, 0, packetOutActions.outputPort, 0);
+  }
+
+  start = os_time_monotonic();
   if (packetOutActions.pipeline)
   {
-    ofdpa_rv = ofdpaPktSend(&pkt, OFDPA_PKT_LOOKUP, packetOutActions.outputPort, of_port_num);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPktSend, &pkt, OFDPA_PKT_LOOKUP, packetOutActions.outputPort, of_port_num);
   }
   else
   {
-    ofdpa_rv = ofdpaPktSend(&pkt, 0, packetOutActions.outputPort, 0);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPktSend, &pkt, 0, packetOutActions.outputPort, 0);
+  }
+  elapsed = (uint32_t)(os_time_monotonic() - start);
+
+  packetOutStats.sendTimeUs += elapsed;
+  if (elapsed > packetOutStats.sendTimeMaxUs)
+  {
+    packetOutStats.sendTimeMaxUs = elapsed;
   }
 
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Packet send failed. (ofdpa_rv = %d)", ofdpa_rv);
+    packetOutStats.errors++;
   }
   else
   {
     LOG_TRACE("Packet sent out of output port (%d) successfully. (ofdpa_rv = %d)", packetOutActions.outputPort, ofdpa_rv);
   }
-
-  return (indigoConvertOfdpaRv(ofdpa_rv));
+
+  return (indigoConvertOfdpaRv(ofdpa_rv));
+}
+
+static void ind_ofdpa_packet_out_batch_count(int count)
+{
+  int bucket = 0;
+
+  while ((count >>= 1) != 0 && (bucket < IND_OFDPA_PKT_OUT_BATCH_BUCKETS - 1))
+  {
+    bucket++;
+  }
+
+  packetOutStats.batches++;
+  packetOutStats.batchSizes[bucket]++;
+}
+
+indigo_error_t indigo_fwd_packet_out(of_packet_out_t *packet_out)
+{
+  ind_ofdpa_packet_out_batch_count(1);
+  packetOutStats.packets++;
+
+  return ind_ofdpa_packet_out_send(packet_out);
+}
+
+/* OF-DPA has no vectored send, so each packet is still one ofdpaPktSend;
+   the batch saves the per-message dispatch and copy in the agent */
+indigo_error_t indigo_fwd_packet_out_batch(int count, of_packet_out_t **packet_outs,
+                                           indigo_error_t *results)
+{
+  int i;
+
+  ind_ofdpa_packet_out_batch_count(count);
+  packetOutStats.packets += count;
+
+  for (i = 0; i < count; i++)
+  {
+    results[i] = ind_ofdpa_packet_out_send(packet_outs[i]);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_flow_expiry_show(void)
+{
+  if (!flowExpiryOffload)
+  {
+    LOG_INFO("Flow expiry: aged by the state manager");
+    return;
+  }
+  if (flowExpiry.batches == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("Flow expiry: %"PRIu64" flows aged by OF-DPA in %"PRIu64" batches",
+           flowExpiry.flows, flowExpiry.batches);
+}
+
+void ind_ofdpa_packet_out_show(void)
+{
+  int i;
+
+  if (packetOutStats.packets == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("Packet-out: %"PRIu64" packets in %"PRIu64" batches, %"PRIu64" send errors",
+           packetOutStats.packets, packetOutStats.batches, packetOutStats.errors);
+  LOG_INFO("  send latency us: avg %"PRIu64" max %u",
+           packetOutStats.sendTimeUs / packetOutStats.packets, packetOutStats.sendTimeMaxUs);
+  for (i = 0; i < IND_OFDPA_PKT_OUT_BATCH_BUCKETS; i++)
+  {
+    if (packetOutStats.batchSizes[i] != 0)
+    {
+      if (i == IND_OFDPA_PKT_OUT_BATCH_BUCKETS - 1)
+      {
+        LOG_INFO("  batches of %d or more: %"PRIu64, 1 << i, packetOutStats.batchSizes[i]);
+      }
+      else
+      {
+        LOG_INFO("  batches of %d-%d: %"PRIu64, 1 << i, (2 << i) - 1, packetOutStats.batchSizes[i]);
+      }
+    }
+  }
 }
 
 indigo_error_t indigo_fwd_experimenter(of_experimenter_t *experimenter,
@@ -2707,6 +3627,11 @@ indigo_error_t indigo_fwd_experimenter(of_experimenter_t *experimenter,
       mpls_tunnel_label_remark = experimenter;
       err = indigo_remark_action(mpls_tunnel_label_remark);
       break;
+
+    case IND_OFDPA_QUEUE_RATES_SUBTYPE:
+      /* Handled by indigo_port_experimenter */
+      return INDIGO_ERROR_NOT_SUPPORTED;
+
     default:
     LOG_ERROR("experimenter subtype 0x%x unsupported", subtype);
     return INDIGO_ERROR_NOT_SUPPORTED;
@@ -2738,7 +3663,7 @@ static indigo_error_t indigo_set_mpls_qos(ofdpa_mpls_set_qos_action_mod_msg_t *m
   switch (mod_command)
   {
     case OFDPA_MSG_MOD_ADD:
-      ofdpa_rv = ofdpaMplsQosActionAdd(&mplsQosEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosActionAdd, &mplsQosEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to add table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2750,7 +3675,7 @@ static indigo_error_t indigo_set_mpls_qos(ofdpa_mpls_set_qos_action_mod_msg_t *m
       break;
 
     case OFDPA_MSG_MOD_MODIFY:
-      ofdpa_rv = ofdpaMplsQosActionDelete(&mplsQosEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosActionDelete, &mplsQosEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to delete  table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2760,7 +3685,7 @@ static indigo_error_t indigo_set_mpls_qos(ofdpa_mpls_set_qos_action_mod_msg_t *m
       {
         LOG_TRACE("Table entry deleted successfully. (ofdpa_rv = %d)", ofdpa_rv);
       }
-      ofdpa_rv = ofdpaMplsQosActionAdd(&mplsQosEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosActionAdd, &mplsQosEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to add flow. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2772,7 +3697,7 @@ static indigo_error_t indigo_set_mpls_qos(ofdpa_mpls_set_qos_action_mod_msg_t *m
       break;
 
     case OFDPA_MSG_MOD_DELETE:
-      ofdpa_rv = ofdpaMplsQosActionDelete(&mplsQosEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosActionDelete, &mplsQosEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to delete flow. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2806,7 +3731,7 @@ indigo_error_t indigo_oam_dataplane(ofdpa_oam_dataplane_ctr_mod_msg_t *oam_datap
   switch (mod_command)
     {
       case OFDPA_MSG_MOD_ADD:
-      ofdpa_rv = ofdpaOamDataCounterAdd(lmepId, trafficClass);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaOamDataCounterAdd, lmepId, trafficClass);
         if (ofdpa_rv != OFDPA_E_NONE)
         {
           LOG_ERROR("Failed to add table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2818,7 +3743,7 @@ indigo_error_t indigo_oam_dataplane(ofdpa_oam_dataplane_ctr_mod_msg_t *oam_datap
         break;
 
       case OFDPA_MSG_MOD_MODIFY:
-        ofdpa_rv = ofdpaOamDataCounterDelete(lmepId, trafficClass);
+        ofdpa_rv = IND_OFDPA_RPC(ofdpaOamDataCounterDelete, lmepId, trafficClass);
         if (ofdpa_rv != OFDPA_E_NONE)
         {
           LOG_ERROR("Failed to delete table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2829,7 +3754,7 @@ indigo_error_t indigo_oam_dataplane(ofdpa_oam_dataplane_ctr_mod_msg_t *oam_datap
           LOG_TRACE("Table entry deleted successfully. (ofdpa_rv = %d)", ofdpa_rv);
         }
 
-        ofdpa_rv = ofdpaOamDataCounterAdd(lmepId, trafficClass);
+        ofdpa_rv = IND_OFDPA_RPC(ofdpaOamDataCounterAdd, lmepId, trafficClass);
         if (ofdpa_rv != OFDPA_E_NONE)
         {
           LOG_ERROR("Failed to add table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2841,7 +3766,7 @@ indigo_error_t indigo_oam_dataplane(ofdpa_oam_dataplane_ctr_mod_msg_t *oam_datap
         break;
 
       case OFDPA_MSG_MOD_DELETE:
-        ofdpa_rv = ofdpaOamDataCounterDelete(lmepId, trafficClass);
+        ofdpa_rv = IND_OFDPA_RPC(ofdpaOamDataCounterDelete, lmepId, trafficClass);
         if (ofdpa_rv != OFDPA_E_NONE)
         {
           LOG_ERROR("Failed to delete table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2881,7 +3806,7 @@ indigo_error_t indigo_drop_status(ofdpa_oam_drop_status_mod_msg_t *oam_drop_stat
   switch (mod_command)
   {
     case OFDPA_MSG_MOD_ADD:
-      ofdpa_rv = ofdpaDropStatusAdd(&dropEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaDropStatusAdd, &dropEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to add table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2893,7 +3818,7 @@ indigo_error_t indigo_drop_status(ofdpa_oam_drop_status_mod_msg_t *oam_drop_stat
       break;
 
     case OFDPA_MSG_MOD_MODIFY:
-      ofdpa_rv = ofdpaDropStatusDelete(lmepId);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaDropStatusDelete, lmepId);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to delete table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2906,7 +3831,7 @@ indigo_error_t indigo_drop_status(ofdpa_oam_drop_status_mod_msg_t *oam_drop_stat
       break;
 
     case OFDPA_MSG_MOD_DELETE:
-      ofdpa_rv = ofdpaDropStatusDelete(lmepId);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaDropStatusDelete, lmepId);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to delete table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2960,7 +3885,7 @@ indigo_error_t indigo_remark_action(ofdpa_mpls_tunnel_label_remark_action_mod_ms
   switch (mod_command)
   {
     case OFDPA_MSG_MOD_ADD:
-      ofdpa_rv = ofdpaRemarkActionAdd(&remarkActionEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaRemarkActionAdd, &remarkActionEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to add table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2972,7 +3897,7 @@ indigo_error_t indigo_remark_action(ofdpa_mpls_tunnel_label_remark_action_mod_ms
     break;
 
     case OFDPA_MSG_MOD_MODIFY:
-      ofdpa_rv = ofdpaRemarkActionDelete(&remarkActionEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaRemarkActionDelete, &remarkActionEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to delete table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2984,7 +3909,7 @@ indigo_error_t indigo_remark_action(ofdpa_mpls_tunnel_label_remark_action_mod_ms
       }
       break;
 
-      ofdpa_rv = ofdpaRemarkActionAdd(&remarkActionEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaRemarkActionAdd, &remarkActionEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to add table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2996,7 +3921,7 @@ indigo_error_t indigo_remark_action(ofdpa_mpls_tunnel_label_remark_action_mod_ms
       break;
 
     case OFDPA_MSG_MOD_DELETE:
-      ofdpa_rv = ofdpaRemarkActionDelete(&remarkActionEntry);
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaRemarkActionDelete, &remarkActionEntry);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Failed to delete table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -3027,7 +3952,7 @@ void indigo_set_mpls_qos_get_multipart(ofdpa_mpls_set_qos_action_multipart_reque
   ofdpa_mpls_set_qos_action_multipart_request_qos_index_get(request, &qosIndex);
   ofdpa_mpls_set_qos_action_multipart_request_mpls_tc_get(request, &mpls_tc);
 
-  ofdpa_rv = ofdpaMplsQosActionEntryGet(qosIndex, mpls_tc, &mplsQosEntry);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosActionEntryGet, qosIndex, mpls_tc, &mplsQosEntry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to read table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -3060,7 +3985,7 @@ void indigo_oam_dataplane_get_multipart(ofdpa_oam_dataplane_ctr_multipart_reques
   ofdpa_index.lmepId = lmepId;
   ofdpa_index.trafficClass = traffic_class;
 
-  ofdpa_rv = ofdpaOamDataCountersLMGet(ofdpa_index, &TxFCl, &RxFCl);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaOamDataCountersLMGet, ofdpa_index, &TxFCl, &RxFCl);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to read table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -3084,7 +4009,7 @@ void indigo_drop_status_get_multipart(ofdpa_oam_drop_status_multipart_request_t
 
   ofdpa_oam_drop_status_multipart_request_index_get(request, &lmepId);
 
-  ofdpa_rv = ofdpaDropStatusGet(lmepId, &dropEntry);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaDropStatusGet, lmepId, &dropEntry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to read table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -3120,7 +4045,7 @@ void indigo_remark_action_get_multipart(ofdpa_mpls_vpn_label_remark_action_multi
   ofdpa_mpls_vpn_label_remark_action_multipart_request_vlan_pcp_get(request, &vlanPcp);
   ofdpa_mpls_vpn_label_remark_action_multipart_request_vlan_dei_get(request, &vlanDei);
 
-  ofdpa_rv = ofdpaRemarkActionEntryGet(&remarkEntry);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaRemarkActionEntryGet, &remarkEntry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to read table entry. (ofdpa_rv = %d)", ofdpa_rv);
@@ -3138,6 +4063,169 @@ void indigo_remark_action_get_multipart(ofdpa_mpls_vpn_label_remark_action_multi
   }
 }
 
+/*
+ * The _next_multipart functions walk a table for a dump request. On entry
+ * 'reply' holds the key of the previous entry, which is replaced with the
+ * next entry. If 'first' is set the walk starts at the beginning of the
+ * table. INDIGO_ERROR_NOT_FOUND is returned after the last entry.
+ *
+ * NextGet returns the entries after a key, so the all-zero key, which is
+ * where a walk starts, is looked up on its own first.
+ */
+
+indigo_error_t indigo_set_mpls_qos_next_multipart(ofdpa_mpls_set_qos_action_multipart_reply_t *reply,
+                                                  int first)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaMplsQosEntry_t mplsQosEntry;
+  ofdpaMplsQosEntry_t nextEntry;
+
+  memset(&mplsQosEntry, 0, sizeof(mplsQosEntry));
+  if (!first)
+  {
+    ofdpa_mpls_set_qos_action_multipart_reply_qos_index_get(reply, &mplsQosEntry.qosIndex);
+    ofdpa_mpls_set_qos_action_multipart_reply_mpls_tc_get(reply, &mplsQosEntry.mpls_tc);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosEntryNextGet, &mplsQosEntry, &nextEntry);
+  }
+  else if (IND_OFDPA_RPC(ofdpaMplsQosActionEntryGet, 0, 0, &nextEntry) == OFDPA_E_NONE)
+  {
+    ofdpa_rv = OFDPA_E_NONE;
+  }
+  else
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaMplsQosEntryNextGet, &mplsQosEntry, &nextEntry);
+  }
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  ofdpa_mpls_set_qos_action_multipart_reply_qos_index_set(reply, nextEntry.qosIndex);
+  ofdpa_mpls_set_qos_action_multipart_reply_mpls_tc_set(reply, nextEntry.mpls_tc);
+  ofdpa_mpls_set_qos_action_multipart_reply_traffic_class_set(reply, nextEntry.trafficClass);
+  ofdpa_mpls_set_qos_action_multipart_reply_color_set(reply, nextEntry.color);
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t indigo_oam_dataplane_next_multipart(ofdpa_oam_dataplane_ctr_multipart_reply_t *reply,
+                                                   int first)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaOamDataCounterIndex_t ofdpa_index;
+  ofdpaOamDataCounterIndex_t nextIndex;
+  ofdpaOamDataCounterStatus_t status;
+  uint32_t TxFCl;
+  uint32_t RxFCl;
+  int found = 0;
+
+  memset(&ofdpa_index, 0, sizeof(ofdpa_index));
+  if (!first)
+  {
+    ofdpa_oam_dataplane_ctr_multipart_reply_lmep_id_get(reply, &ofdpa_index.lmepId);
+    ofdpa_oam_dataplane_ctr_multipart_reply_traffic_class_get(reply, &ofdpa_index.trafficClass);
+  }
+  else if ((IND_OFDPA_RPC(ofdpaOamDataCounterGet, ofdpa_index, &status) == OFDPA_E_NONE) &&
+           (IND_OFDPA_RPC(ofdpaOamDataCountersLMGet, ofdpa_index, &TxFCl, &RxFCl) == OFDPA_E_NONE))
+  {
+    found = 1;
+  }
+
+  /* Skip counters removed between the walk and the read */
+  while (!found)
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaOamDataCounterNextGet, ofdpa_index, &nextIndex, &status);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      return INDIGO_ERROR_NOT_FOUND;
+    }
+    ofdpa_index = nextIndex;
+    found = (IND_OFDPA_RPC(ofdpaOamDataCountersLMGet, ofdpa_index, &TxFCl, &RxFCl) == OFDPA_E_NONE);
+  }
+
+  ofdpa_oam_dataplane_ctr_multipart_reply_lmep_id_set(reply, ofdpa_index.lmepId);
+  ofdpa_oam_dataplane_ctr_multipart_reply_traffic_class_set(reply, ofdpa_index.trafficClass);
+  ofdpa_oam_dataplane_ctr_multipart_reply_reference_count_set(reply, status.refCount);
+  ofdpa_oam_dataplane_ctr_multipart_reply_receive_packets_set(reply, RxFCl);
+  ofdpa_oam_dataplane_ctr_multipart_reply_transmit_packets_set(reply, TxFCl);
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t indigo_drop_status_next_multipart(ofdpa_oam_drop_status_multipart_reply_t *reply,
+                                                 int first)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  uint32_t lmepId = 0;
+  ofdpaDropStatusEntry_t dropEntry;
+
+  if (!first)
+  {
+    ofdpa_oam_drop_status_multipart_reply_index_get(reply, &lmepId);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaDropStatusNextGet, lmepId, &dropEntry);
+  }
+  else if (IND_OFDPA_RPC(ofdpaDropStatusGet, lmepId, &dropEntry) == OFDPA_E_NONE)
+  {
+    ofdpa_rv = OFDPA_E_NONE;
+  }
+  else
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaDropStatusNextGet, lmepId, &dropEntry);
+  }
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  ofdpa_oam_drop_status_multipart_reply_index_set(reply, dropEntry.lmepId);
+  ofdpa_oam_drop_status_multipart_reply_entry_type_set(reply, dropEntry.type);
+  ofdpa_oam_drop_status_multipart_reply_drop_status_set(reply, dropEntry.dropAction);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Only entries of the action table type in the reply's subtype are returned */
+indigo_error_t indigo_remark_action_next_multipart(ofdpa_mpls_vpn_label_remark_action_multipart_reply_t *reply,
+                                                   int first)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaRemarkActionEntry_t remarkEntry;
+  ofdpaRemarkActionEntry_t nextEntry;
+  uint32_t actionTableType;
+  uint8_t color;
+
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_subtype_get(reply, &actionTableType);
+
+  memset(&remarkEntry, 0, sizeof(remarkEntry));
+  if (!first)
+  {
+    remarkEntry.actionTableType = actionTableType;
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_index_get(reply, &remarkEntry.index);
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_traffic_class_get(reply, &remarkEntry.trafficClass);
+    ofdpa_mpls_vpn_label_remark_action_multipart_reply_color_get(reply, &color);
+    remarkEntry.color = color;
+  }
+
+  do
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaRemarkEntryNextGet, &remarkEntry, &nextEntry);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      return INDIGO_ERROR_NOT_FOUND;
+    }
+    remarkEntry = nextEntry;
+  } while (nextEntry.actionTableType != actionTableType);
+
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_index_set(reply, nextEntry.index);
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_traffic_class_set(reply, nextEntry.trafficClass);
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_color_set(reply, nextEntry.color);
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_mpls_tc_set(reply, nextEntry.actions.remarkData);
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_vlan_pcp_set(reply, nextEntry.actions.vlanPcp);
+  ofdpa_mpls_vpn_label_remark_action_multipart_reply_vlan_dei_set(reply, nextEntry.actions.vlanDei);
+
+  return INDIGO_ERROR_NONE;
+}
+
 indigo_error_t indigo_fwd_expiration_enable_set(int is_enabled)
 {
   LOG_TRACE("indigo_fwd_expiration_enable_set() unsupported.");
@@ -3150,143 +4238,528 @@ indigo_error_t indigo_fwd_expiration_enable_get(int *is_enabled)
   return INDIGO_ERROR_NOT_SUPPORTED;
 }
 
-void ind_ofdpa_flow_event_receive(void)
+/* Whether flow timeouts are programmed into OF-DPA, which then ages the
+   flows and raises flow events. Otherwise the state manager ages them. */
+void ind_ofdpa_flow_expiry_offload_set(int offload)
 {
-  int flowTableId;
-  ofdpaFlowEvent_t flowEventData;
+  flowExpiryOffload = offload;
+}
 
-  LOG_TRACE("Reading Flow Events");
+/* Hand the expired flows collected so far to the state manager */
+void ind_ofdpa_flow_event_flush(void)
+{
+  if (flowExpiry.count == 0)
+  {
+    return;
+  }
+
+  indigo_core_flow_removed_batch(flowExpiry.count, flowExpiry.reasons, flowExpiry.stats);
+  flowExpiry.batches++;
+  flowExpiry.flows += flowExpiry.count;
+  flowExpiry.count = 0;
+}
+
+/* Expired flows are passed on in batches; callers flush before
+   returning to the event loop */
+void ind_ofdpa_flow_event_process(ofdpaFlowEvent_t *flowEventData)
+{
+  indigo_fi_flow_stats_t flowStats;
+  int statsCached;
+
+  if (IND_OFDPA_L2_LEARN_COOKIE_IS(flowEventData->flowMatch.cookie))
+  {
+    ind_ofdpa_l2_learn_expired(&flowEventData->flowMatch);
+    return;
+  }
+
+  /* Last cached counters of the flow, before the cache entry goes */
+  memset(&flowStats, 0, sizeof(flowStats));
+  statsCached = (ind_ofdpa_flow_stats_cache_get(flowEventData->flowMatch.cookie,
+                                                &flowStats) == INDIGO_ERROR_NONE);
+  ind_ofdpa_vlan_stats_flow_removed(flowEventData->flowMatch.cookie, &flowStats);
+  ind_ofdpa_punt_flow_removed(flowEventData->flowMatch.cookie);
+  ind_ofdpa_route_compress_expired(flowEventData->flowMatch.cookie);
+  ind_ofdpa_acl_compile_expired(flowEventData->flowMatch.cookie);
+
+  ind_ofdpa_flow_stats_cache_remove(flowEventData->flowMatch.cookie);
+  ind_ofdpa_flow_key_remove(flowEventData->flowMatch.cookie);
+  /* Only flows with a timeout expire */
+  ind_ofdpa_table_stats_flow_removed(flowEventData->flowMatch.tableId, 1);
+
+  /* OF-DPA has already removed the flow, so the state manager must not
+     delete it again */
+  if (!statsCached)
+  {
+    flowStats.packets = (uint64_t)-1;
+    flowStats.bytes = (uint64_t)-1;
+  }
+  flowStats.flow_id = flowEventData->flowMatch.cookie;
+  flowExpiry.stats[flowExpiry.count] = flowStats;
+  if (flowEventData->eventMask & OFDPA_FLOW_EVENT_HARD_TIMEOUT)
+  {
+    LOG_TRACE("Received flow event on hard timeout.");
+    flowExpiry.reasons[flowExpiry.count] = INDIGO_FLOW_REMOVED_HARD_TIMEOUT;
+  }
+  else
+  {
+    LOG_TRACE("Received flow event on idle timeout.");
+    flowExpiry.reasons[flowExpiry.count] = INDIGO_FLOW_REMOVED_IDLE_TIMEOUT;
+  }
+  if (++flowExpiry.count == IND_OFDPA_FLOW_EXPIRY_BATCH_MAX)
+  {
+    ind_ofdpa_flow_event_flush();
+  }
+}
+
+/* Read position of the flow event task */
+static int flowEventTaskActive;
+static int flowEventTableIndex;
+static ofdpaFlowEvent_t flowEventCursor;
+
+/* Drain the tables marked in ind_ofdpa_flow_event_receive. Expiry goes to
+   the state manager a slice at a time, so a mass expiry does not hold the
+   event loop. */
+static ind_soc_task_status_t ind_ofdpa_flow_event_task(void *cookie)
+{
+  int tableId;
+  int i;
 
-  for (flowTableId = 0; flowTableId < 255; flowTableId++)
+  while (flowEventTableIndex < tableStatsCache.numTables)
   {
-    if (ofdpaFlowTableSupported(flowTableId) == OFDPA_E_NONE)
+    tableId = tableStatsCache.tableIds[flowEventTableIndex];
+    if (!tableStatsCache.eventPending[tableId])
+    {
+      flowEventTableIndex++;
+      continue;
+    }
+
+    if (flowEventCursor.flowMatch.tableId != tableId)
     {
-      memset(&flowEventData, 0, sizeof(flowEventData));
-      flowEventData.flowMatch.tableId = flowTableId;
+      memset(&flowEventCursor, 0, sizeof(flowEventCursor));
+      flowEventCursor.flowMatch.tableId = tableId;
+    }
 
-      while (ofdpaFlowEventNextGet(&flowEventData) == OFDPA_E_NONE)
+    while (IND_OFDPA_RPC(ofdpaFlowEventNextGet, &flowEventCursor) == OFDPA_E_NONE)
+    {
+      ind_ofdpa_flow_event_process(&flowEventCursor);
+      if (ind_soc_should_yield())
       {
-        if (flowEventData.eventMask & OFDPA_FLOW_EVENT_HARD_TIMEOUT)
-        {
-          LOG_TRACE("Received flow event on hard timeout.");
-          ind_core_flow_expiry_handler(flowEventData.flowMatch.cookie,
-                                       INDIGO_FLOW_REMOVED_HARD_TIMEOUT);
-        }
-        else
-        {
-          LOG_TRACE("Received flow event on idle timeout.");
-          ind_core_flow_expiry_handler(flowEventData.flowMatch.cookie,
-                                       INDIGO_FLOW_REMOVED_IDLE_TIMEOUT);
-        }
+        ind_ofdpa_flow_event_flush();
+        return IND_SOC_TASK_CONTINUE;
       }
     }
+
+    tableStatsCache.eventPending[tableId] = 0;
+    memset(&flowEventCursor, 0, sizeof(flowEventCursor));
+    flowEventCursor.flowMatch.tableId = IND_OFDPA_FLOW_TABLE_COUNT;
+    flowEventTableIndex++;
   }
-  return;
+  ind_ofdpa_flow_event_flush();
+
+  /* Tables marked again behind the read position */
+  for (i = 0; i < tableStatsCache.numTables; i++)
+  {
+    if (tableStatsCache.eventPending[tableStatsCache.tableIds[i]])
+    {
+      flowEventTableIndex = i;
+      return IND_SOC_TASK_CONTINUE;
+    }
+  }
+
+  flowEventTaskActive = 0;
+  return IND_SOC_TASK_FINISHED;
+}
+
+/* Only flows with a timeout raise flow events */
+int ind_ofdpa_flow_event_possible(void)
+{
+  ind_ofdpa_table_stats_cache_init();
+
+  return (tableStatsCache.sweepAll || (tableStatsCache.timedTotal != 0));
+}
+
+/* Returns the number of tables scheduled to be read */
+int ind_ofdpa_flow_event_receive(void)
+{
+  int tableId;
+  int count = 0;
+  int i;
+
+  LOG_TRACE("Reading Flow Events");
+
+  if (!ind_ofdpa_flow_event_possible())
+  {
+    return 0;
+  }
+
+  for (i = 0; i < tableStatsCache.numTables; i++)
+  {
+    tableId = tableStatsCache.tableIds[i];
+    if (!ind_ofdpa_event_table_subscribed(tableId))
+    {
+      continue;
+    }
+    if (tableStatsCache.sweepAll ||
+        (tableStatsCache.timedCount[tableId] != 0))
+    {
+      tableStatsCache.eventPending[tableId] = 1;
+      count++;
+    }
+  }
+
+  if (flowEventTaskActive)
+  {
+    return count;
+  }
+
+  flowEventTableIndex = 0;
+  memset(&flowEventCursor, 0, sizeof(flowEventCursor));
+  flowEventCursor.flowMatch.tableId = IND_OFDPA_FLOW_TABLE_COUNT;
+  if (ind_soc_task_register(ind_ofdpa_flow_event_task, NULL,
+                            IND_SOC_PRIORITY_FLOW) == INDIGO_ERROR_NONE)
+  {
+    flowEventTaskActive = 1;
+    return count;
+  }
+
+  /* Without the task, read everything now */
+  LOG_ERROR("Failed to start flow event task");
+  while (ind_ofdpa_flow_event_task(NULL) == IND_SOC_TASK_CONTINUE)
+  {
+  }
+  return count;
 }
 
-static void ind_ofdpa_key_to_match(uint32_t portNum, of_match_t *match)
+static void ind_ofdpa_key_to_match(ofdpaPacket_t *rxPkt, of_match_t *match)
 {
+  const uint8_t *data = (const uint8_t *)rxPkt->pktData.pstart;
+
   memset(match, 0, sizeof(*match));
 
   /* We only populate the masks for this OF version */
   match->version = ofagent_of_version;
-  match->fields.in_port = portNum;
+  match->fields.in_port = rxPkt->inPortNum;
   OF_MATCH_MASK_IN_PORT_EXACT_SET(match);
+
+  /* The outer tag is read from the frame, so the controller does not
+     have to parse it to classify the packet */
+  if ((rxPkt->pktData.size >= 18) && (data[12] == 0x81) && (data[13] == 0x00))
+  {
+    match->fields.vlan_vid = OFDPA_VID_PRESENT | (((data[14] << 8) | data[15]) & OFDPA_VID_EXACT_MASK);
+    OF_MATCH_MASK_VLAN_VID_EXACT_SET(match);
+  }
+}
+
+/* Punted packets are received into a ring of slots. Each slot has a
+   receive buffer and a buffer the packet-in is encoded into, and the
+   packet-in is handed to the core from the slot, which copies it where it
+   is queued. Once the ring exists a punted packet costs no allocation.
+   With the packet thread enabled the ring is also the queue between the
+   thread and the event loop. */
+static ind_ofdpa_spsc_t rxRing;
+static ind_ofdpa_pkt_rx_slot_t rxSpareSlot;   /* receives while the ring is full */
+static char *rxRingPool;
+static uint32_t rxPktBufferSize;
+static uint32_t pktInBufferSize;
+
+static void
+ind_ofdpa_pkt_rx_slot_setup(ind_ofdpa_pkt_rx_slot_t *slot, char *buffers)
+{
+  slot->rxBuf = buffers;
+  slot->msgBuf = (uint8_t *)buffers + rxPktBufferSize;
 }
 
 static indigo_error_t
-ind_ofdpa_fwd_pkt_in(of_port_no_t in_port,
-                     uint8_t *data, unsigned int len, unsigned reason,
-                     of_match_t *match, OFDPA_FLOW_TABLE_ID_t tableId)
+ind_ofdpa_pkt_rx_ring_init(void)
 {
-  of_octets_t of_octets = { .data = data, .bytes = len };
-  of_packet_in_t *of_packet_in;
+  uint32_t maxPktSize, i;
+  size_t slotBytes;
+
+  /* Determine how large receive buffers must be */
+  if (IND_OFDPA_RPC(ofdpaMaxPktSizeGet, &maxPktSize) != OFDPA_E_NONE)
+  {
+    LOG_ERROR("\nFailed to determine maximum receive packet size.\r\n");
+    return INDIGO_ERROR_UNKNOWN;
+  }
 
-  LOG_TRACE("Sending packet-in");
+  if (ind_ofdpa_spsc_init(&rxRing, IND_OFDPA_PKT_RX_RING,
+                          sizeof(ind_ofdpa_pkt_rx_slot_t)) != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("\nFailed to allocate receive ring\r\n");
+    return INDIGO_ERROR_RESOURCE;
+  }
 
-  of_packet_in = of_packet_in_new(ofagent_of_version);
-  if (of_packet_in == NULL)
+  /* One more set of buffers for the spare slot */
+  slotBytes = (size_t)maxPktSize * 2 + IND_OFDPA_PKT_IN_HEADROOM;
+  rxRingPool = ind_ofdpa_pool_alloc(slotBytes * (rxRing.size + 1));
+  if (rxRingPool == NULL)
   {
+    LOG_ERROR("\nFailed to allocate receive packet buffers\r\n");
+    ind_ofdpa_spsc_free(&rxRing);
     return INDIGO_ERROR_RESOURCE;
   }
+  indigo_mem_account_alloc(INDIGO_MEM_TAG_PACKET, slotBytes * (rxRing.size + 1));
+
+  rxPktBufferSize = maxPktSize;
+  pktInBufferSize = maxPktSize + IND_OFDPA_PKT_IN_HEADROOM;
+  for (i = 0; i < rxRing.size; i++)
+  {
+    ind_ofdpa_pkt_rx_slot_setup((ind_ofdpa_pkt_rx_slot_t *)rxRing.slots + i,
+                                rxRingPool + (slotBytes * i));
+  }
+  ind_ofdpa_pkt_rx_slot_setup(&rxSpareSlot, rxRingPool + (slotBytes * rxRing.size));
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* OXM headers of the packet-in match fields: OpenFlow basic class, no
+   mask, and the value length */
+#define IND_OFDPA_OXM_IN_PORT   0x80000004
+#define IND_OFDPA_OXM_VLAN_VID  0x80000c02
+
+/* The packet-in match holds the in_port and, for a tagged frame, the
+   outer VLAN (see ind_ofdpa_key_to_match). For OF 1.3 it is written into
+   the message directly, encoded as of_packet_in_match_set would encode
+   it; that serializes through temporary loci objects and allocates
+   several of them per packet. */
+static int
+ind_ofdpa_pkt_in_match_set(of_packet_in_t *obj, of_match_t *match)
+{
+  of_wire_buffer_t *wbuf = OF_OBJECT_TO_WBUF(obj);
+  uint8_t tlv[24];
+  uint16_t curLen;
+  int offset, len, padded;
+
+  if (obj->version != OF_VERSION_1_3)
+  {
+    return of_packet_in_match_set(obj, match);
+  }
+
+  memset(tlv, 0, sizeof(tlv));
+  len = 4;
+  buf_u32_set(tlv + len, IND_OFDPA_OXM_IN_PORT);
+  buf_u32_set(tlv + len + 4, match->fields.in_port);
+  len += 8;
+  if (OF_MATCH_MASK_VLAN_VID_ACTIVE_TEST(match))
+  {
+    buf_u32_set(tlv + len, IND_OFDPA_OXM_VLAN_VID);
+    buf_u16_set(tlv + len + 4, match->fields.vlan_vid);
+    len += 6;
+  }
+  buf_u16_set(tlv, OF_MATCH_TYPE_OXM);
+  buf_u16_set(tlv + 2, len);
+  padded = (len + 7) & ~7;
+
+  /* Replace the match the message holds, padded to 8 bytes */
+  offset = OF_OBJECT_ABSOLUTE_OFFSET(obj, 24);
+  of_wire_buffer_u16_get(wbuf, offset + 2, &curLen);
+  of_wire_buffer_replace_data(wbuf, offset, (curLen + 7) & ~7, tlv, padded);
+  of_object_parent_length_update(obj, padded - ((curLen + 7) & ~7));
+
+  return OF_ERROR_NONE;
+}
+
+static indigo_error_t
+ind_ofdpa_fwd_pkt_in_build(of_port_no_t in_port,
+                           uint8_t *data, unsigned int len, unsigned reason,
+                           of_match_t *match, OFDPA_FLOW_TABLE_ID_t tableId,
+                           uint64_t cookie, uint16_t maxLen,
+                           ind_ofdpa_pkt_rx_slot_t *slot)
+{
+  of_octets_t of_octets = { .data = data, .bytes = len };
+  uint32_t bufferId = OF_BUFFER_ID_NO_BUFFER;
+  of_packet_in_t *obj;
+
+  LOG_TRACE("Building packet-in");
+
+  /* Only the part the controller asked for is sent if the whole packet
+     can be kept for a packet-out; otherwise all of it is sent */
+  if ((maxLen != OF_CONTROLLER_PKT_NO_BUFFER) && (len > maxLen))
+  {
+    bufferId = ind_ofdpa_pkt_buffer_store(in_port, data, len);
+    if (bufferId != OF_BUFFER_ID_NO_BUFFER)
+    {
+      of_octets.bytes = maxLen;
+    }
+  }
+
+  obj = indigo_of_message_new_preallocated(&slot->storage, OF_PACKET_IN,
+                                           ofagent_of_version,
+                                           slot->msgBuf, pktInBufferSize);
+  if (obj == NULL)
+  {
+    return INDIGO_ERROR_UNKNOWN;
+  }
 
-  of_packet_in_total_len_set(of_packet_in, len);
-  of_packet_in_reason_set(of_packet_in, reason);
-  of_packet_in_table_id_set(of_packet_in, tableId);
-  of_packet_in_cookie_set(of_packet_in, 0xffffffffffffffffLL);
+  indigo_of_packet_in_fixed_set(obj, bufferId, len, reason, tableId, cookie);
 
-  if (of_packet_in_match_set(of_packet_in, match) != OF_ERROR_NONE)
+  if (ind_ofdpa_pkt_in_match_set(obj, match) != OF_ERROR_NONE)
   {
     LOG_ERROR("Failed to write match to packet-in message");
-    of_packet_in_delete(of_packet_in);
     return INDIGO_ERROR_UNKNOWN;
   }
 
-  if (of_packet_in_data_set(of_packet_in, &of_octets) != OF_ERROR_NONE)
+  if (of_packet_in_data_set(obj, &of_octets) != OF_ERROR_NONE)
   {
     LOG_ERROR("Failed to write packet data to packet-in message");
-    of_packet_in_delete(of_packet_in);
     return INDIGO_ERROR_UNKNOWN;
   }
 
-  return indigo_core_packet_in(of_packet_in);
+  slot->packetIn = obj;
+
+  return INDIGO_ERROR_NONE;
 }
 
-void ind_ofdpa_pkt_receive(void)
+/* Encode the packet-in for the packet received into the slot. Returns
+   0 if the packet is not sent to the controller. */
+static int ind_ofdpa_pkt_in_build(ind_ofdpa_pkt_rx_slot_t *slot)
 {
+  ofdpaPacket_t *rxPkt = &slot->rxPkt;
   indigo_error_t rc;
-  uint32_t i;
-  uint32_t maxPktSize;
-  ofdpaPacket_t rxPkt;
   of_match_t match;
-  struct timeval timeout;
+  uint64_t cookie;
+  uint16_t maxLen;
 
-  /* Determine how large receive buffer must be */
-  if (ofdpaMaxPktSizeGet(&maxPktSize) != OFDPA_E_NONE)
+  LOG_TRACE("Client received packet. (reason = %d, tableId = %d, port = %u, size = %u)",
+            rxPkt->reason, rxPkt->tableId, rxPkt->inPortNum, rxPkt->pktData.size);
+
+  if (ind_ofdpa_pkt_capture_enabled())
   {
-    LOG_ERROR("\nFailed to determine maximum receive packet size.\r\n");
-    return;
+    ind_ofdpa_pkt_capture_record(rxPkt);
   }
 
-  memset(&rxPkt, 0, sizeof(ofdpaPacket_t));
-  rxPkt.pktData.pstart = (char*) malloc(maxPktSize);
-  if (rxPkt.pktData.pstart == NULL)
+  if (ind_ofdpa_l2_learn_consume(rxPkt))
   {
-    LOG_ERROR("\nFailed to allocate receive packet buffer\r\n");
-    return;
+    return 0;
   }
-  rxPkt.pktData.size = maxPktSize;
 
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
+  if (!ind_ofdpa_punt_dedup_admit(rxPkt))
+  {
+    return 0;
+  }
+
+  if (!ind_ofdpa_pktin_rl_admit(rxPkt))
+  {
+    return 0;
+  }
+
+  ind_ofdpa_key_to_match(rxPkt, &match);
+  cookie = ind_ofdpa_punt_cookie_get(rxPkt, &maxLen);
+
+  rc = ind_ofdpa_fwd_pkt_in_build(rxPkt->inPortNum,
+                                  (uint8_t *)rxPkt->pktData.pstart,
+                                  (rxPkt->pktData.size - 4), rxPkt->reason,
+                                  &match, rxPkt->tableId, cookie, maxLen,
+                                  slot);
+  if (rc != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Could not build Packet-in message, rc = 0x%x", rc);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* OF-DPA hands out one packet per ofdpaPktReceive. Up to
+   IND_OFDPA_PKT_RX_BATCH packets are received back to back into free ring
+   slots and their packet-ins encoded in place. Only the first receive
+   waits up to timeout. Packets received while the ring is full go
+   through the spare slot and are counted in drops if they would have
+   been sent. */
+int ind_ofdpa_pkt_rx_ring_fill(struct timeval *timeout, uint64_t *drops)
+{
+  ind_ofdpa_pkt_rx_slot_t *slot;
+  struct timeval noWait;
+  uint64_t rxTime = 0;
+  int count, queued = 0;
+
+  if ((rxRingPool == NULL) && (ind_ofdpa_pkt_rx_ring_init() != INDIGO_ERROR_NONE))
+  {
+    return 0;
+  }
 
-  while (ofdpaPktReceive(&timeout, &rxPkt) == OFDPA_E_NONE)
+  noWait.tv_sec = 0;
+  noWait.tv_usec = 0;
+
+  for (count = 0; count < IND_OFDPA_PKT_RX_BATCH; count++)
   {
-    LOG_TRACE("Client received packet");
-    LOG_TRACE("Reason:  %d", rxPkt.reason);
-    LOG_TRACE("Table ID:  %d", rxPkt.tableId);
-    LOG_TRACE("Ingress port:  %u", rxPkt.inPortNum);
-    LOG_TRACE("Size:  %u\r\n", rxPkt.pktData.size);
-    for (i = 0; i < rxPkt.pktData.size; i++)
+    slot = ind_ofdpa_spsc_reserve(&rxRing);
+    if (slot == NULL)
+    {
+      slot = &rxSpareSlot;
+    }
+
+    memset(&slot->rxPkt, 0, sizeof(slot->rxPkt));
+    slot->rxPkt.pktData.pstart = slot->rxBuf;
+    slot->rxPkt.pktData.size = rxPktBufferSize;
+
+    if (ofdpaPktReceive((count == 0) ? timeout : &noWait, &slot->rxPkt) != OFDPA_E_NONE)
+    {
+      break;
+    }
+    if (count == 0)
     {
-      if (i && ((i % 16) == 0))
-        LOG_TRACE("\r\n");
-      LOG_TRACE("%02x ", (unsigned int) *(rxPkt.pktData.pstart + i));
+      rxTime = os_time_monotonic();
     }
-    LOG_TRACE("\r\n");
 
-    ind_ofdpa_key_to_match(rxPkt.inPortNum, &match);
+    if (!ind_ofdpa_pkt_in_build(slot))
+    {
+      continue;
+    }
+
+    if (slot == &rxSpareSlot)
+    {
+      /* The loop is not keeping up; shed load like the rate limiter does */
+      (*drops)++;
+      continue;
+    }
+
+    slot->rxTime = rxTime;
+    ind_ofdpa_spsc_commit(&rxRing);
+    queued++;
+  }
+
+  return queued;
+}
+
+/* Oldest queued packet-in, or NULL. The slot stays valid until
+   ind_ofdpa_pkt_rx_ring_release. */
+ind_ofdpa_pkt_rx_slot_t *ind_ofdpa_pkt_rx_ring_peek(void)
+{
+  return ind_ofdpa_spsc_peek(&rxRing);
+}
+
+void ind_ofdpa_pkt_rx_ring_release(void)
+{
+  ind_ofdpa_spsc_release(&rxRing);
+}
+
+/* One batch per socket callback. The socket stays readable if more is
+   queued, so the next batch comes after other events have had a turn.
+   The packet-ins are copied to the connections and written out together
+   when the connection sockets are next serviced. */
+void ind_ofdpa_pkt_receive(void)
+{
+  ind_ofdpa_pkt_rx_slot_t *slot;
+  indigo_error_t rc;
+  struct timeval timeout;
+  uint64_t drops = 0;
 
-    rc = ind_ofdpa_fwd_pkt_in(rxPkt.inPortNum, rxPkt.pktData.pstart,
-                              (rxPkt.pktData.size - 4), rxPkt.reason,
-                              &match, rxPkt.tableId);
+  timeout.tv_sec = 0;
+  timeout.tv_usec = 0;
 
+  /* The ring is drained below, so it has room for a whole batch */
+  (void)ind_ofdpa_pkt_rx_ring_fill(&timeout, &drops);
+
+  while ((slot = ind_ofdpa_pkt_rx_ring_peek()) != NULL)
+  {
+    rc = indigo_core_packet_in_copy(slot->packetIn);
     if (rc != INDIGO_ERROR_NONE)
     {
       LOG_ERROR("Could not send Packet-in message, rc = 0x%x", rc);
     }
+    ind_ofdpa_pkt_rx_ring_release();
   }
-  free(rxPkt.pktData.pstart);
   return;
 }
 
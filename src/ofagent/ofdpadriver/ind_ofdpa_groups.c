@@ -30,9 +30,14 @@
 *
 **********************************************************************/
 
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include "indigo/forwarding.h"
 #include "ind_ofdpa_util.h"
 #include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
 
 static indigo_error_t
 ind_ofdpa_translate_group_actions(of_list_action_t *actions,
@@ -289,473 +294,1568 @@ ind_ofdpa_translate_group_actions(of_list_action_t *actions,
     return INDIGO_ERROR_NONE;
 }
 
+/* Translate one OpenFlow bucket into an OF-DPA bucket entry. The action
+   bitmaps accumulate over the buckets of a group. */
 static indigo_error_t
-ind_ofdpa_translate_group_buckets(uint32_t group_id,
-                                  of_list_bucket_t *of_buckets,
-                                  uint16_t command)
+ind_ofdpa_translate_group_bucket(uint32_t group_id,
+                                 uint16_t bucket_index,
+                                 of_bucket_t *of_bucket,
+                                 uint64_t *action_bitmap,
+                                 uint64_t *action_sf_bitmap,
+                                 ofdpaGroupBucketEntry_t *group_bucket_entry)
 {
   indigo_error_t err;
-  uint16_t bucket_index = 0;
   of_list_action_t of_actions;
-  of_bucket_t of_bucket;
   ind_ofdpa_group_bucket_t group_bucket;
-  int rv;
   uint32_t group_type, sub_group_type;
-  uint64_t group_action_bitmap = 0;
-  uint64_t group_action_sf_bitmap = 0;
-  ofdpaGroupEntry_t group_entry;
-  ofdpaGroupBucketEntry_t group_bucket_entry;
-  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_FAIL;
-  int group_added = 0;
+  uint64_t group_action_bitmap = *action_bitmap;
+  uint64_t group_action_sf_bitmap = *action_sf_bitmap;
   of_port_no_t watch_port;
 
-  OF_LIST_BUCKET_ITER(of_buckets, &of_bucket, rv)
-  {
-    of_bucket_watch_port_get(&of_bucket,&watch_port);
+  of_bucket_watch_port_get(of_bucket,&watch_port);
 
-    of_bucket_actions_bind(&of_bucket, &of_actions);
+  of_bucket_actions_bind(of_bucket, &of_actions);
 
-    memset(&group_bucket, 0, sizeof(group_bucket));
+  memset(&group_bucket, 0, sizeof(group_bucket));
 
-    err = ind_ofdpa_translate_group_actions(
-        &of_actions, &group_bucket, &group_action_bitmap, &group_action_sf_bitmap);
-    if (err < 0)
-    {
-      LOG_ERROR("Error in translating group actions");
-      if (group_added == 1)
-      {
-        /* Delete the added group */
-        (void)ofdpaGroupDelete(group_id);
-      }
-      return err;
-    }
+  err = ind_ofdpa_translate_group_actions(
+      &of_actions, &group_bucket, &group_action_bitmap, &group_action_sf_bitmap);
+  if (err < 0)
+  {
+    LOG_ERROR("Error in translating group actions");
+    return err;
+  }
 
-    ofdpaGroupTypeGet(group_id, &group_type);
+  ofdpaGroupTypeGet(group_id, &group_type);
 
-    memset(&group_bucket_entry, 0, sizeof(group_bucket_entry));
-    group_bucket_entry.groupId = group_id;
-    group_bucket_entry.bucketIndex = bucket_index;
+  memset(group_bucket_entry, 0, sizeof(*group_bucket_entry));
+  group_bucket_entry->groupId = group_id;
+  group_bucket_entry->bucketIndex = bucket_index;
 
-    err = INDIGO_ERROR_NONE;
+  err = INDIGO_ERROR_NONE;
 
-    switch (group_type)
-    {
-      case OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE:
-        group_bucket_entry.bucketData.l2Interface.outputPort = group_bucket.outputPort;
-        group_bucket_entry.bucketData.l2Interface.popVlanTag = group_bucket.popVlanTag;
-        group_bucket_entry.bucketData.l2Interface.allowVlanTranslation = group_bucket.allowVlanTranslation;
+  switch (group_type)
+  {
+    case OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE:
+      group_bucket_entry->bucketData.l2Interface.outputPort = group_bucket.outputPort;
+      group_bucket_entry->bucketData.l2Interface.popVlanTag = group_bucket.popVlanTag;
+      group_bucket_entry->bucketData.l2Interface.allowVlanTranslation = group_bucket.allowVlanTranslation;
 
-        break;
+      break;
 
-      case OFDPA_GROUP_ENTRY_TYPE_L2_UNFILTERED_INTERFACE:
-        group_bucket_entry.bucketData.l2UnfilteredInterface.outputPort = group_bucket.outputPort;
-        group_bucket_entry.bucketData.l2UnfilteredInterface.allowVlanTranslation = group_bucket.allowVlanTranslation;
+    case OFDPA_GROUP_ENTRY_TYPE_L2_UNFILTERED_INTERFACE:
+      group_bucket_entry->bucketData.l2UnfilteredInterface.outputPort = group_bucket.outputPort;
+      group_bucket_entry->bucketData.l2UnfilteredInterface.allowVlanTranslation = group_bucket.allowVlanTranslation;
+
+      break;
 
+    case OFDPA_GROUP_ENTRY_TYPE_L2_REWRITE:
+      if((group_action_bitmap | IND_OFDPA_L2REWRITE_BITMAP) != IND_OFDPA_L2REWRITE_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
+        break;
+      }
+      if((group_action_sf_bitmap | IND_OFDPA_L2REWRITE_SF_BITMAP) != IND_OFDPA_L2REWRITE_SF_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
         break;
+      }
 
-      case OFDPA_GROUP_ENTRY_TYPE_L2_REWRITE:
-        if((group_action_bitmap | IND_OFDPA_L2REWRITE_BITMAP) != IND_OFDPA_L2REWRITE_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
-        if((group_action_sf_bitmap | IND_OFDPA_L2REWRITE_SF_BITMAP) != IND_OFDPA_L2REWRITE_SF_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
+      group_bucket_entry->bucketData.l2Rewrite.vlanId = group_bucket.vlanId;
 
-        group_bucket_entry.bucketData.l2Rewrite.vlanId = group_bucket.vlanId;
+      memcpy(&group_bucket_entry->bucketData.l2Rewrite.srcMac,
+             &group_bucket.srcMac, sizeof(group_bucket_entry->bucketData.l2Rewrite.srcMac));
 
-        memcpy(&group_bucket_entry.bucketData.l2Rewrite.srcMac,
-               &group_bucket.srcMac, sizeof(group_bucket_entry.bucketData.l2Rewrite.srcMac));
+      memcpy(&group_bucket_entry->bucketData.l2Rewrite.dstMac,
+             &group_bucket.dstMac, sizeof(group_bucket_entry->bucketData.l2Rewrite.dstMac));
 
-        memcpy(&group_bucket_entry.bucketData.l2Rewrite.dstMac,
-               &group_bucket.dstMac, sizeof(group_bucket_entry.bucketData.l2Rewrite.dstMac));
+      group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
 
-        group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+      break;
 
+    case OFDPA_GROUP_ENTRY_TYPE_L3_UNICAST:
+      if((group_action_bitmap | IND_OFDPA_L3UNICAST_BITMAP) != IND_OFDPA_L3UNICAST_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
+        break;
+      }
+      if((group_action_sf_bitmap | IND_OFDPA_L3UNICAST_SF_BITMAP) != IND_OFDPA_L3UNICAST_SF_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
         break;
+      }
 
-      case OFDPA_GROUP_ENTRY_TYPE_L3_UNICAST:
-        if((group_action_bitmap | IND_OFDPA_L3UNICAST_BITMAP) != IND_OFDPA_L3UNICAST_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
-        if((group_action_sf_bitmap | IND_OFDPA_L3UNICAST_SF_BITMAP) != IND_OFDPA_L3UNICAST_SF_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
+      group_bucket_entry->bucketData.l3Unicast.vlanId = group_bucket.vlanId;
 
-        group_bucket_entry.bucketData.l3Unicast.vlanId = group_bucket.vlanId;
+      memcpy(&group_bucket_entry->bucketData.l3Unicast.srcMac,
+             &group_bucket.srcMac, sizeof(group_bucket_entry->bucketData.l3Unicast.srcMac));
 
-        memcpy(&group_bucket_entry.bucketData.l3Unicast.srcMac,
-               &group_bucket.srcMac, sizeof(group_bucket_entry.bucketData.l3Unicast.srcMac));
+      memcpy(&group_bucket_entry->bucketData.l3Unicast.dstMac,
+             &group_bucket.dstMac, sizeof(group_bucket_entry->bucketData.l3Unicast.dstMac));
 
-        memcpy(&group_bucket_entry.bucketData.l3Unicast.dstMac,
-               &group_bucket.dstMac, sizeof(group_bucket_entry.bucketData.l3Unicast.dstMac));
+      group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
 
-        group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+      break;
 
+    case OFDPA_GROUP_ENTRY_TYPE_L3_INTERFACE:
+      if((group_action_bitmap | IND_OFDPA_L3INTERFACE_BITMAP) != IND_OFDPA_L3INTERFACE_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
         break;
+      }
+      if((group_action_sf_bitmap | IND_OFDPA_L3INTERFACE_SF_BITMAP) != IND_OFDPA_L3INTERFACE_SF_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
+        break;
+      }
 
-      case OFDPA_GROUP_ENTRY_TYPE_L3_INTERFACE:
-        if((group_action_bitmap | IND_OFDPA_L3INTERFACE_BITMAP) != IND_OFDPA_L3INTERFACE_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
-        if((group_action_sf_bitmap | IND_OFDPA_L3INTERFACE_SF_BITMAP) != IND_OFDPA_L3INTERFACE_SF_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
-
-        group_bucket_entry.bucketData.l3Interface.vlanId = group_bucket.vlanId;
-
-        memcpy(&group_bucket_entry.bucketData.l3Interface.srcMac,
-               &group_bucket.srcMac, sizeof(group_bucket_entry.bucketData.l3Interface.srcMac));
+      group_bucket_entry->bucketData.l3Interface.vlanId = group_bucket.vlanId;
 
-        group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+      memcpy(&group_bucket_entry->bucketData.l3Interface.srcMac,
+             &group_bucket.srcMac, sizeof(group_bucket_entry->bucketData.l3Interface.srcMac));
 
-        break;
+      group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
 
-      case OFDPA_GROUP_ENTRY_TYPE_L2_MULTICAST:
-      case OFDPA_GROUP_ENTRY_TYPE_L2_FLOOD:
-      case OFDPA_GROUP_ENTRY_TYPE_L3_MULTICAST:
-      case OFDPA_GROUP_ENTRY_TYPE_L3_ECMP:
-        if((group_action_bitmap | IND_OFDPA_REFGROUP) != IND_OFDPA_REFGROUP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
+      break;
 
-        group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+    case OFDPA_GROUP_ENTRY_TYPE_L2_MULTICAST:
+    case OFDPA_GROUP_ENTRY_TYPE_L2_FLOOD:
+    case OFDPA_GROUP_ENTRY_TYPE_L3_MULTICAST:
+    case OFDPA_GROUP_ENTRY_TYPE_L3_ECMP:
+      if((group_action_bitmap | IND_OFDPA_REFGROUP) != IND_OFDPA_REFGROUP)
+      {
+        err = INDIGO_ERROR_COMPAT;
         break;
+      }
 
-      case OFDPA_GROUP_ENTRY_TYPE_L2_OVERLAY:
-        if((group_action_bitmap | IND_OFDPA_L2OVERLAY_BITMAP) != IND_OFDPA_L2OVERLAY_BITMAP)
-        {
-          err = INDIGO_ERROR_COMPAT;
-          break;
-        }
+      group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
+      break;
 
-        group_bucket_entry.bucketData.l2Overlay.outputPort = group_bucket.outputPort;
+    case OFDPA_GROUP_ENTRY_TYPE_L2_OVERLAY:
+      if((group_action_bitmap | IND_OFDPA_L2OVERLAY_BITMAP) != IND_OFDPA_L2OVERLAY_BITMAP)
+      {
+        err = INDIGO_ERROR_COMPAT;
         break;
+      }
 
-      case OFDPA_GROUP_ENTRY_TYPE_MPLS_LABEL:
-        ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
-        switch (sub_group_type)
-        {
-          case OFDPA_MPLS_INTERFACE:
-            if((group_action_bitmap | IND_OFDPA_MPLSINTERFACE_BITMAP) != IND_OFDPA_MPLSINTERFACE_BITMAP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
-
-            memcpy(&group_bucket_entry.bucketData.mplsInterface.srcMac,
-                   &group_bucket.srcMac, sizeof(group_bucket_entry.bucketData.mplsInterface.srcMac));
-            memcpy(&group_bucket_entry.bucketData.mplsInterface.dstMac,
-                   &group_bucket.dstMac, sizeof(group_bucket_entry.bucketData.mplsInterface.dstMac));
-            group_bucket_entry.bucketData.mplsInterface.vlanId = group_bucket.vlanId;
-
-            if (group_action_bitmap & IND_OFDPA_OAM_LM_TX_COUNT)
-            {
-              group_bucket_entry.bucketData.mplsInterface.oamLmTxCountAction = 1;
-              group_bucket_entry.bucketData.mplsInterface.lmepId = group_bucket.lmepId;
-            }
+      group_bucket_entry->bucketData.l2Overlay.outputPort = group_bucket.outputPort;
+      break;
 
-            group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+    case OFDPA_GROUP_ENTRY_TYPE_MPLS_LABEL:
+      ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
+      switch (sub_group_type)
+      {
+        case OFDPA_MPLS_INTERFACE:
+          if((group_action_bitmap | IND_OFDPA_MPLSINTERFACE_BITMAP) != IND_OFDPA_MPLSINTERFACE_BITMAP)
+          {
+            err = INDIGO_ERROR_COMPAT;
             break;
+          }
 
-          case OFDPA_MPLS_L2_VPN_LABEL:
-          case OFDPA_MPLS_L3_VPN_LABEL:
-          case OFDPA_MPLS_TUNNEL_LABEL1:
-          case OFDPA_MPLS_TUNNEL_LABEL2:
-          case OFDPA_MPLS_SWAP_LABEL:
-            if((group_action_bitmap | IND_OFDPA_MPLSLABEL_BITMAP) != IND_OFDPA_MPLSLABEL_BITMAP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
-            if((group_action_sf_bitmap | IND_OFDPA_MPLSLABEL_SF_BITMAP) != IND_OFDPA_MPLSLABEL_SF_BITMAP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
+          memcpy(&group_bucket_entry->bucketData.mplsInterface.srcMac,
+                 &group_bucket.srcMac, sizeof(group_bucket_entry->bucketData.mplsInterface.srcMac));
+          memcpy(&group_bucket_entry->bucketData.mplsInterface.dstMac,
+                 &group_bucket.dstMac, sizeof(group_bucket_entry->bucketData.mplsInterface.dstMac));
+          group_bucket_entry->bucketData.mplsInterface.vlanId = group_bucket.vlanId;
 
-            group_bucket_entry.bucketData.mplsLabel.pushL2Hdr = group_bucket.pushL2Hdr;
+          if (group_action_bitmap & IND_OFDPA_OAM_LM_TX_COUNT)
+          {
+            group_bucket_entry->bucketData.mplsInterface.oamLmTxCountAction = 1;
+            group_bucket_entry->bucketData.mplsInterface.lmepId = group_bucket.lmepId;
+          }
 
-            if (group_action_bitmap & IND_OFDPA_PUSH_VLAN)
-            {
-              group_bucket_entry.bucketData.mplsLabel.pushVlan = 1;
-              group_bucket_entry.bucketData.mplsLabel.newTpid = group_bucket.newTpid;
-            }
+          group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
+          break;
 
-            if (group_action_bitmap & IND_OFDPA_PUSH_MPLS)
-            {
-              group_bucket_entry.bucketData.mplsLabel.pushMplsHdr = 1;
-              group_bucket_entry.bucketData.mplsLabel.mplsEtherType = group_bucket.mplsEtherType;
-            }
+        case OFDPA_MPLS_L2_VPN_LABEL:
+        case OFDPA_MPLS_L3_VPN_LABEL:
+        case OFDPA_MPLS_TUNNEL_LABEL1:
+        case OFDPA_MPLS_TUNNEL_LABEL2:
+        case OFDPA_MPLS_SWAP_LABEL:
+          if((group_action_bitmap | IND_OFDPA_MPLSLABEL_BITMAP) != IND_OFDPA_MPLSLABEL_BITMAP)
+          {
+            err = INDIGO_ERROR_COMPAT;
+            break;
+          }
+          if((group_action_sf_bitmap | IND_OFDPA_MPLSLABEL_SF_BITMAP) != IND_OFDPA_MPLSLABEL_SF_BITMAP)
+          {
+            err = INDIGO_ERROR_COMPAT;
+            break;
+          }
+
+          group_bucket_entry->bucketData.mplsLabel.pushL2Hdr = group_bucket.pushL2Hdr;
+
+          if (group_action_bitmap & IND_OFDPA_PUSH_VLAN)
+          {
+            group_bucket_entry->bucketData.mplsLabel.pushVlan = 1;
+            group_bucket_entry->bucketData.mplsLabel.newTpid = group_bucket.newTpid;
+          }
+
+          if (group_action_bitmap & IND_OFDPA_PUSH_MPLS)
+          {
+            group_bucket_entry->bucketData.mplsLabel.pushMplsHdr = 1;
+            group_bucket_entry->bucketData.mplsLabel.mplsEtherType = group_bucket.mplsEtherType;
+          }
+
+          group_bucket_entry->bucketData.mplsLabel.pushCW = group_bucket.pushCW;
+
+          group_bucket_entry->bucketData.mplsLabel.mplsLabel = group_bucket.mplsLabel;
+
+          group_bucket_entry->bucketData.mplsLabel.mplsBOS = group_bucket.mplsBOS;
+
+          group_bucket_entry->bucketData.mplsLabel.mplsCopyEXPOutwards = group_bucket.mplsCopyEXPOutwards;
+          if (group_action_sf_bitmap & IND_OFDPA_MPLS_TC)
+          {
+            group_bucket_entry->bucketData.mplsLabel.mplsEXPAction = 1;
+            group_bucket_entry->bucketData.mplsLabel.mplsEXP = group_bucket.mplsEXP;
+          }
+          if (group_action_bitmap & IND_OFDPA_MPLS_TC_REMARK_TABLE_INDEX)
+          {
+            group_bucket_entry->bucketData.mplsLabel.remarkTableIndexAction = 1;
+            group_bucket_entry->bucketData.mplsLabel.remarkTableIndex = group_bucket.mplsEXPRemarkTableIndex;
+          }
+
+          group_bucket_entry->bucketData.mplsLabel.mplsCopyTTLOutwards = group_bucket.mplsCopyTTLOutwards;
+          if (group_action_bitmap & IND_OFDPA_SET_MPLS_TTL)
+          {
+            group_bucket_entry->bucketData.mplsLabel.mplsTTLAction = 1;
+            group_bucket_entry->bucketData.mplsLabel.mplsTTL = group_bucket.mplsTTL;
+          }
+          if (group_action_sf_bitmap & IND_OFDPA_MPLS_TTL)
+          {
+            group_bucket_entry->bucketData.mplsLabel.mplsTTLAction = 1;
+            group_bucket_entry->bucketData.mplsLabel.mplsTTL = group_bucket.mplsTTL;
+          }
+
+          if (group_action_bitmap & IND_OFDPA_PCP_REMARK_TABLE_INDEX)
+          {
+            group_bucket_entry->bucketData.mplsLabel.remarkTableIndexAction = 1;
+            group_bucket_entry->bucketData.mplsLabel.remarkTableIndex = group_bucket.priorityRemarkTableIndex;
+          }
+
+          if (group_action_bitmap & IND_OFDPA_OAM_LM_TX_COUNT)
+          {
+            group_bucket_entry->bucketData.mplsLabel.oamLmTxCountAction = 1;
+            group_bucket_entry->bucketData.mplsLabel.lmepId = group_bucket.lmepId;
+          }
+
+          group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
+          break;
 
-            group_bucket_entry.bucketData.mplsLabel.pushCW = group_bucket.pushCW;
+        default:
+          LOG_ERROR("unsupported MPLS_SUBTYPE %d for GROUP_TYPE %d", sub_group_type, group_type);
+          return INDIGO_ERROR_COMPAT;
+      }
+      break;
 
-            group_bucket_entry.bucketData.mplsLabel.mplsLabel = group_bucket.mplsLabel;
+    case OFDPA_GROUP_ENTRY_TYPE_MPLS_FORWARDING:
+      ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
+      switch (sub_group_type)
+      {
+        case OFDPA_MPLS_FAST_FAILOVER:
+          if((group_action_bitmap | IND_OFDPA_MPLSFF_BITMAP) != IND_OFDPA_MPLSFF_BITMAP)
+          {
+            err = INDIGO_ERROR_COMPAT;
+            break;
+          }
 
-            group_bucket_entry.bucketData.mplsLabel.mplsBOS = group_bucket.mplsBOS;
+          group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
+          group_bucket_entry->bucketData.mplsFastFailOver.watchPort = watch_port;
+          break;
 
-            group_bucket_entry.bucketData.mplsLabel.mplsCopyEXPOutwards = group_bucket.mplsCopyEXPOutwards;
-            if (group_action_sf_bitmap & IND_OFDPA_MPLS_TC)
-            {
-              group_bucket_entry.bucketData.mplsLabel.mplsEXPAction = 1;
-              group_bucket_entry.bucketData.mplsLabel.mplsEXP = group_bucket.mplsEXP;
-            }
-            if (group_action_bitmap & IND_OFDPA_MPLS_TC_REMARK_TABLE_INDEX)
-            {
-              group_bucket_entry.bucketData.mplsLabel.remarkTableIndexAction = 1;
-              group_bucket_entry.bucketData.mplsLabel.remarkTableIndex = group_bucket.mplsEXPRemarkTableIndex;
-            }
+        case OFDPA_MPLS_L2_TAG:
+          if((group_action_bitmap | IND_OFDPA_MPLSL2TAG_BITMAP) != IND_OFDPA_MPLSL2TAG_BITMAP)
+          {
+            err = INDIGO_ERROR_COMPAT;
+            break;
+          }
+          if((group_action_sf_bitmap | IND_OFDPA_MPLSL2TAG_SF_BITMAP) != IND_OFDPA_MPLSL2TAG_SF_BITMAP)
+          {
+            err = INDIGO_ERROR_COMPAT;
+            break;
+          }
 
-            group_bucket_entry.bucketData.mplsLabel.mplsCopyTTLOutwards = group_bucket.mplsCopyTTLOutwards;
-            if (group_action_bitmap & IND_OFDPA_SET_MPLS_TTL)
-            {
-              group_bucket_entry.bucketData.mplsLabel.mplsTTLAction = 1;
-              group_bucket_entry.bucketData.mplsLabel.mplsTTL = group_bucket.mplsTTL;
-            }
-            if (group_action_sf_bitmap & IND_OFDPA_MPLS_TTL)
-            {
-              group_bucket_entry.bucketData.mplsLabel.mplsTTLAction = 1;
-              group_bucket_entry.bucketData.mplsLabel.mplsTTL = group_bucket.mplsTTL;
-            }
+          if (group_action_bitmap & IND_OFDPA_POP_VLAN)
+          {
+            group_bucket_entry->bucketData.mplsL2Tag.popVlan = 1;
+          }
+          if (group_action_bitmap & IND_OFDPA_PUSH_VLAN)
+          {
+            group_bucket_entry->bucketData.mplsL2Tag.pushVlan = 1;
+            group_bucket_entry->bucketData.mplsL2Tag.newTpid = group_bucket.newTpid;
+          }
+          group_bucket_entry->bucketData.mplsL2Tag.vlanId = group_bucket.vlanId;
 
-            if (group_action_bitmap & IND_OFDPA_PCP_REMARK_TABLE_INDEX)
-            {
-              group_bucket_entry.bucketData.mplsLabel.remarkTableIndexAction = 1;
-              group_bucket_entry.bucketData.mplsLabel.remarkTableIndex = group_bucket.priorityRemarkTableIndex;
-            }
+          group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
 
-            if (group_action_bitmap & IND_OFDPA_OAM_LM_TX_COUNT)
-            {
-              group_bucket_entry.bucketData.mplsLabel.oamLmTxCountAction = 1;
-              group_bucket_entry.bucketData.mplsLabel.lmepId = group_bucket.lmepId;
-            }
+          break;
 
-            group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+        case OFDPA_MPLS_L2_FLOOD:
+        case OFDPA_MPLS_L2_MULTICAST:
+        case OFDPA_MPLS_L2_LOCAL_FLOOD:
+        case OFDPA_MPLS_L2_LOCAL_MULTICAST:
+        case OFDPA_MPLS_L2_FLOOD_SPLIT_HORIZON:
+        case OFDPA_MPLS_L2_MULTICAST_SPLIT_HORIZON:
+        case OFDPA_MPLS_1_1_HEAD_END_PROTECT:
+        case OFDPA_MPLS_ECMP:
+          if((group_action_bitmap | IND_OFDPA_REFGROUP) != IND_OFDPA_REFGROUP)
+          {
+            err = INDIGO_ERROR_COMPAT;
             break;
+          }
 
-          default:
-            LOG_ERROR("unsupported MPLS_SUBTYPE %d for GROUP_TYPE %d", sub_group_type, group_type);
-            return INDIGO_ERROR_COMPAT;
-        }
-        break;
+          group_bucket_entry->referenceGroupId = group_bucket.referenceGroupId;
 
-      case OFDPA_GROUP_ENTRY_TYPE_MPLS_FORWARDING:
-        ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
-        switch (sub_group_type)
-        {
-          case OFDPA_MPLS_FAST_FAILOVER:
-            if((group_action_bitmap | IND_OFDPA_MPLSFF_BITMAP) != IND_OFDPA_MPLSFF_BITMAP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
+          break;
 
-            group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
-            group_bucket_entry.bucketData.mplsFastFailOver.watchPort = watch_port;
-            break;
+        default:
+          LOG_ERROR("unsupported MPLS_SUBTYPE %d for GROUP_TYPE %d", sub_group_type, group_type);
+          return INDIGO_ERROR_COMPAT;
+      }
+      break;
 
-          case OFDPA_MPLS_L2_TAG:
-            if((group_action_bitmap | IND_OFDPA_MPLSL2TAG_BITMAP) != IND_OFDPA_MPLSL2TAG_BITMAP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
-            if((group_action_sf_bitmap | IND_OFDPA_MPLSL2TAG_SF_BITMAP) != IND_OFDPA_MPLSL2TAG_SF_BITMAP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
+    default:
+      err = INDIGO_ERROR_PARAM;
+      LOG_ERROR("Invalid GROUP_TYPE %d", group_type);
+      break;
+  }
 
-            if (group_action_bitmap & IND_OFDPA_POP_VLAN)
-            {
-              group_bucket_entry.bucketData.mplsL2Tag.popVlan = 1;
-            }
-            if (group_action_bitmap & IND_OFDPA_PUSH_VLAN)
-            {
-              group_bucket_entry.bucketData.mplsL2Tag.pushVlan = 1;
-              group_bucket_entry.bucketData.mplsL2Tag.newTpid = group_bucket.newTpid;
-            }
-            group_bucket_entry.bucketData.mplsL2Tag.vlanId = group_bucket.vlanId;
+  *action_bitmap = group_action_bitmap;
+  *action_sf_bitmap = group_action_sf_bitmap;
 
-            group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+  if (err == INDIGO_ERROR_COMPAT)
+  {
+    LOG_ERROR("Incompatible fields for Group Type");
+  }
 
-            break;
+  return err;
+}
 
-          case OFDPA_MPLS_L2_FLOOD:
-          case OFDPA_MPLS_L2_MULTICAST:
-          case OFDPA_MPLS_L2_LOCAL_FLOOD:
-          case OFDPA_MPLS_L2_LOCAL_MULTICAST:
-          case OFDPA_MPLS_L2_FLOOD_SPLIT_HORIZON:
-          case OFDPA_MPLS_L2_MULTICAST_SPLIT_HORIZON:
-          case OFDPA_MPLS_1_1_HEAD_END_PROTECT:
-          case OFDPA_MPLS_ECMP:
-            if((group_action_bitmap | IND_OFDPA_REFGROUP) != IND_OFDPA_REFGROUP)
-            {
-              err = INDIGO_ERROR_COMPAT;
-              break;
-            }
+/* Bucket entries last programmed for a group, kept so that a group modify
+   only touches the buckets that changed */
+typedef struct ind_ofdpa_group_buckets_s
+{
+  bighash_entry_t hash_entry;
+  uint32_t groupId;
+  int numBuckets;
+  ofdpaGroupBucketEntry_t *buckets;
+  int resilient;                /* buckets are a slot table, see below */
+} ind_ofdpa_group_buckets_t;
 
-            group_bucket_entry.referenceGroupId = group_bucket.referenceGroupId;
+#define TEMPLATE_NAME group_buckets_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_group_buckets_t
+#define TEMPLATE_KEY_FIELD groupId
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
 
-            break;
+#define IND_OFDPA_GROUP_BUCKETS_CACHE_BUCKETS 4096
 
-          default:
-            LOG_ERROR("unsupported MPLS_SUBTYPE %d for GROUP_TYPE %d", sub_group_type, group_type);
-            return INDIGO_ERROR_COMPAT;
-        }
-        break;
+static bighash_table_t *groupBucketsTable;
 
-      default:
-        err = INDIGO_ERROR_PARAM;
-        LOG_ERROR("Invalid GROUP_TYPE %d", group_type);
-        break;
-    }
+/* Slots per ECMP group in resilient mode, 0 when disabled */
+static uint32_t groupResilientSlots;
 
-    if (err != INDIGO_ERROR_NONE)
-    {
-      if (err == INDIGO_ERROR_COMPAT)
-      {
-        LOG_ERROR("Incompatible fields for Group Type");
-      }
-      if (group_added == 1)
-      {
-        /* Delete the added group */
-        (void)ofdpaGroupDelete(group_id);
-      }
-      return err;
-    }
+/* Bucket writes made by group modifies; a rebuild counts its delete-all
+   as one write */
+typedef struct
+{
+  uint64_t modifies;
+  uint64_t rebuilds;            /* modifies that rewrote every bucket */
+  uint64_t bucketsWritten;
+  uint64_t bucketsTotal;        /* buckets in the groups after each modify */
+  uint64_t maxWritten;
+} ind_ofdpa_group_modify_stats_t;
+
+static ind_ofdpa_group_modify_stats_t groupModifyStats;
+
+/* Writes made by the modify in progress */
+static uint32_t groupModifyWrites;
+
+/* Takes ownership of buckets */
+static void ind_ofdpa_group_buckets_save(uint32_t group_id,
+                                         ofdpaGroupBucketEntry_t *buckets,
+                                         int numBuckets, int resilient)
+{
+  ind_ofdpa_group_buckets_t *entry;
 
-    if (command == OF_GROUP_ADD)
-    {
-      if (bucket_index == 0)
-      {
-        /* First Bucket; Add Group first*/
-        group_entry.groupId = group_id;
-        ofdpa_rv = ofdpaGroupAdd(&group_entry);
-        if (ofdpa_rv != OFDPA_E_NONE)
-        {
-          LOG_ERROR("Error in adding Group, rv = %d",ofdpa_rv);
-          break;
-        }
-        group_added = 1;
-      }
-    }
-    else /* OF_GROUP_MODIFY */
+  if (groupBucketsTable == NULL)
+  {
+    groupBucketsTable = bighash_table_create(IND_OFDPA_GROUP_BUCKETS_CACHE_BUCKETS);
+    if (groupBucketsTable == NULL)
     {
-      if (bucket_index == 0)
-      {
-        /* First Bucket; Delete all buckets first */
-        ofdpa_rv = ofdpaGroupBucketsDeleteAll(group_id);
-        if (ofdpa_rv != OFDPA_E_NONE)
-        {
-          LOG_ERROR("Error in deleting Group buckets, rv = %d",ofdpa_rv);
-          break;
-        }
-      }
+      LOG_ERROR("Failed to create group bucket cache");
+      free(buckets);
+      return;
     }
+  }
 
-    ofdpa_rv = ofdpaGroupBucketEntryAdd(&group_bucket_entry);
-    if (ofdpa_rv != OFDPA_E_NONE)
+  entry = group_buckets_hashtable_first(groupBucketsTable, &group_id);
+  if (entry == NULL)
+  {
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
     {
-      LOG_ERROR("Error in adding Group bucket, rv = %d",ofdpa_rv);
-      if (group_added == 1)
-      {
-        /* Delete the added group */
-        (void)ofdpaGroupDelete(group_id);
-      }
-      else /* OF_GROUP_MODIFY */
-      {
-        /* Need to clean up and delete Group here as well.
-           Will be done by the caller as the Group also needs to
-           be deleted from the Indigo database. */
-      }
-      break;
+      /* The next modify of this group rebuilds all buckets */
+      free(buckets);
+      return;
     }
-
-    bucket_index++;
+    entry->groupId = group_id;
+    group_buckets_hashtable_insert(groupBucketsTable, entry);
   }
 
-  return indigoConvertOfdpaRv(ofdpa_rv);
+  ind_ofdpa_mpls_label_group_update(group_id, entry->buckets, entry->numBuckets, 0);
+  ind_ofdpa_mpls_label_group_update(group_id, buckets, numBuckets, 1);
+  free(entry->buckets);
+  entry->buckets = buckets;
+  entry->numBuckets = numBuckets;
+  entry->resilient = resilient;
 }
 
-indigo_error_t indigo_fwd_group_add(uint32_t id, uint8_t group_type, of_list_bucket_t *buckets)
+static int ind_ofdpa_group_resilient_slots(uint32_t group_id, int numMembers);
+
+/* Buckets of a group read by the startup load. Takes ownership of
+   buckets. An ECMP group holding exactly as many buckets as it would be
+   given slots is taken to be a slot table. */
+void ind_ofdpa_group_buckets_load(uint32_t group_id,
+                                  ofdpaGroupBucketEntry_t *buckets,
+                                  int numBuckets)
 {
-  indigo_error_t err;
+  int resilient;
 
-  if ((group_type != OF_GROUP_TYPE_INDIRECT) &&
-      (group_type != OF_GROUP_TYPE_SELECT) &&
-      (group_type != OF_GROUP_TYPE_FF) &&
-      (group_type != OF_GROUP_TYPE_ALL))
+  resilient = ((groupResilientSlots != 0) &&
+               (ind_ofdpa_group_resilient_slots(group_id, numBuckets) == numBuckets));
+  ind_ofdpa_group_buckets_save(group_id, buckets, numBuckets, resilient);
+}
+
+static void ind_ofdpa_group_buckets_forget(uint32_t group_id)
+{
+  ind_ofdpa_group_buckets_t *entry;
+
+  if (groupBucketsTable == NULL)
   {
-    return INDIGO_ERROR_NOT_SUPPORTED;
+    return;
   }
 
-  err = ind_ofdpa_translate_group_buckets(id, buckets, OF_GROUP_ADD);
+  entry = group_buckets_hashtable_first(groupBucketsTable, &group_id);
+  if (entry != NULL)
+  {
+    bighash_remove(groupBucketsTable, &entry->hash_entry);
+    ind_ofdpa_mpls_label_group_update(group_id, entry->buckets, entry->numBuckets, 0);
+    free(entry->buckets);
+    free(entry);
+  }
+}
 
-  return err;
+/* Same actions, ignoring the bucket index */
+static int ind_ofdpa_group_bucket_same(const ofdpaGroupBucketEntry_t *a,
+                                       const ofdpaGroupBucketEntry_t *b)
+{
+  return ((a->referenceGroupId == b->referenceGroupId) &&
+          (memcmp(&a->bucketData, &b->bucketData, sizeof(a->bucketData)) == 0));
 }
 
-indigo_error_t indigo_fwd_group_modify(uint32_t id, of_list_bucket_t *buckets)
+/* Groups whose buckets are a set rather than an ordered list; for these a
+   bucket keeps its index as long as its actions do not change */
+static int ind_ofdpa_group_buckets_unordered(uint32_t group_id)
 {
-  indigo_error_t err;
+  uint32_t group_type, sub_group_type;
 
-  err = ind_ofdpa_translate_group_buckets(id, buckets, OF_GROUP_MODIFY);
+  ofdpaGroupTypeGet(group_id, &group_type);
+  switch (group_type)
+  {
+    case OFDPA_GROUP_ENTRY_TYPE_L2_MULTICAST:
+    case OFDPA_GROUP_ENTRY_TYPE_L2_FLOOD:
+    case OFDPA_GROUP_ENTRY_TYPE_L3_MULTICAST:
+    case OFDPA_GROUP_ENTRY_TYPE_L3_ECMP:
+      return 1;
+
+    case OFDPA_GROUP_ENTRY_TYPE_MPLS_FORWARDING:
+      ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
+      switch (sub_group_type)
+      {
+        case OFDPA_MPLS_L2_FLOOD:
+        case OFDPA_MPLS_L2_MULTICAST:
+        case OFDPA_MPLS_L2_LOCAL_FLOOD:
+        case OFDPA_MPLS_L2_LOCAL_MULTICAST:
+        case OFDPA_MPLS_L2_FLOOD_SPLIT_HORIZON:
+        case OFDPA_MPLS_L2_MULTICAST_SPLIT_HORIZON:
+        case OFDPA_MPLS_ECMP:
+          return 1;
+        default:
+          return 0;
+      }
 
-  return err;
+    default:
+      return 0;
+  }
 }
 
-#ifdef OFDPA_FIXUP
-indigo_error_t indigo_fwd_group_delete(uint32_t id)
-#else
-void indigo_fwd_group_delete(uint32_t id)
-#endif
+static OFDPA_ERROR_t ind_ofdpa_group_buckets_add(uint32_t group_id,
+                                                 ofdpaGroupBucketEntry_t *buckets,
+                                                 int numBuckets)
 {
+  ofdpaGroupEntry_t group_entry;
   OFDPA_ERROR_t ofdpa_rv;
+  int i;
 
-  ofdpa_rv = ofdpaGroupDelete(id);
-
+  memset(&group_entry, 0, sizeof(group_entry));
+  group_entry.groupId = group_id;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupAdd, &group_entry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
-    LOG_ERROR("Group Delete failed, rv = %d",ofdpa_rv);
+    LOG_ERROR("Error in adding Group, rv = %d",ofdpa_rv);
+    return ofdpa_rv;
   }
 
-#ifdef OFDPA_FIXUP
-  return indigoConvertOfdpaRv(ofdpa_rv);
-#else
-  return;
-#endif
+  for (i = 0; i < numBuckets; i++)
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryAdd, &buckets[i]);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Error in adding Group bucket, rv = %d",ofdpa_rv);
+      /* Delete the added group */
+      (void)IND_OFDPA_RPC(ofdpaGroupDelete, group_id);
+      return ofdpa_rv;
+    }
+  }
+
+  return OFDPA_E_NONE;
 }
 
-void indigo_fwd_group_stats_get(uint32_t id, of_group_stats_entry_t *entry)
+/* Replace every bucket of a group */
+static OFDPA_ERROR_t ind_ofdpa_group_buckets_rebuild(uint32_t group_id,
+                                                     ofdpaGroupBucketEntry_t *buckets,
+                                                     int numBuckets)
 {
   OFDPA_ERROR_t ofdpa_rv;
-  ofdpaGroupEntryStats_t groupStats;
-
-  memset(&groupStats, 0, sizeof(groupStats));
-  ofdpa_rv = ofdpaGroupStatsGet(id, &groupStats);
+  int i;
 
+  groupModifyStats.rebuilds++;
+  groupModifyWrites++;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketsDeleteAll, group_id);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
-    LOG_ERROR("Failed to get Group stats, rv = %d",ofdpa_rv);
+    LOG_ERROR("Error in deleting Group buckets, rv = %d",ofdpa_rv);
+    return ofdpa_rv;
   }
-  else
+
+  for (i = 0; i < numBuckets; i++)
   {
-    of_group_stats_entry_ref_count_set(entry, groupStats.refCount);
-    of_group_stats_entry_duration_sec_set(entry, groupStats.duration);
+    buckets[i].bucketIndex = i;
+    groupModifyWrites++;
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryAdd, &buckets[i]);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Error in adding Group bucket, rv = %d",ofdpa_rv);
+      /* Need to clean up and delete Group here as well.
+         Will be done by the caller as the Group also needs to
+         be deleted from the Indigo database. */
+      return ofdpa_rv;
+    }
   }
 
-  return;
+  return OFDPA_E_NONE;
+}
+
+/* Ordered buckets: compare position by position */
+static OFDPA_ERROR_t ind_ofdpa_group_buckets_update_ordered(uint32_t group_id,
+                                                            ind_ofdpa_group_buckets_t *old,
+                                                            ofdpaGroupBucketEntry_t *buckets,
+                                                            int numBuckets)
+{
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  int i;
+
+  for (i = 0; (i < numBuckets) || (i < old->numBuckets); i++)
+  {
+    if (i >= numBuckets)
+    {
+      groupModifyWrites++;
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryDelete, group_id, i);
+    }
+    else if (i >= old->numBuckets)
+    {
+      groupModifyWrites++;
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryAdd, &buckets[i]);
+    }
+    else if (!ind_ofdpa_group_bucket_same(&buckets[i], &old->buckets[i]))
+    {
+      groupModifyWrites++;
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryModify, &buckets[i]);
+    }
+
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      break;
+    }
+  }
+
+  return ofdpa_rv;
+}
+
+/* Orders buckets by their actions, ignoring the bucket index */
+static int ind_ofdpa_group_bucket_cmp(const ofdpaGroupBucketEntry_t *a,
+                                      const ofdpaGroupBucketEntry_t *b)
+{
+  if (a->referenceGroupId != b->referenceGroupId)
+  {
+    return (a->referenceGroupId < b->referenceGroupId) ? -1 : 1;
+  }
+  return memcmp(&a->bucketData, &b->bucketData, sizeof(a->bucketData));
+}
+
+static int ind_ofdpa_group_bucket_ptr_cmp(const void *a, const void *b)
+{
+  return ind_ofdpa_group_bucket_cmp(*(ofdpaGroupBucketEntry_t * const *)a,
+                                    *(ofdpaGroupBucketEntry_t * const *)b);
+}
+
+/* Unordered buckets: unchanged members keep their index, new members are
+   added at free indexes before the removed members are deleted. The old
+   buckets are sorted by their actions so that each new bucket finds its
+   match by binary search; a join or leave in a group of hundreds of
+   members costs one bucket write. */
+static OFDPA_ERROR_t ind_ofdpa_group_buckets_update_unordered(uint32_t group_id,
+                                                              ind_ofdpa_group_buckets_t *old,
+                                                              ofdpaGroupBucketEntry_t *buckets,
+                                                              int numBuckets)
+{
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  ofdpaGroupBucketEntry_t **sorted;
+  uint8_t *oldKept, *indexUsed;
+  int *newMatched;
+  int maxIndex, nextFree;
+  int i, j, lo, hi, mid;
+
+  /* Bucket indexes never exceed the number of buckets in both lists */
+  maxIndex = old->numBuckets + numBuckets;
+  oldKept = calloc(old->numBuckets + 1, sizeof(*oldKept));
+  indexUsed = calloc(maxIndex + 1, sizeof(*indexUsed));
+  newMatched = calloc(numBuckets + 1, sizeof(*newMatched));
+  sorted = calloc(old->numBuckets + 1, sizeof(*sorted));
+  if ((oldKept == NULL) || (indexUsed == NULL) || (newMatched == NULL) || (sorted == NULL))
+  {
+    free(oldKept);
+    free(indexUsed);
+    free(newMatched);
+    free(sorted);
+    return OFDPA_E_FAIL;
+  }
+
+  for (i = 0; i < old->numBuckets; i++)
+  {
+    if (old->buckets[i].bucketIndex <= maxIndex)
+    {
+      indexUsed[old->buckets[i].bucketIndex] = 1;
+    }
+    sorted[i] = &old->buckets[i];
+  }
+  qsort(sorted, old->numBuckets, sizeof(*sorted), ind_ofdpa_group_bucket_ptr_cmp);
+
+  for (j = 0; j < numBuckets; j++)
+  {
+    /* First old bucket not ordered before the new one */
+    lo = 0;
+    hi = old->numBuckets;
+    while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (ind_ofdpa_group_bucket_cmp(sorted[mid], &buckets[j]) < 0)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+
+    /* Duplicates each take their own old bucket */
+    for (; (lo < old->numBuckets) &&
+           (ind_ofdpa_group_bucket_cmp(sorted[lo], &buckets[j]) == 0); lo++)
+    {
+      i = sorted[lo] - old->buckets;
+      if (!oldKept[i])
+      {
+        oldKept[i] = 1;
+        newMatched[j] = 1;
+        buckets[j].bucketIndex = old->buckets[i].bucketIndex;
+        break;
+      }
+    }
+  }
+
+  nextFree = 0;
+  for (j = 0; (j < numBuckets) && (ofdpa_rv == OFDPA_E_NONE); j++)
+  {
+    if (newMatched[j])
+    {
+      continue;
+    }
+    while (indexUsed[nextFree])
+    {
+      nextFree++;
+    }
+    indexUsed[nextFree] = 1;
+    buckets[j].bucketIndex = nextFree;
+    groupModifyWrites++;
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryAdd, &buckets[j]);
+  }
+
+  for (i = 0; (i < old->numBuckets) && (ofdpa_rv == OFDPA_E_NONE); i++)
+  {
+    if (!oldKept[i])
+    {
+      groupModifyWrites++;
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryDelete, group_id, old->buckets[i].bucketIndex);
+    }
+  }
+
+  free(oldKept);
+  free(indexUsed);
+  free(newMatched);
+  free(sorted);
+
+  return ofdpa_rv;
+}
+
+/* Program only the buckets that differ from the last add or modify; fall
+   back to replacing all buckets if the previous state is not known or an
+   incremental update fails */
+static OFDPA_ERROR_t ind_ofdpa_group_buckets_modify(uint32_t group_id,
+                                                    ofdpaGroupBucketEntry_t *buckets,
+                                                    int numBuckets)
+{
+  ind_ofdpa_group_buckets_t *old = NULL;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  if (groupBucketsTable != NULL)
+  {
+    old = group_buckets_hashtable_first(groupBucketsTable, &group_id);
+  }
+
+  if (old == NULL)
+  {
+    return ind_ofdpa_group_buckets_rebuild(group_id, buckets, numBuckets);
+  }
+
+  if (ind_ofdpa_group_buckets_unordered(group_id))
+  {
+    ofdpa_rv = ind_ofdpa_group_buckets_update_unordered(group_id, old, buckets, numBuckets);
+  }
+  else
+  {
+    ofdpa_rv = ind_ofdpa_group_buckets_update_ordered(group_id, old, buckets, numBuckets);
+  }
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Incremental bucket update of group 0x%x failed, rv = %d; rebuilding",
+              group_id, ofdpa_rv);
+    ofdpa_rv = ind_ofdpa_group_buckets_rebuild(group_id, buckets, numBuckets);
+  }
+
+  return ofdpa_rv;
+}
+
+/*
+ * Resilient ECMP
+ *
+ * Hardware picks an ECMP bucket by hashing modulo the bucket count, so
+ * adding or removing a member moves most flows. In resilient mode an ECMP
+ * group is programmed with a fixed number of buckets, the slots, each
+ * pointing at one member. A member that goes away only has its own slots
+ * handed to the others, and a new member only takes its share of slots
+ * from the members holding the most; every other slot is left alone and
+ * only the remapped slots are modified.
+ */
+
+indigo_error_t ind_ofdpa_group_resilient_init(uint32_t slots)
+{
+  groupResilientSlots = slots;
+  if (slots != 0)
+  {
+    LOG_INFO("ECMP groups use %u resilient slots", slots);
+  }
+  return INDIGO_ERROR_NONE;
+}
+
+/* Number of slots to program for the group, 0 to program its members */
+static int ind_ofdpa_group_resilient_slots(uint32_t group_id, int numMembers)
+{
+  ofdpaGroupTableInfo_t info;
+  uint32_t group_type, sub_group_type;
+  uint32_t slots = groupResilientSlots;
+
+  if (slots == 0)
+  {
+    return 0;
+  }
+
+  ofdpaGroupTypeGet(group_id, &group_type);
+  if (group_type == OFDPA_GROUP_ENTRY_TYPE_MPLS_FORWARDING)
+  {
+    ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
+    if (sub_group_type != OFDPA_MPLS_ECMP)
+    {
+      return 0;
+    }
+  }
+  else if (group_type != OFDPA_GROUP_ENTRY_TYPE_L3_ECMP)
+  {
+    return 0;
+  }
+
+  if ((IND_OFDPA_RPC(ofdpaGroupTableInfoGet, group_id, &info) == OFDPA_E_NONE) &&
+      (info.maxBucketEntries < slots))
+  {
+    slots = info.maxBucketEntries;
+  }
+
+  return (numMembers <= (int)slots) ? (int)slots : 0;
+}
+
+/* Remap the slots of old onto members, moving as few slots as possible.
+   slots must have numSlots entries; returns the number of slots changed. */
+static int ind_ofdpa_group_slots_remap(const ind_ofdpa_group_buckets_t *old,
+                                       const ofdpaGroupBucketEntry_t *members,
+                                       int numMembers,
+                                       ofdpaGroupBucketEntry_t *slots,
+                                       int numSlots, int *owner)
+{
+  int *count, *target;
+  int base, extra, changed = 0;
+  int m, i;
+
+  count = calloc(numMembers, sizeof(*count));
+  target = calloc(numMembers, sizeof(*target));
+  if ((count == NULL) || (target == NULL))
+  {
+    free(count);
+    free(target);
+    return -1;
+  }
+
+  /* Slots still pointing at a wanted member keep it for now */
+  for (i = 0; i < numSlots; i++)
+  {
+    owner[i] = -1;
+    for (m = 0; (old != NULL) && (i < old->numBuckets) && (m < numMembers); m++)
+    {
+      if (ind_ofdpa_group_bucket_same(&members[m], &old->buckets[i]))
+      {
+        owner[i] = m;
+        count[m]++;
+        break;
+      }
+    }
+  }
+
+  /* Even shares, the odd slots going to members that already hold more */
+  base = numSlots / numMembers;
+  extra = numSlots % numMembers;
+  for (m = 0; m < numMembers; m++)
+  {
+    target[m] = base;
+  }
+  for (m = 0; (m < numMembers) && (extra > 0); m++)
+  {
+    if (count[m] > base)
+    {
+      target[m]++;
+      extra--;
+    }
+  }
+  for (m = 0; (m < numMembers) && (extra > 0); m++)
+  {
+    if (target[m] == base)
+    {
+      target[m]++;
+      extra--;
+    }
+  }
+
+  /* Release the slots members hold beyond their share */
+  memset(count, 0, numMembers * sizeof(*count));
+  for (i = 0; i < numSlots; i++)
+  {
+    if (owner[i] >= 0)
+    {
+      if (count[owner[i]] < target[owner[i]])
+      {
+        count[owner[i]]++;
+      }
+      else
+      {
+        owner[i] = -1;
+      }
+    }
+  }
+
+  /* and hand the free slots to members short of theirs */
+  m = 0;
+  for (i = 0; i < numSlots; i++)
+  {
+    if (owner[i] < 0)
+    {
+      while (count[m] >= target[m])
+      {
+        m++;
+      }
+      owner[i] = m;
+      count[m]++;
+      changed++;
+    }
+    else if (!ind_ofdpa_group_bucket_same(&members[owner[i]], &old->buckets[i]))
+    {
+      changed++;
+    }
+    slots[i] = members[owner[i]];
+    slots[i].bucketIndex = i;
+  }
+
+  free(count);
+  free(target);
+
+  return changed;
+}
+
+/* Program the group as a table of numSlots slots. On success *slotsOut
+   holds the slots as programmed. */
+static OFDPA_ERROR_t ind_ofdpa_group_slots_program(uint32_t group_id,
+                                                   uint16_t command,
+                                                   const ofdpaGroupBucketEntry_t *members,
+                                                   int numMembers, int numSlots,
+                                                   ofdpaGroupBucketEntry_t **slotsOut)
+{
+  ind_ofdpa_group_buckets_t *old = NULL;
+  ofdpaGroupBucketEntry_t *slots;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  int *owner;
+  int changed, i;
+
+  if ((command == OF_GROUP_MODIFY) && (groupBucketsTable != NULL))
+  {
+    old = group_buckets_hashtable_first(groupBucketsTable, &group_id);
+    if ((old != NULL) && (!old->resilient || (old->numBuckets != numSlots)))
+    {
+      old = NULL;
+    }
+  }
+
+  slots = calloc(numSlots, sizeof(*slots));
+  owner = calloc(numSlots, sizeof(*owner));
+  if ((slots == NULL) || (owner == NULL))
+  {
+    free(slots);
+    free(owner);
+    return OFDPA_E_FAIL;
+  }
+
+  changed = ind_ofdpa_group_slots_remap(old, members, numMembers, slots, numSlots, owner);
+  if (changed < 0)
+  {
+    ofdpa_rv = OFDPA_E_FAIL;
+  }
+  else if (command == OF_GROUP_ADD)
+  {
+    ofdpa_rv = ind_ofdpa_group_buckets_add(group_id, slots, numSlots);
+  }
+  else if (old == NULL)
+  {
+    ofdpa_rv = ind_ofdpa_group_buckets_rebuild(group_id, slots, numSlots);
+  }
+  else
+  {
+    for (i = 0; (i < numSlots) && (ofdpa_rv == OFDPA_E_NONE); i++)
+    {
+      if (!ind_ofdpa_group_bucket_same(&slots[i], &old->buckets[i]))
+      {
+        groupModifyWrites++;
+        ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryModify, &slots[i]);
+      }
+    }
+    LOG_TRACE("Remapped %d of %d slots of group 0x%x", changed, numSlots, group_id);
+  }
+
+  free(owner);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    /* A failed add has already deleted the group. A modify may have
+       written part of the slots, release them all so the caller starts
+       again from a group without buckets. */
+    if ((command == OF_GROUP_MODIFY) && (changed >= 0) &&
+        (IND_OFDPA_RPC(ofdpaGroupBucketsDeleteAll, group_id) != OFDPA_E_NONE))
+    {
+      LOG_ERROR("Failed to release slots of group 0x%x", group_id);
+    }
+    free(slots);
+    return ofdpa_rv;
+  }
+
+  *slotsOut = slots;
+  return OFDPA_E_NONE;
+}
+
+static void ind_ofdpa_group_modify_account(uint32_t group_id, int numBuckets)
+{
+  groupModifyStats.modifies++;
+  groupModifyStats.bucketsWritten += groupModifyWrites;
+  groupModifyStats.bucketsTotal += numBuckets;
+  if (groupModifyWrites > groupModifyStats.maxWritten)
+  {
+    groupModifyStats.maxWritten = groupModifyWrites;
+  }
+  LOG_TRACE("Modify of group 0x%x wrote %u buckets for %d",
+            group_id, groupModifyWrites, numBuckets);
+}
+
+void ind_ofdpa_group_modify_show(void)
+{
+  ind_ofdpa_group_modify_stats_t *stats = &groupModifyStats;
+
+  if (stats->modifies == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("Group modifies: %"PRIu64" (%"PRIu64" rebuilt), %"PRIu64" bucket writes "
+           "for %"PRIu64" buckets, avg %"PRIu64" max %"PRIu64" writes per modify",
+           stats->modifies, stats->rebuilds, stats->bucketsWritten, stats->bucketsTotal,
+           stats->bucketsWritten / stats->modifies, stats->maxWritten);
+}
+
+static indigo_error_t
+ind_ofdpa_translate_group_buckets(uint32_t group_id,
+                                  of_list_bucket_t *of_buckets,
+                                  uint16_t command)
+{
+  indigo_error_t err;
+  uint16_t bucket_index = 0;
+  of_bucket_t of_bucket;
+  int rv;
+  uint64_t group_action_bitmap = 0;
+  uint64_t group_action_sf_bitmap = 0;
+  ofdpaGroupBucketEntry_t *buckets, *slots;
+  int numBuckets = 0;
+  int numSlots;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  OF_LIST_BUCKET_ITER(of_buckets, &of_bucket, rv)
+  {
+    numBuckets++;
+  }
+
+  if (numBuckets == 0)
+  {
+    LOG_ERROR("Group 0x%x has no buckets", group_id);
+    return indigoConvertOfdpaRv(OFDPA_E_FAIL);
+  }
+
+  buckets = calloc(numBuckets, sizeof(*buckets));
+  if (buckets == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  /* Translate every bucket before touching the hardware */
+  OF_LIST_BUCKET_ITER(of_buckets, &of_bucket, rv)
+  {
+    err = ind_ofdpa_translate_group_bucket(group_id, bucket_index, &of_bucket,
+                                           &group_action_bitmap, &group_action_sf_bitmap,
+                                           &buckets[bucket_index]);
+    if (err != INDIGO_ERROR_NONE)
+    {
+      free(buckets);
+      return err;
+    }
+    bucket_index++;
+  }
+
+  groupModifyWrites = 0;
+  numSlots = ind_ofdpa_group_resilient_slots(group_id, numBuckets);
+  if (numSlots != 0)
+  {
+    ofdpa_rv = ind_ofdpa_group_slots_program(group_id, command, buckets, numBuckets,
+                                             numSlots, &slots);
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      free(buckets);
+      ind_ofdpa_group_buckets_save(group_id, slots, numSlots, 1);
+      if (command == OF_GROUP_MODIFY)
+      {
+        ind_ofdpa_group_modify_account(group_id, numSlots);
+      }
+      return INDIGO_ERROR_NONE;
+    }
+
+    /* The slots were released; fall back to plain members */
+    LOG_TRACE("Slot table for group 0x%x failed, rv = %d; programming members",
+              group_id, ofdpa_rv);
+    ind_ofdpa_group_buckets_forget(group_id);
+  }
+
+  if (command == OF_GROUP_ADD)
+  {
+    ofdpa_rv = ind_ofdpa_group_buckets_add(group_id, buckets, numBuckets);
+  }
+  else /* OF_GROUP_MODIFY */
+  {
+    /* Also rebuilds after a failed slot table, as its state was forgotten */
+    ofdpa_rv = ind_ofdpa_group_buckets_modify(group_id, buckets, numBuckets);
+    ind_ofdpa_group_modify_account(group_id, numBuckets);
+  }
+
+  if (ofdpa_rv == OFDPA_E_NONE)
+  {
+    ind_ofdpa_group_buckets_save(group_id, buckets, numBuckets, 0);
+  }
+  else
+  {
+    free(buckets);
+    ind_ofdpa_group_buckets_forget(group_id);
+  }
+
+  return indigoConvertOfdpaRv(ofdpa_rv);
+}
+
+/* Group counts and limits per OF-DPA group type, read on first use and
+   kept up to date on add and delete, so that adds of a type that is full
+   are refused without an ofdpaGroupAdd call */
+typedef struct
+{
+  int known;
+  uint32_t count;
+  uint32_t max;                 /* 0 if not known */
+} ind_ofdpa_group_capacity_t;
+
+static ind_ofdpa_group_capacity_t groupCapacity[OFDPA_GROUP_ENTRY_TYPE_LAST];
+
+static ind_ofdpa_group_capacity_t *ind_ofdpa_group_capacity_get(uint32_t group_id)
+{
+  ind_ofdpa_group_capacity_t *capacity;
+  ofdpaGroupTableInfo_t info;
+  uint32_t group_type;
+
+  if ((ofdpaGroupTypeGet(group_id, &group_type) != OFDPA_E_NONE) ||
+      (group_type >= OFDPA_GROUP_ENTRY_TYPE_LAST))
+  {
+    return NULL;
+  }
+
+  capacity = &groupCapacity[group_type];
+  if (!capacity->known)
+  {
+    memset(&info, 0, sizeof(info));
+    if (IND_OFDPA_RPC(ofdpaGroupTableInfoGet, group_id, &info) == OFDPA_E_NONE)
+    {
+      capacity->count = info.numGroupEntries;
+      capacity->max = info.maxGroupEntries;
+    }
+    capacity->known = 1;
+  }
+
+  return capacity;
+}
+
+indigo_error_t indigo_fwd_group_space_check(uint32_t id)
+{
+  ind_ofdpa_group_capacity_t *capacity = ind_ofdpa_group_capacity_get(id);
+
+  if ((capacity != NULL) && (capacity->max != 0) && (capacity->count >= capacity->max))
+  {
+    return INDIGO_ERROR_TABLE_FULL;
+  }
+  return INDIGO_ERROR_NONE;
+}
+
+static uint32_t groupStatsIntervalMs;
+
+/* Latest complete snapshot, and the one being collected */
+static ind_ofdpa_snapshot_t groupStatsCurrent = IND_OFDPA_SNAPSHOT_INIT(indigo_fwd_group_stats_t);
+static ind_ofdpa_snapshot_t groupStatsNext = IND_OFDPA_SNAPSHOT_INIT(indigo_fwd_group_stats_t);
+
+/* Ids of groups added that the latest snapshot does not have yet */
+static ind_ofdpa_snapshot_t groupStatsPending = IND_OFDPA_SNAPSHOT_INIT(uint32_t);
+
+static ofdpaGroupEntry_t walkGroup;
+static int walkGroupFirst;
+
+/* Groups are walked in ascending order */
+static indigo_fwd_group_stats_t *group_stats_lookup(ind_ofdpa_snapshot_t *snapshot,
+                                                    uint32_t groupId)
+{
+  return ind_ofdpa_snapshot_lookup(snapshot, offsetof(indigo_fwd_group_stats_t, id), groupId);
+}
+
+/* Until the next walk picks the group up, its stats are read directly */
+static void group_stats_pending_add(uint32_t groupId)
+{
+  if (groupStatsIntervalMs == 0)
+  {
+    return;
+  }
+
+  if (ind_ofdpa_snapshot_insert(&groupStatsPending, 0, groupId) == NULL)
+  {
+    LOG_ERROR("Failed to track stats of new group 0x%x", groupId);
+  }
+}
+
+indigo_error_t indigo_fwd_group_add(uint32_t id, uint8_t group_type, of_list_bucket_t *buckets)
+{
+  ind_ofdpa_group_capacity_t *capacity;
+  indigo_error_t err;
+
+  if ((group_type != OF_GROUP_TYPE_INDIRECT) &&
+      (group_type != OF_GROUP_TYPE_SELECT) &&
+      (group_type != OF_GROUP_TYPE_FF) &&
+      (group_type != OF_GROUP_TYPE_ALL))
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  /* Read before the add, so the count from OF-DPA does not include it */
+  capacity = ind_ofdpa_group_capacity_get(id);
+
+  err = ind_ofdpa_translate_group_buckets(id, buckets, OF_GROUP_ADD);
+  if ((err == INDIGO_ERROR_NONE) && (capacity != NULL))
+  {
+    capacity->count++;
+  }
+  if (err == INDIGO_ERROR_NONE)
+  {
+    group_stats_pending_add(id);
+  }
+
+  return err;
+}
+
+indigo_error_t indigo_fwd_group_modify(uint32_t id, of_list_bucket_t *buckets)
+{
+  indigo_error_t err;
+
+  err = ind_ofdpa_translate_group_buckets(id, buckets, OF_GROUP_MODIFY);
+
+  return err;
+}
+
+/* A group that survived the restart with as many buckets as it was saved
+   with is kept as is; the bucket state of the driver is rebuilt by its
+   next modify, as after a failed slot table. A group whose bucket count
+   differs was changed under the agent and is programmed again. It is
+   already counted in its type. */
+indigo_error_t indigo_fwd_group_restore(uint32_t id, uint8_t group_type, of_list_bucket_t *buckets)
+{
+  ofdpaGroupEntryStats_t groupStats;
+  OFDPA_ERROR_t ofdpa_rv;
+  of_bucket_t of_bucket;
+  uint32_t numBuckets = 0;
+  int numSlots;
+  int rv;
+
+  memset(&groupStats, 0, sizeof(groupStats));
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupStatsGet, id, &groupStats);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Group 0x%x not restored. (ofdpa_rv = %d)", id, ofdpa_rv);
+    return indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  OF_LIST_BUCKET_ITER(buckets, &of_bucket, rv)
+  {
+    numBuckets++;
+  }
+
+  numSlots = ind_ofdpa_group_resilient_slots(id, numBuckets);
+  if (groupStats.bucketCount != (numSlots ? (uint32_t)numSlots : numBuckets))
+  {
+    LOG_VERBOSE("Group 0x%x has %u buckets, saved with %u; reprogramming",
+                id, groupStats.bucketCount, numBuckets);
+    rv = ind_ofdpa_translate_group_buckets(id, buckets, OF_GROUP_MODIFY);
+    if (rv != INDIGO_ERROR_NONE)
+    {
+      return rv;
+    }
+  }
+
+  group_stats_pending_add(id);
+
+  return INDIGO_ERROR_NONE;
+}
+
+#ifdef OFDPA_FIXUP
+indigo_error_t indigo_fwd_group_delete(uint32_t id)
+#else
+void indigo_fwd_group_delete(uint32_t id)
+#endif
+{
+  ind_ofdpa_group_capacity_t *capacity;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupDelete, id);
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Group Delete failed, rv = %d",ofdpa_rv);
+  }
+  else
+  {
+    ind_ofdpa_group_buckets_forget(id);
+    ind_ofdpa_snapshot_remove(&groupStatsPending, 0, id);
+    capacity = ind_ofdpa_group_capacity_get(id);
+    if ((capacity != NULL) && (capacity->count > 0))
+    {
+      capacity->count--;
+    }
+  }
+
+#ifdef OFDPA_FIXUP
+  return indigoConvertOfdpaRv(ofdpa_rv);
+#else
+  return;
+#endif
+}
+
+static void group_stats_walk_start(void)
+{
+  groupStatsNext.count = 0;
+  memset(&walkGroup, 0, sizeof(walkGroup));
+  walkGroupFirst = 1;
+}
+
+static ind_ofdpa_collect_status_t group_stats_walk_step(void)
+{
+  ofdpaGroupEntryStats_t groupStats;
+  indigo_fwd_group_stats_t *entry;
+
+  /* The walk starts after group 0, which may exist itself */
+  if (walkGroupFirst)
+  {
+    walkGroupFirst = 0;
+  }
+  else if (IND_OFDPA_RPC(ofdpaGroupNextGet, walkGroup.groupId, &walkGroup) != OFDPA_E_NONE)
+  {
+    return IND_OFDPA_COLLECT_FINISHED;
+  }
+
+  memset(&groupStats, 0, sizeof(groupStats));
+  if (IND_OFDPA_RPC(ofdpaGroupStatsGet, walkGroup.groupId, &groupStats) != OFDPA_E_NONE)
+  {
+    /* Deleted under the walk */
+    return IND_OFDPA_COLLECT_CONTINUE;
+  }
+
+  entry = ind_ofdpa_snapshot_append(&groupStatsNext);
+  if (entry == NULL)
+  {
+    LOG_ERROR("Failed to grow group stats snapshot");
+    groupStatsNext.count = 0;
+    return IND_OFDPA_COLLECT_ABORTED;
+  }
+
+  entry->id = walkGroup.groupId;
+  entry->ref_count = groupStats.refCount;
+  entry->duration_sec = groupStats.duration;
+
+  return IND_OFDPA_COLLECT_CONTINUE;
+}
+
+static void group_stats_walk_finish(void)
+{
+  uint32_t *groupId;
+  uint32_t i = 0;
+
+  ind_ofdpa_snapshot_swap(&groupStatsCurrent, &groupStatsNext);
+
+  /* A group added during the walk may have been missed by it */
+  while (i < groupStatsPending.count)
+  {
+    groupId = ind_ofdpa_snapshot_entry(&groupStatsPending, i);
+    if (group_stats_lookup(&groupStatsCurrent, *groupId) != NULL)
+    {
+      ind_ofdpa_snapshot_remove(&groupStatsPending, 0, *groupId);
+    }
+    else
+    {
+      i++;
+    }
+  }
+}
+
+static ind_ofdpa_collector_t groupStatsCollector =
+{
+  .name = "group stats collector",
+  .cls = IND_OFDPA_COLLECT_CLASS_GROUP,
+  .start = group_stats_walk_start,
+  .step = group_stats_walk_step,
+  .finish = group_stats_walk_finish,
+};
+
+indigo_error_t ind_ofdpa_group_stats_cache_init(uint32_t interval_ms)
+{
+  groupStatsIntervalMs = interval_ms;
+  if (groupStatsIntervalMs == 0)
+  {
+    LOG_VERBOSE("Group stats collector disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  groupStatsCollector.intervalMs = groupStatsIntervalMs;
+  if (ind_ofdpa_collector_register(&groupStatsCollector) != INDIGO_ERROR_NONE)
+  {
+    groupStatsIntervalMs = 0;
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  /* Have a snapshot ready for the first request */
+  ind_ofdpa_collector_refresh(&groupStatsCollector);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* True once a complete snapshot is available */
+int ind_ofdpa_group_stats_cache_enabled(void)
+{
+  return (groupStatsIntervalMs != 0) &&
+    (ind_ofdpa_stats_generation_get(IND_OFDPA_COLLECT_CLASS_GROUP) != 0);
+}
+
+void ind_ofdpa_group_stats_cache_foreach(void (*fn)(const indigo_fwd_group_stats_t *stats,
+                                                    void *arg),
+                                         void *arg)
+{
+  uint32_t i;
+
+  for (i = 0; i < groupStatsCurrent.count; i++)
+  {
+    fn(ind_ofdpa_snapshot_entry(&groupStatsCurrent, i), arg);
+  }
+}
+
+void indigo_fwd_group_stats_get(uint32_t id, of_group_stats_entry_t *entry)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaGroupEntryStats_t groupStats;
+  indigo_fwd_group_stats_t *cached;
+
+  /* Groups added since the last walk are read directly */
+  if (ind_ofdpa_group_stats_cache_enabled() &&
+      ((cached = group_stats_lookup(&groupStatsCurrent, id)) != NULL))
+  {
+    of_group_stats_entry_ref_count_set(entry, cached->ref_count);
+    of_group_stats_entry_duration_sec_set(entry, cached->duration_sec);
+    return;
+  }
+
+  memset(&groupStats, 0, sizeof(groupStats));
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupStatsGet, id, &groupStats);
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to get Group stats, rv = %d",ofdpa_rv);
+  }
+  else
+  {
+    of_group_stats_entry_ref_count_set(entry, groupStats.refCount);
+    of_group_stats_entry_duration_sec_set(entry, groupStats.duration);
+  }
+
+  return;
+}
+
+/* Merges the latest snapshot with direct reads of the groups added since,
+   keeping the result in ascending id order */
+static indigo_error_t group_stats_cache_bulk_get(indigo_fwd_group_stats_t *stats,
+                                                 uint32_t max, uint32_t *count)
+{
+  ofdpaGroupEntryStats_t groupStats;
+  indigo_fwd_group_stats_t *cached;
+  uint32_t *pendingId;
+  uint32_t numGroups = 0;
+  uint32_t i = 0, j = 0;
+
+  while ((numGroups < max) &&
+         ((i < groupStatsCurrent.count) || (j < groupStatsPending.count)))
+  {
+    cached = (i < groupStatsCurrent.count) ?
+      ind_ofdpa_snapshot_entry(&groupStatsCurrent, i) : NULL;
+    pendingId = (j < groupStatsPending.count) ?
+      ind_ofdpa_snapshot_entry(&groupStatsPending, j) : NULL;
+
+    if ((pendingId == NULL) || ((cached != NULL) && (cached->id < *pendingId)))
+    {
+      stats[numGroups++] = *cached;
+      i++;
+      continue;
+    }
+    if ((cached != NULL) && (cached->id == *pendingId))
+    {
+      /* Re-added after the walk, the snapshot counters are stale */
+      i++;
+    }
+    j++;
+
+    memset(&groupStats, 0, sizeof(groupStats));
+    if (IND_OFDPA_RPC(ofdpaGroupStatsGet, *pendingId, &groupStats) != OFDPA_E_NONE)
+    {
+      continue;
+    }
+    stats[numGroups].id = *pendingId;
+    stats[numGroups].ref_count = groupStats.refCount;
+    stats[numGroups].duration_sec = groupStats.duration;
+    numGroups++;
+  }
+
+  *count = numGroups;
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* The client API has no multi-group stats call, but walking the groups here
+   saves the per-group lookups and LOCI updates of the per-group path */
+indigo_error_t indigo_fwd_group_stats_bulk_get(indigo_fwd_group_stats_t *stats,
+                                               uint32_t max, uint32_t *count)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaGroupEntry_t groupEntry;
+  ofdpaGroupEntryStats_t groupStats;
+  uint32_t numGroups = 0;
+
+  if (ind_ofdpa_group_stats_cache_enabled())
+  {
+    return group_stats_cache_bulk_get(stats, max, count);
+  }
+
+  memset(&groupEntry, 0, sizeof(groupEntry));
+
+  /* The walk starts after group 0, which may exist itself */
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupStatsGet, groupEntry.groupId, &groupStats);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupNextGet, groupEntry.groupId, &groupEntry);
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupStatsGet, groupEntry.groupId, &groupStats);
+    }
+  }
+
+  while ((ofdpa_rv == OFDPA_E_NONE) && (numGroups < max))
+  {
+    stats[numGroups].id = groupEntry.groupId;
+    stats[numGroups].ref_count = groupStats.refCount;
+    stats[numGroups].duration_sec = groupStats.duration;
+    numGroups++;
+
+    /* A group deleted under the walk is skipped */
+    do
+    {
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupNextGet, groupEntry.groupId, &groupEntry);
+    } while ((ofdpa_rv == OFDPA_E_NONE) &&
+             (IND_OFDPA_RPC(ofdpaGroupStatsGet, groupEntry.groupId, &groupStats) != OFDPA_E_NONE));
+  }
+
+  *count = numGroups;
+
+  return INDIGO_ERROR_NONE;
 }
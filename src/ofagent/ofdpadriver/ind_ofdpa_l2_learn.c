@@ -0,0 +1,443 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_l2_learn.c
+*
+* @purpose    Agent-local source MAC learning for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   With controller managed learning enabled, OF-DPA punts
+*             packets with an unknown or moved source MAC from the source
+*             MAC lookup table. Instead of becoming packet-ins, these are
+*             queued on whichever thread receives packets and drained by
+*             a timer on the SocketManager loop. Each batch is deduplicated
+*             against a table of learned (VLAN, MAC) addresses, and
+*             bridging table entries pointing at the L2 interface group of
+*             the ingress port are installed for the new and moved ones.
+*             The entries age out through their idle timeout. The
+*             controller gets one summary message per batch, see
+*             ind_ofdpa_l2_learn.h.
+*
+*             Learned entries carry cookies with IND_OFDPA_L2_LEARN_COOKIE
+*             set, which OFStateManager never allocates, and are not known
+*             to OFStateManager.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "indigo/of_message.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_spsc.h"
+#include "ind_ofdpa_l2_learn.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+#include <SocketManager/socketmanager.h>
+#include <OS/os_time.h>
+
+#define IND_OFDPA_L2_LEARN_QUEUE_SIZE   4096
+#define IND_OFDPA_L2_LEARN_BUCKETS      1024
+#define IND_OFDPA_L2_LEARN_MAX_ENTRIES  32768
+
+/* Learn packets handled per timer run; the rest wait for the next run */
+#define IND_OFDPA_L2_LEARN_BATCH_MAX    1024
+
+extern int ofagent_of_version;
+
+typedef struct
+{
+  uint16_t vlanId;
+  uint8_t mac[OFDPA_MAC_ADDR_LEN];
+} ind_ofdpa_l2_learn_key_t;
+
+/* A learn packet handed from the receiving thread to the loop */
+typedef struct
+{
+  ind_ofdpa_l2_learn_key_t key;
+  uint32_t port;
+} ind_ofdpa_l2_learn_record_t;
+
+/* A learned address with a bridging entry installed */
+typedef struct ind_ofdpa_l2_learn_entry_s
+{
+  bighash_entry_t hash_entry;
+  ind_ofdpa_l2_learn_key_t key;
+  uint32_t port;
+  uint64_t cookie;
+} ind_ofdpa_l2_learn_entry_t;
+
+#define TEMPLATE_NAME l2_learn_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_l2_learn_entry_t
+#define TEMPLATE_KEY_FIELD key
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+static int learnEnabled;
+static uint32_t learnIntervalMs;
+static uint32_t learnAgeSec;
+static bighash_table_t *learnTable;
+static ind_ofdpa_spsc_t learnQueue;
+static uint64_t learnCookieNext;
+
+/* Written by the receiving thread only */
+static uint64_t learnPktsQueued;
+static uint64_t learnQueueDrops;
+static uint64_t learnPktsUntagged;
+
+/* Summary of the current batch */
+static uint8_t learnNotifyData[IND_OFDPA_L2_LEARN_NOTIFY_HDR_LEN +
+                               IND_OFDPA_L2_LEARN_NOTIFY_RECORDS * IND_OFDPA_L2_LEARN_NOTIFY_RECORD_LEN];
+static uint32_t batchLearned;
+static uint32_t batchMoved;
+static uint32_t batchAged;
+static uint32_t batchRecords;
+static uint16_t batchFlags;
+
+static uint64_t totalLearned;
+static uint64_t totalMoved;
+static uint64_t totalAged;
+static uint64_t totalDuplicates;
+static uint64_t totalFailures;
+
+/* Called in ind_ofdpa_pkt_in_build on the thread receiving packets.
+   Returns 1 if the packet was taken for learning. */
+int ind_ofdpa_l2_learn_consume(const ofdpaPacket_t *rxPkt)
+{
+  ind_ofdpa_l2_learn_record_t rec;
+  const uint8_t *data = (const uint8_t *)rxPkt->pktData.pstart;
+  uint16_t ethType, tci;
+
+  if (!learnEnabled || (rxPkt->tableId != OFDPA_FLOW_TABLE_ID_SA_LOOKUP))
+  {
+    return 0;
+  }
+
+  if (rxPkt->pktData.size < (ETH_HLEN + 4))
+  {
+    return 0;
+  }
+
+  memcpy(&ethType, data + 2 * ETH_ALEN, sizeof(ethType));
+  ethType = ntohs(ethType);
+  if ((ethType != ETH_P_8021Q) && (ethType != ETH_P_8021AD))
+  {
+    /* The VLAN is not known; let the controller see it */
+    learnPktsUntagged++;
+    return 0;
+  }
+
+  /* Multicast source addresses are not learned */
+  if (data[ETH_ALEN] & 0x01)
+  {
+    return 1;
+  }
+
+  memcpy(&tci, data + ETH_HLEN, sizeof(tci));
+  memset(&rec, 0, sizeof(rec));
+  rec.key.vlanId = ntohs(tci) & OFDPA_VID_EXACT_MASK;
+  memcpy(rec.key.mac, data + ETH_ALEN, ETH_ALEN);
+  rec.port = rxPkt->inPortNum;
+
+  if (ind_ofdpa_spsc_push(&learnQueue, &rec))
+  {
+    learnPktsQueued++;
+  }
+  else
+  {
+    /* OF-DPA punts the address again while it stays unknown */
+    learnQueueDrops++;
+  }
+
+  return 1;
+}
+
+static void learn_flow_build(const ind_ofdpa_l2_learn_entry_t *entry, ofdpaFlowEntry_t *flow)
+{
+  ofdpaBridgingFlowEntry_t *bridging = &flow->flowData.bridgingFlowEntry;
+  uint32_t groupId = 0;
+
+  IND_OFDPA_RPC(ofdpaFlowEntryInit, OFDPA_FLOW_TABLE_ID_BRIDGING, flow);
+
+  bridging->match_criteria.vlanId = OFDPA_VID_PRESENT | entry->key.vlanId;
+  bridging->match_criteria.vlanIdMask = OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK;
+  memcpy(bridging->match_criteria.destMac.addr, entry->key.mac, OFDPA_MAC_ADDR_LEN);
+  memset(bridging->match_criteria.destMacMask.addr, 0xff, OFDPA_MAC_ADDR_LEN);
+
+  ofdpaGroupTypeSet(&groupId, OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE);
+  ofdpaGroupVlanSet(&groupId, entry->key.vlanId);
+  ofdpaGroupPortIdSet(&groupId, entry->port);
+  bridging->groupID = groupId;
+  bridging->gotoTableId = OFDPA_FLOW_TABLE_ID_ACL_POLICY;
+
+  flow->idle_time = learnAgeSec;
+  flow->cookie = entry->cookie;
+}
+
+static void learn_record_append(const ind_ofdpa_l2_learn_entry_t *entry, uint16_t flags)
+{
+  uint8_t *p;
+
+  if (batchRecords >= IND_OFDPA_L2_LEARN_NOTIFY_RECORDS)
+  {
+    batchFlags |= IND_OFDPA_L2_LEARN_NOTIFY_TRUNCATED;
+    return;
+  }
+
+  p = learnNotifyData + IND_OFDPA_L2_LEARN_NOTIFY_HDR_LEN +
+      batchRecords * IND_OFDPA_L2_LEARN_NOTIFY_RECORD_LEN;
+  p = ind_ofdpa_put16(p, entry->key.vlanId);
+  p = ind_ofdpa_put16(p, flags);
+  p = ind_ofdpa_put32(p, entry->port);
+  memcpy(p, entry->key.mac, OFDPA_MAC_ADDR_LEN);
+  p += OFDPA_MAC_ADDR_LEN;
+  ind_ofdpa_put16(p, 0);
+  batchRecords++;
+}
+
+static void learn_entry_remove(ind_ofdpa_l2_learn_entry_t *entry)
+{
+  bighash_remove(learnTable, &entry->hash_entry);
+  free(entry);
+}
+
+static void learn_record_process(const ind_ofdpa_l2_learn_record_t *rec)
+{
+  ind_ofdpa_l2_learn_entry_t *entry;
+  ofdpaFlowEntry_t flow;
+  OFDPA_ERROR_t ofdpa_rv;
+  int moved = 0;
+
+  entry = l2_learn_hashtable_first(learnTable, &rec->key);
+  if (entry != NULL)
+  {
+    if (entry->port == rec->port)
+    {
+      /* Punted again before the entry was installed */
+      totalDuplicates++;
+      return;
+    }
+
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieDelete, entry->cookie);
+    if ((ofdpa_rv != OFDPA_E_NONE) && (ofdpa_rv != OFDPA_E_NOT_FOUND))
+    {
+      totalFailures++;
+      LOG_ERROR("Failed to remove learned entry 0x%llx, rv = %d",
+                (unsigned long long)entry->cookie, ofdpa_rv);
+      return;
+    }
+    ind_ofdpa_table_stats_flow_removed(OFDPA_FLOW_TABLE_ID_BRIDGING, 1);
+    entry->port = rec->port;
+    moved = 1;
+  }
+  else
+  {
+    if (bighash_entry_count(learnTable) >= IND_OFDPA_L2_LEARN_MAX_ENTRIES)
+    {
+      totalFailures++;
+      return;
+    }
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+    {
+      totalFailures++;
+      return;
+    }
+    entry->key = rec->key;
+    entry->port = rec->port;
+    l2_learn_hashtable_insert(learnTable, entry);
+  }
+
+  entry->cookie = IND_OFDPA_L2_LEARN_COOKIE | learnCookieNext++;
+  learn_flow_build(entry, &flow);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowAdd, &flow);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    /* Forgotten, so the next punt of the address tries again */
+    totalFailures++;
+    LOG_TRACE("Failed to install learned address on VLAN %u port %u, rv = %d",
+              entry->key.vlanId, entry->port, ofdpa_rv);
+    learn_entry_remove(entry);
+    return;
+  }
+  ind_ofdpa_table_stats_flow_added(OFDPA_FLOW_TABLE_ID_BRIDGING, 1);
+
+  if (moved)
+  {
+    batchMoved++;
+    totalMoved++;
+  }
+  else
+  {
+    batchLearned++;
+    totalLearned++;
+  }
+  learn_record_append(entry, moved ? IND_OFDPA_L2_LEARN_RECORD_MOVED : 0);
+}
+
+static void learn_notify_send(void)
+{
+  of_experimenter_t *msg;
+  of_octets_t octets;
+  uint8_t *p = learnNotifyData;
+
+  p = ind_ofdpa_put32(p, batchLearned);
+  p = ind_ofdpa_put32(p, batchMoved);
+  p = ind_ofdpa_put32(p, batchAged);
+  p = ind_ofdpa_put16(p, batchRecords);
+  ind_ofdpa_put16(p, batchFlags);
+
+  octets.data = learnNotifyData;
+  octets.bytes = IND_OFDPA_L2_LEARN_NOTIFY_HDR_LEN +
+                 batchRecords * IND_OFDPA_L2_LEARN_NOTIFY_RECORD_LEN;
+  msg = indigo_of_experimenter_new(ofagent_of_version, IND_OFDPA_L2_LEARN_NOTIFY_EXPERIMENTER,
+                                   IND_OFDPA_L2_LEARN_NOTIFY_SUBTYPE, &octets);
+  if (msg == NULL)
+  {
+    LOG_ERROR("Failed to build MAC learning summary");
+    return;
+  }
+
+  indigo_cxn_send_async_message(msg);
+}
+
+static void learn_batch_timer(void *cookie)
+{
+  ind_ofdpa_l2_learn_record_t rec;
+  int count = 0;
+
+  while ((count < IND_OFDPA_L2_LEARN_BATCH_MAX) && ind_ofdpa_spsc_pop(&learnQueue, &rec))
+  {
+    learn_record_process(&rec);
+    count++;
+  }
+
+  if ((batchLearned != 0) || (batchMoved != 0) || (batchAged != 0))
+  {
+    learn_notify_send();
+    batchLearned = 0;
+    batchMoved = 0;
+    batchAged = 0;
+    batchRecords = 0;
+    batchFlags = 0;
+  }
+}
+
+/* Flow event of a learned entry, whose cookie has IND_OFDPA_L2_LEARN_COOKIE
+   set. Runs in the SocketManager loop. */
+void ind_ofdpa_l2_learn_expired(const ofdpaFlowEntry_t *flowMatch)
+{
+  const ofdpaBridgingFlowMatch_t *match = &flowMatch->flowData.bridgingFlowEntry.match_criteria;
+  ind_ofdpa_l2_learn_entry_t *entry;
+  ind_ofdpa_l2_learn_key_t key;
+
+  ind_ofdpa_table_stats_flow_removed(OFDPA_FLOW_TABLE_ID_BRIDGING, 1);
+
+  if (learnTable == NULL)
+  {
+    return;
+  }
+
+  memset(&key, 0, sizeof(key));
+  key.vlanId = match->vlanId & OFDPA_VID_EXACT_MASK;
+  memcpy(key.mac, match->destMac.addr, OFDPA_MAC_ADDR_LEN);
+
+  entry = l2_learn_hashtable_first(learnTable, &key);
+  if ((entry != NULL) && (entry->cookie == flowMatch->cookie))
+  {
+    learn_entry_remove(entry);
+    batchAged++;
+    totalAged++;
+  }
+}
+
+indigo_error_t ind_ofdpa_l2_learn_init(uint32_t interval_ms, uint32_t age_sec)
+{
+  ofdpaSrcMacLearnModeCfg_t learnCfg;
+  OFDPA_ERROR_t ofdpa_rv;
+  indigo_error_t err;
+
+  if (interval_ms == 0)
+  {
+    LOG_VERBOSE("Agent MAC learning disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  learnIntervalMs = interval_ms;
+  learnAgeSec = age_sec;
+
+  learnTable = l2_learn_hashtable_create(IND_OFDPA_L2_LEARN_BUCKETS);
+  if (learnTable == NULL)
+  {
+    LOG_ERROR("Failed to create MAC learning table");
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  err = ind_ofdpa_spsc_init(&learnQueue, IND_OFDPA_L2_LEARN_QUEUE_SIZE,
+                            sizeof(ind_ofdpa_l2_learn_record_t));
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to create MAC learning queue");
+    return err;
+  }
+
+  err = ind_soc_timer_event_register(learn_batch_timer, NULL, learnIntervalMs);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register MAC learning timer");
+    return err;
+  }
+
+  memset(&learnCfg, 0, sizeof(learnCfg));
+  learnCfg.destPortNum = OFDPA_PORT_CONTROLLER;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaSourceMacLearningSet, OFDPA_ENABLE, &learnCfg);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to enable source MAC learning, rv = %d", ofdpa_rv);
+    ind_soc_timer_event_unregister(learn_batch_timer, NULL);
+    return indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  learnEnabled = 1;
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_l2_learn_show(void)
+{
+  if (!learnEnabled)
+  {
+    return;
+  }
+
+  LOG_INFO("MAC learning: %d addresses, aging %u s, batches every %u ms",
+           bighash_entry_count(learnTable), learnAgeSec, learnIntervalMs);
+  LOG_INFO("  %"PRIu64" learned, %"PRIu64" moved, %"PRIu64" aged, "
+           "%"PRIu64" duplicates, %"PRIu64" failures",
+           totalLearned, totalMoved, totalAged, totalDuplicates, totalFailures);
+  LOG_INFO("  %"PRIu64" learn packets queued, %"PRIu64" dropped, %"PRIu64" untagged",
+           learnPktsQueued, learnQueueDrops, learnPktsUntagged);
+}
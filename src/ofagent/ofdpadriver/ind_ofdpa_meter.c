@@ -22,29 +22,32 @@
 *
 * @component  OF-DPA
 *
-* @comments   none
+* @comments   Meter stats are answered from a snapshot of every meter's
+*             configuration and counters, refreshed by a periodic
+*             collector walk over ofdpaMeterNextGet.
 *
 * @create     12 Aug 2014
 *
 * @end
 *
 **********************************************************************/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include "indigo/forwarding.h"
 #include "ind_ofdpa_util.h"
 #include "ind_ofdpa_log.h"
 
 #ifdef OFDPA_FIXUP
-indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_band_t *meters)
+/* Translate the bands of a meter mod; meterType stays 0 without a TCM band */
+static indigo_error_t meter_entry_build(uint16_t flag, of_list_meter_band_t *meters,
+                                        ofdpaMeterEntry_t *meter)
 {
-  indigo_error_t err = INDIGO_ERROR_NONE;
   of_meter_band_t of_meter_band;
   int rv;
-  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
-  ofdpaMeterEntry_t meter;
 
-  memset(&meter, 0, sizeof(meter));
+  memset(meter, 0, sizeof(*meter));
 
-  LOG_TRACE("meter_add: id %d, flag 0x%x",id, flag);
   OF_LIST_METER_BAND_ITER(meters, &of_meter_band, rv)
   {
     switch (of_meter_band.header.object_id) {
@@ -70,11 +73,11 @@ indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_ba
 
         if ((flag & OF_METER_FLAG_KBPS) == OF_METER_FLAG_KBPS)
         {
-          meter.u.tcmParameters.tcmRateUnit = OFDPA_METER_RATE_KBPS;
+          meter->u.tcmParameters.tcmRateUnit = OFDPA_METER_RATE_KBPS;
         }
         else if ((flag & OF_METER_FLAG_PKTPS) == OF_METER_FLAG_PKTPS)
         {
-          meter.u.tcmParameters.tcmRateUnit = OFDPA_METER_RATE_PKTPS;
+          meter->u.tcmParameters.tcmRateUnit = OFDPA_METER_RATE_PKTPS;
         }
 
         of_meter_band_ofdpa_color_set_rate_get(&of_meter_band.ofdpa_color_set, &rate);
@@ -84,18 +87,18 @@ indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_ba
         of_meter_band_ofdpa_color_set_color_get(&of_meter_band.ofdpa_color_set, &color);
         LOG_TRACE("meter_band: %d, %d, %d, %d, %d",rate, burst, mode, color_aware, color);
 
-        meter.meterType = OFDPA_METER_TYPE_TCM;
-        meter.u.tcmParameters.tcmMode = mode;
-        meter.u.tcmParameters.colorAwareMode = color_aware;
+        meter->meterType = OFDPA_METER_TYPE_TCM;
+        meter->u.tcmParameters.tcmMode = mode;
+        meter->u.tcmParameters.colorAwareMode = color_aware;
         if (color == 1) /* Yellow */
         {
-          meter.u.tcmParameters.yellowRate = rate;
-          meter.u.tcmParameters.yellowBurst = burst;
+          meter->u.tcmParameters.yellowRate = rate;
+          meter->u.tcmParameters.yellowBurst = burst;
         }
         else if (color == 2) /* Red */
         {
-          meter.u.tcmParameters.redRate = rate;
-          meter.u.tcmParameters.redBurst = burst;
+          meter->u.tcmParameters.redRate = rate;
+          meter->u.tcmParameters.redBurst = burst;
         }
 
         break;
@@ -107,43 +110,147 @@ indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_ba
 
   }
 
-  if (meter.meterType == OFDPA_METER_TYPE_TCM)
+  return INDIGO_ERROR_NONE;
+}
+
+static int meter_entry_equal(const ofdpaMeterEntry_t *a, const ofdpaMeterEntry_t *b)
+{
+  if (a->meterType != b->meterType)
   {
-    /* Submit the changes to ofdpa */
-    ofdpa_rv = ofdpaMeterAdd(id, &meter);
-    if (ofdpa_rv != OFDPA_E_NONE)
-    {
-      LOG_ERROR("Failed to add Meter. (ofdpa_rv = %d)", ofdpa_rv);
-    }
-    else
-    {
-      LOG_TRACE("Meter added successfully. (ofdpa_rv = %d)", ofdpa_rv);
-    }
+    return 0;
+  }
+  if (a->meterType != OFDPA_METER_TYPE_TCM)
+  {
+    return 1;
+  }
+
+  return (a->u.tcmParameters.tcmMode == b->u.tcmParameters.tcmMode) &&
+    (a->u.tcmParameters.colorAwareMode == b->u.tcmParameters.colorAwareMode) &&
+    (a->u.tcmParameters.tcmRateUnit == b->u.tcmParameters.tcmRateUnit) &&
+    (a->u.tcmParameters.yellowRate == b->u.tcmParameters.yellowRate) &&
+    (a->u.tcmParameters.yellowBurst == b->u.tcmParameters.yellowBurst) &&
+    (a->u.tcmParameters.redRate == b->u.tcmParameters.redRate) &&
+    (a->u.tcmParameters.redBurst == b->u.tcmParameters.redBurst);
+}
+
+static OFDPA_ERROR_t meter_entry_add(uint32_t id, ofdpaMeterEntry_t *meter)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  /* Submit the changes to ofdpa */
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaMeterAdd, id, meter);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to add Meter. (ofdpa_rv = %d)", ofdpa_rv);
+  }
+  else
+  {
+    LOG_TRACE("Meter added successfully. (ofdpa_rv = %d)", ofdpa_rv);
+  }
 
-    rv = indigoConvertOfdpaRv(ofdpa_rv);
+  return ofdpa_rv;
+}
+
+indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_band_t *meters)
+{
+  indigo_error_t err;
+  ofdpaMeterEntry_t meter;
+
+  LOG_TRACE("meter_add: id %d, flag 0x%x",id, flag);
+
+  err = meter_entry_build(flag, meters, &meter);
+  if ((err != INDIGO_ERROR_NONE) || (meter.meterType != OFDPA_METER_TYPE_TCM))
+  {
+    return err;
   }
 
-  return err;
+  return indigoConvertOfdpaRv(meter_entry_add(id, &meter));
 }
+
+/*
+ * OF-DPA has no call that changes a meter in place, so a modify has to
+ * delete the meter and add it again. Compare the new parameters with
+ * those programmed first and skip both calls when they are the same,
+ * as for a controller resending its configuration. If the add of the
+ * new parameters fails, the old ones are put back so that the flows
+ * using the meter are policed as before.
+ */
 indigo_error_t indigo_fwd_meter_modify(uint32_t id, uint16_t flag, of_list_meter_band_t *meters)
 {
-  indigo_error_t err = INDIGO_ERROR_NONE;
+  indigo_error_t err;
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaMeterEntry_t meter, current;
 
   LOG_TRACE("meter_mod: id %d", id);
 
-  err = indigo_fwd_meter_delete(id);
+  err = meter_entry_build(flag, meters, &meter);
   if (err != INDIGO_ERROR_NONE)
   {
     return err;
   }
-  err = indigo_fwd_meter_add(id, flag, meters);
-  if (err != INDIGO_ERROR_NONE)
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaMeterGet, id, &current);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to get meter %u. (ofdpa_rv = %d)", id, ofdpa_rv);
+    return indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  if (meter_entry_equal(&meter, &current))
+  {
+    LOG_TRACE("Meter %u unchanged", id);
+    return INDIGO_ERROR_NONE;
+  }
+
+  err = indigo_fwd_meter_delete(id);
+  if ((err != INDIGO_ERROR_NONE) || (meter.meterType != OFDPA_METER_TYPE_TCM))
   {
     return err;
   }
 
-  return err;
+  ofdpa_rv = meter_entry_add(id, &meter);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    if (meter_entry_add(id, &current) != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Failed to restore meter %u", id);
+    }
+    return indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+/* A meter that survived the restart is kept if OF-DPA still has the
+   parameters it was saved with, and programmed again otherwise */
+indigo_error_t indigo_fwd_meter_restore(uint32_t id, uint16_t flag, of_list_meter_band_t *meters)
+{
+  indigo_error_t err;
+  OFDPA_ERROR_t ofdpa_rv;
+  ofdpaMeterEntry_t meter, current;
+
+  err = meter_entry_build(flag, meters, &meter);
+  if ((err != INDIGO_ERROR_NONE) || (meter.meterType != OFDPA_METER_TYPE_TCM))
+  {
+    /* As for an add, only TCM meters are in OF-DPA */
+    return err;
+  }
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaMeterGet, id, &current);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Meter %u not restored. (ofdpa_rv = %d)", id, ofdpa_rv);
+    return indigoConvertOfdpaRv(ofdpa_rv);
+  }
+
+  if (meter_entry_equal(&meter, &current))
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  LOG_VERBOSE("Meter %u changed since it was saved; reprogramming", id);
+  return indigo_fwd_meter_modify(id, flag, meters);
 }
+
 indigo_error_t indigo_fwd_meter_delete(uint32_t id)
 {
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
@@ -151,7 +258,7 @@ indigo_error_t indigo_fwd_meter_delete(uint32_t id)
   LOG_TRACE("meter_del: id %d",id);
 
   /* Submit the changes to ofdpa */
-  ofdpa_rv = ofdpaMeterDelete(id);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaMeterDelete, id);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to delete meter. (ofdpa_rv = %d)", ofdpa_rv);
@@ -163,4 +270,213 @@ indigo_error_t indigo_fwd_meter_delete(uint32_t id)
 
   return (indigoConvertOfdpaRv(ofdpa_rv));;
 }
+
+typedef struct
+{
+  uint32_t meterId;
+  ofdpaMeterEntry_t meter;
+  ofdpaMeterEntryStats_t stats;
+} ind_ofdpa_meter_stats_entry_t;
+
+static uint32_t meterStatsIntervalMs;
+
+/* Latest complete snapshot, and the one being collected */
+static ind_ofdpa_snapshot_t meterStatsCurrent = IND_OFDPA_SNAPSHOT_INIT(ind_ofdpa_meter_stats_entry_t);
+static ind_ofdpa_snapshot_t meterStatsNext = IND_OFDPA_SNAPSHOT_INIT(ind_ofdpa_meter_stats_entry_t);
+
+static uint32_t walkMeterId;
+
+/* Read the configuration and counters of one meter */
+static OFDPA_ERROR_t meter_stats_read(uint32_t meterId, ind_ofdpa_meter_stats_entry_t *entry)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  memset(entry, 0, sizeof(*entry));
+  entry->meterId = meterId;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaMeterGet, meterId, &entry->meter);
+  if (ofdpa_rv == OFDPA_E_NONE)
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaMeterStatsGet, meterId, &entry->stats);
+  }
+
+  return ofdpa_rv;
+}
+
+/* Meters are walked in ascending order */
+static ind_ofdpa_meter_stats_entry_t *meter_stats_lookup(ind_ofdpa_snapshot_t *snapshot,
+                                                         uint32_t meterId)
+{
+  return ind_ofdpa_snapshot_lookup(snapshot, offsetof(ind_ofdpa_meter_stats_entry_t, meterId),
+                                   meterId);
+}
+
+static void meter_stats_walk_start(void)
+{
+  meterStatsNext.count = 0;
+  walkMeterId = 0;
+}
+
+static ind_ofdpa_collect_status_t meter_stats_walk_step(void)
+{
+  ind_ofdpa_meter_stats_entry_t *entry;
+
+  if (IND_OFDPA_RPC(ofdpaMeterNextGet, walkMeterId, &walkMeterId) != OFDPA_E_NONE)
+  {
+    return IND_OFDPA_COLLECT_FINISHED;
+  }
+
+  entry = ind_ofdpa_snapshot_append(&meterStatsNext);
+  if (entry == NULL)
+  {
+    LOG_ERROR("Failed to grow meter stats snapshot");
+    meterStatsNext.count = 0;
+    return IND_OFDPA_COLLECT_ABORTED;
+  }
+
+  if (meter_stats_read(walkMeterId, entry) != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Failed to get stats of meter %u.", walkMeterId);
+    meterStatsNext.count--;
+  }
+
+  return IND_OFDPA_COLLECT_CONTINUE;
+}
+
+static void meter_stats_walk_finish(void)
+{
+  ind_ofdpa_snapshot_swap(&meterStatsCurrent, &meterStatsNext);
+}
+
+static ind_ofdpa_collector_t meterStatsCollector =
+{
+  .name = "meter stats collector",
+  .cls = IND_OFDPA_COLLECT_CLASS_METER,
+  .start = meter_stats_walk_start,
+  .step = meter_stats_walk_step,
+  .finish = meter_stats_walk_finish,
+};
+
+indigo_error_t ind_ofdpa_meter_stats_cache_init(uint32_t interval_ms)
+{
+  meterStatsIntervalMs = interval_ms;
+  if (meterStatsIntervalMs == 0)
+  {
+    LOG_VERBOSE("Meter stats collector disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  meterStatsCollector.intervalMs = meterStatsIntervalMs;
+  if (ind_ofdpa_collector_register(&meterStatsCollector) != INDIGO_ERROR_NONE)
+  {
+    meterStatsIntervalMs = 0;
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  /* Have a snapshot ready for the first request */
+  ind_ofdpa_collector_refresh(&meterStatsCollector);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* True once a complete snapshot is available */
+int ind_ofdpa_meter_stats_cache_enabled(void)
+{
+  return (meterStatsIntervalMs != 0) &&
+    (ind_ofdpa_stats_generation_get(IND_OFDPA_COLLECT_CLASS_METER) != 0);
+}
+
+static indigo_error_t meter_stats_entry_append(of_list_meter_stats_t *list,
+                                               ind_ofdpa_meter_stats_entry_t *entry)
+{
+  of_meter_stats_t stats[1];
+  of_list_meter_band_stats_t bands[1];
+  of_meter_band_stats_t band[1];
+  int bandCount = 0;
+
+  of_meter_stats_init(stats, list->version, -1, 1);
+  if (of_list_meter_stats_append_bind(list, stats) < 0)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  of_meter_stats_meter_id_set(stats, entry->meterId);
+  of_meter_stats_flow_count_set(stats, entry->stats.refCount);
+  of_meter_stats_duration_sec_set(stats, entry->stats.duration);
+
+  /* OF-DPA does not count per band; report the configured bands */
+  if (entry->meter.meterType == OFDPA_METER_TYPE_TCM)
+  {
+    bandCount = (entry->meter.u.tcmParameters.yellowRate != 0) +
+      (entry->meter.u.tcmParameters.redRate != 0);
+  }
+
+  of_meter_stats_band_stats_bind(stats, bands);
+  while (bandCount-- > 0)
+  {
+    of_meter_band_stats_init(band, list->version, -1, 1);
+    if (of_list_meter_band_stats_append_bind(bands, band) < 0)
+    {
+      return INDIGO_ERROR_RESOURCE;
+    }
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t indigo_fwd_meter_stats_get(uint32_t id, of_list_meter_stats_t *entries)
+{
+  ind_ofdpa_meter_stats_entry_t entry;
+  ind_ofdpa_meter_stats_entry_t *cached;
+  indigo_error_t err = INDIGO_ERROR_NONE;
+  uint32_t meterId;
+  uint32_t i;
+
+  LOG_TRACE("meter_stats: id %u", id);
+
+  if (ind_ofdpa_meter_stats_cache_enabled())
+  {
+    if (id != OF_METER_ALL)
+    {
+      /* A meter added since the last collection is read directly */
+      cached = meter_stats_lookup(&meterStatsCurrent, id);
+      if (cached != NULL)
+      {
+        return meter_stats_entry_append(entries, cached);
+      }
+      if (meter_stats_read(id, &entry) != OFDPA_E_NONE)
+      {
+        return INDIGO_ERROR_NONE;
+      }
+      return meter_stats_entry_append(entries, &entry);
+    }
+    for (i = 0; (i < meterStatsCurrent.count) && (err == INDIGO_ERROR_NONE); i++)
+    {
+      err = meter_stats_entry_append(entries, ind_ofdpa_snapshot_entry(&meterStatsCurrent, i));
+    }
+    return err;
+  }
+
+  if (id != OF_METER_ALL)
+  {
+    if (meter_stats_read(id, &entry) != OFDPA_E_NONE)
+    {
+      /* No such meter */
+      return INDIGO_ERROR_NONE;
+    }
+    return meter_stats_entry_append(entries, &entry);
+  }
+
+  meterId = 0;
+  while ((err == INDIGO_ERROR_NONE) &&
+         (IND_OFDPA_RPC(ofdpaMeterNextGet, meterId, &meterId) == OFDPA_E_NONE))
+  {
+    if (meter_stats_read(meterId, &entry) == OFDPA_E_NONE)
+    {
+      err = meter_stats_entry_append(entries, &entry);
+    }
+  }
+
+  return err;
+}
 #endif
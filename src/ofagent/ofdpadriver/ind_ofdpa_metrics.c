@@ -0,0 +1,402 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_metrics.c
+*
+* @purpose    OpenMetrics scrape endpoint for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Serves GET /metrics over HTTP from the SocketManager loop.
+*             The exposition is rebuilt by a timer into a preformatted
+*             response, so a scrape only copies bytes out and never walks
+*             the flow table or the connections. A client keeps a
+*             reference to the response it was given until it has been
+*             written out, so a rebuild does not disturb it.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_pvs_buffer.h>
+#include <SocketManager/socketmanager.h>
+#include <OFStateManager/ofstatemanager.h>
+#include <OFConnectionManager/ofconnectionmanager.h>
+
+#define IND_OFDPA_METRICS_CLIENTS_MAX  8
+#define IND_OFDPA_METRICS_REQUEST_MAX  1024
+
+typedef struct
+{
+  int refs;
+  int len;
+  char data[];
+} ind_ofdpa_metrics_response_t;
+
+typedef struct
+{
+  int fd;                              /* -1 if the slot is free */
+  char request[IND_OFDPA_METRICS_REQUEST_MAX];
+  int requestLen;
+  ind_ofdpa_metrics_response_t *response;
+  int sent;
+} ind_ofdpa_metrics_client_t;
+
+static int metricsSocket = -1;
+static uint32_t metricsRefreshMs;
+static ind_ofdpa_metrics_response_t *metricsCurrent;
+static ind_ofdpa_metrics_client_t metricsClients[IND_OFDPA_METRICS_CLIENTS_MAX];
+
+static struct
+{
+  uint64_t scrapes;
+  uint64_t notFound;
+  uint64_t rejected;
+} metricsStats;
+
+static const char metricsNotFound[] =
+  "HTTP/1.1 404 Not Found\r\n"
+  "Content-Type: text/plain\r\n"
+  "Content-Length: 10\r\n"
+  "Connection: close\r\n"
+  "\r\n"
+  "Not Found\n";
+
+static void metrics_response_release(ind_ofdpa_metrics_response_t *response)
+{
+  if ((response != NULL) && (--response->refs == 0))
+  {
+    free(response);
+  }
+}
+
+static void metrics_loop_write(aim_pvs_t *pvs)
+{
+  ind_soc_loop_stats_t stats;
+
+  ind_soc_loop_stats_get(&stats);
+  aim_printf(pvs, "# TYPE indigo_soc_loop_iterations counter\n");
+  aim_printf(pvs, "# HELP indigo_soc_loop_iterations SocketManager event loop iterations.\n");
+  aim_printf(pvs, "indigo_soc_loop_iterations_total %"PRIu64"\n", stats.iterations);
+  aim_printf(pvs, "# TYPE indigo_soc_loop_seconds counter\n");
+  aim_printf(pvs, "# HELP indigo_soc_loop_seconds SocketManager event loop time by phase.\n");
+  aim_printf(pvs, "indigo_soc_loop_seconds_total{phase=\"scan\"} %.9f\n", stats.scan_ns / 1e9);
+  aim_printf(pvs, "indigo_soc_loop_seconds_total{phase=\"sockets\"} %.9f\n", stats.sockets_ns / 1e9);
+  aim_printf(pvs, "indigo_soc_loop_seconds_total{phase=\"timers\"} %.9f\n", stats.timers_ns / 1e9);
+  aim_printf(pvs, "indigo_soc_loop_seconds_total{phase=\"tasks\"} %.9f\n", stats.tasks_ns / 1e9);
+  aim_printf(pvs, "# TYPE indigo_metrics_scrapes counter\n");
+  aim_printf(pvs, "# HELP indigo_metrics_scrapes Metrics requests answered.\n");
+  aim_printf(pvs, "indigo_metrics_scrapes_total %"PRIu64"\n", metricsStats.scrapes);
+}
+
+/* Build the response served until the next refresh */
+static void metrics_refresh(void *cookie)
+{
+  ind_ofdpa_metrics_response_t *response;
+  aim_pvs_t *pvs;
+  char *body;
+  char header[256];
+  int bodyLen, headerLen;
+
+  pvs = aim_pvs_buffer_create();
+  if (pvs == NULL)
+  {
+    return;
+  }
+  ind_core_metrics_write(pvs);
+  ind_cxn_metrics_write(pvs);
+  metrics_loop_write(pvs);
+  aim_printf(pvs, "# EOF\n");
+
+  body = aim_pvs_buffer_get(pvs);
+  bodyLen = aim_pvs_buffer_size(pvs);
+  aim_pvs_destroy(pvs);
+  if (body == NULL)
+  {
+    return;
+  }
+
+  headerLen = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                       "Content-Length: %d\r\n"
+                       "Connection: close\r\n"
+                       "\r\n", bodyLen);
+
+  response = malloc(sizeof(*response) + headerLen + bodyLen);
+  if (response != NULL)
+  {
+    response->refs = 1;
+    response->len = headerLen + bodyLen;
+    memcpy(response->data, header, headerLen);
+    memcpy(response->data + headerLen, body, bodyLen);
+    metrics_response_release(metricsCurrent);
+    metricsCurrent = response;
+  }
+  aim_free(body);
+}
+
+static void metrics_client_close(ind_ofdpa_metrics_client_t *client)
+{
+  ind_soc_socket_unregister(client->fd);
+  close(client->fd);
+  client->fd = -1;
+  metrics_response_release(client->response);
+  client->response = NULL;
+}
+
+static void metrics_client_request(ind_ofdpa_metrics_client_t *client)
+{
+  if ((strncmp(client->request, "GET /metrics ", 13) == 0) && (metricsCurrent != NULL))
+  {
+    client->response = metricsCurrent;
+    client->response->refs++;
+    metricsStats.scrapes++;
+  }
+  else
+  {
+    metricsStats.notFound++;
+  }
+  client->sent = 0;
+  ind_soc_data_in_pause(client->fd);
+  ind_soc_data_out_ready(client->fd);
+}
+
+static void metrics_client_ready(int fd, void *cookie, int read_ready,
+                                 int write_ready, int error_seen)
+{
+  ind_ofdpa_metrics_client_t *client = cookie;
+  const char *data;
+  int len;
+  ssize_t n;
+
+  if (error_seen)
+  {
+    metrics_client_close(client);
+    return;
+  }
+
+  if (read_ready)
+  {
+    n = read(fd, client->request + client->requestLen,
+             sizeof(client->request) - 1 - client->requestLen);
+    if (n <= 0)
+    {
+      if ((n == 0) || (errno != EAGAIN))
+      {
+        metrics_client_close(client);
+      }
+      return;
+    }
+    client->requestLen += n;
+    client->request[client->requestLen] = '\0';
+    if (strstr(client->request, "\r\n\r\n") != NULL)
+    {
+      metrics_client_request(client);
+    }
+    else if (client->requestLen == sizeof(client->request) - 1)
+    {
+      metrics_client_close(client);
+    }
+    return;
+  }
+
+  if (write_ready)
+  {
+    if (client->response != NULL)
+    {
+      data = client->response->data;
+      len = client->response->len;
+    }
+    else
+    {
+      data = metricsNotFound;
+      len = sizeof(metricsNotFound) - 1;
+    }
+    n = write(fd, data + client->sent, len - client->sent);
+    if ((n < 0) && (errno == EAGAIN))
+    {
+      return;
+    }
+    if (n > 0)
+    {
+      client->sent += n;
+    }
+    if ((n < 0) || (client->sent == len))
+    {
+      metrics_client_close(client);
+    }
+  }
+}
+
+static void metrics_accept(int fd, void *cookie, int read_ready,
+                           int write_ready, int error_seen)
+{
+  ind_ofdpa_metrics_client_t *client = NULL;
+  int clientFd;
+  int i;
+
+  clientFd = accept(fd, NULL, NULL);
+  if (clientFd < 0)
+  {
+    return;
+  }
+
+  for (i = 0; i < IND_OFDPA_METRICS_CLIENTS_MAX; i++)
+  {
+    if (metricsClients[i].fd < 0)
+    {
+      client = &metricsClients[i];
+      break;
+    }
+  }
+
+  if ((client == NULL) ||
+      (fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL) | O_NONBLOCK) < 0))
+  {
+    metricsStats.rejected++;
+    close(clientFd);
+    return;
+  }
+
+  client->fd = clientFd;
+  client->requestLen = 0;
+  client->response = NULL;
+  client->sent = 0;
+  if (ind_soc_socket_register(clientFd, metrics_client_ready, client) != INDIGO_ERROR_NONE)
+  {
+    metricsStats.rejected++;
+    close(clientFd);
+    client->fd = -1;
+  }
+}
+
+/* port 0 disables the endpoint; the response is rebuilt every refreshMs.
+   The endpoint has no authentication, so it listens on addr only. */
+indigo_error_t ind_ofdpa_metrics_init(const char *addr, uint16_t port, uint32_t refreshMs)
+{
+  struct sockaddr_in sa;
+  int one = 1;
+  int i;
+
+  if (port == 0)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1)
+  {
+    LOG_ERROR("Invalid metrics address \"%s\"", addr);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  for (i = 0; i < IND_OFDPA_METRICS_CLIENTS_MAX; i++)
+  {
+    metricsClients[i].fd = -1;
+  }
+
+  metricsSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (metricsSocket < 0)
+  {
+    LOG_ERROR("Failed to create metrics socket: %s", strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  if ((setsockopt(metricsSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0) ||
+      (fcntl(metricsSocket, F_SETFL, fcntl(metricsSocket, F_GETFL) | O_NONBLOCK) < 0) ||
+      (bind(metricsSocket, (struct sockaddr *)&sa, sizeof(sa)) < 0) ||
+      (listen(metricsSocket, IND_OFDPA_METRICS_CLIENTS_MAX) < 0))
+  {
+    LOG_ERROR("Failed to listen for metrics on %s:%u: %s", addr, port, strerror(errno));
+    close(metricsSocket);
+    metricsSocket = -1;
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  if (ind_soc_socket_register(metricsSocket, metrics_accept, NULL) != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register metrics socket");
+    close(metricsSocket);
+    metricsSocket = -1;
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  metricsRefreshMs = refreshMs;
+  metrics_refresh(NULL);
+  if (ind_soc_timer_event_register(metrics_refresh, NULL, metricsRefreshMs) != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register metrics refresh timer");
+    ind_ofdpa_metrics_finish();
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  LOG_VERBOSE("Metrics served on %s:%u. (refresh = %u ms)", addr, port, metricsRefreshMs);
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_metrics_finish(void)
+{
+  int i;
+
+  if (metricsSocket < 0)
+  {
+    return;
+  }
+
+  ind_soc_timer_event_unregister(metrics_refresh, NULL);
+  for (i = 0; i < IND_OFDPA_METRICS_CLIENTS_MAX; i++)
+  {
+    if (metricsClients[i].fd >= 0)
+    {
+      metrics_client_close(&metricsClients[i]);
+    }
+  }
+  ind_soc_socket_unregister(metricsSocket);
+  close(metricsSocket);
+  metricsSocket = -1;
+  metrics_response_release(metricsCurrent);
+  metricsCurrent = NULL;
+}
+
+void ind_ofdpa_metrics_show(void)
+{
+  if (metricsSocket < 0)
+  {
+    return;
+  }
+  LOG_INFO("Metrics: %"PRIu64" scrapes, %"PRIu64" not found, %"PRIu64" rejected, %d bytes",
+           metricsStats.scrapes, metricsStats.notFound, metricsStats.rejected,
+           (metricsCurrent != NULL) ? metricsCurrent->len : 0);
+}
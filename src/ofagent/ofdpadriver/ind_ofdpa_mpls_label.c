@@ -0,0 +1,451 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_mpls_label.c
+*
+* @purpose    MPLS label manager for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Tracks which MPLS labels are bound to MPLS flows (tables
+*             MPLS 0, 1 and 2) and to MPLS label groups (L2 and L3 VPN,
+*             tunnel and swap labels). The flow key cache and the group
+*             bucket cache report every entry installed or removed.
+*
+*             A label is in use when it is bound or allocated, and is
+*             tested in one bitmap. The bindings themselves are kept in
+*             dense arrays of IND_OFDPA_MPLS_LABEL_CHUNK labels indexed
+*             by label, created when the first label of the chunk is bound
+*             and freed when the last is unbound.
+*
+*             Label ranges given at startup have their chunks created up
+*             front, so provisioning thousands of pseudowires in one flow
+*             and group batch allocates nothing per label. Runs of free
+*             labels in these ranges are handed out with
+*             ind_ofdpa_mpls_label_alloc and stay in use until released,
+*             whether or not anything is bound to them yet.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_MPLS_LABEL_MAX        0xFFFFF
+#define IND_OFDPA_MPLS_LABEL_COUNT      (IND_OFDPA_MPLS_LABEL_MAX + 1)
+#define IND_OFDPA_MPLS_LABEL_CHUNK      1024
+#define IND_OFDPA_MPLS_LABEL_CHUNKS     (IND_OFDPA_MPLS_LABEL_COUNT / IND_OFDPA_MPLS_LABEL_CHUNK)
+#define IND_OFDPA_MPLS_LABEL_RANGES_MAX 8
+
+/* Labels 0-15 are reserved by RFC 3032 */
+#define IND_OFDPA_MPLS_LABEL_FIRST_UNRESERVED 16
+
+typedef struct
+{
+  uint32_t flows;               /* flows matching the label */
+  uint32_t groups;              /* label group buckets pushing the label */
+  uint64_t cookie;              /* last flow bound */
+  uint32_t groupId;             /* last group bound */
+} ind_ofdpa_mpls_label_binding_t;
+
+typedef struct
+{
+  uint32_t bound;               /* labels of the chunk with a binding */
+  int reserved;                 /* in a startup range; never freed */
+  ind_ofdpa_mpls_label_binding_t labels[IND_OFDPA_MPLS_LABEL_CHUNK];
+} ind_ofdpa_mpls_label_chunk_t;
+
+typedef struct
+{
+  uint32_t first;
+  uint32_t last;
+} ind_ofdpa_mpls_label_range_t;
+
+static ind_ofdpa_mpls_label_chunk_t *labelChunks[IND_OFDPA_MPLS_LABEL_CHUNKS];
+
+/* One bit per label: bound to a flow or group, or allocated */
+static uint64_t labelBound[IND_OFDPA_MPLS_LABEL_COUNT / 64];
+static uint64_t labelAllocated[IND_OFDPA_MPLS_LABEL_COUNT / 64];
+
+static ind_ofdpa_mpls_label_range_t labelRanges[IND_OFDPA_MPLS_LABEL_RANGES_MAX];
+static int labelRangeCount;
+
+static uint32_t labelsBound;
+static uint32_t labelsAllocated;
+static uint32_t labelChunkCount;
+
+#define LABEL_BIT_TEST(_map, _label)  (((_map)[(_label) / 64] >> ((_label) % 64)) & 1)
+#define LABEL_BIT_SET(_map, _label)   ((_map)[(_label) / 64] |= (1ULL << ((_label) % 64)))
+#define LABEL_BIT_CLEAR(_map, _label) ((_map)[(_label) / 64] &= ~(1ULL << ((_label) % 64)))
+
+static ind_ofdpa_mpls_label_chunk_t *label_chunk_get(uint32_t label, int create)
+{
+  ind_ofdpa_mpls_label_chunk_t **chunk = &labelChunks[label / IND_OFDPA_MPLS_LABEL_CHUNK];
+
+  if ((*chunk == NULL) && create)
+  {
+    *chunk = calloc(1, sizeof(**chunk));
+    if (*chunk == NULL)
+    {
+      LOG_ERROR("Failed to allocate MPLS label table for label %u", label);
+      return NULL;
+    }
+    labelChunkCount++;
+  }
+  return *chunk;
+}
+
+static ind_ofdpa_mpls_label_binding_t *label_bind(uint32_t label)
+{
+  ind_ofdpa_mpls_label_chunk_t *chunk;
+  ind_ofdpa_mpls_label_binding_t *binding;
+
+  if (label > IND_OFDPA_MPLS_LABEL_MAX)
+  {
+    return NULL;
+  }
+  chunk = label_chunk_get(label, 1);
+  if (chunk == NULL)
+  {
+    return NULL;
+  }
+
+  binding = &chunk->labels[label % IND_OFDPA_MPLS_LABEL_CHUNK];
+  if ((binding->flows == 0) && (binding->groups == 0))
+  {
+    chunk->bound++;
+    labelsBound++;
+    LABEL_BIT_SET(labelBound, label);
+  }
+  return binding;
+}
+
+static ind_ofdpa_mpls_label_binding_t *label_binding_get(uint32_t label)
+{
+  ind_ofdpa_mpls_label_chunk_t *chunk;
+
+  if ((label > IND_OFDPA_MPLS_LABEL_MAX) || !LABEL_BIT_TEST(labelBound, label))
+  {
+    return NULL;
+  }
+  chunk = label_chunk_get(label, 0);
+  return (chunk != NULL) ? &chunk->labels[label % IND_OFDPA_MPLS_LABEL_CHUNK] : NULL;
+}
+
+/* Called after a flow or group count of the label went down */
+static void label_unbind_check(uint32_t label, ind_ofdpa_mpls_label_binding_t *binding)
+{
+  ind_ofdpa_mpls_label_chunk_t **chunk;
+
+  if ((binding->flows != 0) || (binding->groups != 0))
+  {
+    return;
+  }
+
+  memset(binding, 0, sizeof(*binding));
+  LABEL_BIT_CLEAR(labelBound, label);
+  labelsBound--;
+
+  chunk = &labelChunks[label / IND_OFDPA_MPLS_LABEL_CHUNK];
+  if ((--(*chunk)->bound == 0) && !(*chunk)->reserved)
+  {
+    free(*chunk);
+    *chunk = NULL;
+    labelChunkCount--;
+  }
+}
+
+/* The label an installed flow matches, if it is an MPLS flow */
+int ind_ofdpa_mpls_label_flow_label(const ofdpaFlowEntry_t *flow, uint32_t *label)
+{
+  switch (flow->tableId)
+  {
+    case OFDPA_FLOW_TABLE_ID_MPLS_0:
+    case OFDPA_FLOW_TABLE_ID_MPLS_1:
+    case OFDPA_FLOW_TABLE_ID_MPLS_2:
+      *label = flow->flowData.mplsFlowEntry.match_criteria.mplsLabel;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+void ind_ofdpa_mpls_label_flow_bind(uint32_t label, uint64_t cookie)
+{
+  ind_ofdpa_mpls_label_binding_t *binding = label_bind(label);
+
+  if (binding != NULL)
+  {
+    binding->flows++;
+    binding->cookie = cookie;
+  }
+}
+
+void ind_ofdpa_mpls_label_flow_unbind(uint32_t label)
+{
+  ind_ofdpa_mpls_label_binding_t *binding = label_binding_get(label);
+
+  if ((binding != NULL) && (binding->flows > 0))
+  {
+    binding->flows--;
+    label_unbind_check(label, binding);
+  }
+}
+
+/* The label a bucket pushes, for the MPLS label group subtypes that push one */
+static int group_bucket_label(uint32_t group_id, const ofdpaGroupBucketEntry_t *bucket,
+                              uint32_t *label)
+{
+  uint32_t group_type, sub_group_type;
+
+  ofdpaGroupTypeGet(group_id, &group_type);
+  if (group_type != OFDPA_GROUP_ENTRY_TYPE_MPLS_LABEL)
+  {
+    return 0;
+  }
+
+  ofdpaGroupMplsSubTypeGet(group_id, &sub_group_type);
+  switch (sub_group_type)
+  {
+    case OFDPA_MPLS_L2_VPN_LABEL:
+    case OFDPA_MPLS_L3_VPN_LABEL:
+    case OFDPA_MPLS_TUNNEL_LABEL1:
+    case OFDPA_MPLS_TUNNEL_LABEL2:
+    case OFDPA_MPLS_SWAP_LABEL:
+      *label = bucket->bucketData.mplsLabel.mplsLabel;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/* Bind or unbind the labels pushed by the buckets of a group */
+void ind_ofdpa_mpls_label_group_update(uint32_t group_id,
+                                       const ofdpaGroupBucketEntry_t *buckets,
+                                       int numBuckets, int bind)
+{
+  ind_ofdpa_mpls_label_binding_t *binding;
+  uint32_t label;
+  int i;
+
+  for (i = 0; i < numBuckets; i++)
+  {
+    if (!group_bucket_label(group_id, &buckets[i], &label))
+    {
+      return;
+    }
+    if (bind)
+    {
+      binding = label_bind(label);
+      if (binding != NULL)
+      {
+        binding->groups++;
+        binding->groupId = group_id;
+      }
+    }
+    else
+    {
+      binding = label_binding_get(label);
+      if ((binding != NULL) && (binding->groups > 0))
+      {
+        binding->groups--;
+        label_unbind_check(label, binding);
+      }
+    }
+  }
+}
+
+int ind_ofdpa_mpls_label_in_use(uint32_t label)
+{
+  return ((label <= IND_OFDPA_MPLS_LABEL_MAX) &&
+          (LABEL_BIT_TEST(labelBound, label) || LABEL_BIT_TEST(labelAllocated, label)));
+}
+
+/* ranges is a comma separated list of FIRST-LAST label ranges */
+indigo_error_t ind_ofdpa_mpls_label_init(const char *ranges)
+{
+  const char *p = ranges;
+  unsigned long first, last, label;
+  ind_ofdpa_mpls_label_chunk_t *chunk;
+  char *end;
+
+  if (ranges == NULL)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  while (*p != '\0')
+  {
+    first = strtoul(p, &end, 0);
+    if ((end == p) || (*end != '-'))
+    {
+      break;
+    }
+    p = end + 1;
+    last = strtoul(p, &end, 0);
+    if ((end == p) || ((*end != ',') && (*end != '\0')))
+    {
+      break;
+    }
+    p = (*end == ',') ? end + 1 : end;
+
+    if ((first < IND_OFDPA_MPLS_LABEL_FIRST_UNRESERVED) || (last < first) ||
+        (last > IND_OFDPA_MPLS_LABEL_MAX))
+    {
+      LOG_ERROR("Invalid MPLS label range %lu-%lu", first, last);
+      return INDIGO_ERROR_PARAM;
+    }
+    if (labelRangeCount == IND_OFDPA_MPLS_LABEL_RANGES_MAX)
+    {
+      LOG_ERROR("At most %d MPLS label ranges are supported", IND_OFDPA_MPLS_LABEL_RANGES_MAX);
+      return INDIGO_ERROR_PARAM;
+    }
+
+    for (label = first - (first % IND_OFDPA_MPLS_LABEL_CHUNK); label <= last;
+         label += IND_OFDPA_MPLS_LABEL_CHUNK)
+    {
+      chunk = label_chunk_get(label, 1);
+      if (chunk == NULL)
+      {
+        return INDIGO_ERROR_RESOURCE;
+      }
+      chunk->reserved = 1;
+    }
+
+    labelRanges[labelRangeCount].first = first;
+    labelRanges[labelRangeCount].last = last;
+    labelRangeCount++;
+    LOG_VERBOSE("MPLS label range %lu-%lu reserved", first, last);
+  }
+
+  if (*p != '\0')
+  {
+    LOG_ERROR("Invalid MPLS label ranges \"%s\"", ranges);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Allocate count consecutive labels not in use from the reserved ranges,
+   first fit. Whole words of the bitmaps are skipped at a time. */
+indigo_error_t ind_ofdpa_mpls_label_alloc(uint32_t count, uint32_t *first)
+{
+  uint32_t label, run, i;
+  int r;
+
+  if (count == 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  for (r = 0; r < labelRangeCount; r++)
+  {
+    run = 0;
+    for (label = labelRanges[r].first; label <= labelRanges[r].last; label++)
+    {
+      if (((label % 64) == 0) &&
+          ((labelBound[label / 64] | labelAllocated[label / 64]) == ~0ULL))
+      {
+        run = 0;
+        label += 63;
+        continue;
+      }
+      if (ind_ofdpa_mpls_label_in_use(label))
+      {
+        run = 0;
+        continue;
+      }
+      if (++run == count)
+      {
+        *first = label - count + 1;
+        for (i = *first; i <= label; i++)
+        {
+          LABEL_BIT_SET(labelAllocated, i);
+        }
+        labelsAllocated += count;
+        return INDIGO_ERROR_NONE;
+      }
+    }
+  }
+
+  return INDIGO_ERROR_RESOURCE;
+}
+
+void ind_ofdpa_mpls_label_release(uint32_t first, uint32_t count)
+{
+  uint32_t label;
+
+  for (label = first; (label < first + count) && (label <= IND_OFDPA_MPLS_LABEL_MAX); label++)
+  {
+    if (LABEL_BIT_TEST(labelAllocated, label))
+    {
+      LABEL_BIT_CLEAR(labelAllocated, label);
+      labelsAllocated--;
+    }
+  }
+}
+
+void ind_ofdpa_mpls_label_show(aim_pvs_t *pvs)
+{
+  uint32_t label, used;
+  int r;
+
+  aim_printf(pvs, "MPLS labels: %u bound, %u allocated, %u label tables of %u\n",
+             labelsBound, labelsAllocated, labelChunkCount, IND_OFDPA_MPLS_LABEL_CHUNK);
+  for (r = 0; r < labelRangeCount; r++)
+  {
+    used = 0;
+    for (label = labelRanges[r].first; label <= labelRanges[r].last; label++)
+    {
+      used += ind_ofdpa_mpls_label_in_use(label);
+    }
+    aim_printf(pvs, "  range %u-%u: %u of %u in use\n", labelRanges[r].first,
+               labelRanges[r].last, used, labelRanges[r].last - labelRanges[r].first + 1);
+  }
+}
+
+void ind_ofdpa_mpls_label_binding_show(aim_pvs_t *pvs, uint32_t label)
+{
+  ind_ofdpa_mpls_label_binding_t *binding = label_binding_get(label);
+
+  if (binding == NULL)
+  {
+    aim_printf(pvs, "MPLS label %u: %s\n", label,
+               ind_ofdpa_mpls_label_in_use(label) ? "allocated, not bound" : "free");
+    return;
+  }
+
+  aim_printf(pvs, "MPLS label %u: %u flows", label, binding->flows);
+  if (binding->flows != 0)
+  {
+    aim_printf(pvs, " (last 0x%"PRIx64")", binding->cookie);
+  }
+  aim_printf(pvs, ", %u group buckets", binding->groups);
+  if (binding->groups != 0)
+  {
+    aim_printf(pvs, " (last 0x%08x)", binding->groupId);
+  }
+  aim_printf(pvs, "%s\n", LABEL_BIT_TEST(labelAllocated, label) ? ", allocated" : "");
+}
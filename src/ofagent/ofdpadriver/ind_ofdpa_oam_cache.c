@@ -0,0 +1,592 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_oam_cache.c
+*
+* @purpose    OAM MEP state cache for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The CCM counters of every local MEP and the state of its
+*             remote MEPs are collected by a periodic walk into a
+*             snapshot, which serves the "ofdpa_oam_mep" gentable and the
+*             OAM telemetry records. OF-DPA OAM events only report the
+*             completion of on-demand LM and DM sessions, so each one
+*             triggers an early walk. Changes in remote MEP state are
+*             flagged in the snapshot and logged.
+*
+*             Changed MEPs are passed to the protection engine in
+*             ind_ofdpa_oam_protection.c first.
+*
+*             Each remote MEP state change and OAM event is also sent to
+*             the controllers right away as an asynchronous experimenter
+*             message, laid out in ind_ofdpa_oam_notify.h. The time from
+*             detection to sending is kept for the latency percentiles.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "indigo/of_message.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_oam_notify.h"
+#include "ind_ofdpa_log.h"
+#include <arpa/inet.h>
+#include <OS/os_time.h>
+
+extern int ofagent_of_version;
+
+/* Gentable dimensions */
+#define IND_OFDPA_OAM_MEP_GENTABLE_MAX      4096
+#define IND_OFDPA_OAM_MEP_GENTABLE_BUCKETS  1024
+
+/* Number of most recent notification latencies kept for the percentiles */
+#define IND_OFDPA_OAM_NOTIFY_SAMPLES        1024
+
+typedef struct
+{
+  ind_ofdpa_oam_mep_state_t *entries;
+  uint32_t count;
+  uint32_t size;
+} ind_ofdpa_oam_snapshot_t;
+
+static uint32_t oamCacheIntervalMs;
+
+/* Latest complete snapshot, and the one being collected */
+static ind_ofdpa_oam_snapshot_t oamCurrent;
+static ind_ofdpa_oam_snapshot_t oamNext;
+
+static uint32_t walkLmepId;
+static int walkLmepFirst;
+
+static indigo_core_gentable_t *oamMepGentable;
+static const indigo_core_gentable_ops_t oamMepGentableOps;
+
+static uint32_t notifyLatencySamples[IND_OFDPA_OAM_NOTIFY_SAMPLES];
+static uint64_t notifyCount;
+static uint64_t notifyFailures;
+
+static ind_ofdpa_oam_mep_state_t *oam_cache_lookup(ind_ofdpa_oam_snapshot_t *snapshot,
+                                                   uint32_t lmepId)
+{
+  int lo = 0, hi = (int)snapshot->count - 1, mid;
+
+  /* MEPs are walked in ascending order */
+  while (lo <= hi)
+  {
+    mid = (lo + hi) / 2;
+    if (snapshot->entries[mid].lmepId == lmepId)
+    {
+      return &snapshot->entries[mid];
+    }
+    if (snapshot->entries[mid].lmepId < lmepId)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid - 1;
+    }
+  }
+
+  return NULL;
+}
+
+static ind_ofdpa_oam_mep_state_t *oam_cache_append(ind_ofdpa_oam_snapshot_t *snapshot)
+{
+  ind_ofdpa_oam_mep_state_t *entries;
+  uint32_t size;
+
+  if (snapshot->count == snapshot->size)
+  {
+    size = snapshot->size ? (snapshot->size * 2) : 256;
+    entries = realloc(snapshot->entries, size * sizeof(*entries));
+    if (entries == NULL)
+    {
+      return NULL;
+    }
+    snapshot->entries = entries;
+    snapshot->size = size;
+  }
+
+  return &snapshot->entries[snapshot->count++];
+}
+
+/* Read the CCM counters of a MEP and the state of its remote MEPs */
+static OFDPA_ERROR_t oam_mep_state_read(uint32_t lmepId, ind_ofdpa_oam_mep_state_t *state)
+{
+  ofdpaOamMepConfig_t config;
+  ofdpaOamMepStatus_t status;
+  ofdpaOamCcmDatabaseEntry_t dbEntry;
+  uint32_t portType = OFDPA_PORT_TYPE_PHYSICAL;
+  uint32_t portConfig;
+  uint32_t remoteMepId = 0;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  memset(&config, 0, sizeof(config));
+  memset(&status, 0, sizeof(status));
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaOamMepGet, lmepId, &config, &status);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return ofdpa_rv;
+  }
+
+  memset(state, 0, sizeof(*state));
+  state->lmepId = lmepId;
+  state->readTime = os_time_monotonic();
+  state->ccmSent = status.ccmFramesSent;
+  state->ccmReceived = status.ccmFramesReceived;
+
+  /* The union holds a drop status id for tail-end protection instead.
+     ofdpaPortTypeGet only decodes the number and reports no errors, so
+     the liveness port is checked to exist before it is used. */
+  if (config.mlp.mlpRole != OFDPA_MLP_ROLE_NONE)
+  {
+    ofdpaPortTypeGet(config.mlp.u.livenessLogicalPortId, &portType);
+    if ((portType == OFDPA_PORT_TYPE_OAM_PROTECTION_LIVENESS_LOGICAL_PORT) &&
+        (IND_OFDPA_RPC(ofdpaPortConfigGet, config.mlp.u.livenessLogicalPortId,
+                       &portConfig) == OFDPA_E_NONE))
+    {
+      state->livenessPort = config.mlp.u.livenessLogicalPortId;
+    }
+  }
+
+  while (IND_OFDPA_RPC(ofdpaOamMepCCMDatabaseEntryNextGet, lmepId, remoteMepId, &remoteMepId) == OFDPA_E_NONE)
+  {
+    memset(&dbEntry, 0, sizeof(dbEntry));
+    if (IND_OFDPA_RPC(ofdpaOamMepCCMDatabaseEntryGet, lmepId, remoteMepId, &dbEntry) != OFDPA_E_NONE)
+    {
+      continue;
+    }
+
+    state->remoteCount++;
+    if (dbEntry.remoteMepState == OFDPA_OAM_RMEP_STATE_OK)
+    {
+      state->remoteOk++;
+    }
+    else if (dbEntry.remoteMepState == OFDPA_OAM_RMEP_STATE_FAILED)
+    {
+      state->remoteFailed++;
+    }
+  }
+
+  return OFDPA_E_NONE;
+}
+
+/* Runs in the SocketManager loop */
+void ind_ofdpa_oam_notify_send(uint16_t reason, const ind_ofdpa_oam_mep_state_t *state,
+                               uint32_t megIndex, uint32_t eventMask, uint64_t detectTime)
+{
+  uint8_t data[IND_OFDPA_OAM_NOTIFY_LEN];
+  of_experimenter_t *msg;
+  of_octets_t octets;
+  uint64_t now, wallNow, latency;
+  uint8_t *p = data;
+
+  now = os_time_monotonic();
+  wallNow = os_time_realtime();
+
+  p = ind_ofdpa_put16(p, reason);
+  p = ind_ofdpa_put16(p, 0);
+  p = ind_ofdpa_put32(p, state->lmepId);
+  p = ind_ofdpa_put32(p, megIndex);
+  p = ind_ofdpa_put32(p, eventMask);
+  p = ind_ofdpa_put16(p, state->remoteCount);
+  p = ind_ofdpa_put16(p, state->remoteOk);
+  p = ind_ofdpa_put16(p, state->remoteFailed);
+  p = ind_ofdpa_put16(p, 0);
+  p = ind_ofdpa_put64(p, wallNow - (now - detectTime));
+  ind_ofdpa_put64(p, wallNow);
+
+  octets.data = data;
+  octets.bytes = sizeof(data);
+  msg = indigo_of_experimenter_new(ofagent_of_version, IND_OFDPA_OAM_NOTIFY_EXPERIMENTER,
+                                   IND_OFDPA_OAM_NOTIFY_SUBTYPE, &octets);
+  if (msg == NULL)
+  {
+    notifyFailures++;
+    LOG_ERROR("Failed to build OAM notification for MEP %u", state->lmepId);
+    return;
+  }
+
+  indigo_cxn_send_async_message(msg);
+
+  latency = os_time_monotonic() - detectTime;
+  notifyLatencySamples[notifyCount % IND_OFDPA_OAM_NOTIFY_SAMPLES] =
+    (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency;
+  notifyCount++;
+}
+
+static void oam_cache_walk_start(void)
+{
+  oamNext.count = 0;
+  walkLmepId = 0;
+  walkLmepFirst = 1;
+}
+
+static ind_ofdpa_collect_status_t oam_cache_walk_step(void)
+{
+  ind_ofdpa_oam_mep_state_t state;
+  ind_ofdpa_oam_mep_state_t *entry;
+
+  /* The walk starts after MEP 0, which may exist itself */
+  if (walkLmepFirst)
+  {
+    walkLmepFirst = 0;
+  }
+  else if (IND_OFDPA_RPC(ofdpaOamMepNextGet, walkLmepId, &walkLmepId) != OFDPA_E_NONE)
+  {
+    return IND_OFDPA_COLLECT_FINISHED;
+  }
+
+  if (oam_mep_state_read(walkLmepId, &state) != OFDPA_E_NONE)
+  {
+    /* Deleted under the walk */
+    return IND_OFDPA_COLLECT_CONTINUE;
+  }
+
+  entry = oam_cache_append(&oamNext);
+  if (entry == NULL)
+  {
+    LOG_ERROR("Failed to grow OAM MEP snapshot");
+    oamNext.count = 0;
+    return IND_OFDPA_COLLECT_ABORTED;
+  }
+  *entry = state;
+
+  return IND_OFDPA_COLLECT_CONTINUE;
+}
+
+static void oam_cache_walk_finish(void)
+{
+  ind_ofdpa_oam_snapshot_t tmp;
+  ind_ofdpa_oam_mep_state_t *entry, *prev;
+  uint32_t i;
+
+  for (i = 0; i < oamNext.count; i++)
+  {
+    entry = &oamNext.entries[i];
+    prev = oam_cache_lookup(&oamCurrent, entry->lmepId);
+    entry->changed = ((prev == NULL) ||
+                      (prev->remoteCount != entry->remoteCount) ||
+                      (prev->remoteOk != entry->remoteOk) ||
+                      (prev->remoteFailed != entry->remoteFailed));
+    if (!entry->changed)
+    {
+      continue;
+    }
+
+    /* Fail over before anything else */
+    ind_ofdpa_oam_protection_update(entry);
+
+    if (prev != NULL)
+    {
+      LOG_INFO("MEP %u: %u of %u remote MEPs up, %u failed",
+               entry->lmepId, entry->remoteOk, entry->remoteCount, entry->remoteFailed);
+      ind_ofdpa_oam_notify_send(IND_OFDPA_OAM_NOTIFY_REMOTE, entry, 0, 0, entry->readTime);
+    }
+  }
+
+  ind_ofdpa_oam_protection_sweep();
+
+  /* Keep both buffers to avoid reallocating on every walk */
+  tmp = oamCurrent;
+  oamCurrent = oamNext;
+  oamNext = tmp;
+  oamNext.count = 0;
+}
+
+static ind_ofdpa_collector_t oamCacheCollector =
+{
+  .name = "OAM MEP collector",
+  .cls = IND_OFDPA_COLLECT_CLASS_OAM,
+  .start = oam_cache_walk_start,
+  .step = oam_cache_walk_step,
+  .finish = oam_cache_walk_finish,
+};
+
+indigo_error_t ind_ofdpa_oam_cache_init(uint32_t interval_ms)
+{
+  indigo_core_gentable_register("ofdpa_oam_mep", &oamMepGentableOps, NULL,
+                                IND_OFDPA_OAM_MEP_GENTABLE_MAX,
+                                IND_OFDPA_OAM_MEP_GENTABLE_BUCKETS,
+                                &oamMepGentable);
+
+  oamCacheIntervalMs = interval_ms;
+  if (oamCacheIntervalMs == 0)
+  {
+    LOG_VERBOSE("OAM MEP collector disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  oamCacheCollector.intervalMs = oamCacheIntervalMs;
+  if (ind_ofdpa_collector_register(&oamCacheCollector) != INDIGO_ERROR_NONE)
+  {
+    oamCacheIntervalMs = 0;
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  /* Have a snapshot ready for the first request */
+  ind_ofdpa_collector_refresh(&oamCacheCollector);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* True once a complete snapshot is available */
+int ind_ofdpa_oam_cache_enabled(void)
+{
+  return (oamCacheIntervalMs != 0) &&
+    (ind_ofdpa_stats_generation_get(IND_OFDPA_COLLECT_CLASS_OAM) != 0);
+}
+
+/* Call fn for each MEP whose remote MEP state changed in the last walk */
+void ind_ofdpa_oam_cache_change_foreach(void (*fn)(const ind_ofdpa_oam_mep_state_t *state,
+                                                   void *arg),
+                                        void *arg)
+{
+  uint32_t i;
+
+  for (i = 0; i < oamCurrent.count; i++)
+  {
+    if (oamCurrent.entries[i].changed)
+    {
+      fn(&oamCurrent.entries[i], arg);
+    }
+  }
+}
+
+static int oam_notify_latency_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x < y) ? -1 : (x > y);
+}
+
+void ind_ofdpa_oam_notify_show(void)
+{
+  static uint32_t sorted[IND_OFDPA_OAM_NOTIFY_SAMPLES];
+  uint32_t count;
+
+  if ((notifyCount == 0) && (notifyFailures == 0))
+  {
+    return;
+  }
+
+  LOG_INFO("OAM notifications: %"PRIu64" sent, %"PRIu64" failed",
+           notifyCount, notifyFailures);
+
+  count = (notifyCount < IND_OFDPA_OAM_NOTIFY_SAMPLES) ?
+    (uint32_t)notifyCount : IND_OFDPA_OAM_NOTIFY_SAMPLES;
+  if (count == 0)
+  {
+    return;
+  }
+
+  memcpy(sorted, notifyLatencySamples, count * sizeof(sorted[0]));
+  qsort(sorted, count, sizeof(sorted[0]), oam_notify_latency_cmp);
+
+  LOG_INFO("  detect to send latency us: p50 %u p99 %u max %u",
+           sorted[(count * 50) / 100], sorted[(count * 99) / 100], sorted[count - 1]);
+}
+
+/* Runs in the SocketManager loop; rxTime is os_time_monotonic() when
+   the event was read from OF-DPA */
+void ind_ofdpa_oam_event_process(ofdpaOamEvent_t *oamEventData, uint64_t rxTime)
+{
+  ind_ofdpa_oam_mep_state_t state;
+  ind_ofdpa_oam_mep_state_t *cached;
+
+  LOG_TRACE("OAM event 0x%x on MEG %u MEP %u", oamEventData->eventMask,
+            oamEventData->megIndex, oamEventData->mepId);
+
+  cached = oam_cache_lookup(&oamCurrent, oamEventData->mepId);
+  if (cached != NULL)
+  {
+    state = *cached;
+  }
+  else
+  {
+    memset(&state, 0, sizeof(state));
+    state.lmepId = oamEventData->mepId;
+  }
+  ind_ofdpa_oam_notify_send(IND_OFDPA_OAM_NOTIFY_EVENT, &state, oamEventData->megIndex,
+                            oamEventData->eventMask, rxTime);
+
+  if (oamCacheIntervalMs != 0)
+  {
+    ind_ofdpa_collector_refresh(&oamCacheCollector);
+  }
+}
+
+int ind_ofdpa_oam_event_receive(void)
+{
+  ofdpaOamEvent_t oamEventData;
+  int count = 0;
+
+  LOG_TRACE("Reading OAM Events");
+
+  memset(&oamEventData, 0, sizeof(oamEventData));
+  while (IND_OFDPA_RPC(ofdpaOamEventNextGet, &oamEventData) == OFDPA_E_NONE)
+  {
+    ind_ofdpa_oam_event_process(&oamEventData, os_time_monotonic());
+    count++;
+  }
+
+  return count;
+}
+
+/*
+ * ofdpa_oam_mep gentable
+ *
+ * Key is a port TLV holding a local MEP id; LOXI has no MEP id TLV. The
+ * entry stats report the CCMs sent (tx_packets) and received
+ * (rx_packets) by the MEP, and the number of its remote MEPs
+ * (request_packets), of those up (reply_packets) and of those failed
+ * (miss_packets). A gentable entry stats request returns every MEP the
+ * controller added in one reply.
+ */
+
+static indigo_error_t oam_mep_parse_key(of_list_bsn_tlv_t *key, uint32_t *lmepId)
+{
+  of_bsn_tlv_t tlv;
+
+  if (of_list_bsn_tlv_first(key, &tlv) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  if (tlv.header.object_id != OF_BSN_TLV_PORT)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  of_bsn_tlv_port_value_get(&tlv.port, lmepId);
+
+  if (of_list_bsn_tlv_next(key, &tlv) == 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t oam_mep_gentable_add(void *table_priv, of_list_bsn_tlv_t *key,
+                                           of_list_bsn_tlv_t *value, void **entry_priv)
+{
+  uint32_t lmepId;
+  indigo_error_t rv;
+
+  rv = oam_mep_parse_key(key, &lmepId);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    return rv;
+  }
+
+  *entry_priv = (void *)(uintptr_t)lmepId;
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t oam_mep_gentable_modify(void *table_priv, void *entry_priv,
+                                              of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *value)
+{
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t oam_mep_gentable_delete(void *table_priv, void *entry_priv,
+                                              of_list_bsn_tlv_t *key)
+{
+  return INDIGO_ERROR_NONE;
+}
+
+static void oam_mep_stats_append(of_list_bsn_tlv_t *stats, of_object_t *tlv)
+{
+  if (tlv != NULL)
+  {
+    of_list_append(stats, tlv);
+    of_object_delete(tlv);
+  }
+}
+
+static void oam_mep_gentable_get_stats(void *table_priv, void *entry_priv,
+                                       of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *stats)
+{
+  uint32_t lmepId = (uint32_t)(uintptr_t)entry_priv;
+  ind_ofdpa_oam_mep_state_t state;
+  ind_ofdpa_oam_mep_state_t *cached;
+  of_object_t *tlv;
+
+  /* MEPs created since the last walk are read directly */
+  if (ind_ofdpa_oam_cache_enabled() &&
+      ((cached = oam_cache_lookup(&oamCurrent, lmepId)) != NULL))
+  {
+    state = *cached;
+  }
+  else if (oam_mep_state_read(lmepId, &state) != OFDPA_E_NONE)
+  {
+    return;
+  }
+
+  tlv = of_bsn_tlv_tx_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_tx_packets_value_set(tlv, state.ccmSent);
+  }
+  oam_mep_stats_append(stats, tlv);
+
+  tlv = of_bsn_tlv_rx_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_rx_packets_value_set(tlv, state.ccmReceived);
+  }
+  oam_mep_stats_append(stats, tlv);
+
+  tlv = of_bsn_tlv_request_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_request_packets_value_set(tlv, state.remoteCount);
+  }
+  oam_mep_stats_append(stats, tlv);
+
+  tlv = of_bsn_tlv_reply_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_reply_packets_value_set(tlv, state.remoteOk);
+  }
+  oam_mep_stats_append(stats, tlv);
+
+  tlv = of_bsn_tlv_miss_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_miss_packets_value_set(tlv, state.remoteFailed);
+  }
+  oam_mep_stats_append(stats, tlv);
+}
+
+static const indigo_core_gentable_ops_t oamMepGentableOps =
+{
+  .add = oam_mep_gentable_add,
+  .modify = oam_mep_gentable_modify,
+  .del = oam_mep_gentable_delete,
+  .get_stats = oam_mep_gentable_get_stats,
+};
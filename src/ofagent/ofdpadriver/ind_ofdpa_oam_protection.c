@@ -0,0 +1,260 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_oam_protection.c
+*
+* @purpose    Agent-local MPLS-TP linear protection for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   A MEP in a protection group has a liveness logical port,
+*             which the buckets of the MPLS fast failover group watch.
+*             When the OAM MEP walk finds that such a MEP has lost all of
+*             its remote MEPs, the liveness port is set administratively
+*             down so the group fails over without waiting for the
+*             controller, which is notified afterwards. The port is set
+*             up again once a remote MEP is back, or if the MEP is
+*             deleted. Only ports set down here are ever set up again.
+*
+*             The time from reading the MEP state to the liveness port
+*             being set down is kept as a log2 histogram in microseconds.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_oam_notify.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+#include <OS/os_time.h>
+
+#define IND_OFDPA_OAM_PROTECTION_BUCKETS  256
+
+/* Bucket i counts switchovers taking [2^i, 2^(i+1)) us, bucket 0 also
+   those under 1 us; the last bucket takes everything above */
+#define IND_OFDPA_OAM_PROTECTION_HIST_BUCKETS  24
+
+/* A liveness port set down by the agent */
+typedef struct ind_ofdpa_oam_protection_entry_s
+{
+  bighash_entry_t hash_entry;
+  uint32_t lmepId;
+  uint32_t livenessPort;
+} ind_ofdpa_oam_protection_entry_t;
+
+#define TEMPLATE_NAME oam_protection_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_oam_protection_entry_t
+#define TEMPLATE_KEY_FIELD lmepId
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+static bighash_table_t *protectionTable;
+
+static uint64_t switchoverHist[IND_OFDPA_OAM_PROTECTION_HIST_BUCKETS];
+static uint64_t switchoverCount;
+static uint64_t restoreCount;
+static uint64_t protectionFailures;
+
+indigo_error_t ind_ofdpa_oam_protection_init(int enable)
+{
+  if (!enable)
+  {
+    LOG_VERBOSE("OAM protection switching disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  protectionTable = bighash_table_create(IND_OFDPA_OAM_PROTECTION_BUCKETS);
+  if (protectionTable == NULL)
+  {
+    LOG_ERROR("Failed to create OAM protection table");
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static void protection_latency_record(uint64_t detectTime)
+{
+  uint64_t latency = os_time_monotonic() - detectTime;
+  int bucket = 0;
+
+  while (((latency >> 1) != 0) && (bucket < (IND_OFDPA_OAM_PROTECTION_HIST_BUCKETS - 1)))
+  {
+    latency >>= 1;
+    bucket++;
+  }
+
+  switchoverHist[bucket]++;
+  switchoverCount++;
+}
+
+/* Changes only the down bit, other config set on the port is kept */
+static OFDPA_ERROR_t protection_port_down_set(uint32_t port, int down)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+  uint32_t config = 0;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortConfigGet, port, &config);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return ofdpa_rv;
+  }
+
+  if (down)
+  {
+    config |= OFDPA_PORT_CONFIG_DOWN;
+  }
+  else
+  {
+    config &= ~OFDPA_PORT_CONFIG_DOWN;
+  }
+
+  return IND_OFDPA_RPC(ofdpaPortConfigSet, port, config);
+}
+
+static void protection_restore(ind_ofdpa_oam_protection_entry_t *entry)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  ofdpa_rv = protection_port_down_set(entry->livenessPort, 0);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    /* Forgotten anyway, the port may be gone with its MEP */
+    protectionFailures++;
+    LOG_ERROR("Failed to set liveness port 0x%x of MEP %u up, rv = %d",
+              entry->livenessPort, entry->lmepId, ofdpa_rv);
+  }
+  else
+  {
+    restoreCount++;
+  }
+
+  bighash_remove(protectionTable, &entry->hash_entry);
+  free(entry);
+}
+
+/* Called from the OAM MEP walk for each MEP whose remote MEP state
+   changed. Runs in the SocketManager loop. */
+void ind_ofdpa_oam_protection_update(const ind_ofdpa_oam_mep_state_t *state)
+{
+  ind_ofdpa_oam_protection_entry_t *entry;
+  uint32_t lmepId = state->lmepId;
+  OFDPA_ERROR_t ofdpa_rv;
+  int failed;
+
+  if ((protectionTable == NULL) || (state->livenessPort == 0))
+  {
+    return;
+  }
+
+  failed = (state->remoteCount != 0) && (state->remoteOk == 0);
+  entry = oam_protection_hashtable_first(protectionTable, &lmepId);
+
+  if (failed && (entry == NULL))
+  {
+    ofdpa_rv = protection_port_down_set(state->livenessPort, 1);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      protectionFailures++;
+      LOG_ERROR("Failed to set liveness port 0x%x of MEP %u down, rv = %d",
+                state->livenessPort, lmepId, ofdpa_rv);
+      return;
+    }
+    protection_latency_record(state->readTime);
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+    {
+      /* The port stays down until the controller sets it up */
+      LOG_ERROR("Failed to track liveness port 0x%x of MEP %u",
+                state->livenessPort, lmepId);
+    }
+    else
+    {
+      entry->lmepId = lmepId;
+      entry->livenessPort = state->livenessPort;
+      oam_protection_hashtable_insert(protectionTable, entry);
+    }
+
+    LOG_INFO("MEP %u lost its remote MEPs, liveness port 0x%x set down",
+             lmepId, state->livenessPort);
+    ind_ofdpa_oam_notify_send(IND_OFDPA_OAM_NOTIFY_FAILOVER, state,
+                              state->livenessPort, 0, state->readTime);
+  }
+  else if (!failed && (entry != NULL))
+  {
+    protection_restore(entry);
+
+    LOG_INFO("MEP %u has remote MEPs again, liveness port 0x%x set up",
+             lmepId, state->livenessPort);
+    ind_ofdpa_oam_notify_send(IND_OFDPA_OAM_NOTIFY_RESTORE, state,
+                              state->livenessPort, 0, state->readTime);
+  }
+}
+
+/* Set up the liveness ports of MEPs deleted since they were set down */
+void ind_ofdpa_oam_protection_sweep(void)
+{
+  ind_ofdpa_oam_protection_entry_t *entry;
+  bighash_iter_t iter;
+
+  if (protectionTable == NULL)
+  {
+    return;
+  }
+
+  for (entry = bighash_iter_start(protectionTable, &iter);
+       entry != NULL; entry = bighash_iter_next(&iter))
+  {
+    if (IND_OFDPA_RPC(ofdpaOamMepGet, entry->lmepId, NULL, NULL) != OFDPA_E_NONE)
+    {
+      LOG_VERBOSE("MEP %u deleted, setting liveness port 0x%x up",
+                  entry->lmepId, entry->livenessPort);
+      protection_restore(entry);
+    }
+  }
+}
+
+void ind_ofdpa_oam_protection_show(void)
+{
+  int i;
+
+  if (protectionTable == NULL)
+  {
+    return;
+  }
+
+  LOG_INFO("OAM protection: %"PRIu64" switchovers, %"PRIu64" restores, "
+           "%"PRIu64" failures, %d liveness ports down",
+           switchoverCount, restoreCount, protectionFailures,
+           bighash_entry_count(protectionTable));
+
+  for (i = 0; i < IND_OFDPA_OAM_PROTECTION_HIST_BUCKETS; i++)
+  {
+    if (switchoverHist[i] != 0)
+    {
+      LOG_INFO("  switchover latency %u us and up: %"PRIu64, 1u << i, switchoverHist[i]);
+    }
+  }
+}
@@ -0,0 +1,356 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_pdu_tx.c
+*
+* @purpose    Periodic PDU transmission for the OF-DPA Driver
+*
+* @comments   A controller configures a packet to be sent out of a port
+*             every tx_interval_ms with a bsn_pdu_tx_request, instead of
+*             sending the same LLDP or keepalive packet-out over and over.
+*             Each (port, slot) keeps a copy of its packet. Entries are
+*             kept on a timer wheel that is advanced by one SocketManager
+*             timer, and the entries due in a tick are sent together.
+*             An interval of 0 stops transmission for the slot.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "indigo/of_connection_manager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <OS/os_time.h>
+#include <SocketManager/socketmanager.h>
+
+/* Configured (port, slot) pairs */
+#define IND_OFDPA_PDU_TX_MAX_ENTRIES  1024
+
+/* Largest packet accepted in a bsn_pdu_tx_request */
+#define IND_OFDPA_PDU_TX_MAX_LEN      1518
+
+/* Wheel resolution and size; longer intervals go around more than once */
+#define IND_OFDPA_PDU_TX_TICK_MS      10
+#define IND_OFDPA_PDU_TX_WHEEL_SLOTS  256
+
+typedef struct
+{
+  list_links_t links;
+  int inUse;
+  uint32_t port;
+  uint8_t slot;
+  uint32_t intervalMs;
+  uint32_t rounds;              /* wheel turns left before it is due */
+  uint8_t *data;
+  uint32_t len;
+  uint64_t txPackets;
+  uint64_t txErrors;
+} ind_ofdpa_pdu_tx_entry_t;
+
+static ind_ofdpa_pdu_tx_entry_t entries[IND_OFDPA_PDU_TX_MAX_ENTRIES];
+static int activeCount;
+
+static list_head_t wheel[IND_OFDPA_PDU_TX_WHEEL_SLOTS];
+static uint64_t wheelTick;
+static uint64_t wheelStartUs;
+
+/* Entries sent in the last timer callback, and the largest such batch */
+static ind_ofdpa_pdu_tx_entry_t *due[IND_OFDPA_PDU_TX_MAX_ENTRIES];
+static uint32_t maxBatch;
+static uint64_t lateTicks;
+
+static ind_ofdpa_pdu_tx_entry_t *pdu_tx_find(uint32_t port, uint8_t slot)
+{
+  int i;
+
+  for (i = 0; i < IND_OFDPA_PDU_TX_MAX_ENTRIES; i++)
+  {
+    if (entries[i].inUse && (entries[i].port == port) && (entries[i].slot == slot))
+    {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static ind_ofdpa_pdu_tx_entry_t *pdu_tx_alloc(void)
+{
+  int i;
+
+  for (i = 0; i < IND_OFDPA_PDU_TX_MAX_ENTRIES; i++)
+  {
+    if (!entries[i].inUse)
+    {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static void pdu_tx_schedule(ind_ofdpa_pdu_tx_entry_t *entry)
+{
+  uint64_t ticks = entry->intervalMs / IND_OFDPA_PDU_TX_TICK_MS;
+
+  if (ticks == 0)
+  {
+    ticks = 1;
+  }
+
+  entry->rounds = (ticks - 1) / IND_OFDPA_PDU_TX_WHEEL_SLOTS;
+  list_push(&wheel[(wheelTick + ticks) % IND_OFDPA_PDU_TX_WHEEL_SLOTS], &entry->links);
+}
+
+static void pdu_tx_send(ind_ofdpa_pdu_tx_entry_t *entry)
+{
+  ofdpa_buffdesc pkt;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  pkt.pstart = (char *)entry->data;
+  pkt.size = entry->len;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPktSend, &pkt, 0, entry->port, 0);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    entry->txErrors++;
+    LOG_TRACE("PDU send on port %u slot %u failed, rv = %d",
+              entry->port, entry->slot, ofdpa_rv);
+  }
+  else
+  {
+    entry->txPackets++;
+  }
+}
+
+static void pdu_tx_timer(void *cookie)
+{
+  uint64_t nowTick;
+  uint32_t count = 0;
+  uint32_t i;
+  list_links_t *cur, *next;
+  ind_ofdpa_pdu_tx_entry_t *entry;
+
+  nowTick = (os_time_monotonic() - wheelStartUs) / (IND_OFDPA_PDU_TX_TICK_MS * 1000);
+
+  /* Catch up on ticks missed while the event loop was busy, but never
+     more than one turn: every bucket has been visited by then */
+  if (nowTick > wheelTick + IND_OFDPA_PDU_TX_WHEEL_SLOTS)
+  {
+    lateTicks += nowTick - wheelTick - IND_OFDPA_PDU_TX_WHEEL_SLOTS;
+    wheelTick = nowTick - IND_OFDPA_PDU_TX_WHEEL_SLOTS;
+  }
+
+  while (wheelTick < nowTick)
+  {
+    wheelTick++;
+    LIST_FOREACH_SAFE(&wheel[wheelTick % IND_OFDPA_PDU_TX_WHEEL_SLOTS], cur, next)
+    {
+      entry = container_of(cur, links, ind_ofdpa_pdu_tx_entry_t);
+      if (entry->rounds > 0)
+      {
+        entry->rounds--;
+        continue;
+      }
+      list_remove(cur);
+      due[count++] = entry;
+    }
+  }
+
+  if (count > maxBatch)
+  {
+    maxBatch = count;
+  }
+
+  /* Rescheduled only after the walk, so an entry is never seen twice */
+  for (i = 0; i < count; i++)
+  {
+    pdu_tx_send(due[i]);
+    pdu_tx_schedule(due[i]);
+  }
+}
+
+static void pdu_tx_entry_free(ind_ofdpa_pdu_tx_entry_t *entry)
+{
+  list_remove(&entry->links);
+  free(entry->data);
+  memset(entry, 0, sizeof(*entry));
+
+  if (--activeCount == 0)
+  {
+    ind_soc_timer_event_unregister(pdu_tx_timer, NULL);
+  }
+}
+
+static indigo_error_t pdu_tx_set(uint32_t port, uint8_t slot, uint32_t intervalMs,
+                                 const of_octets_t *data)
+{
+  ind_ofdpa_pdu_tx_entry_t *entry;
+  uint8_t *copy;
+  indigo_error_t err;
+
+  entry = pdu_tx_find(port, slot);
+
+  if (intervalMs == 0)
+  {
+    if (entry != NULL)
+    {
+      pdu_tx_entry_free(entry);
+      LOG_VERBOSE("Stopped PDU transmission on port %u slot %u", port, slot);
+    }
+    return INDIGO_ERROR_NONE;
+  }
+
+  if ((data->bytes == 0) || (data->bytes > IND_OFDPA_PDU_TX_MAX_LEN))
+  {
+    LOG_ERROR("Invalid PDU length %d for port %u slot %u", data->bytes, port, slot);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  copy = malloc(data->bytes);
+  if (copy == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  memcpy(copy, data->data, data->bytes);
+
+  if (entry != NULL)
+  {
+    list_remove(&entry->links);
+    free(entry->data);
+  }
+  else
+  {
+    entry = pdu_tx_alloc();
+    if (entry == NULL)
+    {
+      LOG_ERROR("No free PDU transmit entry for port %u slot %u", port, slot);
+      free(copy);
+      return INDIGO_ERROR_RESOURCE;
+    }
+
+    if (activeCount == 0)
+    {
+      wheelStartUs = os_time_monotonic();
+      wheelTick = 0;
+      err = ind_soc_timer_event_register(pdu_tx_timer, NULL, IND_OFDPA_PDU_TX_TICK_MS);
+      if (err != INDIGO_ERROR_NONE)
+      {
+        LOG_ERROR("Failed to register PDU transmit timer");
+        free(copy);
+        return err;
+      }
+    }
+
+    entry->inUse = 1;
+    entry->port = port;
+    entry->slot = slot;
+    activeCount++;
+  }
+
+  entry->intervalMs = intervalMs;
+  entry->data = copy;
+  entry->len = data->bytes;
+
+  /* The first packet goes out now, as a packet-out would have */
+  pdu_tx_send(entry);
+  pdu_tx_schedule(entry);
+
+  LOG_VERBOSE("PDU transmission on port %u slot %u every %u ms, %u bytes",
+              port, slot, intervalMs, entry->len);
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_core_listener_result_t pdu_tx_message_listener(indigo_cxn_id_t cxn_id,
+                                                             of_object_t *msg)
+{
+  of_bsn_pdu_tx_reply_t *reply;
+  of_octets_t data;
+  of_port_no_t port;
+  uint32_t intervalMs;
+  uint32_t xid;
+  uint8_t slot;
+  indigo_error_t err;
+
+  if (msg->object_id != OF_BSN_PDU_TX_REQUEST)
+  {
+    return INDIGO_CORE_LISTENER_RESULT_PASS;
+  }
+
+  of_bsn_pdu_tx_request_xid_get(msg, &xid);
+  of_bsn_pdu_tx_request_port_no_get(msg, &port);
+  of_bsn_pdu_tx_request_slot_num_get(msg, &slot);
+  of_bsn_pdu_tx_request_tx_interval_ms_get(msg, &intervalMs);
+  of_bsn_pdu_tx_request_data_get(msg, &data);
+
+  err = pdu_tx_set(port, slot, intervalMs, &data);
+
+  reply = of_bsn_pdu_tx_reply_new(msg->version);
+  if (reply == NULL)
+  {
+    LOG_ERROR("Failed to allocate bsn_pdu_tx_reply");
+    return INDIGO_CORE_LISTENER_RESULT_DROP;
+  }
+
+  of_bsn_pdu_tx_reply_xid_set(reply, xid);
+  of_bsn_pdu_tx_reply_status_set(reply, (err == INDIGO_ERROR_NONE) ? 0 : 1);
+  of_bsn_pdu_tx_reply_port_no_set(reply, port);
+  of_bsn_pdu_tx_reply_slot_num_set(reply, slot);
+  indigo_cxn_send_controller_message(cxn_id, reply);
+
+  return INDIGO_CORE_LISTENER_RESULT_DROP;
+}
+
+indigo_error_t ind_ofdpa_pdu_tx_init(void)
+{
+  int i;
+
+  for (i = 0; i < IND_OFDPA_PDU_TX_WHEEL_SLOTS; i++)
+  {
+    list_init(&wheel[i]);
+  }
+
+  return indigo_core_message_listener_register(pdu_tx_message_listener);
+}
+
+void ind_ofdpa_pdu_tx_show(void)
+{
+  int i;
+
+  if (activeCount == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("PDU transmit: %d entries, largest batch %u, %"PRIu64" ticks late",
+           activeCount, maxBatch, lateTicks);
+  for (i = 0; i < IND_OFDPA_PDU_TX_MAX_ENTRIES; i++)
+  {
+    if (entries[i].inUse)
+    {
+      LOG_INFO("  port %u slot %u: every %u ms, %u bytes, sent %"PRIu64" errors %"PRIu64,
+               entries[i].port, entries[i].slot, entries[i].intervalMs, entries[i].len,
+               entries[i].txPackets, entries[i].txErrors);
+    }
+  }
+}
@@ -0,0 +1,215 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_pkt_buffer.c
+*
+* @purpose    Packet-in buffers for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   When packet buffers are configured, a punted packet longer
+*             than the controller asked for is kept here. The packet-in
+*             then carries only the first max_len bytes and a buffer_id,
+*             and a packet-out naming that buffer_id sends the full
+*             packet. For table misses, max_len is the miss_send_len of
+*             the last set_config. Buffers are reused round robin, so an
+*             id that is not used soon enough goes stale and the
+*             packet-out for it fails. Packet-ins can be built on the
+*             packet thread, so the store is locked.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+/* Default miss_send_len until a controller sends set_config */
+#define IND_OFDPA_PKT_BUFFER_MISS_LEN 128
+
+/* Buffer ids are the slot in the low 16 bits and a generation above */
+#define IND_OFDPA_PKT_BUFFER_ID(_gen, _slot)  (((_gen) << 16) | (_slot))
+#define IND_OFDPA_PKT_BUFFER_SLOT(_id)        ((_id) & 0xffff)
+#define IND_OFDPA_PKT_BUFFER_GEN(_id)         ((_id) >> 16)
+#define IND_OFDPA_PKT_BUFFER_GEN_MAX          0x7fff
+
+typedef struct
+{
+  uint32_t bufferId;
+  uint32_t inPort;
+  uint32_t len;
+  int valid;
+} ind_ofdpa_pkt_buffer_slot_t;
+
+static pthread_mutex_t bufferLock = PTHREAD_MUTEX_INITIALIZER;
+static ind_ofdpa_pkt_buffer_slot_t *slots;
+static uint8_t *bufferData;
+static uint32_t bufferCount;
+static uint32_t nextSlot;
+static uint32_t generation;
+
+static uint16_t missSendLen = IND_OFDPA_PKT_BUFFER_MISS_LEN;
+
+static uint64_t stored;
+static uint64_t used;
+static uint64_t stale;
+static uint64_t evicted;
+
+static indigo_core_listener_result_t pkt_buffer_message_listener(indigo_cxn_id_t cxn_id,
+                                                                 of_object_t *msg)
+{
+  uint16_t len;
+
+  /* Recorded here and left to the state manager */
+  if (msg->object_id == OF_SET_CONFIG)
+  {
+    of_set_config_miss_send_len_get(msg, &len);
+    __atomic_store_n(&missSendLen, len, __ATOMIC_RELAXED);
+  }
+
+  return INDIGO_CORE_LISTENER_RESULT_PASS;
+}
+
+uint32_t ind_ofdpa_pkt_buffer_count(void)
+{
+  return bufferCount;
+}
+
+uint16_t ind_ofdpa_pkt_buffer_miss_send_len(void)
+{
+  return __atomic_load_n(&missSendLen, __ATOMIC_RELAXED);
+}
+
+uint32_t ind_ofdpa_pkt_buffer_store(uint32_t inPort, const uint8_t *data, uint32_t len)
+{
+  ind_ofdpa_pkt_buffer_slot_t *slot;
+  uint32_t bufferId;
+
+  if ((bufferCount == 0) || (len > IND_OFDPA_PKT_BUFFER_LEN))
+  {
+    return OF_BUFFER_ID_NO_BUFFER;
+  }
+
+  pthread_mutex_lock(&bufferLock);
+
+  slot = &slots[nextSlot];
+  if (slot->valid)
+  {
+    evicted++;
+  }
+
+  bufferId = IND_OFDPA_PKT_BUFFER_ID(generation, nextSlot);
+  slot->bufferId = bufferId;
+  slot->inPort = inPort;
+  slot->len = len;
+  slot->valid = 1;
+  memcpy(bufferData + ((size_t)nextSlot * IND_OFDPA_PKT_BUFFER_LEN), data, len);
+
+  if (++nextSlot == bufferCount)
+  {
+    nextSlot = 0;
+    generation = (generation == IND_OFDPA_PKT_BUFFER_GEN_MAX) ? 0 : generation + 1;
+  }
+  stored++;
+
+  pthread_mutex_unlock(&bufferLock);
+
+  return bufferId;
+}
+
+/* Copy a buffered packet out and free the buffer; data must hold
+   IND_OFDPA_PKT_BUFFER_LEN bytes */
+indigo_error_t ind_ofdpa_pkt_buffer_take(uint32_t bufferId, uint8_t *data,
+                                         uint32_t *len, uint32_t *inPort)
+{
+  ind_ofdpa_pkt_buffer_slot_t *slot;
+  uint32_t index = IND_OFDPA_PKT_BUFFER_SLOT(bufferId);
+
+  if ((index >= bufferCount) || (IND_OFDPA_PKT_BUFFER_GEN(bufferId) > IND_OFDPA_PKT_BUFFER_GEN_MAX))
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  pthread_mutex_lock(&bufferLock);
+
+  slot = &slots[index];
+  if (!slot->valid || (slot->bufferId != bufferId))
+  {
+    stale++;
+    pthread_mutex_unlock(&bufferLock);
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  memcpy(data, bufferData + ((size_t)index * IND_OFDPA_PKT_BUFFER_LEN), slot->len);
+  *len = slot->len;
+  *inPort = slot->inPort;
+  slot->valid = 0;
+  used++;
+
+  pthread_mutex_unlock(&bufferLock);
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t ind_ofdpa_pkt_buffer_init(uint32_t count)
+{
+  if (count == 0)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  if (count > 0x10000)
+  {
+    LOG_ERROR("At most 65536 packet buffers are supported, %u requested", count);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  slots = calloc(count, sizeof(*slots));
+  bufferData = ind_ofdpa_pool_alloc((size_t)count * IND_OFDPA_PKT_BUFFER_LEN);
+  if ((slots == NULL) || (bufferData == NULL))
+  {
+    LOG_ERROR("Failed to allocate %u packet buffers", count);
+    free(slots);
+    ind_ofdpa_pool_free(bufferData, (size_t)count * IND_OFDPA_PKT_BUFFER_LEN);
+    slots = NULL;
+    bufferData = NULL;
+    return INDIGO_ERROR_RESOURCE;
+  }
+  bufferCount = count;
+
+  return indigo_core_message_listener_register(pkt_buffer_message_listener);
+}
+
+void ind_ofdpa_pkt_buffer_show(void)
+{
+  if (bufferCount == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("Packet buffers: %u, miss_send_len %u, %"PRIu64" stored, %"PRIu64" used, "
+           "%"PRIu64" overwritten unused, %"PRIu64" stale packet-outs",
+           bufferCount, ind_ofdpa_pkt_buffer_miss_send_len(),
+           stored, used, evicted, stale);
+}
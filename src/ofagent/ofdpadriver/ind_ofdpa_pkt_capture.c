@@ -0,0 +1,276 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_pkt_capture.c
+*
+* @purpose    Sampled capture of punted packets for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Keeps a ring of the last N sampled packets received from
+*             the OF-DPA packet socket. The ring can be logged or written
+*             to a file in pcap format. Nothing is recorded while the
+*             ring size is 0.
+*
+*             The packet thread writes the ring while a SIGHUP dump
+*             reads it from the main thread. Each slot has a sequence
+*             count that is odd while the slot is being written, and the
+*             dump copies a slot out and retries if the count moved.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+/* Number of packet bytes kept for each captured packet */
+#define IND_OFDPA_PKT_CAPTURE_SNAPLEN 128
+
+#define IND_OFDPA_PCAP_MAGIC         0xa1b2c3d4
+#define IND_OFDPA_PCAP_VERSION_MAJOR 2
+#define IND_OFDPA_PCAP_VERSION_MINOR 4
+#define IND_OFDPA_PCAP_LINKTYPE_ETH  1
+
+typedef struct ind_ofdpa_pkt_capture_entry_s
+{
+  uint32_t seq;              /* odd while the slot is being written */
+  uint64_t index;            /* capture number stored in the slot */
+  struct timeval timestamp;
+  uint32_t inPortNum;
+  uint32_t reason;
+  uint32_t tableId;
+  uint32_t length;           /* length of the packet on the wire */
+  uint32_t capLength;        /* bytes stored in data[] */
+  uint8_t data[IND_OFDPA_PKT_CAPTURE_SNAPLEN];
+} ind_ofdpa_pkt_capture_entry_t;
+
+typedef struct
+{
+  uint32_t magic;
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  int32_t  thisZone;
+  uint32_t sigFigs;
+  uint32_t snapLen;
+  uint32_t linkType;
+} ind_ofdpa_pcap_file_header_t;
+
+typedef struct
+{
+  uint32_t tsSec;
+  uint32_t tsUsec;
+  uint32_t capLen;
+  uint32_t len;
+} ind_ofdpa_pcap_record_header_t;
+
+static ind_ofdpa_pkt_capture_entry_t *captureRing;
+static uint32_t captureRingSize;
+static uint32_t captureSampleRate;
+static uint32_t captureSampleCount;
+static uint64_t captureTotal;         /* number of packets captured */
+
+/* Attempts to copy a slot that keeps being rewritten before giving up */
+#define IND_OFDPA_PKT_CAPTURE_READ_RETRIES 8
+
+indigo_error_t ind_ofdpa_pkt_capture_init(uint32_t ring_size, uint32_t sample_rate)
+{
+  ind_ofdpa_pool_free(captureRing, (size_t)captureRingSize * sizeof(*captureRing));
+  captureRing = NULL;
+  captureRingSize = 0;
+  captureTotal = 0;
+  captureSampleCount = 0;
+  captureSampleRate = (sample_rate == 0) ? 1 : sample_rate;
+
+  if (ring_size == 0)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  captureRing = ind_ofdpa_pool_alloc((size_t)ring_size * sizeof(*captureRing));
+  if (captureRing == NULL)
+  {
+    LOG_ERROR("Failed to allocate packet capture ring of %u entries", ring_size);
+    return INDIGO_ERROR_RESOURCE;
+  }
+  captureRingSize = ring_size;
+
+  LOG_VERBOSE("Packet capture enabled. (entries = %u, sample 1 in %u)",
+              captureRingSize, captureSampleRate);
+
+  return INDIGO_ERROR_NONE;
+}
+
+int ind_ofdpa_pkt_capture_enabled(void)
+{
+  return (captureRingSize != 0);
+}
+
+void ind_ofdpa_pkt_capture_record(ofdpaPacket_t *pkt)
+{
+  ind_ofdpa_pkt_capture_entry_t *entry;
+
+  if (++captureSampleCount < captureSampleRate)
+  {
+    return;
+  }
+  captureSampleCount = 0;
+
+  entry = &captureRing[captureTotal % captureRingSize];
+  __atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  entry->index = captureTotal;
+  gettimeofday(&entry->timestamp, NULL);
+  entry->inPortNum = pkt->inPortNum;
+  entry->reason = pkt->reason;
+  entry->tableId = pkt->tableId;
+  entry->length = pkt->pktData.size;
+  entry->capLength = (pkt->pktData.size < IND_OFDPA_PKT_CAPTURE_SNAPLEN) ?
+    pkt->pktData.size : IND_OFDPA_PKT_CAPTURE_SNAPLEN;
+  memcpy(entry->data, pkt->pktData.pstart, entry->capLength);
+
+  __atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&captureTotal, captureTotal + 1, __ATOMIC_RELEASE);
+}
+
+/* Oldest capture number still in the ring and the number after the
+   newest */
+static void pkt_capture_window(uint64_t *first, uint64_t *end)
+{
+  *end = __atomic_load_n(&captureTotal, __ATOMIC_ACQUIRE);
+  *first = (*end > captureRingSize) ? (*end - captureRingSize) : 0;
+}
+
+/* Copies out the given capture. Fails if it has been overwritten by a
+   newer one, or was being written on every attempt. */
+static int pkt_capture_entry_copy(uint64_t index, ind_ofdpa_pkt_capture_entry_t *copy)
+{
+  ind_ofdpa_pkt_capture_entry_t *entry = &captureRing[index % captureRingSize];
+  uint32_t seq;
+  int retry;
+
+  for (retry = 0; retry < IND_OFDPA_PKT_CAPTURE_READ_RETRIES; retry++)
+  {
+    seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+    {
+      continue;
+    }
+    memcpy(copy, entry, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq)
+    {
+      return (copy->index == index);
+    }
+  }
+
+  return 0;
+}
+
+void ind_ofdpa_pkt_capture_show(void)
+{
+  ind_ofdpa_pkt_capture_entry_t entry;
+  uint64_t first, end, i;
+
+  if (!ind_ofdpa_pkt_capture_enabled())
+  {
+    LOG_INFO("Packet capture is disabled");
+    return;
+  }
+
+  pkt_capture_window(&first, &end);
+  LOG_INFO("Last %u captured packets (sample 1 in %u):",
+           (uint32_t)(end - first), captureSampleRate);
+  for (i = first; i < end; i++)
+  {
+    if (!pkt_capture_entry_copy(i, &entry))
+    {
+      continue;
+    }
+    LOG_INFO("%ld.%06ld port %u reason %u table %u length %u",
+             (long)entry.timestamp.tv_sec, (long)entry.timestamp.tv_usec,
+             entry.inPortNum, entry.reason, entry.tableId, entry.length);
+  }
+}
+
+indigo_error_t ind_ofdpa_pkt_capture_pcap_write(const char *filename)
+{
+  FILE *fp;
+  ind_ofdpa_pcap_file_header_t fileHeader;
+  ind_ofdpa_pcap_record_header_t recordHeader;
+  ind_ofdpa_pkt_capture_entry_t entry;
+  uint64_t first, end, i;
+  uint32_t written = 0;
+
+  if (!ind_ofdpa_pkt_capture_enabled())
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  fp = fopen(filename, "w");
+  if (fp == NULL)
+  {
+    LOG_ERROR("Failed to open packet capture file %s", filename);
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  memset(&fileHeader, 0, sizeof(fileHeader));
+  fileHeader.magic = IND_OFDPA_PCAP_MAGIC;
+  fileHeader.versionMajor = IND_OFDPA_PCAP_VERSION_MAJOR;
+  fileHeader.versionMinor = IND_OFDPA_PCAP_VERSION_MINOR;
+  fileHeader.snapLen = IND_OFDPA_PKT_CAPTURE_SNAPLEN;
+  fileHeader.linkType = IND_OFDPA_PCAP_LINKTYPE_ETH;
+  if (fwrite(&fileHeader, sizeof(fileHeader), 1, fp) != 1)
+  {
+    fclose(fp);
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  pkt_capture_window(&first, &end);
+  for (i = first; i < end; i++)
+  {
+    if (!pkt_capture_entry_copy(i, &entry))
+    {
+      continue;
+    }
+    recordHeader.tsSec = entry.timestamp.tv_sec;
+    recordHeader.tsUsec = entry.timestamp.tv_usec;
+    recordHeader.capLen = entry.capLength;
+    recordHeader.len = entry.length;
+    if ((fwrite(&recordHeader, sizeof(recordHeader), 1, fp) != 1) ||
+        ((entry.capLength != 0) &&
+         (fwrite(entry.data, entry.capLength, 1, fp) != 1)))
+    {
+      fclose(fp);
+      return INDIGO_ERROR_UNKNOWN;
+    }
+    written++;
+  }
+
+  fclose(fp);
+  LOG_INFO("Wrote %u captured packets to %s", written, filename);
+
+  return INDIGO_ERROR_NONE;
+}
@@ -0,0 +1,261 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_pkt_thread.c
+*
+* @purpose    Packet-in fast path thread for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   When enabled, a dedicated thread owns the OF-DPA packet
+*             socket. It receives punted packets, applies capture and
+*             rate limiting and encodes the packet-in messages in the
+*             receive ring. The SocketManager loop sends them from the
+*             ring, so flow programming on the loop does not delay
+*             reception. The time from reception to
+*             hand-off to the connection layer is sampled and reported
+*             as p50/p99/p999 punt latency.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <SocketManager/socketmanager.h>
+#include <OS/os_time.h>
+
+#define IND_OFDPA_PKT_WAIT_SEC         1
+
+/* Queued packet-ins are sent ahead of flow programming and stats, but
+   not of controller keepalives */
+#define IND_OFDPA_PKT_PRIORITY         IND_SOC_PRIORITY_PACKET_IN
+
+/* Number of most recent punt latencies kept for the percentiles */
+#define IND_OFDPA_PKT_LATENCY_SAMPLES  4096
+
+static pthread_t pktThread;
+static int pktThreadRunning;
+static int pktThreadStop;
+static int pktNotifyFd = -1;
+static int pktNotifyPending;
+static uint64_t pktQueueDrops;   /* written by the packet thread only */
+
+static uint32_t latencySamples[IND_OFDPA_PKT_LATENCY_SAMPLES];
+static uint64_t latencyCount;
+
+static void pkt_thread_notify(void)
+{
+  uint64_t x = 1;
+
+  /* Only one wakeup is outstanding at a time */
+  if (__atomic_exchange_n(&pktNotifyPending, 1, __ATOMIC_SEQ_CST) == 0)
+  {
+    if (write(pktNotifyFd, &x, sizeof(x)) < 0)
+    {
+      /* silence warn_unused_result */
+    }
+  }
+}
+
+static void *pkt_thread_main(void *arg)
+{
+  struct timeval timeout;
+
+  while (!__atomic_load_n(&pktThreadStop, __ATOMIC_RELAXED))
+  {
+    timeout.tv_sec = IND_OFDPA_PKT_WAIT_SEC;
+    timeout.tv_usec = 0;
+
+    /* One wakeup for the whole batch */
+    if (ind_ofdpa_pkt_rx_ring_fill(&timeout, &pktQueueDrops) > 0)
+    {
+      pkt_thread_notify();
+    }
+  }
+
+  return NULL;
+}
+
+static void pkt_latency_record(uint64_t rxTime)
+{
+  uint64_t latency = os_time_monotonic() - rxTime;
+
+  latencySamples[latencyCount % IND_OFDPA_PKT_LATENCY_SAMPLES] =
+    (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency;
+  latencyCount++;
+}
+
+/* Runs in the SocketManager loop */
+static void pkt_notify_ready(int socket_id, void *cookie, int read_ready,
+                             int write_ready, int error_seen)
+{
+  ind_ofdpa_pkt_rx_slot_t *slot;
+  indigo_error_t rc;
+  uint64_t x;
+
+  if (read(pktNotifyFd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+  /* Packets queued after this point raise a new wakeup */
+  __atomic_store_n(&pktNotifyPending, 0, __ATOMIC_SEQ_CST);
+
+  while ((slot = ind_ofdpa_pkt_rx_ring_peek()) != NULL)
+  {
+    /* The packet-in is copied where it is queued, so the slot can go back
+       to the packet thread right away */
+    rc = indigo_core_packet_in_copy(slot->packetIn);
+    if (rc != INDIGO_ERROR_NONE)
+    {
+      LOG_ERROR("Could not send Packet-in message, rc = 0x%x", rc);
+    }
+    pkt_latency_record(slot->rxTime);
+    ind_ofdpa_pkt_rx_ring_release();
+
+    if (ind_soc_should_yield())
+    {
+      if (ind_ofdpa_pkt_rx_ring_peek() != NULL)
+      {
+        pkt_thread_notify();
+      }
+      break;
+    }
+  }
+}
+
+static int pkt_latency_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x < y) ? -1 : (x > y);
+}
+
+void ind_ofdpa_pkt_thread_latency_get(uint32_t *p50, uint32_t *p99, uint32_t *p999)
+{
+  static uint32_t sorted[IND_OFDPA_PKT_LATENCY_SAMPLES];
+  uint32_t count;
+
+  count = (latencyCount < IND_OFDPA_PKT_LATENCY_SAMPLES) ?
+    (uint32_t)latencyCount : IND_OFDPA_PKT_LATENCY_SAMPLES;
+  if (count == 0)
+  {
+    *p50 = *p99 = *p999 = 0;
+    return;
+  }
+
+  memcpy(sorted, latencySamples, count * sizeof(sorted[0]));
+  qsort(sorted, count, sizeof(sorted[0]), pkt_latency_cmp);
+
+  *p50 = sorted[(count * 50) / 100];
+  *p99 = sorted[(count * 99) / 100];
+  *p999 = sorted[(count * 999) / 1000];
+}
+
+void ind_ofdpa_pkt_thread_show(void)
+{
+  uint32_t p50, p99, p999;
+
+  if (!pktThreadRunning)
+  {
+    return;
+  }
+
+  ind_ofdpa_pkt_thread_latency_get(&p50, &p99, &p999);
+  LOG_INFO("Packet-in thread: %"PRIu64" sent, %"PRIu64" dropped on a full queue",
+           latencyCount, __atomic_load_n(&pktQueueDrops, __ATOMIC_RELAXED));
+  LOG_INFO("  punt latency us: p50 %u p99 %u p999 %u", p50, p99, p999);
+}
+
+indigo_error_t ind_ofdpa_pkt_thread_start(void)
+{
+  indigo_error_t rv;
+
+  if (pktThreadRunning)
+  {
+    return INDIGO_ERROR_EXISTS;
+  }
+
+  pktNotifyFd = eventfd(0, EFD_NONBLOCK);
+  if (pktNotifyFd < 0)
+  {
+    LOG_ERROR("Failed to allocate packet-in eventfd: %s", strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  rv = ind_soc_socket_register_with_priority(pktNotifyFd, pkt_notify_ready, NULL,
+                                             IND_OFDPA_PKT_PRIORITY);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    close(pktNotifyFd);
+    pktNotifyFd = -1;
+    return rv;
+  }
+
+  pktThreadStop = 0;
+  pktNotifyPending = 0;
+  pktQueueDrops = 0;
+  latencyCount = 0;
+  if (pthread_create(&pktThread, NULL, pkt_thread_main, NULL) != 0)
+  {
+    LOG_ERROR("Failed to create packet-in thread");
+    ind_soc_socket_unregister(pktNotifyFd);
+    close(pktNotifyFd);
+    pktNotifyFd = -1;
+    return INDIGO_ERROR_RESOURCE;
+  }
+  pktThreadRunning = 1;
+  ind_ofdpa_sched_worker(pktThread);
+
+  LOG_VERBOSE("Packet-in thread started");
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_pkt_thread_stop(void)
+{
+  if (!pktThreadRunning)
+  {
+    return;
+  }
+
+  /* The thread notices within IND_OFDPA_PKT_WAIT_SEC */
+  __atomic_store_n(&pktThreadStop, 1, __ATOMIC_RELAXED);
+  pthread_join(pktThread, NULL);
+  pktThreadRunning = 0;
+
+  /* Packet-ins not sent yet are discarded */
+  while (ind_ofdpa_pkt_rx_ring_peek() != NULL)
+  {
+    ind_ofdpa_pkt_rx_ring_release();
+  }
+
+  ind_soc_socket_unregister(pktNotifyFd);
+  close(pktNotifyFd);
+  pktNotifyFd = -1;
+}
@@ -0,0 +1,398 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_pkt_tx_thread.c
+*
+* @purpose    Packet-out transmit thread for the OF-DPA Driver
+*
+* @comments   When enabled, packet-outs are not sent from the SocketManager
+*             loop. The loop copies each packet into a slot of an SPSC
+*             ring and rings an eventfd doorbell; a dedicated thread
+*             makes the ofdpaPktSend client RPCs. The cost on the loop
+*             is a ring enqueue instead of a round trip to the OF-DPA
+*             process. Packets too large for a slot wait for the ring to
+*             drain and are sent directly, so the order is kept.
+*
+*             Queued packet-outs are returned to the state manager as
+*             pending. The thread counts the packets it has sent and
+*             passes each failure back on a lock-free BigRing; the loop
+*             wakes on the ring's eventfd and completes the pending
+*             packet-outs in order, so failures reach the controller.
+*             Successes are completed there and before each new send.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_spsc.h"
+#include "ind_ofdpa_log.h"
+#include <BigRing/bigring.h>
+#include <SocketManager/socketmanager.h>
+#include <OS/os_time.h>
+
+#define IND_OFDPA_PKT_TX_QUEUE_SIZE  1024
+
+/* Largest packet copied into the ring; holds a full size tagged frame */
+#define IND_OFDPA_PKT_TX_SLOT_LEN    2048
+
+typedef struct
+{
+  uint32_t flags;
+  uint32_t outPort;
+  uint32_t inPort;
+  uint32_t len;
+  uint8_t data[IND_OFDPA_PKT_TX_SLOT_LEN];
+} ind_ofdpa_pkt_tx_entry_t;
+
+/* A failed send, by its position in the queue */
+typedef struct
+{
+  uint64_t seq;
+  indigo_error_t rv;
+} ind_ofdpa_pkt_tx_failure_t;
+
+static pthread_t txThread;
+static int txThreadRunning;
+static int txThreadStop;
+static int txDoorbellFd = -1;
+static int txDoorbellPending;
+static ind_ofdpa_spsc_t txQueue;
+static bigring_t *txFailures;
+
+/* Written by the SocketManager loop */
+static uint64_t txQueued;
+static uint64_t txQueueDrops;
+static uint64_t txDirect;
+static uint64_t txCompleted;
+
+/* Written by the transmit thread */
+static uint64_t txDone;
+static uint64_t txSent;
+static uint64_t txErrors;
+static uint64_t txFailuresLost;
+static uint64_t txSendTimeUs;
+static uint32_t txSendTimeMaxUs;
+
+static void pkt_tx_doorbell(void)
+{
+  uint64_t x = 1;
+
+  /* Only one wakeup is outstanding at a time */
+  if (__atomic_exchange_n(&txDoorbellPending, 1, __ATOMIC_SEQ_CST) == 0)
+  {
+    if (write(txDoorbellFd, &x, sizeof(x)) < 0)
+    {
+      /* silence warn_unused_result */
+    }
+  }
+}
+
+static void pkt_tx_send(ind_ofdpa_pkt_tx_entry_t *entry)
+{
+  ind_ofdpa_pkt_tx_failure_t *failure;
+  ofdpa_buffdesc pkt;
+  OFDPA_ERROR_t ofdpa_rv;
+  uint64_t start;
+  uint32_t elapsed;
+
+  pkt.pstart = (char *)entry->data;
+  pkt.size = entry->len;
+
+  start = os_time_monotonic();
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPktSend, &pkt, entry->flags, entry->outPort, entry->inPort);
+  elapsed = (uint32_t)(os_time_monotonic() - start);
+
+  __atomic_store_n(&txSendTimeUs, txSendTimeUs + elapsed, __ATOMIC_RELAXED);
+  if (elapsed > txSendTimeMaxUs)
+  {
+    __atomic_store_n(&txSendTimeMaxUs, elapsed, __ATOMIC_RELAXED);
+  }
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Packet send on port %u failed. (ofdpa_rv = %d)", entry->outPort, ofdpa_rv);
+    __atomic_store_n(&txErrors, txErrors + 1, __ATOMIC_RELAXED);
+
+    /* Pushed before txDone moves past it, so the loop sees it in time */
+    failure = malloc(sizeof(*failure));
+    if (failure != NULL)
+    {
+      failure->seq = txDone;
+      failure->rv = indigoConvertOfdpaRv(ofdpa_rv);
+      if (bigring_push_batch(txFailures, (void **)&failure, 1) == 0)
+      {
+        free(failure);
+        failure = NULL;
+      }
+    }
+    if (failure == NULL)
+    {
+      /* Reported to the controller as sent */
+      __atomic_store_n(&txFailuresLost, txFailuresLost + 1, __ATOMIC_RELAXED);
+    }
+  }
+  else
+  {
+    __atomic_store_n(&txSent, txSent + 1, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&txDone, txDone + 1, __ATOMIC_RELEASE);
+}
+
+static void *pkt_tx_thread_main(void *arg)
+{
+  ind_ofdpa_pkt_tx_entry_t *entry;
+  uint64_t x;
+
+  while (!__atomic_load_n(&txThreadStop, __ATOMIC_RELAXED))
+  {
+    while ((entry = ind_ofdpa_spsc_peek(&txQueue)) != NULL)
+    {
+      pkt_tx_send(entry);
+      ind_ofdpa_spsc_release(&txQueue);
+    }
+
+    if (read(txDoorbellFd, &x, sizeof(x)) < 0)
+    {
+      continue;
+    }
+    /* Packets queued after this point ring the doorbell again */
+    __atomic_store_n(&txDoorbellPending, 0, __ATOMIC_SEQ_CST);
+  }
+
+  return NULL;
+}
+
+/* Runs in the SocketManager loop; reports the packets the thread is done with */
+static void pkt_tx_complete(void)
+{
+  ind_ofdpa_pkt_tx_failure_t *failure;
+  uint64_t done;
+
+  done = __atomic_load_n(&txDone, __ATOMIC_ACQUIRE);
+
+  while ((failure = bigring_shift(txFailures)) != NULL)
+  {
+    if (failure->seq > txCompleted)
+    {
+      indigo_core_packet_out_complete(failure->seq - txCompleted, INDIGO_ERROR_NONE);
+    }
+    indigo_core_packet_out_complete(1, failure->rv);
+    txCompleted = failure->seq + 1;
+    free(failure);
+  }
+
+  if (done > txCompleted)
+  {
+    indigo_core_packet_out_complete(done - txCompleted, INDIGO_ERROR_NONE);
+    txCompleted = done;
+  }
+}
+
+static void pkt_tx_failures_ready(int socket_id, void *cookie, int read_ready,
+                                  int write_ready, int error_seen)
+{
+  /* Rearm first; failures pushed from here on wake the loop again */
+  bigring_wait_clear(txFailures);
+  pkt_tx_complete();
+}
+
+int ind_ofdpa_pkt_tx_thread_running(void)
+{
+  return txThreadRunning;
+}
+
+/* Runs in the SocketManager loop */
+indigo_error_t ind_ofdpa_pkt_tx_thread_send(const ofdpa_buffdesc *pkt, uint32_t flags,
+                                            uint32_t outPort, uint32_t inPort)
+{
+  ind_ofdpa_pkt_tx_entry_t *entry;
+  ofdpa_buffdesc directPkt;
+
+  pkt_tx_complete();
+
+  if (pkt->size > IND_OFDPA_PKT_TX_SLOT_LEN)
+  {
+    /* Rare; let the thread catch up rather than reorder */
+    while (__atomic_load_n(&txQueue.head, __ATOMIC_ACQUIRE) !=
+           __atomic_load_n(&txQueue.tail, __ATOMIC_RELAXED))
+    {
+      sched_yield();
+    }
+    txDirect++;
+
+    directPkt = *pkt;
+    return indigoConvertOfdpaRv(IND_OFDPA_RPC(ofdpaPktSend, &directPkt, flags, outPort, inPort));
+  }
+
+  entry = ind_ofdpa_spsc_reserve(&txQueue);
+  if (entry == NULL)
+  {
+    /* The thread is not keeping up; shed load like the packet-in side */
+    txQueueDrops++;
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  entry->flags = flags;
+  entry->outPort = outPort;
+  entry->inPort = inPort;
+  entry->len = pkt->size;
+  memcpy(entry->data, pkt->pstart, pkt->size);
+  ind_ofdpa_spsc_commit(&txQueue);
+  txQueued++;
+
+  pkt_tx_doorbell();
+
+  return INDIGO_ERROR_PENDING;
+}
+
+void ind_ofdpa_pkt_tx_thread_show(void)
+{
+  uint64_t sent;
+
+  if (!txThreadRunning)
+  {
+    return;
+  }
+
+  sent = __atomic_load_n(&txSent, __ATOMIC_RELAXED);
+  LOG_INFO("Packet-out thread: %"PRIu64" queued, %"PRIu64" dropped on a full queue, "
+           "%"PRIu64" sent directly",
+           txQueued, txQueueDrops, txDirect);
+  LOG_INFO("  %"PRIu64" sent, %"PRIu64" send errors (%"PRIu64" not reported), "
+           "send latency us: avg %"PRIu64" max %u",
+           sent, __atomic_load_n(&txErrors, __ATOMIC_RELAXED),
+           __atomic_load_n(&txFailuresLost, __ATOMIC_RELAXED),
+           sent ? __atomic_load_n(&txSendTimeUs, __ATOMIC_RELAXED) / sent : 0,
+           __atomic_load_n(&txSendTimeMaxUs, __ATOMIC_RELAXED));
+}
+
+indigo_error_t ind_ofdpa_pkt_tx_thread_start(void)
+{
+  indigo_error_t rv;
+
+  if (txThreadRunning)
+  {
+    return INDIGO_ERROR_EXISTS;
+  }
+
+  rv = ind_ofdpa_spsc_init(&txQueue, IND_OFDPA_PKT_TX_QUEUE_SIZE,
+                           sizeof(ind_ofdpa_pkt_tx_entry_t));
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to allocate packet-out queue");
+    return rv;
+  }
+
+  /* Blocking, the thread sleeps in read() until the doorbell rings */
+  txDoorbellFd = eventfd(0, 0);
+  if (txDoorbellFd < 0)
+  {
+    LOG_ERROR("Failed to allocate packet-out eventfd: %s", strerror(errno));
+    ind_ofdpa_spsc_free(&txQueue);
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  /* Room for every queued packet failing before the loop runs again */
+  txFailures = bigring_create_lockfree(2 * IND_OFDPA_PKT_TX_QUEUE_SIZE, free, BIGRING_F_SPSC);
+  if (bigring_wait_fd(txFailures) < 0)
+  {
+    LOG_ERROR("Packet-out failure ring has no eventfd");
+    rv = INDIGO_ERROR_RESOURCE;
+  }
+  else
+  {
+    rv = ind_soc_socket_register(bigring_wait_fd(txFailures), pkt_tx_failures_ready, NULL);
+  }
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    bigring_destroy(txFailures);
+    txFailures = NULL;
+    close(txDoorbellFd);
+    txDoorbellFd = -1;
+    ind_ofdpa_spsc_free(&txQueue);
+    return rv;
+  }
+
+  txThreadStop = 0;
+  txDoorbellPending = 0;
+  txQueued = txQueueDrops = txDirect = txCompleted = 0;
+  txDone = txSent = txErrors = txFailuresLost = txSendTimeUs = 0;
+  txSendTimeMaxUs = 0;
+  if (pthread_create(&txThread, NULL, pkt_tx_thread_main, NULL) != 0)
+  {
+    LOG_ERROR("Failed to create packet-out thread");
+    ind_soc_socket_unregister(bigring_wait_fd(txFailures));
+    bigring_destroy(txFailures);
+    txFailures = NULL;
+    close(txDoorbellFd);
+    txDoorbellFd = -1;
+    ind_ofdpa_spsc_free(&txQueue);
+    return INDIGO_ERROR_RESOURCE;
+  }
+  txThreadRunning = 1;
+  ind_ofdpa_sched_worker(txThread);
+
+  LOG_VERBOSE("Packet-out thread started");
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_pkt_tx_thread_stop(void)
+{
+  uint64_t x = 1;
+
+  if (!txThreadRunning)
+  {
+    return;
+  }
+
+  /* Packets still queued are dropped */
+  __atomic_store_n(&txThreadStop, 1, __ATOMIC_RELAXED);
+  if (write(txDoorbellFd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+  pthread_join(txThread, NULL);
+  txThreadRunning = 0;
+
+  pkt_tx_complete();
+  if (txQueued > txCompleted)
+  {
+    indigo_core_packet_out_complete(txQueued - txCompleted, INDIGO_ERROR_RESOURCE);
+    txCompleted = txQueued;
+  }
+  ind_soc_socket_unregister(bigring_wait_fd(txFailures));
+  bigring_destroy(txFailures);
+  txFailures = NULL;
+
+  close(txDoorbellFd);
+  txDoorbellFd = -1;
+  ind_ofdpa_spsc_free(&txQueue);
+}
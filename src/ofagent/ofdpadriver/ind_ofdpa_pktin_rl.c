@@ -0,0 +1,440 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_pktin_rl.c
+*
+* @purpose    Packet-in rate limiting for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Punted packets are rate limited before a packet-in is
+*             built. The priority ethertypes are let through
+*             unconditionally. Other packets go through the per-reason
+*             and per-port token buckets kept here, then through a PIMU
+*             for the global limit. Per-port counters are exported through
+*             the "ofdpa_pktin_ratelimit" gentable, drop counters as BSN
+*             debug counters.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_rl.h>
+#include <OS/os_time.h>
+#include <pimu/pimu.h>
+#include <PPE/ppe.h>
+
+/* PIMU flow cache dimensions; per-flow limiting is not used */
+#define IND_OFDPA_PKTIN_RL_CACHE_BLOCK_SIZE  4
+#define IND_OFDPA_PKTIN_RL_CACHE_ENTRIES     1024
+
+/* Ports numbered at or above this, such as logical tunnel ports, share
+   one bucket rather than each getting their own */
+#define IND_OFDPA_PKTIN_RL_PORT_LIMIT        4096
+
+/* Packet-in reasons with an individual bucket */
+#define IND_OFDPA_PKTIN_RL_MAX_REASONS       8
+
+/* BFD control packets, single hop (RFC 5881) and multihop (RFC 5883) */
+#define IND_OFDPA_PKTIN_RL_BFD_PORT          3784
+#define IND_OFDPA_PKTIN_RL_BFD_MULTIHOP_PORT 4784
+
+typedef struct
+{
+  uint64_t received;
+  uint64_t forwarded;
+  uint64_t dropped;
+} ind_ofdpa_pktin_rl_counters_t;
+
+typedef struct
+{
+  uint32_t pps;
+  aim_ratelimiter_t rl;
+  ind_ofdpa_pktin_rl_counters_t counters;
+} ind_ofdpa_pktin_rl_bucket_t;
+
+static pimu_t *pktInPimu;
+static ind_ofdpa_pktin_rl_bucket_t *portBuckets;
+static uint32_t portBucketCount;
+static ind_ofdpa_pktin_rl_bucket_t otherPortBucket;
+static ind_ofdpa_pktin_rl_bucket_t reasons[IND_OFDPA_PKTIN_RL_MAX_REASONS];
+static uint64_t priorityForwarded;
+
+/* Drops by the limit that made them */
+static uint64_t droppedReasonLimit;
+static uint64_t droppedPortLimit;
+static uint64_t droppedGlobalLimit;
+static uint64_t droppedTotal;
+
+/* Debug counters: the totals above, then one per reason bucket */
+#define IND_OFDPA_PKTIN_RL_DEBUG_COUNTERS    (5 + IND_OFDPA_PKTIN_RL_MAX_REASONS)
+static indigo_core_debug_counter_t *debugCounters[IND_OFDPA_PKTIN_RL_DEBUG_COUNTERS];
+
+static indigo_core_gentable_t *pktInRlGentable;
+static const indigo_core_gentable_ops_t pktInRlGentableOps;
+
+static ind_ofdpa_pktin_rl_bucket_t *pktin_rl_port_bucket(uint32_t port)
+{
+  if (port < portBucketCount)
+  {
+    return &portBuckets[port];
+  }
+  return &otherPortBucket;
+}
+
+static uint32_t pktin_rl_burst(uint32_t pps)
+{
+  /* Allow one tenth of a second worth of packets in a burst */
+  return (pps >= 10) ? (pps / 10) : 1;
+}
+
+static void pktin_rl_bucket_init(ind_ofdpa_pktin_rl_bucket_t *bucket, uint32_t pps)
+{
+  memset(bucket, 0, sizeof(*bucket));
+  bucket->pps = pps;
+  if (pps != 0)
+  {
+    aim_ratelimiter_init(&bucket->rl, 1000000 / pps, pktin_rl_burst(pps), NULL);
+  }
+}
+
+/* Returns nonzero if the bucket has no token for the packet */
+static int pktin_rl_bucket_limit(ind_ofdpa_pktin_rl_bucket_t *bucket, uint64_t now)
+{
+  return (bucket->pps != 0) && (aim_ratelimiter_limit(&bucket->rl, now) != 0);
+}
+
+/* Link, OAM and BFD control protocols are never rate limited. BFD runs
+   over UDP, so it is told apart from other IP by its destination port. */
+static int pktin_rl_priority(ofdpaPacket_t *pkt)
+{
+  ppe_classify_t cls;
+
+  if (ppe_classify((const uint8_t *)pkt->pktData.pstart, pkt->pktData.size, &cls) < 0)
+  {
+    return 0;
+  }
+
+  if ((cls.ip_protocol == 17) &&
+      ((cls.l4_dst_port == IND_OFDPA_PKTIN_RL_BFD_PORT) ||
+       (cls.l4_dst_port == IND_OFDPA_PKTIN_RL_BFD_MULTIHOP_PORT)))
+  {
+    return 1;
+  }
+
+  return (cls.pclass == PPE_CLASS_LLDP) ||
+    (cls.pclass == PPE_CLASS_LACP) ||
+    (cls.pclass == PPE_CLASS_OAM);
+}
+
+static void pktin_rl_debug_counters_register(void)
+{
+  char name[64];
+  char description[128];
+  int n = 0;
+  uint32_t i;
+
+  indigo_core_debug_counter_register("ofdpa.pktin_rl.dropped",
+                                     "Punted packets dropped by the packet-in rate limits",
+                                     &droppedTotal, &debugCounters[n++]);
+  indigo_core_debug_counter_register("ofdpa.pktin_rl.dropped_reason_limit",
+                                     "Punted packets dropped by their reason's limit",
+                                     &droppedReasonLimit, &debugCounters[n++]);
+  indigo_core_debug_counter_register("ofdpa.pktin_rl.dropped_port_limit",
+                                     "Punted packets dropped by their port's limit",
+                                     &droppedPortLimit, &debugCounters[n++]);
+  indigo_core_debug_counter_register("ofdpa.pktin_rl.dropped_global_limit",
+                                     "Punted packets dropped by the switch limit",
+                                     &droppedGlobalLimit, &debugCounters[n++]);
+  indigo_core_debug_counter_register("ofdpa.pktin_rl.priority_forwarded",
+                                     "LLDP, LACP, OAM and BFD packets let through unlimited",
+                                     &priorityForwarded, &debugCounters[n++]);
+
+  for (i = 0; i < IND_OFDPA_PKTIN_RL_MAX_REASONS; i++)
+  {
+    snprintf(name, sizeof(name), "ofdpa.pktin_rl.reason%u.dropped", i);
+    snprintf(description, sizeof(description),
+             "Punted packets with packet-in reason %u dropped by any limit", i);
+    indigo_core_debug_counter_register(name, description, &reasons[i].counters.dropped,
+                                       &debugCounters[n++]);
+  }
+}
+
+/* One bucket for every port OF-DPA reports, up to the limit */
+static uint32_t pktin_rl_port_count(void)
+{
+  uint32_t port = 0;
+  uint32_t count = 0;
+
+  while ((IND_OFDPA_RPC(ofdpaPortNextGet, port, &port) == OFDPA_E_NONE) &&
+         (port < IND_OFDPA_PKTIN_RL_PORT_LIMIT))
+  {
+    count = port + 1;
+  }
+
+  return count;
+}
+
+indigo_error_t ind_ofdpa_pktin_rl_init(uint32_t global_pps, uint32_t port_pps,
+                                       uint32_t reason_pps)
+{
+  uint32_t i;
+
+  pktInPimu = pimu_create(IND_OFDPA_PKTIN_RL_CACHE_BLOCK_SIZE,
+                          IND_OFDPA_PKTIN_RL_CACHE_ENTRIES);
+  if (pktInPimu == NULL)
+  {
+    LOG_ERROR("Failed to create packet-in PIMU");
+    return INDIGO_ERROR_RESOURCE;
+  }
+  pimu_global_pps_set(pktInPimu, global_pps, pktin_rl_burst(global_pps));
+
+  portBucketCount = pktin_rl_port_count();
+  if (portBucketCount != 0)
+  {
+    portBuckets = aim_zmalloc(portBucketCount * sizeof(*portBuckets));
+  }
+  for (i = 0; i < portBucketCount; i++)
+  {
+    pktin_rl_bucket_init(&portBuckets[i], port_pps);
+  }
+  pktin_rl_bucket_init(&otherPortBucket, port_pps);
+
+  for (i = 0; i < IND_OFDPA_PKTIN_RL_MAX_REASONS; i++)
+  {
+    pktin_rl_bucket_init(&reasons[i], reason_pps);
+  }
+  priorityForwarded = 0;
+
+  pktin_rl_debug_counters_register();
+
+  indigo_core_gentable_register("ofdpa_pktin_ratelimit", &pktInRlGentableOps,
+                                NULL, portBucketCount + 1, 64,
+                                &pktInRlGentable);
+
+  LOG_VERBOSE("Packet-in rate limits: global %u pps, port %u pps (%u ports), reason %u pps",
+              global_pps, port_pps, portBucketCount, reason_pps);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* The cheap per-reason and per-port buckets run first, so a packet they
+   drop does not take a token from the global limit */
+int ind_ofdpa_pktin_rl_admit(ofdpaPacket_t *pkt)
+{
+  ind_ofdpa_pktin_rl_bucket_t *port;
+  ind_ofdpa_pktin_rl_bucket_t *reason = NULL;
+  uint64_t now;
+
+  if (pktInPimu == NULL)
+  {
+    return 1;
+  }
+
+  port = pktin_rl_port_bucket(pkt->inPortNum);
+  port->counters.received++;
+  if (pkt->reason < IND_OFDPA_PKTIN_RL_MAX_REASONS)
+  {
+    reason = &reasons[pkt->reason];
+    reason->counters.received++;
+  }
+
+  if (pktin_rl_priority(pkt))
+  {
+    priorityForwarded++;
+  }
+  else
+  {
+    uint64_t *dropped = NULL;
+
+    now = os_time_monotonic();
+    if ((reason != NULL) && pktin_rl_bucket_limit(reason, now))
+    {
+      dropped = &droppedReasonLimit;
+    }
+    else if (pktin_rl_bucket_limit(port, now))
+    {
+      dropped = &droppedPortLimit;
+    }
+    else if (pimu_packet_in(pktInPimu, pkt->inPortNum, -1,
+                            (uint8_t *)pkt->pktData.pstart, pkt->pktData.size,
+                            now) == PIMU_ACTION_DROP)
+    {
+      dropped = &droppedGlobalLimit;
+    }
+
+    if (dropped != NULL)
+    {
+      (*dropped)++;
+      droppedTotal++;
+      port->counters.dropped++;
+      if (reason != NULL)
+      {
+        reason->counters.dropped++;
+      }
+      return 0;
+    }
+  }
+
+  port->counters.forwarded++;
+  if (reason != NULL)
+  {
+    reason->counters.forwarded++;
+  }
+  return 1;
+}
+
+void ind_ofdpa_pktin_rl_show(void)
+{
+  uint32_t i;
+
+  if (pktInPimu == NULL)
+  {
+    return;
+  }
+
+  LOG_INFO("Packet-in rate limiter: %"PRIu64" priority packets forwarded",
+           priorityForwarded);
+  LOG_INFO("  dropped %"PRIu64": reason limit %"PRIu64" port limit %"PRIu64
+           " global limit %"PRIu64, droppedTotal, droppedReasonLimit,
+           droppedPortLimit, droppedGlobalLimit);
+  for (i = 0; i < portBucketCount; i++)
+  {
+    if (portBuckets[i].counters.received != 0)
+    {
+      LOG_INFO("  port %u: received %"PRIu64" forwarded %"PRIu64" dropped %"PRIu64,
+               i, portBuckets[i].counters.received, portBuckets[i].counters.forwarded,
+               portBuckets[i].counters.dropped);
+    }
+  }
+  if (otherPortBucket.counters.received != 0)
+  {
+    LOG_INFO("  other ports: received %"PRIu64" forwarded %"PRIu64" dropped %"PRIu64,
+             otherPortBucket.counters.received, otherPortBucket.counters.forwarded,
+             otherPortBucket.counters.dropped);
+  }
+  for (i = 0; i < IND_OFDPA_PKTIN_RL_MAX_REASONS; i++)
+  {
+    if (reasons[i].counters.received != 0)
+    {
+      LOG_INFO("  reason %u: received %"PRIu64" forwarded %"PRIu64" dropped %"PRIu64,
+               i, reasons[i].counters.received, reasons[i].counters.forwarded,
+               reasons[i].counters.dropped);
+    }
+  }
+}
+
+/*
+ * ofdpa_pktin_ratelimit gentable
+ *
+ * Key is a port TLV. The controller adds an entry for each port it wants
+ * to monitor; the entry stats report the punted packets received from the
+ * port (rx_packets) and the packet-ins sent for them (tx_packets). The
+ * difference was dropped by the rate limiter; the drops by limit and by
+ * reason are reported as the ofdpa.pktin_rl debug counters.
+ */
+
+static indigo_error_t pktin_rl_parse_key(of_list_bsn_tlv_t *key, uint32_t *port)
+{
+  of_bsn_tlv_t tlv;
+
+  if (of_list_bsn_tlv_first(key, &tlv) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  if (tlv.header.object_id != OF_BSN_TLV_PORT)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  of_bsn_tlv_port_value_get(&tlv.port, port);
+
+  if (of_list_bsn_tlv_next(key, &tlv) == 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t pktin_rl_gentable_add(void *table_priv, of_list_bsn_tlv_t *key,
+                                            of_list_bsn_tlv_t *value, void **entry_priv)
+{
+  uint32_t port;
+  indigo_error_t rv;
+
+  rv = pktin_rl_parse_key(key, &port);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    return rv;
+  }
+
+  *entry_priv = &pktin_rl_port_bucket(port)->counters;
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t pktin_rl_gentable_modify(void *table_priv, void *entry_priv,
+                                               of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *value)
+{
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t pktin_rl_gentable_delete(void *table_priv, void *entry_priv,
+                                               of_list_bsn_tlv_t *key)
+{
+  return INDIGO_ERROR_NONE;
+}
+
+static void pktin_rl_gentable_get_stats(void *table_priv, void *entry_priv,
+                                        of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *stats)
+{
+  ind_ofdpa_pktin_rl_counters_t *counters = entry_priv;
+  of_object_t *tlv;
+
+  tlv = of_bsn_tlv_rx_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_rx_packets_value_set(tlv, counters->received);
+    of_list_append(stats, tlv);
+    of_object_delete(tlv);
+  }
+
+  tlv = of_bsn_tlv_tx_packets_new(stats->version);
+  if (tlv != NULL)
+  {
+    of_bsn_tlv_tx_packets_value_set(tlv, counters->forwarded);
+    of_list_append(stats, tlv);
+    of_object_delete(tlv);
+  }
+}
+
+static const indigo_core_gentable_ops_t pktInRlGentableOps =
+{
+  .add = pktin_rl_gentable_add,
+  .modify = pktin_rl_gentable_modify,
+  .del = pktin_rl_gentable_delete,
+  .get_stats = pktin_rl_gentable_get_stats,
+};
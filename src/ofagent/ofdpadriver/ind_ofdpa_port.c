@@ -30,18 +30,49 @@
 *
 **********************************************************************/
 
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
 #include <linux/if_ether.h>
 #include "indigo/port_manager.h"
 #include "indigo/of_state_manager.h"
 #include "ind_ofdpa_util.h"
 #include "ind_ofdpa_log.h"
+#include "ind_ofdpa_queue_rates.h"
 #include "indigo/error.h"
 #include "loci/of_match.h"
 #include "loci/loci.h"
 #include "ofdpa_api.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+#include <SocketManager/socketmanager.h>
+#include <OS/os_time.h>
 
 extern int ofagent_of_version;
 
+#define IND_OFDPA_QUEUE_CONFIG_CACHE_BUCKETS 256
+
+/* Queue count and rates of a port. The rates only change through
+   ofdpaQueueRateSet, after which the cache must be updated, as
+   ind_ofdpa_queue_rates_set does, or ind_ofdpa_queue_config_invalidate
+   called. */
+typedef struct ind_ofdpa_queue_config_s
+{
+  bighash_entry_t hash_entry;
+  uint32_t port;
+  uint32_t numQueues;
+  uint32_t *minRate;
+  uint32_t *maxRate;
+} ind_ofdpa_queue_config_t;
+
+#define TEMPLATE_NAME queue_config_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_queue_config_t
+#define TEMPLATE_KEY_FIELD port
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+static bighash_table_t *queueConfigTable;
+
 static indigo_error_t ind_ofdpa_queue_stats_set(of_port_no_t req_of_port_num,
                                                 uint32_t req_of_port_queue_id,
                                                 of_list_queue_stats_entry_t *list);
@@ -52,12 +83,253 @@ static indigo_error_t ind_ofdpa_queue_config_queue_set(of_packet_queue_t *of_pac
                                                        of_port_no_t port,
                                                        uint32_t queueId);
 
+static void ind_ofdpa_queue_config_free(ind_ofdpa_queue_config_t *config)
+{
+  free(config->minRate);
+  free(config->maxRate);
+  free(config);
+}
+
+/* Look up the queue configuration of a port, reading it on a miss */
+static ind_ofdpa_queue_config_t *ind_ofdpa_queue_config_get(uint32_t port, OFDPA_ERROR_t *ofdpa_rv)
+{
+  ind_ofdpa_queue_config_t *config;
+  uint32_t queueId;
+
+  *ofdpa_rv = OFDPA_E_NONE;
+
+  if (queueConfigTable == NULL)
+  {
+    queueConfigTable = bighash_table_create(IND_OFDPA_QUEUE_CONFIG_CACHE_BUCKETS);
+    if (queueConfigTable == NULL)
+    {
+      *ofdpa_rv = OFDPA_E_FAIL;
+      return NULL;
+    }
+  }
+
+  config = queue_config_hashtable_first(queueConfigTable, &port);
+  if (config != NULL)
+  {
+    return config;
+  }
+
+  config = calloc(1, sizeof(*config));
+  if (config == NULL)
+  {
+    *ofdpa_rv = OFDPA_E_FAIL;
+    return NULL;
+  }
+  config->port = port;
+
+  *ofdpa_rv = IND_OFDPA_RPC(ofdpaNumQueuesGet, port, &config->numQueues);
+  if (*ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to get no. of port queues. (ofdpa_rv = %d)", *ofdpa_rv);
+    ind_ofdpa_queue_config_free(config);
+    return NULL;
+  }
+
+  config->minRate = calloc(config->numQueues + 1, sizeof(uint32_t));
+  config->maxRate = calloc(config->numQueues + 1, sizeof(uint32_t));
+  if ((config->minRate == NULL) || (config->maxRate == NULL))
+  {
+    *ofdpa_rv = OFDPA_E_FAIL;
+    ind_ofdpa_queue_config_free(config);
+    return NULL;
+  }
+
+  for (queueId = 0; queueId < config->numQueues; queueId++)
+  {
+    *ofdpa_rv = IND_OFDPA_RPC(ofdpaQueueRateGet, port, queueId, &config->minRate[queueId],
+                                                 &config->maxRate[queueId]);
+    if (*ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Failed to get port queue min and max rates. (ofdpa_rv = %d)", *ofdpa_rv);
+      ind_ofdpa_queue_config_free(config);
+      return NULL;
+    }
+  }
+
+  queue_config_hashtable_insert(queueConfigTable, config);
+
+  return config;
+}
+
+void ind_ofdpa_queue_config_invalidate(uint32_t port)
+{
+  ind_ofdpa_queue_config_t *config;
+
+  if (queueConfigTable == NULL)
+  {
+    return;
+  }
+
+  config = queue_config_hashtable_first(queueConfigTable, &port);
+  if (config != NULL)
+  {
+    bighash_remove(queueConfigTable, &config->hash_entry);
+    ind_ofdpa_queue_config_free(config);
+  }
+}
+
+OFDPA_ERROR_t ind_ofdpa_queue_count_get(uint32_t port, uint32_t *numQueues)
+{
+  ind_ofdpa_queue_config_t *config;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  config = ind_ofdpa_queue_config_get(port, &ofdpa_rv);
+  if (config != NULL)
+  {
+    *numQueues = config->numQueues;
+  }
+
+  return ofdpa_rv;
+}
+
+/* Set the rates of any number of port queues. Queues already at the
+   rates asked for are skipped, so resubmitting a whole policy after a
+   change only costs an RPC per queue that changed. The cache is updated
+   in place, so queue config requests are still answered from memory.
+   rcs, if not NULL, gets the result of each queue. Returns the number
+   of queues that failed. */
+uint32_t ind_ofdpa_queue_rates_set(const ind_ofdpa_queue_rate_t *rates, uint32_t count,
+                                   OFDPA_ERROR_t *rcs)
+{
+  const ind_ofdpa_queue_rate_t *rate;
+  ind_ofdpa_queue_config_t *config;
+  OFDPA_ERROR_t ofdpa_rv;
+  uint32_t set = 0, unchanged = 0, failed = 0;
+  uint32_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    rate = &rates[i];
+
+    config = ind_ofdpa_queue_config_get(rate->port, &ofdpa_rv);
+    if ((config != NULL) && (rate->queueId >= config->numQueues))
+    {
+      ofdpa_rv = OFDPA_E_PARAM;
+    }
+    else if ((config != NULL) &&
+             (config->minRate[rate->queueId] == rate->minRate) &&
+             (config->maxRate[rate->queueId] == rate->maxRate))
+    {
+      unchanged++;
+    }
+    else if (config != NULL)
+    {
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaQueueRateSet, rate->port, rate->queueId,
+                               rate->minRate, rate->maxRate);
+      if (ofdpa_rv == OFDPA_E_NONE)
+      {
+        config->minRate[rate->queueId] = rate->minRate;
+        config->maxRate[rate->queueId] = rate->maxRate;
+        set++;
+      }
+      else
+      {
+        /* Read back on the next request */
+        ind_ofdpa_queue_config_invalidate(rate->port);
+      }
+    }
+
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_VERBOSE("Failed to set rates of port %u queue %u. (ofdpa_rv = %d)",
+                  rate->port, rate->queueId, ofdpa_rv);
+      failed++;
+    }
+    if (rcs != NULL)
+    {
+      rcs[i] = ofdpa_rv;
+    }
+  }
+
+  if (failed != 0)
+  {
+    LOG_ERROR("Queue rates: %u set, %u unchanged, %u failed", set, unchanged, failed);
+  }
+  else
+  {
+    LOG_INFO("Queue rates: %u set, %u unchanged", set, unchanged);
+  }
+
+  return failed;
+}
+
+static uint32_t ind_ofdpa_queue_rates_get32(const uint8_t *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return ntohl(v);
+}
+
+/* Bulk queue rate message, laid out as in ind_ofdpa_queue_rates.h */
+static indigo_error_t ind_ofdpa_queue_rates_msg(of_experimenter_t *msg, indigo_cxn_id_t cxn_id)
+{
+  ind_ofdpa_queue_rate_t *rates;
+  const uint8_t *p;
+  uint32_t count = 0, i, failed;
+  int len;
+
+  len = msg->length - IND_OFDPA_QUEUE_RATES_DATA_OFFSET - IND_OFDPA_QUEUE_RATES_HDR_LEN;
+  p = OF_OBJECT_BUFFER_INDEX(msg, IND_OFDPA_QUEUE_RATES_DATA_OFFSET);
+  if (len >= 0)
+  {
+    count = ind_ofdpa_queue_rates_get32(p);
+    p += IND_OFDPA_QUEUE_RATES_HDR_LEN;
+  }
+  if ((len < 0) || (len % IND_OFDPA_QUEUE_RATES_RECORD_LEN != 0) ||
+      (count != (uint32_t)len / IND_OFDPA_QUEUE_RATES_RECORD_LEN))
+  {
+    LOG_ERROR("Bad queue rates message: length %d, %u records", msg->length, count);
+    indigo_cxn_send_error_reply(cxn_id, msg, OF_ERROR_TYPE_BAD_REQUEST,
+                                OF_REQUEST_FAILED_BAD_LEN);
+    return INDIGO_ERROR_PARAM;
+  }
+  if (count == 0)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  rates = malloc(count * sizeof(*rates));
+  if (rates == NULL)
+  {
+    LOG_ERROR("Failed to allocate %u queue rates", count);
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  for (i = 0; i < count; i++, p += IND_OFDPA_QUEUE_RATES_RECORD_LEN)
+  {
+    rates[i].port = ind_ofdpa_queue_rates_get32(p);
+    rates[i].queueId = ind_ofdpa_queue_rates_get32(p + 4);
+    rates[i].minRate = ind_ofdpa_queue_rates_get32(p + 8);
+    rates[i].maxRate = ind_ofdpa_queue_rates_get32(p + 12);
+  }
+
+  failed = ind_ofdpa_queue_rates_set(rates, count, NULL);
+  free(rates);
+
+  if (failed != 0)
+  {
+    indigo_cxn_send_error_reply(cxn_id, msg,
+                                OF_ERROR_TYPE_QUEUE_OP_FAILED_BY_VERSION(msg->version),
+                                OF_QUEUE_OP_FAILED_BAD_QUEUE);
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
 static indigo_error_t ind_ofdpa_queue_config_queue_set(of_packet_queue_t *of_packet_queue,
                                                        uint32_t port, uint32_t queueId)
 {
   indigo_error_t err = INDIGO_ERROR_NONE;
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
-  uint32_t minRate, maxRate;
+  ind_ofdpa_queue_config_t *config;
+  uint32_t minRate = 0, maxRate = 0;
   of_list_queue_prop_t of_list_queue_prop;
   of_queue_prop_t of_queue_prop;
   of_queue_prop_min_rate_t *min_rate;
@@ -72,7 +344,16 @@ static indigo_error_t ind_ofdpa_queue_config_queue_set(of_packet_queue_t *of_pac
   /* Set the port: Port this queue is attached to. */
   of_packet_queue_port_set(of_packet_queue, port);
 
-  ofdpa_rv = ofdpaQueueRateGet(port, queueId, &minRate, &maxRate);
+  config = ind_ofdpa_queue_config_get(port, &ofdpa_rv);
+  if ((config != NULL) && (queueId >= config->numQueues))
+  {
+    ofdpa_rv = OFDPA_E_PARAM;
+  }
+  else if (config != NULL)
+  {
+    minRate = config->minRate[queueId];
+    maxRate = config->maxRate[queueId];
+  }
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get port queue min and max rates. (ofdpa_rv = %d)", ofdpa_rv);
@@ -111,7 +392,15 @@ static indigo_error_t ind_ofdpa_port_stats_set(uint32_t port, of_list_port_stats
   }
 
   memset(&portStats, 0, sizeof(portStats));
-  ofdpa_rv = ofdpaPortStatsGet(port, &portStats);
+  if (!ind_ofdpa_port_stats_cache_enabled() ||
+      (ind_ofdpa_port_stats_cache_get(port, &portStats) != INDIGO_ERROR_NONE))
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPortStatsGet, port, &portStats);
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      ind_ofdpa_counter_store_port_apply(port, &portStats);
+    }
+  }
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get stats on port %d.", port);
@@ -159,10 +448,9 @@ static indigo_error_t ind_ofdpa_queue_stats_set(of_port_no_t port,
     queueId = req_of_port_queue_id;
   }
 
-  ofdpa_rv = ofdpaNumQueuesGet(port, &numQueues);
+  ofdpa_rv = ind_ofdpa_queue_count_get(port, &numQueues);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
-    LOG_ERROR("Failed to get no. of port queues. (ofdpa_rv = %d)", ofdpa_rv);
     return (indigoConvertOfdpaRv(ofdpa_rv));
   }
 
@@ -180,7 +468,10 @@ static indigo_error_t ind_ofdpa_queue_stats_set(of_port_no_t port,
       LOG_ERROR("Too many queue stats replies.");
       return INDIGO_ERROR_RESOURCE;
     }
-    ofdpa_rv = ofdpaQueueStatsGet(port, queueId, &queueStats);
+    if (ind_ofdpa_queue_stats_cache_get(port, queueId, &queueStats) != INDIGO_ERROR_NONE)
+    {
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaQueueStatsGet, port, queueId, &queueStats);
+    }
     if (ofdpa_rv != OFDPA_E_NONE)
     {
       LOG_ERROR("Failed to queue stats for port %d on queue %d.", port, queueId);
@@ -208,119 +499,300 @@ static indigo_error_t ind_ofdpa_queue_stats_set(of_port_no_t port,
   return err;
 }
 
-/* Set the port features in LOCI structure
- * Parameters:
- *    port          (input)   Port number
- *    of_port_desc  (output)  Port description LOCI object
- */
-static indigo_error_t ind_ofdpa_port_features_set(of_port_no_t port,
-                                                  of_port_desc_t *of_port_desc)
+/* Port description fields, as last read from the client library */
+typedef struct
+{
+  uint32_t port;
+  ofdpaMacAddr_t mac;
+  char name[OFDPA_PORT_NAME_STRING_SIZE + 1];
+  OFDPA_PORT_CONFIG_t config;
+  OFDPA_PORT_STATE_t state;
+  ofdpaPortFeature_t features;
+  uint32_t currSpeed;
+  uint32_t maxSpeed;
+
+  /* Port status coalescing */
+  uint64_t lastSentUs;          /* os_time_monotonic() of the last message */
+  OFDPA_PORT_STATE_t sentState;
+  OFDPA_PORT_CONFIG_t sentConfig;
+  uint32_t sentSpeed;
+  int eventPending;
+  uint32_t suppressed;
+} ind_ofdpa_port_info_t;
+
+/* Sorted by port. Kept up to date by port events, so port_desc replies
+   and port status messages are built without reading every field of
+   every port again. */
+static ind_ofdpa_port_info_t *portInfo;
+static int portInfoCount;
+static int portInfoSize;
+
+/* Set once every port has been read */
+static int portInfoComplete;
+
+/* State change events for a port within this window of its last port
+   status message are merged, and only the final state is sent */
+static uint32_t portEventWindowMs;
+static int portEventTimerActive;
+static uint64_t portEventsReceived;
+static uint64_t portEventsSuppressed;
+
+/* Return the index of port, or of the entry it would be inserted before */
+static int ind_ofdpa_port_info_index(uint32_t port)
+{
+  int lo = 0, hi = portInfoCount;
+  int mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (portInfo[mid].port < port)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static ind_ofdpa_port_info_t *ind_ofdpa_port_info_lookup(uint32_t port)
+{
+  int i = ind_ofdpa_port_info_index(port);
+
+  if ((i < portInfoCount) && (portInfo[i].port == port))
+  {
+    return &portInfo[i];
+  }
+
+  return NULL;
+}
+
+static ind_ofdpa_port_info_t *ind_ofdpa_port_info_insert(uint32_t port)
+{
+  ind_ofdpa_port_info_t *info;
+  int i, size;
+
+  i = ind_ofdpa_port_info_index(port);
+  if ((i < portInfoCount) && (portInfo[i].port == port))
+  {
+    return &portInfo[i];
+  }
+
+  if (portInfoCount == portInfoSize)
+  {
+    size = portInfoSize ? (portInfoSize * 2) : 64;
+    info = realloc(portInfo, size * sizeof(*info));
+    if (info == NULL)
+    {
+      return NULL;
+    }
+    portInfo = info;
+    portInfoSize = size;
+  }
+
+  memmove(&portInfo[i + 1], &portInfo[i], (portInfoCount - i) * sizeof(*portInfo));
+  portInfoCount++;
+
+  memset(&portInfo[i], 0, sizeof(*portInfo));
+  portInfo[i].port = port;
+
+  return &portInfo[i];
+}
+
+static void ind_ofdpa_port_info_remove(uint32_t port)
+{
+  int i = ind_ofdpa_port_info_index(port);
+
+  if ((i < portInfoCount) && (portInfo[i].port == port))
+  {
+    memmove(&portInfo[i], &portInfo[i + 1], (portInfoCount - i - 1) * sizeof(*portInfo));
+    portInfoCount--;
+  }
+}
+
+/* Read the fields that change with the link: state, features and speed */
+static void ind_ofdpa_port_info_link_read(ind_ofdpa_port_info_t *info)
 {
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
-  ofdpaPortFeature_t  features;
+  uint32_t port = info->port;
 
-  ofdpa_rv = ofdpaPortFeatureGet(port, &features);
+  /* Port State */
+  info->state = 0;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortStateGet, port, &info->state);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
-    LOG_ERROR("Error getting port features");
-    return (indigoConvertOfdpaRv(ofdpa_rv));
+    LOG_ERROR("Failed to get Port State. (ofdpa_rv = %d)\n", ofdpa_rv);
   }
 
-  /* Port Current Features */
-  of_port_desc_curr_set(of_port_desc, features.curr);
-  /* Port Advertised Features */
-  of_port_desc_advertised_set(of_port_desc, features.advertised);
-  /* Port Supported Features */
-  of_port_desc_supported_set(of_port_desc, features.supported);
-  /* Peer Features */
-  of_port_desc_peer_set(of_port_desc, features.peer);
+  /* Port Features */
+  memset(&info->features, 0, sizeof(info->features));
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortFeatureGet, port, &info->features);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to get Port Features. (ofdpa_rv = %d)\n", ofdpa_rv);
+  }
 
-  return INDIGO_ERROR_NONE;
+  /* Port Current Speed in kbps */
+  info->currSpeed = 0;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortCurrSpeedGet, port, &info->currSpeed);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to get Port Current Speed. (ofdpa_rv = %d)\n", ofdpa_rv);
+  }
 }
 
-/* Set the port description in LOCI structure
- * Parameters:
- *    port          (input)   Port number
- *    of_port_desc  (output)  Port description LOCI object
- */
-static indigo_error_t ind_ofdpa_port_desc_set(of_port_no_t port, of_port_desc_t *of_port_desc)
+/* Read every field of a port */
+static void ind_ofdpa_port_info_read(ind_ofdpa_port_info_t *info)
 {
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
-  indigo_error_t err = INDIGO_ERROR_NONE;
-  ofdpaMacAddr_t mac;
-  of_mac_addr_t of_mac;
   ofdpa_buffdesc nameDesc;
-  OFDPA_PORT_STATE_t  state = 0;
-  OFDPA_PORT_CONFIG_t config = 0;
-  char buff[64];
-  uint32_t speed;
-
-  /* Set the port description parameters in LOCI structure */
-
-  /* Port ID */
-  of_port_desc_port_no_set(of_port_desc, port);
+  uint32_t port = info->port;
 
   /* Port MAC */
-  ofdpa_rv = ofdpaPortMacGet(port, &mac);
+  memset(&info->mac, 0, sizeof(info->mac));
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortMacGet, port, &info->mac);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get Port MAC. (ofdpa_rv = %d)\n", ofdpa_rv);
   }
-  memcpy(&of_mac, &mac, sizeof(of_mac));
-  of_port_desc_hw_addr_set(of_port_desc, of_mac);
 
   /* Port Name */
-  memset(buff, 0, sizeof(buff));
-  nameDesc.pstart = buff;
+  memset(info->name, 0, sizeof(info->name));
+  nameDesc.pstart = info->name;
   nameDesc.size = OFDPA_PORT_NAME_STRING_SIZE;
-  ofdpa_rv = ofdpaPortNameGet(port, &nameDesc);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortNameGet, port, &nameDesc);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get Port Name. (ofdpa_rv = %d)\n", ofdpa_rv);
   }
-  of_port_desc_name_set(of_port_desc, nameDesc.pstart);
 
   /* Port Config*/
-  ofdpa_rv = ofdpaPortConfigGet(port, &config);
+  info->config = 0;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortConfigGet, port, &info->config);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get Port Admin State. (ofdpa_rv = %d)\n", ofdpa_rv);
   }
-  of_port_desc_config_set(of_port_desc, config);
 
-  /* Port State */
-  ofdpa_rv = ofdpaPortStateGet(port, &state);
+  /* Port Maximum Speed in kbps */
+  info->maxSpeed = 0;
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortMaxSpeedGet, port, &info->maxSpeed);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
-    LOG_ERROR("Failed to get Port State. (ofdpa_rv = %d)\n", ofdpa_rv);
+    LOG_ERROR("Failed to get Port Max Speed. (ofdpa_rv = %d)\n", ofdpa_rv);
   }
-  of_port_desc_state_set(of_port_desc, state);
 
+  ind_ofdpa_port_info_link_read(info);
+}
 
-  /* Port Features */
-  err = ind_ofdpa_port_features_set(port, of_port_desc);
-  if (err != INDIGO_ERROR_NONE)
+/* Look up a port, reading it on a miss */
+static ind_ofdpa_port_info_t *ind_ofdpa_port_info_get(uint32_t port)
+{
+  ind_ofdpa_port_info_t *info;
+
+  info = ind_ofdpa_port_info_lookup(port);
+  if (info == NULL)
   {
-    LOG_ERROR("Failed to get Port Features. (err = %d)\n", err);
+    info = ind_ofdpa_port_info_insert(port);
+    if (info == NULL)
+    {
+      return NULL;
+    }
+    ind_ofdpa_port_info_read(info);
   }
 
-  /* Port Current Speed in kbps */
-  ofdpa_rv = ofdpaPortCurrSpeedGet(port, &speed);
-  if (ofdpa_rv != OFDPA_E_NONE)
+  return info;
+}
+
+/* Read every port once; afterwards port events keep the table current */
+static void ind_ofdpa_port_info_load(void)
+{
+  uint32_t port = 0;
+
+  while (IND_OFDPA_RPC(ofdpaPortNextGet, port, &port) == OFDPA_E_NONE)
   {
-    LOG_ERROR("Failed to get Port Current Speed. (ofdpa_rv = %d)\n", ofdpa_rv);
+    if (ind_ofdpa_port_info_get(port) == NULL)
+    {
+      return;
+    }
   }
-  of_port_desc_curr_speed_set(of_port_desc, speed);
 
+  portInfoComplete = 1;
+}
+
+/* Read every port ahead of the first port_desc request; returns the
+   number of ports */
+int ind_ofdpa_port_info_preload(void)
+{
+  if (!portInfoComplete)
+  {
+    ind_ofdpa_port_info_load();
+  }
+
+  return portInfoCount;
+}
+
+/* Set the port description in LOCI structure
+ * Parameters:
+ *    info          (input)   Cached port description fields
+ *    of_port_desc  (output)  Port description LOCI object
+ */
+static void ind_ofdpa_port_desc_fill(ind_ofdpa_port_info_t *info, of_port_desc_t *of_port_desc)
+{
+  of_mac_addr_t of_mac;
+
+  /* Port ID */
+  of_port_desc_port_no_set(of_port_desc, info->port);
+
+  /* Port MAC */
+  memcpy(&of_mac, &info->mac, sizeof(of_mac));
+  of_port_desc_hw_addr_set(of_port_desc, of_mac);
+
+  /* Port Name */
+  of_port_desc_name_set(of_port_desc, info->name);
+
+  /* Port Config*/
+  of_port_desc_config_set(of_port_desc, info->config);
+
+  /* Port State */
+  of_port_desc_state_set(of_port_desc, info->state);
+
+  /* Port Current Features */
+  of_port_desc_curr_set(of_port_desc, info->features.curr);
+  /* Port Advertised Features */
+  of_port_desc_advertised_set(of_port_desc, info->features.advertised);
+  /* Port Supported Features */
+  of_port_desc_supported_set(of_port_desc, info->features.supported);
+  /* Peer Features */
+  of_port_desc_peer_set(of_port_desc, info->features.peer);
+
+  /* Port Current Speed in kbps */
+  of_port_desc_curr_speed_set(of_port_desc, info->currSpeed);
 
   /* Port Maximum Speed in kbps */
-  speed = 0;
-  ofdpa_rv = ofdpaPortMaxSpeedGet(port, &speed);
-  if (ofdpa_rv != OFDPA_E_NONE)
+  of_port_desc_max_speed_set(of_port_desc, info->maxSpeed);
+}
+
+/* Set the port description in LOCI structure
+ * Parameters:
+ *    port          (input)   Port number
+ *    of_port_desc  (output)  Port description LOCI object
+ */
+static indigo_error_t ind_ofdpa_port_desc_set(of_port_no_t port, of_port_desc_t *of_port_desc)
+{
+  ind_ofdpa_port_info_t *info;
+
+  info = ind_ofdpa_port_info_get(port);
+  if (info == NULL)
   {
-    LOG_ERROR("Failed to get Port Max Speed. (ofdpa_rv = %d)\n", ofdpa_rv);
+    return INDIGO_ERROR_RESOURCE;
   }
-  of_port_desc_max_speed_set(of_port_desc, speed);
+
+  ind_ofdpa_port_desc_fill(info, of_port_desc);
 
   return INDIGO_ERROR_NONE;
 }
@@ -349,10 +821,9 @@ indigo_error_t indigo_port_features_get(of_features_reply_t *features)
 indigo_error_t indigo_port_desc_stats_get(of_port_desc_stats_reply_t *port_desc_stats_reply)
 {
   indigo_error_t err = INDIGO_ERROR_NONE;
-  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
   of_port_desc_t *of_port_desc = 0;
   of_list_port_desc_t *of_list_port_desc = 0;
-  uint32_t port= 0, nextPort = 0;
+  int i;
 
   LOG_TRACE("%s() called.", __FUNCTION__);
 
@@ -378,17 +849,16 @@ indigo_error_t indigo_port_desc_stats_get(of_port_desc_stats_reply_t *port_desc_
     return INDIGO_ERROR_RESOURCE;
   }
 
-  ofdpa_rv = ofdpaPortNextGet(port, &nextPort);
-  while(ofdpa_rv == OFDPA_E_NONE)
+  if (!portInfoComplete)
+  {
+    ind_ofdpa_port_info_load();
+  }
+
+  for (i = 0; i < portInfoCount; i++)
   {
     /* Set the port description parameters in LOCI structure (of_port_desc)
        to be sent in the reply message */
-    err = ind_ofdpa_port_desc_set(nextPort, of_port_desc);
-    if (err != INDIGO_ERROR_NONE)
-    {
-      LOG_ERROR("Failed to get OpenFlow port description for port %d.", nextPort);
-      break;
-    }
+    ind_ofdpa_port_desc_fill(&portInfo[i], of_port_desc);
 
     if (of_list_port_desc_append(of_list_port_desc, of_port_desc) < 0)
     {
@@ -396,8 +866,6 @@ indigo_error_t indigo_port_desc_stats_get(of_port_desc_stats_reply_t *port_desc_
       err = INDIGO_ERROR_UNKNOWN;
       break;
     }
-    port = nextPort;
-    ofdpa_rv = ofdpaPortNextGet(port, &nextPort);
   }
 
   if (of_port_desc_stats_reply_entries_set(port_desc_stats_reply, of_list_port_desc) < 0)
@@ -422,13 +890,14 @@ indigo_error_t indigo_port_modify(of_port_mod_t *port_mod)
   uint32_t of_mask;
   uint32_t of_advertise;
   ofdpaMacAddr_t mac;
+  ind_ofdpa_port_info_t *info;
 
   LOG_TRACE("%s() called", __FUNCTION__);
 
   of_port_mod_port_no_get(port_mod, &of_port_no);
 
   /* Check if the port hardware address is the same. Sanity check */
-  ofdpa_rv = ofdpaPortMacGet(of_port_no, &mac);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortMacGet, of_port_no, &mac);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get MAC address on port %d. (ofdpa_rv = %d)", of_port_no, ofdpa_rv);
@@ -447,7 +916,7 @@ indigo_error_t indigo_port_modify(of_port_mod_t *port_mod)
 
   of_config &= of_mask;
 
-  ofdpa_rv = ofdpaPortConfigSet(of_port_no, of_config);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortConfigSet, of_port_no, of_config);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to set config state on port %d. (ofdpa_rv = %d)", of_port_no, ofdpa_rv);
@@ -456,13 +925,20 @@ indigo_error_t indigo_port_modify(of_port_mod_t *port_mod)
 
   /* Set advertise features */
   of_port_mod_advertise_get(port_mod, &of_advertise);
-  ofdpa_rv = ofdpaPortAdvertiseFeatureSet(of_port_no, of_advertise);
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortAdvertiseFeatureSet, of_port_no, of_advertise);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to set advertise features on port %d. (ofdpa_rv = %d)", of_port_no, ofdpa_rv);
     return (indigoConvertOfdpaRv(ofdpa_rv));
   }
 
+  /* Config and advertised features changed */
+  info = ind_ofdpa_port_info_lookup(of_port_no);
+  if (info != NULL)
+  {
+    ind_ofdpa_port_info_read(info);
+  }
+
   return INDIGO_ERROR_NONE;
 }
 
@@ -502,7 +978,16 @@ indigo_error_t indigo_port_stats_get(of_port_stats_request_t *port_stats_request
   of_port_stats_request_port_no_get(port_stats_request, &req_of_port_num);
   if (req_of_port_num == OF_PORT_DEST_NONE_BY_VERSION(port_stats_request->version))
   {
-    ofdpa_rv = ofdpaPortNextGet(0, &port);
+    if (ind_ofdpa_port_stats_cache_enabled())
+    {
+      /* Answer from the snapshot without any client RPC */
+      ofdpa_rv = (ind_ofdpa_port_stats_cache_next(0, &port) == INDIGO_ERROR_NONE) ?
+        OFDPA_E_NONE : OFDPA_E_NOT_FOUND;
+    }
+    else
+    {
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaPortNextGet, 0, &port);
+    }
     if (ofdpa_rv != OFDPA_E_NONE)
     {
       LOG_ERROR("Failed to get first port.");
@@ -532,7 +1017,9 @@ indigo_error_t indigo_port_stats_get(of_port_stats_request_t *port_stats_request
       break;
     }
 
-  }while((ofdpaPortNextGet(port, &port) == OFDPA_E_NONE));
+  }while(ind_ofdpa_port_stats_cache_enabled() ?
+          (ind_ofdpa_port_stats_cache_next(port, &port) == INDIGO_ERROR_NONE) :
+          (IND_OFDPA_RPC(ofdpaPortNextGet, port, &port) == OFDPA_E_NONE));
 
   /* Free the reply message only on failure.
      Reply message is freed by the caller on success */
@@ -606,7 +1093,7 @@ indigo_error_t indigo_port_queue_config_get(of_queue_get_config_request_t *queue
   /* Check if the port is OFPP_ANY */
   if (req_of_port_num == OF_PORT_DEST_WILDCARD_BY_VERSION(queue_config_request->version))
   {
-    ofdpa_rv = ofdpaPortNextGet(0, &port);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPortNextGet, 0, &port);
     if (ofdpa_rv != OFDPA_E_NONE)
     {
       LOG_ERROR("Error geting first port. (ofdpa_rv = %d)", ofdpa_rv);
@@ -625,7 +1112,7 @@ indigo_error_t indigo_port_queue_config_get(of_queue_get_config_request_t *queue
     {
       of_queue_get_config_reply_port_set(*queue_config_reply, port);
       /* Set the of_packet_queue struct elements */
-      ofdpa_rv = ofdpaNumQueuesGet(port, &numQueues);
+      ofdpa_rv = ind_ofdpa_queue_count_get(port, &numQueues);
       if (ofdpa_rv != OFDPA_E_NONE)
       {
         LOG_ERROR("Error getting maximum queues supported on port %d. (ofdpa_rv = %d)", port, ofdpa_rv);
@@ -649,7 +1136,7 @@ indigo_error_t indigo_port_queue_config_get(of_queue_get_config_request_t *queue
       {
         break;
       }
-    }while((ofdpaPortNextGet(port, &port) == OFDPA_E_NONE) && (err == INDIGO_ERROR_NONE));
+    }while((IND_OFDPA_RPC(ofdpaPortNextGet, port, &port) == OFDPA_E_NONE) && (err == INDIGO_ERROR_NONE));
   }
 
   of_packet_queue_delete(of_packet_queue);
@@ -710,7 +1197,7 @@ indigo_error_t indigo_port_queue_stats_get(of_queue_stats_request_t *queue_stats
   if (req_of_port_num == OF_PORT_DEST_WILDCARD_BY_VERSION(queue_stats_request->version))
   {
     /* Get the first port if the queue stats message is for all the ports*/
-    ofdpa_rv = ofdpaPortNextGet(0, &port);
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPortNextGet, 0, &port);
     if (ofdpa_rv != OFDPA_E_NONE)
     {
       LOG_ERROR("Failed to get first port. (ofdpa_rv = %d)", ofdpa_rv);
@@ -739,7 +1226,7 @@ indigo_error_t indigo_port_queue_stats_get(of_queue_stats_request_t *queue_stats
       break;
     }
 
-  }while(ofdpaPortNextGet(port, &port) == OFDPA_E_NONE);
+  }while(IND_OFDPA_RPC(ofdpaPortNextGet, port, &port) == OFDPA_E_NONE);
 
   /* Free the reply message only on failure.
      Reply message is freed by the caller on success */
@@ -788,7 +1275,20 @@ void indigo_port_interface_list_destroy(indigo_port_info_t* list)
 indigo_error_t indigo_port_experimenter(of_experimenter_t *experimenter,
                                         indigo_cxn_id_t cxn_id)
 {
-  LOG_ERROR("indigo_port_experimenter() unsupported.");
+  uint32_t subtype;
+
+  /* Other experimenter messages are left to indigo_fwd_experimenter */
+  if (experimenter->object_id != OF_EXPERIMENTER_OFDPA)
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  of_experimenter_ofdpa_subtype_get(experimenter, &subtype);
+  if (subtype == IND_OFDPA_QUEUE_RATES_SUBTYPE)
+  {
+    return ind_ofdpa_queue_rates_msg(experimenter, cxn_id);
+  }
+
   return INDIGO_ERROR_NOT_SUPPORTED;
 }
 
@@ -818,69 +1318,214 @@ indigo_error_t indigo_port_packet_emit_group(uint32_t group_id,
   return INDIGO_ERROR_NOT_SUPPORTED;
 }
 
-void
-ind_ofdpa_port_event_receive(void)
+/* Send a port status message built from the cached description */
+static void ind_ofdpa_port_status_send(ind_ofdpa_port_info_t *info, int reason)
 {
   of_port_desc_t   *of_port_desc   = 0;
   of_port_status_t *of_port_status = 0;
-  ofdpaPortEvent_t portEventData;
-  int reason = 0;
 
-  LOG_TRACE("Reading Port Events");
+  of_port_desc = of_port_desc_new(ofagent_of_version);
+  if (of_port_desc == 0)
+  {
+    LOG_ERROR("of_port_desc_new() failed");
+    return;
+  }
+  ind_ofdpa_port_desc_fill(info, of_port_desc);
 
-  memset(&portEventData, 0, sizeof(portEventData));
-  while (ofdpaPortEventNextGet(&portEventData) == OFDPA_E_NONE)
+  of_port_status = of_port_status_new(ofagent_of_version);
+  if (of_port_status == 0)
   {
-    LOG_TRACE("client_event: retrieved port event: port no = %d, eventMask = 0x%x, state = %d\n",
-              portEventData.portNum, portEventData.eventMask, portEventData.state);
+    LOG_ERROR("of_port_status_new() failed");
+    of_port_desc_delete(of_port_desc);
+    return;
+  }
+
+  of_port_status_reason_set(of_port_status, reason);
+  of_port_status_desc_set(of_port_status, of_port_desc);
+  of_port_desc_delete(of_port_desc);
+
+  indigo_core_port_status_update(of_port_status);
+
+  info->sentState = info->state;
+  info->sentConfig = info->config;
+  info->sentSpeed = info->currSpeed;
+  info->lastSentUs = os_time_monotonic();
+}
+
+/* Send the final state of ports whose events were held back */
+static void ind_ofdpa_port_event_flush_timer(void *cookie)
+{
+  uint64_t now = os_time_monotonic();
+  int pending = 0;
+  int i;
 
-    of_port_desc = of_port_desc_new(ofagent_of_version);
-    if (of_port_desc == 0)
+  for (i = 0; i < portInfoCount; i++)
+  {
+    ind_ofdpa_port_info_t *info = &portInfo[i];
+
+    if (!info->eventPending)
     {
-      LOG_ERROR("of_port_desc_new() failed");
-      break;
+      continue;
+    }
+    if ((now - info->lastSentUs) < (uint64_t)portEventWindowMs * 1000)
+    {
+      pending = 1;
+      continue;
     }
 
-    if ((ind_ofdpa_port_desc_set(portEventData.portNum, of_port_desc)) < 0)
+    info->eventPending = 0;
+    ind_ofdpa_port_info_link_read(info);
+    if ((info->state == info->sentState) &&
+        (info->config == info->sentConfig) &&
+        (info->currSpeed == info->sentSpeed))
     {
-      LOG_ERROR("ind_ofdpa_port_desc_set() failed");
-      break;
+      /* Flapped back to what the controller last saw */
+      info->suppressed++;
+      portEventsSuppressed++;
+      continue;
     }
+    ind_ofdpa_port_status_send(info, OF_PORT_CHANGE_REASON_MODIFY);
+  }
+
+  if (!pending)
+  {
+    ind_soc_timer_event_unregister(ind_ofdpa_port_event_flush_timer, NULL);
+    portEventTimerActive = 0;
+  }
+}
 
-    of_port_status = of_port_status_new(ofagent_of_version);
-    if (of_port_status == 0)
+indigo_error_t ind_ofdpa_port_event_coalesce_init(uint32_t window_ms)
+{
+  portEventWindowMs = window_ms;
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_port_event_show(void)
+{
+  int i;
+
+  if (portEventWindowMs == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("Port events: %"PRIu64" received, %"PRIu64" coalesced within %u ms",
+           portEventsReceived, portEventsSuppressed, portEventWindowMs);
+  for (i = 0; i < portInfoCount; i++)
+  {
+    if (portInfo[i].suppressed != 0)
     {
-      LOG_ERROR("of_port_status_new() failed");
-      break;
+      LOG_INFO("  port %u: %u coalesced", portInfo[i].port, portInfo[i].suppressed);
     }
+  }
+}
+
+void
+ind_ofdpa_port_event_process(ofdpaPortEvent_t *portEventData)
+{
+  ind_ofdpa_port_info_t *info;
+  uint64_t now;
+
+  LOG_TRACE("client_event: retrieved port event: port no = %d, eventMask = 0x%x, state = %d\n",
+            portEventData->portNum, portEventData->eventMask, portEventData->state);
 
-    if (portEventData.eventMask & OFDPA_EVENT_PORT_CREATE)
+  portEventsReceived++;
+
+  if (portEventData->eventMask & (OFDPA_EVENT_PORT_CREATE | OFDPA_EVENT_PORT_DELETE))
+  {
+    ind_ofdpa_queue_config_invalidate(portEventData->portNum);
+  }
+
+  /* Refresh only the port of the event */
+  if (portEventData->eventMask & OFDPA_EVENT_PORT_CREATE)
+  {
+    info = ind_ofdpa_port_info_insert(portEventData->portNum);
+    if (info != NULL)
     {
-      reason = OF_PORT_CHANGE_REASON_ADD;
+      ind_ofdpa_port_info_read(info);
+      info->eventPending = 0;
+      ind_ofdpa_port_status_send(info, OF_PORT_CHANGE_REASON_ADD);
     }
-    else if (portEventData.eventMask & OFDPA_EVENT_PORT_DELETE)
+  }
+  else if (portEventData->eventMask & OFDPA_EVENT_PORT_DELETE)
+  {
+    info = ind_ofdpa_port_info_get(portEventData->portNum);
+    if (info != NULL)
     {
-      reason = OF_PORT_CHANGE_REASON_DELETE;
+      /* The description of a deleted port is its last known one */
+      ind_ofdpa_port_status_send(info, OF_PORT_CHANGE_REASON_DELETE);
+      ind_ofdpa_port_info_remove(portEventData->portNum);
     }
-    else if (portEventData.eventMask & OFDPA_EVENT_PORT_STATE)
+  }
+  else
+  {
+    info = ind_ofdpa_port_info_lookup(portEventData->portNum);
+    if (info == NULL)
     {
-      reason = OF_PORT_CHANGE_REASON_MODIFY;
+      info = ind_ofdpa_port_info_get(portEventData->portNum);
+    }
+    else
+    {
+      now = os_time_monotonic();
+      if ((portEventWindowMs != 0) &&
+          (info->eventPending ||
+           ((now - info->lastSentUs) < (uint64_t)portEventWindowMs * 1000)))
+      {
+        /* Inside the window of the last message; send the final state
+           from the flush timer */
+        if (info->eventPending)
+        {
+          info->suppressed++;
+          portEventsSuppressed++;
+        }
+        info->eventPending = 1;
+        if (!portEventTimerActive &&
+            (ind_soc_timer_event_register(ind_ofdpa_port_event_flush_timer, NULL,
+                                          portEventWindowMs) == INDIGO_ERROR_NONE))
+        {
+          portEventTimerActive = 1;
+        }
+        if (portEventTimerActive)
+        {
+          return;
+        }
+        info->eventPending = 0;
+      }
+      ind_ofdpa_port_info_link_read(info);
     }
 
-    of_port_status_reason_set(of_port_status, reason);
-    of_port_status_desc_set(of_port_status, of_port_desc);
-    of_port_desc_delete(of_port_desc);
-
-    indigo_core_port_status_update(of_port_status);
-
-    of_port_desc   = 0;     /* No longer owned */
-    of_port_status = 0;     /* No longer owned */
+    if (info != NULL)
+    {
+      ind_ofdpa_port_status_send(info, OF_PORT_CHANGE_REASON_MODIFY);
+    }
   }
 
-  if (of_port_desc)
+  if (info == NULL)
   {
-    of_port_desc_delete(of_port_desc);
+    LOG_ERROR("Failed to get port description for port %d", portEventData->portNum);
   }
 
   return;
 }
+
+int
+ind_ofdpa_port_event_receive(void)
+{
+  ofdpaPortEvent_t portEventData;
+  int count = 0;
+
+  LOG_TRACE("Reading Port Events");
+
+  memset(&portEventData, 0, sizeof(portEventData));
+  while (IND_OFDPA_RPC(ofdpaPortEventNextGet, &portEventData) == OFDPA_E_NONE)
+  {
+    if (ind_ofdpa_event_port_subscribed(portEventData.portNum))
+    {
+      ind_ofdpa_port_event_process(&portEventData);
+      count++;
+    }
+  }
+
+  return count;
+}
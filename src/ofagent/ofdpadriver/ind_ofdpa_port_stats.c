@@ -0,0 +1,395 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_port_stats.c
+*
+* @purpose    Port counter collector for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The counters of every port are read by a periodic
+*             SocketManager task into a snapshot. Port stats requests are
+*             answered from the latest snapshot, so the number of client
+*             RPCs no longer grows with the number of pollers. The
+*             difference between the last two snapshots gives per port
+*             deltas and rates. Queue counters are collected in the same
+*             walk while queue stats are being requested. Counters are
+*             passed through the counter store as they are read, so with
+*             --counterstore they keep counting across restarts.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <OS/os_time.h>
+
+/* Queue counters are dropped from the walk after this many intervals
+   without a queue stats request */
+#define IND_OFDPA_QUEUE_STATS_IDLE_INTERVALS 10
+
+typedef struct
+{
+  uint32_t port;
+  ofdpaPortStats_t stats;
+  ind_ofdpa_port_stats_rate_t rate;
+  uint32_t numQueues;           /* 0 if queue counters were not collected */
+  int queueIndex;               /* first queue in the snapshot queue array */
+} ind_ofdpa_port_stats_entry_t;
+
+typedef struct
+{
+  ind_ofdpa_snapshot_t ports;
+  ofdpaPortQueueStats_t *queues;
+  int queueCount;
+  int queueSize;
+  uint64_t timeUs;              /* os_time_monotonic() at the walk start */
+} ind_ofdpa_port_stats_snapshot_t;
+
+static uint32_t portStatsIntervalMs;
+
+/* Latest complete snapshot, and the one being collected */
+static ind_ofdpa_port_stats_snapshot_t portStatsCurrent =
+  { .ports = IND_OFDPA_SNAPSHOT_INIT(ind_ofdpa_port_stats_entry_t) };
+static ind_ofdpa_port_stats_snapshot_t portStatsNext =
+  { .ports = IND_OFDPA_SNAPSHOT_INIT(ind_ofdpa_port_stats_entry_t) };
+
+static uint32_t walkPort;
+static int walkFirst;
+static int walkQueues;
+
+/* os_time_monotonic() of the last queue stats lookup */
+static uint64_t queueStatsRequestUs;
+
+/* Ports are walked in ascending order */
+static ind_ofdpa_port_stats_entry_t *port_stats_lookup(ind_ofdpa_port_stats_snapshot_t *snapshot,
+                                                       uint32_t port)
+{
+  return ind_ofdpa_snapshot_lookup(&snapshot->ports,
+                                   offsetof(ind_ofdpa_port_stats_entry_t, port), port);
+}
+
+static uint64_t port_stats_per_sec(uint64_t delta, uint64_t elapsedUs)
+{
+  return (elapsedUs == 0) ? 0 : (delta * 1000000) / elapsedUs;
+}
+
+static void port_stats_rate_compute(ind_ofdpa_port_stats_entry_t *entry, uint64_t elapsedUs)
+{
+  ind_ofdpa_port_stats_entry_t *prev;
+  ind_ofdpa_port_stats_rate_t *rate = &entry->rate;
+
+  memset(rate, 0, sizeof(*rate));
+
+  prev = port_stats_lookup(&portStatsCurrent, entry->port);
+  if ((prev == NULL) ||
+      (entry->stats.rx_packets < prev->stats.rx_packets) ||
+      (entry->stats.tx_packets < prev->stats.tx_packets))
+  {
+    /* New port, or counters cleared */
+    return;
+  }
+
+  rate->rxPacketsDelta = entry->stats.rx_packets - prev->stats.rx_packets;
+  rate->txPacketsDelta = entry->stats.tx_packets - prev->stats.tx_packets;
+  rate->rxBytesDelta = entry->stats.rx_bytes - prev->stats.rx_bytes;
+  rate->txBytesDelta = entry->stats.tx_bytes - prev->stats.tx_bytes;
+  rate->rxDropsDelta = entry->stats.rx_drops - prev->stats.rx_drops;
+  rate->txDropsDelta = entry->stats.tx_drops - prev->stats.tx_drops;
+
+  rate->rxPps = port_stats_per_sec(rate->rxPacketsDelta, elapsedUs);
+  rate->txPps = port_stats_per_sec(rate->txPacketsDelta, elapsedUs);
+  rate->rxBps = port_stats_per_sec(rate->rxBytesDelta * 8, elapsedUs);
+  rate->txBps = port_stats_per_sec(rate->txBytesDelta * 8, elapsedUs);
+}
+
+/* Read the queue counters of the port in entry */
+static void port_stats_queues_collect(ind_ofdpa_port_stats_snapshot_t *snapshot,
+                                      ind_ofdpa_port_stats_entry_t *entry)
+{
+  ofdpaPortQueueStats_t *queues;
+  uint32_t numQueues, queueId;
+  OFDPA_ERROR_t ofdpa_rv;
+  int size;
+
+  entry->numQueues = 0;
+  entry->queueIndex = snapshot->queueCount;
+
+  /* The queue config cache belongs to the SocketManager loop */
+  ofdpa_rv = ind_ofdpa_collector_threaded() ?
+    IND_OFDPA_RPC(ofdpaNumQueuesGet, entry->port, &numQueues) :
+    ind_ofdpa_queue_count_get(entry->port, &numQueues);
+  if ((ofdpa_rv != OFDPA_E_NONE) || (numQueues == 0))
+  {
+    return;
+  }
+
+  if (snapshot->queueCount + numQueues > snapshot->queueSize)
+  {
+    size = snapshot->queueSize ? snapshot->queueSize : 512;
+    while (size < snapshot->queueCount + numQueues)
+    {
+      size *= 2;
+    }
+    queues = realloc(snapshot->queues, size * sizeof(*queues));
+    if (queues == NULL)
+    {
+      return;
+    }
+    snapshot->queues = queues;
+    snapshot->queueSize = size;
+  }
+
+  for (queueId = 0; queueId < numQueues; queueId++)
+  {
+    memset(&snapshot->queues[entry->queueIndex + queueId], 0, sizeof(ofdpaPortQueueStats_t));
+    if (IND_OFDPA_RPC(ofdpaQueueStatsGet, entry->port, queueId,
+                                          &snapshot->queues[entry->queueIndex + queueId]) != OFDPA_E_NONE)
+    {
+      LOG_TRACE("Failed to get queue %u stats on port %u.", queueId, entry->port);
+      return;
+    }
+  }
+
+  entry->numQueues = numQueues;
+  snapshot->queueCount += numQueues;
+}
+
+static void port_stats_walk_finish(void)
+{
+  ind_ofdpa_port_stats_snapshot_t tmp;
+  uint64_t elapsedUs;
+  uint32_t i;
+
+  elapsedUs = (portStatsCurrent.timeUs != 0) ?
+    (portStatsNext.timeUs - portStatsCurrent.timeUs) : 0;
+  for (i = 0; i < portStatsNext.ports.count; i++)
+  {
+    port_stats_rate_compute(ind_ofdpa_snapshot_entry(&portStatsNext.ports, i), elapsedUs);
+  }
+
+  /* Keep both buffers to avoid reallocating on every walk */
+  tmp = portStatsCurrent;
+  portStatsCurrent = portStatsNext;
+  portStatsNext = tmp;
+  portStatsNext.ports.count = 0;
+}
+
+static ind_ofdpa_collect_status_t port_stats_walk_step(void)
+{
+  ind_ofdpa_port_stats_entry_t *entry;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  if (walkFirst)
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPortNextGet, 0, &walkPort);
+    walkFirst = 0;
+  }
+  else
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaPortNextGet, walkPort, &walkPort);
+  }
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    return IND_OFDPA_COLLECT_FINISHED;
+  }
+
+  entry = ind_ofdpa_snapshot_append(&portStatsNext.ports);
+  if (entry == NULL)
+  {
+    LOG_ERROR("Failed to grow port stats snapshot");
+    portStatsNext.ports.count = 0;
+    return IND_OFDPA_COLLECT_ABORTED;
+  }
+
+  entry->port = walkPort;
+  memset(&entry->stats, 0, sizeof(entry->stats));
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaPortStatsGet, walkPort, &entry->stats);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_TRACE("Failed to get stats on port %d.", walkPort);
+    portStatsNext.ports.count--;
+    return IND_OFDPA_COLLECT_CONTINUE;
+  }
+  ind_ofdpa_counter_store_port_apply(walkPort, &entry->stats);
+
+  entry->numQueues = 0;
+  if (walkQueues)
+  {
+    port_stats_queues_collect(&portStatsNext, entry);
+  }
+
+  return IND_OFDPA_COLLECT_CONTINUE;
+}
+
+static void port_stats_walk_start(void)
+{
+  uint64_t requestUs;
+
+  portStatsNext.ports.count = 0;
+  portStatsNext.queueCount = 0;
+  portStatsNext.timeUs = os_time_monotonic();
+  walkFirst = 1;
+  requestUs = __atomic_load_n(&queueStatsRequestUs, __ATOMIC_RELAXED);
+  walkQueues = (requestUs != 0) &&
+    ((portStatsNext.timeUs - requestUs) <
+     (uint64_t)portStatsIntervalMs * 1000 * IND_OFDPA_QUEUE_STATS_IDLE_INTERVALS);
+}
+
+static ind_ofdpa_collector_t portStatsCollector =
+{
+  .name = "port stats collector",
+  .cls = IND_OFDPA_COLLECT_CLASS_PORT,
+  .start = port_stats_walk_start,
+  .step = port_stats_walk_step,
+  .finish = port_stats_walk_finish,
+};
+
+indigo_error_t ind_ofdpa_port_stats_cache_init(uint32_t interval_ms)
+{
+  portStatsIntervalMs = interval_ms;
+  if (portStatsIntervalMs == 0)
+  {
+    LOG_VERBOSE("Port stats collector disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  portStatsCollector.intervalMs = portStatsIntervalMs;
+  if (ind_ofdpa_collector_register(&portStatsCollector) != INDIGO_ERROR_NONE)
+  {
+    portStatsIntervalMs = 0;
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  /* Have a snapshot ready for the first request */
+  ind_ofdpa_collector_refresh(&portStatsCollector);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* True once a complete snapshot is available */
+int ind_ofdpa_port_stats_cache_enabled(void)
+{
+  return (portStatsIntervalMs != 0) && (portStatsCurrent.timeUs != 0);
+}
+
+indigo_error_t ind_ofdpa_port_stats_cache_get(uint32_t port, ofdpaPortStats_t *stats)
+{
+  ind_ofdpa_port_stats_entry_t *entry;
+
+  entry = port_stats_lookup(&portStatsCurrent, port);
+  if (entry == NULL)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  memcpy(stats, &entry->stats, sizeof(*stats));
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t ind_ofdpa_port_stats_rate_get(uint32_t port, ind_ofdpa_port_stats_rate_t *rate)
+{
+  ind_ofdpa_port_stats_entry_t *entry;
+
+  entry = port_stats_lookup(&portStatsCurrent, port);
+  if (entry == NULL)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  memcpy(rate, &entry->rate, sizeof(*rate));
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Misses until queue stats have been requested for a collection interval */
+indigo_error_t ind_ofdpa_queue_stats_cache_get(uint32_t port, uint32_t queueId,
+                                               ofdpaPortQueueStats_t *stats)
+{
+  ind_ofdpa_port_stats_entry_t *entry;
+
+  if (portStatsIntervalMs == 0)
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+  __atomic_store_n(&queueStatsRequestUs, os_time_monotonic(), __ATOMIC_RELAXED);
+
+  entry = port_stats_lookup(&portStatsCurrent, port);
+  if ((entry == NULL) || (queueId >= entry->numQueues))
+  {
+    return INDIGO_ERROR_NOT_FOUND;
+  }
+
+  memcpy(stats, &portStatsCurrent.queues[entry->queueIndex + queueId], sizeof(*stats));
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Same contract as ofdpaPortNextGet, over the ports of the latest snapshot */
+indigo_error_t ind_ofdpa_port_stats_cache_next(uint32_t port, uint32_t *nextPort)
+{
+  ind_ofdpa_port_stats_entry_t *entry;
+  uint32_t i;
+
+  for (i = 0; i < portStatsCurrent.ports.count; i++)
+  {
+    entry = ind_ofdpa_snapshot_entry(&portStatsCurrent.ports, i);
+    if (entry->port > port)
+    {
+      *nextPort = entry->port;
+      return INDIGO_ERROR_NONE;
+    }
+  }
+
+  return INDIGO_ERROR_NOT_FOUND;
+}
+
+void ind_ofdpa_port_stats_show(void)
+{
+  ind_ofdpa_port_stats_entry_t *entry;
+  uint32_t i;
+
+  if (!ind_ofdpa_port_stats_cache_enabled())
+  {
+    return;
+  }
+
+  LOG_INFO("Port rates over the last %u ms (snapshot %u):", portStatsIntervalMs,
+           ind_ofdpa_stats_generation_get(IND_OFDPA_COLLECT_CLASS_PORT));
+  for (i = 0; i < portStatsCurrent.ports.count; i++)
+  {
+    entry = ind_ofdpa_snapshot_entry(&portStatsCurrent.ports, i);
+    if ((entry->rate.rxPacketsDelta == 0) && (entry->rate.txPacketsDelta == 0))
+    {
+      continue;
+    }
+    LOG_INFO("  port %u: rx %"PRIu64" pps %"PRIu64" bps, tx %"PRIu64" pps %"PRIu64" bps, "
+             "drops rx %"PRIu64" tx %"PRIu64,
+             entry->port, entry->rate.rxPps, entry->rate.rxBps,
+             entry->rate.txPps, entry->rate.txBps,
+             entry->rate.rxDropsDelta, entry->rate.txDropsDelta);
+  }
+}
@@ -0,0 +1,336 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_punt.c
+*
+* @purpose    Packet-in cookies for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   OF-DPA reports only the table a packet was punted from, not
+*             the flow that punted it. The flows with an output to the
+*             controller are tracked per table, and while a table has
+*             exactly one, its packet-ins carry that flow's cookie.
+*             The cookie of each table is kept in an array that the
+*             packet-in path reads without a lock, so it also works from
+*             the packet thread. Otherwise the cookie is all ones, as
+*             before. The max_len of the controller outputs is kept the
+*             same way; with several flows the largest is used, so a
+*             packet is never cut shorter than its flow asked for.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+
+#define IND_OFDPA_PUNT_TABLES        256
+#define IND_OFDPA_PUNT_FLOW_BUCKETS  256
+#define IND_OFDPA_PUNT_NO_COOKIE     0xffffffffffffffffULL
+
+/* A flow with an output to the controller, by cookie and on the list of
+   its table */
+typedef struct ind_ofdpa_punt_flow_s
+{
+  bighash_entry_t hash_entry;
+  uint64_t cookie;
+  list_links_t links;
+  uint32_t tableId;
+  uint16_t maxLen;
+} ind_ofdpa_punt_flow_t;
+
+#define TEMPLATE_NAME punt_flow_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_punt_flow_t
+#define TEMPLATE_KEY_FIELD cookie
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+typedef struct
+{
+  list_head_t flows;
+  uint32_t flowCount;
+} ind_ofdpa_punt_table_t;
+
+static ind_ofdpa_punt_table_t puntTables[IND_OFDPA_PUNT_TABLES];
+static bighash_table_t *puntFlowTable;
+
+/* Read by the packet-in path, possibly on the packet thread. A packet
+   punted while a table changes may see the new cookie with the old
+   max_len or the reverse. */
+static uint64_t puntCookies[IND_OFDPA_PUNT_TABLES];
+static uint16_t puntMaxLens[IND_OFDPA_PUNT_TABLES];
+
+static uint64_t puntCookiesSet;
+
+static int punt_flow_to_controller(const ofdpaFlowEntry_t *flow)
+{
+  uint32_t outputPort;
+
+  switch (flow->tableId)
+  {
+    case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
+      outputPort = flow->flowData.terminationMacFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_BRIDGING:
+      outputPort = flow->flowData.bridgingFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT:
+      outputPort = flow->flowData.mpFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT:
+      outputPort = flow->flowData.mplsMpFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
+      outputPort = flow->flowData.unicastRoutingFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
+      outputPort = flow->flowData.policyAclFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
+      outputPort = flow->flowData.colorActionsFlowEntry.outputPort;
+      break;
+    case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
+      outputPort = flow->flowData.egressMpFlowEntry.outputPort;
+      break;
+    default:
+      return 0;
+  }
+
+  return (outputPort == OFDPA_PORT_CONTROLLER);
+}
+
+/* max_len of the first output to the controller in the apply actions */
+static uint16_t punt_flow_max_len(of_flow_add_t *flow_add)
+{
+  of_list_instruction_t insts;
+  of_instruction_t inst;
+  of_list_action_t actions;
+  of_action_t act;
+  of_port_no_t port_no;
+  uint16_t maxLen;
+  int rv, actRv;
+
+  of_flow_add_instructions_bind(flow_add, &insts);
+  OF_LIST_INSTRUCTION_ITER(&insts, &inst, rv)
+  {
+    if (inst.header.object_id != OF_INSTRUCTION_APPLY_ACTIONS)
+    {
+      continue;
+    }
+
+    of_instruction_apply_actions_actions_bind(&inst.apply_actions, &actions);
+    OF_LIST_ACTION_ITER(&actions, &act, actRv)
+    {
+      if (act.header.object_id != OF_ACTION_OUTPUT)
+      {
+        continue;
+      }
+      of_action_output_port_get(&act.output, &port_no);
+      if (port_no == OF_PORT_DEST_CONTROLLER)
+      {
+        of_action_output_max_len_get(&act.output, &maxLen);
+        return maxLen;
+      }
+    }
+  }
+
+  return OF_CONTROLLER_PKT_NO_BUFFER;
+}
+
+static void punt_cookie_update(uint32_t tableId)
+{
+  ind_ofdpa_punt_table_t *table = &puntTables[tableId];
+  ind_ofdpa_punt_flow_t *entry;
+  list_links_t *cur;
+  uint64_t cookie = IND_OFDPA_PUNT_NO_COOKIE;
+  uint16_t maxLen = 0;
+
+  if (table->flowCount == 1)
+  {
+    entry = container_of(list_first(&table->flows), links, ind_ofdpa_punt_flow_t);
+    cookie = entry->cookie;
+    puntCookiesSet++;
+  }
+
+  LIST_FOREACH(&table->flows, cur)
+  {
+    entry = container_of(cur, links, ind_ofdpa_punt_flow_t);
+    if (entry->maxLen > maxLen)
+    {
+      maxLen = entry->maxLen;
+    }
+  }
+  if (table->flowCount == 0)
+  {
+    maxLen = OF_CONTROLLER_PKT_NO_BUFFER;
+  }
+
+  __atomic_store_n(&puntCookies[tableId], cookie, __ATOMIC_RELAXED);
+  __atomic_store_n(&puntMaxLens[tableId], maxLen, __ATOMIC_RELAXED);
+}
+
+int ind_ofdpa_punt_table_tracked(uint32_t tableId)
+{
+  switch (tableId)
+  {
+    case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
+    case OFDPA_FLOW_TABLE_ID_BRIDGING:
+    case OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT:
+    case OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT:
+    case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
+    case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
+    case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
+    case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+indigo_error_t ind_ofdpa_punt_init(void)
+{
+  int i;
+
+  for (i = 0; i < IND_OFDPA_PUNT_TABLES; i++)
+  {
+    list_init(&puntTables[i].flows);
+    puntCookies[i] = IND_OFDPA_PUNT_NO_COOKIE;
+    puntMaxLens[i] = OF_CONTROLLER_PKT_NO_BUFFER;
+  }
+
+  puntFlowTable = bighash_table_create(IND_OFDPA_PUNT_FLOW_BUCKETS);
+  if (puntFlowTable == NULL)
+  {
+    LOG_ERROR("Failed to allocate packet-in cookie table.");
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_punt_flow_added(const ofdpaFlowEntry_t *flow, of_flow_add_t *flow_add)
+{
+  ind_ofdpa_punt_flow_t *entry;
+
+  if ((puntFlowTable == NULL) || (flow->tableId >= IND_OFDPA_PUNT_TABLES) ||
+      !punt_flow_to_controller(flow) ||
+      (punt_flow_hashtable_first(puntFlowTable, &flow->cookie) != NULL))
+  {
+    return;
+  }
+
+  entry = calloc(1, sizeof(*entry));
+  if (entry == NULL)
+  {
+    /* Until the table changes again, its cookie could be wrong */
+    LOG_ERROR("Failed to track flow 0x%llx for packet-in cookies.",
+              (unsigned long long)flow->cookie);
+    __atomic_store_n(&puntCookies[flow->tableId], IND_OFDPA_PUNT_NO_COOKIE, __ATOMIC_RELAXED);
+    __atomic_store_n(&puntMaxLens[flow->tableId], OF_CONTROLLER_PKT_NO_BUFFER, __ATOMIC_RELAXED);
+    return;
+  }
+  entry->cookie = flow->cookie;
+  entry->tableId = flow->tableId;
+  entry->maxLen = punt_flow_max_len(flow_add);
+  punt_flow_hashtable_insert(puntFlowTable, entry);
+
+  list_push(&puntTables[entry->tableId].flows, &entry->links);
+  puntTables[entry->tableId].flowCount++;
+  punt_cookie_update(entry->tableId);
+}
+
+void ind_ofdpa_punt_flow_removed(uint64_t cookie)
+{
+  ind_ofdpa_punt_flow_t *entry;
+
+  if (puntFlowTable == NULL)
+  {
+    return;
+  }
+
+  entry = punt_flow_hashtable_first(puntFlowTable, &cookie);
+  if (entry == NULL)
+  {
+    return;
+  }
+
+  list_remove(&entry->links);
+  puntTables[entry->tableId].flowCount--;
+  punt_cookie_update(entry->tableId);
+
+  bighash_remove(puntFlowTable, &entry->hash_entry);
+  free(entry);
+}
+
+/* A modify can add or remove the output to the controller */
+void ind_ofdpa_punt_flow_modified(const ofdpaFlowEntry_t *flow, of_flow_modify_t *flow_modify)
+{
+  ind_ofdpa_punt_flow_removed(flow->cookie);
+  ind_ofdpa_punt_flow_added(flow, flow_modify);
+}
+
+/* Cookie of the flow that punted the packet, and how much of the packet
+   the controller wants: miss_send_len for a table miss, the max_len of
+   the output action otherwise */
+uint64_t ind_ofdpa_punt_cookie_get(ofdpaPacket_t *pkt, uint16_t *maxLen)
+{
+  if (pkt->reason == OFDPA_PACKET_IN_REASON_NO_MATCH)
+  {
+    /* A table miss was not punted by a flow */
+    *maxLen = ind_ofdpa_pkt_buffer_miss_send_len();
+    return IND_OFDPA_PUNT_NO_COOKIE;
+  }
+
+  if ((pkt->reason != OFDPA_PACKET_IN_REASON_ACTION) ||
+      (pkt->tableId >= IND_OFDPA_PUNT_TABLES))
+  {
+    *maxLen = OF_CONTROLLER_PKT_NO_BUFFER;
+    return IND_OFDPA_PUNT_NO_COOKIE;
+  }
+
+  *maxLen = __atomic_load_n(&puntMaxLens[pkt->tableId], __ATOMIC_RELAXED);
+  return __atomic_load_n(&puntCookies[pkt->tableId], __ATOMIC_RELAXED);
+}
+
+void ind_ofdpa_punt_show(void)
+{
+  int i;
+
+  if ((puntFlowTable == NULL) || (bighash_entry_count(puntFlowTable) == 0))
+  {
+    return;
+  }
+
+  LOG_INFO("Packet-in cookies: %d flows output to the controller, "
+           "%"PRIu64" table cookie updates",
+           bighash_entry_count(puntFlowTable), puntCookiesSet);
+  for (i = 0; i < IND_OFDPA_PUNT_TABLES; i++)
+  {
+    if (puntTables[i].flowCount != 0)
+    {
+      LOG_INFO("  table %d: %u flows, cookie 0x%"PRIx64", max_len %u",
+               i, puntTables[i].flowCount, puntCookies[i], puntMaxLens[i]);
+    }
+  }
+}
@@ -0,0 +1,265 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_punt_dedup.c
+*
+* @purpose    Duplicate punt suppression for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   During broadcast storms and loops the same frame is punted
+*             over and over, often from several ports. Each punt is
+*             looked up in a direct mapped cache keyed by the ingress
+*             port, the frame length and a hash of the first bytes of the
+*             frame. The first punt of a frame passes and starts a window;
+*             copies seen on the same port within the window are dropped
+*             before the packet-in rate limiter, so they use neither its
+*             tokens nor a packet-in. A new window starts with the first
+*             copy after the old one ends, so the controller keeps seeing
+*             a frame that is punted steadily.
+*
+*             The cache is used on whichever thread receives packets. The
+*             per-port drop counters it writes are read by a timer on the
+*             SocketManager loop, which sends the controller a summary of
+*             the drops, see ind_ofdpa_punt_dedup.h.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "indigo/of_message.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_punt_dedup.h"
+#include "ind_ofdpa_log.h"
+#include <murmur/murmur.h>
+#include <SocketManager/socketmanager.h>
+#include <OS/os_time.h>
+
+/* Cache slots, a power of 2; a colliding frame evicts the older one */
+#define IND_OFDPA_PUNT_DEDUP_SLOTS      4096
+
+/* Ports with individual drop counters in the summaries */
+#define IND_OFDPA_PUNT_DEDUP_MAX_PORTS  256
+
+extern int ofagent_of_version;
+
+typedef struct
+{
+  uint64_t expires;           /* 0 for an unused slot */
+  uint32_t port;
+  uint32_t hash;
+  uint32_t len;
+} ind_ofdpa_punt_dedup_slot_t;
+
+static ind_ofdpa_punt_dedup_slot_t *dedupCache;
+static uint32_t dedupWindowMs;
+static uint32_t dedupBytes;
+
+/* Written by the receiving thread only */
+static uint64_t dedupChecked;
+static uint64_t dedupDropped;
+static uint64_t dedupEvictions;
+static uint32_t portDropped[IND_OFDPA_PUNT_DEDUP_MAX_PORTS];
+static uint32_t otherPortDropped;
+
+/* Counter values at the previous summary */
+static uint32_t portDroppedSent[IND_OFDPA_PUNT_DEDUP_MAX_PORTS];
+static uint32_t otherPortDroppedSent;
+
+static uint8_t dedupNotifyData[IND_OFDPA_PUNT_DEDUP_NOTIFY_HDR_LEN +
+                               IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORDS * IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORD_LEN];
+static uint64_t dedupNotifies;
+
+/* Called in ind_ofdpa_pkt_in_build on the thread receiving packets.
+   Returns 0 if the packet is a duplicate and must be dropped. */
+int ind_ofdpa_punt_dedup_admit(const ofdpaPacket_t *pkt)
+{
+  ind_ofdpa_punt_dedup_slot_t *slot;
+  uint32_t len, hash;
+  uint64_t now;
+
+  if (dedupCache == NULL)
+  {
+    return 1;
+  }
+
+  /* The frame is followed by the CRC */
+  len = (pkt->pktData.size >= 4) ? (pkt->pktData.size - 4) : 0;
+  hash = murmur_hash(pkt->pktData.pstart, (len < dedupBytes) ? len : dedupBytes,
+                     pkt->inPortNum);
+  slot = &dedupCache[hash & (IND_OFDPA_PUNT_DEDUP_SLOTS - 1)];
+  now = os_time_monotonic();
+  dedupChecked++;
+
+  if ((slot->expires > now) && (slot->hash == hash) &&
+      (slot->port == pkt->inPortNum) && (slot->len == len))
+  {
+    dedupDropped++;
+    if (pkt->inPortNum < IND_OFDPA_PUNT_DEDUP_MAX_PORTS)
+    {
+      portDropped[pkt->inPortNum]++;
+    }
+    else
+    {
+      otherPortDropped++;
+    }
+    return 0;
+  }
+
+  if (slot->expires > now)
+  {
+    dedupEvictions++;
+  }
+  slot->expires = now + (uint64_t)dedupWindowMs * 1000;
+  slot->port = pkt->inPortNum;
+  slot->hash = hash;
+  slot->len = len;
+
+  return 1;
+}
+
+static void dedup_notify_send(uint32_t dropped, uint32_t records, uint16_t flags)
+{
+  of_experimenter_t *msg;
+  of_octets_t octets;
+  uint8_t *p = dedupNotifyData;
+
+  p = ind_ofdpa_put32(p, dropped);
+  p = ind_ofdpa_put32(p, dedupWindowMs);
+  p = ind_ofdpa_put16(p, records);
+  p = ind_ofdpa_put16(p, flags);
+  ind_ofdpa_put32(p, 0);
+
+  octets.data = dedupNotifyData;
+  octets.bytes = IND_OFDPA_PUNT_DEDUP_NOTIFY_HDR_LEN +
+                 records * IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORD_LEN;
+  msg = indigo_of_experimenter_new(ofagent_of_version, IND_OFDPA_PUNT_DEDUP_NOTIFY_EXPERIMENTER,
+                                   IND_OFDPA_PUNT_DEDUP_NOTIFY_SUBTYPE, &octets);
+  if (msg == NULL)
+  {
+    LOG_ERROR("Failed to build duplicate punt summary");
+    return;
+  }
+
+  indigo_cxn_send_async_message(msg);
+  dedupNotifies++;
+}
+
+static void dedup_notify_timer(void *cookie)
+{
+  uint8_t *p = dedupNotifyData + IND_OFDPA_PUNT_DEDUP_NOTIFY_HDR_LEN;
+  uint32_t count, dropped = 0, records = 0;
+  uint16_t flags = 0;
+  int i;
+
+  for (i = 0; i < IND_OFDPA_PUNT_DEDUP_MAX_PORTS; i++)
+  {
+    count = portDropped[i];
+    if (count == portDroppedSent[i])
+    {
+      continue;
+    }
+    dropped += count - portDroppedSent[i];
+
+    if (records < IND_OFDPA_PUNT_DEDUP_NOTIFY_RECORDS)
+    {
+      p = ind_ofdpa_put32(p, i);
+      p = ind_ofdpa_put32(p, count - portDroppedSent[i]);
+      records++;
+    }
+    else
+    {
+      flags |= IND_OFDPA_PUNT_DEDUP_NOTIFY_TRUNCATED;
+    }
+    portDroppedSent[i] = count;
+  }
+
+  count = otherPortDropped;
+  if (count != otherPortDroppedSent)
+  {
+    dropped += count - otherPortDroppedSent;
+    flags |= IND_OFDPA_PUNT_DEDUP_NOTIFY_TRUNCATED;
+    otherPortDroppedSent = count;
+  }
+
+  if (dropped != 0)
+  {
+    dedup_notify_send(dropped, records, flags);
+  }
+}
+
+indigo_error_t ind_ofdpa_punt_dedup_init(uint32_t window_ms, uint32_t bytes)
+{
+  indigo_error_t err;
+
+  if ((window_ms == 0) || (bytes == 0))
+  {
+    LOG_VERBOSE("Duplicate punt suppression disabled");
+    return INDIGO_ERROR_NONE;
+  }
+
+  dedupWindowMs = window_ms;
+  dedupBytes = bytes;
+
+  err = ind_soc_timer_event_register(dedup_notify_timer, NULL,
+                                     IND_OFDPA_PUNT_DEDUP_NOTIFY_MS);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register duplicate punt summary timer");
+    return err;
+  }
+
+  /* Enables ind_ofdpa_punt_dedup_admit */
+  dedupCache = aim_zmalloc(IND_OFDPA_PUNT_DEDUP_SLOTS * sizeof(*dedupCache));
+
+  LOG_VERBOSE("Duplicate punt suppression: %u ms window, %u bytes compared",
+              dedupWindowMs, dedupBytes);
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_punt_dedup_show(void)
+{
+  int i;
+
+  if (dedupCache == NULL)
+  {
+    return;
+  }
+
+  LOG_INFO("Duplicate punt suppression: %u ms window, %u bytes compared",
+           dedupWindowMs, dedupBytes);
+  LOG_INFO("  %"PRIu64" checked, %"PRIu64" dropped, %"PRIu64" evictions, "
+           "%"PRIu64" summaries sent",
+           dedupChecked, dedupDropped, dedupEvictions, dedupNotifies);
+  for (i = 0; i < IND_OFDPA_PUNT_DEDUP_MAX_PORTS; i++)
+  {
+    if (portDropped[i] != 0)
+    {
+      LOG_INFO("  port %d: dropped %u", i, portDropped[i]);
+    }
+  }
+  if (otherPortDropped != 0)
+  {
+    LOG_INFO("  other ports: dropped %u", otherPortDropped);
+  }
+}
@@ -0,0 +1,821 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_route_compress.c
+*
+* @purpose    Unicast Routing table compression for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   When enabled, the Unicast Routing flows are kept in a
+*             binary trie per ethertype and VRF, and a route is only
+*             installed in OF-DPA if it forwards differently from the
+*             nearest shorter prefix covering it. A suppressed route is
+*             still a flow of the controller; its packets hit the
+*             covering route, so its own counters stay at zero. Routes
+*             with timeouts or an output port are always installed, as
+*             OF-DPA has to expire them or punt with their cookie.
+*
+*             Every change keeps the hardware forwarding the same for
+*             all addresses: the routes that stop being covered are
+*             installed before the route changes in hardware, and the
+*             routes that became redundant are only deleted after.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/time.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+
+#define IND_OFDPA_ROUTE_BUCKETS 16384
+
+#define IND_OFDPA_ROUTE_FAMILY_IPV4 0
+#define IND_OFDPA_ROUTE_FAMILY_IPV6 1
+#define IND_OFDPA_ROUTE_FAMILY_COUNT 2
+
+/* VRF matches of the routes of one family */
+#define IND_OFDPA_ROUTE_VRF_ANY     0
+#define IND_OFDPA_ROUTE_VRF_EXACT   1
+#define IND_OFDPA_ROUTE_VRF_PARTIAL 2
+#define IND_OFDPA_ROUTE_VRF_KINDS   3
+
+struct ind_ofdpa_route_node_s;
+
+typedef struct ind_ofdpa_route_s
+{
+  bighash_entry_t hash_entry;
+  uint64_t cookie;
+  struct ind_ofdpa_route_node_s *node;
+  struct ind_ofdpa_route_tree_s *tree;
+  ofdpaFlowEntry_t flow;
+  indigo_time_t created;
+  int pinned;                   /* never suppressed */
+  int shared;                   /* prefix also used by another flow */
+  int installed;
+} ind_ofdpa_route_t;
+
+#define TEMPLATE_NAME route_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_route_t
+#define TEMPLATE_KEY_FIELD cookie
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+/* Path compressed: a node without a route has two children */
+typedef struct ind_ofdpa_route_node_s
+{
+  struct ind_ofdpa_route_node_s *parent;
+  struct ind_ofdpa_route_node_s *child[2];
+  ind_ofdpa_route_t *route;
+  uint8_t len;
+  uint8_t prefix[16];
+} ind_ofdpa_route_node_t;
+
+typedef struct ind_ofdpa_route_tree_s
+{
+  struct ind_ofdpa_route_tree_s *next;
+  int family;
+  uint16_t vrf;
+  uint16_t vrfMask;
+  ind_ofdpa_route_node_t *root;
+} ind_ofdpa_route_tree_t;
+
+static int compressEnabled;
+static bighash_table_t *routeTable;
+static ind_ofdpa_route_tree_t *trees;
+
+/* Routes of a family by VRF match; with mixed VRF matches the trees of
+   the family overlap, so nothing in it is suppressed */
+static uint32_t familyVrfCount[IND_OFDPA_ROUTE_FAMILY_COUNT][IND_OFDPA_ROUTE_VRF_KINDS];
+
+static uint32_t installedCount;
+static uint64_t exposed;        /* installed as a covering route changed */
+static uint64_t hidden;         /* deleted as covered by an equal route */
+static uint64_t hwErrors;
+
+/* Bit of a prefix, from the most significant */
+static int route_bit(const uint8_t *prefix, int i)
+{
+  return (prefix[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/* Prefix length of a contiguous mask, -1 if it is not one */
+static int route_mask_len(const uint8_t *mask, int bytes)
+{
+  int len = 0;
+  int i;
+
+  while ((len < bytes * 8) && route_bit(mask, len))
+  {
+    len++;
+  }
+  for (i = len; i < bytes * 8; i++)
+  {
+    if (route_bit(mask, i))
+    {
+      return -1;
+    }
+  }
+  return len;
+}
+
+/* The trie key of a routing flow; 0 if the flow is not compressed */
+static int route_key_get(const ofdpaFlowEntry_t *flow, int *family,
+                         uint8_t *prefix, int *len)
+{
+  const ofdpaUnicastRoutingFlowMatch_t *match =
+    &flow->flowData.unicastRoutingFlowEntry.match_criteria;
+  uint8_t mask[16];
+  int i;
+
+  memset(prefix, 0, 16);
+  if (match->etherType == 0x0800)
+  {
+    *family = IND_OFDPA_ROUTE_FAMILY_IPV4;
+    for (i = 0; i < 4; i++)
+    {
+      prefix[i] = (match->dstIp4 >> (24 - (8 * i))) & 0xff;
+      mask[i] = (match->dstIp4Mask >> (24 - (8 * i))) & 0xff;
+    }
+    *len = route_mask_len(mask, 4);
+  }
+  else if (match->etherType == 0x86dd)
+  {
+    *family = IND_OFDPA_ROUTE_FAMILY_IPV6;
+    memcpy(prefix, match->dstIp6.s6_addr, 16);
+    *len = route_mask_len(match->dstIp6Mask.s6_addr, 16);
+  }
+  else
+  {
+    return 0;
+  }
+
+  return (*len >= 0);
+}
+
+static int route_vrf_kind(uint16_t vrfMask)
+{
+  if (vrfMask == 0)
+  {
+    return IND_OFDPA_ROUTE_VRF_ANY;
+  }
+  return (vrfMask == 0xffff) ? IND_OFDPA_ROUTE_VRF_EXACT : IND_OFDPA_ROUTE_VRF_PARTIAL;
+}
+
+static int route_family_compressed(int family)
+{
+  uint32_t *count = familyVrfCount[family];
+
+  return ((count[IND_OFDPA_ROUTE_VRF_PARTIAL] == 0) &&
+          ((count[IND_OFDPA_ROUTE_VRF_ANY] == 0) || (count[IND_OFDPA_ROUTE_VRF_EXACT] == 0)));
+}
+
+/* Whether a covered route forwards like its cover */
+static int route_same_action(const ind_ofdpa_route_t *route, const ind_ofdpa_route_t *cover)
+{
+  const ofdpaUnicastRoutingFlowEntry_t *a;
+  const ofdpaUnicastRoutingFlowEntry_t *b;
+
+  if ((cover == NULL) || route->pinned || cover->pinned ||
+      !route_family_compressed(route->tree->family))
+  {
+    return 0;
+  }
+
+  a = &route->flow.flowData.unicastRoutingFlowEntry;
+  b = &cover->flow.flowData.unicastRoutingFlowEntry;
+  return ((a->gotoTableId == b->gotoTableId) &&
+          (a->groupID == b->groupID) &&
+          (a->outputPort == b->outputPort));
+}
+
+static int route_timed(const ofdpaFlowEntry_t *flow)
+{
+  return ((flow->idle_time != 0) || (flow->hard_time != 0));
+}
+
+static int route_pinned(const ofdpaFlowEntry_t *flow)
+{
+  return (route_timed(flow) || (flow->flowData.unicastRoutingFlowEntry.outputPort != 0));
+}
+
+static OFDPA_ERROR_t route_hw_add(ind_ofdpa_route_t *route)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowAdd, &route->flow);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to install route 0x%llx. (ofdpa_rv = %d)",
+              (unsigned long long)route->cookie, ofdpa_rv);
+    hwErrors++;
+    return ofdpa_rv;
+  }
+
+  route->installed = 1;
+  installedCount++;
+  ind_ofdpa_flow_stats_cache_add(route->cookie);
+  ind_ofdpa_table_stats_flow_added(route->flow.tableId, route_timed(&route->flow));
+  return OFDPA_E_NONE;
+}
+
+static OFDPA_ERROR_t route_hw_delete(ind_ofdpa_route_t *route)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowByCookieDelete, route->cookie);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to remove route 0x%llx. (ofdpa_rv = %d)",
+              (unsigned long long)route->cookie, ofdpa_rv);
+    hwErrors++;
+    return ofdpa_rv;
+  }
+
+  route->installed = 0;
+  installedCount--;
+  ind_ofdpa_flow_stats_cache_remove(route->cookie);
+  ind_ofdpa_table_stats_flow_removed(route->flow.tableId, route_timed(&route->flow));
+  return OFDPA_E_NONE;
+}
+
+static ind_ofdpa_route_t *route_cover_get(ind_ofdpa_route_node_t *node)
+{
+  for (node = node->parent; node != NULL; node = node->parent)
+  {
+    if (node->route != NULL)
+    {
+      return node->route;
+    }
+  }
+  return NULL;
+}
+
+/* Install the routes directly below node that do not forward like cover */
+static void route_children_expose(ind_ofdpa_route_node_t *node, const ind_ofdpa_route_t *cover)
+{
+  ind_ofdpa_route_node_t *child;
+  int i;
+
+  for (i = 0; i < 2; i++)
+  {
+    child = node->child[i];
+    if (child == NULL)
+    {
+      continue;
+    }
+    if (child->route == NULL)
+    {
+      route_children_expose(child, cover);
+    }
+    else if (!child->route->installed && !route_same_action(child->route, cover))
+    {
+      if (route_hw_add(child->route) == OFDPA_E_NONE)
+      {
+        exposed++;
+      }
+    }
+  }
+}
+
+/* Remove the routes directly below node that forward like cover */
+static void route_children_hide(ind_ofdpa_route_node_t *node, const ind_ofdpa_route_t *cover)
+{
+  ind_ofdpa_route_node_t *child;
+  int i;
+
+  for (i = 0; i < 2; i++)
+  {
+    child = node->child[i];
+    if (child == NULL)
+    {
+      continue;
+    }
+    if (child->route == NULL)
+    {
+      route_children_hide(child, cover);
+    }
+    else if (child->route->installed && route_same_action(child->route, cover))
+    {
+      if (route_hw_delete(child->route) == OFDPA_E_NONE)
+      {
+        hidden++;
+      }
+    }
+  }
+}
+
+static void route_tree_expose(ind_ofdpa_route_node_t *node)
+{
+  if (node == NULL)
+  {
+    return;
+  }
+  if ((node->route != NULL) && !node->route->installed)
+  {
+    if (route_hw_add(node->route) == OFDPA_E_NONE)
+    {
+      exposed++;
+    }
+  }
+  route_tree_expose(node->child[0]);
+  route_tree_expose(node->child[1]);
+}
+
+static ind_ofdpa_route_node_t *route_node_new(ind_ofdpa_route_node_t *parent,
+                                              const uint8_t *prefix, int len)
+{
+  ind_ofdpa_route_node_t *node;
+  int i;
+
+  node = calloc(1, sizeof(*node));
+  if (node == NULL)
+  {
+    return NULL;
+  }
+  node->parent = parent;
+  node->len = len;
+  for (i = 0; i < len; i++)
+  {
+    if (route_bit(prefix, i))
+    {
+      node->prefix[i >> 3] |= 0x80 >> (i & 7);
+    }
+  }
+  return node;
+}
+
+/* Free the nodes no longer needed from node up */
+static void route_node_prune(ind_ofdpa_route_tree_t *tree, ind_ofdpa_route_node_t *node)
+{
+  ind_ofdpa_route_node_t *parent;
+  ind_ofdpa_route_node_t *child;
+
+  while ((node != NULL) && (node->route == NULL) &&
+         ((node->child[0] == NULL) || (node->child[1] == NULL)))
+  {
+    parent = node->parent;
+    child = (node->child[0] != NULL) ? node->child[0] : node->child[1];
+    if (parent == NULL)
+    {
+      tree->root = child;
+    }
+    else
+    {
+      parent->child[(parent->child[0] == node) ? 0 : 1] = child;
+    }
+    if (child != NULL)
+    {
+      child->parent = parent;
+    }
+    free(node);
+
+    /* The parent only changes shape if it lost a child */
+    node = (child == NULL) ? parent : NULL;
+  }
+}
+
+/* Find the node of a prefix, adding it if create is set */
+static ind_ofdpa_route_node_t *route_node_get(ind_ofdpa_route_tree_t *tree,
+                                              const uint8_t *prefix, int len, int create)
+{
+  ind_ofdpa_route_node_t **link = &tree->root;
+  ind_ofdpa_route_node_t *parent = NULL;
+  ind_ofdpa_route_node_t *node;
+  ind_ofdpa_route_node_t *branch;
+  ind_ofdpa_route_node_t *leaf;
+  int common;
+
+  while ((node = *link) != NULL)
+  {
+    common = 0;
+    while ((common < node->len) && (common < len) &&
+           (route_bit(node->prefix, common) == route_bit(prefix, common)))
+    {
+      common++;
+    }
+
+    if (common == node->len)
+    {
+      if (node->len == len)
+      {
+        return node;
+      }
+      parent = node;
+      link = &node->child[route_bit(prefix, node->len)];
+      continue;
+    }
+
+    if (!create)
+    {
+      return NULL;
+    }
+
+    /* The new prefix covers node, or both branch off a shorter one */
+    branch = route_node_new(node->parent, prefix, common);
+    if (branch == NULL)
+    {
+      return NULL;
+    }
+    branch->child[route_bit(node->prefix, common)] = node;
+    node->parent = branch;
+    *link = branch;
+    if (common == len)
+    {
+      return branch;
+    }
+
+    leaf = route_node_new(branch, prefix, len);
+    if (leaf == NULL)
+    {
+      route_node_prune(tree, branch);
+      return NULL;
+    }
+    branch->child[route_bit(prefix, common)] = leaf;
+    return leaf;
+  }
+
+  if (!create)
+  {
+    return NULL;
+  }
+  leaf = route_node_new(parent, prefix, len);
+  *link = leaf;
+  return leaf;
+}
+
+static ind_ofdpa_route_tree_t *route_tree_get(int family, uint16_t vrf, uint16_t vrfMask)
+{
+  ind_ofdpa_route_tree_t *tree;
+
+  vrf &= vrfMask;
+  for (tree = trees; tree != NULL; tree = tree->next)
+  {
+    if ((tree->family == family) && (tree->vrf == vrf) && (tree->vrfMask == vrfMask))
+    {
+      return tree;
+    }
+  }
+
+  tree = calloc(1, sizeof(*tree));
+  if (tree == NULL)
+  {
+    return NULL;
+  }
+  tree->family = family;
+  tree->vrf = vrf;
+  tree->vrfMask = vrfMask;
+  tree->next = trees;
+  trees = tree;
+  return tree;
+}
+
+/* Add a route to the trie; NULL if it is left to the caller as an
+   ordinary flow */
+static ind_ofdpa_route_t *route_insert(const ofdpaFlowEntry_t *flow, int installed)
+{
+  const ofdpaUnicastRoutingFlowMatch_t *match =
+    &flow->flowData.unicastRoutingFlowEntry.match_criteria;
+  ind_ofdpa_route_tree_t *tree;
+  ind_ofdpa_route_node_t *node;
+  ind_ofdpa_route_t *route;
+  uint8_t prefix[16];
+  int family;
+  int len;
+  int kind;
+  int wasCompressed;
+
+  if (!route_key_get(flow, &family, prefix, &len) ||
+      (route_hashtable_first(routeTable, &flow->cookie) != NULL))
+  {
+    return NULL;
+  }
+
+  tree = route_tree_get(family, match->vrf, match->vrfMask);
+  if (tree == NULL)
+  {
+    return NULL;
+  }
+
+  /* Same prefix at another priority: added as an ordinary flow, and
+     the route of the trie is no longer suppressed */
+  node = route_node_get(tree, prefix, len, 0);
+  if ((node != NULL) && (node->route != NULL))
+  {
+    route = node->route;
+    route->shared = route->pinned = 1;
+    route_children_expose(node, route);
+    if (!route->installed)
+    {
+      (void)route_hw_add(route);
+    }
+    return NULL;
+  }
+
+  route = calloc(1, sizeof(*route));
+  node = route_node_get(tree, prefix, len, 1);
+  if ((route == NULL) || (node == NULL))
+  {
+    LOG_ERROR("Failed to allocate route 0x%llx.", (unsigned long long)flow->cookie);
+    free(route);
+    route_node_prune(tree, node);
+    return NULL;
+  }
+
+  route->cookie = flow->cookie;
+  route->flow = *flow;
+  route->node = node;
+  route->tree = tree;
+  route->created = INDIGO_CURRENT_TIME;
+  route->pinned = route_pinned(flow);
+  route->installed = installed;
+  if (installed)
+  {
+    installedCount++;
+  }
+
+  /* Overlapping VRF matches: install the whole family from now on */
+  wasCompressed = route_family_compressed(family);
+  kind = route_vrf_kind(match->vrfMask);
+  familyVrfCount[family][kind]++;
+  if (wasCompressed && !route_family_compressed(family))
+  {
+    LOG_INFO("Routes with mixed VRF masks, %s routes no longer compressed",
+             (family == IND_OFDPA_ROUTE_FAMILY_IPV4) ? "IPv4" : "IPv6");
+    for (tree = trees; tree != NULL; tree = tree->next)
+    {
+      if (tree->family == family)
+      {
+        route_tree_expose(tree->root);
+      }
+    }
+  }
+
+  node->route = route;
+  route_hashtable_insert(routeTable, route);
+  return route;
+}
+
+/* Drop a route from the trie; its hardware entry is handled by the caller */
+static void route_forget(ind_ofdpa_route_t *route)
+{
+  const ofdpaUnicastRoutingFlowMatch_t *match =
+    &route->flow.flowData.unicastRoutingFlowEntry.match_criteria;
+
+  familyVrfCount[route->tree->family][route_vrf_kind(match->vrfMask)]--;
+  if (route->installed)
+  {
+    installedCount--;
+  }
+
+  route->node->route = NULL;
+  route_node_prune(route->tree, route->node);
+  bighash_remove(routeTable, &route->hash_entry);
+  free(route);
+}
+
+/* Move the hardware to a route's new flow; the trie keeps the old flow
+   if OF-DPA refuses the change */
+static OFDPA_ERROR_t route_update(ind_ofdpa_route_t *route, const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_route_t *cover = route_cover_get(route->node);
+  ofdpaFlowEntry_t oldFlow = route->flow;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+
+  route->flow = *flow;
+  route->pinned = route->shared || route_pinned(flow);
+
+  /* Children the route used to cover for */
+  route_children_expose(route->node, route);
+
+  if (route_same_action(route, cover))
+  {
+    if (route->installed)
+    {
+      ofdpa_rv = route_hw_delete(route);
+    }
+  }
+  else if (route->installed)
+  {
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowModify, &route->flow);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_TRACE("Failed to modify route 0x%llx. (ofdpa_rv = %d)",
+                (unsigned long long)route->cookie, ofdpa_rv);
+    }
+  }
+  else
+  {
+    ofdpa_rv = route_hw_add(route);
+  }
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    /* Whatever was exposed is still correct for the old flow */
+    route->flow = oldFlow;
+    route->pinned = route->shared || route_pinned(&oldFlow);
+    return ofdpa_rv;
+  }
+
+  route_children_hide(route->node, route);
+  return OFDPA_E_NONE;
+}
+
+/* Remove a route; hwGone if OF-DPA already removed its entry */
+static OFDPA_ERROR_t route_remove(ind_ofdpa_route_t *route, int hwGone)
+{
+  ind_ofdpa_route_t *cover = route_cover_get(route->node);
+  ind_ofdpa_route_node_t *node = route->node;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+
+  /* Covered by the route until now, by cover after */
+  route_children_expose(node, cover);
+
+  if (route->installed && !hwGone)
+  {
+    ofdpa_rv = route_hw_delete(route);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      return ofdpa_rv;
+    }
+  }
+
+  if (cover != NULL)
+  {
+    route_children_hide(node, cover);
+  }
+  route_forget(route);
+  return OFDPA_E_NONE;
+}
+
+indigo_error_t ind_ofdpa_route_compress_init(int enable)
+{
+  if (!enable)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  routeTable = bighash_table_create(IND_OFDPA_ROUTE_BUCKETS);
+  if (routeTable == NULL)
+  {
+    LOG_ERROR("Failed to allocate route table.");
+    return INDIGO_ERROR_RESOURCE;
+  }
+  compressEnabled = 1;
+
+  return INDIGO_ERROR_NONE;
+}
+
+int ind_ofdpa_route_compress_table(uint32_t tableId)
+{
+  return (compressEnabled && (tableId == OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING));
+}
+
+/* Returns 0 if the flow is left to the caller, else the result in *rv.
+   On success the route is accounted for in the table and counter caches. */
+int ind_ofdpa_route_compress_add(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  ind_ofdpa_route_t *route;
+
+  if (!ind_ofdpa_route_compress_table(flow->tableId))
+  {
+    return 0;
+  }
+
+  route = route_insert(flow, 0);
+  if (route == NULL)
+  {
+    return 0;
+  }
+
+  *rv = route_update(route, flow);
+  if (*rv != OFDPA_E_NONE)
+  {
+    route_remove(route, 1);
+  }
+  return 1;
+}
+
+int ind_ofdpa_route_compress_modify(const ofdpaFlowEntry_t *flow, OFDPA_ERROR_t *rv)
+{
+  ind_ofdpa_route_t *route;
+
+  if (!compressEnabled ||
+      ((route = route_hashtable_first(routeTable, &flow->cookie)) == NULL))
+  {
+    return 0;
+  }
+
+  *rv = route_update(route, flow);
+  return 1;
+}
+
+int ind_ofdpa_route_compress_delete(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats,
+                                    OFDPA_ERROR_t *rv)
+{
+  ind_ofdpa_route_t *route;
+  ofdpaFlowEntry_t flow;
+  ofdpaFlowEntryStats_t flowStats;
+
+  if (!compressEnabled || ((route = route_hashtable_first(routeTable, &cookie)) == NULL))
+  {
+    return 0;
+  }
+
+  if (!ind_ofdpa_route_compress_stats_get(cookie, flow_stats) &&
+      (!ind_ofdpa_flow_stats_cache_enabled() ||
+       (ind_ofdpa_flow_stats_cache_get(cookie, flow_stats) != INDIGO_ERROR_NONE)))
+  {
+    memset(&flowStats, 0, sizeof(flowStats));
+    if (IND_OFDPA_RPC(ofdpaFlowByCookieGet, cookie, &flow, &flowStats) == OFDPA_E_NONE)
+    {
+      flow_stats->flow_id = cookie;
+      flow_stats->packets = flowStats.receivedPackets;
+      flow_stats->bytes = flowStats.receivedBytes;
+      flow_stats->duration_ns = (flowStats.durationSec)*(IND_OFDPA_NANO_SEC);
+    }
+  }
+
+  *rv = route_remove(route, 0);
+  return 1;
+}
+
+/* Counters of a suppressed route; 0 if the route is in OF-DPA */
+int ind_ofdpa_route_compress_stats_get(uint64_t cookie, indigo_fi_flow_stats_t *flow_stats)
+{
+  ind_ofdpa_route_t *route;
+
+  if (!compressEnabled || ((route = route_hashtable_first(routeTable, &cookie)) == NULL) ||
+      route->installed)
+  {
+    return 0;
+  }
+
+  flow_stats->flow_id = cookie;
+  flow_stats->packets = 0;
+  flow_stats->bytes = 0;
+  flow_stats->duration_ns = (uint64_t)INDIGO_TIME_DIFF_ms(route->created, INDIGO_CURRENT_TIME) *
+    (IND_OFDPA_NANO_SEC / 1000);
+  return 1;
+}
+
+/* A route found in OF-DPA after a restart */
+void ind_ofdpa_route_compress_restore(const ofdpaFlowEntry_t *flow)
+{
+  if (!ind_ofdpa_route_compress_table(flow->tableId))
+  {
+    return;
+  }
+
+  /* Already counted in the table; only suppressed on the next change */
+  (void)route_insert(flow, 1);
+}
+
+/* OF-DPA removed a route that timed out */
+void ind_ofdpa_route_compress_expired(uint64_t cookie)
+{
+  ind_ofdpa_route_t *route;
+
+  if (compressEnabled && ((route = route_hashtable_first(routeTable, &cookie)) != NULL))
+  {
+    (void)route_remove(route, 1);
+  }
+}
+
+void ind_ofdpa_route_compress_show(void)
+{
+  uint32_t count;
+
+  if (!compressEnabled)
+  {
+    return;
+  }
+
+  count = bighash_entry_count(routeTable);
+  LOG_INFO("Route compression: %u routes, %u installed, %u suppressed",
+           count, installedCount, count - installedCount);
+  LOG_INFO("  %"PRIu64" exposed, %"PRIu64" hidden, %"PRIu64" OF-DPA errors",
+           exposed, hidden, hwErrors);
+}
@@ -0,0 +1,204 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_rpc.c
+*
+* @purpose    OF-DPA client RPC profiling for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Every OF-DPA client RPC the driver makes goes through
+*             IND_OFDPA_RPC. While profiling is on, the call count, error
+*             count and latency histogram of each RPC function are kept
+*             here, so time spent in the OF-DPA server can be told apart
+*             from time spent in the agent. While it is off the wrapper
+*             only tests ind_ofdpa_rpc_profiling.
+*
+*             RPCs are made from the event loop and from the driver
+*             threads, so the counters are updated atomically. Each call
+*             site caches its entry after the first lookup by name.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <string.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_RPC_FUNCTIONS_MAX       128
+#define IND_OFDPA_RPC_LATENCY_BUCKETS     20
+
+struct ind_ofdpa_rpc_stats_s
+{
+  const char *name;
+  uint64_t calls;
+  uint64_t errors;
+  uint64_t totalNs;
+  uint64_t maxNs;
+  uint64_t latency[IND_OFDPA_RPC_LATENCY_BUCKETS];  /* log2 microseconds */
+};
+
+int ind_ofdpa_rpc_profiling;
+
+static ind_ofdpa_rpc_stats_t rpcStats[IND_OFDPA_RPC_FUNCTIONS_MAX];
+static int rpcStatsCount;
+static pthread_mutex_t rpcStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ind_ofdpa_rpc_stats_t *rpc_stats_find(const char *name)
+{
+  ind_ofdpa_rpc_stats_t *stats = NULL;
+  int i;
+
+  pthread_mutex_lock(&rpcStatsLock);
+  for (i = 0; i < rpcStatsCount; i++)
+  {
+    if (strcmp(rpcStats[i].name, name) == 0)
+    {
+      stats = &rpcStats[i];
+      break;
+    }
+  }
+  if ((stats == NULL) && (rpcStatsCount < IND_OFDPA_RPC_FUNCTIONS_MAX))
+  {
+    stats = &rpcStats[rpcStatsCount];
+    stats->name = name;
+    __atomic_store_n(&rpcStatsCount, rpcStatsCount + 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&rpcStatsLock);
+
+  return stats;
+}
+
+void ind_ofdpa_rpc_record(ind_ofdpa_rpc_stats_t **site, const char *name,
+                          OFDPA_ERROR_t rv, uint64_t startNs)
+{
+  ind_ofdpa_rpc_stats_t *stats = __atomic_load_n(site, __ATOMIC_ACQUIRE);
+  uint64_t elapsedNs = aim_trace_now() - startNs;
+  uint64_t us = elapsedNs / 1000;
+  uint64_t max;
+  int bucket = 0;
+
+  if (stats == NULL)
+  {
+    stats = rpc_stats_find(name);
+    if (stats == NULL)
+    {
+      return;
+    }
+    __atomic_store_n(site, stats, __ATOMIC_RELEASE);
+  }
+
+  while ((us != 0) && (bucket < IND_OFDPA_RPC_LATENCY_BUCKETS - 1))
+  {
+    us >>= 1;
+    bucket++;
+  }
+
+  __atomic_add_fetch(&stats->calls, 1, __ATOMIC_RELAXED);
+  if (rv != OFDPA_E_NONE)
+  {
+    __atomic_add_fetch(&stats->errors, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_add_fetch(&stats->totalNs, elapsedNs, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&stats->latency[bucket], 1, __ATOMIC_RELAXED);
+
+  max = __atomic_load_n(&stats->maxNs, __ATOMIC_RELAXED);
+  while ((elapsedNs > max) &&
+         !__atomic_compare_exchange_n(&stats->maxNs, &max, elapsedNs, 0,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+  {
+  }
+}
+
+void ind_ofdpa_rpc_profile_set(int enable)
+{
+  ind_ofdpa_rpc_profiling = enable;
+}
+
+void ind_ofdpa_rpc_stats_reset(void)
+{
+  int i, count = __atomic_load_n(&rpcStatsCount, __ATOMIC_ACQUIRE);
+
+  /* The entries stay assigned to their functions */
+  for (i = 0; i < count; i++)
+  {
+    const char *name = rpcStats[i].name;
+    memset(&rpcStats[i], 0, sizeof(rpcStats[i]));
+    rpcStats[i].name = name;
+  }
+}
+
+/* Costliest in total first */
+void ind_ofdpa_rpc_stats_show(aim_pvs_t *pvs)
+{
+  int order[IND_OFDPA_RPC_FUNCTIONS_MAX];
+  int count = __atomic_load_n(&rpcStatsCount, __ATOMIC_ACQUIRE);
+  int i, j, n = 0, bucket;
+
+  for (i = 0; i < count; i++)
+  {
+    if (rpcStats[i].calls == 0)
+    {
+      continue;
+    }
+    for (j = n; (j > 0) && (rpcStats[order[j - 1]].totalNs < rpcStats[i].totalNs); j--)
+    {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+    n++;
+  }
+
+  aim_printf(pvs, "OF-DPA RPC latency (profiling %s):\n",
+             ind_ofdpa_rpc_profiling ? "on" : "off");
+  for (i = 0; i < n; i++)
+  {
+    ind_ofdpa_rpc_stats_t *stats = &rpcStats[order[i]];
+
+    aim_printf(pvs, "  %s: %"PRIu64" calls, %"PRIu64" errors, total %"PRIu64" us, "
+               "avg %"PRIu64" us, max %"PRIu64" us\n",
+               stats->name, stats->calls, stats->errors, stats->totalNs / 1000,
+               stats->totalNs / 1000 / stats->calls, stats->maxNs / 1000);
+    aim_printf(pvs, "   ");
+    for (bucket = 0; bucket < IND_OFDPA_RPC_LATENCY_BUCKETS; bucket++)
+    {
+      if (stats->latency[bucket] == 0)
+      {
+        continue;
+      }
+      if (bucket == 0)
+      {
+        aim_printf(pvs, " <1us:%"PRIu64, stats->latency[bucket]);
+      }
+      else
+      {
+        aim_printf(pvs, " %s%uus:%"PRIu64,
+                   (bucket == IND_OFDPA_RPC_LATENCY_BUCKETS - 1) ? ">=" : "<",
+                   (bucket == IND_OFDPA_RPC_LATENCY_BUCKETS - 1) ?
+                   1u << (bucket - 1) : 1u << bucket,
+                   stats->latency[bucket]);
+      }
+    }
+    aim_printf(pvs, "\n");
+  }
+}
@@ -0,0 +1,304 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_sched.c
+*
+* @purpose    CPU placement and memory residency for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The agent shares the switch CPUs with the OF-DPA server,
+*             the SDK threads and other NOS agents. The event loop thread
+*             can be pinned to its own cores and given a real-time
+*             scheduling policy; the driver worker threads are pinned to
+*             another set as they start. Memory can be locked so a burst
+*             never waits on a page fault, and the large packet pools can
+*             be backed by huge pages, falling back to normal pages when
+*             none are reserved.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* CPU sets, pthread_setaffinity_np */
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+#define IND_OFDPA_HUGE_POOLS_MAX  8
+
+static cpu_set_t workerCpus;
+static int workerCpusSet;
+static int hugePagesEnabled;
+static void *hugePools[IND_OFDPA_HUGE_POOLS_MAX];
+static uint64_t hugePoolBytes;
+static uint64_t normalPoolBytes;
+
+/* list is comma separated CPU numbers and ranges, e.g. "2-3,6" */
+static indigo_error_t sched_cpus_parse(const char *list, cpu_set_t *set)
+{
+  const char *p = list;
+  unsigned long first, last;
+  char *end;
+
+  CPU_ZERO(set);
+  do
+  {
+    first = strtoul(p, &end, 10);
+    if (end == p)
+    {
+      return INDIGO_ERROR_PARAM;
+    }
+    last = first;
+    p = end;
+    if (*p == '-')
+    {
+      p++;
+      last = strtoul(p, &end, 10);
+      if ((end == p) || (last < first))
+      {
+        return INDIGO_ERROR_PARAM;
+      }
+      p = end;
+    }
+    if (last >= CPU_SETSIZE)
+    {
+      return INDIGO_ERROR_PARAM;
+    }
+    for (; first <= last; first++)
+    {
+      CPU_SET(first, set);
+    }
+  } while ((*p++ == ',') && (*p != '\0'));
+
+  return (p[-1] == '\0') ? INDIGO_ERROR_NONE : INDIGO_ERROR_PARAM;
+}
+
+/* policy is fifo:PRIORITY or rr:PRIORITY */
+static indigo_error_t sched_policy_set(const char *policy)
+{
+  struct sched_param param;
+  char name[8];
+  int sched, prio, err;
+
+  if ((sscanf(policy, "%7[^:]:%d", name, &prio) != 2))
+  {
+    LOG_ERROR("Invalid real-time policy \"%s\"", policy);
+    return INDIGO_ERROR_PARAM;
+  }
+  if (strcmp(name, "fifo") == 0)
+  {
+    sched = SCHED_FIFO;
+  }
+  else if (strcmp(name, "rr") == 0)
+  {
+    sched = SCHED_RR;
+  }
+  else
+  {
+    LOG_ERROR("Invalid real-time policy \"%s\"", policy);
+    return INDIGO_ERROR_PARAM;
+  }
+  if ((prio < sched_get_priority_min(sched)) || (prio > sched_get_priority_max(sched)))
+  {
+    LOG_ERROR("Real-time priority %d out of range %d-%d", prio,
+              sched_get_priority_min(sched), sched_get_priority_max(sched));
+    return INDIGO_ERROR_PARAM;
+  }
+
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = prio;
+  err = pthread_setschedparam(pthread_self(), sched, &param);
+  if (err != 0)
+  {
+    LOG_ERROR("Failed to set real-time policy \"%s\": %s", policy, strerror(err));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Applies to the calling thread, which runs the event loop. Each argument
+   may be NULL or 0 to leave that setting alone. Call before the packet
+   pools are allocated and the worker threads started. */
+indigo_error_t ind_ofdpa_sched_init(const char *loopCpus, const char *workerCpuList,
+                                    const char *rtPolicy, int lockMemory, int hugePages)
+{
+  cpu_set_t cpus;
+  indigo_error_t rv;
+  int err;
+
+  if (loopCpus != NULL)
+  {
+    if (sched_cpus_parse(loopCpus, &cpus) != INDIGO_ERROR_NONE)
+    {
+      LOG_ERROR("Invalid CPU list \"%s\"", loopCpus);
+      return INDIGO_ERROR_PARAM;
+    }
+    err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0)
+    {
+      LOG_ERROR("Failed to pin the event loop to CPUs %s: %s", loopCpus, strerror(err));
+      return INDIGO_ERROR_RESOURCE;
+    }
+  }
+
+  if (workerCpuList != NULL)
+  {
+    if (sched_cpus_parse(workerCpuList, &workerCpus) != INDIGO_ERROR_NONE)
+    {
+      LOG_ERROR("Invalid CPU list \"%s\"", workerCpuList);
+      return INDIGO_ERROR_PARAM;
+    }
+    workerCpusSet = 1;
+  }
+
+  if (rtPolicy != NULL)
+  {
+    rv = sched_policy_set(rtPolicy);
+    if (rv != INDIGO_ERROR_NONE)
+    {
+      return rv;
+    }
+  }
+
+  if (lockMemory && (mlockall(MCL_CURRENT | MCL_FUTURE) < 0))
+  {
+    LOG_ERROR("Failed to lock memory: %s", strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  hugePagesEnabled = hugePages;
+
+  LOG_VERBOSE("Scheduling: event loop CPUs %s, worker CPUs %s, policy %s, "
+              "memory %slocked, huge pages %s",
+              loopCpus ? loopCpus : "any", workerCpuList ? workerCpuList : "any",
+              rtPolicy ? rtPolicy : "normal", lockMemory ? "" : "not ",
+              hugePages ? "on" : "off");
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Pin a driver worker thread just started */
+void ind_ofdpa_sched_worker(pthread_t thread)
+{
+  int err;
+
+  if (!workerCpusSet)
+  {
+    return;
+  }
+
+  err = pthread_setaffinity_np(thread, sizeof(workerCpus), &workerCpus);
+  if (err != 0)
+  {
+    LOG_WARN("Failed to pin worker thread: %s", strerror(err));
+  }
+}
+
+static size_t pool_huge_size(size_t size)
+{
+  return (size + IND_OFDPA_HUGE_PAGE_SIZE - 1) & ~(size_t)(IND_OFDPA_HUGE_PAGE_SIZE - 1);
+}
+
+/* Zeroed memory for a large, long lived pool. Free with
+   ind_ofdpa_pool_free and the same size. */
+void *ind_ofdpa_pool_alloc(size_t size)
+{
+  void *pool;
+  int i;
+
+  if (size == 0)
+  {
+    return NULL;
+  }
+
+#ifdef MAP_HUGETLB
+  for (i = 0; hugePagesEnabled && (i < IND_OFDPA_HUGE_POOLS_MAX); i++)
+  {
+    if (hugePools[i] != NULL)
+    {
+      continue;
+    }
+    pool = mmap(NULL, pool_huge_size(size), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pool != MAP_FAILED)
+    {
+      hugePools[i] = pool;
+      hugePoolBytes += pool_huge_size(size);
+      return pool;
+    }
+    LOG_VERBOSE("No huge pages for a %zu byte pool: %s", size, strerror(errno));
+    break;
+  }
+#endif
+
+  pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pool == MAP_FAILED)
+  {
+    return NULL;
+  }
+  normalPoolBytes += size;
+  return pool;
+}
+
+void ind_ofdpa_pool_free(void *pool, size_t size)
+{
+  int i;
+
+  if (pool == NULL)
+  {
+    return;
+  }
+
+  for (i = 0; i < IND_OFDPA_HUGE_POOLS_MAX; i++)
+  {
+    if (hugePools[i] == pool)
+    {
+      hugePools[i] = NULL;
+      munmap(pool, pool_huge_size(size));
+      hugePoolBytes -= pool_huge_size(size);
+      return;
+    }
+  }
+
+  munmap(pool, size);
+  normalPoolBytes -= size;
+}
+
+void ind_ofdpa_sched_show(void)
+{
+  if (!hugePagesEnabled && (hugePoolBytes == 0) && (normalPoolBytes == 0))
+  {
+    return;
+  }
+
+  LOG_INFO("Packet pools: %"PRIu64" bytes in huge pages, %"PRIu64" bytes in normal pages",
+           hugePoolBytes, normalPoolBytes);
+}
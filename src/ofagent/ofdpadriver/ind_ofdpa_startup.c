@@ -0,0 +1,341 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_startup.c
+*
+* @purpose    Startup load of the OF-DPA Driver shadow state
+*
+* @component  OF-DPA
+*
+* @comments   When the agent starts against a switch already holding
+*             flows and groups, the driver caches are rebuilt by walking
+*             OF-DPA before any controller connects. The walks are RPC
+*             bound, so each supported flow table is walked by its own
+*             thread, with the groups and the ports walked alongside.
+*
+*             A flow table worker only fills its own array; the flow key
+*             cache and table counts are updated from those arrays once
+*             every worker has been joined. The group and port workers
+*             fill the group bucket and port caches directly, which
+*             nothing else reads until the load returns.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <OS/os_time.h>
+
+#define IND_OFDPA_STARTUP_MAX_TABLES 256
+
+/* What the flow key cache needs of a flow */
+typedef struct
+{
+  uint64_t cookie;
+  uint32_t priority;
+  uint32_t idleTime;
+  uint32_t hardTime;
+} ind_ofdpa_startup_flow_t;
+
+typedef struct
+{
+  OFDPA_FLOW_TABLE_ID_t tableId;
+  pthread_t thread;
+  int started;
+  int failed;
+  ind_ofdpa_startup_flow_t *flows;
+  int count;
+  int size;
+  uint32_t timed;
+  uint64_t elapsedUs;
+} ind_ofdpa_startup_table_t;
+
+typedef struct
+{
+  pthread_t thread;
+  int started;
+  int count;
+  uint64_t elapsedUs;
+} ind_ofdpa_startup_walk_t;
+
+static ind_ofdpa_startup_flow_t *startup_flow_append(ind_ofdpa_startup_table_t *table)
+{
+  ind_ofdpa_startup_flow_t *flows;
+  int size;
+
+  if (table->count == table->size)
+  {
+    size = table->size ? (table->size * 2) : 1024;
+    flows = realloc(table->flows, size * sizeof(*flows));
+    if (flows == NULL)
+    {
+      return NULL;
+    }
+    table->flows = flows;
+    table->size = size;
+  }
+
+  return &table->flows[table->count++];
+}
+
+static void *startup_table_main(void *arg)
+{
+  ind_ofdpa_startup_table_t *table = arg;
+  ofdpaFlowEntry_t cursor, nextFlow;
+  ind_ofdpa_startup_flow_t *flow;
+  uint64_t start = os_time_monotonic();
+
+  memset(&cursor, 0, sizeof(cursor));
+  cursor.tableId = table->tableId;
+
+  while (IND_OFDPA_RPC(ofdpaFlowNextGet, &cursor, &nextFlow) == OFDPA_E_NONE)
+  {
+    flow = startup_flow_append(table);
+    if (flow == NULL)
+    {
+      table->failed = 1;
+      break;
+    }
+    flow->cookie = nextFlow.cookie;
+    flow->priority = nextFlow.priority;
+    flow->idleTime = nextFlow.idle_time;
+    flow->hardTime = nextFlow.hard_time;
+    if ((nextFlow.idle_time != 0) || (nextFlow.hard_time != 0))
+    {
+      table->timed++;
+    }
+    cursor = nextFlow;
+  }
+
+  table->elapsedUs = os_time_monotonic() - start;
+
+  return NULL;
+}
+
+static void *startup_groups_main(void *arg)
+{
+  ind_ofdpa_startup_walk_t *walk = arg;
+  ofdpaGroupEntry_t group;
+  ofdpaGroupBucketEntry_t *buckets = NULL, *grown;
+  int numBuckets, truncated, size = 0;
+  uint64_t start = os_time_monotonic();
+  OFDPA_ERROR_t ofdpa_rv;
+
+  /* Group 0 is a valid group ID, so it is tried before the walk */
+  memset(&group, 0, sizeof(group));
+  ofdpa_rv = OFDPA_E_NONE;
+
+  while (ofdpa_rv == OFDPA_E_NONE)
+  {
+    numBuckets = 0;
+    truncated = 0;
+    if (size == 0)
+    {
+      size = 16;
+      buckets = malloc(size * sizeof(*buckets));
+      if (buckets == NULL)
+      {
+        break;
+      }
+    }
+
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryFirstGet, group.groupId, &buckets[0]);
+    while (ofdpa_rv == OFDPA_E_NONE)
+    {
+      numBuckets++;
+      if (numBuckets == size)
+      {
+        grown = realloc(buckets, size * 2 * sizeof(*buckets));
+        if (grown == NULL)
+        {
+          truncated = 1;
+          break;
+        }
+        buckets = grown;
+        size *= 2;
+      }
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupBucketEntryNextGet, group.groupId,
+                                                             buckets[numBuckets - 1].bucketIndex,
+                                                             &buckets[numBuckets]);
+    }
+
+    /* A group not cached has all its buckets rewritten on the next modify */
+    if ((numBuckets != 0) && !truncated)
+    {
+      /* The cache takes ownership of the buckets */
+      ind_ofdpa_group_buckets_load(group.groupId, buckets, numBuckets);
+      buckets = NULL;
+      size = 0;
+      walk->count++;
+    }
+
+    ofdpa_rv = IND_OFDPA_RPC(ofdpaGroupNextGet, group.groupId, &group);
+  }
+
+  free(buckets);
+  walk->elapsedUs = os_time_monotonic() - start;
+
+  return NULL;
+}
+
+static void *startup_ports_main(void *arg)
+{
+  ind_ofdpa_startup_walk_t *walk = arg;
+  uint64_t start = os_time_monotonic();
+
+  walk->count = ind_ofdpa_port_info_preload();
+  walk->elapsedUs = os_time_monotonic() - start;
+
+  return NULL;
+}
+
+static void startup_walk_start(ind_ofdpa_startup_walk_t *walk, const char *name,
+                               void *(*main)(void *))
+{
+  memset(walk, 0, sizeof(*walk));
+  if (pthread_create(&walk->thread, NULL, main, walk) == 0)
+  {
+    walk->started = 1;
+  }
+  else
+  {
+    /* Too many threads; walk inline */
+    LOG_VERBOSE("Walking %s without a worker thread", name);
+    main(walk);
+  }
+}
+
+static void startup_walk_join(ind_ofdpa_startup_walk_t *walk)
+{
+  if (walk->started)
+  {
+    pthread_join(walk->thread, NULL);
+  }
+}
+
+/* Rebuild the flow key cache, table counts, group bucket cache and port
+   cache from OF-DPA. Call once, before any controller connects and before
+   the event and collector threads are started. */
+indigo_error_t ind_ofdpa_startup_load(void)
+{
+  ind_ofdpa_startup_table_t *tables;
+  ind_ofdpa_startup_walk_t groups, ports;
+  ofdpaFlowEntry_t flow;
+  uint64_t start = os_time_monotonic();
+  int numTables = 0, complete = 1, flows = 0;
+  int i, j;
+
+  tables = calloc(IND_OFDPA_STARTUP_MAX_TABLES, sizeof(*tables));
+  if (tables == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  for (i = 0; i < IND_OFDPA_STARTUP_MAX_TABLES; i++)
+  {
+    if (IND_OFDPA_RPC(ofdpaFlowTableSupported, i) == OFDPA_E_NONE)
+    {
+      tables[numTables++].tableId = i;
+    }
+  }
+
+  startup_walk_start(&groups, "groups", startup_groups_main);
+  startup_walk_start(&ports, "ports", startup_ports_main);
+
+  for (i = 0; i < numTables; i++)
+  {
+    if (pthread_create(&tables[i].thread, NULL, startup_table_main, &tables[i]) == 0)
+    {
+      tables[i].started = 1;
+    }
+    else
+    {
+      LOG_VERBOSE("Walking table %d without a worker thread", tables[i].tableId);
+      startup_table_main(&tables[i]);
+    }
+  }
+
+  for (i = 0; i < numTables; i++)
+  {
+    if (tables[i].started)
+    {
+      pthread_join(tables[i].thread, NULL);
+    }
+  }
+  startup_walk_join(&groups);
+  startup_walk_join(&ports);
+
+  for (i = 0; i < numTables; i++)
+  {
+    ind_ofdpa_startup_table_t *table = &tables[i];
+
+    memset(&flow, 0, sizeof(flow));
+    flow.tableId = table->tableId;
+    for (j = 0; j < table->count; j++)
+    {
+      flow.cookie = table->flows[j].cookie;
+      flow.priority = table->flows[j].priority;
+      flow.idle_time = table->flows[j].idleTime;
+      flow.hard_time = table->flows[j].hardTime;
+      ind_ofdpa_flow_key_add(&flow);
+    }
+
+    if (table->failed)
+    {
+      LOG_ERROR("Startup load of table %d stopped after %d flows",
+                table->tableId, table->count);
+      complete = 0;
+    }
+    else
+    {
+      ind_ofdpa_table_stats_load(table->tableId, table->count, table->timed);
+    }
+
+    if (table->count != 0)
+    {
+      LOG_INFO("Table %3d: loaded %d flows (%u with timeouts) in %"PRIu64" ms",
+               table->tableId, table->count, table->timed,
+               table->elapsedUs / 1000);
+    }
+    flows += table->count;
+    free(table->flows);
+  }
+
+  /* Every table has been counted, so flow events need only read the
+     tables holding flows with a timeout */
+  if (complete)
+  {
+    ind_ofdpa_table_stats_load_done();
+  }
+
+  LOG_INFO("Loaded %d flows in %d tables, %d groups in %"PRIu64" ms, "
+           "%d ports in %"PRIu64" ms; %"PRIu64" ms in total",
+           flows, numTables, groups.count, groups.elapsedUs / 1000,
+           ports.count, ports.elapsedUs / 1000,
+           (os_time_monotonic() - start) / 1000);
+
+  free(tables);
+
+  return complete ? INDIGO_ERROR_NONE : INDIGO_ERROR_RESOURCE;
+}
@@ -0,0 +1,281 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_telemetry.c
+*
+* @purpose    Counter telemetry exporter for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Each time the collector publishes a port, flow, group or OAM
+*             snapshot in the sampling set, its changes are streamed as
+*             datagrams to a monitoring collector over UDP, so monitoring
+*             does not have to poll counters over the OpenFlow channel.
+*             The datagram format is in ind_ofdpa_telemetry.h. A datagram
+*             that cannot be sent right away is dropped; the sequence
+*             number lets the receiver account for it.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_telemetry.h"
+#include "ind_ofdpa_log.h"
+
+typedef struct
+{
+  uint8_t buf[IND_OFDPA_TELEMETRY_DATAGRAM_MAX];
+  int len;
+  int recordLen;
+  uint16_t count;
+  uint8_t cls;
+  uint32_t generation;
+} ind_ofdpa_telemetry_datagram_t;
+
+static int telemetrySocket = -1;
+static uint32_t telemetrySampleSet;
+static uint32_t telemetrySequence;
+
+static void telemetry_datagram_start(ind_ofdpa_telemetry_datagram_t *dgram,
+                                     uint8_t cls, int recordLen, uint32_t generation)
+{
+  dgram->len = IND_OFDPA_TELEMETRY_HEADER_LEN;
+  dgram->recordLen = recordLen;
+  dgram->count = 0;
+  dgram->cls = cls;
+  dgram->generation = generation;
+}
+
+static void telemetry_datagram_send(ind_ofdpa_telemetry_datagram_t *dgram)
+{
+  uint8_t *p = dgram->buf;
+
+  if (dgram->count == 0)
+  {
+    return;
+  }
+
+  p = ind_ofdpa_put16(p, IND_OFDPA_TELEMETRY_MAGIC);
+  *p++ = IND_OFDPA_TELEMETRY_VERSION;
+  *p++ = dgram->cls;
+  p = ind_ofdpa_put32(p, telemetrySequence++);
+  p = ind_ofdpa_put32(p, dgram->generation);
+  p = ind_ofdpa_put16(p, dgram->count);
+  ind_ofdpa_put16(p, 0);
+
+  if (send(telemetrySocket, dgram->buf, dgram->len, 0) < 0)
+  {
+    LOG_TRACE("Failed to send telemetry datagram: %s", strerror(errno));
+  }
+
+  dgram->len = IND_OFDPA_TELEMETRY_HEADER_LEN;
+  dgram->count = 0;
+}
+
+/* Space for the next record, sending the datagram first if it is full */
+static uint8_t *telemetry_record_reserve(ind_ofdpa_telemetry_datagram_t *dgram)
+{
+  uint8_t *p;
+
+  if (dgram->len + dgram->recordLen > IND_OFDPA_TELEMETRY_DATAGRAM_MAX)
+  {
+    telemetry_datagram_send(dgram);
+  }
+
+  p = &dgram->buf[dgram->len];
+  dgram->len += dgram->recordLen;
+  dgram->count++;
+
+  return p;
+}
+
+static void telemetry_port_export(ind_ofdpa_telemetry_datagram_t *dgram)
+{
+  ind_ofdpa_port_stats_rate_t rate;
+  uint32_t port = 0;
+  uint8_t *p;
+
+  while (ind_ofdpa_port_stats_cache_next(port, &port) == INDIGO_ERROR_NONE)
+  {
+    if ((ind_ofdpa_port_stats_rate_get(port, &rate) != INDIGO_ERROR_NONE) ||
+        ((rate.rxPacketsDelta == 0) && (rate.txPacketsDelta == 0) &&
+         (rate.rxDropsDelta == 0) && (rate.txDropsDelta == 0)))
+    {
+      continue;
+    }
+
+    p = telemetry_record_reserve(dgram);
+    p = ind_ofdpa_put32(p, port);
+    p = ind_ofdpa_put64(p, rate.rxPacketsDelta);
+    p = ind_ofdpa_put64(p, rate.txPacketsDelta);
+    p = ind_ofdpa_put64(p, rate.rxBytesDelta);
+    p = ind_ofdpa_put64(p, rate.txBytesDelta);
+    p = ind_ofdpa_put64(p, rate.rxDropsDelta);
+    ind_ofdpa_put64(p, rate.txDropsDelta);
+  }
+}
+
+static void telemetry_flow_record(uint64_t cookie, uint64_t packets,
+                                  uint64_t bytes, void *arg)
+{
+  uint8_t *p = telemetry_record_reserve(arg);
+
+  p = ind_ofdpa_put64(p, cookie);
+  p = ind_ofdpa_put64(p, packets);
+  ind_ofdpa_put64(p, bytes);
+}
+
+static void telemetry_group_record(const indigo_fwd_group_stats_t *stats, void *arg)
+{
+  uint8_t *p = telemetry_record_reserve(arg);
+
+  p = ind_ofdpa_put32(p, stats->id);
+  ind_ofdpa_put32(p, stats->ref_count);
+}
+
+static void telemetry_oam_record(const ind_ofdpa_oam_mep_state_t *state, void *arg)
+{
+  uint8_t *p = telemetry_record_reserve(arg);
+
+  p = ind_ofdpa_put32(p, state->lmepId);
+  p = ind_ofdpa_put32(p, state->ccmSent);
+  p = ind_ofdpa_put32(p, state->ccmReceived);
+  p = ind_ofdpa_put16(p, state->remoteOk);
+  ind_ofdpa_put16(p, state->remoteFailed);
+}
+
+static void telemetry_snapshot_published(ind_ofdpa_collect_class_t cls)
+{
+  ind_ofdpa_telemetry_datagram_t dgram;
+  uint32_t generation = ind_ofdpa_stats_generation_get(cls);
+
+  switch (cls)
+  {
+    case IND_OFDPA_COLLECT_CLASS_PORT:
+      telemetry_datagram_start(&dgram, IND_OFDPA_TELEMETRY_CLASS_PORT,
+                               IND_OFDPA_TELEMETRY_PORT_LEN, generation);
+      telemetry_port_export(&dgram);
+      break;
+    case IND_OFDPA_COLLECT_CLASS_FLOW:
+      telemetry_datagram_start(&dgram, IND_OFDPA_TELEMETRY_CLASS_FLOW,
+                               IND_OFDPA_TELEMETRY_FLOW_LEN, generation);
+      ind_ofdpa_flow_stats_cache_delta_foreach(telemetry_flow_record, &dgram);
+      break;
+    case IND_OFDPA_COLLECT_CLASS_GROUP:
+      telemetry_datagram_start(&dgram, IND_OFDPA_TELEMETRY_CLASS_GROUP,
+                               IND_OFDPA_TELEMETRY_GROUP_LEN, generation);
+      ind_ofdpa_group_stats_cache_foreach(telemetry_group_record, &dgram);
+      break;
+    case IND_OFDPA_COLLECT_CLASS_OAM:
+      telemetry_datagram_start(&dgram, IND_OFDPA_TELEMETRY_CLASS_OAM,
+                               IND_OFDPA_TELEMETRY_OAM_LEN, generation);
+      ind_ofdpa_oam_cache_change_foreach(telemetry_oam_record, &dgram);
+      break;
+    default:
+      return;
+  }
+
+  telemetry_datagram_send(&dgram);
+}
+
+static indigo_error_t telemetry_socket_open(const char *dest)
+{
+  struct sockaddr_in addr;
+  char host[64];
+  unsigned int port;
+
+  memset(&addr, 0, sizeof(addr));
+  if ((sscanf(dest, "%63[^:]:%u", host, &port) != 2) || (port == 0) || (port > 0xffff) ||
+      (inet_pton(AF_INET, host, &addr.sin_addr) != 1))
+  {
+    LOG_ERROR("Invalid telemetry destination \"%s\"", dest);
+    return INDIGO_ERROR_PARAM;
+  }
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+
+  telemetrySocket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (telemetrySocket < 0)
+  {
+    LOG_ERROR("Failed to create telemetry socket: %s", strerror(errno));
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  /* Never block the SocketManager loop on the exporter */
+  if ((fcntl(telemetrySocket, F_SETFL, fcntl(telemetrySocket, F_GETFL) | O_NONBLOCK) < 0) ||
+      (connect(telemetrySocket, (struct sockaddr *)&addr, sizeof(addr)) < 0))
+  {
+    LOG_ERROR("Failed to set up telemetry socket: %s", strerror(errno));
+    close(telemetrySocket);
+    telemetrySocket = -1;
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* dest is IP:PORT, or NULL to disable; sampleSet is a set of
+   IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_*) bits */
+indigo_error_t ind_ofdpa_telemetry_init(const char *dest, uint32_t sampleSet)
+{
+  indigo_error_t rv;
+
+  if ((dest == NULL) || (sampleSet == 0))
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  rv = telemetry_socket_open(dest);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    return rv;
+  }
+  telemetrySampleSet = sampleSet;
+
+  if (sampleSet & IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_PORT))
+  {
+    ind_ofdpa_collector_listen(IND_OFDPA_COLLECT_CLASS_PORT, telemetry_snapshot_published);
+  }
+  if (sampleSet & IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_FLOW))
+  {
+    ind_ofdpa_collector_listen(IND_OFDPA_COLLECT_CLASS_FLOW, telemetry_snapshot_published);
+  }
+  if (sampleSet & IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_GROUP))
+  {
+    ind_ofdpa_collector_listen(IND_OFDPA_COLLECT_CLASS_GROUP, telemetry_snapshot_published);
+  }
+  if (sampleSet & IND_OFDPA_TELEMETRY_SET(IND_OFDPA_TELEMETRY_CLASS_OAM))
+  {
+    ind_ofdpa_collector_listen(IND_OFDPA_COLLECT_CLASS_OAM, telemetry_snapshot_published);
+  }
+
+  LOG_VERBOSE("Telemetry export to %s enabled. (sample set = 0x%x)", dest, telemetrySampleSet);
+
+  return INDIGO_ERROR_NONE;
+}
@@ -0,0 +1,923 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_ttp.c
+*
+* @purpose    Table capability index built from the OF-DPA TTP
+*
+* @component  OF-DPA
+*
+* @comments   The Table Type Pattern (the JSON description of the OF-DPA
+*             pipeline shipped with the agent) is read once at startup
+*             and reduced to a per-table index: the match fields, the
+*             instructions, the actions and the goto targets each table
+*             accepts. The index answers the features and table features
+*             requests, and flow adds are checked against it so a flow
+*             the pipeline cannot hold is rejected without a call into
+*             OF-DPA.
+*
+*             Tables OF-DPA supports that the TTP does not describe are
+*             kept in the index but are not checked. Without a TTP file
+*             the index only knows which tables OF-DPA supports.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <cjson/cJSON.h>
+
+#define IND_OFDPA_TTP_MAX_TABLES 256
+#define IND_OFDPA_TTP_NAME_LEN   32
+
+#define TTP_OXM_EXP_OFDPA 0x1018
+#define TTP_OXM_EXP_ONF   0x4f4e4600
+
+/* A TTP match field name, normalized, and where LOCI keeps it */
+typedef struct
+{
+  const char *name;
+  const char *alias;            /* shorthand some TTP entries use */
+  uint16_t offset;              /* in of_match_fields_t */
+  uint16_t size;
+  uint32_t oxmHeader;
+  uint32_t experimenter;        /* 0 for OpenFlow basic fields */
+} indTtpField_t;
+
+#define TTP_FIELD(_name, _alias, _member, _oxm, _exp)           \
+  { _name, _alias, offsetof(of_match_fields_t, _member),        \
+    sizeof(((of_match_fields_t *)0)->_member), _oxm, _exp }
+
+static const indTtpField_t ttpFields[] =
+{
+  TTP_FIELD("INPORT",               NULL,    in_port,                      0x80000004, 0),
+  TTP_FIELD("INPHYPORT",            NULL,    in_phy_port,                  0x80000204, 0),
+  TTP_FIELD("METADATA",             NULL,    metadata,                     0x80000408, 0),
+  TTP_FIELD("ETHDST",               NULL,    eth_dst,                      0x80000606, 0),
+  TTP_FIELD("ETHSRC",               NULL,    eth_src,                      0x80000806, 0),
+  TTP_FIELD("ETHTYPE",              NULL,    eth_type,                     0x80000a02, 0),
+  TTP_FIELD("VLANVID",              NULL,    vlan_vid,                     0x80000c02, 0),
+  TTP_FIELD("VLANPCP",              NULL,    vlan_pcp,                     0x80000e01, 0),
+  TTP_FIELD("IPDSCP",               NULL,    ip_dscp,                      0x80001001, 0),
+  TTP_FIELD("IPECN",                NULL,    ip_ecn,                       0x80001201, 0),
+  TTP_FIELD("IPPROTO",              NULL,    ip_proto,                     0x80001401, 0),
+  TTP_FIELD("IPV4SRC",              "IPSRC", ipv4_src,                     0x80001604, 0),
+  TTP_FIELD("IPV4DST",              "IPDST", ipv4_dst,                     0x80001804, 0),
+  TTP_FIELD("TCPSRC",               NULL,    tcp_src,                      0x80001a02, 0),
+  TTP_FIELD("TCPDST",               NULL,    tcp_dst,                      0x80001c02, 0),
+  TTP_FIELD("UDPSRC",               NULL,    udp_src,                      0x80001e02, 0),
+  TTP_FIELD("UDPDST",               NULL,    udp_dst,                      0x80002002, 0),
+  TTP_FIELD("SCTPSRC",              NULL,    sctp_src,                     0x80002202, 0),
+  TTP_FIELD("SCTPDST",              NULL,    sctp_dst,                     0x80002402, 0),
+  TTP_FIELD("ICMPV4TYPE",           NULL,    icmpv4_type,                  0x80002601, 0),
+  TTP_FIELD("ICMPV4CODE",           NULL,    icmpv4_code,                  0x80002801, 0),
+  TTP_FIELD("ARPOP",                NULL,    arp_op,                       0x80002a02, 0),
+  TTP_FIELD("ARPSPA",               NULL,    arp_spa,                      0x80002c04, 0),
+  TTP_FIELD("ARPTPA",               NULL,    arp_tpa,                      0x80002e04, 0),
+  TTP_FIELD("ARPSHA",               NULL,    arp_sha,                      0x80003006, 0),
+  TTP_FIELD("ARPTHA",               NULL,    arp_tha,                      0x80003206, 0),
+  TTP_FIELD("IPV6SRC",              "IPSRC", ipv6_src,                     0x80003410, 0),
+  TTP_FIELD("IPV6DST",              "IPDST", ipv6_dst,                     0x80003610, 0),
+  TTP_FIELD("IPV6FLABEL",           NULL,    ipv6_flabel,                  0x80003804, 0),
+  TTP_FIELD("ICMPV6TYPE",           NULL,    icmpv6_type,                  0x80003a01, 0),
+  TTP_FIELD("ICMPV6CODE",           NULL,    icmpv6_code,                  0x80003c01, 0),
+  TTP_FIELD("IPV6NDTARGET",         NULL,    ipv6_nd_target,               0x80003e10, 0),
+  TTP_FIELD("IPV6NDSLL",            NULL,    ipv6_nd_sll,                  0x80004006, 0),
+  TTP_FIELD("IPV6NDTLL",            NULL,    ipv6_nd_tll,                  0x80004206, 0),
+  TTP_FIELD("MPLSLABEL",            NULL,    mpls_label,                   0x80004404, 0),
+  TTP_FIELD("MPLSTC",               NULL,    mpls_tc,                      0x80004601, 0),
+  TTP_FIELD("MPLSBOS",              NULL,    mpls_bos,                     0x80004801, 0),
+  TTP_FIELD("TUNNELID",             NULL,    tunnel_id,                    0x80004c08, 0),
+  TTP_FIELD("VRF",                  NULL,    ofdpa_vrf,                    0xffff0206, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("TRAFFICCLASS",         NULL,    ofdpa_traffic_class,          0xffff0405, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("COLOR",                NULL,    ofdpa_color,                  0xffff0605, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("VLANDEI",              NULL,    ofdpa_dei,                    0xffff0805, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("QOSINDEX",             NULL,    ofdpa_qos_index,              0xffff0a05, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("LMEPID",               NULL,    ofdpa_lmep_id,                0xffff0c08, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("MPLSTTL",              NULL,    ofdpa_mpls_ttl,               0xffff0e05, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("MPLSL2PORT",           NULL,    ofdpa_mpls_l2_port,           0xffff1008, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("L3INPORT",             NULL,    ofdpa_l3_in_port,             0xffff1208, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("OVID",                 NULL,    ofdpa_ovid,                   0xffff1406, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("MPLSDATAFIRSTNIBBLE",  NULL,    ofdpa_mpls_data_first_nibble, 0xffff1605, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("MPLSACHCHANNEL",       NULL,    ofdpa_mpls_ach_channel,       0xffff1806, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("NEXTLABELISGAL",       NULL,    ofdpa_mpls_next_label_is_gal, 0xffff1a05, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("OAMY1731MDL",          NULL,    ofdpa_oam_y1731_mdl,          0xffff1c05, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("OAMY1731OPCODE",       NULL,    ofdpa_oam_y1731_opcode,       0xffff1e05, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("COLORACTIONSINDEX",    NULL,    ofdpa_color_actions_index,    0xffff2008, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("PROTECTIONINDEX",      NULL,    ofdpa_protection_index,       0xffff2a05, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("MPLSTYPE",             NULL,    ofdpa_mpls_type,              0xffff2e06, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("ALLOWVLANTRANSLATION", NULL,    ofdpa_allow_vlan_translation, 0xffff3005, TTP_OXM_EXP_OFDPA),
+  TTP_FIELD("ACTSETOUTPUT",         NULL,    onf_actset_output,            0xffff5608, TTP_OXM_EXP_ONF),
+};
+
+#define TTP_NUM_FIELDS (sizeof(ttpFields) / sizeof(ttpFields[0]))
+
+typedef struct
+{
+  const char *name;
+  of_object_id_t objectId;
+  of_object_t *(*idNew)(of_version_t version);
+} indTtpInstruction_t;
+
+static const indTtpInstruction_t ttpInstructions[] =
+{
+  { "GOTOTABLE",     OF_INSTRUCTION_GOTO_TABLE,     of_instruction_id_goto_table_new },
+  { "WRITEMETADATA", OF_INSTRUCTION_WRITE_METADATA, of_instruction_id_write_metadata_new },
+  { "WRITEACTIONS",  OF_INSTRUCTION_WRITE_ACTIONS,  of_instruction_id_write_actions_new },
+  { "APPLYACTIONS",  OF_INSTRUCTION_APPLY_ACTIONS,  of_instruction_id_apply_actions_new },
+  { "CLEARACTIONS",  OF_INSTRUCTION_CLEAR_ACTIONS,  of_instruction_id_clear_actions_new },
+  { "METER",         OF_INSTRUCTION_METER,          of_instruction_id_meter_new },
+};
+
+#define TTP_NUM_INSTRUCTIONS (sizeof(ttpInstructions) / sizeof(ttpInstructions[0]))
+
+/* Actions the TTP names that have an action ID to advertise */
+typedef struct
+{
+  const char *name;
+  of_object_t *(*idNew)(of_version_t version);
+} indTtpAction_t;
+
+static const indTtpAction_t ttpActions[] =
+{
+  { "OUTPUT",                    of_action_id_output_new },
+  { "GROUP",                     of_action_id_group_new },
+  { "SETFIELD",                  of_action_id_set_field_new },
+  { "SETQUEUE",                  of_action_id_set_queue_new },
+  { "PUSHVLAN",                  of_action_id_push_vlan_new },
+  { "POPVLAN",                   of_action_id_pop_vlan_new },
+  { "PUSHMPLS",                  of_action_id_push_mpls_new },
+  { "POPMPLS",                   of_action_id_pop_mpls_new },
+  { "COPYTTLIN",                 of_action_id_copy_ttl_in_new },
+  { "COPYTTLOUT",                of_action_id_copy_ttl_out_new },
+  { "DECNWTTL",                  of_action_id_dec_nw_ttl_new },
+  { "DECMPLSTTL",                of_action_id_dec_mpls_ttl_new },
+  { "SETNWTTL",                  of_action_id_set_nw_ttl_new },
+  { "SETMPLSTTL",                of_action_id_set_mpls_ttl_new },
+  { "COPYMPLSTCIN",              of_action_id_ofdpa_copy_tc_in_new },
+  { "PUSHCW",                    of_action_id_ofdpa_push_cw_new },
+  { "POPCWORACH",                of_action_id_ofdpa_pop_cw_new },
+  { "POPL2HEADER",               of_action_id_ofdpa_pop_l2hdr_new },
+  { "SETMPLSTCFROMTUNNELTABLE",  of_action_id_ofdpa_set_mpls_tc_from_tunnel_table_new },
+  { "SETMPLSTCFROMVPNTABLE",     of_action_id_ofdpa_set_mpls_tc_from_vpn_table_new },
+};
+
+#define TTP_NUM_ACTIONS (sizeof(ttpActions) / sizeof(ttpActions[0]))
+
+typedef struct
+{
+  uint8_t supported;            /* reported by OF-DPA */
+  uint8_t described;            /* described by the TTP */
+  char name[IND_OFDPA_TTP_NAME_LEN];
+  uint32_t maxEntries;
+  uint64_t matchFields;         /* bits index ttpFields */
+  uint64_t maskFields;          /* may be matched with a mask */
+  uint64_t wildcardFields;      /* may be left out */
+  uint32_t instructions;        /* bits index ttpInstructions */
+  uint32_t applyActions;        /* bits index ttpActions */
+  uint32_t writeActions;
+  uint8_t nextTables[IND_OFDPA_TTP_MAX_TABLES / 8];
+} indTtpTable_t;
+
+typedef struct
+{
+  int initialized;
+  int numTables;                /* supported by OF-DPA */
+  int numDescribed;
+  indTtpTable_t tables[IND_OFDPA_TTP_MAX_TABLES];
+} indTtpIndex_t;
+
+static indTtpIndex_t ttpIndex;
+
+/* Upper case, letters and digits only, so "VLAN _PCP", "$IPv4_DST" and
+   "$LMEP_id" compare equal to the field table */
+static void ttp_name_normalize(const char *name, char *buf, size_t len)
+{
+  size_t i = 0;
+
+  for (; (*name != 0) && (i + 1 < len); name++)
+  {
+    if (isalnum((unsigned char)*name))
+    {
+      buf[i++] = toupper((unsigned char)*name);
+    }
+  }
+  buf[i] = 0;
+}
+
+static uint64_t ttp_field_bits(const char *name)
+{
+  char buf[64];
+  uint64_t bits = 0;
+  int i;
+
+  ttp_name_normalize(name, buf, sizeof(buf));
+  for (i = 0; i < TTP_NUM_FIELDS; i++)
+  {
+    if ((strcmp(buf, ttpFields[i].name) == 0) ||
+        ((ttpFields[i].alias != NULL) && (strcmp(buf, ttpFields[i].alias) == 0)))
+    {
+      bits |= (1ULL << i);
+    }
+  }
+  if (bits == 0)
+  {
+    LOG_VERBOSE("TTP match field %s not known, ignored", name);
+  }
+
+  return bits;
+}
+
+static int ttp_instruction_index(const char *name)
+{
+  char buf[64];
+  int i;
+
+  ttp_name_normalize(name, buf, sizeof(buf));
+  for (i = 0; i < TTP_NUM_INSTRUCTIONS; i++)
+  {
+    if (strcmp(buf, ttpInstructions[i].name) == 0)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int ttp_action_index(const char *name)
+{
+  char buf[64];
+  int i;
+
+  ttp_name_normalize(name, buf, sizeof(buf));
+  for (i = 0; i < TTP_NUM_ACTIONS; i++)
+  {
+    if (strcmp(buf, ttpActions[i].name) == 0)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static int ttp_table_by_name(cJSON *tableMap, const char *name)
+{
+  cJSON *entry, *node;
+  char *end;
+  long number;
+
+  for (entry = tableMap->child; entry != NULL; entry = entry->next)
+  {
+    node = cJSON_GetObjectItem(entry, "name");
+    if ((node != NULL) && (node->type == cJSON_String) &&
+        (strcmp(node->valuestring, name) == 0))
+    {
+      node = cJSON_GetObjectItem(entry, "number");
+      if ((node != NULL) && (node->type == cJSON_Number))
+      {
+        return node->valueint;
+      }
+    }
+  }
+
+  /* Some patterns give the table number */
+  number = strtol(name, &end, 0);
+  if ((*name != 0) && (*end == 0) && (number >= 0) && (number < IND_OFDPA_TTP_MAX_TABLES))
+  {
+    return number;
+  }
+
+  return -1;
+}
+
+/* Match sets, instruction sets and action lists nest their entries in
+   meta members ("zero_or_one", "exactly_one", "all", ...). Anything that
+   is not an entry is walked for entries. */
+static void ttp_match_walk(indTtpTable_t *table, cJSON *node, int optional)
+{
+  cJSON *child, *field, *matchType;
+  uint64_t bits;
+
+  if (node->type == cJSON_Array)
+  {
+    for (child = node->child; child != NULL; child = child->next)
+    {
+      ttp_match_walk(table, child, optional);
+    }
+    return;
+  }
+  if (node->type != cJSON_Object)
+  {
+    return;
+  }
+
+  field = cJSON_GetObjectItem(node, "field");
+  if ((field == NULL) || (field->type != cJSON_String))
+  {
+    for (child = node->child; child != NULL; child = child->next)
+    {
+      ttp_match_walk(table, child,
+                     optional || (strncmp(child->string, "zero_", 5) == 0));
+    }
+    return;
+  }
+
+  bits = ttp_field_bits(field->valuestring);
+  table->matchFields |= bits;
+
+  matchType = cJSON_GetObjectItem(node, "match_type");
+  if ((matchType != NULL) && (matchType->type == cJSON_String))
+  {
+    if ((strcmp(matchType->valuestring, "mask") == 0) ||
+        (strcmp(matchType->valuestring, "prefix") == 0))
+    {
+      table->maskFields |= bits;
+      table->wildcardFields |= bits;
+    }
+    else if (strcmp(matchType->valuestring, "exact") != 0)
+    {
+      table->wildcardFields |= bits;
+    }
+  }
+  if (optional)
+  {
+    table->wildcardFields |= bits;
+  }
+}
+
+static void ttp_actions_walk(uint32_t *actions, cJSON *node)
+{
+  cJSON *child, *action;
+  int i;
+
+  if (node->type == cJSON_Array)
+  {
+    for (child = node->child; child != NULL; child = child->next)
+    {
+      ttp_actions_walk(actions, child);
+    }
+    return;
+  }
+  if (node->type != cJSON_Object)
+  {
+    return;
+  }
+
+  action = cJSON_GetObjectItem(node, "action");
+  if ((action == NULL) || (action->type != cJSON_String))
+  {
+    for (child = node->child; child != NULL; child = child->next)
+    {
+      ttp_actions_walk(actions, child);
+    }
+    return;
+  }
+
+  i = ttp_action_index(action->valuestring);
+  if (i >= 0)
+  {
+    *actions |= (1U << i);
+  }
+}
+
+static void ttp_instructions_walk(indTtpTable_t *table, cJSON *tableMap,
+                                  cJSON *node)
+{
+  cJSON *child, *instruction, *next, *actions;
+  int i, tableId;
+
+  if (node->type == cJSON_Array)
+  {
+    for (child = node->child; child != NULL; child = child->next)
+    {
+      ttp_instructions_walk(table, tableMap, child);
+    }
+    return;
+  }
+  if (node->type != cJSON_Object)
+  {
+    return;
+  }
+
+  instruction = cJSON_GetObjectItem(node, "instruction");
+  if ((instruction == NULL) || (instruction->type != cJSON_String))
+  {
+    for (child = node->child; child != NULL; child = child->next)
+    {
+      ttp_instructions_walk(table, tableMap, child);
+    }
+    return;
+  }
+
+  i = ttp_instruction_index(instruction->valuestring);
+  if (i < 0)
+  {
+    LOG_VERBOSE("TTP instruction %s not known, ignored", instruction->valuestring);
+    return;
+  }
+  table->instructions |= (1U << i);
+
+  switch (ttpInstructions[i].objectId)
+  {
+    case OF_INSTRUCTION_GOTO_TABLE:
+      next = cJSON_GetObjectItem(node, "table");
+      if ((next != NULL) && (next->type == cJSON_String) &&
+          ((tableId = ttp_table_by_name(tableMap, next->valuestring)) >= 0))
+      {
+        table->nextTables[tableId / 8] |= (1 << (tableId % 8));
+      }
+      break;
+    case OF_INSTRUCTION_APPLY_ACTIONS:
+    case OF_INSTRUCTION_WRITE_ACTIONS:
+      actions = cJSON_GetObjectItem(node, "actions");
+      if (actions != NULL)
+      {
+        ttp_actions_walk((ttpInstructions[i].objectId == OF_INSTRUCTION_APPLY_ACTIONS) ?
+                         &table->applyActions : &table->writeActions, actions);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void ttp_flow_mods_walk(indTtpTable_t *table, cJSON *tableMap,
+                               cJSON *flowMods)
+{
+  cJSON *flowMod, *node;
+
+  if ((flowMods == NULL) || (flowMods->type != cJSON_Array))
+  {
+    return;
+  }
+
+  for (flowMod = flowMods->child; flowMod != NULL; flowMod = flowMod->next)
+  {
+    if ((node = cJSON_GetObjectItem(flowMod, "match_set")) != NULL)
+    {
+      ttp_match_walk(table, node, 0);
+    }
+    if ((node = cJSON_GetObjectItem(flowMod, "instruction_set")) != NULL)
+    {
+      ttp_instructions_walk(table, tableMap, node);
+    }
+  }
+}
+
+static cJSON *ttp_file_read(const char *filename)
+{
+  cJSON *root;
+  char *data;
+  long len;
+  FILE *f;
+
+  f = fopen(filename, "r");
+  if (f == NULL)
+  {
+    LOG_ERROR("Failed to open TTP %s", filename);
+    return NULL;
+  }
+
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = malloc(len + 1);
+  if ((data == NULL) || (fread(data, 1, len, f) != len))
+  {
+    LOG_ERROR("Failed to read TTP %s", filename);
+    free(data);
+    fclose(f);
+    return NULL;
+  }
+  data[len] = 0;
+  fclose(f);
+
+  root = cJSON_Parse(data);
+  if ((root == NULL) || (root->type != cJSON_Object))
+  {
+    LOG_ERROR("TTP %s is not a JSON object", filename);
+    cJSON_Delete(root);
+    root = NULL;
+  }
+  free(data);
+
+  return root;
+}
+
+static indigo_error_t ttp_load(const char *filename)
+{
+  cJSON *root, *tableMap, *flowTables, *entry, *node;
+  indTtpTable_t *table;
+  int tableId;
+
+  root = ttp_file_read(filename);
+  if (root == NULL)
+  {
+    return INDIGO_ERROR_PARSE;
+  }
+
+  tableMap = cJSON_GetObjectItem(root, "table_map");
+  flowTables = cJSON_GetObjectItem(root, "flow_tables");
+  if ((tableMap == NULL) || (tableMap->type != cJSON_Array) ||
+      (flowTables == NULL) || (flowTables->type != cJSON_Array))
+  {
+    LOG_ERROR("TTP %s has no table_map or flow_tables", filename);
+    cJSON_Delete(root);
+    return INDIGO_ERROR_PARSE;
+  }
+
+  for (entry = flowTables->child; entry != NULL; entry = entry->next)
+  {
+    node = cJSON_GetObjectItem(entry, "name");
+    if ((node == NULL) || (node->type != cJSON_String))
+    {
+      continue;
+    }
+    tableId = ttp_table_by_name(tableMap, node->valuestring);
+    if (tableId < 0)
+    {
+      LOG_WARN("TTP flow table %s is not in the table map", node->valuestring);
+      continue;
+    }
+
+    table = &ttpIndex.tables[tableId];
+    if (!table->described)
+    {
+      table->described = 1;
+      ttpIndex.numDescribed++;
+    }
+    strncpy(table->name, node->valuestring, sizeof(table->name) - 1);
+
+    ttp_flow_mods_walk(table, tableMap, cJSON_GetObjectItem(entry, "flow_mod_types"));
+    ttp_flow_mods_walk(table, tableMap, cJSON_GetObjectItem(entry, "built_in_flow_mods"));
+
+    if (!table->supported)
+    {
+      LOG_WARN("TTP table %d (%s) is not supported by OF-DPA", tableId, table->name);
+    }
+  }
+
+  cJSON_Delete(root);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Build the index from the tables OF-DPA supports and, if filename is
+   not NULL, the TTP in filename. Call once at startup. */
+indigo_error_t ind_ofdpa_ttp_init(const char *filename)
+{
+  ofdpaFlowTableInfo_t tableInfo;
+  indigo_error_t err = INDIGO_ERROR_NONE;
+  int i;
+
+  memset(&ttpIndex, 0, sizeof(ttpIndex));
+  for (i = 0; i < IND_OFDPA_TTP_MAX_TABLES; i++)
+  {
+    if (IND_OFDPA_RPC(ofdpaFlowTableSupported, i) != OFDPA_E_NONE)
+    {
+      continue;
+    }
+    ttpIndex.tables[i].supported = 1;
+    ttpIndex.numTables++;
+
+    memset(&tableInfo, 0, sizeof(tableInfo));
+    if (IND_OFDPA_RPC(ofdpaFlowTableInfoGet, i, &tableInfo) == OFDPA_E_NONE)
+    {
+      ttpIndex.tables[i].maxEntries = tableInfo.maxEntries;
+    }
+  }
+  ttpIndex.initialized = 1;
+
+  if (filename != NULL)
+  {
+    err = ttp_load(filename);
+    if (err == INDIGO_ERROR_NONE)
+    {
+      LOG_INFO("TTP %s describes %d tables, OF-DPA supports %d",
+               filename, ttpIndex.numDescribed, ttpIndex.numTables);
+    }
+  }
+
+  return err;
+}
+
+static void ttp_index_ensure(void)
+{
+  if (!ttpIndex.initialized)
+  {
+    (void)ind_ofdpa_ttp_init(NULL);
+  }
+}
+
+int ind_ofdpa_ttp_table_count(void)
+{
+  ttp_index_ensure();
+  return ttpIndex.numTables;
+}
+
+static int ttp_field_present(const of_match_t *match, int field)
+{
+  const uint8_t *mask = (const uint8_t *)&match->masks + ttpFields[field].offset;
+  int i;
+
+  for (i = 0; i < ttpFields[field].size; i++)
+  {
+    if (mask[i] != 0)
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Check a flow add against the index before it is translated for OF-DPA */
+indigo_error_t ind_ofdpa_ttp_flow_check(of_flow_add_t *flow_add, const of_match_t *match)
+{
+  indTtpTable_t *table;
+  of_list_instruction_t insts;
+  of_instruction_t inst;
+  uint8_t tableId, nextTableId;
+  int i, rv;
+
+  ttp_index_ensure();
+
+  of_flow_add_table_id_get(flow_add, &tableId);
+  table = &ttpIndex.tables[tableId];
+
+  if (!table->supported)
+  {
+    LOG_TRACE("Flow rejected, table %d not supported", tableId);
+    return INDIGO_ERROR_BAD_TABLE_ID;
+  }
+  if (!table->described)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  for (i = 0; i < TTP_NUM_FIELDS; i++)
+  {
+    if (!(table->matchFields & (1ULL << i)) && ttp_field_present(match, i))
+    {
+      LOG_TRACE("Flow rejected, table %d (%s) does not match %s",
+                tableId, table->name, ttpFields[i].name);
+        return INDIGO_ERROR_BAD_MATCH;
+    }
+  }
+
+  of_flow_add_instructions_bind(flow_add, &insts);
+  OF_LIST_INSTRUCTION_ITER(&insts, &inst, rv)
+  {
+    for (i = 0; i < TTP_NUM_INSTRUCTIONS; i++)
+    {
+      if (ttpInstructions[i].objectId == inst.header.object_id)
+      {
+        break;
+      }
+    }
+    if ((i == TTP_NUM_INSTRUCTIONS) || !(table->instructions & (1U << i)))
+    {
+      LOG_TRACE("Flow rejected, table %d (%s) does not take %s",
+                tableId, table->name, of_object_id_str[inst.header.object_id]);
+        return INDIGO_ERROR_BAD_INSTRUCTION;
+    }
+
+    if (inst.header.object_id == OF_INSTRUCTION_GOTO_TABLE)
+    {
+      of_instruction_goto_table_table_id_get(&inst.goto_table, &nextTableId);
+      if (!(table->nextTables[nextTableId / 8] & (1 << (nextTableId % 8))))
+      {
+        LOG_TRACE("Flow rejected, table %d (%s) cannot go to table %d",
+                  tableId, table->name, nextTableId);
+            return INDIGO_ERROR_BAD_INSTRUCTION;
+      }
+    }
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static void ttp_oxm_ids_append(of_list_uint32_t *ids, uint64_t fields, uint64_t maskFields)
+{
+  of_uint32_t id;
+  uint32_t header;
+  int i;
+
+  for (i = 0; i < TTP_NUM_FIELDS; i++)
+  {
+    if (!(fields & (1ULL << i)))
+    {
+      continue;
+    }
+
+    header = ttpFields[i].oxmHeader;
+    if (maskFields & (1ULL << i))
+    {
+      /* The masked form carries the mask after the value */
+      header = (header & 0xffffff00) | 0x100 |
+               ((header & 0xff) + ttpFields[i].size);
+    }
+
+    of_uint32_init(&id, ids->version, -1, 1);
+    if (of_list_uint32_append_bind(ids, &id) < 0)
+    {
+      return;
+    }
+    of_uint32_value_set(&id, header);
+
+    if (ttpFields[i].experimenter != 0)
+    {
+      of_uint32_init(&id, ids->version, -1, 1);
+      if (of_list_uint32_append_bind(ids, &id) < 0)
+      {
+        return;
+      }
+      of_uint32_value_set(&id, ttpFields[i].experimenter);
+    }
+  }
+}
+
+static void ttp_action_ids_append(of_list_action_id_t *ids, uint32_t actions)
+{
+  of_object_t *id;
+  int i;
+
+  for (i = 0; i < TTP_NUM_ACTIONS; i++)
+  {
+    if ((actions & (1U << i)) && ((id = ttpActions[i].idNew(ids->version)) != NULL))
+    {
+      (void)of_list_action_id_append(ids, (of_action_id_t *)id);
+      of_object_delete(id);
+    }
+  }
+}
+
+static void ttp_prop_append(of_list_table_feature_prop_t *props, of_object_t *prop)
+{
+  if (prop != NULL)
+  {
+    (void)of_list_table_feature_prop_append(props, (of_table_feature_prop_t *)prop);
+    of_object_delete(prop);
+  }
+}
+
+static void ttp_table_props_append(of_list_table_feature_prop_t *props,
+                                   const indTtpTable_t *table)
+{
+  of_version_t version = props->version;
+  of_object_t *prop, *id;
+  of_list_instruction_id_t instIds;
+  of_list_action_id_t actionIds;
+  of_list_uint8_t nextIds;
+  of_list_uint32_t oxmIds;
+  of_uint8_t next;
+  int i;
+
+  if ((prop = of_table_feature_prop_instructions_new(version)) != NULL)
+  {
+    of_table_feature_prop_instructions_instruction_ids_bind(prop, &instIds);
+    for (i = 0; i < TTP_NUM_INSTRUCTIONS; i++)
+    {
+      if ((table->instructions & (1U << i)) &&
+          ((id = ttpInstructions[i].idNew(version)) != NULL))
+      {
+        (void)of_list_instruction_id_append(&instIds, (of_instruction_id_t *)id);
+        of_object_delete(id);
+      }
+    }
+    ttp_prop_append(props, prop);
+  }
+
+  if ((prop = of_table_feature_prop_next_tables_new(version)) != NULL)
+  {
+    of_table_feature_prop_next_tables_next_table_ids_bind(prop, &nextIds);
+    for (i = 0; i < IND_OFDPA_TTP_MAX_TABLES; i++)
+    {
+      if (table->nextTables[i / 8] & (1 << (i % 8)))
+      {
+        of_uint8_init(&next, version, -1, 1);
+        if (of_list_uint8_append_bind(&nextIds, &next) < 0)
+        {
+          break;
+        }
+        of_uint8_value_set(&next, i);
+      }
+    }
+    ttp_prop_append(props, prop);
+  }
+
+  if ((prop = of_table_feature_prop_write_actions_new(version)) != NULL)
+  {
+    of_table_feature_prop_write_actions_action_ids_bind(prop, &actionIds);
+    ttp_action_ids_append(&actionIds, table->writeActions);
+    ttp_prop_append(props, prop);
+  }
+
+  if ((prop = of_table_feature_prop_apply_actions_new(version)) != NULL)
+  {
+    of_table_feature_prop_apply_actions_action_ids_bind(prop, &actionIds);
+    ttp_action_ids_append(&actionIds, table->applyActions);
+    ttp_prop_append(props, prop);
+  }
+
+  if ((prop = of_table_feature_prop_match_new(version)) != NULL)
+  {
+    of_table_feature_prop_match_oxm_ids_bind(prop, &oxmIds);
+    ttp_oxm_ids_append(&oxmIds, table->matchFields, table->maskFields);
+    ttp_prop_append(props, prop);
+  }
+
+  if ((prop = of_table_feature_prop_wildcards_new(version)) != NULL)
+  {
+    of_table_feature_prop_wildcards_oxm_ids_bind(prop, &oxmIds);
+    ttp_oxm_ids_append(&oxmIds, table->wildcardFields, 0);
+    ttp_prop_append(props, prop);
+  }
+}
+
+/* Table features reply for every table OF-DPA supports. Properties are
+   given for the tables the TTP describes. */
+indigo_error_t ind_ofdpa_ttp_table_features_get(of_version_t version,
+                                                of_list_table_features_t *entries)
+{
+  of_table_features_t *features;
+  of_list_table_feature_prop_t props;
+  of_table_name_t name;
+  indTtpTable_t *table;
+  int tableId;
+
+  ttp_index_ensure();
+
+  for (tableId = 0; tableId < IND_OFDPA_TTP_MAX_TABLES; tableId++)
+  {
+    table = &ttpIndex.tables[tableId];
+    if (!table->supported)
+    {
+      continue;
+    }
+
+    features = of_table_features_new(version);
+    if (features == NULL)
+    {
+      return INDIGO_ERROR_RESOURCE;
+    }
+
+    memset(name, 0, sizeof(name));
+    if (table->described)
+    {
+      strncpy(name, table->name, sizeof(name) - 1);
+    }
+    else
+    {
+      snprintf(name, sizeof(name), "Table %d", tableId);
+    }
+
+    of_table_features_table_id_set(features, tableId);
+    of_table_features_name_set(features, name);
+    of_table_features_metadata_match_set(features, 0);
+    of_table_features_metadata_write_set(features, 0);
+    of_table_features_config_set(features, 0);
+    of_table_features_max_entries_set(features, table->maxEntries);
+
+    if (table->described)
+    {
+      of_table_features_properties_bind(features, &props);
+      ttp_table_props_append(&props, table);
+    }
+
+    if (of_list_table_features_append(entries, features) < 0)
+    {
+      LOG_ERROR("Table features reply full at table %d", tableId);
+      of_object_delete(features);
+      return INDIGO_ERROR_RESOURCE;
+    }
+    of_object_delete(features);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
@@ -0,0 +1,912 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_tunnel.c
+*
+* @purpose    Bulk programming of VXLAN tunnel objects for the OF-DPA
+*             Driver
+*
+* @component  OF-DPA
+*
+* @comments   The agent keeps a cache of the tunnel next hops, ECMP next
+*             hop groups, tenants and logical tunnel ports it created.
+*             ind_ofdpa_tunnel_bulk_apply() takes the complete set of
+*             objects wanted and issues only the OF-DPA calls needed to
+*             get there from the cache: objects are created or changed in
+*             dependency order, group members and port tenants are added
+*             and removed by difference, and objects no longer wanted are
+*             removed in reverse order. Unchanged objects cost nothing,
+*             so a whole VTEP can be reapplied after an edit of one line.
+*
+*             Only next hops can be modified in place. Other objects
+*             whose configuration changed are deleted and created again,
+*             which fails for a tenant still bound to a port.
+*
+*             The objects are given in a JSON file, read at startup and
+*             again on SIGHUP:
+*
+*             { "next_hops":   [ { "id", "src_mac", "dst_mac", "port",
+*                                  "vlan" } ],
+*               "ecmp_groups": [ { "id", "next_hops": [ id ] } ],
+*               "tenants":     [ { "index", "vni", "mcast_ip",
+*                                  "mcast_next_hop" } ],
+*               "access_ports": [ { "index", "name", "port", "vlan",
+*                                   "untagged", "tenants": [ index ] } ],
+*               "endpoints":   [ { "index", "name", "remote_ip",
+*                                  "local_ip", "ttl", "next_hop", "ecmp",
+*                                  "udp_dst_port", "udp_src_port",
+*                                  "entropy", "tenants": [ index ] } ] }
+*
+*             Tenant and port indexes are made into data center overlay
+*             tunnel ids and logical tunnel port numbers.
+*
+* @create     14 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <BigHash/bighash.h>
+#include <Configuration/configuration.h>
+#include <cjson/cJSON.h>
+
+#define IND_OFDPA_TUNNEL_BUCKETS  1024
+
+#define IND_OFDPA_VXLAN_UDP_PORT  4789
+
+/* A tunnel object created by the agent */
+typedef struct ind_ofdpa_tunnel_entry_s
+{
+  bighash_entry_t hash_entry;
+  uint32_t id;
+  ind_ofdpa_tunnel_obj_t obj;   /* refs sorted and owned by the entry */
+  uint32_t generation;          /* last batch that named the object */
+} ind_ofdpa_tunnel_entry_t;
+
+#define TEMPLATE_NAME tunnel_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_tunnel_entry_t
+#define TEMPLATE_KEY_FIELD id
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+static const char *tunnelObjNames[IND_OFDPA_TUNNEL_OBJ_COUNT] =
+{
+  "next hop", "ECMP group", "tenant", "tunnel port"
+};
+
+static bighash_table_t *tunnelTables[IND_OFDPA_TUNNEL_OBJ_COUNT];
+static uint32_t applyGeneration;
+static char *configFilename;
+
+/* Counts of the last batch */
+static struct
+{
+  uint32_t created;
+  uint32_t modified;
+  uint32_t deleted;
+  uint32_t unchanged;
+  uint32_t refsAdded;
+  uint32_t refsDeleted;
+  uint32_t failures;
+} applyStats;
+
+static OFDPA_ERROR_t tunnel_obj_create(const ind_ofdpa_tunnel_obj_t *obj)
+{
+  ind_ofdpa_tunnel_obj_t copy = *obj;
+  ofdpa_buffdesc name;
+
+  switch (obj->type)
+  {
+    case IND_OFDPA_TUNNEL_OBJ_NEXT_HOP:
+      return IND_OFDPA_RPC(ofdpaTunnelNextHopCreate, obj->id, &copy.config.nextHop);
+    case IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP:
+      return IND_OFDPA_RPC(ofdpaTunnelEcmpNextHopGroupCreate, obj->id, &copy.config.ecmpGroup);
+    case IND_OFDPA_TUNNEL_OBJ_TENANT:
+      return IND_OFDPA_RPC(ofdpaTunnelTenantCreate, obj->id, &copy.config.tenant);
+    case IND_OFDPA_TUNNEL_OBJ_PORT:
+      name.pstart = copy.name;
+      name.size = strlen(copy.name) + 1;
+      return IND_OFDPA_RPC(ofdpaTunnelPortCreate, obj->id, &name, &copy.config.port);
+    default:
+      return OFDPA_E_PARAM;
+  }
+}
+
+static OFDPA_ERROR_t tunnel_obj_delete(ind_ofdpa_tunnel_obj_type_t type, uint32_t id)
+{
+  switch (type)
+  {
+    case IND_OFDPA_TUNNEL_OBJ_NEXT_HOP:
+      return IND_OFDPA_RPC(ofdpaTunnelNextHopDelete, id);
+    case IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP:
+      return IND_OFDPA_RPC(ofdpaTunnelEcmpNextHopGroupDelete, id);
+    case IND_OFDPA_TUNNEL_OBJ_TENANT:
+      return IND_OFDPA_RPC(ofdpaTunnelTenantDelete, id);
+    case IND_OFDPA_TUNNEL_OBJ_PORT:
+      return IND_OFDPA_RPC(ofdpaTunnelPortDelete, id);
+    default:
+      return OFDPA_E_PARAM;
+  }
+}
+
+static OFDPA_ERROR_t tunnel_ref_add(ind_ofdpa_tunnel_obj_type_t type, uint32_t id, uint32_t ref)
+{
+  if (type == IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP)
+  {
+    return IND_OFDPA_RPC(ofdpaTunnelEcmpNextHopGroupMemberAdd, id, ref);
+  }
+  return IND_OFDPA_RPC(ofdpaTunnelPortTenantAdd, id, ref);
+}
+
+static OFDPA_ERROR_t tunnel_ref_delete(ind_ofdpa_tunnel_obj_type_t type, uint32_t id, uint32_t ref)
+{
+  if (type == IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP)
+  {
+    return IND_OFDPA_RPC(ofdpaTunnelEcmpNextHopGroupMemberDelete, id, ref);
+  }
+  return IND_OFDPA_RPC(ofdpaTunnelPortTenantDelete, id, ref);
+}
+
+static int tunnel_config_equal(const ind_ofdpa_tunnel_obj_t *a, const ind_ofdpa_tunnel_obj_t *b)
+{
+  switch (a->type)
+  {
+    case IND_OFDPA_TUNNEL_OBJ_NEXT_HOP:
+      return memcmp(&a->config.nextHop, &b->config.nextHop, sizeof(a->config.nextHop)) == 0;
+    case IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP:
+      return memcmp(&a->config.ecmpGroup, &b->config.ecmpGroup, sizeof(a->config.ecmpGroup)) == 0;
+    case IND_OFDPA_TUNNEL_OBJ_TENANT:
+      return memcmp(&a->config.tenant, &b->config.tenant, sizeof(a->config.tenant)) == 0;
+    case IND_OFDPA_TUNNEL_OBJ_PORT:
+      return ((memcmp(&a->config.port, &b->config.port, sizeof(a->config.port)) == 0) &&
+              (strncmp(a->name, b->name, sizeof(a->name)) == 0));
+    default:
+      return 0;
+  }
+}
+
+static int tunnel_ref_compare(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Bring the members or tenants of a cached object from its cached refs
+   to refs, which must be sorted. A ref that failed to be added is left
+   out of the cache, one that failed to be removed is kept, so the next
+   batch tries again. Returns the number of failures. */
+static uint32_t tunnel_refs_sync(ind_ofdpa_tunnel_entry_t *entry,
+                                 const uint32_t *refs, uint32_t numRefs)
+{
+  ind_ofdpa_tunnel_obj_t *obj = &entry->obj;
+  uint32_t *result;
+  uint32_t i = 0, j = 0, n = 0;
+  uint32_t failures = 0;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  if ((obj->numRefs == 0) && (numRefs == 0))
+  {
+    return 0;
+  }
+
+  result = malloc((obj->numRefs + numRefs) * sizeof(*result));
+  if (result == NULL)
+  {
+    LOG_ERROR("Failed to allocate refs of %s 0x%x", tunnelObjNames[obj->type], obj->id);
+    return 1;
+  }
+
+  while ((i < obj->numRefs) || (j < numRefs))
+  {
+    if ((j == numRefs) || ((i < obj->numRefs) && (obj->refs[i] < refs[j])))
+    {
+      ofdpa_rv = tunnel_ref_delete(obj->type, obj->id, obj->refs[i]);
+      if (ofdpa_rv != OFDPA_E_NONE)
+      {
+        LOG_ERROR("Failed to remove 0x%x from %s 0x%x, rv = %d",
+                  obj->refs[i], tunnelObjNames[obj->type], obj->id, ofdpa_rv);
+        result[n++] = obj->refs[i];
+        failures++;
+      }
+      else
+      {
+        applyStats.refsDeleted++;
+      }
+      i++;
+    }
+    else if ((i == obj->numRefs) || (refs[j] < obj->refs[i]))
+    {
+      ofdpa_rv = tunnel_ref_add(obj->type, obj->id, refs[j]);
+      if (ofdpa_rv != OFDPA_E_NONE)
+      {
+        LOG_ERROR("Failed to add 0x%x to %s 0x%x, rv = %d",
+                  refs[j], tunnelObjNames[obj->type], obj->id, ofdpa_rv);
+        failures++;
+      }
+      else
+      {
+        result[n++] = refs[j];
+        applyStats.refsAdded++;
+      }
+      j++;
+    }
+    else
+    {
+      result[n++] = refs[j];
+      i++;
+      j++;
+    }
+  }
+
+  free(obj->refs);
+  obj->refs = result;
+  obj->numRefs = n;
+
+  return failures;
+}
+
+/* Create or change one object of the batch. Returns the number of failures. */
+static uint32_t tunnel_obj_apply(const ind_ofdpa_tunnel_obj_t *obj, uint32_t generation)
+{
+  bighash_table_t *table = tunnelTables[obj->type];
+  ind_ofdpa_tunnel_entry_t *entry;
+  uint32_t *refs = NULL;
+  uint32_t numRefs = 0;
+  uint32_t i, failures;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  entry = tunnel_hashtable_first(table, &obj->id);
+  if ((entry != NULL) && (entry->generation == generation))
+  {
+    LOG_ERROR("Duplicate %s 0x%x in tunnel batch", tunnelObjNames[obj->type], obj->id);
+    return 1;
+  }
+
+  if (obj->numRefs != 0)
+  {
+    refs = malloc(obj->numRefs * sizeof(*refs));
+    if (refs == NULL)
+    {
+      LOG_ERROR("Failed to allocate refs of %s 0x%x", tunnelObjNames[obj->type], obj->id);
+      return 1;
+    }
+    memcpy(refs, obj->refs, obj->numRefs * sizeof(*refs));
+    qsort(refs, obj->numRefs, sizeof(*refs), tunnel_ref_compare);
+    for (i = 0; i < obj->numRefs; i++)
+    {
+      if ((numRefs == 0) || (refs[i] != refs[numRefs - 1]))
+      {
+        refs[numRefs++] = refs[i];
+      }
+    }
+  }
+
+  if (entry == NULL)
+  {
+    ofdpa_rv = tunnel_obj_create(obj);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Failed to create %s 0x%x, rv = %d", tunnelObjNames[obj->type], obj->id, ofdpa_rv);
+      free(refs);
+      return 1;
+    }
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+    {
+      /* Left in OF-DPA, the next batch fails to create it and retries */
+      LOG_ERROR("Failed to cache %s 0x%x", tunnelObjNames[obj->type], obj->id);
+      free(refs);
+      return 1;
+    }
+    entry->id = obj->id;
+    entry->obj = *obj;
+    entry->obj.refs = NULL;
+    entry->obj.numRefs = 0;
+    tunnel_hashtable_insert(table, entry);
+    applyStats.created++;
+  }
+  else if (!tunnel_config_equal(&entry->obj, obj))
+  {
+    if (obj->type == IND_OFDPA_TUNNEL_OBJ_NEXT_HOP)
+    {
+      ofdpa_rv = IND_OFDPA_RPC(ofdpaTunnelNextHopModify, obj->id, (ofdpaTunnelNextHopConfig_t *)&obj->config.nextHop);
+      if (ofdpa_rv != OFDPA_E_NONE)
+      {
+        LOG_ERROR("Failed to modify next hop 0x%x, rv = %d", obj->id, ofdpa_rv);
+        entry->generation = generation;
+        free(refs);
+        return 1;
+      }
+    }
+    else
+    {
+      failures = tunnel_refs_sync(entry, NULL, 0);
+      ofdpa_rv = (failures == 0) ? tunnel_obj_delete(obj->type, obj->id) : OFDPA_E_FAIL;
+      if (ofdpa_rv == OFDPA_E_NONE)
+      {
+        ofdpa_rv = tunnel_obj_create(obj);
+        if (ofdpa_rv != OFDPA_E_NONE)
+        {
+          LOG_ERROR("Failed to recreate %s 0x%x, rv = %d",
+                    tunnelObjNames[obj->type], obj->id, ofdpa_rv);
+          bighash_remove(table, &entry->hash_entry);
+          free(entry->obj.refs);
+          free(entry);
+          free(refs);
+          return 1;
+        }
+      }
+      else
+      {
+        LOG_ERROR("Failed to delete %s 0x%x for reconfiguration, rv = %d",
+                  tunnelObjNames[obj->type], obj->id, ofdpa_rv);
+        entry->generation = generation;
+        free(refs);
+        return failures + 1;
+      }
+    }
+
+    entry->obj.config = obj->config;
+    memcpy(entry->obj.name, obj->name, sizeof(entry->obj.name));
+    applyStats.modified++;
+  }
+  else
+  {
+    applyStats.unchanged++;
+  }
+
+  entry->generation = generation;
+  failures = tunnel_refs_sync(entry, refs, numRefs);
+  free(refs);
+
+  return failures;
+}
+
+/* Remove an object missing from the batch. Returns the number of failures. */
+static uint32_t tunnel_entry_remove(bighash_table_t *table, ind_ofdpa_tunnel_entry_t *entry)
+{
+  uint32_t failures;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  failures = tunnel_refs_sync(entry, NULL, 0);
+  if (failures != 0)
+  {
+    return failures;
+  }
+
+  ofdpa_rv = tunnel_obj_delete(entry->obj.type, entry->id);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    /* Kept in the cache so the next batch tries again */
+    LOG_ERROR("Failed to delete %s 0x%x, rv = %d",
+              tunnelObjNames[entry->obj.type], entry->id, ofdpa_rv);
+    return 1;
+  }
+
+  bighash_remove(table, &entry->hash_entry);
+  free(entry->obj.refs);
+  free(entry);
+  applyStats.deleted++;
+
+  return 0;
+}
+
+/* Make objs the complete set of tunnel objects programmed by the agent.
+   Runs in the SocketManager loop. */
+indigo_error_t ind_ofdpa_tunnel_bulk_apply(const ind_ofdpa_tunnel_obj_t *objs, uint32_t count)
+{
+  ind_ofdpa_tunnel_entry_t *entry;
+  bighash_iter_t iter;
+  uint32_t generation;
+  uint32_t i;
+  int type;
+
+  if (tunnelTables[0] == NULL)
+  {
+    return INDIGO_ERROR_INIT;
+  }
+
+  memset(&applyStats, 0, sizeof(applyStats));
+  generation = ++applyGeneration;
+
+  for (type = 0; type < IND_OFDPA_TUNNEL_OBJ_COUNT; type++)
+  {
+    for (i = 0; i < count; i++)
+    {
+      if (objs[i].type == type)
+      {
+        applyStats.failures += tunnel_obj_apply(&objs[i], generation);
+      }
+    }
+  }
+
+  for (type = IND_OFDPA_TUNNEL_OBJ_COUNT - 1; type >= 0; type--)
+  {
+    for (entry = bighash_iter_start(tunnelTables[type], &iter);
+         entry != NULL; entry = bighash_iter_next(&iter))
+    {
+      if (entry->generation != generation)
+      {
+        applyStats.failures += tunnel_entry_remove(tunnelTables[type], entry);
+      }
+    }
+  }
+
+  ind_ofdpa_tunnel_show();
+
+  return (applyStats.failures == 0) ? INDIGO_ERROR_NONE : INDIGO_ERROR_UNKNOWN;
+}
+
+void ind_ofdpa_tunnel_show(void)
+{
+  if (tunnelTables[0] == NULL)
+  {
+    return;
+  }
+
+  LOG_INFO("Tunnel objects: %d next hops, %d ECMP groups, %d tenants, %d ports",
+           bighash_entry_count(tunnelTables[IND_OFDPA_TUNNEL_OBJ_NEXT_HOP]),
+           bighash_entry_count(tunnelTables[IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP]),
+           bighash_entry_count(tunnelTables[IND_OFDPA_TUNNEL_OBJ_TENANT]),
+           bighash_entry_count(tunnelTables[IND_OFDPA_TUNNEL_OBJ_PORT]));
+  LOG_INFO("  last batch: %u created, %u modified, %u deleted, %u unchanged, "
+           "%u refs added, %u refs removed, %u failures",
+           applyStats.created, applyStats.modified, applyStats.deleted,
+           applyStats.unchanged, applyStats.refsAdded, applyStats.refsDeleted,
+           applyStats.failures);
+}
+
+/*
+ * Tunnel configuration file
+ */
+
+static indigo_error_t cfg_uint(cJSON *item, const char *key, int required, uint32_t *value)
+{
+  indigo_error_t err;
+  int v;
+
+  err = ind_cfg_lookup_int(item, key, &v);
+  if ((err == INDIGO_ERROR_NOT_FOUND) && !required)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+  if ((err < 0) || (v < 0))
+  {
+    LOG_ERROR("Tunnel config: \"%s\" missing or not a number", key);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  *value = v;
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_bool(cJSON *item, const char *key, uint16_t *value)
+{
+  indigo_error_t err;
+  int v;
+
+  err = ind_cfg_lookup_bool(item, key, &v);
+  if (err == INDIGO_ERROR_NOT_FOUND)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+  if (err < 0)
+  {
+    LOG_ERROR("Tunnel config: \"%s\" is not a boolean", key);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  *value = v ? 1 : 0;
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_ipv4(cJSON *item, const char *key, int required, in_addr_t *value)
+{
+  struct in_addr addr;
+  indigo_error_t err;
+  char *str;
+
+  err = ind_cfg_lookup_string(item, key, &str);
+  if ((err == INDIGO_ERROR_NOT_FOUND) && !required)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+  if ((err < 0) || (inet_pton(AF_INET, str, &addr) != 1))
+  {
+    LOG_ERROR("Tunnel config: \"%s\" missing or not an IPv4 address", key);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  *value = ntohl(addr.s_addr);
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_mac(cJSON *item, const char *key, ofdpaMacAddr_t *value)
+{
+  of_mac_addr_t mac;
+
+  if (ind_cfg_parse_mac_addr(item, key, &mac) < 0)
+  {
+    LOG_ERROR("Tunnel config: \"%s\" missing or not a MAC address", key);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  memcpy(value->addr, mac.addr, sizeof(value->addr));
+  return INDIGO_ERROR_NONE;
+}
+
+static uint32_t cfg_tunnel_id(uint32_t index)
+{
+  uint32_t tunnelId = 0;
+
+  ofdpaTunnelIdTypeSet(&tunnelId, OFDPA_TUNNELID_TYPE_DATA_CENTER_OVERLAY);
+  ofdpaTunnelIdIndexSet(&tunnelId, index);
+  return tunnelId;
+}
+
+static uint32_t cfg_tunnel_port(uint32_t index)
+{
+  uint32_t portNum = 0;
+
+  ofdpaPortTypeSet(&portNum, OFDPA_PORT_TYPE_LOGICAL_TUNNEL);
+  ofdpaPortIndexSet(&portNum, index);
+  return portNum;
+}
+
+/* Tenants are referred to by index */
+static indigo_error_t cfg_refs(cJSON *item, const char *key, int tenants,
+                               ind_ofdpa_tunnel_obj_t *obj)
+{
+  cJSON *list, *ref;
+  uint32_t n = 0;
+
+  if (ind_cfg_lookup(item, key, &list) < 0)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+  if (list->type != cJSON_Array)
+  {
+    LOG_ERROR("Tunnel config: \"%s\" is not a list", key);
+    return INDIGO_ERROR_PARAM;
+  }
+
+  obj->numRefs = cJSON_GetArraySize(list);
+  if (obj->numRefs == 0)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+  obj->refs = calloc(obj->numRefs, sizeof(*obj->refs));
+  if (obj->refs == NULL)
+  {
+    obj->numRefs = 0;
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  for (ref = list->child; ref != NULL; ref = ref->next)
+  {
+    if ((ref->type != cJSON_Number) || (ref->valueint < 0))
+    {
+      LOG_ERROR("Tunnel config: \"%s\" holds a non-number", key);
+      return INDIGO_ERROR_PARAM;
+    }
+    obj->refs[n++] = tenants ? cfg_tunnel_id(ref->valueint) : (uint32_t)ref->valueint;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_next_hop_parse(cJSON *item, ind_ofdpa_tunnel_obj_t *obj)
+{
+  ofdpaTunnelNextHopConfig_t *cfg = &obj->config.nextHop;
+  uint32_t vlan = 0;
+
+  obj->type = IND_OFDPA_TUNNEL_OBJ_NEXT_HOP;
+  cfg->protocol = OFDPA_TUNNEL_PROTO_VXLAN;
+  if ((cfg_uint(item, "id", 1, &obj->id) < 0) ||
+      (cfg_mac(item, "src_mac", &cfg->srcAddr) < 0) ||
+      (cfg_mac(item, "dst_mac", &cfg->dstAddr) < 0) ||
+      (cfg_uint(item, "port", 1, &cfg->physicalPortNum) < 0) ||
+      (cfg_uint(item, "vlan", 1, &vlan) < 0))
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  cfg->vlanId = vlan;
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_ecmp_group_parse(cJSON *item, ind_ofdpa_tunnel_obj_t *obj)
+{
+  obj->type = IND_OFDPA_TUNNEL_OBJ_ECMP_GROUP;
+  obj->config.ecmpGroup.protocol = OFDPA_TUNNEL_PROTO_VXLAN;
+  if (cfg_uint(item, "id", 1, &obj->id) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  return cfg_refs(item, "next_hops", 0, obj);
+}
+
+static indigo_error_t cfg_tenant_parse(cJSON *item, ind_ofdpa_tunnel_obj_t *obj)
+{
+  ofdpaTunnelTenantConfig_t *cfg = &obj->config.tenant;
+  uint32_t index;
+
+  obj->type = IND_OFDPA_TUNNEL_OBJ_TENANT;
+  cfg->protocol = OFDPA_TUNNEL_PROTO_VXLAN;
+  if ((cfg_uint(item, "index", 1, &index) < 0) ||
+      (cfg_uint(item, "vni", 1, &cfg->virtualNetworkId) < 0) ||
+      (cfg_ipv4(item, "mcast_ip", 0, &cfg->mcastIp) < 0) ||
+      (cfg_uint(item, "mcast_next_hop", 0, &cfg->mcastNextHopId) < 0))
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  obj->id = cfg_tunnel_id(index);
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_port_parse(cJSON *item, ind_ofdpa_tunnel_obj_t *obj)
+{
+  uint32_t index;
+  char *name;
+
+  obj->type = IND_OFDPA_TUNNEL_OBJ_PORT;
+  obj->config.port.tunnelProtocol = OFDPA_TUNNEL_PROTO_VXLAN;
+  if (cfg_uint(item, "index", 1, &index) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  obj->id = cfg_tunnel_port(index);
+
+  if (ind_cfg_lookup_string(item, "name", &name) == INDIGO_ERROR_NONE)
+  {
+    strncpy(obj->name, name, sizeof(obj->name) - 1);
+  }
+  else
+  {
+    snprintf(obj->name, sizeof(obj->name), "tunnel%u", index);
+  }
+
+  return cfg_refs(item, "tenants", 1, obj);
+}
+
+static indigo_error_t cfg_access_port_parse(cJSON *item, ind_ofdpa_tunnel_obj_t *obj)
+{
+  ofdpaAccessPortConfig_t *cfg = &obj->config.port.configData.access;
+  uint32_t vlan = 0;
+
+  if (cfg_port_parse(item, obj) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  obj->config.port.type = OFDPA_TUNNEL_PORT_TYPE_ACCESS;
+  if ((cfg_uint(item, "port", 1, &cfg->physicalPortNum) < 0) ||
+      (cfg_uint(item, "vlan", 0, &vlan) < 0) ||
+      (cfg_bool(item, "untagged", &cfg->untagged) < 0))
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  cfg->vlanId = vlan;
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t cfg_endpoint_parse(cJSON *item, ind_ofdpa_tunnel_obj_t *obj)
+{
+  ofdpaEndpointConfig_t *cfg = &obj->config.port.configData.endpoint;
+  uint32_t dstPort = IND_OFDPA_VXLAN_UDP_PORT;
+  uint32_t srcPort = 0;
+  uint16_t ecmp = 0;
+
+  if (cfg_port_parse(item, obj) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  obj->config.port.type = OFDPA_TUNNEL_PORT_TYPE_ENDPOINT;
+  cfg->ttl = 64;
+  cfg->protocolInfo.vxlan.useEntropy = 1;
+  if ((cfg_ipv4(item, "remote_ip", 1, &cfg->remoteEndpoint) < 0) ||
+      (cfg_ipv4(item, "local_ip", 1, &cfg->localEndpoint) < 0) ||
+      (cfg_uint(item, "ttl", 0, &cfg->ttl) < 0) ||
+      (cfg_uint(item, "next_hop", 1, &cfg->nextHopId) < 0) ||
+      (cfg_bool(item, "ecmp", &ecmp) < 0) ||
+      (cfg_uint(item, "udp_dst_port", 0, &dstPort) < 0) ||
+      (cfg_uint(item, "udp_src_port", 0, &srcPort) < 0) ||
+      (cfg_bool(item, "entropy", &cfg->protocolInfo.vxlan.useEntropy) < 0))
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  cfg->ecmp = ecmp;
+  cfg->protocolInfo.vxlan.terminatorUdpDstPort = dstPort;
+  cfg->protocolInfo.vxlan.initiatorUdpDstPort = dstPort;
+  cfg->protocolInfo.vxlan.udpSrcPortIfNoEntropy = srcPort;
+
+  return INDIGO_ERROR_NONE;
+}
+
+static const struct
+{
+  const char *key;
+  indigo_error_t (*parse)(cJSON *item, ind_ofdpa_tunnel_obj_t *obj);
+} cfgSections[] =
+{
+  { "next_hops",    cfg_next_hop_parse },
+  { "ecmp_groups",  cfg_ecmp_group_parse },
+  { "tenants",      cfg_tenant_parse },
+  { "access_ports", cfg_access_port_parse },
+  { "endpoints",    cfg_endpoint_parse },
+};
+
+static cJSON *cfg_file_read(const char *filename)
+{
+  cJSON *root;
+  char *data;
+  long len;
+  FILE *f;
+
+  f = fopen(filename, "r");
+  if (f == NULL)
+  {
+    LOG_ERROR("Failed to open tunnel config %s", filename);
+    return NULL;
+  }
+
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = malloc(len + 1);
+  if ((data == NULL) || (fread(data, 1, len, f) != len))
+  {
+    LOG_ERROR("Failed to read tunnel config %s", filename);
+    free(data);
+    fclose(f);
+    return NULL;
+  }
+  data[len] = 0;
+  fclose(f);
+
+  root = cJSON_Parse(data);
+  if ((root == NULL) || (root->type != cJSON_Object))
+  {
+    LOG_ERROR("Tunnel config %s is not a JSON object", filename);
+    cJSON_Delete(root);
+    root = NULL;
+  }
+  free(data);
+
+  return root;
+}
+
+/* Read the tunnel config file and apply it. The cache is left alone if
+   the file does not parse. */
+indigo_error_t ind_ofdpa_tunnel_config_reload(void)
+{
+  ind_ofdpa_tunnel_obj_t *objs;
+  indigo_error_t err = INDIGO_ERROR_NONE;
+  cJSON *root, *list, *item;
+  uint32_t count = 0;
+  uint32_t i;
+
+  if (configFilename == NULL)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  root = cfg_file_read(configFilename);
+  if (root == NULL)
+  {
+    return INDIGO_ERROR_PARSE;
+  }
+
+  for (i = 0; i < AIM_ARRAYSIZE(cfgSections); i++)
+  {
+    if (ind_cfg_lookup(root, cfgSections[i].key, &list) == INDIGO_ERROR_NONE)
+    {
+      count += cJSON_GetArraySize(list);
+    }
+  }
+
+  objs = calloc(count + 1, sizeof(*objs));
+  if (objs == NULL)
+  {
+    cJSON_Delete(root);
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  count = 0;
+  for (i = 0; (i < AIM_ARRAYSIZE(cfgSections)) && (err == INDIGO_ERROR_NONE); i++)
+  {
+    if (ind_cfg_lookup(root, cfgSections[i].key, &list) < 0)
+    {
+      continue;
+    }
+    if (list->type != cJSON_Array)
+    {
+      LOG_ERROR("Tunnel config: \"%s\" is not a list", cfgSections[i].key);
+      err = INDIGO_ERROR_PARAM;
+      break;
+    }
+    for (item = list->child; (item != NULL) && (err == INDIGO_ERROR_NONE); item = item->next)
+    {
+      err = cfgSections[i].parse(item, &objs[count++]);
+    }
+  }
+  cJSON_Delete(root);
+
+  if (err == INDIGO_ERROR_NONE)
+  {
+    LOG_INFO("Applying %u tunnel objects from %s", count, configFilename);
+    err = ind_ofdpa_tunnel_bulk_apply(objs, count);
+  }
+  else
+  {
+    LOG_ERROR("Tunnel config %s not applied", configFilename);
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    free(objs[i].refs);
+  }
+  free(objs);
+
+  return err;
+}
+
+indigo_error_t ind_ofdpa_tunnel_init(const char *filename)
+{
+  indigo_error_t err;
+  int type;
+
+  for (type = 0; type < IND_OFDPA_TUNNEL_OBJ_COUNT; type++)
+  {
+    tunnelTables[type] = bighash_table_create(IND_OFDPA_TUNNEL_BUCKETS);
+    if (tunnelTables[type] == NULL)
+    {
+      LOG_ERROR("Failed to create tunnel object table");
+      return INDIGO_ERROR_RESOURCE;
+    }
+  }
+
+  if (filename == NULL)
+  {
+    return INDIGO_ERROR_NONE;
+  }
+
+  configFilename = strdup(filename);
+  if (configFilename == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  /* Objects OF-DPA rejected are logged, not fatal */
+  err = ind_ofdpa_tunnel_config_reload();
+  return (err == INDIGO_ERROR_UNKNOWN) ? INDIGO_ERROR_NONE : err;
+}
@@ -0,0 +1,289 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_ucli.c
+*
+* @purpose    uCli commands for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   Built when IND_OFDPA_CONFIG_INCLUDE_UCLI is 1.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+
+#if IND_OFDPA_CONFIG_INCLUDE_UCLI == 1
+
+#include <stdlib.h>
+#include <string.h>
+#include <uCli/ucli.h>
+#include <uCli/ucli_argparse.h>
+#include <uCli/ucli_handler_macros.h>
+
+static ucli_status_t
+ind_ofdpa_ucli_ucli__rpc_profile__(ucli_context_t* uc)
+{
+  char *str;
+
+  UCLI_COMMAND_INFO(uc,
+                    "rpc_profile", -1,
+                    "$summary#Show the OF-DPA RPC latency, or switch its collection."
+                    "$args#[on|off|reset]");
+  if (uc->pargs->count == 1)
+  {
+    UCLI_ARGPARSE_OR_RETURN(uc, "s", &str);
+    if (!strcmp(str, "on"))
+    {
+      ind_ofdpa_rpc_profile_set(1);
+    }
+    else if (!strcmp(str, "off"))
+    {
+      ind_ofdpa_rpc_profile_set(0);
+    }
+    else if (!strcmp(str, "reset"))
+    {
+      ind_ofdpa_rpc_stats_reset();
+    }
+    else
+    {
+      return ucli_error(uc, "unknown argument %s", str);
+    }
+    return UCLI_STATUS_OK;
+  }
+
+  ind_ofdpa_rpc_stats_show(&uc->pvs);
+
+  return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ind_ofdpa_ucli_ucli__mpls_labels__(ucli_context_t* uc)
+{
+  uint32_t label;
+
+  UCLI_COMMAND_INFO(uc,
+                    "mpls_labels", -1,
+                    "$summary#Show MPLS label use, or what a label is bound to."
+                    "$args#[LABEL]");
+  if (uc->pargs->count == 1)
+  {
+    UCLI_ARGPARSE_OR_RETURN(uc, "i", &label);
+    ind_ofdpa_mpls_label_binding_show(&uc->pvs, label);
+    return UCLI_STATUS_OK;
+  }
+
+  ind_ofdpa_mpls_label_show(&uc->pvs);
+
+  return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ind_ofdpa_ucli_ucli__mpls_label_alloc__(ucli_context_t* uc)
+{
+  uint32_t count, first;
+
+  UCLI_COMMAND_INFO(uc,
+                    "mpls_label_alloc", 1,
+                    "$summary#Allocate a run of free MPLS labels from the label ranges."
+                    "$args#COUNT");
+  UCLI_ARGPARSE_OR_RETURN(uc, "i", &count);
+
+  if (ind_ofdpa_mpls_label_alloc(count, &first) != INDIGO_ERROR_NONE)
+  {
+    return ucli_error(uc, "no run of %u free labels", count);
+  }
+  ucli_printf(uc, "%u-%u\n", first, first + count - 1);
+
+  return UCLI_STATUS_OK;
+}
+
+static ucli_status_t
+ind_ofdpa_ucli_ucli__mpls_label_release__(ucli_context_t* uc)
+{
+  uint32_t first, count;
+
+  UCLI_COMMAND_INFO(uc,
+                    "mpls_label_release", 2,
+                    "$summary#Release a run of allocated MPLS labels."
+                    "$args#FIRST COUNT");
+  UCLI_ARGPARSE_OR_RETURN(uc, "ii", &first, &count);
+
+  ind_ofdpa_mpls_label_release(first, count);
+
+  return UCLI_STATUS_OK;
+}
+
+/* Parse "all" or a comma-separated list of numbers */
+static int
+ind_ofdpa_ucli_list_parse(const char *arg, uint32_t *values, int max)
+{
+  char *str = aim_strdup(arg);
+  char *save = NULL;
+  char *tok;
+  char *end;
+  int count = 0;
+
+  if (strcmp(str, "all") != 0)
+  {
+    for (tok = strtok_r(str, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+      if (count == max)
+      {
+        count = -1;
+        break;
+      }
+      values[count++] = strtoul(tok, &end, 0);
+      if (*end != '\0')
+      {
+        count = -1;
+        break;
+      }
+    }
+  }
+  aim_free(str);
+  return count;
+}
+
+static ucli_status_t
+ind_ofdpa_ucli_ucli__event_subscribe__(ucli_context_t* uc)
+{
+  static uint32_t tables[256];
+  static uint32_t ports[IND_OFDPA_EVENT_PORT_MAX];
+  const char *tableStr = "all";
+  const char *portStr = "all";
+  char *classStr;
+  char *save = NULL;
+  char *tok;
+  uint32_t classes = 0;
+  int numTables, numPorts;
+  int rv;
+
+  UCLI_COMMAND_INFO(uc,
+                    "event_subscribe", -1,
+                    "$summary#Show or set the driver events read and delivered."
+                    "$args#[CLASSES [TABLES [PORTS]]], each 'all' or a comma-separated list; "
+                    "CLASSES of port, oam and flow");
+  if (uc->pargs->count == 0)
+  {
+    ind_ofdpa_event_subscription_show(&uc->pvs);
+    return UCLI_STATUS_OK;
+  }
+
+  if (uc->pargs->count > 3)
+  {
+    return ucli_error(uc, "too many arguments");
+  }
+  if (uc->pargs->count > 1)
+  {
+    tableStr = uc->pargs->args[1];
+  }
+  if (uc->pargs->count > 2)
+  {
+    portStr = uc->pargs->args[2];
+  }
+
+  classStr = aim_strdup(uc->pargs->args[0]);
+  for (tok = strtok_r(classStr, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+  {
+    if (!strcmp(tok, "all"))
+    {
+      classes |= IND_OFDPA_EVENT_CLASS_ALL;
+    }
+    else if (!strcmp(tok, "port"))
+    {
+      classes |= IND_OFDPA_EVENT_CLASS_PORT;
+    }
+    else if (!strcmp(tok, "oam"))
+    {
+      classes |= IND_OFDPA_EVENT_CLASS_OAM;
+    }
+    else if (!strcmp(tok, "flow"))
+    {
+      classes |= IND_OFDPA_EVENT_CLASS_FLOW;
+    }
+    else
+    {
+      rv = ucli_error(uc, "unknown event class %s", tok);
+      aim_free(classStr);
+      return rv;
+    }
+  }
+  aim_free(classStr);
+
+  if ((numTables = ind_ofdpa_ucli_list_parse(tableStr, tables, AIM_ARRAYSIZE(tables))) < 0)
+  {
+    return ucli_error(uc, "invalid table list");
+  }
+  if ((numPorts = ind_ofdpa_ucli_list_parse(portStr, ports, AIM_ARRAYSIZE(ports))) < 0)
+  {
+    return ucli_error(uc, "invalid port list");
+  }
+
+  if (ind_ofdpa_event_subscribe(classes, tables, numTables, ports, numPorts) != INDIGO_ERROR_NONE)
+  {
+    return ucli_error(uc, "table IDs must be below 256 and ports below %d",
+                      IND_OFDPA_EVENT_PORT_MAX);
+  }
+
+  return UCLI_STATUS_OK;
+}
+
+/* <auto.ucli.handlers.start> */
+static ucli_command_handler_f ind_ofdpa_ucli_ucli_handlers__[] =
+{
+  ind_ofdpa_ucli_ucli__rpc_profile__,
+  ind_ofdpa_ucli_ucli__mpls_labels__,
+  ind_ofdpa_ucli_ucli__mpls_label_alloc__,
+  ind_ofdpa_ucli_ucli__mpls_label_release__,
+  ind_ofdpa_ucli_ucli__event_subscribe__,
+  NULL
+};
+/* <auto.ucli.handlers.end> */
+
+static ucli_module_t
+ind_ofdpa_ucli_module__ =
+  {
+    "ofdpa_ucli",
+    NULL,
+    ind_ofdpa_ucli_ucli_handlers__,
+    NULL,
+    NULL,
+  };
+
+void*
+ind_ofdpa_ucli_node_create(void)
+{
+  ucli_node_t* n;
+  ucli_module_init(&ind_ofdpa_ucli_module__);
+  n = ucli_node_create("ofdpa", NULL, &ind_ofdpa_ucli_module__);
+  ucli_node_subnode_add(n, ucli_module_log_node_create("ofdpa"));
+  return n;
+}
+
+#else
+void*
+ind_ofdpa_ucli_node_create(void)
+{
+  return NULL;
+}
+#endif
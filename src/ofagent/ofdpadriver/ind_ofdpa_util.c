@@ -29,6 +29,8 @@
 * @end
 *
 **********************************************************************/
+#include <string.h>
+#include <arpa/inet.h>
 #include "ind_ofdpa_util.h"
 #include "ind_ofdpa_log.h"
 
@@ -73,4 +75,23 @@ indigo_error_t indigoConvertOfdpaRv(OFDPA_ERROR_t result)
   return indigoRv;
 }
 
+/* Store v in network byte order at p, returning the position after it */
+uint8_t *ind_ofdpa_put16(uint8_t *p, uint16_t v)
+{
+  v = htons(v);
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
 
+uint8_t *ind_ofdpa_put32(uint8_t *p, uint32_t v)
+{
+  v = htonl(v);
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+uint8_t *ind_ofdpa_put64(uint8_t *p, uint64_t v)
+{
+  p = ind_ofdpa_put32(p, (uint32_t)(v >> 32));
+  return ind_ofdpa_put32(p, (uint32_t)v);
+}
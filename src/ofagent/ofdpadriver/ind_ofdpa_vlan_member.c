@@ -0,0 +1,377 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_vlan_member.c
+*
+* @purpose    Bulk port VLAN membership for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   The VLAN table takes one flow per port and VLAN, so putting
+*             thousands of VLANs on every trunk port one flow-mod at a
+*             time costs a translation and an RPC each and leaves as many
+*             flows in the agent flow table. Instead the controller sets
+*             the tagged VLANs of a port with one "ofdpa_vlan_membership"
+*             gentable entry. The driver keeps the membership of each port
+*             as a VLAN bitmap and programs only the difference between
+*             the old and new bitmaps, in batches through the flow submit
+*             thread when it runs.
+*
+*             The VLAN table entries carry IND_OFDPA_VLAN_MEMBER_COOKIE
+*             cookies built from the port and VLAN, so they never reach the
+*             agent flow table.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim.h>
+#include <AIM/aim_bitmap.h>
+
+#define IND_OFDPA_VLAN_MEMBER_VLAN_COUNT       4096
+#define IND_OFDPA_VLAN_MEMBER_GENTABLE_MAX     1024
+#define IND_OFDPA_VLAN_MEMBER_GENTABLE_BUCKETS 256
+
+/* VLAN table entries programmed per submit thread batch */
+#define IND_OFDPA_VLAN_MEMBER_BATCH            256
+
+typedef struct
+{
+  uint32_t port;
+  aim_bitmap4096_t vlans;       /* VLANs programmed in the VLAN table */
+} ind_ofdpa_vlan_member_port_t;
+
+typedef struct
+{
+  uint64_t entriesAdded;
+  uint64_t entriesDeleted;
+  uint64_t failures;
+} ind_ofdpa_vlan_member_stats_t;
+
+static indigo_core_gentable_t *vlanMemberGentable;
+static const indigo_core_gentable_ops_t vlanMemberGentableOps;
+
+static ofdpaFlowEntry_t vlanMemberTemplate;
+static ofdpaFlowEntry_t vlanMemberFlows[IND_OFDPA_VLAN_MEMBER_BATCH];
+static OFDPA_ERROR_t vlanMemberRvs[IND_OFDPA_VLAN_MEMBER_BATCH];
+static int vlanMemberDeletes[IND_OFDPA_VLAN_MEMBER_BATCH];
+static int vlanMemberCount;
+
+static uint32_t vlanMemberPorts;
+static ind_ofdpa_vlan_member_stats_t vlanMemberStats;
+
+indigo_error_t ind_ofdpa_vlan_member_init(void)
+{
+  OFDPA_ERROR_t ofdpa_rv;
+
+  ofdpa_rv = IND_OFDPA_RPC(ofdpaFlowEntryInit, OFDPA_FLOW_TABLE_ID_VLAN, &vlanMemberTemplate);
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to initialize VLAN table entry, rv = %d", ofdpa_rv);
+    return INDIGO_ERROR_UNKNOWN;
+  }
+  vlanMemberTemplate.flowData.vlanFlowEntry.match_criteria.vlanIdMask =
+    OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK;
+  vlanMemberTemplate.flowData.vlanFlowEntry.gotoTableId = OFDPA_FLOW_TABLE_ID_TERMINATION_MAC;
+
+  indigo_core_gentable_register("ofdpa_vlan_membership", &vlanMemberGentableOps, NULL,
+                                IND_OFDPA_VLAN_MEMBER_GENTABLE_MAX,
+                                IND_OFDPA_VLAN_MEMBER_GENTABLE_BUCKETS,
+                                &vlanMemberGentable);
+
+  return INDIGO_ERROR_NONE;
+}
+
+/* Add or delete the queued entries and update the port bitmap with those
+   that succeeded. Returns the number that failed. */
+static int vlan_member_flush(ind_ofdpa_vlan_member_port_t *member)
+{
+  ofdpaFlowEntry_t *flow;
+  uint16_t vlanId;
+  int pipelined;
+  int failed = 0;
+  int i;
+
+  pipelined = ind_ofdpa_flow_submit_thread_running();
+  for (i = 0; i < vlanMemberCount; i++)
+  {
+    flow = &vlanMemberFlows[i];
+    if (pipelined)
+    {
+      if (vlanMemberDeletes[i])
+      {
+        ind_ofdpa_flow_submit_delete(flow, &vlanMemberRvs[i]);
+      }
+      else
+      {
+        ind_ofdpa_flow_submit(flow, &vlanMemberRvs[i]);
+      }
+    }
+    else
+    {
+      vlanMemberRvs[i] = vlanMemberDeletes[i] ?
+        IND_OFDPA_RPC(ofdpaFlowByCookieDelete, flow->cookie) :
+        IND_OFDPA_RPC(ofdpaFlowAdd, flow);
+    }
+  }
+  if (pipelined)
+  {
+    ind_ofdpa_flow_submit_wait();
+  }
+
+  for (i = 0; i < vlanMemberCount; i++)
+  {
+    flow = &vlanMemberFlows[i];
+    vlanId = flow->flowData.vlanFlowEntry.match_criteria.vlanId & OFDPA_VID_EXACT_MASK;
+    if (vlanMemberDeletes[i])
+    {
+      /* Already gone is as good as deleted */
+      if ((vlanMemberRvs[i] == OFDPA_E_NONE) || (vlanMemberRvs[i] == OFDPA_E_NOT_FOUND))
+      {
+        aim_bitmap_clr(&member->vlans.hdr, vlanId);
+        ind_ofdpa_table_stats_flow_removed(OFDPA_FLOW_TABLE_ID_VLAN, 0);
+        vlanMemberStats.entriesDeleted++;
+        continue;
+      }
+    }
+    else if (vlanMemberRvs[i] == OFDPA_E_NONE)
+    {
+      aim_bitmap_set(&member->vlans.hdr, vlanId);
+      ind_ofdpa_table_stats_flow_added(OFDPA_FLOW_TABLE_ID_VLAN, 0);
+      vlanMemberStats.entriesAdded++;
+      continue;
+    }
+
+    LOG_TRACE("Failed to %s VLAN %u on port %u, rv = %d",
+              vlanMemberDeletes[i] ? "remove" : "add", vlanId, member->port,
+              vlanMemberRvs[i]);
+    vlanMemberStats.failures++;
+    failed++;
+  }
+
+  vlanMemberCount = 0;
+  return failed;
+}
+
+/* Program the VLAN table so the port is a member of exactly the VLANs in
+   target. On failure the port bitmap holds what was programmed. */
+static indigo_error_t vlan_member_apply(ind_ofdpa_vlan_member_port_t *member,
+                                        aim_bitmap_hdr_t *target)
+{
+  ofdpaFlowEntry_t *flow;
+  int want, have;
+  int failed = 0;
+  int vlanId;
+
+  for (vlanId = 1; vlanId < IND_OFDPA_VLAN_MEMBER_VLAN_COUNT - 1; vlanId++)
+  {
+    want = aim_bitmap_get(target, vlanId);
+    have = aim_bitmap_get(&member->vlans.hdr, vlanId);
+    if (want == have)
+    {
+      continue;
+    }
+
+    flow = &vlanMemberFlows[vlanMemberCount];
+    *flow = vlanMemberTemplate;
+    flow->cookie = IND_OFDPA_VLAN_MEMBER_COOKIE_MAKE(member->port, vlanId);
+    flow->flowData.vlanFlowEntry.match_criteria.inPort = member->port;
+    flow->flowData.vlanFlowEntry.match_criteria.vlanId = OFDPA_VID_PRESENT | vlanId;
+    vlanMemberDeletes[vlanMemberCount] = have;
+
+    if (++vlanMemberCount == IND_OFDPA_VLAN_MEMBER_BATCH)
+    {
+      failed += vlan_member_flush(member);
+    }
+  }
+  if (vlanMemberCount != 0)
+  {
+    failed += vlan_member_flush(member);
+  }
+
+  if (failed != 0)
+  {
+    LOG_ERROR("Failed to update %d VLAN memberships of port %u", failed, member->port);
+    return INDIGO_ERROR_UNKNOWN;
+  }
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_vlan_member_show(void)
+{
+  if (vlanMemberPorts == 0)
+  {
+    return;
+  }
+
+  LOG_INFO("VLAN membership: %u ports, %"PRIu64" VLAN entries added, "
+           "%"PRIu64" deleted, %"PRIu64" failures",
+           vlanMemberPorts, vlanMemberStats.entriesAdded,
+           vlanMemberStats.entriesDeleted, vlanMemberStats.failures);
+}
+
+/*
+ * ofdpa_vlan_membership gentable
+ *
+ * Key is a port TLV. Value is a list of vlan_vid TLVs, the VLANs whose
+ * tagged packets the port accepts. Modifying the entry adds and removes
+ * only the VLANs that changed; deleting it removes all of them.
+ */
+
+static indigo_error_t vlan_member_parse_key(of_list_bsn_tlv_t *key, uint32_t *port)
+{
+  of_bsn_tlv_t tlv;
+
+  if (of_list_bsn_tlv_first(key, &tlv) < 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  if (tlv.header.object_id != OF_BSN_TLV_PORT)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+  of_bsn_tlv_port_value_get(&tlv.port, port);
+
+  if (of_list_bsn_tlv_next(key, &tlv) == 0)
+  {
+    return INDIGO_ERROR_PARAM;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t vlan_member_parse_value(of_list_bsn_tlv_t *value,
+                                              aim_bitmap_hdr_t *vlans)
+{
+  of_bsn_tlv_t tlv;
+  uint16_t vlanId;
+  int rv;
+
+  aim_bitmap_clr_all(vlans);
+  for (rv = of_list_bsn_tlv_first(value, &tlv); rv == 0;
+       rv = of_list_bsn_tlv_next(value, &tlv))
+  {
+    if (tlv.header.object_id != OF_BSN_TLV_VLAN_VID)
+    {
+      return INDIGO_ERROR_PARAM;
+    }
+    of_bsn_tlv_vlan_vid_value_get(&tlv.vlan_vid, &vlanId);
+    if ((vlanId == 0) || (vlanId >= IND_OFDPA_VLAN_MEMBER_VLAN_COUNT - 1))
+    {
+      return INDIGO_ERROR_PARAM;
+    }
+    aim_bitmap_set(vlans, vlanId);
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t vlan_member_gentable_add(void *table_priv, of_list_bsn_tlv_t *key,
+                                               of_list_bsn_tlv_t *value, void **entry_priv)
+{
+  ind_ofdpa_vlan_member_port_t *member;
+  aim_bitmap4096_t vlans;
+  uint32_t port;
+  indigo_error_t rv;
+
+  rv = vlan_member_parse_key(key, &port);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    return rv;
+  }
+  AIM_BITMAP_INIT(&vlans, IND_OFDPA_VLAN_MEMBER_VLAN_COUNT - 1);
+  rv = vlan_member_parse_value(value, &vlans.hdr);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    return rv;
+  }
+
+  member = calloc(1, sizeof(*member));
+  if (member == NULL)
+  {
+    return INDIGO_ERROR_RESOURCE;
+  }
+  member->port = port;
+  AIM_BITMAP_INIT(&member->vlans, IND_OFDPA_VLAN_MEMBER_VLAN_COUNT - 1);
+
+  rv = vlan_member_apply(member, &vlans.hdr);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    /* The entry is not added, so nothing may be left programmed */
+    aim_bitmap_clr_all(&vlans.hdr);
+    (void)vlan_member_apply(member, &vlans.hdr);
+    free(member);
+    return rv;
+  }
+
+  vlanMemberPorts++;
+  *entry_priv = member;
+  return INDIGO_ERROR_NONE;
+}
+
+static indigo_error_t vlan_member_gentable_modify(void *table_priv, void *entry_priv,
+                                                  of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *value)
+{
+  ind_ofdpa_vlan_member_port_t *member = entry_priv;
+  aim_bitmap4096_t vlans;
+  indigo_error_t rv;
+
+  AIM_BITMAP_INIT(&vlans, IND_OFDPA_VLAN_MEMBER_VLAN_COUNT - 1);
+  rv = vlan_member_parse_value(value, &vlans.hdr);
+  if (rv != INDIGO_ERROR_NONE)
+  {
+    return rv;
+  }
+
+  return vlan_member_apply(member, &vlans.hdr);
+}
+
+static indigo_error_t vlan_member_gentable_delete(void *table_priv, void *entry_priv,
+                                                  of_list_bsn_tlv_t *key)
+{
+  ind_ofdpa_vlan_member_port_t *member = entry_priv;
+  aim_bitmap4096_t vlans;
+
+  AIM_BITMAP_INIT(&vlans, IND_OFDPA_VLAN_MEMBER_VLAN_COUNT - 1);
+  (void)vlan_member_apply(member, &vlans.hdr);
+
+  vlanMemberPorts--;
+  free(member);
+  return INDIGO_ERROR_NONE;
+}
+
+static void vlan_member_gentable_get_stats(void *table_priv, void *entry_priv,
+                                           of_list_bsn_tlv_t *key, of_list_bsn_tlv_t *stats)
+{
+}
+
+static const indigo_core_gentable_ops_t vlanMemberGentableOps =
+{
+  .add = vlan_member_gentable_add,
+  .modify = vlan_member_gentable_modify,
+  .del = vlan_member_gentable_delete,
+  .get_stats = vlan_member_gentable_get_stats,
+};
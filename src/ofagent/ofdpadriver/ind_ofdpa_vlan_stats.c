@@ -0,0 +1,243 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2014-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename   ind_ofdpa_vlan_stats.c
+*
+* @purpose    VLAN counters for the OF-DPA Driver
+*
+* @component  OF-DPA
+*
+* @comments   A VLAN is active while the VLAN flow table has a flow for
+*             it, either matching the tag or assigning it to untagged
+*             packets. The active VLANs are kept in a bitmap so that a
+*             bsn_vlan_counter request for all VLANs only covers those.
+*             The receive counters of a VLAN are the sum of the counters
+*             of its VLAN table flows, read from the flow counter cache,
+*             plus the final counters of the flows already deleted.
+*             OF-DPA does not count transmitted packets per VLAN.
+*
+* @create     15 Oct 2016
+*
+* @end
+*
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+#include <AIM/aim_list.h>
+#include <AIM/aim.h>
+#include <BigHash/bighash.h>
+
+#define IND_OFDPA_VLAN_COUNT 4096
+#define IND_OFDPA_VLAN_FLOW_BUCKETS 1024
+
+/* A VLAN table flow, by cookie and on the list of its VLAN */
+typedef struct ind_ofdpa_vlan_flow_s
+{
+  bighash_entry_t hash_entry;
+  uint64_t cookie;
+  list_links_t links;
+  uint16_t vlanId;
+} ind_ofdpa_vlan_flow_t;
+
+#define TEMPLATE_NAME vlan_flow_hashtable
+#define TEMPLATE_OBJ_TYPE ind_ofdpa_vlan_flow_t
+#define TEMPLATE_KEY_FIELD cookie
+#define TEMPLATE_ENTRY_FIELD hash_entry
+#include <BigHash/bighash_template.h>
+
+typedef struct
+{
+  list_head_t flows;
+  uint32_t flowCount;
+  uint64_t retiredPackets;      /* final counters of deleted flows */
+  uint64_t retiredBytes;
+} ind_ofdpa_vlan_t;
+
+static ind_ofdpa_vlan_t vlans[IND_OFDPA_VLAN_COUNT];
+static aim_bitmap4096_t activeVlans;
+static bighash_table_t *vlanFlowTable;
+
+/* VLAN a VLAN table flow counts for, 0 if none */
+static uint16_t vlan_stats_flow_vlan(const ofdpaFlowEntry_t *flow)
+{
+  const ofdpaVlanFlowEntry_t *entry = &flow->flowData.vlanFlowEntry;
+
+  if ((entry->match_criteria.vlanIdMask == (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK)) &&
+      (entry->match_criteria.vlanId & OFDPA_VID_PRESENT))
+  {
+    return entry->match_criteria.vlanId & OFDPA_VID_EXACT_MASK;
+  }
+  if (entry->setVlanIdAction)
+  {
+    return entry->newVlanId & OFDPA_VID_EXACT_MASK;
+  }
+  return 0;
+}
+
+indigo_error_t ind_ofdpa_vlan_stats_init(void)
+{
+  int i;
+
+  for (i = 0; i < IND_OFDPA_VLAN_COUNT; i++)
+  {
+    list_init(&vlans[i].flows);
+  }
+  AIM_BITMAP_INIT(&activeVlans, IND_OFDPA_VLAN_COUNT - 1);
+
+  vlanFlowTable = bighash_table_create(IND_OFDPA_VLAN_FLOW_BUCKETS);
+  if (vlanFlowTable == NULL)
+  {
+    LOG_ERROR("Failed to allocate VLAN flow table.");
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_vlan_stats_flow_added(const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_vlan_flow_t *entry;
+  uint16_t vlanId;
+
+  if ((vlanFlowTable == NULL) || (flow->tableId != OFDPA_FLOW_TABLE_ID_VLAN))
+  {
+    return;
+  }
+
+  vlanId = vlan_stats_flow_vlan(flow);
+  if ((vlanId == 0) || (vlan_flow_hashtable_first(vlanFlowTable, &flow->cookie) != NULL))
+  {
+    return;
+  }
+
+  entry = calloc(1, sizeof(*entry));
+  if (entry == NULL)
+  {
+    LOG_ERROR("Failed to track flow 0x%llx for VLAN %u.",
+              (unsigned long long)flow->cookie, vlanId);
+    return;
+  }
+  entry->cookie = flow->cookie;
+  entry->vlanId = vlanId;
+  vlan_flow_hashtable_insert(vlanFlowTable, entry);
+
+  list_push(&vlans[vlanId].flows, &entry->links);
+  if (vlans[vlanId].flowCount++ == 0)
+  {
+    aim_bitmap_set(&activeVlans.hdr, vlanId);
+  }
+}
+
+void ind_ofdpa_vlan_stats_flow_removed(uint64_t cookie,
+                                       const indigo_fi_flow_stats_t *flow_stats)
+{
+  ind_ofdpa_vlan_flow_t *entry;
+  ind_ofdpa_vlan_t *vlan;
+
+  if (vlanFlowTable == NULL)
+  {
+    return;
+  }
+
+  entry = vlan_flow_hashtable_first(vlanFlowTable, &cookie);
+  if (entry == NULL)
+  {
+    return;
+  }
+
+  vlan = &vlans[entry->vlanId];
+  vlan->retiredPackets += flow_stats->packets;
+  vlan->retiredBytes += flow_stats->bytes;
+
+  list_remove(&entry->links);
+  if (--vlan->flowCount == 0)
+  {
+    aim_bitmap_clr(&activeVlans.hdr, entry->vlanId);
+  }
+
+  bighash_remove(vlanFlowTable, &entry->hash_entry);
+  free(entry);
+}
+
+indigo_error_t indigo_fwd_vlan_active_get(aim_bitmap_hdr_t *vlan_bitmap)
+{
+  int i;
+
+  if (vlanFlowTable == NULL)
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  for (i = 0; (i < vlan_bitmap->wordcount) && (i < activeVlans.hdr.wordcount); i++)
+  {
+    vlan_bitmap->words[i] |= activeVlans.words[i];
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+void indigo_fwd_vlan_stats_get(uint16_t vlan_vid, indigo_fi_vlan_stats_t *vlan_stats)
+{
+  ind_ofdpa_vlan_t *vlan;
+  ind_ofdpa_vlan_flow_t *entry;
+  indigo_fi_flow_stats_t flowStats;
+  list_links_t *cur;
+  uint64_t packets, bytes;
+
+  if ((vlanFlowTable == NULL) || (vlan_vid == 0) || (vlan_vid >= IND_OFDPA_VLAN_COUNT))
+  {
+    return;
+  }
+
+  vlan = &vlans[vlan_vid];
+  if ((vlan->flowCount == 0) && (vlan->retiredPackets == 0) && (vlan->retiredBytes == 0))
+  {
+    return;
+  }
+
+  packets = vlan->retiredPackets;
+  bytes = vlan->retiredBytes;
+
+  /* Served by the flow counter cache when it is enabled */
+  LIST_FOREACH(&vlan->flows, cur)
+  {
+    entry = container_of(cur, links, ind_ofdpa_vlan_flow_t);
+    if (indigo_fwd_flow_stats_get(entry->cookie, &flowStats) == INDIGO_ERROR_NONE)
+    {
+      packets += flowStats.packets;
+      bytes += flowStats.bytes;
+    }
+  }
+
+  vlan_stats->rx_packets = packets;
+  vlan_stats->rx_bytes = bytes;
+}
+
+void ind_ofdpa_vlan_stats_show(void)
+{
+  if (vlanFlowTable == NULL)
+  {
+    return;
+  }
+
+  LOG_INFO("VLAN counters: %d active VLANs, %d VLAN table flows",
+           aim_bitmap_count(&activeVlans.hdr), bighash_entry_count(vlanFlowTable));
+}